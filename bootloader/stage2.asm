@@ -202,65 +202,44 @@ second_step:
 
     ; 4. Load the kernel into memory
 
+    ; The runs of contiguous clusters are read at once, each extended read
+    ; transfers at most 127 sectors
+    mov ax, 127
+    mov bl, [sectors_per_cluster]
+    div bl
+    xor ah, ah
+
+    ; A cluster larger than a transfer is still read at once
+    test ax, ax
+    jne .max_run_set
+    inc ax
+
+.max_run_set:
+    mov [max_run_clusters], ax
+
     mov ax, [cluster_high]
     test ax, ax
     jne cluster_too_high
 
     mov ax, [cluster_low]
     mov [current_cluster], ax
+    mov [run_start], ax
+    mov word [run_clusters], 1
     mov word [current_segment], KERNEL_BASE
 
 .next_cluster:
-    mov si, star
-    call print_16
-
-    mov di, [current_segment]
-    call print_int_16
-
-    mov si, star
-    call print_16
-
-    movzx ax, [sectors_per_cluster]
-    mov word [DAP.count], ax
-    mov word [DAP.offset], 0x0
-
-    mov ax, [current_segment]
-    mov [DAP.segment], ax
-
-    ; Compute LBA from current_cluster
-    mov ax, [current_cluster]
-    sub ax, 2
-    movzx bx, byte [sectors_per_cluster]
-    mul bx
-    mov bx, [cluster_begin]
-    add ax, bx
-
-    mov word [DAP.lba], ax
-
-    mov di, ax
-    call print_int_16
-
-    mov si, star
-    call print_16
-
-    mov di, [current_cluster]
-    call print_int_16
-
-    call extended_read
-
-    mov ax, [loaded_clusters]
-    inc ax
-    mov [loaded_clusters], ax
-
-    ; Compute next cluster
-
     ; Compute the sector of the FAT to read
     mov ax, [current_cluster]
-    shl ax, 2 ; current_cluster * 4
-    shr ax, 9 ; (current_cluster * 4) / 512
+    shr ax, 7 ; (current_cluster * 4) / 512
     mov bx, [fat_begin]
     add ax, bx ; fat_sector
 
+    ; The next clusters are usually in the same FAT sector
+    cmp ax, [fat_sector]
+    je .fat_loaded
+
+    mov [fat_sector], ax
+
     ; Read the FAT sector
     mov word [DAP.count], 1
     mov word [DAP.offset], FREE_BASE
@@ -269,8 +248,9 @@ second_step:
 
     call extended_read
 
+.fat_loaded:
     mov si, [current_cluster]
-    and si, 512 - 1 ; current_cluster % 512
+    and si, 128 - 1 ; current_cluster % 128 (entries per FAT sector)
     shl si, 2
 
     ; cluster low
@@ -291,17 +271,36 @@ second_step:
     test bx, bx
     jne cluster_too_high
 
+    mov cx, [current_cluster]
     mov [current_cluster], ax
 
-    movzx ax, byte [sectors_per_cluster]
-    shl ax, 5
-    mov bx, [current_segment]
-    add ax, bx
-    mov [current_segment], ax
+    ; Extend the run if the next cluster follows it and the run still
+    ; fits in one transfer
+    inc cx
+    cmp ax, cx
+    jne .new_run
+
+    mov cx, [run_clusters]
+    cmp cx, [max_run_clusters]
+    jae .new_run
+
+    inc cx
+    mov [run_clusters], cx
+
+    jmp .next_cluster
+
+.new_run:
+    call read_run
+
+    mov ax, [current_cluster]
+    mov [run_start], ax
+    mov word [run_clusters], 1
 
     jmp .next_cluster
 
 .fully_loaded:
+    call read_run
+
     call new_line_16
 
     mov di, [loaded_clusters]
@@ -317,6 +316,59 @@ second_step:
 
     jmp $
 
+; Read the run_clusters clusters starting at run_start to current_segment
+; with a single extended read, then move current_segment after them
+read_run:
+    mov si, star
+    call print_16
+
+    mov di, [current_segment]
+    call print_int_16
+
+    mov si, star
+    call print_16
+
+    ; At most 127 sectors, or a single cluster
+    movzx ax, byte [sectors_per_cluster]
+    mul word [run_clusters]
+    mov word [DAP.count], ax
+    mov word [DAP.offset], 0x0
+
+    mov bx, [current_segment]
+    mov [DAP.segment], bx
+
+    ; The next run is loaded after this one (512 / 16 paragraphs per sector)
+    shl ax, 5
+    add ax, bx
+    mov [current_segment], ax
+
+    ; Compute LBA from run_start
+    mov ax, [run_start]
+    sub ax, 2
+    movzx bx, byte [sectors_per_cluster]
+    mul bx
+    mov bx, [cluster_begin]
+    add ax, bx
+
+    mov word [DAP.lba], ax
+
+    mov di, ax
+    call print_int_16
+
+    mov si, star
+    call print_16
+
+    mov di, [run_clusters]
+    call print_int_16
+
+    call extended_read
+
+    mov ax, [loaded_clusters]
+    add ax, [run_clusters]
+    mov [loaded_clusters], ax
+
+    ret
+
 cluster_too_high:
     mov si, cluster_too_high_msg
     call print_line_16
@@ -363,6 +415,11 @@ error_end:
     current_cluster dw 0
     current_segment dw 0
 
+    run_start dw 0
+    run_clusters dw 0
+    max_run_clusters dw 0
+    fat_sector dw 0xFFFF
+
     loaded_clusters dw 0
 
 ; Constant Datas
@@ -396,7 +396,7 @@ gdt::gdt_descriptor_t user_data_descriptor(){
 }
 
 //TODO On some machines, this should be aligned to 16 bits
-gdt::gdt_descriptor_t gdt[8];
+gdt::gdt_descriptor_t gdt[9];
 
 gdt::gdt_ptr gdtr;
 
@@ -408,13 +408,14 @@ void setup_gdt(){
     gdt[3] = code_64_descriptor();
     gdt[4] = user_code_64_descriptor();
     gdt[5] = user_data_descriptor();
+    gdt[6] = user_code_64_descriptor(); // SYSRET needs the user code right after the user data
 
     //2. Init TSS Descriptor
 
     uint32_t base = early::tss_address;
     uint32_t limit = base + sizeof(gdt::task_state_segment_t);
 
-    auto tss_selector = reinterpret_cast<gdt::tss_descriptor_t*>(&gdt[6]);
+    auto tss_selector = reinterpret_cast<gdt::tss_descriptor_t*>(&gdt[7]);
     tss_selector->type = gdt::SEG_TSS_AVAILABLE;
     tss_selector->always_0_1 = 0;
     tss_selector->always_0_2 = 0;
@@ -13,6 +13,7 @@
 #include "boot_32.hpp"
 #include "kernel.hpp"
 #include "early_memory.hpp"
+#include "kernel_image.hpp"
 #include "virtual_debug.hpp"
 #include "drivers/ata_constants.hpp"
 
@@ -318,6 +319,61 @@ void suspend_init(const char* message){
     __builtin_unreachable();
 }
 
+// The number of MiB needed to hold the given number of bytes
+uint32_t size_to_mib(uint32_t size){
+    return (size + 0xFFFFF) / 0x100000;
+}
+
+// Decompress the LZ4 block to the destination, the matches are copied
+// byte by byte since they can overlap their own output
+uint32_t lz4_decompress(const uint8_t* source, uint32_t size, uint8_t* destination){
+    auto end = source + size;
+    auto out = destination;
+
+    while(source < end){
+        auto token = *source++;
+
+        uint32_t literals = token >> 4;
+        if(literals == 15){
+            uint8_t extra;
+            do {
+                extra = *source++;
+                literals += extra;
+            } while(extra == 255);
+        }
+
+        for(uint32_t i = 0; i < literals; ++i){
+            *out++ = *source++;
+        }
+
+        // The last sequence has no match
+        if(source >= end){
+            break;
+        }
+
+        uint32_t offset = source[0] | (uint32_t(source[1]) << 8);
+        source += 2;
+
+        uint32_t length = token & 0xF;
+        if(length == 15){
+            uint8_t extra;
+            do {
+                extra = *source++;
+                length += extra;
+            } while(extra == 255);
+        }
+
+        length += 4;
+
+        auto match = out - offset;
+        for(uint32_t i = 0; i < length; ++i){
+            *out++ = *match++;
+        }
+    }
+
+    return out - destination;
+}
+
 void detect_disks(){
     // Disable all interrupts
     out_byte(ATA_PRIMARY + ATA_DEV_CTL, ATA_CTL_nIEN);
@@ -412,12 +468,33 @@ void detect_disks(){
     virtual_debug_var("kernel_cluster_first: ", kernel_cluster);
     virtual_debug_var("kernel_size: ", kernel_size);
 
-    auto kernel_mib = kernel_size / 0x100000 + kernel_size % 0x100000 == 0 ? 0 : 1;
+    // The header of a compressed image is in its first sector
+    auto first_lba = (kernel_cluster - 2) * sectors_per_cluster + cluster_begin;
+    if(!read_sector(first_lba, block_buffer)){
+        suspend_init("Unable to read the kernel header");
+    }
+
+    auto header = *reinterpret_cast<kernel_image::lz4_header*>(block_buffer);
+    bool compressed = header.magic == kernel_image::LZ4_MAGIC;
+
+    auto kernel_mib = size_to_mib(compressed ? header.size : kernel_size);
     early::kernel_mib(kernel_mib);
 
-    setup_kernel_paging(kernel_mib);
+    // A compressed image is loaded right after the memory of the kernel,
+    // then unpacked to its address
+    auto load_address = early::kernel_address;
+    uint32_t image_mib = 0;
 
-    auto current_address = early::kernel_address;
+    if(compressed){
+        load_address += kernel_mib * 0x100000;
+        image_mib = size_to_mib(kernel_size);
+
+        virtual_debug_var("kernel_compressed_size: ", header.compressed_size);
+    }
+
+    setup_kernel_paging(kernel_mib + image_mib);
+
+    auto current_address = load_address;
     uint16_t clusters_read = 0;
 
     while(true){
@@ -458,6 +535,17 @@ void detect_disks(){
         current_address += 512 * sectors_per_cluster;
     }
 
+    if(compressed){
+        auto payload = reinterpret_cast<const uint8_t*>(load_address + sizeof(kernel_image::lz4_header));
+        auto size = lz4_decompress(payload, header.compressed_size, reinterpret_cast<uint8_t*>(early::kernel_address));
+
+        if(size != header.size){
+            suspend_init("Invalid compressed kernel");
+        }
+
+        virtual_debug_var("kernel_decompressed_size: ", size);
+    }
+
     virtual_debug_var("Number of clusters read for kernel: ", clusters_read);
 
     // Reset interrupt status
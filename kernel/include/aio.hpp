@@ -0,0 +1,60 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef AIO_H
+#define AIO_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "process.hpp"
+
+namespace aio {
+
+/*!
+ * \brief Start the asynchronous I/O workers
+ */
+void finalize();
+
+/*!
+ * \brief Submit a read of the given file, executed in the background
+ * \param fd The file descriptor
+ * \param buffer The buffer into which to read, filled when the completion is collected
+ * \param count The number of bytes to read
+ * \param offset The offset at which to start reading
+ * \return the token of the request
+ */
+std::expected<size_t> read(size_t fd, char* buffer, size_t count, size_t offset);
+
+/*!
+ * \brief Submit a write to the given file, executed in the background. The
+ * buffer can be reused as soon as the request is submitted.
+ * \param fd The file descriptor
+ * \param buffer The buffer to write
+ * \param count The number of bytes to write
+ * \param offset The offset at which to start writing
+ * \return the token of the request
+ */
+std::expected<size_t> write(size_t fd, const char* buffer, size_t count, size_t offset);
+
+/*!
+ * \brief Wait for the completion of any request of the current process
+ * \param result Output reference to the number of bytes transferred, or the
+ * negated error code of the request
+ * \param ms The maximum time to wait, in milliseconds, 0 to wait indefinitely
+ * \return the token of the completed request
+ */
+std::expected<size_t> wait(int64_t& result, size_t ms);
+
+/*!
+ * \brief Release the requests of a terminated process
+ */
+void release(scheduler::pid_t pid);
+
+} //end of namespace aio
+
+#endif
@@ -0,0 +1,62 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef ALLOC_PROFILE_H
+#define ALLOC_PROFILE_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include <tlib/alloc_profile.hpp>
+
+namespace scheduler {
+
+struct process_t;
+
+} // end of namespace scheduler
+
+/*!
+ * \brief Sampling profiler of the kernel heap.
+ *
+ * One allocation out of tlib::ALLOC_PROFILE_PERIOD is sampled. The live
+ * bytes of the sampled blocks are aggregated by call site.
+ */
+namespace alloc_profile {
+
+/*!
+ * \brief Register the profile in sysfs
+ */
+void finalize();
+
+/*!
+ * \brief Let the profiler know of a new block
+ * \param block The allocated block
+ * \param size The requested size
+ * \param caller The return address of the allocation call
+ */
+void allocated(void* block, size_t size, void* caller);
+
+/*!
+ * \brief Let the profiler know that a block is going to be freed
+ */
+void freed(void* block);
+
+/*!
+ * \brief Format the given sites as a table, the sites with the most live
+ * bytes first. The sizes are estimated from the samples.
+ */
+std::string format(const tlib::alloc_site* table, size_t count, size_t period);
+
+/*!
+ * \brief Format the allocation profile registered by the given process
+ * \return The table, an empty string if the process has no profile
+ */
+std::string format(const scheduler::process_t& process);
+
+} //end of namespace alloc_profile
+
+#endif
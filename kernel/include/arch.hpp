@@ -10,10 +10,20 @@
 
 #include <types.hpp>
 
+#include "tlb_shootdown.hpp"
+
 namespace arch {
 
 void enable_sse();
 
+/*!
+ * \brief Prevent the kernel from writing to the read-only pages (CR0.WP), so
+ * that its writes to the copy-on-write pages fault as well
+ */
+inline void enable_write_protect(){
+    asm volatile("mov rax, cr0; or rax, 1 << 16; mov cr0, rax" ::: "rax", "memory");
+}
+
 inline size_t get_rflags(){
     size_t rflags;
     asm volatile("pushfq; pop %0;" : "=g" (rflags));
@@ -33,6 +43,81 @@ inline bool interrupts_enabled(){
     return flags & 0x200;
 }
 
+inline uint64_t read_msr(uint32_t msr){
+    uint32_t low;
+    uint32_t high;
+    asm volatile("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+inline void write_msr(uint32_t msr, uint64_t value){
+    asm volatile("wrmsr" : : "c" (msr), "a" (static_cast<uint32_t>(value)), "d" (static_cast<uint32_t>(value >> 32)));
+}
+
+/*!
+ * \brief Pause in a spinning loop.
+ *
+ * The loop may spin with the interrupts disabled while the processor it
+ * waits for waits itself for a TLB shootdown, the requests are handled at
+ * each pause to avoid the deadlock.
+ */
+inline void pause(){
+    tlb_shootdown::poll();
+
+    asm volatile("pause");
+}
+
+/*!
+ * \brief Execute the CPUID instruction for the given leaf
+ */
+inline void cpuid(uint32_t key, uint32_t& eax, uint32_t& ebx, uint32_t& ecx, uint32_t& edx){
+    // ecx is the subleaf of some leaves
+    asm volatile("cpuid"
+        : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+        : "a" (key), "c" (0));
+}
+
+/*!
+ * \brief Returns the value of the time stamp counter
+ */
+inline uint64_t rdtsc(){
+    uint32_t low;
+    uint32_t high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+/*!
+ * \brief Read a random value from the hardware generator, the processor
+ * must support RDRAND
+ * \return true if a value has been read, false if the generator had none ready
+ */
+inline bool rdrand(uint64_t& value){
+    uint8_t ok;
+    asm volatile("rdrand %0; setc %1" : "=r" (value), "=qm" (ok) : : "cc");
+    return ok;
+}
+
+inline uint32_t get_mxcsr(){
+    uint32_t mxcsr;
+    asm volatile("stmxcsr %0" : "=m" (mxcsr));
+    return mxcsr;
+}
+
+inline void set_mxcsr(uint32_t mxcsr){
+    asm volatile("ldmxcsr %0" : : "m" (mxcsr));
+}
+
+inline uint16_t get_fpu_control(){
+    uint16_t control;
+    asm volatile("fnstcw %0" : "=m" (control));
+    return control;
+}
+
+inline void set_fpu_control(uint16_t control){
+    asm volatile("fldcw %0" : : "m" (control));
+}
+
 } //enf of arch namespace
 
 #endif
@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <types.hpp>
+#include <allocator.hpp>
+
+/*!
+ * \brief Bump allocation of the temporaries of a system call.
+ *
+ * Each user process has a small arena, emptied when it returns from a system
+ * call. The allocations are served from the arena only inside a scope, so
+ * that the objects outliving the system call are never allocated from it.
+ */
+namespace arena {
+
+constexpr const size_t size = 4096; ///< The size of the arena of a process
+
+/*!
+ * \brief The arena of a process
+ */
+struct syscall_arena {
+    char* buffer; ///< The storage, allocated on first use
+    size_t used;  ///< The number of used bytes
+    size_t depth; ///< The number of open scopes
+};
+
+/*!
+ * \brief Make the given arena empty, keeping its storage
+ */
+void init(syscall_arena& arena);
+
+/*!
+ * \brief Allocate from the arena of the current process
+ * \return The storage, nullptr if there is no open scope or no more room
+ */
+void* allocate(size_t bytes);
+
+/*!
+ * \brief Returns true if the block comes from the arena of the current process
+ */
+bool owns(const void* block);
+
+/*!
+ * \brief Give back a block of the arena. Only the last block is reused
+ * before the arena is emptied.
+ */
+void release(void* block, size_t bytes);
+
+/*!
+ * \brief Empty the arena of the current process, at the end of a system call
+ */
+void reset();
+
+/*!
+ * \brief Enables the arena of the current process during its lifetime.
+ *
+ * Only the temporaries which do not outlive the system call must be
+ * allocated inside a scope.
+ */
+struct scope {
+    scope();
+    ~scope();
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+};
+
+/*!
+ * \brief An allocator serving the containers from the arena of the current
+ * process inside a scope and from the heap otherwise.
+ */
+template<typename T>
+struct allocator {
+    using value_type = T; ///< The type of the allocated elements
+
+    /*!
+     * \brief The same allocator for another type of elements
+     */
+    template<typename U>
+    struct rebind {
+        using other = allocator<U>; ///< The rebound allocator
+    };
+
+    static T* allocate(size_t n){
+        auto block = arena::allocate(n * sizeof(T));
+
+        if(block){
+            return reinterpret_cast<T*>(block);
+        }
+
+        return std::heap_allocator<T>::allocate(n);
+    }
+
+    static void deallocate(T* ptr, size_t n){
+        if(arena::owns(ptr)){
+            arena::release(ptr, n * sizeof(T));
+        } else {
+            std::heap_allocator<T>::deallocate(ptr, n);
+        }
+    }
+};
+
+} //end of namespace arena
+
+#endif
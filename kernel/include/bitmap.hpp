@@ -99,6 +99,52 @@ struct static_bitmap {
         thor_unreachable("static_bitmap has no free word");
     }
 
+    /*!
+     * \brief Indicates if at least one bit is set
+     */
+    bool any_bit() const {
+        for(size_t w = 0; w < words; ++w){
+            if(data[w]){
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Indicates if at least one word is completely set
+     */
+    bool any_word() const {
+        for(size_t w = 0; w < words; ++w){
+            if(data[w] == ~static_cast<data_type>(0)){
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Returns the number of set bits
+     */
+    size_t count() const {
+        size_t count = 0;
+
+        for(size_t w = 0; w < words; ++w){
+            count += __builtin_popcountll(data[w]);
+        }
+
+        return count;
+    }
+
+    /*!
+     * \brief Returns the number of bits of the bit map
+     */
+    size_t size() const {
+        return words * bits_per_word;
+    }
+
     /*!
      * \brief Indicates if the given bit is set
      */
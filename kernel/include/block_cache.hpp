@@ -9,20 +9,77 @@
 #define BLOCK_CACHE_HPP
 
 #include <types.hpp>
+#include <string.hpp>
 
 /*!
- * \brief A block in the block cache
+ * \brief A block in the block cache, followed by its payload
  */
 struct block_t {
-    uint64_t key; ///< The key of the block
+    uint64_t key;       ///< The key of the block
     block_t* hash_next; ///< The next block in the hash map bucket
-    block_t* free_next; ///< The next block in the free list
-    block_t* free_prev; ///< The previous block in the free list
-    char payload; ///< The start of the payload
-} __attribute__((packed));
+    block_t* next;      ///< The next (older) block in its queue
+    block_t* prev;      ///< The previous (newer) block in its queue
+    uint32_t queue;     ///< The queue holding the block
+    uint32_t dirty;     ///< Indicates if the block must be written back
+    uint64_t dirty_since; ///< The time (in milliseconds) the block became dirty
+};
+
+/*!
+ * \brief The key of a block recently evicted from the cache
+ */
+struct ghost_t {
+    uint64_t key;       ///< The key of the evicted block
+    ghost_t* hash_next; ///< The next ghost in the hash map bucket
+    ghost_t* next;      ///< The next (older) ghost in its queue
+    ghost_t* prev;      ///< The previous (newer) ghost in its queue
+};
+
+/*!
+ * \brief A queue of blocks, the most recent first
+ */
+template<typename T>
+struct block_queue {
+    T* head;     ///< The most recent element
+    T* tail;     ///< The oldest element
+    size_t size; ///< The number of elements
+};
 
 /*!
- * \brief A cache for I/O blocks
+ * \brief A chained hash table of blocks, with a power of two number of buckets.
+ *
+ * When the table is resized, the elements of the previous table are moved
+ * a few buckets at a time, the lookups search both tables meanwhile.
+ */
+template<typename T>
+struct block_hash {
+    T** table;       ///< The buckets
+    size_t bits;     ///< The log2 of the number of buckets
+    T** old_table;   ///< The buckets of the table being migrated, or nullptr
+    size_t old_bits; ///< The log2 of the number of buckets of the old table
+    size_t migrated; ///< The number of buckets of the old table already moved
+};
+
+/*!
+ * \brief The function writing back consecutive dirty blocks
+ * \param data The data given to set_writer
+ * \param device The device of the blocks
+ * \param sector The first sector of the blocks
+ * \param buffer The payloads of the blocks
+ * \param blocks The number of blocks
+ * \return true if the blocks were written, false otherwise
+ */
+using block_writer = bool (*)(void* data, uint16_t device, uint64_t sector, const char* buffer, size_t blocks);
+
+/*!
+ * \brief A cache for I/O blocks, with a 2Q replacement policy.
+ *
+ * The blocks accessed for the first time go to a small FIFO queue. Only the
+ * blocks accessed again after being evicted from this queue, which are
+ * remembered by key, are promoted to the main LRU queue. A sequential scan
+ * only goes through the FIFO queue and does not flush the hot blocks.
+ *
+ * When a writer is set, the blocks can be marked dirty and are written back
+ * when they are evicted or flushed. The cache is not synchronized.
  */
 struct block_cache {
     /*!
@@ -32,6 +89,53 @@ struct block_cache {
      */
     void init(uint64_t payload_size, uint64_t blocks);
 
+    /*!
+     * \brief Change the number of blocks of the cache. When it shrinks, the
+     * blocks are evicted and the dirty ones are written back.
+     * \return true if the cache has the new capacity, false otherwise
+     */
+    bool resize(uint64_t blocks);
+
+    /*!
+     * \brief Export the size and the statistics of the cache in sysfs,
+     * in /sys/block_cache/<name>/
+     */
+    void export_stats(const std::string& name);
+
+    /*!
+     * \brief Set the function writing back the dirty blocks
+     * \param max_blocks The maximum number of blocks of a single write
+     */
+    void set_writer(block_writer writer, void* data, size_t max_blocks);
+
+    /*!
+     * \brief Mark the block at the given position, which must be in cache, dirty
+     */
+    void mark_dirty(uint16_t device, uint64_t sector);
+
+    /*!
+     * \brief Write back the blocks that became dirty at or before the given
+     * time. The adjacent dirty blocks are written together.
+     * \return true if all the blocks were written, false otherwise
+     */
+    bool flush(uint64_t deadline);
+
+    /*!
+     * \brief Returns the number of dirty blocks
+     */
+    uint64_t dirty_blocks() const;
+
+    /*!
+     * \brief Returns the number of blocks of the cache
+     */
+    uint64_t capacity() const;
+
+    /*!
+     * \brief Indicates if the block at the given position is in cache, without
+     * accessing it
+     */
+    bool contains(uint16_t device, uint64_t sector) const;
+
     /*!
      * \brief Returns the block at the given position if it exists
      * \return the block payload address if there is a block,nullptr otherwise
@@ -58,16 +162,51 @@ struct block_cache {
      */
     char* block(uint64_t key, bool& valid);
 
+    /*!
+     * \brief Returns the histogram of the chain lengths of the hash tables
+     */
+    std::string chain_stats() const;
+
+    uint64_t hits;       ///< The number of accesses to cached blocks
+    uint64_t misses;     ///< The number of blocks read into the cache
+    uint64_t evictions;  ///< The number of blocks evicted for another
+    uint64_t promotions; ///< The number of blocks admitted in the main queue
+    uint64_t writebacks; ///< The number of dirty blocks written back
+
 private:
+    block_t* find(uint64_t key) const;
+    block_t* reclaim();
+    block_t* evict();
+    void release(block_t* block);
+    bool owned(const block_t* block) const;
+    void remember(uint64_t key);
+    void touch(block_t* block);
+    bool selected(const block_t* block, uint64_t deadline) const;
+    bool write_back(uint64_t key, uint64_t deadline);
+
     uint64_t payload_size; ///< The size of each blocks
     uint64_t blocks; ///< The number of blocks to cache
+    uint64_t allocated;  ///< The number of blocks in memory, used or free
+    uint64_t in_blocks;  ///< The maximum size of the FIFO queue
+    uint64_t ghosts;     ///< The number of evicted keys remembered
+    uint64_t dirty;      ///< The number of dirty blocks
+
+    block_writer writer; ///< The function writing back the dirty blocks
+    void* writer_data;   ///< The data of the writer
+    size_t max_run;      ///< The maximum number of blocks written together
+    char* run_buffer;    ///< The buffer of the written blocks
 
-    void* blocks_memory; ///< The memory holding the blocks
+    void* blocks_memory; ///< The memory holding the initial blocks
+    uint64_t initial_blocks; ///< The number of blocks in blocks_memory
 
-    block_t** hash_table; ///< Pointer to the hash table
+    block_hash<block_t> hash_table;  ///< The hash table of the blocks
+    block_hash<ghost_t> ghost_table; ///< The hash table of the ghosts
 
-    block_t* front; ///< The head of the free list
-    block_t* rear;  ///< The tail of the free list
+    block_queue<block_t> free_queue; ///< The unused blocks
+    block_queue<block_t> in_queue;   ///< The FIFO queue of the blocks accessed once
+    block_queue<block_t> main_queue; ///< The LRU queue of the hot blocks
+    block_queue<ghost_t> out_queue;  ///< The FIFO queue of the evicted keys
+    block_queue<ghost_t> free_ghosts; ///< The unused ghosts
 };
 
 #endif
@@ -0,0 +1,46 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+/*!
+ * \brief The trace of the phases of the boot.
+ *
+ * The phases are timestamped with the time stamp counter, which runs
+ * before any timer is installed and does not change source during the
+ * boot. They are converted in microseconds once the TSC is calibrated.
+ */
+namespace boot_trace {
+
+constexpr const size_t MAX_PHASES = 64; ///< The maximum number of recorded phases
+
+/*!
+ * \brief Returns the current timestamp of the trace
+ */
+uint64_t now();
+
+/*!
+ * \brief Record a phase of the boot that ran between the two timestamps.
+ *
+ * The name must stay valid, it is not copied.
+ */
+void record(const char* name, uint64_t start, uint64_t end);
+
+/*!
+ * \brief Returns the recorded phases, one line each, in the order they
+ * finished: start duration pid name, the times in microseconds since
+ * the first phase, or in cycles if the TSC is not calibrated.
+ */
+std::string format();
+
+} //end of namespace boot_trace
+
+#endif
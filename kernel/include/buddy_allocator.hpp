@@ -63,6 +63,29 @@ public:
         for(auto& bitmap : bitmaps){
             bitmap.set_all();
         }
+
+        //The blocks past the end of the range can never be allocated
+        for(size_t l = 0; l < levels; ++l){
+            for(size_t i = blocks(l); i < bitmaps[l].size(); ++i){
+                bitmaps[l].unset(i);
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns the number of blocks of the given level inside the range
+     */
+    size_t blocks(size_t l) const {
+        return (last_address - first_address) / (level_size(l) * Unit);
+    }
+
+    /*!
+     * \brief Returns the number of free blocks of the given level.
+     *
+     * A free block is counted at each level it could be allocated from.
+     */
+    size_t free_blocks(size_t l) const {
+        return bitmaps[l].count();
     }
 
     /*!
@@ -77,10 +100,15 @@ public:
             } else {
                 // Select a level for which a whole word can hold the necessary pages
                 auto l = word_level(pages);
+
+                if(!bitmaps[l].any_word()){
+                    return 0;
+                }
+
                 auto index = bitmaps[l].set_word();
                 auto address = block_start(l, index);
 
-                if(address + level_size(l) >= last_address){
+                if(address + level_size(l) * Unit * static_bitmap::bits_per_word > last_address){
                     logging::logf(logging::log_level::ERROR, "buddy: Address too high level:%u index:%u address:%h\n", l, index, address);
                     return 0;
                 }
@@ -94,10 +122,15 @@ public:
             }
         } else {
             auto l = level(pages);
+
+            if(!bitmaps[l].any_bit()){
+                return 0;
+            }
+
             auto index = bitmaps[l].set_bit();
             auto address = block_start(l, index);
 
-            if(address + level_size(l) >= last_address){
+            if(address + level_size(l) * Unit > last_address){
                 logging::logf(logging::log_level::ERROR, "buddy: Address too high pages:%u level:%u index:%u address:%h\n", pages, l, index, address);
                 return 0;
             }
@@ -119,7 +152,7 @@ public:
                 logging::logf(logging::log_level::ERROR, "buddy: Impossible to free more than 33M block:%u\n", pages);
                 //TODO Implement larger allocation
             } else {
-                auto l = level(pages);
+                auto l = word_level(pages);
                 auto index = get_block_index(address, l);
 
                 //Mark all bits of the word as free
@@ -0,0 +1,61 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <types.hpp>
+
+/*!
+ * \brief The nanosecond monotonic clock.
+ *
+ * The clock uses the invariant time stamp counter once it has been
+ * calibrated against the timer counter (HPET or PIT), and the timer
+ * counter itself before or when the processor has no invariant TSC.
+ */
+namespace clocksource {
+
+/*!
+ * \brief Detect the invariant TSC and calibrate it against the counter
+ * of the timer, which must not change afterwards
+ */
+void init();
+
+/*!
+ * \brief Returns the nanoseconds since boot
+ */
+uint64_t nanoseconds();
+
+/*!
+ * \brief Indicates if the clock is using the time stamp counter
+ */
+bool tsc();
+
+/*!
+ * \brief Returns the calibrated frequency of the time stamp counter, 0
+ * if it is not used
+ */
+uint64_t tsc_frequency();
+
+/*!
+ * \brief The parameters to convert a TSC value in nanoseconds:
+ * nanoseconds + ((tsc - base) * mult) >> 32
+ */
+struct tsc_conversion {
+    uint64_t base;        ///< The TSC at the calibration
+    uint64_t nanoseconds; ///< The nanoseconds at the calibration
+    uint64_t mult;        ///< The nanoseconds per cycle, in 32.32 fixed point, 0 if the TSC is not used
+};
+
+/*!
+ * \brief Returns the parameters of the TSC conversion, for the time page
+ */
+tsc_conversion conversion();
+
+} //end of namespace clocksource
+
+#endif
@@ -0,0 +1,109 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef ADAPTIVE_MUTEX_H
+#define ADAPTIVE_MUTEX_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include "conc/spinlock.hpp"
+#include "conc/wait_list.hpp"
+
+#ifdef THOR_CONFIG_LOCK_STAT
+#include "conc/lock_stat.hpp"
+#endif
+
+/*!
+ * \brief A mutex spinning while its owner is running.
+ *
+ * When the mutex is taken by a process running on another processor, it
+ * is likely to be released soon, so the waiter spins for a while before
+ * sleeping in the wait list like mutex. If the owner is not running, the
+ * waiter sleeps right away.
+ */
+struct adaptive_mutex {
+    static constexpr size_t max_spins = 64; ///< The number of waits of a spinning acquisition
+
+    /*!
+     * \brief The spinning statistics of the mutex
+     */
+    struct statistics {
+        volatile uint64_t spins = 0;          ///< The acquisitions that had to spin
+        volatile uint64_t spin_successes = 0; ///< The acquisitions obtained by spinning
+        volatile uint64_t blocks = 0;         ///< The acquisitions that had to sleep
+    };
+
+    /*!
+     * \brief Initialize the mutex, free
+     */
+    void init(){
+        value = 1;
+        owner = NO_OWNER;
+    }
+
+    /*!
+     * \brief Acquire the lock
+     */
+    void lock();
+
+    /*!
+     * \brief Try to acquire the lock.
+     *
+     * This function returns immediately.
+     *
+     * \return true if the lock was acquired, false otherwise.
+     */
+    bool try_lock();
+
+    /*!
+     * \brief Release the lock, the first waiter gets it
+     */
+    void unlock();
+
+    /*!
+     * \brief Name the mutex in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
+    }
+
+    /*!
+     * \brief Returns the spinning statistics of the mutex
+     */
+    const statistics& get_statistics() const {
+        return counters;
+    }
+
+    /*!
+     * \brief Export the spinning statistics in /sys/adaptive_mutex/name/
+     */
+    void export_stats(const std::string& name);
+
+private:
+    static constexpr size_t NO_OWNER = ~size_t(0); ///< The owner of a free mutex
+
+    bool acquire();
+    void acquired(bool contended, uint64_t start);
+
+    mutable spinlock value_lock;      ///< The spin protecting the value and the queue
+    volatile size_t value = 1;        ///< The value of the mutex
+    volatile size_t owner = NO_OWNER; ///< The pid of the owner of the mutex
+    wait_list queue;                  ///< The sleep queue
+    statistics counters;              ///< The spinning statistics
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the mutex, if named
+    uint64_t acquired_at;                   ///< The cycle of the last acquisition
+#endif
+};
+
+#endif
@@ -0,0 +1,50 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <types.hpp>
+
+#include "arch.hpp"
+
+/*!
+ * \brief An exponential backoff for the spinning loops.
+ *
+ * Each wait doubles the number of pause instructions, up to a maximum, so
+ * that the contending processors stop hammering the same cache line.
+ */
+struct backoff {
+    static constexpr size_t max_delay = 1024; ///< The maximum number of pauses of a wait
+
+    /*!
+     * \brief Wait for some time and increase the next wait
+     */
+    void wait(){
+        for(size_t i = 0; i < delay; ++i){
+            arch::pause();
+        }
+
+        if(delay < max_delay){
+            delay *= 2;
+        }
+    }
+
+    /*!
+     * \brief Wait for a number of pauses, without changing the next wait
+     */
+    static void wait(size_t pauses){
+        for(size_t i = 0; i < pauses; ++i){
+            arch::pause();
+        }
+    }
+
+private:
+    size_t delay = 1; ///< The pauses of the next wait
+};
+
+#endif
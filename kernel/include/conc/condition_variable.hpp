@@ -13,8 +13,14 @@
 
 #include "process.hpp"
 
+struct mutex;
+
 /*!
  * \brief A simple sleep queue
+ *
+ * When the waiters relock a mutex once woken up, the notifications under
+ * this mutex move them directly to the queue of the mutex instead of
+ * waking them up only for them to block again on the mutex.
  */
 struct condition_variable {
     /*!
@@ -39,11 +45,38 @@ struct condition_variable {
      */
     void notify_all();
 
+    /*!
+     * \brief Wake up the first process from the queue, the caller holding
+     * the given mutex.
+     *
+     * If the process waits with this mutex, it is moved to the queue of the
+     * mutex and only woken up once it obtained it.
+     */
+    scheduler::pid_t notify_one(mutex& m);
+
+    /*!
+     * \brief Wake up all the processes from the queue, the caller holding
+     * the given mutex.
+     *
+     * The processes waiting with this mutex are moved to its queue and woken
+     * up one at a time, as the mutex is released.
+     */
+    void notify_all(mutex& m);
+
     /*!
      * \brief Wait inside the queue until woken up.
      */
     void wait();
 
+    /*!
+     * \brief Release the mutex and wait inside the queue until woken up,
+     * the mutex is held again on return.
+     *
+     * The mutex is released once the process is in the queue, no notification
+     * can be missed.
+     */
+    void wait(mutex& m);
+
     /*!
      * \brief Wait inside the queue until woken up or until the
      * timeout is passed.
@@ -53,6 +86,8 @@ struct condition_variable {
     bool wait_for(size_t ms);
 
 private:
+    void wake(wait_node& node, mutex& m);
+
     mutable spinlock lock; ///< The spin lock used for protecting the queue
     wait_list queue;       ///< The queue of waiting threads
 };
@@ -12,26 +12,52 @@
 
 #include "arch.hpp"
 
+#ifdef THOR_CONFIG_IRQ_STAT
+#include "interrupts.hpp"
+#endif
+
 /*!
  * \brief An interrupt lock. This lock disable preemption on acquire.
+ *
+ * With THOR_CONFIG_IRQ_STAT, the outermost lock of a processor measures
+ * how long the interrupts stay disabled, attributed to its call site.
  */
 struct int_lock {
     /*!
      * \brief Acquire the lock. This will disable preemption.
      */
-    void lock() {
+    __attribute__((always_inline)) void lock() {
         arch::disable_hwint(rflags);
+
+#ifdef THOR_CONFIG_IRQ_STAT
+        // Nested locks are part of the section of the outermost one
+        if(rflags & 0x200){
+            asm volatile("lea %0, [rip]" : "=r" (site));
+            start = arch::rdtsc();
+        }
+#endif
     }
 
     /*!
      * \brief Release the lock. This will enable preemption.
      */
     void unlock() {
+#ifdef THOR_CONFIG_IRQ_STAT
+        if(rflags & 0x200){
+            interrupt::irqs_off(site, start);
+        }
+#endif
+
         arch::enable_hwint(rflags);
     }
 
 private:
     size_t rflags; ///< The CPU flags
+
+#ifdef THOR_CONFIG_IRQ_STAT
+    uintptr_t site; ///< The address of the acquisition
+    uint64_t start; ///< The cycle of the acquisition
+#endif
 };
 
 /*!
@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef INT_SPINLOCK_HPP
+#define INT_SPINLOCK_HPP
+
+#include <types.hpp>
+
+#include "conc/int_lock.hpp"
+#include "conc/spinlock.hpp"
+#include "conc/ticket_spinlock.hpp"
+
+/*!
+ * \brief An interrupt spinlock. This lock disable preemption on acquire and
+ * then spins until no other CPU holds the lock.
+ *
+ * Contrary to int_lock, it can be shared between several CPUs. The
+ * spinning is done by the Lock (spinlock or ticket_spinlock), see
+ * int_mcs_spinlock for the queue lock.
+ */
+template<typename Lock>
+struct basic_int_spinlock {
+    /*!
+     * \brief Acquire the lock. This will disable preemption.
+     */
+    void lock() {
+        int_lock irq;
+        irq.lock();
+
+        value_lock.lock();
+
+        // Only the owner of the lock can write the flags
+        this->irq = irq;
+    }
+
+    /*!
+     * \brief Release the lock. This will enable preemption.
+     */
+    void unlock() {
+        auto irq = this->irq;
+
+        value_lock.unlock();
+
+        irq.unlock();
+    }
+
+    /*!
+     * \brief Name the lock in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+        value_lock.set_name(name);
+    }
+
+private:
+    Lock value_lock; ///< The lock shared between CPUs
+    int_lock irq;    ///< The CPU flags of the owner
+};
+
+using int_spinlock = basic_int_spinlock<spinlock>;               ///< An interrupt spinlock
+using int_ticket_spinlock = basic_int_spinlock<ticket_spinlock>; ///< A fair interrupt spinlock
+
+#endif
@@ -0,0 +1,106 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef LOCK_STAT_H
+#define LOCK_STAT_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+/*!
+ * \brief Contention statistics of the named locks.
+ *
+ * The statistics are only collected when the kernel is compiled with
+ * THOR_CONFIG_LOCK_STAT, otherwise the locks have neither the fields nor
+ * the code to collect them.
+ */
+namespace lock_stat {
+
+#ifdef THOR_CONFIG_LOCK_STAT
+
+constexpr const size_t MAX_CLASSES = 64; ///< The maximum number of distinct lock names
+
+/*!
+ * \brief The statistics shared by all the locks with the same name.
+ *
+ * The waits and the hold times are counted in cycles of the time stamp
+ * counter.
+ */
+struct lock_class {
+    const char* name;               ///< The name of the locks
+    volatile uint64_t acquisitions; ///< The number of acquisitions
+    volatile uint64_t contentions;  ///< The acquisitions that had to wait
+    volatile uint64_t wait_cycles;  ///< The total time spent waiting
+    volatile uint64_t hold_cycles;  ///< The total time the locks were held
+    volatile uint64_t hold_max;     ///< The longest time a lock was held
+};
+
+/*!
+ * \brief Returns the statistics of the given name, registered on first use.
+ *
+ * \return the statistics or nullptr if there are already MAX_CLASSES names
+ */
+lock_class* register_class(const char* name);
+
+/*!
+ * \brief Returns the time stamp counter of the processor
+ */
+inline uint64_t cycles(){
+    uint32_t low;
+    uint32_t high;
+
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+/*!
+ * \brief Account an acquisition started at the given cycle
+ * \return The cycle at which the lock was acquired
+ */
+inline uint64_t acquired(lock_class* c, bool contended, uint64_t start){
+    auto now = cycles();
+
+    __atomic_add_fetch(&c->acquisitions, 1, __ATOMIC_RELAXED);
+
+    if(contended){
+        __atomic_add_fetch(&c->contentions, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&c->wait_cycles, now - start, __ATOMIC_RELAXED);
+    }
+
+    return now;
+}
+
+/*!
+ * \brief Account the release of a lock acquired at the given cycle
+ */
+inline void released(lock_class* c, uint64_t start){
+    auto hold = cycles() - start;
+
+    __atomic_add_fetch(&c->hold_cycles, hold, __ATOMIC_RELAXED);
+
+    // Locks of the same class may be released at the same time
+    auto max = __atomic_load_n(&c->hold_max, __ATOMIC_RELAXED);
+
+    while(hold > max && !__atomic_compare_exchange_n(&c->hold_max, &max, hold, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        // max has been reloaded
+    }
+}
+
+#endif
+
+/*!
+ * \brief Returns the statistics of all the lock classes, one line each:
+ * name acquisitions contentions wait_cycles hold_cycles hold_max.
+ *
+ * Nothing is returned without THOR_CONFIG_LOCK_STAT.
+ */
+std::string format();
+
+} //end of namespace lock_stat
+
+#endif
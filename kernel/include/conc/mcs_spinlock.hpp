@@ -0,0 +1,228 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef MCS_SPINLOCK_H
+#define MCS_SPINLOCK_H
+
+#include <types.hpp>
+#include <array.hpp>
+
+#include "conc/backoff.hpp"
+#include "conc/int_lock.hpp"
+
+#include "smp.hpp"
+
+#ifdef THOR_CONFIG_LOCK_STAT
+#include "conc/lock_stat.hpp"
+#endif
+
+/*!
+ * \brief The place of a processor in the queue of a MCS lock.
+ *
+ * The node must stay alive until the lock is released.
+ */
+struct mcs_node {
+    mcs_node* volatile next = nullptr; ///< The next waiter
+    volatile bool locked = false;      ///< Indicates if the waiter still waits
+};
+
+/*!
+ * \brief A MCS queue spinlock.
+ *
+ * The waiters form a queue and each one spins on its own node, so that a
+ * release only touches the cache line of the next waiter. The lock is fair.
+ */
+struct mcs_spinlock {
+    /*!
+     * \brief Acquire the lock with the given node.
+     *
+     * This will wait indefinitely.
+     */
+    void lock(mcs_node& node) {
+        node.next = nullptr;
+        node.locked = true;
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        auto start = stats ? lock_stat::cycles() : 0;
+#endif
+
+        auto* previous = __atomic_exchange_n(&tail, &node, __ATOMIC_ACQ_REL);
+
+        if(previous){
+            __atomic_store_n(&previous->next, &node, __ATOMIC_RELEASE);
+
+            backoff b;
+
+            while(__atomic_load_n(&node.locked, __ATOMIC_ACQUIRE)){
+                b.wait();
+            }
+        }
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            acquired_at = lock_stat::acquired(stats, previous, start);
+        }
+#endif
+    }
+
+    /*!
+     * \brief Try to acquire the lock with the given node.
+     *
+     * This function returns immediately.
+     *
+     * \return true if the lock was acquired, false otherwise.
+     */
+    bool try_lock(mcs_node& node) {
+        node.next = nullptr;
+        node.locked = false;
+
+        mcs_node* expected = nullptr;
+
+        if(__atomic_compare_exchange_n(&tail, &expected, &node, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+#ifdef THOR_CONFIG_LOCK_STAT
+            if(stats){
+                acquired_at = lock_stat::acquired(stats, false, 0);
+            }
+#endif
+
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Release the lock acquired with the given node
+     */
+    void unlock(mcs_node& node) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            lock_stat::released(stats, acquired_at);
+        }
+#endif
+
+        auto* next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE);
+
+        if(!next){
+            mcs_node* expected = &node;
+
+            // No waiter, the lock is free
+            if(__atomic_compare_exchange_n(&tail, &expected, nullptr, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+                return;
+            }
+
+            // A waiter is linking itself
+            while(!(next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE))){
+                arch::pause();
+            }
+        }
+
+        __atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
+    }
+
+    /*!
+     * \brief Name the lock in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
+    }
+
+private:
+    mcs_node* volatile tail = nullptr; ///< The last waiter, nullptr if the lock is free
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the lock, if named
+    uint64_t acquired_at;                   ///< The cycle of the last acquisition
+#endif
+};
+
+/*!
+ * \brief A MCS lock guard (RAII), the node is on the stack
+ */
+struct mcs_guard {
+    /*!
+     * \brief Acquire the lock
+     */
+    explicit mcs_guard(mcs_spinlock& lock) : lock(lock) {
+        lock.lock(node);
+    }
+
+    /*!
+     * \brief Release the lock
+     */
+    ~mcs_guard() {
+        lock.unlock(node);
+    }
+
+    mcs_guard(const mcs_guard& rhs) = delete;
+    mcs_guard& operator=(const mcs_guard& rhs) = delete;
+
+private:
+    mcs_spinlock& lock; ///< The acquired lock
+    mcs_node node;      ///< The node of the owner in the queue
+};
+
+/*!
+ * \brief An interrupt MCS lock. This lock disable preemption on acquire and
+ * then waits in the queue of the lock.
+ *
+ * Since a processor can only wait for the lock once while the preemption
+ * is disabled, each processor has its node in the lock, and the lock can
+ * be used like any other lock.
+ */
+struct int_mcs_spinlock {
+    /*!
+     * \brief Acquire the lock. This will disable preemption.
+     */
+    void lock() {
+        int_lock irq;
+        irq.lock();
+
+        auto& cpu = cpus[smp::current_cpu()];
+
+        value_lock.lock(cpu.node);
+
+        cpu.irq = irq;
+    }
+
+    /*!
+     * \brief Release the lock. This will enable preemption.
+     */
+    void unlock() {
+        auto& cpu = cpus[smp::current_cpu()];
+        auto irq = cpu.irq;
+
+        value_lock.unlock(cpu.node);
+
+        irq.unlock();
+    }
+
+    /*!
+     * \brief Name the lock in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+        value_lock.set_name(name);
+    }
+
+private:
+    /*!
+     * \brief The state of a processor using the lock
+     */
+    struct cpu_state {
+        mcs_node node; ///< The node of the processor in the queue
+        int_lock irq;  ///< The interrupt state of the processor, saved by the owner
+    };
+
+    mcs_spinlock value_lock;                   ///< The lock shared between CPUs
+    std::array<cpu_state, smp::MAX_CPUS> cpus; ///< The state of each processor
+};
+
+#endif
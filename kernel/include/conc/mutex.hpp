@@ -22,6 +22,10 @@
  *
  * Once the lock is acquired, the critical section is only accessible by the
  * thread who acquired the mutex.
+ *
+ * The owner inherits the priority of its highest waiter, through the chain
+ * of mutexes the owners are themselves waiting for, until it releases the
+ * mutex.
  */
 struct mutex {
     /*!
@@ -34,25 +38,14 @@ struct mutex {
         } else {
             value = v;
         }
+
+        owner = NO_OWNER;
     }
 
     /*!
      * \brief Acquire the lock
      */
-    void lock() {
-        value_lock.lock();
-
-        if (value > 0) {
-            value = 0;
-
-            value_lock.unlock();
-        } else {
-            queue.enqueue();
-
-            value_lock.unlock();
-            scheduler::reschedule();
-        }
-    }
+    void lock();
 
     /*!
      * \brief Try to acquire the lock.
@@ -61,38 +54,50 @@ struct mutex {
      *
      * \return true if the lock was acquired, false otherwise.
      */
-    bool try_lock() {
-        std::lock_guard<spinlock> l(value_lock);
-
-        if (value > 0) {
-            value = 0;
-
-            return true;
-        } else {
-            return false;
-        }
-    }
+    bool try_lock();
 
     /*!
      * \brief Release the lock
      */
-    void unlock() {
-        std::lock_guard<spinlock> l(value_lock);
+    void unlock();
 
-        if (queue.empty()) {
-            value = 1;
-        } else {
-            queue.dequeue();
+    /*!
+     * \brief Move a process blocked in a condition variable to the queue of
+     * the mutex, it is woken up once it owns the mutex.
+     *
+     * The node must already be removed from its previous list.
+     */
+    void requeue(wait_node& node);
 
-            //No need to increment value, the process won't
-            //decrement it
-        }
+    /*!
+     * \brief Name the mutex in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
     }
 
 private:
-    mutable spinlock value_lock; ///< The spin protecting the value
-    volatile size_t value = 1;   ///< The value of the mutex
-    wait_list queue;             ///< The sleep queue
+    static constexpr size_t NO_OWNER = ~size_t(0); ///< The owner of a free mutex, or of a mutex initialized taken
+
+    void take(size_t pid);
+    void inherit(size_t priority);
+
+    static void release_boost(size_t pid);
+
+    mutable spinlock value_lock;      ///< The spin protecting the value, the owner and the queue
+    volatile size_t value = 1;        ///< The value of the mutex
+    volatile size_t owner = NO_OWNER; ///< The pid of the owner of the mutex
+    mutex* next_held = nullptr;       ///< The next mutex owned by the same process
+    wait_list queue;                  ///< The sleep queue
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the mutex, if named
+    uint64_t acquired_at;                   ///< The cycle of the last acquisition
+#endif
 };
 
 #endif
@@ -0,0 +1,101 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef PERCPU_COUNTER_H
+#define PERCPU_COUNTER_H
+
+#include <types.hpp>
+#include <array.hpp>
+
+#include "smp.hpp"
+
+/*!
+ * \brief A statistics counter split in one slot per processor.
+ *
+ * Each processor only updates its own slot, on its own cache line, the
+ * updates never bounce between the processors. The value is the sum of
+ * the slots, it is only consistent once the updates are finished.
+ *
+ * The updates are atomic on the slot, they stay correct when the process
+ * migrates or is interrupted in the middle of an update. The slots wrap
+ * around, the sum is correct even if a processor only subtracts.
+ */
+struct percpu_counter {
+    /*!
+     * \brief Construct a counter at zero.
+     *
+     * The construction is constant, the global counters can be updated
+     * before the global constructors are run.
+     */
+    constexpr percpu_counter() : slots() {}
+
+    /*!
+     * \brief Add the given value to the counter
+     */
+    void add(size_t value){
+        __atomic_fetch_add(&slots[smp::current_cpu()].value, value, __ATOMIC_RELAXED);
+    }
+
+    /*!
+     * \brief Subtract the given value from the counter
+     */
+    void sub(size_t value){
+        __atomic_fetch_sub(&slots[smp::current_cpu()].value, value, __ATOMIC_RELAXED);
+    }
+
+    /*!
+     * \brief Returns the sum of the slots
+     */
+    size_t value() const {
+        size_t sum = 0;
+
+        for(auto& slot : slots){
+            sum += __atomic_load_n(&slot.value, __ATOMIC_RELAXED);
+        }
+
+        return sum;
+    }
+
+    /*!
+     * \brief Set the counter to the given value, it must not be updated
+     * concurrently
+     */
+    void reset(size_t value = 0){
+        for(auto& slot : slots){
+            __atomic_store_n(&slot.value, 0, __ATOMIC_RELAXED);
+        }
+
+        __atomic_store_n(&slots[0].value, value, __ATOMIC_RELAXED);
+    }
+
+    percpu_counter& operator++(){
+        add(1);
+        return *this;
+    }
+
+    percpu_counter& operator+=(size_t value){
+        add(value);
+        return *this;
+    }
+
+    percpu_counter& operator-=(size_t value){
+        sub(value);
+        return *this;
+    }
+
+private:
+    /*!
+     * \brief The slot of a processor
+     */
+    struct alignas(64) slot_t {
+        size_t value; ///< The part of the counter of the processor
+    };
+
+    std::array<slot_t, smp::MAX_CPUS> slots; ///< The slots of the processors
+};
+
+#endif
@@ -0,0 +1,74 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef QSBR_H
+#define QSBR_H
+
+#include <types.hpp>
+
+#include "conc/int_lock.hpp"
+
+/*!
+ * \brief Quiescent-state based read-copy-update.
+ *
+ * The read-side sections only disable the preemption of their processor,
+ * they write nothing shared. Since a processor cannot switch process nor
+ * take its timer tick inside a read section, each context switch and each
+ * tick is a quiescent state, and so is the idle loop. A writer that
+ * unlinked an element waits in synchronize() for every other processor to
+ * go through a quiescent state before releasing it.
+ *
+ * The read sections must be short and must not sleep, see rcu for the
+ * readers that may. The interrupt handlers must not use them, they can
+ * run on an idle processor.
+ */
+namespace qsbr {
+
+/*!
+ * \brief Account a quiescent state of the current processor
+ */
+void quiescent();
+
+/*!
+ * \brief Indicates that the current processor is idle, it is quiescent
+ * until exit_idle()
+ */
+void enter_idle();
+
+/*!
+ * \brief Indicates that the current processor is not idle anymore
+ */
+void exit_idle();
+
+/*!
+ * \brief Wait until all the read sections started before the call are
+ * finished. The caller may be rescheduled.
+ */
+void synchronize();
+
+} //end of namespace qsbr
+
+/*!
+ * \brief Scoped read-side section of the quiescent-state RCU
+ */
+struct qsbr_reader {
+    qsbr_reader(){
+        irq.lock();
+    }
+
+    ~qsbr_reader(){
+        irq.unlock();
+    }
+
+    qsbr_reader(const qsbr_reader& rhs) = delete;
+    qsbr_reader& operator=(const qsbr_reader& rhs) = delete;
+
+private:
+    int_lock irq; ///< Disable the preemption during the section
+};
+
+#endif
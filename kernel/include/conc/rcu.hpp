@@ -0,0 +1,88 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef RCU_H
+#define RCU_H
+
+#include <types.hpp>
+
+#include "scheduler.hpp"
+
+/*!
+ * \brief Read-copy-update protection of a linked structure.
+ *
+ * The readers never wait, they only count themselves in the current
+ * epoch. A writer that unlinked an element flips the epoch and waits for
+ * the readers of the previous epoch to leave before releasing it. The
+ * writers must be serialized by the caller.
+ *
+ * The readers may sleep, but they write a shared counter, see qsbr for
+ * the short read sections.
+ */
+struct rcu {
+    /*!
+     * \brief Enter a read-side critical section
+     * \return The epoch to give back to read_unlock
+     */
+    size_t read_lock(){
+        while(true){
+            auto epoch = __atomic_load_n(&current, __ATOMIC_SEQ_CST) & 1;
+
+            __atomic_add_fetch(&readers[epoch], 1, __ATOMIC_SEQ_CST);
+
+            // A writer may have flipped the epoch before it saw this reader
+            if((__atomic_load_n(&current, __ATOMIC_SEQ_CST) & 1) == epoch){
+                return epoch;
+            }
+
+            __atomic_sub_fetch(&readers[epoch], 1, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    /*!
+     * \brief Leave a read-side critical section
+     */
+    void read_unlock(size_t epoch){
+        __atomic_sub_fetch(&readers[epoch], 1, __ATOMIC_SEQ_CST);
+    }
+
+    /*!
+     * \brief Wait until the readers that may still see the unlinked
+     * elements have left their critical section
+     */
+    void synchronize(){
+        auto epoch = __atomic_fetch_add(&current, 1, __ATOMIC_SEQ_CST) & 1;
+
+        while(__atomic_load_n(&readers[epoch], __ATOMIC_SEQ_CST)){
+            scheduler::yield();
+        }
+    }
+
+private:
+    volatile size_t current = 0;      ///< The current epoch, only its parity matters
+    volatile size_t readers[2] = {0, 0}; ///< The number of readers of each epoch
+};
+
+/*!
+ * \brief Scoped read-side critical section of a rcu
+ */
+struct rcu_reader {
+    explicit rcu_reader(rcu& r) : r(r), epoch(r.read_lock()) {}
+
+    ~rcu_reader(){
+        r.read_unlock(epoch);
+    }
+
+    rcu_reader(const rcu_reader& rhs) = delete;
+    rcu_reader& operator=(const rcu_reader& rhs) = delete;
+
+private:
+    rcu& r;       ///< The protected structure
+    size_t epoch; ///< The epoch of the reader
+};
+
+#endif
@@ -78,17 +78,27 @@ struct rw_lock final {
      * \brief Acquire the lock for reading
      */
     void read_lock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+        auto start = stats ? lock_stat::cycles() : 0;
+        bool contended = writer;
+#endif
+
         m.lock();
 
         while(writer){
-            m.unlock();
-            write.wait();
-            m.lock();
+            write.wait(m);
         }
 
         ++readers;
 
         m.unlock();
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        // Only the writers have a hold time, the readers overlap
+        if(stats){
+            lock_stat::acquired(stats, contended, start);
+        }
+#endif
     }
 
     /*!
@@ -101,7 +111,7 @@ struct rw_lock final {
 
         // If there are no more readers, notify one writer
         if(!readers){
-            write.notify_one();
+            write.notify_one(m);
         }
 
         m.unlock();
@@ -111,33 +121,63 @@ struct rw_lock final {
      * \brief Acquire the lock for writing.
      */
     void write_lock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+        auto start = stats ? lock_stat::cycles() : 0;
+        bool contended = false;
+#endif
+
         m.lock();
 
         while(writer || readers){
-            m.unlock();
-            write.wait();
-            m.lock();
+#ifdef THOR_CONFIG_LOCK_STAT
+            contended = true;
+#endif
+
+            write.wait(m);
         }
 
         writer = true;
 
         m.unlock();
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            acquired_at = lock_stat::acquired(stats, contended, start);
+        }
+#endif
     }
 
     /*!
      * \brief Release the lock for writing.
      */
     void write_unlock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            lock_stat::released(stats, acquired_at);
+        }
+#endif
+
         m.lock();
 
         writer = false;
 
-        // Notify all writers and readers
-        write.notify_all();
+        // Notify all writers and readers, they are moved to the queue of m
+        write.notify_all(m);
 
         m.unlock();
     }
 
+    /*!
+     * \brief Name the lock in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name){
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
+    }
+
     /*!
      * \brief Returns a lock for reader
      */
@@ -157,6 +197,11 @@ private:
     mutex m;                  ///< Mutex protecting the counter
     size_t readers = 0;       ///< Number of readers
     bool writer    = false;   ///< Boolean flag indicating if there is a writer
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the lock, if named
+    uint64_t acquired_at;                   ///< The cycle of the last write acquisition
+#endif
 };
 
 inline void writer_rw_lock::lock(){
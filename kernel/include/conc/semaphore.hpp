@@ -37,6 +37,11 @@ struct semaphore {
      * section is entered.
      */
     void lock() {
+#ifdef THOR_CONFIG_LOCK_STAT
+        auto start = stats ? lock_stat::cycles() : 0;
+        bool contended = false;
+#endif
+
         value_lock.lock();
 
         if (value > 0) {
@@ -47,7 +52,18 @@ struct semaphore {
 
             value_lock.unlock();
             scheduler::reschedule();
+
+#ifdef THOR_CONFIG_LOCK_STAT
+            contended = true;
+#endif
         }
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        // Several processes hold a semaphore, there is no hold time
+        if(stats){
+            lock_stat::acquired(stats, contended, start);
+        }
+#endif
     }
 
     /*!
@@ -63,6 +79,12 @@ struct semaphore {
         if (value > 0) {
             --value;
 
+#ifdef THOR_CONFIG_LOCK_STAT
+            if(stats){
+                lock_stat::acquired(stats, false, 0);
+            }
+#endif
+
             return true;
         } else {
             return false;
@@ -112,10 +134,25 @@ struct semaphore {
         }
     }
 
+    /*!
+     * \brief Name the semaphore in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
+    }
+
 private:
     mutable spinlock value_lock; ///< The spin lock protecting the counter
     volatile size_t value;       ///< The value of the counter
     wait_list queue;             ///< The sleep queue
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the semaphore, if named
+#endif
 };
 
 #endif
@@ -0,0 +1,84 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <types.hpp>
+
+#include "arch.hpp"
+#include "conc/spinlock.hpp"
+
+/*!
+ * \brief A sequence lock, for small values read much more often than
+ * written.
+ *
+ * The readers never write to the lock, they read the values and retry
+ * if a writer changed them in the meantime:
+ *
+ *     size_t seq;
+ *     do {
+ *         seq = lock.read_begin();
+ *         copy = value;
+ *     } while(lock.read_retry(seq));
+ *
+ * The readers must only copy the values, they can see them torn before
+ * the retry. The writers are serialized by a spinlock and should be short
+ * since the readers spin while a write is in progress.
+ */
+struct seqlock {
+    /*!
+     * \brief Start a read of the values
+     * \return The sequence to give to read_retry
+     */
+    size_t read_begin() const {
+        while(true){
+            auto seq = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+
+            // An odd sequence is a write in progress
+            if(!(seq & 1)){
+                return seq;
+            }
+
+            arch::pause();
+        }
+    }
+
+    /*!
+     * \brief Indicates if the values read since read_begin may be torn
+     */
+    bool read_retry(size_t seq) const {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        return __atomic_load_n(&sequence, __ATOMIC_RELAXED) != seq;
+    }
+
+    /*!
+     * \brief Start to write the values
+     */
+    void write_lock(){
+        writers.lock();
+
+        __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    /*!
+     * \brief Publish the written values
+     */
+    void write_unlock(){
+        __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELEASE);
+
+        writers.unlock();
+    }
+
+private:
+    spinlock writers;             ///< Serialize the writers
+    volatile size_t sequence = 0; ///< The sequence, odd while a write is in progress
+};
+
+#endif
@@ -10,10 +10,23 @@
 
 #include <types.hpp>
 
+#include "arch.hpp"
+
+#ifdef THOR_CONFIG_LOCK_STAT
+#include "conc/lock_stat.hpp"
+#endif
+
 /*!
  * \brief Implementation of a spinlock
  *
- * A spinlock simply waits in a loop until the lock is available.
+ * A spinlock simply waits in a loop until the lock is available. The
+ * waiters only read the lock until it looks free, with a pause, so that
+ * they do not keep the cache line busy.
+ *
+ * The acquisition has acquire semantics and the release has release
+ * semantics, no full fence is needed.
+ *
+ * See ticket_spinlock and mcs_spinlock for fair locks.
  */
 struct spinlock {
     /*!
@@ -22,10 +35,30 @@ struct spinlock {
      * This will wait indefinitely.
      */
     void lock() {
-        while (!__sync_bool_compare_and_swap(&value, 0, 1))
-            ;
-        __sync_synchronize();
-        //TODO The last synchronize is probably not necessary
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            auto start = lock_stat::cycles();
+            bool contended = false;
+
+            while (__atomic_exchange_n(&value, 1, __ATOMIC_ACQUIRE)){
+                contended = true;
+
+                while (__atomic_load_n(&value, __ATOMIC_RELAXED)) {
+                    arch::pause();
+                }
+            }
+
+            acquired_at = lock_stat::acquired(stats, contended, start);
+
+            return;
+        }
+#endif
+
+        while (__atomic_exchange_n(&value, 1, __ATOMIC_ACQUIRE)){
+            while (__atomic_load_n(&value, __ATOMIC_RELAXED)) {
+                arch::pause();
+            }
+        }
     }
 
     /*!
@@ -34,8 +67,14 @@ struct spinlock {
      * This will wait indefinitely.
      */
     bool try_lock() {
-        if(__sync_bool_compare_and_swap(&value, 0, 1)){
-            __sync_synchronize();
+        // A read first does not take the cache line of a held lock
+        if(!__atomic_load_n(&value, __ATOMIC_RELAXED) && !__atomic_exchange_n(&value, 1, __ATOMIC_ACQUIRE)){
+#ifdef THOR_CONFIG_LOCK_STAT
+            if(stats){
+                acquired_at = lock_stat::acquired(stats, false, 0);
+            }
+#endif
+
             return true;
         }
 
@@ -46,12 +85,36 @@ struct spinlock {
      * \brief Release the lock
      */
     void unlock() {
-        __sync_synchronize();
-        value = 0;
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            lock_stat::released(stats, acquired_at);
+        }
+#endif
+
+        __atomic_store_n(&value, 0, __ATOMIC_RELEASE);
+    }
+
+    /*!
+     * \brief Name the lock in the lock statistics.
+     *
+     * The locks with the same name share their statistics. This does
+     * nothing without THOR_CONFIG_LOCK_STAT.
+     */
+    void set_name(const char* name) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
     }
 
 private:
-    volatile size_t value = 0; ///< The value of the lock
+    volatile size_t value = 0; ///< The value of the lock, the locks are copied with the structures they protect
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the lock, if named
+    uint64_t acquired_at;                   ///< The cycle of the last acquisition
+#endif
 };
 
 #endif
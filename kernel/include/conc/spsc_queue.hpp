@@ -0,0 +1,84 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <types.hpp>
+#include <utility.hpp>
+
+/*!
+ * \brief A bounded lock-free queue with a single producer and a single
+ * consumer.
+ *
+ * The producer and the consumer can run concurrently, for instance an
+ * interrupt handler and a kernel process, without any lock or allocation.
+ * Several producers (or consumers) must be serialized by their caller.
+ */
+template<typename T, size_t N>
+struct spsc_queue {
+    static_assert(N && !(N & (N - 1)), "The capacity must be a power of two");
+
+    /*!
+     * \brief Push a value at the back of the queue, from the producer
+     * \return true if the value was pushed, false if the queue is full
+     */
+    bool push(T value){
+        auto t = tail;
+
+        if(t - __atomic_load_n(&head, __ATOMIC_ACQUIRE) == N){
+            return false;
+        }
+
+        slots[t % N] = std::move(value);
+
+        // Publish the value to the consumer
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    /*!
+     * \brief Pop the value at the front of the queue, from the consumer
+     * \return true if a value was popped, false if the queue is empty
+     */
+    bool pop(T& value){
+        auto h = head;
+
+        if(h == __atomic_load_n(&tail, __ATOMIC_ACQUIRE)){
+            return false;
+        }
+
+        value = std::move(slots[h % N]);
+
+        // Give the slot back to the producer
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    /*!
+     * \brief Returns the number of values in the queue
+     */
+    size_t size() const {
+        return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    }
+
+    /*!
+     * \brief Indicates if the queue is empty
+     */
+    bool empty() const {
+        return !size();
+    }
+
+private:
+    T slots[N];       ///< The values
+    size_t head = 0;  ///< The number of popped values, written by the consumer
+    size_t tail = 0;  ///< The number of pushed values, written by the producer
+};
+
+#endif
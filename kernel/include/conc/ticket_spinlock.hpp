@@ -0,0 +1,123 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TICKET_SPINLOCK_H
+#define TICKET_SPINLOCK_H
+
+#include <types.hpp>
+
+#include "conc/backoff.hpp"
+
+#ifdef THOR_CONFIG_LOCK_STAT
+#include "conc/lock_stat.hpp"
+#endif
+
+/*!
+ * \brief A fair spinlock, the processors get the lock in the order they
+ * asked for it.
+ *
+ * Each waiter takes a ticket and spins until the served ticket is its own.
+ * The wait before checking again is proportional to the number of waiters
+ * before it.
+ */
+struct ticket_spinlock {
+    static constexpr size_t pauses_per_waiter = 32; ///< The pauses waited for each waiter ahead
+
+    /*!
+     * \brief Acquire the lock.
+     *
+     * This will wait indefinitely.
+     */
+    void lock() {
+        auto ticket = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        auto start = stats ? lock_stat::cycles() : 0;
+        bool contended = false;
+#endif
+
+        while(true){
+            auto current = __atomic_load_n(&serving, __ATOMIC_ACQUIRE);
+
+            if(current == ticket){
+                break;
+            }
+
+#ifdef THOR_CONFIG_LOCK_STAT
+            contended = true;
+#endif
+
+            backoff::wait(static_cast<uint32_t>(ticket - current) * pauses_per_waiter);
+        }
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            acquired_at = lock_stat::acquired(stats, contended, start);
+        }
+#endif
+    }
+
+    /*!
+     * \brief Try to acquire the lock.
+     *
+     * This function returns immediately.
+     *
+     * \return true if the lock was acquired, false otherwise.
+     */
+    bool try_lock() {
+        auto current = __atomic_load_n(&serving, __ATOMIC_ACQUIRE);
+
+        // A ticket is only taken if it would be served right away
+        if(__atomic_compare_exchange_n(&next, &current, current + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+#ifdef THOR_CONFIG_LOCK_STAT
+            if(stats){
+                acquired_at = lock_stat::acquired(stats, false, 0);
+            }
+#endif
+
+            return true;
+        }
+
+        return false;
+    }
+
+    /*!
+     * \brief Release the lock, the next ticket is served
+     */
+    void unlock() {
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            lock_stat::released(stats, acquired_at);
+        }
+#endif
+
+        // Only the owner writes the served ticket
+        __atomic_store_n(&serving, serving + 1, __ATOMIC_RELEASE);
+    }
+
+    /*!
+     * \brief Name the lock in the lock statistics, see spinlock::set_name
+     */
+    void set_name(const char* name) {
+#ifdef THOR_CONFIG_LOCK_STAT
+        stats = lock_stat::register_class(name);
+#else
+        (void) name;
+#endif
+    }
+
+private:
+    volatile uint32_t next = 0;    ///< The next ticket to give
+    volatile uint32_t serving = 0; ///< The ticket owning the lock
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    lock_stat::lock_class* stats = nullptr; ///< The statistics of the lock, if named
+    uint64_t acquired_at;                   ///< The cycle of the last acquisition
+#endif
+};
+
+#endif
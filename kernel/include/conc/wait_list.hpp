@@ -13,12 +13,18 @@
 struct wait_node {
     size_t pid;
     wait_node* next;
+    bool exclusive = false;          ///< Indicates if only one exclusive waiter is woken up at a time
+    const void* relock = nullptr;    ///< The mutex the waiter obtains again once woken up, if any
+    volatile bool morphed = false;   ///< Indicates if the waiter was given the mutex instead of being woken up
 };
 
 /*!
  * \brief A list of processes waiting.
  *
  * It is implemented as an intrusive singly linked list.
+ *
+ * The exclusive waiters are woken up one at a time by wake_up(), the one
+ * woken up passes the wake up on if the resource is still available.
  */
 struct wait_list {
     /*!
@@ -37,6 +43,12 @@ struct wait_list {
      */
     bool waiting() const;
 
+    /*!
+     * \brief Returns the highest priority of the waiting processes, 0 if
+     * there are none
+     */
+    size_t highest_priority() const;
+
     /*!
      * \brief Removes the current process from the list
      */
@@ -52,6 +64,17 @@ struct wait_list {
      */
     void enqueue_timeout(size_t ms);
 
+    /*!
+     * \brief Enque the current process in the wait list, as an exclusive waiter
+     */
+    void enqueue_exclusive();
+
+    /*!
+     * \brief Enque the current process in the wait list, as an exclusive
+     * waiter, until the timeout is passed
+     */
+    void enqueue_exclusive_timeout(size_t ms);
+
     /*!
      * \brief Dequeue the first process from the wait list
      * \return The pid of the dequeued process
@@ -64,9 +87,47 @@ struct wait_list {
      */
     size_t dequeue_hint();
 
+    /*!
+     * \brief Wake up all the processes that are not exclusive waiters and
+     * the first exclusive waiter.
+     *
+     * The processes may have been woken up by their timeout already.
+     *
+     * \return The number of processes woken up
+     */
+    size_t wake_up();
+
+    /*!
+     * \brief Remove the first process from the list, without waking it up
+     */
+    wait_node& pop();
+
+    /*!
+     * \brief Add a process already blocked at the end of the list
+     */
+    void append(wait_node& node);
+
+    /*!
+     * \brief Returns the number of processes taken from the list
+     */
+    size_t wakeups() const {
+        return woken;
+    }
+
+    /*!
+     * \brief Returns the number of exclusive waiters left waiting by wake_up()
+     */
+    size_t avoided_wakeups() const {
+        return avoided;
+    }
+
 private:
+    void push(wait_node& node, bool exclusive);
+
     wait_node* head = nullptr; ///< The head of the list
     wait_node* tail = nullptr; ///< The tail of the list
+    size_t woken = 0;          ///< The number of processes taken from the list
+    size_t avoided = 0;        ///< The number of exclusive waiters left waiting by wake_up()
 };
 
 #endif
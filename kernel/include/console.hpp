@@ -46,6 +46,13 @@ struct console {
      */
     void print(char c);
 
+    /*!
+     * \brief Print several characters to the console, updated once
+     * \param s The characters to print
+     * \param n The number of characters to print
+     */
+    void print(const char* s, size_t n);
+
     /*!
      * \brief Clear the console
      */
@@ -0,0 +1,122 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <types.hpp>
+#include <initializer_list.hpp>
+#include <utility.hpp>
+
+#include "tlib/cpu_features.hpp"
+
+/*!
+ * \brief The features of the processors, detected once at boot on the
+ * bootstrap processor, and the selection of the implementations of a
+ * function depending on them.
+ */
+namespace cpu_features {
+
+/*!
+ * \brief Detect the features of the processor. This is done before the
+ * global constructors, which select the implementations of the dispatched
+ * functions.
+ */
+void init();
+
+/*!
+ * \brief Export the features in /sys/cpu/features
+ */
+void finalize();
+
+/*!
+ * \brief Returns the mask of the tlib::cpu_feature bits of the processor
+ */
+uint64_t mask();
+
+/*!
+ * \brief Indicates if the processor has the given feature
+ */
+bool has(tlib::cpu_feature feature);
+
+/*!
+ * \brief Indicates if the processor has all the given features
+ */
+inline bool has_all(uint64_t features){
+    return (mask() & features) == features;
+}
+
+/*!
+ * \brief An implementation of a function and the features it needs
+ */
+template<typename F>
+struct version {
+    uint64_t features; ///< The required features, see tlib::cpu_feature_mask
+    F function;        ///< The implementation
+};
+
+/*!
+ * \brief Returns the first version whose features are all present, the
+ * fallback if there is none
+ */
+template<typename F>
+F select(std::initializer_list<version<F>> versions, F fallback){
+    for(auto& v : versions){
+        if(has_all(v.features)){
+            return v.function;
+        }
+    }
+
+    return fallback;
+}
+
+/*!
+ * \brief A function with several implementations, of the given signature.
+ *
+ * The implementation is selected once, when the dispatch is constructed,
+ * the calls are then indirect calls without any check. A dispatch must be
+ * a global, the global constructors run after the detection of the
+ * features.
+ */
+template<typename Signature>
+struct dispatch;
+
+template<typename R, typename... Args>
+struct dispatch<R(Args...)> {
+    using function_t = R (*)(Args...); ///< The type of the implementations
+
+    /*!
+     * \brief Select the implementation
+     * \param versions The versions, from the best to the worst
+     * \param fallback The implementation for any processor
+     */
+    dispatch(std::initializer_list<version<function_t>> versions, function_t fallback) : function(select(versions, fallback)) {}
+
+    dispatch(const dispatch&) = delete;
+    dispatch& operator=(const dispatch&) = delete;
+
+    /*!
+     * \brief Call the selected implementation
+     */
+    R operator()(Args... args) const {
+        return function(std::forward<Args>(args)...);
+    }
+
+    /*!
+     * \brief Returns the selected implementation
+     */
+    function_t get() const {
+        return function;
+    }
+
+private:
+    function_t function; ///< The selected implementation
+};
+
+} //end of namespace cpu_features
+
+#endif
@@ -0,0 +1,47 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef CPUIDLE_H
+#define CPUIDLE_H
+
+#include <types.hpp>
+
+/*!
+ * \brief The idle states of the processors.
+ *
+ * The states are read from the _CST object of the first processor, HLT
+ * is always the first state. The deepest state whose exit latency is
+ * small compared to the predicted idle duration is selected, up to the
+ * state set in /sys/cpuidle/max_state.
+ */
+namespace cpuidle {
+
+constexpr const size_t MAX_STATES = 8; ///< The maximum number of idle states
+
+/*!
+ * \brief Read the idle states once ACPI is initialized
+ */
+void init();
+
+/*!
+ * \brief Enter the best idle state for the predicted idle duration.
+ *
+ * Must be called with interrupts disabled, they are enabled when the
+ * processor is woken up.
+ *
+ * \param predicted_us The expected idle duration, in microseconds
+ */
+void enter(uint64_t predicted_us);
+
+/*!
+ * \brief Returns the number of idle states
+ */
+size_t states();
+
+} //end of namespace cpuidle
+
+#endif
@@ -12,6 +12,7 @@
 #include <array.hpp>
 #include <vector.hpp>
 #include <string.hpp>
+#include <expected.hpp>
 
 #include <tlib/datetime.hpp>
 
@@ -23,29 +24,67 @@ namespace disks {
 enum class disk_type {
     ATA,
     ATAPI,
+    AHCI,
     RAM
 };
 
+struct partition_descriptor;
+
 struct disk_descriptor {
     uint64_t uuid;
     disk_type type;
     void* descriptor;
+    std::unique_heap_array<partition_descriptor> partitions; ///< The partitions, read once at detection
 };
 
 struct partition_descriptor {
     uint64_t uuid;
     vfs::partition_type type;
-    uint64_t start;
-    uint64_t sectors;
+    uint64_t start;   ///< The first sector (LBA) of the partition on the disk
+    uint64_t sectors; ///< The number of sectors of the partition
     disk_descriptor* disk;
 };
 
+/*!
+ * \brief Indicates if the given sectors, relative to the partition, are
+ * inside the partition
+ */
+inline bool in_partition(const partition_descriptor& partition, uint64_t sector, uint64_t count){
+    return sector <= partition.sectors && count <= partition.sectors - sector;
+}
+
+/*!
+ * \brief Detect the disks of all the controllers and register them in
+ * devfs. The scheduler must be started.
+ */
 void detect_disks();
 
+/*!
+ * \brief Create a new RAM disk, registered as /dev/ram<N>
+ * \param size The size of the disk, in bytes
+ * \return The number N of the disk
+ */
+std::expected<size_t> make_ram_disk(size_t size);
+
+/*!
+ * \brief Start the kernel processes of the disk drivers
+ */
+void finalize();
+
+/*!
+ * \brief Write back the blocks of all the disks kept in cache
+ * \return true if all the blocks were written, false otherwise
+ */
+bool sync();
+
 disk_descriptor& disk_by_index(uint64_t index);
 disk_descriptor& disk_by_uuid(uint64_t uuid);
 
-std::unique_heap_array<partition_descriptor> partitions(disk_descriptor& disk);
+/*!
+ * \brief Returns the partitions of the disk, from the MBR or the GPT read
+ * when the disk was detected
+ */
+std::unique_heap_array<partition_descriptor>& partitions(disk_descriptor& disk);
 
 }
 
@@ -0,0 +1,66 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include "fs/devfs.hpp"
+
+namespace ahci {
+
+/*!
+ * \brief A SATA disk attached to a port of the AHCI controller
+ */
+struct drive_descriptor {
+    uint8_t port;         ///< The port of the controller
+    std::string model;    ///< The model of the disk
+    std::string serial;   ///< The serial number of the disk
+    std::string firmware; ///< The firmware revision of the disk
+    size_t size;          ///< The size of the disk, in bytes
+    bool ncq;             ///< Indicates if the commands are queued (NCQ)
+    uint8_t queue_depth;  ///< The maximum number of outstanding commands
+};
+
+/*!
+ * \brief Detect the AHCI controller and its disks
+ */
+void detect_disks();
+
+/*!
+ * \brief Returns the number of detected disks
+ */
+size_t number_of_disks();
+
+/*!
+ * \brief Returns the disk with the given index
+ */
+drive_descriptor& drive(size_t disk);
+
+size_t read_sectors(drive_descriptor& drive, uint64_t start, size_t count, void* destination, size_t& read);
+size_t write_sectors(drive_descriptor& drive, uint64_t start, size_t count, const void* source, size_t& written);
+size_t clear_sectors(drive_descriptor& drive, uint64_t start, size_t count, size_t& written);
+
+struct ahci_driver final : devfs::dev_driver {
+    size_t read(void* data, char* buffer, size_t count, size_t offset, size_t& read) override;
+    size_t write(void* data, const char* buffer, size_t count, size_t offset, size_t& written) override;
+    size_t clear(void* data, size_t count, size_t offset, size_t& written) override;
+    size_t size(void* data) override;
+};
+
+struct ahci_part_driver final : devfs::dev_driver {
+    size_t read(void* data, char* buffer, size_t count, size_t offset, size_t& read) override;
+    size_t write(void* data, const char* buffer, size_t count, size_t offset, size_t& written) override;
+    size_t clear(void* data, size_t count, size_t offset, size_t& written) override;
+    size_t size(void* data) override;
+};
+
+} // end of namespace ahci
+
+#endif
@@ -0,0 +1,85 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef DRIVER_APIC_H
+#define DRIVER_APIC_H
+
+#include <types.hpp>
+
+namespace apic {
+
+constexpr const size_t TIMER_IRQ = 0;      ///< The local APIC interrupt of the timer
+constexpr const size_t RESCHEDULE_IRQ = 1; ///< The local APIC interrupt of the reschedule IPI
+constexpr const size_t SHOOTDOWN_IRQ = 2;  ///< The local APIC interrupt of the TLB shootdown IPI
+
+/*!
+ * \brief Enable the local APIC of the bootstrap processor, in x2APIC mode
+ * if available, and calibrate its timer
+ * \return true if the local APIC is available, false otherwise
+ */
+bool init();
+
+/*!
+ * \brief Enable the local APIC of the current application processor
+ */
+void init_ap();
+
+/*!
+ * \brief Indicates if the local APIC has been initialized
+ */
+bool initialized();
+
+/*!
+ * \brief Returns the local APIC id of the current processor
+ */
+uint32_t id();
+
+/*!
+ * \brief Acknowledge the current local APIC interrupt
+ */
+void eoi();
+
+/*!
+ * \brief Send an INIT IPI to the given processor
+ */
+void send_init(uint32_t apic_id);
+
+/*!
+ * \brief Send a STARTUP IPI to the given processor
+ * \param page The physical page where the processor starts execution
+ */
+void send_startup(uint32_t apic_id, uint8_t page);
+
+/*!
+ * \brief Send a fixed IPI to the given processor
+ * \param irq The local APIC interrupt to raise on the processor
+ */
+void send_ipi(uint32_t apic_id, size_t irq);
+
+/*!
+ * \brief Start the local APIC timer of the current processor at the
+ * given frequency.
+ *
+ * The timer runs in TSC-deadline mode when the processor supports it and
+ * the TSC is calibrated, in periodic mode otherwise.
+ */
+void start_timer(uint64_t frequency);
+
+/*!
+ * \brief Stop the local APIC timer of the current processor
+ */
+void stop_timer();
+
+/*!
+ * \brief Arm the next deadline of the TSC-deadline timer, called by the
+ * timer interrupt handler of the current processor
+ */
+void timer_interrupt();
+
+} //end of namespace apic
+
+#endif
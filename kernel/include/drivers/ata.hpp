@@ -25,15 +25,39 @@ struct drive_descriptor {
     std::string serial;
     std::string firmware;
     size_t size;
+    bool lba48;
+    uint8_t multiple;
+    bool dma;
 };
 
+/*!
+ * \brief Start the identification of the drives, each channel is
+ * identified concurrently by its own task. The scheduler must be started.
+ */
 void detect_disks();
+
+/*!
+ * \brief Wait for the identification of the drives of all the channels
+ */
+void wait_disks();
+
+/*!
+ * \brief Start the flusher of the dirty blocks, once the scheduler is initialized
+ */
+void finalize();
+
+/*!
+ * \brief Write back all the dirty blocks of the cache
+ * \return true if all the blocks were written, false otherwise
+ */
+bool sync();
+
 uint8_t number_of_disks();
 drive_descriptor& drive(uint8_t disk);
 
-size_t read_sectors(drive_descriptor& drive, uint64_t start, uint8_t count, void* destination, size_t& read);
-size_t write_sectors(drive_descriptor& drive, uint64_t start, uint8_t count, const void* source, size_t& written);
-size_t clear_sectors(drive_descriptor& drive, uint64_t start, uint8_t count, size_t& written);
+size_t read_sectors(drive_descriptor& drive, uint64_t start, size_t count, void* destination, size_t& read);
+size_t write_sectors(drive_descriptor& drive, uint64_t start, size_t count, const void* source, size_t& written);
+size_t clear_sectors(drive_descriptor& drive, uint64_t start, size_t count, size_t& written);
 
 struct ata_driver final : devfs::dev_driver {
     size_t read(void* data, char* buffer, size_t count, size_t offset, size_t& read) override;
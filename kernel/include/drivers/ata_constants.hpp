@@ -38,10 +38,36 @@
 #define ATAPI_IDENTIFY  0xA1
 #define ATA_READ_BLOCK  0x20
 #define ATA_WRITE_BLOCK 0x30
+#define ATA_READ_BLOCK_EXT     0x24
+#define ATA_WRITE_BLOCK_EXT    0x34
+#define ATA_READ_MULTIPLE      0xC4
+#define ATA_WRITE_MULTIPLE     0xC5
+#define ATA_READ_MULTIPLE_EXT  0x29
+#define ATA_WRITE_MULTIPLE_EXT 0x39
+#define ATA_SET_MULTIPLE       0xC6
+#define ATA_READ_DMA           0xC8
+#define ATA_WRITE_DMA          0xCA
+#define ATA_READ_DMA_EXT       0x25
+#define ATA_WRITE_DMA_EXT      0x35
 
 #define ATA_CTL_SRST    0x04
 #define ATA_CTL_nIEN    0x02
 
+// Bus master registers, relative to the base of the channel
+#define BM_COMMAND      0
+#define BM_STATUS       2
+#define BM_PRDT         4
+
+#define BM_CMD_START    0x01
+#define BM_CMD_READ     0x08
+
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERR    0x02
+#define BM_STATUS_IRQ    0x04
+
+// Marks the last entry of a PRD table
+#define PRD_EOT         0x8000
+
 //Master/Slave on devices
 #define MASTER_BIT 0
 #define SLAVE_BIT 1
@@ -0,0 +1,35 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef E1000_H
+#define E1000_H
+
+#include <types.hpp>
+
+#include "net/network.hpp"
+
+#include "drivers/pci.hpp"
+
+namespace e1000 {
+
+/*!
+ * \brief Indicates if the given PCI device is an e1000 class controller
+ * supported by this driver
+ */
+bool is_e1000(const pci::device_descriptor& pci_device);
+
+/*!
+ * \brief Initialize the controller and its descriptor rings
+ * \return true if the interface can be used, false otherwise
+ */
+bool init_driver(network::interface_descriptor& interface, pci::device_descriptor& pci_device);
+
+void finalize_driver(network::interface_descriptor& interface);
+
+} //end of namespace e1000
+
+#endif
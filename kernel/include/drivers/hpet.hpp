@@ -19,6 +19,18 @@ void init();
 
 uint64_t counter();
 
+/*!
+ * \brief Delay the next tick IRQ by the given number of ticks
+ *
+ * Must be called with interrupts disabled.
+ */
+void stop_tick(uint64_t ticks);
+
+/*!
+ * \brief Fire the next tick IRQ at the next tick period
+ */
+void restart_tick();
+
 } //end of namespace hpet
 
 #endif
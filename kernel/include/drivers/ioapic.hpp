@@ -0,0 +1,47 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef DRIVER_IOAPIC_H
+#define DRIVER_IOAPIC_H
+
+#include <types.hpp>
+
+namespace ioapic {
+
+/*!
+ * \brief Route the legacy IRQs through the IO APICs of the MADT instead
+ * of the 8259 PICs, all to the bootstrap processor.
+ *
+ * The local APIC must be initialized.
+ *
+ * \return true if the IRQs are now routed by the IO APICs, false otherwise
+ */
+bool init();
+
+/*!
+ * \brief Indicates if the IRQs are routed by the IO APICs
+ */
+bool enabled();
+
+/*!
+ * \brief Returns the processor receiving the given IRQ
+ */
+size_t affinity(size_t irq);
+
+/*!
+ * \brief Route the given IRQ to the given processor.
+ *
+ * The timer IRQ stays on the bootstrap processor, it advances the
+ * timeouts.
+ *
+ * \return true if the IRQ has been routed, false otherwise
+ */
+bool set_affinity(size_t irq, size_t cpu);
+
+} //end of namespace ioapic
+
+#endif
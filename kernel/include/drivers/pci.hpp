@@ -12,6 +12,9 @@
 
 namespace pci {
 
+constexpr const uint8_t CAPABILITY_MSI  = 0x05; ///< The id of the MSI capability
+constexpr const uint8_t CAPABILITY_MSIX = 0x11; ///< The id of the MSI-X capability
+
 enum class device_class_type : uint8_t {
     OLD = 0x0,
     MASS_STORAGE = 0x1,
@@ -59,6 +62,37 @@ void write_config_byte(uint8_t bus, uint8_t device, uint8_t function, uint8_t of
 void write_config_word(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint16_t value);
 void write_config_dword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t value);
 
+/*!
+ * \brief Route the interrupts of the device to the given vector of the given
+ * processor, with message signaled interrupts
+ * \return true if the device supports MSI, false otherwise
+ */
+bool enable_msi(uint8_t bus, uint8_t device, uint8_t function, uint8_t vector, uint32_t apic_id);
+
+/*!
+ * \brief Find a capability of the device
+ * \return the offset of the capability in the configuration space, 0 if the device does not have it
+ */
+uint8_t find_capability(uint8_t bus, uint8_t device, uint8_t function, uint8_t id);
+
+/*!
+ * \brief Returns the number of MSI-X vectors of the device, 0 if it does not support MSI-X
+ */
+size_t msix_entries(uint8_t bus, uint8_t device, uint8_t function);
+
+/*!
+ * \brief Route the first n MSI-X entries of the device to the given vectors
+ * of the given processor, the other entries are masked
+ * \return true if the device supports MSI-X with at least n entries, false otherwise
+ */
+bool enable_msix(uint8_t bus, uint8_t device, uint8_t function, const uint8_t* vectors, size_t n, uint32_t apic_id);
+
+/*!
+ * \brief Route an MSI-X entry, already enabled, to another vector or processor
+ * \return true if the entry was routed, false otherwise
+ */
+bool route_msix(uint8_t bus, uint8_t device, uint8_t function, size_t entry, uint8_t vector, uint32_t apic_id);
+
 } //end of namespace pci
 
 #endif
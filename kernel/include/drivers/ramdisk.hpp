@@ -11,16 +11,26 @@
 #include <types.hpp>
 
 #include "fs/devfs.hpp"
+#include "conc/spinlock.hpp"
 
 namespace ramdisk {
 
+/*!
+ * \brief A RAM disk, backed by large pages allocated on the first write
+ */
 struct disk_descriptor {
-    uint64_t id;
-    uint64_t max_size;
-    uint64_t pages;
-    char** allocated;
+    uint64_t id;        ///< The number of the disk
+    uint64_t max_size;  ///< The size of the disk, in bytes
+    uint64_t chunks;    ///< The number of large pages of the disk
+    char** allocated;   ///< The mapping of the large pages, nullptr until written
+    spinlock lock;      ///< The lock of the allocation of the large pages
 };
 
+/*!
+ * \brief Create a new RAM disk
+ * \param max_size The size of the disk, in bytes
+ * \return The new disk, nullptr if there is no more room for disks
+ */
 disk_descriptor* make_disk(uint64_t max_size);
 
 struct ramdisk_driver final : devfs::dev_driver {
@@ -12,6 +12,25 @@
 
 namespace rtc {
 
+/*!
+ * \brief Read the CMOS clock once, the wall-clock time is then derived
+ * from the monotonic clock and resynchronized periodically.
+ *
+ * The timer must be installed.
+ */
+void init();
+
+/*!
+ * \brief Returns the nanoseconds since the Unix epoch at boot, 0 if the
+ * RTC has not been read yet
+ */
+uint64_t epoch_offset();
+
+/*!
+ * \brief Returns the current date and time.
+ *
+ * This does not access the CMOS once the RTC has been read.
+ */
 rtc::datetime all_data();
 
 } //end of rtc namespace
@@ -12,9 +12,25 @@ namespace serial {
 
 void init();
 
+/*!
+ * \brief Transmit through the interrupt of the UART from now on.
+ *
+ * Before, the characters are transmitted by polling the UART.
+ */
+void install();
+
 bool is_transmit_buffer_empty();
+
+/*!
+ * \brief Transmit a character, buffered once the driver is installed
+ */
 void transmit(char a);
 
+/*!
+ * \brief Synchronously transmit all the buffered characters
+ */
+void flush();
+
 } //end of serial namespace
 
 #endif
@@ -0,0 +1,35 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef VIRTIO_NET_H
+#define VIRTIO_NET_H
+
+#include <types.hpp>
+
+#include "net/network.hpp"
+
+#include "drivers/pci.hpp"
+
+namespace virtio_net {
+
+/*!
+ * \brief Indicates if the given PCI device is a virtio network device
+ * supported by this driver
+ */
+bool is_virtio_net(const pci::device_descriptor& pci_device);
+
+/*!
+ * \brief Initialize the device and its virtqueues
+ * \return true if the interface can be used, false otherwise
+ */
+bool init_driver(network::interface_descriptor& interface, pci::device_descriptor& pci_device);
+
+void finalize_driver(network::interface_descriptor& interface);
+
+} //end of namespace virtio_net
+
+#endif
@@ -0,0 +1,53 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef ELF_CACHE_H
+#define ELF_CACHE_H
+
+#include <types.hpp>
+#include <vector.hpp>
+
+#include <tlib/elf.hpp>
+
+#include "page_cache.hpp"
+
+namespace elf_cache {
+
+/*!
+ * \brief Init the cache of the executable headers
+ */
+void init();
+
+/*!
+ * \brief Returns the cached headers of the given executable
+ * \param source The executable
+ * \param header Output reference to the ELF header
+ * \param program_headers Output reference to the program headers
+ * \return true if the headers were cached, false otherwise
+ */
+bool get(const page_cache::source& source, elf::elf_header& header, std::vector<elf::program_header>& program_headers);
+
+/*!
+ * \brief Cache the validated headers of the given executable.
+ *
+ * The executables with too many program headers are not cached.
+ */
+void put(const page_cache::source& source, const elf::elf_header& header, const std::vector<elf::program_header>& program_headers);
+
+/*!
+ * \brief Drop the cached headers of the given file, once it is modified
+ */
+void invalidate(vfs::file_system* fs, size_t location);
+
+/*!
+ * \brief Indicates if no headers are cached
+ */
+bool empty();
+
+} //end of namespace elf_cache
+
+#endif
@@ -99,6 +99,27 @@ struct char_driver {
      * \return 0 on success, an error code otherwise
      */
     virtual size_t write(void* data, const char* buffer, size_t count, size_t& written) = 0;
+
+    /*!
+     * \brief Returns the readiness source of the device
+     * \param data The driver data
+     * \return The source, or nullptr if the device can not be polled
+     */
+    virtual poll::source* poll_source(void* /*data*/){
+        return nullptr;
+    }
+
+    /*!
+     * \brief Returns the physical memory of the device that can be mapped
+     * by the processes
+     * \param data The driver data
+     * \param physical output reference to the physical address of the memory
+     * \param size output reference to the size of the memory
+     * \return 0 on success, an error code otherwise
+     */
+    virtual size_t memory(void* /*data*/, size_t& /*physical*/, size_t& /*size*/){
+        return std::ERROR_UNSUPPORTED;
+    }
 };
 
 struct devfs_file_system final : vfs::file_system {
@@ -160,6 +181,16 @@ struct devfs_file_system final : vfs::file_system {
      */
     size_t rm(const path& file_path) override;
 
+    /*!
+     * \copydoc vfs::file_system::poll_source
+     */
+    poll::source* poll_source(const path& file_path) override;
+
+    /*!
+     * \copydoc vfs::file_system::memory
+     */
+    size_t memory(const path& file_path, size_t& physical, size_t& size) override;
+
 private:
     path mount_point;
 };
@@ -15,13 +15,95 @@
 
 #include <tlib/fat32_specs.hpp>
 
+#include "conc/spinlock.hpp"
+#include "conc/mutex.hpp"
+
 #include "disks.hpp"
+#include "work_queue.hpp"
 #include "vfs/file_system.hpp"
 
 namespace fat32 {
 
 typedef const disks::disk_descriptor& dd;
 
+constexpr const size_t READAHEAD_STREAMS = 8;  ///< The number of files whose reads are tracked
+constexpr const size_t READAHEAD_REQUESTS = 4; ///< The number of pending prefetches
+constexpr const size_t EXTENT_MAPS = 8;        ///< The number of files whose cluster chain is mapped
+constexpr const size_t DIRECTORY_INDEXES = 8;  ///< The number of directories whose names are indexed
+constexpr const size_t INDEX_MIN_BUCKETS = 16; ///< The minimum number of buckets of a directory index
+constexpr const uint32_t NO_INDEX_ENTRY = 0xFFFFFFFF; ///< Marks the end of a bucket of a directory index
+
+/*!
+ * \brief The readahead state of a file
+ */
+struct readahead_stream {
+    uint32_t location;  ///< The first cluster of the file, 0 if unused
+    size_t next_offset; ///< The offset following the last read
+    size_t ahead;       ///< The index of the first cluster not prefetched
+    size_t window;      ///< The number of clusters to prefetch, 0 after a random access
+    uint64_t last_use;  ///< The time of the last read, for replacement
+};
+
+/*!
+ * \brief A run of contiguous clusters of a file
+ */
+struct extent {
+    uint32_t index;   ///< The index of the first cluster of the run in the file
+    uint32_t cluster; ///< The first cluster of the run
+    uint32_t length;  ///< The number of clusters of the run
+};
+
+/*!
+ * \brief The runs of clusters of a file, mapped lazily from its chain
+ */
+struct extent_map {
+    uint32_t location;           ///< The first cluster of the file, 0 if unused
+    bool complete;               ///< Indicates if the end of the chain is mapped
+    uint64_t generation;         ///< The generation of the FAT the map is valid for
+    uint64_t last_use;           ///< The time of the last lookup, for replacement
+    std::vector<extent> extents; ///< The runs, sorted by index
+};
+
+/*!
+ * \brief A file of an indexed directory
+ */
+struct index_entry {
+    size_t hash;    ///< The hash of the name
+    uint32_t next;  ///< The next entry of the bucket
+    vfs::file file; ///< The file, with its position in the directory
+};
+
+/*!
+ * \brief The files of a directory, hashed by name, built on the first
+ * lookup in the directory and kept up to date by its modifications
+ */
+struct directory_index {
+    uint32_t location;                ///< The first cluster of the directory, 0 if unused
+    uint64_t last_use;                ///< The time of the last lookup, for replacement
+    uint32_t last_cluster;            ///< The last cluster of the chain of the directory
+    size_t clusters;                  ///< The number of clusters of the chain of the directory
+    std::vector<uint32_t> buckets;    ///< The first entry of each bucket, a power of two
+    std::vector<index_entry> entries; ///< The files of the directory
+};
+
+/*!
+ * \brief The operation of a transfer of file contents
+ */
+enum class file_operation {
+    READ,
+    WRITE,
+    CLEAR
+};
+
+/*!
+ * \brief A request to prefetch clusters of a file
+ */
+struct readahead_request {
+    uint32_t cluster; ///< A cluster of the file
+    size_t skip;      ///< The number of clusters to skip after this one
+    size_t count;     ///< The number of clusters to prefetch
+};
+
 struct fat32_file_system final : vfs::file_system {
     fat32_file_system(path mount_point, path device);
     ~fat32_file_system();
@@ -53,6 +135,26 @@ struct fat32_file_system final : vfs::file_system {
      */
     size_t clear(const path& file_path, size_t count, size_t offset, size_t& written) override;
 
+    /*!
+     * \copydoc vfs::file_system::resolve
+     */
+    size_t resolve(vfs::open_file& file) override;
+
+    /*!
+     * \copydoc vfs::file_system::read
+     */
+    size_t read(vfs::open_file& file, char* buffer, size_t count, size_t offset, size_t& read) override;
+
+    /*!
+     * \copydoc vfs::file_system::write
+     */
+    size_t write(vfs::open_file& file, const char* buffer, size_t count, size_t offset, size_t& written) override;
+
+    /*!
+     * \copydoc vfs::file_system::clear
+     */
+    size_t clear(vfs::open_file& file, size_t count, size_t offset, size_t& written) override;
+
     /*!
      * \copydoc vfs::file_system::truncate
      */
@@ -83,34 +185,104 @@ struct fat32_file_system final : vfs::file_system {
      */
     size_t rm(const path& file_path) override;
 
+    /*!
+     * \brief Execute the pending readahead requests, from the work queue
+     */
+    void prefetch();
+
 private:
+    size_t read_file(uint32_t location, size_t file_size, char* buffer, size_t count, size_t offset, size_t& read);
+    size_t write_file(uint32_t location, size_t file_size, const char* buffer, size_t count, size_t offset, size_t& written);
+    size_t clear_file(uint32_t location, size_t file_size, size_t count, size_t offset, size_t& written);
+
     size_t rm_dir(uint32_t parent_cluster_number, size_t position, uint32_t cluster_number);
     size_t rm_file(uint32_t parent_cluster_number, size_t position, uint32_t cluster_number);
 
-    size_t change_directory_entry(uint32_t parent_cluster_number, size_t position, const std::function<void(cluster_entry&)>& functor);
+    size_t change_directory_entry(uint32_t parent_cluster_number, const std::string& name, size_t position, std::function_ref<void(cluster_entry&)> functor);
 
-    cluster_entry* find_free_entry(std::unique_heap_array<cluster_entry>& directory_cluster, size_t entries, uint32_t& cluster_number);
+    size_t add_directory_entry(uint32_t parent_cluster_number, const std::string& name, uint32_t cluster, bool directory);
+    cluster_entry* find_free_entry(std::unique_heap_array<cluster_entry>& directory_cluster, size_t entries, uint32_t& cluster_number, size_t& cluster_index);
     cluster_entry* extend_directory(std::unique_heap_array<cluster_entry>& directory_cluster, size_t entries, uint32_t& cluster_number);
 
     std::vector<vfs::file> files(const path& path, size_t last = 0);
     std::pair<bool, uint32_t> find_cluster_number(const path& path, size_t last = 0);
+    size_t find_file(uint32_t cluster_number, const std::string& name, size_t name_hash, vfs::file& file);
     std::vector<vfs::file> files(uint32_t cluster_number);
+    std::vector<vfs::file> files(uint32_t cluster_number, uint32_t& last_cluster, size_t& clusters);
+    void fill_file(vfs::file& file, const cluster_entry& entry);
+
+    directory_index* get_index(uint32_t cluster_number);
+    directory_index* find_index(uint32_t cluster_number);
+    uint32_t index_find(const directory_index& index, const std::string& name);
+    void index_insert(directory_index& index, const vfs::file& file);
+    void index_remove(directory_index& index, const std::string& name);
+    void index_rehash(directory_index& index, size_t count);
 
     bool write_is();
     uint64_t cluster_lba(uint64_t cluster);
+    uint32_t file_cluster(uint32_t location, size_t index, size_t& contiguous);
+    size_t transfer(uint32_t location, size_t first, size_t last, file_operation operation, char* buffer, size_t& transferred, uint32_t& last_cluster);
+
+    uint32_t* fat_entry(uint32_t cluster);
+    bool flush_fat();
     uint32_t read_fat_value(uint32_t cluster);
     bool write_fat_value(uint32_t cluster, uint32_t value);
     uint32_t next_cluster(uint32_t cluster);
-    uint32_t find_free_cluster();
+    uint32_t find_free_cluster(uint32_t hint = 0);
+    uint32_t find_free_run(uint32_t hint, size_t count);
+    void build_free_map();
+    bool cluster_free(uint32_t cluster) const;
+    void set_cluster_free(uint32_t cluster, bool free);
+
+    void readahead(uint32_t location, size_t file_size, size_t offset, size_t count, uint32_t cluster_number, size_t cluster);
+    readahead_stream& find_stream(uint32_t location);
 
     bool read_sectors(uint64_t start, uint8_t count, void* destination);
     bool write_sectors(uint64_t start, uint8_t count, void* source);
 
+    /*!
+     * \brief Write back the modified pages of the FAT when leaving the scope
+     */
+    struct fat_batch {
+        fat32_file_system& fs; ///< The file system
+        ~fat_batch();
+    };
+
     path mount_point;
     path device;
 
     fat_bs_t* fat_bs = nullptr;
     fat_is_t* fat_is = nullptr;
+
+    mutex fat_lock;                       ///< The lock of the loading and the write back of the FAT
+    std::vector<uint32_t*> fat_pages;     ///< The resident pages of the FAT, nullptr until loaded
+    std::vector<uint8_t> fat_dirty;       ///< Indicates which pages of the FAT are modified
+    volatile size_t fat_dirty_pages = 0;  ///< The number of modified pages of the FAT
+    volatile uint64_t fat_generation = 0; ///< Incremented at each modification of the FAT
+    volatile size_t entries_generation = 1; ///< Incremented at each change of an existing directory entry
+
+    std::vector<uint64_t> free_map;       ///< The bitmap of the clusters, a set bit for a free cluster
+    size_t clusters = 0;                  ///< The number of cluster numbers, including the two reserved ones
+    size_t free_clusters = 0;             ///< The number of free clusters
+    size_t next_free = 2;                 ///< The cluster where the next-fit allocation starts
+
+    mutex extent_lock;                    ///< The lock of the extent maps
+    extent_map extent_maps[EXTENT_MAPS];  ///< The cluster chains of the files accessed recently
+    uint64_t extent_clock = 0;            ///< The number of lookups in the extent maps
+
+    mutex index_lock;                             ///< The lock of the directory indexes
+    directory_index indexes[DIRECTORY_INDEXES];  ///< The names of the directories accessed recently
+    uint64_t index_clock = 0;                     ///< The number of lookups in the directory indexes
+
+    spinlock readahead_lock;                        ///< The lock of the streams and the requests
+    readahead_stream streams[READAHEAD_STREAMS];    ///< The files read recently
+    readahead_request requests[READAHEAD_REQUESTS]; ///< The ring of pending prefetches
+    size_t requests_head = 0;                       ///< The index of the next request to prefetch
+    size_t requests_tail = 0;                       ///< The index of the next request to submit
+    uint64_t readahead_clock = 0;                   ///< The number of reads tracked
+    work_queue::work readahead_work;                ///< The work prefetching the clusters
+    volatile bool readahead_running = false;        ///< Indicates if the prefetch is running
+    char* readahead_buffer = nullptr;               ///< The buffer of the prefetched clusters
 };
 
 }
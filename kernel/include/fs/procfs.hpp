@@ -16,6 +16,12 @@
 
 #include "vfs/file_system.hpp"
 
+namespace scheduler {
+
+struct process_table;
+
+} // end of namespace scheduler
+
 namespace procfs {
 
 struct procfs_file_system final : vfs::file_system {
@@ -81,7 +87,7 @@ private:
     path mount_point;
 };
 
-void set_pcb(const scheduler::process_control_t* pcb);
+void set_pcb(const scheduler::process_table* pcb);
 
 } // end of namespace procfs
 
@@ -75,17 +75,55 @@ struct sysfs_file_system final : vfs::file_system {
      */
     size_t rm(const path& file_path) override;
 
+    /*!
+     * \copydoc vfs::file_system::resolve
+     */
+    size_t resolve(vfs::open_file& file) override;
+
+    /*!
+     * \copydoc vfs::file_system::read
+     */
+    size_t read(vfs::open_file& file, char* buffer, size_t count, size_t offset, size_t& read) override;
+
+    /*!
+     * \copydoc vfs::file_system::write
+     */
+    size_t write(vfs::open_file& file, const char* buffer, size_t count, size_t offset, size_t& written) override;
+
 private:
+    size_t resolve_locked(vfs::open_file& file);
+
     path mount_point;
 };
 
 using dynamic_fun_t = std::string (*)();
 using dynamic_fun_data_t = std::string (*)(void*);
+using store_fun_data_t = size_t (*)(void*, const std::string&); ///< Store a written value, returns 0 or an error code
+using counter_fun_t = uint64_t (*)();
+using counter_fun_data_t = uint64_t (*)(void*);
 
 void set_constant_value(const path& mount_point, const path& file_path, const std::string& value);
 void set_dynamic_value(const path& mount_point, const path& file_path, dynamic_fun_t fun);
 void set_dynamic_value_data(const path& mount_point, const path& file_path, dynamic_fun_data_t fun, void* data);
 
+/*!
+ * \brief Set a dynamic value that can also be written, the written text
+ * is given to the store function up to the first new line.
+ */
+void set_writable_value_data(const path& mount_point, const path& file_path, dynamic_fun_data_t fun, store_fun_data_t store, void* data);
+
+/*!
+ * \brief Set a dynamic numeric value, it is formatted directly in the
+ * buffer of the reader, without allocation
+ */
+void set_counter_value(const path& mount_point, const path& file_path, counter_fun_t fun);
+
+/*!
+ * \brief Set a dynamic numeric value computed from the given data, it is
+ * formatted directly in the buffer of the reader, without allocation
+ */
+void set_counter_value_data(const path& mount_point, const path& file_path, counter_fun_data_t fun, void* data);
+
 void delete_value(const path& mount_point, const path& file_path);
 void delete_folder(const path& mount_point, const path& file_path);
 
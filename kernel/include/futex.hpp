@@ -0,0 +1,39 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+namespace futex {
+
+/*!
+ * \brief Block the current process while the word at the given address
+ * still has the given value.
+ *
+ * The words are identified by their physical address, the processes
+ * sharing a page can wait and wake on the same word.
+ *
+ * \param address The address of the word, in the process, aligned on 4 bytes
+ * \param value The value of the word expected by the process
+ * \param ms The maximum time to wait, in milliseconds, 0 to wait indefinitely
+ * \return nothing once woken up, ERROR_WOULD_BLOCK if the word changed
+ * before, ERROR_TIMEOUT if the time is passed
+ */
+std::expected<void> wait(const volatile uint32_t* address, uint32_t value, size_t ms);
+
+/*!
+ * \brief Wake up at most n processes waiting on the word at the given address
+ * \return the number of woken up processes
+ */
+std::expected<size_t> wake(const volatile uint32_t* address, size_t n);
+
+} //end of namespace futex
+
+#endif
@@ -14,8 +14,28 @@ namespace gdt {
 
 void flush_tss();
 
+/*!
+ * \brief Create and load the GDT and the TSS of an application processor.
+ *
+ * The GDT is a copy of the boot GDT with its own TSS.
+ */
+void init_cpu(size_t cpu);
+
+/*!
+ * \brief Returns the TSS of the current processor
+ */
 task_state_segment_t& tss();
 
+constexpr const uint8_t FAULT_IST = 1; ///< The interrupt stack of the double faults
+
+/*!
+ * \brief Give the processor its own stack for the double faults.
+ *
+ * A fault on a full kernel stack cannot push its frame, the double
+ * fault is then handled on this stack.
+ */
+void init_fault_stack(size_t cpu);
+
 } //end of namespace gdt
 
 #endif
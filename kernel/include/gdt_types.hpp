@@ -17,7 +17,8 @@ constexpr const uint16_t DATA_SELECTOR = 0x10;
 constexpr const uint16_t LONG_SELECTOR = 0x18;
 constexpr const uint16_t USER_CODE_SELECTOR = 0x20;
 constexpr const uint16_t USER_DATA_SELECTOR = 0x28;
-constexpr const uint16_t TSS_SELECTOR = 0x30;
+constexpr const uint16_t SYSRET_CODE_SELECTOR = 0x30; ///< The user code selector loaded by SYSRET
+constexpr const uint16_t TSS_SELECTOR = 0x38;
 
 //Selector types
 constexpr const uint16_t SEG_DATA_RD         = 0x00; ///< Read-Only
@@ -49,6 +50,11 @@ struct gdt_ptr {
     uint32_t pointer;
 } __attribute__ ((packed));
 
+struct gdt_ptr_64 {
+    uint16_t length;
+    uint64_t pointer;
+} __attribute__ ((packed));
+
 struct gdt_descriptor_t {
     unsigned int limit_low      : 16;
     unsigned int base_low       : 24;
@@ -9,12 +9,22 @@
 #define INTERRUPTS_H
 
 #include <types.hpp>
+#include <string.hpp>
 
 namespace interrupt {
 
 constexpr const size_t SYSCALL_FIRST = 50;
 constexpr const size_t SYSCALL_MAX = 10;
 
+constexpr const size_t APIC_FIRST = 60;    ///< The first vector of the local APIC interrupts, after the system calls
+constexpr const size_t APIC_MAX = 3;       ///< The number of local APIC interrupts
+constexpr const size_t APIC_SPURIOUS = 63; ///< The vector of the spurious local APIC interrupt
+
+constexpr const size_t MSI_FIRST = 64; ///< The first vector of the message signaled interrupts
+constexpr const size_t MSI_MAX = 32;   ///< The number of message signaled interrupts
+
+constexpr const size_t HISTOGRAM_BUCKETS = 8; ///< The buckets of the handler durations, from 1K cycles by powers of 4
+
 struct fault_regs {
     uint64_t rbp;
     uint64_t error_no;
@@ -26,6 +36,36 @@ struct fault_regs {
     uint64_t ss;
 } __attribute__((packed));
 
+/*!
+ * \brief The registers saved by the page fault handler, which can
+ * return to the faulting code
+ */
+struct page_fault_regs {
+    sse_128 xmm_registers[16];
+    uint64_t rax;
+    uint64_t rbx;
+    uint64_t rcx;
+    uint64_t rdx;
+    uint64_t rsi;
+    uint64_t rdi;
+    uint64_t r8;
+    uint64_t r9;
+    uint64_t r10;
+    uint64_t r11;
+    uint64_t r12;
+    uint64_t r13;
+    uint64_t r14;
+    uint64_t r15;
+    uint64_t rbp;
+    uint64_t error_no;
+    uint64_t error_code;
+    uint64_t rip;
+    uint64_t cs;
+    uint64_t rflags;
+    uint64_t rsp;
+    uint64_t ss;
+} __attribute__((packed));
+
 struct syscall_regs {
     sse_128 xmm_registers[16];
     uint64_t rax;
@@ -53,8 +93,54 @@ struct syscall_regs {
 
 void setup_interrupts();
 
+/*!
+ * \brief Load the IDT on an application processor
+ */
+void setup_ap_interrupts();
+
 bool register_irq_handler(size_t irq, void (*handler)(syscall_regs*, void*), void* data);
+/*!
+ * \brief Returns the number of times the given IRQ has been received by
+ * the given processor
+ */
+uint64_t irq_count(size_t irq, size_t cpu);
+
+/*!
+ * \brief Returns the statistics of the interrupts, for /proc/interrupts.
+ *
+ * There is one line per IRQ, local APIC interrupt and registered message
+ * signaled interrupt, with the count of each processor, the longest
+ * handler and the histogram of the handler durations, in cycles. With
+ * THOR_CONFIG_IRQ_STAT, the longest section of each processor with the
+ * interrupts disabled by an int_lock follows, with its call site.
+ */
+std::string format_stats();
+
+#ifdef THOR_CONFIG_IRQ_STAT
+
+/*!
+ * \brief Account a section of the current processor with the interrupts
+ * disabled by the int_lock at the given site since the given cycle
+ */
+void irqs_off(uintptr_t site, uint64_t start);
+
+#endif
+
 bool register_syscall_handler(size_t irq, void (*handler)(syscall_regs*));
+bool register_apic_handler(size_t irq, void (*handler)(syscall_regs*, void*), void* data);
+
+/*!
+ * \brief Register a handler on a free message signaled interrupt
+ * \param vector Output reference to the vector of the interrupt, to program in the device
+ * \return true if the handler was registered, false if there is no free interrupt
+ */
+bool register_msi_handler(size_t& vector, void (*handler)(syscall_regs*, void*), void* data);
+
+/*!
+ * \brief Release a message signaled interrupt, for instance when the
+ * device cannot be programmed to use it
+ */
+bool unregister_msi_handler(size_t vector);
 
 bool unregister_irq_handler(size_t irq, void (*handler)(syscall_regs*, void*));
 bool unregister_syscall_handler(size_t irq, void (*handler)(syscall_regs*));
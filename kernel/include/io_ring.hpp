@@ -0,0 +1,42 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "tlib/io_ring_constants.hpp"
+
+#include "process.hpp"
+
+namespace io_ring {
+
+/*!
+ * \brief Map the rings of the current process, created on the first call
+ * \return the address of the rings in the process
+ */
+std::expected<size_t> setup();
+
+/*!
+ * \brief Execute the submissions of the current process
+ * \param n The maximum number of submissions to consume
+ * \param wait The number of completions to wait for in the ring
+ * \param ms The maximum time to wait, in milliseconds, 0 to wait indefinitely
+ * \return the number of consumed submissions
+ */
+std::expected<size_t> enter(size_t n, size_t wait, size_t ms);
+
+/*!
+ * \brief Release the rings of a terminated process
+ */
+void release(scheduler::pid_t pid);
+
+} //end of namespace io_ring
+
+#endif
@@ -27,6 +27,44 @@ void _irq13();
 void _irq14();
 void _irq15();
 
+void _apic_irq0();
+void _apic_irq1();
+void _apic_irq2();
+void _apic_spurious();
+
+void _msi_irq0();
+void _msi_irq1();
+void _msi_irq2();
+void _msi_irq3();
+void _msi_irq4();
+void _msi_irq5();
+void _msi_irq6();
+void _msi_irq7();
+void _msi_irq8();
+void _msi_irq9();
+void _msi_irq10();
+void _msi_irq11();
+void _msi_irq12();
+void _msi_irq13();
+void _msi_irq14();
+void _msi_irq15();
+void _msi_irq16();
+void _msi_irq17();
+void _msi_irq18();
+void _msi_irq19();
+void _msi_irq20();
+void _msi_irq21();
+void _msi_irq22();
+void _msi_irq23();
+void _msi_irq24();
+void _msi_irq25();
+void _msi_irq26();
+void _msi_irq27();
+void _msi_irq28();
+void _msi_irq29();
+void _msi_irq30();
+void _msi_irq31();
+
 } //end of extern "C"
 
 #endif
@@ -16,6 +16,12 @@ void init();
 void finalize();
 
 void* k_malloc(uint64_t bytes);
+
+/*!
+ * \brief Allocate a block, attributed to the given caller by the allocation profiler
+ */
+void* k_malloc(uint64_t bytes, void* caller);
+
 void k_free(void* block);
 
 template<typename T>
@@ -0,0 +1,37 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*
+ * This header contains the format of the compressed kernel image, written
+ * by tools/lz4pack and unpacked by the init stage
+ */
+
+#ifndef KERNEL_IMAGE_H
+#define KERNEL_IMAGE_H
+
+#include <types.hpp>
+
+namespace kernel_image {
+
+constexpr const uint32_t LZ4_MAGIC = 0x4B345A4C; ///< "LZ4K", the magic of a compressed image
+
+/*!
+ * \brief The header of a compressed image, followed by the LZ4 block of
+ * the raw kernel
+ */
+struct lz4_header {
+    uint32_t magic;           ///< LZ4_MAGIC
+    uint32_t size;            ///< The size of the raw kernel
+    uint32_t compressed_size; ///< The size of the LZ4 block
+    uint32_t reserved;        ///< Unused, zero
+} __attribute__((packed));
+
+static_assert(sizeof(lz4_header) == 16, "The compressed image header must be 16 bytes long");
+
+} //end of namespace kernel_image
+
+#endif
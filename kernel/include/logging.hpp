@@ -12,6 +12,32 @@
 #ifndef LOGGING_HPP
 #define LOGGING_HPP
 
+// The minimum level of the logs compiled in, 0 (TRACE) to 4 (USER)
+#ifndef THOR_CONFIG_LOG_LEVEL
+#define THOR_CONFIG_LOG_LEVEL 0
+#endif
+
+// Each subsystem can raise its own minimum level
+#ifndef THOR_CONFIG_LOG_LEVEL_SCHEDULER
+#define THOR_CONFIG_LOG_LEVEL_SCHEDULER THOR_CONFIG_LOG_LEVEL
+#endif
+
+#ifndef THOR_CONFIG_LOG_LEVEL_NET
+#define THOR_CONFIG_LOG_LEVEL_NET THOR_CONFIG_LOG_LEVEL
+#endif
+
+#ifndef THOR_CONFIG_LOG_LEVEL_TCP
+#define THOR_CONFIG_LOG_LEVEL_TCP THOR_CONFIG_LOG_LEVEL
+#endif
+
+#ifndef THOR_CONFIG_LOG_LEVEL_ARP
+#define THOR_CONFIG_LOG_LEVEL_ARP THOR_CONFIG_LOG_LEVEL
+#endif
+
+#ifndef THOR_CONFIG_LOG_LEVEL_NIC
+#define THOR_CONFIG_LOG_LEVEL_NIC THOR_CONFIG_LOG_LEVEL
+#endif
+
 namespace logging {
 
 enum class log_level : char {
@@ -22,11 +48,50 @@ enum class log_level : char {
     USER
 };
 
+/*!
+ * \brief The subsystems whose logs can be filtered
+ */
+enum class subsystem : size_t {
+    SCHEDULER,
+    NET,       ///< The network layers and sockets
+    TCP,
+    ARP,
+    NIC,       ///< The network card drivers
+    COUNT
+};
+
+extern volatile log_level subsystem_levels[size_t(subsystem::COUNT)]; ///< The runtime minimum level of each subsystem
+
+/*!
+ * \brief Returns the minimum level of the logs of the subsystem compiled in
+ */
+constexpr log_level compiled_level(subsystem s){
+    return s == subsystem::SCHEDULER ? log_level(THOR_CONFIG_LOG_LEVEL_SCHEDULER)
+         : s == subsystem::NET       ? log_level(THOR_CONFIG_LOG_LEVEL_NET)
+         : s == subsystem::TCP       ? log_level(THOR_CONFIG_LOG_LEVEL_TCP)
+         : s == subsystem::ARP       ? log_level(THOR_CONFIG_LOG_LEVEL_ARP)
+         :                             log_level(THOR_CONFIG_LOG_LEVEL_NIC);
+}
+
+/*!
+ * \brief Indicates if a log of the subsystem at the given level is output.
+ *
+ * With a constant level below the compiled level, this is constant false.
+ */
+inline bool enabled(subsystem s, log_level level){
+    return level >= compiled_level(s) && level >= subsystem_levels[size_t(s)];
+}
+
 bool is_early();
 bool is_file();
 void finalize();
 void to_file();
 
+/*!
+ * \brief Export the runtime level of each subsystem in /sys/logging/level/
+ */
+void export_levels();
+
 void log(log_level level, const char* s);
 void log(log_level level, const std::string& s);
 void logf(log_level level, const char* s, va_list va);
@@ -34,4 +99,18 @@ void logf(log_level level, const char* s, ...);
 
 } //end of namespace logging
 
+/*!
+ * \brief Log a formatted message of a subsystem, for instance
+ * subsystem_logf(TCP, TRACE, "tcp: ...", ...)
+ *
+ * The arguments are only evaluated and formatted if the level is enabled,
+ * the call is removed if the level is below the compiled level.
+ */
+#define subsystem_logf(sub, level, ...)                                                               \
+    do {                                                                                              \
+        if(logging::enabled(logging::subsystem::sub, logging::log_level::level)){                     \
+            logging::logf(logging::log_level::level, __VA_ARGS__);                                    \
+        }                                                                                             \
+    } while(false)
+
 #endif
@@ -9,13 +9,16 @@
 #define NET_ARP_CACHE_H
 
 #include <types.hpp>
-#include <vector.hpp>
+#include <deque.hpp>
 #include <expected.hpp>
 
 #include "tlib/net_constants.hpp"
 
+#include "conc/spinlock.hpp"
+
 #include "net/ip_layer.hpp"
 #include "net/interface.hpp"
+#include "net/packet.hpp"
 
 namespace network {
 
@@ -27,30 +30,53 @@ namespace arp {
 
 struct layer;
 
+/*!
+ * \brief The state of a neighbor
+ */
+enum class neighbor_state {
+    INCOMPLETE, ///< A request has been sent, there is no answer yet
+    REACHABLE,  ///< The MAC address has been confirmed recently
+    STALE       ///< The MAC address is still used, but must be confirmed again
+};
+
 /*!
  * \brief An entry in the ARP cache
  */
 struct cache_entry {
-    uint64_t mac;            ///< The MAC address
-    network::ip::address ip; ///< The IP address
+    network::ip::address ip;  ///< The IP address
+    uint64_t mac = 0;         ///< The MAC address, if not incomplete
+    neighbor_state state;     ///< The state of the neighbor
+    uint64_t confirmed = 0;   ///< The time of the last answer, in milliseconds
+    uint64_t requested = 0;   ///< The time of the last request, in milliseconds
+    uint64_t used = 0;        ///< The time of the last use, in milliseconds
+    size_t requests = 0;      ///< The number of requests without answer
+    size_t interface = 0;     ///< The interface of the neighbor
 
-    /*!
-     * \brief Construct a new empty cache entry
-     */
-    cache_entry(){}
+    std::deque<network::packet_p> pending; ///< The packets waiting for the MAC address
+
+    cache_entry* next = nullptr; ///< The next entry of the bucket
 
     /*!
      * \brief Construct a new cache entry
-     * \param mac The MAC address
      * \param ip The IP address
+     * \param state The initial state
      */
-    cache_entry(uint64_t mac, network::ip::address ip) : mac(mac), ip(ip) {}
+    cache_entry(network::ip::address ip, neighbor_state state) : ip(ip), state(state) {}
 };
 
 /*!
- * \brief An ARP cache
+ * \brief An ARP cache.
+ *
+ * The neighbors are hashed by IP address. A miss never blocks the sender:
+ * the packets are queued on the incomplete neighbor and sent when the
+ * answer arrives. The entries age from reachable to stale and are
+ * released once unused.
  */
 struct cache {
+    static constexpr size_t buckets = 64;      ///< The number of buckets of the table
+    static constexpr size_t max_entries = 512; ///< The maximum number of neighbors
+    static constexpr size_t max_pending = 8;   ///< The maximum number of packets waiting for a neighbor
+
     /*!
      * \brief Construct a new cache.
      * \param layer The ARP layer
@@ -58,67 +84,60 @@ struct cache {
      */
     cache(network::arp::layer* layer, network::ethernet::layer* parent);
 
+    cache(const cache& rhs) = delete;
+    cache& operator=(const cache& rhs) = delete;
+
     /*!
-     * \brief Update the cache entry for the given MAC address
+     * \brief Update the cache entry with an answer from the neighbor and
+     * send the packets waiting for it
+     * \param interface The interface on which the answer was received
      * \param mac The MAC address
      * \param ip The IP address
+     * \param create Create the entry if the neighbor is not known yet
      */
-    void update_cache(uint64_t mac, network::ip::address ip);
+    void update_cache(network::interface_descriptor& interface, uint64_t mac, network::ip::address ip, bool create);
 
     /*!
-     * \brief Indicates if the given MAC address is cached or not
-     */
-    bool is_mac_cached(uint64_t mac) const ;
-
-    /*!
-     * \brief Indicates if the given IP address is cached or not
-     */
-    bool is_ip_cached(network::ip::address ip) const ;
-
-    /*!
-     * \brief Returns the IP address of the given MAC address.
-     * The address must be in cache.
-     * \param ip The MAC address to look for in the cache
-     * \return The IP address of the MAC address
-     */
-    network::ip::address get_ip(uint64_t mac) const ;
-
-    /*!
-     * \brief Returns the MAC address of the given IP address.
-     * The address must be in cache.
+     * \brief Look for the MAC address of the given IP address. If it is
+     * not known, the resolution is started and the packets for this
+     * neighbor must be given to send_pending.
+     * \param interface The network interface to use
      * \param ip The IP address to look for in the cache
-     * \return The MAC address of the IP address
+     * \param mac The MAC address, if it is known
+     * \return true if the MAC address is known, false otherwise
      */
-    uint64_t get_mac(network::ip::address ip) const ;
+    bool lookup(network::interface_descriptor& interface, network::ip::address ip, uint64_t& mac);
 
     /*!
-     * \brief Returns the MAC address of the given IP address. If the
-     * address is not cached a request will be generated and it will
-     * wait for the answer (may stall indefinitely).
+     * \brief Send a finalized packet prepared before its neighbor was
+     * resolved. The packet waits for the answer if the neighbor is still
+     * incomplete.
      * \param interface The network interface to use
-     * \param ip The IP address to look for in the cache
-     * \return The MAC address of the IP address
+     * \param packet The packet, with a kernel payload
+     * \return Nothing or an error if the neighbor could not be resolved
      */
-    std::expected<uint64_t> get_mac_force(network::interface_descriptor& interface, network::ip::address ip);
+    std::expected<void> send_pending(network::interface_descriptor& interface, network::packet_p& packet);
 
     /*!
-     * \brief Returns the MAC address of the given IP address. If the
-     * address is not cached a request will be generated and it will
-     * wait for the answer or until the timeout (in ms) is reached.
-     * \param interface The network interface to use
-     * \param ip The IP address to look for in the cache
-     * \param ms The maximum time, in milliseconds, to wait
-     * \return The MAC address of the IP address
+     * \brief Returns the number of neighbors
      */
-    std::expected<uint64_t> get_mac_force(network::interface_descriptor& interface, network::ip::address ip, size_t ms);
+    size_t size() const;
 
 private:
     std::expected<void> arp_request(network::interface_descriptor& interface, network::ip::address ip);
 
+    cache_entry* find(network::ip::address ip);
+    cache_entry* insert(network::ip::address ip, neighbor_state state);
+    void age(uint64_t now);
+    void remove(cache_entry* entry);
+
     network::arp::layer* arp_layer; ///< The ARP layer
     network::ethernet::layer* ethernet_layer; ///< The ethernet layer
 
-    std::vector<cache_entry> mac_cache; ///< The cache of MAC addresses
+    mutable spinlock lock;         ///< The lock protecting the table
+    cache_entry* table[buckets];   ///< The neighbors, hashed by IP address
+    size_t entries = 0;            ///< The number of neighbors
+    uint64_t last_aging = 0;       ///< The time of the last aging pass
 };
 
 } // end of arp namespace
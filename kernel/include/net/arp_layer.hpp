@@ -10,8 +10,6 @@
 
 #include <types.hpp>
 
-#include "conc/condition_variable.hpp"
-
 #include "tlib/net_constants.hpp"
 
 #include "net/packet.hpp"
@@ -90,21 +88,9 @@ struct layer {
      */
     network::arp::cache& get_cache();
 
-    /*!
-     * \brief Wait for an ARP packet, indefinitely.
-     */
-    void wait_for_reply();
-
-    /*!
-     * \brief Wait for an ARP packet, for the given time
-     */
-    void wait_for_reply(size_t ms);
-
 private:
     network::ethernet::layer* parent; ///< The parent layer (ethernet)
     network::arp::cache _cache; ///< The ARP cache
-
-    condition_variable wait_queue; ///< Wait queue for ARP packets
 };
 
 } // end of arp namespace
@@ -0,0 +1,70 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_CAPTURE_H
+#define NET_CAPTURE_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "tlib/capture_constants.hpp"
+
+#include "net/interface.hpp"
+#include "net/packet.hpp"
+
+namespace network {
+
+namespace capture {
+
+/*!
+ * \brief Register the capture device (/dev/capture)
+ */
+void init();
+
+/*!
+ * \brief Start capturing the frames of all the interfaces
+ * \param config The snap length and the filter
+ * \return nothing or an error
+ */
+std::expected<void> start(const capture_config& config);
+
+/*!
+ * \brief Stop capturing the frames
+ */
+void stop();
+
+/*!
+ * \brief Indicates if a capture is running
+ */
+bool active();
+
+/*!
+ * \brief Copy a frame to the capture ring, if it passes the filter.
+ *
+ * This must only be called from the rx and tx threads, once active() has
+ * been checked.
+ *
+ * \param interface The interface of the frame
+ * \param packet The frame, its payload starts with the ethernet header
+ * \param dir The direction of the frame
+ */
+void record(const network::interface_descriptor& interface, const network::packet& packet, direction dir);
+
+/*!
+ * \brief Capture a frame if a capture is running, nearly free otherwise
+ */
+inline void tap(const network::interface_descriptor& interface, const network::packet& packet, direction dir){
+    if(active()){
+        record(interface, packet, dir);
+    }
+}
+
+} // end of capture namespace
+
+} // end of network namespace
+
+#endif
@@ -10,31 +10,39 @@
 
 #include <types.hpp>
 
+#include "tlib/checksum.hpp"
+
+#include "kernel_utils.hpp"
+
 namespace network {
 
+/*!
+ * \brief Returns the one-complement sum of the big-endian 16-bit words of
+ * a buffer, not folded past 16 bits
+ */
 template<typename T>
 uint32_t checksum_add_bytes(T* values, size_t length){
-    auto raw_values = reinterpret_cast<uint8_t*>(values);
+    return switch_endian_16(checksum_fold_partial(checksum_partial(values, length)));
+}
 
-    uint32_t sum = 0;
+/*!
+ * \brief Copy a buffer and returns the one-complement sum of its big-endian
+ * 16-bit words, like checksum_add_bytes
+ */
+inline uint32_t checksum_copy_add_bytes(char* destination, const char* source, size_t length){
+    return switch_endian_16(checksum_fold_partial(checksum_copy_partial(destination, source, length)));
+}
 
-    for(size_t i = 0; i < length; ++i){
-        if(i & 1){
-            sum += static_cast<uint32_t>(raw_values[i]);
-        } else {
-            sum += static_cast<uint32_t>(raw_values[i]) << 8;
-        }
+inline uint16_t checksum_fold(uint32_t sum){
+    while(sum >> 16){
+        sum = (sum & 0xFFFF) + (sum >> 16);
     }
 
     return sum;
 }
 
 inline uint16_t checksum_finalize(uint32_t sum){
-    while(sum >> 16){
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-
-    return ~sum;
+    return ~checksum_fold(sum);
 }
 
 inline uint16_t checksum_finalize_nz(uint32_t sum){
@@ -47,6 +55,19 @@ inline uint16_t checksum_finalize_nz(uint32_t sum){
     }
 }
 
+// Complete a partial checksum left to the device, the checksum field
+// already holds the sum of the pseudo header
+inline void checksum_complete(char* frame, size_t length, size_t start, size_t offset){
+    if(start + offset + 2 > length){
+        return;
+    }
+
+    auto* field = reinterpret_cast<uint16_t*>(frame + start + offset);
+
+    auto sum = checksum_add_bytes(frame + start, length - start);
+    *field = switch_endian_16(checksum_finalize_nz(sum));
+}
+
 } // end of network namespace
 
 #endif
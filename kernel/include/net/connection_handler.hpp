@@ -8,96 +8,245 @@
 #ifndef NET_CONNECTION_HANDLER_H
 #define NET_CONNECTION_HANDLER_H
 
-#include <list.hpp>
+#include <types.hpp>
+#include <lock_guard.hpp>
+#include <function.hpp>
 
-#include "conc/rw_lock.hpp"
+#include "conc/adaptive_mutex.hpp"
+#include "conc/rcu.hpp"
+#include "conc/qsbr.hpp"
+
+#include "tlib/net_constants.hpp"
 
 namespace network {
 
 /*!
  * \brief A thread-safe collection of network connection (UDP/TCP)
+ *
+ * The connected connections are hashed by their (local port, remote port,
+ * remote address) tuple and the server connections by their port. The
+ * lookups never take a lock, the removed connections are only released
+ * once no lookup can see them anymore.
+ *
+ * The demultiplexing of the packets writes nothing shared (qsbr), the
+ * iterations run functors that may sleep and are protected by a rcu.
+ *
+ * Several server connections can share a port, the packets are then
+ * distributed between them by a hash of their source, so that all the
+ * packets of a client go to the same server.
  */
 template <typename C>
 struct connection_handler {
     using connection_type = C; ///< The type of connnection
 
+    static constexpr size_t buckets = 256; ///< The number of buckets of each table
+
+    connection_handler(){
+        writers.set_name("connections");
+
+        for(size_t i = 0; i < buckets; ++i){
+            connected[i] = nullptr;
+            servers[i] = nullptr;
+        }
+    }
+
+    connection_handler(const connection_handler& rhs) = delete;
+    connection_handler& operator=(const connection_handler& rhs) = delete;
+
     /*!
-     * \brief Get the first connection matching the packet ports
+     * \brief Get the connection matching the packet, the connected
+     * connections first, then one of the servers of the port
      */
-    connection_type* get_connection_for_packet(size_t source_port, size_t target_port) {
-        auto lock = connections_lock.reader_lock();
-        std::lock_guard<reader_rw_lock> l(lock);
-
-        for (auto& connection : connections) {
-            if(connection.server){
-                if (connection.server_port == target_port) {
-                    return &connection;
-                }
-            } else {
-                if (connection.server_port == source_port && connection.local_port == target_port) {
-                    return &connection;
+    connection_type* get_connection_for_packet(size_t source_port, size_t target_port, network::ip::address source) {
+        qsbr_reader r;
+
+        for(auto* n = load(connected[connected_hash(target_port, source_port, source)]); n; n = load(n->next)){
+            if(matches(n->connection, source_port, target_port, source)){
+                return &n->connection;
+            }
+        }
+
+        auto& head = servers[server_hash(target_port)];
+
+        size_t count = 0;
+
+        for(auto* n = load(head); n; n = load(n->next)){
+            count += n->connection.server_port == target_port;
+        }
+
+        if(!count){
+            return nullptr;
+        }
+
+        // The chain may change meanwhile, the last server found is taken then
+        auto pick = flow_hash(source_port, source) % count;
+        connection_type* selected = nullptr;
+
+        for(auto* n = load(head); n; n = load(n->next)){
+            if(n->connection.server_port == target_port){
+                selected = &n->connection;
+
+                if(!pick--){
+                    break;
                 }
             }
         }
 
-        return nullptr;
+        return selected;
     }
 
     /*!
-     * \brief Execute a functor for each connection matcing the packet ports
+     * \brief Indicates if a server connection is bound to the given port
      */
-    template<typename Functor>
-    void for_each_connection_for_packet(size_t source_port, size_t target_port, Functor fun){
-        auto lock = connections_lock.reader_lock();
-        std::lock_guard<reader_rw_lock> l(lock);
-
-        for (auto& connection : connections) {
-            if(connection.server){
-                if (connection.server_port == target_port) {
-                    fun(connection);
-                }
-            } else {
-                if (connection.server_port == source_port && connection.local_port == target_port) {
-                    fun(connection);
-                }
+    bool has_server(size_t port) {
+        qsbr_reader r;
+
+        for(auto* n = load(servers[server_hash(port)]); n; n = load(n->next)){
+            if(n->connection.server_port == port){
+                return true;
             }
         }
+
+        return false;
     }
 
     /*!
-     * \brief Create a new connection
+     * \brief Execute a functor for each connection matcing the packet, the
+     * server connections first
+     */
+    void for_each_connection_for_packet(size_t source_port, size_t target_port, network::ip::address source, std::function_ref<void(connection_type&)> fun){
+        rcu_reader r(lookup);
+
+        for(auto* n = load(servers[server_hash(target_port)]); n; n = load(n->next)){
+            if(n->connection.server_port == target_port){
+                fun(n->connection);
+            }
+        }
+
+        for(auto* n = load(connected[connected_hash(target_port, source_port, source)]); n; n = load(n->next)){
+            if(matches(n->connection, source_port, target_port, source)){
+                fun(n->connection);
+            }
+        }
+    }
+
+    /*!
+     * \brief Execute a functor for each connection
+     */
+    void for_each_connection(std::function_ref<void(connection_type&)> fun){
+        rcu_reader r(lookup);
+
+        for(size_t i = 0; i < buckets; ++i){
+            for(auto* n = load(servers[i]); n; n = load(n->next)){
+                fun(n->connection);
+            }
+
+            for(auto* n = load(connected[i]); n; n = load(n->next)){
+                fun(n->connection);
+            }
+        }
+    }
+
+    /*!
+     * \brief Create a new connection.
+     *
+     * The connection is only visible to the lookups once its ports and
+     * address are set and it is inserted.
      */
     connection_type& create_connection() {
-        auto lock = connections_lock.writer_lock();
-        std::lock_guard<writer_rw_lock> l(lock);
+        return (new node())->connection;
+    }
 
-        return connections.emplace_back();
+    /*!
+     * \brief Make the connection visible to the lookups, with its current
+     * ports and address
+     */
+    void insert_connection(connection_type& connection) {
+        std::lock_guard<adaptive_mutex> l(writers);
+
+        auto* n = to_node(connection);
+        auto& head = bucket(connection);
+
+        n->next = head;
+        n->inserted = true;
+
+        // The node is complete before it is published
+        __atomic_store_n(&head, n, __ATOMIC_RELEASE);
     }
 
     /*!
-     * \brief Remove the connection from the collection
+     * \brief Remove the connection from the collection and release it
      */
     void remove_connection(connection_type& connection) {
-        auto lock = connections_lock.writer_lock();
-        std::lock_guard<writer_rw_lock> l(lock);
+        auto* n = to_node(connection);
+
+        if(n->inserted){
+            std::lock_guard<adaptive_mutex> l(writers);
 
-        auto end = connections.end();
-        auto it  = connections.begin();
+            auto* link = &bucket(connection);
+
+            while(*link && *link != n){
+                link = &(*link)->next;
+            }
 
-        while (it != end) {
-            if (&(*it) == &connection) {
-                connections.erase(it);
-                return;
+            // The lookups in progress can still follow the removed node
+            if(*link){
+                __atomic_store_n(link, n->next, __ATOMIC_RELEASE);
             }
 
-            ++it;
+            lookup.synchronize();
+            qsbr::synchronize();
         }
+
+        delete n;
     }
 
 private:
-    rw_lock connections_lock; ///< The Readers/Writer lock
+    struct node {
+        connection_type connection; ///< The connection, must stay the first member
+        node* next = nullptr;       ///< The next node of the bucket
+        bool inserted = false;      ///< Indicates if the node is in a table
+    };
+
+    static node* load(node* const& pointer){
+        return __atomic_load_n(&pointer, __ATOMIC_ACQUIRE);
+    }
+
+    static node* to_node(connection_type& connection){
+        return reinterpret_cast<node*>(&connection);
+    }
+
+    static size_t connected_hash(size_t local_port, size_t remote_port, network::ip::address remote){
+        auto hash = uint32_t(local_port) * 2654435761U ^ uint32_t(remote_port) * 40503U ^ remote.raw_address * 2246822519U;
+        return (hash ^ (hash >> 16)) & (buckets - 1);
+    }
+
+    static size_t flow_hash(size_t remote_port, network::ip::address remote){
+        auto hash = uint32_t(remote_port) * 40503U ^ remote.raw_address * 2246822519U;
+        return hash ^ (hash >> 16);
+    }
+
+    static size_t server_hash(size_t port){
+        return (port ^ (port >> 8)) & (buckets - 1);
+    }
+
+    static bool matches(const connection_type& connection, size_t source_port, size_t target_port, network::ip::address source){
+        return connection.server_port == source_port && connection.local_port == target_port && connection.server_address == source;
+    }
+
+    node*& bucket(const connection_type& connection){
+        if(connection.server){
+            return servers[server_hash(connection.server_port)];
+        }
+
+        return connected[connected_hash(connection.local_port, connection.server_port, connection.server_address)];
+    }
+
+    adaptive_mutex writers; ///< Serialize the insertions and removals
+    rcu lookup;             ///< Protect the iterations from the removals
 
-    std::list<connection_type> connections; ///< The list of connections
+    node* connected[buckets]; ///< The connected connections
+    node* servers[buckets];   ///< The server connections
 };
 
 } // end of network namespace
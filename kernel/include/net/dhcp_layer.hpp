@@ -50,11 +50,28 @@ struct dhcp_configuration {
     network::ip::address ip_address;      ///< The IP address
     network::ip::address dns_address;     ///< The DNS address
     network::ip::address gateway_address; ///< The gateway address
+    network::ip::address server_address;  ///< The address of the DHCP server
 
     bool dns     = false; ///< Indicates if there is a DNS
     bool gateway = false; ///< Indicates if there is a gateway
+
+    uint32_t lease_time     = 0; ///< The duration of the lease, in seconds
+    uint32_t renewal_time   = 0; ///< The time (T1) after which the lease is renewed with the server, in seconds
+    uint32_t rebinding_time = 0; ///< The time (T2) after which the lease is renewed with any server, in seconds
 };
 
+/*!
+ * \brief Load the lease saved for the interface, with its times reduced by
+ * the time elapsed since it was saved
+ * \return The lease or an error if there is no valid lease
+ */
+std::expected<dhcp_configuration> load_lease(network::interface_descriptor& interface);
+
+/*!
+ * \brief Save the lease of the interface, to be reused at the next boot
+ */
+void save_lease(network::interface_descriptor& interface, const dhcp_configuration& lease);
+
 /*!
  * \brief The DHCP layer implementation
  */
@@ -76,13 +93,41 @@ struct layer {
     void decode(network::interface_descriptor& interface, network::packet_p& packet);
 
     /*!
-     * \brief Request an IP address on the network
+     * \brief Request an IP address on the network, with a full
+     * DISCOVER/OFFER/REQUEST/ACK exchange
      *
      * \param interface The interface for which we want an IP address
      */
     std::expected<dhcp_configuration> request_ip(network::interface_descriptor& interface);
 
+    /*!
+     * \brief Confirm a previous lease after a reboot, with a single
+     * broadcast REQUEST (INIT-REBOOT)
+     *
+     * \param interface The interface of the lease
+     * \param lease The previous lease
+     * \return The confirmed lease, ERROR_INVALID_REQUEST if the server refused
+     * it or ERROR_TIMEOUT if no server answered
+     */
+    std::expected<dhcp_configuration> reboot(network::interface_descriptor& interface, const dhcp_configuration& lease);
+
+    /*!
+     * \brief Extend the current lease of the interface
+     *
+     * \param interface The interface of the lease
+     * \param lease The current lease
+     * \param rebinding If true, the request is broadcast to any server (after
+     * T2), otherwise it is sent to the server of the lease (after T1)
+     * \return The extended lease, ERROR_INVALID_REQUEST if the server refused
+     * it or ERROR_TIMEOUT if no server answered
+     */
+    std::expected<dhcp_configuration> renew(network::interface_descriptor& interface, const dhcp_configuration& lease, bool rebinding);
+
 private:
+    std::expected<void> send(network::interface_descriptor& interface, uint8_t message, network::ip::address destination,
+                             network::ip::address client, network::ip::address requested, network::ip::address server);
+    std::expected<dhcp_configuration> receive(uint8_t message);
+
     network::udp::layer* parent; ///< The parent layer
 
     std::atomic<bool> listening;                    ///< Flag indicating if the kernel is listening for packets
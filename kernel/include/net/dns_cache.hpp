@@ -0,0 +1,146 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_DNS_CACHE_H
+#define NET_DNS_CACHE_H
+
+#include <types.hpp>
+#include <string.hpp>
+#include <expected.hpp>
+
+#include "tlib/net_constants.hpp"
+
+#include "conc/spinlock.hpp"
+#include "conc/wait_list.hpp"
+
+#include "net/packet.hpp"
+
+namespace network {
+
+namespace dns {
+
+struct layer;
+
+/*!
+ * \brief The state of a cached name
+ */
+enum class entry_state {
+    PENDING,  ///< A query has been sent, there is no answer yet
+    RESOLVED, ///< The address of the name is known
+    FAILED    ///< The name does not exist or could not be resolved (negative entry)
+};
+
+/*!
+ * \brief An entry in the DNS cache
+ */
+struct cache_entry {
+    std::string name;             ///< The domain name
+    entry_state state;            ///< The state of the entry
+    network::ip::address address; ///< The address, if resolved
+    size_t error = 0;             ///< The error, if failed
+    uint64_t expires = 0;         ///< The time after which the entry is dropped, in milliseconds
+
+    uint16_t identification = 0; ///< The identification of the pending query
+    uint64_t sent = 0;           ///< The time of the last query, in milliseconds
+    size_t queries = 0;          ///< The number of queries sent
+    size_t max_queries = 0;      ///< The number of queries before giving up
+    size_t timeout = 0;          ///< The time to wait for an answer to a query, in milliseconds
+
+    cache_entry* next = nullptr; ///< The next entry of the bucket
+
+    /*!
+     * \brief Construct a new pending cache entry
+     * \param name The domain name
+     */
+    cache_entry(const std::string& name) : name(name), state(entry_state::PENDING) {}
+};
+
+/*!
+ * \brief A DNS resolver cache.
+ *
+ * The names are hashed and kept for the TTL of their records. The names
+ * that do not exist are cached as well (negative caching). Only one query
+ * is sent for a name: the concurrent lookups wait for the answer of the
+ * pending query, the first lookup giving the timeout of the queries.
+ */
+struct cache {
+    static constexpr size_t buckets = 64;      ///< The number of buckets of the table
+    static constexpr size_t max_entries = 256; ///< The maximum number of names
+
+    /*!
+     * \brief Construct a new cache.
+     * \param layer The DNS layer, used to send the queries
+     */
+    cache(network::dns::layer* layer);
+    ~cache();
+
+    cache(const cache& rhs) = delete;
+    cache& operator=(const cache& rhs) = delete;
+
+    /*!
+     * \brief Resolve a name to an IPv4 address.
+     *
+     * The cache is used if possible, otherwise a query is sent (or the
+     * pending query for this name is waited for).
+     *
+     * \param name The domain name
+     * \param timeout_ms The time to wait for an answer to a query
+     * \param retries The number of queries to send before giving up
+     * \return The address or an error
+     */
+    std::expected<network::ip::address> resolve(const std::string& name, size_t timeout_ms, size_t retries);
+
+    /*!
+     * \brief Handle a DNS response, a pending query may be answered.
+     * \param packet The packet, its index must point to the DNS header
+     */
+    void answer(const network::packet& packet);
+
+    /*!
+     * \brief Remove all the resolved and negative entries. The pending
+     * queries are kept.
+     */
+    void flush();
+
+    /*!
+     * \brief Returns a textual view of the entries, one per line
+     */
+    std::string view() const;
+
+    /*!
+     * \brief Returns the number of names
+     */
+    size_t size() const;
+
+    size_t hits = 0;      ///< The number of lookups answered by the cache
+    size_t misses = 0;    ///< The number of lookups that sent a query
+    size_t coalesced = 0; ///< The number of lookups that waited for the query of another one
+
+private:
+    cache_entry* find(const std::string& name);
+    cache_entry* find(uint16_t identification);
+    cache_entry* insert(const std::string& name);
+    void age(uint64_t now);
+    void remove(cache_entry* entry);
+    void complete(cache_entry* entry, entry_state state, uint64_t ttl_ms);
+    void wake_all();
+
+    network::dns::layer* dns_layer; ///< The DNS layer
+
+    mutable spinlock lock;          ///< The lock protecting the table
+    cache_entry* table[buckets];    ///< The names, hashed
+    size_t entries = 0;             ///< The number of names
+    uint64_t last_aging = 0;        ///< The time of the last aging pass
+    uint16_t identification = 0;    ///< The identification of the last query
+    wait_list waiters;              ///< The processes waiting for a pending query
+};
+
+} // end of dns namespace
+
+} // end of network namespace
+
+#endif
@@ -9,11 +9,14 @@
 #define NET_DNS_LAYER_H
 
 #include <types.hpp>
+#include <string.hpp>
+#include <expected.hpp>
 
 #include "tlib/net_constants.hpp"
 
 #include "net/packet.hpp"
 #include "net/interface.hpp"
+#include "net/dns_cache.hpp"
 
 namespace network {
 
@@ -70,8 +73,31 @@ struct layer {
      */
     std::expected<void> finalize_packet(network::interface_descriptor& interface, network::socket& sock, network::packet_p& p);
 
+    /*!
+     * \brief Resolve a name to an IPv4 address, using the cache
+     * \param domain The domain name
+     * \param timeout_ms The time to wait for an answer to a query
+     * \param retries The number of queries to send before giving up
+     * \return The address or an error
+     */
+    std::expected<network::ip::address> resolve(const std::string& domain, size_t timeout_ms, size_t retries);
+
+    /*!
+     * \brief Send a query for the address of a name to the DNS server
+     * \param domain The domain name
+     * \param identification The identification of the query
+     * \return nothing or an error
+     */
+    std::expected<void> send_query(const std::string& domain, uint16_t identification);
+
+    /*!
+     * \brief Returns the resolver cache
+     */
+    network::dns::cache& get_cache();
+
 private:
     network::udp::layer* parent; ///< The parent layer
+    network::dns::cache dns_cache; ///< The resolver cache
 };
 
 } // end of dns namespace
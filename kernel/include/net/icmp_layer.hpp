@@ -13,6 +13,8 @@
 
 #include "tlib/net_constants.hpp"
 
+#include "conc/spinlock.hpp"
+
 #include "net/interface.hpp"
 #include "net/packet.hpp"
 
@@ -80,7 +82,14 @@ struct layer {
     std::expected<void> finalize_packet(network::interface_descriptor& interface, network::socket& sock, network::packet_p& p);
 
 private:
+    bool rate_allow();
+    bool fast_echo_reply(network::interface_descriptor& interface, network::packet_p& packet);
+
     network::ip::layer* parent; ///< The parent layer
+
+    spinlock rate_lock;   ///< Protect the token bucket
+    uint64_t tokens;      ///< The tokens of the bucket, in thousandths of a message
+    uint64_t refilled_ms; ///< The time of the last refill of the bucket
 };
 
 } // end of icmp namespace
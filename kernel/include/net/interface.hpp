@@ -12,18 +12,26 @@
 #include <string.hpp>
 #include <lock_guard.hpp>
 #include <shared_ptr.hpp>
-#include <queue.hpp>
 
 #include "conc/mutex.hpp"
 #include "conc/semaphore.hpp"
 #include "conc/deferred_unique_semaphore.hpp"
+#include "conc/spsc_queue.hpp"
+#include "conc/percpu_counter.hpp"
 
 #include "net/packet.hpp"
+#include "net/packet_pool.hpp"
+#include "net/stats.hpp"
 
 #include "tlib/net_constants.hpp"
 
 namespace network {
 
+constexpr const size_t RX_QUEUE_SIZE = 256; ///< The number of received packets waiting for the rx thread
+constexpr const size_t TX_QUEUE_SIZE = 256; ///< The number of packets waiting for the tx thread
+constexpr const size_t TX_BATCH = 32;       ///< The maximum number of packets sent per wake up of the tx thread
+constexpr const size_t TX_HISTOGRAM = 9;    ///< The number of buckets of the tx histograms, by powers of two
+
 /*!
  * \brief Abstraction of a network interface
  */
@@ -37,31 +45,121 @@ struct interface_descriptor {
     void* driver_data = nullptr;     ///<  The driver data
     network::ip::address ip_address; ///< The interface IP address
     network::ip::address gateway;    ///< The interface IP gateway
+    size_t checksum_offload = 0;     ///< The checksums handled by the device (CHECKSUM_* flags)
+    size_t mtu = 1500;               ///< The largest IP packet the link can carry
+    bool segmentation_offload = false; ///< The device cuts the large TCP packets into segments itself (TSO)
 
     size_t rx_thread_pid; ///< The pid of the rx thread
     size_t tx_thread_pid; ///< The pid of the tx thread
 
-    size_t rx_packets_counter = 0; ///< Counter of received packets
-    size_t rx_bytes_counter   = 0; ///< Counter of received bytes
-    size_t tx_packets_counter = 0; ///< Counter of transmitted packets
-    size_t tx_bytes_counter   = 0; ///< Counter of transmitted bytes
+    percpu_counter rx_packets_counter; ///< Counter of received packets
+    percpu_counter rx_bytes_counter;   ///< Counter of received bytes
+    percpu_counter tx_packets_counter; ///< Counter of transmitted packets
+    percpu_counter tx_bytes_counter;   ///< Counter of transmitted bytes
+    size_t rx_dropped_counter = 0; ///< Counter of received packets dropped on a full queue
+    size_t tx_dropped_counter = 0; ///< Counter of packets to transmit dropped on a full queue
+    size_t rx_interrupts_counter = 0; ///< Counter of reception interrupts that scheduled a poll
+    size_t rx_polls_counter = 0;      ///< Counter of poll passes
+    size_t rx_errors_counter = 0;     ///< Counter of received packets dropped as malformed or with an invalid checksum
+
+    size_t tx_depth_histogram[TX_HISTOGRAM] = {}; ///< The number of packets in the tx queue at the wake ups of the tx thread
+    size_t tx_batch_histogram[TX_HISTOGRAM] = {}; ///< The number of packets sent per wake up of the tx thread
 
-    mutable mutex tx_lock;                    ///< Mutex protecting the queues
+    mutable mutex tx_lock;                    ///< Mutex serializing the producers of the tx queue
     mutable semaphore tx_sem;                 ///< Semaphore for transmission
     mutable deferred_unique_semaphore rx_sem; ///< Semaphore for reception
 
-    std::queue<network::packet_p> rx_queue;
-    std::queue<network::packet_p> tx_queue;
+    spsc_queue<packet_p, RX_QUEUE_SIZE> rx_queue;       ///< The packets received by the driver
+    spsc_queue<packet_p, RX_QUEUE_SIZE> rx_local_queue; ///< The packets sent to the interface itself, from the tx thread
+    spsc_queue<packet_p, TX_QUEUE_SIZE> tx_queue;       ///< The packets to transmit
+    packet_pool rx_pool; ///< The packets filled by the driver on reception
+
+    volatile bool poll_scheduled = false; ///< Indicates that the driver asked the rx thread to poll the device
 
     void (*hw_send)(interface_descriptor&, packet_p& p); ///< Driver hardware send function
 
+    /*!
+     * \brief Driver function notifying the device of the packets given to
+     * hw_send since the last call, optional.
+     *
+     * When it is set, hw_send only fills the descriptors and the tx thread
+     * calls it once per batch. hw_send must still notify the device before
+     * waiting for a free descriptor.
+     */
+    void (*hw_flush)(interface_descriptor&) = nullptr;
+
+    /*!
+     * \brief Driver hardware poll function, optional.
+     *
+     * Receives at most budget packets into the rx queue and returns the
+     * number of packets received. When the device is empty, it re-enables
+     * the reception interrupt before returning less than the budget.
+     */
+    size_t (*hw_poll)(interface_descriptor&, size_t budget) = nullptr;
+
     /*!
      * \brief Send a packet through this interface
      */
     void send(packet_p& p){
         std::lock_guard<mutex> l(tx_lock);
-        tx_queue.push(p);
-        tx_sem.unlock();
+
+        if(tx_queue.push(p)){
+            tx_sem.unlock();
+        } else {
+            ++tx_dropped_counter;
+            stats::count(stats::get().queue_overflows);
+        }
+    }
+
+    /*!
+     * \brief Give a received packet to the rx thread, from the reception
+     * of the driver, the single producer of the rx queue
+     */
+    void receive(packet_p p){
+        p->timestamp = stats::timestamp();
+
+        if(rx_queue.push(std::move(p))){
+            rx_sem.notify();
+        } else {
+            ++rx_dropped_counter;
+            stats::count(stats::get().queue_overflows);
+        }
+    }
+
+    /*!
+     * \brief Ask the rx thread to poll the device, from the reception
+     * interrupt handler of the driver, once the interrupt is masked
+     */
+    void schedule_poll(){
+        ++rx_interrupts_counter;
+        poll_scheduled = true;
+        rx_sem.notify();
+    }
+
+    /*!
+     * \brief Give a packet received by a poll of the device to the rx
+     * thread, from the poll function of the driver
+     */
+    void poll_receive(packet_p p){
+        p->timestamp = stats::timestamp();
+
+        if(!rx_queue.push(std::move(p))){
+            ++rx_dropped_counter;
+            stats::count(stats::get().queue_overflows);
+        }
+    }
+
+    /*!
+     * \brief Give a packet sent to the interface itself to the rx thread,
+     * from the tx thread. The notification must not be interrupted.
+     */
+    void receive_local(packet_p p){
+        if(rx_local_queue.push(std::move(p))){
+            rx_sem.notify();
+        } else {
+            ++rx_dropped_counter;
+            stats::count(stats::get().queue_overflows);
+        }
     }
 
     /*!
@@ -13,8 +13,11 @@
 
 #include "tlib/net_constants.hpp"
 
+#include "conc/spinlock.hpp"
+
 #include "net/interface.hpp"
 #include "net/packet.hpp"
+#include "net/ip_reassembly.hpp"
 
 namespace network {
 
@@ -62,6 +65,15 @@ bool same_network(address ip, address test);
 
 static_assert(sizeof(header) == 20, "The size of an IPv4 header must be 20 bytes");
 
+/*!
+ * \brief The MTU of the path to a destination, learned from the routers
+ */
+struct path_mtu_entry {
+    network::ip::address target; ///< The destination
+    size_t mtu = 0;              ///< The MTU of the path, 0 if the entry is free
+    uint64_t expires = 0;        ///< The time after which the interface MTU is tried again, in milliseconds
+};
+
 /*!
  * \brief The IP layer implementation
  */
@@ -107,6 +119,20 @@ struct layer {
      */
     std::expected<void> finalize_packet(network::interface_descriptor& interface, network::packet_p& p);
 
+    /*!
+     * \brief Returns the largest packet that can be sent to the given
+     * destination without fragmentation
+     */
+    size_t path_mtu(network::interface_descriptor& interface, network::ip::address target);
+
+    /*!
+     * \brief Lower the MTU of the path to a destination, after a router
+     * reported it (RFC 1191)
+     * \param target The destination
+     * \param mtu The MTU of the next hop, 0 if the router did not give it
+     */
+    void update_path_mtu(network::ip::address target, size_t mtu);
+
     /*!
      * \brief Register the ICMP layer
      * \param layer The ICMP layer
@@ -132,7 +158,11 @@ struct layer {
     void register_tcp_layer(network::tcp::layer* layer);
 
 private:
-    std::expected<uint64_t> get_target_mac(network::interface_descriptor& interface, network::ip::address target_ip);
+    network::ip::address get_target_mac(network::interface_descriptor& interface, network::ip::address target_ip, uint64_t& mac);
+    std::expected<void> fragment(network::interface_descriptor& interface, network::packet_p& p, size_t mtu);
+    std::expected<void> deliver_local(network::interface_descriptor& interface, network::packet_p& p);
+
+    static constexpr size_t path_mtus_size = 16; ///< The number of destinations with a known path MTU
 
     network::ethernet::layer* parent;  ///< The parent layer
 
@@ -140,6 +170,13 @@ private:
     network::arp::layer* arp_layer; ///< The ARP layer
     network::udp::layer* udp_layer; ///< The UDP layer
     network::tcp::layer* tcp_layer; ///< The TCP layer
+
+    reassembly_cache reassembly; ///< The fragmented datagrams being received
+
+    volatile uint16_t identification = 0; ///< The identification of the last fragmented datagram
+
+    spinlock path_mtus_lock;                  ///< The lock protecting the path MTUs
+    path_mtu_entry path_mtus[path_mtus_size]; ///< The destinations with a path MTU lower than the interface MTU
 };
 
 } // end of ip namespace
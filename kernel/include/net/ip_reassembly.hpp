@@ -0,0 +1,126 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_IP_REASSEMBLY_H
+#define NET_IP_REASSEMBLY_H
+
+#include <types.hpp>
+#include <unique_ptr.hpp>
+
+#include "tlib/net_constants.hpp"
+
+#include "conc/spinlock.hpp"
+
+#include "net/interface.hpp"
+#include "net/packet.hpp"
+
+namespace network {
+
+namespace ip {
+
+constexpr const uint16_t fragment_dont  = 1 << 14; ///< The Don't Fragment flag
+constexpr const uint16_t fragment_more  = 1 << 13; ///< The More Fragments flag
+constexpr const uint16_t fragment_mask  = 0x1FFF;  ///< The offset of a fragment, in units of 8 bytes
+
+/*!
+ * \brief A range of received bytes of a datagram
+ */
+struct fragment_range {
+    size_t start; ///< The first byte
+    size_t end;   ///< The byte after the last one
+};
+
+/*!
+ * \brief A datagram being reassembled
+ */
+struct reassembly_entry {
+    static constexpr size_t max_ranges = 16; ///< The maximum number of holes between the fragments
+    static constexpr size_t max_header = 80; ///< The maximum size of the link and IP headers
+
+    network::ip::address source; ///< The source address
+    network::ip::address target; ///< The target address
+    uint16_t identification;     ///< The identification of the datagram
+    uint8_t protocol;            ///< The protocol of the datagram
+
+    uint64_t expires = 0; ///< The time after which the datagram is dropped, in milliseconds
+
+    size_t total = 0;    ///< The length of the payload, 0 until the last fragment is received
+    size_t received = 0; ///< The number of bytes received
+
+    std::unique_ptr<char[]> data; ///< The payload
+    size_t capacity = 0;          ///< The size of the payload buffer
+
+    char header[max_header];   ///< The link and IP headers of the first fragment
+    size_t link_length = 0;    ///< The length of the link header
+    size_t header_length = 0;  ///< The length of the IP header, 0 until the first fragment is received
+
+    fragment_range ranges[max_ranges]; ///< The received ranges, sorted
+    size_t ranges_count = 0;           ///< The number of received ranges
+
+    reassembly_entry* next = nullptr; ///< The next entry of the bucket
+};
+
+/*!
+ * \brief The reassembly of the fragmented datagrams.
+ *
+ * The datagrams are hashed by (source, target, protocol, identification).
+ * A datagram not complete after the timeout is dropped, as well as the
+ * oldest datagrams when the memory held by the fragments is too large.
+ */
+struct reassembly_cache {
+    static constexpr size_t buckets = 32;            ///< The number of buckets of the table
+    static constexpr size_t max_entries = 64;        ///< The maximum number of datagrams
+    static constexpr size_t max_memory = 256 * 1024; ///< The maximum number of bytes held
+
+    reassembly_cache();
+    ~reassembly_cache();
+
+    reassembly_cache(const reassembly_cache& rhs) = delete;
+    reassembly_cache& operator=(const reassembly_cache& rhs) = delete;
+
+    /*!
+     * \brief Add a received fragment.
+     *
+     * The IP header of the fragment must have been verified.
+     *
+     * \param interface The interface on which the fragment was received
+     * \param fragment The fragment
+     * \return The complete datagram, or an empty pointer if fragments are
+     * still missing
+     */
+    network::packet_p add_fragment(network::interface_descriptor& interface, const network::packet& fragment);
+
+    /*!
+     * \brief Returns the number of datagrams being reassembled
+     */
+    size_t size() const;
+
+    /*!
+     * \brief Returns the number of bytes held by the datagrams being reassembled
+     */
+    size_t memory() const;
+
+private:
+    reassembly_entry* find(const network::ip::header* header);
+    reassembly_entry* insert(const network::ip::header* header);
+    void remove(reassembly_entry* entry);
+    void age(uint64_t now);
+    bool reserve(reassembly_entry* entry, size_t size);
+    network::packet_p make_datagram(network::interface_descriptor& interface, reassembly_entry* entry);
+
+    mutable spinlock lock;              ///< The lock protecting the table
+    reassembly_entry* table[buckets];   ///< The datagrams
+    size_t entries = 0;                 ///< The number of datagrams
+    size_t used_memory = 0;             ///< The number of bytes held by the datagrams
+    uint64_t last_aging = 0;            ///< The time of the last aging pass
+};
+
+} // end of ip namespace
+
+} // end of network namespace
+
+#endif
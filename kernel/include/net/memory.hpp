@@ -0,0 +1,62 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_MEMORY_H
+#define NET_MEMORY_H
+
+#include <types.hpp>
+
+namespace network {
+
+namespace memory {
+
+/*!
+ * \brief Compute the global limit from the available memory
+ */
+void init();
+
+/*!
+ * \brief Publish the accounting in sysfs (/net/memory/)
+ */
+void finalize();
+
+/*!
+ * \brief Charge bytes held by the sockets, if it stays under the limit
+ * \return true if the bytes were charged, false if the limit is reached
+ */
+bool charge(size_t bytes);
+
+/*!
+ * \brief Charge bytes that must be held, even over the limit
+ */
+void force_charge(size_t bytes);
+
+/*!
+ * \brief Release charged bytes
+ */
+void release(size_t bytes);
+
+/*!
+ * \brief Count a packet dropped because a budget was exhausted
+ */
+void drop();
+
+/*!
+ * \brief Returns the number of bytes currently charged
+ */
+size_t used();
+
+/*!
+ * \brief Returns the maximum number of bytes held by all the sockets
+ */
+size_t limit();
+
+} // end of memory namespace
+
+} // end of network namespace
+
+#endif
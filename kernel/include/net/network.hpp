@@ -11,12 +11,18 @@
 #include <types.hpp>
 #include <tuple.hpp>
 #include <expected.hpp>
+#include <string.hpp>
 
 #include "tlib/net_constants.hpp"
+#include "tlib/iovec.hpp"
 
 #include "net/interface.hpp"
 #include "net/packet.hpp"
 
+namespace poll {
+struct source;
+}
+
 namespace network {
 
 using socket_fd_t = size_t;
@@ -64,6 +70,18 @@ std::expected<socket_fd_t> open(network::socket_domain domain, network::socket_t
  */
 void close(size_t fd);
 
+/*!
+ * \brief Returns the readiness source of the socket, for the poll
+ * instances.
+ *
+ * A socket is readable once a datagram (or stream data) is queued, a TCP
+ * socket is hung up once its connection is closed.
+ *
+ * \param socket_fd The file descriptor of the socket
+ * \return the source, or an error
+ */
+std::expected<poll::source*> poll_source(socket_fd_t socket_fd);
+
 /*!
  * \brief Prepare a packet
  * \param socket_fd The file descriptor of the packet
@@ -73,6 +91,27 @@ void close(size_t fd);
  */
 std::tuple<size_t, size_t> prepare_packet(socket_fd_t socket_fd, void* desc, char* buffer);
 
+/*!
+ * \brief Prepare a packet in one of the mapped packet buffers of the socket.
+ *
+ * The process writes the packet directly in the buffer, it is sent without
+ * any copy once finalized.
+ *
+ * \param socket_fd The file descriptor of the socket
+ * \param desc The packet descriptor to send (depending on the protocol)
+ * \return a tuple containing the packet file descriptor, the packet payload
+ * index and the address of the buffer in the process
+ */
+std::tuple<size_t, size_t, size_t> prepare_mapped_packet(socket_fd_t socket_fd, void* desc);
+
+/*!
+ * \brief Map packet buffers of the socket in the current process, to
+ * prepare packets without copies.
+ * \param socket_fd The file descriptor of the socket
+ * \return the address of the buffers in the process or an error
+ */
+std::expected<size_t> map_packet_buffers(socket_fd_t socket_fd);
+
 /*!
  * \brief Finalize a packet (send it)
  * \param socket_fd The file descriptor of the packet
@@ -95,6 +134,40 @@ std::expected<void> send(socket_fd_t socket_fd, const char* buffer, size_t n, ch
  */
 std::expected<void> send_to(socket_fd_t socket_fd, const char* buffer, size_t n, char* target_buffer, void* address);
 
+/*!
+ * \brief Send a batch of datagrams, in a single kernel entry.
+ *
+ * The messages are sent in order, the target buffer must be large enough
+ * for the largest of them and is reused for each datagram.
+ *
+ * \param socket_fd The file descriptor of the packet
+ * \param messages The messages to send
+ * \param n The number of messages
+ * \param target_buffer The buffer for the packets
+ * \return the number of messages sent, or an error if none was sent
+ */
+std::expected<size_t> send_to_batch(socket_fd_t socket_fd, network::message* messages, size_t n, char* target_buffer);
+
+/*!
+ * \brief Send several buffers through a connected TCP socket, as one message
+ * \param socket_fd The file descriptor of the socket
+ * \param vectors The buffers to send
+ * \param n The number of buffers
+ * \return Nothing or an error
+ */
+std::expected<void> sendv(socket_fd_t socket_fd, const vfs::iovec* vectors, size_t n);
+
+/*!
+ * \brief Send the contents of a file through a connected TCP socket,
+ * directly from the page cache
+ * \param socket_fd The file descriptor of the socket
+ * \param file_fd The file descriptor of the file
+ * \param offset The offset of the first byte to send
+ * \param count The number of bytes to send, the send stops at the end of the file
+ * \return The number of bytes sent or an error
+ */
+std::expected<size_t> sendfile(socket_fd_t socket_fd, size_t file_fd, size_t offset, size_t count);
+
 /*!
  * \brief Receive some data (not a packet, only a payload)
  * \param socket_fd The file descriptor of the packet
@@ -123,6 +196,33 @@ std::expected<size_t> receive_from(socket_fd_t socket_fd, char* buffer, size_t n
  */
 std::expected<size_t> receive_from(socket_fd_t socket_fd, char* buffer, size_t n, size_t ms, void* address);
 
+/*!
+ * \brief Receive a batch of datagrams, in a single kernel entry.
+ *
+ * Wait for the first datagram indefinitely, the next messages are only
+ * filled with the datagrams already received.
+ *
+ * \param socket_fd The file descriptor of the packet
+ * \param messages The messages to fill
+ * \param n The number of messages
+ * \return the number of messages filled, or an error if none was received
+ */
+std::expected<size_t> receive_from_batch(socket_fd_t socket_fd, network::message* messages, size_t n);
+
+/*!
+ * \brief Receive a batch of datagrams, in a single kernel entry.
+ *
+ * Wait for the first datagram at most ms milliseconds, the next messages
+ * are only filled with the datagrams already received.
+ *
+ * \param socket_fd The file descriptor of the packet
+ * \param messages The messages to fill
+ * \param n The number of messages
+ * \param ms The maximum time to wait for the first datagram
+ * \return the number of messages filled, or an error if none was received
+ */
+std::expected<size_t> receive_from_batch(socket_fd_t socket_fd, network::message* messages, size_t n, size_t ms);
+
 /*!
  * \brief Listen to a socket or not
  * \param socket_fd The file descriptor of the packet
@@ -131,6 +231,41 @@ std::expected<size_t> receive_from(socket_fd_t socket_fd, char* buffer, size_t n
  */
 std::expected<void> listen(socket_fd_t socket_fd, bool listen);
 
+/*!
+ * \brief Set the socket non-blocking or not.
+ *
+ * The receive, accept and wait for packet calls of a non-blocking socket
+ * return ERROR_WOULD_BLOCK instead of waiting. The connection of a TCP
+ * socket still waits for the handshake.
+ *
+ * \param socket_fd The file descriptor of the packet
+ * \param non_blocking Indicates if the socket is non-blocking
+ * \return 0 on success and a negative error code otherwise
+ */
+std::expected<void> set_non_blocking(socket_fd_t socket_fd, bool non_blocking);
+
+/*!
+ * \brief Set the size of a buffer of a socket.
+ *
+ * The size is clamped between MIN_SOCKET_BUFFER and MAX_SOCKET_BUFFER. The
+ * receive buffer of a TCP socket is its window, it is only applied to the
+ * connections established after the call.
+ *
+ * \param socket_fd The file descriptor of the socket
+ * \param buffer The buffer to set
+ * \param size The maximum number of bytes of the buffer
+ * \return nothing or an error
+ */
+std::expected<void> set_buffer_size(socket_fd_t socket_fd, socket_buffer buffer, size_t size);
+
+/*!
+ * \brief Returns the size of a buffer of a socket
+ * \param socket_fd The file descriptor of the socket
+ * \param buffer The buffer to query
+ * \return the maximum number of bytes of the buffer or an error
+ */
+std::expected<size_t> get_buffer_size(socket_fd_t socket_fd, socket_buffer buffer);
+
 /*!
  * \brief Bind a socket datagram as a client (bind a local random port)
  * \param socket_fd The file descriptor of the packet
@@ -180,9 +315,10 @@ std::expected<size_t> connect(socket_fd_t socket_fd, network::ip::address addres
  * \param socket_fd The file descriptor of the packet
  * \param server The ip address of the server
  * \param port The port of the server
+ * \param backlog The maximum number of connections waiting to be accepted
  * \return the allocated port on success and a negative error code otherwise
  */
-std::expected<void> server_start(socket_fd_t socket_fd, network::ip::address address, size_t port);
+std::expected<void> server_start(socket_fd_t socket_fd, network::ip::address address, size_t port, size_t backlog);
 
 /*!
  * \brief Wait for a connection
@@ -199,6 +335,12 @@ std::expected<size_t> accept(socket_fd_t socket_fd);
  */
 std::expected<size_t> accept(socket_fd_t socket_fd, size_t ms);
 
+/*!
+ * \brief Format the state of the TCP connections, one line per connection,
+ * with their congestion window and RTT estimation
+ */
+std::string format_tcp_connections();
+
 /*!
  * \brief Disconnect from  a socket stream
  * \param socket_fd The file descriptor of the packet
@@ -236,6 +378,20 @@ void propagate_packet(const packet_p& packet, socket_protocol protocol);
  */
 network::ip::address dns_server();
 
+/*!
+ * \brief Resolve a domain name to an IPv4 address, using the DNS cache
+ * \param domain The domain name
+ * \param timeout_ms The time to wait for an answer to a query
+ * \param retries The number of queries to send before giving up
+ * \return The address or an error
+ */
+std::expected<network::ip::address> resolve(const char* domain, size_t timeout_ms, size_t retries);
+
+/*!
+ * \brief Remove the resolved and negative entries of the DNS cache
+ */
+void flush_dns_cache();
+
 } // end of network namespace
 
 #endif
@@ -9,14 +9,24 @@
 #define NET_PACKET_H
 
 #include <types.hpp>
-#include <shared_ptr.hpp>
+#include <intrusive_ptr.hpp>
 
 #include "assert.hpp"
 
 namespace network {
 
+struct packet_pool;
+
+constexpr const size_t CHECKSUM_TX_IP = 0x1; ///< The device computes the IP header checksum
+constexpr const size_t CHECKSUM_TX_L4 = 0x2; ///< The device completes the partial TCP and UDP checksums
+constexpr const size_t CHECKSUM_RX_IP = 0x4; ///< The device verifies the IP header checksum
+constexpr const size_t CHECKSUM_RX_L4 = 0x8; ///< The device verifies the TCP and UDP checksums
+
 /*!
  * \brief A network packet.
+ *
+ * The packets are shared with intrusive pointers, their reference counter
+ * is stored in the packet itself.
  */
 struct packet {
     // Set from the beginning
@@ -31,6 +41,27 @@ struct packet {
     uint64_t tags;          ///< Tags of the layer indices
     uint64_t interface;     ///< Id of the interface
 
+    // Set when the checksum is left to the device
+    uint16_t checksum_start = 0;  ///< The index from which the device sums the packet, 0 if the checksum is complete
+    uint16_t checksum_offset = 0; ///< The offset of the checksum from checksum_start
+
+    // Set by the driver on reception
+    uint8_t checksum_verified = 0; ///< The checksums already verified by the device (CHECKSUM_RX_* flags)
+
+    // Set for a large TCP packet, cut into segments before the device
+    uint16_t gso_size = 0; ///< The payload of each segment, 0 if the packet is sent as is
+
+    // Set when the target MAC address is not known when the packet is prepared
+    uint32_t neighbor = 0; ///< The raw IP address of the neighbor to resolve before sending, 0 if the target MAC is set
+
+    uint64_t timestamp = 0; ///< The reception by the driver or the finalization of the packet, in counter ticks, 0 if unknown
+
+    // Set by the packet pool
+    packet_pool* pool = nullptr; ///< The pool owning the packet and its payload, nullptr if allocated on the heap
+    size_t slot = 0;             ///< The slot of the packet in its pool
+
+    volatile size_t references = 0; ///< The number of intrusive pointers to the packet
+
     packet() : fd(0), user(false), tags(0) {}
     packet(char* payload, size_t payload_size) : payload(payload), payload_size(payload_size), index(0), fd(0), user(false), tags(0) {}
 
@@ -56,7 +87,20 @@ struct packet {
     }
 };
 
-using packet_p = std::shared_ptr<packet>;
+/*!
+ * \brief Take a new reference on the packet
+ */
+inline void intrusive_ptr_add_ref(packet* p){
+    __atomic_fetch_add(&p->references, 1, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief Drop a reference on the packet. With the last reference, the
+ * packet is deleted or goes back to its pool.
+ */
+void intrusive_ptr_release(packet* p);
+
+using packet_p = std::intrusive_ptr<packet>;
 
 } // end of network namespace
 
@@ -0,0 +1,95 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_PACKET_POOL_H
+#define NET_PACKET_POOL_H
+
+#include <types.hpp>
+
+#include "conc/int_spinlock.hpp"
+
+#include "net/packet.hpp"
+
+namespace network {
+
+constexpr const size_t PACKET_BUFFER_SIZE = 2048; ///< The size of the buffer of a pooled packet, enough for an Ethernet frame
+
+/*!
+ * \brief A pool of packets with preallocated buffers.
+ *
+ * A pooled packet is allocated together with its reference counter and its
+ * buffer, and goes back to the pool when its last reference is dropped. The
+ * allocation and the release are safe from an interrupt handler and never
+ * use the heap.
+ */
+struct packet_pool {
+    /*!
+     * \brief Allocate the packets and their buffers
+     * \param packets The number of packets of the pool
+     */
+    void init(size_t packets);
+
+    /*!
+     * \brief Allocate the packets, their buffers are given by the caller
+     * \param packets The number of packets of the pool
+     * \param storage The buffers, packets * PACKET_BUFFER_SIZE bytes
+     */
+    void init(size_t packets, char* storage);
+
+    /*!
+     * \brief Release the storage of the pool, the caller must ensure that
+     * all its packets are back
+     */
+    void destroy();
+
+    /*!
+     * \brief Returns a packet of the pool, holding a copy of the given bytes
+     * \return the packet, an empty pointer if the pool is exhausted or the
+     * bytes do not fit in a buffer
+     */
+    packet_p allocate(const char* source, size_t size);
+
+    /*!
+     * \brief Returns a packet of the pool, its buffer is not initialized
+     * \return the packet, an empty pointer if the pool is exhausted or the
+     * size does not fit in a buffer
+     */
+    packet_p allocate(size_t size);
+
+    /*!
+     * \brief Retire the pool, no packet must be allocated anymore. The
+     * callback is called once the last packet is back, possibly right away.
+     */
+    void retire(void (*callback)(packet_pool* pool));
+
+    /*!
+     * \brief Returns the number of allocations that did not find a packet
+     */
+    size_t misses() const {
+        return _misses;
+    }
+
+private:
+    void release(size_t index);
+
+    int_spinlock lock;            ///< The lock of the free packets
+    char* slots = nullptr;        ///< The storage of the packets
+    char* buffers = nullptr;      ///< The buffers of the packets
+    bool owned = true;            ///< Indicates if the buffers are allocated by the pool
+    size_t* free_slots = nullptr; ///< The indices of the free packets
+    size_t free_count = 0;        ///< The number of free packets
+    size_t capacity = 0;          ///< The number of packets of the pool
+    size_t _misses = 0;           ///< The number of failed allocations
+
+    void (*retired)(packet_pool* pool) = nullptr; ///< Called once the retired pool is empty
+
+    friend void intrusive_ptr_release(packet* p);
+};
+
+} // end of network namespace
+
+#endif
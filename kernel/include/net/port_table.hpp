@@ -0,0 +1,63 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_PORT_TABLE_H
+#define NET_PORT_TABLE_H
+
+#include <types.hpp>
+#include <expected.hpp>
+#include <function.hpp>
+
+namespace network {
+
+/*!
+ * \brief The allocator of the ephemeral local ports of a protocol.
+ *
+ * The used ports are kept in a bitmap, each allocation searches from the
+ * word of the previous one, a full word of ports is skipped at once. The
+ * allocations and releases are lock-free.
+ */
+struct port_table {
+    static constexpr const size_t FIRST_EPHEMERAL = 49152; ///< The first ephemeral port (IANA)
+    static constexpr const size_t LAST_EPHEMERAL  = 65535; ///< The last ephemeral port (IANA)
+
+    port_table();
+
+    port_table(const port_table& rhs) = delete;
+    port_table& operator=(const port_table& rhs) = delete;
+
+    /*!
+     * \brief Allocate a free ephemeral port
+     * \param busy A functor indicating if a port is used otherwise (by a server)
+     * \return The port or ERROR_BUSY if all the ports are used
+     */
+    std::expected<size_t> allocate(std::function_ref<bool(size_t)> busy);
+
+    /*!
+     * \brief Release a port returned by allocate
+     */
+    void release(size_t port);
+
+    /*!
+     * \brief Returns the number of allocated ports
+     */
+    size_t allocated() const;
+
+private:
+    static constexpr const size_t PORTS = LAST_EPHEMERAL - FIRST_EPHEMERAL + 1; ///< The number of ephemeral ports
+    static constexpr const size_t WORDS = PORTS / 64;                         ///< The number of words of the bitmap
+
+    static_assert(PORTS % 64 == 0, "The bitmap covers words of ports");
+
+    uint64_t bitmap[WORDS]; ///< The used ports, one bit each
+    size_t cursor;          ///< The word of the next allocation
+    size_t used;            ///< The number of allocated ports
+};
+
+} // end of network namespace
+
+#endif
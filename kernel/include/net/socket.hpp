@@ -19,8 +19,12 @@
 #include "conc/condition_variable.hpp"
 
 #include "net/packet.hpp"
+#include "net/memory.hpp"
+#include "net/stats.hpp"
+#include "net/user_buffers.hpp"
 
 #include "assert.hpp"
+#include "poll.hpp"
 
 namespace network {
 
@@ -34,12 +38,22 @@ struct socket {
     socket_protocol protocol;        ///< The socket protocol
     size_t next_fd;                  ///< The next file descriptor
     bool listen;                     ///< Indicates if the socket is listening to packets
+    bool non_blocking = false;       ///< Indicates if the calls return ERROR_WOULD_BLOCK instead of waiting
     void* connection_data = nullptr; ///< Optional pointer to the connection data (TCP/UDP)
 
+    size_t send_buffer    = DEFAULT_SEND_BUFFER;    ///< The maximum number of bytes of the prepared packets
+    size_t receive_buffer = DEFAULT_RECEIVE_BUFFER; ///< The maximum number of bytes of the packets waiting to be read
+    size_t send_queued    = 0;                      ///< The number of bytes of the prepared packets
+    size_t receive_queued = 0;                      ///< The number of bytes of the packets waiting to be read
+    size_t receive_dropped = 0;                     ///< The number of packets dropped because the receive buffer was full
+
+    user_buffers* buffers = nullptr; ///< The packet buffers mapped in the process, if any
+
     std::vector<network::packet_p> packets; ///< Packets that are prepared with their fd
 
     std::queue<network::packet_p> listen_packets; ///< The packets that wait to be read in listen mode
     condition_variable listen_queue;              ///< Condition variable to wait for packets
+    poll::source poll_source;                     ///< The readiness of the socket, for the poll instances
 
     socket() {}
     socket(size_t id, socket_domain domain, socket_type type, socket_protocol protocol, size_t next_fd, bool listen)
@@ -59,6 +73,15 @@ struct socket {
         return id != 0xFFFFFFFF;
     }
 
+    /*!
+     * \brief Indicates if a packet of the given size can be prepared
+     * without exceeding the send buffer
+     */
+    bool can_prepare(size_t size) const {
+        // A packet can always be prepared when none is pending
+        return packets.empty() || send_queued + size <= send_buffer;
+    }
+
     /*!
      * \brief Register a new packet into the socket
      * \return The file descriptor of the packet
@@ -70,6 +93,8 @@ struct socket {
 
         packets.push_back(packet);
 
+        send_queued += packet->payload_size;
+
         return fd;
     }
 
@@ -103,11 +128,75 @@ struct socket {
      * \brief Removes the packet with the given file descriptor
      */
     void erase_packet(size_t fd) {
-        packets.erase(std::remove_if(packets.begin(), packets.end(), [fd](network::packet_p& packet) {
-            return packet->fd == fd;
+        auto& queued = send_queued;
+
+        packets.erase(std::remove_if(packets.begin(), packets.end(), [fd, &queued](network::packet_p& packet) {
+            if (packet->fd == fd) {
+                queued -= packet->payload_size;
+                return true;
+            }
+
+            return false;
         }), packets.end());
     }
 
+    /*!
+     * \brief Queue a received packet to be read, if it fits in the receive
+     * buffer of the socket and in the global network memory.
+     *
+     * The readers of the socket are notified.
+     *
+     * \return true if the packet was queued, false if it was dropped
+     */
+    bool queue_packet(const network::packet_p& packet) {
+        auto size = packet->payload_size;
+
+        // A packet is always accepted by an empty queue, to make progress
+        auto queued = __atomic_load_n(&receive_queued, __ATOMIC_RELAXED);
+
+        if ((queued && queued + size > receive_buffer) || !network::memory::charge(size)) {
+            __atomic_add_fetch(&receive_dropped, 1, __ATOMIC_RELAXED);
+            network::memory::drop();
+            return false;
+        }
+
+        __atomic_add_fetch(&receive_queued, size, __ATOMIC_RELAXED);
+
+        network::stats::delivered(*packet);
+
+        listen_packets.push(packet);
+        listen_queue.notify_one();
+        poll_source.notify();
+
+        return true;
+    }
+
+    /*!
+     * \brief Remove the oldest received packet, it must not be empty
+     * \return The oldest received packet
+     */
+    network::packet_p dequeue_packet() {
+        auto packet = listen_packets.top();
+        listen_packets.pop();
+
+        __atomic_sub_fetch(&receive_queued, packet->payload_size, __ATOMIC_RELAXED);
+        network::memory::release(packet->payload_size);
+
+        return packet;
+    }
+
+    /*!
+     * \brief Release the received and prepared packets of the socket
+     */
+    void release_packets() {
+        while (!listen_packets.empty()) {
+            dequeue_packet();
+        }
+
+        packets.clear();
+        send_queued = 0;
+    }
+
     /*!
      * \brief Returns the connection data of the given type.
      *
@@ -0,0 +1,112 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_STATS_H
+#define NET_STATS_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include "net/packet.hpp"
+
+namespace network {
+
+namespace stats {
+
+/*!
+ * \brief The counters of a protocol
+ */
+struct protocol_counters {
+    uint64_t in     = 0; ///< The packets received by the layer
+    uint64_t out    = 0; ///< The packets sent by the layer
+    uint64_t errors = 0; ///< The packets received malformed or with an invalid checksum
+    uint64_t drops  = 0; ///< The valid packets received and not delivered
+};
+
+/*!
+ * \brief Histogram of latencies.
+ *
+ * The bucket i counts the latencies lower than 2^i microseconds, the last
+ * bucket counts all the longer latencies.
+ */
+struct latency_histogram {
+    static constexpr const size_t buckets = 16; ///< The number of buckets
+
+    uint64_t counts[buckets] = {}; ///< The number of latencies of each bucket
+
+    /*!
+     * \brief Add a latency, in microseconds, to the histogram
+     */
+    void add(uint64_t us){
+        size_t bucket = 0;
+
+        while(bucket + 1 < buckets && us >= (1ULL << bucket)){
+            ++bucket;
+        }
+
+        __atomic_add_fetch(&counts[bucket], 1, __ATOMIC_RELAXED);
+    }
+};
+
+/*!
+ * \brief The counters of the network stack, for all the interfaces
+ */
+struct counters {
+    protocol_counters ip;   ///< The IPv4 counters
+    protocol_counters icmp; ///< The ICMP counters
+    protocol_counters udp;  ///< The UDP counters
+    protocol_counters tcp;  ///< The TCP counters
+
+    uint64_t tcp_retransmits   = 0; ///< The TCP segments sent again
+    uint64_t checksum_failures = 0; ///< The packets received with an invalid checksum, at any layer
+    uint64_t queue_overflows   = 0; ///< The packets dropped because a queue was full
+    uint64_t arp_misses        = 0; ///< The packets that waited for the resolution of their neighbor
+    uint64_t icmp_fast_replies = 0; ///< The echo requests answered in their own buffer
+    uint64_t icmp_rate_limited = 0; ///< The ICMP messages of the kernel not sent because of the rate limit
+
+    latency_histogram rx_latency; ///< From the reception by the driver to the delivery to a socket
+    latency_histogram tx_latency; ///< From the finalization of a packet to its driver
+};
+
+/*!
+ * \brief Returns the counters of the stack
+ */
+counters& get();
+
+/*!
+ * \brief Increment a counter of the stack, from any thread
+ */
+inline void count(uint64_t& counter){
+    __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief Returns the current timestamp of the packets, in counter ticks
+ */
+uint64_t timestamp();
+
+/*!
+ * \brief Record the latency of a received packet delivered to a socket
+ */
+void delivered(const network::packet& packet);
+
+/*!
+ * \brief Record the latency of a packet given to its driver
+ */
+void transmitted(const network::packet& packet);
+
+/*!
+ * \brief Format all the counters, one line of names and one line of values
+ * per group, like /proc/net/snmp
+ */
+std::string format();
+
+} // end of stats namespace
+
+} // end of network namespace
+
+#endif
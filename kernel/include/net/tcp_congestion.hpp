@@ -0,0 +1,116 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_TCP_CONGESTION_H
+#define NET_TCP_CONGESTION_H
+
+#include <types.hpp>
+
+namespace network {
+
+namespace tcp {
+
+struct congestion_state;
+
+/*!
+ * \brief A congestion avoidance algorithm.
+ *
+ * Slow start, fast retransmit and fast recovery are common to all the
+ * algorithms, only the growth of the window past the slow start threshold
+ * and the reduction after a loss differ.
+ */
+struct congestion_algorithm {
+    const char* name; ///< The name of the algorithm
+
+    /*!
+     * \brief Grow the window after the given bytes were acknowledged,
+     * in congestion avoidance
+     */
+    void (*avoid)(congestion_state& state, uint32_t acked, uint64_t now);
+
+    /*!
+     * \brief Returns the new slow start threshold after a loss
+     */
+    uint32_t (*loss)(congestion_state& state, uint32_t in_flight);
+};
+
+extern const congestion_algorithm new_reno; ///< NewReno (RFC 5681 and 6582)
+extern const congestion_algorithm cubic;    ///< CUBIC (RFC 8312)
+
+/*!
+ * \brief The congestion state of a connection
+ */
+struct congestion_state {
+    const congestion_algorithm* algorithm = nullptr; ///< The congestion avoidance algorithm
+
+    uint32_t mss      = 0; ///< The maximum segment size
+    uint32_t cwnd     = 0; ///< The congestion window, in bytes
+    uint32_t ssthresh = 0; ///< The slow start threshold, in bytes
+
+    bool in_recovery      = false; ///< Indicates if losses are being recovered
+    bool after_timeout    = false; ///< Indicates if the recovery started with a timeout
+    uint32_t recover      = 0;     ///< The highest sequence number sent when the recovery started
+    size_t duplicate_acks = 0;     ///< The number of consecutive duplicate ACKs
+
+    uint32_t srtt   = 0; ///< The smoothed round trip time, in milliseconds, 0 before the first sample
+    uint32_t rttvar = 0; ///< The round trip time variation, in milliseconds
+    uint32_t rto    = 0; ///< The retransmission timeout, in milliseconds
+
+    size_t timeouts         = 0; ///< The number of segments retransmitted on timeout
+    size_t fast_retransmits = 0; ///< The number of segments retransmitted on duplicate ACKs
+
+    uint32_t w_max       = 0; ///< CUBIC: The window before the last reduction, in segments
+    uint32_t origin      = 0; ///< CUBIC: The window at the plateau of the current epoch, in segments
+    uint64_t k           = 0; ///< CUBIC: The time to reach the plateau, in milliseconds
+    uint64_t epoch_start = 0; ///< CUBIC: The start of the current epoch, 0 if none
+};
+
+/*!
+ * \brief Returns the algorithm of the new connections
+ */
+const congestion_algorithm& default_congestion_algorithm();
+
+/*!
+ * \brief Initialize the congestion state of a connection once established
+ */
+void congestion_init(congestion_state& state, uint32_t mss);
+
+/*!
+ * \brief Update the round trip estimation with a new sample
+ * \param rtt The round trip time of a segment sent once, in milliseconds
+ */
+void congestion_rtt_sample(congestion_state& state, uint64_t rtt);
+
+/*!
+ * \brief Update the window after an ACK for new data
+ * \param snd_una The acknowledged sequence number
+ * \param acked The number of newly acknowledged bytes
+ * \param now The current time, in milliseconds
+ * \return true if the oldest segment must be retransmitted (partial ACK during a recovery)
+ */
+bool congestion_new_ack(congestion_state& state, uint32_t snd_una, uint32_t acked, uint64_t now);
+
+/*!
+ * \brief Update the window after a duplicate ACK
+ * \param snd_nxt The next sequence number to send
+ * \param in_flight The number of bytes not acknowledged
+ * \return true if the oldest segment must be retransmitted (fast retransmit)
+ */
+bool congestion_duplicate_ack(congestion_state& state, uint32_t snd_nxt, uint32_t in_flight);
+
+/*!
+ * \brief Update the window and back off the timer after a retransmission timeout
+ * \param snd_nxt The next sequence number to send
+ * \param in_flight The number of bytes not acknowledged
+ */
+void congestion_timeout(congestion_state& state, uint32_t snd_nxt, uint32_t in_flight);
+
+} // end of tcp namespace
+
+} // end of network namespace
+
+#endif
@@ -11,13 +11,22 @@
 #include <types.hpp>
 #include <atomic.hpp>
 #include <queue.hpp>
+#include <deque.hpp>
+#include <vector.hpp>
+#include <string.hpp>
+#include <unique_ptr.hpp>
+
+#include <tlib/iovec.hpp>
 
 #include "conc/condition_variable.hpp"
+#include "conc/spinlock.hpp"
 
 #include "net/packet.hpp"
 #include "net/connection_handler.hpp"
 #include "net/interface.hpp"
 #include "net/socket.hpp"
+#include "net/memory.hpp"
+#include "net/tcp_congestion.hpp"
 
 namespace network {
 
@@ -27,6 +36,87 @@ struct layer;
 
 namespace tcp {
 
+/*!
+ * \brief A segment sent and not acknowledged yet
+ */
+struct tcp_segment {
+    network::packet_p packet; ///< The finalized packet, sent again on timeout
+    uint32_t sequence;        ///< The sequence number of the first byte
+    uint32_t length;          ///< The number of bytes of payload
+    uint64_t sent;            ///< The time of the last transmission, in milliseconds
+    size_t tries;             ///< The number of transmissions
+};
+
+/*!
+ * \brief A range of sequence numbers received out of order
+ */
+struct tcp_range {
+    uint32_t start; ///< The first sequence number
+    uint32_t end;   ///< The sequence number after the last one
+};
+
+/*!
+ * \brief The received bytes of a connection, waiting to be read.
+ *
+ * The bytes are stored in a ring at their position in the stream. The
+ * segments received out of order are stored in place, after the hole,
+ * and their ranges are remembered until the hole is filled.
+ */
+struct tcp_receive_buffer {
+    static constexpr size_t max_ranges = 8; ///< The maximum number of holes
+
+    std::unique_ptr<char[]> data; ///< The ring of bytes
+    size_t capacity = 0;          ///< The size of the ring
+    size_t start    = 0;          ///< The position of the first byte not read yet
+    size_t size     = 0;          ///< The number of bytes received in order, not read yet
+
+    tcp_range ranges[max_ranges]; ///< The ranges received out of order
+    size_t holes = 0;             ///< The number of ranges received out of order
+
+    spinlock lock; ///< The lock protecting the buffer
+
+    tcp_receive_buffer() = default;
+
+    tcp_receive_buffer(const tcp_receive_buffer& rhs) = delete;
+    tcp_receive_buffer& operator=(const tcp_receive_buffer& rhs) = delete;
+
+    ~tcp_receive_buffer(){
+        // The ring is charged to the network memory
+        network::memory::release(capacity);
+    }
+};
+
+struct tcp_connection;
+
+/*!
+ * \brief A half-open connection of a server: the SYN of the peer is
+ * answered and its ACK is not received yet
+ */
+struct tcp_syn_entry {
+    network::ip::address address; ///< The address of the peer
+    uint16_t port;                ///< The port of the peer
+    uint32_t iss;                 ///< The initial sequence number of the server
+    uint32_t irs;                 ///< The initial sequence number of the peer
+    uint16_t window;              ///< The window of the SYN of the peer
+    int window_scale;             ///< The window scale option of the peer, -1 if absent
+    uint64_t expires;             ///< The time after which the entry is dropped, in milliseconds
+};
+
+/*!
+ * \brief The listen backlog of a server connection.
+ *
+ * The SYNs are answered from the RX path and remembered in the SYN queue
+ * until the handshake completes, the established connections then wait in
+ * the accept queue. Once the SYN queue is full, the SYNs are answered with
+ * a cookie and no state is kept.
+ */
+struct tcp_backlog {
+    size_t size = 0;                          ///< The maximum number of connections in each queue
+    std::vector<tcp_syn_entry> syn_queue;     ///< The half-open connections
+    std::queue<tcp_connection*> accept_queue; ///< The established connections, not accepted yet
+    spinlock lock;                            ///< The lock protecting the queues
+};
+
 /*!
  * \brief A TCP connection
  */
@@ -49,6 +139,21 @@ struct tcp_connection {
     uint32_t fina_ack_number = 0; ///< The next ack number (from finalize)
     uint32_t fina_seq_number = 0; ///< The next sequence number (from finalize)
 
+    uint32_t send_unacked = 0;  ///< The oldest sequence number not acknowledged
+    uint32_t send_window  = 0;  ///< The window advertised by the peer, in bytes
+    uint8_t send_shift    = 0;  ///< The window scale of the peer
+    uint8_t receive_shift = 0;  ///< The window scale advertised to the peer
+    int syn_window_scale  = -1; ///< The window scale option of the SYN of the peer, -1 if absent
+
+    spinlock segments_lock;            ///< The lock protecting the send state
+    std::deque<tcp_segment> segments;  ///< The retransmission queue
+    condition_variable acked;          ///< Notified when segments are acknowledged
+    congestion_state congestion;       ///< The congestion window and the RTT estimation
+
+    tcp_receive_buffer receive; ///< The bytes received and not read yet
+
+    tcp_backlog backlog; ///< The connections not accepted yet, for a server
+
     network::socket* socket = nullptr; ///< Pointer to the user socket
 
     tcp_connection() : listening(false) {
@@ -59,6 +164,15 @@ struct tcp_connection {
     tcp_connection& operator=(const tcp_connection& rhs) = delete;
 };
 
+/*!
+ * \brief Cut a large TCP packet into segments of its gso_size, each with
+ * its own headers and checksums.
+ * \param interface The interface on which the segments are sent
+ * \param packet The finalized large packet
+ * \return The segments, in order
+ */
+std::vector<network::packet_p> segment(network::interface_descriptor& interface, const network::packet& packet);
+
 /*!
  * \brief The TCP layer implementation
  */
@@ -106,6 +220,28 @@ struct layer {
      */
     std::expected<void> send(char* target_buffer, network::socket& socket, const char* buffer, size_t n);
 
+    /*!
+     * \brief Send kernel data through the connection, split into segments
+     * built in the kernel and sent as long as the window of the peer
+     * allows it. Returns once all the segments are acknowledged.
+     * \param socket The user socket
+     * \param buffer The source data
+     * \param n The size of the source data
+     * \return Nothing or an error
+     */
+    std::expected<void> kernel_send(network::socket& socket, const char* buffer, size_t n);
+
+    /*!
+     * \brief Send several buffers through the connection, gathered into
+     * segments built in the kernel and sent as long as the window of the
+     * peer allows it. Returns once all the segments are acknowledged.
+     * \param socket The user socket
+     * \param vectors The source buffers
+     * \param n The number of buffers
+     * \return Nothing or an error
+     */
+    std::expected<void> kernel_sendv(network::socket& socket, const vfs::iovec* vectors, size_t n);
+
     /*!
      * \brief Receive a message directly
      * \þaram buffer The buffer in which to store the message
@@ -147,9 +283,10 @@ struct layer {
      * \param socket The user socket
      * \param server_port The server port
      * \param server The server address
+     * \param backlog The maximum number of connections waiting to be accepted
      * \return Nothing or an error
      */
-    std::expected<void> server_start(network::socket& socket, size_t server_port, network::ip::address server);
+    std::expected<void> server_start(network::socket& socket, size_t server_port, network::ip::address server, size_t backlog);
 
     /*!
      * \brief Wait for a connection to the server
@@ -166,15 +303,26 @@ struct layer {
      */
     std::expected<size_t> accept(network::socket& socket, size_t ms);
 
+    /*!
+     * \brief Format the state of the connections, one line per connection
+     */
+    std::string format_connections();
+
 private:
     std::expected<network::packet_p> kernel_prepare_packet(network::interface_descriptor& interface, network::ip::address target_ip, size_t source, size_t target, size_t payload_size);
     std::expected<network::packet_p> kernel_prepare_packet(network::interface_descriptor& interface, tcp_connection& connection, size_t payload_size);
-    std::expected<void> finalize_packet_direct(network::interface_descriptor& interface, network::packet_p& p);
+    std::expected<void> finalize_packet_direct(network::interface_descriptor& interface, network::packet_p& p, uint32_t payload_sum = 0, size_t payload_len = 0);
+    std::expected<size_t> read_stream(tcp_connection& connection, char* buffer, size_t n);
+    std::expected<void> wait_send_window(network::interface_descriptor& interface, tcp_connection& connection, size_t bytes, bool flush);
+    bool server_handshake(network::interface_descriptor& interface, network::packet_p& packet, tcp_connection& server);
+    void send_syn_ack(network::interface_descriptor& interface, size_t local_port, const tcp_syn_entry& entry);
 
     network::ip::layer* parent; ///< The parent layer
 
     std::atomic<size_t> local_port; ///< The local port allocator
 
+    uint32_t cookie_secret = 0; ///< The secret of the SYN cookies
+
     network::connection_handler<network::tcp::tcp_connection> connections; ///< The TCP connections
 };
 
@@ -16,6 +16,7 @@
 #include "net/interface.hpp"
 #include "net/packet.hpp"
 #include "net/connection_handler.hpp"
+#include "net/port_table.hpp"
 #include "net/socket.hpp"
 
 namespace network {
@@ -235,7 +236,7 @@ private:
     network::dns::layer* dns_layer; ///< The DNS layer
     network::dhcp::layer* dhcp_layer; ///< The DHCP layer
 
-    std::atomic<size_t> local_port; ///< The local port allocator
+    network::port_table ports; ///< The allocator of the local ports of the clients
 
     network::connection_handler<udp_connection> connections; ///< The UDP connections
 };
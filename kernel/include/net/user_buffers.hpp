@@ -0,0 +1,58 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NET_USER_BUFFERS_H
+#define NET_USER_BUFFERS_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "net/packet_pool.hpp"
+
+#include "paging.hpp"
+
+namespace network {
+
+constexpr const size_t USER_BUFFERS = 64; ///< The number of packet buffers mapped for a socket
+constexpr const size_t USER_BUFFER_PAGES = USER_BUFFERS * PACKET_BUFFER_SIZE / paging::PAGE_SIZE; ///< The number of pages of the buffers of a socket
+
+/*!
+ * \brief The packet buffers of a socket, mapped both in the kernel and in
+ * the process.
+ *
+ * The process writes the headers and the payload of the packets directly
+ * into their buffers, the packets are then sent without any copy. A buffer
+ * goes back to the pool once its packet is released by the stack.
+ */
+struct user_buffers : packet_pool {
+    size_t pages[USER_BUFFER_PAGES]; ///< The physical pages of the buffers
+    size_t kernel_address = 0;       ///< The address of the buffers in the kernel
+    size_t user_address = 0;         ///< The address of the buffers in the process
+
+    /*!
+     * \brief Returns the address of the payload of the given packet in the process
+     */
+    size_t user_payload(const network::packet& packet) const {
+        return user_address + (reinterpret_cast<size_t>(packet.payload) - kernel_address);
+    }
+};
+
+/*!
+ * \brief Allocate packet buffers and map them in the current process
+ * \return the buffers or an error
+ */
+std::expected<user_buffers*> map_user_buffers();
+
+/*!
+ * \brief Release packet buffers. They are freed once all their packets are
+ * released by the stack and the process does not map them anymore.
+ */
+void unmap_user_buffers(user_buffers* buffers);
+
+} // end of network namespace
+
+#endif
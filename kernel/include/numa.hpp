@@ -0,0 +1,63 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <types.hpp>
+
+/*!
+ * \brief The memory nodes of the machine, from the ACPI SRAT and SLIT
+ * tables.
+ *
+ * Without SRAT, there is a single node holding all the memory and all the
+ * processors.
+ */
+namespace numa {
+
+constexpr const size_t MAX_NODES = 8;        ///< The maximum number of nodes
+constexpr const uint8_t LOCAL_DISTANCE = 10; ///< The SLIT distance of a node to itself
+
+/*!
+ * \brief Queue the discovery of the nodes, once ACPI and the application
+ * processors are initialized
+ */
+void init();
+
+/*!
+ * \brief Discover the nodes and place the physical zones on them
+ */
+void late_init();
+
+/*!
+ * \brief Returns the number of nodes
+ */
+size_t nodes();
+
+/*!
+ * \brief Returns the node of the given processor
+ */
+size_t cpu_node(size_t cpu);
+
+/*!
+ * \brief Returns the node of the current processor
+ */
+size_t current_node();
+
+/*!
+ * \brief Returns the node holding most of the given physical range
+ */
+size_t range_node(size_t first, size_t last);
+
+/*!
+ * \brief Returns the SLIT distance between two nodes
+ */
+uint8_t distance(size_t from, size_t to);
+
+} //end of namespace numa
+
+#endif
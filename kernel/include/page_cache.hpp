@@ -0,0 +1,99 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "vfs/path.hpp"
+
+namespace vfs {
+
+struct file_system;
+
+} // end of namespace vfs
+
+namespace page_cache {
+
+/*!
+ * \brief The file backing cached pages.
+ *
+ * The pages are identified by the mounted file system, the location of
+ * the file inside it and the index of the page in the file.
+ */
+struct source {
+    vfs::file_system* fs; ///< The mounted file system
+    path fs_path;         ///< The path of the file inside the file system
+    size_t location;      ///< The location of the file inside the file system
+    size_t size;          ///< The size of the file, in bytes
+};
+
+/*!
+ * \brief Init the page cache
+ */
+void init();
+
+/*!
+ * \brief Returns the physical page holding the given page of the file.
+ *
+ * The page is read from the file if it is not cached, the bytes after the
+ * end of the file are zeroes. The caller becomes an owner of the page and
+ * must release it with physical_allocator::release.
+ *
+ * \param source The file
+ * \param page The index of the page in the file
+ * \return The physical address of the page, 0 if it cannot be read
+ */
+size_t get(const source& source, size_t page);
+
+/*!
+ * \brief Returns the physical page holding the given page of the file, only
+ * if it is already cached. The file is never read.
+ *
+ * The caller becomes an owner of the page and must release it with
+ * physical_allocator::release.
+ *
+ * \param source The file
+ * \param page The index of the page in the file
+ * \return The physical address of the page, 0 if it is not cached
+ */
+size_t get_cached(const source& source, size_t page);
+
+/*!
+ * \brief Read from the file through the cached pages
+ * \param source The file
+ * \param buffer The buffer into which to read
+ * \param count The number of bytes to read, the read stops at the end of the file
+ * \param offset The offset at which to start reading
+ * \return The number of bytes read
+ */
+std::expected<size_t> read(const source& source, char* buffer, size_t count, size_t offset);
+
+/*!
+ * \brief Evict up to the given number of pages only owned by the cache,
+ * to give memory back to the physical allocator
+ * \return The number of evicted pages
+ */
+size_t shrink(size_t pages);
+
+/*!
+ * \brief Drop the cached pages of the given file.
+ *
+ * The pages already handed out are left to their owners.
+ */
+void invalidate(vfs::file_system* fs, size_t location);
+
+/*!
+ * \brief Indicates if the page cache holds no page
+ */
+bool empty();
+
+} //end of namespace page_cache
+
+#endif
@@ -21,6 +21,8 @@ struct process_t;
 namespace paging {
 
 constexpr const size_t PAGE_SIZE = 4096; ///< The size of a page (4K)
+constexpr const size_t LARGE_PAGE_SIZE = 512 * PAGE_SIZE; ///< The size of a large page (2M)
+constexpr const size_t LARGE_PAGE_PAGES = LARGE_PAGE_SIZE / PAGE_SIZE; ///< The number of pages of a large page
 
 constexpr const size_t pml4e_allocations = 512_GiB; ///< The physical memory that a PML4T Entry can map
 constexpr const size_t pdpte_allocations = 1_GiB;   ///< The physical memory that a PDPT Entry can map
@@ -59,9 +61,17 @@ extern size_t virtual_pt_start;
 constexpr const uint8_t PRESENT        = 0x1;  ///< Paging flag for present page
 constexpr const uint8_t WRITE          = 0x2;  ///< Paging flag for writable page
 constexpr const uint8_t USER           = 0x4;  ///< Paging flag for user page
-constexpr const uint8_t WRITE_THROUGH  = 0x8;  ///< Paging flag for write-through page
+constexpr const uint8_t WRITE_THROUGH  = 0x8;  ///< Paging flag for write-through page, write-combining once init_pat is done
 constexpr const uint8_t CACHE_DISABLED = 0x10; ///< Paging flag for cache disabled page
 constexpr const uint8_t ACCESSED       = 0x20; ///< Paging flag for assessed page
+constexpr const uint8_t LARGE          = 0x80; ///< Paging flag for a large page (in a PD entry)
+
+constexpr const uint8_t WRITE_COMBINING = WRITE_THROUGH; ///< Paging flag for write-combining page, the PAT entry 1 is reprogrammed
+
+constexpr const size_t GLOBAL = 0x100;        ///< Paging flag for a page kept in the TLB across the address spaces, set on the kernel pages
+constexpr const size_t COPY_ON_WRITE = 0x200; ///< Available bit marking a shared page, copied on the first write
+
+constexpr const size_t KERNEL_ADDRESS_SPACE = 1; ///< The address space of the system processes
 
 /*!
  * \brief Test if an address is aligned on a page boundary
@@ -74,6 +84,75 @@ constexpr size_t page_align(size_t addr){
     return (addr / paging::PAGE_SIZE) * paging::PAGE_SIZE;
 }
 
+/*!
+ * \brief Test if an address is aligned on a large page boundary
+ */
+constexpr bool large_page_aligned(size_t addr){
+    return !(addr & (paging::LARGE_PAGE_SIZE - 1));
+}
+
+/*!
+ * \brief Program the page attribute table of the current processor.
+ *
+ * The entry selected by the write-through flag becomes write-combining.
+ * This must be done by each processor, before any write-combining page
+ * is mapped.
+ */
+void init_pat();
+
+/*!
+ * \brief Indicates if the pages can be mapped write-combining
+ */
+bool write_combining();
+
+/*!
+ * \brief Enable the process-context identifiers (PCID) on the given
+ * processor, if it supports them.
+ *
+ * The TLB entries are then tagged with the address space, they survive
+ * the switches between processes. This must be done by each processor,
+ * while CR3 holds the PCID 0.
+ */
+void init_pcid(size_t cpu);
+
+/*!
+ * \brief Enable the global pages on the current processor.
+ *
+ * The kernel pages are global, their TLB entries are shared by all the
+ * address spaces and invlpg flushes them from every PCID.
+ */
+void init_global_pages();
+
+/*!
+ * \brief Flush all the TLB entries of the current processor.
+ *
+ * A starting processor flushes the mappings changed before it receives
+ * the TLB shootdowns of the other processors.
+ */
+void flush_tlb_local();
+
+/*!
+ * \brief Returns a new address space identifier, never reused
+ */
+size_t new_address_space();
+
+/*!
+ * \brief Returns the value of CR3 to switch to the address space of the
+ * given process on the current processor.
+ *
+ * The TLB entries of the address space are kept if none of its user pages
+ * was invalidated since they were loaded, they are flushed otherwise. The
+ * process must be the owner of the address space, the current processor
+ * then receives the TLB shootdowns of its user pages.
+ */
+size_t switch_cr3(scheduler::process_t& process);
+
+/*!
+ * \brief Drop the TLB entries of a destroyed address space from the
+ * current processor
+ */
+void release_address_space(size_t address_space);
+
 /*!
  * \brief Early initialization of the paging manager. This is done
  * before the virtual and physical allocators are initialized.
@@ -141,7 +220,11 @@ bool identity_map_pages(size_t virt, size_t pages, uint8_t flags = PRESENT | WRI
 bool map(size_t virt, size_t physical, uint8_t flags = PRESENT | WRITE);
 
 /*!
- * \brief Map the given virtual pages to the given physical pages
+ * \brief Map the given virtual pages to the given physical pages.
+ *
+ * The parts of the range that are aligned on large pages, both virtually
+ * and physically, are mapped with large pages.
+ *
  * \param virt The first virtual page
  * \param physical The first physical page
  * \param pages The number of pages to map
@@ -151,13 +234,18 @@ bool map(size_t virt, size_t physical, uint8_t flags = PRESENT | WRITE);
 bool map_pages(size_t virt, size_t physical, size_t pages, uint8_t flags = PRESENT | WRITE);
 
 /*!
- * \brief Unmap the virtual page
+ * \brief Unmap the virtual page.
+ *
+ * A large page containing the page is split first. The page is flushed
+ * from the TLB of every processor before this returns.
+ *
  * \return true if unmap is possible, false otherwise
  */
 bool unmap(size_t virt);
 
 /*!
- * \brief Unmap the virtual pages
+ * \brief Unmap the virtual pages, they are flushed from the TLB of every
+ * processor before this returns
  * \þaram virt The first virtual page
  * \þaram pages The number of pages to unmap
  * \return true if unmap is possible, false otherwise
@@ -174,9 +262,19 @@ void map_kernel_inside_user(scheduler::process_t& process);
  * \brief Map the given virtual page to the given physical page for the given process
  * \param virt The virtual page
  * \param physical The physical page
+ * \param writable Indicates if the process can write to the page
+ * \return true if paging is possible, false otherwise
+ */
+bool user_map(scheduler::process_t& process, size_t virt, size_t physical, bool writable = true);
+
+/*!
+ * \brief Map the given virtual page to the given shared physical page for the
+ * given process, read-only and copied on the first write
+ * \param virt The virtual page
+ * \param physical The physical page
  * \return true if paging is possible, false otherwise
  */
-bool user_map(scheduler::process_t& process, size_t virt, size_t physical);
+bool user_map_copy_on_write(scheduler::process_t& process, size_t virt, size_t physical);
 
 /*!
  * \brief Map the given virtual pages to the given physical page for the given process
@@ -187,6 +285,59 @@ bool user_map(scheduler::process_t& process, size_t virt, size_t physical);
  */
 bool user_map_pages(scheduler::process_t& process, size_t virt, size_t physical, size_t pages);
 
+/*!
+ * \brief Map the given virtual large page to the given physical large page for the given process
+ * \param virt The virtual large page
+ * \param physical The physical large page
+ * \return true if paging is possible, false otherwise
+ */
+bool user_map_large(scheduler::process_t& process, size_t virt, size_t physical);
+
+/*!
+ * \brief Unmap the given virtual pages of the given process.
+ *
+ * The large pages must be entirely inside the range. The process must be
+ * the current one. The range is flushed from the TLB of every processor
+ * running the address space before this returns.
+ *
+ * \param virt The first virtual page
+ * \param pages The number of pages to unmap
+ * \return true if the pages have been unmapped, false otherwise
+ */
+bool user_unmap_pages(scheduler::process_t& process, size_t virt, size_t pages);
+
+/*!
+ * \brief Share all the user pages of the source process with the target process.
+ *
+ * The writable pages become read-only and copy-on-write in both processes.
+ * The source process must be the current one.
+ *
+ * \return true if the pages have been shared, false otherwise
+ */
+bool user_share(scheduler::process_t& source, scheduler::process_t& target);
+
+/*!
+ * \brief Returns the entry mapping the given virtual address of the process
+ * \param large Set to true if the entry is a large page (PD entry)
+ * \return The entry, 0 if the address is not mapped
+ */
+size_t user_entry(const scheduler::process_t& process, size_t virt, bool& large);
+
+/*!
+ * \brief Copy user memory of the given process into the kernel buffer.
+ * The process does not need to be the current one.
+ * \return true if the memory has been read, false if a page is not present
+ */
+bool user_read(const scheduler::process_t& process, size_t virt, char* buffer, size_t size);
+
+/*!
+ * \brief Map the page (or large page) of the given virtual address to the
+ * given physical memory, writable, instead of its current copy-on-write entry.
+ * The process must be the current one.
+ * \return true if the page has been remapped, false otherwise
+ */
+bool user_remap_writable(scheduler::process_t& process, size_t virt, size_t physical, bool large);
+
 /*!
  * \brief Returns the physical address of the PML4T table
  */
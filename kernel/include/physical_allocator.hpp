@@ -44,6 +44,23 @@ void finalize();
  */
 size_t allocate(size_t pages);
 
+/*!
+ * \brief Allocate several pages of physical memory filled with zeroes.
+ *
+ * The single and double pages are taken from the pools zeroed in advance
+ * by the idle processors, the other blocks are cleared synchronously.
+ *
+ * \param pages The number of pages
+ * \return The physical addres of the allocated pages
+ */
+size_t allocate_zeroed(size_t pages);
+
+/*!
+ * \brief Zero a batch of free pages for the zeroed pools, from an idle processor
+ * \return true if pages have been zeroed, false if there is nothing to do
+ */
+bool zero_free_pages();
+
 /*!
  * \brief Free the allocated physical memory
  * \param address The address of the allocated physical memory
@@ -51,6 +68,57 @@ size_t allocate(size_t pages);
  */
 void free(size_t address, size_t pages);
 
+/*!
+ * \brief Add an owner to the allocated block starting at the given address.
+ *
+ * A shared block is only freed once all its owners have released it.
+ */
+void share(size_t address);
+
+/*!
+ * \brief Release the allocated block, it is freed if the caller is its
+ * last owner
+ * \param address The address of the allocated physical memory
+ * \param pages The number of pages
+ * \return true if the block has been freed, false if it is still owned
+ */
+bool release(size_t address, size_t pages);
+
+/*!
+ * \brief Release a batch of single pages, like release for each of them.
+ *
+ * The freed pages go to the hot list of the processor and then to the zones
+ * under a single lock, the memory pressure is updated once.
+ *
+ * \param pages The addresses of the pages, the freed ones are moved at the front
+ * \param count The number of pages
+ * \return The number of freed pages
+ */
+size_t release_pages(size_t* pages, size_t count);
+
+/*!
+ * \brief Indicates if the block starting at the given address has several owners
+ */
+bool shared(size_t address);
+
+/*!
+ * \brief Place the zones on the memory nodes, once they are known. The
+ * allocations are then served from the node of the processor first.
+ */
+void init_nodes();
+
+/*!
+ * \brief Returns the size, in bytes, of the zones of the given node
+ */
+size_t node_size(size_t node);
+
+/*!
+ * \brief Returns the free memory, in bytes, of the zones of the given node.
+ *
+ * The pages of the hot lists and of the zeroed pools are not counted.
+ */
+size_t node_free(size_t node);
+
 /*!
  * \brief Return the amount of physical memory available
  */
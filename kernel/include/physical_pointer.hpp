@@ -88,7 +88,7 @@ struct physical_pointer {
      * \brief Returns the physical address
      */
     uintptr_t get_phys() const {
-        return virt;
+        return phys;
     }
 
     /*!
@@ -0,0 +1,73 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <types.hpp>
+#include <expected.hpp>
+#include <vector.hpp>
+
+#include "vfs/path.hpp"
+
+namespace pipe {
+
+constexpr const size_t CAPACITY = 16 * 1024; ///< The bytes buffered in a pipe
+
+/*!
+ * \brief Create a new pipe and register both its ends in the handles of
+ * the current process.
+ *
+ * The ends are files of the pipe file system, they are inherited as any
+ * other handle and the pipe is freed once all of them are released.
+ *
+ * \param read_fd Output reference to the fd of the read end
+ * \param write_fd Output reference to the fd of the write end
+ */
+std::expected<void> create(size_t& read_fd, size_t& write_fd);
+
+/*!
+ * \brief Read from a pipe, waiting until bytes are available. Once
+ * there are no writers anymore, the end of file is reached.
+ * \param id The pipe
+ * \param ms The maximum time to wait, in milliseconds, 0 to wait indefinitely
+ * \return the number of bytes read, 0 at the end of file
+ */
+std::expected<size_t> read(size_t id, char* buffer, size_t count, size_t ms);
+
+/*!
+ * \brief Write to a pipe, waiting while it is full
+ * \param id The pipe
+ * \return the number of bytes written, less than count only if the readers are gone midway
+ */
+std::expected<size_t> write(size_t id, const char* buffer, size_t count);
+
+/*!
+ * \brief Returns the number of bytes buffered in the pipe
+ */
+std::expected<size_t> size(size_t id);
+
+/*!
+ * \brief Returns the ids of the live pipes
+ */
+std::vector<size_t> pipes();
+
+/*!
+ * \brief Account a new handle of the given file, does nothing unless it is
+ * the end of a pipe
+ */
+void acquire(const path& file);
+
+/*!
+ * \brief Account the release of a handle of the given file, does nothing
+ * unless it is the end of a pipe
+ */
+void release(const path& file);
+
+} //end of namespace pipe
+
+#endif
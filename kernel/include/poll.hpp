@@ -0,0 +1,198 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef POLL_H
+#define POLL_H
+
+#include <types.hpp>
+#include <vector.hpp>
+#include <expected.hpp>
+
+#include "tlib/poll_constants.hpp"
+
+#include "conc/spinlock.hpp"
+#include "conc/wait_list.hpp"
+
+namespace poll {
+
+struct instance;
+struct source;
+
+/*!
+ * \brief The interest of a poll instance in a source
+ */
+struct watch {
+    poll_target target; ///< The kind of descriptor
+    size_t fd;          ///< The descriptor
+    size_t events;      ///< The watched events, with the triggering mode
+    size_t data;        ///< The data reported with the events
+
+    instance* owner; ///< The poll instance
+    source* origin;  ///< The watched source
+
+    watch* next = nullptr; ///< The next watch of the source
+
+    bool queued = false;         ///< Indicates if the watch is in the ready list
+    watch* ready_prev = nullptr; ///< The previous watch of the ready list
+    watch* ready_next = nullptr; ///< The next watch of the ready list
+};
+
+/*!
+ * \brief Something that can become ready (a socket, a terminal, ...).
+ *
+ * The owner calls notify() once its state changed, the readiness function
+ * gives the current events of the object.
+ */
+struct source {
+    typedef size_t (*readiness_fun)(const void* object); ///< Returns the current events of an object
+
+    /*!
+     * \brief Set the readiness function of the source
+     * \param fun The readiness function
+     * \param object The object given to the function
+     */
+    void init(readiness_fun fun, const void* object);
+
+    /*!
+     * \brief Returns the current events of the source
+     */
+    size_t events() const;
+
+    /*!
+     * \brief Wake up the poll instances interested in the current events
+     */
+    void notify();
+
+private:
+    readiness_fun readiness = nullptr; ///< The readiness function
+    const void* object = nullptr;      ///< The object of the source
+
+    spinlock lock;           ///< The lock protecting the watches
+    watch* watches = nullptr; ///< The watches of the source
+
+    friend struct instance;
+};
+
+/*!
+ * \brief A poll instance: an interest set and the list of the ready
+ * descriptors.
+ *
+ * The ready list is filled by the sources, a wait only looks at the ready
+ * descriptors. A level triggered descriptor stays in the list as long as
+ * it is ready, an edge triggered one is reported once per notification.
+ */
+struct instance {
+    instance(){}
+    ~instance();
+
+    instance(const instance& rhs) = delete;
+    instance& operator=(const instance& rhs) = delete;
+
+    /*!
+     * \brief Watch a new descriptor
+     * \param target The kind of descriptor
+     * \param fd The descriptor
+     * \param origin The source of the descriptor
+     * \param events The events to watch
+     * \param data The data to report with the events
+     */
+    std::expected<void> add(poll_target target, size_t fd, source* origin, size_t events, size_t data);
+
+    /*!
+     * \brief Change the watched events of a descriptor
+     */
+    std::expected<void> modify(poll_target target, size_t fd, size_t events, size_t data);
+
+    /*!
+     * \brief Stop watching a descriptor
+     */
+    std::expected<void> remove(poll_target target, size_t fd);
+
+    /*!
+     * \brief Stop watching a descriptor if it is watched (it has been closed)
+     */
+    void forget(poll_target target, size_t fd);
+
+    /*!
+     * \brief Wait indefinitely for ready descriptors
+     * \param events The events to fill
+     * \param n The maximum number of events
+     * \return The number of events
+     */
+    size_t wait(poll_event* events, size_t n);
+
+    /*!
+     * \brief Wait for ready descriptors at most ms milliseconds
+     * \param events The events to fill
+     * \param n The maximum number of events
+     * \param ms The maximum time to wait
+     * \return The number of events, 0 on timeout
+     */
+    size_t wait(poll_event* events, size_t n, size_t ms);
+
+    /*!
+     * \brief Queue a ready watch and wake up a waiter
+     */
+    void wake(watch* w);
+
+private:
+    watch* find(poll_target target, size_t fd);
+    void detach(watch* w);
+    void queue(watch* w);
+    void dequeue(watch* w);
+    size_t harvest(poll_event* events, size_t n);
+
+    std::vector<watch*> watches; ///< The interest set, only used by the owner process
+
+    spinlock lock;                ///< The lock protecting the ready list
+    wait_list waiters;            ///< The processes waiting for events
+    watch* ready_head = nullptr;  ///< The first ready watch
+    watch* ready_tail = nullptr;  ///< The last ready watch
+    size_t ready_count = 0;       ///< The number of ready watches
+};
+
+/*!
+ * \brief Create a new poll instance for the current process
+ * \return The descriptor of the instance
+ */
+std::expected<size_t> create();
+
+/*!
+ * \brief Destroy a poll instance of the current process
+ */
+std::expected<void> close(size_t fd);
+
+/*!
+ * \brief Change the interest set of a poll instance
+ * \param fd The descriptor of the instance
+ * \param operation The operation
+ * \param event The watched descriptor, its events (with POLL_EDGE for edge
+ * triggering) and the data to report with them
+ */
+std::expected<void> control(size_t fd, poll_operation operation, const poll_event* event);
+
+/*!
+ * \brief Wait indefinitely for ready descriptors
+ * \return The number of events
+ */
+std::expected<size_t> wait(size_t fd, poll_event* events, size_t n);
+
+/*!
+ * \brief Wait for ready descriptors at most ms milliseconds
+ * \return The number of events, 0 on timeout
+ */
+std::expected<size_t> wait(size_t fd, poll_event* events, size_t n, size_t ms);
+
+/*!
+ * \brief Stop watching a closed descriptor in the instances of the current
+ * process
+ */
+void forget(poll_target target, size_t fd);
+
+} //end of namespace poll
+
+#endif
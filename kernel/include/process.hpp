@@ -15,8 +15,15 @@
 #include "paging.hpp"
 #include "interrupts.hpp"
 #include "conc/wait_list.hpp"
+#include "timer_wheel.hpp"
+#include "sched_trace.hpp"
+#include "page_cache.hpp"
+#include "arena.hpp"
 
 #include "vfs/path.hpp"
+#include "vfs/open_file.hpp"
+
+struct mutex;
 
 namespace network {
 
@@ -24,6 +31,18 @@ struct socket;
 
 } // end of namespace network
 
+namespace poll {
+
+struct instance;
+
+} // end of namespace poll
+
+namespace syscall_stats {
+
+struct process_stats;
+
+} // end of namespace syscall_stats
+
 namespace scheduler {
 
 constexpr const size_t MAX_PRIORITY = 4;
@@ -33,7 +52,15 @@ constexpr const size_t DEFAULT_PRIORITY = 3;
 
 using pid_t = size_t; ///< A process id
 
-constexpr const pid_t INVALID_PID = 1024 * 1024 * 1024; //I'm pretty sure we won't violate this limit
+constexpr const pid_t INVALID_PID = static_cast<pid_t>(-1); ///< Never reached by the generations of the pids
+
+/*!
+ * \brief The scheduling class of a process
+ */
+enum class sched_policy : char {
+    ROUND_ROBIN = 0, ///< Round robin between the processes of the highest priority
+    FAIR = 1         ///< Fair share of the processor, weighted by priority
+};
 
 enum class process_state : char {
     EMPTY = 0, ///< Not a process
@@ -53,6 +80,31 @@ enum class process_state : char {
 struct segment_t {
     size_t physical; ///< The physical start
     size_t size; ///< The size of allocated memory
+    bool table; ///< Indicates if the segment is a paging table of the process
+};
+
+/*!
+ * \brief A region of the process loaded on demand from a file.
+ *
+ * The pages of the region are mapped on first touch. The bytes between
+ * file_start and file_end are read from the executable, the others are
+ * filled with zeroes.
+ *
+ * The pages of a cached region are mapped from the page cache instead,
+ * read-only or copy-on-write. The pages of a device region are the memory
+ * of the device, shared with it.
+ */
+struct region_t {
+    size_t start;      ///< The virtual start (page-aligned)
+    size_t end;        ///< The virtual end (page-aligned)
+    size_t file_start; ///< The virtual address of the first byte of the file
+    size_t file_end;   ///< The virtual address after the last byte of the file
+    size_t offset;     ///< The file offset of file_start
+
+    bool cached;               ///< Indicates if the region is mapped from the page cache
+    bool writable;             ///< Indicates if the process can write to its private copy of the pages
+    page_cache::source source; ///< The file of a cached region
+    size_t physical = 0;       ///< The physical memory of a device region, shared with the device, 0 otherwise
 };
 
 struct process_t {
@@ -67,6 +119,9 @@ struct process_t {
 
     size_t physical_cr3; ///< The physical address of the CR3
     size_t paging_size; ///< The  size of the paging structure
+    size_t address_space; ///< The identifier of the address space, tagging its TLB entries
+    volatile size_t tlb_generation; ///< Incremented at each invalidation of the user pages, only on the owner of the address space
+    volatile uint64_t tlb_cpus;     ///< The mask of the processors with the address space loaded, only on the owner of the address space
 
     size_t physical_user_stack; ///< The physical address of the user stack
     size_t physical_kernel_stack; ///< The physical address of the kernel stack
@@ -74,8 +129,17 @@ struct process_t {
 
     size_t kernel_rsp; ///< The kernel stack pointer
 
+    size_t mmap_end; ///< The end of the mapped files area
+
     size_t brk_start; ///< The start of the brk section
     size_t brk_end; ///< The end of the brk section
+    bool huge_heap; ///< Indicates if the brk section is backed by large pages
+
+    size_t alloc_profile; ///< The virtual address of the allocation profile of the program, 0 if none
+
+    arena::syscall_arena scratch; ///< The arena of the temporaries of the system calls
+
+    syscall_stats::process_stats* syscalls; ///< The statistics of the system calls, allocated by the first one
 
     // Only for system kernels
     char* user_stack; ///< Pointer to the user stack
@@ -85,20 +149,50 @@ struct process_t {
 
     wait_node wait; ///< The process's wait node
 
+    mutex* blocked_on;   ///< The mutex the process is waiting for, for the priority inheritance
+    mutex* held_mutexes; ///< The mutexes owned by the process, linked by their next_held
+
     std::vector<segment_t> segments; ///< The physical segments
+    std::vector<region_t> regions;   ///< The regions loaded on demand
+
+    path image; ///< The executable file backing the regions
 
     std::string name; ///< The name of the process
 };
 
 constexpr const size_t program_base = 0x8000000000; ///< The virtual address of a program start
 constexpr const size_t program_break = 0x9000000000; ///< The virtual address of a program break start
+constexpr const size_t program_mmap = 0xA000000000; ///< The virtual address of the first mapped file
 
 constexpr const auto user_stack_size = 2 * paging::PAGE_SIZE; ///< The size of the user stack
 constexpr const auto kernel_stack_size = 2 * paging::PAGE_SIZE; ///< The size of the kernel stack
 
 constexpr const auto user_stack_start = program_base + 0x700000; ///< The virtual address of a program user stack
+constexpr const auto time_page_start = program_base + 0x300000; ///< The virtual address of the time page
 constexpr const auto user_rsp = user_stack_start + (user_stack_size - 8); ///< The initial program stack pointer
 
+constexpr const auto user_stack_max_size = 256 * paging::PAGE_SIZE; ///< The size the user stack can grow to, the pages below the first ones are allocated on demand
+constexpr const auto user_stack_limit = user_stack_start + user_stack_size - user_stack_max_size; ///< The lowest address of the user stack, the page below it is never mapped
+
+static_assert(user_stack_limit - paging::PAGE_SIZE > time_page_start, "The guard page of the user stack must not overlap the time page");
+
+/*!
+ * \brief The resources used by a process since its creation
+ */
+struct process_usage {
+    uint64_t user_ticks;           ///< The timer ticks interrupting the process in user mode
+    uint64_t kernel_ticks;         ///< The timer ticks interrupting the process in kernel mode
+    uint64_t voluntary_switches;   ///< The switches away from the process while it was blocked, sleeping or exiting
+    uint64_t involuntary_switches; ///< The switches away from the process while it was still ready
+    uint64_t page_faults;          ///< The page faults of the process
+    uint64_t read_bytes;           ///< The bytes read through the VFS
+    uint64_t written_bytes;        ///< The bytes written through the VFS
+    uint64_t received_bytes;       ///< The bytes received from the sockets
+    uint64_t sent_bytes;           ///< The bytes sent to the sockets
+    uint64_t children_user_ticks;   ///< The user ticks of the terminated children
+    uint64_t children_kernel_ticks; ///< The kernel ticks of the terminated children
+};
+
 /*!
  * \brief An entry in the Process Control Block
  */
@@ -106,9 +200,31 @@ struct process_control_t {
     scheduler::process_t process; ///< The process itself
     scheduler::process_state state; ///< The state of the process
     size_t rounds; ///< The number of rounds remaining
-    size_t sleep_timeout; ///< The sleep timeout (in ticks)
-    std::vector<path> handles; ///< The file handles
+    timer_entry timeout; ///< The timeout of a sleeping or blocked process
+    process_control_t* run_next; ///< The next process in the run queue
+    process_control_t* run_prev; ///< The previous process in the run queue
+    bool queued; ///< Indicates if the process is in the run queue
+    size_t boost; ///< The priority inherited from the waiters of its mutexes, 0 if none
+    size_t cpu; ///< The processor running the process
+    scheduler::sched_policy policy; ///< The scheduling class of the process
+    uint64_t vruntime; ///< The virtual runtime, for the fair class
+    size_t heap_index; ///< The position in the fair heap, for the fair class
+    volatile bool on_cpu; ///< Indicates if a processor still uses the context of the process
+    uint64_t last_run; ///< The time (in milliseconds) the process was last switched out
+    uint32_t mxcsr; ///< The SSE control and status register of the process
+    uint16_t fpu_control; ///< The x87 control word of the process
+    uint64_t wakeup_time; ///< The timestamp of the last wake up, 0 once the process ran
+    sched_trace::run_delay_histogram run_delay; ///< The delays between wake up and run
+    process_usage usage; ///< The resources used by the process
+    size_t generation; ///< The number of times the slot has been released
+    size_t next_free; ///< The next free slot of the process table
+    pid_t owner; ///< The process owning the address space, the handles and the sockets, itself unless it is a thread
+    volatile size_t threads; ///< The number of threads sharing the address space of the process, not cleaned yet
+    process_control_t* zombie_next; ///< The next killed process waiting to be cleaned
+    uint64_t fs_base; ///< The base of the FS segment, for the thread-local storage
+    std::vector<vfs::open_file> handles; ///< The file handles
     std::deque<network::socket> sockets; ///< The socket handles
+    std::vector<poll::instance*> polls; ///< The poll instances
     path working_directory; ///< The current working directory
 };
 
@@ -0,0 +1,203 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef PROCESS_TABLE_H
+#define PROCESS_TABLE_H
+
+#include <types.hpp>
+#include <array.hpp>
+
+#include "scheduler.hpp"
+
+namespace scheduler {
+
+/*!
+ * \brief The table of the processes.
+ *
+ * The first slab is static, so that the table can be used before the
+ * kernel allocator is ready. The other entries are allocated by slabs,
+ * when there are no more free slots, and are never released, so they
+ * never move. The free slots are chained
+ * together so that allocation does not have to search for an empty one.
+ *
+ * A pid is made of the slot index and the generation of the slot, which
+ * is increased each time the slot is released, so that a stale pid cannot
+ * designate the next process of the slot.
+ */
+struct process_table {
+    static constexpr const size_t slot_bits = 12;                      ///< The number of bits of the slot in a pid
+    static constexpr const size_t max_slots = 1 << slot_bits;          ///< The maximum number of processes
+    static constexpr const size_t slot_mask = max_slots - 1;           ///< The mask of the slot in a pid
+    static constexpr const size_t slab_size = 64;                      ///< The number of entries of a slab
+    static constexpr const size_t max_slabs = max_slots / slab_size;   ///< The maximum number of slabs
+    static constexpr const size_t no_slot = max_slots;                 ///< Marks the end of the free list
+
+    static_assert(max_slots == MAX_PROCESS, "The pid slots must cover all the processes");
+
+    process_table(){
+        add_slab(first_slab.data());
+    }
+
+    /*!
+     * \brief An iterator over all the allocated slots
+     */
+    struct iterator {
+        iterator(process_table* table, size_t index) : table(table), index(index) {}
+
+        process_control_t& operator*(){
+            return table->slot(index);
+        }
+
+        iterator& operator++(){
+            ++index;
+            return *this;
+        }
+
+        bool operator!=(const iterator& rhs) const {
+            return index != rhs.index;
+        }
+
+    private:
+        process_table* table;
+        size_t index;
+    };
+
+    /*!
+     * \brief Returns the entry of the slot designated by the pid
+     */
+    process_control_t& operator[](pid_t pid){
+        return slot(pid & slot_mask);
+    }
+
+    /*!
+     * \brief Returns the entry of the slot designated by the pid
+     */
+    const process_control_t& operator[](pid_t pid) const {
+        return slot(pid & slot_mask);
+    }
+
+    /*!
+     * \brief Returns the entry of the given slot
+     */
+    process_control_t& slot(size_t index){
+        return slabs[index / slab_size][index % slab_size];
+    }
+
+    /*!
+     * \brief Returns the entry of the given slot
+     */
+    const process_control_t& slot(size_t index) const {
+        return slabs[index / slab_size][index % slab_size];
+    }
+
+    /*!
+     * \brief Returns the number of allocated slots
+     */
+    size_t size() const {
+        return slots;
+    }
+
+    /*!
+     * \brief Indicates if the pid designates an allocated slot
+     */
+    bool valid(pid_t pid) const {
+        return (pid & slot_mask) < slots;
+    }
+
+    /*!
+     * \brief Indicates if the pid designates a living process of its generation
+     */
+    bool exists(pid_t pid) const {
+        if(!valid(pid)){
+            return false;
+        }
+
+        auto& entry = (*this)[pid];
+        return entry.state != process_state::EMPTY && entry.process.pid == pid;
+    }
+
+    /*!
+     * \brief Allocate a free slot
+     * \param pid Filled with the pid of the allocated slot
+     * \return true if a slot was allocated, false if the table is full
+     */
+    bool allocate(pid_t& pid){
+        if(free_head == no_slot && !grow()){
+            return false;
+        }
+
+        auto index = free_head;
+        auto& entry = slot(index);
+
+        free_head = entry.next_free;
+        pid = index | (entry.generation << slot_bits);
+
+        return true;
+    }
+
+    /*!
+     * \brief Release the slot of the given pid, its pid can no longer be used
+     */
+    void release(pid_t pid){
+        auto index = pid & slot_mask;
+        auto& entry = slot(index);
+
+        ++entry.generation;
+        entry.next_free = free_head;
+        free_head = index;
+    }
+
+    iterator begin(){
+        return {this, 0};
+    }
+
+    iterator end(){
+        return {this, slots};
+    }
+
+private:
+    bool grow(){
+        if(slab_count == max_slabs){
+            return false;
+        }
+
+        // Value-initialization leaves the new entries EMPTY
+        auto slab = new process_control_t[slab_size]();
+
+        if(!slab){
+            return false;
+        }
+
+        add_slab(slab);
+
+        return true;
+    }
+
+    void add_slab(process_control_t* slab){
+        slabs[slab_count++] = slab;
+
+        // Chain the new slots so that the lowest ones are allocated first
+        for(size_t i = slab_size; i > 0; --i){
+            auto index = slots + i - 1;
+
+            slot(index).next_free = free_head;
+            free_head = index;
+        }
+
+        slots += slab_size;
+    }
+
+    std::array<process_control_t, slab_size> first_slab; ///< The static slab
+    std::array<process_control_t*, max_slabs> slabs {}; ///< The allocated slabs
+    size_t slab_count = 0;                              ///< The number of allocated slabs
+    size_t slots = 0;                                   ///< The number of allocated slots
+    size_t free_head = no_slot;                         ///< The first free slot
+};
+
+} //end of namespace scheduler
+
+#endif
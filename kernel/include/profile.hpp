@@ -0,0 +1,55 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <types.hpp>
+
+#include "interrupts.hpp"
+
+namespace profile {
+
+constexpr const size_t MAX_DEPTH = 8;   ///< The maximum number of frames unwound for a sample
+constexpr const size_t LINE_SIZE = 256; ///< An upper bound of the size of the text of one sample
+
+/*!
+ * \brief Start the sampling on all the processors
+ * \param depth The number of kernel frames to unwind with the frame
+ * pointers, only meaningful if the kernel keeps its frame pointers
+ */
+void start(size_t depth);
+
+/*!
+ * \brief Stop the sampling, the pending samples can still be read
+ */
+void stop();
+
+/*!
+ * \brief Record the interrupted context, called by the timer interrupts
+ * of each processor. This does not take any lock.
+ */
+void sample(const interrupt::syscall_regs* regs);
+
+/*!
+ * \brief Returns the number of samples that have not been read yet
+ */
+size_t pending();
+
+/*!
+ * \brief Consume the oldest samples, in text form, one line per sample:
+ * the processor, the pid, k or u for the mode, the address and the
+ * return addresses of the unwound frames, in hexadecimal
+ * \param buffer The output buffer
+ * \param count The size of the buffer
+ * \return The number of characters written
+ */
+size_t read(char* buffer, size_t count);
+
+} //end of namespace profile
+
+#endif
@@ -0,0 +1,137 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef REQUEST_QUEUE_HPP
+#define REQUEST_QUEUE_HPP
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include "conc/spinlock.hpp"
+#include "conc/semaphore.hpp"
+
+/*!
+ * \brief The operation of a block request
+ */
+enum class block_operation : uint8_t {
+    READ,
+    WRITE,
+    CLEAR
+};
+
+struct block_request;
+
+/*!
+ * \brief The function called once a request is completed, from the
+ * dispatcher of the queue
+ */
+using block_callback = void (*)(block_request& request);
+
+/*!
+ * \brief The function executing a transfer on the device
+ * \param data The data given to the queue
+ * \param operation The operation to execute
+ * \param sector The first sector
+ * \param count The number of sectors
+ * \param buffer The buffer of the transfer, nullptr for CLEAR
+ * \param transferred Output reference to indicate the number of bytes transferred
+ * \return 0 on success, an error code otherwise
+ */
+using block_handler = size_t (*)(void* data, block_operation operation, uint64_t sector, size_t count, char* buffer, size_t& transferred);
+
+/*!
+ * \brief A request to transfer consecutive sectors of a device.
+ *
+ * The request is intrusive, it must stay alive until it is completed.
+ */
+struct block_request {
+    block_operation operation; ///< The operation to execute
+    uint64_t sector;           ///< The first sector
+    size_t count;              ///< The number of sectors
+    char* buffer;              ///< The buffer of the transfer, nullptr for CLEAR
+    block_callback callback;   ///< The function called on completion
+    void* data;                ///< The data of the callback
+    size_t result;             ///< 0 on success, an error code otherwise, set on completion
+    size_t transferred;        ///< The number of bytes transferred, set on completion
+    uint64_t submitted;        ///< The time (in milliseconds) of the submission
+    block_request* next;       ///< The next request in the queue
+};
+
+/*!
+ * \brief The queue of the requests of a block device.
+ *
+ * The pending requests are kept sorted by sector. A dispatcher task
+ * executes them in one direction of the disk (C-LOOK), unless a request
+ * waited past its deadline, and merges the adjacent requests with the
+ * same operation into one transfer. The overlapping requests are not
+ * ordered.
+ */
+struct request_queue {
+    /*!
+     * \brief Initialize the queue
+     * \param name The name of the queue, for sysfs and the dispatcher
+     * \param handler The function executing the transfers
+     * \param data The data given to the handler
+     * \param sector_size The size of a sector
+     * \param max_sectors The maximum number of sectors of a merged transfer
+     */
+    void init(const std::string& name, block_handler handler, void* data, size_t sector_size, size_t max_sectors);
+
+    /*!
+     * \brief Start the dispatcher of the queue. Before that, the requests
+     * are executed directly by the submitter.
+     */
+    void start();
+
+    /*!
+     * \brief Submit the request, its callback is called once the request
+     * is completed
+     */
+    void submit(block_request& request);
+
+    /*!
+     * \brief Submit the transfer and wait for its completion
+     * \return 0 on success, an error code otherwise
+     */
+    size_t execute(block_operation operation, uint64_t sector, size_t count, char* buffer, size_t& transferred);
+
+    /*!
+     * \brief Run the dispatcher, never returns
+     */
+    void dispatch();
+
+    uint64_t requests;    ///< The number of submitted requests
+    uint64_t completed;   ///< The number of completed requests
+    uint64_t transfers;   ///< The number of transfers executed on the device
+    uint64_t merges;      ///< The number of requests merged into another
+    uint64_t expired;     ///< The number of requests dispatched on their deadline
+    uint64_t depth;       ///< The number of requests submitted and not completed
+    uint64_t max_depth;   ///< The largest depth of the queue
+    uint64_t latency;     ///< The total time (in milliseconds) from submission to completion
+    uint64_t max_latency; ///< The longest time (in milliseconds) from submission to completion
+
+private:
+    block_request* next_request();
+    void unlink(block_request* first, block_request* last);
+    void complete(block_request& request, size_t result, size_t transferred);
+
+    std::string name;      ///< The name of the queue
+    block_handler handler; ///< The function executing the transfers
+    void* handler_data;    ///< The data of the handler
+    size_t sector_size;    ///< The size of a sector
+    size_t max_sectors;    ///< The maximum number of sectors of a merged transfer
+    char* merge_buffer;    ///< The buffer of the merged transfers
+
+    volatile bool started; ///< Indicates if the dispatcher runs
+    uint64_t position;     ///< The sector following the last transfer
+
+    spinlock lock;        ///< The lock of the pending requests
+    semaphore pending;    ///< The number of submitted requests not yet seen by the dispatcher
+    block_request* head;  ///< The pending requests, sorted by sector
+};
+
+#endif
@@ -0,0 +1,101 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SCHED_TRACE_H
+#define SCHED_TRACE_H
+
+#include <types.hpp>
+#include <array.hpp>
+
+namespace sched_trace {
+
+/*!
+ * \brief The type of a scheduler event
+ */
+enum class event_type : uint8_t {
+    SWITCH, ///< A processor switched from a process (other) to another (pid)
+    WAKEUP, ///< A process (pid) was woken up by another (other)
+    BLOCK   ///< A process (pid) was blocked or put to sleep
+};
+
+constexpr const size_t LINE_SIZE = 73; ///< The size of the text of one event
+
+/*!
+ * \brief Histogram of the delays between the wake up of a process and the
+ * moment it runs.
+ *
+ * The bucket i counts the delays lower than 2^i microseconds, the last
+ * bucket counts all the longer delays.
+ */
+struct run_delay_histogram {
+    static constexpr const size_t buckets = 16; ///< The number of buckets
+
+    /*!
+     * \brief Add a delay, in microseconds, to the histogram
+     */
+    void add(uint64_t us){
+        size_t bucket = 0;
+
+        while(bucket + 1 < buckets && us >= (1ULL << bucket)){
+            ++bucket;
+        }
+
+        ++counts[bucket];
+    }
+
+    /*!
+     * \brief Reset all the buckets
+     */
+    void clear(){
+        counts = {};
+    }
+
+    std::array<uint32_t, buckets> counts; ///< The number of delays of each bucket
+};
+
+/*!
+ * \brief Enable the tracing, once the timer counter is available
+ */
+void init();
+
+/*!
+ * \brief Returns the current timestamp, in counter ticks
+ */
+uint64_t timestamp();
+
+/*!
+ * \brief Convert a number of counter ticks to microseconds
+ */
+uint64_t to_us(uint64_t ticks);
+
+/*!
+ * \brief Record an event in the ring of the current processor.
+ *
+ * This does not take any lock and can be used from any context.
+ */
+void record(event_type type, size_t pid, size_t other);
+
+/*!
+ * \brief Returns the number of events that have not been read yet
+ */
+size_t pending();
+
+/*!
+ * \brief Consume the oldest events, in text form.
+ *
+ * The events of all the processors are merged in timestamp order. Each
+ * event takes exactly LINE_SIZE characters.
+ *
+ * \param buffer The output buffer
+ * \param count The size of the buffer
+ * \return The number of characters written
+ */
+size_t read(char* buffer, size_t count);
+
+} //end of namespace sched_trace
+
+#endif
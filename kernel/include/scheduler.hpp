@@ -9,8 +9,10 @@
 #define SCHEDULER_H
 
 #include <vector.hpp>
+#include <small_vector.hpp>
 #include <string.hpp>
 #include <expected.hpp>
+#include <initializer_list.hpp>
 
 #include "process.hpp"
 #include "net/socket.hpp"
@@ -19,7 +21,17 @@
 
 namespace scheduler {
 
-constexpr const size_t MAX_PROCESS = 128;
+constexpr const size_t MAX_PROCESS = 4096; ///< The maximum number of processes alive at the same time
+
+typedef std::small_vector<std::string, 8> params_type; ///< The parameters of a program, usually only a few
+
+/*!
+ * \brief Returns the number of slots of the process table.
+ *
+ * A slot index can be used in place of a pid to designate the process
+ * currently in the slot.
+ */
+size_t process_slots();
 
 /*!
  * \brief Return the id of the current process
@@ -36,6 +48,31 @@ scheduler::process_t& get_process(pid_t pid);
  */
 scheduler::process_state get_process_state(pid_t pid);
 
+/*!
+ * \brief Indicates if the process with the given ID is running on a processor
+ */
+bool is_running(pid_t pid);
+
+/*!
+ * \brief Returns the priority the process is scheduled with, including
+ * the priority inherited from the waiters of its mutexes
+ */
+size_t get_priority(pid_t pid);
+
+/*!
+ * \brief Raise the process to the given priority, inherited from a waiter
+ * of one of its mutexes
+ * \return true if the priority of the process has been raised, false if
+ * it was already at least the given priority
+ */
+bool inherit_priority(pid_t pid, size_t priority);
+
+/*!
+ * \brief Set the priority inherited by the process from the waiters of
+ * its mutexes, 0 or any priority not above its own removes the boost
+ */
+void set_boost(pid_t pid, size_t priority);
+
 /*!
  * \brief Block the given process and immediately reschedule it
  */
@@ -61,6 +98,18 @@ void init();
  */
 void start() __attribute__((noreturn));
 
+/*!
+ * \brief Prepare the scheduling of an application processor
+ *
+ * This creates the idle task of the processor.
+ */
+void init_cpu(size_t cpu);
+
+/*!
+ * \brief Start the scheduler on the current application processor
+ */
+void start_cpu(size_t cpu) __attribute__((noreturn));
+
 /*!
  * \brief Indicates if the scheduler is started or not
  */
@@ -68,8 +117,51 @@ bool is_started();
 
 /*!
  * \brief Execute the given file in a new process
+ * \param flags The EXEC_ flags of the new process
+ * \param handles The fds of the current process to use as the standard
+ * input, output and error of the new process, 0 to inherit the standard one,
+ * nullptr to inherit all of them
  */
-std::expected<pid_t> exec(const std::string& path, const std::vector<std::string>& params);
+std::expected<pid_t> exec(const std::string& path, const params_type& params, size_t flags = 0, const size_t* handles = nullptr);
+
+/*!
+ * \brief Create a copy of the current process, from its system call.
+ *
+ * The child shares the pages of the parent, they are copied on write. The
+ * child returns from the system call with 0.
+ *
+ * \param regs The registers of the system call
+ * \return The pid of the child
+ */
+std::expected<pid_t> fork(const interrupt::syscall_regs& regs);
+
+/*!
+ * \brief Create a thread of the current process.
+ *
+ * The thread shares the address space, the files and the sockets of the
+ * process. The address space stays alive until all the threads have ended,
+ * even if the process itself ends before. The thread is joined with
+ * await_termination().
+ *
+ * \param entry The function executed by the thread, it must not return
+ * \param stack The top of the user stack of the thread
+ * \param data The argument of the function
+ * \param tls The base of the FS segment of the thread
+ * \return The pid of the thread
+ */
+std::expected<pid_t> create_thread(size_t entry, size_t stack, size_t data, size_t tls);
+
+/*!
+ * \brief Set the base of the FS segment of the current process, for its
+ * thread-local storage
+ */
+void set_tls(size_t tls);
+
+/*!
+ * \brief Returns the process owning the address space, the files and the
+ * sockets of the current process, the process itself unless it is a thread
+ */
+process_t& get_owner_process();
 
 /*!
  * \brief Kill the current process
@@ -87,11 +179,80 @@ void await_termination(pid_t pid);
  */
 void sbrk(size_t inc);
 
+/*!
+ * \brief Give back the memory at the end of the heap of the process.
+ *
+ * Only the blocks of memory entirely inside the released range are given
+ * back, so less memory than requested can be released.
+ *
+ * \param dec The amount of memory to release
+ */
+void brk_release(size_t dec);
+
+/*!
+ * \brief Map a file in the memory of the current process.
+ *
+ * The pages are mapped from the page cache on first touch. The writes of
+ * the process go to private copies of the pages, they never reach the file.
+ *
+ * \param fd The file descriptor
+ * \param offset The offset of the mapping in the file (page-aligned)
+ * \param length The number of bytes to map, clipped to the end of the file
+ * \param prot The MMAP_ flags of the mapping
+ * \return The virtual address of the mapping
+ */
+std::expected<size_t> mmap(size_t fd, size_t offset, size_t length, size_t prot);
+
+/*!
+ * \brief Map pages of the kernel into the current process, writable.
+ *
+ * The pages are mapped right away and the process becomes one of their
+ * owners, they are only freed once released by all their owners.
+ *
+ * \param pages The physical addresses of the pages
+ * \param n The number of pages
+ * \return The virtual address of the mapping
+ */
+std::expected<size_t> map_shared_pages(const size_t* pages, size_t n);
+
+/*!
+ * \brief Unmap pages mapped with map_shared_pages() from the current process.
+ *
+ * The process is no longer one of the owners of the pages.
+ *
+ * \param address The virtual address of the mapping
+ * \param n The number of pages
+ */
+std::expected<void> unmap_shared_pages(size_t address, size_t n);
+
 /*!
  * \brief Let the scheduler know of a timer tick
  */
 void tick();
 
+/*!
+ * \brief Let the scheduler know that several timer ticks elapsed at once
+ */
+void tick(uint64_t ticks);
+
+/*!
+ * \brief Account a timer tick to the current process
+ * \param user Indicates if the tick interrupted the process in user mode
+ */
+void account_tick(bool user);
+
+/*!
+ * \brief Account the bytes read and written through the VFS by the
+ * current process
+ */
+void account_io(size_t read, size_t written);
+
+/*!
+ * \brief Account the bytes received and sent through the sockets by the
+ * current process
+ */
+void account_socket(size_t received, size_t sent);
+
 /*!
  * \brief Let another process run.
  */
@@ -107,6 +268,23 @@ void reschedule();
  */
 void fault();
 
+/*!
+ * \brief Returns the physical address of a writable address of the current
+ * process. A copy-on-write page is copied first, the address then stays
+ * the same while the page is mapped.
+ * \return the physical address, 0 if the address is not mapped writable
+ */
+size_t user_physical_address(size_t address);
+
+/*!
+ * \brief Try to resolve a page fault of the current process by loading
+ * the missing page of one of its regions
+ * \param address The faulting address
+ * \param error_code The error code of the page fault
+ * \return true if the page has been mapped, false if the fault is genuine
+ */
+bool page_fault(size_t address, uint64_t error_code);
+
 /*!
  * \brief Make the current process sleep for the given amount of milliseconds
  * \param time The number of milliseconds to wait
@@ -129,6 +307,11 @@ size_t register_new_handle(const path& p);
  */
 const path& get_handle(size_t fd);
 
+/*!
+ * \brief Get the open file of the given file descriptor
+ */
+vfs::open_file& get_open_file(size_t fd);
+
 /*!
  * \brief Indicates if the current process has the given file descriptor
  */
@@ -172,6 +355,33 @@ std::deque<network::socket>& get_sockets();
  */
 std::deque<network::socket>& get_sockets(pid_t pid);
 
+/*!
+ * \brief Register a new poll instance for the current process
+ * \return The descriptor of the instance
+ */
+size_t register_new_poll(poll::instance* instance);
+
+/*!
+ * \brief Get the poll instance of the given descriptor
+ */
+poll::instance& get_poll(size_t fd);
+
+/*!
+ * \brief Indicates if the current process has the given poll instance
+ */
+bool has_poll(size_t fd);
+
+/*!
+ * \brief Release the given poll instance from the current process
+ * \return The instance, to be destroyed by the caller
+ */
+poll::instance* release_poll(size_t fd);
+
+/*!
+ * \brief Returns the poll instances of the current process
+ */
+std::vector<poll::instance*>& get_polls();
+
 /*!
  * \brief Returns the working directory of the current process
  */
@@ -216,6 +426,14 @@ process_t& create_kernel_task_args(const char* name, char* user_stack, char* ker
  */
 void queue_system_process(pid_t pid);
 
+/*!
+ * \brief Queue a created system process on the given processor
+ */
+void queue_system_process(pid_t pid, size_t cpu);
+
+constexpr const size_t MAX_INIT_TASKS = 16;       ///< The maximum number of asynchronous initialization tasks
+constexpr const size_t MAX_INIT_DEPENDENCIES = 4; ///< The maximum number of dependencies of an initialization task
+
 /*!
  * \brief Queue an initilization task that will be run after the
  * scheduler is started
@@ -223,8 +441,14 @@ void queue_system_process(pid_t pid);
  * This must be used for drivers that needs scheduling to be started
  * or for drivers depending on others drivers asynchronously
  * started.
+ *
+ * Each task runs in its own kernel process, concurrently with the tasks
+ * it does not depend on, and is recorded in the boot trace.
+ *
+ * \param name The name of the task, must stay valid
+ * \param after The names of the tasks to wait for, queued before this one
  */
-void queue_async_init_task(void (*fun)());
+void queue_async_init_task(const char* name, void (*fun)(), std::initializer_list<const char*> after = {});
 
 /*!
  * \brief Lets the scheduler know that the timer frequency has been updated
@@ -0,0 +1,55 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "process.hpp"
+
+namespace shm {
+
+constexpr const size_t MAX_NAME = 64;                ///< The maximum length of the name of an object
+constexpr const size_t MAX_SIZE = 16 * 1024 * 1024;  ///< The maximum size of an object
+
+/*!
+ * \brief Create a named shared memory object, filled with zeroes
+ * \param name The name of the object
+ * \param size The size of the object, rounded up to pages
+ */
+std::expected<void> create(const char* name, size_t size);
+
+/*!
+ * \brief Map a shared memory object into the current process, writable
+ * \param name The name of the object
+ * \param size Output reference to the size of the mapping
+ * \return the address of the mapping
+ */
+std::expected<size_t> map(const char* name, size_t& size);
+
+/*!
+ * \brief Unmap a shared memory object from the current process
+ * \param address The address returned by map()
+ */
+std::expected<void> unmap(size_t address);
+
+/*!
+ * \brief Remove the name of a shared memory object. The memory is
+ * freed once the last process unmapped it.
+ */
+std::expected<void> remove(const char* name);
+
+/*!
+ * \brief Release the mappings of a terminated process
+ */
+void release(scheduler::pid_t pid);
+
+} //end of namespace shm
+
+#endif
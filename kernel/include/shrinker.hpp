@@ -0,0 +1,71 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SHRINKER_H
+#define SHRINKER_H
+
+#include <types.hpp>
+
+namespace shrinker {
+
+/*!
+ * \brief The level of pressure on the physical memory
+ */
+enum class pressure : uint8_t {
+    NONE = 0,    ///< Enough memory is free
+    LOW = 1,     ///< Less than 1/8 of the memory is free, the caches are reclaimed
+    MEDIUM = 2,  ///< Less than 1/16 of the memory is free
+    CRITICAL = 3 ///< Less than 1/32 of the memory is free, the allocations may soon fail
+};
+
+constexpr const size_t MAX_SHRINKERS = 8; ///< The maximum number of registered caches
+
+typedef size_t (*count_fun)();            ///< Returns an estimate of the number of pages the cache could give back
+typedef size_t (*scan_fun)(size_t pages); ///< Give back up to the given number of pages, returns the number of pages given back
+
+/*!
+ * \brief Init the memory pressure notifications, the /dev/memory_pressure
+ * device can be polled and is readable under pressure
+ */
+void init();
+
+/*!
+ * \brief Register a cache that can give memory back under pressure.
+ *
+ * The functions are called from a kernel worker, without any lock held,
+ * they must not allocate physical memory.
+ *
+ * \param name The name of the cache, for the statistics
+ * \param count The estimate of the reclaimable pages
+ * \param scan The reclaim function
+ */
+void add(const char* name, count_fun count, scan_fun scan);
+
+/*!
+ * \brief Update the pressure level after an allocation or a release of the
+ * physical memory.
+ *
+ * Once the level changed, the reclaim and the notifications are done by a
+ * kernel worker. With the interrupts disabled, nothing is done.
+ */
+void update();
+
+/*!
+ * \brief Ask the caches for the given number of pages, each in proportion
+ * of its reclaimable pages
+ * \return The number of pages given back
+ */
+size_t shrink(size_t pages);
+
+/*!
+ * \brief Returns the current pressure level
+ */
+pressure level();
+
+} //end of namespace shrinker
+
+#endif
@@ -0,0 +1,69 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <types.hpp>
+
+namespace smp {
+
+constexpr const size_t MAX_CPUS = 16; ///< The maximum number of processors
+
+/*!
+ * \brief Queue the initialization of the application processors.
+ *
+ * Since the processors are discovered with ACPI, the initialization
+ * is done asynchronously once the scheduler is started.
+ */
+void init();
+
+/*!
+ * \brief Start all the application processors
+ */
+void late_init();
+
+/*!
+ * \brief Returns the number of processors running the kernel
+ */
+size_t cpus();
+
+/*!
+ * \brief Returns one more than the highest index of the processors
+ * running the kernel.
+ *
+ * The indices follow the order of the MADT, the processors below this
+ * bound are not necessarily online, see online().
+ */
+size_t max_cpus();
+
+/*!
+ * \brief Returns the mask of the processors running the kernel, the bit i
+ * is set if the processor i is online
+ */
+uint64_t online_mask();
+
+/*!
+ * \brief Indicates if the given processor runs the kernel
+ */
+bool online(size_t cpu);
+
+/*!
+ * \brief Returns the index of the current processor
+ *
+ * The bootstrap processor is always the processor 0.
+ */
+size_t current_cpu();
+
+/*!
+ * \brief Returns the local APIC id of the given processor
+ */
+uint32_t apic_id(size_t cpu);
+
+} //end of namespace smp
+
+#endif
@@ -0,0 +1,58 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <types.hpp>
+
+namespace softirq {
+
+constexpr const size_t MAX_SOFTIRQS = 64; ///< The maximum number of registered softirqs
+
+/*!
+ * \brief Start the softirq thread of the bootstrap processor
+ */
+void init();
+
+/*!
+ * \brief Start the softirq thread of the given application processor
+ */
+void init_cpu(size_t cpu);
+
+/*!
+ * \brief Register the bottom half of an interrupt handler.
+ *
+ * The handler runs with the interrupts enabled, right after an interrupt
+ * or in the softirq thread of the processor under load. It must not block.
+ *
+ * \param id Output reference to the id of the softirq, to raise from the top half
+ * \return true if the handler was registered, false if there is no free softirq
+ */
+bool register_handler(size_t& id, void (*handler)(void*), void* data);
+
+/*!
+ * \brief Mark the softirq as pending on the current processor, can be
+ * used from an interrupt handler
+ */
+void raise(size_t id);
+
+/*!
+ * \brief Run the pending softirqs of the current processor, the
+ * interrupts must be disabled. Called at the end of the interrupts.
+ */
+void run();
+
+/*!
+ * \brief Indicates if softirqs are running on the current processor,
+ * the processor must not switch to another process meanwhile
+ */
+bool active();
+
+} //end of namespace softirq
+
+#endif
@@ -0,0 +1,35 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include <tlib/stats_snapshot.hpp>
+
+namespace stats {
+
+/*!
+ * \brief Take a snapshot of the core counters (memory, processes and
+ * network interfaces) into a buffer of the current process.
+ *
+ * The counters are gathered in a single pass with the interrupts disabled on
+ * the current processor. Only the given number of bytes of the snapshot are
+ * filled, for programs compiled against an older layout.
+ *
+ * \param buffer The buffer of the process
+ * \param size The size of the buffer
+ * \return The number of bytes filled, or an error if the buffer is too small
+ * for the header of the snapshot
+ */
+std::expected<size_t> snapshot(char* buffer, size_t size);
+
+} //end of namespace stats
+
+#endif
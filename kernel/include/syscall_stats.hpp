@@ -0,0 +1,73 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SYSCALL_STATS_H
+#define SYSCALL_STATS_H
+
+#include <types.hpp>
+#include <array.hpp>
+#include <string.hpp>
+
+namespace syscall_stats {
+
+constexpr const size_t MAX_SYSCALLS = 128; ///< The number of system calls with statistics
+constexpr const size_t BUCKETS = 32;       ///< The number of buckets of the latency histograms
+
+/*!
+ * \brief The statistics of the system calls of a process.
+ *
+ * The bucket i of a histogram counts the calls that took less than 2^i
+ * cycles of the time stamp counter, the last bucket counts all the longer
+ * calls.
+ */
+struct process_stats {
+    std::array<uint64_t, MAX_SYSCALLS> counts;                        ///< The calls of each system call
+    std::array<std::array<uint32_t, BUCKETS>, MAX_SYSCALLS> latencies; ///< The latency histograms of each system call
+};
+
+/*!
+ * \brief Returns the time stamp counter of the processor
+ */
+inline uint64_t cycles(){
+    uint32_t low;
+    uint32_t high;
+
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+/*!
+ * \brief Give a slot of statistics to the system call, once registered
+ */
+void register_syscall(size_t code);
+
+/*!
+ * \brief Account a system call of the current process.
+ *
+ * Only the counters of the current processor and of the current process
+ * are incremented, there is no lock nor atomic operation.
+ *
+ * \param code The system call
+ * \param cycles The cycles the system call took
+ */
+void record(size_t code, uint64_t cycles);
+
+/*!
+ * \brief Returns the statistics of all the processes, one line per system
+ * call with its number, its calls and its histogram
+ */
+std::string format();
+
+/*!
+ * \brief Returns the statistics of the given process, in the same format
+ */
+std::string format(const process_stats* stats);
+
+} //end of namespace syscall_stats
+
+#endif
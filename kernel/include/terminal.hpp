@@ -14,15 +14,29 @@
 #include <tlib/keycode.hpp>
 
 #include "conc/condition_variable.hpp"
+#include "conc/int_spinlock.hpp"
+#include "conc/spsc_queue.hpp"
 
 #include "fs/devfs.hpp"
 
 #include "console.hpp"
+#include "poll.hpp"
 
 namespace stdio {
 
 constexpr const size_t INPUT_BUFFER_SIZE = 256;
 
+constexpr const size_t IRQ_INPUT_SIZE = 128; ///< The number of inputs buffered from each IRQ
+constexpr const size_t RAW_INPUT_SIZE = 512; ///< The number of events buffered for the raw mode reader
+
+/*!
+ * \brief An input received by an IRQ handler
+ */
+struct irq_input {
+    size_t value;  ///< The scan code (keyboard) or key code (mouse)
+    uint64_t time; ///< The time (in ms since boot) of the IRQ
+};
+
 /*!
  * \brief A virtual terminal
  */
@@ -44,6 +58,14 @@ struct virtual_terminal {
      */
     void print(char c);
 
+    /*!
+     * \brief Print the given characters to the terminal, as one update of
+     * its console
+     * \param s The characters to print
+     * \param n The number of characters to print
+     */
+    void print(const char* s, size_t n);
+
     /*!
      * \brief Send a keyboard input to the terminal (from the keyboard driver)
      */
@@ -86,6 +108,20 @@ struct virtual_terminal {
      */
     size_t read_input_raw(size_t ms);
 
+    /*!
+     * \brief Reads all the pending input events, up to max, waiting for
+     * at least one
+     * \return the number of events that have been read
+     */
+    size_t read_input_events(std::input_event* events, size_t max);
+
+    /*!
+     * \brief Reads all the pending input events, up to max, waiting at
+     * most ms milliseconds for at least one
+     * \return the number of events that have been read
+     */
+    size_t read_input_events(std::input_event* events, size_t max, size_t ms);
+
     /*!
      * \brief Set the canonical mode of the terminal
      * \param can The canonical mode of the terminal
@@ -113,6 +149,12 @@ struct virtual_terminal {
      */
     void set_active(bool);
 
+    /*!
+     * \brief Returns the poll events of the terminal, the input is ready
+     * once a line (canonical mode) or a key (raw mode) is available
+     */
+    size_t poll_events() const;
+
     /*!
      * \brief Returns the console linked to this terminal
      */
@@ -124,19 +166,23 @@ struct virtual_terminal {
     bool mouse;
     size_t input_thread_pid;
 
-    // Filled by the IRQ
-    circular_buffer<char, 128> keyboard_buffer;
-    circular_buffer<size_t, 128> mouse_buffer;
+    // Filled by the IRQ, drained by the input thread
+    spsc_queue<irq_input, IRQ_INPUT_SIZE> keyboard_buffer;
+    spsc_queue<irq_input, IRQ_INPUT_SIZE> mouse_buffer;
 
     // Handled by the input thread
     circular_buffer<char, INPUT_BUFFER_SIZE> input_buffer;
     circular_buffer<char, 2 * INPUT_BUFFER_SIZE> canonical_buffer;
-    circular_buffer<size_t, 3 * INPUT_BUFFER_SIZE> raw_buffer;
+
+    // Filled by the input thread, drained by the raw mode reader
+    spsc_queue<std::input_event, RAW_INPUT_SIZE> raw_buffer;
 
     condition_variable input_queue;
+    poll::source input_source; ///< The readiness of the input, for the poll instances
 
 private:
     console cons;
+    int_spinlock output_lock; ///< Serialize the writes, and the activation, of the console
 };
 
 } //end of namespace stdio
@@ -18,6 +18,7 @@ struct terminal_driver final : devfs::char_driver {
     size_t read(void* data, char* buffer, size_t count, size_t& read) override;
     size_t read(void* data, char* buffer, size_t count, size_t& read, size_t ms) override;
     size_t write(void* data, const char* buffer, size_t count, size_t& written) override;
+    poll::source* poll_source(void* data) override;
 };
 
 } //end of namespace stdio
@@ -17,8 +17,9 @@
 // Don't use the full debugger, only the features for debugging output
 #define ACPI_DEBUG_OUTPUT
 
-// Let APCICA use its own cache
-#define ACPI_USE_LOCAL_CACHE
+// The object caches are provided by the OS layer (thor_acpi.cpp)
+struct thor_acpi_cache;
+#define ACPI_CACHE_T struct thor_acpi_cache
 
 // Limit compatibility to ACPI 5.0
 #define ACPI_REDUCED_HARDWARE TRUE
@@ -0,0 +1,38 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TIME_PAGE_H
+#define TIME_PAGE_H
+
+#include <types.hpp>
+
+#include "process.hpp"
+
+namespace time_page {
+
+/*!
+ * \brief Allocate the time page
+ */
+void init();
+
+/*!
+ * \brief Update the time page from the timer.
+ *
+ * This is called from the timer ticks of all the processors, an update
+ * is skipped if another processor is already updating the page.
+ */
+void update();
+
+/*!
+ * \brief Map the time page, read-only, inside the given process
+ * \return true if the page was mapped, false otherwise
+ */
+bool map(scheduler::process_t& process);
+
+} //end of namespace time_page
+
+#endif
@@ -32,6 +32,26 @@ uint64_t milliseconds();
  */
 void tick();
 
+/*!
+ * \brief Let the timer know that several ticks elapsed since the last one
+ */
+void tick(uint64_t ticks);
+
+/*!
+ * \brief Stop the periodic tick for at most the given number of ticks.
+ *
+ * Must be called with interrupts disabled. The elapsed ticks are
+ * reported at once by the next tick.
+ *
+ * \return true if the timer supports it, false otherwise
+ */
+bool stop_tick(uint64_t ticks);
+
+/*!
+ * \brief Restart the periodic tick after it has been stopped
+ */
+void restart_tick();
+
 /*!
  * \brief Return the frequency in Hz of the current timer system.
  */
@@ -62,6 +82,11 @@ void counter_frequency(uint64_t freq);
  */
 void counter_fun(uint64_t (*fun)());
 
+/*!
+ * \brief Sets the functions to use to stop and restart the periodic tick
+ */
+void tickless_fun(void (*stop_fun)(uint64_t), void (*restart_fun)());
+
 } //end of timer namespace
 
 #endif
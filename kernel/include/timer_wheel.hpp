@@ -0,0 +1,240 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <types.hpp>
+#include <array.hpp>
+
+/*!
+ * \brief A timer that can be armed in a timer wheel.
+ *
+ * The timer is intrusive, it must stay alive while it is armed.
+ */
+struct timer_entry {
+    size_t id;             ///< The owner of the timer
+    uint64_t expires;      ///< The tick at which the timer expires
+    timer_entry* next;     ///< The next timer in the slot
+    timer_entry* prev;     ///< The previous timer in the slot
+    uint8_t level;         ///< The level holding the timer
+    uint8_t slot;          ///< The slot holding the timer
+    bool armed;            ///< Indicates if the timer is in a wheel
+};
+
+/*!
+ * \brief A hierarchical timer wheel.
+ *
+ * Each level has 64 slots, a slot of level N covering 64^N ticks. Timers
+ * are put in the level matching their distance and cascaded to the lower
+ * level when the lower level wraps around. Insertion and cancellation are
+ * O(1) and a tick only looks at one slot, except when cascading.
+ */
+struct timer_wheel {
+    static constexpr const size_t bits = 6;                     ///< The number of bits indexing a slot
+    static constexpr const size_t slots = 1 << bits;            ///< The number of slots of each level
+    static constexpr const size_t mask = slots - 1;             ///< The mask of a slot index
+    static constexpr const size_t levels = 4;                   ///< The number of levels
+    static constexpr const uint64_t max_delta = (1ULL << (bits * levels)) - 1; ///< The maximal distance of a timer
+
+    /*!
+     * \brief Returns the last tick that has been processed
+     */
+    uint64_t now() const {
+        return next_tick - 1;
+    }
+
+    /*!
+     * \brief Indicates if there is no armed timer
+     */
+    bool empty() const {
+        return !count;
+    }
+
+    /*!
+     * \brief Arm the timer to expire in the given number of ticks (at least one)
+     */
+    void insert(timer_entry& timer, uint64_t ticks){
+        if(timer.armed){
+            cancel(timer);
+        }
+
+        timer.expires = now() + (ticks ? ticks : 1);
+
+        place(timer);
+
+        ++count;
+    }
+
+    /*!
+     * \brief Disarm the timer, if it is armed
+     */
+    void cancel(timer_entry& timer){
+        if(!timer.armed){
+            return;
+        }
+
+        unlink(timer);
+
+        --count;
+    }
+
+    /*!
+     * \brief Returns the number of ticks before the timer expires
+     */
+    uint64_t remaining(const timer_entry& timer) const {
+        return timer.expires > now() ? timer.expires - now() : 0;
+    }
+
+    /*!
+     * \brief Returns a lower bound of the number of ticks before the next
+     * timer expires, or max if there is no timer before
+     */
+    uint64_t next_expiry(uint64_t max) const {
+        if(!count){
+            return max;
+        }
+
+        auto next = max;
+
+        for(size_t level = 0; level < levels; ++level){
+            auto shift = bits * level;
+            auto index = next_tick >> shift;
+
+            for(size_t i = 0; i < slots; ++i){
+                if(wheel[level][(index + i) & mask]){
+                    // Timers of the upper levels are cascaded at the start
+                    // of their slot
+                    auto start = (index + i) << shift;
+                    auto ticks = start > now() ? start - now() : 1;
+
+                    next = ticks < next ? ticks : next;
+                    break;
+                }
+            }
+        }
+
+        return next;
+    }
+
+    /*!
+     * \brief Advance the wheel by the given number of ticks.
+     *
+     * The expired timers are disarmed and chained (with their next field)
+     * in the returned list, in order to be processed after the wheel is
+     * released.
+     */
+    timer_entry* advance(uint64_t ticks){
+        timer_entry* expired = nullptr;
+
+        // Nothing can expire, the time can simply be moved
+        if(!count){
+            next_tick += ticks;
+            return expired;
+        }
+
+        for(uint64_t i = 0; i < ticks; ++i){
+            auto index = next_tick & mask;
+
+            // Cascade the upper levels when the lower one wraps around
+            for(size_t level = 1; level < levels && !index; ++level){
+                index = (next_tick >> (bits * level)) & mask;
+                cascade(level, index);
+            }
+
+            auto& slot = wheel[0][next_tick & mask];
+
+            while(slot){
+                auto timer = slot;
+
+                unlink(*timer);
+
+                // The timer was too far to be placed directly
+                if(timer->expires > next_tick){
+                    place(*timer);
+                    continue;
+                }
+
+                --count;
+
+                timer->next = expired;
+                expired = timer;
+            }
+
+            ++next_tick;
+        }
+
+        return expired;
+    }
+
+private:
+    void place(timer_entry& timer){
+        auto expires = timer.expires;
+        auto delta = expires >= next_tick ? expires - next_tick : 0;
+
+        // Too far timers are placed at the end and placed again later
+        if(delta > max_delta){
+            expires = next_tick + max_delta;
+            delta = max_delta;
+        }
+
+        size_t level = 0;
+        while(level + 1 < levels && delta >= (1ULL << (bits * (level + 1)))){
+            ++level;
+        }
+
+        auto index = delta ? (expires >> (bits * level)) & mask : next_tick & mask;
+        auto& slot = wheel[level][index];
+
+        timer.prev = nullptr;
+        timer.next = slot;
+
+        if(slot){
+            slot->prev = &timer;
+        }
+
+        slot = &timer;
+
+        timer.armed = true;
+        timer.level = level;
+        timer.slot = index;
+    }
+
+    void unlink(timer_entry& timer){
+        auto& slot = wheel[timer.level][timer.slot];
+
+        if(timer.prev){
+            timer.prev->next = timer.next;
+        } else {
+            slot = timer.next;
+        }
+
+        if(timer.next){
+            timer.next->prev = timer.prev;
+        }
+
+        timer.next = timer.prev = nullptr;
+        timer.armed = false;
+    }
+
+    void cascade(size_t level, size_t index){
+        auto timer = wheel[level][index];
+        wheel[level][index] = nullptr;
+
+        while(timer){
+            auto next = timer->next;
+            place(*timer);
+            timer = next;
+        }
+    }
+
+    uint64_t next_tick = 1; ///< The next tick to process
+    size_t count = 0;       ///< The number of armed timers
+    std::array<std::array<timer_entry*, slots>, levels> wheel {}; ///< The slots of each level
+};
+
+#endif
@@ -0,0 +1,45 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLB_SHOOTDOWN_H
+#define TLB_SHOOTDOWN_H
+
+#include <types.hpp>
+
+/*!
+ * \brief The invalidation of the TLB entries of the other processors.
+ *
+ * A processor changing a mapping sends the range to the processors that
+ * may have cached it and waits for each of them to flush it. The requests
+ * are delivered with an IPI, but a processor spinning with the interrupts
+ * disabled would never acknowledge them and could wait for the sender
+ * itself. For this reason, the spinning loops poll the requests as well,
+ * see arch::pause().
+ *
+ * The requests are implemented with the paging structures, in paging.cpp.
+ */
+namespace tlb_shootdown {
+
+extern volatile uint64_t pending; ///< The mask of the processors with requests to handle
+
+/*!
+ * \brief Handle the requests sent to the current processor
+ */
+void handle();
+
+/*!
+ * \brief Handle the requests sent to the current processor, if any
+ */
+inline void poll(){
+    if(__atomic_load_n(&pending, __ATOMIC_RELAXED)){
+        handle();
+    }
+}
+
+} //end of namespace tlb_shootdown
+
+#endif
@@ -8,6 +8,8 @@
 #ifndef VESA_H
 #define VESA_H
 
+#include <expected.hpp>
+
 #include "vesa_types.hpp"
 
 namespace vesa {
@@ -47,9 +49,35 @@ uint64_t get_blue_shift();
 
 void* create_buffer();
 
+/*!
+ * \brief Draw a full screen buffer, only its pixels that changed are copied
+ * to the framebuffer
+ */
 void redraw(const char* buffer);
 void save(char* buffer);
 
+/*!
+ * \brief Copy the damaged pixels of the back buffer to the framebuffer.
+ *
+ * The drawings on the screen are flushed automatically once per frame.
+ */
+void flush();
+
+/*!
+ * \brief Map the back buffer in the current process.
+ *
+ * The buffer can only be mapped by one process at a time, which draws
+ * directly into it and presents the changes with present().
+ *
+ * \return The virtual address of the buffer in the process
+ */
+std::expected<size_t> map_buffer();
+
+/*!
+ * \brief Copy a rectangle of the mapped back buffer to the screen
+ */
+std::expected<void> present(size_t x, size_t y, size_t w, size_t h);
+
 } //end of vesa namespace
 
 #endif
@@ -29,6 +29,22 @@ struct vesa_console {
      */
     size_t columns() const;
 
+    /*!
+     * \brief Start a batch of changes of the console on screen, rendered
+     * together at the end of the batch
+     */
+    void begin_batch();
+
+    /*!
+     * \brief End a batch of changes started with begin_batch()
+     */
+    void end_batch();
+
+    /*!
+     * \brief Create a new, empty, vesa console state
+     */
+    void* create_buffer();
+
     /*!
      * \brief Clear the vesa console
      */
@@ -69,14 +85,16 @@ struct vesa_console {
     void print_char(void* buffer, size_t line, size_t column, char c);
 
     /*!
-     * \brief Save the state of the console
+     * \brief Save the state of the console, only copied if the screen
+     * does not already show the buffer
      * \param buffer The buffer to save to
      * \return the buffer the state was saved to
      */
     void* save(void* buffer);
 
     /*!
-     * \brief Restore the state of the console
+     * \brief Restore the state of the console. The screen shows the
+     * buffer itself, which receives the following changes
      * \param buffer The buffer to restore from
      */
     void restore(void* buffer);
@@ -0,0 +1,76 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef DENTRY_CACHE_H
+#define DENTRY_CACHE_H
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include "vfs/file.hpp"
+
+namespace vfs {
+
+struct file_system;
+
+} // end of namespace vfs
+
+namespace dentry_cache {
+
+/*!
+ * \brief Init the dentry cache
+ */
+void init();
+
+/*!
+ * \brief Look for the given name in a directory.
+ *
+ * The directory is identified by the mounted file system and its location
+ * inside it. A negative entry indicates that the name is known not to exist.
+ *
+ * \param fs The mounted file system
+ * \param parent The location of the directory
+ * \param name The name of the file in the directory
+ * \param file Output reference to the cached file
+ * \param exists Output reference indicating if the file exists
+ * \param generation Output reference to the generation to give to insert on a miss
+ * \return true if the name is cached, false otherwise
+ */
+bool lookup(vfs::file_system* fs, size_t parent, const std::string& name, vfs::file& file, bool& exists, size_t& generation);
+
+/*!
+ * \brief Look for the given name in a directory, with the precomputed hash
+ * of the name (the one of the parts of the paths)
+ */
+bool lookup(vfs::file_system* fs, size_t parent, const std::string& name, size_t name_hash, vfs::file& file, bool& exists, size_t& generation);
+
+/*!
+ * \brief Cache the file found in the directory.
+ *
+ * Nothing is cached if the cache was invalidated since the generation was
+ * returned by lookup.
+ */
+void insert(vfs::file_system* fs, size_t parent, const vfs::file& file, size_t generation);
+
+/*!
+ * \brief Cache that the name does not exist in the directory
+ */
+void insert_negative(vfs::file_system* fs, size_t parent, const std::string& name, size_t generation);
+
+/*!
+ * \brief Drop the entry of the given name in the directory
+ */
+void invalidate(vfs::file_system* fs, size_t parent, const std::string& name);
+
+/*!
+ * \brief Drop all the entries of the directory
+ */
+void invalidate(vfs::file_system* fs, size_t parent);
+
+} //end of namespace dentry_cache
+
+#endif
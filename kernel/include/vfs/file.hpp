@@ -20,6 +20,7 @@ struct file {
     bool directory;
     bool hidden;
     bool system;
+    bool char_device = false; ///< Indicates if the file is a character device
     uint64_t size;
     rtc::datetime created;
     rtc::datetime modified;
@@ -12,9 +12,15 @@
 #include <string.hpp>
 
 #include <tlib/statfs_info.hpp>
+#include <tlib/errors.hpp>
 
 #include "file.hpp"
 #include "path.hpp"
+#include "open_file.hpp"
+
+namespace poll {
+struct source;
+}
 
 namespace vfs {
 
@@ -82,6 +88,76 @@ struct file_system {
      */
     virtual size_t clear(const path& file_path, size_t count, size_t offset, size_t& written) = 0;
 
+    /*!
+     * \brief Fill the file system specific fields of the open file
+     * \param file The open file
+     * \return 0 on success, an error code otherwise
+     */
+    virtual size_t resolve(vfs::open_file& /*file*/){
+        return 0;
+    }
+
+    /*!
+     * \brief Returns the readiness source of a file, for the poll
+     * instances. Unless overridden, the files can not be polled.
+     * \param file_path The path to the file
+     * \return The source, or nullptr if the file can not be polled
+     */
+    virtual poll::source* poll_source(const path& /*file_path*/){
+        return nullptr;
+    }
+
+    /*!
+     * \brief Returns the physical memory of a file that can be mapped by
+     * the processes. Unless overridden, the files have no such memory.
+     * \param file_path The path to the file
+     * \param physical output reference to the physical address of the memory
+     * \param size output reference to the size of the memory
+     * \return 0 on success, an error code otherwise
+     */
+    virtual size_t memory(const path& /*file_path*/, size_t& /*physical*/, size_t& /*size*/){
+        return std::ERROR_UNSUPPORTED;
+    }
+
+    /*!
+     * \brief Read an open file. Unless overridden, the file is read from its path.
+     * \param file The open file, the file system can keep its resolution inside
+     * \param buffer The buffer into which to read
+     * \param count The amount of bytes to read
+     * \param offset The offset at which to start reading
+     * \param read output reference to indicate the number of bytes read
+     * \return 0 on success, an error code otherwise
+     */
+    virtual size_t read(vfs::open_file& file, char* buffer, size_t count, size_t offset, size_t& read){
+        return this->read(file.fs_path, buffer, count, offset, read);
+    }
+
+    /*!
+     * \brief Write to an open file. Unless overridden, the file is written from its path.
+     * \param file The open file, the file system can keep its resolution inside
+     * \param buffer The buffer from which to read
+     * \param count The amount of bytes to write
+     * \param offset The offset at which to start writing
+     * \param written output reference to indicate the number of bytes written
+     * \return 0 on success, an error code otherwise
+     */
+    virtual size_t write(vfs::open_file& file, const char* buffer, size_t count, size_t offset, size_t& written){
+        return this->write(file.fs_path, buffer, count, offset, written);
+    }
+
+    /*!
+     * \brief Clear a portion of an open file (write zeroes). Unless
+     * overridden, the file is cleared from its path.
+     * \param file The open file, the file system can keep its resolution inside
+     * \param count The amount of bytes to write
+     * \param offset The offset at which to start writing
+     * \param written output reference to indicate the number of bytes written
+     * \return 0 on success, an error code otherwise
+     */
+    virtual size_t clear(vfs::open_file& file, size_t count, size_t offset, size_t& written){
+        return this->clear(file.fs_path, count, offset, written);
+    }
+
     /*!
      * \brief Change the size of a file
      * \param file_path The path to the file to modify
@@ -0,0 +1,43 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef VFS_OPEN_FILE_H
+#define VFS_OPEN_FILE_H
+
+#include <types.hpp>
+
+#include "vfs/path.hpp"
+
+namespace vfs {
+
+struct file_system;
+
+/*!
+ * \brief A file descriptor of a process.
+ *
+ * The file is resolved once in its file system, the following operations
+ * do not walk its path again.
+ */
+struct open_file {
+    path base_path;            ///< The absolute path of the file
+    file_system* fs = nullptr; ///< The mounted file system, nullptr until resolved
+    path fs_path;              ///< The path of the file inside its file system
+    bool cached = false;       ///< Indicates if the pages of the file can be in the page cache
+
+    //File system specific
+    size_t location = 0;   ///< The location of the file inside its file system
+    size_t size = 0;       ///< The size of the file
+    bool directory = false; ///< Indicates if the file is a directory
+    size_t generation = 0; ///< The state of the file system when the file was resolved, 0 if never
+
+    open_file(){}
+    open_file(const path& base_path) : base_path(base_path) {}
+};
+
+} //end of namespace vfs
+
+#endif
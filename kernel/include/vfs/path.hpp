@@ -8,14 +8,66 @@
 #ifndef VFS_PATH_H
 #define VFS_PATH_H
 
-#include <vector.hpp>
+#include <small_vector.hpp>
 #include <string.hpp>
+#include <string_view.hpp>
+
+#include "arena.hpp"
 
 /*!
- * \brief Structure to represent a path on the file system
+ * \brief Structure to represent a path on the file system.
+ *
+ * The characters of the path are stored once, in its normalized string
+ * form, and each part is an offset, a length and a hash inside them. The
+ * parts are accessed without copy and their hashes are computed once.
+ *
+ * The storage of a path built inside an arena::scope is allocated from the
+ * arena of the system call. The first characters and parts are stored
+ * inline, the kernel stacks are too small for more.
  */
 struct path {
-    typedef std::vector<std::string>::const_iterator iterator; ///< The type of iterator
+    static constexpr const size_t INLINE_PARTS = 4;  ///< The number of parts stored in the path itself
+    static constexpr const size_t INLINE_CHARS = 32; ///< The number of characters stored in the path itself
+
+    /*!
+     * \brief A part of the path
+     */
+    struct segment {
+        uint32_t offset; ///< The position of the part in the characters
+        uint32_t length; ///< The number of characters of the part
+        size_t hash;     ///< The hash of the part, as std::hash<std::string_view>
+    };
+
+    typedef std::small_vector<char, INLINE_CHARS, arena::allocator<char>> chars_type;          ///< The type of the characters
+    typedef std::small_vector<segment, INLINE_PARTS, arena::allocator<segment>> segments_type; ///< The type of the parts
+
+    /*!
+     * \brief An iterator over the parts of a path
+     */
+    struct iterator {
+        iterator(const path* p, size_t i) : p(p), i(i) {}
+
+        std::string_view operator*() const {
+            return (*p)[i];
+        }
+
+        iterator& operator++(){
+            ++i;
+            return *this;
+        }
+
+        bool operator==(const iterator& rhs) const {
+            return i == rhs.i;
+        }
+
+        bool operator!=(const iterator& rhs) const {
+            return i != rhs.i;
+        }
+
+    private:
+        const path* p; ///< The iterated path
+        size_t i;      ///< The index of the part
+    };
 
     /*!
      * \brief Construct an empty path.
@@ -52,11 +104,6 @@ struct path {
      */
     std::string string() const;
 
-    /*!
-     * \brief Returns a reference to the internal representation of the path
-     */
-    const std::vector<std::string>& vec() const;
-
     // Modifiers
 
     /*
@@ -95,19 +142,19 @@ struct path {
     size_t size() const;
 
     /*!
-     * \brief Returns the base name (the last part)
+     * \brief Returns the base name (the last part), valid as long as the path
      */
-    std::string base_name() const;
+    std::string_view base_name() const;
 
     /*!
-     * \brief Returns the root name (the first part)
+     * \brief Returns the root name (the first part), valid as long as the path
      */
-    std::string root_name() const;
+    std::string_view root_name() const;
 
     /*!
-     * \brief Returns the sub root name (the second part)
+     * \brief Returns the sub root name (the second part), valid as long as the path
      */
-    std::string sub_root_name() const;
+    std::string_view sub_root_name() const;
 
     /*!
      * \brief Returns true if the path is absoluate, false otherwise
@@ -122,14 +169,19 @@ struct path {
     // Accessors to sub parts
 
     /*!
-     * \brief Returns the ith part of the path
+     * \brief Returns the ith part of the path, valid as long as the path
+     */
+    std::string_view name(size_t i) const;
+
+    /*!
+     * \brief Returns the ith part of the path, valid as long as the path
      */
-    const std::string& name(size_t i) const;
+    std::string_view operator[](size_t i) const;
 
     /*!
-     * \brief Returns the ith part of the path
+     * \brief Returns the hash of the ith part of the path
      */
-    const std::string& operator[](size_t i) const;
+    size_t hash(size_t i) const;
 
     // Decomposition functions
 
@@ -138,6 +190,11 @@ struct path {
      */
     path sub_path(size_t i) const;
 
+    /*!
+     * \brief Returns the absolute path formed by the elements from the ith one
+     */
+    path root_sub_path(size_t i) const;
+
     /*!
      * \brief Returns the path minus the last element
      */
@@ -167,8 +224,14 @@ struct path {
      */
     bool operator!=(const path& p) const;
 
-    private:
-        std::vector<std::string> names;
+private:
+    void append_root();
+    void append(std::string_view part);
+    void append(std::string_view part, size_t hash);
+    void append_all(std::string_view path);
+
+    chars_type chars;       ///< The characters of the path
+    segments_type segments; ///< The parts of the path
 };
 
 /*!
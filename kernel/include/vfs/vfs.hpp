@@ -12,9 +12,22 @@
 
 #include <tlib/stat_info.hpp>
 #include <tlib/statfs_info.hpp>
+#include <tlib/iovec.hpp>
 
 #include "vfs/path.hpp"
 
+namespace page_cache {
+
+struct source;
+
+} // end of namespace page_cache
+
+namespace poll {
+
+struct source;
+
+} // end of namespace poll
+
 namespace vfs {
 
 using fd_t = size_t;
@@ -27,14 +40,26 @@ enum class partition_type {
     SYSFS = 2, ///< Sysfs
     DEVFS = 3, ///< Devfs
     PROCFS = 4, ///< Procfs
+    PIPEFS = 5, ///< Pipefs
     UNKNOWN = 100 ///< Unknown file system
 };
 
 /*!
- * \brief Init the virtual file system
+ * \brief Init the virtual file system, with the file systems not backed
+ * by a disk
  */
 void init();
 
+/*!
+ * \brief Mount the root file system, once its disk is detected
+ */
+void mount_root();
+
+/*!
+ * \brief Wait until the root file system is mounted
+ */
+void wait_root();
+
 /*!
  * \brief Open the given file with the given flags
  * \param file The path to the file to open
@@ -109,6 +134,26 @@ std::expected<size_t> read(fd_t fd, char* buffer, size_t count, size_t offset, s
  */
 std::expected<size_t> write(fd_t fd, const char* buffer, size_t count, size_t offset = 0);
 
+/*!
+ * \brief Read from a file into several buffers, filled in order
+ * \param fd The file descriptor to the file
+ * \param vectors The buffers to write to
+ * \param n The number of buffers
+ * \param offset The index where to start reading the file
+ * \return the number of bytes read
+ */
+std::expected<size_t> readv(fd_t fd, const iovec* vectors, size_t n, size_t offset = 0);
+
+/*!
+ * \brief Write several buffers to a file, contiguously
+ * \param fd The file descriptor to the file
+ * \param vectors The buffers to read from
+ * \param n The number of buffers
+ * \param offset The index where to start writting the file
+ * \return the number of bytes written
+ */
+std::expected<size_t> writev(fd_t fd, const iovec* vectors, size_t n, size_t offset = 0);
+
 /*!
  * \brief Clear parts of a file content
  * \param fd The file descriptor to the file
@@ -126,6 +171,48 @@ std::expected<size_t> clear(fd_t fd, size_t count, size_t offset = 0);
  */
 std::expected<void> truncate(fd_t fd, size_t size);
 
+/*!
+ * \brief Describe the file for the page cache
+ *
+ * Only the regular files of FAT32 partitions can be cached.
+ *
+ * \param fd The file descriptor
+ * \param source The source to fill
+ * \return a status code
+ */
+std::expected<void> cache_source(fd_t fd, page_cache::source& source);
+
+/*!
+ * \brief Describe the file of the given path for the page cache
+ * \param file The path to the file
+ * \param source The source to fill
+ * \return a status code
+ */
+std::expected<void> cache_source(const path& file, page_cache::source& source);
+
+/*!
+ * \brief Returns the readiness source of the file, for the poll instances.
+ *
+ * Only the character devices (the terminals) can be polled.
+ *
+ * \param fd The file descriptor
+ * \return the source, or an error
+ */
+std::expected<poll::source*> poll_source(fd_t fd);
+
+/*!
+ * \brief Returns the physical memory of the file that can be mapped by the
+ * processes.
+ *
+ * Only some character devices have such memory.
+ *
+ * \param fd The file descriptor
+ * \param physical output reference to the physical address of the memory
+ * \param size output reference to the size of the memory
+ * \return a status code
+ */
+std::expected<void> device_memory(fd_t fd, size_t& physical, size_t& size);
+
 /*!
  * \brief List entries in the given directory
  * \param fd The file descriptor
@@ -135,6 +222,16 @@ std::expected<void> truncate(fd_t fd, size_t size);
  */
 std::expected<size_t> entries(fd_t fd, char* buffer, size_t size);
 
+/*!
+ * \brief List entries in the given directory, with the attributes of their
+ * files, in directory_stat_entry records
+ * \param fd The file descriptor
+ * \param buffer The buffer to fill with the entries
+ * \param size The maximum size of the buffer
+ * \return the size of the entries, or an error code
+ */
+std::expected<size_t> entries_stat(fd_t fd, char* buffer, size_t size);
+
 /*!
  * \brief List mounted file systems.
  * \param buffer The buffer to fill with the entries
@@ -0,0 +1,64 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <types.hpp>
+
+namespace work_queue {
+
+/*!
+ * \brief A deferred function to execute in a kernel worker.
+ *
+ * The work is intrusive, it must stay alive while it is pending. The
+ * function is called once per submission and can submit its work again.
+ */
+struct work {
+    void (*fun)(void*);    ///< The function to execute
+    void* data;            ///< The data given to the function
+    work* next;            ///< The next work in the queue
+    uint64_t expires;      ///< The time (in milliseconds) a delayed work is due
+    volatile bool pending; ///< Indicates if the work is submitted and not yet started
+};
+
+/*!
+ * \brief Start the worker of the bootstrap processor
+ */
+void init();
+
+/*!
+ * \brief Start the worker of the given application processor
+ */
+void init_cpu(size_t cpu);
+
+/*!
+ * \brief Submit the work to the worker of the current processor.
+ *
+ * This does not take any lock unless the worker needs to be woken up
+ * and can be used from an interrupt handler.
+ *
+ * \return true if the work was submitted, false if it was already pending
+ */
+bool submit(work& w);
+
+/*!
+ * \brief Submit the work to the worker of the given processor
+ * \return true if the work was submitted, false if it was already pending
+ */
+bool submit_on(size_t cpu, work& w);
+
+/*!
+ * \brief Submit the work to the worker of the current processor once
+ * the given delay is elapsed
+ * \return true if the work was submitted, false if it was already pending
+ */
+bool submit_delayed(work& w, size_t ms);
+
+} //end of namespace work_queue
+
+#endif
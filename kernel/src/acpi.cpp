@@ -147,7 +147,7 @@ void acpi_write(const ACPI_GENERIC_ADDRESS& address, uint64_t value){
 
 void acpi::init(){
     // ACPICA needs scheduling to be started
-    scheduler::queue_async_init_task(initialize_acpica);
+    scheduler::queue_async_init_task("acpi", initialize_acpica);
 }
 
 bool acpi::initialized(){
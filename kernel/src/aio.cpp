@@ -0,0 +1,309 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "aio.hpp"
+#include "scheduler.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+#include "conc/semaphore.hpp"
+#include "conc/wait_list.hpp"
+
+#include "vfs/vfs.hpp"
+
+namespace {
+
+constexpr const size_t MAX_REQUESTS = 64;       ///< The number of requests in flight, for all the processes
+constexpr const size_t MAX_COUNT = 128 * 1024;  ///< The maximum number of bytes of a request
+constexpr const size_t WORKERS = 2;             ///< The number of tasks executing the requests
+
+enum class request_state : uint8_t {
+    FREE,
+    QUEUED,
+    RUNNING,
+    DONE
+};
+
+/*!
+ * \brief An asynchronous request and its kernel buffer
+ */
+struct request_t {
+    request_state state;  ///< The state of the request
+    bool write;           ///< Indicates if the request is a write
+    bool orphan;          ///< Indicates if the process terminated before the completion
+    scheduler::pid_t pid; ///< The process that submitted the request
+    size_t token;         ///< The token returned to the process
+    path file;            ///< The file to read or write
+    char* user_buffer;    ///< The buffer of the process for a read
+    char* buffer;         ///< The kernel buffer of the transfer
+    size_t count;         ///< The number of bytes to transfer
+    size_t offset;        ///< The offset in the file
+    int64_t result;       ///< The bytes transferred, or the negated error code
+    request_t* next;      ///< The next queued request
+};
+
+std::array<request_t, MAX_REQUESTS> requests;
+
+spinlock lock;           ///< The lock of the requests
+semaphore queued;        ///< The number of queued requests
+wait_list waiters;       ///< The processes waiting for a completion
+request_t* head = nullptr; ///< The first queued request
+request_t* tail = nullptr; ///< The last queued request
+size_t next_token = 1;   ///< The token of the next request
+
+/*!
+ * \brief Release a request, with the lock held
+ */
+void free_request(request_t& request){
+    delete[] request.buffer;
+
+    request.buffer = nullptr;
+    request.state = request_state::FREE;
+}
+
+void worker_task(){
+    while(true){
+        queued.lock();
+
+        request_t* request;
+
+        {
+            std::lock_guard<spinlock> l(lock);
+
+            request = head;
+            head = head->next;
+
+            if(!head){
+                tail = nullptr;
+            }
+
+            request->state = request_state::RUNNING;
+        }
+
+        // The request is only modified by this worker while it is running
+        auto status = request->write
+            ? vfs::direct_write(request->file, request->buffer, request->count, request->offset)
+            : vfs::direct_read(request->file, request->buffer, request->count, request->offset);
+
+        std::lock_guard<spinlock> l(lock);
+
+        if(request->orphan){
+            free_request(*request);
+            continue;
+        }
+
+        request->result = status ? int64_t(*status) : -int64_t(status.error());
+        request->state = request_state::DONE;
+
+        // The waiters check again for their own completions
+        while(!waiters.empty()){
+            waiters.dequeue();
+        }
+    }
+}
+
+std::expected<size_t> submit(size_t fd, bool write, char* buffer, size_t count, size_t offset){
+    if(!scheduler::has_handle(fd)){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    auto& file = scheduler::get_handle(fd);
+
+    if(file.is_root()){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_PATH);
+    }
+
+    if(count > MAX_COUNT){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    // The kernel buffer is filled outside of the lock
+    auto* kernel_buffer = new char[count ? count : 1];
+
+    if(write){
+        std::copy_n(buffer, count, kernel_buffer);
+    }
+
+    size_t token;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        request_t* request = nullptr;
+
+        for(auto& r : requests){
+            if(r.state == request_state::FREE){
+                request = &r;
+                break;
+            }
+        }
+
+        if(!request){
+            delete[] kernel_buffer;
+            return std::make_unexpected<size_t>(std::ERROR_BUSY);
+        }
+
+        token = next_token++;
+
+        request->state = request_state::QUEUED;
+        request->write = write;
+        request->orphan = false;
+        request->pid = scheduler::get_pid();
+        request->token = token;
+        request->file = file;
+        request->user_buffer = buffer;
+        request->buffer = kernel_buffer;
+        request->count = count;
+        request->offset = offset;
+        request->result = 0;
+        request->next = nullptr;
+
+        if(tail){
+            tail = tail->next = request;
+        } else {
+            head = tail = request;
+        }
+    }
+
+    queued.unlock();
+
+    return token;
+}
+
+} //end of anonymous namespace
+
+void aio::finalize(){
+    queued.init(0);
+
+    for(auto& request : requests){
+        request.state = request_state::FREE;
+        request.buffer = nullptr;
+    }
+
+    for(size_t i = 0; i < WORKERS; ++i){
+        auto* user_stack = new char[scheduler::user_stack_size];
+        auto* kernel_stack = new char[scheduler::kernel_stack_size];
+
+        auto& process = scheduler::create_kernel_task("aio_worker", user_stack, kernel_stack, &worker_task);
+        process.ppid = 1;
+        process.priority = scheduler::DEFAULT_PRIORITY;
+
+        scheduler::queue_system_process(process.pid);
+    }
+}
+
+std::expected<size_t> aio::read(size_t fd, char* buffer, size_t count, size_t offset){
+    return submit(fd, false, buffer, count, offset);
+}
+
+std::expected<size_t> aio::write(size_t fd, const char* buffer, size_t count, size_t offset){
+    return submit(fd, true, const_cast<char*>(buffer), count, offset);
+}
+
+std::expected<size_t> aio::wait(int64_t& result, size_t ms){
+    auto pid = scheduler::get_pid();
+
+    bool waited = false;
+
+    while(true){
+        lock.lock();
+
+        request_t* completed = nullptr;
+        bool pending = false;
+
+        for(auto& request : requests){
+            if(request.state == request_state::FREE || request.pid != pid){
+                continue;
+            }
+
+            if(request.state == request_state::DONE){
+                completed = &request;
+                break;
+            }
+
+            pending = true;
+        }
+
+        if(completed){
+            auto token = completed->token;
+            auto* buffer = completed->buffer;
+            auto* user_buffer = completed->user_buffer;
+            bool copy = !completed->write && completed->result > 0;
+
+            result = completed->result;
+
+            // The kernel buffer is released outside of the lock
+            completed->buffer = nullptr;
+            free_request(*completed);
+
+            // A process woken by a timeout is still in the list
+            if(waited && waiters.waiting()){
+                waiters.remove();
+            }
+
+            lock.unlock();
+
+            // The read is copied in the context of the process
+            if(copy){
+                std::copy_n(buffer, size_t(result), user_buffer);
+            }
+
+            delete[] buffer;
+
+            return token;
+        }
+
+        if(waited && waiters.waiting()){
+            waiters.remove();
+            lock.unlock();
+
+            return std::make_unexpected<size_t>(std::ERROR_TIMEOUT);
+        }
+
+        if(!pending){
+            lock.unlock();
+
+            return std::make_unexpected<size_t>(std::ERROR_NOT_EXISTS);
+        }
+
+        // Wait for the next completion, the list is modified with the lock held
+        if(ms){
+            waiters.enqueue_timeout(ms);
+        } else {
+            waiters.enqueue();
+        }
+
+        lock.unlock();
+
+        scheduler::reschedule();
+
+        waited = true;
+    }
+}
+
+void aio::release(scheduler::pid_t pid){
+    std::lock_guard<spinlock> l(lock);
+
+    for(auto& request : requests){
+        if(request.state == request_state::FREE || request.pid != pid){
+            continue;
+        }
+
+        // The running and queued requests are released by their worker
+        if(request.state == request_state::DONE){
+            free_request(request);
+        } else {
+            request.orphan = true;
+        }
+    }
+}
@@ -0,0 +1,326 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include "alloc_profile.hpp"
+#include "process.hpp"
+#include "paging.hpp"
+#include "smp.hpp"
+#include "print.hpp"
+
+#include "conc/int_spinlock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t SITES = 128;          ///< The maximum number of call sites of the kernel
+constexpr const size_t MAX_LIVE = 1024;      ///< The maximum number of sampled live blocks
+constexpr const size_t BUCKETS = 1024;       ///< The number of buckets of the live blocks
+constexpr const size_t FILTER_SIZE = 32768;  ///< The number of counters of the free filter
+constexpr const size_t RING_SIZE = 256;      ///< The number of recent samples
+constexpr const uint16_t NO_ENTRY = MAX_LIVE; ///< Marks the end of a chain
+
+/*!
+ * \brief A sampled block not yet freed
+ */
+struct live_block {
+    uintptr_t address; ///< The address of the block
+    size_t size;       ///< The requested size
+    uint16_t site;     ///< The call site of the allocation
+    uint16_t next;     ///< The next block of the bucket or of the free list
+};
+
+/*!
+ * \brief A recent sample
+ */
+struct sample {
+    uint64_t caller; ///< The return address of the allocation call
+    uint64_t size;   ///< The requested size
+};
+
+std::array<tlib::alloc_site, SITES> sites;
+std::array<live_block, MAX_LIVE> live;
+std::array<uint16_t, BUCKETS> buckets;
+std::array<sample, RING_SIZE> ring;
+size_t ring_next = 0; ///< The next sample of the ring to write
+
+// The counters of the sampled blocks hashing to each slot, so that most
+// frees are discarded without taking the lock
+std::array<volatile uint8_t, FILTER_SIZE> filter;
+
+std::array<size_t, smp::MAX_CPUS> countdown; ///< The allocations before the next sample of each processor
+
+uint16_t free_head = NO_ENTRY;
+bool ready = false;         ///< Indicates if the tables are initialized
+size_t dropped = 0;         ///< The samples lost because the tables are full
+
+int_spinlock lock; ///< Protect the tables
+
+size_t hash(uintptr_t address){
+    return (address >> 4) * 0x9E3779B97F4A7C15;
+}
+
+volatile uint8_t& filter_slot(uintptr_t address){
+    return filter[hash(address) >> 49];
+}
+
+size_t bucket(uintptr_t address){
+    return (hash(address) >> 32) % BUCKETS;
+}
+
+void init_tables(){
+    for(auto& b : buckets){
+        b = NO_ENTRY;
+    }
+
+    for(size_t i = MAX_LIVE; i > 0; --i){
+        live[i - 1].next = free_head;
+        free_head = i - 1;
+    }
+
+    for(auto& c : countdown){
+        c = tlib::ALLOC_PROFILE_PERIOD;
+    }
+
+    ready = true;
+}
+
+/*!
+ * \brief Returns the index of the site of the caller, SITES if there is no room
+ */
+size_t find_site(uint64_t caller){
+    auto index = (caller * 0x9E3779B97F4A7C15 >> 32) % SITES;
+
+    for(size_t i = 0; i < SITES; ++i){
+        auto& site = sites[index];
+
+        if(site.caller == caller){
+            return index;
+        }
+
+        if(!site.caller){
+            site.caller = caller;
+            return index;
+        }
+
+        index = (index + 1) % SITES;
+    }
+
+    return SITES;
+}
+
+void record(uintptr_t address, size_t size, uint64_t caller){
+    std::lock_guard<int_spinlock> l(lock);
+
+    ring[ring_next] = {caller, size};
+    ring_next = (ring_next + 1) % RING_SIZE;
+
+    auto site_index = find_site(caller);
+
+    // A saturated filter counter could no longer be decremented
+    if(site_index == SITES || free_head == NO_ENTRY || filter_slot(address) == 0xFF){
+        ++dropped;
+        return;
+    }
+
+    auto& site = sites[site_index];
+    ++site.samples;
+    ++site.live_blocks;
+    site.live_bytes += size;
+
+    auto index = free_head;
+    auto& block = live[index];
+    free_head = block.next;
+
+    auto& head = buckets[bucket(address)];
+
+    block.address = address;
+    block.size = size;
+    block.site = site_index;
+    block.next = head;
+    head = index;
+
+    ++filter_slot(address);
+}
+
+void forget(uintptr_t address){
+    std::lock_guard<int_spinlock> l(lock);
+
+    auto* link = &buckets[bucket(address)];
+
+    while(*link != NO_ENTRY){
+        auto index = *link;
+        auto& block = live[index];
+
+        if(block.address == address){
+            auto& site = sites[block.site];
+            --site.live_blocks;
+            site.live_bytes -= block.size;
+
+            *link = block.next;
+            block.next = free_head;
+            free_head = index;
+
+            --filter_slot(address);
+
+            return;
+        }
+
+        link = &block.next;
+    }
+}
+
+// The tables are copied before being formatted, since formatting allocates
+// and the allocations may be sampled
+
+std::string sysfs_profile(){
+    auto copy = new tlib::alloc_site[SITES];
+
+    {
+        std::lock_guard<int_spinlock> l(lock);
+        std::copy_n(sites.begin(), SITES, copy);
+    }
+
+    auto value = alloc_profile::format(copy, SITES, tlib::ALLOC_PROFILE_PERIOD);
+
+    delete[] copy;
+
+    return value;
+}
+
+std::string sysfs_recent(){
+    auto copy = new sample[RING_SIZE];
+
+    {
+        std::lock_guard<int_spinlock> l(lock);
+
+        // The oldest samples first
+        for(size_t i = 0; i < RING_SIZE; ++i){
+            copy[i] = ring[(ring_next + i) % RING_SIZE];
+        }
+    }
+
+    std::string value;
+
+    for(size_t i = 0; i < RING_SIZE; ++i){
+        if(copy[i].caller){
+            value += sprintf("%h %u\n", copy[i].caller, copy[i].size);
+        }
+    }
+
+    delete[] copy;
+
+    return value;
+}
+
+std::string sysfs_dropped(){
+    return std::to_string(dropped);
+}
+
+} //end of anonymous namespace
+
+void alloc_profile::finalize(){
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/profile/sites"), &sysfs_profile);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/profile/recent"), &sysfs_recent);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/profile/dropped"), &sysfs_dropped);
+}
+
+void alloc_profile::allocated(void* block, size_t size, void* caller){
+    if(!ready){
+        std::lock_guard<int_spinlock> l(lock);
+
+        if(!ready){
+            init_tables();
+        }
+    }
+
+    // A preemption may lose a decrement, the period is only approximate
+    auto& c = countdown[smp::current_cpu()];
+
+    if(--c){
+        return;
+    }
+
+    c = tlib::ALLOC_PROFILE_PERIOD;
+
+    record(reinterpret_cast<uintptr_t>(block), size, reinterpret_cast<uint64_t>(caller));
+}
+
+void alloc_profile::freed(void* block){
+    auto address = reinterpret_cast<uintptr_t>(block);
+
+    // The block was sampled before being handed out, its slot is already counted
+    if(filter_slot(address)){
+        forget(address);
+    }
+}
+
+std::string alloc_profile::format(const tlib::alloc_site* table, size_t count, size_t period){
+    std::string value = "caller live_bytes live_blocks samples\n";
+
+    // Selection of the sites with the most live bytes, the tables are small
+    uint64_t last = ~uint64_t(0);
+    size_t last_index = 0;
+
+    while(true){
+        size_t best = count;
+
+        for(size_t i = 0; i < count; ++i){
+            auto& site = table[i];
+
+            if(!site.caller || !site.samples){
+                continue;
+            }
+
+            // Skip the sites already printed
+            if(site.live_bytes > last || (site.live_bytes == last && i <= last_index)){
+                continue;
+            }
+
+            if(best == count || site.live_bytes > table[best].live_bytes){
+                best = i;
+            }
+        }
+
+        if(best == count){
+            break;
+        }
+
+        auto& site = table[best];
+        value += sprintf("%h %u %u %u\n", site.caller, site.live_bytes * period, site.live_blocks * period, site.samples);
+
+        last = site.live_bytes;
+        last_index = best;
+    }
+
+    return value;
+}
+
+std::string alloc_profile::format(const scheduler::process_t& process){
+    if(!process.alloc_profile){
+        return "";
+    }
+
+    // Too large for the kernel stack
+    auto profile = new tlib::alloc_profile;
+
+    std::string value;
+
+    if(paging::user_read(process, process.alloc_profile, reinterpret_cast<char*>(profile), sizeof(*profile))){
+        auto count = profile->sites < tlib::ALLOC_PROFILE_SITES ? profile->sites : tlib::ALLOC_PROFILE_SITES;
+
+        value = format(profile->site, count, profile->period);
+    }
+
+    delete profile;
+
+    return value;
+}
@@ -0,0 +1,99 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT_1_0.txt)
+//=======================================================================
+
+.intel_syntax noprefix
+
+// Trampoline used to start the application processors. It is copied
+// by the BSP at AP_TRAMPOLINE_ADDRESS and the application processors
+// start executing it in real mode after the STARTUP IPI. It directly
+// switches to long mode with the GDT and the page tables of the BSP.
+
+.set AP_TRAMPOLINE_ADDRESS, 0x80000
+
+.global ap_trampoline_start
+.global ap_trampoline_end
+.global ap_trampoline_gdtr
+.global ap_trampoline_cr3
+.global ap_trampoline_stack
+.global ap_trampoline_entry
+
+.code16
+
+ap_trampoline_start:
+    cli
+    cld
+
+    mov ax, cs
+    mov ds, ax
+
+    // Load the GDT of the BSP
+    lgdt [ap_trampoline_gdtr - ap_trampoline_start]
+
+    // Enable PAE
+    mov eax, cr4
+    or eax, 1 << 5
+    mov cr4, eax
+
+    // Use the page tables of the BSP
+    mov eax, [ap_trampoline_cr3 - ap_trampoline_start]
+    mov cr3, eax
+
+    // Enable long mode in the EFER MSR
+    mov ecx, 0xC0000080
+    rdmsr
+    or eax, 1 << 8
+    wrmsr
+
+    // Enable paging and protected mode at once
+    mov eax, cr0
+    or eax, (1 << 31) | 1
+    mov cr0, eax
+
+    // Far jump to the long mode code segment
+    .byte 0x66, 0xEA
+    .long AP_TRAMPOLINE_ADDRESS + (ap_long_mode - ap_trampoline_start)
+    .word 0x18
+
+.code64
+
+ap_long_mode:
+    mov eax, 0x10
+    mov ds, eax
+    mov es, eax
+    mov fs, eax
+    mov gs, eax
+    mov ss, eax
+
+    mov rsp, [AP_TRAMPOLINE_ADDRESS + (ap_trampoline_stack - ap_trampoline_start)]
+    mov rax, [AP_TRAMPOLINE_ADDRESS + (ap_trampoline_entry - ap_trampoline_start)]
+
+    // The entry point never returns
+    call rax
+
+    .ap_halt:
+    cli
+    hlt
+    jmp .ap_halt
+
+.align 8
+
+ap_trampoline_gdtr:
+    .word 0
+    .quad 0
+
+.align 8
+
+ap_trampoline_cr3:
+    .quad 0
+
+ap_trampoline_stack:
+    .quad 0
+
+ap_trampoline_entry:
+    .quad 0
+
+ap_trampoline_end:
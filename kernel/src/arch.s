@@ -28,6 +28,9 @@ _arch_enable_sse:
     or ax, 3 << 9   // set CR4.OSFXSR and CR4.OSXMMEXCPT
     mov cr4, rax
 
+    // Start from a known x87 control word, processes inherit it
+    fninit
+
     .no_sse:
 
     ret
@@ -0,0 +1,115 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "arena.hpp"
+#include "scheduler.hpp"
+#include "process.hpp"
+#include "kalloc.hpp"
+
+namespace {
+
+constexpr const size_t ALIGNMENT = 16;
+
+/*!
+ * \brief Returns the arena of the current process, nullptr if it has none
+ */
+arena::syscall_arena* current_arena(){
+    if(!scheduler::is_started()){
+        return nullptr;
+    }
+
+    auto& process = scheduler::get_process(scheduler::get_pid());
+
+    // The system processes never return from system calls, their arena would
+    // never be emptied
+    if(process.system){
+        return nullptr;
+    }
+
+    return &process.scratch;
+}
+
+size_t align(size_t bytes){
+    return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+} //end of anonymous namespace
+
+void arena::init(syscall_arena& arena){
+    arena.used = 0;
+    arena.depth = 0;
+}
+
+void* arena::allocate(size_t bytes){
+    auto arena = current_arena();
+
+    if(!arena || !arena->depth){
+        return nullptr;
+    }
+
+    if(!arena->buffer){
+        arena->buffer = static_cast<char*>(kalloc::k_malloc(size));
+
+        if(!arena->buffer){
+            return nullptr;
+        }
+    }
+
+    bytes = align(bytes);
+
+    if(arena->used + bytes > size){
+        return nullptr;
+    }
+
+    auto block = arena->buffer + arena->used;
+    arena->used += bytes;
+
+    return block;
+}
+
+bool arena::owns(const void* block){
+    auto arena = current_arena();
+
+    if(!arena || !arena->buffer){
+        return false;
+    }
+
+    auto address = static_cast<const char*>(block);
+    return address >= arena->buffer && address < arena->buffer + size;
+}
+
+void arena::release(void* block, size_t bytes){
+    auto arena = current_arena();
+
+    if(static_cast<char*>(block) + align(bytes) == arena->buffer + arena->used){
+        arena->used -= align(bytes);
+    }
+}
+
+void arena::reset(){
+    auto arena = current_arena();
+
+    if(arena){
+        arena->used = 0;
+    }
+}
+
+arena::scope::scope(){
+    auto arena = current_arena();
+
+    if(arena){
+        ++arena->depth;
+    }
+}
+
+arena::scope::~scope(){
+    auto arena = current_arena();
+
+    if(arena){
+        --arena->depth;
+    }
+}
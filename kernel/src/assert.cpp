@@ -9,6 +9,9 @@
 #include "print.hpp"
 #include "kernel.hpp"
 #include "logging.hpp"
+#include "vesa.hpp"
+
+#include "drivers/serial.hpp"
 
 void __thor_assert(bool condition){
     __thor_assert(condition, "assertion failed");
@@ -18,6 +21,8 @@ void __thor_assert(bool condition, const char* message){
     if(!condition){
         logging::logf(logging::log_level::ERROR, "Assertion failed: %s\n", message);
         k_print_line(message);
+        serial::flush();
+        vesa::flush();
         suspend_kernel();
     }
 }
@@ -25,5 +30,7 @@ void __thor_assert(bool condition, const char* message){
 void __thor_unreachable(const char* message){
     logging::logf(logging::log_level::ERROR, "Reached unreachable block: %s\n", message);
     k_print_line(message);
+    serial::flush();
+    vesa::flush();
     suspend_kernel();
 }
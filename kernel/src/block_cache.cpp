@@ -5,87 +5,537 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithms.hpp>
+
 #include "block_cache.hpp"
 #include "kalloc.hpp"
 #include "assert.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+enum queue_type : uint32_t {
+    FREE_QUEUE,
+    IN_QUEUE,
+    MAIN_QUEUE
+};
+
+template<typename T>
+void push_front(block_queue<T>& queue, T* element){
+    element->prev = nullptr;
+    element->next = queue.head;
+
+    if(queue.head){
+        queue.head->prev = element;
+    } else {
+        queue.tail = element;
+    }
+
+    queue.head = element;
+    ++queue.size;
+}
+
+template<typename T>
+void remove(block_queue<T>& queue, T* element){
+    if(element->prev){
+        element->prev->next = element->next;
+    } else {
+        queue.head = element->next;
+    }
+
+    if(element->next){
+        element->next->prev = element->prev;
+    } else {
+        queue.tail = element->prev;
+    }
+
+    --queue.size;
+}
+
+template<typename T>
+T* pop_back(block_queue<T>& queue){
+    auto element = queue.tail;
+    remove(queue, element);
+    return element;
+}
+
+constexpr const size_t MIGRATE_BUCKETS = 16; ///< The number of old buckets moved by each step of a rehash
+constexpr const size_t MAX_CHAIN_STAT = 8;    ///< The chains at least as long are counted together
+
+/*!
+ * \brief Returns the bucket of the key in a table of 2^bits buckets.
+ *
+ * The key is multiplied by 2^64 / phi and the high bits are kept, they
+ * depend on both the device and the sector bits of the key. Consecutive
+ * sectors land in distant buckets.
+ */
+inline size_t hash_bucket(uint64_t key, size_t bits){
+    return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+}
+
+/*!
+ * \brief Returns the number of bits of a table for the given number of
+ * elements, with at most one element per two buckets
+ */
+size_t hash_bits(uint64_t elements){
+    size_t bits = 1;
+
+    while((uint64_t(1) << bits) < elements * 2){
+        ++bits;
+    }
+
+    return bits;
+}
+
+template<typename T>
+T** hash_allocate(size_t bits){
+    auto table = new T*[size_t(1) << bits];
+
+    // The table is empty to start with
+    std::fill_n(table, size_t(1) << bits, nullptr);
+
+    return table;
+}
+
+template<typename T>
+void hash_init(block_hash<T>& hash, uint64_t elements){
+    hash.bits = hash_bits(elements);
+    hash.table = hash_allocate<T>(hash.bits);
+    hash.old_table = nullptr;
+    hash.old_bits = 0;
+    hash.migrated = 0;
+}
+
+template<typename T>
+T* chain_find(T* entry, uint64_t key){
+    while(entry && entry->key != key){
+        entry = entry->hash_next;
+    }
+
+    return entry;
+}
+
+template<typename T>
+bool chain_remove(T** link, T* element){
+    while(*link && *link != element){
+        link = &(*link)->hash_next;
+    }
+
+    if(!*link){
+        return false;
+    }
+
+    *link = element->hash_next;
+
+    return true;
+}
+
+template<typename T>
+T* hash_find(const block_hash<T>& hash, uint64_t key){
+    auto* entry = chain_find(hash.table[hash_bucket(key, hash.bits)], key);
+
+    if(!entry && hash.old_table){
+        entry = chain_find(hash.old_table[hash_bucket(key, hash.old_bits)], key);
+    }
+
+    return entry;
+}
+
+template<typename T>
+void hash_insert(block_hash<T>& hash, T* element){
+    auto& head = hash.table[hash_bucket(element->key, hash.bits)];
+
+    element->hash_next = head;
+    head = element;
+}
+
+template<typename T>
+void hash_remove(block_hash<T>& hash, T* element){
+    if(chain_remove(&hash.table[hash_bucket(element->key, hash.bits)], element)){
+        return;
+    }
+
+    auto removed = hash.old_table && chain_remove(&hash.old_table[hash_bucket(element->key, hash.old_bits)], element);
+
+    thor_assert(removed, "The hash table chain did not contain the block");
+}
+
+/*!
+ * \brief Move up to the given number of buckets of the old table to the new
+ * table, the old table is released once empty
+ */
+template<typename T>
+void hash_migrate(block_hash<T>& hash, size_t buckets){
+    if(!hash.old_table){
+        return;
+    }
+
+    auto old_buckets = size_t(1) << hash.old_bits;
+
+    for(size_t i = 0; i < buckets && hash.migrated < old_buckets; ++i, ++hash.migrated){
+        auto* entry = hash.old_table[hash.migrated];
+
+        while(entry){
+            auto* next = entry->hash_next;
+            hash_insert(hash, entry);
+            entry = next;
+        }
+
+        hash.old_table[hash.migrated] = nullptr;
+    }
+
+    if(hash.migrated == old_buckets){
+        delete[] hash.old_table;
+
+        hash.old_table = nullptr;
+        hash.old_bits = 0;
+    }
+}
+
+/*!
+ * \brief Start moving the elements to a table sized for the given number of
+ * elements. A migration still in progress is finished first.
+ */
+template<typename T>
+void hash_resize(block_hash<T>& hash, uint64_t elements){
+    auto bits = hash_bits(elements);
+
+    if(bits == hash.bits){
+        return;
+    }
+
+    hash_migrate(hash, ~size_t(0));
+
+    hash.old_table = hash.table;
+    hash.old_bits = hash.bits;
+    hash.migrated = 0;
+
+    hash.bits = bits;
+    hash.table = hash_allocate<T>(bits);
+}
+
+/*!
+ * \brief Count the chains of a table by length
+ */
+template<typename T>
+void chain_histogram(T* const* table, size_t bits, size_t* histogram, size_t& longest){
+    for(size_t i = 0; i < (size_t(1) << bits); ++i){
+        size_t length = 0;
+
+        for(auto* entry = table[i]; entry; entry = entry->hash_next){
+            ++length;
+        }
+
+        ++histogram[std::min(length, MAX_CHAIN_STAT)];
+        longest = std::max(longest, length);
+    }
+}
+
+template<typename T>
+void append_chain_stats(std::string& result, const char* name, const block_hash<T>& hash){
+    size_t histogram[MAX_CHAIN_STAT + 1] = {};
+    size_t longest = 0;
+
+    chain_histogram(hash.table, hash.bits, histogram, longest);
+
+    if(hash.old_table){
+        chain_histogram(hash.old_table, hash.old_bits, histogram, longest);
+    }
+
+    result += name;
+    result += ": buckets ";
+    result += std::to_string(size_t(1) << hash.bits);
+    result += " longest ";
+    result += std::to_string(longest);
+    result += hash.old_table ? " migrating\n" : "\n";
+
+    for(size_t length = 0; length <= MAX_CHAIN_STAT; ++length){
+        result += "  ";
+        result += std::to_string(length);
+        result += length == MAX_CHAIN_STAT ? "+: " : ": ";
+        result += std::to_string(histogram[length]);
+        result += '\n';
+    }
+}
+
+constexpr const size_t SECTOR_BITS = 48; ///< The bits of the sector in a key
+
+uint64_t make_key(uint16_t device, uint64_t sector){
+    return (uint64_t(device) << SECTOR_BITS) + sector;
+}
+
+char* payload(block_t* block){
+    return reinterpret_cast<char*>(block + 1);
+}
+
+size_t block_bytes(uint64_t payload_size){
+    return sizeof(block_t) + ((payload_size + 7) & ~7);
+}
+
+std::string sysfs_blocks(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->capacity());
+}
+
+std::string sysfs_chains(void* data){
+    return reinterpret_cast<block_cache*>(data)->chain_stats();
+}
+
+std::string sysfs_accesses(void* data){
+    auto cache = reinterpret_cast<block_cache*>(data);
+    return std::to_string(cache->hits + cache->misses);
+}
+
+std::string sysfs_hits(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->hits);
+}
+
+std::string sysfs_misses(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->misses);
+}
+
+std::string sysfs_evictions(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->evictions);
+}
+
+std::string sysfs_promotions(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->promotions);
+}
+
+std::string sysfs_dirty(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->dirty_blocks());
+}
+
+std::string sysfs_writebacks(void* data){
+    return std::to_string(reinterpret_cast<block_cache*>(data)->writebacks);
+}
+
+} //end of anonymous namespace
 
 void block_cache::init(uint64_t payload_size, uint64_t blocks){
     this->payload_size = payload_size;
     this->blocks = blocks;
+    this->allocated = blocks;
+    this->initial_blocks = blocks;
 
-    auto block_size = payload_size + 4 * sizeof(uint64_t);
+    // The proportions advised for 2Q
+    in_blocks = blocks / 4 ? blocks / 4 : 1;
+    ghosts = blocks / 2 ? blocks / 2 : 1;
 
-    // Allocate the necessary memory
-    this->hash_table = new block_t*[blocks * 2];
-    this->blocks_memory = kalloc::k_malloc(blocks * block_size);
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+    promotions = 0;
+    writebacks = 0;
+    dirty = 0;
 
-    // The table is empty to start with
-    for(size_t i = 0; i < blocks * 2; ++i){
-        hash_table[i] = nullptr;
-    }
+    writer = nullptr;
+    writer_data = nullptr;
+    max_run = 0;
+    run_buffer = nullptr;
+
+    free_queue = {nullptr, nullptr, 0};
+    in_queue = {nullptr, nullptr, 0};
+    main_queue = {nullptr, nullptr, 0};
+    out_queue = {nullptr, nullptr, 0};
+    free_ghosts = {nullptr, nullptr, 0};
 
-    front = reinterpret_cast<block_t*>(blocks_memory);
+    auto block_size = block_bytes(payload_size);
 
-    block_t* previous = nullptr;
+    // Allocate the necessary memory
+    hash_init(hash_table, blocks);
+    hash_init(ghost_table, ghosts);
+    blocks_memory = kalloc::k_malloc(blocks * block_size);
 
     for(size_t i = 0; i < blocks; ++i){
         auto block = reinterpret_cast<block_t*>(reinterpret_cast<size_t>(blocks_memory) + i * block_size);
 
-        block->key = 0;             // The key
-        block->hash_next = nullptr; // The hash pointer
+        block->key = 0;
+        block->hash_next = nullptr;
+        block->queue = FREE_QUEUE;
+        block->dirty = false;
+
+        push_front(free_queue, block);
+    }
 
-        // The next block in the free list
-        if(i < blocks - 1){
-            block->free_next = reinterpret_cast<block_t*>(reinterpret_cast<size_t>(blocks_memory) + (i + 1) * block_size);
-        } else {
-            block->free_next = nullptr;
+    auto ghosts_memory = new ghost_t[ghosts];
+
+    for(size_t i = 0; i < ghosts; ++i){
+        push_front(free_ghosts, &ghosts_memory[i]);
+    }
+}
+
+bool block_cache::resize(uint64_t blocks){
+    if(!blocks){
+        return false;
+    }
+
+    // Evict the blocks over the new capacity
+    while(in_queue.size + main_queue.size > blocks){
+        release(evict());
+    }
+
+    // Release the free blocks that were allocated by a previous growth
+    for(auto* block = free_queue.head; block && allocated > blocks;){
+        auto* next = block->next;
+
+        if(!owned(block)){
+            remove(free_queue, block);
+            kalloc::k_free(block);
+            --allocated;
+        }
+
+        block = next;
+    }
+
+    auto block_size = block_bytes(payload_size);
+    auto success = true;
+
+    // The free blocks kept by a previous shrink are counted as allocated
+    while(allocated < blocks){
+        auto block = static_cast<block_t*>(kalloc::k_malloc(block_size));
+
+        if(!block){
+            logging::logf(logging::log_level::ERROR, "block_cache: Unable to allocate a block for a resize\n");
+
+            blocks = allocated;
+            success = false;
+            break;
         }
 
-        // The previous block in the free list
-        block->free_prev = previous;
+        block->key = 0;
+        block->hash_next = nullptr;
+        block->queue = FREE_QUEUE;
+        block->dirty = false;
+
+        push_front(free_queue, block);
+        ++allocated;
+    }
+
+    this->blocks = blocks;
+
+    in_blocks = blocks / 4 ? blocks / 4 : 1;
+
+    auto ghosts = blocks / 2 ? blocks / 2 : 1;
+
+    // Forget the oldest evicted keys over the new number of ghosts
+    while(out_queue.size > ghosts){
+        auto ghost = pop_back(out_queue);
+        hash_remove(ghost_table, ghost);
+        push_front(free_ghosts, ghost);
+    }
 
-        previous = block;
+    for(auto n = out_queue.size + free_ghosts.size; n < ghosts; ++n){
+        push_front(free_ghosts, new ghost_t);
     }
 
-    rear = previous;
+    this->ghosts = ghosts;
+
+    hash_resize(hash_table, blocks);
+    hash_resize(ghost_table, ghosts);
+
+    return success;
 }
 
-char* block_cache::block_if_present(uint16_t device, uint64_t sector){
-    return block_if_present((uint64_t(device) << 16) + sector);
+void block_cache::export_stats(const std::string& name){
+    auto base = path("/block_cache") / name;
+
+    sysfs::set_dynamic_value_data(path("/sys"), base / "blocks", &sysfs_blocks, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "accesses", &sysfs_accesses, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "hits", &sysfs_hits, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "misses", &sysfs_misses, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "evictions", &sysfs_evictions, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "promotions", &sysfs_promotions, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "dirty", &sysfs_dirty, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "writebacks", &sysfs_writebacks, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "chains", &sysfs_chains, this);
 }
 
-char* block_cache::block_if_present(uint64_t orig_key){
-    auto key = orig_key % (blocks * 2);
+void block_cache::set_writer(block_writer writer, void* data, size_t max_blocks){
+    this->writer = writer;
+    this->writer_data = data;
+    this->max_run = max_blocks;
+    this->run_buffer = new char[max_blocks * payload_size];
+}
 
-    if(hash_table[key]){
-        auto* entry = hash_table[key];
+void block_cache::mark_dirty(uint16_t device, uint64_t sector){
+    auto block = find(make_key(device, sector));
+
+    thor_assert(block, "Only a cached block can be dirty");
+
+    if(!block->dirty){
+        block->dirty = true;
+        block->dirty_since = timer::milliseconds();
+
+        ++dirty;
+    }
+}
+
+bool block_cache::flush(uint64_t deadline){
+    if(!dirty){
+        return true;
+    }
 
-        if(entry->key == orig_key){
-            return &entry->payload;
-        } else {
-            while(entry->hash_next){
-               entry = entry->hash_next;
+    // The write backs do not move the blocks between the queues
+    block_queue<block_t>* queues[] = {&in_queue, &main_queue};
 
-               if(entry->key == orig_key){
-                    return &entry->payload;
-               }
+    for(auto* queue : queues){
+        for(auto* block = queue->head; block; block = block->next){
+            // Only the first block of each run of dirty blocks starts a write
+            if(!selected(block, deadline) || selected(find(block->key - 1), deadline)){
+                continue;
+            }
+
+            if(!write_back(block->key, deadline)){
+                return false;
             }
         }
     }
 
-    return nullptr;
+    return true;
 }
 
-char* block_cache::block(uint16_t device, uint64_t sector, bool& valid){
-    return block((uint64_t(device) << 16) + sector, valid);
+uint64_t block_cache::dirty_blocks() const {
+    return dirty;
+}
+
+uint64_t block_cache::capacity() const {
+    return blocks;
+}
+
+bool block_cache::contains(uint16_t device, uint64_t sector) const {
+    return find(make_key(device, sector));
+}
+
+char* block_cache::block_if_present(uint16_t device, uint64_t sector){
+    return block_if_present(make_key(device, sector));
+}
+
+char* block_cache::block_if_present(uint64_t key){
+    hash_migrate(hash_table, MIGRATE_BUCKETS);
+
+    auto block = find(key);
+
+    if(!block){
+        return nullptr;
+    }
+
+    ++hits;
+    touch(block);
+
+    return payload(block);
 }
 
-char* block_cache::block(uint64_t orig_key, bool& valid){
-    auto key = orig_key % (blocks * 2);
+char* block_cache::block(uint16_t device, uint64_t sector, bool& valid){
+    return block(make_key(device, sector), valid);
+}
 
+char* block_cache::block(uint64_t key, bool& valid){
     // First, try to get it directly from the hash table
 
-    auto direct = block_if_present(orig_key);
+    auto direct = block_if_present(key);
 
     if(direct){
         valid = true;
@@ -95,64 +545,187 @@ char* block_cache::block(uint64_t orig_key, bool& valid){
     // At this point, we will allocate a new block
     valid = false;
 
-    auto* block = front;
+    ++misses;
 
-    // If the block was used, remove it from the hash table
-    if(block->key){
-        auto previous_key = block->key % (blocks * 2);
+    auto* block = reclaim();
 
-        if(hash_table[previous_key] == block){
-            // Use the next block in the bucket list as the first block in the chain
-            hash_table[previous_key] = block->hash_next;
-        } else {
-            auto* entry = block;
-            bool found = false;
+    block->key = key;
+    hash_insert(hash_table, block);
 
-            while(entry->hash_next){
-                auto next = entry->hash_next;
+    // A block evicted recently from the FIFO queue is hot
+    auto ghost = hash_find(ghost_table, key);
 
-                if(entry->hash_next == block){
-                    entry->hash_next = block->hash_next;
-                    found = true;
-                    break;
-                }
+    if(ghost){
+        hash_remove(ghost_table, ghost);
+        remove(out_queue, ghost);
+        push_front(free_ghosts, ghost);
 
-                entry = next;
-            }
+        ++promotions;
 
-            thor_assert(found, "The hash table chain did not contain the used block");
-        }
+        block->queue = MAIN_QUEUE;
+        push_front(main_queue, block);
+    } else {
+        block->queue = IN_QUEUE;
+        push_front(in_queue, block);
     }
 
-    // Inserts the block in the hash table
+    return payload(block);
+}
 
-    block->key = orig_key; // Sets the key
+std::string block_cache::chain_stats() const {
+    std::string result;
 
-    if(!hash_table[key]){
-        // Directly sets the head of the table
-        block->hash_next = nullptr;
-        hash_table[key] = block;
+    append_chain_stats(result, "blocks", hash_table);
+    append_chain_stats(result, "ghosts", ghost_table);
+
+    return result;
+}
+
+block_t* block_cache::find(uint64_t key) const {
+    return hash_find(hash_table, key);
+}
+
+/*!
+ * \brief Returns an unused block, evicting a block if necessary
+ */
+block_t* block_cache::reclaim(){
+    // After a shrink, the free blocks are kept over the capacity
+    if(free_queue.size && in_queue.size + main_queue.size < blocks){
+        return pop_back(free_queue);
+    }
+
+    return evict();
+}
+
+/*!
+ * \brief Evict a block from the queues, writing it back if necessary
+ */
+block_t* block_cache::evict(){
+    block_t* victim;
+
+    // The FIFO queue is kept small, the blocks it evicts are remembered
+    if(in_queue.size > in_blocks || !main_queue.size){
+        victim = pop_back(in_queue);
+        remember(victim->key);
     } else {
-        // Insert at the end of the chain
+        victim = pop_back(main_queue);
+    }
 
-        auto* entry = hash_table[key];
+    // A dirty block is written back before being reused
+    if(victim->dirty && !write_back(victim->key, ~uint64_t(0))){
+        logging::logf(logging::log_level::ERROR, "block_cache: Unable to write back an evicted block\n");
 
-        while(entry->hash_next){
-            entry = entry->hash_next;
-        }
+        victim->dirty = false;
+        --dirty;
+    }
 
-        entry->hash_next = block;
-        block->hash_next = nullptr;
+    hash_remove(hash_table, victim);
+
+    ++evictions;
+
+    return victim;
+}
+
+/*!
+ * \brief Give back an evicted block, the blocks of the initial memory are
+ * kept in the free queue
+ */
+void block_cache::release(block_t* block){
+    if(owned(block)){
+        block->queue = FREE_QUEUE;
+        push_front(free_queue, block);
+    } else {
+        kalloc::k_free(block);
+        --allocated;
     }
+}
+
+/*!
+ * \brief Indicates if the block is part of the initial memory of the cache
+ */
+bool block_cache::owned(const block_t* block) const {
+    auto address = reinterpret_cast<size_t>(block);
+    auto start = reinterpret_cast<size_t>(blocks_memory);
+
+    return address >= start && address < start + initial_blocks * block_bytes(payload_size);
+}
 
-    // Puts the block at the bottom of the free
+/*!
+ * \brief Remember the key of a block evicted from the FIFO queue
+ */
+void block_cache::remember(uint64_t key){
+    ghost_t* ghost;
+
+    hash_migrate(ghost_table, MIGRATE_BUCKETS);
+
+    // After a shrink, the free ghosts are kept over the limit
+    if(free_ghosts.size && out_queue.size < ghosts){
+        ghost = pop_back(free_ghosts);
+    } else {
+        ghost = pop_back(out_queue);
+        hash_remove(ghost_table, ghost);
+    }
 
-    front = front->free_next;
-    front->free_prev = nullptr;
+    ghost->key = key;
+
+    hash_insert(ghost_table, ghost);
+    push_front(out_queue, ghost);
+}
+
+/*!
+ * \brief Account an access to a cached block
+ */
+void block_cache::touch(block_t* block){
+    // The blocks of the FIFO queue are not moved on access
+    if(block->queue == MAIN_QUEUE){
+        remove(main_queue, block);
+        push_front(main_queue, block);
+    }
+}
+
+/*!
+ * \brief Indicates if the block must be written back by a flush with the given deadline
+ */
+bool block_cache::selected(const block_t* block, uint64_t deadline) const {
+    return block && block->queue != FREE_QUEUE && block->dirty && block->dirty_since <= deadline;
+}
 
-    rear->free_next = block;
-    block->free_prev = rear;
-    rear = block;
+/*!
+ * \brief Write back the run of selected blocks starting at the given key,
+ * by writes of at most max_run blocks
+ */
+bool block_cache::write_back(uint64_t key, uint64_t deadline){
+    while(true){
+        size_t n = 0;
 
-    return &block->payload;
+        for(; n < max_run; ++n){
+            auto block = find(key + n);
+
+            if(!selected(block, deadline)){
+                break;
+            }
+
+            std::copy_n(payload(block), payload_size, run_buffer + n * payload_size);
+        }
+
+        if(!n){
+            return true;
+        }
+
+        auto device = key >> SECTOR_BITS;
+        auto sector = key & ((uint64_t(1) << SECTOR_BITS) - 1);
+
+        if(!writer(writer_data, device, sector, run_buffer, n)){
+            return false;
+        }
+
+        for(size_t i = 0; i < n; ++i){
+            find(key + i)->dirty = false;
+        }
+
+        dirty -= n;
+        writebacks += n;
+
+        key += n;
+    }
 }
@@ -0,0 +1,97 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <lock_guard.hpp>
+
+#include "boot_trace.hpp"
+#include "arch.hpp"
+#include "clocksource.hpp"
+#include "scheduler.hpp"
+#include "logging.hpp"
+#include "print.hpp"
+
+#include "conc/spinlock.hpp"
+
+namespace {
+
+/*!
+ * \brief A finished phase of the boot
+ */
+struct phase {
+    const char* name; ///< The name of the phase
+    uint64_t start;   ///< The TSC at the start of the phase
+    uint64_t end;     ///< The TSC at the end of the phase
+    size_t pid;       ///< The process that ran the phase, 0 before the scheduler
+};
+
+std::array<phase, boot_trace::MAX_PHASES> phases;
+size_t recorded = 0;
+
+// The asynchronous phases finish concurrently, the recorded ones never change
+spinlock phases_lock;
+
+// Convert a duration of the trace, in microseconds once the TSC is known
+uint64_t convert(uint64_t cycles, uint64_t frequency){
+    if(!frequency){
+        return cycles;
+    }
+
+    return (cycles / frequency) * 1000000 + ((cycles % frequency) * 1000000) / frequency;
+}
+
+} //End of anonymous namespace
+
+uint64_t boot_trace::now(){
+    return arch::rdtsc();
+}
+
+void boot_trace::record(const char* name, uint64_t start, uint64_t end){
+    logging::logf(logging::log_level::DEBUG, "boot: %s in %u cycles\n", name, end - start);
+
+    std::lock_guard<spinlock> l(phases_lock);
+
+    if(recorded == MAX_PHASES){
+        return;
+    }
+
+    auto& p = phases[recorded++];
+
+    p.name = name;
+    p.start = start;
+    p.end = end;
+    p.pid = scheduler::is_started() ? scheduler::get_pid() : 0;
+}
+
+std::string boot_trace::format(){
+    auto frequency = clocksource::tsc_frequency();
+
+    std::string value = frequency ? "start_us duration_us pid name\n" : "start_cycles duration_cycles pid name\n";
+
+    size_t count;
+
+    {
+        std::lock_guard<spinlock> l(phases_lock);
+        count = recorded;
+    }
+
+    // The phases finish out of order, the origin is the earliest start
+    uint64_t origin = count ? phases[0].start : 0;
+    for(size_t i = 1; i < count; ++i){
+        if(phases[i].start < origin){
+            origin = phases[i].start;
+        }
+    }
+
+    for(size_t i = 0; i < count; ++i){
+        auto& p = phases[i];
+
+        value += sprintf("%u %u %u %s\n", convert(p.start - origin, frequency), convert(p.end - p.start, frequency), p.pid, p.name);
+    }
+
+    return value;
+}
@@ -0,0 +1,135 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "clocksource.hpp"
+#include "timer.hpp"
+#include "arch.hpp"
+#include "cpu_features.hpp"
+#include "logging.hpp"
+
+#include "conc/int_lock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const uint64_t NS_PER_SECOND = 1000000000;
+constexpr const uint64_t CALIBRATION_MS = 50; ///< The duration of the calibration
+
+clocksource::tsc_conversion tsc_params {0, 0, 0};
+volatile bool tsc_ready = false; ///< Published once the parameters are written
+uint64_t frequency = 0;
+
+// The nanoseconds of the timer counter, without overflowing the multiplication
+uint64_t counter_nanoseconds(){
+    auto counter = timer::counter();
+    auto freq = timer::counter_frequency();
+
+    return (counter / freq) * NS_PER_SECOND + ((counter % freq) * NS_PER_SECOND) / freq;
+}
+
+// Measure the TSC frequency between two edges of the timer counter
+uint64_t calibrate(){
+    auto freq = timer::counter_frequency();
+    auto duration = freq * CALIBRATION_MS / 1000;
+
+    auto edge = timer::counter();
+
+    while(timer::counter() == edge){
+        arch::pause();
+    }
+
+    uint64_t start_counter;
+    uint64_t start_tsc;
+
+    // The other init tasks must not preempt between the paired reads
+    {
+        direct_int_lock lock;
+
+        start_counter = timer::counter();
+        start_tsc = arch::rdtsc();
+    }
+
+    uint64_t end_counter;
+    uint64_t end_tsc;
+
+    while(true){
+        direct_int_lock lock;
+
+        end_counter = timer::counter();
+        end_tsc = arch::rdtsc();
+
+        if(end_counter - start_counter >= duration){
+            break;
+        }
+    }
+
+    return (end_tsc - start_tsc) * freq / (end_counter - start_counter);
+}
+
+std::string sysfs_current(){
+    return clocksource::tsc() ? "tsc" : "counter";
+}
+
+std::string sysfs_tsc_frequency(){
+    return std::to_string(clocksource::tsc_frequency());
+}
+
+} //End of anonymous namespace
+
+void clocksource::init(){
+    sysfs::set_dynamic_value(path("/sys"), path("/clocksource/current"), &sysfs_current);
+    sysfs::set_dynamic_value(path("/sys"), path("/clocksource/tsc_frequency"), &sysfs_tsc_frequency);
+
+    if(!cpu_features::has(tlib::cpu_feature::INVARIANT_TSC)){
+        logging::logf(logging::log_level::DEBUG, "clocksource: No invariant TSC, using the timer counter\n");
+        return;
+    }
+
+    frequency = calibrate();
+
+    if(!frequency){
+        logging::logf(logging::log_level::ERROR, "clocksource: Unable to calibrate the TSC\n");
+        return;
+    }
+
+    // The TSC clock starts from the counter clock, it stays monotonic
+    tsc_params.nanoseconds = counter_nanoseconds();
+    tsc_params.base = arch::rdtsc();
+    tsc_params.mult = (NS_PER_SECOND << 32) / frequency;
+
+    __atomic_store_n(&tsc_ready, true, __ATOMIC_RELEASE);
+
+    logging::logf(logging::log_level::DEBUG, "clocksource: TSC calibrated at %uHz\n", frequency);
+}
+
+uint64_t clocksource::nanoseconds(){
+    if(!__atomic_load_n(&tsc_ready, __ATOMIC_ACQUIRE)){
+        return counter_nanoseconds();
+    }
+
+    auto delta = arch::rdtsc() - tsc_params.base;
+
+    // (delta * mult) >> 32 without overflowing the intermediate product
+    return tsc_params.nanoseconds + (delta >> 32) * tsc_params.mult + (((delta & 0xFFFFFFFF) * tsc_params.mult) >> 32);
+}
+
+bool clocksource::tsc(){
+    return __atomic_load_n(&tsc_ready, __ATOMIC_ACQUIRE);
+}
+
+uint64_t clocksource::tsc_frequency(){
+    return tsc() ? frequency : 0;
+}
+
+clocksource::tsc_conversion clocksource::conversion(){
+    if(!tsc()){
+        return {0, 0, 0};
+    }
+
+    return tsc_params;
+}
@@ -61,6 +61,27 @@
 
 .endm
 
+// Only saves the general purpose registers, the space of the SSE
+// registers is reserved to keep the same layout as save_context
+.macro save_context_light
+    push rbp
+    push r15
+    push r14
+    push r13
+    push r12
+    push r11
+    push r10
+    push r9
+    push r8
+    push rdi
+    push rsi
+    push rdx
+    push rcx
+    push rbx
+    push rax
+    sub rsp, 256
+.endm
+
 .macro restore_context
     movdqu xmm15, [rsp]
     movdqu xmm14, [rsp+16]
@@ -0,0 +1,152 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <lock_guard.hpp>
+
+#include "conc/adaptive_mutex.hpp"
+#include "conc/backoff.hpp"
+
+#include "scheduler.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+std::string sysfs_spins(void* data){
+    return std::to_string(reinterpret_cast<adaptive_mutex*>(data)->get_statistics().spins);
+}
+
+std::string sysfs_spin_successes(void* data){
+    return std::to_string(reinterpret_cast<adaptive_mutex*>(data)->get_statistics().spin_successes);
+}
+
+std::string sysfs_blocks(void* data){
+    return std::to_string(reinterpret_cast<adaptive_mutex*>(data)->get_statistics().blocks);
+}
+
+} //End of anonymous namespace
+
+bool adaptive_mutex::acquire(){
+    std::lock_guard<spinlock> l(value_lock);
+
+    if(value > 0){
+        value = 0;
+        owner = scheduler::get_pid();
+
+        return true;
+    }
+
+    return false;
+}
+
+void adaptive_mutex::acquired(bool contended, uint64_t start){
+#ifdef THOR_CONFIG_LOCK_STAT
+    if(stats){
+        acquired_at = lock_stat::acquired(stats, contended, start);
+    }
+#else
+    (void) contended;
+    (void) start;
+#endif
+}
+
+void adaptive_mutex::lock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+    uint64_t start = stats ? lock_stat::cycles() : 0;
+#else
+    uint64_t start = 0;
+#endif
+
+    if(acquire()){
+        acquired(false, start);
+        return;
+    }
+
+    // The owner is likely to release the mutex soon if it is running
+    bool spun = false;
+    backoff b;
+
+    for(size_t i = 0; i < max_spins; ++i){
+        auto current = owner;
+
+        if(current != NO_OWNER && !scheduler::is_running(current)){
+            break;
+        }
+
+        spun = true;
+
+        b.wait();
+
+        if(value > 0 && acquire()){
+            __atomic_add_fetch(&counters.spins, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&counters.spin_successes, 1, __ATOMIC_RELAXED);
+
+            acquired(true, start);
+            return;
+        }
+    }
+
+    if(spun){
+        __atomic_add_fetch(&counters.spins, 1, __ATOMIC_RELAXED);
+    }
+
+    value_lock.lock();
+
+    if(value > 0){
+        value = 0;
+        owner = scheduler::get_pid();
+
+        value_lock.unlock();
+    } else {
+        __atomic_add_fetch(&counters.blocks, 1, __ATOMIC_RELAXED);
+
+        queue.enqueue();
+
+        value_lock.unlock();
+        scheduler::reschedule();
+
+        // unlock() gave the mutex and its ownership to this process
+    }
+
+    acquired(true, start);
+}
+
+bool adaptive_mutex::try_lock(){
+    if(acquire()){
+        acquired(false, 0);
+        return true;
+    }
+
+    return false;
+}
+
+void adaptive_mutex::unlock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+    if(stats){
+        lock_stat::released(stats, acquired_at);
+    }
+#endif
+
+    std::lock_guard<spinlock> l(value_lock);
+
+    if(queue.empty()){
+        owner = NO_OWNER;
+        value = 1;
+    } else {
+        // The value stays taken, the woken process owns the mutex
+        owner = queue.top();
+        queue.dequeue();
+    }
+}
+
+void adaptive_mutex::export_stats(const std::string& name){
+    auto base = path("/adaptive_mutex") / name;
+
+    sysfs::set_dynamic_value_data(path("/sys"), base / "spins", &sysfs_spins, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "spin_successes", &sysfs_spin_successes, this);
+    sysfs::set_dynamic_value_data(path("/sys"), base / "blocks", &sysfs_blocks, this);
+}
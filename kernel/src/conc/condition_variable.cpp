@@ -8,6 +8,7 @@
 #include <lock_guard.hpp>
 
 #include "conc/condition_variable.hpp"
+#include "conc/mutex.hpp"
 
 #include "scheduler.hpp"
 #include "assert.hpp"
@@ -48,6 +49,37 @@ void condition_variable::notify_all() {
     }
 }
 
+void condition_variable::wake(wait_node& node, mutex& m) {
+    if (node.relock == &m) {
+        // The process would only block again on the mutex held by the caller
+        m.requeue(node);
+    } else {
+        scheduler::unblock_process_hint(node.pid);
+    }
+}
+
+scheduler::pid_t condition_variable::notify_one(mutex& m) {
+    std::lock_guard<spinlock> l(lock);
+
+    if (!queue.empty()) {
+        auto& node = queue.pop();
+
+        wake(node, m);
+
+        return node.pid;
+    }
+
+    return scheduler::INVALID_PID;
+}
+
+void condition_variable::notify_all(mutex& m) {
+    std::lock_guard<spinlock> l(lock);
+
+    while (!queue.empty()) {
+        wake(queue.pop(), m);
+    }
+}
+
 void condition_variable::wait() {
     lock.lock();
 
@@ -59,6 +91,27 @@ void condition_variable::wait() {
     scheduler::reschedule();
 }
 
+void condition_variable::wait(mutex& m) {
+    lock.lock();
+
+    //Enqueue the process in the sleep queue
+    queue.enqueue();
+
+    auto& node = scheduler::get_process(scheduler::get_pid()).wait;
+    node.relock = &m;
+
+    lock.unlock();
+
+    m.unlock();
+
+    scheduler::reschedule();
+
+    // A morphed process was given the mutex by its previous owner
+    if (!node.morphed) {
+        m.lock();
+    }
+}
+
 bool condition_variable::wait_for(size_t ms) {
     if (!ms) {
         return false;
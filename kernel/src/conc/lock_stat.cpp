@@ -0,0 +1,83 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "conc/lock_stat.hpp"
+
+#ifdef THOR_CONFIG_LOCK_STAT
+
+#include <array.hpp>
+#include <lock_guard.hpp>
+
+#include "conc/spinlock.hpp"
+
+#include "print.hpp"
+
+namespace {
+
+// The classes are never allocated, the allocators have named locks too
+std::array<lock_stat::lock_class, lock_stat::MAX_CLASSES> classes;
+size_t registered = 0;
+
+// Not named, it would register itself
+spinlock classes_lock;
+
+bool same_name(const char* a, const char* b){
+    while(*a && *a == *b){
+        ++a;
+        ++b;
+    }
+
+    return *a == *b;
+}
+
+} //End of anonymous namespace
+
+lock_stat::lock_class* lock_stat::register_class(const char* name){
+    std::lock_guard<spinlock> l(classes_lock);
+
+    for(size_t i = 0; i < registered; ++i){
+        if(same_name(classes[i].name, name)){
+            return &classes[i];
+        }
+    }
+
+    if(registered == MAX_CLASSES){
+        return nullptr;
+    }
+
+    auto& c = classes[registered++];
+    c.name = name;
+
+    return &c;
+}
+
+std::string lock_stat::format(){
+    std::string value;
+
+    size_t count;
+
+    {
+        std::lock_guard<spinlock> l(classes_lock);
+        count = registered;
+    }
+
+    for(size_t i = 0; i < count; ++i){
+        auto& c = classes[i];
+
+        value += sprintf("%s %u %u %u %u %u\n", c.name, c.acquisitions, c.contentions, c.wait_cycles, c.hold_cycles, c.hold_max);
+    }
+
+    return value;
+}
+
+#else
+
+std::string lock_stat::format(){
+    return {};
+}
+
+#endif
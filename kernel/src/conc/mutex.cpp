@@ -0,0 +1,225 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "conc/mutex.hpp"
+
+namespace {
+
+constexpr const size_t MAX_CHAIN = 8; ///< The maximum number of owners boosted by a single waiter
+
+} //End of anonymous namespace
+
+void mutex::take(size_t pid){
+    owner = pid;
+
+    if(pid != NO_OWNER){
+        auto& process = scheduler::get_process(pid);
+
+        next_held = process.held_mutexes;
+        process.held_mutexes = this;
+    }
+}
+
+void mutex::inherit(size_t priority){
+    auto m = this;
+
+    for(size_t i = 0; i < MAX_CHAIN; ++i){
+        auto pid = m->owner;
+
+        if(pid == NO_OWNER || !scheduler::inherit_priority(pid, priority)){
+            break;
+        }
+
+        // The owner may itself be waiting for a mutex, whose owner must be boosted too
+        auto next = scheduler::get_process(pid).blocked_on;
+
+        // Only try the next lock, the chain is walked against the lock order
+        if(!next || !next->value_lock.try_lock()){
+            break;
+        }
+
+        // The owner may have obtained the mutex in the meantime
+        if(scheduler::get_process(pid).blocked_on != next){
+            next->value_lock.unlock();
+            break;
+        }
+
+        if(m != this){
+            m->value_lock.unlock();
+        }
+
+        m = next;
+    }
+
+    if(m != this){
+        m->value_lock.unlock();
+    }
+}
+
+void mutex::release_boost(size_t pid){
+    auto& process = scheduler::get_process(pid);
+
+    // The boost of a process is only raised under the lock of one of its mutexes
+    for(auto m = process.held_mutexes; m; m = m->next_held){
+        m->value_lock.lock();
+    }
+
+    size_t priority = 0;
+
+    for(auto m = process.held_mutexes; m; m = m->next_held){
+        auto waiter = m->queue.highest_priority();
+
+        if(waiter > priority){
+            priority = waiter;
+        }
+    }
+
+    scheduler::set_boost(pid, priority);
+
+    for(auto m = process.held_mutexes; m; m = m->next_held){
+        m->value_lock.unlock();
+    }
+}
+
+void mutex::lock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+    auto start = stats ? lock_stat::cycles() : 0;
+    bool contended = false;
+#endif
+
+    // Before the scheduler is started, the mutexes are not owned by any process
+    auto pid = scheduler::is_started() ? scheduler::get_pid() : NO_OWNER;
+
+    value_lock.lock();
+
+    if (value > 0) {
+        value = 0;
+        take(pid);
+
+        value_lock.unlock();
+    } else {
+        if(pid != NO_OWNER){
+            scheduler::get_process(pid).blocked_on = this;
+        }
+
+        queue.enqueue();
+
+        if(pid != NO_OWNER){
+            inherit(scheduler::get_priority(pid));
+        }
+
+        value_lock.unlock();
+        scheduler::reschedule();
+
+        // unlock() gave the mutex and its ownership to this process
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        contended = true;
+#endif
+    }
+
+#ifdef THOR_CONFIG_LOCK_STAT
+    // The mutex is owned here, even when woken up by unlock()
+    if(stats){
+        acquired_at = lock_stat::acquired(stats, contended, start);
+    }
+#endif
+}
+
+bool mutex::try_lock(){
+    std::lock_guard<spinlock> l(value_lock);
+
+    if (value > 0) {
+        value = 0;
+        take(scheduler::is_started() ? scheduler::get_pid() : NO_OWNER);
+
+#ifdef THOR_CONFIG_LOCK_STAT
+        if(stats){
+            acquired_at = lock_stat::acquired(stats, false, 0);
+        }
+#endif
+
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void mutex::unlock(){
+#ifdef THOR_CONFIG_LOCK_STAT
+    if(stats){
+        lock_stat::released(stats, acquired_at);
+    }
+#endif
+
+    size_t previous;
+
+    {
+        std::lock_guard<spinlock> l(value_lock);
+
+        previous = owner;
+
+        if(previous != NO_OWNER){
+            auto& process = scheduler::get_process(previous);
+
+            for(auto link = &process.held_mutexes; *link; link = &(*link)->next_held){
+                if(*link == this){
+                    *link = next_held;
+                    break;
+                }
+            }
+
+            next_held = nullptr;
+        }
+
+        if (queue.empty()) {
+            owner = NO_OWNER;
+            value = 1;
+        } else {
+            auto pid = queue.top();
+
+            // The woken process owns the mutex and inherits from the remaining waiters
+            scheduler::get_process(pid).blocked_on = nullptr;
+            take(pid);
+
+            auto priority = queue.highest_priority();
+
+            if(priority){
+                scheduler::inherit_priority(pid, priority);
+            }
+
+            queue.dequeue();
+
+            //No need to increment value, the process won't
+            //decrement it
+        }
+    }
+
+    // The previous owner loses the priority inherited from the waiters of this mutex
+    if(previous != NO_OWNER){
+        release_boost(previous);
+    }
+}
+
+void mutex::requeue(wait_node& node){
+    std::lock_guard<spinlock> l(value_lock);
+
+    node.morphed = true;
+
+    if (value > 0) {
+        value = 0;
+        take(node.pid);
+
+        scheduler::unblock_process_hint(node.pid);
+    } else {
+        scheduler::get_process(node.pid).blocked_on = this;
+
+        queue.append(node);
+
+        inherit(scheduler::get_priority(node.pid));
+    }
+}
@@ -0,0 +1,79 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+
+#include "conc/qsbr.hpp"
+
+#include "smp.hpp"
+#include "scheduler.hpp"
+
+namespace {
+
+/*!
+ * \brief The quiescent states of a processor, only written by itself
+ */
+struct cpu_state {
+    volatile uint64_t quiescent = 0; ///< The number of quiescent states
+    volatile bool idle = false;      ///< Indicates if the processor is idle
+} __attribute__((aligned(64)));
+
+std::array<cpu_state, smp::MAX_CPUS> cpus;
+
+} //End of anonymous namespace
+
+void qsbr::quiescent(){
+    auto& cpu = cpus[smp::current_cpu()];
+
+    __atomic_store_n(&cpu.quiescent, cpu.quiescent + 1, __ATOMIC_RELEASE);
+}
+
+void qsbr::enter_idle(){
+    __atomic_store_n(&cpus[smp::current_cpu()].idle, true, __ATOMIC_RELEASE);
+}
+
+void qsbr::exit_idle(){
+    auto& cpu = cpus[smp::current_cpu()];
+
+    __atomic_store_n(&cpu.idle, false, __ATOMIC_RELAXED);
+
+    // The readers after the idle loop must not be missed by a writer
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void qsbr::synchronize(){
+    // The unlinks are visible before the quiescent states are sampled
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    std::array<uint64_t, smp::MAX_CPUS> snapshot;
+
+    size_t current;
+    size_t n;
+
+    {
+        // The current processor is not in a read section while it runs the caller
+        direct_int_lock lock;
+
+        current = smp::current_cpu();
+        n = smp::max_cpus();
+
+        for(size_t cpu = 0; cpu < n; ++cpu){
+            snapshot[cpu] = __atomic_load_n(&cpus[cpu].quiescent, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    for(size_t cpu = 0; cpu < n; ++cpu){
+        // The processors that are not running never report a quiescent state
+        if(cpu == current || !smp::online(cpu)){
+            continue;
+        }
+
+        while(__atomic_load_n(&cpus[cpu].quiescent, __ATOMIC_ACQUIRE) == snapshot[cpu] && !__atomic_load_n(&cpus[cpu].idle, __ATOMIC_ACQUIRE)){
+            scheduler::yield();
+        }
+    }
+}
@@ -34,12 +34,31 @@ bool wait_list::waiting() const {
     return false;
 }
 
+size_t wait_list::highest_priority() const {
+    size_t priority = 0;
+
+    for(auto node = head; node; node = node->next){
+        auto waiter = scheduler::get_priority(node->pid);
+
+        if(waiter > priority){
+            priority = waiter;
+        }
+    }
+
+    return priority;
+}
+
 void wait_list::remove(){
     auto pid      = scheduler::get_pid();
     auto& process = scheduler::get_process(pid);
 
     if(head == &process.wait){
         head = head->next;
+
+        if(!head){
+            tail = nullptr;
+        }
+
         return;
     }
 
@@ -47,6 +66,10 @@ void wait_list::remove(){
 
     while(node->next){
         if(node->next == &process.wait){
+            if(tail == node->next){
+                tail = node;
+            }
+
             node->next = node->next->next;
             return;
         }
@@ -55,17 +78,24 @@ void wait_list::remove(){
     }
 }
 
-void wait_list::enqueue() {
-    auto pid      = scheduler::get_pid();
-    auto& process = scheduler::get_process(pid);
-
-    process.wait.next = nullptr;
+void wait_list::push(wait_node& node, bool exclusive){
+    node.next = nullptr;
+    node.exclusive = exclusive;
+    node.relock = nullptr;
+    node.morphed = false;
 
     if (!tail) {
-        tail = head = &process.wait;
+        tail = head = &node;
     } else {
-        tail = tail->next = &process.wait;
+        tail = tail->next = &node;
     }
+}
+
+void wait_list::enqueue() {
+    auto pid      = scheduler::get_pid();
+    auto& process = scheduler::get_process(pid);
+
+    push(process.wait, false);
 
     scheduler::block_process_light(pid);
 }
@@ -74,25 +104,31 @@ void wait_list::enqueue_timeout(size_t ms) {
     auto pid      = scheduler::get_pid();
     auto& process = scheduler::get_process(pid);
 
-    process.wait.next = nullptr;
+    push(process.wait, false);
 
-    if (!tail) {
-        tail = head = &process.wait;
-    } else {
-        tail = tail->next = &process.wait;
-    }
+    scheduler::block_process_timeout_light(pid, ms);
+}
+
+void wait_list::enqueue_exclusive() {
+    auto pid      = scheduler::get_pid();
+    auto& process = scheduler::get_process(pid);
+
+    push(process.wait, true);
+
+    scheduler::block_process_light(pid);
+}
+
+void wait_list::enqueue_exclusive_timeout(size_t ms) {
+    auto pid      = scheduler::get_pid();
+    auto& process = scheduler::get_process(pid);
+
+    push(process.wait, true);
 
     scheduler::block_process_timeout_light(pid, ms);
 }
 
 size_t wait_list::dequeue() {
-    auto pid = head->pid;
-
-    if (head == tail) {
-        head = tail = nullptr;
-    } else {
-        head = head->next;
-    }
+    auto pid = pop().pid;
 
     scheduler::unblock_process(pid);
 
@@ -100,7 +136,53 @@ size_t wait_list::dequeue() {
 }
 
 size_t wait_list::dequeue_hint() {
-    auto pid = head->pid;
+    auto pid = pop().pid;
+
+    scheduler::unblock_process_hint(pid);
+
+    return pid;
+}
+
+size_t wait_list::wake_up() {
+    size_t count = 0;
+    bool exclusive = false;
+
+    wait_node* previous = nullptr;
+    auto node = head;
+
+    while(node){
+        auto next = node->next;
+
+        if(node->exclusive && exclusive){
+            ++avoided;
+            previous = node;
+        } else {
+            exclusive |= node->exclusive;
+
+            if(previous){
+                previous->next = next;
+            } else {
+                head = next;
+            }
+
+            if(tail == node){
+                tail = previous;
+            }
+
+            ++woken;
+            ++count;
+
+            scheduler::unblock_process_hint(node->pid);
+        }
+
+        node = next;
+    }
+
+    return count;
+}
+
+wait_node& wait_list::pop() {
+    auto& node = *head;
 
     if (head == tail) {
         head = tail = nullptr;
@@ -108,7 +190,17 @@ size_t wait_list::dequeue_hint() {
         head = head->next;
     }
 
-    scheduler::unblock_process_hint(pid);
+    ++woken;
 
-    return pid;
+    return node;
+}
+
+void wait_list::append(wait_node& node) {
+    node.next = nullptr;
+
+    if (!tail) {
+        tail = head = &node;
+    } else {
+        tail = tail->next = &node;
+    }
 }
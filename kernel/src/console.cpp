@@ -38,7 +38,7 @@ void stdio::init_console() {
 
 void stdio::console::init() {
     if (!text) {
-        buffer = vesa::create_buffer();
+        buffer = v_console.create_buffer();
     }
 }
 
@@ -89,6 +89,23 @@ void stdio::console::print(char key) {
     }
 }
 
+void stdio::console::print(const char* s, size_t n) {
+    // Only the console on screen is rendered
+    bool batch = !text && active;
+
+    if (batch) {
+        v_console.begin_batch();
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        print(s[i]);
+    }
+
+    if (batch) {
+        v_console.end_batch();
+    }
+}
+
 void stdio::console::wipeout() {
     if (text) {
         t_console.clear();
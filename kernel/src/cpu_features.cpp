@@ -0,0 +1,47 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "cpu_features.hpp"
+#include "logging.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+uint64_t features = 0;
+
+} //end of anonymous namespace
+
+void cpu_features::init(){
+    features = tlib::detect_cpu_features();
+
+    logging::logf(logging::log_level::TRACE, "cpu_features: %h\n", features);
+}
+
+void cpu_features::finalize(){
+    std::string value;
+
+    for(size_t i = 0; i < size_t(tlib::cpu_feature::COUNT); ++i){
+        if(features & (uint64_t(1) << i)){
+            if(!value.empty()){
+                value += ' ';
+            }
+
+            value += tlib::cpu_feature_names[i];
+        }
+    }
+
+    sysfs::set_constant_value(path("/sys"), path("/cpu/features"), value);
+}
+
+uint64_t cpu_features::mask(){
+    return features;
+}
+
+bool cpu_features::has(tlib::cpu_feature feature){
+    return features & tlib::cpu_feature_bit(feature);
+}
@@ -0,0 +1,285 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <string.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "cpuidle.hpp"
+#include "acpica.hpp"
+#include "acpi.hpp"
+#include "arch.hpp"
+#include "clocksource.hpp"
+#include "cpu_features.hpp"
+#include "kernel_utils.hpp"
+#include "logging.hpp"
+#include "scheduler.hpp"
+#include "smp.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const uint8_t SPACE_SYSTEM_IO = 0x1;
+constexpr const uint8_t SPACE_FIXED_HARDWARE = 0x7F;
+
+constexpr const uint64_t LATENCY_FACTOR = 2; ///< The idle duration must be this many times the exit latency
+
+enum class state_type {
+    HLT,   ///< Halt until the next interrupt
+    MWAIT, ///< Wait on a monitored line with a C-state hint
+    IO     ///< Read a P_LVLx port of the chipset
+};
+
+/*!
+ * \brief An idle state of the processors
+ */
+struct idle_state {
+    char name[8];                         ///< The name of the state, C1, C2...
+    state_type type;                      ///< How to enter the state
+    uint32_t argument;                    ///< The MWAIT hint or the IO port
+    uint64_t latency;                     ///< The exit latency, in microseconds
+    uint64_t power;                       ///< The average power, in milliwatts
+    volatile uint64_t usage = 0;          ///< The number of times the state has been entered
+    volatile uint64_t residency = 0;      ///< The time spent in the state, in nanoseconds
+    size_t index = 0;                     ///< The index of the state, for sysfs
+};
+
+/*!
+ * \brief The line monitored by MWAIT, one per processor
+ */
+struct monitor_line {
+    volatile uint64_t value = 0;
+} __attribute__((aligned(64)));
+
+std::array<idle_state, cpuidle::MAX_STATES> idle_states;
+volatile size_t state_count = 0;
+
+volatile size_t max_state = cpuidle::MAX_STATES - 1; ///< The deepest state allowed
+
+std::array<monitor_line, smp::MAX_CPUS> monitor_lines;
+
+void add_state(state_type type, uint32_t argument, uint64_t latency, uint64_t power){
+    auto& state = idle_states[state_count];
+
+    state.name[0] = 'C';
+    state.name[1] = '1' + state_count;
+    state.name[2] = '\0';
+    state.type = type;
+    state.argument = argument;
+    state.latency = latency;
+    state.power = power;
+    state.index = state_count;
+
+    // The idle processors may already select among the states
+    __atomic_store_n(&state_count, state_count + 1, __ATOMIC_RELEASE);
+}
+
+ACPI_STATUS find_processor(ACPI_HANDLE object, UINT32 /*level*/, void* context, void** /*ret*/){
+    *static_cast<ACPI_HANDLE*>(context) = object;
+
+    // Only the first processor is needed, they all have the same states
+    return AE_CTRL_TERMINATE;
+}
+
+// Read the states after HLT from the _CST package of the first processor
+void read_cst(){
+    ACPI_HANDLE processor = nullptr;
+
+    AcpiWalkNamespace(ACPI_TYPE_PROCESSOR, ACPI_ROOT_OBJECT, ACPI_UINT32_MAX, find_processor, nullptr, &processor, nullptr);
+
+    if(!processor){
+        AcpiGetDevices(const_cast<char*>("ACPI0007"), find_processor, &processor, nullptr);
+    }
+
+    if(!processor){
+        logging::logf(logging::log_level::TRACE, "cpuidle: No ACPI processor object\n");
+        return;
+    }
+
+    ACPI_BUFFER buffer = {ACPI_ALLOCATE_BUFFER, nullptr};
+
+    auto status = AcpiEvaluateObjectTyped(processor, const_cast<char*>("_CST"), nullptr, &buffer, ACPI_TYPE_PACKAGE);
+    if(ACPI_FAILURE(status)){
+        logging::logf(logging::log_level::TRACE, "cpuidle: No _CST object\n");
+        return;
+    }
+
+    bool mwait = cpu_features::has(tlib::cpu_feature::MWAIT);
+
+    auto cst = static_cast<ACPI_OBJECT*>(buffer.Pointer);
+
+    // The first element is the number of states
+    for(size_t i = 1; i < cst->Package.Count && state_count < cpuidle::MAX_STATES; ++i){
+        auto& element = cst->Package.Elements[i];
+
+        if(element.Type != ACPI_TYPE_PACKAGE || element.Package.Count != 4){
+            continue;
+        }
+
+        auto& reg = element.Package.Elements[0];
+        auto& type = element.Package.Elements[1];
+        auto& latency = element.Package.Elements[2];
+        auto& power = element.Package.Elements[3];
+
+        // The register is a Generic Register Descriptor, the address is at offset 7
+        if(reg.Type != ACPI_TYPE_BUFFER || reg.Buffer.Length < 15 || type.Type != ACPI_TYPE_INTEGER){
+            continue;
+        }
+
+        // C1 is already HLT
+        if(type.Integer.Value <= 1){
+            continue;
+        }
+
+        auto space = reg.Buffer.Pointer[3];
+
+        uint64_t address = 0;
+        for(size_t b = 0; b < 8; ++b){
+            address |= static_cast<uint64_t>(reg.Buffer.Pointer[7 + b]) << (8 * b);
+        }
+
+        if(space == SPACE_FIXED_HARDWARE && mwait){
+            add_state(state_type::MWAIT, address, latency.Integer.Value, power.Integer.Value);
+        } else if(space == SPACE_SYSTEM_IO){
+            add_state(state_type::IO, address, latency.Integer.Value, power.Integer.Value);
+        } else {
+            logging::logf(logging::log_level::TRACE, "cpuidle: Unsupported C%u (space:%u)\n", size_t(type.Integer.Value), size_t(space));
+        }
+    }
+
+    AcpiOsFree(buffer.Pointer);
+}
+
+std::string sysfs_name(void* data){
+    return reinterpret_cast<idle_state*>(data)->name;
+}
+
+std::string sysfs_latency(void* data){
+    return std::to_string(reinterpret_cast<idle_state*>(data)->latency);
+}
+
+std::string sysfs_usage(void* data){
+    return std::to_string(reinterpret_cast<idle_state*>(data)->usage);
+}
+
+std::string sysfs_residency(void* data){
+    return std::to_string(reinterpret_cast<idle_state*>(data)->residency / 1000);
+}
+
+std::string sysfs_max_state(void*){
+    return std::to_string(max_state);
+}
+
+size_t sysfs_set_max_state(void*, const std::string& value){
+    if(value.empty()){
+        return std::ERROR_INVALID_REQUEST;
+    }
+
+    size_t state = 0;
+
+    for(auto c : value){
+        if(c < '0' || c > '9'){
+            return std::ERROR_INVALID_REQUEST;
+        }
+
+        state = state * 10 + (c - '0');
+    }
+
+    if(state >= state_count){
+        return std::ERROR_INVALID_REQUEST;
+    }
+
+    max_state = state;
+
+    return 0;
+}
+
+void late_init(){
+    if(acpi::initialized()){
+        read_cst();
+    }
+
+    for(size_t i = 0; i < state_count; ++i){
+        auto& state = idle_states[i];
+        auto base = path("/cpuidle") / std::to_string(i);
+
+        sysfs::set_dynamic_value_data(path("/sys"), base / "name", &sysfs_name, &state);
+        sysfs::set_dynamic_value_data(path("/sys"), base / "latency", &sysfs_latency, &state);
+        sysfs::set_dynamic_value_data(path("/sys"), base / "usage", &sysfs_usage, &state);
+        sysfs::set_dynamic_value_data(path("/sys"), base / "residency", &sysfs_residency, &state);
+
+        logging::logf(logging::log_level::TRACE, "cpuidle: %s latency:%uus power:%umW\n", state.name, state.latency, state.power);
+    }
+
+    sysfs::set_writable_value_data(path("/sys"), path("/cpuidle/max_state"), &sysfs_max_state, &sysfs_set_max_state, nullptr);
+}
+
+size_t select(uint64_t predicted_us){
+    size_t selected = 0;
+    size_t deepest = max_state;
+    size_t count = __atomic_load_n(&state_count, __ATOMIC_ACQUIRE);
+
+    if(deepest >= count){
+        deepest = count - 1;
+    }
+
+    for(size_t i = 1; i <= deepest; ++i){
+        if(idle_states[i].latency * LATENCY_FACTOR > predicted_us){
+            break;
+        }
+
+        selected = i;
+    }
+
+    return selected;
+}
+
+} //End of anonymous namespace
+
+void cpuidle::init(){
+    // HLT is always available, even before ACPI
+    add_state(state_type::HLT, 0, 1, 0);
+
+    // The _CST object needs ACPICA
+    scheduler::queue_async_init_task("cpuidle", late_init, {"acpi"});
+}
+
+void cpuidle::enter(uint64_t predicted_us){
+    auto& state = idle_states[select(predicted_us)];
+
+    auto start = clocksource::nanoseconds();
+
+    switch(state.type){
+        case state_type::HLT:
+            // hlt is executed before any interrupt is delivered
+            asm volatile("sti; hlt");
+            break;
+
+        case state_type::MWAIT:
+            asm volatile("monitor" : : "a" (&monitor_lines[smp::current_cpu()].value), "c" (0), "d" (0));
+
+            // The masked interrupts break the wait, they are taken after sti
+            asm volatile("mwait" : : "a" (state.argument), "c" (1));
+            asm volatile("sti");
+            break;
+
+        case state_type::IO:
+            // The chipset puts the processor in the state until the next interrupt
+            in_byte(state.argument);
+            asm volatile("sti");
+            break;
+    }
+
+    __atomic_add_fetch(&state.usage, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&state.residency, clocksource::nanoseconds() - start, __ATOMIC_RELAXED);
+}
+
+size_t cpuidle::states(){
+    return state_count;
+}
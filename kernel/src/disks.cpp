@@ -8,14 +8,19 @@
 #include <unique_ptr.hpp>
 #include <array.hpp>
 #include <string.hpp>
+#include <algorithms.hpp>
+
+#include <tlib/errors.hpp>
 
 #include "disks.hpp"
 #include "thor.hpp"
 #include "print.hpp"
 #include "logging.hpp"
+#include "timer.hpp"
 
 // The disks implementation
 #include "drivers/ata.hpp"
+#include "drivers/ahci.hpp"
 #include "drivers/ramdisk.hpp"
 
 #include "fs/devfs.hpp"
@@ -23,8 +28,8 @@
 
 namespace {
 
-//For now, 5 is enough as only the ata driver and ramdisk are implemented
-std::array<disks::disk_descriptor, 5> _disks;
+//The four ATA drives, the AHCI disks and the ramdisk
+std::array<disks::disk_descriptor, 16> _disks;
 
 uint64_t number_of_disks = 0;
 
@@ -47,34 +52,208 @@ struct boot_record_t {
 
 static_assert(sizeof(boot_record_t) == 512, "The boot record is 512 bytes long");
 
+struct gpt_header_t {
+    char signature[8];
+    uint32_t revision;
+    uint32_t header_size;
+    uint32_t header_crc;
+    uint32_t reserved;
+    uint64_t current_lba;
+    uint64_t backup_lba;
+    uint64_t first_usable_lba;
+    uint64_t last_usable_lba;
+    uint8_t disk_guid[16];
+    uint64_t entries_lba;
+    uint32_t entries;
+    uint32_t entry_size;
+    uint32_t entries_crc;
+    uint8_t padding[420];
+} __attribute__ ((packed));
+
+static_assert(sizeof(gpt_header_t) == 512, "The GPT header is 512 bytes long");
+
+struct gpt_entry_t {
+    uint8_t type_guid[16];
+    uint8_t partition_guid[16];
+    uint64_t first_lba;
+    uint64_t last_lba;
+    uint64_t attributes;
+    uint16_t name[36];
+} __attribute__ ((packed));
+
+static_assert(sizeof(gpt_entry_t) == 128, "A GPT entry is 128 bytes long");
+
+constexpr const uint8_t MBR_GPT_PROTECTIVE = 0xEE; ///< The type of the MBR partition covering a GPT disk
+constexpr const size_t MAX_GPT_ENTRIES = 128;      ///< The maximum number of GPT entries read
+
+// The GUIDs, as stored on the disk, of the partitions that can hold FAT32
+constexpr const uint8_t GPT_BASIC_DATA[16] = {0xA2, 0xA0, 0xD0, 0xEB, 0xE5, 0xB9, 0x33, 0x44, 0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7};
+constexpr const uint8_t GPT_EFI_SYSTEM[16] = {0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11, 0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B};
+
 ata::ata_driver ata_driver_impl;
 ata::ata_part_driver ata_part_driver_impl;
+ahci::ahci_driver ahci_driver_impl;
+ahci::ahci_part_driver ahci_part_driver_impl;
 ramdisk::ramdisk_driver ramdisk_driver_impl;
 
 devfs::dev_driver* ata_driver = &ata_driver_impl;
 devfs::dev_driver* ata_part_driver = &ata_part_driver_impl;
+devfs::dev_driver* ahci_driver = &ahci_driver_impl;
+devfs::dev_driver* ahci_part_driver = &ahci_part_driver_impl;
 devfs::dev_driver* ramdisk_driver = &ramdisk_driver_impl;
 devfs::dev_driver* atapi_driver = nullptr;
 
-void make_ram_disk(){
-    auto* descriptor = ramdisk::make_disk(1024 * 1024); //1MiB
+size_t read_sectors(disks::disk_descriptor& disk, uint64_t start, size_t count, void* destination){
+    size_t read = 0;
 
-    if(!descriptor){
-        logging::logf(logging::log_level::ERROR, "disks: failed to created /dev/ram0");
-        return;
+    if(disk.type == disks::disk_type::AHCI){
+        return ahci::read_sectors(*static_cast<ahci::drive_descriptor*>(disk.descriptor), start, count, destination, read);
+    } else {
+        return ata::read_sectors(*static_cast<ata::drive_descriptor*>(disk.descriptor), start, count, destination, read);
+    }
+}
+
+bool guid_equals(const uint8_t* a, const uint8_t* b){
+    return std::equal_n(a, b, 16);
+}
+
+bool guid_empty(const uint8_t* guid){
+    for(size_t i = 0; i < 16; ++i){
+        if(guid[i]){
+            return false;
+        }
     }
 
-    _disks[number_of_disks] = {number_of_disks, disks::disk_type::RAM, descriptor};
+    return true;
+}
 
-    devfs::register_device("/dev/", "ram0", devfs::device_type::BLOCK_DEVICE, ramdisk_driver, &_disks[number_of_disks]);
+std::unique_heap_array<disks::partition_descriptor> gpt_partitions(disks::disk_descriptor& disk){
+    std::unique_ptr<gpt_header_t> header(new gpt_header_t());
 
-    ++number_of_disks;
+    if(read_sectors(disk, 1, 1, header.get()) > 0){
+        logging::logf(logging::log_level::ERROR, "disks: Read GPT header failed\n");
+        return {};
+    }
+
+    if(!std::equal_n(header->signature, "EFI PART", 8) || header->entry_size < sizeof(gpt_entry_t) || header->entry_size % 8){
+        logging::logf(logging::log_level::ERROR, "disks: Invalid GPT header\n");
+        return {};
+    }
+
+    auto entries = std::min(size_t(header->entries), MAX_GPT_ENTRIES);
+    auto sectors = (entries * header->entry_size + 511) / 512;
+
+    std::unique_heap_array<char> table(sectors * 512);
+
+    if(read_sectors(disk, header->entries_lba, sectors, table.get()) > 0){
+        logging::logf(logging::log_level::ERROR, "disks: Read GPT entries failed\n");
+        return {};
+    }
+
+    auto entry = [&](size_t i){ return reinterpret_cast<const gpt_entry_t*>(table.get() + i * header->entry_size); };
+
+    uint64_t n = 0;
+    for(size_t i = 0; i < entries; ++i){
+        if(!guid_empty(entry(i)->type_guid)){
+            ++n;
+        }
+    }
+
+    std::unique_heap_array<disks::partition_descriptor> partitions(n);
+    uint64_t p = 0;
+
+    for(size_t i = 0; i < entries; ++i){
+        auto& e = *entry(i);
+
+        if(!guid_empty(e.type_guid)){
+            vfs::partition_type type;
+            if(guid_equals(e.type_guid, GPT_BASIC_DATA) || guid_equals(e.type_guid, GPT_EFI_SYSTEM)){
+                type = vfs::partition_type::FAT32;
+            } else {
+                type = vfs::partition_type::UNKNOWN;
+            }
+
+            partitions[p] = {p, type, e.first_lba, e.last_lba - e.first_lba + 1, &disk};
+
+            ++p;
+        }
+    }
+
+    return partitions;
+}
+
+std::unique_heap_array<disks::partition_descriptor> mbr_partitions(disks::disk_descriptor& disk){
+    std::unique_ptr<boot_record_t> boot_record(new boot_record_t());
+
+    if(read_sectors(disk, 0, 1, boot_record.get()) > 0){
+        k_print_line("Read Boot Record failed");
+
+        return {};
+    }
+
+    if(boot_record->signature != 0xAA55){
+        k_print_line("Invalid boot record signature");
+
+        return {};
+    }
+
+    uint64_t n = 0;
+    for(int i = 0; i < 4; ++i){
+        // A protective partition covers the whole disk, the partitions are in the GPT
+        if(boot_record->partitions[i].type_code == MBR_GPT_PROTECTIVE){
+            return gpt_partitions(disk);
+        }
+
+        if(boot_record->partitions[i].type_code > 0){
+            ++n;
+        }
+    }
+
+    std::unique_heap_array<disks::partition_descriptor> partitions(n);
+    uint64_t p = 0;
+
+    for(uint64_t i = 0; i < 4; ++i){
+        if(boot_record->partitions[i].type_code > 0){
+            vfs::partition_type type;
+            if(boot_record->partitions[i].type_code == 0x0B || boot_record->partitions[i].type_code == 0x0C){
+                type = vfs::partition_type::FAT32;
+            } else {
+                type = vfs::partition_type::UNKNOWN;
+            }
+
+            partitions[p] = {p, type, boot_record->partitions[i].lba_begin, boot_record->partitions[i].sectors, &disk};
+
+            ++p;
+        }
+    }
+
+    return partitions;
+}
+
+/*!
+ * \brief Read the partitions of the disk and register them in devfs
+ */
+void register_partitions(disks::disk_descriptor& disk, const std::string& name, devfs::dev_driver* driver){
+    disk.partitions = mbr_partitions(disk);
+
+    char part = '1';
+
+    for(auto& partition : disk.partitions){
+        auto part_name = name + part++;
+
+        devfs::register_device("/dev/", part_name, devfs::device_type::BLOCK_DEVICE, driver, &partition);
+    }
 }
 
 } //end of anonymous namespace
 
 void disks::detect_disks(){
+    auto start = timer::milliseconds();
+
+    //The ATA channels are identified while the AHCI controllers are probed
     ata::detect_disks();
+    ahci::detect_disks();
+    ata::wait_disks();
 
     char cdrom = 'a';
     char disk = 'a';
@@ -85,27 +264,21 @@ void disks::detect_disks(){
         if(descriptor.present){
             std::string name;
             if(descriptor.atapi){
-                _disks[number_of_disks] = {number_of_disks, disks::disk_type::ATAPI, &descriptor};
+                _disks[number_of_disks] = {number_of_disks, disks::disk_type::ATAPI, &descriptor, {}};
 
                 name = "cd";
                 name += cdrom++;
 
                 devfs::register_device("/dev/", name, devfs::device_type::BLOCK_DEVICE, atapi_driver, &_disks[number_of_disks]);
             } else {
-                _disks[number_of_disks] = {number_of_disks, disks::disk_type::ATA, &descriptor};
+                _disks[number_of_disks] = {number_of_disks, disks::disk_type::ATA, &descriptor, {}};
 
                 name = "hd";
                 name += disk++;
 
                 devfs::register_device("/dev/", name, devfs::device_type::BLOCK_DEVICE, ata_driver, &_disks[number_of_disks]);
 
-                char part = '1';
-
-                for(auto& partition : partitions(_disks[number_of_disks])){
-                    auto part_name = name + part++;
-
-                    devfs::register_device("/dev/", part_name, devfs::device_type::BLOCK_DEVICE, ata_part_driver, new partition_descriptor(partition));
-                }
+                register_partitions(_disks[number_of_disks], name, ata_part_driver);
             }
 
             sysfs::set_constant_value(path("/sys"), path("/ata") / name / "model", descriptor.model);
@@ -116,68 +289,82 @@ void disks::detect_disks(){
         }
     }
 
-    make_ram_disk();
-}
+    // The AHCI disks follow the ATA disks, with the same names
+    for(size_t i = 0; i < ahci::number_of_disks() && number_of_disks + 1 < _disks.size(); ++i){
+        auto& descriptor = ahci::drive(i);
 
-disks::disk_descriptor& disks::disk_by_index(uint64_t index){
-    return _disks[index];
-}
+        _disks[number_of_disks] = {number_of_disks, disks::disk_type::AHCI, &descriptor, {}};
 
-disks::disk_descriptor& disks::disk_by_uuid(uint64_t uuid){
-    for(uint64_t i = 0; i < number_of_disks; ++i){
-        if(_disks[i].uuid == uuid){
-            return _disks[i];
-        }
+        std::string name = "hd";
+        name += disk++;
+
+        devfs::register_device("/dev/", name, devfs::device_type::BLOCK_DEVICE, ahci_driver, &_disks[number_of_disks]);
+
+        register_partitions(_disks[number_of_disks], name, ahci_part_driver);
+
+        sysfs::set_constant_value(path("/sys"), path("/ahci") / name / "model", descriptor.model);
+        sysfs::set_constant_value(path("/sys"), path("/ahci") / name / "serial", descriptor.serial);
+        sysfs::set_constant_value(path("/sys"), path("/ahci") / name / "firmware", descriptor.firmware);
+        sysfs::set_constant_value(path("/sys"), path("/ahci") / name / "queue_depth", std::to_string(descriptor.queue_depth));
+
+        ++number_of_disks;
     }
 
-    __builtin_unreachable();
+    if(!make_ram_disk(1024 * 1024)){ //1MiB
+        logging::logf(logging::log_level::ERROR, "disks: failed to created /dev/ram0");
+    }
+
+    logging::logf(logging::log_level::DEBUG, "disks: %u disks detected in %ums\n", number_of_disks, timer::milliseconds() - start);
 }
 
-std::unique_heap_array<disks::partition_descriptor> disks::partitions(disk_descriptor& disk){
-    // A RAM disk has no partition
-    if(disk.type == disk_type::RAM){
-        return {};
+std::expected<size_t> disks::make_ram_disk(size_t size){
+    if(!size){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
     }
 
-    std::unique_ptr<boot_record_t> boot_record(new boot_record_t());
+    if(number_of_disks == _disks.size()){
+        return std::make_unexpected<size_t>(std::ERROR_BUSY);
+    }
 
-    size_t read;
-    if(ata::read_sectors(*static_cast<ata::drive_descriptor*>(disk.descriptor), 0, 1, boot_record.get(), read) > 0){
-        k_print_line("Read Boot Record failed");
+    auto* descriptor = ramdisk::make_disk(size);
 
-        return {};
-    } else {
-        if(boot_record->signature != 0xAA55){
-            k_print_line("Invalid boot record signature");
+    if(!descriptor){
+        return std::make_unexpected<size_t>(std::ERROR_BUSY);
+    }
 
-            return {};
-        }
+    _disks[number_of_disks] = {number_of_disks, disks::disk_type::RAM, descriptor, {}};
 
-        uint64_t n = 0;
-        for(int i = 0; i < 4; ++i){
-            if(boot_record->partitions[i].type_code > 0){
-                ++n;
-            }
-        }
+    auto name = "ram" + std::to_string(descriptor->id);
 
-        std::unique_heap_array<partition_descriptor> partitions(n);
-        uint64_t p = 0;
+    devfs::register_device("/dev/", name, devfs::device_type::BLOCK_DEVICE, ramdisk_driver, &_disks[number_of_disks]);
 
-        for(uint64_t i = 0; i < 4; ++i){
-            if(boot_record->partitions[i].type_code > 0){
-                vfs::partition_type type;
-                if(boot_record->partitions[i].type_code == 0x0B || boot_record->partitions[i].type_code == 0x0C){
-                    type = vfs::partition_type::FAT32;
-                } else {
-                    type = vfs::partition_type::UNKNOWN;
-                }
+    ++number_of_disks;
 
-                partitions[p] = {p, type, boot_record->partitions[i].lba_begin, boot_record->partitions[i].sectors, &disk};
+    return descriptor->id;
+}
 
-                ++p;
-            }
-        }
+void disks::finalize(){
+    ata::finalize();
+}
 
-        return partitions;
+bool disks::sync(){
+    return ata::sync();
+}
+
+disks::disk_descriptor& disks::disk_by_index(uint64_t index){
+    return _disks[index];
+}
+
+disks::disk_descriptor& disks::disk_by_uuid(uint64_t uuid){
+    for(uint64_t i = 0; i < number_of_disks; ++i){
+        if(_disks[i].uuid == uuid){
+            return _disks[i];
+        }
     }
+
+    __builtin_unreachable();
+}
+
+std::unique_heap_array<disks::partition_descriptor>& disks::partitions(disk_descriptor& disk){
+    return disk.partitions;
 }
@@ -0,0 +1,933 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <lock_guard.hpp>
+#include <array.hpp>
+#include <vector.hpp>
+#include <algorithms.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "drivers/ahci.hpp"
+#include "drivers/pci.hpp"
+#include "drivers/apic.hpp"
+
+#include "conc/mutex.hpp"
+#include "conc/semaphore.hpp"
+#include "conc/int_spinlock.hpp"
+#include "conc/deferred_unique_mutex.hpp"
+
+#include "disks.hpp"
+#include "interrupts.hpp"
+#include "logging.hpp"
+#include "paging.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "scheduler.hpp"
+
+namespace {
+
+constexpr const size_t BLOCK_SIZE = 512;
+constexpr const size_t MAX_TRANSFER = 256;      ///< The maximum number of sectors of a command
+constexpr const size_t SLOTS = 32;              ///< The number of command slots of a port
+constexpr const size_t MAX_PORTS = 32;          ///< The number of ports of a controller
+constexpr const size_t MAX_PRD = 56;            ///< The number of PRD entries of a command table
+constexpr const uint64_t DMA_LIMIT = 1ULL << 32; ///< The memory reachable by a controller without 64 bits DMA
+
+// Global registers of the HBA
+constexpr const size_t HBA_CAP = 0x00;
+constexpr const size_t HBA_GHC = 0x04;
+constexpr const size_t HBA_IS  = 0x08;
+constexpr const size_t HBA_PI  = 0x0C;
+
+constexpr const uint32_t HBA_CAP_S64A = 1U << 31;
+constexpr const uint32_t HBA_CAP_SNCQ = 1U << 30;
+constexpr const uint32_t HBA_GHC_AE   = 1U << 31;
+constexpr const uint32_t HBA_GHC_IE   = 1U << 1;
+
+// Registers of a port, relative to its base
+constexpr const size_t PORT_CLB  = 0x00;
+constexpr const size_t PORT_CLBU = 0x04;
+constexpr const size_t PORT_FB   = 0x08;
+constexpr const size_t PORT_FBU  = 0x0C;
+constexpr const size_t PORT_IS   = 0x10;
+constexpr const size_t PORT_IE   = 0x14;
+constexpr const size_t PORT_CMD  = 0x18;
+constexpr const size_t PORT_SIG  = 0x24;
+constexpr const size_t PORT_SSTS = 0x28;
+constexpr const size_t PORT_SERR = 0x30;
+constexpr const size_t PORT_SACT = 0x34;
+constexpr const size_t PORT_CI   = 0x38;
+
+constexpr const uint32_t PORT_CMD_ST  = 1U << 0;
+constexpr const uint32_t PORT_CMD_FRE = 1U << 4;
+constexpr const uint32_t PORT_CMD_FR  = 1U << 14;
+constexpr const uint32_t PORT_CMD_CR  = 1U << 15;
+
+constexpr const uint32_t PORT_IS_COMPLETION = 0x0000002F; ///< D2H, PIO setup, DMA setup, set device bits and descriptor processed
+constexpr const uint32_t PORT_IS_ERRORS     = 0x78000000; ///< Task file, host bus fatal, host bus data and interface errors
+
+constexpr const uint32_t SATA_SIG_ATA = 0x00000101; ///< The signature of a SATA disk
+
+// Commands
+constexpr const uint8_t ATA_IDENTIFY       = 0xEC;
+constexpr const uint8_t ATA_READ_DMA_EXT   = 0x25;
+constexpr const uint8_t ATA_WRITE_DMA_EXT  = 0x35;
+constexpr const uint8_t ATA_READ_FPDMA     = 0x60;
+constexpr const uint8_t ATA_WRITE_FPDMA    = 0x61;
+
+constexpr const uint8_t FIS_TYPE_H2D = 0x27;
+
+struct command_header {
+    uint16_t flags;          ///< The length of the FIS and the direction
+    uint16_t prdtl;          ///< The number of PRD entries
+    volatile uint32_t prdbc; ///< The number of transferred bytes
+    uint32_t ctba;           ///< The physical address of the command table
+    uint32_t ctbau;          ///< The upper part of the address of the command table
+    uint32_t reserved[4];
+} __attribute__((packed));
+
+static_assert(sizeof(command_header) == 32, "A command header is 32 bytes long");
+
+struct prd_entry {
+    uint32_t dba;  ///< The physical address of the region
+    uint32_t dbau; ///< The upper part of the address of the region
+    uint32_t reserved;
+    uint32_t dbc;  ///< The size of the region, minus one
+} __attribute__((packed));
+
+struct command_table {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    prd_entry prdt[MAX_PRD];
+} __attribute__((packed));
+
+static_assert(sizeof(command_table) == 1024, "A command table is 1024 bytes long");
+
+struct fis_h2d {
+    uint8_t type;
+    uint8_t flags;
+    uint8_t command;
+    uint8_t feature_low;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+    uint32_t reserved;
+} __attribute__((packed));
+
+constexpr const size_t TABLE_PAGES = SLOTS * sizeof(command_table) / paging::PAGE_SIZE;
+constexpr const size_t BOUNCE_PAGES = MAX_TRANSFER * BLOCK_SIZE / paging::PAGE_SIZE;
+
+enum class sector_operation {
+    READ,
+    WRITE,
+    CLEAR
+};
+
+/*!
+ * \brief The state of a command slot
+ */
+struct slot_state {
+    deferred_unique_mutex done_lock; ///< Notified when the command is completed
+    volatile bool done;              ///< Indicates if the command is completed
+    volatile bool error;             ///< Indicates if the command failed
+};
+
+/*!
+ * \brief The state of a port with a disk
+ */
+struct port_state {
+    command_header* headers; ///< The command list
+    command_table* tables;   ///< The command tables, one per slot
+    char* bounce;            ///< A buffer for the data not reachable by the controller
+    mutex bounce_lock;       ///< Protect the bounce buffer
+    semaphore free_slots;    ///< The slots which can be used
+    int_spinlock lock;       ///< Protect the slot bitmaps and the issue registers
+    uint32_t busy;           ///< The used slots
+    uint32_t active;         ///< The issued commands not yet completed
+    std::array<slot_state, SLOTS> slots;
+};
+
+volatile char* hba = nullptr; ///< The registers of the controller
+bool dma64 = false;           ///< Indicates if the controller supports 64 bits addresses
+size_t command_slots = 0;     ///< The number of command slots of each port
+bool ncq_support = false;     ///< Indicates if the controller supports NCQ
+
+std::array<port_state*, MAX_PORTS> ports;
+std::vector<ahci::drive_descriptor> drives;
+
+uint32_t read_register(size_t offset){
+    return *reinterpret_cast<volatile uint32_t*>(hba + offset);
+}
+
+void write_register(size_t offset, uint32_t value){
+    *reinterpret_cast<volatile uint32_t*>(hba + offset) = value;
+}
+
+uint32_t read_port(size_t port, size_t offset){
+    return read_register(0x100 + port * 0x80 + offset);
+}
+
+void write_port(size_t port, size_t offset, uint32_t value){
+    write_register(0x100 + port * 0x80 + offset, value);
+}
+
+bool wait_port(size_t port, size_t offset, uint32_t mask, uint32_t value){
+    for(size_t i = 0; i < 1000000; ++i){
+        if((read_port(port, offset) & mask) == value){
+            return true;
+        }
+
+        asm volatile ("pause");
+    }
+
+    return false;
+}
+
+/*!
+ * \brief Allocate zeroed physically contiguous memory reachable by the controller
+ * \return The virtual address of the memory, 0 if it cannot be allocated
+ */
+size_t allocate_dma(size_t pages, size_t& phys){
+    phys = physical_allocator::allocate(pages);
+
+    if(!phys){
+        return 0;
+    }
+
+    if(!dma64 && phys + pages * paging::PAGE_SIZE > DMA_LIMIT){
+        physical_allocator::free(phys, pages);
+        return 0;
+    }
+
+    auto virt = virtual_allocator::allocate(pages);
+
+    if(!virt || !paging::map_pages(virt, phys, pages)){
+        physical_allocator::free(phys, pages);
+        return 0;
+    }
+
+    std::fill_n(reinterpret_cast<char*>(virt), pages * paging::PAGE_SIZE, 0);
+
+    return virt;
+}
+
+bool stop_port(size_t port){
+    write_port(port, PORT_CMD, read_port(port, PORT_CMD) & ~PORT_CMD_ST);
+
+    if(!wait_port(port, PORT_CMD, PORT_CMD_CR, 0)){
+        return false;
+    }
+
+    write_port(port, PORT_CMD, read_port(port, PORT_CMD) & ~PORT_CMD_FRE);
+
+    return wait_port(port, PORT_CMD, PORT_CMD_FR, 0);
+}
+
+void start_port(size_t port){
+    wait_port(port, PORT_CMD, PORT_CMD_CR, 0);
+
+    write_port(port, PORT_CMD, read_port(port, PORT_CMD) | PORT_CMD_FRE);
+    write_port(port, PORT_CMD, read_port(port, PORT_CMD) | PORT_CMD_ST);
+}
+
+/*!
+ * \brief Restart a port after an error. The outstanding commands are aborted.
+ */
+void recover_port(size_t port){
+    stop_port(port);
+
+    write_port(port, PORT_SERR, 0xFFFFFFFF);
+    write_port(port, PORT_IS, 0xFFFFFFFF);
+
+    start_port(port);
+}
+
+/*!
+ * \brief Complete the commands of the port the controller is done with
+ */
+void complete(size_t p){
+    auto& port = *ports[p];
+
+    std::lock_guard<int_spinlock> l(port.lock);
+
+    auto status = read_port(p, PORT_IS);
+    write_port(p, PORT_IS, status);
+
+    uint32_t failed = 0;
+
+    if(status & PORT_IS_ERRORS){
+        logging::logf(logging::log_level::ERROR, "ahci: Error on port %u (status %h)\n", p, size_t(status));
+
+        failed = port.active;
+        recover_port(p);
+    }
+
+    // The queued commands are cleared from SACT and the others from CI
+    auto pending = read_port(p, PORT_CI) | read_port(p, PORT_SACT);
+    auto done = port.active & (~pending | failed);
+
+    port.active &= ~done;
+
+    for(size_t slot = 0; slot < SLOTS; ++slot){
+        if(done & (1U << slot)){
+            auto& state = port.slots[slot];
+
+            state.error = failed & (1U << slot);
+            state.done = true;
+
+            if(scheduler::is_started()){
+                state.done_lock.notify();
+            }
+        }
+    }
+}
+
+void ahci_handler(interrupt::syscall_regs*, void*){
+    auto pending = read_register(HBA_IS);
+
+    for(size_t p = 0; p < MAX_PORTS; ++p){
+        if((pending & (1U << p)) && ports[p]){
+            complete(p);
+        }
+    }
+
+    write_register(HBA_IS, pending);
+}
+
+/*!
+ * \brief Indicates if the controller can transfer directly from the given buffer
+ */
+bool reachable(size_t virt, size_t bytes){
+    if(virt & 1){
+        return false;
+    }
+
+    auto end = virt + bytes;
+
+    for(auto page = virt & ~(paging::PAGE_SIZE - 1); page < end; page += paging::PAGE_SIZE){
+        auto phys = paging::physical_address(page);
+
+        // The buffers of the user space are not mapped in the kernel tables
+        if(!phys || (!dma64 && phys + paging::PAGE_SIZE > DMA_LIMIT)){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Describe a reachable buffer in the PRD table of a command
+ * \return The number of entries
+ */
+size_t build_prd(command_table& table, size_t virt, size_t bytes){
+    size_t entries = 0;
+
+    while(bytes){
+        auto phys = paging::physical_address(virt);
+        auto chunk = std::min(bytes, paging::PAGE_SIZE - (virt & (paging::PAGE_SIZE - 1)));
+
+        // Merge the physically contiguous pages
+        if(entries){
+            auto& last = table.prdt[entries - 1];
+            auto last_end = ((uint64_t(last.dbau) << 32) | last.dba) + last.dbc + 1;
+
+            if(last_end == phys){
+                last.dbc += chunk;
+
+                virt += chunk;
+                bytes -= chunk;
+
+                continue;
+            }
+        }
+
+        table.prdt[entries++] = {uint32_t(phys), uint32_t(uint64_t(phys) >> 32), 0, uint32_t(chunk - 1)};
+
+        virt += chunk;
+        bytes -= chunk;
+    }
+
+    return entries;
+}
+
+/*!
+ * \brief Issue a command on a free slot of the port of the drive and wait
+ * for its completion. The data buffer must be reachable by the controller.
+ *
+ * Several processes can have commands outstanding on the same port, up to
+ * the queue depth of the drive.
+ */
+bool execute(ahci::drive_descriptor& drive, uint8_t command, uint64_t start, size_t count, void* data, size_t bytes, bool write){
+    auto p = drive.port;
+    auto& port = *ports[p];
+
+    port.free_slots.lock();
+
+    size_t slot = 0;
+
+    {
+        std::lock_guard<int_spinlock> l(port.lock);
+
+        while(port.busy & (1U << slot)){
+            ++slot;
+        }
+
+        port.busy |= 1U << slot;
+    }
+
+    bool queued = command == ATA_READ_FPDMA || command == ATA_WRITE_FPDMA;
+
+    auto& table = port.tables[slot];
+    auto& header = port.headers[slot];
+
+    header.prdtl = build_prd(table, reinterpret_cast<size_t>(data), bytes);
+    header.prdbc = 0;
+    header.flags = (sizeof(fis_h2d) / 4) | (write ? (1 << 6) : 0);
+
+    auto& fis = *reinterpret_cast<fis_h2d*>(table.cfis);
+    fis = {};
+
+    fis.type = FIS_TYPE_H2D;
+    fis.flags = 0x80; // Command
+    fis.command = command;
+    fis.device = command == ATA_IDENTIFY ? 0 : (1 << 6);
+    fis.lba0 = start & 0xFF;
+    fis.lba1 = (start >> 8) & 0xFF;
+    fis.lba2 = (start >> 16) & 0xFF;
+    fis.lba3 = (start >> 24) & 0xFF;
+    fis.lba4 = (start >> 32) & 0xFF;
+    fis.lba5 = (start >> 40) & 0xFF;
+
+    if(queued){
+        // The count is in the features and the tag in the count
+        fis.feature_low = count & 0xFF;
+        fis.feature_high = (count >> 8) & 0xFF;
+        fis.count_low = slot << 3;
+    } else {
+        fis.count_low = count & 0xFF;
+        fis.count_high = (count >> 8) & 0xFF;
+    }
+
+    auto& state = port.slots[slot];
+    state.done = false;
+    state.error = false;
+
+    if(scheduler::is_started()){
+        state.done_lock.claim();
+    }
+
+    {
+        std::lock_guard<int_spinlock> l(port.lock);
+
+        port.active |= 1U << slot;
+
+        if(queued){
+            write_port(p, PORT_SACT, 1U << slot);
+        }
+
+        write_port(p, PORT_CI, 1U << slot);
+    }
+
+    if(scheduler::is_started()){
+        state.done_lock.wait();
+    } else {
+        while(!state.done){
+            complete(p);
+
+            asm volatile ("pause");
+        }
+    }
+
+    bool result = !state.error;
+
+    {
+        std::lock_guard<int_spinlock> l(port.lock);
+
+        port.busy &= ~(1U << slot);
+    }
+
+    port.free_slots.unlock();
+
+    return result;
+}
+
+/*!
+ * \brief Transfer consecutive sectors with a single command
+ * \param count The number of sectors, at most MAX_TRANSFER
+ */
+bool transfer_sectors(ahci::drive_descriptor& drive, uint64_t start, size_t count, void* data, sector_operation operation){
+    auto& port = *ports[drive.port];
+
+    bool write = operation != sector_operation::READ;
+    auto bytes = count * BLOCK_SIZE;
+
+    uint8_t command;
+    if(drive.ncq){
+        command = write ? ATA_WRITE_FPDMA : ATA_READ_FPDMA;
+    } else {
+        command = write ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT;
+    }
+
+    if(operation != sector_operation::CLEAR && reachable(reinterpret_cast<size_t>(data), bytes)){
+        return execute(drive, command, start, count, data, bytes, write);
+    }
+
+    // The bounce buffer is shared by all the commands of the port
+    std::lock_guard<mutex> l(port.bounce_lock);
+
+    if(operation == sector_operation::WRITE){
+        std::copy_n(reinterpret_cast<char*>(data), bytes, port.bounce);
+    } else if(operation == sector_operation::CLEAR){
+        std::fill_n(port.bounce, bytes, 0);
+    }
+
+    if(!execute(drive, command, start, count, port.bounce, bytes, write)){
+        return false;
+    }
+
+    if(operation == sector_operation::READ){
+        std::copy_n(port.bounce, bytes, reinterpret_cast<char*>(data));
+    }
+
+    return true;
+}
+
+void ide_string_into(std::string& destination, uint16_t* info, size_t start, size_t size){
+    char buffer[50];
+
+    //Copy the characters, swapped
+    auto t = reinterpret_cast<char*>(&info[start]);
+    for(size_t i = 0; i < size; i += 2){
+        buffer[i] = t[i + 1];
+        buffer[i + 1] = t[i];
+    }
+
+    //Cleanup the output
+    size_t end = size;
+    while(end > 0 && (buffer[end - 1] <= 32 || buffer[end - 1] >= 127)){
+        --end;
+    }
+
+    buffer[end] = '\0';
+    destination = buffer;
+}
+
+/*!
+ * \brief Allocate the command list and the buffers of a port and start it
+ */
+bool init_port(size_t p){
+    auto ssts = read_port(p, PORT_SSTS);
+
+    // Only the ports with an established link
+    if((ssts & 0xF) != 3 || ((ssts >> 8) & 0xF) != 1){
+        return false;
+    }
+
+    // The ATAPI devices and the port multipliers are not supported
+    if(read_port(p, PORT_SIG) != SATA_SIG_ATA){
+        logging::logf(logging::log_level::TRACE, "ahci: Ignoring device on port %u (signature %h)\n", p, size_t(read_port(p, PORT_SIG)));
+        return false;
+    }
+
+    if(!stop_port(p)){
+        logging::logf(logging::log_level::ERROR, "ahci: Unable to stop port %u\n", p);
+        return false;
+    }
+
+    // The command list and the received FIS share the first page
+    size_t phys;
+    auto virt = allocate_dma(1 + TABLE_PAGES, phys);
+
+    size_t bounce_phys;
+    auto bounce = allocate_dma(BOUNCE_PAGES, bounce_phys);
+
+    if(!virt || !bounce){
+        logging::logf(logging::log_level::ERROR, "ahci: Unable to allocate the buffers of port %u\n", p);
+        return false;
+    }
+
+    auto port = new port_state();
+
+    port->headers = reinterpret_cast<command_header*>(virt);
+    port->tables = reinterpret_cast<command_table*>(virt + paging::PAGE_SIZE);
+    port->bounce = reinterpret_cast<char*>(bounce);
+    port->bounce_lock.init();
+    port->free_slots.init(1);
+
+    for(size_t slot = 0; slot < SLOTS; ++slot){
+        uint64_t table = phys + paging::PAGE_SIZE + slot * sizeof(command_table);
+
+        port->headers[slot].ctba = uint32_t(table);
+        port->headers[slot].ctbau = uint32_t(table >> 32);
+    }
+
+    write_port(p, PORT_CLB, uint32_t(phys));
+    write_port(p, PORT_CLBU, uint32_t(uint64_t(phys) >> 32));
+    write_port(p, PORT_FB, uint32_t(phys + 1024));
+    write_port(p, PORT_FBU, uint32_t(uint64_t(phys + 1024) >> 32));
+
+    write_port(p, PORT_SERR, 0xFFFFFFFF);
+    write_port(p, PORT_IS, 0xFFFFFFFF);
+    write_port(p, PORT_IE, PORT_IS_COMPLETION | PORT_IS_ERRORS);
+
+    ports[p] = port;
+
+    start_port(p);
+
+    return true;
+}
+
+/*!
+ * \brief Identify the disk of a started port
+ */
+bool identify(size_t p, ahci::drive_descriptor& drive){
+    drive.port = p;
+    drive.ncq = false;
+    drive.queue_depth = 1;
+
+    auto info = new uint16_t[256];
+
+    if(!execute(drive, ATA_IDENTIFY, 0, 0, info, 512, false)){
+        logging::logf(logging::log_level::ERROR, "ahci: IDENTIFY failed on port %u\n", p);
+        delete[] info;
+        return false;
+    }
+
+    // All the commands are 48 bits
+    if(!(info[83] & (1 << 10))){
+        logging::logf(logging::log_level::ERROR, "ahci: Disk without LBA48 on port %u\n", p);
+        delete[] info;
+        return false;
+    }
+
+    ide_string_into(drive.model, info, 27, 40);
+    ide_string_into(drive.serial, info, 10, 20);
+    ide_string_into(drive.firmware, info, 23, 8);
+
+    size_t sectors = info[100] | (size_t(info[101]) << 16) | (size_t(info[102]) << 32) | (size_t(info[103]) << 48);
+    drive.size = sectors * BLOCK_SIZE;
+
+    if(ncq_support && (info[76] & (1 << 8))){
+        drive.ncq = true;
+        drive.queue_depth = std::min<size_t>((info[75] & 0x1F) + 1, command_slots);
+    }
+
+    delete[] info;
+
+    ports[p]->free_slots.init(drive.queue_depth);
+
+    logging::logf(logging::log_level::TRACE, "ahci: Identified disk of size %u on port %u (ncq: %u, depth: %u)\n",
+        drive.size, p, size_t(drive.ncq), size_t(drive.queue_depth));
+
+    return true;
+}
+
+/*!
+ * \brief Route the interrupts of the controller, with MSI if possible
+ */
+void init_interrupts(pci::device_descriptor& device){
+    size_t vector;
+
+    if(apic::initialized() && interrupt::register_msi_handler(vector, ahci_handler, nullptr)){
+        if(pci::enable_msi(device.bus, device.device, device.function, vector, apic::id())){
+            logging::logf(logging::log_level::TRACE, "ahci: MSI on vector %u\n", vector);
+            return;
+        }
+
+        interrupt::unregister_msi_handler(vector);
+    }
+
+    auto irq = pci::read_config_byte(device.bus, device.device, device.function, 0x3C);
+
+    if(irq >= 16 || !interrupt::register_irq_handler(irq, ahci_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "ahci: Unable to register IRQ handler %u\n", size_t(irq));
+        return;
+    }
+
+    logging::logf(logging::log_level::TRACE, "ahci: Legacy interrupt on IRQ %u\n", size_t(irq));
+}
+
+bool init_controller(pci::device_descriptor& device){
+    auto bar5 = pci::read_config_dword(device.bus, device.device, device.function, 0x24);
+
+    uint64_t base = bar5 & ~0xF;
+
+    // 64 bits memory BAR
+    if(((bar5 >> 1) & 0x3) == 0x2){
+        base |= uint64_t(pci::read_config_dword(device.bus, device.device, device.function, 0x28)) << 32;
+    }
+
+    auto command_register = pci::read_config_dword(device.bus, device.device, device.function, 0x4);
+    command_register |= 0x6; // Set Memory Space and Bus Mastering Bits
+    pci::write_config_dword(device.bus, device.device, device.function, 0x4, command_register);
+
+    // The registers of the 32 ports follow the global registers
+    auto offset = base & (paging::PAGE_SIZE - 1);
+    auto pages = paging::pages(offset + 0x100 + MAX_PORTS * 0x80);
+
+    auto virt = virtual_allocator::allocate(pages);
+
+    if(!virt || !paging::map_pages(virt, base - offset, pages, paging::PRESENT | paging::WRITE | paging::CACHE_DISABLED)){
+        logging::logf(logging::log_level::ERROR, "ahci: Unable to map the registers\n");
+        return false;
+    }
+
+    hba = reinterpret_cast<volatile char*>(virt + offset);
+
+    write_register(HBA_GHC, read_register(HBA_GHC) | HBA_GHC_AE);
+
+    auto capabilities = read_register(HBA_CAP);
+
+    dma64 = capabilities & HBA_CAP_S64A;
+    ncq_support = capabilities & HBA_CAP_SNCQ;
+    command_slots = ((capabilities >> 8) & 0x1F) + 1;
+
+    logging::logf(logging::log_level::TRACE, "ahci: Controller with %u slots (ncq: %u, 64 bits: %u)\n",
+        command_slots, size_t(ncq_support), size_t(dma64));
+
+    auto implemented = read_register(HBA_PI);
+
+    for(size_t p = 0; p < MAX_PORTS; ++p){
+        if(implemented & (1U << p)){
+            init_port(p);
+        }
+    }
+
+    init_interrupts(device);
+
+    write_register(HBA_IS, 0xFFFFFFFF);
+    write_register(HBA_GHC, read_register(HBA_GHC) | HBA_GHC_IE);
+
+    for(size_t p = 0; p < MAX_PORTS; ++p){
+        if(ports[p]){
+            ahci::drive_descriptor drive;
+
+            if(identify(p, drive)){
+                drives.push_back(drive);
+            }
+        }
+    }
+
+    return true;
+}
+
+} //end of anonymous namespace
+
+void ahci::detect_disks(){
+    for(size_t i = 0; i < pci::number_of_devices(); ++i){
+        auto& device = pci::device(i);
+
+        if(device.class_type != pci::device_class_type::MASS_STORAGE || device.sub_class != 0x6){
+            continue;
+        }
+
+        // Only the AHCI interface of the SATA controllers
+        if(pci::read_config_byte(device.bus, device.device, device.function, 0x9) != 0x1){
+            continue;
+        }
+
+        init_controller(device);
+
+        // A single controller is supported
+        return;
+    }
+}
+
+size_t ahci::number_of_disks(){
+    return drives.size();
+}
+
+ahci::drive_descriptor& ahci::drive(size_t disk){
+    return drives[disk];
+}
+
+size_t ahci::read_sectors(drive_descriptor& drive, uint64_t start, size_t count, void* destination, size_t& read){
+    auto buffer = reinterpret_cast<uint8_t*>(destination);
+
+    for(size_t i = 0; i < count; i += MAX_TRANSFER){
+        auto sectors = std::min(count - i, MAX_TRANSFER);
+
+        if(!transfer_sectors(drive, start + i, sectors, buffer, sector_operation::READ)){
+            return std::ERROR_FAILED;
+        }
+
+        buffer += sectors * BLOCK_SIZE;
+        read += sectors * BLOCK_SIZE;
+    }
+
+    return 0;
+}
+
+size_t ahci::write_sectors(drive_descriptor& drive, uint64_t start, size_t count, const void* source, size_t& written){
+    auto buffer = reinterpret_cast<uint8_t*>(const_cast<void*>(source));
+
+    for(size_t i = 0; i < count; i += MAX_TRANSFER){
+        auto sectors = std::min(count - i, MAX_TRANSFER);
+
+        if(!transfer_sectors(drive, start + i, sectors, buffer, sector_operation::WRITE)){
+            return std::ERROR_FAILED;
+        }
+
+        buffer += sectors * BLOCK_SIZE;
+        written += sectors * BLOCK_SIZE;
+    }
+
+    return 0;
+}
+
+size_t ahci::clear_sectors(drive_descriptor& drive, uint64_t start, size_t count, size_t& written){
+    for(size_t i = 0; i < count; i += MAX_TRANSFER){
+        auto sectors = std::min(count - i, MAX_TRANSFER);
+
+        if(!transfer_sectors(drive, start + i, sectors, nullptr, sector_operation::CLEAR)){
+            return std::ERROR_FAILED;
+        }
+
+        written += sectors * BLOCK_SIZE;
+    }
+
+    return 0;
+}
+
+size_t ahci::ahci_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
+    if(count % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_COUNT;
+    }
+
+    if(offset % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    read = 0;
+
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(descriptor->descriptor);
+
+    return ahci::read_sectors(*disk, offset / BLOCK_SIZE, count / BLOCK_SIZE, destination, read);
+}
+
+size_t ahci::ahci_driver::write(void* data, const char* source, size_t count, size_t offset, size_t& written){
+    if(count % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_COUNT;
+    }
+
+    if(offset % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    written = 0;
+
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(descriptor->descriptor);
+
+    return ahci::write_sectors(*disk, offset / BLOCK_SIZE, count / BLOCK_SIZE, source, written);
+}
+
+size_t ahci::ahci_driver::clear(void* data, size_t count, size_t offset, size_t& written){
+    if(count % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_COUNT;
+    }
+
+    if(offset % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    written = 0;
+
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(descriptor->descriptor);
+
+    return ahci::clear_sectors(*disk, offset / BLOCK_SIZE, count / BLOCK_SIZE, written);
+}
+
+size_t ahci::ahci_driver::size(void* data){
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(descriptor->descriptor);
+
+    return disk->size;
+}
+
+size_t ahci::ahci_part_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
+    if(count % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_COUNT;
+    }
+
+    if(offset % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    read = 0;
+
+    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(part_descriptor->disk->descriptor);
+
+    if(!disks::in_partition(*part_descriptor, offset / BLOCK_SIZE, count / BLOCK_SIZE)){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    return ahci::read_sectors(*disk, part_descriptor->start + offset / BLOCK_SIZE, count / BLOCK_SIZE, destination, read);
+}
+
+size_t ahci::ahci_part_driver::write(void* data, const char* source, size_t count, size_t offset, size_t& written){
+    if(count % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_COUNT;
+    }
+
+    if(offset % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    written = 0;
+
+    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(part_descriptor->disk->descriptor);
+
+    if(!disks::in_partition(*part_descriptor, offset / BLOCK_SIZE, count / BLOCK_SIZE)){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    return ahci::write_sectors(*disk, part_descriptor->start + offset / BLOCK_SIZE, count / BLOCK_SIZE, source, written);
+}
+
+size_t ahci::ahci_part_driver::clear(void* data, size_t count, size_t offset, size_t& written){
+    if(count % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_COUNT;
+    }
+
+    if(offset % BLOCK_SIZE != 0){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    written = 0;
+
+    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
+    auto disk = reinterpret_cast<ahci::drive_descriptor*>(part_descriptor->disk->descriptor);
+
+    if(!disks::in_partition(*part_descriptor, offset / BLOCK_SIZE, count / BLOCK_SIZE)){
+        return std::ERROR_INVALID_OFFSET;
+    }
+
+    return ahci::clear_sectors(*disk, part_descriptor->start + offset / BLOCK_SIZE, count / BLOCK_SIZE, written);
+}
+
+size_t ahci::ahci_part_driver::size(void* data){
+    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
+
+    return part_descriptor->sectors * BLOCK_SIZE;
+}
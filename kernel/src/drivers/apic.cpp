@@ -0,0 +1,292 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+
+#include "drivers/apic.hpp"
+
+#include "conc/int_lock.hpp"
+
+#include "arch.hpp"
+#include "interrupts.hpp"
+#include "logging.hpp"
+#include "mmap.hpp"
+#include "timer.hpp"
+#include "smp.hpp"
+#include "clocksource.hpp"
+#include "cpu_features.hpp"
+
+namespace {
+
+constexpr const uint32_t APIC_BASE_MSR = 0x1B;
+constexpr const uint64_t APIC_BASE_ENABLE = 1 << 11;
+constexpr const uint64_t APIC_BASE_X2APIC = 1 << 10;
+
+constexpr const uint32_t X2APIC_MSR_BASE = 0x800;  ///< The MSR of the first register in x2APIC mode
+constexpr const uint32_t X2APIC_ICR_MSR = 0x830;   ///< The 64-bit ICR in x2APIC mode
+constexpr const uint32_t TSC_DEADLINE_MSR = 0x6E0;
+
+// Offset of the registers inside the local APIC memory
+constexpr const size_t ID_REGISTER = 0x20 / 4;
+constexpr const size_t EOI_REGISTER = 0xB0 / 4;
+constexpr const size_t SPURIOUS_REGISTER = 0xF0 / 4;
+constexpr const size_t ICR_LOW_REGISTER = 0x300 / 4;
+constexpr const size_t ICR_HIGH_REGISTER = 0x310 / 4;
+constexpr const size_t LVT_TIMER_REGISTER = 0x320 / 4;
+constexpr const size_t TIMER_INITIAL_REGISTER = 0x380 / 4;
+constexpr const size_t TIMER_CURRENT_REGISTER = 0x390 / 4;
+constexpr const size_t TIMER_DIVIDE_REGISTER = 0x3E0 / 4;
+
+constexpr const uint32_t SPURIOUS_ENABLE = 1 << 8;
+
+constexpr const uint32_t ICR_FIXED = 0x0 << 8;
+constexpr const uint32_t ICR_INIT = 0x5 << 8;
+constexpr const uint32_t ICR_STARTUP = 0x6 << 8;
+constexpr const uint32_t ICR_DELIVERY_PENDING = 1 << 12;
+constexpr const uint32_t ICR_LEVEL_ASSERT = 1 << 14;
+
+constexpr const uint32_t TIMER_PERIODIC = 1 << 17;
+constexpr const uint32_t TIMER_TSC_DEADLINE = 2 << 17;
+constexpr const uint32_t TIMER_MASKED = 1 << 16;
+constexpr const uint32_t TIMER_DIVIDE_16 = 0x3;
+
+constexpr const uint64_t CALIBRATION_MS = 10;
+
+/*!
+ * \brief The TSC-deadline timer of a processor, re-armed at each interrupt
+ */
+struct deadline_timer {
+    uint64_t period = 0;   ///< The TSC cycles between two interrupts, 0 if the timer is stopped
+    uint64_t deadline = 0; ///< The TSC of the next interrupt
+} __attribute__((aligned(64)));
+
+volatile uint32_t* apic_map = nullptr;
+bool enabled = false;
+bool x2apic = false;       ///< The registers are accessed with MSRs
+bool tsc_deadline = false; ///< The timer supports the TSC-deadline mode
+
+uint64_t timer_ticks_per_ms = 0;
+
+std::array<deadline_timer, smp::MAX_CPUS> deadline_timers;
+
+uint32_t read_register(size_t reg){
+    if(x2apic){
+        // The MSRs are indexed by the register offset divided by 16
+        return arch::read_msr(X2APIC_MSR_BASE + reg / 4);
+    }
+
+    return apic_map[reg];
+}
+
+void write_register(size_t reg, uint32_t value){
+    if(x2apic){
+        arch::write_msr(X2APIC_MSR_BASE + reg / 4, value);
+    } else {
+        apic_map[reg] = value;
+    }
+}
+
+void enable(){
+    // Each processor must be switched to the x2APIC mode
+    if(x2apic){
+        arch::write_msr(APIC_BASE_MSR, arch::read_msr(APIC_BASE_MSR) | APIC_BASE_ENABLE | APIC_BASE_X2APIC);
+    }
+
+    write_register(SPURIOUS_REGISTER, SPURIOUS_ENABLE | interrupt::APIC_SPURIOUS);
+}
+
+void send_command(uint32_t apic_id, uint32_t command){
+    // The ICR must not be written again before the delivery is done
+    direct_int_lock lock;
+
+    if(x2apic){
+        // A single write, the delivery status does not exist anymore
+        arch::write_msr(X2APIC_ICR_MSR, (static_cast<uint64_t>(apic_id) << 32) | command);
+        return;
+    }
+
+    write_register(ICR_HIGH_REGISTER, apic_id << 24);
+    write_register(ICR_LOW_REGISTER, command);
+
+    while(read_register(ICR_LOW_REGISTER) & ICR_DELIVERY_PENDING){
+        arch::pause();
+    }
+}
+
+void calibrate_timer(){
+    write_register(TIMER_DIVIDE_REGISTER, TIMER_DIVIDE_16);
+    write_register(LVT_TIMER_REGISTER, TIMER_MASKED);
+
+    // Measure between two edges of the timer counter
+    auto duration = timer::counter_frequency() * CALIBRATION_MS / 1000;
+    auto edge = timer::counter();
+
+    while(timer::counter() == edge){
+        arch::pause();
+    }
+
+    uint64_t start;
+
+    // The other init tasks must not preempt between the counter and the timer
+    {
+        direct_int_lock lock;
+
+        start = timer::counter();
+        write_register(TIMER_INITIAL_REGISTER, 0xFFFFFFFF);
+    }
+
+    uint64_t end;
+    uint64_t elapsed;
+
+    while(true){
+        direct_int_lock lock;
+
+        end = timer::counter();
+        elapsed = 0xFFFFFFFF - read_register(TIMER_CURRENT_REGISTER);
+
+        if(end - start >= duration){
+            break;
+        }
+    }
+
+    write_register(TIMER_INITIAL_REGISTER, 0);
+
+    timer_ticks_per_ms = (elapsed * timer::counter_frequency()) / ((end - start) * 1000);
+
+    logging::logf(logging::log_level::TRACE, "apic: timer calibrated to %u ticks per ms\n", timer_ticks_per_ms);
+}
+
+/*!
+ * \brief Indicates if the timer should run in TSC-deadline mode, which
+ * needs the TSC frequency from the clock source
+ */
+bool deadline_mode(){
+    return tsc_deadline && clocksource::tsc();
+}
+
+} //End of anonymous namespace
+
+bool apic::init(){
+    auto base = arch::read_msr(APIC_BASE_MSR);
+
+    if(!(base & APIC_BASE_ENABLE)){
+        logging::logf(logging::log_level::TRACE, "apic: local APIC is disabled\n");
+        return false;
+    }
+
+    x2apic = cpu_features::has(tlib::cpu_feature::X2APIC);
+    tsc_deadline = cpu_features::has(tlib::cpu_feature::TSC_DEADLINE);
+
+    if(x2apic){
+        logging::logf(logging::log_level::TRACE, "apic: Using x2APIC mode\n");
+    } else {
+        auto physical = base & ~static_cast<uint64_t>(0xFFF);
+
+        apic_map = static_cast<volatile uint32_t*>(mmap_phys(physical, 0x400));
+
+        if(!apic_map){
+            logging::logf(logging::log_level::ERROR, "apic: Unable to map the local APIC\n");
+            return false;
+        }
+
+        logging::logf(logging::log_level::TRACE, "apic: local APIC at %h\n", physical);
+    }
+
+    enable();
+    enabled = true;
+
+    logging::logf(logging::log_level::TRACE, "apic: local APIC id:%u tsc_deadline:%u\n", size_t(id()), size_t(tsc_deadline));
+
+    calibrate_timer();
+
+    return true;
+}
+
+void apic::init_ap(){
+    // The mapping is shared between all the processors
+    enable();
+}
+
+bool apic::initialized(){
+    return enabled;
+}
+
+uint32_t apic::id(){
+    // The x2APIC id is the whole register
+    if(x2apic){
+        return read_register(ID_REGISTER);
+    }
+
+    return read_register(ID_REGISTER) >> 24;
+}
+
+void apic::eoi(){
+    write_register(EOI_REGISTER, 0);
+}
+
+void apic::send_init(uint32_t apic_id){
+    send_command(apic_id, ICR_INIT | ICR_LEVEL_ASSERT);
+}
+
+void apic::send_startup(uint32_t apic_id, uint8_t page){
+    send_command(apic_id, ICR_STARTUP | ICR_LEVEL_ASSERT | page);
+}
+
+void apic::send_ipi(uint32_t apic_id, size_t irq){
+    send_command(apic_id, ICR_FIXED | (interrupt::APIC_FIRST + irq));
+}
+
+void apic::start_timer(uint64_t frequency){
+    if(deadline_mode()){
+        auto& timer = deadline_timers[smp::current_cpu()];
+
+        write_register(LVT_TIMER_REGISTER, TIMER_TSC_DEADLINE | (interrupt::APIC_FIRST + TIMER_IRQ));
+
+        timer.period = clocksource::tsc_frequency() / frequency;
+        timer.deadline = arch::rdtsc() + timer.period;
+
+        arch::write_msr(TSC_DEADLINE_MSR, timer.deadline);
+
+        return;
+    }
+
+    write_register(TIMER_DIVIDE_REGISTER, TIMER_DIVIDE_16);
+    write_register(LVT_TIMER_REGISTER, TIMER_PERIODIC | (interrupt::APIC_FIRST + TIMER_IRQ));
+    write_register(TIMER_INITIAL_REGISTER, (timer_ticks_per_ms * 1000) / frequency);
+}
+
+void apic::stop_timer(){
+    auto& timer = deadline_timers[smp::current_cpu()];
+
+    if(timer.period){
+        // Writing a zero deadline disarms the timer
+        timer.period = 0;
+        arch::write_msr(TSC_DEADLINE_MSR, 0);
+    }
+
+    // Writing a zero count stops the timer
+    write_register(TIMER_INITIAL_REGISTER, 0);
+}
+
+void apic::timer_interrupt(){
+    auto& timer = deadline_timers[smp::current_cpu()];
+
+    if(!timer.period){
+        return;
+    }
+
+    // The deadlines stay on the period, unless the processor is late
+    auto now = arch::rdtsc();
+
+    timer.deadline += timer.period;
+
+    if(timer.deadline <= now){
+        timer.deadline = now + timer.period;
+    }
+
+    arch::write_msr(TSC_DEADLINE_MSR, timer.deadline);
+}
@@ -6,14 +6,18 @@
 //=======================================================================
 
 #include <lock_guard.hpp>
+#include <array.hpp>
 
 #include <tlib/errors.hpp>
 
 #include "drivers/ata.hpp"
 #include "drivers/ata_constants.hpp"
+#include "drivers/pci.hpp"
 
 #include "conc/mutex.hpp"
+#include "conc/adaptive_mutex.hpp"
 #include "conc/deferred_unique_mutex.hpp"
+#include "conc/semaphore.hpp"
 
 #include "kernel_utils.hpp"
 #include "kalloc.hpp"
@@ -22,14 +26,66 @@
 #include "console.hpp"
 #include "disks.hpp"
 #include "block_cache.hpp"
+#include "request_queue.hpp"
+#include "paging.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+
+#include "fs/sysfs.hpp"
 
 namespace {
 
 static constexpr const size_t BLOCK_SIZE = 512;
+static constexpr const size_t MAX_TRANSFER = 256;            ///< The maximum number of sectors of a command
+static constexpr const size_t MAX_MULTIPLE = 16;             ///< The maximum number of sectors per IRQ
+static constexpr const uint64_t LBA28_SECTORS = 1ULL << 28;  ///< The number of sectors reachable with LBA28
+static constexpr const size_t MIN_CACHE_BLOCKS = 256;       ///< The minimum number of blocks of the cache (128KiB)
+static constexpr const size_t MAX_CACHE_BLOCKS = 16384;     ///< The maximum number of blocks of the cache (8MiB)
+static constexpr const size_t FLUSH_INTERVAL = 1000;        ///< The period of the flusher, in milliseconds
+static constexpr const size_t DIRTY_AGE = 5000;             ///< The age of the dirty blocks written back by the flusher, in milliseconds
+static constexpr const size_t DIRTY_RATIO = 10;             ///< The percentage of dirty blocks after which the flusher writes them all
+static constexpr const size_t DIRTY_LIMIT = 40;             ///< The percentage of dirty blocks after which the writes go to the disk
+
+#ifdef THOR_CONFIG_ATA_WRITE_BACK
+static constexpr const bool WRITE_BACK = true;              ///< Indicates if the small writes are kept in cache
+#else
+static constexpr const bool WRITE_BACK = false;             ///< Indicates if the small writes are kept in cache
+#endif
+
+static constexpr const uint64_t DMA_LIMIT = 1ULL << 32;      ///< The physical memory reachable by the bus master
+
+/*!
+ * \brief An entry of a Physical Region Descriptor table
+ */
+struct prd_entry {
+    uint32_t address; ///< The physical address of the region
+    uint16_t bytes;   ///< The size of the region, 0 for 64KiB
+    uint16_t flags;   ///< PRD_EOT for the last entry
+} __attribute__((packed));
+
+static constexpr const size_t MAX_PRD = paging::PAGE_SIZE / sizeof(prd_entry);       ///< The number of entries of a PRD table
+static constexpr const size_t BOUNCE_PAGES = MAX_TRANSFER * BLOCK_SIZE / paging::PAGE_SIZE; ///< The size of the bounce buffer
+
+/*!
+ * \brief The bus master DMA state of an IDE channel
+ */
+struct dma_channel {
+    uint16_t base;        ///< The I/O port of the bus master registers, 0 without DMA
+    prd_entry* prdt;      ///< The PRD table
+    uint32_t prdt_phys;   ///< The physical address of the PRD table
+    char* bounce;         ///< A physically contiguous buffer of MAX_TRANSFER sectors
+    size_t zeroed;        ///< The number of leading bytes of the bounce buffer known to be zero
+};
+
+std::array<dma_channel, 2> channels;
 
 ata::drive_descriptor* drives;
 
-mutex ata_lock;
+std::array<request_queue, 4> queues; ///< The request queues of the drives
+
+adaptive_mutex ata_lock;
 
 deferred_unique_mutex primary_lock;
 deferred_unique_mutex secondary_lock;
@@ -139,9 +195,41 @@ enum class sector_operation {
     CLEAR
 };
 
-bool read_write_sector(ata::drive_descriptor& drive, uint64_t start, void* data, sector_operation operation){
-    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
+void wait_irq(uint16_t controller){
+    if(controller == ATA_PRIMARY){
+        ata_wait_irq_primary();
+    } else {
+        ata_wait_irq_secondary();
+    }
+}
 
+/*!
+ * \brief Returns the command of the given operation
+ */
+uint8_t sector_command(ata::drive_descriptor& drive, bool ext, sector_operation operation){
+    bool multiple = drive.multiple > 1;
+
+    if(operation == sector_operation::READ){
+        if(ext){
+            return multiple ? ATA_READ_MULTIPLE_EXT : ATA_READ_BLOCK_EXT;
+        }
+
+        return multiple ? ATA_READ_MULTIPLE : ATA_READ_BLOCK;
+    }
+
+    if(ext){
+        return multiple ? ATA_WRITE_MULTIPLE_EXT : ATA_WRITE_BLOCK_EXT;
+    }
+
+    return multiple ? ATA_WRITE_MULTIPLE : ATA_WRITE_BLOCK;
+}
+
+/*!
+ * \brief Select the device and send it a command on consecutive sectors
+ * \param command The command, for LBA28
+ * \param ext_command The command, for LBA48
+ */
+bool send_command(ata::drive_descriptor& drive, uint64_t start, size_t count, uint8_t command, uint8_t ext_command){
     //Select the device
     if(!select_device(drive)){
         return false;
@@ -149,67 +237,363 @@ bool read_write_sector(ata::drive_descriptor& drive, uint64_t start, void* data,
 
     auto controller = drive.controller;
 
-    uint8_t sc = start & 0xFF;
-    uint8_t cl = (start >> 8) & 0xFF;
-    uint8_t ch = (start >> 16) & 0xFF;
-    uint8_t hd = (start >> 24) & 0x0F;
+    // The extended commands are only used past the reach of LBA28
+    bool ext = start + count > LBA28_SECTORS;
 
-    auto command = operation == sector_operation::READ ? ATA_READ_BLOCK : ATA_WRITE_BLOCK;
+    if(ext && !drive.lba48){
+        return false;
+    }
 
     //Process the command
-    out_byte(controller + ATA_NSECTOR, 1);
-    out_byte(controller + ATA_SECTOR, sc);
-    out_byte(controller + ATA_LCYL, cl);
-    out_byte(controller + ATA_HCYL, ch);
-    out_byte(controller + ATA_DRV_HEAD, (1 << 6) | (drive.slave << 4) | hd);
-    out_byte(controller + ATA_COMMAND, command);
-
-    //Wait at most 30 seconds for BSY flag to be cleared
-    if(!wait_for_controller(controller, ATA_STATUS_BSY, 0, 30000)){
-        return false;
+    if(ext){
+        // The high bytes are written first
+        out_byte(controller + ATA_NSECTOR, (count >> 8) & 0xFF);
+        out_byte(controller + ATA_SECTOR, (start >> 24) & 0xFF);
+        out_byte(controller + ATA_LCYL, (start >> 32) & 0xFF);
+        out_byte(controller + ATA_HCYL, (start >> 40) & 0xFF);
+        out_byte(controller + ATA_NSECTOR, count & 0xFF);
+        out_byte(controller + ATA_SECTOR, start & 0xFF);
+        out_byte(controller + ATA_LCYL, (start >> 8) & 0xFF);
+        out_byte(controller + ATA_HCYL, (start >> 16) & 0xFF);
+        out_byte(controller + ATA_DRV_HEAD, (1 << 6) | (drive.slave << 4));
+    } else {
+        // A count of 0 means 256 sectors
+        out_byte(controller + ATA_NSECTOR, count & 0xFF);
+        out_byte(controller + ATA_SECTOR, start & 0xFF);
+        out_byte(controller + ATA_LCYL, (start >> 8) & 0xFF);
+        out_byte(controller + ATA_HCYL, (start >> 16) & 0xFF);
+        out_byte(controller + ATA_DRV_HEAD, (1 << 6) | (drive.slave << 4) | ((start >> 24) & 0x0F));
     }
 
-    //Verify if there are errors
-    if(in_byte(controller + ATA_STATUS) & ATA_STATUS_ERR){
+    out_byte(controller + ATA_COMMAND, ext ? ext_command : command);
+
+    return true;
+}
+
+/*!
+ * \brief Transfer consecutive sectors with a single PIO command.
+ *
+ * The data is moved by blocks of drive.multiple sectors, with one IRQ per
+ * block. The ATA lock must be held.
+ *
+ * \param count The number of sectors, at most MAX_TRANSFER
+ */
+bool pio_transfer(ata::drive_descriptor& drive, uint64_t start, size_t count, void* data, sector_operation operation){
+    auto controller = drive.controller;
+
+    if(!send_command(drive, start, count, sector_command(drive, false, operation), sector_command(drive, true, operation))){
         return false;
     }
 
+    size_t block_sectors = drive.multiple > 1 ? drive.multiple : 1;
+
     uint16_t* buffer = reinterpret_cast<uint16_t*>(data);
 
-    if(operation == sector_operation::WRITE){
-        //Send the data to the controller
-        for(int i = 0; i < 256; ++i){
-            out_word(controller + ATA_DATA, *buffer++);
+    for(size_t done = 0; done < count; done += block_sectors){
+        auto words = std::min(block_sectors, count - done) * (BLOCK_SIZE / 2);
+
+        if(operation == sector_operation::READ){
+            //Wait at most 30 seconds for BSY flag to be cleared
+            if(!wait_for_controller(controller, ATA_STATUS_BSY, 0, 30000)){
+                return false;
+            }
+
+            //Wait the IRQ of the block
+            wait_irq(controller);
+
+            if(in_byte(controller + ATA_STATUS) & ATA_STATUS_ERR){
+                return false;
+            }
+
+            //Read the disk sectors of the block
+            for(size_t i = 0; i < words; ++i){
+                *buffer++ = in_word(controller + ATA_DATA);
+            }
+        } else {
+            //Wait at most 30 seconds for the controller to request the data
+            if(!wait_for_controller(controller, ATA_STATUS_BSY | ATA_STATUS_DRQ, ATA_STATUS_DRQ, 30000)){
+                return false;
+            }
+
+            if(in_byte(controller + ATA_STATUS) & ATA_STATUS_ERR){
+                return false;
+            }
+
+            //Send the data of the block to the controller
+            if(operation == sector_operation::WRITE){
+                for(size_t i = 0; i < words; ++i){
+                    out_word(controller + ATA_DATA, *buffer++);
+                }
+            } else {
+                for(size_t i = 0; i < words; ++i){
+                    out_word(controller + ATA_DATA, 0);
+                }
+            }
+
+            //Wait the IRQ of the block
+            wait_irq(controller);
+
+            //The device can report an error after the IRQ
+            if(in_byte(controller + ATA_STATUS) & ATA_STATUS_ERR){
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Returns the DMA state of the channel of the given drive
+ */
+dma_channel& channel_of(const ata::drive_descriptor& drive){
+    return channels[drive.controller == ATA_PRIMARY ? 0 : 1];
+}
+
+/*!
+ * \brief Describe the given buffer in the PRD table of the channel
+ * \return false if the buffer cannot be reached by the bus master
+ */
+bool build_prd(dma_channel& channel, size_t virt, size_t bytes){
+    size_t entries = 0;
+
+    while(bytes){
+        auto phys = paging::physical_address(virt);
+        auto chunk = std::min(bytes, paging::PAGE_SIZE - (virt & (paging::PAGE_SIZE - 1)));
+
+        // The buffers of the user space are not mapped in the kernel tables
+        if(!phys || (phys & 1) || phys + chunk > DMA_LIMIT){
+            return false;
         }
-    } else if(operation == sector_operation::CLEAR){
-        //Send the data to the controller
-        for(int i = 0; i < 256; ++i){
-            out_word(controller + ATA_DATA, 0);
+
+        // A region can span contiguous pages, but not a 64KiB boundary
+        bool merge = false;
+        if(entries){
+            auto& last = channel.prdt[entries - 1];
+            size_t last_bytes = last.bytes ? last.bytes : 0x10000;
+
+            if(last.address + last_bytes == phys && (last.address >> 16) == ((phys + chunk - 1) >> 16)){
+                last.bytes = (last_bytes + chunk) & 0xFFFF;
+                merge = true;
+            }
         }
+
+        if(!merge){
+            if(entries == MAX_PRD){
+                return false;
+            }
+
+            channel.prdt[entries++] = {uint32_t(phys), uint16_t(chunk), 0};
+        }
+
+        virt += chunk;
+        bytes -= chunk;
     }
 
-    //Wait the IRQ to happen
-    if(controller == ATA_PRIMARY){
-        ata_wait_irq_primary();
-    } else {
-        ata_wait_irq_secondary();
+    channel.prdt[entries - 1].flags = PRD_EOT;
+
+    return true;
+}
+
+/*!
+ * \brief Transfer consecutive sectors with a single bus master DMA command.
+ *
+ * The caller buffer is given directly to the controller when it is reachable,
+ * otherwise the data goes through the bounce buffer of the channel. The ATA
+ * lock must be held.
+ *
+ * \param count The number of sectors, at most MAX_TRANSFER
+ */
+bool dma_transfer(ata::drive_descriptor& drive, uint64_t start, size_t count, void* data, sector_operation operation){
+    auto& channel = channel_of(drive);
+
+    auto bytes = count * BLOCK_SIZE;
+    bool read = operation == sector_operation::READ;
+
+    bool bounce = operation == sector_operation::CLEAR || !build_prd(channel, reinterpret_cast<size_t>(data), bytes);
+
+    if(bounce){
+        if(operation == sector_operation::CLEAR){
+            // The zeros stay in the buffer from one clear to the next
+            if(channel.zeroed < bytes){
+                std::fill_n(channel.bounce + channel.zeroed, bytes - channel.zeroed, 0);
+                channel.zeroed = bytes;
+            }
+        } else {
+            channel.zeroed = 0;
+
+            if(operation == sector_operation::WRITE){
+                std::copy_n(reinterpret_cast<char*>(data), bytes, channel.bounce);
+            }
+        }
+
+        build_prd(channel, reinterpret_cast<size_t>(channel.bounce), bytes);
     }
 
-    //The device can report an error after the IRQ
-    if(in_byte(controller + ATA_STATUS) & ATA_STATUS_ERR){
+    auto base = channel.base;
+    uint8_t direction = read ? BM_CMD_READ : 0;
+
+    out_dword(base + BM_PRDT, channel.prdt_phys);
+    out_byte(base + BM_COMMAND, direction);
+
+    //Clear the error and interrupt bits, by writing them
+    out_byte(base + BM_STATUS, in_byte(base + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_IRQ);
+
+    if(!send_command(drive, start, count, read ? ATA_READ_DMA : ATA_WRITE_DMA, read ? ATA_READ_DMA_EXT : ATA_WRITE_DMA_EXT)){
         return false;
     }
 
-    if(operation == sector_operation::READ){
-        //Read the disk sectors
-        for(int i = 0; i < 256; ++i){
-            *buffer++ = in_word(controller + ATA_DATA);
+    out_byte(base + BM_COMMAND, direction | BM_CMD_START);
+
+    //Wait the IRQ of the end of the transfer
+    wait_irq(drive.controller);
+
+    auto bm_status = in_byte(base + BM_STATUS);
+    out_byte(base + BM_COMMAND, direction);
+
+    //Reading the status acknowledges the interrupt of the device
+    auto status = in_byte(drive.controller + ATA_STATUS);
+    out_byte(base + BM_STATUS, bm_status | BM_STATUS_ERR | BM_STATUS_IRQ);
+
+    if((bm_status & BM_STATUS_ERR) || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))){
+        return false;
+    }
+
+    if(bounce && read){
+        std::copy_n(channel.bounce, bytes, reinterpret_cast<char*>(data));
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Transfer consecutive sectors, by DMA when the drive supports it.
+ *
+ * A drive is switched to PIO after a failed DMA transfer. The ATA lock must
+ * be held.
+ *
+ * \param count The number of sectors, at most MAX_TRANSFER
+ */
+bool transfer_sectors(ata::drive_descriptor& drive, uint64_t start, size_t count, void* data, sector_operation operation){
+    if(drive.dma){
+        if(dma_transfer(drive, start, count, data, operation)){
+            return true;
         }
+
+        logging::logf(logging::log_level::WARNING, "ata: DMA transfer failed, falling back to PIO\n");
+
+        drive.dma = false;
+    }
+
+    return pio_transfer(drive, start, count, data, operation);
+}
+
+/*!
+ * \brief Allocate the PRD table and the bounce buffer of a channel
+ */
+bool init_channel(dma_channel& channel, uint16_t base){
+    auto pages = 1 + BOUNCE_PAGES;
+
+    auto phys = physical_allocator::allocate(pages);
+
+    if(!phys){
+        return false;
+    }
+
+    // The PRD table holds 32 bits addresses
+    if(phys + pages * paging::PAGE_SIZE > DMA_LIMIT){
+        physical_allocator::free(phys, pages);
+        return false;
+    }
+
+    auto virt = virtual_allocator::allocate(pages);
+
+    if(!virt || !paging::map_pages(virt, phys, pages)){
+        physical_allocator::free(phys, pages);
+        return false;
     }
 
+    channel.base = base;
+    channel.prdt = reinterpret_cast<prd_entry*>(virt);
+    channel.prdt_phys = phys;
+    channel.bounce = reinterpret_cast<char*>(virt + paging::PAGE_SIZE);
+    channel.zeroed = 0;
+
     return true;
 }
 
+/*!
+ * \brief Find the bus master of the IDE controller on the PCI bus
+ */
+void init_dma(){
+    for(size_t i = 0; i < pci::number_of_devices(); ++i){
+        auto& device = pci::device(i);
+
+        if(device.class_type != pci::device_class_type::MASS_STORAGE || device.sub_class != 0x1){
+            continue;
+        }
+
+        auto prog_if = pci::read_config_byte(device.bus, device.device, device.function, 0x9);
+
+        // The driver only knows the legacy ports and IRQs of the compatibility mode
+        if(!(prog_if & 0x80) || (prog_if & 0x5)){
+            logging::logf(logging::log_level::TRACE, "ata: IDE controller not usable for DMA\n");
+            continue;
+        }
+
+        auto bar4 = pci::read_config_dword(device.bus, device.device, device.function, 0x20);
+
+        if(!(bar4 & 0x1)){
+            continue;
+        }
+
+        uint16_t base = bar4 & ~0x3;
+
+        auto command_register = pci::read_config_dword(device.bus, device.device, device.function, 0x4);
+        command_register |= 0x4; // Set Bus Mastering Bit
+        pci::write_config_dword(device.bus, device.device, device.function, 0x4, command_register);
+
+        if(!init_channel(channels[0], base) || !init_channel(channels[1], base + 8)){
+            logging::logf(logging::log_level::ERROR, "ata: Unable to allocate the DMA buffers\n");
+            channels[0].base = 0;
+            channels[1].base = 0;
+            return;
+        }
+
+        logging::logf(logging::log_level::TRACE, "ata: Bus master DMA at %h\n", size_t(base));
+
+        return;
+    }
+}
+
+/*!
+ * \brief Enable the transfers of several sectors per IRQ
+ */
+void set_multiple_mode(ata::drive_descriptor& drive, uint8_t max_sectors){
+    drive.multiple = 0;
+
+    if(max_sectors < 2){
+        return;
+    }
+
+    auto sectors = std::min<uint8_t>(max_sectors, MAX_MULTIPLE);
+
+    out_byte(drive.controller + ATA_NSECTOR, sectors);
+    out_byte(drive.controller + ATA_COMMAND, ATA_SET_MULTIPLE);
+
+    //The interrupts are disabled during the identification
+    if(!wait_for_controller(drive.controller, ATA_STATUS_BSY, 0, 30000)){
+        return;
+    }
+
+    if(in_byte(drive.controller + ATA_STATUS) & ATA_STATUS_ERR){
+        logging::logf(logging::log_level::DEBUG, "ata: SET MULTIPLE MODE rejected\n");
+        return;
+    }
+
+    drive.multiple = sectors;
+}
+
 bool reset_controller(uint16_t controller){
     out_byte(controller + ATA_DEV_CTL, ATA_CTL_SRST);
 
@@ -332,64 +716,172 @@ void identify(ata::drive_descriptor& drive){
         info[b] = in_word(drive.controller + ATA_DATA);
     }
 
-    //INFO: LBA and DMA feature can be tested here
-
     ide_string_into(drive.model, info, 27, 40);
     ide_string_into(drive.serial, info, 10, 20);
     ide_string_into(drive.firmware, info, 23, 8);
 
-    // Get the size of the disk
-    size_t sectors = *reinterpret_cast<uint32_t*>(reinterpret_cast<size_t>(&info[0]) + 114);
+    // Get the size of the disk, from the LBA48 count if supported
+    drive.lba48 = info[83] & (1 << 10);
+
+    size_t sectors;
+    if(drive.lba48){
+        sectors = info[100] | (size_t(info[101]) << 16) | (size_t(info[102]) << 32) | (size_t(info[103]) << 48);
+    } else {
+        sectors = info[60] | (size_t(info[61]) << 16);
+    }
+
     drive.size = sectors * BLOCK_SIZE;
 
-    logging::logf(logging::log_level::TRACE, "ata: Identified disk of size: %u \n", drive.size);
+    if(!drive.atapi){
+        set_multiple_mode(drive, info[47] & 0xFF);
+
+        // The transfer modes are left as configured by the firmware
+        drive.dma = channel_of(drive).base && (info[49] & (1 << 8));
+    }
+
+    logging::logf(logging::log_level::TRACE, "ata: Identified disk of size: %u (lba48: %u, multiple: %u, dma: %u)\n", drive.size, size_t(drive.lba48), size_t(drive.multiple), size_t(drive.dma));
 }
 
-} //end of anonymous namespace
+/*!
+ * \brief Write back dirty blocks of the cache, with the ATA lock held
+ */
+bool cache_writer(void*, uint16_t device, uint64_t sector, const char* buffer, size_t blocks){
+    for(uint8_t i = 0; i < 4; ++i){
+        auto& drive = drives[i];
 
-void ata::detect_disks(){
-    ata_lock.init();
+        if(((drive.controller << 8) + drive.drive) == device){
+            return transfer_sectors(drive, sector, blocks, const_cast<char*>(buffer), sector_operation::WRITE);
+        }
+    }
 
-    // Init the cache with 256 blocks
-    cache.init(BLOCK_SIZE, 256);
+    return false;
+}
 
-    drives = new drive_descriptor[4];
+/*!
+ * \brief Indicates if a write of the given number of sectors is only done in cache
+ */
+bool write_in_cache(size_t count){
+    // The large writes and the writes past the dirty limit go to the disk
+    return WRITE_BACK && count <= MAX_TRANSFER && cache.dirty_blocks() * 100 < cache.capacity() * DIRTY_LIMIT;
+}
 
-    drives[0] = {ATA_PRIMARY, 0xE0, false, MASTER_BIT, false, "", "", "", 0};
-    drives[1] = {ATA_PRIMARY, 0xF0, false, SLAVE_BIT, false, "", "", "", 0};
-    drives[2] = {ATA_SECONDARY, 0xE0, false, MASTER_BIT, false, "", "", "", 0};
-    drives[3] = {ATA_SECONDARY, 0xF0, false, SLAVE_BIT, false, "", "", "", 0};
+/*!
+ * \brief Periodically write back the old dirty blocks
+ */
+void flusher_task(){
+    while(true){
+        scheduler::sleep_ms(FLUSH_INTERVAL);
 
-    out_byte(ATA_PRIMARY + ATA_DEV_CTL, ATA_CTL_nIEN);
-    out_byte(ATA_SECONDARY + ATA_DEV_CTL, ATA_CTL_nIEN);
+        std::lock_guard<decltype(ata_lock)> lock(ata_lock);
 
-    for(uint8_t i = 0; i < 4; ++i){
-        auto& drive = drives[i];
+        // Past the ratio, the dirty blocks are written regardless of their age
+        if(cache.dirty_blocks() * 100 >= cache.capacity() * DIRTY_RATIO){
+            cache.flush(~uint64_t(0));
+        } else {
+            auto now = timer::milliseconds();
+
+            if(now > DIRTY_AGE){
+                cache.flush(now - DIRTY_AGE);
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Returns the number of blocks of the cache, set at build time with
+ * THOR_CONFIG_BLOCK_CACHE_BLOCKS or scaled with the memory
+ */
+size_t cache_blocks(){
+#ifdef THOR_CONFIG_BLOCK_CACHE_BLOCKS
+    return THOR_CONFIG_BLOCK_CACHE_BLOCKS;
+#else
+    // 1/256th of the memory
+    auto blocks = physical_allocator::available() / 256 / BLOCK_SIZE;
+
+    return std::min(std::max(blocks, MIN_CACHE_BLOCKS), MAX_CACHE_BLOCKS);
+#endif
+}
+
+std::string sysfs_cache_blocks(void*){
+    return std::to_string(cache.capacity());
+}
 
-        identify(drive);
+size_t sysfs_set_cache_blocks(void*, const std::string& value){
+    if(value.empty()){
+        return std::ERROR_INVALID_REQUEST;
     }
 
-    out_byte(ATA_PRIMARY + ATA_DEV_CTL, 0);
-    out_byte(ATA_SECONDARY + ATA_DEV_CTL, 0);
+    size_t blocks = 0;
 
-    if(!interrupt::register_irq_handler(14, primary_controller_handler, nullptr)){
-        logging::logf(logging::log_level::ERROR, "ata: Unable to register IRQ handler 14\n");
+    for(auto c : value){
+        if(c < '0' || c > '9'){
+            return std::ERROR_INVALID_REQUEST;
+        }
+
+        blocks = blocks * 10 + (c - '0');
     }
 
-    if(!interrupt::register_irq_handler(15, secondary_controller_handler, nullptr)){
-        logging::logf(logging::log_level::ERROR, "ata: Unable to register IRQ handler 15\n");
+    if(blocks < MIN_CACHE_BLOCKS || blocks > MAX_CACHE_BLOCKS){
+        return std::ERROR_INVALID_REQUEST;
     }
+
+    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
+
+    return cache.resize(blocks) ? 0 : std::ERROR_FAILED;
 }
 
-uint8_t ata::number_of_disks(){
-    return 4;
+/*!
+ * \brief Execute a transfer of the request queue of the drive
+ */
+size_t queue_handler(void* data, block_operation operation, uint64_t sector, size_t count, char* buffer, size_t& transferred){
+    auto& drive = *reinterpret_cast<ata::drive_descriptor*>(data);
+
+    switch(operation){
+        case block_operation::READ:
+            return ata::read_sectors(drive, sector, count, buffer, transferred);
+        case block_operation::WRITE:
+            return ata::write_sectors(drive, sector, count, buffer, transferred);
+        case block_operation::CLEAR:
+            return ata::clear_sectors(drive, sector, count, transferred);
+    }
+
+    return std::ERROR_FAILED;
 }
 
-ata::drive_descriptor& ata::drive(uint8_t disk){
-    return drives[disk];
+/*!
+ * \brief Indicates if all the given sectors are in the cache
+ */
+bool cached(ata::drive_descriptor& drive, uint64_t start, size_t count){
+    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
+
+    auto device = (drive.controller << 8) + drive.drive;
+
+    for(size_t i = 0; i < count; ++i){
+        if(!cache.contains(device, start + i)){
+            return false;
+        }
+    }
+
+    return true;
 }
 
-size_t ata::ata_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
+/*!
+ * \brief Execute a transfer of the devices, through the request queue of the
+ * drive unless the sectors are read from the cache
+ */
+size_t transfer(ata::drive_descriptor& drive, block_operation operation, uint64_t start, size_t count, char* buffer, size_t& transferred){
+    if(operation == block_operation::READ && cached(drive, start, count)){
+        return ata::read_sectors(drive, start, count, buffer, transferred);
+    }
+
+    return queues[&drive - drives].execute(operation, start, count, buffer, transferred);
+}
+
+/*!
+ * \brief Transfer sectors of a partition, the offset is relative to the
+ * start of the partition
+ */
+size_t part_transfer(void* data, block_operation operation, size_t count, size_t offset, char* buffer, size_t& transferred){
     if(count % BLOCK_SIZE != 0){
         return std::ERROR_INVALID_COUNT;
     }
@@ -398,65 +890,139 @@ size_t ata::ata_driver::read(void* data, char* destination, size_t count, size_t
         return std::ERROR_INVALID_OFFSET;
     }
 
-    read = 0;
+    transferred = 0;
+
+    auto& partition = *reinterpret_cast<disks::partition_descriptor*>(data);
+    auto& disk = *reinterpret_cast<ata::drive_descriptor*>(partition.disk->descriptor);
 
     auto sectors = count / BLOCK_SIZE;
     auto start = offset / BLOCK_SIZE;
 
-    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
-    auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
+    if(!disks::in_partition(partition, start, sectors)){
+        return std::ERROR_INVALID_OFFSET;
+    }
 
-    return ata::read_sectors(*disk, start, sectors, destination, read);
+    return transfer(disk, operation, partition.start + start, sectors, buffer, transferred);
 }
 
-size_t ata::ata_driver::write(void* data, const char* source, size_t count, size_t offset, size_t& written){
-    if(count % BLOCK_SIZE != 0){
-        return std::ERROR_INVALID_COUNT;
+semaphore probed; ///< The number of channels identified
+
+/*!
+ * \brief Identify the two drives of an IDE channel
+ */
+void probe_channel(void* data){
+    auto channel = reinterpret_cast<size_t>(data);
+    auto controller = channel ? ATA_SECONDARY : ATA_PRIMARY;
+
+    auto start = timer::milliseconds();
+
+    out_byte(controller + ATA_DEV_CTL, ATA_CTL_nIEN);
+
+    identify(drives[2 * channel]);
+    identify(drives[2 * channel + 1]);
+
+    out_byte(controller + ATA_DEV_CTL, 0);
+
+    logging::logf(logging::log_level::DEBUG, "ata: channel %u identified in %ums\n", channel, timer::milliseconds() - start);
+
+    probed.unlock();
+
+    scheduler::kill_current_process();
+}
+
+} //end of anonymous namespace
+
+void ata::detect_disks(){
+    ata_lock.init();
+    ata_lock.set_name("ata");
+    ata_lock.export_stats("ata");
+
+    cache.init(BLOCK_SIZE, cache_blocks());
+    cache.export_stats("ata");
+    cache.set_writer(&cache_writer, nullptr, MAX_TRANSFER);
+
+    sysfs::set_writable_value_data(path("/sys"), path("/ata/cache_blocks"), &sysfs_cache_blocks, &sysfs_set_cache_blocks, nullptr);
+
+    init_dma();
+
+    drives = new drive_descriptor[4];
+
+    drives[0] = {ATA_PRIMARY, 0xE0, false, MASTER_BIT, false, "", "", "", 0, false, 0, false};
+    drives[1] = {ATA_PRIMARY, 0xF0, false, SLAVE_BIT, false, "", "", "", 0, false, 0, false};
+    drives[2] = {ATA_SECONDARY, 0xE0, false, MASTER_BIT, false, "", "", "", 0, false, 0, false};
+    drives[3] = {ATA_SECONDARY, 0xF0, false, SLAVE_BIT, false, "", "", "", 0, false, 0, false};
+
+    if(!interrupt::register_irq_handler(14, primary_controller_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "ata: Unable to register IRQ handler 14\n");
     }
 
-    if(offset % BLOCK_SIZE != 0){
-        return std::ERROR_INVALID_OFFSET;
+    if(!interrupt::register_irq_handler(15, secondary_controller_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "ata: Unable to register IRQ handler 15\n");
     }
 
-    written = 0;
+    //Each channel is identified by its own task, a missing or slow channel
+    //does not delay the other one
+    probed.init(0);
 
-    auto sectors = count / BLOCK_SIZE;
-    auto start = offset / BLOCK_SIZE;
+    for(size_t channel = 0; channel < 2; ++channel){
+        auto* user_stack = new char[scheduler::user_stack_size];
+        auto* kernel_stack = new char[scheduler::kernel_stack_size];
 
-    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
-    auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
+        auto& process = scheduler::create_kernel_task_args("ata_probe", user_stack, kernel_stack, &probe_channel, reinterpret_cast<void*>(channel));
+        process.ppid = 1;
+        process.priority = scheduler::DEFAULT_PRIORITY;
 
-    return ata::write_sectors(*disk, start, sectors, source, written);
+        scheduler::queue_system_process(process.pid);
+    }
 }
 
-size_t ata::ata_driver::clear(void* data, size_t count, size_t offset, size_t& written){
-    if(count % BLOCK_SIZE != 0){
-        return std::ERROR_INVALID_COUNT;
+void ata::wait_disks(){
+    probed.lock();
+    probed.lock();
+
+    for(uint8_t i = 0; i < 4; ++i){
+        if(drives[i].present){
+            queues[i].init(std::string("ata") + std::to_string(size_t(i)), &queue_handler, &drives[i], BLOCK_SIZE, MAX_TRANSFER);
+        }
     }
+}
 
-    if(offset % BLOCK_SIZE != 0){
-        return std::ERROR_INVALID_OFFSET;
+void ata::finalize(){
+    for(size_t i = 0; i < 4; ++i){
+        if(drives[i].present){
+            queues[i].start();
+        }
     }
 
-    written = 0;
+    if(!WRITE_BACK){
+        return;
+    }
 
-    auto sectors = count / BLOCK_SIZE;
-    auto start = offset / BLOCK_SIZE;
+    auto* user_stack = new char[scheduler::user_stack_size];
+    auto* kernel_stack = new char[scheduler::kernel_stack_size];
 
-    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
-    auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
+    auto& process = scheduler::create_kernel_task("ata_flusher", user_stack, kernel_stack, &flusher_task);
+    process.ppid = 1;
+    process.priority = scheduler::DEFAULT_PRIORITY;
 
-    return ata::clear_sectors(*disk, start, sectors, written);
+    scheduler::queue_system_process(process.pid);
 }
 
-size_t ata::ata_driver::size(void* data){
-    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
-    auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
+bool ata::sync(){
+    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
 
-    return disk->size;
+    return cache.flush(~uint64_t(0));
 }
 
-size_t ata::ata_part_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
+uint8_t ata::number_of_disks(){
+    return 4;
+}
+
+ata::drive_descriptor& ata::drive(uint8_t disk){
+    return drives[disk];
+}
+
+size_t ata::ata_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
     if(count % BLOCK_SIZE != 0){
         return std::ERROR_INVALID_COUNT;
     }
@@ -470,16 +1036,13 @@ size_t ata::ata_part_driver::read(void* data, char* destination, size_t count, s
     auto sectors = count / BLOCK_SIZE;
     auto start = offset / BLOCK_SIZE;
 
-    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
-    auto descriptor = part_descriptor->disk;
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
     auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
 
-    start += part_descriptor->start;
-
-    return ata::read_sectors(*disk, start, sectors, destination, read);
+    return transfer(*disk, block_operation::READ, start, sectors, destination, read);
 }
 
-size_t ata::ata_part_driver::write(void* data, const char* source, size_t count, size_t offset, size_t& written){
+size_t ata::ata_driver::write(void* data, const char* source, size_t count, size_t offset, size_t& written){
     if(count % BLOCK_SIZE != 0){
         return std::ERROR_INVALID_COUNT;
     }
@@ -493,16 +1056,13 @@ size_t ata::ata_part_driver::write(void* data, const char* source, size_t count,
     auto sectors = count / BLOCK_SIZE;
     auto start = offset / BLOCK_SIZE;
 
-    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
-    auto descriptor = part_descriptor->disk;
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
     auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
 
-    start += part_descriptor->start;
-
-    return ata::write_sectors(*disk, start, sectors, source, written);
+    return transfer(*disk, block_operation::WRITE, start, sectors, const_cast<char*>(source), written);
 }
 
-size_t ata::ata_part_driver::clear(void* data, size_t count, size_t offset, size_t& written){
+size_t ata::ata_driver::clear(void* data, size_t count, size_t offset, size_t& written){
     if(count % BLOCK_SIZE != 0){
         return std::ERROR_INVALID_COUNT;
     }
@@ -516,72 +1076,153 @@ size_t ata::ata_part_driver::clear(void* data, size_t count, size_t offset, size
     auto sectors = count / BLOCK_SIZE;
     auto start = offset / BLOCK_SIZE;
 
-    auto part_descriptor = reinterpret_cast<disks::partition_descriptor*>(data);
-    auto descriptor = part_descriptor->disk;
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
     auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
 
-    start += part_descriptor->start;
+    return transfer(*disk, block_operation::CLEAR, start, sectors, nullptr, written);
+}
+
+size_t ata::ata_driver::size(void* data){
+    auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
+    auto disk = reinterpret_cast<ata::drive_descriptor*>(descriptor->descriptor);
 
-    return ata::clear_sectors(*disk, start, sectors, written);
+    return disk->size;
 }
 
-size_t ata::read_sectors(drive_descriptor& drive, uint64_t start, uint8_t count, void* destination, size_t& read){
+size_t ata::ata_part_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
+    return part_transfer(data, block_operation::READ, count, offset, destination, read);
+}
+
+size_t ata::ata_part_driver::write(void* data, const char* source, size_t count, size_t offset, size_t& written){
+    return part_transfer(data, block_operation::WRITE, count, offset, const_cast<char*>(source), written);
+}
+
+size_t ata::ata_part_driver::clear(void* data, size_t count, size_t offset, size_t& written){
+    return part_transfer(data, block_operation::CLEAR, count, offset, nullptr, written);
+}
+
+size_t ata::read_sectors(drive_descriptor& drive, uint64_t start, size_t count, void* destination, size_t& read){
+    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
+
     auto buffer = reinterpret_cast<uint8_t*>(destination);
+    auto device = (drive.controller << 8) + drive.drive;
 
-    for(size_t i = 0; i < count; ++i){
-        bool valid;
-        auto block = cache.block((drive.controller << 8) + drive.drive, start + i, valid);
+    size_t i = 0;
+    while(i < count){
+        auto block = cache.block_if_present(device, start + i);
 
-        if(!valid){
-            if(!read_write_sector(drive, start + i, block, sector_operation::READ)){
-                return std::ERROR_FAILED;
-            }
+        if(block){
+            // Copy the block to the output buffer
+            std::copy_n(block, BLOCK_SIZE, buffer);
+
+            buffer += BLOCK_SIZE;
+            read += BLOCK_SIZE;
+            ++i;
+
+            continue;
+        }
+
+        // Merge the following sectors missing from the cache in one command
+        size_t sectors = 1;
+        while(i + sectors < count && sectors < MAX_TRANSFER && !cache.contains(device, start + i + sectors)){
+            ++sectors;
         }
 
-        // Copy the block to the output buffer
-        std::copy_n(block, BLOCK_SIZE, buffer);
+        if(!transfer_sectors(drive, start + i, sectors, buffer, sector_operation::READ)){
+            return std::ERROR_FAILED;
+        }
 
-        buffer += BLOCK_SIZE;
-        read += BLOCK_SIZE;
+        for(size_t j = 0; j < sectors; ++j){
+            bool valid;
+            auto block = cache.block(device, start + i + j, valid);
+            std::copy_n(buffer, BLOCK_SIZE, block);
+
+            buffer += BLOCK_SIZE;
+            read += BLOCK_SIZE;
+        }
+
+        i += sectors;
     }
 
     return 0;
 }
 
-size_t ata::write_sectors(drive_descriptor& drive, uint64_t start, uint8_t count, const void* source, size_t& written){
+size_t ata::write_sectors(drive_descriptor& drive, uint64_t start, size_t count, const void* source, size_t& written){
+    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
+
     auto buffer = reinterpret_cast<uint8_t*>(const_cast<void*>(source));
+    auto device = (drive.controller << 8) + drive.drive;
+
+    // The small writes are only done in cache, the flusher writes them back
+    if(write_in_cache(count)){
+        for(size_t j = 0; j < count; ++j){
+            bool valid;
+            auto block = cache.block(device, start + j, valid);
+            std::copy_n(buffer + j * BLOCK_SIZE, BLOCK_SIZE, block);
+            cache.mark_dirty(device, start + j);
+        }
 
-    for(size_t i = 0; i < count; ++i){
-        // If the block is in cache, simply update the cache and write through the disk
-        auto block = cache.block_if_present((drive.controller << 8) + drive.drive, start + i);
-        if(block){
-            std::copy_n(buffer, BLOCK_SIZE, block);
+        written += count * BLOCK_SIZE;
+
+        return 0;
+    }
+
+    for(size_t i = 0; i < count; i += MAX_TRANSFER){
+        auto sectors = std::min(count - i, MAX_TRANSFER);
+
+        // If the blocks are in cache, simply update the cache and write through the disk
+        for(size_t j = 0; j < sectors; ++j){
+            auto block = cache.block_if_present(device, start + i + j);
+            if(block){
+                std::copy_n(buffer + j * BLOCK_SIZE, BLOCK_SIZE, block);
+            }
         }
 
-        if(!read_write_sector(drive, start + i, buffer, sector_operation::WRITE)){
+        if(!transfer_sectors(drive, start + i, sectors, buffer, sector_operation::WRITE)){
             return std::ERROR_FAILED;
         }
 
-        buffer += BLOCK_SIZE;
-        written += BLOCK_SIZE;
+        buffer += sectors * BLOCK_SIZE;
+        written += sectors * BLOCK_SIZE;
     }
 
     return 0;
 }
 
-size_t ata::clear_sectors(drive_descriptor& drive, uint64_t start, uint8_t count, size_t& written){
-    for(size_t i = 0; i < count; ++i){
-        // If the block is in cache, simply update the cache and write through the disk
-        auto block = cache.block_if_present((drive.controller << 8) + drive.drive, start + i);
-        if(block){
+size_t ata::clear_sectors(drive_descriptor& drive, uint64_t start, size_t count, size_t& written){
+    std::lock_guard<decltype(ata_lock)> lock(ata_lock);
+
+    auto device = (drive.controller << 8) + drive.drive;
+
+    if(write_in_cache(count)){
+        for(size_t j = 0; j < count; ++j){
+            bool valid;
+            auto block = cache.block(device, start + j, valid);
             std::fill_n(block, BLOCK_SIZE, 0);
+            cache.mark_dirty(device, start + j);
+        }
+
+        written += count * BLOCK_SIZE;
+
+        return 0;
+    }
+
+    for(size_t i = 0; i < count; i += MAX_TRANSFER){
+        auto sectors = std::min(count - i, MAX_TRANSFER);
+
+        // If the blocks are in cache, simply update the cache and write through the disk
+        for(size_t j = 0; j < sectors; ++j){
+            auto block = cache.block_if_present(device, start + i + j);
+            if(block){
+                std::fill_n(block, BLOCK_SIZE, 0);
+            }
         }
 
-        if(!read_write_sector(drive, start + i, nullptr, sector_operation::CLEAR)){
+        if(!transfer_sectors(drive, start + i, sectors, nullptr, sector_operation::CLEAR)){
             return std::ERROR_FAILED;
         }
 
-        written += BLOCK_SIZE;
+        written += sectors * BLOCK_SIZE;
     }
 
     return 0;
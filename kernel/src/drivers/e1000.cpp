@@ -0,0 +1,617 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+
+#include "drivers/e1000.hpp"
+
+#include "conc/int_lock.hpp"
+
+#include "net/ethernet_layer.hpp"
+#include "net/checksum.hpp"
+
+#include "logging.hpp"
+#include "kernel_utils.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "interrupts.hpp"
+#include "paging.hpp"
+
+#define CTRL 0x0000
+#define STATUS 0x0008
+#define EERD 0x0014
+#define ICR 0x00C0 // Interrupt cause read
+#define ITR 0x00C4 // Interrupt throttling
+#define IMS 0x00D0 // Interrupt mask set
+#define IMC 0x00D8 // Interrupt mask clear
+#define RCTL 0x0100
+#define TCTL 0x0400
+#define TIPG 0x0410
+#define RDBAL 0x2800
+#define RDBAH 0x2804
+#define RDLEN 0x2808
+#define RDH 0x2810
+#define RDT 0x2818
+#define TDBAL 0x3800
+#define TDBAH 0x3804
+#define TDLEN 0x3808
+#define TDH 0x3810
+#define TDT 0x3818
+#define RXCSUM 0x5000
+#define MTA 0x5200 // Multicast table array
+#define RAL 0x5400
+#define RAH 0x5404
+
+#define CTRL_ASDE (1 << 5)
+#define CTRL_SLU (1 << 6)
+#define CTRL_RST (1 << 26)
+
+#define STATUS_LU (1 << 1)
+
+#define INT_TXDW (1 << 0)   // Transmit descriptor written back
+#define INT_LSC (1 << 2)    // Link status change
+#define INT_RXDMT0 (1 << 4) // Receive descriptors minimum threshold
+#define INT_RXO (1 << 6)    // Receiver overrun
+#define INT_RXT0 (1 << 7)   // Receiver timer
+
+#define INT_RX (INT_RXDMT0 | INT_RXO | INT_RXT0)
+
+#define RCTL_EN (1 << 1)
+#define RCTL_UPE (1 << 3)   // Unicast promiscuous
+#define RCTL_MPE (1 << 4)   // Multicast promiscuous
+#define RCTL_BAM (1 << 15)  // Accept broadcast
+#define RCTL_SECRC (1 << 26) // Strip the CRC
+
+#define TCTL_EN (1 << 1)
+#define TCTL_PSP (1 << 3) // Pad short packets
+#define TCTL_CT (0x10 << 4)
+#define TCTL_COLD (0x40 << 12)
+
+#define RXCSUM_IPOFL (1 << 8)
+#define RXCSUM_TUOFL (1 << 9)
+
+#define RX_STATUS_DD (1 << 0)
+#define RX_STATUS_EOP (1 << 1)
+#define RX_STATUS_IXSM (1 << 2)  // Ignore the checksum indications
+#define RX_STATUS_TCPCS (1 << 5) // TCP/UDP checksum computed
+#define RX_STATUS_IPCS (1 << 6)  // IP checksum computed
+
+#define RX_ERROR_CE (1 << 0)   // CRC error
+#define RX_ERROR_SE (1 << 1)   // Symbol error
+#define RX_ERROR_SEQ (1 << 2)  // Sequence error
+#define RX_ERROR_TCPE (1 << 5) // TCP/UDP checksum error
+#define RX_ERROR_IPE (1 << 6)  // IP checksum error
+#define RX_ERROR_RXE (1 << 7)  // Data error
+
+#define TX_CMD_EOP (1 << 0)
+#define TX_CMD_IFCS (1 << 1) // Insert the FCS
+#define TX_CMD_IC (1 << 2)   // Insert the checksum
+#define TX_CMD_RS (1 << 3)   // Report the status
+
+#define TX_STATUS_DD (1 << 0)
+
+namespace {
+
+constexpr const size_t rx_descriptors = 256;
+constexpr const size_t tx_descriptors = 256;
+constexpr const size_t rx_buffer_size = 2048;
+constexpr const size_t rx_packets = 128;          ///< The number of packets of the reception pool
+constexpr const size_t mmio_size = 0x20000;       ///< The size of the register space
+constexpr const size_t interrupt_rate = 8000;     ///< The maximum number of interrupts per second
+
+struct rx_desc_t {
+    uint64_t address;
+    uint16_t length;
+    uint16_t checksum;
+    uint8_t status;
+    uint8_t errors;
+    uint16_t special;
+} __attribute__((packed));
+
+struct tx_desc_t {
+    uint64_t address;
+    uint16_t length;
+    uint8_t cso; // Checksum offset
+    uint8_t cmd;
+    uint8_t status;
+    uint8_t css; // Checksum start
+    uint16_t special;
+} __attribute__((packed));
+
+struct e1000_t {
+    volatile char* registers;
+
+    volatile rx_desc_t* rx_ring;
+    char* rx_buffers;
+    size_t rx_cur; //Index of the next descriptor to receive
+
+    volatile tx_desc_t* tx_ring;
+    network::packet_p tx_packets[tx_descriptors]; //The packets in transmission, on their descriptors
+    size_t tx_tail;  //Index of the next descriptor to fill
+    size_t tx_clean; //Index of the next descriptor to reclaim
+    size_t tx_flushed; //Index of the tail known by the controller
+
+    volatile bool tx_waiting; //Indicates if the tx thread waits for descriptors
+    deferred_unique_semaphore tx_sem;
+
+    bool polling; //Indicates if the reception interrupts are masked
+
+    network::interface_descriptor* interface;
+};
+
+uint32_t read_register(e1000_t& desc, size_t reg){
+    return *reinterpret_cast<volatile uint32_t*>(desc.registers + reg);
+}
+
+void write_register(e1000_t& desc, size_t reg, uint32_t value){
+    *reinterpret_cast<volatile uint32_t*>(desc.registers + reg) = value;
+}
+
+char* allocate_dma(size_t bytes, size_t& physical){
+    auto pages = paging::pages(bytes);
+
+    physical = physical_allocator::allocate(pages);
+
+    if(!physical){
+        return nullptr;
+    }
+
+    auto virt = virtual_allocator::allocate(pages);
+
+    if(!virt || !paging::map_pages(virt, physical, pages)){
+        physical_allocator::free(physical, pages);
+        return nullptr;
+    }
+
+    std::fill_n(reinterpret_cast<char*>(virt), pages * paging::PAGE_SIZE, 0);
+
+    return reinterpret_cast<char*>(virt);
+}
+
+// Read a word of the EEPROM, the layout of EERD differs on the 8257x
+uint16_t read_eeprom(e1000_t& desc, uint8_t address, bool extended){
+    size_t shift = extended ? 2 : 8;
+    uint32_t done = extended ? 1 << 1 : 1 << 4;
+
+    write_register(desc, EERD, (uint32_t(address) << shift) | 1);
+
+    uint32_t value;
+    size_t tries = 100000;
+
+    while(!((value = read_register(desc, EERD)) & done) && --tries){}
+
+    return value >> 16;
+}
+
+void receive_packet(e1000_t& desc, network::interface_descriptor& interface, volatile rx_desc_t& rx){
+    auto length = rx.length;
+
+    // The buffers are large enough for any frame, the other frames are dropped
+    if(!(rx.status & RX_STATUS_EOP) || rx.errors & (RX_ERROR_CE | RX_ERROR_SE | RX_ERROR_SEQ | RX_ERROR_RXE | RX_ERROR_TCPE | RX_ERROR_IPE)){
+        subsystem_logf(NIC, TRACE, "e1000: Packet Error, status:%u errors:%u\n", size_t(rx.status), size_t(rx.errors));
+
+        ++interface.rx_dropped_counter;
+
+        return;
+    }
+
+    auto* payload = desc.rx_buffers + desc.rx_cur * rx_buffer_size;
+
+    subsystem_logf(NIC, TRACE, "e1000: Packet OK length:%u\n", size_t(length));
+
+    auto packet = interface.rx_pool.allocate(payload, length);
+
+    if(!packet){
+        auto packet_buffer = new char[length];
+
+        std::copy_n(payload, length, packet_buffer);
+
+        packet = std::make_intrusive<network::packet>(packet_buffer, length);
+    }
+
+    // The checksums with errors have been dropped above
+    if(!(rx.status & RX_STATUS_IXSM)){
+        if(rx.status & RX_STATUS_IPCS){
+            packet->checksum_verified |= network::CHECKSUM_RX_IP;
+        }
+
+        if(rx.status & RX_STATUS_TCPCS){
+            packet->checksum_verified |= network::CHECKSUM_RX_L4;
+        }
+    }
+
+    interface.poll_receive(std::move(packet));
+}
+
+size_t poll_packets(network::interface_descriptor& interface, size_t budget){
+    auto& desc = *static_cast<e1000_t*>(interface.driver_data);
+
+    size_t received = 0;
+
+    while(true){
+        size_t last = rx_descriptors;
+
+        while(received < budget && desc.rx_ring[desc.rx_cur].status & RX_STATUS_DD){
+            auto& rx = desc.rx_ring[desc.rx_cur];
+
+            receive_packet(desc, interface, rx);
+
+            // Give back the descriptor to the controller
+            rx.status = 0;
+
+            last = desc.rx_cur;
+            desc.rx_cur = (desc.rx_cur + 1) % rx_descriptors;
+
+            ++received;
+        }
+
+        if(last != rx_descriptors){
+            write_register(desc, RDT, last);
+        }
+
+        if(received == budget){
+            return received;
+        }
+
+        // A packet received after the check raises an interrupt once unmasked
+        __atomic_store_n(&desc.polling, false, __ATOMIC_SEQ_CST);
+        write_register(desc, IMS, INT_RX);
+
+        if(!(desc.rx_ring[desc.rx_cur].status & RX_STATUS_DD)){
+            return received;
+        }
+
+        // Otherwise, continue unless the interrupt handler scheduled a poll already
+        if(__atomic_exchange_n(&desc.polling, true, __ATOMIC_SEQ_CST)){
+            return received;
+        }
+
+        write_register(desc, IMC, INT_RX);
+    }
+}
+
+void packet_handler(interrupt::syscall_regs*, void* data){
+    auto& desc = *static_cast<e1000_t*>(data);
+    auto& interface = *desc.interface;
+
+    // Reading the causes acknowledges them
+    auto cause = read_register(desc, ICR);
+
+    if(!cause){
+        return;
+    }
+
+    if(cause & INT_LSC){
+        subsystem_logf(NIC, TRACE, "e1000: Link %s\n", read_register(desc, STATUS) & STATUS_LU ? "up" : "down");
+    }
+
+    // The transmitted packets are released by the tx thread
+    if(cause & INT_TXDW && __atomic_exchange_n(&desc.tx_waiting, false, __ATOMIC_SEQ_CST)){
+        desc.tx_sem.notify();
+    }
+
+    // The ring is emptied by the rx thread, with the reception interrupts masked
+    if(cause & INT_RX && !__atomic_exchange_n(&desc.polling, true, __ATOMIC_SEQ_CST)){
+        write_register(desc, IMC, INT_RX);
+
+        interface.schedule_poll();
+    }
+}
+
+// Release the packets of the descriptors written back by the controller
+void reclaim_tx(e1000_t& desc){
+    while(desc.tx_clean != desc.tx_tail && desc.tx_ring[desc.tx_clean].status & TX_STATUS_DD){
+        desc.tx_packets[desc.tx_clean] = nullptr;
+        desc.tx_clean = (desc.tx_clean + 1) % tx_descriptors;
+    }
+}
+
+size_t free_tx(e1000_t& desc){
+    // One descriptor always stays empty to distinguish a full ring
+    return tx_descriptors - 1 - (desc.tx_tail + tx_descriptors - desc.tx_clean) % tx_descriptors;
+}
+
+// Give the descriptors filled since the last flush to the controller
+void flush_packets(network::interface_descriptor& interface){
+    auto& desc = *reinterpret_cast<e1000_t*>(interface.driver_data);
+
+    if(desc.tx_flushed != desc.tx_tail){
+        write_register(desc, TDT, desc.tx_tail);
+        desc.tx_flushed = desc.tx_tail;
+    }
+}
+
+void send_packet(network::interface_descriptor& interface, network::packet_p& packet){
+    subsystem_logf(NIC, TRACE, "e1000: Start transmitting packet (%p)\n", packet.get());
+
+    auto* ether_header = reinterpret_cast<network::ethernet::header*>(packet->payload);
+
+    // Shortcut packet to self directly to the rx queue
+    if(network::ethernet::mac6_to_mac64(ether_header->target.mac) == interface.mac_address){
+        if(packet->checksum_start){
+            network::checksum_complete(packet->payload, packet->payload_size, packet->checksum_start, packet->checksum_offset);
+        }
+
+        {
+            direct_int_lock lock;
+
+            interface.receive_local(packet);
+        }
+
+        subsystem_logf(NIC, TRACE, "e1000: Packet to self transmitted correctly\n");
+
+        return;
+    }
+
+    // Only the tx thread sends packets, the ring does not need a lock
+    auto& desc = *reinterpret_cast<e1000_t*>(interface.driver_data);
+
+    // The packet is given to the controller in place, one descriptor per
+    // physical page it spans
+    auto start = reinterpret_cast<size_t>(packet->payload);
+    auto end = start + packet->payload_size;
+    auto segments = paging::pages(end - (start & ~(paging::PAGE_SIZE - 1)));
+
+    reclaim_tx(desc);
+
+    // The descriptors are only written back once the controller sees the batch
+    if(free_tx(desc) < segments){
+        flush_packets(interface);
+    }
+
+    while(free_tx(desc) < segments){
+        desc.tx_sem.claim();
+
+        __atomic_store_n(&desc.tx_waiting, true, __ATOMIC_SEQ_CST);
+
+        // The descriptors written back before the flag do not raise a wake up
+        reclaim_tx(desc);
+
+        if(free_tx(desc) >= segments){
+            break;
+        }
+
+        desc.tx_sem.wait();
+
+        reclaim_tx(desc);
+    }
+
+    uint8_t cmd = TX_CMD_IFCS | TX_CMD_RS;
+    uint8_t css = 0;
+    uint8_t cso = 0;
+
+    if(packet->checksum_start){
+        cmd |= TX_CMD_IC;
+        css = packet->checksum_start;
+        cso = packet->checksum_start + packet->checksum_offset;
+    }
+
+    size_t last = desc.tx_tail;
+
+    for(auto address = start; address < end;){
+        auto next = std::min(end, (address & ~(paging::PAGE_SIZE - 1)) + paging::PAGE_SIZE);
+
+        last = desc.tx_tail;
+
+        auto& tx = desc.tx_ring[last];
+
+        tx.address = paging::physical_address(address);
+        tx.length = next - address;
+        tx.css = css;
+        tx.cso = cso;
+        tx.cmd = next == end ? cmd | TX_CMD_EOP : cmd;
+        tx.status = 0;
+
+        desc.tx_tail = (desc.tx_tail + 1) % tx_descriptors;
+
+        address = next;
+    }
+
+    // The packet is kept alive until its last descriptor is reclaimed
+    desc.tx_packets[last] = packet;
+
+    // The controller is notified by flush_packets, once per batch
+}
+
+bool is_extended(uint16_t device_id){
+    return device_id == 0x10D3 || device_id == 0x10F6 || device_id == 0x150C;
+}
+
+} //end of anonymous namespace
+
+bool e1000::is_e1000(const pci::device_descriptor& pci_device){
+    if(pci_device.vendor_id != 0x8086){
+        return false;
+    }
+
+    switch(pci_device.device_id){
+        case 0x100E: // 82540EM
+        case 0x100F: // 82545EM
+        case 0x1004: // 82543GC
+        case 0x1015: // 82540EM LOM
+        case 0x107C: // 82541PI
+        case 0x10D3: // 82574L
+        case 0x10F6: // 82574LA
+        case 0x150C: // 82583V
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool e1000::init_driver(network::interface_descriptor& interface, pci::device_descriptor& pci_device){
+    subsystem_logf(NIC, TRACE, "e1000: Initialize e1000 driver on pci:%u:%u:%u\n", uint64_t(pci_device.bus), uint64_t(pci_device.device), uint64_t(pci_device.function));
+
+    auto* desc = new e1000_t();
+
+    interface.driver_data = desc;
+    interface.hw_send = send_packet;
+    interface.hw_flush = flush_packets;
+    interface.hw_poll = poll_packets;
+
+    // 1. Enable PCI Bus Mastering (allows DMA) and the memory space
+
+    auto command_register = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x4);
+    command_register |= 0x6; // Set Memory Space and Bus Mastering Bits
+    pci::write_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x4, command_register);
+
+    // 2. Map the registers
+
+    auto bar0 = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x10);
+
+    uint64_t base = bar0 & ~0xF;
+
+    // 64 bits memory BAR
+    if(((bar0 >> 1) & 0x3) == 0x2){
+        base |= uint64_t(pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x14)) << 32;
+    }
+
+    auto pages = paging::pages(mmio_size);
+    auto virt = virtual_allocator::allocate(pages);
+
+    if(!virt || !paging::map_pages(virt, base, pages, paging::PRESENT | paging::WRITE | paging::CACHE_DISABLED)){
+        logging::logf(logging::log_level::ERROR, "e1000: Unable to map the registers\n");
+        return false;
+    }
+
+    desc->registers = reinterpret_cast<volatile char*>(virt);
+
+    subsystem_logf(NIC, TRACE, "e1000: Registers at %h\n", base);
+
+    // 3. Reset the controller, with the interrupts disabled
+
+    write_register(*desc, IMC, 0xFFFFFFFF);
+    write_register(*desc, CTRL, read_register(*desc, CTRL) | CTRL_RST);
+
+    size_t tries = 100000;
+    while((read_register(*desc, CTRL) & CTRL_RST) && --tries){ /* Wait for RST to be done */ }
+
+    write_register(*desc, IMC, 0xFFFFFFFF);
+    read_register(*desc, ICR);
+
+    write_register(*desc, CTRL, read_register(*desc, CTRL) | CTRL_SLU | CTRL_ASDE);
+
+    for(size_t i = 0; i < 128; ++i){
+        write_register(*desc, MTA + i * 4, 0);
+    }
+
+    // 4. Get the mac address, from the receive address or the EEPROM
+
+    size_t mac = 0;
+
+    auto ral = read_register(*desc, RAL);
+    auto rah = read_register(*desc, RAH);
+
+    if(rah & (1U << 31)){
+        for(size_t i = 0; i < 4; ++i){
+            mac |= uint64_t((ral >> (i * 8)) & 0xFF) << ((5 - i) * 8);
+        }
+
+        mac |= uint64_t(rah & 0xFF) << 8;
+        mac |= uint64_t((rah >> 8) & 0xFF);
+    } else {
+        auto extended = is_extended(pci_device.device_id);
+
+        for(size_t i = 0; i < 3; ++i){
+            auto word = read_eeprom(*desc, i, extended);
+
+            mac |= uint64_t(word & 0xFF) << ((5 - 2 * i) * 8);
+            mac |= uint64_t(word >> 8) << ((4 - 2 * i) * 8);
+        }
+    }
+
+    interface.mac_address = mac;
+
+    subsystem_logf(NIC, TRACE, "e1000: MAC Address %h \n", mac);
+
+    // 5. Init the receive ring
+
+    size_t rx_ring_phys;
+    desc->rx_ring = reinterpret_cast<volatile rx_desc_t*>(allocate_dma(rx_descriptors * sizeof(rx_desc_t), rx_ring_phys));
+
+    size_t rx_buffers_phys;
+    desc->rx_buffers = allocate_dma(rx_descriptors * rx_buffer_size, rx_buffers_phys);
+
+    if(!desc->rx_ring || !desc->rx_buffers){
+        logging::logf(logging::log_level::ERROR, "e1000: Unable to allocate the receive ring\n");
+        return false;
+    }
+
+    for(size_t i = 0; i < rx_descriptors; ++i){
+        desc->rx_ring[i].address = rx_buffers_phys + i * rx_buffer_size;
+    }
+
+    desc->rx_cur = 0;
+
+    write_register(*desc, RDBAL, rx_ring_phys & 0xFFFFFFFF);
+    write_register(*desc, RDBAH, rx_ring_phys >> 32);
+    write_register(*desc, RDLEN, rx_descriptors * sizeof(rx_desc_t));
+    write_register(*desc, RDH, 0);
+    write_register(*desc, RDT, rx_descriptors - 1);
+
+    // The controller verifies the checksums, the invalid packets are dropped
+    write_register(*desc, RXCSUM, RXCSUM_IPOFL | RXCSUM_TUOFL);
+
+    // 2048 bytes buffers
+    write_register(*desc, RCTL, RCTL_EN | RCTL_UPE | RCTL_MPE | RCTL_BAM | RCTL_SECRC);
+
+    // 6. Init the transmit ring
+
+    size_t tx_ring_phys;
+    desc->tx_ring = reinterpret_cast<volatile tx_desc_t*>(allocate_dma(tx_descriptors * sizeof(tx_desc_t), tx_ring_phys));
+
+    if(!desc->tx_ring){
+        logging::logf(logging::log_level::ERROR, "e1000: Unable to allocate the transmit ring\n");
+        return false;
+    }
+
+    desc->tx_tail = 0;
+    desc->tx_clean = 0;
+    desc->tx_flushed = 0;
+    desc->tx_waiting = false;
+    desc->tx_sem.init(0);
+
+    write_register(*desc, TDBAL, tx_ring_phys & 0xFFFFFFFF);
+    write_register(*desc, TDBAH, tx_ring_phys >> 32);
+    write_register(*desc, TDLEN, tx_descriptors * sizeof(tx_desc_t));
+    write_register(*desc, TDH, 0);
+    write_register(*desc, TDT, 0);
+
+    write_register(*desc, TIPG, 0x0060200A);
+    write_register(*desc, TCTL, TCTL_EN | TCTL_PSP | TCTL_CT | TCTL_COLD);
+
+    interface.checksum_offload = network::CHECKSUM_TX_L4 | network::CHECKSUM_RX_IP | network::CHECKSUM_RX_L4;
+
+    // 7. Throttle the interrupts, in units of 256 nanoseconds
+
+    write_register(*desc, ITR, 1000000000 / (interrupt_rate * 256));
+
+    desc->polling = false;
+
+    // 8. Register IRQ handler
+
+    auto irq = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x3c) & 0xFF;
+    if(!interrupt::register_irq_handler(irq, packet_handler, desc)){
+        logging::logf(logging::log_level::ERROR, "e1000: Unable to register IRQ handler %u\n", irq);
+    }
+
+    subsystem_logf(NIC, TRACE, "e1000: IRQ :%u\n", uint64_t(irq));
+
+    return true;
+}
+
+void e1000::finalize_driver(network::interface_descriptor& interface){
+    auto* desc = static_cast<e1000_t*>(interface.driver_data);
+    desc->interface = &interface;
+
+    // The pool refers to the interface, which does not move anymore
+    interface.rx_pool.init(rx_packets);
+
+    // The interrupts are only enabled once the interface is known
+    write_register(*desc, IMS, INT_RX | INT_TXDW | INT_LSC);
+}
@@ -15,6 +15,8 @@
 #include "kernel.hpp" // For suspend_kernel
 #include "scheduler.hpp" // For async init
 #include "timer.hpp"     // For setting the frequency
+#include "profile.hpp"   // For sampling at each tick
+#include "clocksource.hpp" // For the TSC calibration
 
 #include "drivers/pit.hpp" // For uninstalling it
 
@@ -45,6 +47,7 @@ constexpr const size_t TIMER_FREQUENCY_GOAL = 10000; // 1 tick every 100 microse
 ACPI_TABLE_HPET* hpet_table;
 uint64_t* hpet_map;
 volatile uint64_t comparator_update;
+volatile uint64_t last_tick; ///< The value of the main counter at the last tick
 
 uint64_t timer_configuration_reg(uint64_t n){
     return (0x100 + 0x20 * n) / 8;
@@ -74,21 +77,46 @@ void clear_register_bits(size_t reg, uint64_t bits){
     write_register(reg, read_register(reg) & ~bits);
 }
 
-void timer_handler(interrupt::syscall_regs*, void*){
+/*!
+ * \brief Fire the next IRQ at the given value of the main counter.
+ *
+ * The comparator only matches when the main counter crosses it, so a
+ * deadline that has already passed is moved slightly in the future.
+ */
+void set_deadline(uint64_t deadline){
+    auto min_deadline = read_register(MAIN_COUNTER) + comparator_update / 4;
+
+    write_register(timer_comparator_reg(0), deadline < min_deadline ? min_deadline : deadline);
+}
+
+void timer_handler(interrupt::syscall_regs* regs, void*){
     // Clears Tn_INT_STS
     set_register_bits(GENERAL_INTERRUPT_REGISTER, 1 << 0);
 
+    profile::sample(regs);
+    scheduler::account_tick(regs->cs & 0x3);
+
+    // Several ticks may have elapsed if the tick was stopped
+    auto ticks = (read_register(MAIN_COUNTER) - last_tick) / comparator_update;
+
+    last_tick += ticks * comparator_update;
+
     // Sets the next event to fire an IRQ
-    write_register(timer_comparator_reg(0), read_register(MAIN_COUNTER) + comparator_update);
+    set_deadline(last_tick + comparator_update);
 
-    timer::tick();
+    if(ticks){
+        timer::tick(ticks);
+    }
 }
 
 } //End of anonymous namespace
 
 void hpet::init(){
-    // HPET needs ACPI
-    scheduler::queue_async_init_task(hpet::late_install);
+    // HPET needs ACPI, the TSC is calibrated against the final counter
+    scheduler::queue_async_init_task("hpet", [](){
+        hpet::late_install();
+        clocksource::init();
+    }, {"acpi"});
 }
 
 bool hpet::install(){
@@ -158,6 +186,9 @@ void hpet::late_install(){
         timer::counter_fun(hpet::counter);
         timer::counter_frequency(hpet_frequency);
 
+        // The comparator is programmed at each tick, it can be delayed
+        timer::tickless_fun(hpet::stop_tick, hpet::restart_tick);
+
         // Uninstall the PIT driver
         pit::remove();
 
@@ -171,6 +202,7 @@ void hpet::late_install(){
 
         // Clear the main counter
         write_register(MAIN_COUNTER, 0);
+        last_tick = 0;
 
         // Initialize timer #0
         clear_register_bits(timer_configuration_reg(0), TIMER_CONFIG_PERIODIC);
@@ -182,6 +214,16 @@ void hpet::late_install(){
     }
 }
 
+void hpet::stop_tick(uint64_t ticks){
+    set_deadline(last_tick + ticks * comparator_update);
+}
+
+void hpet::restart_tick(){
+    direct_int_lock lock;
+
+    set_deadline(last_tick + comparator_update);
+}
+
 uint64_t hpet::counter(){
     return read_register(MAIN_COUNTER);
 }
@@ -0,0 +1,314 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <string.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "drivers/ioapic.hpp"
+#include "drivers/apic.hpp"
+
+#include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
+
+#include "acpica.hpp"
+#include "interrupts.hpp"
+#include "kernel_utils.hpp"
+#include "logging.hpp"
+#include "mmap.hpp"
+#include "smp.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t MAX_IOAPICS = 4;
+constexpr const size_t LEGACY_IRQS = 16;
+constexpr const size_t IRQ_VECTOR = 32;    ///< The vector of IRQ 0, the same as with the PICs
+constexpr const size_t TIMER_IRQ = 0;
+
+// The indirect registers of an IO APIC
+constexpr const size_t IOREGSEL = 0x0 / 4;
+constexpr const size_t IOWIN = 0x10 / 4;
+
+constexpr const uint32_t VERSION_REGISTER = 0x1;
+constexpr const uint32_t REDIRECTION_REGISTER = 0x10; ///< The low half of the first redirection entry
+
+constexpr const uint32_t ENTRY_ACTIVE_LOW = 1 << 13;
+constexpr const uint32_t ENTRY_LEVEL = 1 << 15;
+constexpr const uint32_t ENTRY_MASKED = 1 << 16;
+
+constexpr const uint16_t ELCR_PORT = 0x4D0; ///< The trigger mode of the legacy IRQs, one bit per IRQ on two ports
+
+/*!
+ * \brief An IO APIC of the MADT
+ */
+struct ioapic_t {
+    volatile uint32_t* map = nullptr; ///< The memory mapped registers
+    uint32_t gsi_base = 0;            ///< The first global system interrupt of the IO APIC
+    uint32_t entries = 0;             ///< The number of redirection entries
+};
+
+/*!
+ * \brief The routing of a legacy IRQ
+ */
+struct route_t {
+    uint32_t gsi = 0;   ///< The global system interrupt of the IRQ
+    uint32_t flags = 0; ///< The polarity and trigger bits of the redirection entry
+    size_t cpu = 0;     ///< The processor receiving the IRQ
+};
+
+std::array<ioapic_t, MAX_IOAPICS> ioapics;
+size_t ioapic_count = 0;
+
+std::array<route_t, LEGACY_IRQS> routes;
+std::array<size_t, LEGACY_IRQS> irq_ids; ///< The IRQ number given to the sysfs functions
+
+int_spinlock ioapic_lock; ///< Protect the register selection of all the IO APICs
+
+bool ioapic_enabled = false;
+
+uint32_t read_register(const ioapic_t& ioapic, uint32_t reg){
+    ioapic.map[IOREGSEL] = reg;
+    return ioapic.map[IOWIN];
+}
+
+void write_register(const ioapic_t& ioapic, uint32_t reg, uint32_t value){
+    ioapic.map[IOREGSEL] = reg;
+    ioapic.map[IOWIN] = value;
+}
+
+ioapic_t* find_ioapic(uint32_t gsi){
+    for(size_t i = 0; i < ioapic_count; ++i){
+        auto& ioapic = ioapics[i];
+
+        if(gsi >= ioapic.gsi_base && gsi < ioapic.gsi_base + ioapic.entries){
+            return &ioapic;
+        }
+    }
+
+    return nullptr;
+}
+
+/*!
+ * \brief Program the redirection entry of the IRQ from its route
+ */
+bool program(size_t irq){
+    auto& route = routes[irq];
+    auto ioapic = find_ioapic(route.gsi);
+
+    if(!ioapic){
+        return false;
+    }
+
+    auto reg = REDIRECTION_REGISTER + 2 * (route.gsi - ioapic->gsi_base);
+
+    std::lock_guard<int_spinlock> l(ioapic_lock);
+
+    // Masked while the destination is changed
+    write_register(*ioapic, reg, ENTRY_MASKED);
+    write_register(*ioapic, reg + 1, smp::apic_id(route.cpu) << 24);
+    write_register(*ioapic, reg, route.flags | (IRQ_VECTOR + irq));
+
+    return true;
+}
+
+uint32_t override_flags(uint16_t inti_flags){
+    uint32_t flags = 0;
+
+    if((inti_flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_ACTIVE_LOW){
+        flags |= ENTRY_ACTIVE_LOW;
+    }
+
+    if((inti_flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL){
+        flags |= ENTRY_LEVEL;
+    }
+
+    return flags;
+}
+
+bool discover_ioapics(){
+    ACPI_TABLE_MADT* madt;
+    auto status = AcpiGetTable(ACPI_SIG_MADT, 0, reinterpret_cast<ACPI_TABLE_HEADER **>(&madt));
+    if (ACPI_FAILURE(status)){
+        logging::logf(logging::log_level::TRACE, "ioapic: No ACPI MADT table\n");
+        return false;
+    }
+
+    // The PCI interrupts routed to legacy IRQs are level-triggered
+    uint16_t elcr = in_byte(ELCR_PORT) | (in_byte(ELCR_PORT + 1) << 8);
+
+    for(size_t irq = 0; irq < LEGACY_IRQS; ++irq){
+        routes[irq].gsi = irq;
+        routes[irq].flags = (elcr & (1 << irq)) ? ENTRY_LEVEL : 0;
+        routes[irq].cpu = 0;
+    }
+
+    auto start = reinterpret_cast<uintptr_t>(madt) + sizeof(ACPI_TABLE_MADT);
+    auto end = reinterpret_cast<uintptr_t>(madt) + madt->Header.Length;
+
+    while(start < end){
+        auto header = reinterpret_cast<ACPI_SUBTABLE_HEADER*>(start);
+
+        if(!header->Length){
+            break;
+        }
+
+        if(header->Type == ACPI_MADT_TYPE_IO_APIC){
+            auto entry = reinterpret_cast<ACPI_MADT_IO_APIC*>(header);
+
+            if(ioapic_count == MAX_IOAPICS){
+                logging::logf(logging::log_level::WARNING, "ioapic: Too many IO APICs, ignore %u\n", size_t(entry->Id));
+            } else {
+                auto& ioapic = ioapics[ioapic_count];
+
+                ioapic.map = static_cast<volatile uint32_t*>(mmap_phys(entry->Address, 0x20));
+
+                if(ioapic.map){
+                    ioapic.gsi_base = entry->GlobalIrqBase;
+                    ioapic.entries = ((read_register(ioapic, VERSION_REGISTER) >> 16) & 0xFF) + 1;
+
+                    logging::logf(logging::log_level::TRACE, "ioapic: IO APIC %u at %h (gsi:%u entries:%u)\n",
+                        size_t(entry->Id), size_t(entry->Address), size_t(ioapic.gsi_base), size_t(ioapic.entries));
+
+                    ++ioapic_count;
+                } else {
+                    logging::logf(logging::log_level::ERROR, "ioapic: Unable to map IO APIC %u\n", size_t(entry->Id));
+                }
+            }
+        } else if(header->Type == ACPI_MADT_TYPE_INTERRUPT_OVERRIDE){
+            auto entry = reinterpret_cast<ACPI_MADT_INTERRUPT_OVERRIDE*>(header);
+
+            if(entry->SourceIrq < LEGACY_IRQS){
+                // The ISA IRQs are edge-triggered and active high unless overridden
+                routes[entry->SourceIrq].gsi = entry->GlobalIrq;
+                routes[entry->SourceIrq].flags = override_flags(entry->IntiFlags);
+
+                logging::logf(logging::log_level::TRACE, "ioapic: IRQ %u is GSI %u (flags:%u)\n",
+                    size_t(entry->SourceIrq), size_t(entry->GlobalIrq), size_t(entry->IntiFlags));
+            }
+        }
+
+        start += header->Length;
+    }
+
+    return ioapic_count;
+}
+
+std::string sysfs_affinity(void* data){
+    return std::to_string(ioapic::affinity(*reinterpret_cast<size_t*>(data)));
+}
+
+size_t sysfs_set_affinity(void* data, const std::string& value){
+    size_t cpu = 0;
+
+    if(value.empty()){
+        return std::ERROR_INVALID_REQUEST;
+    }
+
+    for(auto c : value){
+        if(c < '0' || c > '9'){
+            return std::ERROR_INVALID_REQUEST;
+        }
+
+        cpu = cpu * 10 + (c - '0');
+    }
+
+    if(!ioapic::set_affinity(*reinterpret_cast<size_t*>(data), cpu)){
+        return std::ERROR_INVALID_REQUEST;
+    }
+
+    return 0;
+}
+
+std::string sysfs_counts(void* data){
+    auto irq = *reinterpret_cast<size_t*>(data);
+
+    std::string value;
+
+    for(size_t cpu = 0; cpu < smp::max_cpus(); ++cpu){
+        if(!smp::online(cpu)){
+            continue;
+        }
+
+        if(cpu){
+            value += ' ';
+        }
+
+        value += std::to_string(interrupt::irq_count(irq, cpu));
+    }
+
+    return value;
+}
+
+} //End of anonymous namespace
+
+bool ioapic::init(){
+    if(!apic::initialized() || !discover_ioapics()){
+        return false;
+    }
+
+    {
+        // No IRQ can be lost between the two controllers
+        direct_int_lock lock;
+
+        for(size_t irq = 0; irq < LEGACY_IRQS; ++irq){
+            if(!program(irq)){
+                logging::logf(logging::log_level::ERROR, "ioapic: No IO APIC for IRQ %u (GSI %u)\n", irq, size_t(routes[irq].gsi));
+            }
+        }
+
+        // Mask all the IRQs of both PICs
+        out_byte(0x21, 0xFF);
+        out_byte(0xA1, 0xFF);
+
+        ioapic_enabled = true;
+    }
+
+    for(size_t irq = 0; irq < LEGACY_IRQS; ++irq){
+        irq_ids[irq] = irq;
+
+        auto base = path("/irq") / std::to_string(irq);
+
+        sysfs::set_writable_value_data(path("/sys"), base / "affinity", &sysfs_affinity, &sysfs_set_affinity, &irq_ids[irq]);
+        sysfs::set_dynamic_value_data(path("/sys"), base / "counts", &sysfs_counts, &irq_ids[irq]);
+    }
+
+    logging::logf(logging::log_level::TRACE, "ioapic: IRQs routed by %u IO APICs\n", ioapic_count);
+
+    return true;
+}
+
+bool ioapic::enabled(){
+    return ioapic_enabled;
+}
+
+size_t ioapic::affinity(size_t irq){
+    return irq < LEGACY_IRQS ? routes[irq].cpu : 0;
+}
+
+bool ioapic::set_affinity(size_t irq, size_t cpu){
+    if(!ioapic_enabled || irq >= LEGACY_IRQS || !smp::online(cpu)){
+        return false;
+    }
+
+    if(irq == TIMER_IRQ && cpu != 0){
+        return false;
+    }
+
+    routes[irq].cpu = cpu;
+
+    if(!program(irq)){
+        return false;
+    }
+
+    logging::logf(logging::log_level::TRACE, "ioapic: IRQ %u routed to processor %u\n", irq, cpu);
+
+    return true;
+}
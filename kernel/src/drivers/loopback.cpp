@@ -25,11 +25,13 @@ struct loopback_t {
 void send_packet(network::interface_descriptor& interface, network::packet_p& packet){
     logging::logf(logging::log_level::TRACE, "loopback: Transmit packet\n");
 
+    // The packet never leaves the memory
+    packet->checksum_verified = network::CHECKSUM_RX_IP | network::CHECKSUM_RX_L4;
+
     {
         direct_int_lock lock;
 
-        interface.rx_queue.push(packet);
-        interface.rx_sem.notify();
+        interface.receive(packet);
     }
 
     logging::logf(logging::log_level::TRACE, "loopback: Packet transmitted correctly\n");
@@ -42,6 +44,8 @@ void loopback::init_driver(network::interface_descriptor& interface){
 
     interface.driver_data = new loopback_t();
     interface.hw_send = send_packet;
+    interface.mtu = 0xFFFF;
+    interface.checksum_offload = network::CHECKSUM_TX_IP | network::CHECKSUM_TX_L4 | network::CHECKSUM_RX_IP | network::CHECKSUM_RX_L4;
 
     interface.ip_address = network::ip::make_address(127, 0, 0, 1);
     //TODO maybe set a MAC address
@@ -5,10 +5,19 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <array.hpp>
+#include <lock_guard.hpp>
+
 #include "drivers/pci.hpp"
 
+#include "conc/int_spinlock.hpp"
+
 #include "kernel_utils.hpp"
 #include "logging.hpp"
+#include "virtual_allocator.hpp"
+#include "paging.hpp"
+#include "scheduler.hpp"
+#include "acpica.hpp"
 
 #include "fs/sysfs.hpp"
 
@@ -16,6 +25,117 @@ namespace {
 
 std::vector<pci::device_descriptor> devices;
 
+int_spinlock config_lock; ///< Serialize the address/data pairs of the legacy configuration ports
+
+constexpr const size_t ECAM_BUS_SIZE  = 1024 * 1024; ///< The configuration space of a bus, 4K per function
+constexpr const size_t MCFG_ENTRIES   = 44;          ///< The offset of the allocations in the MCFG table
+
+/*!
+ * \brief An allocation of the MCFG table, one ECAM region
+ */
+struct mcfg_allocation {
+    uint64_t address;       ///< The physical address of the region
+    uint16_t segment;       ///< The PCI segment group
+    uint8_t start_bus;      ///< The first bus decoded by the region
+    uint8_t end_bus;        ///< The last bus decoded by the region
+    uint32_t reserved;
+} __attribute__((packed));
+
+std::array<volatile uint8_t*, 256> ecam_buses; ///< The mapped ECAM configuration space of each bus, if any
+std::array<bool, 256> scanned_buses;           ///< The buses already enumerated
+
+// Returns the ECAM address of a register, or nullptr if the bus is only reachable with the ports
+volatile uint32_t* ecam_register(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset){
+    auto base = __atomic_load_n(&ecam_buses[bus], __ATOMIC_ACQUIRE);
+
+    if(!base){
+        return nullptr;
+    }
+
+    return reinterpret_cast<volatile uint32_t*>(base + ((size_t(device) << 15) | (size_t(function) << 12) | (offset & 0xFC)));
+}
+
+constexpr const uint32_t MSI_ADDRESS = 0xFEE00000; ///< The address of the messages, for the local APICs
+
+constexpr const uint16_t MSIX_ENABLE        = 1 << 15; ///< The MSI-X enable bit of the message control
+constexpr const uint16_t MSIX_FUNCTION_MASK = 1 << 14; ///< The MSI-X function mask bit of the message control
+constexpr const uint32_t MSIX_ENTRY_MASKED  = 1 << 0;  ///< The mask bit of the vector control of an entry
+
+/*!
+ * \brief The mapped MSI-X table of a device
+ */
+struct msix_table {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    size_t entries;           ///< The number of entries in the table
+    volatile uint32_t* table; ///< The entries, four dwords each
+};
+
+std::vector<msix_table> msix_tables;
+
+msix_table* find_msix_table(uint8_t bus, uint8_t device, uint8_t function){
+    for(auto& table : msix_tables){
+        if(table.bus == bus && table.device == device && table.function == function){
+            return &table;
+        }
+    }
+
+    return nullptr;
+}
+
+// Map the table in the memory BAR given by the table offset register
+volatile uint32_t* map_msix_table(uint8_t bus, uint8_t device, uint8_t function, uint8_t capability, size_t entries){
+    auto table_register = pci::read_config_dword(bus, device, function, capability + 4);
+
+    auto bir = table_register & 0x7;
+    auto offset = table_register & ~0x7;
+
+    if(bir > 5){
+        return nullptr;
+    }
+
+    auto bar = pci::read_config_dword(bus, device, function, 0x10 + bir * 4);
+
+    // Only memory BARs can hold the table
+    if(bar & 0x1){
+        return nullptr;
+    }
+
+    uint64_t base = bar & ~0xF;
+
+    // 64 bits memory BAR
+    if(((bar >> 1) & 0x3) == 0x2){
+        base |= uint64_t(pci::read_config_dword(bus, device, function, 0x10 + bir * 4 + 4)) << 32;
+    }
+
+    auto physical = base + offset;
+    auto first_page = paging::page_align(physical);
+    auto pages = paging::pages(physical - first_page + entries * 16);
+
+    auto virt = virtual_allocator::allocate(pages);
+
+    if(!virt || !paging::map_pages(virt, first_page, pages, paging::PRESENT | paging::WRITE | paging::CACHE_DISABLED)){
+        logging::logf(logging::log_level::ERROR, "pci: Unable to map the MSI-X table\n");
+        return nullptr;
+    }
+
+    return reinterpret_cast<volatile uint32_t*>(virt + (physical - first_page));
+}
+
+void write_msix_entry(volatile uint32_t* table, size_t entry, uint8_t vector, uint32_t apic_id){
+    auto* e = table + entry * 4;
+
+    // The entry is masked while its message changes
+    e[3] = e[3] | MSIX_ENTRY_MASKED;
+
+    e[0] = MSI_ADDRESS | (apic_id << 12);
+    e[1] = 0;
+    e[2] = vector;
+
+    e[3] = e[3] & ~MSIX_ENTRY_MASKED;
+}
+
 #define PCI_CONFIG_ADDRESS 0xCF8
 #define PCI_CONFIG_DATA 0xCFC
 
@@ -95,13 +215,52 @@ void check_function(uint8_t bus, uint8_t device, uint8_t function){
     sysfs::set_constant_value(path("/sys"), p / "subclass", std::to_string(sub_class));
 }
 
+void check_bus(uint8_t bus);
+
 void check_device(uint8_t bus, uint8_t device) {
-    check_function(bus, device, 0);
+    if(get_vendor_id(bus, device, 0) == 0xFFFF){
+        return;
+    }
 
     auto header_type = get_header_type(bus, device, 0);
-    if((header_type & 0x80) != 0){
-        for(uint8_t function = 1; function < 8; ++function){
-            check_function(bus, device, function);
+    auto functions = (header_type & 0x80) != 0 ? 8 : 1;
+
+    for(uint8_t function = 0; function < functions; ++function){
+        check_function(bus, device, function);
+
+        // A PCI-to-PCI bridge leads to another bus
+        if(get_class_code(bus, device, function) == 0x06 && get_subclass(bus, device, function) == 0x04){
+            auto secondary_bus = pci::read_config_byte(bus, device, function, 0x19);
+
+            if(secondary_bus){
+                check_bus(secondary_bus);
+            }
+        }
+    }
+}
+
+void check_bus(uint8_t bus){
+    // Misconfigured bridges could make a cycle
+    if(scanned_buses[bus]){
+        return;
+    }
+
+    scanned_buses[bus] = true;
+
+    for(uint8_t device = 0; device < 32; ++device) {
+        check_device(bus, device);
+    }
+}
+
+void check_all_buses(){
+    // With several host controllers, each function of the host bridge is a bus
+    if((get_header_type(0, 0, 0) & 0x80) == 0){
+        check_bus(0);
+    } else {
+        for(uint8_t function = 0; function < 8; ++function){
+            if(get_vendor_id(0, 0, function) != 0xFFFF){
+                check_bus(function);
+            }
         }
     }
 }
@@ -114,10 +273,82 @@ void brute_force_check_all_buses(){
     }
 }
 
+std::string sysfs_config_access(){
+    for(auto base : ecam_buses){
+        if(base){
+            return "ecam";
+        }
+    }
+
+    return "ports";
+}
+
+// Map the configuration space of the enumerated buses with the regions of the MCFG table
+void init_ecam(){
+    ACPI_TABLE_HEADER* mcfg = nullptr;
+
+    if(ACPI_FAILURE(AcpiGetTable(const_cast<char*>(ACPI_SIG_MCFG), 0, &mcfg))){
+        logging::logf(logging::log_level::TRACE, "pci: No MCFG table, keep the configuration ports\n");
+        return;
+    }
+
+    auto start = reinterpret_cast<uintptr_t>(mcfg) + MCFG_ENTRIES;
+    auto end   = reinterpret_cast<uintptr_t>(mcfg) + mcfg->Length;
+
+    size_t mapped = 0;
+
+    for(auto it = start; it + sizeof(mcfg_allocation) <= end; it += sizeof(mcfg_allocation)){
+        auto* allocation = reinterpret_cast<mcfg_allocation*>(it);
+
+        // Only the first segment is enumerated
+        if(allocation->segment){
+            continue;
+        }
+
+        for(size_t bus = allocation->start_bus; bus <= allocation->end_bus; ++bus){
+            if(!scanned_buses[bus] || ecam_buses[bus]){
+                continue;
+            }
+
+            // The region of a bus starts at its offset from the first bus of the region
+            auto physical = allocation->address + (bus - allocation->start_bus) * ECAM_BUS_SIZE;
+            auto pages = ECAM_BUS_SIZE / paging::PAGE_SIZE;
+
+            auto virt = virtual_allocator::allocate(pages);
+
+            if(!virt || !paging::map_pages(virt, physical, pages, paging::PRESENT | paging::WRITE | paging::CACHE_DISABLED)){
+                logging::logf(logging::log_level::ERROR, "pci: Unable to map the ECAM region of bus %u\n", bus);
+                continue;
+            }
+
+            // From now on, the bus is accessed through the memory
+            __atomic_store_n(&ecam_buses[bus], reinterpret_cast<volatile uint8_t*>(virt), __ATOMIC_RELEASE);
+
+            ++mapped;
+        }
+    }
+
+    logging::logf(logging::log_level::TRACE, "pci: %u buses accessed with ECAM\n", mapped);
+}
+
 } //end of anonymous namespace
 
 void pci::detect_devices(){
-    brute_force_check_all_buses();
+    check_all_buses();
+
+    // Without any device, the firmware may not have configured the bridges
+    if(devices.empty()){
+        brute_force_check_all_buses();
+
+        for(auto& device : devices){
+            scanned_buses[device.bus] = true;
+        }
+    }
+
+    sysfs::set_dynamic_value(path("/sys"), path("/pci/config_access"), &sysfs_config_access);
+
+    // The MCFG table is only available once ACPICA is initialized
+    scheduler::queue_async_init_task("pci", &init_ecam, {"acpi"});
 }
 
 size_t pci::number_of_devices(){
@@ -139,6 +370,10 @@ uint16_t pci::read_config_word(uint8_t bus, uint8_t device, uint8_t function, ui
 }
 
 uint32_t pci::read_config_dword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset){
+    if(auto reg = ecam_register(bus, device, function, offset)){
+        return *reg;
+    }
+
     uint32_t address =
         static_cast<uint32_t>(1 << 31)  //enabled
         | (uint32_t(bus) << 16)  //bus number
@@ -146,6 +381,8 @@ uint32_t pci::read_config_dword(uint8_t bus, uint8_t device, uint8_t function, u
         | (uint32_t(function) << 8) //function number
         | ((uint32_t(offset) ) & 0xfc); //Register number
 
+    std::lock_guard<int_spinlock> l(config_lock);
+
     out_dword(PCI_CONFIG_ADDRESS, address);
 
     return in_dword(PCI_CONFIG_DATA);
@@ -170,6 +407,11 @@ void pci::write_config_word(uint8_t bus, uint8_t device, uint8_t function, uint8
 }
 
 void pci::write_config_dword (uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t value){
+    if(auto reg = ecam_register(bus, device, function, offset)){
+        *reg = value;
+        return;
+    }
+
     uint32_t address =
         static_cast<uint32_t>(1 << 31)  //enabled
         | (uint32_t(bus) << 16)  //bus number
@@ -177,7 +419,134 @@ void pci::write_config_dword (uint8_t bus, uint8_t device, uint8_t function, uin
         | (uint32_t(function) << 8) //function number
         | ((uint32_t(offset) ) & 0xfc); //Register number
 
+    std::lock_guard<int_spinlock> l(config_lock);
+
     out_dword(PCI_CONFIG_ADDRESS, address);
 
     out_dword(PCI_CONFIG_DATA, value);
 }
+
+bool pci::enable_msi(uint8_t bus, uint8_t device, uint8_t function, uint8_t vector, uint32_t apic_id){
+    auto capability = find_capability(bus, device, function, CAPABILITY_MSI);
+
+    if(!capability){
+        return false;
+    }
+
+    auto control = read_config_word(bus, device, function, capability + 2);
+
+    write_config_dword(bus, device, function, capability + 4, MSI_ADDRESS | (apic_id << 12));
+
+    // The data follows the high part of the address with 64 bits messages
+    if(control & (1 << 7)){
+        write_config_dword(bus, device, function, capability + 8, 0);
+        write_config_word(bus, device, function, capability + 12, vector);
+    } else {
+        write_config_word(bus, device, function, capability + 8, vector);
+    }
+
+    // A single message, enabled
+    control &= ~(0x7 << 4);
+    control |= 0x1;
+    write_config_word(bus, device, function, capability + 2, control);
+
+    // Disable the legacy interrupt line
+    auto command_register = read_config_word(bus, device, function, 0x4);
+    write_config_word(bus, device, function, 0x4, command_register | (1 << 10));
+
+    return true;
+}
+
+uint8_t pci::find_capability(uint8_t bus, uint8_t device, uint8_t function, uint8_t id){
+    // Without capabilities list, there is no capability
+    if(!(read_config_word(bus, device, function, 0x6) & (1 << 4))){
+        return 0;
+    }
+
+    auto capability = read_config_byte(bus, device, function, 0x34) & ~0x3;
+
+    // The list is bounded, in case of a broken device
+    for(size_t i = 0; capability && i < 48; ++i){
+        if(read_config_byte(bus, device, function, capability) == id){
+            return capability;
+        }
+
+        capability = read_config_byte(bus, device, function, capability + 1) & ~0x3;
+    }
+
+    return 0;
+}
+
+size_t pci::msix_entries(uint8_t bus, uint8_t device, uint8_t function){
+    auto capability = find_capability(bus, device, function, CAPABILITY_MSIX);
+
+    if(!capability){
+        return 0;
+    }
+
+    // The table size is encoded as N - 1
+    return (read_config_word(bus, device, function, capability + 2) & 0x7FF) + 1;
+}
+
+bool pci::enable_msix(uint8_t bus, uint8_t device, uint8_t function, const uint8_t* vectors, size_t n, uint32_t apic_id){
+    auto capability = find_capability(bus, device, function, CAPABILITY_MSIX);
+
+    if(!capability){
+        return false;
+    }
+
+    auto control = read_config_word(bus, device, function, capability + 2);
+    auto entries = size_t(control & 0x7FF) + 1;
+
+    if(!n || n > entries){
+        logging::logf(logging::log_level::ERROR, "pci: %u MSI-X vectors requested, the device has %u\n", n, entries);
+        return false;
+    }
+
+    auto* table = find_msix_table(bus, device, function);
+
+    if(!table){
+        auto* mapped = map_msix_table(bus, device, function, capability, entries);
+
+        if(!mapped){
+            return false;
+        }
+
+        msix_tables.push_back({bus, device, function, entries, mapped});
+        table = &msix_tables.back();
+    }
+
+    // The function is masked while the table is programmed
+    write_config_word(bus, device, function, capability + 2, control | MSIX_ENABLE | MSIX_FUNCTION_MASK);
+
+    for(size_t i = 0; i < entries; ++i){
+        if(i < n){
+            write_msix_entry(table->table, i, vectors[i], apic_id);
+        } else {
+            table->table[i * 4 + 3] = table->table[i * 4 + 3] | MSIX_ENTRY_MASKED;
+        }
+    }
+
+    // Disable the legacy interrupt line
+    auto command_register = read_config_word(bus, device, function, 0x4);
+    write_config_word(bus, device, function, 0x4, command_register | (1 << 10));
+
+    write_config_word(bus, device, function, capability + 2, (control | MSIX_ENABLE) & ~MSIX_FUNCTION_MASK);
+
+    logging::logf(logging::log_level::TRACE, "pci: MSI-X enabled with %u of %u vectors on %u:%u.%u\n",
+        n, entries, size_t(bus), size_t(device), size_t(function));
+
+    return true;
+}
+
+bool pci::route_msix(uint8_t bus, uint8_t device, uint8_t function, size_t entry, uint8_t vector, uint32_t apic_id){
+    auto* table = find_msix_table(bus, device, function);
+
+    if(!table || entry >= table->entries){
+        return false;
+    }
+
+    write_msix_entry(table->table, entry, vector, apic_id);
+
+    return true;
+}
@@ -11,6 +11,7 @@
 #include "interrupts.hpp"
 #include "scheduler.hpp"
 #include "kernel_utils.hpp"
+#include "profile.hpp"
 #include "logging.hpp"
 
 namespace {
@@ -19,9 +20,12 @@ constexpr const uint64_t PIT_FREQUENCY = 1000;
 
 size_t pit_counter = 0;
 
-void timer_handler(interrupt::syscall_regs*, void*){
+void timer_handler(interrupt::syscall_regs* regs, void*){
     ++pit_counter;
 
+    profile::sample(regs);
+    scheduler::account_tick(regs->cs & 0x3);
+
     timer::tick();
 }
 
@@ -5,21 +5,67 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <lock_guard.hpp>
+
 #include <tlib/errors.hpp>
 
 #include "drivers/ramdisk.hpp"
 
 #include "disks.hpp"
 #include "paging.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
 #include "logging.hpp"
 
 namespace {
 
-constexpr const size_t MAX_RAMDISK = 3;
+constexpr const size_t MAX_RAMDISK = 8;
+constexpr const size_t CHUNK_SIZE = paging::LARGE_PAGE_SIZE;
+constexpr const size_t CHUNK_PAGES = paging::LARGE_PAGE_PAGES;
 
 size_t current = 0;
 ramdisk::disk_descriptor ramdisks[MAX_RAMDISK];
 
+/*!
+ * \brief Returns the mapping of the given large page of the disk, allocated
+ * and zeroed if necessary
+ * \return The virtual address of the large page, nullptr if there is no memory
+ */
+char* allocate_chunk(ramdisk::disk_descriptor& disk, size_t chunk){
+    std::lock_guard<spinlock> l(disk.lock);
+
+    if(disk.allocated[chunk]){
+        return disk.allocated[chunk];
+    }
+
+    // Large pages are mapped at once, when it is aligned
+    auto physical = physical_allocator::allocate(CHUNK_PAGES);
+
+    if(!physical){
+        return nullptr;
+    }
+
+    auto virt = virtual_allocator::allocate(CHUNK_PAGES);
+
+    if(!virt || !paging::map_pages(virt, physical, CHUNK_PAGES)){
+        if(virt){
+            virtual_allocator::free(virt, CHUNK_PAGES);
+        }
+
+        physical_allocator::free(physical, CHUNK_PAGES);
+        return nullptr;
+    }
+
+    logging::logf(logging::log_level::TRACE, "ramdisk: Disk %u Allocated chunk %u \n", disk.id, chunk);
+
+    auto memory = reinterpret_cast<char*>(virt);
+    std::fill_n(memory, CHUNK_SIZE, 0);
+
+    disk.allocated[chunk] = memory;
+
+    return memory;
+}
+
 } //end of anonymous namespace
 
 ramdisk::disk_descriptor* ramdisk::make_disk(uint64_t max_size){
@@ -27,21 +73,23 @@ ramdisk::disk_descriptor* ramdisk::make_disk(uint64_t max_size){
         return nullptr;
     }
 
-    auto pages = paging::pages(max_size);
+    auto chunks = (max_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    auto& disk = ramdisks[current];
 
-    ramdisks[current].id = current;
-    ramdisks[current].max_size = max_size;
-    ramdisks[current].pages = pages;
-    ramdisks[current].allocated = new char*[pages];
+    disk.id = current;
+    disk.max_size = max_size;
+    disk.chunks = chunks;
+    disk.allocated = new char*[chunks];
 
-    for(size_t i = 0; i < pages; ++i){
-        ramdisks[current].allocated[i] = nullptr;
+    for(size_t i = 0; i < chunks; ++i){
+        disk.allocated[i] = nullptr;
     }
 
-    logging::logf(logging::log_level::ERROR, "ramdisk: Created ramdisk %u of size %m with %u pages\n", current, max_size, pages);
+    logging::logf(logging::log_level::TRACE, "ramdisk: Created ramdisk %u of size %m with %u large pages\n", current, max_size, chunks);
 
     ++current;
-    return &ramdisks[current - 1];
+    return &disk;
 }
 
 size_t ramdisk::ramdisk_driver::read(void* data, char* destination, size_t count, size_t offset, size_t& read){
@@ -50,22 +98,22 @@ size_t ramdisk::ramdisk_driver::read(void* data, char* destination, size_t count
     auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
     auto disk = reinterpret_cast<ramdisk::disk_descriptor*>(descriptor->descriptor);
 
-    if(offset + count >= disk->max_size){
+    if(offset + count > disk->max_size){
         logging::logf(logging::log_level::ERROR, "ramdisk: Tried to read too far\n");
         return std::ERROR_INVALID_OFFSET;
     }
 
     while(read != count){
-        auto page = offset / paging::PAGE_SIZE;
-        auto page_offset = offset % paging::PAGE_SIZE;
+        auto chunk = offset / CHUNK_SIZE;
+        auto chunk_offset = offset % CHUNK_SIZE;
 
-        auto to_read = std::min(paging::PAGE_SIZE - page_offset, count - read);
+        auto to_read = std::min(CHUNK_SIZE - chunk_offset, count - read);
 
-        // If the page is not allocated, we simply consider it full of zero
-        if(!disk->allocated[page]){
+        // If the chunk is not allocated, we simply consider it full of zero
+        if(!disk->allocated[chunk]){
             std::fill_n(destination + read, to_read, 0);
         } else {
-            std::copy_n(disk->allocated[page] + page_offset, to_read, destination + read);
+            std::copy_n(disk->allocated[chunk] + chunk_offset, to_read, destination + read);
         }
 
         read += to_read;
@@ -81,24 +129,24 @@ size_t ramdisk::ramdisk_driver::write(void* data, const char* source, size_t cou
     auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
     auto disk = reinterpret_cast<ramdisk::disk_descriptor*>(descriptor->descriptor);
 
-    if(offset + count >= disk->max_size){
+    if(offset + count > disk->max_size){
         logging::logf(logging::log_level::ERROR, "ramdisk: Tried to write too far\n");
         return std::ERROR_INVALID_OFFSET;
     }
 
     while(written != count){
-        auto page = offset / paging::PAGE_SIZE;
-        auto page_offset = offset % paging::PAGE_SIZE;
+        auto chunk = offset / CHUNK_SIZE;
+        auto chunk_offset = offset % CHUNK_SIZE;
 
-        if(!disk->allocated[page]){
-            logging::logf(logging::log_level::TRACE, "ramdisk: Disk %u Allocated page %u \n", disk->id, page);
+        auto memory = allocate_chunk(*disk, chunk);
 
-            disk->allocated[page] = new char[paging::PAGE_SIZE];
-            std::fill_n(disk->allocated[page], paging::PAGE_SIZE, 0);
+        if(!memory){
+            logging::logf(logging::log_level::ERROR, "ramdisk: Cannot allocate a large page for disk %u\n", disk->id);
+            return std::ERROR_DISK_FULL;
         }
 
-        uint64_t to_write = std::min(paging::PAGE_SIZE - page_offset, count - written);
-        std::copy_n(source, to_write, disk->allocated[page] + page_offset);
+        uint64_t to_write = std::min(CHUNK_SIZE - chunk_offset, count - written);
+        std::copy_n(source + written, to_write, memory + chunk_offset);
         written += to_write;
 
         offset += to_write;
@@ -113,21 +161,21 @@ size_t ramdisk::ramdisk_driver::clear(void* data, size_t count, size_t offset, s
     auto descriptor = reinterpret_cast<disks::disk_descriptor*>(data);
     auto disk = reinterpret_cast<ramdisk::disk_descriptor*>(descriptor->descriptor);
 
-    if(offset + count >= disk->max_size){
+    if(offset + count > disk->max_size){
         logging::logf(logging::log_level::ERROR, "ramdisk: Tried to write too far\n");
         return std::ERROR_INVALID_OFFSET;
     }
 
     while(written != count){
-        auto page = offset / paging::PAGE_SIZE;
-        auto page_offset = offset % paging::PAGE_SIZE;
+        auto chunk = offset / CHUNK_SIZE;
+        auto chunk_offset = offset % CHUNK_SIZE;
 
-        uint64_t to_write = std::min(paging::PAGE_SIZE - page_offset, count - written);
+        uint64_t to_write = std::min(CHUNK_SIZE - chunk_offset, count - written);
 
-        // No need to allocate page, they are filled with zeros the
+        // No need to allocate chunks, they are filled with zeros the
         // first time they are allocated
-        if(disk->allocated[page]){
-            std::fill_n(disk->allocated[page] + page_offset, to_write, 0);
+        if(disk->allocated[chunk]){
+            std::fill_n(disk->allocated[chunk] + chunk_offset, to_write, 0);
         }
 
         written += to_write;
@@ -10,6 +10,8 @@
 #include "acpi.hpp"
 #include "acpica.hpp"
 #include "logging.hpp"
+#include "clocksource.hpp"
+#include "work_queue.hpp"
 
 namespace {
 
@@ -17,6 +19,11 @@ namespace {
 #define cmos_address        0x70
 #define cmos_data           0x71
 
+constexpr const size_t RESYNC_MS = 60 * 1000;           ///< The delay between two synchronizations with the CMOS
+constexpr const uint64_t MAX_DRIFT = 1000 * 1000 * 1000; ///< The drift (ns) from the CMOS tolerated, its resolution
+
+volatile uint64_t offset = 0; ///< The nanoseconds since the epoch at boot, 0 if unknown
+
 int get_update_in_progress_flag(){
     out_byte(cmos_address, 0x0A);
     return (in_byte(cmos_data) & 0x80);
@@ -27,9 +34,7 @@ uint8_t get_RTC_register(int reg){
     return in_byte(cmos_data);
 }
 
-} //end of anonymous namespace
-
-rtc::datetime rtc::all_data(){
+rtc::datetime read_cmos(){
     uint8_t second;
     uint8_t minute;
     uint8_t hour;
@@ -125,3 +130,55 @@ rtc::datetime rtc::all_data(){
 
     return {full_year, month, day, hour, minute, second, 0, 0};
 }
+
+/*!
+ * \brief Returns the nanoseconds since the epoch at boot, from the CMOS
+ */
+uint64_t cmos_offset(){
+    auto seconds = rtc::epoch_seconds(read_cmos());
+
+    return seconds * 1000000000 - clocksource::nanoseconds();
+}
+
+void resync_task(void*);
+
+work_queue::work resync_work = {&resync_task, nullptr, nullptr, 0, false};
+
+void resync_task(void*){
+    auto current = offset;
+    auto cmos = cmos_offset();
+
+    // The CMOS has a resolution of one second, a smaller difference is
+    // not a drift of the monotonic clock
+    auto drift = cmos > current ? cmos - current : current - cmos;
+
+    if(drift > MAX_DRIFT){
+        logging::logf(logging::log_level::DEBUG, "rtc: Correct a drift of %u ms\n", size_t(drift / 1000000));
+
+        offset = cmos;
+    }
+
+    work_queue::submit_delayed(resync_work, RESYNC_MS);
+}
+
+} //end of anonymous namespace
+
+void rtc::init(){
+    offset = cmos_offset();
+
+    work_queue::submit_delayed(resync_work, RESYNC_MS);
+}
+
+uint64_t rtc::epoch_offset(){
+    return offset;
+}
+
+rtc::datetime rtc::all_data(){
+    auto current = offset;
+
+    if(!current){
+        return read_cmos();
+    }
+
+    return rtc::epoch_date(current + clocksource::nanoseconds());
+}
@@ -18,6 +18,7 @@
 #include "physical_allocator.hpp"
 #include "virtual_allocator.hpp"
 #include "interrupts.hpp"
+#include "softirq.hpp"
 #include "paging.hpp"
 
 #define MAC0 0x00
@@ -67,6 +68,7 @@
 namespace {
 
 constexpr const size_t tx_buffers = 4;
+constexpr const size_t rx_packets = 128; ///< The number of packets of the reception pool
 constexpr const size_t tx_buffer_size = 0x2000;
 
 struct tx_desc_t {
@@ -88,93 +90,149 @@ struct rtl8139_t {
     mutex tx_lock;
     deferred_unique_semaphore tx_sem;
 
+    volatile bool polling; //Indicates if the reception interrupt is masked
+
+    size_t tx_softirq; //The bottom half reclaiming the transmitted buffers
+
     network::interface_descriptor* interface;
 };
 
-void packet_handler(interrupt::syscall_regs*, void* data){
-    auto& desc = *static_cast<rtl8139_t*>(data);
-    auto& interface = *desc.interface;
+bool rx_empty(rtl8139_t& desc){
+    return in_byte(desc.iobase + CMD) & CMD_NOT_EMPTY;
+}
 
-    // Get the interrupt status
-    auto status = in_word(desc.iobase + ISR);
+// Receive the packet at the head of the ring
+void receive_packet(rtl8139_t& desc, network::interface_descriptor& interface){
+    auto cur_rx = desc.cur_rx;
+    auto cur_offset = cur_rx % 0x3000;
+    auto buffer_rx = reinterpret_cast<char*>(desc.buffer_rx);
 
-    // Acknowledge the handling of the packet
-    out_word(desc.iobase + ISR, status);
+    auto packet_status = *reinterpret_cast<uint32_t*>(buffer_rx + cur_offset);
+    auto packet_length = packet_status >> 16; //Extract the size from the header
+    auto packet_payload = buffer_rx + cur_offset + 4; //Skip the packet header (NIC)
 
-    if(status & RX_OK){
-        logging::logf(logging::log_level::TRACE, "rtl8139: Packet received correctly OK\n");
+    if (packet_status & (RX_BAD_SYMBOL | RX_RUNT | RX_TOO_LONG | RX_CRC_ERR | RX_BAD_ALIGN)) {
+        subsystem_logf(NIC, TRACE, "rtl8139: Packet Error, status:%u\n", uint64_t(packet_status));
 
-        auto cur_rx = desc.cur_rx;
+        //TODO We should probably reset the controller ?
+    } else if(packet_length == 0){
+        // TODO Normally this should not happen, it probably indicates a bug somewhere
+        subsystem_logf(NIC, TRACE, "rtl8139: Packet Error Length = 0, status:%u\n", uint64_t(packet_status));
+    } else {
+        // Omit CRC from the length
+        auto packet_only_length = packet_length - 4;
 
-        while((in_byte(desc.iobase + CMD) & CMD_NOT_EMPTY) == 0){
-            auto cur_offset = cur_rx % 0x3000;
-            auto buffer_rx = reinterpret_cast<char*>(desc.buffer_rx);
+        subsystem_logf(NIC, TRACE, "rtl8139: Packet OK length:%u\n", uint64_t(packet_only_length));
 
-            auto packet_status = *reinterpret_cast<uint32_t*>(buffer_rx + cur_offset);
-            auto packet_length = packet_status >> 16; //Extract the size from the header
-            auto packet_payload = buffer_rx + cur_offset + 4; //Skip the packet header (NIC)
+        // The frame is copied once, out of the ring, into a packet of the pool
+        auto packet = interface.rx_pool.allocate(packet_payload, packet_only_length);
 
-            if (packet_status & (RX_BAD_SYMBOL | RX_RUNT | RX_TOO_LONG | RX_CRC_ERR | RX_BAD_ALIGN)) {
-                logging::logf(logging::log_level::TRACE, "rtl8139: Packet Error, status:%u\n", uint64_t(packet_status));
+        if(!packet){
+            auto packet_buffer = new char[packet_only_length];
 
-                //TODO We should probably reset the controller ?
-            } else if(packet_length == 0){
-                // TODO Normally this should not happen, it probably indicates a bug somewhere
-                logging::logf(logging::log_level::TRACE, "rtl8139: Packet Error Length = 0, status:%u\n", uint64_t(packet_status));
-            } else {
-                // Omit CRC from the length
-                auto packet_only_length = packet_length - 4;
+            std::copy_n(packet_payload, packet_only_length, packet_buffer);
 
-                logging::logf(logging::log_level::TRACE, "rtl8139: Packet OK length:%u\n", uint64_t(packet_only_length));
+            packet = std::make_intrusive<network::packet>(packet_buffer, packet_only_length);
+        }
 
-                auto packet_buffer = new char[packet_only_length];
+        interface.poll_receive(std::move(packet));
+    }
 
-                std::copy_n(packet_payload, packet_only_length, packet_buffer);
+    cur_rx = (cur_rx + packet_length + 4 + 3) & ~3; //align on 4 bytes
+    out_word(desc.iobase + RX_BUF_PTR, cur_rx - 0x10);
 
-                interface.rx_queue.emplace(std::make_shared<network::packet>(packet_buffer, packet_only_length));
-                interface.rx_sem.notify();
-            }
+    desc.cur_rx = cur_rx;
 
-            cur_rx = (cur_rx + packet_length + 4 + 3) & ~3; //align on 4 bytes
-            out_word(desc.iobase + RX_BUF_PTR, cur_rx - 0x10);
+    subsystem_logf(NIC, TRACE, "rtl8139: Packet Handled\n");
+}
+
+size_t poll_packets(network::interface_descriptor& interface, size_t budget){
+    auto& desc = *static_cast<rtl8139_t*>(interface.driver_data);
 
-            logging::logf(logging::log_level::TRACE, "rtl8139: Packet Handled\n");
+    size_t received = 0;
+
+    while(true){
+        while(received < budget && !rx_empty(desc)){
+            receive_packet(desc, interface);
+            ++received;
         }
 
-        desc.cur_rx = cur_rx;
+        if(received == budget){
+            return received;
+        }
+
+        // A packet arriving after the acknowledge raises an interrupt once unmasked
+        out_word(desc.iobase + ISR, RX_OK);
+
+        if(rx_empty(desc)){
+            direct_int_lock lock;
+
+            desc.polling = false;
+            out_word(desc.iobase + IMR, RX_OK | TX_OK | TX_ERR);
+
+            return received;
+        }
     }
+}
 
-    if(status & (TX_OK | TX_ERR)){
-        auto& dirty_tx = desc.dirty_tx;
-        size_t cleaned_up = 0;
+void tx_handler(void* data){
+    auto& desc = *static_cast<rtl8139_t*>(data);
 
-        while(desc.cur_tx - dirty_tx > 0){
-            auto entry = dirty_tx % tx_buffers;
+    auto& dirty_tx = desc.dirty_tx;
+    size_t cleaned_up = 0;
 
-            auto tx_status = in_dword(desc.iobase + TX_STATUS + entry * 4);
+    while(desc.cur_tx - dirty_tx > 0){
+        auto entry = dirty_tx % tx_buffers;
 
-            // Check if the packet has already been transmitted
-            if(!(tx_status & (TX_STATUS_OK | TX_STATUS_ABORTED | TX_STATUS_UNDERRUN))){
-                break;
-            }
+        auto tx_status = in_dword(desc.iobase + TX_STATUS + entry * 4);
+
+        // Check if the packet has already been transmitted
+        if(!(tx_status & (TX_STATUS_OK | TX_STATUS_ABORTED | TX_STATUS_UNDERRUN))){
+            break;
+        }
 
-            if(tx_status & (TX_STATUS_OUT_OF_WINDOW | TX_STATUS_ABORTED)){
-                if(tx_status & TX_STATUS_CARRIER_LOST){
-                    logging::logf(logging::log_level::ERROR, "rtl8139: Carrier lost\n");
-                } else if (tx_status & TX_STATUS_OUT_OF_WINDOW){
-                    logging::logf(logging::log_level::ERROR, "rtl8139: Out of window\n");
-                } else {
-                    logging::logf(logging::log_level::TRACE, "rtl8139: Packet abortd\n");
-                }
+        if(tx_status & (TX_STATUS_OUT_OF_WINDOW | TX_STATUS_ABORTED)){
+            if(tx_status & TX_STATUS_CARRIER_LOST){
+                logging::logf(logging::log_level::ERROR, "rtl8139: Carrier lost\n");
+            } else if (tx_status & TX_STATUS_OUT_OF_WINDOW){
+                logging::logf(logging::log_level::ERROR, "rtl8139: Out of window\n");
             } else {
-                logging::logf(logging::log_level::TRACE, "rtl8139: Packet transmitted correctly\n");
+                subsystem_logf(NIC, TRACE, "rtl8139: Packet abortd\n");
             }
-
-            ++cleaned_up;
-            ++dirty_tx;
+        } else {
+            subsystem_logf(NIC, TRACE, "rtl8139: Packet transmitted correctly\n");
         }
 
-        desc.tx_sem.notify(cleaned_up);
+        ++cleaned_up;
+        ++dirty_tx;
+    }
+
+    desc.tx_sem.notify(cleaned_up);
+}
+
+void packet_handler(interrupt::syscall_regs*, void* data){
+    auto& desc = *static_cast<rtl8139_t*>(data);
+    auto& interface = *desc.interface;
+
+    // Get the interrupt status
+    auto status = in_word(desc.iobase + ISR);
+
+    // Acknowledge the handling of the packet
+    out_word(desc.iobase + ISR, status);
+
+    // The ring is emptied by the rx thread, the reception interrupt stays
+    // masked until it is empty
+    if(status & RX_OK && !desc.polling){
+        desc.polling = true;
+
+        out_word(desc.iobase + IMR, TX_OK | TX_ERR);
+
+        interface.schedule_poll();
+    }
+
+    // The transmitted buffers are reclaimed by the bottom half
+    if(status & (TX_OK | TX_ERR)){
+        softirq::raise(desc.tx_softirq);
     }
 
     if(!(status & (RX_OK | TX_OK | TX_ERR))){
@@ -185,7 +243,7 @@ void packet_handler(interrupt::syscall_regs*, void* data){
 }
 
 void send_packet(network::interface_descriptor& interface, network::packet_p& packet){
-    logging::logf(logging::log_level::TRACE, "rtl8139: Start transmitting packet (%p)\n", packet.get());
+    subsystem_logf(NIC, TRACE, "rtl8139: Start transmitting packet (%p)\n", packet.get());
 
     auto* ether_header = reinterpret_cast<network::ethernet::header*>(packet->payload);
 
@@ -194,11 +252,10 @@ void send_packet(network::interface_descriptor& interface, network::packet_p& pa
         {
             direct_int_lock lock;
 
-            interface.rx_queue.push(packet);
-            interface.rx_sem.notify();
+            interface.receive_local(packet);
         }
 
-        logging::logf(logging::log_level::TRACE, "rtl8139: Packet to self transmitted correctly\n");
+        subsystem_logf(NIC, TRACE, "rtl8139: Packet to self transmitted correctly\n");
 
         return;
     }
@@ -228,15 +285,17 @@ void send_packet(network::interface_descriptor& interface, network::packet_p& pa
 } //end of anonymous namespace
 
 void rtl8139::init_driver(network::interface_descriptor& interface, pci::device_descriptor& pci_device){
-    logging::logf(logging::log_level::TRACE, "rtl8139: Initialize RTL8139 driver on pci:%u:%u:%u\n", uint64_t(pci_device.bus), uint64_t(pci_device.device), uint64_t(pci_device.function));
+    subsystem_logf(NIC, TRACE, "rtl8139: Initialize RTL8139 driver on pci:%u:%u:%u\n", uint64_t(pci_device.bus), uint64_t(pci_device.device), uint64_t(pci_device.function));
 
     rtl8139_t* desc = new rtl8139_t();
 
     interface.driver_data = desc;
     interface.hw_send = send_packet;
+    interface.hw_poll = poll_packets;
 
     desc->tx_sem.init(tx_buffers);
 
+
     for(size_t i = 0; i < tx_buffers; ++i){
         auto& tx_desc = desc->tx_desc[i];
 
@@ -259,7 +318,7 @@ void rtl8139::init_driver(network::interface_descriptor& interface, pci::device_
     auto iobase = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x10) & (~0x3);
     desc->iobase = iobase;
 
-    logging::logf(logging::log_level::TRACE, "rtl8139: I/O Base address :%h\n", uint64_t(iobase));
+    subsystem_logf(NIC, TRACE, "rtl8139: I/O Base address :%h\n", uint64_t(iobase));
 
     // 3. Power on the device
 
@@ -287,22 +346,27 @@ void rtl8139::init_driver(network::interface_descriptor& interface, pci::device_
     desc->cur_rx = 0;
     desc->cur_tx = 0;
     desc->dirty_tx = 0;
+    desc->polling = false;
 
     std::fill_n(reinterpret_cast<char*>(desc->buffer_rx), 0x3000, 0);
 
-    logging::logf(logging::log_level::TRACE, "rtl8139: Physical RX Buffer :%h\n", uint64_t(desc->phys_buffer_rx));
-    logging::logf(logging::log_level::TRACE, "rtl8139: Virtual RX Buffer :%h\n", uint64_t(desc->buffer_rx));
+    subsystem_logf(NIC, TRACE, "rtl8139: Physical RX Buffer :%h\n", uint64_t(desc->phys_buffer_rx));
+    subsystem_logf(NIC, TRACE, "rtl8139: Virtual RX Buffer :%h\n", uint64_t(desc->buffer_rx));
 
     // 6. Register IRQ handler
 
     auto irq = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x3c) & 0xFF;
+    if(!softirq::register_handler(desc->tx_softirq, tx_handler, desc)){
+        logging::logf(logging::log_level::ERROR, "rtl8139: Unable to register the transmission softirq\n");
+    }
+
     if(!interrupt::register_irq_handler(irq, packet_handler, desc)){
         logging::logf(logging::log_level::ERROR, "rtl8139: Unable to register IRQ handler %u\n", irq);
     }
 
     // 7. Set IMR + ISR
 
-    logging::logf(logging::log_level::TRACE, "rtl8139: IRQ :%u\n", uint64_t(irq));
+    subsystem_logf(NIC, TRACE, "rtl8139: IRQ :%u\n", uint64_t(irq));
 
     // Enable some interrupts
     out_word(iobase + IMR, RX_OK | TX_OK | TX_ERR);
@@ -326,10 +390,13 @@ void rtl8139::init_driver(network::interface_descriptor& interface, pci::device_
 
     interface.mac_address = mac;
 
-    logging::logf(logging::log_level::TRACE, "rtl8139: MAC Address %h \n", mac);
+    subsystem_logf(NIC, TRACE, "rtl8139: MAC Address %h \n", mac);
 }
 
 void rtl8139::finalize_driver(network::interface_descriptor& interface){
     auto* desc = static_cast<rtl8139_t*>(interface.driver_data);
     desc->interface = &interface;
+
+    // The pool refers to the interface, which does not move anymore
+    interface.rx_pool.init(rx_packets);
 }
@@ -5,12 +5,61 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <lock_guard.hpp>
+
 #include "drivers/serial.hpp"
 
+#include "conc/int_spinlock.hpp"
+
 #include "kernel_utils.hpp"
+#include "interrupts.hpp"
+#include "logging.hpp"
 
 #define COM1_PORT 0x3f8
 
+namespace {
+
+constexpr const size_t COM1_IRQ = 4;
+constexpr const size_t TX_RING_SIZE = 16384; ///< The characters buffered before the UART
+constexpr const size_t FIFO_SIZE = 16;       ///< The size of the transmit FIFO of the 16550
+
+constexpr const uint8_t IER_THR_EMPTY = 0x02; ///< Interrupt when the transmit FIFO is empty
+constexpr const uint8_t IIR_THR_EMPTY = 0x02; ///< The transmit FIFO empty interrupt identification
+
+int_spinlock tx_lock;       ///< Protect the ring and the transmitter
+char tx_ring[TX_RING_SIZE]; ///< The characters waiting for the transmitter
+size_t tx_head = 0;         ///< The total number of buffered characters
+size_t tx_tail = 0;         ///< The total number of characters sent to the UART
+bool buffered = false;      ///< Indicates if the transmit interrupt is used
+
+// Fill the transmit FIFO from the ring, must be called with the lock
+void fill_fifo(){
+    // The FIFO is only refilled once empty, it cannot overflow
+    if(!serial::is_transmit_buffer_empty()){
+        return;
+    }
+
+    for(size_t n = 0; tx_tail != tx_head && n < FIFO_SIZE; ++n){
+        out_byte(COM1_PORT, tx_ring[tx_tail % TX_RING_SIZE]);
+        ++tx_tail;
+    }
+}
+
+void serial_handler(interrupt::syscall_regs*, void*){
+    // Reading the identification acknowledges the transmit interrupt
+    auto iir = in_byte(COM1_PORT + 2);
+
+    if((iir & 0x0F) != IIR_THR_EMPTY){
+        return;
+    }
+
+    std::lock_guard<int_spinlock> l(tx_lock);
+
+    fill_fifo();
+}
+
+} //end of anonymous namespace
+
 void serial::init() {
    out_byte(COM1_PORT + 1, 0x00);    // Disable all interrupts
    out_byte(COM1_PORT + 3, 0x80);    // Enable DLAB
@@ -21,12 +70,59 @@ void serial::init() {
    out_byte(COM1_PORT + 4, 0x0B);    // IRQs enabled, RTS/DSR set
 }
 
+void serial::install() {
+    if(!interrupt::register_irq_handler(COM1_IRQ, serial_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "serial: Unable to register IRQ handler %u\n", COM1_IRQ);
+        return;
+    }
+
+    // The characters transmitted so far were polled
+    while(!is_transmit_buffer_empty()){}
+
+    std::lock_guard<int_spinlock> l(tx_lock);
+
+    out_byte(COM1_PORT + 1, IER_THR_EMPTY);
+
+    buffered = true;
+}
+
 bool serial::is_transmit_buffer_empty() {
    return in_byte(COM1_PORT + 5) & 0x20;
 }
 
 void serial::transmit(char a) {
-   while (is_transmit_buffer_empty() == 0){}
+    if(!buffered){
+        while (is_transmit_buffer_empty() == 0){}
+
+        out_byte(COM1_PORT,a);
+
+        return;
+    }
+
+    std::lock_guard<int_spinlock> l(tx_lock);
+
+    // With a full ring, the oldest character is sent synchronously
+    if(tx_head - tx_tail == TX_RING_SIZE){
+        while (is_transmit_buffer_empty() == 0){}
+
+        out_byte(COM1_PORT, tx_ring[tx_tail % TX_RING_SIZE]);
+        ++tx_tail;
+    }
+
+    tx_ring[tx_head % TX_RING_SIZE] = a;
+    ++tx_head;
+
+    // An idle transmitter must be started, the interrupt refills it afterwards
+    fill_fifo();
+}
+
+void serial::flush() {
+    std::lock_guard<int_spinlock> l(tx_lock);
+
+    while(tx_tail != tx_head){
+        while (is_transmit_buffer_empty() == 0){}
 
-   out_byte(COM1_PORT,a);
+        out_byte(COM1_PORT, tx_ring[tx_tail % TX_RING_SIZE]);
+        ++tx_tail;
+    }
 }
@@ -0,0 +1,633 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include "drivers/virtio_net.hpp"
+
+#include "conc/mutex.hpp"
+#include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
+
+#include "net/ethernet_layer.hpp"
+#include "net/checksum.hpp"
+
+#include "logging.hpp"
+#include "kernel_utils.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "interrupts.hpp"
+#include "softirq.hpp"
+#include "paging.hpp"
+
+// Registers of the legacy PCI interface, from the I/O base
+#define DEVICE_FEATURES 0x00
+#define GUEST_FEATURES 0x04
+#define QUEUE_ADDRESS 0x08
+#define QUEUE_SIZE 0x0C
+#define QUEUE_SELECT 0x0E
+#define QUEUE_NOTIFY 0x10
+#define DEVICE_STATUS 0x12
+#define ISR_STATUS 0x13
+#define DEVICE_CONFIG 0x14 // The MAC address, without MSI-X
+
+#define STATUS_ACKNOWLEDGE 0x1
+#define STATUS_DRIVER 0x2
+#define STATUS_DRIVER_OK 0x4
+#define STATUS_FAILED 0x80
+
+#define ISR_QUEUE 0x1
+
+#define F_CSUM       (1 << 0)  // The device completes partial checksums
+#define F_GUEST_CSUM (1 << 1)  // The driver completes partial checksums
+#define F_MAC        (1 << 5)  // The device has a MAC address
+#define F_MRG_RXBUF  (1 << 15) // A packet can be received into several buffers
+
+#define DESC_NEXT 0x1
+#define DESC_WRITE 0x2
+
+#define AVAIL_NO_INTERRUPT 0x1
+#define USED_NO_NOTIFY 0x1
+
+#define HDR_NEEDS_CSUM 0x1
+#define HDR_DATA_VALID 0x2
+#define HDR_GSO_NONE 0x0
+
+namespace {
+
+constexpr const uint16_t RX_QUEUE = 0;
+constexpr const uint16_t TX_QUEUE = 1;
+
+constexpr const size_t rx_buffers = 128;      ///< The maximum number of buffers posted for reception
+constexpr const size_t tx_buffers = 64;       ///< The maximum number of packets in transmission
+constexpr const size_t buffer_size = 2048;    ///< The size of a reception or transmission buffer
+constexpr const size_t tx_header_space = 16;  ///< The space for the header in front of a transmitted packet
+constexpr const size_t rx_packets = 128;      ///< The number of packets of the reception pool
+
+struct virtq_desc {
+    uint64_t address;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t length;
+} __attribute__((packed));
+
+struct virtio_net_header {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t header_length;
+    uint16_t gso_size;
+    uint16_t checksum_start;
+    uint16_t checksum_offset;
+    uint16_t num_buffers; // Only with mergeable buffers
+} __attribute__((packed));
+
+/*!
+ * \brief A split virtqueue, in the legacy layout
+ */
+struct virtqueue {
+    uint16_t size; ///< The number of descriptors
+
+    virtq_desc* desc;          ///< The descriptor table
+    volatile uint16_t* avail;  ///< The available ring: flags, index and ring
+    volatile uint16_t* used;   ///< The used ring: flags, index and elements
+
+    uint16_t avail_index; ///< The next index in the available ring
+    uint16_t last_used;   ///< The index of the next used element to process
+
+    volatile uint16_t& avail_flags(){
+        return avail[0];
+    }
+
+    uint16_t used_index() const {
+        return __atomic_load_n(&used[1], __ATOMIC_ACQUIRE);
+    }
+
+    virtq_used_elem used_elem(uint16_t index) const {
+        auto* ring = reinterpret_cast<volatile virtq_used_elem*>(used + 2);
+        auto& elem = ring[index % size];
+        return {elem.id, elem.length};
+    }
+
+    void make_available(uint16_t head){
+        avail[2 + avail_index++ % size] = head;
+    }
+
+    // Publish the new available descriptors to the device
+    void publish(){
+        __atomic_store_n(&avail[1], avail_index, __ATOMIC_RELEASE);
+    }
+
+    bool needs_notify() const {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        return !(used[0] & USED_NO_NOTIFY);
+    }
+};
+
+struct virtio_net_t {
+    uint32_t iobase;
+
+    size_t header_size; //The size of the header, depending on the mergeable buffers
+    bool mergeable;
+
+    virtqueue rx;
+    virtqueue tx;
+
+    size_t rx_count;      //The number of reception buffers
+    char* rx_virt;        //The reception buffers
+
+    size_t tx_count;      //The number of transmission buffers
+    char* tx_virt;        //The transmission buffers
+
+    int_spinlock tx_free_lock;
+    uint16_t tx_free[tx_buffers]; //The free transmission buffers
+    size_t tx_free_count;
+
+    mutex tx_lock;
+    deferred_unique_semaphore tx_sem;
+
+    bool polling; //Indicates if the reception interrupt is suppressed
+
+    size_t tx_softirq; //The bottom half reclaiming the transmitted buffers
+
+    network::interface_descriptor* interface;
+};
+
+size_t pages(size_t bytes){
+    return (bytes + paging::PAGE_SIZE - 1) / paging::PAGE_SIZE;
+}
+
+// Allocate physically contiguous memory, returns the virtual address
+char* allocate_dma(size_t bytes, size_t& physical){
+    auto n = pages(bytes);
+
+    physical = physical_allocator::allocate(n);
+    auto virt = virtual_allocator::allocate(n);
+
+    if(!physical || !virt || !paging::map_pages(virt, physical, n)){
+        logging::logf(logging::log_level::ERROR, "virtio_net: Unable to map %h into %h\n", physical, virt);
+        return nullptr;
+    }
+
+    std::fill_n(reinterpret_cast<char*>(virt), n * paging::PAGE_SIZE, 0);
+
+    return reinterpret_cast<char*>(virt);
+}
+
+bool init_queue(virtio_net_t& desc, virtqueue& queue, uint16_t index){
+    out_word(desc.iobase + QUEUE_SELECT, index);
+
+    // The size of a legacy queue is fixed by the device
+    queue.size = in_word(desc.iobase + QUEUE_SIZE);
+
+    if(!queue.size){
+        logging::logf(logging::log_level::ERROR, "virtio_net: Queue %u not available\n", size_t(index));
+        return false;
+    }
+
+    auto desc_bytes = queue.size * sizeof(virtq_desc);
+    auto avail_bytes = 2 * (3 + queue.size);
+    auto used_offset = pages(desc_bytes + avail_bytes) * paging::PAGE_SIZE;
+    auto used_bytes = 2 * 3 + queue.size * sizeof(virtq_used_elem);
+
+    size_t physical;
+    auto* memory = allocate_dma(used_offset + used_bytes, physical);
+
+    if(!memory){
+        return false;
+    }
+
+    queue.desc = reinterpret_cast<virtq_desc*>(memory);
+    queue.avail = reinterpret_cast<volatile uint16_t*>(memory + desc_bytes);
+    queue.used = reinterpret_cast<volatile uint16_t*>(memory + used_offset);
+    queue.avail_index = 0;
+    queue.last_used = 0;
+
+    out_dword(desc.iobase + QUEUE_ADDRESS, physical / paging::PAGE_SIZE);
+
+    subsystem_logf(NIC, TRACE, "virtio_net: Queue %u: %u descriptors at %h\n", size_t(index), size_t(queue.size), physical);
+
+    return true;
+}
+
+void notify(virtio_net_t& desc, virtqueue& queue, uint16_t index){
+    if(queue.needs_notify()){
+        out_word(desc.iobase + QUEUE_NOTIFY, index);
+    }
+}
+
+// Receive the packet of the next used element, and give back its buffers
+void receive_packet(virtio_net_t& desc, network::interface_descriptor& interface){
+    auto& rx = desc.rx;
+
+    auto elem = rx.used_elem(rx.last_used++);
+
+    auto* buffer = desc.rx_virt + elem.id * buffer_size;
+    auto* header = reinterpret_cast<virtio_net_header*>(buffer);
+
+    size_t buffers = 1;
+    if(desc.mergeable && header->num_buffers > 1){
+        buffers = header->num_buffers;
+    }
+
+    // The device publishes all the buffers of a packet at once
+    size_t first_length = elem.length > desc.header_size ? elem.length - desc.header_size : 0;
+    size_t length = first_length;
+    for(size_t i = 1; i < buffers; ++i){
+        length += rx.used_elem(rx.last_used + i - 1).length;
+    }
+
+    network::packet_p packet;
+
+    if(buffers == 1){
+        packet = interface.rx_pool.allocate(buffer + desc.header_size, length);
+    }
+
+    if(!packet && length){
+        auto* packet_buffer = new char[length];
+
+        std::copy_n(buffer + desc.header_size, first_length, packet_buffer);
+
+        auto* destination = packet_buffer + first_length;
+
+        for(size_t i = 1; i < buffers; ++i){
+            auto next = rx.used_elem(rx.last_used + i - 1);
+
+            std::copy_n(desc.rx_virt + next.id * buffer_size, next.length, destination);
+            destination += next.length;
+        }
+
+        packet = std::make_intrusive<network::packet>(packet_buffer, length);
+    }
+
+    if(packet && header->flags & HDR_NEEDS_CSUM){
+        network::checksum_complete(packet->payload, length, header->checksum_start, header->checksum_offset);
+    }
+
+    // A partial checksum comes from the host itself, it can not be corrupted
+    if(packet && header->flags & (HDR_NEEDS_CSUM | HDR_DATA_VALID)){
+        packet->checksum_verified |= network::CHECKSUM_RX_L4;
+    }
+
+    rx.make_available(elem.id);
+
+    for(size_t i = 1; i < buffers; ++i){
+        rx.make_available(rx.used_elem(rx.last_used++).id);
+    }
+
+    if(packet){
+        subsystem_logf(NIC, TRACE, "virtio_net: Packet OK length:%u buffers:%u\n", length, buffers);
+
+        interface.poll_receive(std::move(packet));
+    } else {
+        subsystem_logf(NIC, TRACE, "virtio_net: Empty packet\n");
+    }
+}
+
+size_t poll_packets(network::interface_descriptor& interface, size_t budget){
+    auto& desc = *static_cast<virtio_net_t*>(interface.driver_data);
+    auto& rx = desc.rx;
+
+    size_t received = 0;
+
+    while(true){
+        while(received < budget && rx.last_used != rx.used_index()){
+            receive_packet(desc, interface);
+            ++received;
+        }
+
+        // Give the buffers back to the device
+        rx.publish();
+        notify(desc, rx, RX_QUEUE);
+
+        if(received == budget){
+            return received;
+        }
+
+        __atomic_store_n(&desc.polling, false, __ATOMIC_SEQ_CST);
+        rx.avail_flags() = 0;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        // A packet used after this check raises an interrupt
+        if(rx.last_used == rx.used_index()){
+            return received;
+        }
+
+        // Otherwise, continue unless the interrupt handler scheduled a poll already
+        if(__atomic_exchange_n(&desc.polling, true, __ATOMIC_SEQ_CST)){
+            return received;
+        }
+
+        rx.avail_flags() = AVAIL_NO_INTERRUPT;
+    }
+}
+
+void tx_handler(void* data){
+    auto& desc = *static_cast<virtio_net_t*>(data);
+
+    auto& tx = desc.tx;
+    size_t cleaned_up = 0;
+
+    {
+        std::lock_guard<int_spinlock> l(desc.tx_free_lock);
+
+        while(tx.last_used != tx.used_index()){
+            auto elem = tx.used_elem(tx.last_used++);
+
+            desc.tx_free[desc.tx_free_count++] = elem.id / 2;
+            ++cleaned_up;
+        }
+    }
+
+    if(cleaned_up){
+        subsystem_logf(NIC, TRACE, "virtio_net: %u packets transmitted\n", cleaned_up);
+
+        desc.tx_sem.notify(cleaned_up);
+    }
+}
+
+void packet_handler(interrupt::syscall_regs*, void* data){
+    auto& desc = *static_cast<virtio_net_t*>(data);
+    auto& interface = *desc.interface;
+
+    // Reading the status acknowledges the interrupt
+    auto status = in_byte(desc.iobase + ISR_STATUS);
+
+    if(!(status & ISR_QUEUE)){
+        return;
+    }
+
+    // The transmitted buffers are reclaimed by the bottom half
+    if(desc.tx.last_used != desc.tx.used_index()){
+        softirq::raise(desc.tx_softirq);
+    }
+
+    // The used buffers are processed by the rx thread, without interrupts
+    auto& rx = desc.rx;
+
+    if(rx.last_used != rx.used_index() && !__atomic_exchange_n(&desc.polling, true, __ATOMIC_SEQ_CST)){
+        rx.avail_flags() = AVAIL_NO_INTERRUPT;
+
+        interface.schedule_poll();
+    }
+}
+
+// Publish the packets made available since the last flush, and notify the device
+void flush_packets(network::interface_descriptor& interface){
+    auto& desc = *reinterpret_cast<virtio_net_t*>(interface.driver_data);
+
+    desc.tx.publish();
+
+    notify(desc, desc.tx, TX_QUEUE);
+}
+
+void send_packet(network::interface_descriptor& interface, network::packet_p& packet){
+    subsystem_logf(NIC, TRACE, "virtio_net: Start transmitting packet (%p)\n", packet.get());
+
+    auto* ether_header = reinterpret_cast<network::ethernet::header*>(packet->payload);
+
+    // Shortcut packet to self directly to the rx queue
+    if(network::ethernet::mac6_to_mac64(ether_header->target.mac) == interface.mac_address){
+        if(packet->checksum_start){
+            network::checksum_complete(packet->payload, packet->payload_size, packet->checksum_start, packet->checksum_offset);
+        }
+
+        {
+            direct_int_lock lock;
+
+            interface.receive_local(packet);
+        }
+
+        subsystem_logf(NIC, TRACE, "virtio_net: Packet to self transmitted correctly\n");
+
+        return;
+    }
+
+    auto& desc = *reinterpret_cast<virtio_net_t*>(interface.driver_data);
+
+    if(packet->payload_size > buffer_size - tx_header_space){
+        logging::logf(logging::log_level::ERROR, "virtio_net: Packet too large (%u)\n", packet->payload_size);
+        return;
+    }
+
+    desc.tx_lock.lock();
+
+    bool full;
+
+    {
+        std::lock_guard<int_spinlock> l(desc.tx_free_lock);
+
+        full = !desc.tx_free_count;
+    }
+
+    // The buffers are only released once the device sees the batch
+    if(full){
+        flush_packets(interface);
+    }
+
+    // Wait for a free transmission buffer
+    desc.tx_sem.claim();
+    desc.tx_sem.wait();
+
+    uint16_t slot;
+
+    {
+        std::lock_guard<int_spinlock> l(desc.tx_free_lock);
+
+        slot = desc.tx_free[--desc.tx_free_count];
+    }
+
+    auto* buffer = desc.tx_virt + slot * buffer_size;
+
+    auto* header = reinterpret_cast<virtio_net_header*>(buffer);
+    std::fill_n(buffer, desc.header_size, 0);
+
+    header->gso_type = HDR_GSO_NONE;
+
+    if(packet->checksum_start){
+        header->flags = HDR_NEEDS_CSUM;
+        header->checksum_start = packet->checksum_start;
+        header->checksum_offset = packet->checksum_offset;
+    }
+
+    std::copy_n(packet->payload, packet->payload_size, buffer + tx_header_space);
+
+    // The header and the packet are chained in two descriptors
+    desc.tx.desc[2 * slot + 1].length = packet->payload_size;
+
+    // The device is notified by flush_packets, once per batch
+    desc.tx.make_available(2 * slot);
+
+    desc.tx_lock.unlock();
+}
+
+} //end of anonymous namespace
+
+bool virtio_net::is_virtio_net(const pci::device_descriptor& pci_device){
+    // Only the legacy (transitional) interface is supported
+    return pci_device.vendor_id == 0x1AF4 && pci_device.device_id == 0x1000;
+}
+
+bool virtio_net::init_driver(network::interface_descriptor& interface, pci::device_descriptor& pci_device){
+    subsystem_logf(NIC, TRACE, "virtio_net: Initialize virtio-net driver on pci:%u:%u:%u\n", uint64_t(pci_device.bus), uint64_t(pci_device.device), uint64_t(pci_device.function));
+
+    auto* desc = new virtio_net_t();
+
+    interface.driver_data = desc;
+    interface.hw_send = send_packet;
+    interface.hw_flush = flush_packets;
+    interface.hw_poll = poll_packets;
+
+    // 1. Enable PCI Bus Mastering (allows DMA)
+
+    auto command_register = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x4);
+    command_register |= 0x4; // Set Bus Mastering Bit
+    pci::write_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x4, command_register);
+
+    // 2. Get the I/O base address
+
+    auto iobase = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x10) & (~0x3);
+    desc->iobase = iobase;
+
+    subsystem_logf(NIC, TRACE, "virtio_net: I/O Base address :%h\n", uint64_t(iobase));
+
+    // 3. Reset the device and negotiate the features
+
+    out_byte(iobase + DEVICE_STATUS, 0);
+    out_byte(iobase + DEVICE_STATUS, STATUS_ACKNOWLEDGE);
+    out_byte(iobase + DEVICE_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+    auto device_features = in_dword(iobase + DEVICE_FEATURES);
+
+    // The segmentation offload is not asked since the stack only builds
+    // segments of the size of the MSS, and a single queue pair is used
+    // since there is a single rx and tx thread per interface
+    auto features = device_features & (F_CSUM | F_GUEST_CSUM | F_MAC | F_MRG_RXBUF);
+
+    out_dword(iobase + GUEST_FEATURES, features);
+
+    subsystem_logf(NIC, TRACE, "virtio_net: Features device:%h driver:%h\n", uint64_t(device_features), uint64_t(features));
+
+    desc->mergeable = features & F_MRG_RXBUF;
+    desc->header_size = desc->mergeable ? sizeof(virtio_net_header) : sizeof(virtio_net_header) - 2;
+
+    interface.checksum_offload = 0;
+
+    if(features & F_CSUM){
+        interface.checksum_offload |= network::CHECKSUM_TX_L4;
+    }
+
+    if(features & F_GUEST_CSUM){
+        interface.checksum_offload |= network::CHECKSUM_RX_L4;
+    }
+
+    // 4. Init the queues
+
+    if(!init_queue(*desc, desc->rx, RX_QUEUE) || !init_queue(*desc, desc->tx, TX_QUEUE)){
+        out_byte(iobase + DEVICE_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    size_t physical;
+
+    desc->rx_count = std::min(rx_buffers, size_t(desc->rx.size));
+    desc->rx_virt = allocate_dma(desc->rx_count * buffer_size, physical);
+
+    if(!desc->rx_virt){
+        out_byte(iobase + DEVICE_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    for(size_t i = 0; i < desc->rx_count; ++i){
+        auto& d = desc->rx.desc[i];
+
+        d.address = physical + i * buffer_size;
+        d.length = buffer_size;
+        d.flags = DESC_WRITE;
+
+        desc->rx.make_available(i);
+    }
+
+    desc->rx.publish();
+
+    // Each transmitted packet uses two descriptors
+    desc->tx_count = std::min(tx_buffers, size_t(desc->tx.size / 2));
+    desc->tx_virt = allocate_dma(desc->tx_count * buffer_size, physical);
+
+    if(!desc->tx_virt){
+        out_byte(iobase + DEVICE_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    for(size_t i = 0; i < desc->tx_count; ++i){
+        auto& header = desc->tx.desc[2 * i];
+        auto& data = desc->tx.desc[2 * i + 1];
+
+        header.address = physical + i * buffer_size;
+        header.length = desc->header_size;
+        header.flags = DESC_NEXT;
+        header.next = 2 * i + 1;
+
+        data.address = physical + i * buffer_size + tx_header_space;
+        data.flags = 0;
+
+        desc->tx_free[i] = i;
+    }
+
+    desc->tx_free_count = desc->tx_count;
+    desc->tx_sem.init(desc->tx_count);
+
+    desc->polling = false;
+
+    // 5. Register IRQ handler
+
+    if(!softirq::register_handler(desc->tx_softirq, tx_handler, desc)){
+        logging::logf(logging::log_level::ERROR, "virtio_net: Unable to register the transmission softirq\n");
+    }
+
+    auto irq = pci::read_config_dword(pci_device.bus, pci_device.device, pci_device.function, 0x3c) & 0xFF;
+    if(!interrupt::register_irq_handler(irq, packet_handler, desc)){
+        logging::logf(logging::log_level::ERROR, "virtio_net: Unable to register IRQ handler %u\n", irq);
+    }
+
+    subsystem_logf(NIC, TRACE, "virtio_net: IRQ :%u\n", uint64_t(irq));
+
+    // 6. Get the mac address
+
+    size_t mac = 0;
+
+    if(features & F_MAC){
+        for(size_t i = 0; i < 6; ++i){
+            mac |= uint64_t(in_byte(iobase + DEVICE_CONFIG + i)) << ((5 - i) * 8);
+        }
+    }
+
+    interface.mac_address = mac;
+
+    subsystem_logf(NIC, TRACE, "virtio_net: MAC Address %h \n", mac);
+
+    // 7. The device can be used once the interface is finalized
+
+    return true;
+}
+
+void virtio_net::finalize_driver(network::interface_descriptor& interface){
+    auto* desc = static_cast<virtio_net_t*>(interface.driver_data);
+    desc->interface = &interface;
+
+    // The pool refers to the interface, which does not move anymore
+    interface.rx_pool.init(rx_packets);
+
+    out_byte(desc->iobase + DEVICE_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+    notify(*desc, desc->rx, RX_QUEUE);
+}
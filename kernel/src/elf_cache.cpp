@@ -0,0 +1,125 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include "elf_cache.hpp"
+
+#include "conc/int_spinlock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t MAX_ENTRIES = 32; ///< The number of cached executables
+constexpr const size_t MAX_HEADERS = 8;  ///< The maximum number of program headers of a cached executable
+
+/*!
+ * \brief The parsed headers of an executable
+ */
+struct entry_t {
+    vfs::file_system* fs; ///< The mounted file system, nullptr if the entry is free
+    size_t location;      ///< The location of the file inside the file system
+    size_t size;          ///< The size of the file when it was parsed
+    elf::elf_header header;                                 ///< The ELF header
+    std::array<elf::program_header, MAX_HEADERS> headers;   ///< The program headers
+};
+
+std::array<entry_t, MAX_ENTRIES> entries;
+
+size_t next = 0;   ///< The next entry to replace
+size_t cached = 0; ///< The number of used entries
+
+int_spinlock lock; ///< Protect the entries
+
+volatile size_t hits = 0;   ///< The number of execs that skipped the parsing
+volatile size_t misses = 0; ///< The number of execs that parsed the headers
+
+bool matches(const entry_t& entry, const page_cache::source& source){
+    return entry.fs == source.fs && entry.location == source.location && entry.size == source.size;
+}
+
+uint64_t sysfs_hits(){
+    return hits;
+}
+
+uint64_t sysfs_misses(){
+    return misses;
+}
+
+} //end of anonymous namespace
+
+void elf_cache::init(){
+    sysfs::set_counter_value(path("/sys"), path("/memory/elf_cache/hits"), &sysfs_hits);
+    sysfs::set_counter_value(path("/sys"), path("/memory/elf_cache/misses"), &sysfs_misses);
+}
+
+bool elf_cache::get(const page_cache::source& source, elf::elf_header& header, std::vector<elf::program_header>& program_headers){
+    std::lock_guard<int_spinlock> l(lock);
+
+    for(auto& entry : entries){
+        if(entry.fs && matches(entry, source)){
+            header = entry.header;
+
+            program_headers.resize(header.e_phnum);
+            std::copy_n(entry.headers.begin(), header.e_phnum, program_headers.begin());
+
+            ++hits;
+
+            return true;
+        }
+    }
+
+    ++misses;
+
+    return false;
+}
+
+void elf_cache::put(const page_cache::source& source, const elf::elf_header& header, const std::vector<elf::program_header>& program_headers){
+    if(program_headers.size() > MAX_HEADERS){
+        return;
+    }
+
+    std::lock_guard<int_spinlock> l(lock);
+
+    for(auto& entry : entries){
+        if(entry.fs && matches(entry, source)){
+            return;
+        }
+    }
+
+    auto& entry = entries[next];
+    next = (next + 1) % MAX_ENTRIES;
+
+    if(!entry.fs){
+        ++cached;
+    }
+
+    entry.fs       = source.fs;
+    entry.location = source.location;
+    entry.size     = source.size;
+    entry.header   = header;
+
+    std::copy_n(program_headers.begin(), program_headers.size(), entry.headers.begin());
+}
+
+void elf_cache::invalidate(vfs::file_system* fs, size_t location){
+    std::lock_guard<int_spinlock> l(lock);
+
+    for(auto& entry : entries){
+        if(entry.fs == fs && entry.location == location){
+            entry.fs = nullptr;
+            --cached;
+        }
+    }
+}
+
+bool elf_cache::empty(){
+    return !cached;
+}
@@ -73,6 +73,7 @@ size_t devfs::devfs_file_system::get_file(const path& file_path, vfs::file& f){
                     f.directory = false;
                     f.hidden = false;
                     f.system = false;
+                    f.char_device = device.type == devfs::device_type::CHAR_DEVICE;
                     f.size = 0;
 
                     return 0;
@@ -281,6 +282,42 @@ size_t devfs::devfs_file_system::rm(const path& ){
     return std::ERROR_PERMISSION_DENIED;
 }
 
+poll::source* devfs::devfs_file_system::poll_source(const path& file_path){
+    if(file_path.is_root()){
+        return nullptr;
+    }
+
+    for(auto& device_list : devices){
+        if(device_list.mount_point == mount_point){
+            for(auto& device : device_list.devices){
+                if(device.name == file_path.base_name() && device.type == device_type::CHAR_DEVICE && device.driver){
+                    return reinterpret_cast<devfs::char_driver*>(device.driver)->poll_source(device.data);
+                }
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+size_t devfs::devfs_file_system::memory(const path& file_path, size_t& physical, size_t& size){
+    if(file_path.is_root()){
+        return std::ERROR_DIRECTORY;
+    }
+
+    for(auto& device_list : devices){
+        if(device_list.mount_point == mount_point){
+            for(auto& device : device_list.devices){
+                if(device.name == file_path.base_name() && device.type == device_type::CHAR_DEVICE && device.driver){
+                    return reinterpret_cast<devfs::char_driver*>(device.driver)->memory(device.data, physical, size);
+                }
+            }
+        }
+    }
+
+    return std::ERROR_NOT_EXISTS;
+}
+
 size_t devfs::devfs_file_system::statfs(vfs::statfs_info& file){
     file.total_size = 0;
     file.free_size = 0;
@@ -8,6 +8,7 @@
 #include <types.hpp>
 #include <unique_ptr.hpp>
 #include <algorithms.hpp>
+#include <lock_guard.hpp>
 
 #include <tlib/errors.hpp>
 
@@ -17,6 +18,9 @@
 
 #include "console.hpp"
 #include "logging.hpp"
+#include "scheduler.hpp"
+
+#include "vfs/dentry_cache.hpp"
 
 namespace {
 
@@ -25,6 +29,21 @@ constexpr const uint32_t CLUSTER_RESERVED= 0x1;
 constexpr const uint32_t CLUSTER_CORRUPTED = 0x0FFFFFF7;
 constexpr const uint32_t CLUSTER_END = 0x0FFFFFF8;
 
+constexpr const size_t FAT_PAGE_SECTORS = 8;                               ///< The number of sectors of a resident page of the FAT
+constexpr const size_t FAT_PAGE_ENTRIES = FAT_PAGE_SECTORS * 512 / sizeof(uint32_t); ///< The number of entries of a resident page of the FAT
+
+constexpr const size_t READAHEAD_MIN = 16 * 1024; ///< The first prefetch of a sequential read, in bytes
+constexpr const size_t READAHEAD_MAX = 64 * 1024; ///< The largest prefetch, in bytes
+
+//Indicates if the cluster number denotes a cluster of data
+inline bool data_cluster(uint32_t cluster){
+    return cluster >= 2 && cluster < CLUSTER_CORRUPTED;
+}
+
+void readahead_worker(void* data){
+    reinterpret_cast<fat32::fat32_file_system*>(data)->prefetch();
+}
+
 //Indicates if the entry is unused, indicating a file deletion or move
 inline bool entry_unused(const fat32::cluster_entry& entry){
     return entry.name[0] == 0xE5;
@@ -46,6 +65,17 @@ size_t number_of_entries(const std::string& name){
     return (name.size() - 1) / 13 + 2;
 }
 
+//FNV-1a hash of a file name, for the directory indexes
+size_t name_hash(const std::string& name){
+    size_t key = 0xCBF29CE484222325;
+
+    for(size_t i = 0; i < name.size(); ++i){
+        key = (key ^ uint8_t(name[i])) * 0x100000001B3;
+    }
+
+    return key ^ (key >> 29);
+}
+
 //Init an entry
 template<bool Long>
 fat32::cluster_entry* init_entry(fat32::cluster_entry* entry_ptr, const char* name, uint32_t cluster){
@@ -174,12 +204,28 @@ void init_file_entry(fat32::cluster_entry* entry_ptr, const char* name, uint32_t
 } //end of anonymous namespace
 
 fat32::fat32_file_system::fat32_file_system(path mount_point, path device) : mount_point(mount_point), device(device) {
-    //Nothing else to init
+    for(auto& stream : streams){
+        stream = {0, 0, 0, 0, 0};
+    }
+
+    readahead_work = {&readahead_worker, this, nullptr, 0, false};
 }
 
 fat32::fat32_file_system::~fat32_file_system(){
+    // The prefetch uses the file system
+    while(readahead_running){
+        scheduler::yield();
+    }
+
+    flush_fat();
+
+    for(auto* page : fat_pages){
+        delete[] page;
+    }
+
     delete fat_bs;
     delete fat_is;
+    delete[] readahead_buffer;
 }
 
 void fat32::fat32_file_system::init(){
@@ -208,19 +254,66 @@ void fat32::fat32_file_system::init(){
         fat_is = nullptr;
     }
 
+    readahead_buffer = new char[std::max(READAHEAD_MAX, size_t(512) * fat_bs->sectors_per_cluster)];
+
+    //The pages of the FAT are loaded on demand
+    fat_lock.init();
+
+    const auto fat_sectors = fat_bs->sectors_per_fat_long + fat_bs->sectors_per_fat;
+    const auto pages = (fat_sectors + FAT_PAGE_SECTORS - 1) / FAT_PAGE_SECTORS;
+
+    fat_pages.resize(pages);
+    fat_dirty.resize(pages);
+
+    extent_lock.init();
+
+    for(auto& map : extent_maps){
+        map.location = 0;
+        map.last_use = 0;
+    }
+
+    index_lock.init();
+
+    for(auto& index : indexes){
+        index.location = 0;
+        index.last_use = 0;
+    }
+
+    build_free_map();
+
     logging::logf(logging::log_level::TRACE, "fat32: Number of fat:%u\n", uint64_t(fat_bs->number_of_fat));
 }
 
 size_t fat32::fat32_file_system::get_file(const path& file_path, vfs::file& file){
-    auto all_files = files(file_path, 1);
-    for(auto& f : all_files){
-        if(f.file_name == file_path.base_name()){
-            file = f;
-            return 0;
-        }
+    auto cluster_number = find_cluster_number(file_path, 1);
+    if(!cluster_number.first){
+        return std::ERROR_NOT_EXISTS;
+    }
+
+    return find_file(cluster_number.second, file_path.base_name(), file_path.hash(file_path.size() - 1), file);
+}
+
+//Resolve the open file again if a directory entry changed since it was
+//last resolved
+size_t fat32::fat32_file_system::resolve(vfs::open_file& file){
+    size_t generation = entries_generation;
+
+    if(file.generation == generation){
+        return 0;
+    }
+
+    vfs::file f;
+    auto result = get_file(file.fs_path, f);
+    if(result > 0){
+        return result;
     }
 
-    return std::ERROR_NOT_EXISTS;
+    file.location = f.location;
+    file.size = f.size;
+    file.directory = f.directory;
+    file.generation = generation;
+
+    return 0;
 }
 
 size_t fat32::fat32_file_system::read(const path& file_path, char* buffer, size_t count, size_t offset, size_t& read){
@@ -230,8 +323,20 @@ size_t fat32::fat32_file_system::read(const path& file_path, char* buffer, size_
         return result;
     }
 
-    uint32_t cluster_number = file.location;
-    size_t file_size = file.size;
+    return read_file(file.location, file.size, buffer, count, offset, read);
+}
+
+size_t fat32::fat32_file_system::read(vfs::open_file& file, char* buffer, size_t count, size_t offset, size_t& read){
+    auto result = resolve(file);
+    if(result > 0){
+        return result;
+    }
+
+    return read_file(file.location, file.size, buffer, count, offset, read);
+}
+
+//Read the file starting at the given cluster
+size_t fat32::fat32_file_system::read_file(uint32_t location, size_t file_size, char* buffer, size_t count, size_t offset, size_t& read){
 
     //Check the offset parameter
     if(offset > file_size){
@@ -247,54 +352,20 @@ size_t fat32::fat32_file_system::read(const path& file_path, char* buffer, size_
     size_t first = offset;
     size_t last = std::min(offset + count, file_size);
 
-    size_t read_bytes = 0;
-    size_t position = 0;
-    size_t cluster = 0;
-
     size_t cluster_size = 512 * fat_bs->sectors_per_cluster;
 
-    while(read_bytes < last){
-        auto cluster_last = (cluster + 1) * cluster_size;
-
-        if(first < cluster_last){
-            std::unique_heap_array<char> cluster_buffer(cluster_size);
-
-            if(read_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, cluster_buffer.get())){
-                size_t i = 0;
-
-                if(position == 0){
-                    i = first % cluster_size;
-                }
-
-                for(; i < cluster_size && read_bytes < last; ++i, ++read_bytes){
-                    buffer[position++] = cluster_buffer[i];
-                }
-            } else {
-                return std::ERROR_FAILED;
-            }
-        } else {
-            read_bytes += cluster_size;
-        }
-
-        ++cluster;
-
-        //If the file is not read completely, get the next cluster
-        if(read_bytes < last){
-            cluster_number = next_cluster(cluster_number);
-
-            //It may be possible that either the file size or the FAT entry is wrong
-            if(!cluster_number){
-                break;
-            }
+    read = 0;
 
-            //The block is corrupted
-            if(cluster_number == 0x0FFFFFF7){
-                break;
-            }
-        }
+    uint32_t last_cluster = 0;
+    auto result = transfer(location, first, last, file_operation::READ, buffer, read, last_cluster);
+    if(result > 0){
+        return result;
     }
 
-    read = last - first;
+    //Prefetch the following clusters if the file is read sequentially
+    if(read){
+        readahead(location, file_size, offset, read, last_cluster, (offset + read - 1) / cluster_size);
+    }
 
     return 0;
 }
@@ -310,8 +381,22 @@ size_t fat32::fat32_file_system::write(const path& file_path, const char* buffer
         return result;
     }
 
-    uint32_t cluster_number = file.location;
-    size_t file_size = file.size;
+    return write_file(file.location, file.size, buffer, count, offset, written);
+}
+
+size_t fat32::fat32_file_system::write(vfs::open_file& file, const char* buffer, size_t count, size_t offset, size_t& written){
+    auto result = resolve(file);
+    if(result > 0){
+        return result;
+    }
+
+    return write_file(file.location, file.size, buffer, count, offset, written);
+}
+
+//Write the file starting at the given cluster
+size_t fat32::fat32_file_system::write_file(uint32_t location, size_t file_size, const char* buffer, size_t count, size_t offset, size_t& written){
+    fat_batch batch{*this};
+
 
     //Check the offset parameter
     if(offset + count > file_size){
@@ -329,61 +414,10 @@ size_t fat32::fat32_file_system::write(const path& file_path, const char* buffer
     size_t first = offset;
     size_t last = offset + count;
 
-    size_t read_bytes = 0;
-    size_t position = 0;
-    size_t cluster = 0;
-
-    size_t cluster_size = 512 * fat_bs->sectors_per_cluster;
-
-    while(read_bytes < last){
-        auto cluster_last = (cluster + 1) * cluster_size;
-
-        if(first < cluster_last){
-            std::unique_heap_array<char> cluster(cluster_size);
+    written = 0;
 
-            if(read_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, cluster.get())){
-                size_t i = 0;
-
-                if(position == 0){
-                    i = first % cluster_size;
-                }
-
-                for(; i < cluster_size && read_bytes < last; ++i, ++read_bytes){
-                    cluster[i] = buffer[position++];
-                }
-
-                if(!write_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, cluster.get())){
-                    return std::ERROR_FAILED;
-                }
-            } else {
-                return std::ERROR_FAILED;
-            }
-
-        } else {
-            read_bytes += cluster_size;
-        }
-
-        ++cluster;
-
-        //If the file is not read completely, get the next cluster
-        if(read_bytes < last){
-            cluster_number = next_cluster(cluster_number);
-
-            //It may be possible that either the file size or the FAT entry is wrong
-            if(!cluster_number){
-                break;
-            }
-
-            //The block is corrupted
-            if(cluster_number == 0x0FFFFFF7){
-                break;
-            }
-        }
-    }
-
-    written = last - first;
-
-    return 0;
+    uint32_t last_cluster = 0;
+    return transfer(location, first, last, file_operation::WRITE, const_cast<char*>(buffer), written, last_cluster);
 }
 
 size_t fat32::fat32_file_system::clear(const path& file_path, size_t count, size_t offset, size_t& written){
@@ -393,8 +427,22 @@ size_t fat32::fat32_file_system::clear(const path& file_path, size_t count, size
         return result;
     }
 
-    uint32_t cluster_number = file.location;
-    size_t file_size = file.size;
+    return clear_file(file.location, file.size, count, offset, written);
+}
+
+size_t fat32::fat32_file_system::clear(vfs::open_file& file, size_t count, size_t offset, size_t& written){
+    auto result = resolve(file);
+    if(result > 0){
+        return result;
+    }
+
+    return clear_file(file.location, file.size, count, offset, written);
+}
+
+//Clear the file starting at the given cluster
+size_t fat32::fat32_file_system::clear_file(uint32_t location, size_t file_size, size_t count, size_t offset, size_t& written){
+    fat_batch batch{*this};
+
 
     //Check the offset parameter
     if(offset + count > file_size){
@@ -412,65 +460,15 @@ size_t fat32::fat32_file_system::clear(const path& file_path, size_t count, size
     size_t first = offset;
     size_t last = offset + count;
 
-    size_t read_bytes = 0;
-    size_t cluster = 0;
-    bool first_position = true;
-
-    size_t cluster_size = 512 * fat_bs->sectors_per_cluster;
-
-    while(read_bytes < last){
-        auto cluster_last = (cluster + 1) * cluster_size;
-
-        if(first < cluster_last){
-            std::unique_heap_array<char> cluster(cluster_size);
-
-            if(read_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, cluster.get())){
-                size_t i = 0;
-
-                if(first_position){
-                    i = first % cluster_size;
-                    first_position = false;
-                }
-
-                for(; i < cluster_size && read_bytes < last; ++i, ++read_bytes){
-                    cluster[i] = 0;
-                }
-
-                if(!write_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, cluster.get())){
-                    return std::ERROR_FAILED;
-                }
-            } else {
-                return std::ERROR_FAILED;
-            }
-
-        } else {
-            read_bytes += cluster_size;
-        }
-
-        ++cluster;
-
-        //If the file is not read completely, get the next cluster
-        if(read_bytes < last){
-            cluster_number = next_cluster(cluster_number);
-
-            //It may be possible that either the file size or the FAT entry is wrong
-            if(!cluster_number){
-                break;
-            }
-
-            //The block is corrupted
-            if(cluster_number == 0x0FFFFFF7){
-                break;
-            }
-        }
-    }
-
-    written = last - first;
+    written = 0;
 
-    return 0;
+    uint32_t last_cluster = 0;
+    return transfer(location, first, last, file_operation::CLEAR, nullptr, written, last_cluster);
 }
 
 size_t fat32::fat32_file_system::truncate(const path& file_path, size_t file_size){
+    fat_batch batch{*this};
+
     vfs::file file;
     auto result = get_file(file_path, file);
     if(result > 0){
@@ -513,8 +511,20 @@ size_t fat32::fat32_file_system::truncate(const path& file_path, size_t file_siz
         }
 
         if(capacity < clusters){
+            //Preallocate the new clusters contiguously after the last one if possible
+            auto run = find_free_run(capacity ? last_cluster + 1 : 0, clusters - capacity);
+            size_t allocated = 0;
+
+            auto allocate = [&]() -> uint32_t {
+                if(run){
+                    return run + allocated++;
+                }
+
+                return find_free_cluster(capacity ? last_cluster + 1 : 0);
+            };
+
             if(capacity == 0){
-                auto cluster = find_free_cluster();
+                auto cluster = allocate();
                 if(!cluster){
                     return std::ERROR_DISK_FULL;
                 }
@@ -525,7 +535,7 @@ size_t fat32::fat32_file_system::truncate(const path& file_path, size_t file_siz
 
                 ++capacity;
 
-                change_directory_entry(parent_cluster_number_search.second, file.position,
+                change_directory_entry(parent_cluster_number_search.second, file.file_name, file.position,
                     [cluster](cluster_entry& entry){
                     entry.cluster_low = cluster;
                     entry.cluster_high = cluster >> 16;
@@ -534,7 +544,7 @@ size_t fat32::fat32_file_system::truncate(const path& file_path, size_t file_siz
 
             //Extend the clusters if necessary
             for(auto i = capacity; i < clusters; ++i){
-                auto cluster = find_free_cluster();
+                auto cluster = allocate();
                 if(!cluster){
                     return std::ERROR_DISK_FULL;
                 }
@@ -561,7 +571,7 @@ size_t fat32::fat32_file_system::truncate(const path& file_path, size_t file_siz
     }
 
     //Set the new file size in the directory entry
-    change_directory_entry(parent_cluster_number_search.second, file.position,
+    change_directory_entry(parent_cluster_number_search.second, file.file_name, file.position,
         [file_size](cluster_entry& entry){ entry.file_size = file_size; });
 
     return 0;
@@ -575,35 +585,20 @@ size_t fat32::fat32_file_system::ls(const path& file_path, std::vector<vfs::file
 }
 
 size_t fat32::fat32_file_system::touch(const path& file_path){
+    fat_batch batch{*this};
+
     //Find the cluster number of the parent directory
     auto cluster_number = find_cluster_number(file_path, 1);
     if(!cluster_number.first){
         return std::ERROR_NOT_EXISTS;
     }
 
-    auto parent_cluster_number = cluster_number.second;
-
-    std::unique_heap_array<cluster_entry> directory_cluster(16 * fat_bs->sectors_per_cluster);
-    if(!read_sectors(cluster_lba(parent_cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
-        return std::ERROR_FAILED;
-    }
-
-    auto file = file_path.base_name();
-
-    auto entries = number_of_entries(file);
-    auto new_directory_entry = find_free_entry(directory_cluster, entries, parent_cluster_number);
-
-    init_file_entry<true>(new_directory_entry, file.c_str(), 0);
-
-    //Write back the parent directory cluster
-    if(!write_sectors(cluster_lba(parent_cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
-        return std::ERROR_FAILED;
-    }
-
-    return 0;
+    return add_directory_entry(cluster_number.second, file_path.base_name(), 0, false);
 }
 
 size_t fat32::fat32_file_system::mkdir(const path& file_path){
+    fat_batch batch{*this};
+
     //Find the cluster number of the parent directory
     auto cluster_number = find_cluster_number(file_path, 1);
     if(!cluster_number.first){
@@ -623,27 +618,15 @@ size_t fat32::fat32_file_system::mkdir(const path& file_path){
     logging::logf(logging::log_level::TRACE, "fat32: mkdir: parent_cluster:%u\n", size_t(parent_cluster));
 #endif
 
-    std::unique_heap_array<cluster_entry> directory_cluster(16 * fat_bs->sectors_per_cluster);
-    if(!read_sectors(cluster_lba(parent_cluster), fat_bs->sectors_per_cluster, directory_cluster.get())){
-        return std::ERROR_FAILED;
-    }
-
-    auto directory = file_path.base_name();
-
-    auto parent_cluster_number = parent_cluster; // This may change if full
-    auto entries = number_of_entries(directory);
-    auto new_directory_entry = find_free_entry(directory_cluster, entries, parent_cluster_number);
-
-    init_directory_entry<true>(new_directory_entry, directory.c_str(), cluster);
-
-    //Write back the parent directory cluster
-    if(!write_sectors(cluster_lba(parent_cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
+    //This cluster is the end of the chain, it must be used before the
+    //parent directory is extended
+    if(!write_fat_value(cluster, CLUSTER_END)){
         return std::ERROR_FAILED;
     }
 
-    //This cluster is the end of the chain
-    if(!write_fat_value(cluster, CLUSTER_END)){
-        return std::ERROR_FAILED;
+    auto result = add_directory_entry(parent_cluster, file_path.base_name(), cluster, true);
+    if(result > 0){
+        return result;
     }
 
     //One cluster is now used for the directory entries
@@ -683,6 +666,8 @@ size_t fat32::fat32_file_system::mkdir(const path& file_path){
 }
 
 size_t fat32::fat32_file_system::rm(const path& file_path){
+    fat_batch batch{*this};
+
     vfs::file file;
     auto result = get_file(file_path, file);
     if(result > 0){
@@ -701,20 +686,86 @@ size_t fat32::fat32_file_system::rm(const path& file_path){
 
     auto parent_cluster_number = cluster_number_search.second;
 
+    dentry_cache::invalidate(this, parent_cluster_number, file.file_name);
+    __sync_fetch_and_add(&entries_generation, 1);
+
     if(is_file){
-        return rm_file(parent_cluster_number, position, cluster_number);
+        result = rm_file(parent_cluster_number, position, cluster_number);
     } else {
-        return rm_dir(parent_cluster_number, position, cluster_number);
+        result = rm_dir(parent_cluster_number, position, cluster_number);
+    }
+
+    std::lock_guard<mutex> l(index_lock);
+
+    if(auto* index = find_index(parent_cluster_number)){
+        //After a failure, the state of the directory is not known
+        if(result > 0){
+            index->location = 0;
+        } else {
+            index_remove(*index, file.file_name);
+        }
     }
+
+    return result;
 }
 
 size_t fat32::fat32_file_system::statfs(vfs::statfs_info& file){
     file.total_size = fat_bs->total_sectors_long * 512;
-    file.free_size = fat_is->free_clusters * fat_bs->sectors_per_cluster * 512;
+    file.free_size = free_clusters * fat_bs->sectors_per_cluster * 512;
 
     return 0;
 }
 
+void fat32::fat32_file_system::prefetch(){
+    size_t cluster_size = 512 * fat_bs->sectors_per_cluster;
+    size_t buffer_clusters = std::max(READAHEAD_MAX / cluster_size, size_t(1));
+
+    while(true){
+        readahead_request request;
+
+        {
+            std::lock_guard<spinlock> l(readahead_lock);
+
+            if(requests_head == requests_tail){
+                readahead_running = false;
+                return;
+            }
+
+            request = requests[requests_head % READAHEAD_REQUESTS];
+            ++requests_head;
+        }
+
+        auto cluster = request.cluster;
+
+        for(size_t i = 0; i < request.skip && data_cluster(cluster); ++i){
+            cluster = next_cluster(cluster);
+        }
+
+        auto remaining = request.count;
+
+        while(remaining && data_cluster(cluster)){
+            //The contiguous clusters are read together
+            auto first = cluster;
+            size_t run = 1;
+
+            cluster = next_cluster(cluster);
+
+            while(run < remaining && run < buffer_clusters && cluster == first + run){
+                ++run;
+                cluster = next_cluster(cluster);
+            }
+
+            //The clusters are only read to be in the block cache of the device
+            auto result = vfs::direct_read(device, readahead_buffer, run * cluster_size, cluster_lba(first) * 512);
+            if(!result){
+                break;
+            }
+
+            remaining -= run;
+        }
+    }
+}
+
 /* Private methods implementation */
 
 size_t fat32::fat32_file_system::rm_file(uint32_t parent_cluster_number, size_t position, uint32_t cluster_number){
@@ -801,6 +852,17 @@ size_t fat32::fat32_file_system::rm_file(uint32_t parent_cluster_number, size_t
 }
 
 size_t fat32::fat32_file_system::rm_dir(uint32_t parent_cluster_number, size_t position, uint32_t cluster_number){
+    //The cluster of the directory may be reused by another one
+    dentry_cache::invalidate(this, cluster_number);
+
+    {
+        std::lock_guard<mutex> l(index_lock);
+
+        if(auto* index = find_index(cluster_number)){
+            index->location = 0;
+        }
+    }
+
     //1. Every sub entry of the directory must be removed
 
     for(auto& file : files(cluster_number)){
@@ -826,7 +888,13 @@ size_t fat32::fat32_file_system::rm_dir(uint32_t parent_cluster_number, size_t p
     return rm_file(parent_cluster_number, position, cluster_number);
 }
 
-size_t fat32::fat32_file_system::change_directory_entry(uint32_t parent_cluster_number, size_t position, const std::function<void(cluster_entry&)>& functor){
+size_t fat32::fat32_file_system::change_directory_entry(uint32_t parent_cluster_number, const std::string& name, size_t position, std::function_ref<void(cluster_entry&)> functor){
+    //The cached file is not updated in place
+    dentry_cache::invalidate(this, parent_cluster_number, name);
+    __sync_fetch_and_add(&entries_generation, 1);
+
+    const auto directory_cluster_number = parent_cluster_number;
+
     std::unique_heap_array<cluster_entry> directory_cluster(16 * fat_bs->sectors_per_cluster);
     if(!read_sectors(cluster_lba(parent_cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
         return std::ERROR_FAILED;
@@ -850,6 +918,17 @@ size_t fat32::fat32_file_system::change_directory_entry(uint32_t parent_cluster_
             if(!write_sectors(cluster_lba(parent_cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
                 return std::ERROR_FAILED;
             }
+
+            //The indexed file is updated in place
+            std::lock_guard<mutex> l(index_lock);
+
+            if(auto* index = find_index(directory_cluster_number)){
+                auto i = index_find(*index, name);
+
+                if(i != NO_INDEX_ENTRY){
+                    fill_file(index->entries[i].file, directory_cluster[j]);
+                }
+            }
         }
 
         //Jump to next cluser
@@ -879,7 +958,7 @@ size_t fat32::fat32_file_system::change_directory_entry(uint32_t parent_cluster_
 }
 
 //Finds "entries" consecutive free entries in the given directory cluster
-fat32::cluster_entry* fat32::fat32_file_system::find_free_entry(std::unique_heap_array<cluster_entry>& directory_cluster, size_t entries, uint32_t& cluster_number){
+fat32::cluster_entry* fat32::fat32_file_system::find_free_entry(std::unique_heap_array<cluster_entry>& directory_cluster, size_t entries, uint32_t& cluster_number, size_t& cluster_index){
     while(true){
         size_t end;
         bool end_found = false;
@@ -988,6 +1067,7 @@ fat32::cluster_entry* fat32::fat32_file_system::find_free_entry(std::unique_heap
 
         //Try again with the cluster in the chain
         cluster_number = next;
+        ++cluster_index;
 
         //Read the next sector
         if(!read_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
@@ -997,11 +1077,12 @@ fat32::cluster_entry* fat32::fat32_file_system::find_free_entry(std::unique_heap
 
     //At this point, we tried all the possible clusters of the directory,
     //So it is necessary to add a new cluster to the chain
+    ++cluster_index;
     return extend_directory(directory_cluster, entries, cluster_number);
 }
 
 fat32::cluster_entry* fat32::fat32_file_system::extend_directory(std::unique_heap_array<fat32::cluster_entry>& directory_cluster, size_t entries, uint32_t& cluster_number){
-    auto cluster = find_free_cluster();
+    auto cluster = find_free_cluster(cluster_number + 1);
     if(!cluster){
         return nullptr;
     }
@@ -1048,6 +1129,14 @@ fat32::cluster_entry* fat32::fat32_file_system::extend_directory(std::unique_hea
 
 //Return all the files of the given directory (denoted by its cluster number)
 std::vector<vfs::file> fat32::fat32_file_system::files(uint32_t cluster_number){
+    uint32_t last_cluster;
+    size_t clusters;
+    return files(cluster_number, last_cluster, clusters);
+}
+
+//Return all the files of the given directory, and the last cluster and the
+//number of clusters of its chain
+std::vector<vfs::file> fat32::fat32_file_system::files(uint32_t cluster_number, uint32_t& last_cluster, size_t& clusters){
     std::vector<vfs::file> files;
 
     bool end_reached = false;
@@ -1064,6 +1153,9 @@ std::vector<vfs::file> fat32::fat32_file_system::files(uint32_t cluster_number){
             return std::move(files);
         }
 
+        last_cluster = cluster_number;
+        clusters = cluster_position + 1;
+
         size_t position = 0;
         for(auto& entry : cluster){
             ++position;
@@ -1140,50 +1232,14 @@ std::vector<vfs::file> fat32::fat32_file_system::files(uint32_t cluster_number){
                 }
             }
 
-            file.hidden = entry.attrib & 0x1;
-            file.system = entry.attrib & 0x2;
-            file.directory = entry.attrib & 0x10;
-
-            file.created.day = entry.creation_date & 0x1F;
-            file.created.month = (entry.creation_date >> 5) & 0xF;
-            file.created.year = (entry.creation_date >> 9) + 1980;
-
-            file.created.seconds = entry.creation_time & 0x1F;
-            file.created.minutes = (entry.creation_time >> 5) & 0x3F;
-            file.created.hour = entry.creation_time >> 11;
+            fill_file(file, entry);
+            file.position = cluster_position * cluster.size() + (position - 1);
 
-            file.modified.day = entry.modification_date & 0x1F;
-            file.modified.month = (entry.modification_date >> 5) & 0xF;
-            file.modified.year = (entry.modification_date >> 9) + 1980;
+            files.push_back(file);
+        }
 
-            file.modified.seconds = entry.modification_time & 0x1F;
-            file.modified.minutes = (entry.modification_time >> 5) & 0x3F;
-            file.modified.hour = entry.modification_time >> 11;
-
-            file.accessed.day = entry.accessed_date & 0x1F;
-            file.accessed.month = (entry.accessed_date >> 5) & 0xF;
-            file.accessed.year = (entry.accessed_date >> 9) + 1980;
-
-            if(file.directory){
-                //TODO Should read the cluster chain to get the number of
-                //clusters
-                file.size = fat_bs->sectors_per_cluster * 512;
-            } else {
-                file.size = entry.file_size;
-            }
-
-            file.location = (uint32_t(entry.cluster_high) << 16) + uint32_t(entry.cluster_low);
-            file.position = cluster_position * cluster.size() + (position - 1);
-
-            if(file.location == 0){
-                file.location = fat_bs->root_directory_cluster_start;
-            }
-
-            files.push_back(file);
-        }
-
-        if(!end_reached){
-            cluster_number = next_cluster(cluster_number);
+        if(!end_reached){
+            cluster_number = next_cluster(cluster_number);
 
             //If there are no more cluster, return false
             if(!cluster_number){
@@ -1202,6 +1258,47 @@ std::vector<vfs::file> fat32::fat32_file_system::files(uint32_t cluster_number){
     return std::move(files);
 }
 
+//Fill the file from its short directory entry, except its name and position
+void fat32::fat32_file_system::fill_file(vfs::file& file, const cluster_entry& entry){
+    file.hidden = entry.attrib & 0x1;
+    file.system = entry.attrib & 0x2;
+    file.directory = entry.attrib & 0x10;
+
+    file.created.day = entry.creation_date & 0x1F;
+    file.created.month = (entry.creation_date >> 5) & 0xF;
+    file.created.year = (entry.creation_date >> 9) + 1980;
+
+    file.created.seconds = entry.creation_time & 0x1F;
+    file.created.minutes = (entry.creation_time >> 5) & 0x3F;
+    file.created.hour = entry.creation_time >> 11;
+
+    file.modified.day = entry.modification_date & 0x1F;
+    file.modified.month = (entry.modification_date >> 5) & 0xF;
+    file.modified.year = (entry.modification_date >> 9) + 1980;
+
+    file.modified.seconds = entry.modification_time & 0x1F;
+    file.modified.minutes = (entry.modification_time >> 5) & 0x3F;
+    file.modified.hour = entry.modification_time >> 11;
+
+    file.accessed.day = entry.accessed_date & 0x1F;
+    file.accessed.month = (entry.accessed_date >> 5) & 0xF;
+    file.accessed.year = (entry.accessed_date >> 9) + 1980;
+
+    if(file.directory){
+        //TODO Should read the cluster chain to get the number of
+        //clusters
+        file.size = fat_bs->sectors_per_cluster * 512;
+    } else {
+        file.size = entry.file_size;
+    }
+
+    file.location = (uint32_t(entry.cluster_high) << 16) + uint32_t(entry.cluster_low);
+
+    if(file.location == 0){
+        file.location = fat_bs->root_directory_cluster_start;
+    }
+}
+
 //TODO use expected here
 //Find the cluster for the given path
 std::pair<bool, uint32_t> fat32::fat32_file_system::find_cluster_number(const path& file_path, size_t last){
@@ -1212,38 +1309,258 @@ std::pair<bool, uint32_t> fat32::fat32_file_system::find_cluster_number(const pa
     }
 
     for(size_t i = 1; i < file_path.size() - last; ++i){
-        auto& p = file_path[i];
+        vfs::file file;
+        if(find_file(cluster_number, file_path[i], file_path.hash(i), file)){
+            return std::make_pair(false, 0);
+        }
 
-        bool found = false;
+        cluster_number = file.location;
 
-        auto entries = files(cluster_number);
+        //If it is the last part of the path, just return the number
+        if(i == file_path.size() - 1 - last){
+            return std::make_pair(true, cluster_number);
+        }
 
-        for(auto& file : entries){
-            if(i == file_path.size() - 1 - last || file.directory){
-                if(file.file_name == p){
-                    cluster_number = file.location;
+        //Otherwise, continue with the next level of the path
+        if(!file.directory){
+            return std::make_pair(false, 0);
+        }
+    }
 
-                    //If it is the last part of the path, just return the
-                    //number
-                    if(i == file_path.size() - 1 - last){
-                        return std::make_pair(true, cluster_number);
-                    }
+    return std::make_pair(false, 0);
+}
+
+//Find the file of the given name in the directory, from the dentry cache
+//if possible, name_hash is the hash of the name in the path
+size_t fat32::fat32_file_system::find_file(uint32_t cluster_number, const std::string& name, size_t name_hash, vfs::file& file){
+    bool exists;
+    size_t generation;
 
-                    //Otherwise, continue with the next level of the path
+    if(dentry_cache::lookup(this, cluster_number, name, name_hash, file, exists, generation)){
+        return exists ? 0 : std::ERROR_NOT_EXISTS;
+    }
 
-                    found = true;
+    std::lock_guard<mutex> l(index_lock);
 
-                    break;
-                }
-            }
+    auto* index = get_index(cluster_number);
+    if(!index){
+        return std::ERROR_NOT_EXISTS;
+    }
+
+    auto i = index_find(*index, name);
+
+    if(i == NO_INDEX_ENTRY){
+        dentry_cache::insert_negative(this, cluster_number, name, generation);
+
+        return std::ERROR_NOT_EXISTS;
+    }
+
+    file = index->entries[i].file;
+
+    dentry_cache::insert(this, cluster_number, file, generation);
+
+    return 0;
+}
+
+//Return the index of the directory, built on its first access, nullptr if
+//the directory cannot be read. The index lock must be held.
+fat32::directory_index* fat32::fat32_file_system::get_index(uint32_t cluster_number){
+    auto* index = &indexes[0];
+
+    for(auto& candidate : indexes){
+        if(candidate.location == cluster_number){
+            candidate.last_use = ++index_clock;
+            return &candidate;
         }
 
-        if(!found){
-            return std::make_pair(false, 0);
+        if(candidate.last_use < index->last_use){
+            index = &candidate;
         }
     }
 
-    return std::make_pair(false, 0);
+    uint32_t last_cluster = cluster_number;
+    size_t clusters = 0;
+
+    auto contents = files(cluster_number, last_cluster, clusters);
+
+    if(!clusters){
+        return nullptr;
+    }
+
+    index->location = cluster_number;
+    index->last_use = ++index_clock;
+    index->last_cluster = last_cluster;
+    index->clusters = clusters;
+    index->entries.clear();
+
+    index_rehash(*index, contents.size());
+
+    for(auto& file : contents){
+        index_insert(*index, file);
+    }
+
+    return index;
+}
+
+//Return the index of the directory if it is already built, nullptr
+//otherwise. The index lock must be held.
+fat32::directory_index* fat32::fat32_file_system::find_index(uint32_t cluster_number){
+    for(auto& index : indexes){
+        if(index.location == cluster_number){
+            return &index;
+        }
+    }
+
+    return nullptr;
+}
+
+//Add the entries of a new file to the directory. When the directory is
+//indexed, the free entries are searched directly from its last cluster.
+size_t fat32::fat32_file_system::add_directory_entry(uint32_t parent_cluster_number, const std::string& name, uint32_t cluster, bool directory){
+    //The name may be cached as not existing
+    dentry_cache::invalidate(this, parent_cluster_number, name);
+
+    std::lock_guard<mutex> l(index_lock);
+
+    auto* index = get_index(parent_cluster_number);
+
+    //Only the cluster holding the end of directory has free entries to
+    //offer, the previous clusters do not need to be read
+    auto cluster_number = index ? index->last_cluster : parent_cluster_number;
+    size_t cluster_index = index ? index->clusters - 1 : 0;
+
+    std::unique_heap_array<cluster_entry> directory_cluster(16 * fat_bs->sectors_per_cluster);
+    if(!read_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
+        return std::ERROR_FAILED;
+    }
+
+    auto entries = number_of_entries(name);
+    auto new_directory_entry = find_free_entry(directory_cluster, entries, cluster_number, cluster_index);
+
+    if(new_directory_entry){
+        if(directory){
+            init_directory_entry<true>(new_directory_entry, name.c_str(), cluster);
+        } else {
+            init_file_entry<true>(new_directory_entry, name.c_str(), cluster);
+        }
+    }
+
+    //Write back the parent directory cluster
+    if(!new_directory_entry || !write_sectors(cluster_lba(cluster_number), fat_bs->sectors_per_cluster, directory_cluster.get())){
+        //The chain of the directory may have been extended
+        if(index){
+            index->location = 0;
+        }
+
+        return std::ERROR_FAILED;
+    }
+
+    if(index){
+        //The short entry follows the long name entries
+        auto& entry = new_directory_entry[entries - 1];
+
+        vfs::file file;
+        file.file_name = name;
+        fill_file(file, entry);
+        file.position = cluster_index * directory_cluster.size() + (&entry - directory_cluster.get());
+
+        index->last_cluster = cluster_number;
+        index->clusters = cluster_index + 1;
+
+        index_insert(*index, file);
+    }
+
+    return 0;
+}
+
+//Return the position of the name in the index, NO_INDEX_ENTRY if it is not
+//in the directory
+uint32_t fat32::fat32_file_system::index_find(const directory_index& index, const std::string& name){
+    auto key = name_hash(name);
+    auto i = index.buckets[key & (index.buckets.size() - 1)];
+
+    while(i != NO_INDEX_ENTRY){
+        auto& entry = index.entries[i];
+
+        if(entry.hash == key && entry.file.file_name == name){
+            return i;
+        }
+
+        i = entry.next;
+    }
+
+    return NO_INDEX_ENTRY;
+}
+
+void fat32::fat32_file_system::index_insert(directory_index& index, const vfs::file& file){
+    //Keep at most one file per bucket on average
+    if(index.entries.size() >= index.buckets.size()){
+        index_rehash(index, 2 * index.buckets.size());
+    }
+
+    auto key = name_hash(file.file_name);
+    auto& head = index.buckets[key & (index.buckets.size() - 1)];
+
+    index.entries.push_back({key, head, file});
+    head = index.entries.size() - 1;
+}
+
+//Remove the name from the index, the last entry takes its place
+void fat32::fat32_file_system::index_remove(directory_index& index, const std::string& name){
+    auto i = index_find(index, name);
+
+    if(i == NO_INDEX_ENTRY){
+        return;
+    }
+
+    auto unlink = [&index](uint32_t e){
+        auto* link = &index.buckets[index.entries[e].hash & (index.buckets.size() - 1)];
+
+        while(*link != e){
+            link = &index.entries[*link].next;
+        }
+
+        *link = index.entries[e].next;
+    };
+
+    unlink(i);
+
+    uint32_t last = index.entries.size() - 1;
+
+    if(i != last){
+        unlink(last);
+
+        auto& head = index.buckets[index.entries[last].hash & (index.buckets.size() - 1)];
+
+        index.entries[i] = std::move(index.entries[last]);
+        index.entries[i].next = head;
+        head = i;
+    }
+
+    index.entries.pop_back();
+}
+
+//Set the number of buckets of the index to the power of two holding count
+//entries and chain the entries again
+void fat32::fat32_file_system::index_rehash(directory_index& index, size_t count){
+    size_t buckets = INDEX_MIN_BUCKETS;
+
+    while(buckets < count){
+        buckets *= 2;
+    }
+
+    index.buckets.resize(buckets);
+
+    for(auto& bucket : index.buckets){
+        bucket = NO_INDEX_ENTRY;
+    }
+
+    for(uint32_t i = 0; i < index.entries.size(); ++i){
+        auto& head = index.buckets[index.entries[i].hash & (buckets - 1)];
+
+        index.entries[i].next = head;
+        head = i;
+    }
 }
 
 //Return all the files in the directory denoted by its path
@@ -1271,48 +1588,264 @@ uint64_t fat32::fat32_file_system::cluster_lba(uint64_t cluster){
     return cluster_begin + (cluster - 2) * fat_bs->sectors_per_cluster;
 }
 
+//Return the cluster at the given index of the file starting at location and
+//the number of contiguous clusters from it, from the extent map of the file
+//Return 0 if the chain is shorter
+uint32_t fat32::fat32_file_system::file_cluster(uint32_t location, size_t index, size_t& contiguous){
+    //The map is extended past the index to find long runs
+    static constexpr const size_t LOOKAHEAD = 256;
+
+    if(!data_cluster(location)){
+        return 0;
+    }
+
+    std::lock_guard<mutex> l(extent_lock);
+
+    auto* map = &extent_maps[0];
+
+    for(auto& candidate : extent_maps){
+        if(candidate.location == location){
+            map = &candidate;
+            break;
+        }
+
+        if(candidate.last_use < map->last_use){
+            map = &candidate;
+        }
+    }
+
+    map->last_use = ++extent_clock;
+
+    //A map of another file or of an old chain is built again
+    if(map->location != location || map->generation != fat_generation){
+        map->location = location;
+        map->complete = false;
+        map->generation = fat_generation;
+        map->extents.clear();
+        map->extents.push_back({0, location, 1});
+    }
+
+    auto& extents = map->extents;
+
+    while(!map->complete && extents.back().index + extents.back().length <= index + LOOKAHEAD){
+        auto& back = extents.back();
+        auto next = next_cluster(back.cluster + back.length - 1);
+
+        if(!data_cluster(next)){
+            map->complete = true;
+        } else if(next == back.cluster + back.length){
+            ++back.length;
+        } else {
+            extents.push_back({back.index + back.length, next, 1});
+        }
+    }
+
+    //Binary search of the extent holding the index
+    size_t low = 0;
+    size_t high = extents.size();
+
+    while(high - low > 1){
+        auto middle = (low + high) / 2;
+
+        if(extents[middle].index <= index){
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    auto& e = extents[low];
+
+    if(index >= e.index + e.length){
+        return 0;
+    }
+
+    contiguous = e.index + e.length - index;
+
+    return e.cluster + (index - e.index);
+}
+
+//Transfer the bytes [first, last) of the file starting at location. The
+//runs of whole contiguous clusters are transferred with a single request.
+size_t fat32::fat32_file_system::transfer(uint32_t location, size_t first, size_t last, file_operation operation, char* buffer, size_t& transferred, uint32_t& last_cluster){
+    size_t cluster_size = 512 * fat_bs->sectors_per_cluster;
+
+    std::unique_heap_array<char> cluster_buffer(cluster_size);
+
+    size_t index = first / cluster_size;
+    size_t current = first;
+
+    while(current < last){
+        size_t contiguous = 0;
+        auto cluster = file_cluster(location, index, contiguous);
+
+        //It may be possible that either the file size or the FAT entry is wrong
+        if(!cluster){
+            break;
+        }
+
+        auto in_cluster = current % cluster_size;
+        auto remaining = last - current;
+
+        size_t run = 1;
+        size_t bytes;
+
+        if(in_cluster == 0 && remaining >= cluster_size && operation != file_operation::CLEAR){
+            //Whole clusters are transferred directly from or to the buffer
+            run = std::min(contiguous, remaining / cluster_size);
+            bytes = run * cluster_size;
+
+            auto status = operation == file_operation::READ
+                ? vfs::direct_read(device, buffer + transferred, bytes, cluster_lba(cluster) * 512)
+                : vfs::direct_write(device, buffer + transferred, bytes, cluster_lba(cluster) * 512);
+
+            if(!status || *status != bytes){
+                return std::ERROR_FAILED;
+            }
+        } else {
+            //A part of a cluster goes through the cluster buffer
+            bytes = std::min(cluster_size - in_cluster, remaining);
+
+            if(operation == file_operation::CLEAR && bytes == cluster_size){
+                std::fill_n(cluster_buffer.get(), cluster_size, 0);
+            } else if(!read_sectors(cluster_lba(cluster), fat_bs->sectors_per_cluster, cluster_buffer.get())){
+                return std::ERROR_FAILED;
+            }
+
+            if(operation == file_operation::READ){
+                std::copy_n(cluster_buffer.get() + in_cluster, bytes, buffer + transferred);
+            } else {
+                if(operation == file_operation::WRITE){
+                    std::copy_n(buffer + transferred, bytes, cluster_buffer.get() + in_cluster);
+                } else {
+                    std::fill_n(cluster_buffer.get() + in_cluster, bytes, 0);
+                }
+
+                if(!write_sectors(cluster_lba(cluster), fat_bs->sectors_per_cluster, cluster_buffer.get())){
+                    return std::ERROR_FAILED;
+                }
+            }
+        }
+
+        current += bytes;
+        transferred += bytes;
+        index += run;
+        last_cluster = cluster + run - 1;
+    }
+
+    return 0;
+}
+
+//Return the resident entry of the FAT for the given cluster, loading its
+//page if necessary
+//Return nullptr if an error occurs
+uint32_t* fat32::fat32_file_system::fat_entry(uint32_t cluster){
+    auto page = cluster / FAT_PAGE_ENTRIES;
+
+    if(page >= fat_pages.size()){
+        return nullptr;
+    }
+
+    if(!fat_pages[page]){
+        std::lock_guard<mutex> l(fat_lock);
+
+        //The page may have been loaded while waiting for the lock
+        if(!fat_pages[page]){
+            const auto fat_sectors = fat_bs->sectors_per_fat_long + fat_bs->sectors_per_fat;
+            const auto sectors = std::min(FAT_PAGE_SECTORS, size_t(fat_sectors - page * FAT_PAGE_SECTORS));
+
+            auto* entries = new uint32_t[FAT_PAGE_ENTRIES];
+            std::fill_n(entries, FAT_PAGE_ENTRIES, 0);
+
+            if(!read_sectors(fat_bs->reserved_sectors + page * FAT_PAGE_SECTORS, sectors, entries)){
+                delete[] entries;
+                return nullptr;
+            }
+
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+
+            fat_pages[page] = entries;
+        }
+    }
+
+    return &fat_pages[page][cluster % FAT_PAGE_ENTRIES];
+}
+
+//Write the modified pages of the FAT to all the copies of the FAT
+bool fat32::fat32_file_system::flush_fat(){
+    if(!fat_dirty_pages){
+        return true;
+    }
+
+    std::lock_guard<mutex> l(fat_lock);
+
+    const auto fat_sectors = fat_bs->sectors_per_fat_long + fat_bs->sectors_per_fat;
+
+    bool flushed = true;
+
+    for(size_t page = 0; page < fat_pages.size(); ++page){
+        if(!fat_dirty[page]){
+            continue;
+        }
+
+        //A concurrent modification marks the page dirty again
+        fat_dirty[page] = 0;
+        --fat_dirty_pages;
+
+        const auto sectors = std::min(FAT_PAGE_SECTORS, size_t(fat_sectors - page * FAT_PAGE_SECTORS));
+
+        uint64_t fat_begin = fat_bs->reserved_sectors;
+
+        for(size_t f = 0; f < fat_bs->number_of_fat; ++f){
+            if(!write_sectors(fat_begin + page * FAT_PAGE_SECTORS, sectors, fat_pages[page])){
+                logging::logf(logging::log_level::ERROR, "fat32: Unable to write back the FAT\n");
+                flushed = false;
+            }
+
+            // Switch to the next FAT
+            fat_begin += fat_sectors;
+        }
+    }
+
+    return flushed;
+}
+
+fat32::fat32_file_system::fat_batch::~fat_batch(){
+    fs.flush_fat();
+}
+
 //Return the value of the fat for the given cluster
 //Return 0 if an error occurs
 uint32_t fat32::fat32_file_system::read_fat_value(uint32_t cluster){
-    uint64_t fat_begin = fat_bs->reserved_sectors;
-    uint64_t fat_sector = fat_begin + (cluster * sizeof(uint32_t)) / 512;
+    auto entry = fat_entry(cluster);
 
-    std::unique_heap_array<uint32_t> fat_table(512 / sizeof(uint32_t));
-    if(read_sectors(fat_sector, 1, fat_table.get())){
-        uint64_t entry_offset = cluster % (512 / sizeof(uint32_t));
-        auto v = fat_table[entry_offset] & 0x0FFFFFFF;
-        return v;
-    } else {
-        return 0;
-    }
+    return entry ? *entry & 0x0FFFFFFF : 0;
 }
 
 //Write a value to the FAT for the given cluster
+//The FAT is written back at the end of the operation
 bool fat32::fat32_file_system::write_fat_value(uint32_t cluster, uint32_t value){
-    const auto fat_sectors = fat_bs->sectors_per_fat_long + fat_bs->sectors_per_fat;
+    auto entry = fat_entry(cluster);
 
-    uint64_t fat_begin = fat_bs->reserved_sectors;
+    if(!entry){
+        return false;
+    }
 
-    for(size_t f = 0; f < fat_bs->number_of_fat; ++f){
-        uint64_t fat_sector = fat_begin + (cluster * sizeof(uint32_t)) / 512;
+    //The high 4 bits of the entry are reserved
+    *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
 
-        //Read the cluster we need to alter
-        std::unique_heap_array<uint32_t> fat_table(512 / sizeof(uint32_t));
-        if(!read_sectors(fat_sector, 1, fat_table.get())){
-            return false;
-        }
+    //The extent maps are built again from the new chains
+    __sync_fetch_and_add(&fat_generation, 1);
 
-        //Set the entry to the given value
-        uint64_t entry_offset = cluster % (512 / sizeof(uint32_t));
-        fat_table[entry_offset] = value;
+    auto page = cluster / FAT_PAGE_ENTRIES;
 
-        //Write back the cluster
-        if(!write_sectors(fat_sector, 1, fat_table.get())){
-            return false;
-        }
+    std::lock_guard<mutex> l(fat_lock);
+
+    set_cluster_free(cluster, (value & 0x0FFFFFFF) == CLUSTER_FREE);
 
-        // Switch to the next FAT
-        fat_begin += fat_sectors;
+    if(!fat_dirty[page]){
+        fat_dirty[page] = 1;
+        ++fat_dirty_pages;
     }
 
     return true;
@@ -1329,41 +1862,216 @@ uint32_t fat32::fat32_file_system::next_cluster(uint32_t cluster){
     return fat_value;
 }
 
-//Find a free cluster in the disk
-//0 indicates failure or disk full
-uint32_t fat32::fat32_file_system::find_free_cluster(){
-    uint64_t fat_begin = fat_bs->reserved_sectors;
+//Build the bitmap of the free clusters from the FAT on the disk
+void fat32::fat32_file_system::build_free_map(){
+    const auto fat_sectors = fat_bs->sectors_per_fat_long + fat_bs->sectors_per_fat;
+    const auto data_begin = fat_bs->reserved_sectors + fat_bs->number_of_fat * fat_bs->sectors_per_fat_long;
 
-    static constexpr const auto entries_per_sector = 512 / sizeof(uint32_t);
+    //The FAT may have more entries than the clusters of the volume
+    clusters = std::min(size_t(fat_sectors) * 512 / sizeof(uint32_t), size_t(fat_bs->total_sectors_long - data_begin) / fat_bs->sectors_per_cluster + 2);
 
-    std::unique_heap_array<uint32_t> fat_table(entries_per_sector);
+    free_map.resize((clusters + 63) / 64);
+    free_clusters = 0;
 
-    const auto fat_sectors = fat_bs->sectors_per_fat_long + fat_bs->sectors_per_fat;
+    std::unique_heap_array<uint32_t> fat_table(FAT_PAGE_ENTRIES);
 
-    // Iterate over each sector of the FAT
-    for(size_t j = 0; j < fat_sectors; ++j){
-        uint64_t fat_sector = fat_begin + j;
+    for(size_t page = 0; page * FAT_PAGE_ENTRIES < clusters; ++page){
+        const auto sectors = std::min(FAT_PAGE_SECTORS, size_t(fat_sectors - page * FAT_PAGE_SECTORS));
 
-        // Read one sector of the FAT
-        if(!read_sectors(fat_sector, 1, fat_table.get())){
-            return 0; //0 is not a valid cluster number, indicates failure
+        if(!read_sectors(fat_bs->reserved_sectors + page * FAT_PAGE_SECTORS, sectors, fat_table.get())){
+            logging::logf(logging::log_level::ERROR, "fat32: Unable to read the FAT\n");
+            return;
         }
 
-        // Check all cluster
-        for(size_t i = 0; i < fat_table.size(); ++i){
+        for(size_t i = 0; i < FAT_PAGE_ENTRIES && page * FAT_PAGE_ENTRIES + i < clusters; ++i){
+            auto cluster = page * FAT_PAGE_ENTRIES + i;
+
             //Cluster 0 and 1 are not valid cluster
-            if(j == 0 && i < 2){
+            if(cluster >= 2 && (fat_table[i] & 0x0FFFFFFF) == CLUSTER_FREE){
+                set_cluster_free(cluster, true);
+            }
+        }
+    }
+
+    logging::logf(logging::log_level::TRACE, "fat32: %u free clusters out of %u\n", free_clusters, clusters - 2);
+}
+
+//Indicates if the cluster is free in the bitmap
+bool fat32::fat32_file_system::cluster_free(uint32_t cluster) const {
+    return free_map[cluster / 64] & (uint64_t(1) << (cluster % 64));
+}
+
+//Update the cluster in the bitmap and the count of free clusters
+void fat32::fat32_file_system::set_cluster_free(uint32_t cluster, bool free){
+    if(cluster < 2 || cluster >= clusters || cluster_free(cluster) == free){
+        return;
+    }
+
+    if(free){
+        free_map[cluster / 64] |= uint64_t(1) << (cluster % 64);
+        ++free_clusters;
+    } else {
+        free_map[cluster / 64] &= ~(uint64_t(1) << (cluster % 64));
+        --free_clusters;
+    }
+}
+
+//Find and reserve a free cluster in the disk, the first one from the hint
+//or from the last allocation (next-fit)
+//0 indicates failure or disk full
+uint32_t fat32::fat32_file_system::find_free_cluster(uint32_t hint){
+    std::lock_guard<mutex> l(fat_lock);
+
+    if(!free_clusters){
+        return 0; //0 is not a valid cluster number, indicates failure
+    }
+
+    size_t start = hint >= 2 && hint < clusters ? hint : next_free;
+
+    for(size_t n = 0; n < clusters; ++n){
+        auto cluster = start + n < clusters ? start + n : start + n - clusters;
+
+        //Skip the words without any free cluster
+        if(cluster % 64 == 0 && cluster + 64 <= clusters && n + 64 <= clusters && !free_map[cluster / 64]){
+            n += 63;
+            continue;
+        }
+
+        if(cluster_free(cluster)){
+            set_cluster_free(cluster, false);
+            next_free = cluster + 1 < clusters ? cluster + 1 : 2;
+
+            return cluster;
+        }
+    }
+
+    return 0; //0 is not a valid cluster number, indicates failure
+}
+
+//Find and reserve count contiguous free clusters, the first run from the
+//hint or from the last allocation
+//0 indicates that there is no such run
+uint32_t fat32::fat32_file_system::find_free_run(uint32_t hint, size_t count){
+    std::lock_guard<mutex> l(fat_lock);
+
+    if(count < 2 || count > free_clusters){
+        return 0;
+    }
+
+    size_t start = hint >= 2 && hint < clusters ? hint : next_free;
+
+    //The run cannot wrap around the end of the volume
+    for(size_t pass = 0; pass < 2; ++pass){
+        size_t begin = pass == 0 ? start : 2;
+        size_t end = pass == 0 ? clusters : std::min(start + count, clusters);
+
+        size_t length = 0;
+
+        for(size_t cluster = begin; cluster < end; ++cluster){
+            if(!cluster_free(cluster)){
+                length = 0;
                 continue;
             }
 
-            auto value = fat_table[i] & 0x0FFFFFFF;
-            if(value == CLUSTER_FREE){
-                return i + j * entries_per_sector;
+            if(++length == count){
+                auto first = cluster + 1 - count;
+
+                for(size_t i = 0; i < count; ++i){
+                    set_cluster_free(first + i, false);
+                }
+
+                next_free = cluster + 1 < clusters ? cluster + 1 : 2;
+
+                return first;
             }
         }
     }
 
-    return 0; //0 is not a valid cluster number, indicates failure
+    return 0;
+}
+
+//Track the reads of the file and prefetch its following clusters in the
+//background while it is read sequentially. The last cluster read is given
+//with its index in the file.
+void fat32::fat32_file_system::readahead(uint32_t location, size_t file_size, size_t offset, size_t count, uint32_t cluster_number, size_t cluster){
+    if(!data_cluster(cluster_number)){
+        return;
+    }
+
+    size_t cluster_size = 512 * fat_bs->sectors_per_cluster;
+    size_t clusters = (file_size + cluster_size - 1) / cluster_size;
+    size_t min_window = std::max(READAHEAD_MIN / cluster_size, size_t(1));
+    size_t max_window = std::max(READAHEAD_MAX / cluster_size, size_t(1));
+
+    {
+        std::lock_guard<spinlock> l(readahead_lock);
+
+        auto& stream = find_stream(location);
+
+        bool sequential;
+
+        //A file read again from its start is a new stream
+        if(stream.location != location || offset == 0){
+            stream.location = location;
+            stream.ahead = 0;
+            stream.window = 0;
+
+            sequential = offset == 0;
+        } else {
+            sequential = offset == stream.next_offset;
+        }
+
+        stream.next_offset = offset + count;
+        stream.last_use = ++readahead_clock;
+
+        //Back off on random accesses
+        if(!sequential){
+            stream.window = 0;
+            stream.ahead = 0;
+            return;
+        }
+
+        //The window grows while the file is read sequentially
+        stream.window = stream.window ? std::min(stream.window * 2, max_window) : min_window;
+
+        auto next = std::max(cluster + 1, stream.ahead);
+        auto end = std::min(cluster + 1 + stream.window, clusters);
+
+        //The prefetch starts again once half of the window has been read
+        if(next >= end || next > cluster + 1 + stream.window / 2){
+            return;
+        }
+
+        //Too many pending prefetches, the clusters will be read on demand
+        if(requests_tail - requests_head == READAHEAD_REQUESTS){
+            return;
+        }
+
+        requests[requests_tail % READAHEAD_REQUESTS] = {cluster_number, next - cluster, end - next};
+        ++requests_tail;
+
+        stream.ahead = end;
+        readahead_running = true;
+    }
+
+    work_queue::submit(readahead_work);
+}
+
+//Return the stream of the given file, or the least recently used one
+fat32::readahead_stream& fat32::fat32_file_system::find_stream(uint32_t location){
+    auto* victim = &streams[0];
+
+    for(auto& stream : streams){
+        if(stream.location == location){
+            return stream;
+        }
+
+        if(stream.last_use < victim->last_use){
+            victim = &stream;
+        }
+    }
+
+    return *victim;
 }
 
 bool fat32::fat32_file_system::read_sectors(uint64_t start, uint8_t count, void* destination){
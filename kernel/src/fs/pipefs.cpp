@@ -0,0 +1,162 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <types.hpp>
+#include <string.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "fs/pipefs.hpp"
+
+#include "pipe.hpp"
+
+namespace {
+
+const char* read_file = "read";   ///< The read end of a pipe
+const char* write_file = "write"; ///< The write end of a pipe
+
+void fill(vfs::file& f, const std::string& name, bool directory, size_t size){
+    f.file_name = name;
+    f.directory = directory;
+    f.hidden = false;
+    f.system = false;
+    f.size = size;
+}
+
+} //end of anonymous namespace
+
+pipefs::pipefs_file_system::pipefs_file_system(path mp) : mount_point(mp) {
+    //Nothing to init
+}
+
+pipefs::pipefs_file_system::~pipefs_file_system(){
+    //Nothing to delete
+}
+
+size_t pipefs::pipefs_file_system::get_file(const path& file_path, vfs::file& f){
+    // Access the root folder
+    if(file_path.is_root()){
+        fill(f, "/", true, 0);
+
+        return 0;
+    }
+
+    auto size = pipe::size(std::atoui(file_path[1]));
+
+    if(!size){
+        return size.error();
+    }
+
+    // Access a pipe folder
+    if(file_path.size() == 2){
+        fill(f, file_path[1], true, 0);
+
+        return 0;
+    }
+
+    // Access one of the ends, the size is what is buffered
+    if(file_path.size() == 3 && (file_path[2] == read_file || file_path[2] == write_file)){
+        fill(f, file_path[2], false, *size);
+
+        return 0;
+    }
+
+    return std::ERROR_NOT_EXISTS;
+}
+
+size_t pipefs::pipefs_file_system::read(const path& file_path, char* buffer, size_t count, size_t offset, size_t& read){
+    return this->read(file_path, buffer, count, offset, read, 0);
+}
+
+size_t pipefs::pipefs_file_system::read(const path& file_path, char* buffer, size_t count, size_t /*offset*/, size_t& read, size_t ms){
+    if(file_path.size() != 3){
+        return std::ERROR_PERMISSION_DENIED;
+    }
+
+    // A pipe is a stream, the offset is ignored
+    if(file_path[2] != read_file){
+        return std::ERROR_PERMISSION_DENIED;
+    }
+
+    auto result = pipe::read(std::atoui(file_path[1]), buffer, count, ms);
+
+    if(!result){
+        return result.error();
+    }
+
+    read = *result;
+
+    return 0;
+}
+
+size_t pipefs::pipefs_file_system::write(const path& file_path, const char* buffer, size_t count, size_t /*offset*/, size_t& written){
+    if(file_path.size() != 3 || file_path[2] != write_file){
+        return std::ERROR_PERMISSION_DENIED;
+    }
+
+    auto result = pipe::write(std::atoui(file_path[1]), buffer, count);
+
+    if(!result){
+        return result.error();
+    }
+
+    written = *result;
+
+    return 0;
+}
+
+size_t pipefs::pipefs_file_system::ls(const path& file_path, std::vector<vfs::file>& contents){
+    if(file_path.is_root()){
+        for(auto id : pipe::pipes()){
+            contents.emplace_back(std::to_string(id), true, false, false, 0UL);
+        }
+
+        return 0;
+    }
+
+    if(file_path.size() == 2){
+        auto size = pipe::size(std::atoui(file_path[1]));
+
+        if(!size){
+            return size.error();
+        }
+
+        contents.emplace_back(read_file, false, false, false, *size);
+        contents.emplace_back(write_file, false, false, false, *size);
+
+        return 0;
+    }
+
+    return std::ERROR_NOT_EXISTS;
+}
+
+size_t pipefs::pipefs_file_system::statfs(vfs::statfs_info& file){
+    file.total_size = 0;
+    file.free_size = 0;
+
+    return 0;
+}
+
+size_t pipefs::pipefs_file_system::clear(const path&, size_t, size_t, size_t&){
+    return std::ERROR_UNSUPPORTED;
+}
+
+size_t pipefs::pipefs_file_system::truncate(const path&, size_t){
+    return std::ERROR_UNSUPPORTED;
+}
+
+size_t pipefs::pipefs_file_system::touch(const path& ){
+    return std::ERROR_PERMISSION_DENIED;
+}
+
+size_t pipefs::pipefs_file_system::mkdir(const path& ){
+    return std::ERROR_PERMISSION_DENIED;
+}
+
+size_t pipefs::pipefs_file_system::rm(const path& ){
+    return std::ERROR_PERMISSION_DENIED;
+}
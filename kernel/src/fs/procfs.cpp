@@ -15,14 +15,37 @@
 #include "fs/procfs.hpp"
 
 #include "scheduler.hpp"
+#include "process_table.hpp"
 #include "logging.hpp"
+#include "sched_trace.hpp"
+#include "alloc_profile.hpp"
+#include "syscall_stats.hpp"
+#include "profile.hpp"
+#include "interrupts.hpp"
+#include "timer.hpp"
+#include "boot_trace.hpp"
+#include "physical_allocator.hpp"
+
+#include "conc/lock_stat.hpp"
+
+#include "net/network.hpp"
+#include "net/stats.hpp"
 
 namespace {
 
-const scheduler::process_control_t* pcb = nullptr;
+const scheduler::process_table* pcb = nullptr;
 
 std::vector<vfs::file> standard_contents;
 
+const char* trace_file = "sched_trace";     ///< The stream of the scheduler events
+const char* tcp_file = "tcp";               ///< The state of the TCP connections
+const char* snmp_file = "snmp";             ///< The counters of the network protocols
+const char* syscalls_file = "syscalls";     ///< The statistics of the system calls
+const char* profile_file = "profile";       ///< The stream of the samples of the profiler
+const char* lockstat_file = "lockstat";     ///< The contention statistics of the named locks
+const char* interrupts_file = "interrupts"; ///< The counts and durations of the interrupts
+const char* boottime_file = "boottime";     ///< The trace of the boot phases
+
 size_t read(const std::string& value, char* buffer, size_t count, size_t offset, size_t& read){
     if(offset > value.size()){
         return std::ERROR_INVALID_OFFSET;
@@ -34,8 +57,8 @@ size_t read(const std::string& value, char* buffer, size_t count, size_t offset,
     return 0;
 }
 
-std::string get_value(uint64_t pid, const std::string& name){
-    auto& process = pcb[pid];
+std::string get_value(uint64_t pid, std::string_view name){
+    auto& process = (*pcb)[pid];
 
     if(name == "pid"){
         return std::to_string(process.process.pid);
@@ -51,6 +74,57 @@ std::string get_value(uint64_t pid, const std::string& name){
         return process.process.name;
     } else if(name == "memory"){
         return std::to_string(process.process.brk_end - process.process.brk_start);
+    } else if(name == "allocations"){
+        return alloc_profile::format(process.process);
+    } else if(name == "syscalls"){
+        return syscall_stats::format(process.process.syscalls);
+    } else if(name == "stat"){
+        // One line per counter, the times in milliseconds
+        auto& usage = process.usage;
+        auto frequency = timer::timer_frequency();
+
+        // The memory is shared by the threads of the process, the shared
+        // pages are also mapped by other processes or by the page cache
+        size_t resident = 0;
+        size_t shared = 0;
+        for(auto& segment : (*pcb)[process.owner].process.segments){
+            resident += segment.size / paging::PAGE_SIZE;
+
+            if(physical_allocator::shared(segment.physical)){
+                shared += segment.size / paging::PAGE_SIZE;
+            }
+        }
+
+        std::string value;
+
+        value += "user_ms " + std::to_string(frequency ? usage.user_ticks * 1000 / frequency : 0) + '\n';
+        value += "kernel_ms " + std::to_string(frequency ? usage.kernel_ticks * 1000 / frequency : 0) + '\n';
+        value += "voluntary_switches " + std::to_string(usage.voluntary_switches) + '\n';
+        value += "involuntary_switches " + std::to_string(usage.involuntary_switches) + '\n';
+        value += "page_faults " + std::to_string(usage.page_faults) + '\n';
+        value += "resident_pages " + std::to_string(resident) + '\n';
+        value += "shared_pages " + std::to_string(shared) + '\n';
+        value += "read_bytes " + std::to_string(usage.read_bytes) + '\n';
+        value += "written_bytes " + std::to_string(usage.written_bytes) + '\n';
+        value += "received_bytes " + std::to_string(usage.received_bytes) + '\n';
+        value += "sent_bytes " + std::to_string(usage.sent_bytes) + '\n';
+        value += "children_user_ms " + std::to_string(frequency ? usage.children_user_ticks * 1000 / frequency : 0) + '\n';
+        value += "children_kernel_ms " + std::to_string(frequency ? usage.children_kernel_ticks * 1000 / frequency : 0) + '\n';
+
+        return value;
+    } else if(name == "run_delay"){
+        // One line per bucket, with the upper bound in microseconds
+        std::string value;
+
+        auto& counts = process.run_delay.counts;
+        for(size_t i = 0; i < counts.size(); ++i){
+            value += i + 1 < counts.size() ? std::to_string(1ULL << i) : std::string("inf");
+            value += ' ';
+            value += std::to_string(counts[i]);
+            value += '\n';
+        }
+
+        return value;
     } else {
         return "";
     }
@@ -58,12 +132,12 @@ std::string get_value(uint64_t pid, const std::string& name){
 
 } //end of anonymous namespace
 
-void procfs::set_pcb(const scheduler::process_control_t* pcb_ptr){
+void procfs::set_pcb(const scheduler::process_table* pcb_ptr){
     pcb = pcb_ptr;
 }
 
 procfs::procfs_file_system::procfs_file_system(path mp) : mount_point(mp) {
-    standard_contents.reserve(7);
+    standard_contents.reserve(11);
     standard_contents.emplace_back("pid", false, false, false, 0UL);
     standard_contents.emplace_back("ppid", false, false, false, 0UL);
     standard_contents.emplace_back("state", false, false, false, 0UL);
@@ -71,6 +145,10 @@ procfs::procfs_file_system::procfs_file_system(path mp) : mount_point(mp) {
     standard_contents.emplace_back("priority", false, false, false, 0UL);
     standard_contents.emplace_back("name", false, false, false, 0UL);
     standard_contents.emplace_back("memory", false, false, false, 0UL);
+    standard_contents.emplace_back("run_delay", false, false, false, 0UL);
+    standard_contents.emplace_back("allocations", false, false, false, 0UL);
+    standard_contents.emplace_back("syscalls", false, false, false, 0UL);
+    standard_contents.emplace_back("stat", false, false, false, 0UL);
 }
 
 procfs::procfs_file_system::~procfs_file_system(){
@@ -89,16 +167,98 @@ size_t procfs::procfs_file_system::get_file(const path& file_path, vfs::file& f)
         return 0;
     }
 
-    auto i = atoui(file_path[1]);
+    // Access the trace of the scheduler
+    if(file_path.size() == 2 && file_path[1] == trace_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = sched_trace::pending() * sched_trace::LINE_SIZE;
 
-    // Check the pid folder
-    if(i >= scheduler::MAX_PROCESS){
-        return std::ERROR_NOT_EXISTS;
+        return 0;
+    }
+
+    // Access the state of the TCP connections
+    if(file_path.size() == 2 && file_path[1] == tcp_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = network::format_tcp_connections().size();
+
+        return 0;
+    }
+
+    // Access the counters of the network protocols
+    if(file_path.size() == 2 && file_path[1] == snmp_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = network::stats::format().size();
+
+        return 0;
+    }
+
+    // Access the statistics of the system calls
+    if(file_path.size() == 2 && file_path[1] == syscalls_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = syscall_stats::format().size();
+
+        return 0;
+    }
+
+    // Access the statistics of the locks
+    if(file_path.size() == 2 && file_path[1] == lockstat_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = lock_stat::format().size();
+
+        return 0;
+    }
+
+    // Access the statistics of the interrupts
+    if(file_path.size() == 2 && file_path[1] == interrupts_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = interrupt::format_stats().size();
+
+        return 0;
+    }
+
+    // Access the trace of the boot
+    if(file_path.size() == 2 && file_path[1] == boottime_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = boot_trace::format().size();
+
+        return 0;
+    }
+
+    // Access the samples of the profiler
+    if(file_path.size() == 2 && file_path[1] == profile_file){
+        f.file_name = file_path[1];
+        f.directory = false;
+        f.hidden = false;
+        f.system = false;
+        f.size = profile::pending() * profile::LINE_SIZE;
+
+        return 0;
     }
 
-    auto& process = pcb[i];
+    auto i = atoui(file_path[1]);
 
-    if(process.state == scheduler::process_state::EMPTY){
+    // Check the pid folder
+    if(!pcb->exists(i)){
         return std::ERROR_NOT_EXISTS;
     }
 
@@ -135,6 +295,42 @@ size_t procfs::procfs_file_system::get_file(const path& file_path, vfs::file& f)
 }
 
 size_t procfs::procfs_file_system::read(const path& file_path, char* buffer, size_t count, size_t offset, size_t& read){
+    // The trace is a stream, each read consumes the events, regardless of the offset
+    if(file_path.size() == 2 && file_path[1] == trace_file){
+        read = sched_trace::read(buffer, count);
+        return 0;
+    }
+
+    if(file_path.size() == 2 && file_path[1] == tcp_file){
+        return ::read(network::format_tcp_connections(), buffer, count, offset, read);
+    }
+
+    if(file_path.size() == 2 && file_path[1] == snmp_file){
+        return ::read(network::stats::format(), buffer, count, offset, read);
+    }
+
+    if(file_path.size() == 2 && file_path[1] == syscalls_file){
+        return ::read(syscall_stats::format(), buffer, count, offset, read);
+    }
+
+    if(file_path.size() == 2 && file_path[1] == lockstat_file){
+        return ::read(lock_stat::format(), buffer, count, offset, read);
+    }
+
+    if(file_path.size() == 2 && file_path[1] == interrupts_file){
+        return ::read(interrupt::format_stats(), buffer, count, offset, read);
+    }
+
+    if(file_path.size() == 2 && file_path[1] == boottime_file){
+        return ::read(boot_trace::format(), buffer, count, offset, read);
+    }
+
+    // The samples are a stream as well
+    if(file_path.size() == 2 && file_path[1] == profile_file){
+        read = profile::read(buffer, count);
+        return 0;
+    }
+
     //Cannot access the root nor the pid directores for reading
     if(file_path.size() < 3){
         return std::ERROR_PERMISSION_DENIED;
@@ -143,13 +339,7 @@ size_t procfs::procfs_file_system::read(const path& file_path, char* buffer, siz
     if(file_path.size() == 3){
         auto i = atoui(file_path[1]);
 
-        if(i >= scheduler::MAX_PROCESS){
-            return std::ERROR_NOT_EXISTS;
-        }
-
-        auto& process = pcb[i];
-
-        if(process.state == scheduler::process_state::EMPTY){
+        if(!pcb->exists(i)){
             return std::ERROR_NOT_EXISTS;
         }
 
@@ -171,8 +361,8 @@ size_t procfs::procfs_file_system::read(const path& /*file_path*/, char* /*buffe
 
 size_t procfs::procfs_file_system::ls(const path& file_path, std::vector<vfs::file>& contents){
     if(file_path.is_root()){
-        for(size_t i = 0; i < scheduler::MAX_PROCESS; ++i){
-            auto& process = pcb[i];
+        for(size_t i = 0; i < pcb->size(); ++i){
+            auto& process = pcb->slot(i);
 
             if(process.state != scheduler::process_state::EMPTY){
                 vfs::file f;
@@ -185,6 +375,15 @@ size_t procfs::procfs_file_system::ls(const path& file_path, std::vector<vfs::fi
             }
         }
 
+        contents.emplace_back(trace_file, false, false, false, 0UL);
+        contents.emplace_back(tcp_file, false, false, false, 0UL);
+        contents.emplace_back(snmp_file, false, false, false, 0UL);
+        contents.emplace_back(syscalls_file, false, false, false, 0UL);
+        contents.emplace_back(profile_file, false, false, false, 0UL);
+        contents.emplace_back(lockstat_file, false, false, false, 0UL);
+        contents.emplace_back(interrupts_file, false, false, false, 0UL);
+        contents.emplace_back(boottime_file, false, false, false, 0UL);
+
         return 0;
     }
 
@@ -204,7 +403,34 @@ size_t procfs::procfs_file_system::statfs(vfs::statfs_info& file){
     return 0;
 }
 
-size_t procfs::procfs_file_system::write(const path&, const char*, size_t, size_t, size_t&){
+size_t procfs::procfs_file_system::write(const path& file_path, const char* buffer, size_t count, size_t /*offset*/, size_t& written){
+    // The profiler is controlled with "start [depth]" and "stop"
+    if(file_path.size() == 2 && file_path[1] == profile_file){
+        std::string command;
+
+        for(size_t i = 0; i < count && buffer[i] != '\n'; ++i){
+            command += buffer[i];
+        }
+
+        auto parts = std::split(command);
+
+        if(parts.empty()){
+            return std::ERROR_INVALID_REQUEST;
+        }
+
+        if(parts[0] == "start" && parts.size() <= 2){
+            profile::start(parts.size() == 2 ? std::atoui(parts[1]) : 0);
+        } else if(parts[0] == "stop" && parts.size() == 1){
+            profile::stop();
+        } else {
+            return std::ERROR_INVALID_REQUEST;
+        }
+
+        written = count;
+
+        return 0;
+    }
+
     return std::ERROR_PERMISSION_DENIED;
 }
 
@@ -8,11 +8,15 @@
 #include <types.hpp>
 #include <unique_ptr.hpp>
 #include <algorithms.hpp>
+#include <lock_guard.hpp>
+#include <hash.hpp>
 
 #include <tlib/errors.hpp>
 
 #include "fs/sysfs.hpp"
 
+#include "conc/mutex.hpp"
+
 #include "console.hpp"
 #include "assert.hpp"
 
@@ -20,98 +24,170 @@ namespace {
 
 struct sys_value {
     std::string name;
+    size_t hash                                = 0;
     std::string _value;
-    sysfs::dynamic_fun_t fun           = nullptr;
-    sysfs::dynamic_fun_data_t fun_data = nullptr;
-    void* data                         = nullptr;
-
-    sys_value() {}
-    sys_value(std::string name, std::string value)
-            : name(name), _value(value) {
+    sysfs::dynamic_fun_t fun                   = nullptr;
+    sysfs::dynamic_fun_data_t fun_data         = nullptr;
+    sysfs::counter_fun_t counter               = nullptr;
+    sysfs::counter_fun_data_t counter_data     = nullptr;
+    sysfs::store_fun_data_t store              = nullptr;
+    void* data                                 = nullptr;
+
+    explicit sys_value(std::string_view name)
+            : name(name), hash(std::hash<std::string_view>()(name)) {
         //Nothing else to init
     }
+};
 
-    sys_value(std::string name, sysfs::dynamic_fun_t fun)
-            : name(name), fun(fun) {
-        //Nothing else to init
-    }
+struct sys_folder {
+    std::string name;
+    size_t hash = 0;
+
+    // The nodes are allocated one by one, the open files keep pointers to them
+    std::vector<std::unique_ptr<sys_folder>> folders;
+    std::vector<std::unique_ptr<sys_value>> values;
 
-    sys_value(std::string name, sysfs::dynamic_fun_data_t fun_data, void* data)
-            : name(name), fun_data(fun_data), data(data) {
+    explicit sys_folder(std::string_view name)
+            : name(name), hash(std::hash<std::string_view>()(name)) {
         //Nothing else to init
     }
+};
 
-    std::string value() const {
-        if (fun_data){
-            return fun_data(data);
-        } else if (fun) {
-            return fun();
-        } else {
-            return _value;
-        }
-    }
+/*!
+ * \brief The characters of a value, the counters are formatted on the stack
+ * and the constant values are not copied
+ */
+struct rendered_value {
+    std::string dynamic;       ///< The value returned by a dynamic function
+    char digits[24];           ///< The formatted counter
+    const char* data = nullptr; ///< The characters of the value
+    size_t size      = 0;       ///< The number of characters of the value
 };
 
-struct sys_folder {
-    std::string name;
-    std::vector<sys_folder> folders;
-    std::vector<sys_value> values;
+std::vector<std::unique_ptr<sys_folder>> root_folders;
 
-    sys_folder() {}
+// The drivers publish their values concurrently, the vectors must not move under a reader
+mutex folders_lock;
 
-    explicit sys_folder(std::string name)
-            : name(name) {
-        //Nothing else to init
+// Incremented each time a node is deleted, the open files resolved before
+// must look for their node again
+size_t nodes_generation = 1;
+
+void render(const sys_value& value, rendered_value& r) {
+    if (value.counter_data || value.counter) {
+        auto n = value.counter_data ? value.counter_data(value.data) : value.counter();
+
+        std::to_raw_string(n, r.digits, sizeof(r.digits));
+
+        r.data = r.digits;
+        r.size = std::str_len(r.digits);
+    } else if (value.fun_data || value.fun) {
+        r.dynamic = value.fun_data ? value.fun_data(value.data) : value.fun();
+
+        r.data = r.dynamic.c_str();
+        r.size = r.dynamic.size();
+    } else {
+        r.data = value._value.c_str();
+        r.size = value._value.size();
     }
-};
+}
 
-std::vector<sys_folder> root_folders;
+size_t value_size(const sys_value& value) {
+    rendered_value r;
+    render(value, r);
+    return r.size;
+}
 
 sys_folder& find_root_folder(const path& mount_point) {
     thor_assert(mount_point.is_sub_root(), "Unsupported mount point");
 
     for (auto& sys_folder : root_folders) {
-        if (sys_folder.name == mount_point.sub_root_name()) {
-            return sys_folder;
+        if (sys_folder->name == mount_point.sub_root_name()) {
+            return *sys_folder;
         }
     }
 
-    return root_folders.emplace_back(mount_point.sub_root_name());
+    root_folders.emplace_back(new sys_folder(mount_point.sub_root_name()));
+
+    return *root_folders.back();
 }
 
+// The names are compared by hash first, the hashes of the parts of the path are precomputed
+template <typename T>
+bool matches(const T& entry, const path& file_path, size_t i) {
+    return entry.hash == file_path.hash(i) && entry.name == file_path[i];
+}
+
+template <typename T>
+bool matches(const T& entry, std::string_view name, size_t hash) {
+    return entry.hash == hash && entry.name == name;
+}
+
+// Find the folder of the parts [i, last) of the path, creating the missing folders
 sys_folder& find_folder(sys_folder& root, const path& file_path, size_t i, size_t last){
-    auto& name = file_path[i];
-
-    for (auto& folder : root.folders) {
-        if (folder.name == name) {
-            if (i == last - 1) {
-                return folder;
-            } else {
-                return find_folder(folder, file_path, i + 1, last);
+    auto* folder = &root;
+
+    for (; i < last; ++i) {
+        sys_folder* next = nullptr;
+
+        for (auto& child : folder->folders) {
+            if (matches(*child, file_path, i)) {
+                next = child.get();
+                break;
             }
         }
-    }
 
-    root.folders.emplace_back(name);
+        if (!next) {
+            folder->folders.emplace_back(new sys_folder(file_path[i]));
+            next = folder->folders.back().get();
+        }
 
-    if (i == last - 1) {
-        return root.folders.back();
-    } else {
-        return find_folder(root.folders.back(), file_path, i + 1, last);
+        folder = next;
     }
+
+    return *folder;
 }
 
-bool exists_folder(sys_folder& root, const path& file_path, size_t i, size_t last) {
-    auto& name = file_path[i];
+// Find the folder of the parts [i, last) of the path, nullptr if it does not exist
+sys_folder* lookup_folder(sys_folder& root, const path& file_path, size_t i, size_t last) {
+    auto* folder = &root;
 
-    for (auto& folder : root.folders) {
-        if (folder.name == name) {
-            if (i == last - 1) {
-                return true;
-            } else {
-                return exists_folder(folder, file_path, i + 1, last);
+    for (; i < last && folder; ++i) {
+        sys_folder* next = nullptr;
+
+        for (auto& child : folder->folders) {
+            if (matches(*child, file_path, i)) {
+                next = child.get();
+                break;
             }
         }
+
+        folder = next;
+    }
+
+    return folder;
+}
+
+// The folder containing the last part of the path, nullptr if it does not exist
+sys_folder* lookup_parent(const path& mount_point, const path& file_path) {
+    return lookup_folder(find_root_folder(mount_point), file_path, 1, file_path.size() - 1);
+}
+
+sys_value* lookup_value(sys_folder& folder, const path& file_path) {
+    for (auto& value : folder.values) {
+        if (matches(*value, file_path, file_path.size() - 1)) {
+            return value.get();
+        }
+    }
+
+    return nullptr;
+}
+
+bool has_folder(sys_folder& folder, const path& file_path) {
+    for (auto& child : folder.folders) {
+        if (matches(*child, file_path, file_path.size() - 1)) {
+            return true;
+        }
     }
 
     return false;
@@ -119,8 +195,8 @@ bool exists_folder(sys_folder& root, const path& file_path, size_t i, size_t las
 
 size_t get_file(const sys_folder& folder, const path& file_path, vfs::file& f) {
     for (auto& file : folder.folders) {
-        if (file.name == file_path.base_name()) {
-            f.file_name = file.name;
+        if (matches(*file, file_path, file_path.size() - 1)) {
+            f.file_name = file->name;
             f.directory = true;
             f.hidden    = false;
             f.system    = false;
@@ -131,12 +207,12 @@ size_t get_file(const sys_folder& folder, const path& file_path, vfs::file& f) {
     }
 
     for (auto& file : folder.values) {
-        if (file.name == file_path.base_name()) {
-            f.file_name = file.name;
+        if (matches(*file, file_path, file_path.size() - 1)) {
+            f.file_name = file->name;
             f.directory = false;
             f.hidden    = false;
             f.system    = false;
-            f.size      = file.value().size();
+            f.size      = value_size(*file);
 
             return 0;
         }
@@ -147,85 +223,102 @@ size_t get_file(const sys_folder& folder, const path& file_path, vfs::file& f) {
 
 size_t ls(const sys_folder& folder, std::vector<vfs::file>& contents) {
     for (auto& file : folder.folders) {
-        contents.emplace_back(file.name, true, false, false, 0UL);
+        contents.emplace_back(file->name, true, false, false, 0UL);
     }
 
     for (auto& file : folder.values) {
-        contents.emplace_back(file.name, false, false, false, file.value().size());
+        contents.emplace_back(file->name, false, false, false, value_size(*file));
     }
 
     return 0;
 }
 
-size_t read(const sys_folder& folder, const path& file_path, char* buffer, size_t count, size_t offset, size_t& read) {
-    for (auto& file : folder.values) {
-        if (file.name == file_path.base_name()) {
-            auto value = file.value();
+size_t read(const sys_value& value, char* buffer, size_t count, size_t offset, size_t& read) {
+    rendered_value r;
+    render(value, r);
 
-            if (offset > value.size()) {
-                return std::ERROR_INVALID_OFFSET;
-            }
+    if (offset > r.size) {
+        return std::ERROR_INVALID_OFFSET;
+    }
 
-            read = std::min(count, value.size() - offset);
-            std::copy_n(value.c_str() + offset, read, buffer);
+    read = std::min(count, r.size - offset);
+    std::copy_n(r.data + offset, read, buffer);
 
-            return 0;
-        }
+    return 0;
+}
+
+size_t write(sys_value& value, const char* buffer, size_t count, size_t offset, size_t& written) {
+    if (!value.store) {
+        return std::ERROR_PERMISSION_DENIED;
     }
 
-    for (auto& file : folder.folders) {
-        if (file.name == file_path.base_name()) {
-            return std::ERROR_DIRECTORY;
-        }
+    // A value is always written as a whole
+    if (offset) {
+        return std::ERROR_INVALID_OFFSET;
     }
 
-    return std::ERROR_NOT_EXISTS;
-}
+    size_t n = 0;
+    while (n < count && buffer[n] != '\n') {
+        ++n;
+    }
 
-void set_value(sys_folder& folder, const std::string& name, const std::string& value) {
-    for (auto& v : folder.values) {
-        if (v.name == name) {
-            v._value = value;
-            return;
-        }
+    auto result = value.store(value.data, std::string(buffer, buffer + n));
+
+    if (!result) {
+        written = count;
     }
 
-    folder.values.emplace_back(name, value);
+    return result;
 }
 
-void set_value(sys_folder& folder, const std::string& name, sysfs::dynamic_fun_t fun) {
-    for (auto& v : folder.values) {
-        if (v.name == name) {
-            v.fun = fun;
-            return;
-        }
+// Find the value of the path, or the error to return for it
+size_t lookup(const path& mount_point, const path& file_path, sys_value*& value) {
+    if (file_path.is_root()) {
+        return std::ERROR_DIRECTORY;
     }
 
-    folder.values.emplace_back(name, fun);
+    auto* folder = lookup_parent(mount_point, file_path);
+
+    if (!folder) {
+        return std::ERROR_NOT_EXISTS;
+    }
+
+    value = lookup_value(*folder, file_path);
+
+    if (!value) {
+        return has_folder(*folder, file_path) ? std::ERROR_DIRECTORY : std::ERROR_NOT_EXISTS;
+    }
+
+    return 0;
 }
 
-void set_value(sys_folder& folder, const std::string& name, sysfs::dynamic_fun_data_t fun, void* data) {
+sys_value& find_value(const path& mount_point, const path& file_path) {
+    auto& folder = find_folder(find_root_folder(mount_point), file_path, 1, file_path.size() - 1);
+    auto name    = file_path.base_name();
+    auto hash    = file_path.hash(file_path.size() - 1);
+
     for (auto& v : folder.values) {
-        if (v.name == name) {
-            v.fun_data = fun;
-            v.data     = data;
-            return;
+        if (matches(*v, name, hash)) {
+            return *v;
         }
     }
 
-    folder.values.emplace_back(name, fun, data);
-}
+    folder.values.emplace_back(new sys_value(name));
 
-void delete_value(sys_folder& folder, const std::string& name) {
-    folder.values.erase(std::remove_if(folder.values.begin(), folder.values.end(), [&name](const sys_value& value){
-        return value.name == name;
-    }), folder.values.end());
+    return *folder.values.back();
 }
 
-void delete_folder(sys_folder& folder, const std::string& name) {
-    folder.folders.erase(std::remove_if(folder.folders.begin(), folder.folders.end(), [&name](const sys_folder& value){
-        return value.name == name;
-    }), folder.folders.end());
+template <typename T>
+void erase_node(std::vector<std::unique_ptr<T>>& nodes, const path& file_path) {
+    auto it = std::remove_if(nodes.begin(), nodes.end(), [&file_path](const std::unique_ptr<T>& node) {
+        return matches(*node, file_path, file_path.size() - 1);
+    });
+
+    if (it != nodes.end()) {
+        nodes.erase(it, nodes.end());
+
+        ++nodes_generation;
+    }
 }
 
 } //end of anonymous namespace
@@ -240,7 +333,7 @@ sysfs::sysfs_file_system::~sysfs_file_system() {
 }
 
 size_t sysfs::sysfs_file_system::get_file(const path& file_path, vfs::file& f) {
-    auto& root_folder = find_root_folder(mount_point);
+    std::lock_guard<mutex> l(folders_lock);
 
     if (file_path.is_root()) {
         f.file_name = "/";
@@ -250,43 +343,104 @@ size_t sysfs::sysfs_file_system::get_file(const path& file_path, vfs::file& f) {
         f.size      = 0;
 
         return 0;
-    } else if (file_path.size() == 2) {
-        return ::get_file(root_folder, file_path, f);
-    } else {
-        if (exists_folder(root_folder, file_path, 1, file_path.size() - 1)) {
-            auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
+    }
 
-            return ::get_file(folder, file_path, f);
-        }
+    auto* folder = lookup_parent(mount_point, file_path);
 
+    if (!folder) {
         return std::ERROR_NOT_EXISTS;
     }
+
+    return ::get_file(*folder, file_path, f);
 }
 
 size_t sysfs::sysfs_file_system::read(const path& file_path, char* buffer, size_t count, size_t offset, size_t& read) {
-    auto& root_folder = find_root_folder(mount_point);
+    std::lock_guard<mutex> l(folders_lock);
 
-    if (file_path.is_root()) {
-        return std::ERROR_DIRECTORY;
-    } else if (file_path.size() == 2) {
-        return ::read(root_folder, file_path, buffer, count, offset, read);
-    } else {
-        if (exists_folder(root_folder, file_path, 1, file_path.size() - 1)) {
-            auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
+    sys_value* value = nullptr;
+    auto result = lookup(mount_point, file_path, value);
 
-            return ::read(folder, file_path, buffer, count, offset, read);
-        }
-
-        return std::ERROR_NOT_EXISTS;
+    if (result) {
+        return result;
     }
+
+    return ::read(*value, buffer, count, offset, read);
 }
 
 size_t sysfs::sysfs_file_system::read(const path& /*file_path*/, char* /*buffer*/, size_t /*count*/, size_t /*offset*/, size_t& /*read*/, size_t /*ms*/) {
     return std::ERROR_UNSUPPORTED;
 }
 
-size_t sysfs::sysfs_file_system::write(const path&, const char*, size_t, size_t, size_t&) {
-    return std::ERROR_PERMISSION_DENIED;
+size_t sysfs::sysfs_file_system::write(const path& file_path, const char* buffer, size_t count, size_t offset, size_t& written) {
+    std::lock_guard<mutex> l(folders_lock);
+
+    sys_value* value = nullptr;
+    auto result = lookup(mount_point, file_path, value);
+
+    if (result) {
+        return result;
+    }
+
+    return ::write(*value, buffer, count, offset, written);
+}
+
+// The node of the value is kept in the open file, it is looked for again
+// only if a node has been deleted since it was resolved. The lock must be
+// held by the caller.
+size_t sysfs::sysfs_file_system::resolve_locked(vfs::open_file& file) {
+    if (file.generation == nodes_generation) {
+        return file.location ? 0 : std::ERROR_DIRECTORY;
+    }
+
+    sys_value* value = nullptr;
+    auto result = lookup(mount_point, file.fs_path, value);
+
+    if (result == std::ERROR_DIRECTORY) {
+        file.location  = 0;
+        file.directory = true;
+    } else if (result) {
+        return result;
+    } else {
+        file.location  = reinterpret_cast<size_t>(value);
+        file.directory = false;
+    }
+
+    file.generation = nodes_generation;
+
+    return result;
+}
+
+size_t sysfs::sysfs_file_system::resolve(vfs::open_file& file) {
+    std::lock_guard<mutex> l(folders_lock);
+
+    auto result = resolve_locked(file);
+
+    // The directories can be opened, they are only not readable
+    return result == std::ERROR_DIRECTORY ? 0 : result;
+}
+
+size_t sysfs::sysfs_file_system::read(vfs::open_file& file, char* buffer, size_t count, size_t offset, size_t& read) {
+    std::lock_guard<mutex> l(folders_lock);
+
+    auto result = resolve_locked(file);
+
+    if (result) {
+        return result;
+    }
+
+    return ::read(*reinterpret_cast<sys_value*>(file.location), buffer, count, offset, read);
+}
+
+size_t sysfs::sysfs_file_system::write(vfs::open_file& file, const char* buffer, size_t count, size_t offset, size_t& written) {
+    std::lock_guard<mutex> l(folders_lock);
+
+    auto result = resolve_locked(file);
+
+    if (result) {
+        return result;
+    }
+
+    return ::write(*reinterpret_cast<sys_value*>(file.location), buffer, count, offset, written);
 }
 
 size_t sysfs::sysfs_file_system::clear(const path&, size_t, size_t, size_t&) {
@@ -298,19 +452,15 @@ size_t sysfs::sysfs_file_system::truncate(const path&, size_t) {
 }
 
 size_t sysfs::sysfs_file_system::ls(const path& file_path, std::vector<vfs::file>& contents) {
-    auto& root_folder = find_root_folder(mount_point);
+    std::lock_guard<mutex> l(folders_lock);
 
-    if (file_path.is_root()) {
-        return ::ls(root_folder, contents);
-    } else {
-        if (exists_folder(root_folder, file_path, 1, file_path.size())) {
-            auto& folder = find_folder(root_folder, file_path, 1, file_path.size());
-
-            return ::ls(folder, contents);
-        }
+    auto* folder = lookup_folder(find_root_folder(mount_point), file_path, 1, file_path.size());
 
+    if (!folder) {
         return std::ERROR_NOT_EXISTS;
     }
+
+    return ::ls(*folder, contents);
 }
 
 size_t sysfs::sysfs_file_system::touch(const path&) {
@@ -333,58 +483,60 @@ size_t sysfs::sysfs_file_system::statfs(vfs::statfs_info& file) {
 }
 
 void sysfs::set_constant_value(const path& mount_point, const path& file_path, const std::string& value) {
-    auto& root_folder = find_root_folder(mount_point);
+    std::lock_guard<mutex> l(folders_lock);
 
-    if (file_path.size() == 2) {
-        ::set_value(root_folder, file_path.base_name(), value);
-    } else {
-        auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
-        ::set_value(folder, file_path.base_name(), value);
-    }
+    find_value(mount_point, file_path)._value = value;
 }
 
 void sysfs::set_dynamic_value(const path& mount_point, const path& file_path, dynamic_fun_t fun) {
-    auto& root_folder = find_root_folder(mount_point);
+    std::lock_guard<mutex> l(folders_lock);
 
-    if (file_path.size() == 2) {
-        ::set_value(root_folder, file_path.base_name(), fun);
-    } else {
-        auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
-        ::set_value(folder, file_path.base_name(), fun);
-    }
+    find_value(mount_point, file_path).fun = fun;
 }
 
 void sysfs::set_dynamic_value_data(const path& mount_point, const path& file_path, dynamic_fun_data_t fun, void* data) {
-    auto& root_folder = find_root_folder(mount_point);
+    std::lock_guard<mutex> l(folders_lock);
 
-    if (file_path.size() == 2) {
-        ::set_value(root_folder, file_path.base_name(), fun, data);
-    } else {
-        auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
-        ::set_value(folder, file_path.base_name(), fun, data);
-    }
+    auto& value    = find_value(mount_point, file_path);
+    value.fun_data = fun;
+    value.data     = data;
 }
 
-void sysfs::delete_value(const path& mount_point, const path& file_path) {
-    auto& root_folder = find_root_folder(mount_point);
+void sysfs::set_writable_value_data(const path& mount_point, const path& file_path, dynamic_fun_data_t fun, store_fun_data_t store, void* data) {
+    std::lock_guard<mutex> l(folders_lock);
 
-    if (file_path.size() == 2) {
-        ::delete_value(root_folder, file_path.base_name());
-    } else {
-        auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
+    auto& value    = find_value(mount_point, file_path);
+    value.fun_data = fun;
+    value.store    = store;
+    value.data     = data;
+}
+
+void sysfs::set_counter_value(const path& mount_point, const path& file_path, counter_fun_t fun) {
+    std::lock_guard<mutex> l(folders_lock);
 
-        ::delete_value(folder, file_path.base_name());
+    find_value(mount_point, file_path).counter = fun;
+}
+
+void sysfs::set_counter_value_data(const path& mount_point, const path& file_path, counter_fun_data_t fun, void* data) {
+    std::lock_guard<mutex> l(folders_lock);
+
+    auto& value        = find_value(mount_point, file_path);
+    value.counter_data = fun;
+    value.data         = data;
+}
+
+void sysfs::delete_value(const path& mount_point, const path& file_path) {
+    std::lock_guard<mutex> l(folders_lock);
+
+    if (auto* folder = lookup_parent(mount_point, file_path)) {
+        erase_node(folder->values, file_path);
     }
 }
 
 void sysfs::delete_folder(const path& mount_point, const path& file_path) {
-    auto& root_folder = find_root_folder(mount_point);
-
-    if (file_path.size() == 2) {
-        ::delete_folder(root_folder, file_path.base_name());
-    } else {
-        auto& folder = find_folder(root_folder, file_path, 1, file_path.size() - 1);
+    std::lock_guard<mutex> l(folders_lock);
 
-        ::delete_folder(folder, file_path.base_name());
+    if (auto* folder = lookup_parent(mount_point, file_path)) {
+        erase_node(folder->folders, file_path);
     }
 }
@@ -0,0 +1,181 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <vector.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "futex.hpp"
+#include "scheduler.hpp"
+
+#include "conc/spinlock.hpp"
+#include "conc/wait_list.hpp"
+
+namespace {
+
+constexpr const size_t BUCKETS = 64; ///< The number of buckets of the wait queues
+
+/*!
+ * \brief The processes waiting on a word
+ */
+struct queue_t {
+    size_t key;     ///< The physical address of the word
+    wait_list list; ///< The waiting processes
+};
+
+/*!
+ * \brief The queues of the words hashed to the same bucket
+ */
+struct bucket_t {
+    spinlock lock;                 ///< The lock protecting the queues
+    std::vector<queue_t*> queues;  ///< The queues with waiting processes
+};
+
+std::array<bucket_t, BUCKETS> buckets;
+
+bucket_t& bucket(size_t key){
+    // The low bits are the same for all the aligned words
+    return buckets[((key >> 2) ^ (key >> 12)) % BUCKETS];
+}
+
+// Find the queue of the given word, with the lock of the bucket held
+queue_t* find_queue(bucket_t& bucket, size_t key){
+    for(auto* queue : bucket.queues){
+        if(queue->key == key){
+            return queue;
+        }
+    }
+
+    return nullptr;
+}
+
+// Release the queue once nobody waits in it, with the lock of the bucket held
+void release_queue(bucket_t& bucket, queue_t* queue){
+    if(!queue->list.empty()){
+        return;
+    }
+
+    for(size_t i = 0; i < bucket.queues.size(); ++i){
+        if(bucket.queues[i] == queue){
+            bucket.queues.erase(i);
+            break;
+        }
+    }
+
+    delete queue;
+}
+
+std::expected<size_t> word_key(const volatile uint32_t* address){
+    auto virt = reinterpret_cast<size_t>(address);
+
+    if(virt & 0x3){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_REQUEST);
+    }
+
+    auto key = scheduler::user_physical_address(virt);
+
+    if(!key){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_REQUEST);
+    }
+
+    return key;
+}
+
+} //End of anonymous namespace
+
+std::expected<void> futex::wait(const volatile uint32_t* address, uint32_t value, size_t ms){
+    // Early check, this also loads the page if it was not accessed yet
+    if(*address != value){
+        return std::make_unexpected<void>(std::ERROR_WOULD_BLOCK);
+    }
+
+    auto key = word_key(address);
+
+    if(!key){
+        return std::make_unexpected<void>(key.error());
+    }
+
+    auto& b = bucket(*key);
+
+    b.lock.lock();
+
+    // A waker changes the word before taking the lock, it cannot be missed
+    if(*address != value){
+        b.lock.unlock();
+
+        return std::make_unexpected<void>(std::ERROR_WOULD_BLOCK);
+    }
+
+    auto* queue = find_queue(b, *key);
+
+    if(!queue){
+        queue = new queue_t();
+        queue->key = *key;
+
+        b.queues.push_back(queue);
+    }
+
+    if(ms){
+        queue->list.enqueue_timeout(ms);
+    } else {
+        queue->list.enqueue();
+    }
+
+    b.lock.unlock();
+
+    scheduler::reschedule();
+
+    if(!ms){
+        return {};
+    }
+
+    std::lock_guard<spinlock> l(b.lock);
+
+    // The queue is released by the waker once empty, still waiting means a timeout
+    queue = find_queue(b, *key);
+
+    if(queue && queue->list.waiting()){
+        queue->list.remove();
+
+        release_queue(b, queue);
+
+        return std::make_unexpected<void>(std::ERROR_TIMEOUT);
+    }
+
+    return {};
+}
+
+std::expected<size_t> futex::wake(const volatile uint32_t* address, size_t n){
+    auto key = word_key(address);
+
+    if(!key){
+        return std::make_unexpected<size_t>(key.error());
+    }
+
+    auto& b = bucket(*key);
+
+    std::lock_guard<spinlock> l(b.lock);
+
+    auto* queue = find_queue(b, *key);
+
+    if(!queue){
+        return 0;
+    }
+
+    size_t woken = 0;
+
+    while(woken < n && !queue->list.empty()){
+        queue->list.dequeue();
+        ++woken;
+    }
+
+    release_queue(b, queue);
+
+    return woken;
+}
@@ -5,13 +5,95 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <array.hpp>
+#include <algorithms.hpp>
+
 #include "gdt.hpp"
 #include "early_memory.hpp"
+#include "smp.hpp"
+
+namespace {
+
+constexpr const size_t GDT_ENTRIES = 9;
+constexpr const size_t FAULT_STACK_SIZE = 4096; ///< The size of the double fault stack of a processor
+
+struct cpu_gdt_t {
+    gdt::gdt_descriptor_t descriptors[GDT_ENTRIES];
+    gdt::task_state_segment_t tss;
+    gdt::gdt_ptr_64 gdtr;
+} __attribute__((aligned(16)));
+
+// The BSP uses the boot GDT and TSS
+std::array<cpu_gdt_t, smp::MAX_CPUS> cpu_gdts;
+
+struct fault_stack_t {
+    char data[FAULT_STACK_SIZE];
+} __attribute__((aligned(16)));
+
+std::array<fault_stack_t, smp::MAX_CPUS> fault_stacks;
+
+gdt::task_state_segment_t& cpu_tss(size_t cpu){
+    if(cpu == 0){
+        return *reinterpret_cast<gdt::task_state_segment_t*>(early::tss_address);
+    }
+
+    return cpu_gdts[cpu].tss;
+}
+
+} //end of anonymous namespace
 
 void gdt::flush_tss(){
     asm volatile("mov ax, %0; ltr ax;" : : "i" (gdt::TSS_SELECTOR + 0x3) : "rax");
 }
 
+void gdt::init_cpu(size_t cpu){
+    auto& cpu_gdt = cpu_gdts[cpu];
+
+    //1. Copy the segments of the boot GDT (without the TSS)
+
+    gdt::gdt_ptr_64 boot_gdtr;
+    asm volatile("sgdt [%0]" : : "r" (&boot_gdtr) : "memory");
+
+    auto boot_gdt = reinterpret_cast<const gdt::gdt_descriptor_t*>(boot_gdtr.pointer);
+    std::copy_n(boot_gdt, TSS_SELECTOR / sizeof(gdt::gdt_descriptor_t), &cpu_gdt.descriptors[0]);
+
+    //2. Create the TSS descriptor of this CPU
+
+    std::fill_n(reinterpret_cast<char*>(&cpu_gdt.tss), sizeof(gdt::task_state_segment_t), 0);
+
+    auto base = reinterpret_cast<uint64_t>(&cpu_gdt.tss);
+    auto limit = sizeof(gdt::task_state_segment_t);
+
+    auto tss_selector = reinterpret_cast<gdt::tss_descriptor_t*>(&cpu_gdt.descriptors[TSS_SELECTOR / sizeof(gdt::gdt_descriptor_t)]);
+    std::fill_n(reinterpret_cast<char*>(tss_selector), sizeof(gdt::tss_descriptor_t), 0);
+
+    tss_selector->type = gdt::SEG_TSS_AVAILABLE;
+    tss_selector->dpl = 3;
+    tss_selector->present = 1;
+
+    tss_selector->base_low = base & 0xFFFFFF;             //Bottom 24 bits
+    tss_selector->base_middle = (base >> 24) & 0xFF;      //Middle 8 bits
+    tss_selector->base_high = base >> 32;                 //Top 32 bits
+
+    tss_selector->limit_low = limit & 0xFFFF;             //Low 16 bits
+    tss_selector->limit_high = (limit & 0xF0000) >> 16;   //Top 4 bits
+
+    //3. Load the GDT and the TSS
+
+    cpu_gdt.gdtr.length = sizeof(cpu_gdt.descriptors) - 1;
+    cpu_gdt.gdtr.pointer = reinterpret_cast<uint64_t>(&cpu_gdt.descriptors[0]);
+
+    asm volatile("lgdt [%0]" : : "r" (&cpu_gdt.gdtr) : "memory");
+
+    flush_tss();
+}
+
 gdt::task_state_segment_t& gdt::tss(){
-    return *reinterpret_cast<task_state_segment_t*>(early::tss_address);
+    return cpu_tss(smp::current_cpu());
+}
+
+void gdt::init_fault_stack(size_t cpu){
+    auto& stack = fault_stacks[cpu];
+
+    cpu_tss(cpu).ist1 = reinterpret_cast<uint64_t>(&stack.data[FAULT_STACK_SIZE]);
 }
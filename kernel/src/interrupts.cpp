@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <types.hpp>
+#include <array.hpp>
 
 #include "interrupts.hpp"
 #include "print.hpp"
@@ -13,6 +14,12 @@
 #include "gdt.hpp"
 #include "scheduler.hpp"
 #include "logging.hpp"
+#include "arch.hpp"
+#include "smp.hpp"
+#include "softirq.hpp"
+
+#include "drivers/apic.hpp"
+#include "drivers/ioapic.hpp"
 
 #include "isrs.hpp"
 #include "irqs.hpp"
@@ -32,7 +39,7 @@ static_assert(sizeof(idt_flags) == 1, "The Flags of an IDT entry take one byte")
 struct idt_entry {
     uint16_t offset_low;
     uint16_t segment_selector;
-    uint8_t  zero;
+    uint8_t  ist;     ///< The interrupt stack of the TSS, 0 for the current stack
     idt_flags flags;
     uint16_t offset_middle;
     uint32_t offset_high;
@@ -46,20 +53,121 @@ struct idtr {
     uint64_t base;
 } __attribute__((packed));
 
-idt_entry idt_64[64];
+constexpr const size_t IDT_ENTRIES = interrupt::MSI_FIRST + interrupt::MSI_MAX; ///< The vectors covered by the IDT
+
+idt_entry idt_64[IDT_ENTRIES];
 idtr idtr_64;
 
+constexpr const uint32_t MSR_EFER = 0xC0000080;
+constexpr const uint32_t MSR_STAR = 0xC0000081;
+constexpr const uint32_t MSR_LSTAR = 0xC0000082;
+constexpr const uint32_t MSR_FMASK = 0xC0000084;
+constexpr const uint32_t MSR_KERNEL_GS_BASE = 0xC0000102;
+
+constexpr const uint64_t EFER_SCE = 1 << 0;
+
+constexpr const uint64_t RFLAGS_TF = 1 << 8;
+constexpr const uint64_t RFLAGS_IF = 1 << 9;
+constexpr const uint64_t RFLAGS_DF = 1 << 10;
+
+/*!
+ * \brief The data used by the SYSCALL entry of a processor, through GS
+ */
+struct fast_syscall_cpu_t {
+    uint64_t user_rsp;                ///< Scratch space for the user stack pointer
+    gdt::task_state_segment_t* tss;   ///< The TSS holding the kernel stack of the current process
+};
+
+std::array<fast_syscall_cpu_t, smp::MAX_CPUS> fast_syscall_cpus;
+
 void (*irq_handlers[16])(interrupt::syscall_regs*, void*);
 void* irq_handler_data[16];
 void (*syscall_handlers[interrupt::SYSCALL_MAX])(interrupt::syscall_regs*);
 
-void idt_set_gate(size_t gate, void (*function)(void), uint16_t gdt_selector, idt_flags flags){
+void (*apic_handlers[interrupt::APIC_MAX])(interrupt::syscall_regs*, void*);
+void* apic_handler_data[interrupt::APIC_MAX];
+void (*msi_handlers[interrupt::MSI_MAX])(interrupt::syscall_regs*, void*);
+void* msi_handler_data[interrupt::MSI_MAX];
+
+constexpr const size_t APIC_LINE = 16;                             ///< The statistics line of the first local APIC interrupt
+constexpr const size_t MSI_LINE = APIC_LINE + interrupt::APIC_MAX; ///< The statistics line of the first message signaled interrupt
+constexpr const size_t STAT_LINES = MSI_LINE + interrupt::MSI_MAX; ///< The number of statistics lines
+
+/*!
+ * \brief The durations of the handlers of an interrupt, on all the processors
+ */
+struct line_stats {
+    volatile uint64_t max_cycles;                              ///< The longest handler
+    volatile uint64_t histogram[interrupt::HISTOGRAM_BUCKETS]; ///< The number of handlers in each bucket
+};
+
+std::array<std::array<uint64_t, smp::MAX_CPUS>, STAT_LINES> irq_counts; ///< The interrupts received by each processor
+std::array<line_stats, STAT_LINES> irq_stats;
+
+#ifdef THOR_CONFIG_IRQ_STAT
+
+/*!
+ * \brief The longest section of a processor with the interrupts disabled,
+ * only written by itself
+ */
+struct irqs_off_stats {
+    uint64_t max_cycles; ///< The duration of the section
+    uintptr_t site;      ///< The int_lock acquisition of the section
+} __attribute__((aligned(64)));
+
+std::array<irqs_off_stats, smp::MAX_CPUS> irqs_off_cpus;
+
+#endif
+
+// The handlers of a line may run on several processors at the same time
+void account(size_t line, uint64_t start){
+    auto duration = arch::rdtsc() - start;
+
+    size_t bucket = 0;
+    while(bucket + 1 < interrupt::HISTOGRAM_BUCKETS && duration >= (1024ULL << (2 * bucket))){
+        ++bucket;
+    }
+
+    auto& stats = irq_stats[line];
+
+    __atomic_add_fetch(&stats.histogram[bucket], 1, __ATOMIC_RELAXED);
+
+    auto max = __atomic_load_n(&stats.max_cycles, __ATOMIC_RELAXED);
+
+    while(duration > max && !__atomic_compare_exchange_n(&stats.max_cycles, &max, duration, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        // max has been reloaded
+    }
+}
+
+std::string format_line(const std::string& name, size_t line, size_t cpus){
+    auto value = sprintf("%7s", (name + ":").c_str());
+
+    for(size_t cpu = 0; cpu < cpus; ++cpu){
+        if(smp::online(cpu)){
+            value += sprintf(" %10u", irq_counts[line][cpu]);
+        }
+    }
+
+    auto& stats = irq_stats[line];
+
+    value += sprintf(" max %u hist", stats.max_cycles);
+
+    for(size_t bucket = 0; bucket < interrupt::HISTOGRAM_BUCKETS; ++bucket){
+        value += sprintf(" %u", stats.histogram[bucket]);
+    }
+
+    value += '\n';
+
+    return value;
+}
+
+void idt_set_gate(size_t gate, void (*function)(void), uint16_t gdt_selector, idt_flags flags, uint8_t ist = 0){
     auto& entry = idt_64[gate];
 
     entry.segment_selector = gdt_selector;
     entry.flags = flags;
     entry.reserved = 0;
-    entry.zero = 0;
+    entry.ist = ist;
 
     auto function_address = reinterpret_cast<uintptr_t>(function);
     entry.offset_low = function_address & 0xFFFF;
@@ -81,11 +189,11 @@ uint64_t get_cr3(){
 
 void install_idt(){
     //Set the correct values inside IDTR
-    idtr_64.limit = (64 * 16) - 1;
+    idtr_64.limit = (IDT_ENTRIES * 16) - 1;
     idtr_64.base = reinterpret_cast<size_t>(&idt_64[0]);
 
     //Clear the IDT
-    std::fill_n(reinterpret_cast<size_t*>(idt_64), 64 * sizeof(idt_entry) / sizeof(size_t), 0);
+    std::fill_n(reinterpret_cast<size_t*>(idt_64), IDT_ENTRIES * sizeof(idt_entry) / sizeof(size_t), 0);
 
     //Clear the IRQ handlers
     std::fill_n(irq_handlers, 16, nullptr);
@@ -106,7 +214,8 @@ void install_isrs(){
     idt_set_gate(5, _isr5, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
     idt_set_gate(6, _isr6, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
     idt_set_gate(7, _isr7, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
-    idt_set_gate(8, _isr8, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
+    // A double fault may come from an overflow of the kernel stack
+    idt_set_gate(8, _isr8, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1}, gdt::FAULT_IST);
     idt_set_gate(9, _isr9, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
     idt_set_gate(10, _isr10, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
     idt_set_gate(11, _isr11, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
@@ -172,6 +281,41 @@ void install_irqs(){
     idt_set_gate(47, _irq15, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
 }
 
+void install_apic_irqs(){
+    idt_set_gate(interrupt::APIC_FIRST+0, _apic_irq0, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
+    idt_set_gate(interrupt::APIC_FIRST+1, _apic_irq1, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
+    idt_set_gate(interrupt::APIC_FIRST+2, _apic_irq2, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
+    idt_set_gate(interrupt::APIC_SPURIOUS, _apic_spurious, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
+}
+
+void install_msi_irqs(){
+    void (*stubs[interrupt::MSI_MAX])() = {
+        _msi_irq0, _msi_irq1, _msi_irq2, _msi_irq3, _msi_irq4, _msi_irq5, _msi_irq6, _msi_irq7,
+        _msi_irq8, _msi_irq9, _msi_irq10, _msi_irq11, _msi_irq12, _msi_irq13, _msi_irq14, _msi_irq15,
+        _msi_irq16, _msi_irq17, _msi_irq18, _msi_irq19, _msi_irq20, _msi_irq21, _msi_irq22, _msi_irq23,
+        _msi_irq24, _msi_irq25, _msi_irq26, _msi_irq27, _msi_irq28, _msi_irq29, _msi_irq30, _msi_irq31
+    };
+
+    for(size_t i = 0; i < interrupt::MSI_MAX; ++i){
+        idt_set_gate(interrupt::MSI_FIRST + i, stubs[i], gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 0, 1});
+    }
+}
+
+void install_fast_syscalls(size_t cpu){
+    auto& data = fast_syscall_cpus[cpu];
+    data.tss = &gdt::tss();
+
+    // SYSCALL loads the kernel selectors from STAR[47:32] and SYSRET the
+    // user selectors from STAR[63:48] (data at +8 and code at +16)
+    uint64_t star = (static_cast<uint64_t>(gdt::USER_DATA_SELECTOR - 8) << 48) | (static_cast<uint64_t>(gdt::LONG_SELECTOR) << 32);
+
+    arch::write_msr(MSR_STAR, star);
+    arch::write_msr(MSR_LSTAR, reinterpret_cast<uint64_t>(&_syscall_fast));
+    arch::write_msr(MSR_FMASK, RFLAGS_TF | RFLAGS_IF | RFLAGS_DF);
+    arch::write_msr(MSR_KERNEL_GS_BASE, reinterpret_cast<uint64_t>(&data));
+    arch::write_msr(MSR_EFER, arch::read_msr(MSR_EFER) | EFER_SCE);
+}
+
 void install_syscalls(){
     idt_set_gate(interrupt::SYSCALL_FIRST+0, _syscall0, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 3, 1});
     idt_set_gate(interrupt::SYSCALL_FIRST+1, _syscall1, gdt::LONG_SELECTOR, {gdt::SEG_INTERRUPT_GATE, 0, 3, 1});
@@ -258,6 +402,12 @@ void _fault_handler(interrupt::fault_regs regs){
     // TODO Should also print the message to the terminal of the process
     // (cannot use printf because of string manipulation)
 
+    // The kernel state cannot be trusted after a double fault
+    if(regs.error_no == 8){
+        fault_printf("Double fault, the kernel stack may have overflowed\n");
+        asm volatile ("cli; hlt;");
+    }
+
     if(scheduler::is_started()){
         // TODO Should also send a signal to the process (if user)
         scheduler::fault();
@@ -266,19 +416,102 @@ void _fault_handler(interrupt::fault_regs regs){
     }
 }
 
+void _page_fault_handler(interrupt::page_fault_regs* regs){
+    auto address = get_cr2();
+
+    // The page is loaded in the context of the faulting code
+    if(regs->rflags & 0x200){
+        asm volatile("sti");
+    }
+
+    if(scheduler::is_started() && scheduler::page_fault(address, regs->error_code)){
+        return;
+    }
+
+    interrupt::fault_regs fault;
+    fault.rbp = regs->rbp;
+    fault.error_no = regs->error_no;
+    fault.error_code = regs->error_code;
+    fault.rip = regs->rip;
+    fault.rflags = regs->rflags;
+    fault.cs = regs->cs;
+    fault.rsp = regs->rsp;
+    fault.ss = regs->ss;
+
+    _fault_handler(fault);
+}
+
 void _irq_handler(interrupt::syscall_regs* regs){
-    //If the IRQ is on the slave controller, send EOI to it
-    if(regs->code >= 8){
-        out_byte(0xA0, 0x20);
+    if(ioapic::enabled()){
+        //The IO APICs deliver the IRQs to the local APIC
+        apic::eoi();
+    } else {
+        //If the IRQ is on the slave controller, send EOI to it
+        if(regs->code >= 8){
+            out_byte(0xA0, 0x20);
+        }
+
+        //Send EOI to the master controller
+        out_byte(0x20, 0x20);
     }
 
-    //Send EOI to the master controller
-    out_byte(0x20, 0x20);
+    auto irq = regs->code;
+
+    ++irq_counts[irq][smp::current_cpu()];
+
+    auto start = arch::rdtsc();
 
     //If there is an handler, call it
-    if(irq_handlers[regs->code]){
-        irq_handlers[regs->code](regs, irq_handler_data[regs->code]);
+    if(irq_handlers[irq]){
+        irq_handlers[irq](regs, irq_handler_data[irq]);
     }
+
+    account(irq, start);
+
+    //The bottom halves run with the interrupts enabled
+    softirq::run();
+}
+
+void _apic_irq_handler(interrupt::syscall_regs* regs){
+    //The local APIC must be acknowledged before the handler, it may not return
+    apic::eoi();
+
+    auto irq = regs->code;
+
+    ++irq_counts[APIC_LINE + irq][smp::current_cpu()];
+
+    auto start = arch::rdtsc();
+
+    //If there is an handler, call it
+    //The duration of a handler switching process is only accounted when
+    //the interrupted process runs again, on its processor
+    if(apic_handlers[irq]){
+        apic_handlers[irq](regs, apic_handler_data[irq]);
+    }
+
+    account(APIC_LINE + irq, start);
+
+    softirq::run();
+}
+
+void _msi_irq_handler(interrupt::syscall_regs* regs){
+    //The message signaled interrupts are delivered to the local APIC
+    apic::eoi();
+
+    auto irq = regs->code;
+
+    ++irq_counts[MSI_LINE + irq][smp::current_cpu()];
+
+    auto start = arch::rdtsc();
+
+    //If there is an handler, call it
+    if(msi_handlers[irq]){
+        msi_handlers[irq](regs, msi_handler_data[irq]);
+    }
+
+    account(MSI_LINE + irq, start);
+
+    softirq::run();
 }
 
 void _syscall_handler(interrupt::syscall_regs* regs){
@@ -309,6 +542,66 @@ bool interrupt::register_irq_handler(size_t irq, void (*handler)(interrupt::sysc
     return true;
 }
 
+uint64_t interrupt::irq_count(size_t irq, size_t cpu){
+    if(irq > 15 || cpu >= smp::MAX_CPUS){
+        return 0;
+    }
+
+    return irq_counts[irq][cpu];
+}
+
+std::string interrupt::format_stats(){
+    auto cpus = smp::max_cpus();
+
+    std::string value = "       ";
+
+    for(size_t cpu = 0; cpu < cpus; ++cpu){
+        if(smp::online(cpu)){
+            value += sprintf(" %10s", ("CPU" + std::to_string(cpu)).c_str());
+        }
+    }
+
+    value += "\n";
+
+    for(size_t irq = 0; irq < 16; ++irq){
+        value += format_line(std::to_string(irq), irq, cpus);
+    }
+
+    value += format_line("LOC", APIC_LINE + apic::TIMER_IRQ, cpus);
+    value += format_line("RES", APIC_LINE + apic::RESCHEDULE_IRQ, cpus);
+    value += format_line("TLB", APIC_LINE + apic::SHOOTDOWN_IRQ, cpus);
+
+    for(size_t irq = 0; irq < MSI_MAX; ++irq){
+        if(msi_handlers[irq]){
+            value += format_line("MSI" + std::to_string(irq), MSI_LINE + irq, cpus);
+        }
+    }
+
+#ifdef THOR_CONFIG_IRQ_STAT
+    for(size_t cpu = 0; cpu < cpus; ++cpu){
+        auto& off = irqs_off_cpus[cpu];
+
+        value += sprintf("irqs-off CPU%u: max %u site %h\n", cpu, off.max_cycles, off.site);
+    }
+#endif
+
+    return value;
+}
+
+#ifdef THOR_CONFIG_IRQ_STAT
+
+void interrupt::irqs_off(uintptr_t site, uint64_t start){
+    auto duration = arch::rdtsc() - start;
+    auto& off = irqs_off_cpus[smp::current_cpu()];
+
+    if(duration > off.max_cycles){
+        off.max_cycles = duration;
+        off.site = site;
+    }
+}
+
+#endif
+
 bool interrupt::register_syscall_handler(size_t syscall, void (*handler)(interrupt::syscall_regs*)){
     if(syscall_handlers[syscall]){
         logging::logf(logging::log_level::ERROR, "Register syscall %u while already registered\n", syscall);
@@ -325,6 +618,59 @@ bool interrupt::register_syscall_handler(size_t syscall, void (*handler)(interru
     return true;
 }
 
+bool interrupt::register_apic_handler(size_t irq, void (*handler)(interrupt::syscall_regs*, void*), void* data){
+    if(irq >= interrupt::APIC_MAX){
+        logging::logf(logging::log_level::ERROR, "Register APIC interrupt %u too high\n", irq);
+        return false;
+    }
+
+    if(apic_handlers[irq]){
+        logging::logf(logging::log_level::ERROR, "Register APIC interrupt %u while already registered\n", irq);
+        return false;
+    }
+
+    apic_handlers[irq] = handler;
+    apic_handler_data[irq] = data;
+
+    return true;
+}
+
+bool interrupt::register_msi_handler(size_t& vector, void (*handler)(interrupt::syscall_regs*, void*), void* data){
+    for(size_t irq = 0; irq < interrupt::MSI_MAX; ++irq){
+        if(!msi_handlers[irq]){
+            msi_handler_data[irq] = data;
+            msi_handlers[irq] = handler;
+
+            vector = interrupt::MSI_FIRST + irq;
+
+            return true;
+        }
+    }
+
+    logging::logf(logging::log_level::ERROR, "No free message signaled interrupt\n");
+
+    return false;
+}
+
+bool interrupt::unregister_msi_handler(size_t vector){
+    if(vector < interrupt::MSI_FIRST || vector >= interrupt::MSI_FIRST + interrupt::MSI_MAX){
+        logging::logf(logging::log_level::ERROR, "Unregister message signaled interrupt %u out of range\n", vector);
+        return false;
+    }
+
+    auto irq = vector - interrupt::MSI_FIRST;
+
+    if(!msi_handlers[irq]){
+        logging::logf(logging::log_level::ERROR, "Unregister message signaled interrupt %u while not registered\n", vector);
+        return false;
+    }
+
+    msi_handlers[irq] = nullptr;
+    msi_handler_data[irq] = nullptr;
+
+    return true;
+}
+
 bool interrupt::unregister_irq_handler(size_t irq, void (*handler)(interrupt::syscall_regs*, void*)){
     if(!irq_handlers[irq]){
         logging::logf(logging::log_level::ERROR, "Unregister interrupt %u while not registered\n", irq);
@@ -374,6 +720,16 @@ void interrupt::setup_interrupts(){
     install_isrs();
     remap_irqs();
     install_irqs();
+    install_apic_irqs();
+    install_msi_irqs();
     install_syscalls();
+    install_fast_syscalls(0);
     enable_interrupts();
 }
+
+void interrupt::setup_ap_interrupts(){
+    //The IDT is shared between all the processors
+    asm volatile("lidt [%0]" : : "m" (idtr_64));
+
+    install_fast_syscalls(smp::current_cpu());
+}
@@ -0,0 +1,332 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <vector.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "io_ring.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "paging.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+
+#include "vfs/vfs.hpp"
+#include "net/network.hpp"
+
+namespace {
+
+/*!
+ * \brief A timeout waiting for its deadline
+ */
+struct timeout_t {
+    uint64_t deadline; ///< The time of the completion, in milliseconds
+    size_t data;       ///< The data of the submission
+};
+
+/*!
+ * \brief The rings of a process
+ */
+struct ring_t {
+    scheduler::pid_t pid;                       ///< The owner process
+    io_ring::ring_page* page;                   ///< The rings, in the kernel
+    size_t pages[io_ring::RING_PAGES];          ///< The physical pages of the rings
+    size_t kernel_address;                      ///< The address of the rings in the kernel
+    size_t user_address;                        ///< The address of the rings in the process
+    std::vector<timeout_t> timeouts;            ///< The pending timeouts
+};
+
+spinlock lock;             ///< The lock of the rings
+std::vector<ring_t*> rings; ///< The rings of all the processes
+
+ring_t* find_ring(scheduler::pid_t pid){
+    std::lock_guard<spinlock> l(lock);
+
+    for(auto* ring : rings){
+        if(ring->pid == pid){
+            return ring;
+        }
+    }
+
+    return nullptr;
+}
+
+// Release the kernel side of the first n pages, the pages still mapped in
+// the process are freed with it
+void release_pages(ring_t& ring, size_t n){
+    for(size_t i = 0; i < n; ++i){
+        paging::unmap(ring.kernel_address + i * paging::PAGE_SIZE);
+        physical_allocator::release(ring.pages[i], 1);
+    }
+
+    virtual_allocator::free(ring.kernel_address, io_ring::RING_PAGES);
+}
+
+template<typename T>
+int64_t to_result(const std::expected<T>& status){
+    if(status){
+        return *status;
+    } else {
+        return -status.error();
+    }
+}
+
+int64_t to_result(const std::expected<void>& status){
+    if(status){
+        return 0;
+    } else {
+        return -status.error();
+    }
+}
+
+size_t ready_completions(const io_ring::ring_page& page){
+    return page.completion_tail - __atomic_load_n(&page.completion_head, __ATOMIC_ACQUIRE);
+}
+
+void complete(io_ring::ring_page& page, size_t data, int64_t result){
+    auto tail = page.completion_tail;
+
+    auto& completion = page.completions[tail % io_ring::RING_COMPLETIONS];
+    completion.data = data;
+    completion.result = result;
+
+    // The entry is visible before the process sees the new tail
+    __atomic_store_n(&page.completion_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void expire_timeouts(ring_t& ring){
+    auto now = timer::milliseconds();
+
+    for(size_t i = 0; i < ring.timeouts.size();){
+        if(ring.timeouts[i].deadline <= now){
+            complete(*ring.page, ring.timeouts[i].data, 0);
+
+            ring.timeouts.erase(ring.timeouts.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void execute(ring_t& ring, const io_ring::ring_submission& submission){
+    auto buffer = reinterpret_cast<char*>(submission.address);
+
+    int64_t result;
+
+    switch(submission.operation){
+        case io_ring::ring_operation::NOP:
+            result = 0;
+            break;
+
+        case io_ring::ring_operation::OPEN:
+            result = to_result(vfs::open(buffer, submission.fd));
+            break;
+
+        case io_ring::ring_operation::CLOSE:
+            vfs::close(submission.fd);
+            result = 0;
+            break;
+
+        case io_ring::ring_operation::STAT:
+            result = to_result(vfs::stat(submission.fd, *reinterpret_cast<vfs::stat_info*>(submission.address)));
+            break;
+
+        case io_ring::ring_operation::READ:
+            result = to_result(vfs::read(submission.fd, buffer, submission.length, submission.offset));
+            break;
+
+        case io_ring::ring_operation::WRITE:
+            result = to_result(vfs::write(submission.fd, buffer, submission.length, submission.offset));
+            break;
+
+        case io_ring::ring_operation::ENTRIES:
+            result = to_result(vfs::entries(submission.fd, buffer, submission.length));
+            break;
+
+        case io_ring::ring_operation::SEND: {
+            vfs::iovec vector{buffer, submission.length};
+
+            auto status = network::sendv(submission.fd, &vector, 1);
+            result = status ? int64_t(submission.length) : -int64_t(status.error());
+            break;
+        }
+
+        case io_ring::ring_operation::RECEIVE:
+            if(submission.offset){
+                result = to_result(network::receive(submission.fd, buffer, submission.length, submission.offset));
+            } else {
+                result = to_result(network::receive(submission.fd, buffer, submission.length));
+            }
+            break;
+
+        case io_ring::ring_operation::TIMEOUT:
+            // Completed once its deadline is passed
+            ring.timeouts.push_back({timer::milliseconds() + submission.length, submission.data});
+            return;
+
+        default:
+            result = -int64_t(std::ERROR_INVALID_REQUEST);
+            break;
+    }
+
+    complete(*ring.page, submission.data, result);
+}
+
+} //end of anonymous namespace
+
+std::expected<size_t> io_ring::setup(){
+    auto pid = scheduler::get_pid();
+
+    if(auto* ring = find_ring(pid)){
+        return ring->user_address;
+    }
+
+    auto* ring = new ring_t();
+    ring->pid = pid;
+
+    ring->kernel_address = virtual_allocator::allocate(RING_PAGES);
+
+    if(!ring->kernel_address){
+        delete ring;
+        return std::make_unexpected<size_t>(std::ERROR_FAILED);
+    }
+
+    // The pages are allocated one by one, each of them is released by its last owner
+    for(size_t i = 0; i < RING_PAGES; ++i){
+        auto physical = physical_allocator::allocate_zeroed(1);
+
+        if(!physical || !paging::map(ring->kernel_address + i * paging::PAGE_SIZE, physical)){
+            logging::logf(logging::log_level::ERROR, "io_ring: Unable to allocate the rings\n");
+
+            if(physical){
+                physical_allocator::free(physical, 1);
+            }
+
+            release_pages(*ring, i);
+            delete ring;
+
+            return std::make_unexpected<size_t>(std::ERROR_FAILED);
+        }
+
+        ring->pages[i] = physical;
+    }
+
+    auto user_address = scheduler::map_shared_pages(ring->pages, RING_PAGES);
+
+    if(!user_address){
+        release_pages(*ring, RING_PAGES);
+        delete ring;
+
+        return std::make_unexpected<size_t>(user_address.error());
+    }
+
+    ring->page = reinterpret_cast<ring_page*>(ring->kernel_address);
+    ring->user_address = *user_address;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+        rings.push_back(ring);
+    }
+
+    logging::logf(logging::log_level::TRACE, "io_ring: Mapped the rings of process %u at %h\n", pid, ring->user_address);
+
+    return ring->user_address;
+}
+
+std::expected<size_t> io_ring::enter(size_t n, size_t wait, size_t ms){
+    auto* ring = find_ring(scheduler::get_pid());
+
+    if(!ring){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_REQUEST);
+    }
+
+    if(wait > RING_COMPLETIONS){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    auto& page = *ring->page;
+
+    size_t submitted = 0;
+
+    while(submitted < n){
+        auto head = page.submission_head;
+
+        if(head == __atomic_load_n(&page.submission_tail, __ATOMIC_ACQUIRE)){
+            break;
+        }
+
+        // The completion of each consumed submission, and of the pending timeouts, always fits
+        if(ready_completions(page) + ring->timeouts.size() >= RING_COMPLETIONS){
+            break;
+        }
+
+        // The process may reuse the entry as soon as the head moves
+        auto submission = page.submissions[head % RING_SUBMISSIONS];
+        __atomic_store_n(&page.submission_head, head + 1, __ATOMIC_RELEASE);
+
+        execute(*ring, submission);
+
+        ++submitted;
+    }
+
+    expire_timeouts(*ring);
+
+    // Only the timeouts complete later, the other operations are done already
+    auto end = ms ? timer::milliseconds() + ms : 0;
+
+    while(ready_completions(page) < wait && !ring->timeouts.empty()){
+        auto now = timer::milliseconds();
+
+        if(end && now >= end){
+            break;
+        }
+
+        auto next = ring->timeouts.front().deadline;
+        for(auto& timeout : ring->timeouts){
+            next = std::min(next, timeout.deadline);
+        }
+
+        if(end){
+            next = std::min(next, end);
+        }
+
+        if(next > now){
+            scheduler::sleep_ms(next - now);
+        }
+
+        expire_timeouts(*ring);
+    }
+
+    return submitted;
+}
+
+void io_ring::release(scheduler::pid_t pid){
+    ring_t* ring = nullptr;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        for(size_t i = 0; i < rings.size(); ++i){
+            if(rings[i]->pid == pid){
+                ring = rings[i];
+                rings.erase(rings.begin() + i);
+                break;
+            }
+        }
+    }
+
+    if(ring){
+        release_pages(*ring, RING_PAGES);
+        delete ring;
+    }
+}
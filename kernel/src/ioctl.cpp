@@ -10,7 +10,9 @@
 #include "ioctl.hpp"
 #include "scheduler.hpp"
 #include "logging.hpp"
+#include "disks.hpp"
 #include "fs/devfs.hpp"
+#include "net/capture.hpp"
 
 std::expected<size_t> ioctl(size_t device_fd, io::ioctl_request request, void* data){
     if(!scheduler::has_handle(device_fd)){
@@ -23,5 +25,41 @@ std::expected<size_t> ioctl(size_t device_fd, io::ioctl_request request, void* d
         return devfs::get_device_size(device, *reinterpret_cast<size_t*>(data));
     }
 
+    if(request == io::ioctl_request::CREATE_RAMDISK){
+        if(device != path("/dev")){
+            return std::make_unexpected<size_t>(std::ERROR_INVALID_DEVICE);
+        }
+
+        auto& size = *reinterpret_cast<size_t*>(data);
+        auto disk = disks::make_ram_disk(size);
+
+        if(!disk){
+            return std::make_unexpected<size_t>(disk.error());
+        }
+
+        size = *disk;
+
+        return 0;
+    }
+
+    if(request == io::ioctl_request::CAPTURE_START || request == io::ioctl_request::CAPTURE_STOP){
+        if(device != path("/dev/capture")){
+            return std::make_unexpected<size_t>(std::ERROR_INVALID_DEVICE);
+        }
+
+        if(request == io::ioctl_request::CAPTURE_STOP){
+            network::capture::stop();
+            return 0;
+        }
+
+        auto status = network::capture::start(*reinterpret_cast<const network::capture::capture_config*>(data));
+
+        if(!status){
+            return std::make_unexpected<size_t>(status.error());
+        }
+
+        return 0;
+    }
+
     return std::make_unexpected<size_t>(std::ERROR_INVALID_REQUEST);
 }
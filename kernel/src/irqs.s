@@ -51,3 +51,98 @@ irq_common_handler:
     add rsp, 16
 
     iretq // iret will clean the other automatically pushed stuff
+
+// Local APIC interrupts
+
+.macro create_apic_irq number
+.global _apic_irq\number
+_apic_irq\number:
+    push rax
+    push \number
+
+    jmp apic_irq_common_handler
+.endm
+
+create_apic_irq 0
+create_apic_irq 1
+create_apic_irq 2
+
+apic_irq_common_handler:
+    save_context
+
+    restore_kernel_segments
+
+    mov rdi, rsp
+    call _apic_irq_handler
+
+    restore_context
+
+    //Was pushed by the base handler code
+    add rsp, 16
+
+    iretq // iret will clean the other automatically pushed stuff
+
+// Message signaled interrupts
+
+.macro create_msi_irq number
+.global _msi_irq\number
+_msi_irq\number:
+    push rax
+    push \number
+
+    jmp msi_irq_common_handler
+.endm
+
+create_msi_irq 0
+create_msi_irq 1
+create_msi_irq 2
+create_msi_irq 3
+create_msi_irq 4
+create_msi_irq 5
+create_msi_irq 6
+create_msi_irq 7
+create_msi_irq 8
+create_msi_irq 9
+create_msi_irq 10
+create_msi_irq 11
+create_msi_irq 12
+create_msi_irq 13
+create_msi_irq 14
+create_msi_irq 15
+create_msi_irq 16
+create_msi_irq 17
+create_msi_irq 18
+create_msi_irq 19
+create_msi_irq 20
+create_msi_irq 21
+create_msi_irq 22
+create_msi_irq 23
+create_msi_irq 24
+create_msi_irq 25
+create_msi_irq 26
+create_msi_irq 27
+create_msi_irq 28
+create_msi_irq 29
+create_msi_irq 30
+create_msi_irq 31
+
+msi_irq_common_handler:
+    save_context
+
+    restore_kernel_segments
+
+    mov rdi, rsp
+    call _msi_irq_handler
+
+    restore_context
+
+    //Was pushed by the base handler code
+    add rsp, 16
+
+    iretq // iret will clean the other automatically pushed stuff
+
+// The spurious interrupt must not be acknowledged
+
+.global _apic_spurious
+_apic_spurious:
+    iretq
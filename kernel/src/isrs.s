@@ -44,7 +44,6 @@ create_irq 10
 create_irq 11
 create_irq 12
 create_irq 13
-create_irq 14
 create_irq_dummy 15
 create_irq_dummy 16
 create_irq_dummy 17
@@ -63,6 +62,26 @@ create_irq_dummy 29
 create_irq_dummy 30
 create_irq_dummy 31
 
+// The page fault handler saves the context, since the faulting
+// code is resumed when the missing page has been loaded
+
+.global _isr14
+_isr14:
+    push 14
+
+    save_context
+
+    restore_kernel_segments
+
+    mov rdi, rsp
+    call _page_fault_handler
+
+    restore_context
+
+    add rsp, 16 // Cleans the pushed error number and error code
+
+    iretq
+
 isr_common_handler:
     //TODO Kernel segments should be restored
 
@@ -5,14 +5,24 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <lock_guard.hpp>
+#include <array.hpp>
+#include <string.hpp>
+
 #include "kalloc.hpp"
 #include "print.hpp"
 #include "physical_allocator.hpp"
 #include "paging.hpp"
+#include "virtual_allocator.hpp"
 #include "e820.hpp"
 #include "logging.hpp"
+#include "smp.hpp"
+#include "alloc_profile.hpp"
+#include "shrinker.hpp"
 
 #include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
+#include "conc/percpu_counter.hpp"
 
 #include "fs/sysfs.hpp"
 
@@ -26,6 +36,8 @@ const bool TRACE_MALLOC = false;
 size_t _used_memory;
 size_t _allocated_memory;
 
+int_spinlock kalloc_lock;
+
 struct malloc_footer_chunk;
 
 class malloc_header_chunk {
@@ -311,6 +323,411 @@ malloc_header_chunk* coalesce(malloc_header_chunk* b){
     return b;
 }
 
+// The slab layer serves the small allocations from slabs of fixed size
+// objects, each size class having its own slabs
+
+constexpr const size_t SLAB_PAGES = 4;                                       ///< The number of pages of a slab
+constexpr const size_t SLAB_SIZE = SLAB_PAGES * paging::PAGE_SIZE;           ///< The size of a slab
+constexpr const size_t SLAB_HEADER_SIZE = 64;                                ///< The space reserved for the header of a slab
+constexpr const size_t MAX_SLAB_OBJECT = 2048;                               ///< The largest size served by the slabs
+constexpr const size_t SLAB_COUNT = virtual_allocator::kernel_virtual_size / SLAB_SIZE; ///< The number of possible slabs
+
+constexpr const size_t SIZE_CLASSES = 14; ///< The number of size classes
+
+constexpr const size_t class_sizes[SIZE_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048}; ///< The power-of-two and intermediate sizes
+
+struct size_class;
+
+/*!
+ * \brief The header of a slab, at the start of the slab
+ */
+struct slab_header {
+    slab_header* next;   ///< The next slab with free objects
+    slab_header* prev;   ///< The previous slab with free objects
+    void* free;          ///< The first free object
+    size_class* owner;   ///< The size class of the slab
+    uint32_t used;       ///< The number of allocated objects
+    uint32_t capacity;   ///< The number of objects of the slab
+    bool partial;        ///< Indicates if the slab is in the partial list
+};
+
+static_assert(sizeof(slab_header) <= SLAB_HEADER_SIZE, "The slab header must fit in its reserved space");
+
+/*!
+ * \brief A size class, with the slabs that still have free objects
+ */
+struct size_class {
+    size_t size;                    ///< The size of the objects
+    slab_header* partial;           ///< The slabs with free objects
+    slab_header* empty;             ///< The cached empty slab, if any
+    size_t slabs;                   ///< The number of slabs
+    size_t used;                    ///< The number of allocated objects
+    size_t capacity;                ///< The number of objects of all the slabs
+    int_spinlock lock;              ///< Protect the slabs of the class
+};
+
+std::array<size_class, SIZE_CLASSES> classes;
+
+// The size class of every 16 bytes step
+std::array<uint8_t, MAX_SLAB_OBJECT / ALIGNMENT + 1> class_index;
+
+// One bit per slab-aligned region of the kernel virtual space, set if it is a slab
+std::array<uint64_t, SLAB_COUNT / 64> slab_bitmap;
+
+percpu_counter slab_memory; ///< The memory allocated for the slabs
+
+void init_slabs(){
+    for(size_t i = 0; i < SIZE_CLASSES; ++i){
+        classes[i].size = class_sizes[i];
+        classes[i].partial = nullptr;
+        classes[i].empty = nullptr;
+        classes[i].slabs = 0;
+        classes[i].used = 0;
+        classes[i].capacity = 0;
+    }
+
+    size_t c = 0;
+    for(size_t i = 0; i < class_index.size(); ++i){
+        while(class_sizes[c] < i * ALIGNMENT){
+            ++c;
+        }
+
+        class_index[i] = c;
+    }
+}
+
+bool is_slab(uintptr_t address){
+    auto slab = address / SLAB_SIZE;
+
+    return slab < SLAB_COUNT && (slab_bitmap[slab / 64] & (1UL << (slab % 64)));
+}
+
+void mark_slab(uintptr_t address, bool slab){
+    auto index = address / SLAB_SIZE;
+
+    if(slab){
+        __atomic_fetch_or(&slab_bitmap[index / 64], 1UL << (index % 64), __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&slab_bitmap[index / 64], ~(1UL << (index % 64)), __ATOMIC_RELAXED);
+    }
+}
+
+void link_partial(size_class& c, slab_header* slab){
+    slab->prev = nullptr;
+    slab->next = c.partial;
+
+    if(c.partial){
+        c.partial->prev = slab;
+    }
+
+    c.partial = slab;
+    slab->partial = true;
+}
+
+void unlink_partial(size_class& c, slab_header* slab){
+    if(slab->prev){
+        slab->prev->next = slab->next;
+    } else {
+        c.partial = slab->next;
+    }
+
+    if(slab->next){
+        slab->next->prev = slab->prev;
+    }
+
+    slab->partial = false;
+}
+
+slab_header* create_slab(size_class& c){
+    auto physical_memory = physical_allocator::allocate(SLAB_PAGES);
+
+    if(!physical_memory){
+        return nullptr;
+    }
+
+    auto virtual_memory = virtual_allocator::allocate(SLAB_PAGES);
+
+    // The slab of an object is found by alignment
+    if(!virtual_memory || virtual_memory % SLAB_SIZE){
+        logging::logf(logging::log_level::ERROR, "kalloc: Unable to allocate an aligned slab\n");
+
+        if(virtual_memory){
+            virtual_allocator::free(virtual_memory, SLAB_PAGES);
+        }
+
+        physical_allocator::free(physical_memory, SLAB_PAGES);
+
+        return nullptr;
+    }
+
+    paging::map_pages(virtual_memory, physical_memory, SLAB_PAGES);
+
+    auto slab = reinterpret_cast<slab_header*>(virtual_memory);
+
+    slab->owner = &c;
+    slab->used = 0;
+    slab->capacity = (SLAB_SIZE - SLAB_HEADER_SIZE) / c.size;
+    slab->free = nullptr;
+
+    // Chain the objects so that they are allocated in address order
+    for(size_t i = slab->capacity; i > 0; --i){
+        auto object = reinterpret_cast<void**>(virtual_memory + SLAB_HEADER_SIZE + (i - 1) * c.size);
+        *object = slab->free;
+        slab->free = object;
+    }
+
+    ++c.slabs;
+    c.capacity += slab->capacity;
+
+    slab_memory += SLAB_SIZE;
+
+    mark_slab(virtual_memory, true);
+
+    return slab;
+}
+
+void release_slab(size_class& c, slab_header* slab){
+    auto virtual_memory = reinterpret_cast<size_t>(slab);
+    auto physical_memory = paging::physical_address(virtual_memory);
+
+    --c.slabs;
+    c.capacity -= slab->capacity;
+
+    mark_slab(virtual_memory, false);
+
+    paging::unmap_pages(virtual_memory, SLAB_PAGES);
+    virtual_allocator::free(virtual_memory, SLAB_PAGES);
+    physical_allocator::free(physical_memory, SLAB_PAGES);
+
+    slab_memory -= SLAB_SIZE;
+}
+
+/*!
+ * \brief Take a free object from the slabs of the class, its lock must be held
+ */
+void* slab_pop(size_class& c){
+    auto slab = c.partial;
+
+    if(!slab){
+        if(c.empty){
+            slab = c.empty;
+            c.empty = nullptr;
+        } else {
+            slab = create_slab(c);
+
+            if(!slab){
+                return nullptr;
+            }
+        }
+
+        link_partial(c, slab);
+    }
+
+    auto object = static_cast<void**>(slab->free);
+    slab->free = *object;
+
+    ++slab->used;
+    ++c.used;
+
+    if(!slab->free){
+        unlink_partial(c, slab);
+    }
+
+    return object;
+}
+
+slab_header* slab_of(void* block){
+    return reinterpret_cast<slab_header*>(reinterpret_cast<uintptr_t>(block) & ~(SLAB_SIZE - 1));
+}
+
+/*!
+ * \brief Give back an object to its slab, the lock of its class must be held
+ */
+void slab_push(size_class& c, void* block){
+    auto slab = slab_of(block);
+
+    auto object = static_cast<void**>(block);
+    *object = slab->free;
+    slab->free = object;
+
+    --slab->used;
+    --c.used;
+
+    if(!slab->partial){
+        link_partial(c, slab);
+    }
+
+    // Keep one empty slab per class to avoid trashing the allocators
+    if(!slab->used){
+        unlink_partial(c, slab);
+
+        if(c.empty){
+            release_slab(c, slab);
+        } else {
+            c.empty = slab;
+        }
+    }
+}
+
+// Each processor keeps a magazine of free objects per size class in front
+// of the slabs, the class lock is only taken to move a batch of objects
+
+constexpr const size_t MAGAZINE_SIZE = 16;                 ///< The number of objects of a magazine
+constexpr const size_t MAGAZINE_BATCH = MAGAZINE_SIZE / 2; ///< The number of objects moved at once from or to the slabs
+
+/*!
+ * \brief A bounded stack of free objects of one size class
+ */
+struct magazine {
+    size_t count;                               ///< The number of objects
+    std::array<void*, MAGAZINE_SIZE> objects;   ///< The free objects
+};
+
+std::array<std::array<magazine, SIZE_CLASSES>, smp::MAX_CPUS> magazines;
+
+void* cached_allocate(size_t bytes){
+    auto index = class_index[(bytes + ALIGNMENT - 1) / ALIGNMENT];
+    auto& c = classes[index];
+
+    // The magazine cannot change of processor while it is used
+    direct_int_lock l;
+
+    auto& m = magazines[smp::current_cpu()][index];
+
+    if(!m.count){
+        std::lock_guard<int_spinlock> class_lock(c.lock);
+
+        while(m.count < MAGAZINE_BATCH){
+            auto object = slab_pop(c);
+
+            if(!object){
+                break;
+            }
+
+            m.objects[m.count++] = object;
+        }
+
+        if(!m.count){
+            return nullptr;
+        }
+    }
+
+    return m.objects[--m.count];
+}
+
+void cached_free(void* block){
+    auto& c = *slab_of(block)->owner;
+    auto index = &c - classes.data();
+
+    direct_int_lock l;
+
+    auto& m = magazines[smp::current_cpu()][index];
+
+    if(m.count == MAGAZINE_SIZE){
+        std::lock_guard<int_spinlock> class_lock(c.lock);
+
+        while(m.count > MAGAZINE_SIZE - MAGAZINE_BATCH){
+            slab_push(c, m.objects[--m.count]);
+        }
+    }
+
+    m.objects[m.count++] = block;
+}
+
+/*!
+ * \brief Returns the number of free objects of the class held in magazines
+ */
+size_t cached_objects(const size_class& c){
+    auto index = &c - classes.data();
+
+    size_t cached = 0;
+
+    for(auto& cpu_magazines : magazines){
+        cached += cpu_magazines[index].count;
+    }
+
+    return cached;
+}
+
+size_t slab_used_memory(){
+    size_t used = 0;
+
+    for(auto& c : classes){
+        used += (c.used - cached_objects(c)) * c.size;
+    }
+
+    return used;
+}
+
+size_t slab_free_memory(){
+    size_t free = 0;
+
+    for(auto& c : classes){
+        free += (c.capacity - c.used + cached_objects(c)) * c.size;
+    }
+
+    return free;
+}
+
+std::string sysfs_class_used(void* data){
+    auto& c = *static_cast<size_class*>(data);
+    return std::to_string(c.used - cached_objects(c));
+}
+
+std::string sysfs_class_free(void* data){
+    auto& c = *static_cast<size_class*>(data);
+    return std::to_string(c.capacity - c.used + cached_objects(c));
+}
+
+std::string sysfs_class_cached(void* data){
+    return std::to_string(cached_objects(*static_cast<size_class*>(data)));
+}
+
+std::string sysfs_class_slabs(void* data){
+    return std::to_string(static_cast<size_class*>(data)->slabs);
+}
+
+/*!
+ * \brief Returns the number of pages of the empty slabs kept by the size classes
+ */
+size_t reclaimable_slabs(){
+    size_t pages = 0;
+
+    for(auto& c : classes){
+        if(c.empty){
+            pages += SLAB_PAGES;
+        }
+    }
+
+    return pages;
+}
+
+/*!
+ * \brief Release the empty slabs kept by the size classes
+ * \return The number of pages given back
+ */
+size_t shrink_slabs(size_t pages){
+    size_t released = 0;
+
+    for(auto& c : classes){
+        if(released >= pages){
+            break;
+        }
+
+        std::lock_guard<int_spinlock> l(c.lock);
+
+        if(c.empty){
+            auto slab = c.empty;
+            c.empty = nullptr;
+
+            release_slab(c, slab);
+            released += SLAB_PAGES;
+        }
+    }
+
+    return released;
+}
+
 std::string sysfs_free(){
     return std::to_string(kalloc::free_memory());
 }
@@ -323,24 +740,17 @@ std::string sysfs_used(){
     return std::to_string(kalloc::used_memory());
 }
 
-} //end of anonymous namespace
-
-void kalloc::init(){
-    //Init the fake head
-    init_head();
-
-    //Allocate a first block
-    expand_heap(malloc_head);
-}
+void* allocate(uint64_t bytes){
+    // Small blocks are served by the slabs, unless no slab can be allocated
+    if(bytes <= MAX_SLAB_OBJECT){
+        auto object = cached_allocate(bytes);
 
-void kalloc::finalize(){
-    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/free"), &sysfs_free);
-    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/used"), &sysfs_used);
-    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/allocated"), &sysfs_allocated);
-}
+        if(object){
+            return object;
+        }
+    }
 
-void* kalloc::k_malloc(uint64_t bytes){
-    direct_int_lock lock;
+    std::lock_guard<int_spinlock> l(kalloc_lock);
 
     auto current = malloc_head->next();
 
@@ -425,8 +835,60 @@ void* kalloc::k_malloc(uint64_t bytes){
     return reinterpret_cast<void*>(block_start);
 }
 
+} //end of anonymous namespace
+
+void kalloc::init(){
+    kalloc_lock.set_name("kalloc");
+
+    //Init the fake head
+    init_head();
+
+    init_slabs();
+
+    //Allocate a first block
+    expand_heap(malloc_head);
+}
+
+void kalloc::finalize(){
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/free"), &sysfs_free);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/used"), &sysfs_used);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/dynamic/allocated"), &sysfs_allocated);
+
+    for(auto& c : classes){
+        auto base = "/memory/dynamic/slab/" + std::to_string(c.size);
+
+        sysfs::set_dynamic_value_data(path("/sys"), path(base + "/used"), &sysfs_class_used, &c);
+        sysfs::set_dynamic_value_data(path("/sys"), path(base + "/free"), &sysfs_class_free, &c);
+        sysfs::set_dynamic_value_data(path("/sys"), path(base + "/slabs"), &sysfs_class_slabs, &c);
+        sysfs::set_dynamic_value_data(path("/sys"), path(base + "/cached"), &sysfs_class_cached, &c);
+    }
+
+    shrinker::add("slabs", &reclaimable_slabs, &shrink_slabs);
+}
+
+void* kalloc::k_malloc(uint64_t bytes){
+    return k_malloc(bytes, __builtin_return_address(0));
+}
+
+void* kalloc::k_malloc(uint64_t bytes, void* caller){
+    auto block = allocate(bytes);
+
+    if(block){
+        alloc_profile::allocated(block, bytes, caller);
+    }
+
+    return block;
+}
+
 void kalloc::k_free(void* block){
-    direct_int_lock lock;
+    alloc_profile::freed(block);
+
+    if(is_slab(reinterpret_cast<uintptr_t>(block))){
+        cached_free(block);
+        return;
+    }
+
+    std::lock_guard<int_spinlock> l(kalloc_lock);
 
     auto free_header = reinterpret_cast<malloc_header_chunk*>(
         reinterpret_cast<uintptr_t>(block) - sizeof(malloc_header_chunk));
@@ -453,15 +915,15 @@ void kalloc::k_free(void* block){
 }
 
 size_t kalloc::allocated_memory(){
-    return _allocated_memory;
+    return _allocated_memory + slab_memory.value();
 }
 
 size_t kalloc::used_memory(){
-    return _used_memory;
+    return _used_memory + slab_used_memory();
 }
 
 size_t kalloc::free_memory(){
-    size_t memory_free = 0;
+    size_t memory_free = slab_free_memory();
 
     auto it = malloc_head;
     do {
@@ -10,6 +10,7 @@
 #include "virtual_allocator.hpp"
 #include "paging.hpp"
 #include "kalloc.hpp"
+#include "alloc_profile.hpp"
 #include "timer.hpp"
 #include "drivers/keyboard.hpp"
 #include "drivers/mouse.hpp"
@@ -29,8 +30,23 @@
 #include "logging.hpp"
 #include "net/network.hpp"
 #include "vfs/vfs.hpp"
+#include "page_cache.hpp"
+#include "elf_cache.hpp"
+#include "shrinker.hpp"
+#include "vfs/dentry_cache.hpp"
+#include "aio.hpp"
 #include "fs/sysfs.hpp"
 #include "drivers/hpet.hpp"
+#include "drivers/rtc.hpp"
+#include "smp.hpp"
+#include "cpuidle.hpp"
+#include "work_queue.hpp"
+#include "softirq.hpp"
+#include "time_page.hpp"
+#include "sched_trace.hpp"
+#include "boot_trace.hpp"
+#include "cpu_features.hpp"
+#include "numa.hpp"
 
 extern "C" {
 
@@ -43,15 +59,49 @@ void __cxa_pure_virtual(){
 
 } //end of extern "C"
 
+namespace {
+
+uint64_t stage_start = 0; ///< The timestamp of the end of the previous boot stage
+
+/*!
+ * \brief Record the boot stage that just finished in the boot trace
+ */
+void boot_stage(const char* stage){
+    auto now = boot_trace::now();
+
+    boot_trace::record(stage, stage_start, now);
+
+    stage_start = now;
+}
+
+/*!
+ * \brief Detect the disks and mount the root as soon as they are known. The
+ * processes loading programs wait for the root.
+ */
+void init_disks(){
+    disks::detect_disks();
+    disks::finalize();
+
+    vfs::mount_root();
+}
+
+} //end of anonymous namespace
+
 void kernel_main() __attribute__((section(".start")));
 
 void kernel_main(){
     //Make sure stack is aligned to 16 byte boundary
     asm volatile("and rsp, -16");
 
+    stage_start = boot_trace::now();
+
     arch::enable_sse();
+    arch::enable_write_protect();
+    cpu_features::init();
+    paging::init_pat();
 
     gdt::flush_tss();
+    gdt::init_fault_stack(0);
 
     // Necessary for logging with Qemu
     serial::init();
@@ -73,6 +123,8 @@ void kernel_main(){
 
     //Init all the physical
     paging::init();
+    paging::init_global_pages();
+    paging::init_pcid(0);
 
     //Finalize physical allocator initialization for kalloc
     physical_allocator::init();
@@ -100,22 +152,44 @@ void kernel_main(){
     physical_allocator::finalize();
     virtual_allocator::finalize();
     kalloc::finalize();
+    alloc_profile::finalize();
+    cpu_features::finalize();
+    logging::export_levels();
+    boot_stage("memory and console initialized");
 
     // Asynchronously initialized drivers
     acpi::init();
     hpet::init();
+    smp::init();
+    cpuidle::init();
+    numa::init();
 
     //Install drivers
     timer::install();
+    rtc::init();
+    time_page::init();
+    sched_trace::init();
     keyboard::install_driver();
+    serial::install();
     mouse::install();
-    disks::detect_disks();
     pci::detect_devices();
+    boot_stage("pci devices detected");
+
+    //The disks are probed concurrently once the scheduler is started, the
+    //edge-triggered IRQs of the controllers must not be rerouted meanwhile
+    scheduler::queue_async_init_task("disks", init_disks, {"smp"});
+
     network::init();
     stdio::register_devices();
+    boot_stage("drivers installed");
 
     //Init the virtual file system
+    dentry_cache::init();
     vfs::init();
+    page_cache::init();
+    elf_cache::init();
+    shrinker::init();
+    boot_stage("virtual file system initialized");
 
     //Only install system calls when everything else is ready
     install_system_calls();
@@ -126,9 +200,16 @@ void kernel_main(){
     // Initialize the scheduler
     scheduler::init();
 
+    // Start the kernel workers
+    work_queue::init();
+    softirq::init();
+
     // Start the secondary kernel processes
     network::finalize();
     stdio::finalize();
+    aio::finalize();
+
+    boot_stage("kernel processes started");
 
     // Start the scheduler
     scheduler::start();
@@ -6,8 +6,11 @@
 //=======================================================================
 
 #include <string.hpp>
+#include <array.hpp>
+#include <algorithms.hpp>
 
 #include <tlib/flags.hpp>
+#include <tlib/errors.hpp>
 
 #include "logging.hpp"
 #include "assert.hpp"
@@ -15,15 +18,72 @@
 #include "virtual_debug.hpp"
 #include "early_memory.hpp"
 #include "scheduler.hpp"
+#include "smp.hpp"
+
+#include "conc/int_lock.hpp"
 
 #include "vfs/vfs.hpp"
 
+#include "fs/sysfs.hpp"
+
 namespace {
 
+constexpr const size_t RING_SIZE = 8192; ///< The size of the log ring of each processor
+constexpr const size_t FLUSH_MS  = 100;  ///< The delay between two flushes of the logger
+
+/*!
+ * \brief The lines logged by a processor, not yet written to the log file.
+ *
+ * The ring has a single producer, its processor with the interrupts
+ * disabled, and a single consumer, the logger.
+ */
+struct log_ring {
+    char data[RING_SIZE];          ///< The characters of the lines
+    volatile size_t head = 0;      ///< The total number of characters produced
+    volatile size_t tail = 0;      ///< The total number of characters consumed
+    volatile uint64_t dropped = 0; ///< The lines dropped because the ring was full
+} __attribute__((aligned(64)));
+
 bool early_mode = true;
 bool file = false;
 
-std::string buffer;
+std::array<log_ring, smp::MAX_CPUS> rings;
+
+volatile scheduler::pid_t logger_pid = 0; ///< The pid of the logger, its own lines are not written
+
+uint64_t dropped_lines(){
+    uint64_t dropped = 0;
+
+    for(auto& ring : rings){
+        dropped += __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+    }
+
+    return dropped;
+}
+
+std::string sysfs_dropped(){
+    return std::to_string(dropped_lines());
+}
+
+const char* subsystem_names[size_t(logging::subsystem::COUNT)] = {"scheduler", "net", "tcp", "arp", "nic"};
+
+std::string sysfs_level(void* data){
+    auto s = reinterpret_cast<size_t>(data);
+
+    return std::to_string(size_t(logging::subsystem_levels[s]));
+}
+
+size_t sysfs_set_level(void* data, const std::string& value){
+    auto s = reinterpret_cast<size_t>(data);
+
+    if(value.size() != 1 || value[0] < '0' || value[0] > '0' + size_t(logging::log_level::USER)){
+        return std::ERROR_INVALID_REQUEST;
+    }
+
+    logging::subsystem_levels[s] = logging::log_level(value[0] - '0');
+
+    return 0;
+}
 
 inline const char* level_to_string(logging::log_level level){
     switch(level){
@@ -42,26 +102,98 @@ inline const char* level_to_string(logging::log_level level){
     return "UNKNOWN";
 }
 
-void append_to_file(const char* s, size_t length){
+void append_to_ring(const char* s, size_t length){
+    // The lines of the logger itself would feed the log file forever
+    if(scheduler::is_started() && scheduler::get_pid() == logger_pid){
+        return;
+    }
+
+    // An interrupt handler could log in the middle of the line
+    direct_int_lock l;
+
+    auto& ring = rings[smp::current_cpu()];
+
+    auto head = ring.head;
+    auto tail = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+
+    if(length + 1 > RING_SIZE - (head - tail)){
+        __atomic_add_fetch(&ring.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for(size_t i = 0; i < length; ++i){
+        ring.data[(head + i) % RING_SIZE] = s[i];
+    }
+
+    ring.data[(head + length) % RING_SIZE] = '\n';
+
+    __atomic_store_n(&ring.head, head + length + 1, __ATOMIC_RELEASE);
+}
+
+// Move the pending lines of all the rings at the end of the batch
+void drain_rings(std::string& batch){
+    for(auto& ring : rings){
+        auto tail = ring.tail;
+        auto head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+
+        for(auto i = tail; i < head; ++i){
+            batch += ring.data[i % RING_SIZE];
+        }
+
+        __atomic_store_n(&ring.tail, head, __ATOMIC_RELEASE);
+    }
+}
+
+void logger_task(){
     auto fd = vfs::open("/messages", std::OPEN_CREATE);
 
-    if(fd){
-        vfs::stat_info info;
-        if(vfs::stat(*fd, info)){
-            if(vfs::truncate(*fd, info.size + length + 1)){
-                std::string buffer = s;
-                buffer += '\n';
+    if(!fd){
+        file = false;
+        scheduler::kill_current_process();
+    }
+
+    size_t size = 0;
 
-                vfs::write(*fd, buffer.c_str(), buffer.size(), info.size);
-            }
+    vfs::stat_info info;
+    if(vfs::stat(*fd, info)){
+        size = info.size;
+    }
+
+    std::string batch;
+    uint64_t reported = 0;
+
+    while(true){
+        scheduler::sleep_ms(FLUSH_MS);
+
+        batch.clear();
+        drain_rings(batch);
+
+        auto dropped = dropped_lines();
+
+        if(dropped != reported){
+            batch += "logging: " + std::to_string(dropped - reported) + " lines dropped\n";
+            reported = dropped;
+        }
+
+        if(batch.empty()){
+            continue;
         }
 
-        vfs::close(*fd);
+        // A single write for all the lines of the period
+        if(vfs::truncate(*fd, size + batch.size())){
+            auto written = vfs::write(*fd, batch.c_str(), batch.size(), size);
+
+            if(written){
+                size += *written;
+            }
+        }
     }
 }
 
 } //end of anonymous namespace
 
+volatile logging::log_level logging::subsystem_levels[size_t(logging::subsystem::COUNT)] = {};
+
 bool logging::is_early(){
     return early_mode;
 }
@@ -89,12 +221,26 @@ void logging::finalize(){
 }
 
 void logging::to_file(){
-    thor_assert(false, "logging to file needs revision");
+    auto& process = scheduler::create_kernel_task("logger", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &logger_task);
+    process.ppid = 1;
+    process.priority = scheduler::DEFAULT_PRIORITY;
+
+    logger_pid = process.pid;
+
+    scheduler::queue_system_process(process.pid);
+
+    sysfs::set_dynamic_value(path("/sys"), path("/logging/dropped"), &sysfs_dropped);
 
     //Starting from there, the messages will be sent to the log file
     file = true;
 }
 
+void logging::export_levels(){
+    for(size_t s = 0; s < size_t(subsystem::COUNT); ++s){
+        sysfs::set_writable_value_data(path("/sys"), path("/logging/level") / subsystem_names[s], &sysfs_level, &sysfs_set_level, reinterpret_cast<void*>(s));
+    }
+}
+
 void logging::log(log_level level, const char* s){
     if(!is_early()){
         // Get a nice message
@@ -106,7 +252,7 @@ void logging::log(log_level level, const char* s){
     }
 
     if(is_file()){
-        append_to_file(s, std::str_len(s));
+        append_to_ring(s, std::str_len(s));
     }
 }
 
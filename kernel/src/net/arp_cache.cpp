@@ -5,38 +5,211 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <lock_guard.hpp>
+
 #include "tlib/errors.hpp"
 
 #include "net/arp_cache.hpp"
 #include "net/arp_layer.hpp"
 #include "net/ethernet_layer.hpp"
+#include "net/network.hpp"
+#include "net/stats.hpp"
 
 #include "logging.hpp"
 #include "kernel_utils.hpp"
 #include "assert.hpp"
 #include "timer.hpp"
 
+namespace {
+
+constexpr uint64_t reachable_ms  = 30000;  ///< The time a neighbor stays reachable after an answer
+constexpr uint64_t unused_ms     = 600000; ///< The time after which an unused stale neighbor is released
+constexpr uint64_t retransmit_ms = 1000;   ///< The time between two requests
+constexpr uint64_t aging_ms      = 1000;   ///< The time between two aging passes
+constexpr size_t max_requests    = 3;      ///< The number of requests before a neighbor is unreachable
+
+size_t hash(network::ip::address ip){
+    auto h = ip.raw_address ^ (ip.raw_address >> 16);
+    return (h ^ (h >> 8)) % network::arp::cache::buckets;
+}
+
+// Set the target MAC address of a packet prepared before its neighbor was resolved
+void set_target(network::packet& packet, uint64_t mac){
+    auto* ether_header = reinterpret_cast<network::ethernet::header*>(packet.payload + packet.tag(0));
+
+    network::ethernet::mac64_to_mac6(mac, ether_header->target.mac);
+
+    packet.neighbor = 0;
+}
+
+} //end of anonymous namespace
+
 network::arp::cache::cache(network::arp::layer* layer, network::ethernet::layer* parent) : arp_layer(layer), ethernet_layer(parent) {
-    // Nothing else to init
+    for(size_t i = 0; i < buckets; ++i){
+        table[i] = nullptr;
+    }
 }
 
-void network::arp::cache::update_cache(uint64_t mac, network::ip::address ip){
-    for(auto& entry : mac_cache){
-        if(entry.mac == mac && entry.ip == ip){
-            return;
-        } else if(entry.mac == mac || entry.ip == ip){
-            logging::logf(logging::log_level::TRACE, "arp: Update cache %h->%u.%u.%u.%u \n",
-                mac, ip(0), ip(1), ip(2), ip(3));
-
-            entry.mac = mac;
-            entry.ip = ip;
-            return;
+network::arp::cache_entry* network::arp::cache::find(network::ip::address ip){
+    for(auto* entry = table[hash(ip)]; entry; entry = entry->next){
+        if(entry->ip == ip){
+            return entry;
         }
     }
 
-    logging::logf(logging::log_level::TRACE, "arp: Insert new entry into cache %h->%u.%u.%u.%u \n", mac, ip(0), ip(1), ip(2), ip(3));
+    return nullptr;
+}
+
+network::arp::cache_entry* network::arp::cache::insert(network::ip::address ip, neighbor_state state){
+    // Make room by releasing the stale neighbor unused for the longest time
+    if(entries == max_entries){
+        cache_entry* oldest = nullptr;
+
+        for(size_t i = 0; i < buckets; ++i){
+            for(auto* entry = table[i]; entry; entry = entry->next){
+                if(entry->state == neighbor_state::STALE && (!oldest || entry->used < oldest->used)){
+                    oldest = entry;
+                }
+            }
+        }
+
+        if(!oldest){
+            subsystem_logf(ARP, DEBUG, "arp: The cache is full\n");
+            return nullptr;
+        }
+
+        remove(oldest);
+    }
+
+    auto* entry = new cache_entry(ip, state);
+
+    auto& head = table[hash(ip)];
+    entry->next = head;
+    head = entry;
+
+    ++entries;
+
+    return entry;
+}
+
+void network::arp::cache::remove(cache_entry* entry){
+    auto* link = &table[hash(entry->ip)];
+
+    while(*link != entry){
+        link = &(*link)->next;
+    }
+
+    *link = entry->next;
 
-    mac_cache.emplace_back(mac, ip);
+    --entries;
+
+    delete entry;
+}
+
+void network::arp::cache::age(uint64_t now){
+    if(now < last_aging + aging_ms){
+        return;
+    }
+
+    last_aging = now;
+
+    for(size_t i = 0; i < buckets; ++i){
+        auto* entry = table[i];
+
+        while(entry){
+            auto* next = entry->next;
+
+            switch(entry->state){
+                case neighbor_state::REACHABLE:
+                    if(now >= entry->confirmed + reachable_ms){
+                        entry->state = neighbor_state::STALE;
+                    }
+
+                    break;
+
+                case neighbor_state::STALE:
+                    if(now >= entry->used + unused_ms){
+                        remove(entry);
+                    }
+
+                    break;
+
+                case neighbor_state::INCOMPLETE:
+                    if(now >= entry->requested + retransmit_ms){
+                        if(entry->requests == max_requests){
+                            auto ip = entry->ip;
+
+                            subsystem_logf(ARP, DEBUG, "arp: %u.%u.%u.%u is unreachable, drop %u packets\n",
+                                ip(0), ip(1), ip(2), ip(3), entry->pending.size());
+
+                            remove(entry);
+                        } else {
+                            entry->requested = now;
+                            ++entry->requests;
+
+                            arp_request(network::interface(entry->interface), entry->ip);
+                        }
+                    }
+
+                    break;
+            }
+
+            entry = next;
+        }
+    }
+}
+
+void network::arp::cache::update_cache(network::interface_descriptor& interface, uint64_t mac, network::ip::address ip, bool create){
+    std::deque<network::packet_p> pending;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        auto now = timer::milliseconds();
+
+        age(now);
+
+        auto* entry = find(ip);
+
+        if(!entry){
+            if(!create){
+                return;
+            }
+
+            subsystem_logf(ARP, TRACE, "arp: Insert new entry into cache %h->%u.%u.%u.%u \n", mac, ip(0), ip(1), ip(2), ip(3));
+
+            entry = insert(ip, neighbor_state::REACHABLE);
+
+            if(!entry){
+                return;
+            }
+
+            entry->used = now;
+        } else if(entry->state != neighbor_state::INCOMPLETE && entry->mac != mac){
+            subsystem_logf(ARP, TRACE, "arp: Update cache %h->%u.%u.%u.%u \n", mac, ip(0), ip(1), ip(2), ip(3));
+        }
+
+        entry->mac       = mac;
+        entry->state     = neighbor_state::REACHABLE;
+        entry->confirmed = now;
+        entry->requests  = 0;
+        entry->interface = interface.id;
+
+        while(!entry->pending.empty()){
+            pending.push_back(entry->pending.front());
+            entry->pending.pop_front();
+        }
+    }
+
+    // The packets are sent in order, outside of the lock
+    while(!pending.empty()){
+        auto& packet = pending.front();
+
+        set_target(*packet, mac);
+        interface.send(packet);
+
+        pending.pop_front();
+    }
 }
 
 std::expected<void> network::arp::cache::arp_request(network::interface_descriptor& interface, network::ip::address ip){
@@ -69,116 +242,106 @@ std::expected<void> network::arp::cache::arp_request(network::interface_descript
     }
 }
 
-bool network::arp::cache::is_mac_cached(uint64_t mac) const {
-    for(auto& entry : mac_cache){
-        if(entry.mac == mac){
-            return true;
-        }
+bool network::arp::cache::lookup(network::interface_descriptor& interface, network::ip::address ip, uint64_t& mac){
+    // Ask for self MAC address
+    if(interface.ip_address == ip){
+        mac = interface.mac_address;
+        return true;
     }
 
-    return false;
-}
+    bool request = false;
+    bool known = false;
 
-bool network::arp::cache::is_ip_cached(network::ip::address ip) const {
-    for(auto& entry : mac_cache){
-        if(entry.ip == ip){
-            return true;
-        }
-    }
+    {
+        std::lock_guard<spinlock> l(lock);
 
-    return false;
-}
+        auto now = timer::milliseconds();
 
-network::ip::address network::arp::cache::get_ip(uint64_t mac) const {
-    thor_assert(is_mac_cached(mac), "The MAC is not cached in the ARP table");
+        age(now);
 
-    for(auto& entry : mac_cache){
-        if(entry.mac == mac){
-            return entry.ip;
-        }
-    }
+        auto* entry = find(ip);
 
-    thor_unreachable("The MAC is not cached in the ARP table");
-}
+        if(entry && entry->state != neighbor_state::INCOMPLETE){
+            // A stale neighbor is still used while it is confirmed again
+            if(entry->state == neighbor_state::STALE && now >= entry->requested + retransmit_ms){
+                entry->requested = now;
+                request = true;
+            }
 
-uint64_t network::arp::cache::get_mac(network::ip::address ip) const {
-    thor_assert(is_ip_cached(ip), "The IP is not cached in the ARP table");
+            entry->used = now;
 
-    for(auto& entry : mac_cache){
-        if(entry.ip == ip){
-            return entry.mac;
-        }
-    }
+            mac = entry->mac;
+            known = true;
+        } else if(!entry){
+            entry = insert(ip, neighbor_state::INCOMPLETE);
 
-    thor_unreachable("The IP is not cached in the ARP table");
-}
+            if(entry){
+                entry->used      = now;
+                entry->requested = now;
+                entry->requests  = 1;
+                entry->interface = interface.id;
 
-std::expected<uint64_t> network::arp::cache::get_mac_force(network::interface_descriptor& interface, network::ip::address ip){
-    // Check cache first
-    if(is_ip_cached(ip)){
-        return get_mac(ip);
-    }
-
-    // Ask for self MAC address
-    if(interface.ip_address == ip){
-        return interface.mac_address;
+                request = true;
+            }
+        }
     }
 
-    // At this point we need to send a request for the IP
+    if(request){
+        subsystem_logf(ARP, TRACE, "arp: IP %u.%u.%u.%u not confirmed, generate ARP Request\n",
+            ip(0), ip(1), ip(2), ip(3));
 
-    logging::logf(logging::log_level::TRACE, "arp: IP %u.%u.%u.%u not cached, generate ARP Request\n",
-        ip(0), ip(1), ip(2), ip(3));
-
-    auto arp_result = arp_request(interface, ip);
-    if(!arp_result){
-        return std::make_expected_from_error<uint64_t>(arp_result.error());
+        arp_request(interface, ip);
     }
 
-    while(!is_ip_cached(ip)){
-        arp_layer->wait_for_reply();
-    }
+    return known;
+}
 
-    logging::logf(logging::log_level::TRACE, "arp: received ARP Reply\n");
+std::expected<void> network::arp::cache::send_pending(network::interface_descriptor& interface, network::packet_p& packet){
+    network::ip::address ip(packet->neighbor);
 
-    return get_mac(ip);
-}
+    uint64_t mac = 0;
 
-std::expected<uint64_t> network::arp::cache::get_mac_force(network::interface_descriptor& interface, network::ip::address ip, size_t ms){
-    // Check cache first
-    if(is_ip_cached(ip)){
-        return std::make_expected<uint64_t>(get_mac(ip));
-    }
+    {
+        std::lock_guard<spinlock> l(lock);
 
-    // Ask for self MAC address
-    if(interface.ip_address == ip){
-        return std::make_expected<uint64_t>(interface.mac_address);
-    }
+        age(timer::milliseconds());
 
-    // At this point we need to send a request for the IP
+        auto* entry = find(ip);
 
-    logging::logf(logging::log_level::TRACE, "arp: IP %u.%u.%u.%u not cached, generate ARP Request (timeout)\n",
-        ip(0), ip(1), ip(2), ip(3));
+        // The neighbor could not be resolved
+        if(!entry){
+            stats::count(stats::get().arp_misses);
 
-    auto arp_result = arp_request(interface, ip);
-    if(!arp_result){
-        return std::make_expected_from_error<uint64_t>(arp_result.error());
-    }
+            return std::make_unexpected<void>(std::ERROR_SOCKET_TIMEOUT);
+        }
 
-    auto start = timer::milliseconds();
+        if(entry->state == neighbor_state::INCOMPLETE){
+            stats::count(stats::get().arp_misses);
 
-    while(!is_ip_cached(ip)){
-        arp_layer->wait_for_reply(ms);
+            // The oldest packet is dropped to make room
+            if(entry->pending.size() == max_pending){
+                entry->pending.pop_front();
 
-        if(!is_ip_cached(ip)){
-            auto end = timer::milliseconds();
-            if(start - end > ms){
-                logging::logf(logging::log_level::TRACE, "arp: reached timeout, exiting\n");
-                return std::make_expected_from_error<uint64_t>(std::ERROR_SOCKET_TIMEOUT);
+                stats::count(stats::get().queue_overflows);
             }
+
+            entry->pending.push_back(packet);
+
+            return {};
         }
+
+        mac = entry->mac;
     }
 
-    logging::logf(logging::log_level::TRACE, "arp: received ARP Reply\n");
+    // The answer arrived since the packet was prepared
+    set_target(*packet, mac);
+    interface.send(packet);
+
+    return {};
+}
+
+size_t network::arp::cache::size() const {
+    std::lock_guard<spinlock> l(lock);
 
-    return std::make_expected<uint64_t>(get_mac(ip));
+    return entries;
 }
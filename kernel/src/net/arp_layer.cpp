@@ -57,7 +57,7 @@ void network::arp::layer::decode(network::interface_descriptor& interface, netwo
 
     auto* arp_header = reinterpret_cast<header*>(packet->payload + packet->index);
 
-    logging::logf(logging::log_level::TRACE, "arp: Start ARP packet handling\n");
+    subsystem_logf(ARP, TRACE, "arp: Start ARP packet handling\n");
 
     auto hw_type = switch_endian_16(arp_header->hw_type);
     auto protocol_type = switch_endian_16(arp_header->protocol_type);
@@ -85,32 +85,42 @@ void network::arp::layer::decode(network::interface_descriptor& interface, netwo
     }
 
     if (operation != 0x1 && operation != 0x2) {
-        logging::logf(logging::log_level::TRACE, "arp: Unhandled operation %h\n", size_t(operation));
+        subsystem_logf(ARP, TRACE, "arp: Unhandled operation %h\n", size_t(operation));
         return;
     }
 
     auto source_hw = mac3_to_mac64(arp_header->source_hw_addr);
     auto target_hw = mac3_to_mac64(arp_header->target_hw_addr);
 
-    logging::logf(logging::log_level::TRACE, "arp: Source HW Address %h \n", source_hw);
-    logging::logf(logging::log_level::TRACE, "arp: Target HW Address %h \n", target_hw);
+    subsystem_logf(ARP, TRACE, "arp: Source HW Address %h \n", source_hw);
+    subsystem_logf(ARP, TRACE, "arp: Target HW Address %h \n", target_hw);
 
     auto source_prot = ip2_to_ip(arp_header->source_protocol_addr);
     auto target_prot = ip2_to_ip(arp_header->target_protocol_addr);
 
-    logging::logf(logging::log_level::TRACE, "arp: Source Protocol Address %u.%u.%u.%u \n",
+    subsystem_logf(ARP, TRACE, "arp: Source Protocol Address %u.%u.%u.%u \n",
         uint64_t(source_prot(0)), uint64_t(source_prot(1)), uint64_t(source_prot(2)), uint64_t(source_prot(3)));
-    logging::logf(logging::log_level::TRACE, "arp: Target Protocol Address %u.%u.%u.%u \n",
+    subsystem_logf(ARP, TRACE, "arp: Target Protocol Address %u.%u.%u.%u \n",
         uint64_t(target_prot(0)), uint64_t(target_prot(1)), uint64_t(target_prot(2)), uint64_t(target_prot(3)));
 
-    // If not an ARP Probe, update the ARP cache
-    if(source_prot.raw_address != 0x0){
-        _cache.update_cache(source_hw, source_prot);
+    // A gratuitous ARP announces the address of its sender
+    if(source_prot == target_prot){
+        if(source_prot == interface.ip_address && source_hw != interface.mac_address){
+            logging::logf(logging::log_level::WARNING, "arp: Address conflict with %h\n", source_hw);
+        }
+
+        subsystem_logf(ARP, TRACE, "arp: Gratuitous ARP\n");
+    }
+
+    // If not an ARP Probe, update the ARP cache. Only the neighbors that
+    // talk to this host are added, the others are only updated.
+    if(source_prot.raw_address != 0x0 && !(source_prot == interface.ip_address)){
+        _cache.update_cache(interface, source_hw, source_prot, target_prot == interface.ip_address);
     }
 
     if(operation == 0x1){
         if(target_prot == interface.ip_address){
-            logging::logf(logging::log_level::TRACE, "arp: Reply to Request for own IP\n");
+            subsystem_logf(ARP, TRACE, "arp: Reply to Request for own IP\n");
 
             // Ask the ethernet layer to craft a packet
             network::ethernet::packet_descriptor desc{sizeof(header), source_hw, ethernet::ether_type::ARP};
@@ -141,20 +151,10 @@ void network::arp::layer::decode(network::interface_descriptor& interface, netwo
             }
         }
     } else if(operation == 0x2){
-        logging::logf(logging::log_level::TRACE, "arp: Handle Reply\n");
-
-        wait_queue.notify_all();
+        subsystem_logf(ARP, TRACE, "arp: Handle Reply\n");
     }
 }
 
-void network::arp::layer::wait_for_reply(){
-    wait_queue.wait();
-}
-
-void network::arp::layer::wait_for_reply(size_t ms){
-    wait_queue.wait_for(ms);
-}
-
 network::arp::cache& network::arp::layer::get_cache(){
     return _cache;
 }
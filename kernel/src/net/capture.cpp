@@ -0,0 +1,411 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <lock_guard.hpp>
+#include <algorithms.hpp>
+
+#include "tlib/errors.hpp"
+
+#include "net/capture.hpp"
+
+#include "conc/spinlock.hpp"
+
+#include "fs/devfs.hpp"
+
+#include "poll.hpp"
+#include "physical_allocator.hpp"
+#include "physical_pointer.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+
+namespace {
+
+using network::capture::filter_instruction;
+
+// The device, it is only mapped and polled, the frames are never read
+struct capture_driver final : devfs::char_driver {
+    size_t read(void* data, char* buffer, size_t count, size_t& read) override;
+    size_t read(void* data, char* buffer, size_t count, size_t& read, size_t ms) override;
+    size_t write(void* data, const char* buffer, size_t count, size_t& written) override;
+    poll::source* poll_source(void* data) override;
+    size_t memory(void* data, size_t& physical, size_t& size) override;
+};
+
+capture_driver driver;
+
+spinlock lock;                ///< The lock protecting the ring and the configuration
+volatile bool running = false; ///< Indicates if a capture is running
+
+size_t snap_length = 0;                                     ///< The maximum number of bytes captured per frame
+filter_instruction filter[network::capture::MAX_FILTER];  ///< The filter of the capture
+size_t filter_length = 0;                                   ///< The number of instructions of the filter, 0 for no filter
+
+physical_pointer* ring = nullptr;                 ///< The kernel mapping of the device memory, allocated on first use
+network::capture::ring_header* header = nullptr;  ///< The header page of the ring
+char* frames = nullptr;                           ///< The frames of the ring
+
+poll::source source; ///< The readiness of the device, readable when the ring is not empty
+
+size_t capture_readiness(const void* /*object*/){
+    return header && header->head != header->tail ? poll::POLL_IN : 0;
+}
+
+// Must be called with the lock, the ring is never released since the
+// processes may have mapped it
+bool allocate_ring(){
+    if(ring){
+        return true;
+    }
+
+    auto pages = network::capture::MAP_SIZE / paging::PAGE_SIZE;
+    auto physical = physical_allocator::allocate_zeroed(pages);
+
+    if(!physical){
+        logging::logf(logging::log_level::ERROR, "capture: Cannot allocate the ring\n");
+        return false;
+    }
+
+    ring = new physical_pointer(physical, pages);
+
+    if(!*ring){
+        logging::logf(logging::log_level::ERROR, "capture: Cannot map the ring\n");
+
+        delete ring;
+        ring = nullptr;
+
+        physical_allocator::free(physical, pages);
+        return false;
+    }
+
+    header = ring->as_ptr<network::capture::ring_header>();
+    frames = ring->as_ptr<char>() + paging::PAGE_SIZE;
+
+    return true;
+}
+
+uint64_t timestamp(){
+    auto frequency = timer::counter_frequency();
+
+    if(frequency >= 1000000){
+        return timer::counter() / (frequency / 1000000);
+    }
+
+    return timer::milliseconds() * 1000;
+}
+
+// Load n bytes in network order, returns false if it is outside of the frame
+bool load(const uint8_t* frame, size_t size, size_t offset, size_t n, uint32_t& value){
+    if(offset > size || n > size - offset){
+        return false;
+    }
+
+    value = 0;
+
+    for(size_t i = 0; i < n; ++i){
+        value = (value << 8) | frame[offset + i];
+    }
+
+    return true;
+}
+
+bool valid_filter(const filter_instruction* program, size_t length){
+    if(!length || length > network::capture::MAX_FILTER){
+        return false;
+    }
+
+    for(size_t pc = 0; pc < length; ++pc){
+        auto& instruction = program[pc];
+
+        switch(instruction.code){
+            case network::capture::LD_W_ABS:
+            case network::capture::LD_H_ABS:
+            case network::capture::LD_B_ABS:
+            case network::capture::LD_W_IND:
+            case network::capture::LD_H_IND:
+            case network::capture::LD_B_IND:
+            case network::capture::LDX_B_MSH:
+            case network::capture::ALU_AND_K:
+            case network::capture::MISC_TAX:
+            case network::capture::MISC_TXA:
+            case network::capture::RET_K:
+            case network::capture::RET_A:
+                break;
+
+            case network::capture::JMP_JA:
+                if(instruction.k >= length - pc - 1){
+                    return false;
+                }
+
+                break;
+
+            case network::capture::JMP_JEQ_K:
+            case network::capture::JMP_JGT_K:
+            case network::capture::JMP_JGE_K:
+            case network::capture::JMP_JSET_K:
+                if(instruction.jt >= length - pc - 1 || instruction.jf >= length - pc - 1){
+                    return false;
+                }
+
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    // The jumps are forward, the program always ends with a return
+    auto last = program[length - 1].code;
+
+    return last == network::capture::RET_K || last == network::capture::RET_A;
+}
+
+// Returns the number of bytes of the frame to capture, an access outside of
+// the frame rejects it
+uint32_t run_filter(const uint8_t* frame, size_t size){
+    uint32_t a = 0;
+    uint32_t x = 0;
+
+    for(size_t pc = 0; pc < filter_length; ++pc){
+        auto& instruction = filter[pc];
+        auto k = instruction.k;
+
+        switch(instruction.code){
+            case network::capture::LD_W_ABS:
+                if(!load(frame, size, k, 4, a)){
+                    return 0;
+                }
+
+                break;
+
+            case network::capture::LD_H_ABS:
+                if(!load(frame, size, k, 2, a)){
+                    return 0;
+                }
+
+                break;
+
+            case network::capture::LD_B_ABS:
+                if(!load(frame, size, k, 1, a)){
+                    return 0;
+                }
+
+                break;
+
+            case network::capture::LD_W_IND:
+                if(!load(frame, size, size_t(x) + k, 4, a)){
+                    return 0;
+                }
+
+                break;
+
+            case network::capture::LD_H_IND:
+                if(!load(frame, size, size_t(x) + k, 2, a)){
+                    return 0;
+                }
+
+                break;
+
+            case network::capture::LD_B_IND:
+                if(!load(frame, size, size_t(x) + k, 1, a)){
+                    return 0;
+                }
+
+                break;
+
+            case network::capture::LDX_B_MSH:
+                if(!load(frame, size, k, 1, x)){
+                    return 0;
+                }
+
+                x = 4 * (x & 0xF);
+                break;
+
+            case network::capture::ALU_AND_K:
+                a &= k;
+                break;
+
+            case network::capture::JMP_JA:
+                pc += k;
+                break;
+
+            case network::capture::JMP_JEQ_K:
+                pc += a == k ? instruction.jt : instruction.jf;
+                break;
+
+            case network::capture::JMP_JGT_K:
+                pc += a > k ? instruction.jt : instruction.jf;
+                break;
+
+            case network::capture::JMP_JGE_K:
+                pc += a >= k ? instruction.jt : instruction.jf;
+                break;
+
+            case network::capture::JMP_JSET_K:
+                pc += (a & k) ? instruction.jt : instruction.jf;
+                break;
+
+            case network::capture::MISC_TAX:
+                x = a;
+                break;
+
+            case network::capture::MISC_TXA:
+                a = x;
+                break;
+
+            case network::capture::RET_K:
+                return k;
+
+            case network::capture::RET_A:
+                return a;
+        }
+    }
+
+    return 0;
+}
+
+// Copy bytes at the given position of the ring, wrapping around its end
+void copy_to_ring(uint64_t position, const char* source, size_t n){
+    auto offset = position % network::capture::RING_SIZE;
+    auto first = std::min(n, network::capture::RING_SIZE - offset);
+
+    std::copy_n(source, first, frames + offset);
+    std::copy_n(source + first, n - first, frames);
+}
+
+size_t capture_driver::read(void* /*data*/, char* /*buffer*/, size_t /*count*/, size_t& /*read*/){
+    return std::ERROR_UNSUPPORTED;
+}
+
+size_t capture_driver::read(void* /*data*/, char* /*buffer*/, size_t /*count*/, size_t& /*read*/, size_t /*ms*/){
+    return std::ERROR_UNSUPPORTED;
+}
+
+size_t capture_driver::write(void* /*data*/, const char* /*buffer*/, size_t /*count*/, size_t& /*written*/){
+    return std::ERROR_UNSUPPORTED;
+}
+
+poll::source* capture_driver::poll_source(void* /*data*/){
+    return &source;
+}
+
+size_t capture_driver::memory(void* /*data*/, size_t& physical, size_t& size){
+    std::lock_guard<spinlock> l(lock);
+
+    if(!allocate_ring()){
+        return std::ERROR_FAILED;
+    }
+
+    physical = ring->get_phys();
+    size = network::capture::MAP_SIZE;
+
+    return 0;
+}
+
+} //end of anonymous namespace
+
+void network::capture::init(){
+    source.init(capture_readiness, nullptr);
+
+    devfs::register_device("/dev/", "capture", devfs::device_type::CHAR_DEVICE, &driver, nullptr);
+}
+
+std::expected<void> network::capture::start(const capture_config& config){
+    if(config.filter && !valid_filter(config.filter, config.filter_length)){
+        return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+    }
+
+    std::lock_guard<spinlock> l(lock);
+
+    if(!allocate_ring()){
+        return std::make_unexpected<void>(std::ERROR_FAILED);
+    }
+
+    snap_length = config.snap_length ? std::min(config.snap_length, MAX_SNAP_LENGTH) : MAX_SNAP_LENGTH;
+    filter_length = config.filter ? config.filter_length : 0;
+
+    std::copy_n(config.filter, filter_length, filter);
+
+    header->head     = 0;
+    header->tail     = 0;
+    header->captured = 0;
+    header->dropped  = 0;
+
+    running = true;
+
+    logging::logf(logging::log_level::DEBUG, "capture: Start capture (snap %u, filter %u)\n", snap_length, filter_length);
+
+    return {};
+}
+
+void network::capture::stop(){
+    std::lock_guard<spinlock> l(lock);
+
+    running = false;
+}
+
+bool network::capture::active(){
+    return running;
+}
+
+void network::capture::record(const network::interface_descriptor& interface, const network::packet& packet, direction dir){
+    auto* frame = reinterpret_cast<const uint8_t*>(packet.payload);
+    auto length = packet.payload_size;
+
+    bool notify = false;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        if(!running){
+            return;
+        }
+
+        auto captured = std::min(length, snap_length);
+
+        if(filter_length){
+            captured = std::min(captured, size_t(run_filter(frame, length)));
+
+            if(!captured){
+                return;
+            }
+        }
+
+        auto size = ((sizeof(record_header) + captured + RECORD_ALIGN - 1) / RECORD_ALIGN) * RECORD_ALIGN;
+
+        // The tail is written by the reader, it is not trusted
+        auto head = header->head;
+        auto used = std::min(head - header->tail, RING_SIZE);
+
+        if(RING_SIZE - used < size){
+            ++header->dropped;
+            return;
+        }
+
+        record_header record;
+        record.timestamp = timestamp();
+        record.length    = length;
+        record.captured  = captured;
+        record.interface = interface.id;
+        record.dir       = dir;
+
+        copy_to_ring(head, reinterpret_cast<const char*>(&record), sizeof(record_header));
+        copy_to_ring(head + sizeof(record_header), packet.payload, captured);
+
+        // The record must be complete before the reader can see it
+        asm volatile("" ::: "memory");
+
+        header->head = head + size;
+        ++header->captured;
+
+        notify = !used;
+    }
+
+    // The reader only needs to be woken up once the ring is not empty anymore
+    if(notify){
+        source.notify();
+    }
+}
@@ -10,11 +10,85 @@
 #include "net/ethernet_layer.hpp"
 
 #include "kernel_utils.hpp"
+#include "logging.hpp"
+#include "timer.hpp"
+
+#include "drivers/rtc.hpp"
+
+#include "vfs/vfs.hpp"
 
 #include "tlib/errors.hpp"
+#include "tlib/flags.hpp"
 
 namespace {
 
+constexpr const uint32_t DHCP_XID = 0x66666666;     ///< The identification of the transactions of the kernel
+constexpr const size_t DHCP_TIMEOUT_MS = 2000;      ///< The delay for the answer of a server
+constexpr const size_t DHCP_POLL_MS = 100;          ///< The period of the checks of the queue, in case of a missed notification
+constexpr const uint32_t DEFAULT_LEASE_TIME = 3600; ///< The duration of a lease given without any time, in seconds
+
+constexpr const char* LEASE_FILE = "/dhcp.lease";   ///< The file holding the lease of each interface
+constexpr const uint32_t LEASE_MAGIC = 0x4C504844;  ///< The magic number of a lease record
+
+// The DHCP message types
+constexpr const uint8_t DHCP_DISCOVER = 1;
+constexpr const uint8_t DHCP_OFFER    = 2;
+constexpr const uint8_t DHCP_REQUEST  = 3;
+constexpr const uint8_t DHCP_ACK      = 5;
+constexpr const uint8_t DHCP_NAK      = 6;
+
+/*!
+ * \brief The lease of an interface, as saved on disk
+ */
+struct lease_record {
+    uint32_t magic;          ///< LEASE_MAGIC for a valid record
+    uint32_t flags;          ///< Bit 0: the gateway is set, bit 1: the DNS is set
+    uint64_t mac_address;    ///< The MAC address of the interface
+    uint32_t ip_address;     ///< The leased address
+    uint32_t server_address; ///< The server of the lease
+    uint32_t gateway;        ///< The gateway address
+    uint32_t dns;            ///< The DNS address
+    uint32_t lease_time;     ///< The duration of the lease, in seconds
+    uint32_t renewal_time;   ///< T1, in seconds
+    uint32_t rebinding_time; ///< T2, in seconds
+    uint32_t reserved;       ///< Padding
+    uint64_t saved;          ///< The RTC time of the save, in seconds since 1970
+} __attribute__((packed));
+
+static_assert(sizeof(lease_record) == 56, "The lease record is 56 bytes long");
+
+/*!
+ * \brief Returns the time of the RTC, in seconds since 1970
+ */
+uint64_t rtc_seconds(){
+    auto date = rtc::all_data();
+
+    // Days since 1970 of the civil date, with the years starting in March
+    int64_t year = date.year - (date.month <= 2);
+    int64_t era = year / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (date.month + (date.month > 2 ? -3 : 9)) + 2) / 5 + date.day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int64_t days = era * 146097 + day_of_era - 719468;
+
+    return uint64_t(days) * 86400 + date.hour * 3600 + date.minutes * 60 + date.seconds;
+}
+
+uint32_t read_32(const uint8_t* option){
+    return (uint32_t(option[0]) << 24) + (uint32_t(option[1]) << 16) + (uint32_t(option[2]) << 8) + option[3];
+}
+
+uint8_t* write_address(uint8_t* options, uint8_t code, network::ip::address address){
+    options[0] = code;
+    options[1] = 4;
+    options[2] = address(0);
+    options[3] = address(1);
+    options[4] = address(2);
+    options[5] = address(3);
+
+    return options + 6;
+}
+
 void prepare_packet(network::packet& packet, network::interface_descriptor& interface) {
     packet.tag(3, packet.index);
 
@@ -57,11 +131,11 @@ network::dhcp::layer::layer(network::udp::layer* parent) : parent(parent) {
 void network::dhcp::layer::decode(network::interface_descriptor& /*interface*/, network::packet_p& packet) {
     packet->tag(3, packet->index);
 
-    logging::logf(logging::log_level::TRACE, "dhcp: Start DHCP packet handling\n");
+    subsystem_logf(NET, TRACE, "dhcp: Start DHCP packet handling\n");
 
     auto* dhcp_header = reinterpret_cast<header*>(packet->payload + packet->index);
 
-    logging::logf(logging::log_level::TRACE, "dhcp: Identification: %u\n", size_t(dhcp_header->xid));
+    subsystem_logf(NET, TRACE, "dhcp: Identification: %u\n", size_t(dhcp_header->xid));
 
     // Note: Propagate is handled by UDP connections
 
@@ -72,305 +146,347 @@ void network::dhcp::layer::decode(network::interface_descriptor& /*interface*/,
 }
 
 std::expected<network::dhcp::dhcp_configuration> network::dhcp::layer::request_ip(network::interface_descriptor& interface) {
-    logging::logf(logging::log_level::TRACE, "dhcp: Start discovery\n");
-
-    listening = true;
+    subsystem_logf(NET, TRACE, "dhcp: Start discovery\n");
 
     // 1. Send DHCP Discovery
 
-    {
-        // Ask the UDP layer to craft a packet
-        auto payload_size = sizeof(network::dhcp::header) + 4 + 3 + 5 + 4;
-        network::udp::kernel_packet_descriptor udp_desc{payload_size, 68, 67, network::ip::make_address(255, 255, 255, 255)};
+    auto status = send(interface, DHCP_DISCOVER, network::ip::make_address(255, 255, 255, 255), {}, {}, {});
+    if (!status) {
+        return std::make_unexpected<dhcp_configuration>(status.error());
+    }
 
-        auto packet_e = parent->kernel_prepare_packet(interface, udp_desc);
+    // 2. Receive DHCP Offer
 
-        if (!packet_e) {
-            return std::make_unexpected<dhcp_configuration>(packet_e.error());
-        }
+    auto offer = receive(DHCP_OFFER);
+    if (!offer) {
+        return offer;
+    }
 
-        auto& packet = *packet_e;
+    subsystem_logf(NET, TRACE, "dhcp: Received DHCP Offer\n");
+    subsystem_logf(NET, TRACE, "dhcp:          From %h\n", size_t(offer->server_address.raw_address));
+    subsystem_logf(NET, TRACE, "dhcp:            IP %h\n", size_t(offer->ip_address.raw_address));
+    subsystem_logf(NET, TRACE, "dhcp:           DNS %b\n", offer->dns);
+    subsystem_logf(NET, TRACE, "dhcp:       Gateway %b\n", offer->gateway);
 
-        ::prepare_packet(*packet, interface);
+    // 3. Send DHCP Request
 
-        auto* dhcp_header = reinterpret_cast<network::dhcp::header*>(packet->payload + packet->tag(3));
+    status = send(interface, DHCP_REQUEST, offer->server_address, {}, offer->ip_address, offer->server_address);
+    if (!status) {
+        return std::make_unexpected<dhcp_configuration>(status.error());
+    }
 
-        dhcp_header->op    = 1;          // This is a request
-        dhcp_header->xid   = 0x66666666; // Our identification
-        dhcp_header->flags = 0x8000;     // We don't know our IP address for now
-
-        auto* options = packet->payload + packet->tag(3) + sizeof(network::dhcp::header);
-
-        // Option 0: Magic cookie
-        options[0] = 99;
-        options[1] = 130;
-        options[2] = 83;
-        options[3] = 99;
-
-        // Option 1: DHCP Discover
-        options[4] = 53; // DHCP Message Type
-        options[5] = 1;  // Length 1
-        options[6] = 1;  // DHCP Discover
-
-        // Option 2: Request Gateway / DNS / Mask
-        options[7]  = 55; // Parameter Request List
-        options[8]  = 3;  // Length 3
-        options[9]  = 1;  // Subnet mask
-        options[10] = 3;  // Router (Gateway)
-        options[11] = 6;  // DNS Server
-
-        // Pad 3 bytes
-        options[12] = 0;
-        options[13] = 0;
-        options[14] = 0;
-
-        // End of options
-        options[15] = 255;
-
-        // Finalize the UDP packet
-        auto status = parent->finalize_packet(interface, packet);
-        if (!status) {
-            return std::make_unexpected<dhcp_configuration>(status.error());
-        }
+    // 4. Receive DHCP Acknowledge
+
+    auto ack = receive(DHCP_ACK);
+
+    if (ack) {
+        subsystem_logf(NET, TRACE, "dhcp: Received DHCP Ack\n");
     }
 
-    // 2. Receive DHCP Offer
+    return ack;
+}
 
-    network::ip::address offer_address;
-    network::ip::address server_address;
-    network::ip::address gateway_address;
-    network::ip::address dns_address;
+std::expected<network::dhcp::dhcp_configuration> network::dhcp::layer::reboot(network::interface_descriptor& interface, const dhcp_configuration& lease) {
+    subsystem_logf(NET, TRACE, "dhcp: Confirm the lease of %h\n", size_t(lease.ip_address.raw_address));
 
-    bool gateway = false;
-    bool dns     = false;
+    // The client does not know if it is still on the same network, the server is not named
+    auto status = send(interface, DHCP_REQUEST, network::ip::make_address(255, 255, 255, 255), {}, lease.ip_address, {});
+    if (!status) {
+        return std::make_unexpected<dhcp_configuration>(status.error());
+    }
 
-    {
-        while (true) {
-            if (packets.empty()) {
-                listen_queue.wait();
-            }
+    return receive(DHCP_ACK);
+}
 
-            auto packet = packets.back();
-            packets.pop_back();
-
-            auto* dhcp_header = reinterpret_cast<network::dhcp::header*>(packet->payload + packet->tag(3));
-
-            if (dhcp_header->xid == 0x66666666 && dhcp_header->op == 0x2) {
-                logging::logf(logging::log_level::TRACE, "dhcp: Received DHCP answer\n");
-
-                auto* options = packet->payload + packet->tag(3) + sizeof(network::dhcp::header);
-
-                bool dhcp_offer = false;
-
-                auto cookie = (options[0] << 24) + (options[1] << 16) + (options[2] << 8) + options[3];
-                if (cookie != 0x63825363) {
-                    logging::logf(logging::log_level::TRACE, "dhcp: Received wrong magic cookie\n");
-                    continue;
-                }
-
-                size_t i = 4;
-                while (true) {
-                    auto id = options[i++];
-
-                    // End of options
-                    if (id == 255) {
-                        break;
-                    }
-
-                    // Pad
-                    if (id == 0) {
-                        continue;
-                    }
-
-                    auto n = options[i++];
-
-                    if (!n) {
-                        continue;
-                    }
-
-                    if (id == 53) {
-                        if (options[i++] == 2) {
-                            dhcp_offer = true;
-                        }
-                    } else if (id == 3) {
-                        gateway_address = network::ip::make_address(options[i], options[i + 1], options[i + 2], options[i + 3]);
-                        i += n;
-                        gateway = true;
-                    } else if (id == 6) {
-                        dns_address = network::ip::make_address(options[i], options[i + 1], options[i + 2], options[i + 3]);
-                        i += n;
-                        dns = true;
-                    } else {
-                        i += n;
-                    }
-                }
-
-                if (!dhcp_offer) {
-                    logging::logf(logging::log_level::TRACE, "dhcp: Received wrong DHCP message type\n");
-                    continue;
-                }
-
-                offer_address  = switch_endian_32(dhcp_header->your_ip);
-                server_address = switch_endian_32(dhcp_header->server_ip);
+std::expected<network::dhcp::dhcp_configuration> network::dhcp::layer::renew(network::interface_descriptor& interface, const dhcp_configuration& lease, bool rebinding) {
+    subsystem_logf(NET, TRACE, "dhcp: %s the lease of %h\n", rebinding ? "Rebind" : "Renew", size_t(lease.ip_address.raw_address));
 
-                break;
-            }
-        }
+    // The address of the client is in the header, not in the options
+    auto destination = rebinding ? network::ip::make_address(255, 255, 255, 255) : lease.server_address;
+
+    auto status = send(interface, DHCP_REQUEST, destination, lease.ip_address, {}, {});
+    if (!status) {
+        return std::make_unexpected<dhcp_configuration>(status.error());
     }
 
-    logging::logf(logging::log_level::TRACE, "dhcp: Received DHCP Offer\n");
-    logging::logf(logging::log_level::TRACE, "dhcp:          From %h\n", size_t(server_address.raw_address));
-    logging::logf(logging::log_level::TRACE, "dhcp:            IP %h\n", size_t(offer_address.raw_address));
-    logging::logf(logging::log_level::TRACE, "dhcp:           DNS %b\n", dns);
-    logging::logf(logging::log_level::TRACE, "dhcp:       Gateway %b\n", gateway);
+    return receive(DHCP_ACK);
+}
 
-    // 3. Send DHCP Request
+/*!
+ * \brief Send a DHCP message, the addresses that are not set are left out
+ * \param destination The address of the server or the broadcast address
+ * \param client The current address of the client (renewal)
+ * \param requested The requested address (option 50)
+ * \param server The selected server (option 54)
+ */
+std::expected<void> network::dhcp::layer::send(network::interface_descriptor& interface, uint8_t message, network::ip::address destination,
+                                                network::ip::address client, network::ip::address requested, network::ip::address server) {
+    // The answers of a previous exchange are not valid anymore
+    packets.clear();
+    listening = true;
 
-    {
-        // Ask the UDP layer to craft a packet
-        auto payload_size = sizeof(network::dhcp::header) + 20;
-        network::udp::kernel_packet_descriptor udp_desc{payload_size, 68, 67, server_address};
+    // Ask the UDP layer to craft a packet
+    auto payload_size = sizeof(network::dhcp::header) + 32;
+    network::udp::kernel_packet_descriptor udp_desc{payload_size, 68, 67, destination};
 
-        auto packet_e = parent->kernel_prepare_packet(interface, udp_desc);
+    auto packet_e = parent->kernel_prepare_packet(interface, udp_desc);
 
-        if (!packet_e) {
-            return std::make_unexpected<dhcp_configuration>(packet_e.error());
-        }
+    if (!packet_e) {
+        return std::make_unexpected<void>(packet_e.error());
+    }
 
-        auto& packet = *packet_e;
+    auto& packet = *packet_e;
 
-        ::prepare_packet(*packet, interface);
+    ::prepare_packet(*packet, interface);
 
-        auto* dhcp_header = reinterpret_cast<network::dhcp::header*>(packet->payload + packet->tag(3));
+    auto* dhcp_header = reinterpret_cast<network::dhcp::header*>(packet->payload + packet->tag(3));
 
-        dhcp_header->op        = 1;                                            // This is a request
-        dhcp_header->xid       = 0x66666666;                                   // Our identification
-        dhcp_header->flags     = switch_endian_16(0x8000);                     // We don't know our IP address for now
-        dhcp_header->server_ip = switch_endian_32(server_address.raw_address); // Address ip of the server
-
-        auto* options = packet->payload + packet->tag(3) + sizeof(network::dhcp::header);
-
-        // Option 0: Magic cookie
-        options[0] = 99;
-        options[1] = 130;
-        options[2] = 83;
-        options[3] = 99;
-
-        // Option 1: DHCP Request
-        options[4] = 53; // DHCP Message Type
-        options[5] = 1;  // Length 1
-        options[6] = 3;  // DHCP Request
-
-        // Option 2: Request IP address
-        options[7]  = 50;
-        options[8]  = 4;
-        options[9]  = offer_address(0);
-        options[10] = offer_address(1);
-        options[11] = offer_address(2);
-        options[12] = offer_address(3);
-
-        // Option 3: DHCP server
-        options[13] = 54;
-        options[14] = 4;
-        options[15] = server_address(0);
-        options[16] = server_address(1);
-        options[17] = server_address(2);
-        options[18] = server_address(3);
-
-        // End of options
-        options[19] = 255;
-
-        // Finalize the UDP packet
-        auto status = parent->finalize_packet(interface, packet);
-        if (!status) {
-            return std::make_unexpected<dhcp_configuration>(status.error());
-        }
+    dhcp_header->op        = 1;        // This is a request
+    dhcp_header->xid       = DHCP_XID; // Our identification
+    dhcp_header->client_ip = switch_endian_32(client.raw_address);
+
+    // Without an address, the answer must be broadcast
+    dhcp_header->flags = client.raw_address ? 0 : switch_endian_16(0x8000);
+
+    auto* options = reinterpret_cast<uint8_t*>(packet->payload + packet->tag(3) + sizeof(network::dhcp::header));
+
+    // Magic cookie
+    options[0] = 99;
+    options[1] = 130;
+    options[2] = 83;
+    options[3] = 99;
+
+    // DHCP Message Type
+    options[4] = 53;
+    options[5] = 1;
+    options[6] = message;
+
+    options += 7;
+
+    if (requested.raw_address) {
+        options = write_address(options, 50, requested);
     }
 
-    // 4. Receive DHCP Acknowledge
+    if (server.raw_address) {
+        options = write_address(options, 54, server);
+    }
 
-    {
-        while (true) {
-            if (packets.empty()) {
-                listen_queue.wait();
-            }
+    // Parameter Request List: Mask, Gateway, DNS and the times of the lease
+    options[0] = 55;
+    options[1] = 6;
+    options[2] = 1;
+    options[3] = 3;
+    options[4] = 6;
+    options[5] = 51;
+    options[6] = 58;
+    options[7] = 59;
+
+    // End of options, the rest is padding
+    options[8] = 255;
+
+    auto* end = reinterpret_cast<uint8_t*>(packet->payload + packet->tag(3) + payload_size);
+    std::fill_n(options + 9, end - (options + 9), 0);
 
-            auto packet = packets.back();
-            packets.pop_back();
+    // Finalize the UDP packet
+    return parent->finalize_packet(interface, packet);
+}
+
+/*!
+ * \brief Wait for an answer of the given type to the last message
+ * \return The configuration of the answer, ERROR_INVALID_REQUEST for a NAK
+ * or ERROR_TIMEOUT without any answer
+ */
+std::expected<network::dhcp::dhcp_configuration> network::dhcp::layer::receive(uint8_t message) {
+    auto deadline = timer::milliseconds() + DHCP_TIMEOUT_MS;
 
-            auto* dhcp_header = reinterpret_cast<network::dhcp::header*>(packet->payload + packet->tag(3));
+    while (true) {
+        if (packets.empty()) {
+            auto now = timer::milliseconds();
 
-            if (dhcp_header->xid == 0x66666666 && dhcp_header->op == 0x2) {
-                logging::logf(logging::log_level::TRACE, "dhcp: Received DHCP answer\n");
+            if (now >= deadline) {
+                listening = false;
 
-                auto* options = packet->payload + packet->tag(3) + sizeof(network::dhcp::header);
+                subsystem_logf(NET, TRACE, "dhcp: No answer from a server\n");
 
-                auto cookie = (options[0] << 24) + (options[1] << 16) + (options[2] << 8) + options[3];
-                if (cookie != 0x63825363) {
-                    logging::logf(logging::log_level::TRACE, "dhcp: Received wrong magic cookie\n");
-                    continue;
-                }
+                return std::make_unexpected<dhcp_configuration>(std::ERROR_TIMEOUT);
+            }
 
-                bool dhcp_ack = false;
+            listen_queue.wait_for(std::min(deadline - now, DHCP_POLL_MS));
+            continue;
+        }
 
-                size_t i = 4;
-                while (true) {
-                    auto id = options[i++];
+        auto packet = packets.back();
+        packets.pop_back();
 
-                    // End of options
-                    if (id == 255) {
-                        break;
-                    }
+        auto* dhcp_header = reinterpret_cast<network::dhcp::header*>(packet->payload + packet->tag(3));
 
-                    // Pad
-                    if (id == 0) {
-                        continue;
-                    }
+        if (dhcp_header->xid != DHCP_XID || dhcp_header->op != 0x2) {
+            continue;
+        }
 
-                    auto n = options[i++];
+        subsystem_logf(NET, TRACE, "dhcp: Received DHCP answer\n");
 
-                    if (!n) {
-                        continue;
-                    }
+        auto* options = reinterpret_cast<const uint8_t*>(packet->payload + packet->tag(3) + sizeof(network::dhcp::header));
+        auto* end     = reinterpret_cast<const uint8_t*>(packet->payload + packet->payload_size);
 
-                    if (id == 53) {
-                        if (options[i] == 5 || options[i] == 6) {
-                            dhcp_ack = true;
-                        }
+        if (end - options < 4 || read_32(options) != 0x63825363) {
+            subsystem_logf(NET, TRACE, "dhcp: Received wrong magic cookie\n");
+            continue;
+        }
 
-                        ++i;
+        dhcp_configuration conf;
+        uint8_t type = 0;
 
-                        continue;
-                    }
-                }
+        conf.ip_address     = switch_endian_32(dhcp_header->your_ip);
+        conf.server_address = switch_endian_32(dhcp_header->server_ip);
 
-                if (!dhcp_ack) {
-                    logging::logf(logging::log_level::TRACE, "dhcp: Received wrong DHCP message type\n");
-                    continue;
-                }
+        for (auto* option = options + 4; option < end && *option != 255;) {
+            auto id = *option++;
 
-                logging::logf(logging::log_level::TRACE, "dhcp: Received DHCP Ack\n");
+            // Pad
+            if (id == 0) {
+                continue;
+            }
 
+            if (option >= end || option + 1 + *option > end) {
                 break;
             }
+
+            auto n = *option++;
+
+            if (id == 53 && n >= 1) {
+                type = option[0];
+            } else if (id == 3 && n >= 4) {
+                conf.gateway_address = read_32(option);
+                conf.gateway         = true;
+            } else if (id == 6 && n >= 4) {
+                conf.dns_address = read_32(option);
+                conf.dns         = true;
+            } else if (id == 51 && n >= 4) {
+                conf.lease_time = read_32(option);
+            } else if (id == 54 && n >= 4) {
+                conf.server_address = read_32(option);
+            } else if (id == 58 && n >= 4) {
+                conf.renewal_time = read_32(option);
+            } else if (id == 59 && n >= 4) {
+                conf.rebinding_time = read_32(option);
+            }
+
+            option += n;
+        }
+
+        if (type == DHCP_NAK) {
+            listening = false;
+
+            subsystem_logf(NET, TRACE, "dhcp: Received DHCP Nak\n");
+
+            return std::make_unexpected<dhcp_configuration>(std::ERROR_INVALID_REQUEST);
+        }
+
+        if (type != message) {
+            subsystem_logf(NET, TRACE, "dhcp: Received wrong DHCP message type\n");
+            continue;
+        }
+
+        // The default times advised by the RFC 2131
+        if (!conf.lease_time) {
+            conf.lease_time = DEFAULT_LEASE_TIME;
+        }
+
+        if (!conf.renewal_time || conf.renewal_time >= conf.lease_time) {
+            conf.renewal_time = conf.lease_time / 2;
+        }
+
+        if (!conf.rebinding_time || conf.rebinding_time >= conf.lease_time || conf.rebinding_time < conf.renewal_time) {
+            conf.rebinding_time = uint64_t(conf.lease_time) * 7 / 8;
         }
+
+        if (message != DHCP_OFFER) {
+            listening = false;
+        }
+
+        return {conf};
     }
+}
+
+std::expected<network::dhcp::dhcp_configuration> network::dhcp::load_lease(network::interface_descriptor& interface) {
+    auto fd = vfs::open(LEASE_FILE, 0);
+
+    if (!fd) {
+        return std::make_unexpected<dhcp_configuration>(fd.error());
+    }
+
+    lease_record record;
+    auto read = vfs::read(*fd, reinterpret_cast<char*>(&record), sizeof(lease_record), interface.id * sizeof(lease_record));
 
-    listening = false;
+    vfs::close(*fd);
 
-    dhcp_configuration conf;
+    if (!read || *read != sizeof(lease_record) || record.magic != LEASE_MAGIC || record.mac_address != interface.mac_address) {
+        return std::make_unexpected<dhcp_configuration>(std::ERROR_NOT_EXISTS);
+    }
 
-    conf.dns        = dns;
-    conf.gateway    = gateway;
-    conf.ip_address = offer_address;
+    // The RTC may have been set back, the lease is then considered as fresh
+    auto now     = rtc_seconds();
+    auto elapsed = now > record.saved ? now - record.saved : 0;
 
-    if (dns) {
-        conf.dns_address = dns_address;
+    if (elapsed >= record.lease_time) {
+        subsystem_logf(NET, TRACE, "dhcp: The saved lease of interface %u expired\n", interface.id);
+        return std::make_unexpected<dhcp_configuration>(std::ERROR_TIMEOUT);
     }
 
-    if (gateway) {
-        conf.gateway_address = gateway_address;
+    dhcp_configuration lease;
+
+    lease.ip_address      = record.ip_address;
+    lease.server_address  = record.server_address;
+    lease.gateway_address = record.gateway;
+    lease.dns_address     = record.dns;
+    lease.gateway         = record.flags & 1;
+    lease.dns             = record.flags & 2;
+
+    // The timers continue from the save
+    lease.lease_time     = record.lease_time - elapsed;
+    lease.renewal_time   = record.renewal_time > elapsed ? record.renewal_time - elapsed : 0;
+    lease.rebinding_time = record.rebinding_time > elapsed ? record.rebinding_time - elapsed : 0;
+
+    return {lease};
+}
+
+void network::dhcp::save_lease(network::interface_descriptor& interface, const dhcp_configuration& lease) {
+    auto fd = vfs::open(LEASE_FILE, std::OPEN_CREATE);
+
+    if (!fd) {
+        subsystem_logf(NET, DEBUG, "dhcp: Unable to open %s: %s\n", LEASE_FILE, std::error_message(fd.error()));
+        return;
+    }
+
+    lease_record record;
+
+    record.magic          = LEASE_MAGIC;
+    record.flags          = (lease.gateway ? 1 : 0) | (lease.dns ? 2 : 0);
+    record.mac_address    = interface.mac_address;
+    record.ip_address     = lease.ip_address.raw_address;
+    record.server_address = lease.server_address.raw_address;
+    record.gateway        = lease.gateway_address.raw_address;
+    record.dns            = lease.dns_address.raw_address;
+    record.lease_time     = lease.lease_time;
+    record.renewal_time   = lease.renewal_time;
+    record.rebinding_time = lease.rebinding_time;
+    record.reserved       = 0;
+    record.saved          = rtc_seconds();
+
+    auto offset = interface.id * sizeof(lease_record);
+
+    // The records of the other interfaces are kept
+    vfs::stat_info info;
+    if (vfs::stat(*fd, info) && info.size < offset + sizeof(lease_record)) {
+        vfs::truncate(*fd, offset + sizeof(lease_record));
+    }
+
+    auto written = vfs::write(*fd, reinterpret_cast<const char*>(&record), sizeof(lease_record), offset);
+
+    if (!written) {
+        subsystem_logf(NET, DEBUG, "dhcp: Unable to save the lease: %s\n", std::error_message(written.error()));
     }
 
-    return {conf};
+    vfs::close(*fd);
 }
@@ -0,0 +1,557 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <lock_guard.hpp>
+#include <algorithms.hpp>
+
+#include "tlib/errors.hpp"
+
+#include "net/dns_cache.hpp"
+#include "net/dns_layer.hpp"
+#include "net/ip_layer.hpp"
+
+#include "logging.hpp"
+#include "kernel_utils.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+
+namespace {
+
+constexpr uint64_t aging_ms             = 1000;                ///< The time between two aging passes
+constexpr uint64_t min_ttl_ms           = 1000;                ///< The minimum time an answer is kept, for the lookups waiting for it
+constexpr uint64_t max_ttl_ms           = 86400 * 1000ULL;     ///< The maximum time an answer is kept
+constexpr uint64_t negative_ttl_ms      = 60 * 1000;           ///< The time a missing name is kept without SOA record
+constexpr uint64_t max_negative_ttl_ms  = 3 * 3600 * 1000ULL;  ///< The maximum time a missing name is kept (RFC 2308)
+constexpr uint64_t failure_ttl_ms       = 5000;                ///< The time a server failure is kept
+constexpr uint16_t user_identification  = 0x666;               ///< The identification used by the user queries
+constexpr size_t max_name               = 253;                 ///< The maximum length of a domain name
+constexpr size_t max_jumps              = 16;                  ///< The maximum number of compression pointers in a name
+
+constexpr uint16_t type_a   = 1; ///< An IPv4 address record
+constexpr uint16_t type_soa = 6; ///< A start of authority record
+constexpr uint16_t class_in = 1; ///< The Internet class
+
+constexpr uint8_t rcode_name_error = 3; ///< The name does not exist
+
+size_t hash(const std::string& name){
+    size_t h = 5381;
+
+    for(size_t i = 0; i < name.size(); ++i){
+        h = h * 33 + static_cast<uint8_t>(name[i]);
+    }
+
+    return h % network::dns::cache::buckets;
+}
+
+char to_lower(char c){
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+uint16_t read_16(const char* message, size_t offset){
+    return switch_endian_16(*reinterpret_cast<const uint16_t*>(message + offset));
+}
+
+uint32_t read_32(const char* message, size_t offset){
+    return switch_endian_32(*reinterpret_cast<const uint32_t*>(message + offset));
+}
+
+// Skip a possibly compressed name, returns false if it is malformed
+bool skip_name(const char* message, size_t size, size_t& offset){
+    while(offset < size){
+        auto label = static_cast<uint8_t>(message[offset]);
+
+        if(!label){
+            ++offset;
+            return true;
+        }
+
+        if((label & 0xC0) == 0xC0){
+            offset += 2;
+            return offset <= size;
+        }
+
+        offset += 1 + label;
+    }
+
+    return false;
+}
+
+// Read a possibly compressed name in lower case, returns false if it is malformed
+bool read_name(const char* message, size_t size, size_t offset, std::string& name){
+    size_t jumps = 0;
+
+    while(offset < size){
+        auto label = static_cast<uint8_t>(message[offset]);
+
+        if(!label){
+            return true;
+        }
+
+        if((label & 0xC0) == 0xC0){
+            if(offset + 1 >= size || ++jumps > max_jumps){
+                return false;
+            }
+
+            offset = (size_t(label & 0x3F) << 8) | static_cast<uint8_t>(message[offset + 1]);
+            continue;
+        }
+
+        if(offset + 1 + label > size || name.size() + label > max_name){
+            return false;
+        }
+
+        if(!name.empty()){
+            name += '.';
+        }
+
+        for(size_t i = 0; i < label; ++i){
+            name += to_lower(message[offset + 1 + i]);
+        }
+
+        offset += 1 + label;
+    }
+
+    return false;
+}
+
+// Returns the time to keep a missing name, from the SOA record of the
+// authority section (RFC 2308)
+uint64_t negative_ttl(const char* message, size_t size, size_t offset, size_t authorities){
+    for(size_t i = 0; i < authorities; ++i){
+        if(!skip_name(message, size, offset) || offset + 10 > size){
+            break;
+        }
+
+        auto rr_type   = read_16(message, offset);
+        auto ttl       = read_32(message, offset + 4);
+        auto rd_length = read_16(message, offset + 8);
+
+        offset += 10;
+
+        if(offset + rd_length > size){
+            break;
+        }
+
+        if(rr_type == type_soa && rd_length >= 4){
+            auto minimum = read_32(message, offset + rd_length - 4);
+
+            return std::min(uint64_t(std::min(ttl, minimum)) * 1000, max_negative_ttl_ms);
+        }
+
+        offset += rd_length;
+    }
+
+    return negative_ttl_ms;
+}
+
+} //end of anonymous namespace
+
+network::dns::cache::cache(network::dns::layer* layer) : dns_layer(layer) {
+    for(size_t i = 0; i < buckets; ++i){
+        table[i] = nullptr;
+    }
+}
+
+network::dns::cache::~cache(){
+    for(size_t i = 0; i < buckets; ++i){
+        while(table[i]){
+            remove(table[i]);
+        }
+    }
+}
+
+network::dns::cache_entry* network::dns::cache::find(const std::string& name){
+    for(auto* entry = table[hash(name)]; entry; entry = entry->next){
+        if(entry->name == name){
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+network::dns::cache_entry* network::dns::cache::find(uint16_t identification){
+    for(size_t i = 0; i < buckets; ++i){
+        for(auto* entry = table[i]; entry; entry = entry->next){
+            if(entry->state == entry_state::PENDING && entry->identification == identification){
+                return entry;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+network::dns::cache_entry* network::dns::cache::insert(const std::string& name){
+    // Make room by dropping the entry closest to its expiration
+    if(entries == max_entries){
+        cache_entry* oldest = nullptr;
+
+        for(size_t i = 0; i < buckets; ++i){
+            for(auto* e = table[i]; e; e = e->next){
+                if(e->state != entry_state::PENDING && (!oldest || e->expires < oldest->expires)){
+                    oldest = e;
+                }
+            }
+        }
+
+        if(!oldest){
+            logging::logf(logging::log_level::DEBUG, "dns: Too many pending queries\n");
+            return nullptr;
+        }
+
+        remove(oldest);
+    }
+
+    auto* entry = new cache_entry(name);
+
+    auto& head = table[hash(name)];
+    entry->next = head;
+    head = entry;
+
+    ++entries;
+
+    return entry;
+}
+
+void network::dns::cache::remove(cache_entry* entry){
+    auto* link = &table[hash(entry->name)];
+
+    while(*link != entry){
+        link = &(*link)->next;
+    }
+
+    *link = entry->next;
+
+    --entries;
+
+    delete entry;
+}
+
+void network::dns::cache::age(uint64_t now){
+    if(now < last_aging + aging_ms){
+        return;
+    }
+
+    last_aging = now;
+
+    for(size_t i = 0; i < buckets; ++i){
+        auto* entry = table[i];
+
+        while(entry){
+            auto* next = entry->next;
+
+            if(entry->state != entry_state::PENDING && now >= entry->expires){
+                remove(entry);
+            }
+
+            entry = next;
+        }
+    }
+}
+
+void network::dns::cache::wake_all(){
+    while(!waiters.empty()){
+        // The waiter may have been woken up by its timeout and not be
+        // removed from the list yet
+        waiters.dequeue_hint();
+    }
+}
+
+// Must be called with the lock
+void network::dns::cache::complete(cache_entry* entry, entry_state state, uint64_t ttl_ms){
+    entry->state   = state;
+    entry->expires = timer::milliseconds() + std::max(ttl_ms, min_ttl_ms);
+
+    wake_all();
+}
+
+std::expected<network::ip::address> network::dns::cache::resolve(const std::string& name, size_t timeout_ms, size_t retries){
+    if(name.empty() || name.size() > max_name){
+        return std::make_unexpected<network::ip::address>(std::ERROR_INVALID_REQUEST);
+    }
+
+    std::string key;
+    for(size_t i = 0; i < name.size(); ++i){
+        key += to_lower(name[i]);
+    }
+
+    auto max_queries = std::max(retries, size_t(1));
+    auto deadline = timer::milliseconds() + timeout_ms * max_queries;
+
+    bool first = true;
+
+    while(true){
+        lock.lock();
+
+        auto now = timer::milliseconds();
+
+        age(now);
+
+        auto* entry = find(key);
+
+        if(entry && entry->state != entry_state::PENDING && now < entry->expires){
+            if(first){
+                ++hits;
+            }
+
+            auto resolved = entry->state == entry_state::RESOLVED;
+            auto address  = entry->address;
+            auto error    = entry->error;
+
+            lock.unlock();
+
+            if(resolved){
+                return std::make_expected<network::ip::address>(address);
+            }
+
+            return std::make_unexpected<network::ip::address>(error);
+        }
+
+        bool send = false;
+
+        if(entry && entry->state != entry_state::PENDING){
+            // Expired, but not aged yet
+            remove(entry);
+            entry = nullptr;
+        }
+
+        if(!entry){
+            entry = insert(key);
+
+            if(!entry){
+                lock.unlock();
+                return std::make_unexpected<network::ip::address>(std::ERROR_BUSY);
+            }
+
+            entry->timeout     = timeout_ms;
+            entry->max_queries = max_queries;
+
+            ++misses;
+            send = true;
+        } else if(now >= entry->sent + entry->timeout){
+            // The pending query has not been answered
+            if(entry->queries >= entry->max_queries){
+                logging::logf(logging::log_level::DEBUG, "dns: No answer for %s\n", key.c_str());
+
+                entry->error = std::ERROR_SOCKET_TIMEOUT;
+                complete(entry, entry_state::FAILED, failure_ttl_ms);
+
+                lock.unlock();
+                return std::make_unexpected<network::ip::address>(std::ERROR_SOCKET_TIMEOUT);
+            }
+
+            send = true;
+        } else if(first){
+            ++coalesced;
+        }
+
+        first = false;
+
+        if(send){
+            if(++identification == user_identification){
+                ++identification;
+            }
+
+            entry->identification = identification;
+            entry->sent = now;
+            ++entry->queries;
+
+            auto query = identification;
+
+            lock.unlock();
+
+            // An answer received before the entry is checked again
+            // completes it, it is seen by the next iteration
+            auto status = dns_layer->send_query(key, query);
+
+            if(!status){
+                std::lock_guard<spinlock> l(lock);
+
+                entry = find(key);
+
+                if(entry && entry->state == entry_state::PENDING && entry->identification == query){
+                    entry->error = status.error();
+                    complete(entry, entry_state::FAILED, failure_ttl_ms);
+                }
+
+                return std::make_unexpected<network::ip::address>(status.error());
+            }
+
+            continue;
+        }
+
+        if(now >= deadline){
+            lock.unlock();
+            return std::make_unexpected<network::ip::address>(std::ERROR_SOCKET_TIMEOUT);
+        }
+
+        // The answer takes the lock to wake up the waiters, no wake up is lost
+        waiters.enqueue_timeout(std::min(deadline, entry->sent + entry->timeout) - now);
+
+        lock.unlock();
+
+        scheduler::reschedule();
+
+        // Still in the list after the timeout
+        std::lock_guard<spinlock> l(lock);
+
+        if(waiters.waiting()){
+            waiters.remove();
+        }
+    }
+}
+
+void network::dns::cache::answer(const network::packet& packet){
+    if(packet.payload_size < packet.index + sizeof(header)){
+        return;
+    }
+
+    auto* message = packet.payload + packet.index;
+    auto size = packet.payload_size - packet.index;
+
+    auto* dns_header = reinterpret_cast<const header*>(message);
+
+    auto flags          = switch_endian_16(dns_header->flags);
+    auto identification = switch_endian_16(dns_header->identification);
+    auto questions      = switch_endian_16(dns_header->questions);
+    auto answers        = switch_endian_16(dns_header->answers);
+    auto authorities    = switch_endian_16(dns_header->authority_rrs);
+
+    // Only the responses to a single question are handled
+    if(!(flags >> 15) || questions != 1 || identification == user_identification){
+        return;
+    }
+
+    size_t offset = sizeof(header);
+
+    std::string name;
+    if(!read_name(message, size, offset, name) || !skip_name(message, size, offset) || offset + 4 > size){
+        return;
+    }
+
+    offset += 4;
+
+    std::lock_guard<spinlock> l(lock);
+
+    auto* entry = find(identification);
+
+    if(!entry || entry->name != name){
+        return;
+    }
+
+    auto rcode = flags & 0xF;
+
+    if(rcode == rcode_name_error){
+        entry->error = std::ERROR_NOT_EXISTS;
+        complete(entry, entry_state::FAILED, negative_ttl(message, size, offset, authorities));
+        return;
+    }
+
+    if(rcode){
+        logging::logf(logging::log_level::DEBUG, "dns: Server failure %u for %s\n", size_t(rcode), name.c_str());
+
+        entry->error = std::ERROR_FAILED;
+        complete(entry, entry_state::FAILED, failure_ttl_ms);
+        return;
+    }
+
+    // The records of a CNAME chain expire with the shortest one
+    bool found = false;
+    uint64_t ttl_ms = max_ttl_ms;
+
+    for(size_t i = 0; i < answers; ++i){
+        if(!skip_name(message, size, offset) || offset + 10 > size){
+            return;
+        }
+
+        auto rr_type   = read_16(message, offset);
+        auto rr_class  = read_16(message, offset + 2);
+        auto ttl       = read_32(message, offset + 4);
+        auto rd_length = read_16(message, offset + 8);
+
+        offset += 10;
+
+        if(offset + rd_length > size){
+            return;
+        }
+
+        ttl_ms = std::min(ttl_ms, uint64_t(ttl) * 1000);
+
+        if(!found && rr_type == type_a && rr_class == class_in && rd_length == 4){
+            entry->address = network::ip::ip32_to_ip(*reinterpret_cast<const uint32_t*>(message + offset));
+            found = true;
+        }
+
+        offset += rd_length;
+    }
+
+    if(found){
+        complete(entry, entry_state::RESOLVED, ttl_ms);
+    } else {
+        // The name exists but has no address (NODATA)
+        entry->error = std::ERROR_NOT_EXISTS;
+        complete(entry, entry_state::FAILED, negative_ttl(message, size, offset, authorities));
+    }
+}
+
+void network::dns::cache::flush(){
+    std::lock_guard<spinlock> l(lock);
+
+    for(size_t i = 0; i < buckets; ++i){
+        auto* entry = table[i];
+
+        while(entry){
+            auto* next = entry->next;
+
+            if(entry->state != entry_state::PENDING){
+                remove(entry);
+            }
+
+            entry = next;
+        }
+    }
+}
+
+std::string network::dns::cache::view() const {
+    std::lock_guard<spinlock> l(lock);
+
+    auto now = timer::milliseconds();
+
+    std::string value;
+
+    for(size_t i = 0; i < buckets; ++i){
+        for(auto* entry = table[i]; entry; entry = entry->next){
+            value += entry->name;
+
+            if(entry->state == entry_state::PENDING){
+                value += " pending";
+            } else if(now < entry->expires){
+                if(entry->state == entry_state::RESOLVED){
+                    value += " " + network::ip::ip_to_str(entry->address);
+                } else {
+                    value += " ";
+                    value += std::error_message(entry->error);
+                }
+
+                value += " ttl=" + std::to_string((entry->expires - now) / 1000);
+            } else {
+                value += " expired";
+            }
+
+            value += '\n';
+        }
+    }
+
+    return value;
+}
+
+size_t network::dns::cache::size() const {
+    std::lock_guard<spinlock> l(lock);
+
+    return entries;
+}
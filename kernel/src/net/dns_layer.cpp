@@ -10,6 +10,7 @@
 #include "net/dns_layer.hpp"
 #include "net/udp_layer.hpp"
 #include "net/ip_layer.hpp"
+#include "net/network.hpp"
 
 #include "kernel_utils.hpp"
 
@@ -17,6 +18,8 @@
 
 namespace {
 
+constexpr size_t query_port = 1023; ///< The source port of the kernel queries, below the ephemeral ports of the sockets
+
 using flag_qr     = std::bit_field<uint16_t, uint8_t, 15, 1>;
 using flag_opcode = std::bit_field<uint16_t, uint8_t, 11, 4>;
 using flag_aa     = std::bit_field<uint16_t, uint8_t, 10, 1>;
@@ -85,9 +88,28 @@ std::string decode_domain(char* payload, size_t& offset) {
     return domain;
 }
 
+// Test if the name can be encoded in a question
+bool valid_name(const std::string& domain) {
+    size_t label = 0;
+
+    for (size_t i = 0; i < domain.size(); ++i) {
+        if (domain[i] == '.') {
+            if (!label) {
+                return false;
+            }
+
+            label = 0;
+        } else if (++label > 63) {
+            return false;
+        }
+    }
+
+    return label > 0;
+}
+
 } //end of anonymous namespace
 
-network::dns::layer::layer(network::udp::layer* parent) : parent(parent) {
+network::dns::layer::layer(network::udp::layer* parent) : parent(parent), dns_cache(this) {
     parent->register_dns_layer(this);
 }
 
@@ -96,7 +118,9 @@ void network::dns::layer::decode(network::interface_descriptor& /*interface*/, n
 
     auto* dns_header = reinterpret_cast<header*>(packet->payload + packet->index);
 
-    logging::logf(logging::log_level::TRACE, "dns: Start DNS packet handling\n");
+    subsystem_logf(NET, TRACE, "dns: Start DNS packet handling\n");
+
+    dns_cache.answer(*packet);
 
     auto identification = switch_endian_16(dns_header->identification);
     auto questions      = switch_endian_16(dns_header->questions);
@@ -104,21 +128,21 @@ void network::dns::layer::decode(network::interface_descriptor& /*interface*/, n
     auto authority_rrs  = switch_endian_16(dns_header->authority_rrs);
     auto additional_rrs = switch_endian_16(dns_header->additional_rrs);
 
-    logging::logf(logging::log_level::TRACE, "dns: Identification %h \n", size_t(identification));
-    logging::logf(logging::log_level::TRACE, "dns: Answers %u \n", size_t(answers));
-    logging::logf(logging::log_level::TRACE, "dns: Questions %u \n", size_t(questions));
-    logging::logf(logging::log_level::TRACE, "dns: Authorithy RRs %u \n", size_t(authority_rrs));
-    logging::logf(logging::log_level::TRACE, "dns: Additional RRs %u \n", size_t(additional_rrs));
+    subsystem_logf(NET, TRACE, "dns: Identification %h \n", size_t(identification));
+    subsystem_logf(NET, TRACE, "dns: Answers %u \n", size_t(answers));
+    subsystem_logf(NET, TRACE, "dns: Questions %u \n", size_t(questions));
+    subsystem_logf(NET, TRACE, "dns: Authorithy RRs %u \n", size_t(authority_rrs));
+    subsystem_logf(NET, TRACE, "dns: Additional RRs %u \n", size_t(additional_rrs));
 
     auto flags = switch_endian_16(dns_header->flags);
 
     if (*flag_qr(&flags) == 0) {
-        logging::logf(logging::log_level::TRACE, "dns: Query\n");
+        subsystem_logf(NET, TRACE, "dns: Query\n");
     } else {
-        auto response_code = *flag_opcode(&flags);
+        auto response_code = *flag_rcode(&flags);
 
         if (response_code == 0x0) {
-            logging::logf(logging::log_level::TRACE, "dns: Response OK\n");
+            subsystem_logf(NET, TRACE, "dns: Response OK\n");
 
             auto* payload = packet->payload + packet->index + sizeof(header);
 
@@ -136,7 +160,7 @@ void network::dns::layer::decode(network::interface_descriptor& /*interface*/, n
                 auto rr_class = switch_endian_16(*reinterpret_cast<uint16_t*>(payload));
                 payload += 2;
 
-                logging::logf(logging::log_level::TRACE, "dns: Query %u Type %u Class %u Name %s\n", i, rr_type, rr_class, domain.c_str());
+                subsystem_logf(NET, TRACE, "dns: Query %u Type %u Class %u Name %s\n", i, rr_type, rr_class, domain.c_str());
             }
 
             for (size_t i = 0; i < answers; ++i) {
@@ -153,7 +177,7 @@ void network::dns::layer::decode(network::interface_descriptor& /*interface*/, n
                     size_t ignored;
                     domain = decode_domain(packet->payload + packet->index + offset, ignored);
                 } else {
-                    logging::logf(logging::log_level::TRACE, "dns: Unable to handle non-compressed data\n");
+                    subsystem_logf(NET, TRACE, "dns: Unable to handle non-compressed data\n");
                     return;
                 }
 
@@ -173,24 +197,24 @@ void network::dns::layer::decode(network::interface_descriptor& /*interface*/, n
                     auto ip     = network::ip::ip32_to_ip(*reinterpret_cast<uint32_t*>(payload));
                     auto ip_str = network::ip::ip_to_str(ip);
 
-                    logging::logf(logging::log_level::TRACE, "dns: Answer %u Domain %s Type %u Class %u TTL %u IP: %s\n", i, domain.c_str(), rr_type, rr_class, ttl, ip_str.c_str());
+                    subsystem_logf(NET, TRACE, "dns: Answer %u Domain %s Type %u Class %u TTL %u IP: %s\n", i, domain.c_str(), rr_type, rr_class, ttl, ip_str.c_str());
                 } else {
-                    logging::logf(logging::log_level::TRACE, "dns: Answer %u Domain %s Type %u Class %u TTL %u \n", i, rr_type, rr_class, ttl, domain.c_str());
-                    logging::logf(logging::log_level::TRACE, "dns: Answer %u Unable to read data for type and class\n", i);
+                    subsystem_logf(NET, TRACE, "dns: Answer %u Domain %s Type %u Class %u TTL %u \n", i, rr_type, rr_class, ttl, domain.c_str());
+                    subsystem_logf(NET, TRACE, "dns: Answer %u Unable to read data for type and class\n", i);
                 }
 
                 payload += rd_length;
             }
         } else if (response_code == 0x1) {
-            logging::logf(logging::log_level::TRACE, "dns: Format Error\n");
+            subsystem_logf(NET, TRACE, "dns: Format Error\n");
         } else if (response_code == 0x2) {
-            logging::logf(logging::log_level::TRACE, "dns: Server Failure\n");
+            subsystem_logf(NET, TRACE, "dns: Server Failure\n");
         } else if (response_code == 0x3) {
-            logging::logf(logging::log_level::TRACE, "dns: Name Error\n");
+            subsystem_logf(NET, TRACE, "dns: Name Error\n");
         } else if (response_code == 0x4) {
-            logging::logf(logging::log_level::TRACE, "dns: Not Implemented\n");
+            subsystem_logf(NET, TRACE, "dns: Not Implemented\n");
         } else if (response_code == 0x5) {
-            logging::logf(logging::log_level::TRACE, "dns: Refused\n");
+            subsystem_logf(NET, TRACE, "dns: Refused\n");
         }
     }
 
@@ -224,3 +248,57 @@ std::expected<void> network::dns::layer::finalize_packet(network::interface_desc
 std::expected<void> network::dns::layer::finalize_packet(network::interface_descriptor& interface, network::socket& /*sock*/, network::packet_p& p) {
     return this->finalize_packet(interface, p);
 }
+
+std::expected<network::ip::address> network::dns::layer::resolve(const std::string& domain, size_t timeout_ms, size_t retries) {
+    return dns_cache.resolve(domain, timeout_ms, retries);
+}
+
+std::expected<void> network::dns::layer::send_query(const std::string& domain, uint16_t identification) {
+    if (!valid_name(domain)) {
+        return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+    }
+
+    auto server = network::dns_server();
+    auto& interface = network::select_interface(server);
+
+    // The labels replace the dots, the type and class follow the name
+    auto question_size = domain.size() + 2 + 2 * 2;
+
+    // Ask the UDP layer to craft a packet
+    network::udp::kernel_packet_descriptor desc{sizeof(header) + question_size, query_port, 53, server};
+    auto packet_e = parent->kernel_prepare_packet(interface, desc);
+
+    if (!packet_e) {
+        return std::make_unexpected<void>(packet_e.error());
+    }
+
+    auto& packet = *packet_e;
+
+    ::prepare_packet_query(*packet, identification);
+
+    auto* payload = packet->payload + packet->index;
+
+    size_t length = 0;
+    size_t i = 1;
+
+    for (size_t j = 0; j < domain.size(); ++j) {
+        if (domain[j] == '.') {
+            payload[length] = i - length - 1;
+            length = i++;
+        } else {
+            payload[i++] = domain[j];
+        }
+    }
+
+    payload[length] = i - length - 1;
+    payload[i++] = 0;
+
+    *reinterpret_cast<uint16_t*>(payload + i)     = switch_endian_16(1); // A record
+    *reinterpret_cast<uint16_t*>(payload + i + 2) = switch_endian_16(1); // IN class
+
+    return finalize_packet(interface, packet);
+}
+
+network::dns::cache& network::dns::layer::get_cache() {
+    return dns_cache;
+}
@@ -8,6 +8,8 @@
 #include "net/ethernet_layer.hpp"
 #include "net/arp_layer.hpp"
 #include "net/ip_layer.hpp"
+#include "net/capture.hpp"
+#include "net/stats.hpp"
 
 #include "logging.hpp"
 #include "kernel_utils.hpp"
@@ -78,7 +80,9 @@ void network::ethernet::mac64_to_mac6(uint64_t source_mac, char* mac){
 }
 
 void network::ethernet::layer::decode(network::interface_descriptor& interface, packet_p& packet){
-    logging::logf(logging::log_level::TRACE, "ethernet: Start decoding new packet (%p)\n", packet.get());
+    subsystem_logf(NET, TRACE, "ethernet: Start decoding new packet (%p)\n", packet.get());
+
+    network::capture::tap(interface, *packet, network::capture::direction::RX);
 
     auto* ether_header = reinterpret_cast<header*>(packet->payload);
 
@@ -91,8 +95,8 @@ void network::ethernet::layer::decode(network::interface_descriptor& interface,
     size_t source_mac = mac6_to_mac64(ether_header->source.mac);
     size_t target_mac = mac6_to_mac64(ether_header->target.mac);
 
-    logging::logf(logging::log_level::TRACE, "ethernet: Source MAC Address %h \n", source_mac);
-    logging::logf(logging::log_level::TRACE, "ethernet: Destination MAC Address %h \n", target_mac);
+    subsystem_logf(NET, TRACE, "ethernet: Source MAC Address %h \n", source_mac);
+    subsystem_logf(NET, TRACE, "ethernet: Destination MAC Address %h \n", target_mac);
 
     packet->tag(0, 0);
     packet->index = sizeof(header);
@@ -101,6 +105,8 @@ void network::ethernet::layer::decode(network::interface_descriptor& interface,
 
     switch (type) {
         case ether_type::IPV4:
+            // Counted here, a reassembled datagram is decoded again
+            stats::count(stats::get().ip.in);
             ip_layer->decode(interface, packet);
             break;
 
@@ -109,11 +115,11 @@ void network::ethernet::layer::decode(network::interface_descriptor& interface,
             break;
 
         case ether_type::IPV6:
-            logging::logf(logging::log_level::TRACE, "ethernet: IPV6 Packet (unsupported)\n");
+            subsystem_logf(NET, TRACE, "ethernet: IPV6 Packet (unsupported)\n");
             break;
 
         case ether_type::UNKNOWN:
-            logging::logf(logging::log_level::TRACE, "ethernet: Unhandled Packet Type: %u\n", uint64_t(switch_endian_16(ether_header->type)));
+            subsystem_logf(NET, TRACE, "ethernet: Unhandled Packet Type: %u\n", uint64_t(switch_endian_16(ether_header->type)));
             break;
 
         default:
@@ -121,13 +127,13 @@ void network::ethernet::layer::decode(network::interface_descriptor& interface,
             break;
     }
 
-    logging::logf(logging::log_level::TRACE, "ethernet: Finished decoding packet\n");
+    subsystem_logf(NET, TRACE, "ethernet: Finished decoding packet\n");
 }
 
 std::expected<network::packet_p> network::ethernet::layer::kernel_prepare_packet(network::interface_descriptor& interface, const packet_descriptor& descriptor){
     auto total_size = descriptor.size + sizeof(header);
 
-    auto p = std::make_shared<network::packet>(new char[total_size], total_size);
+    auto p = std::make_intrusive<network::packet>(new char[total_size], total_size);
 
     ::prepare_packet(*p, interface, descriptor);
 
@@ -137,7 +143,7 @@ std::expected<network::packet_p> network::ethernet::layer::kernel_prepare_packet
 std::expected<network::packet_p> network::ethernet::layer::user_prepare_packet(char* buffer, network::interface_descriptor& interface, const packet_descriptor* descriptor){
     auto total_size = descriptor->size + sizeof(header);
 
-    auto p = std::make_shared<network::packet>(buffer, total_size);
+    auto p = std::make_intrusive<network::packet>(buffer, total_size);
     p->user = true;
 
     ::prepare_packet(*p, interface, *descriptor);
@@ -146,18 +152,32 @@ std::expected<network::packet_p> network::ethernet::layer::user_prepare_packet(c
 }
 
 std::expected<void> network::ethernet::layer::finalize_packet(network::interface_descriptor& interface, packet_p& p){
+    auto packet = p;
+
     if(p->user){
         // The packet will be handled by a kernel thread, needs to
         // be copied to kernel memory
 
-        auto kernel_packet = std::make_shared<network::packet>(new char[p->payload_size], p->payload_size);
-        std::copy_n(p->payload, p->payload_size, kernel_packet->payload);
+        packet = std::make_intrusive<network::packet>(new char[p->payload_size], p->payload_size);
+        std::copy_n(p->payload, p->payload_size, packet->payload);
 
-        interface.send(kernel_packet);
-    } else {
-        interface.send(p);
+        packet->tags            = p->tags;
+        packet->interface       = p->interface;
+        packet->checksum_start  = p->checksum_start;
+        packet->checksum_offset = p->checksum_offset;
+        packet->neighbor        = p->neighbor;
+        packet->gso_size        = p->gso_size;
     }
 
+    packet->timestamp = stats::timestamp();
+
+    // The packet may have to wait for the MAC address of its neighbor
+    if(packet->neighbor){
+        return arp_layer->get_cache().send_pending(interface, packet);
+    }
+
+    interface.send(packet);
+
     return {};
 }
 
@@ -10,32 +10,33 @@
 #include "net/icmp_layer.hpp"
 #include "net/ip_layer.hpp"
 #include "net/network.hpp"
+#include "net/checksum.hpp"
+#include "net/stats.hpp"
 
 #include "logging.hpp"
 #include "kernel_utils.hpp"
 #include "scheduler.hpp"
+#include "timer.hpp"
 
 namespace {
 
-void compute_checksum(network::icmp::header* icmp_header, size_t payload_size){
-    icmp_header->checksum = 0;
+constexpr const uint64_t RATE_LIMIT = 1000; ///< The ICMP messages sent by the kernel per second
+constexpr const uint64_t RATE_BURST = 50;   ///< The messages that can be sent at once after a pause
+constexpr const uint8_t REPLY_TTL   = 64;   ///< The time to live of the replies
 
-    auto sum = std::accumulate(
-        reinterpret_cast<uint16_t*>(icmp_header),
-        reinterpret_cast<uint16_t*>(icmp_header) + sizeof(network::icmp::header) / 2 + payload_size * 2,
-        uint32_t(0));
+// The 16-bit word of two consecutive bytes, in the native order of the sums
+uint16_t checksum_word(uint8_t first, uint8_t second){
+    return uint16_t(first) | (uint16_t(second) << 8);
+}
 
-    uint32_t value = sum & 0xFFFF;
-    uint32_t carry = (sum - value) >> 16;
+// The length covers the header and the data of the message
+void compute_checksum(network::icmp::header* icmp_header, size_t length){
+    icmp_header->checksum = 0;
 
-    while(carry){
-        value += carry;
-        auto sub = value & 0xFFFF;
-        carry = (value - sub) >> 16;
-        value = sub;
-    }
+    // The sum is in native order, like the field
+    auto sum = network::checksum_partial(icmp_header, length);
 
-    icmp_header->checksum = ~value;
+    icmp_header->checksum = ~network::checksum_fold_partial(sum);
 }
 
 void prepare_packet(network::packet& packet, network::icmp::type t, size_t code){
@@ -53,73 +54,183 @@ void prepare_packet(network::packet& packet, network::icmp::type t, size_t code)
 
 } // end of anonymous namespace
 
-network::icmp::layer::layer(network::ip::layer* parent) : parent(parent) {
+network::icmp::layer::layer(network::ip::layer* parent) : parent(parent), tokens(RATE_BURST * 1000), refilled_ms(0) {
     parent->register_icmp_layer(this);
 }
 
+bool network::icmp::layer::rate_allow(){
+    std::lock_guard<spinlock> l(rate_lock);
+
+    auto now = timer::milliseconds();
+
+    // One message per second is one thousandth of a message per millisecond
+    tokens = std::min(tokens + (now - refilled_ms) * RATE_LIMIT, RATE_BURST * 1000);
+    refilled_ms = now;
+
+    if(tokens < 1000){
+        return false;
+    }
+
+    tokens -= 1000;
+
+    return true;
+}
+
+bool network::icmp::layer::fast_echo_reply(network::interface_descriptor& interface, network::packet_p& packet){
+    // The buffer must not be seen by anyone else, sockets included
+    if(packet->user || packet->references != 1){
+        return false;
+    }
+
+    auto ip_index = packet->tag(1);
+    auto* ip_header = reinterpret_cast<network::ip::header*>(packet->payload + ip_index);
+
+    size_t length = switch_endian_16(ip_header->total_len);
+
+    if(ip_index + length > packet->payload_size || length > interface.mtu){
+        return false;
+    }
+
+    auto* ether_header = reinterpret_cast<network::ethernet::header*>(packet->payload + packet->tag(0));
+    auto* icmp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
+
+    auto source_mac = ether_header->source;
+    ether_header->source = ether_header->target;
+    ether_header->target = source_mac;
+
+    auto source_ip = ip_header->source_ip;
+    ip_header->source_ip = ip_header->target_ip;
+    ip_header->target_ip = source_ip;
+
+    // The swap of the addresses does not change the sums, only the TTL and
+    // the type have to be accounted for
+    auto old_ip_word = checksum_word(ip_header->ttl, ip_header->protocol);
+    ip_header->ttl = REPLY_TTL;
+    ip_header->header_checksum = network::checksum_update(ip_header->header_checksum, old_ip_word, checksum_word(ip_header->ttl, ip_header->protocol));
+
+    auto old_icmp_word = checksum_word(icmp_header->type, icmp_header->code);
+    icmp_header->type = static_cast<uint8_t>(type::ECHO_REPLY);
+    icmp_header->checksum = network::checksum_update(icmp_header->checksum, old_icmp_word, checksum_word(icmp_header->type, icmp_header->code));
+
+    // The padding of the frame is not sent back
+    packet->payload_size = ip_index + length;
+    packet->index = packet->tag(0);
+
+    packet->checksum_start = 0;
+    packet->gso_size = 0;
+    packet->neighbor = 0;
+
+    stats::count(stats::get().icmp.out);
+    stats::count(stats::get().icmp_fast_replies);
+
+    auto result = parent->finalize_packet(interface, packet);
+
+    if(!result){
+        logging::logf(logging::log_level::ERROR, "icmp: Failed to reply: %s\n", std::error_message(result.error()));
+    }
+
+    return true;
+}
+
 void network::icmp::layer::decode(network::interface_descriptor& interface, network::packet_p& packet){
-    logging::logf(logging::log_level::TRACE, "icmp: Start ICMP packet handling (%p)\n", packet.get());
+    subsystem_logf(NET, TRACE, "icmp: Start ICMP packet handling (%p)\n", packet.get());
 
     packet->tag(2, packet->index);
 
+    stats::count(stats::get().icmp.in);
+
+    if(packet->index + sizeof(header) > packet->payload_size){
+        subsystem_logf(NET, DEBUG, "icmp: Truncated packet, drop packet\n");
+
+        stats::count(stats::get().icmp.errors);
+        __atomic_add_fetch(&interface.rx_errors_counter, 1, __ATOMIC_RELAXED);
+
+        return;
+    }
+
     auto* icmp_header = reinterpret_cast<header*>(packet->payload + packet->index);
 
     auto command_type = static_cast<type>(icmp_header->type);
 
     auto command_index = packet->index + sizeof(network::icmp::header) - sizeof(uint32_t);
 
+    bool echo_reply = false;
+
     switch(command_type){
         case type::ECHO_REQUEST:
             {
-                logging::logf(logging::log_level::TRACE, "icmp: received Echo Request\n");
+                subsystem_logf(NET, TRACE, "icmp: received Echo Request\n");
 
                 auto ip_index = packet->tag(1);
                 auto* ip_header = reinterpret_cast<network::ip::header*>(packet->payload + ip_index);
 
                 auto target_ip = network::ip::ip32_to_ip(ip_header->target_ip);
-                auto source_ip = network::ip::ip32_to_ip(ip_header->source_ip);
 
                 if(target_ip == interface.ip_address){
-                    logging::logf(logging::log_level::TRACE, "icmp: Reply to Echo Request for own IP\n");
-
-                    network::icmp::packet_descriptor desc{0, source_ip, type::ECHO_REPLY, 0x0};
-                    auto reply_packet_e = kernel_prepare_packet(interface, desc);
-
-                    if(reply_packet_e){
-                        auto& reply_packet = *reply_packet_e;
+                    subsystem_logf(NET, TRACE, "icmp: Reply to Echo Request for own IP\n");
 
-                        auto* command_header = reinterpret_cast<echo_request_header*>(packet->payload + command_index);
-                        auto* reply_command_header = reinterpret_cast<echo_request_header*>(reply_packet->payload + reply_packet->index);
+                    if(!rate_allow()){
+                        subsystem_logf(NET, DEBUG, "icmp: Rate limit reached, no reply\n");
 
-                        *reply_command_header = *command_header;
-
-                        finalize_packet(interface, reply_packet);
+                        stats::count(stats::get().icmp_rate_limited);
                     } else {
-                        logging::logf(logging::log_level::ERROR, "icmp: Failed to reply: %s\n", std::error_message(reply_packet_e.error()));
+                        echo_reply = true;
                     }
                 }
 
                 break;
             }
         case type::ECHO_REPLY:
-            logging::logf(logging::log_level::TRACE, "icmp: Echo Reply\n");
+            subsystem_logf(NET, TRACE, "icmp: Echo Reply\n");
             break;
         case type::UNREACHABLE:
-            logging::logf(logging::log_level::TRACE, "icmp: Unreachable\n");
+            subsystem_logf(NET, TRACE, "icmp: Unreachable\n");
+
+            // The datagram needed fragmentation, the MTU of the next hop is in the header (RFC 1191)
+            if(icmp_header->code == 4 && packet->index + sizeof(header) + sizeof(network::ip::header) <= packet->payload_size){
+                auto* original = reinterpret_cast<network::ip::header*>(packet->payload + packet->index + sizeof(header));
+                auto mtu = switch_endian_16(uint16_t(icmp_header->rest >> 16));
+
+                parent->update_path_mtu(network::ip::ip32_to_ip(original->target_ip), mtu);
+            }
+
             break;
         case type::TIME_EXCEEDED:
-            logging::logf(logging::log_level::TRACE, "icmp: Time exceeded\n");
+            subsystem_logf(NET, TRACE, "icmp: Time exceeded\n");
             break;
         default:
-            logging::logf(logging::log_level::TRACE, "icmp: Unsupported ICMP packet received (type:%u)\n", uint64_t(icmp_header->type));
+            subsystem_logf(NET, TRACE, "icmp: Unsupported ICMP packet received (type:%u)\n", uint64_t(icmp_header->type));
             break;
     }
 
-    logging::logf(logging::log_level::TRACE, "icmp: Propagate (%p)\n", packet.get());
+    subsystem_logf(NET, TRACE, "icmp: Propagate (%p)\n", packet.get());
 
     network::propagate_packet(packet, network::socket_protocol::ICMP);
 
-    logging::logf(logging::log_level::TRACE, "icmp: Finished packet handling (%p)\n", packet.get());
+    // The request is answered once the sockets have seen it, in its own
+    // buffer when nobody else holds it
+    if(echo_reply && !fast_echo_reply(interface, packet)){
+        auto* ip_header = reinterpret_cast<network::ip::header*>(packet->payload + packet->tag(1));
+
+        size_t ip_end = packet->tag(1) + switch_endian_16(ip_header->total_len);
+        size_t data_length = std::min(ip_end, packet->payload_size) - command_index;
+
+        network::icmp::packet_descriptor desc{data_length - sizeof(uint32_t), network::ip::ip32_to_ip(ip_header->source_ip), type::ECHO_REPLY, 0x0};
+        auto reply_packet_e = kernel_prepare_packet(interface, desc);
+
+        if(reply_packet_e){
+            auto& reply_packet = *reply_packet_e;
+
+            // The identifier, the sequence and the data are sent back
+            std::copy_n(packet->payload + command_index, data_length, reply_packet->payload + reply_packet->index);
+
+            finalize_packet(interface, reply_packet);
+        } else {
+            logging::logf(logging::log_level::ERROR, "icmp: Failed to reply: %s\n", std::error_message(reply_packet_e.error()));
+        }
+    }
+
+    subsystem_logf(NET, TRACE, "icmp: Finished packet handling (%p)\n", packet.get());
 }
 
 std::expected<network::packet_p> network::icmp::layer::kernel_prepare_packet(network::interface_descriptor& interface, const packet_descriptor& descriptor){
@@ -154,7 +265,9 @@ std::expected<void> network::icmp::layer::finalize_packet(network::interface_des
     auto* icmp_header = reinterpret_cast<header*>(packet->payload + packet->index);
 
     // Compute the checksum
-    compute_checksum(icmp_header, 0);
+    compute_checksum(icmp_header, packet->payload_size - packet->index);
+
+    stats::count(stats::get().icmp.out);
 
     // Give the packet to the IP layer for finalization
     return parent->finalize_packet(interface, packet);
@@ -6,6 +6,8 @@
 //=======================================================================
 
 #include <string.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
 
 #include "net/ip_layer.hpp"
 #include "net/ethernet_layer.hpp"
@@ -13,33 +15,28 @@
 #include "net/udp_layer.hpp"
 #include "net/tcp_layer.hpp"
 #include "net/arp_layer.hpp"
+#include "net/checksum.hpp"
+#include "net/stats.hpp"
 
 #include "logging.hpp"
 #include "kernel_utils.hpp"
+#include "timer.hpp"
 
 namespace {
 
-constexpr const size_t ARP_TIMEOUT = 5000;
 constexpr size_t default_ip_header_len = 20;
+constexpr size_t min_path_mtu = 576;        ///< The smallest datagram every host must accept (RFC 791)
+constexpr uint64_t path_mtu_ms = 600000;    ///< The time a lower path MTU is kept (RFC 1191)
 
 void compute_checksum(network::ip::header* header){
     auto ihl = header->version_ihl & 0xF;
 
     header->header_checksum = 0;
 
-    auto sum = std::accumulate(reinterpret_cast<uint16_t*>(header),reinterpret_cast<uint16_t*>(header) + ihl * 2, uint32_t(0));
+    // The sum is in native order, like the field
+    auto sum = network::checksum_partial(header, ihl * 4);
 
-    uint32_t value = sum & 0xFFFF;
-    uint32_t carry = (sum - value) >> 16;
-
-    while(carry){
-        value += carry;
-        auto sub = value & 0xFFFF;
-        carry = (value - sub) >> 16;
-        value = sub;
-    }
-
-    header->header_checksum = ~uint16_t(value);
+    header->header_checksum = ~network::checksum_fold_partial(sum);
 }
 
 void prepare_packet(network::packet& packet, network::interface_descriptor& interface, size_t size, network::ip::address target_ip, size_t protocol){
@@ -52,13 +49,18 @@ void prepare_packet(network::packet& packet, network::interface_descriptor& inte
     ip_header->total_len      = switch_endian_16(uint16_t(size) + default_ip_header_len);
     ip_header->identification = 0;
     ip_header->flags_offset   = 0;
-    ip_header->flags_offset   = switch_endian_16(uint16_t(1) << 14);
+    ip_header->flags_offset   = switch_endian_16(network::ip::fragment_dont);
     ip_header->ttl            = 255;
     ip_header->protocol       = protocol;
     ip_header->source_ip      = ip_to_ip32(interface.ip_address);
     ip_header->target_ip      = ip_to_ip32(target_ip);
 
-    compute_checksum(ip_header);
+    // The device may insert the checksum itself
+    if(interface.checksum_offload & network::CHECKSUM_TX_IP){
+        ip_header->header_checksum = 0;
+    } else {
+        compute_checksum(ip_header);
+    }
 
     packet.index += default_ip_header_len;
 }
@@ -94,7 +96,7 @@ network::ip::layer::layer(network::ethernet::layer* parent) : parent(parent) {
 }
 
 void network::ip::layer::decode(network::interface_descriptor& interface, network::packet_p& packet){
-    logging::logf(logging::log_level::TRACE, "ip: Start IPv4 packet handling (%p)\n", packet.get());
+    subsystem_logf(NET, TRACE, "ip: Start IPv4 packet handling (%p)\n", packet.get());
 
     packet->tag(1, packet->index);
 
@@ -105,6 +107,8 @@ void network::ip::layer::decode(network::interface_descriptor& interface, networ
     if(version != 4){
         logging::logf(logging::log_level::ERROR, "ip: IPv6 Packet received instead of IPv4\n");
 
+        stats::count(stats::get().ip.drops);
+
         return;
     }
 
@@ -112,17 +116,50 @@ void network::ip::layer::decode(network::interface_descriptor& interface, networ
     auto length              = switch_endian_16(ip_header->total_len);
     auto data_length         = length - header_length;
 
-    logging::logf(logging::log_level::TRACE, "ip: Data Length: %u\n", size_t(data_length));
-    logging::logf(logging::log_level::TRACE, "ip: Time To Live: %u\n", size_t(ip_header->ttl));
+    // The device may have verified the header already
+    if(!(packet->checksum_verified & network::CHECKSUM_RX_IP)){
+        if(network::checksum_fold_partial(network::checksum_partial(ip_header, header_length)) != 0xFFFF){
+            subsystem_logf(NET, DEBUG, "ip: Invalid header checksum, drop packet\n");
+
+            stats::count(stats::get().ip.errors);
+            stats::count(stats::get().checksum_failures);
+            __atomic_add_fetch(&interface.rx_errors_counter, 1, __ATOMIC_RELAXED);
+
+            return;
+        }
+    }
+
+    subsystem_logf(NET, TRACE, "ip: Data Length: %u\n", size_t(data_length));
+    subsystem_logf(NET, TRACE, "ip: Time To Live: %u\n", size_t(ip_header->ttl));
 
     auto source = ip32_to_ip(ip_header->source_ip);
     auto target = ip32_to_ip(ip_header->target_ip);
 
-    logging::logf(logging::log_level::TRACE, "ip: Source Protocol Address %u.%u.%u.%u \n",
+    subsystem_logf(NET, TRACE, "ip: Source Protocol Address %u.%u.%u.%u \n",
                   uint64_t(source(0)), uint64_t(source(1)), uint64_t(source(2)), uint64_t(source(3)));
-    logging::logf(logging::log_level::TRACE, "ip: Target Protocol Address %u.%u.%u.%u \n",
+    subsystem_logf(NET, TRACE, "ip: Target Protocol Address %u.%u.%u.%u \n",
                   uint64_t(target(0)), uint64_t(target(1)), uint64_t(target(2)), uint64_t(target(3)));
 
+    if(length < header_length || packet->index + length > packet->payload_size){
+        subsystem_logf(NET, DEBUG, "ip: Invalid length, drop packet\n");
+
+        stats::count(stats::get().ip.errors);
+        __atomic_add_fetch(&interface.rx_errors_counter, 1, __ATOMIC_RELAXED);
+
+        return;
+    }
+
+    // A fragment waits for the rest of its datagram
+    if(switch_endian_16(ip_header->flags_offset) & (fragment_more | fragment_mask)){
+        auto datagram = reassembly.add_fragment(interface, *packet);
+
+        if(datagram){
+            decode(interface, datagram);
+        }
+
+        return;
+    }
+
     auto protocol = ip_header->protocol;
 
     packet->index += header_length;
@@ -135,77 +172,259 @@ void network::ip::layer::decode(network::interface_descriptor& interface, networ
         udp_layer->decode(interface, packet);
     } else {
         logging::logf(logging::log_level::ERROR, "ip: Packet of unknown protocol detected (%h)\n", size_t(protocol));
+
+        stats::count(stats::get().ip.drops);
     }
 }
 
 std::expected<network::packet_p> network::ip::layer::kernel_prepare_packet(network::interface_descriptor& interface, const packet_descriptor& descriptor){
-    auto target_mac = get_target_mac(interface, descriptor.destination);
-
-    if(!target_mac){
-        return std::make_expected_from_error<network::packet_p>(target_mac.error());
-    }
+    uint64_t target_mac = 0;
+    auto neighbor = get_target_mac(interface, descriptor.destination, target_mac);
 
     // Ask the ethernet layer to craft a packet
-    network::ethernet::packet_descriptor desc{descriptor.size + default_ip_header_len, *target_mac, ethernet::ether_type::IPV4};
+    network::ethernet::packet_descriptor desc{descriptor.size + default_ip_header_len, target_mac, ethernet::ether_type::IPV4};
     auto packet = parent->kernel_prepare_packet(interface, desc);
 
     if(packet){
         ::prepare_packet(**packet, interface, descriptor.size, descriptor.destination, descriptor.protocol);
+
+        // The target MAC address is set once the neighbor answers
+        (*packet)->neighbor = neighbor.raw_address;
     }
 
     return packet;
 }
 
 std::expected<network::packet_p> network::ip::layer::user_prepare_packet(char* buffer, network::interface_descriptor& interface, const packet_descriptor* descriptor){
-    auto target_mac = get_target_mac(interface, descriptor->destination);
-
-    if(!target_mac){
-        return std::make_expected_from_error<network::packet_p>(target_mac.error());
-    }
+    uint64_t target_mac = 0;
+    auto neighbor = get_target_mac(interface, descriptor->destination, target_mac);
 
     // Ask the ethernet layer to craft a packet
-    network::ethernet::packet_descriptor desc{descriptor->size + default_ip_header_len, *target_mac, ethernet::ether_type::IPV4};
+    network::ethernet::packet_descriptor desc{descriptor->size + default_ip_header_len, target_mac, ethernet::ether_type::IPV4};
     auto packet = parent->user_prepare_packet(buffer, interface, &desc);
 
     if(packet){
         ::prepare_packet(**packet, interface, descriptor->size, descriptor->destination, descriptor->protocol);
+
+        // The target MAC address is set once the neighbor answers
+        (*packet)->neighbor = neighbor.raw_address;
     }
 
     return packet;
 }
 
 std::expected<void> network::ip::layer::finalize_packet(network::interface_descriptor& interface, network::packet_p& p){
+    stats::count(stats::get().ip.out);
+
+    // The packets of the loopback never reach the link
+    if(interface.is_loopback()){
+        return deliver_local(interface, p);
+    }
+
+    auto* ip_header = reinterpret_cast<header*>(p->payload + p->tag(1));
+
+    auto mtu = path_mtu(interface, ip32_to_ip(ip_header->target_ip));
+
+    // A large TCP packet is cut into segments instead
+    if(switch_endian_16(ip_header->total_len) > mtu && !p->gso_size){
+        return fragment(interface, p, mtu);
+    }
+
     // Send the packet to the ethernet layer
     return parent->finalize_packet(interface, p);
 }
 
-std::expected<uint64_t> network::ip::layer::get_target_mac(network::interface_descriptor& interface, network::ip::address target_ip){
-    // Handle broadcast
-    if(target_ip == network::ip::make_address(255, 255, 255, 255)){
-        return 0xFFFFFFFFFFFF;
+std::expected<void> network::ip::layer::fragment(network::interface_descriptor& interface, network::packet_p& p, size_t mtu){
+    auto* ip_header = reinterpret_cast<header*>(p->payload + p->tag(1));
+
+    size_t header_length = (ip_header->version_ihl & 0xF) * 4;
+    size_t data_length = switch_endian_16(ip_header->total_len) - header_length;
+    auto* data = p->payload + p->tag(1) + header_length;
+
+    // The device can not complete a checksum spread over several fragments
+    if(p->checksum_start){
+        network::checksum_complete(p->payload, p->payload_size, p->checksum_start, p->checksum_offset);
+        p->checksum_start = 0;
+    }
+
+    auto* ether_header = reinterpret_cast<network::ethernet::header*>(p->payload + p->tag(0));
+    auto target_mac = network::ethernet::mac6_to_mac64(ether_header->target.mac);
+
+    // The offsets are in units of 8 bytes
+    auto chunk = ((mtu - header_length) / 8) * 8;
+
+    auto id = switch_endian_16(__atomic_add_fetch(&identification, 1, __ATOMIC_RELAXED));
+
+    subsystem_logf(NET, TRACE, "ip: Fragment %u bytes, mtu:%u\n", data_length, mtu);
+
+    for(size_t offset = 0; offset < data_length; offset += chunk){
+        auto bytes = std::min(chunk, data_length - offset);
+
+        network::ethernet::packet_descriptor desc{header_length + bytes, target_mac, ethernet::ether_type::IPV4};
+        auto packet_e = parent->kernel_prepare_packet(interface, desc);
+
+        if(!packet_e){
+            return std::make_unexpected<void>(packet_e.error());
+        }
+
+        auto& packet = *packet_e;
+
+        packet->tag(1, packet->index);
+
+        // The options are copied in all the fragments, the stack never sets any
+        auto* fragment_header = reinterpret_cast<header*>(packet->payload + packet->index);
+        std::copy_n(reinterpret_cast<const char*>(ip_header), header_length, reinterpret_cast<char*>(fragment_header));
+        std::copy_n(data + offset, bytes, packet->payload + packet->index + header_length);
+
+        uint16_t flags_offset = offset / 8;
+
+        if(offset + bytes < data_length){
+            flags_offset |= fragment_more;
+        }
+
+        fragment_header->total_len      = switch_endian_16(uint16_t(header_length + bytes));
+        fragment_header->flags_offset   = switch_endian_16(flags_offset);
+        fragment_header->identification = id;
+
+        if(interface.checksum_offload & network::CHECKSUM_TX_IP){
+            fragment_header->header_checksum = 0;
+        } else {
+            compute_checksum(fragment_header);
+        }
+
+        // The fragments wait for the same neighbor
+        packet->neighbor = p->neighbor;
+
+        auto result = parent->finalize_packet(interface, packet);
+
+        if(!result){
+            return result;
+        }
     }
 
-    // For loopback, there is no gateway
+    return {};
+}
+
+std::expected<void> network::ip::layer::deliver_local(network::interface_descriptor& interface, network::packet_p& p){
+    auto packet = p;
+
+    // The packet may be kept by the receiver after the call returns
+    if(p->user){
+        packet = std::make_intrusive<network::packet>(new char[p->payload_size], p->payload_size);
+        std::copy_n(p->payload, p->payload_size, packet->payload);
+
+        packet->tags      = p->tags;
+        packet->interface = p->interface;
+    }
+
+    size_t length = switch_endian_16(reinterpret_cast<header*>(packet->payload + packet->tag(1))->total_len);
+
+    interface.tx_packets_counter.add(1);
+    interface.tx_bytes_counter.add(length);
+    interface.rx_packets_counter.add(1);
+    interface.rx_bytes_counter.add(length);
+
+    // The packet never leaves the memory, the checksums are not needed
+    packet->checksum_verified = network::CHECKSUM_RX_IP | network::CHECKSUM_RX_L4;
+    packet->index = packet->tag(1);
+    packet->timestamp = stats::timestamp();
+
+    stats::count(stats::get().ip.in);
+
+    subsystem_logf(NET, TRACE, "ip: Deliver %u bytes locally\n", length);
+
+    decode(interface, packet);
+
+    return {};
+}
+
+size_t network::ip::layer::path_mtu(network::interface_descriptor& interface, network::ip::address target){
+    auto mtu = interface.mtu;
+
+    std::lock_guard<spinlock> l(path_mtus_lock);
+
+    for(auto& entry : path_mtus){
+        if(entry.mtu && entry.target == target){
+            // The larger MTU is tried again from time to time
+            if(timer::milliseconds() >= entry.expires){
+                entry.mtu = 0;
+            } else {
+                mtu = std::min(mtu, entry.mtu);
+            }
+
+            break;
+        }
+    }
+
+    return mtu;
+}
+
+void network::ip::layer::update_path_mtu(network::ip::address target, size_t mtu){
+    // The old routers do not give the MTU of the next hop
+    if(!mtu){
+        mtu = min_path_mtu;
+    }
+
+    mtu = std::max(mtu, min_path_mtu);
+
+    subsystem_logf(NET, DEBUG, "ip: Path MTU to %u.%u.%u.%u is %u\n", target(0), target(1), target(2), target(3), mtu);
+
+    std::lock_guard<spinlock> l(path_mtus_lock);
+
+    path_mtu_entry* slot = nullptr;
+
+    for(auto& entry : path_mtus){
+        if(entry.mtu && entry.target == target){
+            slot = &entry;
+            break;
+        }
+
+        // Replace a free entry, or else the one expiring first
+        if(!slot || (slot->mtu && (!entry.mtu || entry.expires < slot->expires))){
+            slot = &entry;
+        }
+    }
+
+    // The MTU only grows again once the entry expires
+    if(slot->mtu && slot->target == target){
+        mtu = std::min(mtu, slot->mtu);
+    }
+
+    slot->target = target;
+    slot->mtu = mtu;
+    slot->expires = timer::milliseconds() + path_mtu_ms;
+}
+
+network::ip::address network::ip::layer::get_target_mac(network::interface_descriptor& interface, network::ip::address target_ip, uint64_t& mac){
+    // The loopback has no link header to fill
     if(interface.is_loopback()){
-        return arp_layer->get_cache().get_mac_force(interface, target_ip, ARP_TIMEOUT);
+        mac = 0;
+        return {};
+    }
+
+    // Handle broadcast
+    if(target_ip == network::ip::make_address(255, 255, 255, 255)){
+        mac = 0xFFFFFFFFFFFF;
+        return {};
     }
 
     auto& interface_ip = interface.ip_address;
 
-    // At this point, we have no gateway, neither IP
-    if(interface_ip == network::ip::make_address(0, 0, 0, 0)){
-        return arp_layer->get_cache().get_mac_force(interface, target_ip, ARP_TIMEOUT);
-    }
+    // The hosts of the same network are reached directly, as well as all
+    // the hosts for loopback or without IP, the others through the gateway
+    auto neighbor = interface.gateway;
 
-    // If it is the same network, use ARP to get the MAC address
-    if(network::ip::same_network(interface_ip, target_ip)){
-        return arp_layer->get_cache().get_mac_force(interface, target_ip, ARP_TIMEOUT);
+    if(interface.is_loopback() || interface_ip == network::ip::make_address(0, 0, 0, 0) || network::ip::same_network(interface_ip, target_ip)){
+        neighbor = target_ip;
     }
 
-    // If it is another network, use the gateway
+    if(arp_layer->get_cache().lookup(interface, neighbor, mac)){
+        return {};
+    }
 
-    return arp_layer->get_cache().get_mac_force(interface, interface.gateway, ARP_TIMEOUT);
+    return neighbor;
 }
+
 void network::ip::layer::register_icmp_layer(network::icmp::layer* layer){
     this->icmp_layer = layer;
 }
@@ -0,0 +1,354 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <lock_guard.hpp>
+#include <algorithms.hpp>
+
+#include "net/ip_reassembly.hpp"
+#include "net/ip_layer.hpp"
+#include "net/checksum.hpp"
+
+#include "logging.hpp"
+#include "kernel_utils.hpp"
+#include "timer.hpp"
+
+namespace {
+
+constexpr uint64_t timeout_ms    = 30000; ///< The time to receive all the fragments of a datagram
+constexpr uint64_t aging_ms      = 1000;  ///< The time between two aging passes
+constexpr size_t max_datagram    = 65535; ///< The maximum size of an IP datagram
+constexpr size_t growth          = 8192;  ///< The granularity of the payload buffers
+
+size_t hash(network::ip::address source, network::ip::address target, uint16_t identification, uint8_t protocol){
+    auto h = source.raw_address ^ target.raw_address ^ identification ^ (uint32_t(protocol) << 16);
+    h ^= h >> 16;
+    return (h ^ (h >> 8)) % network::ip::reassembly_cache::buckets;
+}
+
+size_t hash(const network::ip::header* header){
+    return hash(network::ip::ip32_to_ip(header->source_ip), network::ip::ip32_to_ip(header->target_ip), header->identification, header->protocol);
+}
+
+bool matches(const network::ip::reassembly_entry* entry, const network::ip::header* header){
+    return entry->source == network::ip::ip32_to_ip(header->source_ip)
+        && entry->target == network::ip::ip32_to_ip(header->target_ip)
+        && entry->identification == header->identification
+        && entry->protocol == header->protocol;
+}
+
+// Add a range to the received ranges, returns false if it overlaps another
+// one or if there are too many holes. A duplicate is ignored.
+bool add_range(network::ip::reassembly_entry& entry, size_t start, size_t end, bool& duplicate){
+    auto& ranges = entry.ranges;
+    auto& count = entry.ranges_count;
+
+    duplicate = false;
+
+    for(size_t i = 0; i < count; ++i){
+        if(start >= ranges[i].start && end <= ranges[i].end){
+            duplicate = true;
+            return true;
+        }
+
+        if(start < ranges[i].end && end > ranges[i].start){
+            return false;
+        }
+    }
+
+    // The ranges are sorted and never overlap
+    size_t i = 0;
+    while(i < count && ranges[i].start < start){
+        ++i;
+    }
+
+    bool with_previous = i > 0 && ranges[i - 1].end == start;
+    bool with_next = i < count && ranges[i].start == end;
+
+    if(with_previous && with_next){
+        ranges[i - 1].end = ranges[i].end;
+
+        for(size_t j = i; j + 1 < count; ++j){
+            ranges[j] = ranges[j + 1];
+        }
+
+        --count;
+    } else if(with_previous){
+        ranges[i - 1].end = end;
+    } else if(with_next){
+        ranges[i].start = start;
+    } else {
+        if(count == network::ip::reassembly_entry::max_ranges){
+            return false;
+        }
+
+        for(size_t j = count; j > i; --j){
+            ranges[j] = ranges[j - 1];
+        }
+
+        ranges[i] = {start, end};
+        ++count;
+    }
+
+    return true;
+}
+
+} //end of anonymous namespace
+
+network::ip::reassembly_cache::reassembly_cache(){
+    for(size_t i = 0; i < buckets; ++i){
+        table[i] = nullptr;
+    }
+}
+
+network::ip::reassembly_cache::~reassembly_cache(){
+    for(size_t i = 0; i < buckets; ++i){
+        while(table[i]){
+            remove(table[i]);
+        }
+    }
+}
+
+network::ip::reassembly_entry* network::ip::reassembly_cache::find(const network::ip::header* header){
+    for(auto* entry = table[hash(header)]; entry; entry = entry->next){
+        if(matches(entry, header)){
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+network::ip::reassembly_entry* network::ip::reassembly_cache::insert(const network::ip::header* header){
+    if(entries == max_entries){
+        subsystem_logf(NET, DEBUG, "ip: Too many datagrams being reassembled\n");
+        return nullptr;
+    }
+
+    auto* entry = new reassembly_entry();
+
+    entry->source         = network::ip::ip32_to_ip(header->source_ip);
+    entry->target         = network::ip::ip32_to_ip(header->target_ip);
+    entry->identification = header->identification;
+    entry->protocol       = header->protocol;
+    entry->expires        = timer::milliseconds() + timeout_ms;
+
+    auto& head = table[hash(header)];
+    entry->next = head;
+    head = entry;
+
+    ++entries;
+
+    return entry;
+}
+
+void network::ip::reassembly_cache::remove(reassembly_entry* entry){
+    auto* link = &table[hash(entry->source, entry->target, entry->identification, entry->protocol)];
+
+    while(*link != entry){
+        link = &(*link)->next;
+    }
+
+    *link = entry->next;
+
+    used_memory -= entry->capacity;
+    --entries;
+
+    delete entry;
+}
+
+void network::ip::reassembly_cache::age(uint64_t now){
+    if(now < last_aging + aging_ms){
+        return;
+    }
+
+    last_aging = now;
+
+    for(size_t i = 0; i < buckets; ++i){
+        auto* entry = table[i];
+
+        while(entry){
+            auto* next = entry->next;
+
+            if(now >= entry->expires){
+                subsystem_logf(NET, DEBUG, "ip: Reassembly timeout, drop %u bytes\n", entry->received);
+
+                remove(entry);
+            }
+
+            entry = next;
+        }
+    }
+}
+
+// Make room for the payload of the datagram, the oldest other datagrams are
+// dropped if the memory is exhausted
+bool network::ip::reassembly_cache::reserve(reassembly_entry* entry, size_t size){
+    if(size <= entry->capacity){
+        return true;
+    }
+
+    auto capacity = std::min(((size + growth - 1) / growth) * growth, max_datagram);
+
+    while(used_memory + capacity - entry->capacity > max_memory){
+        reassembly_entry* oldest = nullptr;
+
+        for(size_t i = 0; i < buckets; ++i){
+            for(auto* e = table[i]; e; e = e->next){
+                if(e != entry && (!oldest || e->expires < oldest->expires)){
+                    oldest = e;
+                }
+            }
+        }
+
+        if(!oldest){
+            return false;
+        }
+
+        subsystem_logf(NET, DEBUG, "ip: Reassembly memory exhausted, drop %u bytes\n", oldest->received);
+
+        remove(oldest);
+    }
+
+    auto* data = new char[capacity];
+
+    if(entry->capacity){
+        std::copy_n(entry->data.get(), entry->capacity, data);
+    }
+
+    entry->data.reset(data);
+
+    used_memory += capacity - entry->capacity;
+    entry->capacity = capacity;
+
+    return true;
+}
+
+network::packet_p network::ip::reassembly_cache::make_datagram(network::interface_descriptor& interface, reassembly_entry* entry){
+    auto headers = entry->link_length + entry->header_length;
+    auto size = headers + entry->total;
+
+    auto datagram = std::make_intrusive<network::packet>(new char[size], size);
+
+    std::copy_n(entry->header, headers, datagram->payload);
+    std::copy_n(entry->data.get(), entry->total, datagram->payload + headers);
+
+    datagram->interface = interface.id;
+    datagram->index = entry->link_length;
+    datagram->tag(0, 0);
+
+    auto* ip_header = reinterpret_cast<network::ip::header*>(datagram->payload + entry->link_length);
+
+    ip_header->total_len = switch_endian_16(uint16_t(entry->header_length + entry->total));
+    ip_header->flags_offset = 0;
+    ip_header->header_checksum = 0;
+    ip_header->header_checksum = ~network::checksum_fold_partial(network::checksum_partial(ip_header, entry->header_length));
+
+    // The transport checksum is verified over the whole datagram
+    datagram->checksum_verified = network::CHECKSUM_RX_IP;
+
+    return datagram;
+}
+
+network::packet_p network::ip::reassembly_cache::add_fragment(network::interface_descriptor& interface, const network::packet& fragment){
+    auto link_length = fragment.tag(1);
+
+    auto* ip_header = reinterpret_cast<const network::ip::header*>(fragment.payload + link_length);
+
+    auto header_length = (ip_header->version_ihl & 0xF) * 4;
+    auto length = switch_endian_16(ip_header->total_len);
+    auto flags_offset = switch_endian_16(ip_header->flags_offset);
+
+    auto start = size_t(flags_offset & fragment_mask) * 8;
+    auto end = start + length - header_length;
+    bool last = !(flags_offset & fragment_more);
+
+    // Only the last fragment can have a length that is not a multiple of 8
+    if(length < header_length || link_length + length > fragment.payload_size || end == start || (!last && (end - start) % 8)){
+        subsystem_logf(NET, DEBUG, "ip: Invalid fragment\n");
+        return {};
+    }
+
+    if(header_length + end > max_datagram || link_length + header_length > reassembly_entry::max_header){
+        subsystem_logf(NET, DEBUG, "ip: Oversized fragmented datagram\n");
+        return {};
+    }
+
+    std::lock_guard<spinlock> l(lock);
+
+    age(timer::milliseconds());
+
+    auto* entry = find(ip_header);
+
+    if(!entry){
+        entry = insert(ip_header);
+
+        if(!entry){
+            return {};
+        }
+    }
+
+    // The last fragment gives the length of the datagram
+    if((last && entry->total && entry->total != end) || (entry->total && end > entry->total)){
+        subsystem_logf(NET, DEBUG, "ip: Inconsistent fragments, drop datagram\n");
+        remove(entry);
+        return {};
+    }
+
+    bool duplicate;
+    if(!add_range(*entry, start, end, duplicate)){
+        subsystem_logf(NET, DEBUG, "ip: Overlapping fragments, drop datagram\n");
+        remove(entry);
+        return {};
+    }
+
+    if(duplicate){
+        return {};
+    }
+
+    if(!reserve(entry, end)){
+        remove(entry);
+        return {};
+    }
+
+    std::copy_n(fragment.payload + link_length + header_length, end - start, entry->data.get() + start);
+
+    entry->received += end - start;
+
+    if(last){
+        entry->total = end;
+    }
+
+    // The headers of the datagram are the ones of the first fragment
+    if(!start){
+        std::copy_n(fragment.payload, link_length + header_length, entry->header);
+
+        entry->link_length = link_length;
+        entry->header_length = header_length;
+    }
+
+    if(!entry->total || entry->received != entry->total || !entry->header_length){
+        return {};
+    }
+
+    auto datagram = make_datagram(interface, entry);
+
+    remove(entry);
+
+    return datagram;
+}
+
+size_t network::ip::reassembly_cache::size() const {
+    std::lock_guard<spinlock> l(lock);
+
+    return entries;
+}
+
+size_t network::ip::reassembly_cache::memory() const {
+    std::lock_guard<spinlock> l(lock);
+
+    return used_memory;
+}
@@ -0,0 +1,81 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+#include <string.hpp>
+
+#include "net/memory.hpp"
+
+#include "fs/sysfs.hpp"
+
+#include "physical_allocator.hpp"
+#include "logging.hpp"
+
+namespace {
+
+constexpr size_t min_limit = 1024 * 1024; ///< The smallest global limit
+constexpr size_t memory_share = 8;        ///< The fraction of the available memory the sockets can hold
+
+size_t limit_bytes = min_limit; ///< The maximum number of bytes held by the sockets
+size_t used_bytes = 0;          ///< The number of bytes held by the sockets
+size_t dropped = 0;             ///< The number of packets dropped over a budget
+
+uint64_t sysfs_used(){
+    return network::memory::used();
+}
+
+uint64_t sysfs_limit(){
+    return limit_bytes;
+}
+
+uint64_t sysfs_dropped(){
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+} //end of anonymous namespace
+
+void network::memory::init(){
+    limit_bytes = std::max(physical_allocator::available() / memory_share, min_limit);
+
+    logging::logf(logging::log_level::TRACE, "network: Socket memory limit: %m\n", limit_bytes);
+}
+
+void network::memory::finalize(){
+    sysfs::set_counter_value(path("/sys"), path("/net/memory/used"), &sysfs_used);
+    sysfs::set_counter_value(path("/sys"), path("/net/memory/limit"), &sysfs_limit);
+    sysfs::set_counter_value(path("/sys"), path("/net/memory/dropped"), &sysfs_dropped);
+}
+
+bool network::memory::charge(size_t bytes){
+    // The limit is never exceeded, a concurrent charge may fail while this one is undone
+    if(__atomic_add_fetch(&used_bytes, bytes, __ATOMIC_RELAXED) > limit_bytes){
+        __atomic_sub_fetch(&used_bytes, bytes, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    return true;
+}
+
+void network::memory::force_charge(size_t bytes){
+    __atomic_add_fetch(&used_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+void network::memory::release(size_t bytes){
+    __atomic_sub_fetch(&used_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+void network::memory::drop(){
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+}
+
+size_t network::memory::used(){
+    return __atomic_load_n(&used_bytes, __ATOMIC_RELAXED);
+}
+
+size_t network::memory::limit(){
+    return limit_bytes;
+}
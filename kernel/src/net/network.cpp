@@ -9,6 +9,7 @@
 #include <string.hpp>
 #include <atomic.hpp>
 #include <bit_field.hpp>
+#include <algorithms.hpp>
 
 #include "net/network.hpp"
 #include "net/ethernet_layer.hpp"
@@ -18,17 +19,29 @@
 #include "net/dns_layer.hpp"
 #include "net/udp_layer.hpp"
 #include "net/tcp_layer.hpp"
+#include "net/capture.hpp"
+#include "net/memory.hpp"
+#include "net/user_buffers.hpp"
+#include "net/stats.hpp"
 
 #include "drivers/rtl8139.hpp"
+#include "drivers/virtio_net.hpp"
+#include "drivers/e1000.hpp"
 #include "drivers/pci.hpp"
 #include "drivers/loopback.hpp"
 
 #include "physical_allocator.hpp"
+#include "physical_pointer.hpp"
+#include "page_cache.hpp"
+#include "paging.hpp"
 #include "scheduler.hpp"
 #include "logging.hpp"
 #include "kernel_utils.hpp"
+#include "poll.hpp"
+#include "timer.hpp"
 
 #include "fs/sysfs.hpp"
+#include "vfs/vfs.hpp"
 
 #include "tlib/errors.hpp"
 
@@ -60,6 +73,61 @@ network::dns::layer* dns_layer;
 network::dhcp::layer* dhcp_layer;
 network::tcp::layer* tcp_layer;
 
+constexpr const size_t POLL_BUDGET = 64; ///< The maximum number of packets received by a poll pass
+
+// The bucket of a value in the tx histograms: 0, 1, 2-3, 4-7, ...
+size_t histogram_bucket(size_t value){
+    size_t bucket = 0;
+
+    while(value && bucket + 1 < network::TX_HISTOGRAM){
+        value >>= 1;
+        ++bucket;
+    }
+
+    return bucket;
+}
+
+void transmit(network::interface_descriptor& interface, network::packet_p& packet){
+    // The frames are captured as they are given to the driver
+    network::capture::tap(interface, *packet, network::capture::direction::TX);
+
+    network::stats::transmitted(*packet);
+
+    interface.hw_send(interface, packet);
+
+    ++interface.tx_packets_counter;
+    interface.tx_bytes_counter += packet->payload_size;
+}
+
+void process_packet(network::interface_descriptor& interface, network::packet_p& packet){
+    ethernet_layer->decode(interface, packet);
+
+    ++interface.rx_packets_counter;
+    interface.rx_bytes_counter += packet->payload_size;
+}
+
+// Poll the device until it is empty, the reception interrupt stays masked
+// by the driver in the meantime
+void poll_device(network::interface_descriptor& interface){
+    while(true){
+        ++interface.rx_polls_counter;
+
+        auto received = interface.hw_poll(interface, POLL_BUDGET);
+
+        network::packet_p packet;
+        while(interface.rx_queue.pop(packet)){
+            process_packet(interface, packet);
+        }
+
+        if(received < POLL_BUDGET){
+            break;
+        }
+
+        // Let the other processes run between two full passes
+        scheduler::yield();
+    }
+}
+
 void rx_thread(void* data){
     auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
 
@@ -67,20 +135,27 @@ void rx_thread(void* data){
 
     interface.rx_sem.claim();
 
-    logging::logf(logging::log_level::TRACE, "network: RX Thread for interface %u started (pid:%u)\n", interface.id, pid);
+    subsystem_logf(NET, TRACE, "network: RX Thread for interface %u started (pid:%u)\n", interface.id, pid);
 
     while(true){
         interface.rx_sem.wait();
 
-        //TODO This is highly unsafe since back() and pop_back() can suffer interleaving
+        // The device is polled without a notification per packet
+        if(interface.poll_scheduled){
+            interface.poll_scheduled = false;
+
+            poll_device(interface);
 
-        auto packet = interface.rx_queue.top();
-        interface.rx_queue.pop();
+            continue;
+        }
 
-        ethernet_layer->decode(interface, packet);
+        // The other notifications follow a push in one of the queues
+        network::packet_p packet;
+        if(!interface.rx_queue.pop(packet) && !interface.rx_local_queue.pop(packet)){
+            continue;
+        }
 
-        ++interface.rx_packets_counter;
-        interface.rx_bytes_counter += packet->payload_size;
+        process_packet(interface, packet);
     }
 }
 
@@ -89,40 +164,139 @@ void tx_thread(void* data){
 
     auto pid = scheduler::get_pid();
 
-    logging::logf(logging::log_level::TRACE, "network: TX Thread for interface %u started (pid:%u)\n", interface.id, pid);
+    subsystem_logf(NET, TRACE, "network: TX Thread for interface %u started (pid:%u)\n", interface.id, pid);
 
     while(true){
         interface.tx_sem.lock();
 
-        auto packet = interface.tx_queue.top();
-        interface.tx_queue.pop();
-        interface.hw_send(interface, packet);
+        ++interface.tx_depth_histogram[histogram_bucket(interface.tx_queue.size())];
 
-        thor_assert(!packet->user);
+        // Drain the queue, the device is only notified once per batch
+        size_t batch = 0;
+
+        network::packet_p packet;
+        while(batch < network::TX_BATCH && interface.tx_queue.pop(packet)){
+            // The semaphore counts the queued packets. The count of a packet
+            // not taken here (not released yet) only causes an empty wake up.
+            if(batch++){
+                interface.tx_sem.try_lock();
+            }
+
+            thor_assert(!packet->user);
+
+            // The large TCP packets are only cut at the boundary of the driver
+            if(packet->gso_size && !interface.segmentation_offload){
+                for(auto& segment : network::tcp::segment(interface, *packet)){
+                    transmit(interface, segment);
+                }
+            } else {
+                transmit(interface, packet);
+            }
+        }
+
+        if(!batch){
+            continue;
+        }
+
+        if(interface.hw_flush){
+            interface.hw_flush(interface);
+        }
 
-        ++interface.tx_packets_counter;
-        interface.tx_bytes_counter += packet->payload_size;
+        ++interface.tx_batch_histogram[histogram_bucket(batch)];
     }
 }
 
-std::string sysfs_rx_packets(void* data){
+uint64_t sysfs_rx_packets(void* data){
     auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
-    return std::to_string(interface.rx_packets_counter);
+    return interface.rx_packets_counter.value();
 }
 
-std::string sysfs_rx_bytes(void* data){
+uint64_t sysfs_rx_bytes(void* data){
     auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
-    return std::to_string(interface.rx_bytes_counter);
+    return interface.rx_bytes_counter.value();
 }
 
-std::string sysfs_tx_packets(void* data){
+uint64_t sysfs_tx_packets(void* data){
     auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
-    return std::to_string(interface.tx_packets_counter);
+    return interface.tx_packets_counter.value();
 }
 
-std::string sysfs_tx_bytes(void* data){
+uint64_t sysfs_tx_bytes(void* data){
     auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
-    return std::to_string(interface.tx_bytes_counter);
+    return interface.tx_bytes_counter.value();
+}
+
+std::string format_histogram(const size_t* histogram){
+    std::string value;
+
+    for(size_t i = 0; i < network::TX_HISTOGRAM; ++i){
+        if(i){
+            value += ' ';
+        }
+
+        value += std::to_string(i ? size_t(1) << (i - 1) : 0);
+        value += ':';
+        value += std::to_string(histogram[i]);
+    }
+
+    return value;
+}
+
+std::string sysfs_tx_depth_histogram(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return format_histogram(interface.tx_depth_histogram);
+}
+
+std::string sysfs_tx_batch_histogram(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return format_histogram(interface.tx_batch_histogram);
+}
+
+uint64_t sysfs_rx_interrupts(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return interface.rx_interrupts_counter;
+}
+
+uint64_t sysfs_rx_polls(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return interface.rx_polls_counter;
+}
+
+uint64_t sysfs_rx_packets_per_interrupt(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    auto interrupts = interface.rx_interrupts_counter;
+    return interrupts ? interface.rx_packets_counter.value() / interrupts : 0;
+}
+
+uint64_t sysfs_rx_dropped(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return interface.rx_dropped_counter;
+}
+
+uint64_t sysfs_rx_errors(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return interface.rx_errors_counter;
+}
+
+uint64_t sysfs_tx_dropped(void* data){
+    auto& interface = *reinterpret_cast<network::interface_descriptor*>(data);
+    return interface.tx_dropped_counter;
+}
+
+std::string sysfs_dns_cache(){
+    return dns_layer->get_cache().view();
+}
+
+uint64_t sysfs_dns_hits(){
+    return dns_layer->get_cache().hits;
+}
+
+uint64_t sysfs_dns_misses(){
+    return dns_layer->get_cache().misses;
+}
+
+uint64_t sysfs_dns_coalesced(){
+    return dns_layer->get_cache().coalesced;
 }
 
 void sysfs_publish(network::interface_descriptor& interface){
@@ -147,10 +321,18 @@ void sysfs_publish(network::interface_descriptor& interface){
             sysfs::set_constant_value(path("/sys"), p / "gateway", gateway_addr);
         }
 
-        sysfs::set_dynamic_value_data(path("/sys"), p / "rx_packets", sysfs_rx_packets, &interface);
-        sysfs::set_dynamic_value_data(path("/sys"), p / "rx_bytes", sysfs_rx_bytes, &interface);
-        sysfs::set_dynamic_value_data(path("/sys"), p / "tx_packets", sysfs_tx_packets, &interface);
-        sysfs::set_dynamic_value_data(path("/sys"), p / "tx_bytes", sysfs_tx_bytes, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_packets", sysfs_rx_packets, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_bytes", sysfs_rx_bytes, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "tx_packets", sysfs_tx_packets, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "tx_bytes", sysfs_tx_bytes, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_dropped", sysfs_rx_dropped, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_errors", sysfs_rx_errors, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_interrupts", sysfs_rx_interrupts, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_polls", sysfs_rx_polls, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "rx_packets_per_interrupt", sysfs_rx_packets_per_interrupt, &interface);
+        sysfs::set_counter_value_data(path("/sys"), p / "tx_dropped", sysfs_tx_dropped, &interface);
+        sysfs::set_dynamic_value_data(path("/sys"), p / "tx_depth_histogram", sysfs_tx_depth_histogram, &interface);
+        sysfs::set_dynamic_value_data(path("/sys"), p / "tx_batch_histogram", sysfs_tx_batch_histogram, &interface);
     }
 }
 
@@ -181,30 +363,163 @@ network::socket_protocol stream_protocol(network::socket_protocol protocol){
     }
 }
 
+/*!
+ * \brief The DHCP lease of an interface
+ */
+struct dhcp_lease {
+    bool bound = false;                     ///< Indicates if the interface holds a lease
+    network::dhcp::dhcp_configuration conf; ///< The lease, with its times relative to bound_ms
+    uint64_t bound_ms = 0;                  ///< The time of the acknowledge of the lease, in milliseconds
+    uint64_t next_ms = 0;                   ///< The time of the next renewal attempt, in milliseconds
+};
+
+constexpr const uint64_t DHCP_RETRY_MS = 60 * 1000; ///< The minimum delay between two renewal attempts
+
+std::vector<dhcp_lease> leases; ///< The lease of each interface
+
+void configure(network::interface_descriptor& interface, const network::dhcp::dhcp_configuration& conf) {
+    interface.ip_address = conf.ip_address;
+
+    subsystem_logf(NET, TRACE, "network: interface %u acquired IP %h by DHCP\n", interface.id, size_t(interface.ip_address.raw_address));
+
+    if (conf.gateway) {
+        interface.gateway = conf.gateway_address;
+        subsystem_logf(NET, TRACE, "network: interface %u acquired gateway %h by DHCP\n", interface.id, size_t(interface.gateway.raw_address));
+    } else {
+        interface.gateway = network::ip::make_address(10, 0, 2, 2);
+    }
+
+    if (conf.dns) {
+        dns_address = conf.dns_address;
+        subsystem_logf(NET, TRACE, "network: acquired DNS %h by DHCP\n", size_t(dns_address.raw_address));
+    } else {
+        dns_address = network::ip::make_address(10, 0, 2, 2);
+    }
+
+    sysfs_publish(interface);
+}
+
+/*!
+ * \brief Use a lease acknowledged by a server and save it for the next boot
+ */
+void bind(network::interface_descriptor& interface, const network::dhcp::dhcp_configuration& conf) {
+    auto& lease = leases[interface.id];
+
+    lease.bound    = true;
+    lease.conf     = conf;
+    lease.bound_ms = timer::milliseconds();
+    lease.next_ms  = lease.bound_ms + uint64_t(conf.renewal_time) * 1000;
+
+    configure(interface, conf);
+
+    network::dhcp::save_lease(interface, conf);
+}
+
+/*!
+ * \brief Schedule the next attempt halfway to the given limit, as advised
+ * by the RFC 2131, but not sooner than DHCP_RETRY_MS
+ */
+void retry(dhcp_lease& lease, uint64_t now, uint64_t limit) {
+    lease.next_ms = now + std::max((limit > now ? limit - now : 0) / 2, DHCP_RETRY_MS);
+}
+
+/*!
+ * \brief Renew the leases of the interfaces in the background, at their
+ * T1 and T2 times
+ */
+void dhcp_task() {
+    while (true) {
+        auto now  = timer::milliseconds();
+        auto next = ~uint64_t(0);
+
+        for (auto& interface : interfaces) {
+            auto& lease = leases[interface.id];
+
+            if (!lease.bound) {
+                continue;
+            }
+
+            if (now >= lease.next_ms) {
+                auto elapsed   = now - lease.bound_ms;
+                auto expiry    = lease.bound_ms + uint64_t(lease.conf.lease_time) * 1000;
+                auto rebinding = lease.bound_ms + uint64_t(lease.conf.rebinding_time) * 1000;
+
+                std::expected<network::dhcp::dhcp_configuration> conf;
+
+                if (elapsed >= uint64_t(lease.conf.lease_time) * 1000) {
+                    // The lease expired, the address must be requested again
+                    conf = dhcp_layer->request_ip(interface);
+                } else {
+                    conf = dhcp_layer->renew(interface, lease.conf, now >= rebinding);
+                }
+
+                if (conf) {
+                    bind(interface, *conf);
+                } else if (conf.error() == std::ERROR_INVALID_REQUEST) {
+                    // The server refused the address, start again
+                    lease.bound_ms = now;
+                    lease.conf.lease_time = 0;
+                    lease.next_ms = now;
+                } else {
+                    retry(lease, now, now >= rebinding ? expiry : rebinding);
+                }
+            }
+
+            next = std::min(next, lease.next_ms);
+        }
+
+        now = timer::milliseconds();
+
+        if (next > now) {
+            scheduler::sleep_ms(std::min(next - now, DHCP_RETRY_MS));
+        }
+    }
+}
+
 void network_discovery() {
+    leases.resize(interfaces.size());
+
+    bool dhcp = false;
+
     for (auto& interface : interfaces) {
         if (interface.enabled) {
             if (!interface.is_loopback()) {
-                auto ip = dhcp_layer->request_ip(interface);
+                // The lease of the previous boot is on the root file system
+                vfs::wait_root();
 
-                if (ip) {
-                    interface.ip_address = ip->ip_address;
+                auto saved = network::dhcp::load_lease(interface);
 
-                    logging::logf(logging::log_level::TRACE, "network: interface %u acquired IP %h by DHCP\n", interface.id, size_t(interface.ip_address.raw_address));
+                std::expected<network::dhcp::dhcp_configuration> ip;
 
-                    if (ip->gateway) {
-                        interface.gateway = ip->ip_address;
-                        logging::logf(logging::log_level::TRACE, "network: interface %u acquired gateway %h by DHCP\n", interface.id, size_t(interface.gateway.raw_address));
-                    } else {
-                        interface.gateway    = network::ip::make_address(10, 0, 2, 2);
-                    }
+                if (saved) {
+                    // The previous address is used right away, until the server answers
+                    configure(interface, *saved);
+
+                    ip = dhcp_layer->reboot(interface, *saved);
 
-                    if (ip->dns) {
-                        dns_address = ip->dns_address;
-                        logging::logf(logging::log_level::TRACE, "network: acquired DNS %h by DHCP\n", size_t(interface.gateway.raw_address));
-                    } else {
-                        dns_address = network::ip::make_address(10, 0, 2, 2);
+                    if (!ip && ip.error() == std::ERROR_TIMEOUT) {
+                        // Without a server, the lease is valid until its expiry
+                        auto& lease = leases[interface.id];
+
+                        lease.bound    = true;
+                        lease.conf     = *saved;
+                        lease.bound_ms = timer::milliseconds();
+                        lease.next_ms  = lease.bound_ms + uint64_t(saved->renewal_time) * 1000;
+
+                        dhcp = true;
+
+                        continue;
                     }
+                }
+
+                if (!ip) {
+                    ip = dhcp_layer->request_ip(interface);
+                }
+
+                if (ip) {
+                    bind(interface, *ip);
+
+                    dhcp = true;
                 } else {
                     // Defaults for Qemu (better than nothing)
                     interface.ip_address = network::ip::make_address(10, 0, 2, 15);
@@ -217,6 +532,121 @@ void network_discovery() {
 
         sysfs_publish(interface);
     }
+
+    // The leases are renewed in the background
+    if (dhcp) {
+        auto& process = scheduler::create_kernel_task("dhcp", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &dhcp_task);
+
+        process.ppid     = 1;
+        process.priority = scheduler::DEFAULT_PRIORITY;
+
+        scheduler::queue_system_process(process.pid);
+    }
+}
+
+// A non-blocking socket reports that the call would block instead of a timeout
+std::expected<size_t> would_block(const network::socket& socket, std::expected<size_t> result){
+    if(socket.non_blocking && !result && result.error() == std::ERROR_SOCKET_TIMEOUT){
+        return std::make_unexpected<size_t>(std::ERROR_WOULD_BLOCK);
+    }
+
+    return result;
+}
+
+size_t socket_events(const void* object){
+    auto& socket = *static_cast<const network::socket*>(object);
+
+    if(socket.protocol == network::socket_protocol::TCP){
+        if(!socket.connection_data){
+            return 0;
+        }
+
+        auto& connection = socket.get_connection_data<network::tcp::tcp_connection>();
+
+        size_t events = 0;
+
+        // The data received before the end of the connection can still be read
+        if(connection.receive.size){
+            events |= poll::POLL_IN;
+        }
+
+        // A server is readable once a connection can be accepted
+        if(connection.server && !connection.backlog.accept_queue.empty()){
+            events |= poll::POLL_IN;
+        }
+
+        if(connection.connected){
+            events |= poll::POLL_OUT;
+        } else {
+            events |= poll::POLL_HUP;
+        }
+
+        return events;
+    }
+
+    size_t events = poll::POLL_OUT;
+
+    if(!socket.listen_packets.empty()){
+        events |= poll::POLL_IN;
+    }
+
+    return events;
+}
+
+// The bytes of the sockets are accounted to the process using them
+std::expected<void> sent(std::expected<void> result, size_t n){
+    if(result){
+        scheduler::account_socket(0, n);
+    }
+
+    return result;
+}
+
+std::expected<size_t> received(std::expected<size_t> result){
+    if(result){
+        scheduler::account_socket(*result, 0);
+    }
+
+    return result;
+}
+
+// Fill the messages after the first one with the datagrams already received
+size_t receive_pending(network::socket_fd_t socket_fd, network::message* messages, size_t n){
+    size_t received = 1;
+
+    for(; received < n; ++received){
+        auto& message = messages[received];
+
+        auto status = network::receive_from(socket_fd, message.buffer, message.length, 0, &message.address);
+
+        if(!status){
+            break;
+        }
+
+        message.received = *status;
+    }
+
+    return received;
+}
+
+// Let the layer of the socket prepare a packet into the given buffer
+std::expected<network::packet_p> user_prepare_packet(network::socket& socket, void* desc, char* buffer){
+    switch (socket.protocol) {
+        case network::socket_protocol::ICMP:
+            return icmp_layer->user_prepare_packet(buffer, socket, static_cast<network::icmp::packet_descriptor*>(desc));
+
+        case network::socket_protocol::UDP:
+            return udp_layer->user_prepare_packet(buffer, socket, static_cast<network::udp::packet_descriptor*>(desc));
+
+        case network::socket_protocol::TCP:
+            return tcp_layer->user_prepare_packet(buffer, socket, static_cast<network::tcp::packet_descriptor*>(desc));
+
+        case network::socket_protocol::DNS:
+            return dns_layer->user_prepare_packet(buffer, socket, static_cast<network::dns::packet_descriptor*>(desc));
+
+        default:
+            return std::make_unexpected<network::packet_p>(std::ERROR_SOCKET_UNIMPLEMENTED);
+    }
 }
 
 } //end of anonymous namespace
@@ -241,6 +671,12 @@ void network::init(){
                 interface.driver = "rtl8139";
 
                 rtl8139::init_driver(interface, pci_device);
+            } else if(virtio_net::is_virtio_net(pci_device)){
+                interface.driver = "virtio_net";
+                interface.enabled = virtio_net::init_driver(interface, pci_device);
+            } else if(e1000::is_e1000(pci_device)){
+                interface.driver = "e1000";
+                interface.enabled = e1000::init_driver(interface, pci_device);
             }
 
             // No IP address by default
@@ -277,6 +713,10 @@ void network::init(){
                 loopback::finalize_driver(interface);
             } else if(interface.driver == "rtl8139"){
                 rtl8139::finalize_driver(interface);
+            } else if(interface.driver == "virtio_net"){
+                virtio_net::finalize_driver(interface);
+            } else if(interface.driver == "e1000"){
+                e1000::finalize_driver(interface);
             }
         }
     }
@@ -296,6 +736,9 @@ void network::init(){
     dhcp_layer = new network::dhcp::layer(udp_layer);
 
     tcp_layer = new network::tcp::layer(ip_layer);
+
+    network::capture::init();
+    network::memory::init();
 }
 
 void network::finalize(){
@@ -328,7 +771,15 @@ void network::finalize(){
         }
     }
 
-    scheduler::queue_async_init_task(network_discovery);
+    sysfs::set_dynamic_value(path("/sys"), path("/net/dns/cache"), &sysfs_dns_cache);
+    sysfs::set_counter_value(path("/sys"), path("/net/dns/hits"), &sysfs_dns_hits);
+    sysfs::set_counter_value(path("/sys"), path("/net/dns/misses"), &sysfs_dns_misses);
+    sysfs::set_counter_value(path("/sys"), path("/net/dns/coalesced"), &sysfs_dns_coalesced);
+
+    network::memory::finalize();
+
+    // DHCP only needs the interfaces, it does not delay the other tasks
+    scheduler::queue_async_init_task("network", network_discovery);
 }
 
 size_t network::number_of_interfaces(){
@@ -390,10 +841,38 @@ std::expected<network::socket_fd_t> network::open(network::socket_domain domain,
 
 void network::close(size_t fd){
     if(scheduler::has_socket(fd)){
+        poll::forget(poll::poll_target::SOCKET, fd);
+
+        auto& socket = scheduler::get_socket(fd);
+
+        // A bound datagram socket gives back its port
+        if(socket.type == socket_type::DGRAM && socket.connection_data && datagram_protocol(socket.protocol) == socket_protocol::UDP){
+            udp_layer->client_unbind(socket);
+        }
+
+        socket.release_packets();
+
+        if(socket.buffers){
+            unmap_user_buffers(socket.buffers);
+            socket.buffers = nullptr;
+        }
+
         scheduler::release_socket(fd);
     }
 }
 
+std::expected<poll::source*> network::poll_source(socket_fd_t socket_fd){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<poll::source*>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    socket.poll_source.init(&socket_events, &socket);
+
+    return &socket.poll_source;
+}
+
 std::tuple<size_t, size_t> network::prepare_packet(socket_fd_t socket_fd, void* desc, char* buffer){
     if(!scheduler::has_socket(socket_fd)){
         return {-std::ERROR_SOCKET_INVALID_FD, 0};
@@ -405,48 +884,94 @@ std::tuple<size_t, size_t> network::prepare_packet(socket_fd_t socket_fd, void*
 
     auto& socket = scheduler::get_socket(socket_fd);
 
-    auto return_from_packet = [&socket](std::expected<network::packet_p>& packet) -> std::tuple<size_t, size_t> {
-        if (packet) {
-            auto fd = socket.register_packet(*packet);
+    auto packet = user_prepare_packet(socket, desc, buffer);
 
-            return {fd, (*packet)->index};
-        } else {
-            return {-packet.error(), 0};
-        }
-    };
+    if (!packet) {
+        return {-packet.error(), 0};
+    }
 
-    switch (socket.protocol) {
-        case network::socket_protocol::ICMP: {
-            auto descriptor = static_cast<network::icmp::packet_descriptor*>(desc);
-            auto packet     = icmp_layer->user_prepare_packet(buffer, socket, descriptor);
+    // The prepared packets are only released once finalized by the user
+    if (!socket.can_prepare((*packet)->payload_size)) {
+        return {-std::ERROR_SOCKET_BUFFER_FULL, 0};
+    }
 
-            return return_from_packet(packet);
-        }
+    auto fd = socket.register_packet(*packet);
 
-        case network::socket_protocol::UDP: {
-            auto descriptor = static_cast<network::udp::packet_descriptor*>(desc);
-            auto packet     = udp_layer->user_prepare_packet(buffer, socket, descriptor);
+    return {fd, (*packet)->index};
+}
 
-            return return_from_packet(packet);
-        }
+std::tuple<size_t, size_t, size_t> network::prepare_mapped_packet(socket_fd_t socket_fd, void* desc){
+    if(!scheduler::has_socket(socket_fd)){
+        return {-std::ERROR_SOCKET_INVALID_FD, 0, 0};
+    }
 
-        case network::socket_protocol::TCP: {
-            auto descriptor = static_cast<network::tcp::packet_descriptor*>(desc);
-            auto packet     = tcp_layer->user_prepare_packet(buffer, socket, descriptor);
+    if(!network::number_of_interfaces()){
+        return {-std::ERROR_SOCKET_NO_INTERFACE, 0, 0};
+    }
 
-            return return_from_packet(packet);
-        }
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    if(!socket.buffers){
+        return {-std::ERROR_INVALID_REQUEST, 0, 0};
+    }
+
+    // The buffer stays reserved until the stack releases the packet
+    auto mapped = socket.buffers->allocate(PACKET_BUFFER_SIZE);
+
+    if(!mapped){
+        return {-std::ERROR_SOCKET_BUFFER_FULL, 0, 0};
+    }
+
+    auto packet = user_prepare_packet(socket, desc, mapped->payload);
 
-        case network::socket_protocol::DNS: {
-            auto descriptor = static_cast<network::dns::packet_descriptor*>(desc);
-            auto packet     = dns_layer->user_prepare_packet(buffer, socket, descriptor);
+    if (!packet) {
+        return {-packet.error(), 0, 0};
+    }
+
+    auto& prepared = **packet;
+
+    if (prepared.payload_size > PACKET_BUFFER_SIZE) {
+        return {-std::ERROR_BUFFER_SMALL, 0, 0};
+    }
+
+    if (!socket.can_prepare(prepared.payload_size)) {
+        return {-std::ERROR_SOCKET_BUFFER_FULL, 0, 0};
+    }
 
-            return return_from_packet(packet);
+    // The layers built the packet in the mapped buffer, the packet of the
+    // pool takes its place and is a kernel packet, never copied
+    mapped->payload_size    = prepared.payload_size;
+    mapped->index           = prepared.index;
+    mapped->tags            = prepared.tags;
+    mapped->interface       = prepared.interface;
+    mapped->checksum_start  = prepared.checksum_start;
+    mapped->checksum_offset = prepared.checksum_offset;
+    mapped->neighbor        = prepared.neighbor;
+    mapped->gso_size        = prepared.gso_size;
+
+    auto fd = socket.register_packet(mapped);
+
+    return {fd, mapped->index, socket.buffers->user_payload(*mapped)};
+}
+
+std::expected<size_t> network::map_packet_buffers(socket_fd_t socket_fd){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    if(!socket.buffers){
+        auto buffers = map_user_buffers();
+
+        if(!buffers){
+            return std::make_unexpected<size_t>(buffers.error());
         }
 
-        default:
-            return {-std::ERROR_SOCKET_UNIMPLEMENTED, 0};
+        socket.buffers = *buffers;
     }
+
+    return socket.buffers->user_address;
 }
 
 std::expected<void> network::send(socket_fd_t socket_fd, const char* buffer, size_t n, char* target_buffer){
@@ -462,10 +987,10 @@ std::expected<void> network::send(socket_fd_t socket_fd, const char* buffer, siz
 
     switch (socket.protocol) {
         case network::socket_protocol::TCP:
-            return tcp_layer->send(target_buffer, socket, buffer, n);
+            return sent(tcp_layer->send(target_buffer, socket, buffer, n), n);
 
         case network::socket_protocol::UDP:
-            return udp_layer->send(target_buffer, socket, buffer, n);
+            return sent(udp_layer->send(target_buffer, socket, buffer, n), n);
 
         default:
             return std::make_unexpected<void>(std::ERROR_SOCKET_UNIMPLEMENTED);
@@ -485,13 +1010,135 @@ std::expected<void> network::send_to(socket_fd_t socket_fd, const char* buffer,
 
     switch (socket.protocol) {
         case network::socket_protocol::UDP:
-            return udp_layer->send_to(target_buffer, socket, buffer, n, address);
+            return sent(udp_layer->send_to(target_buffer, socket, buffer, n, address), n);
 
         default:
             return std::make_unexpected<void>(std::ERROR_SOCKET_UNIMPLEMENTED);
     }
 }
 
+std::expected<size_t> network::send_to_batch(socket_fd_t socket_fd, network::message* messages, size_t n, char* target_buffer){
+    if(!n || n > network::MAX_MESSAGES){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    size_t sent = 0;
+
+    for(; sent < n; ++sent){
+        auto& message = messages[sent];
+
+        auto status = network::send_to(socket_fd, message.buffer, message.length, target_buffer, &message.address);
+
+        if(!status){
+            // The messages already sent are reported, the error is for the next call
+            if(!sent){
+                return std::make_unexpected<size_t>(status.error());
+            }
+
+            break;
+        }
+    }
+
+    return sent;
+}
+
+std::expected<void> network::sendv(socket_fd_t socket_fd, const vfs::iovec* vectors, size_t n){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    if(!network::number_of_interfaces()){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_NO_INTERFACE);
+    }
+
+    if(n > vfs::MAX_IOVECS){
+        return std::make_unexpected<void>(std::ERROR_INVALID_COUNT);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    size_t bytes = 0;
+    for(size_t i = 0; i < n; ++i){
+        bytes += vectors[i].length;
+    }
+
+    switch (socket.protocol) {
+        case network::socket_protocol::TCP:
+            return sent(tcp_layer->kernel_sendv(socket, vectors, n), bytes);
+
+        default:
+            return std::make_unexpected<void>(std::ERROR_SOCKET_UNIMPLEMENTED);
+    }
+}
+
+std::expected<size_t> network::sendfile(socket_fd_t socket_fd, size_t file_fd, size_t offset, size_t count){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    if(!network::number_of_interfaces()){
+        return std::make_unexpected<size_t>(std::ERROR_SOCKET_NO_INTERFACE);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    if(socket.protocol != network::socket_protocol::TCP){
+        return std::make_unexpected<size_t>(std::ERROR_SOCKET_UNIMPLEMENTED);
+    }
+
+    page_cache::source source;
+    auto status = vfs::cache_source(file_fd, source);
+
+    if(!status){
+        return std::make_unexpected<size_t>(status.error());
+    }
+
+    if(offset > source.size){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_OFFSET);
+    }
+
+    count = std::min(count, source.size - offset);
+
+    size_t sent = 0;
+
+    // The segments are filled from the cached pages, without user copy
+    while(sent < count){
+        auto page = (offset + sent) / paging::PAGE_SIZE;
+        auto page_offset = (offset + sent) % paging::PAGE_SIZE;
+        auto bytes = std::min(paging::PAGE_SIZE - page_offset, count - sent);
+
+        auto physical = page_cache::get(source, page);
+
+        if(!physical){
+            return std::make_unexpected<size_t>(std::ERROR_FAILED);
+        }
+
+        std::expected<void> result;
+
+        {
+            physical_pointer page_ptr(physical, 1);
+
+            if(page_ptr){
+                result = tcp_layer->kernel_send(socket, page_ptr.as_ptr<char>() + page_offset, bytes);
+            } else {
+                result = std::make_unexpected<void>(std::ERROR_FAILED);
+            }
+        }
+
+        physical_allocator::release(physical, 1);
+
+        if(!result){
+            return std::make_unexpected<size_t>(result.error());
+        }
+
+        sent += bytes;
+    }
+
+    scheduler::account_socket(0, sent);
+
+    return sent;
+}
+
 std::expected<size_t> network::receive(socket_fd_t socket_fd, char* buffer, size_t n){
     if(!scheduler::has_socket(socket_fd)){
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_FD);
@@ -507,12 +1154,16 @@ std::expected<size_t> network::receive(socket_fd_t socket_fd, char* buffer, size
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_LISTEN);
     }
 
+    if(socket.non_blocking){
+        return network::receive(socket_fd, buffer, n, 0);
+    }
+
     switch (socket.protocol) {
         case network::socket_protocol::UDP:
-            return udp_layer->receive(buffer, socket, n);
+            return received(udp_layer->receive(buffer, socket, n));
 
         case network::socket_protocol::TCP:
-            return tcp_layer->receive(buffer, socket, n);
+            return received(tcp_layer->receive(buffer, socket, n));
 
         default:
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_UNIMPLEMENTED);
@@ -534,12 +1185,16 @@ std::expected<size_t> network::receive(socket_fd_t socket_fd, char* buffer, size
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_LISTEN);
     }
 
+    if(socket.non_blocking){
+        ms = 0;
+    }
+
     switch (socket.protocol) {
         case network::socket_protocol::UDP:
-            return udp_layer->receive(buffer, socket, n, ms);
+            return received(would_block(socket, udp_layer->receive(buffer, socket, n, ms)));
 
         case network::socket_protocol::TCP:
-            return tcp_layer->receive(buffer, socket, n, ms);
+            return received(would_block(socket, tcp_layer->receive(buffer, socket, n, ms)));
 
         default:
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_UNIMPLEMENTED);
@@ -561,9 +1216,13 @@ std::expected<size_t> network::receive_from(socket_fd_t socket_fd, char* buffer,
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_LISTEN);
     }
 
+    if(socket.non_blocking){
+        return network::receive_from(socket_fd, buffer, n, 0, address);
+    }
+
     switch (socket.protocol) {
         case network::socket_protocol::UDP:
-            return udp_layer->receive_from(buffer, socket, n, address);
+            return received(udp_layer->receive_from(buffer, socket, n, address));
 
         default:
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_UNIMPLEMENTED);
@@ -585,15 +1244,55 @@ std::expected<size_t> network::receive_from(socket_fd_t socket_fd, char* buffer,
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_LISTEN);
     }
 
+    if(socket.non_blocking){
+        ms = 0;
+    }
+
     switch (socket.protocol) {
         case network::socket_protocol::UDP:
-            return udp_layer->receive_from(buffer, socket, n, ms, address);
+            return received(would_block(socket, udp_layer->receive_from(buffer, socket, n, ms, address)));
 
         default:
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_UNIMPLEMENTED);
     }
 }
 
+std::expected<size_t> network::receive_from_batch(socket_fd_t socket_fd, network::message* messages, size_t n){
+    if(!n || n > network::MAX_MESSAGES){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    auto& first = messages[0];
+
+    auto status = network::receive_from(socket_fd, first.buffer, first.length, &first.address);
+
+    if(!status){
+        return std::make_unexpected<size_t>(status.error());
+    }
+
+    first.received = *status;
+
+    return receive_pending(socket_fd, messages, n);
+}
+
+std::expected<size_t> network::receive_from_batch(socket_fd_t socket_fd, network::message* messages, size_t n, size_t ms){
+    if(!n || n > network::MAX_MESSAGES){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    auto& first = messages[0];
+
+    auto status = network::receive_from(socket_fd, first.buffer, first.length, ms, &first.address);
+
+    if(!status){
+        return std::make_unexpected<size_t>(status.error());
+    }
+
+    first.received = *status;
+
+    return receive_pending(socket_fd, messages, n);
+}
+
 std::expected<void> network::finalize_packet(socket_fd_t socket_fd, size_t packet_fd){
     if(!scheduler::has_socket(socket_fd)){
         return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_FD);
@@ -646,6 +1345,60 @@ std::expected<void> network::listen(socket_fd_t socket_fd, bool listen){
     return std::make_expected();
 }
 
+std::expected<void> network::set_non_blocking(socket_fd_t socket_fd, bool non_blocking){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    socket.non_blocking = non_blocking;
+
+    return std::make_expected();
+}
+
+std::expected<void> network::set_buffer_size(socket_fd_t socket_fd, socket_buffer buffer, size_t size){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    size = std::min(std::max(size, MIN_SOCKET_BUFFER), MAX_SOCKET_BUFFER);
+
+    switch(buffer){
+        case socket_buffer::SEND:
+            socket.send_buffer = size;
+            return std::make_expected();
+
+        case socket_buffer::RECEIVE:
+            socket.receive_buffer = size;
+            return std::make_expected();
+
+        default:
+            return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+    }
+}
+
+std::expected<size_t> network::get_buffer_size(socket_fd_t socket_fd, socket_buffer buffer){
+    if(!scheduler::has_socket(socket_fd)){
+        return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_FD);
+    }
+
+    auto& socket = scheduler::get_socket(socket_fd);
+
+    switch(buffer){
+        case socket_buffer::SEND:
+            return std::make_expected<size_t>(socket.send_buffer);
+
+        case socket_buffer::RECEIVE:
+            return std::make_expected<size_t>(socket.receive_buffer);
+
+        default:
+            return std::make_unexpected<size_t>(std::ERROR_INVALID_REQUEST);
+    }
+}
+
 std::expected<size_t> network::client_bind(socket_fd_t socket_fd, network::ip::address address){
     if(!scheduler::has_socket(socket_fd)){
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_FD);
@@ -749,7 +1502,7 @@ std::expected<void> network::client_unbind(socket_fd_t socket_fd){
         return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_TYPE);
     }
 
-    logging::logf(logging::log_level::TRACE, "network: %u disconnect from datagram socket %u\n", scheduler::get_pid(), socket_fd);
+    subsystem_logf(NET, TRACE, "network: %u disconnect from datagram socket %u\n", scheduler::get_pid(), socket_fd);
 
     switch(datagram_protocol(socket.protocol)){
         case network::socket_protocol::UDP:
@@ -780,11 +1533,15 @@ std::expected<size_t> network::connect(socket_fd_t socket_fd, network::ip::addre
     }
 }
 
-std::expected<void> network::server_start(socket_fd_t socket_fd, network::ip::address server, size_t port){
+std::expected<void> network::server_start(socket_fd_t socket_fd, network::ip::address server, size_t port, size_t backlog){
     if(!scheduler::has_socket(socket_fd)){
         return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_FD);
     }
 
+    if(!backlog || backlog > network::MAX_BACKLOG){
+        return std::make_unexpected<void>(std::ERROR_INVALID_COUNT);
+    }
+
     auto& socket = scheduler::get_socket(socket_fd);
 
     if(socket.type != socket_type::STREAM){
@@ -793,7 +1550,7 @@ std::expected<void> network::server_start(socket_fd_t socket_fd, network::ip::ad
 
     switch(stream_protocol(socket.protocol)){
         case socket_protocol::TCP:
-            return tcp_layer->server_start(socket, port, server);
+            return tcp_layer->server_start(socket, port, server, backlog);
 
         default:
             return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_TYPE_PROTOCOL);
@@ -811,6 +1568,10 @@ std::expected<size_t> network::accept(socket_fd_t socket_fd){
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_TYPE);
     }
 
+    if(socket.non_blocking){
+        return network::accept(socket_fd, 0);
+    }
+
     switch(stream_protocol(socket.protocol)){
         case socket_protocol::TCP:
             return tcp_layer->accept(socket);
@@ -831,15 +1592,23 @@ std::expected<size_t> network::accept(socket_fd_t socket_fd, size_t ms){
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_TYPE);
     }
 
+    if(socket.non_blocking){
+        ms = 0;
+    }
+
     switch(stream_protocol(socket.protocol)){
         case socket_protocol::TCP:
-            return tcp_layer->accept(socket, ms);
+            return would_block(socket, tcp_layer->accept(socket, ms));
 
         default:
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_INVALID_TYPE_PROTOCOL);
     }
 }
 
+std::string network::format_tcp_connections(){
+    return tcp_layer->format_connections();
+}
+
 std::expected<void> network::disconnect(socket_fd_t socket_fd){
     if(!scheduler::has_socket(socket_fd)){
         return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_FD);
@@ -851,7 +1620,7 @@ std::expected<void> network::disconnect(socket_fd_t socket_fd){
         return std::make_unexpected<void>(std::ERROR_SOCKET_INVALID_TYPE);
     }
 
-    logging::logf(logging::log_level::TRACE, "network: %u disconnect from stream socket %u\n", scheduler::get_pid(), socket_fd);
+    subsystem_logf(NET, TRACE, "network: %u disconnect from stream socket %u\n", scheduler::get_pid(), socket_fd);
 
     switch(datagram_protocol(socket.protocol)){
         case network::socket_protocol::TCP:
@@ -873,18 +1642,21 @@ std::expected<size_t> network::wait_for_packet(char* buffer, socket_fd_t socket_
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_LISTEN);
     }
 
-    logging::logf(logging::log_level::TRACE, "network: %u wait for packet on socket %u\n", scheduler::get_pid(), socket_fd);
+    if(socket.non_blocking){
+        return network::wait_for_packet(buffer, socket_fd, 0);
+    }
+
+    subsystem_logf(NET, TRACE, "network: %u wait for packet on socket %u\n", scheduler::get_pid(), socket_fd);
 
     if(socket.listen_packets.empty()){
         socket.listen_queue.wait();
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    auto packet = socket.dequeue_packet();
 
     std::copy_n(packet->payload, packet->payload_size, buffer);
 
-    logging::logf(logging::log_level::TRACE, "network: %u received packet on socket %u\n", scheduler::get_pid(), socket_fd);
+    subsystem_logf(NET, TRACE, "network: %u received packet on socket %u\n", scheduler::get_pid(), socket_fd);
 
     return {packet->index};
 }
@@ -900,9 +1672,13 @@ std::expected<size_t> network::wait_for_packet(char* buffer, socket_fd_t socket_
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_LISTEN);
     }
 
-    logging::logf(logging::log_level::TRACE, "network: %u wait for packet on socket (with timeout) %u\n", scheduler::get_pid(), socket_fd);
+    subsystem_logf(NET, TRACE, "network: %u wait for packet on socket (with timeout) %u\n", scheduler::get_pid(), socket_fd);
 
     if(socket.listen_packets.empty()){
+        if(socket.non_blocking){
+            return std::make_unexpected<size_t>(std::ERROR_WOULD_BLOCK);
+        }
+
         if(!ms){
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
         }
@@ -912,12 +1688,11 @@ std::expected<size_t> network::wait_for_packet(char* buffer, socket_fd_t socket_
         }
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    auto packet = socket.dequeue_packet();
 
     std::copy_n(packet->payload, packet->payload_size, buffer);
 
-    logging::logf(logging::log_level::TRACE, "network: %u received packet on socket %u\n", scheduler::get_pid(), socket_fd);
+    subsystem_logf(NET, TRACE, "network: %u received packet on socket %u\n", scheduler::get_pid(), socket_fd);
 
     return {packet->index};
 }
@@ -925,7 +1700,7 @@ std::expected<size_t> network::wait_for_packet(char* buffer, socket_fd_t socket_
 void network::propagate_packet(const packet_p& packet, socket_protocol protocol){
     // TODO Need something better for this
 
-    for(size_t pid = 0; pid < scheduler::MAX_PROCESS; ++pid){
+    for(size_t pid = 0; pid < scheduler::process_slots(); ++pid){
         auto state = scheduler::get_process_state(pid);
         if(state != scheduler::process_state::EMPTY && state != scheduler::process_state::NEW && state != scheduler::process_state::KILLED){
             for(auto& socket : scheduler::get_sockets(pid)){
@@ -940,8 +1715,7 @@ void network::propagate_packet(const packet_p& packet, socket_protocol protocol)
                     // Note: Stream and datagram sockets are responsible for propagation
 
                     if (propagate) {
-                        socket.listen_packets.push(packet);
-                        socket.listen_queue.notify_one();
+                        socket.queue_packet(packet);
                     }
                 }
             }
@@ -952,3 +1726,11 @@ void network::propagate_packet(const packet_p& packet, socket_protocol protocol)
 network::ip::address network::dns_server(){
     return dns_address;
 }
+
+std::expected<network::ip::address> network::resolve(const char* domain, size_t timeout_ms, size_t retries){
+    return dns_layer->resolve(domain, timeout_ms, retries);
+}
+
+void network::flush_dns_cache(){
+    dns_layer->get_cache().flush();
+}
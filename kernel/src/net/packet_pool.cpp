@@ -0,0 +1,143 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <types.hpp>
+#include <new.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include "net/packet_pool.hpp"
+
+namespace {
+
+constexpr size_t slot_size(){
+    return (sizeof(network::packet) + 15) & ~size_t(15);
+}
+
+} //end of anonymous namespace
+
+void network::intrusive_ptr_release(packet* p){
+    if(!__atomic_sub_fetch(&p->references, 1, __ATOMIC_ACQ_REL)){
+        auto* pool = p->pool;
+
+        if(pool){
+            auto slot = p->slot;
+
+            // The buffer belongs to the slot
+            p->payload = nullptr;
+            p->~packet();
+
+            pool->release(slot);
+        } else {
+            delete p;
+        }
+    }
+}
+
+void network::packet_pool::init(size_t packets){
+    init(packets, new char[packets * PACKET_BUFFER_SIZE]);
+
+    owned = true;
+}
+
+void network::packet_pool::init(size_t packets, char* storage){
+    slots = new char[packets * slot_size()];
+    buffers = storage;
+    owned = false;
+    free_slots = new size_t[packets];
+    capacity = packets;
+
+    for(size_t i = 0; i < packets; ++i){
+        free_slots[i] = i;
+    }
+
+    free_count = packets;
+}
+
+void network::packet_pool::destroy(){
+    delete[] slots;
+    delete[] free_slots;
+
+    if(owned){
+        delete[] buffers;
+    }
+
+    slots = nullptr;
+    buffers = nullptr;
+    free_slots = nullptr;
+    free_count = 0;
+    capacity = 0;
+}
+
+network::packet_p network::packet_pool::allocate(const char* source, size_t size){
+    auto packet = allocate(size);
+
+    if(packet){
+        std::copy_n(source, size, packet->payload);
+    }
+
+    return packet;
+}
+
+network::packet_p network::packet_pool::allocate(size_t size){
+    if(size > PACKET_BUFFER_SIZE){
+        ++_misses;
+        return {};
+    }
+
+    size_t index;
+
+    {
+        std::lock_guard<int_spinlock> l(lock);
+
+        if(!free_count){
+            ++_misses;
+            return {};
+        }
+
+        index = free_slots[--free_count];
+    }
+
+    auto* buffer = buffers + index * PACKET_BUFFER_SIZE;
+    auto* p = new (slots + index * slot_size()) packet(buffer, size);
+    p->pool = this;
+    p->slot = index;
+
+    return packet_p{p};
+}
+
+void network::packet_pool::retire(void (*callback)(packet_pool* pool)){
+    bool empty;
+
+    {
+        std::lock_guard<int_spinlock> l(lock);
+
+        retired = callback;
+        empty = free_count == capacity;
+    }
+
+    if(empty){
+        callback(this);
+    }
+}
+
+void network::packet_pool::release(size_t index){
+    bool empty;
+
+    {
+        std::lock_guard<int_spinlock> l(lock);
+
+        free_slots[free_count++] = index;
+
+        empty = retired && free_count == capacity;
+    }
+
+    // The pool may be freed by the callback
+    if(empty){
+        retired(this);
+    }
+}
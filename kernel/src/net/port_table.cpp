@@ -0,0 +1,72 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "net/port_table.hpp"
+
+#include "tlib/errors.hpp"
+
+network::port_table::port_table() : cursor(0), used(0) {
+    for(size_t i = 0; i < WORDS; ++i){
+        bitmap[i] = 0;
+    }
+}
+
+std::expected<size_t> network::port_table::allocate(std::function_ref<bool(size_t)> busy){
+    auto start = __atomic_load_n(&cursor, __ATOMIC_RELAXED);
+
+    for(size_t w = 0; w < WORDS; ++w){
+        auto index = (start + w) % WORDS;
+        auto word = __atomic_load_n(&bitmap[index], __ATOMIC_RELAXED);
+        uint64_t skipped = 0;
+
+        // The free bits of the word are claimed one by one
+        while(auto free = ~word & ~skipped){
+            auto bit = __builtin_ctzll(free);
+            auto mask = uint64_t(1) << bit;
+
+            word = __atomic_fetch_or(&bitmap[index], mask, __ATOMIC_ACQ_REL);
+
+            if(word & mask){
+                // Claimed by another allocation meanwhile
+                continue;
+            }
+
+            auto port = FIRST_EPHEMERAL + index * 64 + bit;
+
+            // A port bound by a server is left free and skipped
+            if(busy(port)){
+                __atomic_fetch_and(&bitmap[index], ~mask, __ATOMIC_ACQ_REL);
+                skipped |= mask;
+                continue;
+            }
+
+            __atomic_store_n(&cursor, index, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&used, 1, __ATOMIC_RELAXED);
+
+            return port;
+        }
+    }
+
+    return std::make_unexpected<size_t>(std::ERROR_BUSY);
+}
+
+void network::port_table::release(size_t port){
+    if(port < FIRST_EPHEMERAL || port > LAST_EPHEMERAL){
+        return;
+    }
+
+    auto index = port - FIRST_EPHEMERAL;
+    auto mask = uint64_t(1) << (index % 64);
+
+    if(__atomic_fetch_and(&bitmap[index / 64], ~mask, __ATOMIC_ACQ_REL) & mask){
+        __atomic_sub_fetch(&used, 1, __ATOMIC_RELAXED);
+    }
+}
+
+size_t network::port_table::allocated() const {
+    return __atomic_load_n(&used, __ATOMIC_RELAXED);
+}
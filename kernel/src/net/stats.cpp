@@ -0,0 +1,129 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "net/stats.hpp"
+
+#include "sched_trace.hpp"
+#include "timer.hpp"
+
+namespace {
+
+network::stats::counters stack_counters;
+
+uint64_t load(const uint64_t& counter){
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+// A group of the protocol counters, its names and its values
+void format_protocol(std::string& value, const char* name, const network::stats::protocol_counters& counters, const char* extra_name = nullptr, const uint64_t* extra = nullptr){
+    value += name;
+    value += ": In Out Errors Drops";
+
+    if(extra_name){
+        value += ' ';
+        value += extra_name;
+    }
+
+    value += '\n';
+    value += name;
+    value += ": ";
+    value += std::to_string(load(counters.in));
+    value += ' ';
+    value += std::to_string(load(counters.out));
+    value += ' ';
+    value += std::to_string(load(counters.errors));
+    value += ' ';
+    value += std::to_string(load(counters.drops));
+
+    if(extra){
+        value += ' ';
+        value += std::to_string(load(*extra));
+    }
+
+    value += '\n';
+}
+
+// The upper bounds of the buckets in microseconds, then their counts
+void format_latency(std::string& value, const char* name, const network::stats::latency_histogram& histogram){
+    constexpr auto buckets = network::stats::latency_histogram::buckets;
+
+    value += name;
+    value += ':';
+
+    for(size_t i = 0; i < buckets; ++i){
+        value += ' ';
+        value += i + 1 < buckets ? std::to_string(1ULL << i) : std::string("inf");
+    }
+
+    value += '\n';
+    value += name;
+    value += ':';
+
+    for(size_t i = 0; i < buckets; ++i){
+        value += ' ';
+        value += std::to_string(load(histogram.counts[i]));
+    }
+
+    value += '\n';
+}
+
+// The latency of a packet since its timestamp, if it has one
+void add_latency(network::stats::latency_histogram& histogram, const network::packet& packet){
+    if(packet.timestamp){
+        histogram.add(sched_trace::to_us(timer::counter() - packet.timestamp));
+    }
+}
+
+} //end of anonymous namespace
+
+network::stats::counters& network::stats::get(){
+    return stack_counters;
+}
+
+uint64_t network::stats::timestamp(){
+    return timer::counter();
+}
+
+void network::stats::delivered(const network::packet& packet){
+    add_latency(stack_counters.rx_latency, packet);
+}
+
+void network::stats::transmitted(const network::packet& packet){
+    add_latency(stack_counters.tx_latency, packet);
+}
+
+std::string network::stats::format(){
+    auto& c = stack_counters;
+
+    std::string value;
+
+    format_protocol(value, "Ip", c.ip);
+    format_protocol(value, "Icmp", c.icmp);
+
+    value += "IcmpKernel: FastReplies RateLimited\n";
+    value += "IcmpKernel: ";
+    value += std::to_string(load(c.icmp_fast_replies));
+    value += ' ';
+    value += std::to_string(load(c.icmp_rate_limited));
+    value += '\n';
+    format_protocol(value, "Udp", c.udp);
+    format_protocol(value, "Tcp", c.tcp, "Retransmits", &c.tcp_retransmits);
+
+    value += "Net: ChecksumFailures QueueOverflows ArpMisses\n";
+    value += "Net: ";
+    value += std::to_string(load(c.checksum_failures));
+    value += ' ';
+    value += std::to_string(load(c.queue_overflows));
+    value += ' ';
+    value += std::to_string(load(c.arp_misses));
+    value += '\n';
+
+    format_latency(value, "RxLatency", c.rx_latency);
+    format_latency(value, "TxLatency", c.tx_latency);
+
+    return value;
+}
@@ -0,0 +1,234 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+
+#include "net/tcp_congestion.hpp"
+
+namespace {
+
+constexpr uint32_t initial_rto = 1000;   ///< The timeout before the first RTT sample (RFC 6298)
+constexpr uint32_t min_rto     = 200;    ///< The lowest retransmission timeout
+constexpr uint32_t max_rto     = 60000;  ///< The highest retransmission timeout
+constexpr uint32_t clock_granularity = 1; ///< The granularity of timer::milliseconds
+constexpr uint32_t initial_segments  = 10; ///< The initial window, in segments (RFC 6928)
+constexpr size_t duplicate_threshold = 3; ///< The duplicate ACKs triggering a fast retransmit
+
+constexpr int64_t cubic_max_delta = 300000; ///< The largest time offset in the cubic function, in milliseconds
+
+// Compare sequence numbers, modulo 2^32
+bool seq_after(uint32_t a, uint32_t b){
+    return int32_t(a - b) > 0;
+}
+
+uint32_t segments(const network::tcp::congestion_state& state){
+    return std::max(state.cwnd / state.mss, uint32_t(1));
+}
+
+// Integer cube root, by bisection
+uint64_t cube_root(uint64_t value){
+    uint64_t low = 0;
+    uint64_t high = 2097152; // 2^21, (2^21)^3 > 2^63
+
+    while(low < high){
+        auto middle = (low + high + 1) / 2;
+
+        if(middle * middle * middle <= value){
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
+
+void reno_avoid(network::tcp::congestion_state& state, uint32_t acked, uint64_t /*now*/){
+    // One segment per window of acknowledged data
+    state.cwnd += std::max(uint32_t((uint64_t(state.mss) * acked) / state.cwnd), uint32_t(1));
+}
+
+uint32_t reno_loss(network::tcp::congestion_state& state, uint32_t in_flight){
+    return std::max(in_flight / 2, 2 * state.mss);
+}
+
+void cubic_avoid(network::tcp::congestion_state& state, uint32_t acked, uint64_t now){
+    auto cwnd = segments(state);
+
+    // A new epoch starts with the first growth after a reduction
+    if(!state.epoch_start){
+        state.epoch_start = now;
+
+        if(cwnd < state.w_max){
+            // K = cbrt((W_max - cwnd) / C), with C = 0.4 and K in milliseconds
+            state.k = cube_root(uint64_t(state.w_max - cwnd) * uint64_t(2500000000));
+            state.origin = state.w_max;
+        } else {
+            state.k = 0;
+            state.origin = cwnd;
+        }
+    }
+
+    auto rtt = state.srtt ? state.srtt : state.rto;
+    auto t = int64_t(now - state.epoch_start + rtt);
+    auto delta = std::min(std::max(t - int64_t(state.k), -cubic_max_delta), cubic_max_delta);
+
+    // W(t) = C * (t - K)^3 + W_max, in segments
+    auto target = int64_t(state.origin) + (4 * delta * delta * delta) / int64_t(10000000000);
+
+    // The window of Reno with the same average, W_max * beta + 3 * (1 - beta) / (1 + beta) * t / RTT
+    auto reno = int64_t(state.w_max) * 7 / 10 + (9 * t) / (17 * int64_t(std::max(rtt, uint32_t(1))));
+
+    target = std::max(target, reno);
+
+    if(target > int64_t(cwnd)){
+        // At most half the acknowledged bytes, at most 1.5 the window per RTT
+        auto increase = uint64_t(target - cwnd) * acked / cwnd;
+        state.cwnd += std::max(uint32_t(std::min(increase, uint64_t(acked / 2))), uint32_t(1));
+    } else {
+        // Very slow growth around the plateau
+        state.cwnd += std::max(uint32_t((uint64_t(state.mss) * acked) / (100 * uint64_t(state.cwnd))), uint32_t(1));
+    }
+}
+
+uint32_t cubic_loss(network::tcp::congestion_state& state, uint32_t /*in_flight*/){
+    auto cwnd = segments(state);
+
+    // Fast convergence, release bandwidth for the new flows
+    if(cwnd < state.w_max){
+        state.w_max = (cwnd * 17) / 20;
+    } else {
+        state.w_max = cwnd;
+    }
+
+    state.epoch_start = 0;
+
+    // beta = 0.7
+    return std::max((state.cwnd / 10) * 7, 2 * state.mss);
+}
+
+void enter_recovery(network::tcp::congestion_state& state, uint32_t snd_nxt, uint32_t in_flight){
+    state.ssthresh = state.algorithm->loss(state, in_flight);
+    state.in_recovery = true;
+    state.recover = snd_nxt;
+}
+
+} //end of anonymous namespace
+
+const network::tcp::congestion_algorithm network::tcp::new_reno = {"reno", &reno_avoid, &reno_loss};
+const network::tcp::congestion_algorithm network::tcp::cubic = {"cubic", &cubic_avoid, &cubic_loss};
+
+const network::tcp::congestion_algorithm& network::tcp::default_congestion_algorithm(){
+#ifdef THOR_CONFIG_TCP_RENO
+    return new_reno;
+#else
+    return cubic;
+#endif
+}
+
+void network::tcp::congestion_init(congestion_state& state, uint32_t mss){
+    state = congestion_state();
+
+    state.algorithm = &default_congestion_algorithm();
+    state.mss       = mss;
+    state.cwnd      = initial_segments * mss;
+    state.ssthresh  = 0xFFFFFFFF;
+    state.rto       = initial_rto;
+}
+
+void network::tcp::congestion_rtt_sample(congestion_state& state, uint64_t rtt){
+    auto r = uint32_t(std::min(rtt, uint64_t(max_rto)));
+
+    // RFC 6298, alpha = 1/8 and beta = 1/4
+    if(!state.srtt){
+        state.srtt = std::max(r, uint32_t(1));
+        state.rttvar = r / 2;
+    } else {
+        auto error = state.srtt > r ? state.srtt - r : r - state.srtt;
+
+        state.rttvar = (3 * state.rttvar + error) / 4;
+        state.srtt = std::max((7 * state.srtt + r) / 8, uint32_t(1));
+    }
+
+    state.rto = std::min(std::max(state.srtt + std::max(clock_granularity, 4 * state.rttvar), min_rto), max_rto);
+}
+
+bool network::tcp::congestion_new_ack(congestion_state& state, uint32_t snd_una, uint32_t acked, uint64_t now){
+    state.duplicate_acks = 0;
+
+    if(state.in_recovery){
+        if(seq_after(state.recover, snd_una)){
+            // Partial ACK, the next hole is retransmitted at once
+            if(state.after_timeout){
+                state.cwnd += std::min(acked, state.mss);
+            } else {
+                state.cwnd -= std::min(acked, state.cwnd - state.mss);
+                state.cwnd += state.mss;
+            }
+
+            return true;
+        }
+
+        // Full ACK, leave the recovery with a deflated window
+        if(!state.after_timeout){
+            state.cwnd = std::max(state.ssthresh, state.mss);
+        }
+
+        state.in_recovery = false;
+        state.after_timeout = false;
+
+        return false;
+    }
+
+    if(state.cwnd < state.ssthresh){
+        // Slow start, at most one segment per ACK (RFC 3465 with L = 1)
+        state.cwnd += std::min(acked, state.mss);
+    } else {
+        state.algorithm->avoid(state, acked, now);
+    }
+
+    return false;
+}
+
+bool network::tcp::congestion_duplicate_ack(congestion_state& state, uint32_t snd_nxt, uint32_t in_flight){
+    if(state.in_recovery){
+        // Each duplicate ACK means a segment has left the network
+        if(!state.after_timeout){
+            state.cwnd += state.mss;
+        }
+
+        return false;
+    }
+
+    if(++state.duplicate_acks < duplicate_threshold){
+        return false;
+    }
+
+    enter_recovery(state, snd_nxt, in_flight);
+
+    state.cwnd = state.ssthresh + duplicate_threshold * state.mss;
+
+    ++state.fast_retransmits;
+
+    return true;
+}
+
+void network::tcp::congestion_timeout(congestion_state& state, uint32_t snd_nxt, uint32_t in_flight){
+    // A timeout during the recovery of a timeout does not reduce the threshold again
+    if(!(state.in_recovery && state.after_timeout)){
+        enter_recovery(state, snd_nxt, in_flight);
+    }
+
+    state.after_timeout = true;
+    state.duplicate_acks = 0;
+    state.cwnd = state.mss;
+
+    // Exponential back off (RFC 6298 5.5)
+    state.rto = std::min(state.rto * 2, max_rto);
+
+    ++state.timeouts;
+}
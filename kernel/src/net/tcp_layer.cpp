@@ -6,6 +6,8 @@
 //=======================================================================
 
 #include <bit_field.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
 
 #include "tlib/errors.hpp"
 
@@ -13,15 +15,25 @@
 #include "net/ip_layer.hpp"
 #include "net/checksum.hpp"
 #include "net/network.hpp"
+#include "net/stats.hpp"
 
 #include "kernel_utils.hpp"
 #include "timer.hpp"
+#include "arch.hpp"
+#include "cpu_features.hpp"
 
 namespace {
 
 static constexpr size_t timeout_ms = 1000;
 static constexpr size_t max_tries  = 5;
 constexpr size_t default_tcp_header_length = 20;
+constexpr size_t max_segment_size = 1460; ///< The maximum payload of a segment on Ethernet
+constexpr size_t max_in_flight = 64;      ///< The maximum number of segments waiting for their ACK
+constexpr uint8_t window_shift = 6;       ///< The window scale advertised to the peers, enough for MAX_SOCKET_BUFFER
+constexpr size_t window_poll_ms = 10;     ///< The maximum time to wait for an ACK before checking the window again
+constexpr uint64_t syn_timeout_ms = timeout_ms * max_tries; ///< The time a half-open connection is kept
+constexpr uint64_t cookie_period_ms = 64000; ///< The lifetime of the counter of the SYN cookies
+constexpr size_t max_gso_size = 0xFFFF - 40;  ///< The largest payload of a packet cut into segments
 
 using flag_data_offset = std::bit_field<uint16_t, uint8_t, 12, 4>;
 using flag_reserved    = std::bit_field<uint16_t, uint8_t, 9, 3>;
@@ -35,7 +47,8 @@ using flag_rst         = std::bit_field<uint16_t, uint8_t, 2, 1>;
 using flag_syn         = std::bit_field<uint16_t, uint8_t, 1, 1>;
 using flag_fin         = std::bit_field<uint16_t, uint8_t, 0, 1>;
 
-void compute_checksum(network::packet& packet) {
+// The sum of the last payload_len bytes of the segment can be known already
+void compute_checksum(network::packet& packet, uint32_t payload_sum = 0, size_t payload_len = 0) {
     auto* ip_header  = reinterpret_cast<network::ip::header*>(packet.payload + packet.tag(1));
     auto* tcp_header = reinterpret_cast<network::tcp::header*>(packet.payload + packet.tag(2));
 
@@ -43,11 +56,13 @@ void compute_checksum(network::packet& packet) {
 
     tcp_header->checksum = 0;
 
-    // Accumulate the Payload
-    auto sum = network::checksum_add_bytes(packet.payload + packet.index, tcp_len);
+    // The segments are summed once cut
+    if(packet.gso_size){
+        return;
+    }
 
     // Accumulate the IP addresses
-    sum += network::checksum_add_bytes(&ip_header->source_ip, 8);
+    auto sum = network::checksum_add_bytes(&ip_header->source_ip, 8);
 
     // Accumulate the IP Protocol
     sum += ip_header->protocol;
@@ -55,10 +70,43 @@ void compute_checksum(network::packet& packet) {
     // Accumulate the TCP length
     sum += tcp_len;
 
+    // The device sums the segment over the pseudo header
+    if(network::interface(packet.interface).checksum_offload & network::CHECKSUM_TX_L4){
+        tcp_header->checksum = switch_endian_16(network::checksum_fold(sum));
+
+        packet.checksum_start = packet.tag(2);
+        packet.checksum_offset = reinterpret_cast<char*>(&tcp_header->checksum) - reinterpret_cast<char*>(tcp_header);
+
+        return;
+    }
+
+    // Accumulate the header and the Payload
+    sum += network::checksum_add_bytes(packet.payload + packet.index, tcp_len - payload_len);
+    sum += payload_sum;
+
     // Complete the 1-complement sum
     tcp_header->checksum = switch_endian_16(network::checksum_finalize_nz(sum));
 }
 
+// Verify the checksum of a received segment, with the pseudo header
+bool verify_checksum(const network::packet& packet){
+    auto* ip_header  = reinterpret_cast<const network::ip::header*>(packet.payload + packet.tag(1));
+    auto* tcp_header = reinterpret_cast<const network::tcp::header*>(packet.payload + packet.tag(2));
+
+    size_t tcp_len = switch_endian_16(ip_header->total_len) - (ip_header->version_ihl & 0xF) * 4;
+
+    if(packet.tag(2) + tcp_len > packet.payload_size){
+        return false;
+    }
+
+    auto sum = network::checksum_add_bytes(&ip_header->source_ip, 8);
+    sum += ip_header->protocol;
+    sum += tcp_len;
+    sum += network::checksum_add_bytes(tcp_header, tcp_len);
+
+    return network::checksum_fold(sum) == 0xFFFF;
+}
+
 uint16_t get_default_flags() {
     uint16_t flags = 0; // By default
 
@@ -67,7 +115,7 @@ uint16_t get_default_flags() {
     return flags;
 }
 
-void prepare_packet(network::packet& packet, size_t source, size_t target) {
+void prepare_packet(network::packet& packet, size_t source, size_t target, uint16_t window) {
     packet.tag(2, packet.index);
 
     // Set the TCP header
@@ -76,7 +124,7 @@ void prepare_packet(network::packet& packet, size_t source, size_t target) {
 
     tcp_header->source_port    = switch_endian_16(source);
     tcp_header->target_port    = switch_endian_16(target);
-    tcp_header->window_size    = switch_endian_16(1024);
+    tcp_header->window_size    = switch_endian_16(window);
     tcp_header->urgent_pointer = 0;
 
     packet.index += default_tcp_header_length;
@@ -102,6 +150,380 @@ size_t tcp_payload_len(const network::packet_p& packet){
     return payload_len;
 }
 
+// Compare sequence numbers, modulo 2^32
+bool seq_after(uint32_t a, uint32_t b){
+    return int32_t(a - b) > 0;
+}
+
+// The window of the segments without scale option
+uint16_t default_window(){
+    return std::min(network::DEFAULT_RECEIVE_BUFFER, size_t(0xFFFF));
+}
+
+// The window reflects the space left in the receive buffer
+uint16_t receive_window(const network::tcp::tcp_connection& connection){
+    auto& receive = connection.receive;
+
+    if(!receive.capacity){
+        return default_window();
+    }
+
+    return std::min((receive.capacity - receive.size) >> connection.receive_shift, size_t(0xFFFF));
+}
+
+// Refresh the acknowledgement and the window of a segment sent again, the
+// checksum is updated rather than computed again
+void refresh_segment(network::packet& packet, const network::tcp::tcp_connection& connection){
+    auto* tcp_header = reinterpret_cast<network::tcp::header*>(packet.payload + packet.tag(2));
+
+    uint32_t ack_number = switch_endian_32(connection.ack_number);
+    uint16_t window_size = switch_endian_16(receive_window(connection));
+
+    // A checksum left to the device only covers the pseudo header
+    if(!packet.checksum_start){
+        auto checksum = network::checksum_update32(tcp_header->checksum, tcp_header->ack_number, ack_number);
+        tcp_header->checksum = network::checksum_update(checksum, tcp_header->window_size, window_size);
+    }
+
+    tcp_header->ack_number = ack_number;
+    tcp_header->window_size = window_size;
+}
+
+// Returns the window scale option of a SYN segment, -1 if it has none
+int window_scale_option(const network::packet_p& packet){
+    auto* options = reinterpret_cast<const uint8_t*>(packet->payload + packet->tag(2));
+    auto end = tcp_data_offset(packet);
+
+    size_t i = default_tcp_header_length;
+
+    while(i < end){
+        auto kind = options[i];
+
+        // End of options
+        if(kind == 0){
+            break;
+        }
+
+        // No operation
+        if(kind == 1){
+            ++i;
+            continue;
+        }
+
+        if(i + 1 >= end || options[i + 1] < 2){
+            break;
+        }
+
+        if(kind == 3 && options[i + 1] == 3 && i + 2 < end){
+            return std::min(options[i + 2], uint8_t(14));
+        }
+
+        i += options[i + 1];
+    }
+
+    return -1;
+}
+
+// Add the window scale option to a SYN segment, prepared with 4 bytes of payload
+void add_window_scale_option(network::packet& packet, uint16_t& flags){
+    auto* option = reinterpret_cast<uint8_t*>(packet.payload + packet.index);
+
+    option[0] = 1; // No operation
+    option[1] = 3; // Window scale
+    option[2] = 3;
+    option[3] = window_shift;
+
+    packet.index += 4;
+
+    (flag_data_offset(&flags)) = (default_tcp_header_length + 4) / 4;
+}
+
+// The maximum number of bytes not acknowledged yet of a connection
+size_t send_limit(const network::tcp::tcp_connection& connection){
+    return connection.socket ? connection.socket->send_buffer : network::DEFAULT_SEND_BUFFER;
+}
+
+// The number of bytes to send in one packet: as many full segments as the
+// windows and the send buffer allow, at least one segment
+size_t burst_size(network::tcp::tcp_connection& connection, size_t remaining, size_t mss){
+    std::lock_guard<spinlock> l(connection.segments_lock);
+
+    size_t in_flight = connection.seq_number - connection.send_unacked;
+    size_t window = std::min(size_t(std::min(connection.send_window, connection.congestion.cwnd)), send_limit(connection));
+    size_t room = window > in_flight ? window - in_flight : 0;
+
+    auto bytes = std::max(mss, (room / mss) * mss);
+
+    return std::min(std::min(remaining, bytes), (max_gso_size / mss) * mss);
+}
+
+// Allocate the receive buffer of a new connection, of the receive buffer size
+// of its socket. Once the network memory is exhausted, the connections only get
+// the minimum window.
+void stream_init(network::tcp::tcp_connection& connection, size_t size){
+    auto& receive = connection.receive;
+
+    if(!network::memory::charge(size)){
+        subsystem_logf(TCP, DEBUG, "tcp: Network memory exhausted, use the minimum window\n");
+
+        size = network::MIN_SOCKET_BUFFER;
+        network::memory::force_charge(size);
+    }
+
+    receive.data.reset(new char[size]);
+    receive.capacity = size;
+}
+
+// Copy bytes into the ring, at the given offset after the bytes in order
+void stream_copy_in(network::tcp::tcp_receive_buffer& receive, size_t offset, const char* data, size_t len){
+    auto position = (receive.start + receive.size + offset) % receive.capacity;
+    auto first = std::min(len, receive.capacity - position);
+
+    std::copy_n(data, first, receive.data.get() + position);
+    std::copy_n(data + first, len - first, receive.data.get());
+}
+
+// Remember a range received out of order, merged with the ranges it touches
+bool stream_add_range(network::tcp::tcp_receive_buffer& receive, uint32_t start, uint32_t end){
+    for(size_t i = 0; i < receive.holes;){
+        auto& range = receive.ranges[i];
+
+        if(seq_after(start, range.end) || seq_after(range.start, end)){
+            ++i;
+            continue;
+        }
+
+        // Merge the range and look again for the ranges it now touches
+        if(seq_after(start, range.start)){
+            start = range.start;
+        }
+
+        if(seq_after(range.end, end)){
+            end = range.end;
+        }
+
+        receive.ranges[i] = receive.ranges[--receive.holes];
+    }
+
+    if(receive.holes == network::tcp::tcp_receive_buffer::max_ranges){
+        return false;
+    }
+
+    receive.ranges[receive.holes++] = {start, end};
+
+    return true;
+}
+
+// Store the payload of a segment at its place in the stream. Returns true
+// if new bytes can be read. The segment is acknowledged by the caller with
+// the updated ack_number.
+bool stream_write(network::tcp::tcp_connection& connection, uint32_t seq, const char* data, size_t len){
+    auto& receive = connection.receive;
+
+    std::lock_guard<spinlock> l(receive.lock);
+
+    auto offset = int32_t(seq - connection.ack_number);
+
+    // Drop the bytes already received
+    if(offset < 0){
+        if(size_t(-offset) >= len){
+            return false;
+        }
+
+        data += -offset;
+        len -= -offset;
+        seq = connection.ack_number;
+        offset = 0;
+    }
+
+    // Drop the bytes out of the window
+    auto space = receive.capacity - receive.size;
+
+    if(size_t(offset) >= space){
+        return false;
+    }
+
+    len = std::min(len, space - offset);
+
+    if(offset){
+        if(stream_add_range(receive, seq, seq + len)){
+            stream_copy_in(receive, offset, data, len);
+        }
+
+        return false;
+    }
+
+    stream_copy_in(receive, 0, data, len);
+
+    receive.size += len;
+    connection.ack_number += len;
+
+    // Fill the holes now in order
+    for(size_t i = 0; i < receive.holes;){
+        auto& range = receive.ranges[i];
+
+        if(seq_after(range.start, connection.ack_number)){
+            ++i;
+            continue;
+        }
+
+        if(seq_after(range.end, connection.ack_number)){
+            receive.size += range.end - connection.ack_number;
+            connection.ack_number = range.end;
+        }
+
+        receive.ranges[i] = receive.ranges[--receive.holes];
+        i = 0;
+    }
+
+    return true;
+}
+
+// Copy at most n bytes out of the receive buffer
+size_t stream_read(network::tcp::tcp_receive_buffer& receive, char* buffer, size_t n){
+    std::lock_guard<spinlock> l(receive.lock);
+
+    auto bytes = std::min(n, receive.size);
+    auto first = std::min(bytes, receive.capacity - receive.start);
+
+    std::copy_n(receive.data.get() + receive.start, first, buffer);
+    std::copy_n(receive.data.get(), bytes - first, buffer + first);
+
+    receive.start = (receive.start + bytes) % receive.capacity;
+    receive.size -= bytes;
+
+    return bytes;
+}
+
+// Mix the identity of a connection and the fields of the cookie with the secret
+uint32_t cookie_hash(uint32_t secret, network::ip::address address, uint16_t port, uint16_t local_port, uint32_t irs, uint32_t counter, int window_scale){
+    uint32_t words[4] = {address.raw_address, (uint32_t(port) << 16) | local_port, irs, (counter << 8) | uint32_t(window_scale + 1)};
+
+    auto h = secret;
+
+    for(auto word : words){
+        h ^= word;
+        h ^= h >> 16;
+        h *= 0x85EBCA6B;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35;
+        h ^= h >> 16;
+    }
+
+    return h;
+}
+
+// The initial sequence number of a server connection. It holds the counter
+// of the period (5 bits), the window scale of the peer (4 bits) and a hash
+// of the connection and of the other fields (23 bits), the ACK of the
+// handshake can be verified without any state.
+uint32_t syn_cookie(uint32_t secret, network::ip::address address, uint16_t port, uint16_t local_port, uint32_t irs, int window_scale, uint64_t now){
+    uint32_t counter = (now / cookie_period_ms) & 0x1F;
+
+    return (counter << 27) | (uint32_t(window_scale + 1) << 23) | (cookie_hash(secret, address, port, local_port, irs, counter, window_scale) & 0x7FFFFF);
+}
+
+// Verify the cookie acknowledged by a peer, only the cookies of the current
+// and of the previous periods are valid
+bool check_syn_cookie(uint32_t secret, network::ip::address address, uint16_t port, uint16_t local_port, uint32_t irs, uint32_t cookie, uint64_t now, int& window_scale){
+    uint32_t counter = cookie >> 27;
+    uint32_t current = (now / cookie_period_ms) & 0x1F;
+
+    if(((current - counter) & 0x1F) > 1){
+        return false;
+    }
+
+    window_scale = int((cookie >> 23) & 0xF) - 1;
+
+    if(window_scale > 14){
+        return false;
+    }
+
+    return (cookie & 0x7FFFFF) == (cookie_hash(secret, address, port, local_port, irs, counter, window_scale) & 0x7FFFFF);
+}
+
+// The secret of the SYN cookies, from the hardware generator when there
+// is one, from the time stamp counter otherwise
+uint32_t cookie_seed(network::ip::address server, size_t server_port){
+    uint64_t seed = 0;
+
+    if(cpu_features::has(tlib::cpu_feature::RDRAND)){
+        // The generator can be temporarily exhausted
+        for(size_t i = 0; i < 10; ++i){
+            if(arch::rdrand(seed)){
+                break;
+            }
+        }
+    }
+
+    if(!seed){
+        seed = arch::rdtsc();
+    }
+
+    return cookie_hash(uint32_t(seed >> 32) ^ 0x9E3779B9, server, server_port, 0, uint32_t(seed), timer::milliseconds(), 0) | 1;
+}
+
+// Returns the half-open connection of a peer, must be called with the lock
+network::tcp::tcp_syn_entry* find_syn_entry(network::tcp::tcp_backlog& backlog, network::ip::address address, uint16_t port){
+    for(auto& entry : backlog.syn_queue){
+        if(entry.address == address && entry.port == port){
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+// Remove a half-open connection, must be called with the lock
+void remove_syn_entry(network::tcp::tcp_backlog& backlog, network::tcp::tcp_syn_entry* entry){
+    *entry = backlog.syn_queue.back();
+    backlog.syn_queue.pop_back();
+}
+
+// Drop the half-open connections whose peer never answered, must be called
+// with the lock
+void expire_syn_queue(network::tcp::tcp_backlog& backlog, uint64_t now){
+    auto& queue = backlog.syn_queue;
+
+    for(size_t i = 0; i < queue.size();){
+        if(now >= queue[i].expires){
+            remove_syn_entry(backlog, &queue[i]);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Pop the oldest established connection of a server, nullptr if there is none
+network::tcp::tcp_connection* pop_established(network::tcp::tcp_connection& server){
+    auto& backlog = server.backlog;
+
+    std::lock_guard<spinlock> l(backlog.lock);
+
+    if(backlog.accept_queue.empty()){
+        return nullptr;
+    }
+
+    auto* child = backlog.accept_queue.top();
+    backlog.accept_queue.pop();
+
+    return child;
+}
+
+// Give a socket of the accepting process to an established connection
+size_t accept_connection(network::socket& socket, network::tcp::tcp_connection& child){
+    auto child_fd = scheduler::register_new_socket(socket.domain, socket.type, socket.protocol);
+    auto& child_sock = scheduler::get_socket(child_fd);
+
+    subsystem_logf(TCP, TRACE, "tcp:accept: Register new socket %u\n", child_fd);
+
+    // Link the socket and connection
+    child_sock.connection_data = &child;
+    child.socket = &child_sock;
+
+    return child_fd;
+}
+
 } //end of anonymous namespace
 
 network::tcp::layer::layer(network::ip::layer* parent) : parent(parent) {
@@ -117,19 +539,33 @@ void network::tcp::layer::decode(network::interface_descriptor& interface, netwo
     auto* ip_header = reinterpret_cast<network::ip::header*>(packet->payload + packet->tag(1));
     auto* tcp_header = reinterpret_cast<network::tcp::header*>(packet->payload + packet->index);
 
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Start TCP packet handling (%p)\n", packet.get());
+    subsystem_logf(TCP, TRACE, "tcp:decode: Start TCP packet handling (%p)\n", packet.get());
+
+    stats::count(stats::get().tcp.in);
+
+    // The device may have verified the checksum already
+    if(!(packet->checksum_verified & network::CHECKSUM_RX_L4) && !verify_checksum(*packet)){
+        subsystem_logf(TCP, DEBUG, "tcp:decode: Invalid checksum, drop segment\n");
+
+        stats::count(stats::get().tcp.errors);
+        stats::count(stats::get().checksum_failures);
+        __atomic_add_fetch(&interface.rx_errors_counter, 1, __ATOMIC_RELAXED);
+
+        return;
+    }
 
     auto source_port = switch_endian_16(tcp_header->source_port);
     auto target_port = switch_endian_16(tcp_header->target_port);
     auto seq         = switch_endian_32(tcp_header->sequence_number);
     auto ack         = switch_endian_32(tcp_header->ack_number);
     auto len         = tcp_payload_len(packet);
+    auto window      = switch_endian_16(tcp_header->window_size);
 
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Source Port %u \n", size_t(source_port));
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Target Port %u \n", size_t(target_port));
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Seq Number %u \n", size_t(seq));
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Ack Number %u \n", size_t(ack));
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Length %u \n", size_t(len));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Source Port %u \n", size_t(source_port));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Target Port %u \n", size_t(target_port));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Seq Number %u \n", size_t(seq));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Ack Number %u \n", size_t(ack));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Length %u \n", size_t(len));
 
     auto flags = switch_endian_16(tcp_header->flags);
 
@@ -138,42 +574,155 @@ void network::tcp::layer::decode(network::interface_descriptor& interface, netwo
     const bool is_fin = *flag_fin(&flags);
     const bool is_psh = *flag_psh(&flags);
 
-    logging::logf(logging::log_level::TRACE, "tcp:decode: SYN:%b ACK:%b FIN:%b PSH:%b \n", is_syn, is_ack, is_fin, is_psh);
+    subsystem_logf(TCP, TRACE, "tcp:decode: SYN:%b ACK:%b FIN:%b PSH:%b \n", is_syn, is_ack, is_fin, is_psh);
 
     auto next_seq = ack;
     auto next_ack = seq + len;
 
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Next Seq Number %u \n", size_t(next_seq));
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Next Ack Number %u \n", size_t(next_ack));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Next Seq Number %u \n", size_t(next_seq));
+    subsystem_logf(TCP, TRACE, "tcp:decode: Next Ack Number %u \n", size_t(next_ack));
+
+    // The handshakes of the servers are answered here, the segments of the
+    // accepted connections go to their own connection
+    auto* target = connections.get_connection_for_packet(source_port, target_port, switch_endian_32(ip_header->source_ip));
+
+    if(target && target->server && server_handshake(interface, packet, *target)){
+        return;
+    }
+
+    // The answer uses the state of the connection, the listening connection
+    // of a server only answers if there is no child connection
+    bool found = false;
+    bool found_stream = false;
+    auto answer_seq = next_seq;
+    auto answer_ack = next_ack;
+    auto answer_window = default_window();
 
-    connections.for_each_connection_for_packet(source_port, target_port, [&](tcp_connection& connection) {
+    connections.for_each_connection_for_packet(source_port, target_port, switch_endian_32(ip_header->source_ip), [&](tcp_connection& connection) {
         if(connection.socket){
-            logging::logf(logging::log_level::TRACE, "tcp:decode: Found connection with socket\n");
+            subsystem_logf(TCP, TRACE, "tcp:decode: Found connection with socket\n");
         } else {
-            logging::logf(logging::log_level::TRACE, "tcp:decode: Found connection without socket\n");
+            subsystem_logf(TCP, TRACE, "tcp:decode: Found connection without socket\n");
         }
 
-        logging::logf(logging::log_level::TRACE, "tcp:decode: connection (server:%b,connected:%b,child:%b)\n", connection.server, connection.connected, connection.child);
-        logging::logf(logging::log_level::TRACE, "            src:%u dest:%u server:%h\n", connection.local_port, connection.server_port, connection.server_address.raw_address);
+        subsystem_logf(TCP, TRACE, "tcp:decode: connection (server:%b,connected:%b,child:%b)\n", connection.server, connection.connected, connection.child);
+        subsystem_logf(TCP, TRACE, "            src:%u dest:%u server:%h\n", connection.local_port, connection.server_port, connection.server_address.raw_address);
 
         // Update the connection status
 
-        connection.seq_number = next_seq;
-        connection.ack_number = next_ack;
+        if(is_syn){
+            connection.syn_window_scale = window_scale_option(packet);
+            connection.send_window = window;
+        }
+
+        if(is_ack){
+            network::packet_p retransmit;
+
+            {
+                std::lock_guard<spinlock> l(connection.segments_lock);
+
+                // An ACK past the sent data is the ACK of a SYN or of a
+                // segment finalized directly
+                if(seq_after(ack, connection.seq_number)){
+                    connection.seq_number = ack;
+                }
+
+                auto& congestion = connection.congestion;
+                auto now = timer::milliseconds();
+                auto send_window = uint32_t(window) << connection.send_shift;
+
+                if(seq_after(ack, connection.send_unacked)){
+                    // Cumulative acknowledgement of the retransmission queue
+                    auto acked = ack - connection.send_unacked;
+                    connection.send_unacked = ack;
+
+                    bool sampled = false;
+
+                    while(!connection.segments.empty()){
+                        auto& segment = connection.segments.front();
+
+                        if(seq_after(segment.sequence + segment.length, ack)){
+                            break;
+                        }
+
+                        // Only the segments sent once measure the RTT (Karn)
+                        if(!sampled && segment.tries == 1 && congestion.algorithm){
+                            congestion_rtt_sample(congestion, now - segment.sent);
+                            sampled = true;
+                        }
+
+                        connection.segments.pop_front();
+                    }
+
+                    if(congestion.algorithm && congestion_new_ack(congestion, ack, acked, now) && !connection.segments.empty()){
+                        retransmit = connection.segments.front().packet;
+                    }
+                } else if(ack == connection.send_unacked && !len && !is_syn && !is_fin && send_window == connection.send_window && !connection.segments.empty()){
+                    auto in_flight = connection.seq_number - connection.send_unacked;
+
+                    if(congestion.algorithm && congestion_duplicate_ack(congestion, connection.seq_number, in_flight)){
+                        retransmit = connection.segments.front().packet;
+                    }
+                }
+
+                if(retransmit){
+                    auto& oldest = connection.segments.front();
+
+                    ++oldest.tries;
+                    oldest.sent = now;
+                }
+
+                connection.send_window = send_window;
+            }
+
+            if(retransmit){
+                subsystem_logf(TCP, TRACE, "tcp:decode: Fast retransmit\n");
+
+                // The packet is already finalized
+                refresh_segment(*retransmit, connection);
+
+                stats::count(stats::get().tcp.out);
+                stats::count(stats::get().tcp_retransmits);
+
+                parent->finalize_packet(interface, retransmit);
+            }
+
+            connection.acked.notify_all();
+        }
+
+        // The data of the established connections is stored in the stream
+        // and the packet is released, the rest is only acknowledged
+
+        bool stream = len && connection.connected && connection.receive.capacity;
+
+        if(stream){
+            auto* data = packet->payload + packet->tag(2) + *flag_data_offset(&flags) * 4;
+
+            if(stream_write(connection, seq, data, len) && connection.socket){
+                stats::delivered(*packet);
+
+                connection.socket->listen_queue.notify_one();
+                connection.socket->poll_source.notify();
+            } else if(seq != connection.ack_number) {
+                subsystem_logf(TCP, TRACE, "tcp:decode: Out of order segment (expected %u)\n", size_t(connection.ack_number));
+            }
+        } else if(!connection.connected || !connection.receive.capacity){
+            connection.ack_number = next_ack;
+        }
 
         // Propagate to kernel connections
 
         if (connection.listening.load()) {
-            logging::logf(logging::log_level::TRACE, "tcp:decode: Propagated to connection\n");
+            subsystem_logf(TCP, TRACE, "tcp:decode: Propagated to connection\n");
 
             connection.packets.push(packet);
             connection.queue.notify_one();
         }
 
         if(connection.child && is_fin){
-            logging::logf(logging::log_level::TRACE, "tcp:decode: End connection (received FIN/ACK)\n");
+            subsystem_logf(TCP, TRACE, "tcp:decode: End connection (received FIN/ACK)\n");
 
-            logging::logf(logging::log_level::TRACE, "tcp:decode: Send FIN/ACK\n");
+            subsystem_logf(TCP, TRACE, "tcp:decode: Send FIN/ACK\n");
 
             auto p = kernel_prepare_packet(interface, switch_endian_32(ip_header->source_ip), target_port, source_port, 0);
 
@@ -202,130 +751,276 @@ void network::tcp::layer::decode(network::interface_descriptor& interface, netwo
 
             if(connection.socket){
                 connection.socket->listen_queue.notify_all();
+                connection.socket->poll_source.notify();
+            }
+        }
+
+        if(!found || (!found_stream && connection.receive.capacity)){
+            found = true;
+            found_stream = connection.receive.capacity > 0;
+            answer_seq = connection.seq_number;
+            answer_ack = connection.ack_number;
+            answer_window = receive_window(connection);
+        }
+    });
+
+    if(!found){
+        subsystem_logf(TCP, DEBUG, "tcp:decode: Received segment for which there are no connection\n");
+
+        stats::count(stats::get().tcp.drops);
+    }
+
+    // Acknowledge the data
+
+    if (len) {
+        subsystem_logf(TCP, TRACE, "tcp:decode: Acknowledge directly\n");
+
+        auto p = kernel_prepare_packet(interface, switch_endian_32(ip_header->source_ip), target_port, source_port, 0);
+
+        if (!p) {
+            logging::logf(logging::log_level::ERROR, "tcp:decode: Impossible to prepare TCP packet for ACK\n");
+            return;
+        }
+
+        auto& packet = *p;
+
+        auto* ack_tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
+
+        ack_tcp_header->sequence_number = switch_endian_32(answer_seq);
+        ack_tcp_header->ack_number      = switch_endian_32(answer_ack);
+        ack_tcp_header->window_size     = switch_endian_16(answer_window);
+
+        auto ack_flags = get_default_flags();
+        (flag_ack(&ack_flags)) = 1;
+        ack_tcp_header->flags = switch_endian_16(ack_flags);
+
+        finalize_packet_direct(interface, packet);
+    }
+
+    subsystem_logf(TCP, TRACE, "tcp:decode: Done\n");
+}
+
+std::expected<void> network::tcp::layer::send(char* /*target_buffer*/, network::socket& socket, const char* buffer, size_t n){
+    auto& connection = socket.get_connection_data<tcp_connection>();
+
+    // Make sure stream sockets are connected
+    if(!connection.connected){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_NOT_CONNECTED);
+    }
+
+    subsystem_logf(TCP, TRACE, "tcp:send: Send %u bytes\n", n);
+
+    // The data is copied into segments built in the kernel, the buffer of
+    // the packet is not needed
+    return kernel_send(socket, buffer, n);
+}
+
+std::expected<void> network::tcp::layer::kernel_send(network::socket& socket, const char* buffer, size_t n){
+    vfs::iovec vector{const_cast<char*>(buffer), n};
+
+    return kernel_sendv(socket, &vector, 1);
+}
+
+std::expected<void> network::tcp::layer::kernel_sendv(network::socket& socket, const vfs::iovec* vectors, size_t n){
+    auto& connection = socket.get_connection_data<tcp_connection>();
+
+    // Make sure stream sockets are connected
+    if(!connection.connected){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_NOT_CONNECTED);
+    }
+
+    auto target_ip  = connection.server_address;
+    auto& interface = network::select_interface(target_ip);
+
+    size_t remaining = 0;
+    for(size_t i = 0; i < n; ++i){
+        remaining += vectors[i].length;
+    }
+
+    // Several segments go down the stack as one packet, cut before the device
+    auto mss = std::min(max_segment_size, parent->path_mtu(interface, target_ip) - 40);
+
+    // The position in the buffers
+    size_t vector = 0;
+    size_t vector_offset = 0;
+
+    while(remaining){
+        auto bytes = burst_size(connection, remaining, mss);
+
+        // Wait for the segment to fit in the window of the peer
+        auto status = wait_send_window(interface, connection, bytes, false);
+
+        if (!status) {
+            return status;
+        }
+
+        subsystem_logf(TCP, TRACE, "tcp:kernel_send: Send segment (%u)\n", bytes);
+
+        auto p = kernel_prepare_packet(interface, connection, bytes);
+
+        if (!p) {
+            return std::make_unexpected<void>(p.error());
+        }
+
+        auto& packet = *p;
+
+        if(bytes > mss){
+            packet->gso_size = mss;
+        }
+
+        auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
+
+        // Only the last segment pushes the data to the application
+        auto flags = get_default_flags();
+        (flag_psh(&flags)) = remaining == bytes;
+        (flag_ack(&flags)) = 1;
+        tcp_header->flags = switch_endian_16(flags);
+
+        // Gather the payload from the buffers, summing it on the way
+        uint32_t payload_sum = 0;
+
+        for(size_t copied = 0; copied < bytes;){
+            auto chunk = std::min(bytes - copied, vectors[vector].length - vector_offset);
+
+            auto chunk_sum = network::checksum_copy_add_bytes(packet->payload + packet->index + copied, vectors[vector].base + vector_offset, chunk);
+
+            // The bytes of a chunk at an odd offset are swapped in the words
+            payload_sum += (copied & 1) ? switch_endian_16(chunk_sum) : chunk_sum;
+
+            copied += chunk;
+            vector_offset += chunk;
+
+            if(vector_offset == vectors[vector].length){
+                ++vector;
+                vector_offset = 0;
             }
         }
 
-        // Propagate to the kernel socket
+        {
+            std::lock_guard<spinlock> l(connection.segments_lock);
+
+            connection.segments.push_back({packet, connection.seq_number, uint32_t(bytes), timer::milliseconds(), 1});
+            connection.seq_number += bytes;
+        }
+
+        auto result = finalize_packet_direct(interface, packet, payload_sum, bytes);
 
-        if (is_psh && connection.socket) {
-            auto& socket = *connection.socket;
+        if (!result) {
+            return result;
+        }
 
-            packet->index += *flag_data_offset(&flags) * 4;
+        remaining -= bytes;
+    }
 
-            if (socket.listen) {
-                logging::logf(logging::log_level::TRACE, "tcp:decode: Propagated to socket\n");
+    // Wait for the ACK of all the segments
+    return wait_send_window(interface, connection, 0, true);
+}
 
-                socket.listen_packets.push(packet);
-                socket.listen_queue.notify_one();
-            }
+/*!
+ * \brief Wait until a segment of the given size fits in the send window, or
+ * until all the segments are acknowledged (flush). The timed out segments
+ * are sent again in the meantime.
+ */
+std::expected<void> network::tcp::layer::wait_send_window(network::interface_descriptor& interface, tcp_connection& connection, size_t bytes, bool flush){
+    while(true){
+        if(!connection.connected){
+            return std::make_unexpected<void>(std::ERROR_SOCKET_NOT_CONNECTED);
         }
-    });
 
-    // Acknowledge if necessary
+        network::packet_p retransmit;
 
-    if (is_psh) {
-        logging::logf(logging::log_level::TRACE, "tcp:decode: Acknowledge directly\n");
+        {
+            std::lock_guard<spinlock> l(connection.segments_lock);
 
-        auto p = kernel_prepare_packet(interface, switch_endian_32(ip_header->source_ip), target_port, source_port, 0);
+            auto& segments = connection.segments;
 
-        if (!p) {
-            logging::logf(logging::log_level::ERROR, "tcp:decode: Impossible to prepare TCP packet for ACK\n");
-            return;
-        }
+            if(segments.empty()){
+                return {};
+            }
 
-        auto& packet = *p;
+            auto& congestion = connection.congestion;
 
-        auto* ack_tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
+            // A segment is always sent when nothing is in flight, to probe a closed window
+            auto in_flight = connection.seq_number - connection.send_unacked;
+            auto window = std::min(connection.send_window, congestion.cwnd);
 
-        ack_tcp_header->sequence_number = switch_endian_32(next_seq);
-        ack_tcp_header->ack_number      = switch_endian_32(next_ack);
+            // The unacknowledged bytes are held until their ACK, within the send buffer
+            auto held = in_flight + bytes;
 
-        auto ack_flags = get_default_flags();
-        (flag_ack(&ack_flags)) = 1;
-        ack_tcp_header->flags = switch_endian_16(ack_flags);
+            if(!flush && held <= window && held <= send_limit(connection) && segments.size() < max_in_flight){
+                return {};
+            }
 
-        finalize_packet_direct(interface, packet);
-    }
+            auto& oldest = segments.front();
+            auto now = timer::milliseconds();
 
-    logging::logf(logging::log_level::TRACE, "tcp:decode: Done\n");
-}
+            if(now >= oldest.sent + congestion.rto){
+                if(oldest.tries == max_tries){
+                    return std::make_unexpected<void>(std::ERROR_SOCKET_TCP_ERROR);
+                }
 
-std::expected<void> network::tcp::layer::send(char* target_buffer, network::socket& socket, const char* buffer, size_t n){
-    auto& connection = socket.get_connection_data<tcp_connection>();
+                congestion_timeout(congestion, connection.seq_number, in_flight);
 
-    // Make sure stream sockets are connected
-    if(!connection.connected){
-        return std::make_unexpected<void>(std::ERROR_SOCKET_NOT_CONNECTED);
-    }
+                // The other segments are retransmitted one by one, on the partial ACKs
+                for(auto& segment : segments){
+                    segment.sent = now;
+                }
 
-    logging::logf(logging::log_level::TRACE, "tcp:send: Send %s(%u)\n", buffer, n);
+                ++oldest.tries;
 
-    network::tcp::packet_descriptor desc{n};
-    auto p = user_prepare_packet(target_buffer, socket, &desc);
+                retransmit = oldest.packet;
+            }
+        }
 
-    if (p) {
-        auto& packet = *p;
+        if(retransmit){
+            subsystem_logf(TCP, TRACE, "tcp:send: Retransmit segment\n");
+
+            // The packet is already finalized
+            refresh_segment(*retransmit, connection);
+
+            stats::count(stats::get().tcp.out);
+            stats::count(stats::get().tcp_retransmits);
+
+            auto result = parent->finalize_packet(interface, retransmit);
 
-        for(size_t i = 0; i < n; ++i){
-            packet->payload[packet->index + i] = buffer[i];
+            if(!result){
+                return result;
+            }
         }
 
-        auto target_ip  = connection.server_address;
-        auto& interface = network::select_interface(target_ip);
-        return finalize_packet(interface, socket, packet);
+        // An ACK between the check and the wait is only seen at the next check
+        connection.acked.wait_for(window_poll_ms);
     }
-
-    return std::make_unexpected<void>(p.error());
 }
 
 std::expected<size_t> network::tcp::layer::receive(char* buffer, network::socket& socket, size_t n){
     auto& connection = socket.get_connection_data<tcp_connection>();
 
-    // Make sure stream sockets are connected
-    if(!connection.connected){
-        return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
-    }
-
-    logging::logf(logging::log_level::TRACE, "tcp:receive: Wait for packet\n");
-
-    if(socket.listen_packets.empty()){
-        socket.listen_queue.wait();
+    subsystem_logf(TCP, TRACE, "tcp:receive: Wait for data\n");
 
+    // The data received before the end of the connection can still be read
+    while(!connection.receive.size){
         if(!connection.connected){
-            logging::logf(logging::log_level::TRACE, "tcp:receive: Disconnected while waiting\n");
+            subsystem_logf(TCP, TRACE, "tcp:receive: Disconnected\n");
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
         }
-    }
-
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
-
-    logging::logf(logging::log_level::TRACE, "tcp:receive: Received packet\n");
 
-    auto payload_len = tcp_payload_len(packet);
-
-    if(payload_len > n){
-        return std::make_unexpected<size_t>(std::ERROR_BUFFER_SMALL);
+        socket.listen_queue.wait();
     }
 
-    auto offset = packet->tag(2) + tcp_data_offset(packet);
-
-    std::copy_n(packet->payload + offset, payload_len, buffer);
-
-    return payload_len;
+    return read_stream(connection, buffer, n);
 }
 
 std::expected<size_t> network::tcp::layer::receive(char* buffer, network::socket& socket, size_t n, size_t ms){
     auto& connection = socket.get_connection_data<tcp_connection>();
 
-    // Make sure stream sockets are connected
-    if(!connection.connected){
-        return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
-    }
+    subsystem_logf(TCP, TRACE, "tcp:receive: Wait for data (timeout)\n");
 
-    logging::logf(logging::log_level::TRACE, "tcp:receive: Wait for packet (timeout)\n");
+    if(!connection.receive.size){
+        if(!connection.connected){
+            return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
+        }
 
-    if(socket.listen_packets.empty()){
         if(!ms){
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
         }
@@ -334,28 +1029,52 @@ std::expected<size_t> network::tcp::layer::receive(char* buffer, network::socket
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
         }
 
-        if(!connection.connected){
-            logging::logf(logging::log_level::TRACE, "tcp:receive: Disconnected while waiting\n");
-            return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
+        if(!connection.receive.size){
+            if(!connection.connected){
+                subsystem_logf(TCP, TRACE, "tcp:receive: Disconnected while waiting\n");
+                return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
+            }
+
+            return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
         }
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    return read_stream(connection, buffer, n);
+}
+
+/*!
+ * \brief Read the received bytes of the connection and let the peer know
+ * when the window opens again
+ */
+std::expected<size_t> network::tcp::layer::read_stream(tcp_connection& connection, char* buffer, size_t n){
+    auto& receive = connection.receive;
 
-    logging::logf(logging::log_level::TRACE, "tcp:receive: Received packet\n");
+    auto before = receive.capacity - receive.size;
+    auto bytes = stream_read(receive, buffer, n);
+    auto after = receive.capacity - receive.size;
 
-    auto payload_len = tcp_payload_len(packet);
+    subsystem_logf(TCP, TRACE, "tcp:receive: Read %u bytes\n", bytes);
 
-    if(payload_len > n){
-        return std::make_unexpected<size_t>(std::ERROR_BUFFER_SMALL);
-    }
+    // The peer may be waiting on a window too small for its segments
+    if(connection.connected && before < receive.capacity / 4 && after >= receive.capacity / 4){
+        auto& interface = network::select_interface(connection.server_address);
 
-    auto offset = packet->tag(2) + tcp_data_offset(packet);
+        auto p = kernel_prepare_packet(interface, connection, 0);
 
-    std::copy_n(packet->payload + offset, payload_len, buffer);
+        if(p){
+            auto& packet = *p;
 
-    return payload_len;
+            auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
+
+            auto flags = get_default_flags();
+            (flag_ack(&flags)) = 1;
+            tcp_header->flags = switch_endian_16(flags);
+
+            finalize_packet_direct(interface, packet);
+        }
+    }
+
+    return bytes;
 }
 
 std::expected<network::packet_p> network::tcp::layer::user_prepare_packet(char* buffer, network::socket& socket, const packet_descriptor* descriptor) {
@@ -379,7 +1098,7 @@ std::expected<network::packet_p> network::tcp::layer::user_prepare_packet(char*
         auto source = connection.local_port;
         auto target = connection.server_port;
 
-        ::prepare_packet(*packet, source, target);
+        ::prepare_packet(*packet, source, target, receive_window(connection));
 
         auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
 
@@ -412,7 +1131,13 @@ std::expected<void> network::tcp::layer::finalize_packet(network::interface_desc
     bool received = false;
 
     for(size_t t = 0; t < max_tries; ++t){
-        logging::logf(logging::log_level::TRACE, "tcp:finalize(std): Send Packet (%h)\n", size_t(source_flags));
+        subsystem_logf(TCP, TRACE, "tcp:finalize(std): Send Packet (%h)\n", size_t(source_flags));
+
+        stats::count(stats::get().tcp.out);
+
+        if(t){
+            stats::count(stats::get().tcp_retransmits);
+        }
 
         // Give the packet to the IP layer for finalization
         auto result = parent->finalize_packet(interface, p);
@@ -463,7 +1188,7 @@ std::expected<void> network::tcp::layer::finalize_packet(network::interface_desc
             //the sent packet
 
             if (correct_ack) {
-                logging::logf(logging::log_level::TRACE, "tcp:finalize: Received ACK\n");
+                subsystem_logf(TCP, TRACE, "tcp:finalize: Received ACK\n");
 
                 connection.fina_ack_number = switch_endian_32(tcp_header->ack_number);
                 connection.fina_seq_number = switch_endian_32(tcp_header->sequence_number);
@@ -473,7 +1198,7 @@ std::expected<void> network::tcp::layer::finalize_packet(network::interface_desc
                 break;
             }
 
-            logging::logf(logging::log_level::TRACE, "tcp:finalize: Received unrelated answer\n");
+            subsystem_logf(TCP, TRACE, "tcp:finalize: Received unrelated answer\n");
         }
 
         if(received){
@@ -494,7 +1219,7 @@ std::expected<void> network::tcp::layer::finalize_packet(network::interface_desc
 }
 
 std::expected<size_t> network::tcp::layer::connect(network::socket& sock, network::interface_descriptor& interface, size_t server_port, network::ip::address server) {
-    logging::logf(logging::log_level::TRACE, "tcp:connect: Start\n");
+    subsystem_logf(TCP, TRACE, "tcp:connect: Start\n");
 
     // Create the connection
 
@@ -508,9 +1233,13 @@ std::expected<size_t> network::tcp::layer::connect(network::socket& sock, networ
     sock.connection_data = &connection;
     connection.socket = &sock;
 
-    // Prepare the SYN packet
+    stream_init(connection, sock.receive_buffer);
 
-    auto p = kernel_prepare_packet(interface, connection, 0);
+    connections.insert_connection(connection);
+
+    // Prepare the SYN packet, with room for the window scale option
+
+    auto p = kernel_prepare_packet(interface, connection, 4);
 
     if (!p) {
         return std::make_unexpected<size_t>(p.error());
@@ -522,9 +1251,10 @@ std::expected<size_t> network::tcp::layer::connect(network::socket& sock, networ
 
     auto flags = get_default_flags();
     (flag_syn(&flags)) = 1;
+    add_window_scale_option(*packet, flags);
     tcp_header->flags = switch_endian_16(flags);
 
-    logging::logf(logging::log_level::TRACE, "tcp:connect: Send SYN\n");
+    subsystem_logf(TCP, TRACE, "tcp:connect: Send SYN\n");
 
     auto status = finalize_packet(interface, sock, packet);
 
@@ -535,9 +1265,18 @@ std::expected<size_t> network::tcp::layer::connect(network::socket& sock, networ
     connection.seq_number = connection.fina_ack_number;
     connection.ack_number = connection.fina_seq_number + 1;
 
+    connection.send_unacked = connection.seq_number;
+    congestion_init(connection.congestion, max_segment_size);
+
+    // The windows are scaled only if both sides sent the option
+    if(connection.syn_window_scale >= 0){
+        connection.send_shift = connection.syn_window_scale;
+        connection.receive_shift = window_shift;
+    }
+
     // The SYN/ACK is ensured by finalize_packet
 
-    logging::logf(logging::log_level::TRACE, "tcp:connect: Received SYN/ACK\n");
+    subsystem_logf(TCP, TRACE, "tcp:connect: Received SYN/ACK\n");
 
     // At this point we have received the SYN/ACK, only remains to ACK
 
@@ -556,7 +1295,7 @@ std::expected<size_t> network::tcp::layer::connect(network::socket& sock, networ
         (flag_ack(&flags)) = 1;
         tcp_header->flags = switch_endian_16(flags);
 
-        logging::logf(logging::log_level::TRACE, "tcp:connect: Send ACK\n");
+        subsystem_logf(TCP, TRACE, "tcp:connect: Send ACK\n");
 
         finalize_packet_direct(interface, packet);
     }
@@ -565,152 +1304,226 @@ std::expected<size_t> network::tcp::layer::connect(network::socket& sock, networ
 
     connection.connected = true;
 
-    logging::logf(logging::log_level::TRACE, "tcp:connect: Done\n");
+    subsystem_logf(TCP, TRACE, "tcp:connect: Done\n");
 
     return connection.local_port;
 }
 
-std::expected<size_t> network::tcp::layer::accept(network::socket& socket){
-    auto& connection = socket.get_connection_data<tcp_connection>();
+// Answer the SYN sent to a server and establish the connection once its ACK
+// is received. Returns true if the segment is consumed.
+bool network::tcp::layer::server_handshake(network::interface_descriptor& interface, network::packet_p& packet, tcp_connection& server){
+    auto* ip_header  = reinterpret_cast<network::ip::header*>(packet->payload + packet->tag(1));
+    auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
 
-    if(!connection.connected){
-        return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
-    }
+    auto flags = switch_endian_16(tcp_header->flags);
 
-    // 1. Wait for SYN
+    const bool is_syn = *flag_syn(&flags);
+    const bool is_ack = *flag_ack(&flags);
+    const bool is_rst = *flag_rst(&flags);
 
-    connection.listening = true;
+    network::ip::address address = switch_endian_32(ip_header->source_ip);
+    uint16_t port       = switch_endian_16(tcp_header->source_port);
+    uint16_t local_port = server.server_port;
 
-    logging::logf(logging::log_level::TRACE, "tcp:accept: wait for connection\n");
+    auto seq = switch_endian_32(tcp_header->sequence_number);
+    auto ack = switch_endian_32(tcp_header->ack_number);
+    auto now = timer::milliseconds();
 
-    uint32_t ack = 0;
-    uint32_t seq = 0;
+    auto& backlog = server.backlog;
 
-    uint16_t source_port = 0;
-    uint16_t target_port = 0;
-    uint32_t source_address = 0;
+    if(is_syn && !is_ack){
+        tcp_syn_entry entry;
 
-    while (true) {
-        if(connection.packets.empty()){
-            connection.queue.wait();
+        {
+            std::lock_guard<spinlock> l(backlog.lock);
+
+            expire_syn_queue(backlog, now);
+
+            auto* existing = find_syn_entry(backlog, address, port);
+
+            if(existing && existing->irs == seq){
+                // The SYN/ACK was lost, answer again with the same numbers
+                entry = *existing;
+            } else {
+                if(existing){
+                    remove_syn_entry(backlog, existing);
+                }
+
+                entry.address      = address;
+                entry.port         = port;
+                entry.irs          = seq;
+                entry.window       = switch_endian_16(tcp_header->window_size);
+                entry.window_scale = window_scale_option(packet);
+                entry.iss          = syn_cookie(cookie_secret, address, port, local_port, seq, entry.window_scale, now);
+                entry.expires      = now + syn_timeout_ms;
+
+                // Once the queue is full, only the cookie remembers the SYN
+                if(backlog.syn_queue.size() < backlog.size){
+                    backlog.syn_queue.push_back(entry);
+                } else {
+                    subsystem_logf(TCP, TRACE, "tcp:handshake: SYN queue full, answer with a cookie\n");
+                }
+            }
         }
 
-        auto received_packet = connection.packets.top();
-        connection.packets.pop();
+        send_syn_ack(interface, local_port, entry);
+
+        return true;
+    }
+
+    if(!is_ack || is_syn || is_rst){
+        return false;
+    }
 
-        auto* tcp_header = reinterpret_cast<header*>(received_packet->payload + received_packet->index);
-        auto flags       = switch_endian_16(tcp_header->flags);
+    tcp_syn_entry entry;
+    uint32_t send_window;
 
-        if (*flag_syn(&flags)) {
-            seq = switch_endian_32(tcp_header->sequence_number);
-            ack = switch_endian_32(tcp_header->ack_number);
+    {
+        std::lock_guard<spinlock> l(backlog.lock);
 
-            source_port = switch_endian_16(tcp_header->source_port);
-            target_port = switch_endian_16(tcp_header->target_port);
+        // The peer sends the ACK again if it is dropped
+        if(backlog.accept_queue.size() >= backlog.size){
+            subsystem_logf(TCP, TRACE, "tcp:handshake: Accept queue full, drop ACK\n");
+            return true;
+        }
 
-            auto* ip_header = reinterpret_cast<network::ip::header*>(received_packet->payload + received_packet->tag(1));
+        auto* existing = find_syn_entry(backlog, address, port);
 
-            source_address = switch_endian_32(ip_header->source_ip);
+        if(existing && existing->iss + 1 == ack){
+            entry = *existing;
+            send_window = entry.window;
 
-            break;
+            remove_syn_entry(backlog, existing);
+        } else if(check_syn_cookie(cookie_secret, address, port, local_port, seq - 1, ack - 1, now, entry.window_scale)){
+            entry.address = address;
+            entry.port    = port;
+            entry.irs     = seq - 1;
+            entry.iss     = ack - 1;
+
+            // Only the window of the SYN is not scaled
+            send_window = uint32_t(switch_endian_16(tcp_header->window_size)) << std::max(entry.window_scale, 0);
+        } else {
+            return false;
         }
     }
 
-    logging::logf(logging::log_level::TRACE, "tcp:accept: received SYN from %h\n", source_address);
+    subsystem_logf(TCP, TRACE, "tcp:handshake: Connection established with %h\n", size_t(address.raw_address));
 
-    connection.listening = false;
+    // The child connection is complete before it is visible
 
-    // Set the future sequence and acknowledgement numbers
-    connection.seq_number = ack;
-    connection.ack_number = seq + 1;
+    auto& child = connections.create_connection();
 
-    // 2. Prepare the child connection
+    child.child = true;
 
-    auto child_fd = scheduler::register_new_socket(socket.domain, socket.type, socket.protocol);
-    auto& child_sock = scheduler::get_socket(child_fd);
+    child.local_port     = local_port;
+    child.server_port    = port;
+    child.server_address = address;
 
-    logging::logf(logging::log_level::TRACE, "tcp:accept: Register new socket %u\n", child_fd);
+    // The child inherits the buffer sizes of the server socket
+    stream_init(child, server.socket ? server.socket->receive_buffer : network::DEFAULT_RECEIVE_BUFFER);
 
-    // Create the connection
+    child.seq_number   = entry.iss + 1;
+    child.ack_number   = entry.irs + 1;
+    child.send_unacked = child.seq_number;
+    child.send_window  = send_window;
 
-    auto& child_connection = connections.create_connection();
+    // The windows are scaled only if both sides sent the option
+    if(entry.window_scale >= 0){
+        child.send_shift    = entry.window_scale;
+        child.receive_shift = window_shift;
+    }
 
-    child_connection.child = true;
+    congestion_init(child.congestion, max_segment_size);
 
-    child_connection.local_port     = target_port;
-    child_connection.server_port    = source_port;
-    child_connection.server_address = source_address;
+    child.connected = true;
 
-    // Link the socket and connection
-    child_sock.connection_data = &child_connection;
-    child_connection.socket = &child_sock;
+    connections.insert_connection(child);
 
-    // Child connection numbers
-    child_connection.seq_number = connection.seq_number;
-    child_connection.ack_number = connection.ack_number;
+    {
+        std::lock_guard<spinlock> l(backlog.lock);
 
-    child_connection.connected = true;
+        backlog.accept_queue.push(&child);
+    }
 
-    auto& interface = network::select_interface(source_address);
+    server.queue.notify_one();
 
-    // 3. Send SYN/ACK
+    if(server.socket){
+        server.socket->poll_source.notify();
+    }
 
-    {
-        auto p = kernel_prepare_packet(interface, child_connection, 0);
+    // The data of the ACK goes to the child connection
+    return false;
+}
 
-        if (!p) {
-            return std::make_unexpected<size_t>(p.error());
-        }
+void network::tcp::layer::send_syn_ack(network::interface_descriptor& interface, size_t local_port, const tcp_syn_entry& entry){
+    auto p = kernel_prepare_packet(interface, entry.address, local_port, entry.port, entry.window_scale >= 0 ? 4 : 0);
 
-        auto& packet = *p;
+    if (!p) {
+        logging::logf(logging::log_level::ERROR, "tcp:handshake: Impossible to prepare TCP packet for SYN/ACK\n");
+        return;
+    }
 
-        auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
+    auto& packet = *p;
 
-        auto flags = get_default_flags();
-        (flag_ack(&flags)) = 1;
-        (flag_syn(&flags)) = 1;
-        tcp_header->flags = switch_endian_16(flags);
+    auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
 
-        logging::logf(logging::log_level::TRACE, "tcp:accept: Send SYN/ACK %h\n", size_t(flags));
+    tcp_header->sequence_number = switch_endian_32(entry.iss);
+    tcp_header->ack_number      = switch_endian_32(entry.irs + 1);
 
-        auto status = finalize_packet(interface, child_sock, packet);
+    auto flags = get_default_flags();
+    (flag_ack(&flags)) = 1;
+    (flag_syn(&flags)) = 1;
 
-        if(!status){
-            return std::make_unexpected<size_t, size_t>(status.error());
-        }
+    if(entry.window_scale >= 0){
+        add_window_scale_option(*packet, flags);
     }
 
-    // The ACK is enforced by finalize_packet
+    tcp_header->flags = switch_endian_16(flags);
 
-    logging::logf(logging::log_level::TRACE, "tcp:accept: Done\n");
+    subsystem_logf(TCP, TRACE, "tcp:handshake: Send SYN/ACK %h\n", size_t(flags));
 
-    return {child_fd};
+    finalize_packet_direct(interface, packet);
 }
 
-std::expected<size_t> network::tcp::layer::accept(network::socket& socket, size_t ms){
+std::expected<size_t> network::tcp::layer::accept(network::socket& socket){
     auto& connection = socket.get_connection_data<tcp_connection>();
 
-    if(!connection.connected){
+    if(!connection.connected || !connection.server){
         return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
     }
 
-    // 1. Wait for SYN
+    subsystem_logf(TCP, TRACE, "tcp:accept: wait for connection\n");
 
-    connection.listening = true;
+    while (true) {
+        auto* child = pop_established(connection);
 
-    logging::logf(logging::log_level::TRACE, "tcp:accept: wait for connection\n");
+        if(child){
+            return accept_connection(socket, *child);
+        }
 
-    uint32_t ack = 0;
-    uint32_t seq = 0;
+        connection.queue.wait();
+    }
+}
+
+std::expected<size_t> network::tcp::layer::accept(network::socket& socket, size_t ms){
+    auto& connection = socket.get_connection_data<tcp_connection>();
+
+    if(!connection.connected || !connection.server){
+        return std::make_unexpected<size_t>(std::ERROR_SOCKET_NOT_CONNECTED);
+    }
 
-    uint16_t source_port = 0;
-    uint16_t target_port = 0;
-    uint32_t source_address = 0;
+    subsystem_logf(TCP, TRACE, "tcp:accept: wait for connection\n");
 
     auto before = timer::milliseconds();
     auto after  = before;
 
     while (true) {
+        auto* child = pop_established(connection);
+
+        if(child){
+            return accept_connection(socket, *child);
+        }
+
         // Make sure we don't wait for more than the timeout
         if (after > before + ms) {
             return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
@@ -718,107 +1531,26 @@ std::expected<size_t> network::tcp::layer::accept(network::socket& socket, size_
 
         auto remaining = ms - (after - before);
 
-        if (connection.packets.empty()) {
-            if (!connection.queue.wait_for(remaining)) {
-                return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
-            }
-        }
-
-        auto received_packet = connection.packets.top();
-        connection.packets.pop();
-
-        auto* tcp_header = reinterpret_cast<header*>(received_packet->payload + received_packet->index);
-        auto flags       = switch_endian_16(tcp_header->flags);
+        if (!connection.queue.wait_for(remaining)) {
+            // A connection may have been established just before the timeout
+            child = pop_established(connection);
 
-        if (*flag_syn(&flags)) {
-            seq = switch_endian_32(tcp_header->sequence_number);
-            ack = switch_endian_32(tcp_header->ack_number);
-
-            source_port = switch_endian_16(tcp_header->source_port);
-            target_port = switch_endian_16(tcp_header->target_port);
-
-            auto* ip_header = reinterpret_cast<network::ip::header*>(received_packet->payload + received_packet->tag(1));
-
-            source_address = switch_endian_32(ip_header->source_ip);
+            if(child){
+                return accept_connection(socket, *child);
+            }
 
-            break;
+            return std::make_unexpected<size_t>(std::ERROR_SOCKET_TIMEOUT);
         }
 
         after = timer::milliseconds();
     }
+}
 
-    logging::logf(logging::log_level::TRACE, "tcp:accept: received SYN from %h\n", source_address);
-
-    connection.listening = false;
-
-    // Set the future sequence and acknowledgement numbers
-    connection.seq_number = ack;
-    connection.ack_number = seq + 1;
-
-    // 2. Prepare the child connection
-
-    auto child_fd = scheduler::register_new_socket(socket.domain, socket.type, socket.protocol);
-    auto& child_sock = scheduler::get_socket(child_fd);
-
-    logging::logf(logging::log_level::TRACE, "tcp:accept: Register new socket %u\n", child_fd);
-
-    // Create the connection
-
-    auto& child_connection = connections.create_connection();
-
-    child_connection.child = true;
-
-    child_connection.local_port     = target_port;
-    child_connection.server_port    = source_port;
-    child_connection.server_address = source_address;
-
-    // Link the socket and connection
-    child_sock.connection_data = &child_connection;
-    child_connection.socket = &child_sock;
-
-    // Child connection numbers
-    child_connection.seq_number = connection.seq_number;
-    child_connection.ack_number = connection.ack_number;
-
-    child_connection.connected = true;
-
-    auto& interface = network::select_interface(source_address);
-
-    // 3. Send SYN/ACK
-
-    {
-        auto p = kernel_prepare_packet(interface, child_connection, 0);
-
-        if (!p) {
-            return std::make_unexpected<size_t>(p.error());
-        }
-
-        auto& packet = *p;
-
-        auto* tcp_header = reinterpret_cast<header*>(packet->payload + packet->tag(2));
-
-        auto flags = get_default_flags();
-        (flag_ack(&flags)) = 1;
-        (flag_syn(&flags)) = 1;
-        tcp_header->flags = switch_endian_16(flags);
-
-        logging::logf(logging::log_level::TRACE, "tcp:accept: Send SYN/ACK %h\n", size_t(flags));
-
-        auto status = finalize_packet(interface, child_sock, packet);
-
-        if(!status){
-            return std::make_unexpected<size_t, size_t>(status.error());
-        }
+std::expected<void> network::tcp::layer::server_start(network::socket& sock, size_t server_port, network::ip::address server, size_t backlog) {
+    if(!cookie_secret){
+        cookie_secret = cookie_seed(server, server_port);
     }
 
-    // The ACK is enforced by finalize_packet
-
-    logging::logf(logging::log_level::TRACE, "tcp:accept: Done\n");
-
-    return {child_fd};
-}
-
-std::expected<void> network::tcp::layer::server_start(network::socket& sock, size_t server_port, network::ip::address server) {
     // Create the connection
 
     auto& connection = connections.create_connection();
@@ -827,10 +1559,15 @@ std::expected<void> network::tcp::layer::server_start(network::socket& sock, siz
     connection.server_port    = server_port;
     connection.server_address = server;
 
+    connection.backlog.size = backlog;
+    connection.backlog.syn_queue.reserve(backlog);
+
     // Link the socket and connection
     sock.connection_data = &connection;
     connection.socket = &sock;
 
+    connections.insert_connection(connection);
+
     // Mark the connection as connected
 
     connection.connected = true;
@@ -839,7 +1576,7 @@ std::expected<void> network::tcp::layer::server_start(network::socket& sock, siz
 }
 
 std::expected<void> network::tcp::layer::disconnect(network::socket& sock) {
-    logging::logf(logging::log_level::TRACE, "tcp:disconnect: Disconnect\n");
+    subsystem_logf(TCP, TRACE, "tcp:disconnect: Disconnect\n");
 
     auto& connection = sock.get_connection_data<tcp_connection>();
 
@@ -867,7 +1604,7 @@ std::expected<void> network::tcp::layer::disconnect(network::socket& sock) {
 
     connection.listening = true;
 
-    logging::logf(logging::log_level::TRACE, "tcp:disconnect: Send FIN/ACK\n");
+    subsystem_logf(TCP, TRACE, "tcp:disconnect: Send FIN/ACK\n");
 
     bool rec_fin_ack = false;
     bool rec_ack     = false;
@@ -942,7 +1679,7 @@ std::expected<void> network::tcp::layer::disconnect(network::socket& sock) {
 
     // If we received an ACK, we must wait for a FIN/ACK from the server now
     if(rec_ack){
-        logging::logf(logging::log_level::TRACE, "tcp:disconnect: Received ACK waiting for FIN/ACK\n");
+        subsystem_logf(TCP, TRACE, "tcp:disconnect: Received ACK waiting for FIN/ACK\n");
 
         received = false;
 
@@ -989,9 +1726,9 @@ std::expected<void> network::tcp::layer::disconnect(network::socket& sock) {
         connection.seq_number = ack;
         connection.ack_number = seq + 1;
 
-        logging::logf(logging::log_level::TRACE, "tcp:disconnect: Received FIN/ACK waiting for ACK\n");
+        subsystem_logf(TCP, TRACE, "tcp:disconnect: Received FIN/ACK waiting for ACK\n");
     } else if(rec_fin_ack) {
-        logging::logf(logging::log_level::TRACE, "tcp:disconnect: Received FIN/ACK directly waiting for ACK\n");
+        subsystem_logf(TCP, TRACE, "tcp:disconnect: Received FIN/ACK directly waiting for ACK\n");
     }
 
     // Stop listening
@@ -1014,7 +1751,7 @@ std::expected<void> network::tcp::layer::disconnect(network::socket& sock) {
         (flag_ack(&flags)) = 1;
         tcp_header->flags = switch_endian_16(flags);
 
-        logging::logf(logging::log_level::TRACE, "tcp: Send ACK\n");
+        subsystem_logf(TCP, TRACE, "tcp: Send ACK\n");
         finalize_packet_direct(interface, packet);
     }
 
@@ -1034,7 +1771,7 @@ std::expected<network::packet_p> network::tcp::layer::kernel_prepare_packet(netw
     auto packet = parent->kernel_prepare_packet(interface, desc);
 
     if (packet) {
-        ::prepare_packet(**packet, source, target);
+        ::prepare_packet(**packet, source, target, default_window());
     }
 
     return packet;
@@ -1053,7 +1790,7 @@ std::expected<network::packet_p> network::tcp::layer::kernel_prepare_packet(netw
     if (p) {
         auto& packet = *p;
 
-        ::prepare_packet(*packet, local_port, server_port);
+        ::prepare_packet(*packet, local_port, server_port, receive_window(connection));
 
         auto* tcp_header = reinterpret_cast<network::tcp::header*>(packet->payload + packet->tag(2));
 
@@ -1065,7 +1802,7 @@ std::expected<network::packet_p> network::tcp::layer::kernel_prepare_packet(netw
 }
 
 // finalize without waiting for ACK
-std::expected<void> network::tcp::layer::finalize_packet_direct(network::interface_descriptor& interface, network::packet_p& p) {
+std::expected<void> network::tcp::layer::finalize_packet_direct(network::interface_descriptor& interface, network::packet_p& p, uint32_t payload_sum, size_t payload_len) {
     auto* tcp_header = reinterpret_cast<network::tcp::header*>(p->payload + p->tag(2));
 
     auto flags = switch_endian_16(tcp_header->flags);
@@ -1073,8 +1810,111 @@ std::expected<void> network::tcp::layer::finalize_packet_direct(network::interfa
     p->index -= *flag_data_offset(&flags) * 4;
 
     // Compute the checksum
-    compute_checksum(*p);
+    compute_checksum(*p, payload_sum, payload_len);
+
+    stats::count(stats::get().tcp.out);
 
     // Give the packet to the IP layer for finalization
     return parent->finalize_packet(interface, p);
 }
+
+std::vector<network::packet_p> network::tcp::segment(network::interface_descriptor& interface, const network::packet& packet){
+    auto* ip_header  = reinterpret_cast<const network::ip::header*>(packet.payload + packet.tag(1));
+    auto* tcp_header = reinterpret_cast<const header*>(packet.payload + packet.tag(2));
+
+    auto tcp_flags = switch_endian_16(tcp_header->flags);
+
+    size_t ip_header_length = (ip_header->version_ihl & 0xF) * 4;
+    size_t headers = packet.tag(2) + *flag_data_offset(&tcp_flags) * 4;
+    size_t data_length = packet.tag(1) + switch_endian_16(ip_header->total_len) - headers;
+    size_t mss = packet.gso_size;
+
+    auto sequence = switch_endian_32(tcp_header->sequence_number);
+
+    std::vector<network::packet_p> segments;
+    segments.reserve((data_length + mss - 1) / mss);
+
+    for(size_t offset = 0; offset < data_length; offset += mss){
+        auto bytes = std::min(mss, data_length - offset);
+        bool last = offset + bytes == data_length;
+
+        auto segment = std::make_intrusive<network::packet>(new char[headers + bytes], headers + bytes);
+
+        std::copy_n(packet.payload, headers, segment->payload);
+        std::copy_n(packet.payload + headers + offset, bytes, segment->payload + headers);
+
+        segment->tags      = packet.tags;
+        segment->interface = packet.interface;
+        segment->timestamp = packet.timestamp;
+        segment->index     = packet.tag(2);
+
+        auto* segment_ip  = reinterpret_cast<network::ip::header*>(segment->payload + segment->tag(1));
+        auto* segment_tcp = reinterpret_cast<header*>(segment->payload + segment->tag(2));
+
+        segment_ip->total_len = switch_endian_16(uint16_t(headers - packet.tag(1) + bytes));
+
+        if(interface.checksum_offload & network::CHECKSUM_TX_IP){
+            segment_ip->header_checksum = 0;
+        } else {
+            segment_ip->header_checksum = 0;
+            segment_ip->header_checksum = ~network::checksum_fold_partial(network::checksum_partial(segment_ip, ip_header_length));
+        }
+
+        // Only the last segment pushes or ends the data
+        auto flags = tcp_flags;
+
+        if(!last){
+            (flag_psh(&flags)) = 0;
+            (flag_fin(&flags)) = 0;
+        }
+
+        segment_tcp->sequence_number = switch_endian_32(uint32_t(sequence + offset));
+        segment_tcp->flags = switch_endian_16(flags);
+
+        compute_checksum(*segment);
+
+        segments.push_back(segment);
+    }
+
+    return segments;
+}
+
+std::string network::tcp::layer::format_connections(){
+    std::string value;
+
+    connections.for_each_connection([&](tcp_connection& connection){
+        // The listening connections have no congestion state
+        if(!connection.connected){
+            return;
+        }
+
+        std::lock_guard<spinlock> l(connection.segments_lock);
+
+        auto& congestion = connection.congestion;
+
+        value += std::to_string(connection.local_port);
+        value += ' ';
+        value += std::to_string(connection.server_port);
+        value += ' ';
+        value += congestion.algorithm ? congestion.algorithm->name : "none";
+        value += " cwnd:";
+        value += std::to_string(congestion.cwnd);
+        value += " ssthresh:";
+        value += std::to_string(congestion.ssthresh);
+        value += " in_flight:";
+        value += std::to_string(connection.seq_number - connection.send_unacked);
+        value += " srtt:";
+        value += std::to_string(congestion.srtt);
+        value += " rttvar:";
+        value += std::to_string(congestion.rttvar);
+        value += " rto:";
+        value += std::to_string(congestion.rto);
+        value += " timeouts:";
+        value += std::to_string(congestion.timeouts);
+        value += " fast_retransmits:";
+        value += std::to_string(congestion.fast_retransmits);
+        value += '\n';
+    });
+
+    return value;
+}
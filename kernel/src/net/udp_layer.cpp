@@ -13,11 +13,14 @@
 #include "net/dhcp_layer.hpp"
 #include "net/checksum.hpp"
 #include "net/network.hpp"
+#include "net/stats.hpp"
 
 #include "kernel_utils.hpp"
 
 namespace {
 
+constexpr size_t max_payload = 0xFFFF - sizeof(network::ip::header) - sizeof(network::udp::header); ///< The largest payload of a datagram
+
 void compute_checksum(network::packet& packet){
     auto* ip_header = reinterpret_cast<network::ip::header*>(packet.payload + packet.tag(1));
     auto* udp_header = reinterpret_cast<network::udp::header*>(packet.payload + packet.tag(2));
@@ -28,9 +31,6 @@ void compute_checksum(network::packet& packet){
 
     uint32_t sum = 0;
 
-    // Accumulate the Payload
-    sum += network::checksum_add_bytes(packet.payload + packet.tag(2), length);
-
     // Accumulate the IP addresses
     sum += network::checksum_add_bytes(&ip_header->source_ip, 8);
 
@@ -40,10 +40,47 @@ void compute_checksum(network::packet& packet){
     // Accumulate the UDP length
     sum += length;
 
+    // The device sums the datagram over the pseudo header
+    if(network::interface(packet.interface).checksum_offload & network::CHECKSUM_TX_L4){
+        udp_header->checksum = switch_endian_16(network::checksum_fold(sum));
+
+        packet.checksum_start = packet.tag(2);
+        packet.checksum_offset = reinterpret_cast<char*>(&udp_header->checksum) - reinterpret_cast<char*>(udp_header);
+
+        return;
+    }
+
+    // Accumulate the Payload
+    sum += network::checksum_add_bytes(packet.payload + packet.tag(2), length);
+
     // Complete the 1-complement sum
     udp_header->checksum = switch_endian_16(network::checksum_finalize_nz(sum));
 }
 
+// Verify the checksum of a received datagram, with the pseudo header
+bool verify_checksum(const network::packet& packet){
+    auto* ip_header = reinterpret_cast<const network::ip::header*>(packet.payload + packet.tag(1));
+    auto* udp_header = reinterpret_cast<const network::udp::header*>(packet.payload + packet.tag(2));
+
+    // The checksum is optional over IPv4
+    if(!udp_header->checksum){
+        return true;
+    }
+
+    size_t length = switch_endian_16(udp_header->length);
+
+    if(packet.tag(2) + length > packet.payload_size){
+        return false;
+    }
+
+    auto sum = network::checksum_add_bytes(&ip_header->source_ip, 8);
+    sum += ip_header->protocol;
+    sum += length;
+    sum += network::checksum_add_bytes(udp_header, length);
+
+    return network::checksum_fold(sum) == 0xFFFF;
+}
+
 void prepare_packet(network::packet& packet, size_t source, size_t target, size_t payload_size){
     packet.tag(2, packet.index);
 
@@ -62,9 +99,6 @@ void prepare_packet(network::packet& packet, size_t source, size_t target, size_
 
 network::udp::layer::layer(network::ip::layer* parent) : parent(parent) {
     parent->register_udp_layer(this);
-
-    // The first port will be 1024
-    local_port = 1023;
 }
 
 void network::udp::layer::decode(network::interface_descriptor& interface, network::packet_p& packet){
@@ -72,15 +106,28 @@ void network::udp::layer::decode(network::interface_descriptor& interface, netwo
 
     auto* udp_header = reinterpret_cast<header*>(packet->payload + packet->index);
 
-    logging::logf(logging::log_level::TRACE, "udp: Start UDP packet handling\n");
+    subsystem_logf(NET, TRACE, "udp: Start UDP packet handling\n");
+
+    stats::count(stats::get().udp.in);
 
     auto source_port = switch_endian_16(udp_header->source_port);
     auto target_port = switch_endian_16(udp_header->target_port);
     auto length      = switch_endian_16(udp_header->length);
 
-    logging::logf(logging::log_level::TRACE, "udp: Source Port %h \n", source_port);
-    logging::logf(logging::log_level::TRACE, "udp: Target Port %h \n", target_port);
-    logging::logf(logging::log_level::TRACE, "udp: Length %h \n", length);
+    subsystem_logf(NET, TRACE, "udp: Source Port %h \n", source_port);
+    subsystem_logf(NET, TRACE, "udp: Target Port %h \n", target_port);
+    subsystem_logf(NET, TRACE, "udp: Length %h \n", length);
+
+    // The device may have verified the checksum already
+    if(!(packet->checksum_verified & network::CHECKSUM_RX_L4) && !verify_checksum(*packet)){
+        subsystem_logf(NET, DEBUG, "udp: Invalid checksum, drop datagram\n");
+
+        stats::count(stats::get().udp.errors);
+        stats::count(stats::get().checksum_failures);
+        __atomic_add_fetch(&interface.rx_errors_counter, 1, __ATOMIC_RELAXED);
+
+        return;
+    }
 
     packet->index += sizeof(header);
 
@@ -90,7 +137,9 @@ void network::udp::layer::decode(network::interface_descriptor& interface, netwo
         dhcp_layer->decode(interface, packet);
     }
 
-    auto connection_ptr = connections.get_connection_for_packet(source_port, target_port);
+    auto* ip_header = reinterpret_cast<network::ip::header*>(packet->payload + packet->tag(1));
+
+    auto connection_ptr = connections.get_connection_for_packet(source_port, target_port, switch_endian_32(ip_header->source_ip));
 
     if(connection_ptr){
         auto& connection = *connection_ptr;
@@ -101,12 +150,20 @@ void network::udp::layer::decode(network::interface_descriptor& interface, netwo
             auto& socket = *connection.socket;
 
             if (socket.listen) {
-                socket.listen_packets.push(packet);
-                socket.listen_queue.notify_one();
+                if (!socket.queue_packet(packet)) {
+                    subsystem_logf(NET, DEBUG, "udp: Receive buffer full, drop datagram\n");
+
+                    stats::count(stats::get().udp.drops);
+                }
             }
         }
     } else {
-        logging::logf(logging::log_level::DEBUG, "udp: Received packet for which there are no connection\n");
+        subsystem_logf(NET, DEBUG, "udp: Received packet for which there are no connection\n");
+
+        // The answers of the DNS and DHCP servers are handled by the kernel
+        if(source_port != 53 && source_port != 67){
+            stats::count(stats::get().udp.drops);
+        }
     }
 }
 
@@ -164,6 +221,8 @@ std::expected<void> network::udp::layer::finalize_packet(network::interface_desc
     // Compute the checksum
     compute_checksum(*p);
 
+    stats::count(stats::get().udp.out);
+
     // Give the packet to the IP layer for finalization
     return parent->finalize_packet(interface, p);
 }
@@ -173,11 +232,18 @@ std::expected<void> network::udp::layer::finalize_packet(network::interface_desc
 }
 
 std::expected<size_t> network::udp::layer::client_bind(network::socket& sock, size_t server_port, network::ip::address server){
+    // The ports bound by the servers are not given to the clients
+    auto port = ports.allocate([this](size_t candidate){ return connections.has_server(candidate); });
+
+    if(!port){
+        return std::make_unexpected<size_t>(port.error());
+    }
+
     // Create the connection
 
     auto& connection = connections.create_connection();
 
-    connection.local_port     = ++local_port;
+    connection.local_port     = *port;
     connection.server_port    = server_port;
     connection.server_address = server;
 
@@ -185,6 +251,8 @@ std::expected<size_t> network::udp::layer::client_bind(network::socket& sock, si
     sock.connection_data = &connection;
     connection.socket = &sock;
 
+    connections.insert_connection(connection);
+
     // Mark the connection as connected
 
     connection.connected = true;
@@ -205,6 +273,8 @@ std::expected<void> network::udp::layer::server_bind(network::socket& sock, size
     sock.connection_data = &connection;
     connection.socket = &sock;
 
+    connections.insert_connection(connection);
+
     // Mark the connection as connected
 
     connection.connected = true;
@@ -213,6 +283,10 @@ std::expected<void> network::udp::layer::server_bind(network::socket& sock, size
 }
 
 std::expected<void> network::udp::layer::client_unbind(network::socket& sock){
+    if(!sock.connection_data){
+        return std::make_unexpected<void>(std::ERROR_SOCKET_NOT_CONNECTED);
+    }
+
     auto& connection = sock.get_connection_data<udp_connection>();
 
     if(!connection.connected){
@@ -223,7 +297,16 @@ std::expected<void> network::udp::layer::client_unbind(network::socket& sock){
 
     connection.connected = false;
 
+    auto server = connection.server;
+    auto port   = connection.local_port;
+
     connections.remove_connection(connection);
+    sock.connection_data = nullptr;
+
+    // No lookup can find the connection anymore, its port can be reused
+    if(!server){
+        ports.release(port);
+    }
 
     return {};
 }
@@ -236,6 +319,11 @@ std::expected<void> network::udp::layer::send(char* target_buffer, network::sock
         return std::make_unexpected<void>(std::ERROR_SOCKET_NOT_CONNECTED);
     }
 
+    // The datagram is fragmented by the IP layer, up to the maximum IP size
+    if(n > max_payload){
+        return std::make_unexpected<void>(std::ERROR_INVALID_COUNT);
+    }
+
     network::udp::packet_descriptor desc{n};
     auto packet_e = user_prepare_packet(target_buffer, socket, &desc);
 
@@ -264,6 +352,11 @@ std::expected<void> network::udp::layer::send_to(char* target_buffer, network::s
 
     auto* address = static_cast<network::inet_address*>(addr);
 
+    // The datagram is fragmented by the IP layer, up to the maximum IP size
+    if(n > max_payload){
+        return std::make_unexpected<void>(std::ERROR_INVALID_COUNT);
+    }
+
     network::udp::packet_descriptor desc{n};
     auto packet_e = user_prepare_packet(target_buffer, socket, &desc, address);
 
@@ -294,8 +387,7 @@ std::expected<size_t> network::udp::layer::receive(char* buffer, network::socket
         socket.listen_queue.wait();
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    auto packet = socket.dequeue_packet();
 
     auto* udp_header = reinterpret_cast<network::udp::header*>(packet->payload + packet->tag(2));
     auto payload_len = switch_endian_16(udp_header->length);
@@ -327,8 +419,7 @@ std::expected<size_t> network::udp::layer::receive(char* buffer, network::socket
         }
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    auto packet = socket.dequeue_packet();
 
     auto* udp_header = reinterpret_cast<network::udp::header*>(packet->payload + packet->tag(2));
     auto payload_len = switch_endian_16(udp_header->length);
@@ -356,8 +447,7 @@ std::expected<size_t> network::udp::layer::receive_from(char* buffer, network::s
         socket.listen_queue.wait();
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    auto packet = socket.dequeue_packet();
 
     auto* udp_header = reinterpret_cast<network::udp::header*>(packet->payload + packet->tag(2));
     auto payload_len = switch_endian_16(udp_header->length);
@@ -396,8 +486,7 @@ std::expected<size_t> network::udp::layer::receive_from(char* buffer, network::s
         }
     }
 
-    auto packet = socket.listen_packets.top();
-    socket.listen_packets.pop();
+    auto packet = socket.dequeue_packet();
 
     auto* udp_header = reinterpret_cast<network::udp::header*>(packet->payload + packet->tag(2));
     auto payload_len = switch_endian_16(udp_header->length);
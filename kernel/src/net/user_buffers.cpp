@@ -0,0 +1,92 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/errors.hpp"
+
+#include "net/user_buffers.hpp"
+
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "scheduler.hpp"
+#include "logging.hpp"
+
+namespace {
+
+// Release the kernel side of the first n pages of the buffers, the pages
+// still mapped in the process are freed with it
+void release_pages(network::user_buffers& buffers, size_t n){
+    for(size_t i = 0; i < n; ++i){
+        paging::unmap(buffers.kernel_address + i * paging::PAGE_SIZE);
+        physical_allocator::release(buffers.pages[i], 1);
+    }
+
+    virtual_allocator::free(buffers.kernel_address, network::USER_BUFFER_PAGES);
+}
+
+// Called once the last packet of retired buffers is back
+void free_buffers(network::packet_pool* pool){
+    auto* buffers = static_cast<network::user_buffers*>(pool);
+
+    buffers->destroy();
+
+    release_pages(*buffers, network::USER_BUFFER_PAGES);
+
+    delete buffers;
+}
+
+} //end of anonymous namespace
+
+std::expected<network::user_buffers*> network::map_user_buffers(){
+    auto* buffers = new user_buffers();
+
+    buffers->kernel_address = virtual_allocator::allocate(USER_BUFFER_PAGES);
+
+    if(!buffers->kernel_address){
+        delete buffers;
+        return std::make_unexpected<user_buffers*>(std::ERROR_FAILED);
+    }
+
+    // The pages are allocated one by one, each of them is released by its last owner
+    for(size_t i = 0; i < USER_BUFFER_PAGES; ++i){
+        auto physical = physical_allocator::allocate_zeroed(1);
+
+        if(!physical || !paging::map(buffers->kernel_address + i * paging::PAGE_SIZE, physical)){
+            logging::logf(logging::log_level::ERROR, "net: Unable to allocate the user packet buffers\n");
+
+            if(physical){
+                physical_allocator::free(physical, 1);
+            }
+
+            release_pages(*buffers, i);
+            delete buffers;
+
+            return std::make_unexpected<user_buffers*>(std::ERROR_FAILED);
+        }
+
+        buffers->pages[i] = physical;
+    }
+
+    auto user_address = scheduler::map_shared_pages(buffers->pages, USER_BUFFER_PAGES);
+
+    if(!user_address){
+        release_pages(*buffers, USER_BUFFER_PAGES);
+        delete buffers;
+
+        return std::make_unexpected<user_buffers*>(user_address.error());
+    }
+
+    buffers->user_address = *user_address;
+    buffers->init(USER_BUFFERS, reinterpret_cast<char*>(buffers->kernel_address));
+
+    logging::logf(logging::log_level::TRACE, "net: Mapped %u packet buffers at %h\n", USER_BUFFERS, buffers->user_address);
+
+    return buffers;
+}
+
+void network::unmap_user_buffers(user_buffers* buffers){
+    buffers->retire(&free_buffers);
+}
@@ -0,0 +1,290 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <string.hpp>
+#include <algorithms.hpp>
+
+#include "numa.hpp"
+#include "acpica.hpp"
+#include "logging.hpp"
+#include "physical_allocator.hpp"
+#include "scheduler.hpp"
+#include "smp.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t MAX_RANGES = 32; ///< The maximum number of memory ranges
+
+/*!
+ * \brief A range of physical memory of a node
+ */
+struct memory_range {
+    size_t first; ///< The first address
+    size_t last;  ///< The end address
+    size_t node;  ///< The node of the memory
+};
+
+std::array<memory_range, MAX_RANGES> ranges;
+size_t range_count = 0;
+
+std::array<uint32_t, numa::MAX_NODES> domains; ///< The proximity domain of each node
+volatile size_t node_count = 1;
+
+std::array<uint8_t, smp::MAX_CPUS> cpu_nodes;
+std::array<std::array<uint8_t, numa::MAX_NODES>, numa::MAX_NODES> distances;
+
+std::array<size_t, numa::MAX_NODES> node_ids; ///< The index of each node, for sysfs
+
+// Returns the node of the proximity domain, a new node for a new domain
+size_t domain_node(uint32_t domain){
+    for(size_t i = 0; i < node_count; ++i){
+        if(domains[i] == domain){
+            return i;
+        }
+    }
+
+    if(node_count == numa::MAX_NODES){
+        logging::logf(logging::log_level::WARNING, "numa: Too many nodes, domain %u is put on node 0\n", size_t(domain));
+        return 0;
+    }
+
+    domains[node_count] = domain;
+
+    return node_count++;
+}
+
+void set_cpu_node(uint32_t apic_id, uint32_t domain){
+    auto node = domain_node(domain);
+
+    for(size_t cpu = 0; cpu < smp::max_cpus(); ++cpu){
+        if(smp::online(cpu) && smp::apic_id(cpu) == apic_id){
+            cpu_nodes[cpu] = node;
+        }
+    }
+}
+
+void add_range(size_t base, size_t length, uint32_t domain){
+    if(range_count == MAX_RANGES){
+        logging::logf(logging::log_level::WARNING, "numa: Too many memory ranges, ignore %h\n", base);
+        return;
+    }
+
+    ranges[range_count++] = {base, base + length, domain_node(domain)};
+}
+
+bool parse_srat(){
+    ACPI_TABLE_SRAT* srat;
+    auto status = AcpiGetTable(ACPI_SIG_SRAT, 0, reinterpret_cast<ACPI_TABLE_HEADER **>(&srat));
+    if (ACPI_FAILURE(status)){
+        logging::logf(logging::log_level::TRACE, "numa: No ACPI SRAT table\n");
+        return false;
+    }
+
+    // The first node is the one of the first domain met
+    node_count = 0;
+
+    auto start = reinterpret_cast<uintptr_t>(srat) + sizeof(ACPI_TABLE_SRAT);
+    auto end = reinterpret_cast<uintptr_t>(srat) + srat->Header.Length;
+
+    while(start < end){
+        auto header = reinterpret_cast<ACPI_SUBTABLE_HEADER*>(start);
+
+        if(!header->Length){
+            break;
+        }
+
+        if(header->Type == ACPI_SRAT_TYPE_CPU_AFFINITY){
+            auto cpu = reinterpret_cast<ACPI_SRAT_CPU_AFFINITY*>(header);
+
+            if(cpu->Flags & ACPI_SRAT_CPU_USE_AFFINITY){
+                uint32_t domain = cpu->ProximityDomainLo
+                    | (uint32_t(cpu->ProximityDomainHi[0]) << 8)
+                    | (uint32_t(cpu->ProximityDomainHi[1]) << 16)
+                    | (uint32_t(cpu->ProximityDomainHi[2]) << 24);
+
+                set_cpu_node(cpu->ApicId, domain);
+            }
+        } else if(header->Type == ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY){
+            auto cpu = reinterpret_cast<ACPI_SRAT_X2APIC_CPU_AFFINITY*>(header);
+
+            if(cpu->Flags & ACPI_SRAT_CPU_ENABLED){
+                set_cpu_node(cpu->ApicId, cpu->ProximityDomain);
+            }
+        } else if(header->Type == ACPI_SRAT_TYPE_MEMORY_AFFINITY){
+            auto memory = reinterpret_cast<ACPI_SRAT_MEM_AFFINITY*>(header);
+
+            if((memory->Flags & ACPI_SRAT_MEM_ENABLED) && memory->Length){
+                add_range(memory->BaseAddress, memory->Length, memory->ProximityDomain);
+            }
+        }
+
+        start += header->Length;
+    }
+
+    if(!node_count){
+        node_count = 1;
+    }
+
+    return true;
+}
+
+void parse_slit(){
+    ACPI_TABLE_SLIT* slit;
+    auto status = AcpiGetTable(ACPI_SIG_SLIT, 0, reinterpret_cast<ACPI_TABLE_HEADER **>(&slit));
+    if (ACPI_FAILURE(status)){
+        logging::logf(logging::log_level::TRACE, "numa: No ACPI SLIT table\n");
+        return;
+    }
+
+    auto localities = slit->LocalityCount;
+
+    // The matrix is indexed by the proximity domains
+    if(sizeof(ACPI_TABLE_SLIT) - 1 + localities * localities > slit->Header.Length){
+        logging::logf(logging::log_level::WARNING, "numa: Truncated SLIT table\n");
+        return;
+    }
+
+    for(size_t i = 0; i < node_count; ++i){
+        for(size_t j = 0; j < node_count; ++j){
+            if(domains[i] < localities && domains[j] < localities){
+                distances[i][j] = slit->Entry[domains[i] * localities + domains[j]];
+            }
+        }
+    }
+}
+
+std::string sysfs_cpus(void* data){
+    auto node = *static_cast<size_t*>(data);
+
+    std::string value;
+
+    for(size_t cpu = 0; cpu < smp::max_cpus(); ++cpu){
+        if(smp::online(cpu) && cpu_nodes[cpu] == node){
+            if(!value.empty()){
+                value += ' ';
+            }
+
+            value += std::to_string(cpu);
+        }
+    }
+
+    return value;
+}
+
+std::string sysfs_distances(void* data){
+    auto node = *static_cast<size_t*>(data);
+
+    std::string value;
+
+    for(size_t i = 0; i < node_count; ++i){
+        if(i){
+            value += ' ';
+        }
+
+        value += std::to_string(size_t(distances[node][i]));
+    }
+
+    return value;
+}
+
+std::string sysfs_free(void* data){
+    return std::to_string(physical_allocator::node_free(*static_cast<size_t*>(data)));
+}
+
+std::string sysfs_used(void* data){
+    auto node = *static_cast<size_t*>(data);
+    return std::to_string(physical_allocator::node_size(node) - physical_allocator::node_free(node));
+}
+
+std::string sysfs_size(void* data){
+    return std::to_string(physical_allocator::node_size(*static_cast<size_t*>(data)));
+}
+
+} //end of anonymous namespace
+
+void numa::init(){
+    // The processors of the nodes are only known once they are started
+    scheduler::queue_async_init_task("numa", numa::late_init, {"acpi", "smp"});
+}
+
+void numa::late_init(){
+    // The defaults of ACPI without SLIT: local and remote distances
+    for(size_t i = 0; i < MAX_NODES; ++i){
+        for(size_t j = 0; j < MAX_NODES; ++j){
+            distances[i][j] = i == j ? LOCAL_DISTANCE : 2 * LOCAL_DISTANCE;
+        }
+    }
+
+    if(parse_srat()){
+        parse_slit();
+
+        logging::logf(logging::log_level::TRACE, "numa: %u nodes, %u memory ranges\n", size_t(node_count), range_count);
+
+        if(node_count > 1){
+            physical_allocator::init_nodes();
+        }
+    }
+
+    sysfs::set_constant_value(path("/sys"), path("/memory/numa/nodes"), std::to_string(size_t(node_count)));
+
+    for(size_t node = 0; node < node_count; ++node){
+        node_ids[node] = node;
+
+        auto base_path = path("/memory/numa") / std::to_string(node);
+
+        sysfs::set_dynamic_value_data(path("/sys"), base_path / "cpus", &sysfs_cpus, &node_ids[node]);
+        sysfs::set_dynamic_value_data(path("/sys"), base_path / "distances", &sysfs_distances, &node_ids[node]);
+        sysfs::set_dynamic_value_data(path("/sys"), base_path / "size", &sysfs_size, &node_ids[node]);
+        sysfs::set_dynamic_value_data(path("/sys"), base_path / "free", &sysfs_free, &node_ids[node]);
+        sysfs::set_dynamic_value_data(path("/sys"), base_path / "used", &sysfs_used, &node_ids[node]);
+    }
+}
+
+size_t numa::nodes(){
+    return node_count;
+}
+
+size_t numa::cpu_node(size_t cpu){
+    return cpu_nodes[cpu];
+}
+
+size_t numa::current_node(){
+    return cpu_nodes[smp::current_cpu()];
+}
+
+size_t numa::range_node(size_t first, size_t last){
+    std::array<size_t, MAX_NODES> overlaps;
+    std::fill_n(overlaps.begin(), MAX_NODES, 0);
+
+    for(size_t i = 0; i < range_count; ++i){
+        auto& range = ranges[i];
+
+        auto start = std::max(first, range.first);
+        auto end = std::min(last, range.last);
+
+        if(start < end){
+            overlaps[range.node] += end - start;
+        }
+    }
+
+    size_t best = 0;
+
+    for(size_t node = 1; node < node_count; ++node){
+        if(overlaps[node] > overlaps[best]){
+            best = node;
+        }
+    }
+
+    return best;
+}
+
+uint8_t numa::distance(size_t from, size_t to){
+    return distances[from][to];
+}
@@ -0,0 +1,391 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <string.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "page_cache.hpp"
+#include "physical_allocator.hpp"
+#include "physical_pointer.hpp"
+#include "paging.hpp"
+#include "logging.hpp"
+#include "shrinker.hpp"
+
+#include "conc/int_spinlock.hpp"
+
+#include "vfs/file_system.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t MAX_PAGES = 2048;  ///< The maximum number of cached pages
+constexpr const size_t BUCKETS = 512;     ///< The number of buckets of the hash table
+constexpr const size_t NO_ENTRY = MAX_PAGES; ///< Marks the end of a chain
+constexpr const size_t LOW_MEMORY = 4 * 1024 * 1024; ///< Below this free memory, the cache does not grow
+
+/*!
+ * \brief A cached page of a file
+ */
+struct entry_t {
+    vfs::file_system* fs; ///< The mounted file system
+    size_t location;      ///< The location of the file inside the file system
+    size_t page;          ///< The index of the page in the file
+    size_t physical;      ///< The physical page, 0 if the entry is free
+    size_t next;          ///< The next entry of the bucket or of the free list
+    bool referenced;      ///< Indicates if the page was used since the clock last passed
+};
+
+std::array<entry_t, MAX_PAGES> entries;
+std::array<size_t, BUCKETS> buckets;
+
+size_t free_head = NO_ENTRY; ///< The first free entry
+size_t hand = 0;             ///< The clock hand of the eviction
+size_t cached = 0;           ///< The number of cached pages
+size_t generation = 0;       ///< The number of invalidations
+
+int_spinlock lock; ///< Protect the entries, never held during I/O
+
+volatile size_t hits = 0;      ///< The number of pages found in the cache
+volatile size_t misses = 0;    ///< The number of pages read from their file
+volatile size_t evictions = 0; ///< The number of pages evicted to make room
+
+uint64_t sysfs_pages(){
+    return cached;
+}
+
+// The pages still mapped by processes are counted as well, they are skipped by the eviction
+size_t reclaimable_pages(){
+    return cached;
+}
+
+uint64_t sysfs_hits(){
+    return hits;
+}
+
+uint64_t sysfs_misses(){
+    return misses;
+}
+
+uint64_t sysfs_evictions(){
+    return evictions;
+}
+
+size_t bucket(vfs::file_system* fs, size_t location, size_t page){
+    auto key = reinterpret_cast<size_t>(fs) ^ (location * 0x9E3779B97F4A7C15) ^ (page * 0xC2B2AE3D27D4EB4F);
+    return (key ^ (key >> 29)) % BUCKETS;
+}
+
+/*!
+ * \brief Returns the entry of the given page, NO_ENTRY if it is not cached
+ */
+size_t find(vfs::file_system* fs, size_t location, size_t page){
+    auto i = buckets[bucket(fs, location, page)];
+
+    while(i != NO_ENTRY){
+        auto& entry = entries[i];
+
+        if(entry.fs == fs && entry.location == location && entry.page == page){
+            return i;
+        }
+
+        i = entry.next;
+    }
+
+    return NO_ENTRY;
+}
+
+/*!
+ * \brief Remove the entry from its bucket and put it back in the free list
+ */
+void remove(size_t index){
+    auto& entry = entries[index];
+    auto* link = &buckets[bucket(entry.fs, entry.location, entry.page)];
+
+    while(*link != index){
+        link = &entries[*link].next;
+    }
+
+    *link = entry.next;
+
+    // The owners still mapping the page keep it alive
+    physical_allocator::release(entry.physical, 1);
+
+    entry.physical = 0;
+    entry.next = free_head;
+    free_head = index;
+
+    --cached;
+}
+
+/*!
+ * \brief Evict a page only owned by the cache and not used recently
+ * \return true if an entry has been freed, false if every page is in use
+ */
+bool evict(){
+    // The first pass clears the referenced bits, the second one finds them cleared
+    for(size_t i = 0; i < 2 * MAX_PAGES; ++i){
+        auto index = hand;
+        hand = (hand + 1) % MAX_PAGES;
+
+        auto& entry = entries[index];
+
+        if(!entry.physical || physical_allocator::shared(entry.physical)){
+            continue;
+        }
+
+        if(entry.referenced){
+            entry.referenced = false;
+            continue;
+        }
+
+        remove(index);
+        ++evictions;
+
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief Read the given page of the file into a new physical page
+ * \return The physical page, 0 if it cannot be read
+ */
+size_t read_page(const page_cache::source& source, size_t page){
+    auto offset = page * paging::PAGE_SIZE;
+
+    if(offset >= source.size){
+        return 0;
+    }
+
+    // The end of the last page stays zero
+    auto physical = physical_allocator::allocate_zeroed(1);
+
+    if(!physical){
+        return 0;
+    }
+
+    physical_pointer page_ptr(physical, 1);
+
+    if(!page_ptr){
+        physical_allocator::free(physical, 1);
+        return 0;
+    }
+
+    auto count = std::min(paging::PAGE_SIZE, source.size - offset);
+
+    size_t read = 0;
+    auto result = source.fs->read(source.fs_path, page_ptr.as_ptr<char>(), count, offset, read);
+
+    if(result || read != count){
+        logging::logf(logging::log_level::ERROR, "page_cache: Cannot read page %u of %s\n", page, source.fs_path.string().c_str());
+
+        physical_allocator::free(physical, 1);
+        return 0;
+    }
+
+    return physical;
+}
+
+} //end of anonymous namespace
+
+void page_cache::init(){
+    lock.set_name("page_cache");
+
+    for(size_t i = 0; i < BUCKETS; ++i){
+        buckets[i] = NO_ENTRY;
+    }
+
+    // The lowest entries are used first
+    for(size_t i = MAX_PAGES; i > 0; --i){
+        entries[i - 1].physical = 0;
+        entries[i - 1].next = free_head;
+        free_head = i - 1;
+    }
+
+    sysfs::set_counter_value(path("/sys"), path("/memory/page_cache/pages"), &sysfs_pages);
+    sysfs::set_counter_value(path("/sys"), path("/memory/page_cache/hits"), &sysfs_hits);
+    sysfs::set_counter_value(path("/sys"), path("/memory/page_cache/misses"), &sysfs_misses);
+    sysfs::set_counter_value(path("/sys"), path("/memory/page_cache/evictions"), &sysfs_evictions);
+
+    shrinker::add("page_cache", &reclaimable_pages, &page_cache::shrink);
+}
+
+size_t page_cache::get(const source& source, size_t page){
+    size_t read_generation;
+
+    {
+        std::lock_guard<int_spinlock> l(lock);
+
+        read_generation = generation;
+
+        auto index = find(source.fs, source.location, page);
+
+        if(index != NO_ENTRY){
+            auto& entry = entries[index];
+
+            entry.referenced = true;
+            physical_allocator::share(entry.physical);
+
+            ++hits;
+
+            return entry.physical;
+        }
+    }
+
+    ++misses;
+
+    auto physical = read_page(source, page);
+
+    if(!physical){
+        return 0;
+    }
+
+    std::lock_guard<int_spinlock> l(lock);
+
+    // Another process may have read the same page in the meantime
+    auto index = find(source.fs, source.location, page);
+
+    if(index != NO_ENTRY){
+        auto& entry = entries[index];
+
+        physical_allocator::free(physical, 1);
+
+        entry.referenced = true;
+        physical_allocator::share(entry.physical);
+
+        return entry.physical;
+    }
+
+    // A page read during an invalidation may be stale, it is not cached.
+    // Without room, the page is only owned by the caller as well
+    if(read_generation != generation){
+        return physical;
+    }
+
+    // Under memory pressure, a new page replaces an old one
+    if(free_head == NO_ENTRY || physical_allocator::free() < LOW_MEMORY){
+        if(!evict()){
+            return physical;
+        }
+    }
+
+    index = free_head;
+
+    auto& entry = entries[index];
+    free_head = entry.next;
+
+    auto& head = buckets[bucket(source.fs, source.location, page)];
+
+    entry.fs = source.fs;
+    entry.location = source.location;
+    entry.page = page;
+    entry.physical = physical;
+    entry.referenced = true;
+    entry.next = head;
+    head = index;
+
+    ++cached;
+
+    // One owner for the cache and one for the caller
+    physical_allocator::share(physical);
+
+    return physical;
+}
+
+size_t page_cache::get_cached(const source& source, size_t page){
+    std::lock_guard<int_spinlock> l(lock);
+
+    auto index = find(source.fs, source.location, page);
+
+    if(index == NO_ENTRY){
+        return 0;
+    }
+
+    auto& entry = entries[index];
+
+    entry.referenced = true;
+    physical_allocator::share(entry.physical);
+
+    ++hits;
+
+    return entry.physical;
+}
+
+std::expected<size_t> page_cache::read(const source& source, char* buffer, size_t count, size_t offset){
+    if(offset > source.size){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_OFFSET);
+    }
+
+    count = std::min(count, source.size - offset);
+
+    size_t read = 0;
+
+    while(read < count){
+        auto page = (offset + read) / paging::PAGE_SIZE;
+        auto page_offset = (offset + read) % paging::PAGE_SIZE;
+        auto bytes = std::min(paging::PAGE_SIZE - page_offset, count - read);
+
+        auto physical = get(source, page);
+
+        if(!physical){
+            return std::make_unexpected<size_t>(std::ERROR_FAILED);
+        }
+
+        {
+            physical_pointer page_ptr(physical, 1);
+
+            if(!page_ptr){
+                physical_allocator::release(physical, 1);
+                return std::make_unexpected<size_t>(std::ERROR_FAILED);
+            }
+
+            std::copy_n(page_ptr.as_ptr<char>() + page_offset, bytes, buffer + read);
+        }
+
+        physical_allocator::release(physical, 1);
+
+        read += bytes;
+    }
+
+    return read;
+}
+
+size_t page_cache::shrink(size_t pages){
+    std::lock_guard<int_spinlock> l(lock);
+
+    size_t evicted = 0;
+
+    while(evicted < pages && evict()){
+        ++evicted;
+    }
+
+    return evicted;
+}
+
+void page_cache::invalidate(vfs::file_system* fs, size_t location){
+    std::lock_guard<int_spinlock> l(lock);
+
+    ++generation;
+
+    for(size_t i = 0; i < MAX_PAGES; ++i){
+        auto& entry = entries[i];
+
+        if(entry.physical && entry.fs == fs && entry.location == location){
+            remove(i);
+        }
+    }
+}
+
+bool page_cache::empty(){
+    return !cached;
+}
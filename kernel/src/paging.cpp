@@ -19,6 +19,14 @@
 #include "kernel_utils.hpp"
 #include "logging.hpp"
 #include "early_memory.hpp"
+#include "arch.hpp"
+#include "smp.hpp"
+#include "cpu_features.hpp"
+#include "tlb_shootdown.hpp"
+
+#include "conc/int_lock.hpp"
+
+#include "drivers/apic.hpp"
 
 #include "fs/sysfs.hpp"
 
@@ -30,8 +38,17 @@ size_t paging::virtual_pdpt_start;
 size_t paging::virtual_pd_start;
 size_t paging::virtual_pt_start;
 
+volatile uint64_t tlb_shootdown::pending = 0;
+
 namespace {
 
+constexpr const uint32_t MSR_PAT = 0x277;
+
+// WB, WC, UC-, UC for the entries 0-3 and again for 4-7, the entry 1 was WT
+constexpr const uint64_t PAT_VALUE = 0x0007010600070106;
+
+bool pat = false; ///< Indicates if the page attribute table is programmed
+
 typedef uint64_t* page_entry;
 typedef page_entry* pt_t;
 typedef pt_t* pd_t;
@@ -85,10 +102,351 @@ pt_t find_pt(pd_t pd, size_t pde){
     return reinterpret_cast<pt_t>(virtual_pt);
 }
 
-inline void flush_tlb(size_t page){
+constexpr const size_t CR4_PGE = 1 << 7;            ///< The CR4 flag enabling the global pages
+constexpr const size_t CR4_PCIDE = 1 << 17;         ///< The CR4 flag enabling the process-context identifiers
+constexpr const size_t CR3_NO_FLUSH = 1ULL << 63;    ///< The CR3 flag keeping the TLB entries of the loaded PCID
+constexpr const size_t PCID_SLOTS = 16;              ///< The number of address spaces tagged in the TLB of each processor
+
+/*!
+ * \brief The address spaces tagged in the TLB of a processor.
+ *
+ * The PCID of a slot is its index plus one, the PCID 0 is only used
+ * during boot. The kernel pages are global, only the user pages are
+ * tagged.
+ */
+struct pcid_cpu_t {
+    bool enabled = false;                       ///< Indicates if CR4.PCIDE is set on the processor
+    size_t loaded = 0;                          ///< The address space loaded on the processor
+    scheduler::process_t* owner = nullptr;      ///< The owner of the loaded address space
+    size_t next = 0;                            ///< The next slot to evict
+    std::array<size_t, PCID_SLOTS> slots;       ///< The address space of each slot, 0 if none
+    std::array<size_t, PCID_SLOTS> generations; ///< The TLB generation of the address space each slot is valid for
+};
+
+std::array<pcid_cpu_t, smp::MAX_CPUS> pcid_cpus;
+
+bool invpcid = false; ///< Indicates if the invpcid instruction is supported
+
+volatile size_t address_spaces = paging::KERNEL_ADDRESS_SPACE; ///< The last allocated address space
+
+volatile size_t pcid_hits = 0;   ///< The number of switches that kept the TLB entries of the address space
+volatile size_t pcid_misses = 0; ///< The number of switches that flushed the TLB entries of the address space
+
+std::string sysfs_pcid_hits(){
+    return std::to_string(pcid_hits);
+}
+
+std::string sysfs_pcid_misses(){
+    return std::to_string(pcid_misses);
+}
+
+/*!
+ * \brief Invalidate a page of the current PCID, or a global page in every PCID
+ */
+inline void invalidate_page(size_t page){
     asm volatile("invlpg [%0]" :: "r" (page) : "memory");
 }
 
+/*!
+ * \brief Flush all the non-global TLB entries of the current PCID, by reloading CR3
+ */
+inline void invalidate_all(){
+    asm volatile("mov rax, cr3; mov cr3, rax" ::: "rax", "memory");
+}
+
+/*!
+ * \brief Flush all the TLB entries of every PCID, the global ones included,
+ * by toggling CR4.PGE
+ */
+inline void invalidate_global(){
+    asm volatile("mov rax, cr4; xor rax, %0; mov cr4, rax; xor rax, %0; mov cr4, rax" :: "r" (CR4_PGE) : "rax", "memory");
+}
+
+inline void flush_tlb(size_t page){
+    invalidate_page(page);
+}
+
+/*!
+ * \brief Flush the TLB entries of the given PCID with invpcid (single context)
+ */
+inline void flush_pcid(size_t pcid){
+    struct {
+        uint64_t pcid;
+        uint64_t address;
+    } __attribute__((packed)) descriptor = {pcid, 0};
+
+    asm volatile("invpcid %0, [%1]" :: "r" (size_t(1)), "r" (&descriptor) : "memory");
+}
+
+/*!
+ * \brief Flush the TLB entry of a page of the given PCID with invpcid
+ * (individual address), the PCID does not need to be loaded
+ */
+inline void flush_pcid_page(size_t pcid, size_t page){
+    struct {
+        uint64_t pcid;
+        uint64_t address;
+    } __attribute__((packed)) descriptor = {pcid, page};
+
+    asm volatile("invpcid %0, [%1]" :: "r" (size_t(0)), "r" (&descriptor) : "memory");
+}
+
+constexpr const size_t FLUSH_THRESHOLD = 32; ///< Beyond this number of pages, the whole TLB is flushed
+
+/*!
+ * \brief Flush the TLB entries of a range of kernel pages, in every PCID.
+ *
+ * The kernel pages are global, invlpg flushes them from every PCID. Past
+ * the threshold, flushing the whole TLB is cheaper than invalidating each
+ * page. It also flushes the paging-structure caches of every PCID, the
+ * PD entries changed with the large pages are only flushed this way.
+ */
+void flush_tlb_range(size_t virt, size_t pages){
+    if(pages > FLUSH_THRESHOLD){
+        invalidate_global();
+    } else {
+        for(size_t page = 0; page < pages; ++page){
+            invalidate_page(virt + page * paging::PAGE_SIZE);
+        }
+    }
+}
+
+/*!
+ * \brief Flush the TLB entries of a range of user pages of the loaded PCID.
+ *
+ * Past the threshold, reloading CR3 is cheaper, it keeps the global pages.
+ *
+ * \param pages The number of pages of the range, 0 for the whole address space
+ */
+void invalidate_user_range(size_t virt, size_t pages){
+    if(!pages || pages > FLUSH_THRESHOLD){
+        invalidate_all();
+    } else {
+        for(size_t page = 0; page < pages; ++page){
+            invalidate_page(virt + page * paging::PAGE_SIZE);
+        }
+    }
+}
+
+/*!
+ * \brief The TLB shootdown request of a processor, it sends one at a time
+ */
+struct shootdown_request {
+    size_t address_space;      ///< The address space of the user pages, 0 for kernel pages
+    size_t virt;               ///< The first page of the range
+    size_t pages;              ///< The number of pages of the range
+    volatile uint64_t waiting; ///< The mask of the processors that have not flushed the range yet
+};
+
+std::array<shootdown_request, smp::MAX_CPUS> requests; ///< The request of each processor
+std::array<volatile uint64_t, smp::MAX_CPUS> incoming; ///< The mask of the processors with a request for each processor
+
+volatile size_t shootdowns = 0; ///< The number of ranges flushed on the other processors
+
+std::string sysfs_shootdowns(){
+    return std::to_string(shootdowns);
+}
+
+/*!
+ * \brief Flush a range of pages on the given online processors, except
+ * the current one, and wait until they have all flushed it.
+ *
+ * The requests of the other processors are handled while waiting, they
+ * may be waiting for this processor as well.
+ *
+ * \param address_space The address space of the user pages, 0 for kernel pages
+ * \param cpus The mask of the processors that may cache the range
+ */
+void shootdown(size_t address_space, uint64_t cpus, size_t virt, size_t pages){
+    direct_int_lock lock;
+
+    auto cpu = smp::current_cpu();
+    auto targets = cpus & smp::online_mask() & ~(uint64_t(1) << cpu);
+
+    if(!targets){
+        return;
+    }
+
+    auto& request = requests[cpu];
+
+    request.address_space = address_space;
+    request.virt = virt;
+    request.pages = pages;
+    __atomic_store_n(&request.waiting, targets, __ATOMIC_SEQ_CST);
+
+    // The request must be visible before the pending flag is polled
+    for(size_t target = 0; target < smp::MAX_CPUS; ++target){
+        if(targets & (uint64_t(1) << target)){
+            __atomic_or_fetch(&incoming[target], uint64_t(1) << cpu, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    __atomic_or_fetch(&tlb_shootdown::pending, targets, __ATOMIC_SEQ_CST);
+
+    for(size_t target = 0; target < smp::MAX_CPUS; ++target){
+        if(targets & (uint64_t(1) << target)){
+            apic::send_ipi(smp::apic_id(target), apic::SHOOTDOWN_IRQ);
+        }
+    }
+
+    __sync_fetch_and_add(&shootdowns, 1);
+
+    while(__atomic_load_n(&request.waiting, __ATOMIC_ACQUIRE)){
+        arch::pause();
+    }
+}
+
+/*!
+ * \brief Flush the TLB entries of a range of kernel pages on every
+ * processor.
+ *
+ * The range is unmapped from all the processors when this returns, its
+ * virtual addresses and its frames can then be reused.
+ */
+void flush_kernel_range(size_t virt, size_t pages){
+    flush_tlb_range(virt, pages);
+    shootdown(0, smp::online_mask(), virt, pages);
+}
+
+/*!
+ * \brief Flush the TLB entries of a range of user pages of the process on
+ * every processor and record the invalidation in its address space.
+ *
+ * The processors with the address space loaded flush the range right
+ * away, in a shootdown. The other processors flush the PCID of the
+ * address space the next time they load it, the TLB generation has
+ * changed. The current processor flushes the range from its PCID
+ * directly, even when the address space is not loaded, and keeps the
+ * other entries.
+ *
+ * The generation is incremented before the loaded processors are read,
+ * while switch_cr3() sets the processor before reading the generation.
+ * A processor loading the address space concurrently is therefore either
+ * sent the shootdown or sees the new generation.
+ *
+ * \param process The owner of the address space
+ * \param pages The number of pages of the range, 0 for the whole address space
+ */
+void flush_user_range(scheduler::process_t& process, size_t virt, size_t pages){
+    direct_int_lock lock;
+
+    auto& cpu = pcid_cpus[smp::current_cpu()];
+    auto generation = __sync_add_and_fetch(&process.tlb_generation, 1);
+    bool all = !pages || pages > FLUSH_THRESHOLD;
+
+    if(cpu.loaded == process.address_space){
+        invalidate_user_range(virt, pages);
+    }
+
+    if(cpu.enabled){
+        for(size_t i = 0; i < PCID_SLOTS; ++i){
+            if(cpu.slots[i] != process.address_space){
+                continue;
+            }
+
+            if(cpu.loaded != process.address_space){
+                if(!invpcid){
+                    // The PCID is flushed the next time it is loaded
+                    cpu.slots[i] = 0;
+                    continue;
+                }
+
+                if(all){
+                    flush_pcid(i + 1);
+                } else {
+                    for(size_t page = 0; page < pages; ++page){
+                        flush_pcid_page(i + 1, virt + page * paging::PAGE_SIZE);
+                    }
+                }
+            }
+
+            // The PCID holds no stale entry on this processor
+            cpu.generations[i] = generation;
+        }
+    }
+
+    shootdown(process.address_space, __atomic_load_n(&process.tlb_cpus, __ATOMIC_SEQ_CST), virt, pages);
+}
+
+/*!
+ * \brief Returns the number of pages of the range that are inside the PT
+ * of its first page
+ */
+size_t pt_pages(size_t virt, size_t pages){
+    return std::min(pages, size_t(512) - pt_entry(virt));
+}
+
+constexpr const uintptr_t table_flags = paging::PRESENT | paging::WRITE | paging::USER; ///< The flags of a kernel entry pointing to a table
+
+bool is_large(pt_t pd_entry){
+    return reinterpret_cast<uintptr_t>(pd_entry) & paging::LARGE;
+}
+
+/*!
+ * \brief Returns the PD entry of the given kernel virtual address.
+ *
+ * The PML4T, PDPT and PD entries of the kernel are always present.
+ */
+pt_t& find_pd_entry(size_t virt){
+    auto pml4t = find_pml4t();
+    auto pdpt = find_pdpt(pml4t, pml4_entry(virt));
+    auto pd = find_pd(pdpt, pdpt_entry(virt));
+
+    return pd[pd_entry(virt)];
+}
+
+/*!
+ * \brief Returns the physical address of the PT preallocated for the given kernel virtual address
+ */
+size_t kernel_physical_pt(size_t virt){
+    return physical_pt_start + (virt / paging::LARGE_PAGE_SIZE) * paging::PAGE_SIZE;
+}
+
+/*!
+ * \brief Returns the PT preallocated for the given kernel virtual address
+ */
+pt_t kernel_pt(size_t virt){
+    return reinterpret_cast<pt_t>(paging::virtual_pt_start + (virt / paging::LARGE_PAGE_SIZE) * paging::PAGE_SIZE);
+}
+
+/*!
+ * \brief Indicates if no page is mapped in the PT of the given kernel virtual address
+ */
+bool kernel_pt_empty(size_t virt){
+    auto pt = kernel_pt(virt);
+
+    for(size_t i = 0; i < 512; ++i){
+        if(pt[i]){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Replace the large page containing the given address by the 512
+ * pages of its PT
+ */
+void split_large(size_t virt){
+    auto base = virt & ~(paging::LARGE_PAGE_SIZE - 1);
+
+    auto& pd_entry = find_pd_entry(base);
+    auto value = reinterpret_cast<uintptr_t>(pd_entry);
+    auto physical = value & ~(paging::LARGE_PAGE_SIZE - 1);
+    auto flags = value & (0xFF | paging::GLOBAL) & ~uintptr_t(paging::LARGE);
+
+    // The PT is filled before it is used, the pages are never unmapped
+    auto pt = kernel_pt(base);
+    for(size_t i = 0; i < 512; ++i){
+        pt[i] = reinterpret_cast<page_entry>((physical + i * paging::PAGE_SIZE) | flags);
+    }
+
+    pd_entry = reinterpret_cast<pt_t>(kernel_physical_pt(base) | table_flags);
+
+    flush_tlb(base);
+}
+
 size_t early_map_page(size_t physical){
     thor_assert(paging::virtual_early_page < 0x100000, "Invalid early page");
 
@@ -114,8 +472,249 @@ size_t early_map_page_clear(size_t physical){
     return virt;
 }
 
+/*!
+ * \brief Returns the physical address of the table pointed by the given
+ * entry of a table of the process, allocating it if necessary
+ * \return The physical address of the table, 0 if it cannot be allocated
+ */
+size_t user_table(scheduler::process_t& process, size_t physical_table, size_t index){
+    physical_pointer table_ptr(physical_table, 1);
+
+    if(!table_ptr){
+        return 0;
+    }
+
+    auto table = table_ptr.as_ptr<uintptr_t>();
+
+    if(!(table[index] & paging::PRESENT)){
+        auto physical = physical_allocator::allocate_zeroed(1);
+
+        if(!physical){
+            return 0;
+        }
+
+        table[index] = physical | paging::WRITE | paging::USER | paging::PRESENT;
+
+        // The tables are released with the process
+        process.paging_size += paging::PAGE_SIZE;
+        process.segments.emplace_back(physical, paging::PAGE_SIZE, true);
+    }
+
+    return table[index] & ~0xFFF;
+}
+
+/*!
+ * \brief Returns the physical address of the PD of the process for the
+ * given virtual address, allocating the missing tables
+ * \return The physical address of the PD, 0 if it cannot be allocated
+ */
+size_t user_pd(scheduler::process_t& process, size_t virt){
+    auto physical_pdpt = user_table(process, process.physical_cr3, pml4_entry(virt));
+    return physical_pdpt ? user_table(process, physical_pdpt, pdpt_entry(virt)) : 0;
+}
+
+/*!
+ * \brief Returns the physical address of the PT of the process for the
+ * given virtual address, allocating the missing tables
+ * \return The physical address of the PT, 0 if it cannot be allocated
+ */
+size_t user_pt(scheduler::process_t& process, size_t virt){
+    auto physical_pd = user_pd(process, virt);
+    return physical_pd ? user_table(process, physical_pd, pd_entry(virt)) : 0;
+}
+
+/*!
+ * \brief Returns the entry to share a page, a writable page becomes copy-on-write
+ */
+uintptr_t share_entry(uintptr_t entry){
+    if(entry & paging::WRITE){
+        return (entry & ~uintptr_t(paging::WRITE)) | paging::COPY_ON_WRITE;
+    }
+
+    return entry;
+}
+
+/*!
+ * \brief Share the entries of a PT of the source process with the target process
+ */
+bool share_pt(scheduler::process_t& target, size_t virt, size_t physical_source_pt){
+    auto physical_target_pt = user_pt(target, virt);
+
+    if(!physical_target_pt){
+        return false;
+    }
+
+    physical_pointer source_ptr(physical_source_pt, 1);
+    physical_pointer target_ptr(physical_target_pt, 1);
+
+    if(!source_ptr || !target_ptr){
+        return false;
+    }
+
+    auto source_pt = source_ptr.as_ptr<uintptr_t>();
+    auto target_pt = target_ptr.as_ptr<uintptr_t>();
+
+    for(size_t pte = 0; pte < 512; ++pte){
+        if(source_pt[pte] & paging::PRESENT){
+            source_pt[pte] = share_entry(source_pt[pte]);
+            target_pt[pte] = source_pt[pte];
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Set the PT entry of the given virtual page of the process
+ */
+bool user_map_entry(scheduler::process_t& process, size_t virt, size_t entry){
+    auto pte = pt_entry(virt);
+
+    auto physical_pt = user_pt(process, virt);
+
+    if(!physical_pt){
+        return false;
+    }
+
+    physical_pointer pt_ptr(physical_pt, 1);
+
+    if(!pt_ptr){
+        return false;
+    }
+
+    auto pt = pt_ptr.as<pt_t>();
+
+    //Map to the physical address
+    pt[pte] = reinterpret_cast<page_entry>(entry);
+
+    return true;
+}
+
 } //end of anonymous namespace
 
+void paging::init_pat(){
+    if(!cpu_features::has(tlib::cpu_feature::PAT)){
+        return;
+    }
+
+    // The caches must not hold lines of the previous memory types
+    asm volatile("wbinvd" ::: "memory");
+    arch::write_msr(MSR_PAT, PAT_VALUE);
+    asm volatile("wbinvd; mov rax, cr3; mov cr3, rax" ::: "rax", "memory");
+
+    pat = true;
+}
+
+bool paging::write_combining(){
+    return pat;
+}
+
+void paging::init_pcid(size_t cpu){
+    if(!cpu_features::has(tlib::cpu_feature::PCID)){
+        return;
+    }
+
+    invpcid = cpu_features::has(tlib::cpu_feature::INVPCID);
+
+    // CR3 still holds the PCID 0, as required to set CR4.PCIDE
+    asm volatile("mov rax, cr4; or rax, %0; mov cr4, rax" :: "r" (CR4_PCIDE) : "rax", "memory");
+
+    pcid_cpus[cpu].enabled = true;
+}
+
+void paging::init_global_pages(){
+    asm volatile("mov rax, cr4; or rax, %0; mov cr4, rax" :: "r" (CR4_PGE) : "rax", "memory");
+}
+
+void paging::flush_tlb_local(){
+    invalidate_global();
+}
+
+size_t paging::new_address_space(){
+    return __sync_add_and_fetch(&address_spaces, 1);
+}
+
+size_t paging::switch_cr3(scheduler::process_t& process){
+    auto current = smp::current_cpu();
+    auto& cpu = pcid_cpus[current];
+
+    if(cpu.owner != &process || cpu.loaded != process.address_space){
+        auto bit = uint64_t(1) << current;
+
+        if(cpu.owner){
+            __atomic_and_fetch(&cpu.owner->tlb_cpus, ~bit, __ATOMIC_SEQ_CST);
+        }
+
+        // From now on, the invalidations of the address space are sent to this processor
+        __atomic_or_fetch(&process.tlb_cpus, bit, __ATOMIC_SEQ_CST);
+
+        cpu.owner = &process;
+        cpu.loaded = process.address_space;
+    }
+
+    if(!cpu.enabled){
+        return process.physical_cr3;
+    }
+
+    auto generation = process.tlb_generation;
+
+    for(size_t i = 0; i < PCID_SLOTS; ++i){
+        if(cpu.slots[i] == process.address_space){
+            // The user pages of the address space have been invalidated since the slot was loaded
+            if(cpu.generations[i] != generation){
+                cpu.generations[i] = generation;
+                ++pcid_misses;
+                return process.physical_cr3 | (i + 1);
+            }
+
+            ++pcid_hits;
+            return process.physical_cr3 | (i + 1) | CR3_NO_FLUSH;
+        }
+    }
+
+    // Prefer a free slot, otherwise evict in round-robin order
+    size_t slot = cpu.next;
+    for(size_t i = 0; i < PCID_SLOTS; ++i){
+        if(!cpu.slots[i]){
+            slot = i;
+            break;
+        }
+    }
+
+    if(slot == cpu.next){
+        cpu.next = (cpu.next + 1) % PCID_SLOTS;
+    }
+
+    cpu.slots[slot] = process.address_space;
+    cpu.generations[slot] = generation;
+    ++pcid_misses;
+
+    // Without the no-flush flag, the stale entries of the PCID are flushed
+    return process.physical_cr3 | (slot + 1);
+}
+
+void paging::release_address_space(size_t address_space){
+    size_t rflags;
+    arch::disable_hwint(rflags);
+
+    auto& cpu = pcid_cpus[smp::current_cpu()];
+
+    if(cpu.enabled){
+        for(size_t i = 0; i < PCID_SLOTS; ++i){
+            if(cpu.slots[i] == address_space){
+                // The other processors never load this address space anymore, its slots are evicted in time
+                if(invpcid){
+                    flush_pcid(i + 1);
+                }
+
+                cpu.slots[i] = 0;
+            }
+        }
+    }
+
+    arch::enable_hwint(rflags);
+}
+
 void paging::early_init(){
     logging::logf(logging::log_level::TRACE, "Kernel occupies %u MiB from %h\n", uint64_t(early::kernel_mib()), uint64_t(early::kernel_address));
 
@@ -197,7 +796,7 @@ void paging::init(){
     auto current_pt_phys = physical_pt_start;
     virt = early_map_page_clear(current_pt_phys);
     auto page_table_ptr = reinterpret_cast<uint64_t*>(virt);
-    auto phys = PRESENT | WRITE;
+    auto phys = PRESENT | WRITE | GLOBAL;
     for(size_t i = 0; i < 256 + 256 * early::kernel_mib(); ++i){
         *page_table_ptr = phys;
 
@@ -232,7 +831,7 @@ void paging::init(){
             current_virt = early_map_page(physical);
         }
 
-        (reinterpret_cast<pt_t>(current_virt))[pte] = reinterpret_cast<page_entry>(phys_page | PRESENT | WRITE);
+        (reinterpret_cast<pt_t>(current_virt))[pte] = reinterpret_cast<page_entry>(phys_page | PRESENT | WRITE | GLOBAL);
 
         current_pt_index = pt_index;
 
@@ -275,6 +874,10 @@ void paging::finalize(){
     sysfs::set_constant_value(path("/sys"), path("/paging/pd"), std::to_string(paging::pdpt_entries));
     sysfs::set_constant_value(path("/sys"), path("/paging/pt"), std::to_string(paging::pd_entries));
     sysfs::set_constant_value(path("/sys"), path("/paging/physical_size"), std::to_string(paging::physical_memory_pages * paging::PAGE_SIZE));
+    sysfs::set_constant_value(path("/sys"), path("/paging/pcid"), pcid_cpus[0].enabled ? "true" : "false");
+    sysfs::set_dynamic_value(path("/sys"), path("/paging/pcid_hits"), &sysfs_pcid_hits);
+    sysfs::set_dynamic_value(path("/sys"), path("/paging/pcid_misses"), &sysfs_pcid_misses);
+    sysfs::set_dynamic_value(path("/sys"), path("/paging/shootdowns"), &sysfs_shootdowns);
 }
 
 size_t paging::pages(size_t size){
@@ -288,7 +891,7 @@ size_t paging::physical_address(size_t virt){
     }
 
     // Offset inside the page
-    auto offset = virt & uint64_t((1 << 13) - 1);
+    auto offset = virt & uint64_t(PAGE_SIZE - 1);
 
     //Find the correct indexes inside the paging table for the physical address
     auto pml4e = pml4_entry(virt);
@@ -299,6 +902,12 @@ size_t paging::physical_address(size_t virt){
     auto pml4t = find_pml4t();
     auto pdpt = find_pdpt(pml4t, pml4e);
     auto pd = find_pd(pdpt, pdpte);
+
+    if(is_large(pd[pde])){
+        auto large_offset = virt & uint64_t(LARGE_PAGE_SIZE - 1);
+        return large_offset + (reinterpret_cast<uintptr_t>(pd[pde]) & ~(LARGE_PAGE_SIZE - 1));
+    }
+
     auto pt = find_pt(pd, pde);
 
     return offset + (reinterpret_cast<uintptr_t>(pt[pte]) & ~0xFFF);
@@ -326,6 +935,10 @@ bool paging::page_present(size_t virt){
         return false;
     }
 
+    if(is_large(pd[pde])){
+        return true;
+    }
+
     auto pt = find_pt(pd, pde);
     return reinterpret_cast<uintptr_t>(pt[pte]) & PRESENT;
 }
@@ -363,17 +976,22 @@ bool paging::map(size_t virt, size_t physical, uint8_t flags){
     auto pd = find_pd(pdpt, pdpte);
     thor_assert(reinterpret_cast<uintptr_t>(pd[pde]) & PRESENT, "A PD entry is not PRESENT");
 
+    //The page may be part of a large page
+    if(is_large(pd[pde])){
+        return physical_address(virt) == physical;
+    }
+
     auto pt = find_pt(pd, pde);
 
     //Check if the page is already present
     if(reinterpret_cast<uintptr_t>(pt[pte]) & PRESENT){
         //If the page is already set to the correct value, return true
         //If the page is set to another value, return false
-        return reinterpret_cast<uintptr_t>(pt[pte]) == (physical | flags);
+        return reinterpret_cast<uintptr_t>(pt[pte]) == (physical | flags | GLOBAL);
     }
 
     //Map to the physical address
-    pt[pte] = reinterpret_cast<page_entry>(physical | flags);
+    pt[pte] = reinterpret_cast<page_entry>(physical | flags | GLOBAL);
 
     //Flush TLB
     flush_tlb(virt);
@@ -388,24 +1006,77 @@ bool paging::map_pages(size_t virt, size_t physical, size_t pages, uint8_t flags
     }
 
     //To avoid mapping only a subset of the pages
-    //check if one of the page is already mapped to another value
-    for(size_t page = 0; page < pages; ++page){
+    //check if one of the page is already mapped to another value, one PT at a time
+    for(size_t page = 0; page < pages;){
         auto virt_addr = virt + page * PAGE_SIZE;
         auto phys_addr = physical + page * PAGE_SIZE;
-
-        if(!page_free_or_set(virt_addr, phys_addr)){
-            return false;
+        auto count = pt_pages(virt_addr, pages - page);
+
+        auto pd_entry = find_pd_entry(virt_addr);
+
+        if(is_large(pd_entry)){
+            //The range is contiguous, its first page is enough
+            if(physical_address(virt_addr) != phys_addr){
+                return false;
+            }
+        } else {
+            auto pt = kernel_pt(virt_addr);
+            auto pte = pt_entry(virt_addr);
+
+            for(size_t i = 0; i < count; ++i){
+                auto entry = reinterpret_cast<uintptr_t>(pt[pte + i]);
+
+                if(entry & PRESENT && (entry & ~0xFFF) != phys_addr + i * PAGE_SIZE){
+                    return false;
+                }
+            }
         }
+
+        page += count;
     }
 
-    //Map each page
-    for(size_t page = 0; page < pages; ++page){
+    bool large = false;
+
+    //Fill each PT, using large pages when possible
+    for(size_t page = 0; page < pages;){
         auto virt_addr = virt + page * PAGE_SIZE;
         auto phys_addr = physical + page * PAGE_SIZE;
+        auto count = pt_pages(virt_addr, pages - page);
 
-        if(!map(virt_addr, phys_addr, flags)){
-            return false;
+        auto& pd_entry = find_pd_entry(virt_addr);
+
+        //An already mapped large page has been checked above
+        if(is_large(pd_entry)){
+            page += count;
+            continue;
+        }
+
+        if(count == LARGE_PAGE_PAGES && large_page_aligned(phys_addr) && kernel_pt_empty(virt_addr)){
+            pd_entry = reinterpret_cast<pt_t>(phys_addr | flags | GLOBAL | LARGE);
+            large = true;
+
+            page += count;
+            continue;
+        }
+
+        auto pt = kernel_pt(virt_addr);
+        auto pte = pt_entry(virt_addr);
+
+        for(size_t i = 0; i < count; ++i){
+            if(!(reinterpret_cast<uintptr_t>(pt[pte + i]) & PRESENT)){
+                pt[pte + i] = reinterpret_cast<page_entry>((phys_addr + i * PAGE_SIZE) | flags | GLOBAL);
+            }
         }
+
+        page += count;
+    }
+
+    // The new pages were not present, but the other processors may cache
+    // the PD entries pointing to the PTs replaced by large pages
+    if(large){
+        flush_kernel_range(virt, pages);
+    } else {
+        flush_tlb_range(virt, pages);
     }
 
     return true;
@@ -444,13 +1115,18 @@ bool paging::unmap(size_t virt){
         return true;
     }
 
+    //Only a part of the large page is unmapped
+    if(is_large(pd[pde])){
+        split_large(virt);
+    }
+
     auto pt = find_pt(pd, pde);
 
     //Unmap the virtual address
     pt[pte] = 0x0;
 
     //Flush TLB
-    flush_tlb(virt);
+    flush_kernel_range(virt, 1);
 
     return true;
 }
@@ -461,15 +1137,38 @@ bool paging::unmap_pages(size_t virt, size_t pages){
         return false;
     }
 
-    //Unmap each page
-    for(size_t page = 0; page < pages; ++page){
+    //Clear each PT, a whole large page at once
+    for(size_t page = 0; page < pages;){
         auto virt_addr = virt + page * PAGE_SIZE;
+        auto count = pt_pages(virt_addr, pages - page);
 
-        if(!unmap(virt_addr)){
-            return false;
+        auto& pd_entry = find_pd_entry(virt_addr);
+
+        if(is_large(pd_entry)){
+            if(count == LARGE_PAGE_PAGES){
+                // The PT has been left empty by the large page
+                pd_entry = reinterpret_cast<pt_t>(kernel_physical_pt(virt_addr) | table_flags);
+
+                page += count;
+                continue;
+            }
+
+            //Only a part of the large page is unmapped
+            split_large(virt_addr);
+        }
+
+        auto pt = kernel_pt(virt_addr);
+        auto pte = pt_entry(virt_addr);
+
+        for(size_t i = 0; i < count; ++i){
+            pt[pte + i] = 0x0;
         }
+
+        page += count;
     }
 
+    flush_kernel_range(virt, pages);
+
     return true;
 }
 
@@ -492,106 +1191,327 @@ void paging::map_kernel_inside_user(scheduler::process_t& process){
     }
 }
 
-void clear_physical_page(size_t physical){
-    physical_pointer ptr(physical, 1);
-
-    auto it = ptr.as_ptr<uint64_t>();
-    std::fill_n(it, paging::PAGE_SIZE / sizeof(uint64_t), 0);
+bool paging::user_map(scheduler::process_t& process, size_t virt, size_t physical, bool writable){
+    return user_map_entry(process, virt, physical | (writable ? WRITE : 0) | USER | PRESENT);
 }
 
-//TODO It is highly inefficient to remap CR3 each time
-bool paging::user_map(scheduler::process_t& process, size_t virt, size_t physical){
-    physical_pointer cr3_ptr(process.physical_cr3, 1);
+bool paging::user_map_copy_on_write(scheduler::process_t& process, size_t virt, size_t physical){
+    return user_map_entry(process, virt, physical | COPY_ON_WRITE | USER | PRESENT);
+}
 
-    if(!cr3_ptr){
+bool paging::user_map_large(scheduler::process_t& process, size_t virt, size_t physical){
+    if(!large_page_aligned(virt) || !large_page_aligned(physical)){
         return false;
     }
 
-    //Find the correct indexes inside the paging table for the virtual address
-    auto pml4e = pml4_entry(virt);
-    auto pdpte = pdpt_entry(virt);
     auto pde = pd_entry(virt);
-    auto pte = pt_entry(virt);
 
-    auto pml4t = cr3_ptr.as<pml4t_t>();
-    if(!(reinterpret_cast<uintptr_t>(pml4t[pml4e]) & PRESENT)){
-        auto physical_pdpt = physical_allocator::allocate(1);
+    auto physical_pd = user_pd(process, virt);
 
-        pml4t[pml4e] = reinterpret_cast<pdpt_t>(physical_pdpt | WRITE | USER | PRESENT);
+    if(!physical_pd){
+        return false;
+    }
 
-        clear_physical_page(physical_pdpt);
+    physical_pointer pd_ptr(physical_pd, 1);
 
-        process.paging_size += paging::PAGE_SIZE;
-        process.segments.emplace_back(physical_pdpt, 1UL);
+    if(!pd_ptr){
+        return false;
     }
 
-    auto physical_pdpt = reinterpret_cast<uintptr_t>(pml4t[pml4e]) & ~0xFFF;
-    physical_pointer pdpt_ptr(physical_pdpt, 1);
+    auto pd = pd_ptr.as<pd_t>();
 
-    if(!pdpt_ptr){
+    //A large page cannot replace a PT
+    if(reinterpret_cast<uintptr_t>(pd[pde]) & PRESENT){
         return false;
     }
 
-    auto pdpt = pdpt_ptr.as<pdpt_t>();
-    if(!(reinterpret_cast<uintptr_t>(pdpt[pdpte]) & PRESENT)){
-        auto physical_pd = physical_allocator::allocate(1);
+    pd[pde] = reinterpret_cast<pt_t>(physical | LARGE | WRITE | USER | PRESENT);
 
-        pdpt[pdpte] = reinterpret_cast<pd_t>(physical_pd | WRITE | USER | PRESENT);
+    return true;
+}
 
-        clear_physical_page(physical_pd);
+bool paging::user_map_pages(scheduler::process_t& process, size_t virt, size_t physical, size_t pages){
+    //Walk the tables once per PT and fill its entries
+    for(size_t page = 0; page < pages;){
+        auto virt_addr = virt + page * PAGE_SIZE;
+        auto phys_addr = physical + page * PAGE_SIZE;
+        auto count = pt_pages(virt_addr, pages - page);
 
-        process.paging_size += paging::PAGE_SIZE;
-        process.segments.emplace_back(physical_pdpt, 1UL);
+        auto physical_pt = user_pt(process, virt_addr);
+
+        if(!physical_pt){
+            return false;
+        }
+
+        physical_pointer pt_ptr(physical_pt, 1);
+
+        if(!pt_ptr){
+            return false;
+        }
+
+        auto pt = pt_ptr.as<pt_t>();
+        auto pte = pt_entry(virt_addr);
+
+        for(size_t i = 0; i < count; ++i){
+            pt[pte + i] = reinterpret_cast<page_entry>((phys_addr + i * PAGE_SIZE) | WRITE | USER | PRESENT);
+        }
+
+        page += count;
     }
 
-    auto physical_pd = reinterpret_cast<uintptr_t>(pdpt[pdpte]) & ~0xFFF;
-    physical_pointer pd_ptr(physical_pd, 1);
+    return true;
+}
 
-    if(!pd_ptr){
+bool paging::user_share(scheduler::process_t& source, scheduler::process_t& target){
+    physical_pointer pml4t_ptr(source.physical_cr3, 1);
+
+    if(!pml4t_ptr){
         return false;
     }
 
-    auto pd = pd_ptr.as<pd_t>();
-    if(!(reinterpret_cast<uintptr_t>(pd[pde]) & PRESENT)){
-        auto physical_pt = physical_allocator::allocate(1);
+    auto pml4t = pml4t_ptr.as_ptr<uintptr_t>();
 
-        pd[pde] = reinterpret_cast<pt_t>(physical_pt | WRITE | USER | PRESENT);
+    //The first entries are the kernel ones, shared by all the processes
+    for(size_t pml4e = pml4_entries; pml4e < 512; ++pml4e){
+        if(!(pml4t[pml4e] & PRESENT)){
+            continue;
+        }
 
-        clear_physical_page(physical_pt);
+        physical_pointer pdpt_ptr(pml4t[pml4e] & ~0xFFF, 1);
 
-        process.paging_size += paging::PAGE_SIZE;
-        process.segments.emplace_back(physical_pdpt, 1UL);
+        if(!pdpt_ptr){
+            return false;
+        }
+
+        auto pdpt = pdpt_ptr.as_ptr<uintptr_t>();
+
+        for(size_t pdpte = 0; pdpte < 512; ++pdpte){
+            if(!(pdpt[pdpte] & PRESENT)){
+                continue;
+            }
+
+            physical_pointer pd_ptr(pdpt[pdpte] & ~0xFFF, 1);
+
+            if(!pd_ptr){
+                return false;
+            }
+
+            auto pd = pd_ptr.as_ptr<uintptr_t>();
+
+            for(size_t pde = 0; pde < 512; ++pde){
+                if(!(pd[pde] & PRESENT)){
+                    continue;
+                }
+
+                auto virt = (pml4e << 39) | (pdpte << 30) | (pde << 21);
+
+                if(pd[pde] & LARGE){
+                    auto physical_target_pd = user_pd(target, virt);
+
+                    if(!physical_target_pd){
+                        return false;
+                    }
+
+                    physical_pointer target_pd_ptr(physical_target_pd, 1);
+
+                    if(!target_pd_ptr){
+                        return false;
+                    }
+
+                    pd[pde] = share_entry(pd[pde]);
+                    target_pd_ptr.as_ptr<uintptr_t>()[pde] = pd[pde];
+                } else if(!share_pt(target, virt, pd[pde] & ~0xFFF)){
+                    return false;
+                }
+            }
+        }
     }
 
-    auto physical_pt = reinterpret_cast<uintptr_t>(pd[pde]) & ~0xFFF;
-    physical_pointer pt_ptr(physical_pt, 1);
+    //The pages of the source are now read-only
+    flush_user_range(source, 0, 0);
 
-    if(!pt_ptr){
-        return false;
+    return true;
+}
+
+size_t paging::user_entry(const scheduler::process_t& process, size_t virt, bool& large){
+    large = false;
+
+    auto physical_table = process.physical_cr3;
+    size_t indexes[4] = {pml4_entry(virt), pdpt_entry(virt), pd_entry(virt), pt_entry(virt)};
+
+    for(size_t level = 0; level < 4; ++level){
+        physical_pointer table_ptr(physical_table, 1);
+
+        if(!table_ptr){
+            return 0;
+        }
+
+        auto entry = table_ptr.as_ptr<uintptr_t>()[indexes[level]];
+
+        if(!(entry & PRESENT)){
+            return 0;
+        }
+
+        if(level == 3 || (level == 2 && entry & LARGE)){
+            large = level == 2;
+            return entry;
+        }
+
+        physical_table = entry & ~0xFFF;
     }
 
-    auto pt = pt_ptr.as<pt_t>();
+    return 0;
+}
 
-    //Map to the physical address
-    pt[pte] = reinterpret_cast<page_entry>(physical | WRITE | USER | PRESENT);
+bool paging::user_unmap_pages(scheduler::process_t& process, size_t virt, size_t pages){
+    auto start = virt;
+    auto total = pages;
+
+    while(pages){
+        bool large;
+        user_entry(process, virt, large);
+
+        if(large){
+            if(!large_page_aligned(virt) || pages < LARGE_PAGE_PAGES){
+                return false;
+            }
+
+            auto physical_pd = user_pd(process, virt);
+
+            if(!physical_pd){
+                return false;
+            }
+
+            physical_pointer pd_ptr(physical_pd, 1);
+
+            if(!pd_ptr){
+                return false;
+            }
+
+            pd_ptr.as_ptr<uintptr_t>()[pd_entry(virt)] = 0;
+
+            virt += LARGE_PAGE_SIZE;
+            pages -= LARGE_PAGE_PAGES;
+
+            continue;
+        }
+
+        auto count = pt_pages(virt, pages);
+        auto physical_pt = user_pt(process, virt);
+
+        if(!physical_pt){
+            return false;
+        }
+
+        physical_pointer pt_ptr(physical_pt, 1);
+
+        if(!pt_ptr){
+            return false;
+        }
+
+        std::fill_n(pt_ptr.as_ptr<uintptr_t>() + pt_entry(virt), count, uintptr_t(0));
+
+        virt += count * PAGE_SIZE;
+        pages -= count;
+    }
+
+    flush_user_range(process, start, total);
 
     return true;
 }
 
-bool paging::user_map_pages(scheduler::process_t& process, size_t virt, size_t physical, size_t pages){
-    //Map each page
-    for(size_t page = 0; page < pages; ++page){
-        auto virt_addr = virt + page * PAGE_SIZE;
-        auto phys_addr = physical + page * PAGE_SIZE;
+bool paging::user_read(const scheduler::process_t& process, size_t virt, char* buffer, size_t size){
+    while(size){
+        bool large;
+        auto entry = user_entry(process, virt, large);
 
-        if(!user_map(process, virt_addr, phys_addr)){
+        if(!(entry & PRESENT)){
             return false;
         }
+
+        auto physical = (entry & 0x000FFFFFFFFFF000) + (virt & (PAGE_SIZE - 1));
+
+        if(large){
+            physical = (physical & ~(LARGE_PAGE_SIZE - 1)) + (virt & (LARGE_PAGE_SIZE - 1));
+        }
+
+        // Copy up to the end of the current page
+        auto offset = virt & (PAGE_SIZE - 1);
+        auto count = std::min(size, PAGE_SIZE - offset);
+
+        physical_pointer page_ptr(page_align(physical), 1);
+
+        if(!page_ptr){
+            return false;
+        }
+
+        std::copy_n(page_ptr.as_ptr<char>() + offset, count, buffer);
+
+        virt += count;
+        buffer += count;
+        size -= count;
     }
 
     return true;
 }
 
+bool paging::user_remap_writable(scheduler::process_t& process, size_t virt, size_t physical, bool large){
+    auto physical_table = large ? user_pd(process, virt) : user_pt(process, virt);
+
+    if(!physical_table){
+        return false;
+    }
+
+    physical_pointer table_ptr(physical_table, 1);
+
+    if(!table_ptr){
+        return false;
+    }
+
+    auto table = table_ptr.as_ptr<uintptr_t>();
+
+    if(large){
+        table[pd_entry(virt)] = physical | LARGE | WRITE | USER | PRESENT;
+    } else {
+        table[pt_entry(virt)] = physical | WRITE | USER | PRESENT;
+    }
+
+    // The entry of a large page is flushed with any of its addresses
+    flush_user_range(process, virt, 1);
+
+    return true;
+}
+
+void tlb_shootdown::handle(){
+    direct_int_lock lock;
+
+    auto cpu = smp::current_cpu();
+    auto bit = uint64_t(1) << cpu;
+
+    if(!(__atomic_load_n(&pending, __ATOMIC_ACQUIRE) & bit)){
+        return;
+    }
+
+    // A request arriving after the exchange sets the flag again
+    __atomic_and_fetch(&pending, ~bit, __ATOMIC_SEQ_CST);
+    auto senders = __atomic_exchange_n(&incoming[cpu], 0, __ATOMIC_SEQ_CST);
+
+    for(size_t sender = 0; sender < smp::MAX_CPUS; ++sender){
+        if(senders & (uint64_t(1) << sender)){
+            auto& request = requests[sender];
+
+            // The processors that switched away flush the user pages with the generation
+            if(!request.address_space){
+                flush_tlb_range(request.virt, request.pages);
+            } else if(pcid_cpus[cpu].loaded == request.address_space){
+                invalidate_user_range(request.virt, request.pages);
+            }
+
+            __atomic_and_fetch(&request.waiting, ~bit, __ATOMIC_SEQ_CST);
+        }
+    }
+}
+
 size_t paging::get_physical_pml4t(){
     return physical_pml4t_start;
 }
@@ -5,6 +5,8 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <hash.hpp>
+
 #include "vfs/path.hpp"
 
 #include "assert.hpp"
@@ -13,128 +15,170 @@ path::path(){
     //Nothing to init
 }
 
-path::path(const std::string& path){
-    if(path[0] == '/'){
-        names.push_back("/");
+namespace {
+
+/*!
+ * \brief Returns an upper bound of the number of parts of the string path
+ */
+size_t max_parts(std::string_view path){
+    size_t parts = 2;
+
+    for(char c : path){
+        if(c == '/'){
+            ++parts;
+        }
     }
 
-    std::split_append(path, names, '/');
+    return parts;
 }
 
-path::path(const path& base_path, const std::string& p){
-    thor_assert(p.empty() || p[0] != '/', "Impossible to add absolute path to another path");
+size_t part_hash(std::string_view part){
+    return std::hash<std::string_view>()(part);
+}
+
+} //end of anonymous namespace
 
-    auto parts = std::split(p, '/');
-    names.reserve(names.size() + base_path.size() + parts.size());
+path::path(const std::string& p){
+    chars.reserve(p.size());
+    segments.reserve(max_parts(p));
+
+    if(p[0] == '/'){
+        append_root();
+    }
 
-    std::copy(base_path.begin(), base_path.end(), std::back_inserter(names));
-    std::copy(parts.begin(), parts.end(), std::back_inserter(names));
+    append_all(p);
 }
 
-path::path(const path& base_path, const path& p){
-    thor_assert(p.is_relative(), "Impossible to add absolute path to another path");
+path::path(const path& base_path, const std::string& p) : chars(base_path.chars), segments(base_path.segments) {
+    thor_assert(p.empty() || p[0] != '/', "Impossible to add absolute path to another path");
 
-    names.reserve(names.size() + base_path.size() + p.size());
+    chars.reserve(base_path.chars.size() + p.size() + 1);
+    segments.reserve(base_path.size() + max_parts(p));
 
-    std::copy(base_path.begin(), base_path.end(), std::back_inserter(names));
-    std::copy(p.begin(), p.end(), std::back_inserter(names));
+    append_all(p);
 }
 
-// TODO Ideally, the last / should not be used
-std::string path::string() const {
-    std::string str_path;
+path::path(const path& base_path, const path& p) : chars(base_path.chars), segments(base_path.segments) {
+    thor_assert(p.is_relative(), "Impossible to add absolute path to another path");
 
-    size_t i = 0;
+    chars.reserve(base_path.chars.size() + p.chars.size() + 1);
+    segments.reserve(base_path.size() + p.size());
 
-    if(is_absolute()){
-        str_path = "/";
-        i = 1;
+    for(size_t i = 0; i < p.size(); ++i){
+        append(p[i], p.hash(i));
     }
+}
 
-    std::string comma;
-    for(; i < names.size(); ++i){
-        str_path += comma;
-        str_path += names[i];
-
-        comma = "/";
+std::string path::string() const {
+    if(chars.empty()){
+        return "";
     }
 
-    return str_path;
-}
-
-const std::vector<std::string>& path::vec() const {
-    return names;
+    return std::string(chars.begin(), chars.end());
 }
 
 void path::invalidate(){
-    names.resize(1);
-    names[0] = "//";
+    chars.clear();
+    segments.clear();
+
+    chars.push_back('/');
+    chars.push_back('/');
+
+    segments.push_back({0, 2, part_hash("//")});
 }
 
 bool path::empty() const {
-    return names.empty();
+    return segments.empty();
 }
 
 bool path::is_root() const {
-    return names.size() == 1 && names[0] == "/";
+    return segments.size() == 1 && (*this)[0] == "/";
 }
 
 bool path::is_valid() const {
-    return !names.empty() && !(names.size() == 1 && names[0] == "//");
+    return !segments.empty() && !(segments.size() == 1 && (*this)[0] == "//");
 }
 
 bool path::is_sub_root() const {
-    return is_absolute() && names.size() == 2;
+    return is_absolute() && segments.size() == 2;
 }
 
 size_t path::size() const {
-    return names.size();
+    return segments.size();
 }
 
-std::string path::base_name() const {
+std::string_view path::base_name() const {
     if(empty()){
-        return "";
+        return {};
     } else {
-        return names.back();
+        return name(size() - 1);
     }
 }
 
-std::string path::root_name() const {
+std::string_view path::root_name() const {
     if(empty()){
-        return "";
+        return {};
     } else {
-        return names.front();
+        return name(0);
     }
 }
 
-std::string path::sub_root_name() const {
+std::string_view path::sub_root_name() const {
     if(size() < 2){
-        return "";
+        return {};
     } else {
-        return names[1];
+        return name(1);
     }
 }
 
 bool path::is_absolute() const {
-    return names.size() && names[0] == "/";
+    return segments.size() && (*this)[0] == "/";
 }
 
 bool path::is_relative() const {
-    return names.size() && names[0] != "/";
+    return segments.size() && (*this)[0] != "/";
 }
 
-const std::string& path::name(size_t i) const {
-    return names[i];
+std::string_view path::name(size_t i) const {
+    auto& s = segments[i];
+    return {&chars[s.offset], s.length};
 }
 
-const std::string& path::operator[](size_t i) const {
-    return names[i];
+std::string_view path::operator[](size_t i) const {
+    return name(i);
+}
+
+size_t path::hash(size_t i) const {
+    return segments[i].hash;
 }
 
 path path::sub_path(size_t i) const {
     path p;
-    p.names.resize(size() - i);
-    std::copy(names.begin() + i, names.end(), p.names.begin());
+
+    if(i < size()){
+        p.chars.reserve(chars.size() - segments[i].offset);
+        p.segments.reserve(size() - i);
+
+        for(; i < size(); ++i){
+            p.append(name(i), hash(i));
+        }
+    }
+
+    return p;
+}
+
+path path::root_sub_path(size_t i) const {
+    path p;
+
+    p.chars.reserve(chars.size() - (i < size() ? segments[i].offset : chars.size()) + 1);
+    p.segments.reserve(size() - i + 1);
+
+    p.append_root();
+
+    for(; i < size(); ++i){
+        p.append(name(i), hash(i));
+    }
+
     return p;
 }
 
@@ -151,26 +195,79 @@ path path::branch_path() const {
         return *this;
     }
 
-    path p;
-    p.names.resize(size() - 1);
-    std::copy(names.begin(), names.end() - 1, p.names.begin());
+    // The last part and its separator are dropped
+    path p(*this);
+
+    auto& previous = segments[size() - 2];
+
+    p.chars.resize(previous.offset + previous.length);
+    p.segments.pop_back();
+
     return p;
 }
 
 path::iterator path::begin() const {
-    return names.begin();
+    return {this, 0};
 }
 
 path::iterator path::end() const {
-    return names.end();
+    return {this, size()};
 }
 
 bool path::operator==(const path& p) const {
-    return names == p.names;
+    if(size() != p.size()){
+        return false;
+    }
+
+    for(size_t i = 0; i < size(); ++i){
+        if(hash(i) != p.hash(i) || name(i) != p.name(i)){
+            return false;
+        }
+    }
+
+    return true;
 }
 
 bool path::operator!=(const path& p) const {
-    return names != p.names;
+    return !(*this == p);
+}
+
+void path::append_root(){
+    chars.push_back('/');
+    segments.push_back({0, 1, part_hash("/")});
+}
+
+void path::append(std::string_view part){
+    append(part, part_hash(part));
+}
+
+void path::append(std::string_view part, size_t hash){
+    // The parts are separated by a slash, the root is one already
+    if(!chars.empty() && chars.back() != '/'){
+        chars.push_back('/');
+    }
+
+    auto offset = chars.size();
+
+    for(char c : part){
+        chars.push_back(c);
+    }
+
+    segments.push_back({uint32_t(offset), uint32_t(part.size()), hash});
+}
+
+void path::append_all(std::string_view p){
+    size_t start = 0;
+
+    for(size_t i = 0; i <= p.size(); ++i){
+        if(i == p.size() || p[i] == '/'){
+            if(i > start){
+                append(p.substr(start, i - start));
+            }
+
+            start = i + 1;
+        }
+    }
 }
 
 path operator/(const path& lhs, const path& rhs){
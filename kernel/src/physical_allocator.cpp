@@ -5,6 +5,9 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <array.hpp>
+#include <lock_guard.hpp>
+
 #include "physical_allocator.hpp"
 #include "e820.hpp"
 #include "paging.hpp"
@@ -12,6 +15,15 @@
 #include "assert.hpp"
 #include "logging.hpp"
 #include "early_memory.hpp"
+#include "smp.hpp"
+#include "physical_pointer.hpp"
+#include "page_cache.hpp"
+#include "shrinker.hpp"
+#include "numa.hpp"
+
+#include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
+#include "conc/percpu_counter.hpp"
 
 #include "fs/sysfs.hpp"
 
@@ -23,23 +35,90 @@ namespace {
 
 constexpr const size_t unit = paging::PAGE_SIZE;
 
+constexpr const size_t MAX_ZONES = 8;              ///< The maximum number of managed e820 entries
+constexpr const size_t HOT_PAGES = 64;             ///< The maximum number of pages of a hot list
+constexpr const size_t HOT_BATCH = HOT_PAGES / 2;  ///< The number of pages moved at once between a hot list and the zones
+constexpr const size_t MIN_ZONE_ADDRESS = paging::LARGE_PAGE_SIZE; ///< The memory below is left to the boot, the trampolines and the kernel
+constexpr const size_t ZEROED_SIZES = 2;          ///< The blocks of up to this number of pages are kept zeroed
+constexpr const size_t ZEROED_BLOCKS = 64;        ///< The maximum number of zeroed blocks of each size
+constexpr const size_t ZERO_BATCH = 4;            ///< The number of blocks zeroed at once by an idle processor
+constexpr const size_t ZERO_RESERVE = 1024;       ///< Below this number of free pages, no more pages are zeroed in advance
+
 const e820::mmapentry* current_mmap_entry = 0;
 uintptr_t current_mmap_entry_position = 0;
 
-size_t allocated_memory = 0;
+percpu_counter allocated_memory; ///< The allocated physical memory
+
+int_spinlock allocator_lock;
 
 typedef buddy_allocator<8, unit> buddy_type;
-buddy_type allocator;
 
-size_t first_physical_address;
-size_t last_physical_address;
+/*!
+ * \brief A zone of physical memory, one usable e820 entry
+ */
+struct zone_t {
+    buddy_type allocator;          ///< The buddy allocator of the zone
+    size_t first;                  ///< The first address of the zone
+    size_t last;                   ///< The end address of the zone
+    volatile uint16_t* references; ///< The number of additional owners of the blocks, by first page
+    size_t node;                   ///< The memory node holding the zone
+};
+
+std::array<zone_t, MAX_ZONES> zones;
+size_t zone_count = 0;
+
+std::array<std::array<uint8_t, MAX_ZONES>, numa::MAX_NODES> zone_orders; ///< The zones of each node, from the nearest
+volatile bool numa_zones = false; ///< Indicates if the zones are placed on several nodes
+
+percpu_counter local_allocations;  ///< The allocations from a zone of the node of the processor
+percpu_counter remote_allocations; ///< The allocations from a zone of another node
+
+/*!
+ * \brief The free order-0 pages of a processor
+ */
+struct hot_list {
+    size_t count;                         ///< The number of pages
+    std::array<size_t, HOT_PAGES> pages;  ///< The free pages
+};
+
+std::array<hot_list, smp::MAX_CPUS> hot_lists;
+
+/*!
+ * \brief The blocks of a size zeroed in advance by the idle processors
+ */
+struct zeroed_pool {
+    int_spinlock lock;                        ///< Protect the pool
+    volatile size_t count;                    ///< The number of blocks
+    std::array<size_t, ZEROED_BLOCKS> blocks; ///< The zeroed blocks
+};
+
+std::array<zeroed_pool, ZEROED_SIZES> zeroed_pools; ///< The pools of the blocks of one and two pages
+
+percpu_counter zeroed_hits;   ///< The number of zeroed allocations served by the pools
+percpu_counter zeroed_misses; ///< The number of zeroed allocations cleared synchronously
+
+/*!
+ * \brief Identifies a free blocks statistic in sysfs
+ */
+struct order_stat {
+    const zone_t* zone; ///< The zone
+    size_t order;       ///< The order (level) of the blocks
+};
+
+std::array<std::array<order_stat, buddy_type::levels>, MAX_ZONES> order_stats;
+
+size_t large_page_align(size_t address){
+    return (address + paging::LARGE_PAGE_SIZE - 1) & ~(paging::LARGE_PAGE_SIZE - 1);
+}
 
 size_t array_size(size_t managed_space, size_t block){
     return (managed_space / (block * unit) + 1) / (sizeof(uint64_t) * 8) + 1;
 }
 
-uint64_t* create_array(size_t managed_space, size_t block){
-    auto size = array_size(managed_space, block) * sizeof(uint64_t);
+/*!
+ * \brief Allocate metadata of the given size from the kernel e820 entry
+ */
+void* create_metadata(size_t size){
     auto pages = paging::pages(size);
 
     auto physical_address = current_mmap_entry_position;
@@ -51,7 +130,211 @@ uint64_t* create_array(size_t managed_space, size_t block){
 
     thor_assert(paging::map_pages(virtual_address, physical_address, pages), "Impossible to map pages for the physical allocator");
 
-    return reinterpret_cast<uint64_t*>(virtual_address);
+    return reinterpret_cast<void*>(virtual_address);
+}
+
+uint64_t* create_array(size_t managed_space, size_t block){
+    return reinterpret_cast<uint64_t*>(create_metadata(array_size(managed_space, block) * sizeof(uint64_t)));
+}
+
+/*!
+ * \brief Create the bitmaps of the zone, from the memory of the kernel e820 entry
+ */
+void init_zone(zone_t& zone, size_t managed_space){
+    auto data_bitmap_1 = create_array(managed_space, 1);
+    auto data_bitmap_2 = create_array(managed_space, 2);
+    auto data_bitmap_4 = create_array(managed_space, 4);
+    auto data_bitmap_8 = create_array(managed_space, 8);
+    auto data_bitmap_16 = create_array(managed_space, 16);
+    auto data_bitmap_32 = create_array(managed_space, 32);
+    auto data_bitmap_64 = create_array(managed_space, 64);
+    auto data_bitmap_128 = create_array(managed_space, 128);
+
+    zone.allocator.init<0>(array_size(managed_space, 1), data_bitmap_1);
+    zone.allocator.init<1>(array_size(managed_space, 2), data_bitmap_2);
+    zone.allocator.init<2>(array_size(managed_space, 4), data_bitmap_4);
+    zone.allocator.init<3>(array_size(managed_space, 8), data_bitmap_8);
+    zone.allocator.init<4>(array_size(managed_space, 16), data_bitmap_16);
+    zone.allocator.init<5>(array_size(managed_space, 32), data_bitmap_32);
+    zone.allocator.init<6>(array_size(managed_space, 64), data_bitmap_64);
+    zone.allocator.init<7>(array_size(managed_space, 128), data_bitmap_128);
+
+    auto pages = managed_space / unit + 1;
+    auto references = reinterpret_cast<uint16_t*>(create_metadata(pages * sizeof(uint16_t)));
+    std::fill_n(references, pages, 0);
+
+    zone.references = references;
+}
+
+zone_t* find_zone(size_t address){
+    for(size_t i = 0; i < zone_count; ++i){
+        if(address >= zones[i].first && address < zones[i].last){
+            return &zones[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/*!
+ * \brief Returns the number of additional owners of the block starting at the given address
+ */
+volatile uint16_t& references(size_t address){
+    auto zone = find_zone(address);
+
+    thor_assert(zone, "Sharing physical memory outside of any zone");
+
+    return zone->references[(address - zone->first) / unit];
+}
+
+/*!
+ * \brief Allocate from the first zone that has enough memory, the lock must
+ * be held. With several nodes, the zones of the node of the processor are
+ * tried first, then the others from the nearest.
+ */
+size_t zone_allocate(size_t blocks){
+    if(!numa_zones){
+        for(size_t i = 0; i < zone_count; ++i){
+            auto phys = zones[i].allocator.allocate(blocks);
+
+            if(phys){
+                return phys;
+            }
+        }
+
+        return 0;
+    }
+
+    auto node = numa::current_node();
+    auto& order = zone_orders[node];
+
+    for(size_t i = 0; i < zone_count; ++i){
+        auto& zone = zones[order[i]];
+        auto phys = zone.allocator.allocate(blocks);
+
+        if(phys){
+            if(zone.node == node){
+                ++local_allocations;
+            } else {
+                ++remote_allocations;
+            }
+
+            return phys;
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Indicates if the page must go back to its zone instead of the hot
+ * list of the processor, because it is on another node
+ */
+bool remote_page(size_t address){
+    return numa_zones && find_zone(address)->node != numa::current_node();
+}
+
+/*!
+ * \brief Free the blocks to their zone, the lock must be held
+ */
+void zone_free(size_t address, size_t blocks){
+    auto zone = find_zone(address);
+
+    thor_assert(zone, "Freeing physical memory outside of any zone");
+
+    zone->allocator.free(address, blocks);
+}
+
+/*!
+ * \brief Drop an owner of the block starting at the given address
+ * \return true if the caller was the last owner
+ */
+bool drop_owner(size_t address){
+    auto& count = references(address);
+
+    while(true){
+        uint16_t owners = count;
+
+        if(!owners){
+            return true;
+        }
+
+        if(__atomic_compare_exchange_n(&count, &owners, owners - 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+            return false;
+        }
+    }
+}
+
+size_t allocate_page(){
+    // The hot list cannot change of processor while it is used
+    direct_int_lock l;
+
+    auto& hot = hot_lists[smp::current_cpu()];
+
+    if(!hot.count){
+        std::lock_guard<int_spinlock> zone_lock(allocator_lock);
+
+        while(hot.count < HOT_BATCH){
+            auto page = zone_allocate(1);
+
+            if(!page){
+                break;
+            }
+
+            hot.pages[hot.count++] = page;
+        }
+
+        if(!hot.count){
+            return 0;
+        }
+    }
+
+    return hot.pages[--hot.count];
+}
+
+void free_page(size_t address){
+    direct_int_lock l;
+
+    // The hot list only keeps the pages of the local node
+    if(remote_page(address)){
+        std::lock_guard<int_spinlock> zone_lock(allocator_lock);
+
+        zone_free(address, 1);
+
+        return;
+    }
+
+    auto& hot = hot_lists[smp::current_cpu()];
+
+    if(hot.count == HOT_PAGES){
+        std::lock_guard<int_spinlock> zone_lock(allocator_lock);
+
+        while(hot.count > HOT_PAGES - HOT_BATCH){
+            zone_free(hot.pages[--hot.count], 1);
+        }
+    }
+
+    hot.pages[hot.count++] = address;
+}
+
+/*!
+ * \brief Zero the given physical memory with non-temporal stores, so
+ * that the pages do not evict the data of the running processes from
+ * the caches
+ */
+void clear_non_temporal(size_t physical, size_t pages){
+    physical_pointer ptr(physical, pages);
+
+    auto it = ptr.as_ptr<uint64_t>();
+    auto end = it + pages * paging::PAGE_SIZE / sizeof(uint64_t);
+
+    for(; it != end; it += 4){
+        asm volatile("movnti [%0], %1; movnti [%0 + 8], %1; movnti [%0 + 16], %1; movnti [%0 + 24], %1"
+            : : "r" (it), "r" (uint64_t(0)) : "memory");
+    }
+
+    // The non-temporal stores must be visible before the pages are used
+    asm volatile("sfence" ::: "memory");
 }
 
 std::string sysfs_free(){
@@ -66,6 +349,47 @@ std::string sysfs_allocated(){
     return std::to_string(physical_allocator::allocated());
 }
 
+std::string sysfs_hot(){
+    size_t pages = 0;
+
+    for(auto& hot : hot_lists){
+        pages += hot.count;
+    }
+
+    return std::to_string(pages);
+}
+
+std::string sysfs_zeroed(){
+    size_t pages = 0;
+
+    for(size_t i = 0; i < ZEROED_SIZES; ++i){
+        pages += zeroed_pools[i].count * (i + 1);
+    }
+
+    return std::to_string(pages);
+}
+
+std::string sysfs_zeroed_hits(){
+    return std::to_string(zeroed_hits.value());
+}
+
+std::string sysfs_zeroed_misses(){
+    return std::to_string(zeroed_misses.value());
+}
+
+std::string sysfs_local_allocations(){
+    return std::to_string(local_allocations.value());
+}
+
+std::string sysfs_remote_allocations(){
+    return std::to_string(remote_allocations.value());
+}
+
+std::string sysfs_free_blocks(void* data){
+    auto& stat = *static_cast<order_stat*>(data);
+    return std::to_string(stat.zone->allocator.free_blocks(stat.order));
+}
+
 } //End of anonymous namespace
 
 void physical_allocator::early_init(){
@@ -119,42 +443,66 @@ size_t physical_allocator::early_allocate(size_t blocks){
 }
 
 void physical_allocator::init(){
+    allocator_lock.set_name("physical_allocator");
+
     //Make sure to start with an aligned address
     if((current_mmap_entry_position % paging::PAGE_SIZE) != 0){
         allocated_memory += current_mmap_entry_position % paging::PAGE_SIZE;
         current_mmap_entry_position = current_mmap_entry_position + current_mmap_entry_position % paging::PAGE_SIZE;
     }
 
-    // Compute the size of the managed space
-    auto size = current_mmap_entry->size;
-    auto managed_space = size - (current_mmap_entry_position -  current_mmap_entry->base);
+    // The zone of the kernel entry is the first one, the bitmaps of all
+    // the zones are taken from it
+    auto& kernel_zone = zones[zone_count++];
+    kernel_zone.last = current_mmap_entry->base + current_mmap_entry->size;
 
-    logging::logf(logging::log_level::ERROR, "palloc: Managed space %h\n", size_t(managed_space));
+    for(uint64_t i = 0; i < e820::mmap_entry_count() && zone_count < MAX_ZONES; ++i){
+        auto& entry = e820::mmap_entry(i);
 
-    auto data_bitmap_1 = create_array(managed_space, 1);
-    auto data_bitmap_2 = create_array(managed_space, 2);
-    auto data_bitmap_4 = create_array(managed_space, 4);
-    auto data_bitmap_8 = create_array(managed_space, 8);
-    auto data_bitmap_16 = create_array(managed_space, 16);
-    auto data_bitmap_32 = create_array(managed_space, 32);
-    auto data_bitmap_64 = create_array(managed_space, 64);
-    auto data_bitmap_128 = create_array(managed_space, 128);
+        if(entry.type != 1 || &entry == current_mmap_entry){
+            continue;
+        }
 
-    first_physical_address = current_mmap_entry_position;
-    last_physical_address = current_mmap_entry->base + current_mmap_entry->size;
+        // The zones are aligned so that their large blocks can back large pages
+        auto first = large_page_align(entry.base);
+        auto last = paging::page_align(entry.base + entry.size);
 
-    allocator.set_memory_range(first_physical_address, last_physical_address);
+        if(first < MIN_ZONE_ADDRESS){
+            first = MIN_ZONE_ADDRESS;
+        }
+
+        // Too small entries are not worth their bitmaps
+        if(last <= first || last - first < buddy_type::max_block * unit){
+            continue;
+        }
+
+        auto& zone = zones[zone_count++];
+        zone.first = first;
+        zone.last = last;
+    }
+
+    for(size_t i = 0; i < zone_count; ++i){
+        auto& zone = zones[i];
+
+        auto managed_space = i == 0
+            ? kernel_zone.last - current_mmap_entry_position
+            : zone.last - zone.first;
+
+        logging::logf(logging::log_level::DEBUG, "palloc: Zone %u managed space %h\n", i, size_t(managed_space));
 
-    allocator.init<0>(array_size(managed_space, 1), data_bitmap_1);
-    allocator.init<1>(array_size(managed_space, 2), data_bitmap_2);
-    allocator.init<2>(array_size(managed_space, 4), data_bitmap_4);
-    allocator.init<3>(array_size(managed_space, 8), data_bitmap_8);
-    allocator.init<4>(array_size(managed_space, 16), data_bitmap_16);
-    allocator.init<5>(array_size(managed_space, 32), data_bitmap_32);
-    allocator.init<6>(array_size(managed_space, 64), data_bitmap_64);
-    allocator.init<7>(array_size(managed_space, 128), data_bitmap_128);
+        init_zone(zone, managed_space);
+    }
+
+    // The kernel zone starts after all the bitmaps
+    kernel_zone.first = large_page_align(current_mmap_entry_position);
+    allocated_memory += kernel_zone.first - current_mmap_entry_position;
 
-    allocator.init();
+    for(size_t i = 0; i < zone_count; ++i){
+        auto& zone = zones[i];
+
+        zone.allocator.set_memory_range(zone.first, zone.last);
+        zone.allocator.init();
+    }
 
     //TODO The current system uses more memory than necessary,
     //because it also tries to index memory that is used for the
@@ -167,6 +515,30 @@ void physical_allocator::finalize(){
     sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/available"), &sysfs_available);
     sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/free"), &sysfs_free);
     sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/allocated"), &sysfs_allocated);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/hot"), &sysfs_hot);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/zeroed/pages"), &sysfs_zeroed);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/zeroed/hits"), &sysfs_zeroed_hits);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/physical/zeroed/misses"), &sysfs_zeroed_misses);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/numa/local_allocations"), &sysfs_local_allocations);
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/numa/remote_allocations"), &sysfs_remote_allocations);
+
+    // Publish the zones and their free blocks of each order
+    sysfs::set_constant_value(path("/sys/"), path("/memory/physical/zones/count"), std::to_string(zone_count));
+
+    for(size_t i = 0; i < zone_count; ++i){
+        auto& zone = zones[i];
+
+        auto base_path = path("/memory/physical/zones") / std::to_string(i);
+
+        sysfs::set_constant_value(path("/sys/"), base_path / "base", std::to_string(zone.first));
+        sysfs::set_constant_value(path("/sys/"), base_path / "size", std::to_string(zone.last - zone.first));
+
+        for(size_t order = 0; order < buddy_type::levels; ++order){
+            order_stats[i][order] = {&zone, order};
+
+            sysfs::set_dynamic_value_data(path("/sys/"), base_path / "free_blocks" / std::to_string(order), &sysfs_free_blocks, &order_stats[i][order]);
+        }
+    }
 
     // Publish the e820 map
     auto entries = e820::mmap_entry_count();
@@ -183,24 +555,246 @@ void physical_allocator::finalize(){
     }
 }
 
+void physical_allocator::init_nodes(){
+    std::lock_guard<int_spinlock> l(allocator_lock);
+
+    for(size_t i = 0; i < zone_count; ++i){
+        zones[i].node = numa::range_node(zones[i].first, zones[i].last);
+
+        logging::logf(logging::log_level::DEBUG, "palloc: Zone %u on node %u\n", i, zones[i].node);
+    }
+
+    // The zones of each node, then the zones of the other nodes from the nearest
+    for(size_t node = 0; node < numa::nodes(); ++node){
+        auto& order = zone_orders[node];
+
+        for(size_t i = 0; i < zone_count; ++i){
+            order[i] = i;
+        }
+
+        // Insertion sort, stable to keep the kernel zone first among equals
+        for(size_t i = 1; i < zone_count; ++i){
+            auto zone = order[i];
+            auto d = numa::distance(node, zones[zone].node);
+
+            size_t j = i;
+
+            while(j > 0 && numa::distance(node, zones[order[j - 1]].node) > d){
+                order[j] = order[j - 1];
+                --j;
+            }
+
+            order[j] = zone;
+        }
+    }
+
+    numa_zones = true;
+}
+
+size_t physical_allocator::node_size(size_t node){
+    size_t size = 0;
+
+    for(size_t i = 0; i < zone_count; ++i){
+        if(zones[i].node == node){
+            size += zones[i].last - zones[i].first;
+        }
+    }
+
+    return size;
+}
+
+size_t physical_allocator::node_free(size_t node){
+    size_t pages = 0;
+
+    for(size_t i = 0; i < zone_count; ++i){
+        if(zones[i].node == node){
+            pages += zones[i].allocator.free_blocks(0);
+        }
+    }
+
+    return pages * unit;
+}
+
 size_t physical_allocator::allocate(size_t blocks){
+    // The page cache gives back the pages it is the only owner of
+    if(blocks >= free() / paging::PAGE_SIZE){
+        page_cache::shrink(blocks);
+    }
+
     thor_assert(blocks < free() / paging::PAGE_SIZE, "Not enough physical memory");
 
-    allocated_memory += buddy_type::level_size(blocks) * unit;
+    size_t phys;
 
-    auto phys = allocator.allocate(blocks);
+    // Single pages are served by the hot list of the processor
+    if(blocks == 1){
+        phys = allocate_page();
+    } else {
+        std::lock_guard<int_spinlock> l(allocator_lock);
+
+        phys = zone_allocate(blocks);
+    }
 
     if(!phys){
         logging::logf(logging::log_level::ERROR, "palloc: Unable to allocate %u blocks\n", size_t(blocks));
+        return phys;
+    }
+
+    allocated_memory += blocks * unit;
+
+    // Below the low watermark, a worker asks the caches to give memory back
+    shrinker::update();
+
+    return phys;
+}
+
+size_t physical_allocator::allocate_zeroed(size_t blocks){
+    if(blocks <= ZEROED_SIZES){
+        auto& pool = zeroed_pools[blocks - 1];
+
+        std::lock_guard<int_spinlock> l(pool.lock);
+
+        if(pool.count){
+            ++zeroed_hits;
+            return pool.blocks[--pool.count];
+        }
+    }
+
+    ++zeroed_misses;
+
+    auto phys = allocate(blocks);
+
+    if(phys){
+        physical_pointer ptr(phys, blocks);
+
+        auto it = ptr.as_ptr<uint64_t>();
+        std::fill_n(it, blocks * paging::PAGE_SIZE / sizeof(uint64_t), 0);
     }
 
     return phys;
 }
 
+bool physical_allocator::zero_free_pages(){
+    for(size_t i = 0; i < ZEROED_SIZES; ++i){
+        auto& pool = zeroed_pools[i];
+        auto blocks = i + 1;
+
+        if(pool.count == ZEROED_BLOCKS){
+            continue;
+        }
+
+        for(size_t b = 0; b < ZERO_BATCH; ++b){
+            // The pools must not take the last free pages
+            if(free() / paging::PAGE_SIZE < ZERO_RESERVE){
+                return false;
+            }
+
+            auto phys = allocate(blocks);
+
+            if(!phys){
+                return false;
+            }
+
+            clear_non_temporal(phys, blocks);
+
+            pool.lock.lock();
+
+            // Another idle processor may have filled the pool
+            bool full = pool.count == ZEROED_BLOCKS;
+
+            if(!full){
+                pool.blocks[pool.count++] = phys;
+            }
+
+            pool.lock.unlock();
+
+            if(full){
+                free(phys, blocks);
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
 void physical_allocator::free(size_t address, size_t blocks){
-    allocated_memory -= buddy_type::level_size(blocks) * unit;
+    allocated_memory -= blocks * unit;
+
+    if(blocks == 1){
+        free_page(address);
+    } else {
+        std::lock_guard<int_spinlock> l(allocator_lock);
+
+        zone_free(address, blocks);
+    }
+
+    shrinker::update();
+}
+
+void physical_allocator::share(size_t address){
+    __atomic_fetch_add(&references(address), 1, __ATOMIC_RELAXED);
+}
+
+bool physical_allocator::release(size_t address, size_t blocks){
+    // The last owner frees the block
+    if(drop_owner(address)){
+        free(address, blocks);
+        return true;
+    }
+
+    return false;
+}
+
+size_t physical_allocator::release_pages(size_t* pages, size_t count){
+    size_t freed = 0;
+
+    for(size_t i = 0; i < count; ++i){
+        if(drop_owner(pages[i])){
+            pages[freed++] = pages[i];
+        }
+    }
+
+    if(!freed){
+        return 0;
+    }
+
+    {
+        // The hot list cannot change of processor while it is filled
+        direct_int_lock l;
+
+        auto& hot = hot_lists[smp::current_cpu()];
+
+        // The pages not kept by the hot list are moved at the front
+        size_t spilled = 0;
+
+        for(size_t i = 0; i < freed; ++i){
+            if(hot.count < HOT_PAGES && !remote_page(pages[i])){
+                hot.pages[hot.count++] = pages[i];
+            } else {
+                pages[spilled++] = pages[i];
+            }
+        }
+
+        if(spilled){
+            std::lock_guard<int_spinlock> zone_lock(allocator_lock);
+
+            for(size_t i = 0; i < spilled; ++i){
+                zone_free(pages[i], 1);
+            }
+        }
+    }
+
+    allocated_memory -= freed * unit;
+
+    shrinker::update();
+
+    return freed;
+}
 
-    return allocator.free(address, blocks);
+bool physical_allocator::shared(size_t address){
+    return references(address);
 }
 
 size_t physical_allocator::available(){
@@ -208,7 +802,7 @@ size_t physical_allocator::available(){
 }
 
 size_t physical_allocator::allocated(){
-    return allocated_memory;
+    return allocated_memory.value();
 }
 
 size_t physical_allocator::free(){
@@ -0,0 +1,322 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+#include <string.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "pipe.hpp"
+#include "scheduler.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+#include "conc/wait_list.hpp"
+
+namespace {
+
+/*!
+ * \brief A pipe, the bytes are kept in a ring buffer
+ */
+struct pipe_t {
+    size_t id;               ///< The id of the pipe, its directory in the file system
+    char* buffer;            ///< The ring buffer of CAPACITY bytes
+    size_t head = 0;         ///< The total of bytes read
+    size_t tail = 0;         ///< The total of bytes written
+    size_t readers = 0;      ///< The handles of the read end
+    size_t writers = 0;      ///< The handles of the write end
+    spinlock lock;           ///< The lock of the buffer and of the queues
+    wait_list read_queue;    ///< The processes waiting for bytes
+    wait_list write_queue;   ///< The processes waiting for space
+};
+
+spinlock pipes_lock;           ///< The lock of the list of pipes and of their ends
+std::vector<pipe_t*> pipes_list; ///< The live pipes
+size_t next_id = 1;            ///< The id of the next pipe
+
+// Find a pipe, with the lock of the list held
+pipe_t* find_pipe(size_t id){
+    for(auto* p : pipes_list){
+        if(p->id == id){
+            return p;
+        }
+    }
+
+    return nullptr;
+}
+
+// The live pipes are never freed while the current process has one of their ends
+pipe_t* get_pipe(size_t id){
+    std::lock_guard<spinlock> l(pipes_lock);
+
+    return find_pipe(id);
+}
+
+void wake_all(wait_list& queue){
+    while(!queue.empty()){
+        queue.dequeue();
+    }
+}
+
+/*!
+ * \brief Parse the end of a pipe from its path, /pipe/<id>/read or /pipe/<id>/write
+ */
+bool parse_end(const path& file, size_t& id, bool& write){
+    if(file.size() != 4 || !file.is_absolute() || file[1] != "pipe"){
+        return false;
+    }
+
+    if(file[3] == "read"){
+        write = false;
+    } else if(file[3] == "write"){
+        write = true;
+    } else {
+        return false;
+    }
+
+    id = std::atoui(file[2]);
+
+    return true;
+}
+
+} //End of anonymous namespace
+
+std::expected<void> pipe::create(size_t& read_fd, size_t& write_fd){
+    auto* p = new pipe_t();
+    p->buffer = new char[CAPACITY];
+
+    {
+        std::lock_guard<spinlock> l(pipes_lock);
+
+        p->id = next_id++;
+        pipes_list.push_back(p);
+    }
+
+    auto base = "/pipe/" + std::to_string(p->id);
+
+    // The ends are accounted by the registration of the handles
+    read_fd = scheduler::register_new_handle(path(base + "/read"));
+    write_fd = scheduler::register_new_handle(path(base + "/write"));
+
+    logging::logf(logging::log_level::TRACE, "pipe: Created pipe %u (fds %u and %u)\n", p->id, read_fd, write_fd);
+
+    return {};
+}
+
+std::expected<size_t> pipe::read(size_t id, char* buffer, size_t count, size_t ms){
+    auto* p = get_pipe(id);
+
+    if(!p){
+        return std::make_unexpected<size_t>(std::ERROR_NOT_EXISTS);
+    }
+
+    if(!count){
+        return 0;
+    }
+
+    std::lock_guard<spinlock> l(p->lock);
+
+    while(p->head == p->tail){
+        // Nothing can be written anymore
+        if(!p->writers){
+            return 0;
+        }
+
+        if(ms){
+            p->read_queue.enqueue_exclusive_timeout(ms);
+        } else {
+            p->read_queue.enqueue_exclusive();
+        }
+
+        p->lock.unlock();
+
+        scheduler::reschedule();
+
+        p->lock.lock();
+
+        // Still in the queue means the timeout is passed
+        if(ms && p->read_queue.waiting()){
+            p->read_queue.remove();
+
+            return std::make_unexpected<size_t>(std::ERROR_TIMEOUT);
+        }
+    }
+
+    auto n = std::min(count, p->tail - p->head);
+
+    // The bytes may wrap at the end of the buffer
+    auto start = p->head % CAPACITY;
+    auto first = std::min(n, CAPACITY - start);
+
+    std::copy_n(p->buffer + start, first, buffer);
+    std::copy_n(p->buffer, n - first, buffer + first);
+
+    p->head += n;
+
+    // The next reader is only woken up if bytes are left for it
+    if(p->head != p->tail){
+        p->read_queue.wake_up();
+    }
+
+    p->write_queue.wake_up();
+
+    return n;
+}
+
+std::expected<size_t> pipe::write(size_t id, const char* buffer, size_t count){
+    auto* p = get_pipe(id);
+
+    if(!p){
+        return std::make_unexpected<size_t>(std::ERROR_NOT_EXISTS);
+    }
+
+    std::lock_guard<spinlock> l(p->lock);
+
+    size_t written = 0;
+
+    while(written < count){
+        if(!p->readers){
+            if(written){
+                return written;
+            }
+
+            return std::make_unexpected<size_t>(std::ERROR_BROKEN_PIPE);
+        }
+
+        auto space = CAPACITY - (p->tail - p->head);
+
+        if(!space){
+            p->write_queue.enqueue_exclusive();
+
+            p->lock.unlock();
+
+            scheduler::reschedule();
+
+            p->lock.lock();
+
+            continue;
+        }
+
+        auto n = std::min(space, count - written);
+
+        auto start = p->tail % CAPACITY;
+        auto first = std::min(n, CAPACITY - start);
+
+        std::copy_n(buffer + written, first, p->buffer + start);
+        std::copy_n(buffer + written + first, n - first, p->buffer);
+
+        p->tail += n;
+        written += n;
+
+        // One reader consumes while the rest is written, it wakes up the next one
+        p->read_queue.wake_up();
+    }
+
+    // The next writer is only woken up if space is left for it
+    if(p->tail - p->head < CAPACITY){
+        p->write_queue.wake_up();
+    }
+
+    return written;
+}
+
+std::expected<size_t> pipe::size(size_t id){
+    auto* p = get_pipe(id);
+
+    if(!p){
+        return std::make_unexpected<size_t>(std::ERROR_NOT_EXISTS);
+    }
+
+    std::lock_guard<spinlock> l(p->lock);
+
+    return p->tail - p->head;
+}
+
+std::vector<size_t> pipe::pipes(){
+    std::lock_guard<spinlock> l(pipes_lock);
+
+    std::vector<size_t> ids;
+    ids.reserve(pipes_list.size());
+
+    for(auto* p : pipes_list){
+        ids.push_back(p->id);
+    }
+
+    return ids;
+}
+
+void pipe::acquire(const path& file){
+    size_t id;
+    bool write;
+
+    if(!parse_end(file, id, write)){
+        return;
+    }
+
+    std::lock_guard<spinlock> l(pipes_lock);
+
+    auto* p = find_pipe(id);
+
+    if(p){
+        std::lock_guard<spinlock> pl(p->lock);
+
+        if(write){
+            ++p->writers;
+        } else {
+            ++p->readers;
+        }
+    }
+}
+
+void pipe::release(const path& file){
+    size_t id;
+    bool write;
+
+    if(!parse_end(file, id, write)){
+        return;
+    }
+
+    std::lock_guard<spinlock> l(pipes_lock);
+
+    auto* p = find_pipe(id);
+
+    if(!p){
+        return;
+    }
+
+    {
+        std::lock_guard<spinlock> pl(p->lock);
+
+        // The other end sees the end of file or the broken pipe
+        if(write){
+            if(!--p->writers){
+                wake_all(p->read_queue);
+            }
+        } else {
+            if(!--p->readers){
+                wake_all(p->write_queue);
+            }
+        }
+
+        if(p->readers || p->writers){
+            return;
+        }
+    }
+
+    for(size_t i = 0; i < pipes_list.size(); ++i){
+        if(pipes_list[i] == p){
+            pipes_list.erase(i);
+            break;
+        }
+    }
+
+    logging::logf(logging::log_level::TRACE, "pipe: Released pipe %u\n", p->id);
+
+    delete[] p->buffer;
+    delete p;
+}
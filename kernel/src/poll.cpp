@@ -0,0 +1,367 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <lock_guard.hpp>
+#include <algorithms.hpp>
+
+#include "tlib/errors.hpp"
+
+#include "poll.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+
+#include "vfs/vfs.hpp"
+
+#include "net/network.hpp"
+
+namespace {
+
+// Returns the events of the watch that are ready, the hang up is always
+// reported
+size_t ready_events(const poll::watch* w){
+    return w->origin->events() & ((w->events & ~poll::POLL_EDGE) | poll::POLL_HUP);
+}
+
+std::expected<poll::source*> find_source(poll::poll_target target, size_t fd){
+    switch(target){
+        case poll::poll_target::FILE:
+            return vfs::poll_source(fd);
+
+        case poll::poll_target::SOCKET:
+            return network::poll_source(fd);
+
+        default:
+            return std::make_unexpected<poll::source*>(std::ERROR_INVALID_REQUEST);
+    }
+}
+
+} //end of anonymous namespace
+
+void poll::source::init(readiness_fun fun, const void* object){
+    this->readiness = fun;
+    this->object = object;
+}
+
+size_t poll::source::events() const {
+    return readiness(object);
+}
+
+void poll::source::notify(){
+    std::lock_guard<spinlock> l(lock);
+
+    for(auto* w = watches; w; w = w->next){
+        if(ready_events(w)){
+            w->owner->wake(w);
+        }
+    }
+}
+
+poll::instance::~instance(){
+    for(auto* w : watches){
+        detach(w);
+    }
+}
+
+poll::watch* poll::instance::find(poll_target target, size_t fd){
+    for(auto* w : watches){
+        if(w->target == target && w->fd == fd){
+            return w;
+        }
+    }
+
+    return nullptr;
+}
+
+void poll::instance::queue(watch* w){
+    w->queued = true;
+    w->ready_next = nullptr;
+    w->ready_prev = ready_tail;
+
+    if(ready_tail){
+        ready_tail->ready_next = w;
+    } else {
+        ready_head = w;
+    }
+
+    ready_tail = w;
+    ++ready_count;
+}
+
+void poll::instance::dequeue(watch* w){
+    if(w->ready_prev){
+        w->ready_prev->ready_next = w->ready_next;
+    } else {
+        ready_head = w->ready_next;
+    }
+
+    if(w->ready_next){
+        w->ready_next->ready_prev = w->ready_prev;
+    } else {
+        ready_tail = w->ready_prev;
+    }
+
+    w->queued = false;
+    w->ready_prev = w->ready_next = nullptr;
+    --ready_count;
+}
+
+void poll::instance::wake(watch* w){
+    std::lock_guard<spinlock> l(lock);
+
+    if(!w->queued){
+        queue(w);
+    }
+
+    if(!waiters.empty()){
+        // The waiter may have been woken up by its timeout and not be
+        // removed from the list yet
+        waiters.dequeue_hint();
+    }
+}
+
+// Unlink the watch from its source and from the ready list, it is not
+// reachable from the source once this returns
+void poll::instance::detach(watch* w){
+    auto* origin = w->origin;
+
+    {
+        std::lock_guard<spinlock> l(origin->lock);
+
+        auto** link = &origin->watches;
+
+        while(*link != w){
+            link = &(*link)->next;
+        }
+
+        *link = w->next;
+
+        std::lock_guard<spinlock> l2(lock);
+
+        if(w->queued){
+            dequeue(w);
+        }
+    }
+
+    delete w;
+}
+
+std::expected<void> poll::instance::add(poll_target target, size_t fd, source* origin, size_t events, size_t data){
+    if(find(target, fd)){
+        return std::make_unexpected<void>(std::ERROR_EXISTS);
+    }
+
+    auto* w = new watch();
+
+    w->target = target;
+    w->fd     = fd;
+    w->events = events;
+    w->data   = data;
+    w->owner  = this;
+    w->origin = origin;
+
+    watches.push_back(w);
+
+    std::lock_guard<spinlock> l(origin->lock);
+
+    w->next = origin->watches;
+    origin->watches = w;
+
+    // The descriptor may already be ready
+    if(ready_events(w)){
+        wake(w);
+    }
+
+    return {};
+}
+
+std::expected<void> poll::instance::modify(poll_target target, size_t fd, size_t events, size_t data){
+    auto* w = find(target, fd);
+
+    if(!w){
+        return std::make_unexpected<void>(std::ERROR_NOT_EXISTS);
+    }
+
+    std::lock_guard<spinlock> l(w->origin->lock);
+
+    w->events = events;
+    w->data   = data;
+
+    if(ready_events(w)){
+        wake(w);
+    }
+
+    return {};
+}
+
+std::expected<void> poll::instance::remove(poll_target target, size_t fd){
+    auto* w = find(target, fd);
+
+    if(!w){
+        return std::make_unexpected<void>(std::ERROR_NOT_EXISTS);
+    }
+
+    watches.erase(std::remove(watches.begin(), watches.end(), w), watches.end());
+
+    detach(w);
+
+    return {};
+}
+
+void poll::instance::forget(poll_target target, size_t fd){
+    remove(target, fd);
+}
+
+// Fill the events with the ready watches, must be called with the lock.
+// The level triggered watches are moved at the end of the list to be fair
+// when there are more ready watches than events.
+size_t poll::instance::harvest(poll_event* events, size_t n){
+    size_t count = 0;
+    size_t pending = ready_count;
+
+    while(pending-- && count < n){
+        auto* w = ready_head;
+        auto ready = ready_events(w);
+
+        dequeue(w);
+
+        if(ready){
+            events[count++] = {w->target, w->fd, ready, w->data};
+
+            if(!(w->events & POLL_EDGE)){
+                queue(w);
+            }
+        }
+    }
+
+    return count;
+}
+
+size_t poll::instance::wait(poll_event* events, size_t n){
+    while(true){
+        lock.lock();
+
+        auto count = harvest(events, n);
+
+        if(count){
+            lock.unlock();
+
+            return count;
+        }
+
+        // The sources take the lock to queue their watch, no wake up is lost
+        waiters.enqueue();
+
+        lock.unlock();
+
+        scheduler::reschedule();
+    }
+}
+
+size_t poll::instance::wait(poll_event* events, size_t n, size_t ms){
+    auto deadline = timer::milliseconds() + ms;
+
+    while(true){
+        lock.lock();
+
+        auto count = harvest(events, n);
+        auto now = timer::milliseconds();
+
+        if(count || now >= deadline){
+            lock.unlock();
+
+            return count;
+        }
+
+        waiters.enqueue_timeout(deadline - now);
+
+        lock.unlock();
+
+        scheduler::reschedule();
+
+        // Still in the list after the timeout
+        std::lock_guard<spinlock> l(lock);
+
+        if(waiters.waiting()){
+            waiters.remove();
+        }
+    }
+}
+
+std::expected<size_t> poll::create(){
+    return scheduler::register_new_poll(new instance());
+}
+
+std::expected<void> poll::close(size_t fd){
+    if(!scheduler::has_poll(fd)){
+        return std::make_unexpected<void>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    delete scheduler::release_poll(fd);
+
+    return {};
+}
+
+std::expected<void> poll::control(size_t fd, poll_operation operation, const poll_event* event){
+    if(!scheduler::has_poll(fd)){
+        return std::make_unexpected<void>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    auto& instance = scheduler::get_poll(fd);
+
+    switch(operation){
+        case poll_operation::ADD: {
+            auto origin = find_source(event->target, event->fd);
+
+            if(!origin){
+                return std::make_unexpected<void>(origin.error());
+            }
+
+            return instance.add(event->target, event->fd, *origin, event->events, event->data);
+        }
+
+        case poll_operation::MODIFY:
+            return instance.modify(event->target, event->fd, event->events, event->data);
+
+        case poll_operation::REMOVE:
+            return instance.remove(event->target, event->fd);
+
+        default:
+            return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+    }
+}
+
+std::expected<size_t> poll::wait(size_t fd, poll_event* events, size_t n){
+    if(!scheduler::has_poll(fd)){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    if(!n || n > MAX_POLL_EVENTS){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    return scheduler::get_poll(fd).wait(events, n);
+}
+
+std::expected<size_t> poll::wait(size_t fd, poll_event* events, size_t n, size_t ms){
+    if(!scheduler::has_poll(fd)){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    if(!n || n > MAX_POLL_EVENTS){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    return scheduler::get_poll(fd).wait(events, n, ms);
+}
+
+void poll::forget(poll_target target, size_t fd){
+    for(auto* instance : scheduler::get_polls()){
+        if(instance){
+            instance->forget(target, fd);
+        }
+    }
+}
@@ -86,21 +86,21 @@ void k_print(char key){
 }
 
 void k_print(const char* str){
-    for(uint64_t i = 0; str[i] != 0; ++i){
-        k_print(str[i]);
-    }
+    stdio::get_active_terminal().print(str, std::str_len(str));
 }
 
 void k_print(const std::string& s){
-    for(auto c : s){
-        k_print(c);
-    }
+    stdio::get_active_terminal().print(s.c_str(), s.size());
 }
 
 void k_print(const char* str, uint64_t end){
-    for(uint64_t i = 0; i < end && str[i] != 0; ++i){
-        k_print(str[i]);
+    uint64_t n = 0;
+
+    while(n < end && str[n] != 0){
+        ++n;
     }
+
+    stdio::get_active_terminal().print(str, n);
 }
 
 #include "printf_def.hpp"
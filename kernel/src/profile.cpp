@@ -0,0 +1,209 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include "profile.hpp"
+#include "scheduler.hpp"
+#include "smp.hpp"
+#include "print.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t ring_size = 1024; ///< The number of samples of a ring
+constexpr const size_t ring_mask = ring_size - 1;
+
+static_assert((ring_size & ring_mask) == 0, "The size of the rings must be a power of two");
+
+/*!
+ * \brief The interrupted context of a processor
+ */
+struct sample_t {
+    uint64_t rip;                                     ///< The interrupted address
+    size_t pid;                                       ///< The interrupted process
+    bool user;                                        ///< Indicates if the processor was in user mode
+    size_t depth;                                     ///< The number of unwound frames
+    std::array<uint64_t, profile::MAX_DEPTH> frames; ///< The return addresses of the unwound frames
+};
+
+/*!
+ * \brief The samples of a processor.
+ *
+ * The timer interrupt of the processor is the only writer, the samples
+ * are dropped while the ring is full.
+ */
+struct ring_t {
+    volatile uint64_t head = 0;  ///< The number of written samples
+    volatile uint64_t tail = 0;  ///< The number of consumed samples
+    sample_t* samples = nullptr; ///< The ring_size samples
+};
+
+std::array<ring_t, smp::MAX_CPUS> rings;
+
+volatile bool enabled = false;
+volatile size_t depth = 0;
+
+spinlock read_lock; ///< Serialize the readers
+
+volatile size_t dropped = 0; ///< The number of samples dropped because their ring was full
+
+std::string sysfs_dropped(){
+    return std::to_string(dropped);
+}
+
+// Follow the saved frame pointers, inside the kernel stack of the process only
+size_t unwind(const interrupt::syscall_regs* regs, sample_t& sample){
+    auto& process = scheduler::get_process(sample.pid);
+
+    size_t bottom = process.system
+        ? reinterpret_cast<size_t>(process.kernel_stack)
+        : process.virtual_kernel_stack;
+
+    if(!bottom){
+        return 0;
+    }
+
+    size_t top = bottom + scheduler::kernel_stack_size;
+
+    size_t frames = 0;
+    size_t rbp = regs->rbp;
+
+    while(frames < depth && rbp >= bottom && rbp + 16 <= top && !(rbp & 0x7)){
+        auto* frame = reinterpret_cast<const size_t*>(rbp);
+
+        sample.frames[frames++] = frame[1];
+
+        // The frames are deeper in the stack, anything else is not a frame
+        if(frame[0] <= rbp){
+            break;
+        }
+
+        rbp = frame[0];
+    }
+
+    return frames;
+}
+
+void format(std::string& line, size_t cpu, const sample_t& sample){
+    line = sprintf("%u %u %s %x", cpu, sample.pid, sample.user ? "u" : "k", sample.rip);
+
+    for(size_t i = 0; i < sample.depth; ++i){
+        line += sprintf(" %x", sample.frames[i]);
+    }
+
+    line += '\n';
+}
+
+} //End of anonymous namespace
+
+void profile::start(size_t frames){
+    // The rings are kept once allocated, they can be read at any time
+    for(size_t cpu = 0; cpu < smp::max_cpus(); ++cpu){
+        if(smp::online(cpu) && !rings[cpu].samples){
+            rings[cpu].samples = new sample_t[ring_size];
+        }
+    }
+
+    static bool sysfs = false;
+
+    if(!sysfs){
+        sysfs::set_dynamic_value(path("/sys"), path("/profile/dropped"), &sysfs_dropped);
+        sysfs = true;
+    }
+
+    depth = std::min(frames, MAX_DEPTH);
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    enabled = true;
+
+    logging::logf(logging::log_level::TRACE, "profile: Started (depth: %u)\n", depth);
+}
+
+void profile::stop(){
+    enabled = false;
+
+    logging::logf(logging::log_level::TRACE, "profile: Stopped\n");
+}
+
+void profile::sample(const interrupt::syscall_regs* regs){
+    if(!enabled){
+        return;
+    }
+
+    auto& ring = rings[smp::current_cpu()];
+
+    // A processor started after the profiler has no ring
+    if(!ring.samples){
+        return;
+    }
+
+    auto head = ring.head;
+
+    if(head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == ring_size){
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    auto& sample = ring.samples[head & ring_mask];
+
+    sample.rip = regs->rip;
+    sample.pid = scheduler::get_pid();
+    sample.user = regs->cs & 0x3;
+    sample.depth = 0;
+
+    // The user stacks are not walked from the interrupt
+    if(!sample.user && depth){
+        sample.depth = unwind(regs, sample);
+    }
+
+    __atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+}
+
+size_t profile::pending(){
+    size_t count = 0;
+
+    for(auto& ring : rings){
+        count += __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) - ring.tail;
+    }
+
+    return count;
+}
+
+size_t profile::read(char* buffer, size_t count){
+    std::lock_guard<spinlock> l(read_lock);
+
+    size_t written = 0;
+    std::string line;
+
+    for(size_t cpu = 0; cpu < rings.size(); ++cpu){
+        auto& ring = rings[cpu];
+
+        while(ring.tail != __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE)){
+            format(line, cpu, ring.samples[ring.tail & ring_mask]);
+
+            // Only complete lines are given
+            if(written + line.size() > count){
+                return written;
+            }
+
+            std::copy_n(line.c_str(), line.size(), buffer + written);
+            written += line.size();
+
+            __atomic_store_n(&ring.tail, ring.tail + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    return written;
+}
@@ -0,0 +1,354 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+#include <lock_guard.hpp>
+
+#include "request_queue.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+
+#include "conc/deferred_unique_mutex.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const uint64_t READ_DEADLINE = 500;   ///< The time (in milliseconds) a read can wait behind the elevator
+constexpr const uint64_t WRITE_DEADLINE = 5000; ///< The time (in milliseconds) a write can wait behind the elevator
+
+uint64_t deadline(const block_request& request){
+    return request.submitted + (request.operation == block_operation::READ ? READ_DEADLINE : WRITE_DEADLINE);
+}
+
+void dispatcher_task(void* data){
+    reinterpret_cast<request_queue*>(data)->dispatch();
+}
+
+void wake_up(block_request& request){
+    reinterpret_cast<deferred_unique_mutex*>(request.data)->notify();
+}
+
+uint64_t sysfs_requests(void* data){
+    return reinterpret_cast<request_queue*>(data)->requests;
+}
+
+uint64_t sysfs_transfers(void* data){
+    return reinterpret_cast<request_queue*>(data)->transfers;
+}
+
+uint64_t sysfs_merges(void* data){
+    return reinterpret_cast<request_queue*>(data)->merges;
+}
+
+uint64_t sysfs_expired(void* data){
+    return reinterpret_cast<request_queue*>(data)->expired;
+}
+
+uint64_t sysfs_depth(void* data){
+    return reinterpret_cast<request_queue*>(data)->depth;
+}
+
+uint64_t sysfs_max_depth(void* data){
+    return reinterpret_cast<request_queue*>(data)->max_depth;
+}
+
+uint64_t sysfs_average_latency(void* data){
+    auto queue = reinterpret_cast<request_queue*>(data);
+    return queue->completed ? queue->latency / queue->completed : 0;
+}
+
+uint64_t sysfs_max_latency(void* data){
+    return reinterpret_cast<request_queue*>(data)->max_latency;
+}
+
+} //end of anonymous namespace
+
+void request_queue::init(const std::string& name, block_handler handler, void* data, size_t sector_size, size_t max_sectors){
+    this->name = name;
+    this->handler = handler;
+    this->handler_data = data;
+    this->sector_size = sector_size;
+    this->max_sectors = max_sectors;
+
+    requests = 0;
+    completed = 0;
+    transfers = 0;
+    merges = 0;
+    expired = 0;
+    depth = 0;
+    max_depth = 0;
+    latency = 0;
+    max_latency = 0;
+
+    merge_buffer = new char[max_sectors * sector_size];
+
+    started = false;
+    position = 0;
+
+    pending.init(0);
+    head = nullptr;
+
+    auto base = path("/request_queue") / name;
+
+    sysfs::set_counter_value_data(path("/sys"), base / "requests", &sysfs_requests, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "transfers", &sysfs_transfers, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "merges", &sysfs_merges, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "expired", &sysfs_expired, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "depth", &sysfs_depth, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "max_depth", &sysfs_max_depth, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "average_latency", &sysfs_average_latency, this);
+    sysfs::set_counter_value_data(path("/sys"), base / "max_latency", &sysfs_max_latency, this);
+}
+
+void request_queue::start(){
+    auto* user_stack = new char[scheduler::user_stack_size];
+    auto* kernel_stack = new char[scheduler::kernel_stack_size];
+
+    auto task_name = "io_" + name;
+
+    auto& process = scheduler::create_kernel_task_args(task_name.c_str(), user_stack, kernel_stack, &dispatcher_task, this);
+    process.ppid = 1;
+    process.priority = scheduler::DEFAULT_PRIORITY;
+
+    started = true;
+
+    scheduler::queue_system_process(process.pid);
+}
+
+void request_queue::submit(block_request& request){
+    request.submitted = timer::milliseconds();
+    request.result = 0;
+    request.transferred = 0;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        // Keep the requests sorted by sector, in submission order for a same sector
+        auto** link = &head;
+
+        while(*link && (*link)->sector <= request.sector){
+            link = &(*link)->next;
+        }
+
+        request.next = *link;
+        *link = &request;
+
+        ++requests;
+        ++depth;
+        max_depth = std::max(max_depth, depth);
+    }
+
+    pending.unlock();
+}
+
+size_t request_queue::execute(block_operation operation, uint64_t sector, size_t count, char* buffer, size_t& transferred){
+    // Until the dispatcher runs, there is no one to wait for
+    if(!started){
+        return handler(handler_data, operation, sector, count, buffer, transferred);
+    }
+
+    deferred_unique_mutex done;
+    done.claim();
+
+    block_request request;
+    request.operation = operation;
+    request.sector = sector;
+    request.count = count;
+    request.buffer = buffer;
+    request.callback = &wake_up;
+    request.data = &done;
+
+    submit(request);
+
+    done.wait();
+
+    transferred += request.transferred;
+
+    return request.result;
+}
+
+void request_queue::dispatch(){
+    while(true){
+        pending.lock();
+
+        block_request* batch;
+
+        {
+            std::lock_guard<spinlock> l(lock);
+
+            batch = next_request();
+        }
+
+        // The request of this token may already have been merged
+        if(!batch){
+            continue;
+        }
+
+        auto operation = batch->operation;
+        auto sector = batch->sector;
+
+        size_t count = 0;
+        size_t n = 0;
+
+        for(auto* request = batch; request; request = request->next){
+            count += request->count;
+            ++n;
+        }
+
+        // The merged requests do not need their own dispatch
+        for(size_t i = 1; i < n; ++i){
+            pending.try_lock();
+        }
+
+        ++transfers;
+        merges += n - 1;
+
+        position = sector + count;
+
+        size_t transferred = 0;
+        size_t result;
+
+        if(n == 1){
+            result = handler(handler_data, operation, sector, count, batch->buffer, transferred);
+
+            complete(*batch, result, transferred);
+
+            continue;
+        }
+
+        // The merged requests go through a contiguous buffer
+        char* buffer = operation == block_operation::CLEAR ? nullptr : merge_buffer;
+
+        if(operation == block_operation::WRITE){
+            auto* destination = merge_buffer;
+
+            for(auto* request = batch; request; request = request->next){
+                std::copy_n(request->buffer, request->count * sector_size, destination);
+                destination += request->count * sector_size;
+            }
+        }
+
+        result = handler(handler_data, operation, sector, count, buffer, transferred);
+
+        auto* source = merge_buffer;
+
+        while(batch){
+            auto* next = batch->next;
+            auto bytes = batch->count * sector_size;
+
+            if(operation == block_operation::READ && !result){
+                std::copy_n(source, bytes, batch->buffer);
+            }
+
+            source += bytes;
+
+            complete(*batch, result, result ? 0 : bytes);
+
+            batch = next;
+        }
+    }
+}
+
+/*!
+ * \brief Remove the next requests to dispatch from the queue. The lock
+ * must be held.
+ * \return the requests to transfer together, linked in sector order
+ */
+block_request* request_queue::next_request(){
+    if(!head){
+        return nullptr;
+    }
+
+    auto now = timer::milliseconds();
+
+    block_request* first = nullptr;
+
+    // The oldest request past its deadline is served first
+    for(auto* request = head; request; request = request->next){
+        if(deadline(*request) <= now && (!first || request->submitted < first->submitted)){
+            first = request;
+        }
+    }
+
+    if(first){
+        ++expired;
+    } else {
+        // Otherwise, continue in the direction of the disk, or restart from the lowest sector
+        for(auto* request = head; request; request = request->next){
+            if(request->sector >= position){
+                first = request;
+                break;
+            }
+        }
+
+        if(!first){
+            first = head;
+        }
+    }
+
+    // Merge the following adjacent requests with the same operation
+    auto* last = first;
+    auto count = first->count;
+
+    while(true){
+        auto* candidate = last->next;
+
+        if(!candidate || candidate->operation != first->operation || candidate->sector != last->sector + last->count){
+            break;
+        }
+
+        if(count + candidate->count > max_sectors){
+            break;
+        }
+
+        count += candidate->count;
+        last = candidate;
+    }
+
+    unlink(first, last);
+
+    return first;
+}
+
+/*!
+ * \brief Remove the consecutive requests from first to last from the queue,
+ * they stay chained together. The lock must be held.
+ */
+void request_queue::unlink(block_request* first, block_request* last){
+    auto** link = &head;
+
+    while(*link != first){
+        link = &(*link)->next;
+    }
+
+    *link = last->next;
+    last->next = nullptr;
+}
+
+/*!
+ * \brief Complete the given request and update the statistics
+ */
+void request_queue::complete(block_request& request, size_t result, size_t transferred){
+    auto elapsed = timer::milliseconds() - request.submitted;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        --depth;
+        ++completed;
+        latency += elapsed;
+        max_latency = std::max(max_latency, elapsed);
+    }
+
+    request.result = result;
+    request.transferred = transferred;
+
+    if(request.callback){
+        request.callback(request);
+    }
+}
@@ -0,0 +1,231 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <string.hpp>
+#include <lock_guard.hpp>
+
+#include "sched_trace.hpp"
+#include "smp.hpp"
+#include "timer.hpp"
+#include "print.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t ring_size = 512;           ///< The number of events of each ring
+constexpr const size_t ring_mask = ring_size - 1; ///< The mask of an index in a ring
+
+static_assert((ring_size & ring_mask) == 0, "The ring size must be a power of two");
+
+/*!
+ * \brief An event in a ring
+ */
+struct event_t {
+    volatile uint64_t sequence;        ///< The index of the event plus one, zero while it is written
+    uint64_t timestamp;                ///< The counter value of the event
+    size_t pid;                        ///< The process of the event
+    size_t other;                      ///< The other process of the event
+    sched_trace::event_type type;      ///< The type of the event
+};
+
+/*!
+ * \brief The events of a processor.
+ *
+ * Any context of the processor reserves an event with an atomic increment,
+ * so the writers never wait. The reader detects the events that have been
+ * overwritten before it could read them.
+ */
+struct ring_t {
+    volatile uint64_t head = 0; ///< The number of reserved events
+    uint64_t tail = 0;          ///< The number of consumed events
+    event_t* events = nullptr;  ///< The ring_size events
+};
+
+std::array<ring_t, smp::MAX_CPUS> rings;
+
+bool enabled = false;
+
+spinlock read_lock; ///< Serialize the readers
+
+volatile size_t lost = 0; ///< The number of events overwritten before being read
+
+std::string sysfs_lost(){
+    return std::to_string(lost);
+}
+
+const char* type_to_string(sched_trace::event_type type){
+    switch(type){
+        case sched_trace::event_type::SWITCH:
+            return "switch";
+        case sched_trace::event_type::WAKEUP:
+            return "wakeup";
+        case sched_trace::event_type::BLOCK:
+            return "block";
+    }
+
+    return "";
+}
+
+/*!
+ * \brief Skip the events that the writers have already overwritten
+ */
+void catch_up(ring_t& ring){
+    auto head = ring.head;
+
+    if(head - ring.tail > ring_size){
+        lost += head - ring.tail - ring_size;
+        ring.tail = head - ring_size;
+    }
+}
+
+/*!
+ * \brief Copy the next event of the ring
+ * \return true if there was a complete event to read, false otherwise
+ */
+bool peek(ring_t& ring, event_t& event){
+    while(ring.tail != ring.head){
+        auto& slot = ring.events[ring.tail & ring_mask];
+
+        auto sequence = slot.sequence;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        event.timestamp = slot.timestamp;
+        event.pid = slot.pid;
+        event.other = slot.other;
+        event.type = slot.type;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if(sequence == ring.tail + 1 && slot.sequence == sequence){
+            return true;
+        }
+
+        // The event is still being written, it will be read next time
+        if(sequence <= ring.tail + 1){
+            return false;
+        }
+
+        // The event has been overwritten
+        ++lost;
+        ++ring.tail;
+    }
+
+    return false;
+}
+
+} //End of anonymous namespace
+
+void sched_trace::init(){
+    // The rings are allocated once the kernel allocator is ready
+    for(auto& ring : rings){
+        ring.events = new event_t[ring_size]();
+
+        if(!ring.events){
+            logging::logf(logging::log_level::ERROR, "sched_trace: Unable to allocate the trace rings\n");
+            return;
+        }
+    }
+
+    enabled = true;
+
+    sysfs::set_dynamic_value(path("/sys"), path("/sched_trace/lost"), &sysfs_lost);
+}
+
+uint64_t sched_trace::timestamp(){
+    return enabled ? timer::counter() : 0;
+}
+
+uint64_t sched_trace::to_us(uint64_t ticks){
+    auto frequency = timer::counter_frequency();
+
+    if(frequency >= 1000000){
+        return ticks / (frequency / 1000000);
+    }
+
+    return frequency ? (ticks * 1000000) / frequency : 0;
+}
+
+void sched_trace::record(event_type type, size_t pid, size_t other){
+    if(!enabled){
+        return;
+    }
+
+    auto& ring = rings[smp::current_cpu()];
+
+    auto index = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+    auto& event = ring.events[index & ring_mask];
+
+    event.sequence = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    event.timestamp = timer::counter();
+    event.pid = pid;
+    event.other = other;
+    event.type = type;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event.sequence = index + 1;
+}
+
+size_t sched_trace::pending(){
+    size_t count = 0;
+
+    for(auto& ring : rings){
+        auto available = ring.head - ring.tail;
+        count += available > ring_size ? ring_size : available;
+    }
+
+    return count;
+}
+
+size_t sched_trace::read(char* buffer, size_t count){
+    std::lock_guard<spinlock> l(read_lock);
+
+    size_t written = 0;
+
+    while(written + LINE_SIZE <= count){
+        // Merge the rings by taking the oldest event first
+        ring_t* oldest = nullptr;
+        event_t oldest_event;
+        size_t oldest_cpu = 0;
+
+        for(size_t cpu = 0; cpu < rings.size(); ++cpu){
+            auto& ring = rings[cpu];
+
+            catch_up(ring);
+
+            event_t event;
+            if(peek(ring, event) && (!oldest || event.timestamp < oldest_event.timestamp)){
+                oldest = &ring;
+                oldest_event = event;
+                oldest_cpu = cpu;
+            }
+        }
+
+        if(!oldest){
+            break;
+        }
+
+        ++oldest->tail;
+
+        // The fixed width lets a reader compute the size of the pending events
+        char line[LINE_SIZE + 1];
+        sprintf_raw(line, LINE_SIZE + 1, "%.20u %.2u %6s %.20u %.20u\n",
+            oldest_event.timestamp, oldest_cpu, type_to_string(oldest_event.type), oldest_event.pid, oldest_event.other);
+
+        std::copy_n(line, LINE_SIZE, buffer + written);
+        written += LINE_SIZE;
+    }
+
+    return written;
+}
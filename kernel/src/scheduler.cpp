@@ -13,10 +13,15 @@
 
 #include <tlib/errors.hpp>
 #include <tlib/elf.hpp>
+#include <tlib/flags.hpp>
 
 #include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
+#include "conc/qsbr.hpp"
+#include "conc/semaphore.hpp"
 
 #include "scheduler.hpp"
+#include "process_table.hpp"
 #include "paging.hpp"
 #include "assert.hpp"
 #include "gdt.hpp"
@@ -29,9 +34,28 @@
 #include "kernel_utils.hpp"
 #include "logging.hpp"
 #include "timer.hpp"
+#include "time_page.hpp"
+#include "sched_trace.hpp"
+#include "boot_trace.hpp"
 #include "kernel.hpp"
+#include "smp.hpp"
+#include "cpuidle.hpp"
+#include "page_cache.hpp"
+#include "elf_cache.hpp"
+#include "aio.hpp"
+#include "io_ring.hpp"
+#include "shm.hpp"
+#include "pipe.hpp"
+#include "syscall_stats.hpp"
+#include "poll.hpp"
+#include "softirq.hpp"
+
+#include "drivers/apic.hpp"
 
 #include "fs/procfs.hpp"
+#include "fs/sysfs.hpp"
+
+#include "vfs/vfs.hpp"
 
 //Provided by task_switch.s
 extern "C" {
@@ -49,513 +73,1850 @@ namespace {
 
 constexpr const size_t STACK_ALIGNMENT = 16;     ///< In bytes
 constexpr const size_t ROUND_ROBIN_QUANTUM = 25; ///< In milliseconds
+constexpr const size_t BALANCE_INTERVAL = 100;   ///< In milliseconds
+constexpr const size_t MIGRATION_COST = 5;       ///< In milliseconds, a process that ran more recently is cache-hot
+constexpr const size_t MAX_TICKLESS = 1000;      ///< In milliseconds, the longest time the tick can be stopped
+constexpr const size_t GC_BATCH = 256;          ///< The pages released at once by the GC thread
+constexpr const uint64_t FAIR_SCALE = 1ULL << (scheduler::PRIORITY_LEVELS - 1); ///< The virtual runtime of one tick at the lowest priority
+constexpr const uint32_t DEFAULT_MXCSR = 0x1F80;      ///< All SSE exceptions masked, round to nearest
+constexpr const uint16_t DEFAULT_FPU_CONTROL = 0x37F; ///< The x87 control word set by fninit
+constexpr const uint32_t MSR_FS_BASE = 0xC0000100;    ///< The base of the FS segment
+constexpr const size_t FAULT_AROUND_PAGES = 8;        ///< The cached pages of the shared text mapped after a fault
+constexpr const char* AUTORUN_SCRIPT = "/autorun.tsh";       ///< The script run by the init task before the shell, if present
 
 //The Process Control Block
-using pcb_t = std::array<scheduler::process_control_t, scheduler::MAX_PROCESS>;
-
-pcb_t pcb;
+scheduler::process_table pcb;
+
+/*!
+ * \brief Returns the priority the process is scheduled with, its own
+ * priority or the one inherited from the waiters of its mutexes
+ */
+size_t effective_priority(const scheduler::process_control_t& process){
+    return std::max(process.process.priority, process.boost);
+}
 
-//Define one run queue for each priority level
-std::array<std::vector<scheduler::pid_t>, scheduler::PRIORITY_LEVELS> run_queues;
+/*!
+ * \brief Indicates if the process is scheduled in the fair class.
+ *
+ * A fair process boosted above the fair class is scheduled as a round
+ * robin process of its inherited priority until the boost is removed.
+ */
+bool fair_class(const scheduler::process_control_t& process){
+    return process.policy == scheduler::sched_policy::FAIR && process.boost < scheduler::DEFAULT_PRIORITY;
+}
 
-int_lock queue_lock;
+/*!
+ * \brief Returns the rank of the scheduling class of the process.
+ *
+ * Round robin levels are ranked by priority. The fair class is ranked
+ * as a whole between the default priority and the level below it.
+ */
+size_t rank(const scheduler::process_control_t& process){
+    if(fair_class(process)){
+        return 2 * scheduler::DEFAULT_PRIORITY - 1;
+    }
 
-volatile bool started = false;
+    return 2 * effective_priority(process);
+}
 
-volatile size_t rr_quantum = 0;
+/*!
+ * \brief Returns the weight of a fair process, the higher the priority,
+ * the slower its virtual runtime grows
+ */
+uint64_t fair_weight(const scheduler::process_control_t& process){
+    return 1ULL << (effective_priority(process) - scheduler::MIN_PRIORITY);
+}
 
-volatile size_t current_pid;
-volatile size_t next_pid = 0;
+/*!
+ * \brief The queue of the processes ready to run.
+ *
+ * There is one intrusive FIFO list for each priority level and a bitmap
+ * indicating which levels are not empty. The processes of the fair class
+ * are kept in a binary min-heap ordered by virtual runtime. The currently
+ * running process is not in the queue.
+ */
+struct run_queue_t {
+    /*!
+     * \brief Indicates if there is no ready process in the queue
+     */
+    bool empty() const {
+        return !ready_bitmap && fair_heap.empty();
+    }
 
-size_t gc_pid = 0;
-size_t idle_pid = 0;
-size_t init_pid = 0;
+    /*!
+     * \brief Returns the highest rank with a ready process.
+     *
+     * The queue must not be empty.
+     */
+    size_t highest_rank() const {
+        size_t best = 0;
 
-std::vector<scheduler::pid_t>& run_queue(size_t priority){
-    return run_queues[priority - scheduler::MIN_PRIORITY];
-}
+        if(ready_bitmap){
+            best = 2 * (scheduler::MIN_PRIORITY + (63 - __builtin_clzll(ready_bitmap)));
+        }
 
-void idle_task(){
-    while(true){
-        asm volatile("hlt");
+        if(!fair_heap.empty() && fair_rank() > best){
+            best = fair_rank();
+        }
 
-        //If we go out of 'hlt', there have been an IRQ
-        //There is probably someone ready, let's yield
-        scheduler::yield();
+        return best;
     }
-}
-
-void gc_task(){
-    while(true){
-        //Wait until there is something to do
-        scheduler::block_process(scheduler::get_pid());
 
-        //2. Clean up each killed process
+    /*!
+     * \brief Indicates if a queued process should run instead of the given process
+     */
+    bool should_preempt(const scheduler::process_control_t& current) const {
+        if(empty()){
+            return false;
+        }
 
-        for(auto& process : pcb){
-            if(process.state == scheduler::process_state::KILLED){
-                auto& desc = process.process;
-                auto prev_pid = desc.pid;
+        auto best = highest_rank();
+        auto current_rank = rank(current);
 
-                logging::logf(logging::log_level::DEBUG, "scheduler: Clean process %u\n", prev_pid);
+        // Between fair processes, the lowest virtual runtime wins
+        if(best == current_rank && fair_class(current)){
+            return fair_heap[0]->vruntime < current.vruntime;
+        }
 
-                // 0. Notify parent if still waiting
-                auto ppid = desc.ppid;
-                for(auto& parent_process : pcb){
-                    if(parent_process.process.pid == ppid && parent_process.state == scheduler::process_state::WAITING){
-                        scheduler::unblock_process(parent_process.process.pid);
-                    }
-                }
+        // Round robin between the processes of the same priority
+        return best >= current_rank;
+    }
 
-                // 1. Release physical memory of PML4T (if not system task)
+    /*!
+     * \brief Add the process to the queue
+     */
+    void enqueue(scheduler::process_control_t& process){
+        if(process.queued){
+            return;
+        }
 
-                if(!desc.system){
-                    physical_allocator::free(desc.physical_cr3, 1);
-                }
+        if(fair_class(process)){
+            fair_push(process);
+        } else {
+            auto level = effective_priority(process) - scheduler::MIN_PRIORITY;
 
-                // 2. Release physical stacks (if dynamically allocated)
+            process.run_next = nullptr;
+            process.run_prev = tails[level];
 
-                if(desc.physical_kernel_stack){
-                    physical_allocator::free(desc.physical_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE);
-                }
+            if(tails[level]){
+                tails[level]->run_next = &process;
+            } else {
+                heads[level] = &process;
+            }
 
-                if(desc.physical_user_stack){
-                    physical_allocator::free(desc.physical_user_stack, scheduler::user_stack_size / paging::PAGE_SIZE);
-                }
+            tails[level] = &process;
 
-                // kernel processes can either use dynamic memory or static memory
+            ready_bitmap |= 1ULL << level;
+        }
 
-                if(desc.system){
-                    if(reinterpret_cast<size_t>(desc.user_stack) >= paging::virtual_paging_start + (paging::physical_memory_pages * paging::PAGE_SIZE)){
-                        delete[] desc.user_stack;
-                    }
+        process.queued = true;
+        ++size;
+    }
 
-                    if(reinterpret_cast<size_t>(desc.kernel_stack) >= paging::virtual_paging_start + (paging::physical_memory_pages * paging::PAGE_SIZE)){
-                        delete[] desc.kernel_stack;
-                    }
-                }
+    /*!
+     * \brief Remove the process from the queue, if it is queued
+     */
+    void dequeue(scheduler::process_control_t& process){
+        if(!process.queued){
+            return;
+        }
 
-                // 3. Release segment's physical memory
+        if(fair_class(process)){
+            fair_remove(process);
+        } else {
+            auto level = effective_priority(process) - scheduler::MIN_PRIORITY;
 
-                for(auto& segment : desc.segments){
-                    physical_allocator::free(segment.physical, segment.size / paging::PAGE_SIZE);
-                }
-                desc.segments.clear();
+            if(process.run_prev){
+                process.run_prev->run_next = process.run_next;
+            } else {
+                heads[level] = process.run_next;
+            }
 
-                // 4. Release virtual kernel stack
+            if(process.run_next){
+                process.run_next->run_prev = process.run_prev;
+            } else {
+                tails[level] = process.run_prev;
+            }
 
-                if(desc.virtual_kernel_stack){
-                    virtual_allocator::free(desc.virtual_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE);
-                    paging::unmap_pages(desc.virtual_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE);
-                }
+            process.run_next = process.run_prev = nullptr;
 
-                // 5. Remove process from run queue
+            if(!heads[level]){
+                ready_bitmap &= ~(1ULL << level);
+            }
+        }
 
-                {
-                    std::lock_guard<int_lock> l(queue_lock);
+        process.queued = false;
+        --size;
+    }
 
-                    for(size_t index = 0; index < run_queue(desc.priority).size(); ++index){
-                        if(run_queue(desc.priority)[index] == desc.pid){
-                            run_queue(desc.priority).erase(index);
-                            break;
-                        }
-                    }
-                }
+    /*!
+     * \brief Remove and return the best process: the first process of the
+     * highest priority or the fair process with the lowest virtual runtime.
+     *
+     * The queue must not be empty.
+     */
+    scheduler::process_control_t& pop(){
+        auto best = highest_rank();
 
-                // 6. Clean process
+        auto& process = !fair_heap.empty() && best == fair_rank()
+            ? *fair_heap[0]
+            : *heads[best / 2 - scheduler::MIN_PRIORITY];
 
-                desc.pid = 0;
-                desc.ppid = 0;
-                desc.system = false;
-                desc.physical_cr3 = 0;
-                desc.physical_user_stack = 0;
-                desc.physical_kernel_stack = 0;
-                desc.virtual_kernel_stack = 0;
-                desc.paging_size = 0;
-                desc.context = nullptr;
-                desc.brk_start = desc.brk_end = 0;
+        dequeue(process);
 
-                // 7. Clean file handles
-                //TODO If not empty, probably something should be done
-                process.handles.clear();
+        return process;
+    }
 
-                // 8. Release the PCB slot
-                process.state = scheduler::process_state::EMPTY;
+    /*!
+     * \brief Returns the first process matching the predicate, from the
+     * highest rank to the lowest, or nullptr if there is none
+     */
+    template<typename P>
+    scheduler::process_control_t* find(P predicate) const {
+        bool fair_checked = fair_heap.empty();
+
+        for(size_t level = scheduler::PRIORITY_LEVELS; level > 0; --level){
+            if(!fair_checked && 2 * (level - 1 + scheduler::MIN_PRIORITY) < fair_rank()){
+                fair_checked = true;
+
+                for(size_t i = 0; i < fair_heap.size(); ++i){
+                    if(predicate(*fair_heap[i])){
+                        return fair_heap[i];
+                    }
+                }
+            }
 
-                logging::logf(logging::log_level::DEBUG, "scheduler: Process %u cleaned\n", prev_pid);
+            for(auto process = heads[level - 1]; process; process = process->run_next){
+                if(predicate(*process)){
+                    return process;
+                }
             }
         }
+
+        return nullptr;
     }
-}
 
-std::vector<void(*)()> init_tasks;
+    size_t size = 0; ///< The number of queued processes
 
-void post_init_task(){
-    logging::logf(logging::log_level::DEBUG, "scheduler: post_init_task (pid:%u) started %u tasks\n", scheduler::get_pid(), init_tasks.size());
+private:
+    static constexpr size_t fair_rank(){
+        return 2 * scheduler::DEFAULT_PRIORITY - 1;
+    }
 
-    for(auto func : init_tasks){
-        func();
+    static bool fair_less(const scheduler::process_control_t* lhs, const scheduler::process_control_t* rhs){
+        return lhs->vruntime < rhs->vruntime;
     }
 
-    logging::logf(logging::log_level::DEBUG, "scheduler: post_init_task finished %u tasks\n", init_tasks.size());
+    void fair_swap(size_t a, size_t b){
+        std::swap(fair_heap[a], fair_heap[b]);
+        fair_heap[a]->heap_index = a;
+        fair_heap[b]->heap_index = b;
+    }
 
-    scheduler::kill_current_process();
-}
+    void fair_sift_up(size_t i){
+        while(i > 0 && fair_less(fair_heap[i], fair_heap[(i - 1) / 2])){
+            fair_swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
 
-//TODO tsh should be configured somewhere
-void init_task(){
-    logging::logf(logging::log_level::DEBUG, "scheduler: init_task started (pid:%d)\n", scheduler::get_pid());
+    void fair_sift_down(size_t i){
+        while(true){
+            auto smallest = i;
+            auto left = 2 * i + 1;
+            auto right = 2 * i + 2;
 
-    std::vector<std::string> params;
+            if(left < fair_heap.size() && fair_less(fair_heap[left], fair_heap[smallest])){
+                smallest = left;
+            }
 
-    while(true){
-        auto pid = scheduler::exec("/bin/tsh", params);
+            if(right < fair_heap.size() && fair_less(fair_heap[right], fair_heap[smallest])){
+                smallest = right;
+            }
 
-        if(!pid){
-            logging::logf(logging::log_level::DEBUG, "scheduler: failed to run the shell: %s\n", std::error_message(pid.error()));
-            return;
+            if(smallest == i){
+                return;
+            }
+
+            fair_swap(i, smallest);
+            i = smallest;
         }
+    }
 
-        scheduler::await_termination(*pid);
+    void fair_push(scheduler::process_control_t& process){
+        // A process coming back from sleep does not get all the time it missed
+        if(process.vruntime < min_vruntime){
+            process.vruntime = min_vruntime;
+        }
 
-        logging::log(logging::log_level::DEBUG, "scheduler: shell exited, run new one\n");
+        process.heap_index = fair_heap.size();
+        fair_heap.push_back(&process);
+        fair_sift_up(process.heap_index);
     }
-}
 
-#define likely(x)    __builtin_expect (!!(x), 1)
-#define unlikely(x)  __builtin_expect (!!(x), 0)
+    void fair_remove(scheduler::process_control_t& process){
+        auto i = process.heap_index;
 
-scheduler::pid_t get_free_pid(){
-    // Normally, the next pid should be empty
-    if(likely(pcb[next_pid].state == scheduler::process_state::EMPTY)){
-        auto pid = next_pid;
-        next_pid = (next_pid + 1) % scheduler::MAX_PROCESS;
-        return pid;
-    }
+        if(i == 0 && process.vruntime > min_vruntime){
+            min_vruntime = process.vruntime;
+        }
 
-    // If the next pid is not available, iterate until one is empty
+        auto last = fair_heap.back();
+        fair_heap.pop_back();
 
-    auto pid = (next_pid + 1) % scheduler::MAX_PROCESS;
-    size_t i = 0;
+        if(i != fair_heap.size()){
+            fair_heap[i] = last;
+            fair_heap[i]->heap_index = i;
 
-    while(pcb[pid].state != scheduler::process_state::EMPTY && i < scheduler::MAX_PROCESS){
-        pid = (pid + 1) % scheduler::MAX_PROCESS;
-        ++i;
+            fair_sift_up(i);
+            fair_sift_down(fair_heap[i]->heap_index);
+        }
     }
 
-    // Make sure there was one free
-    if(unlikely(i == scheduler::MAX_PROCESS)){
-        logging::logf(logging::log_level::ERROR, "scheduler: Ran out of process\n");
-        k_print_line("Ran out of processes");
-        suspend_kernel();
-    }
+    uint64_t ready_bitmap = 0; ///< One bit for each non-empty priority level
+    std::array<scheduler::process_control_t*, scheduler::PRIORITY_LEVELS> heads {}; ///< The first process of each level
+    std::array<scheduler::process_control_t*, scheduler::PRIORITY_LEVELS> tails {}; ///< The last process of each level
 
-    // Set the next pid
-    next_pid = (pid + 1) % scheduler::MAX_PROCESS;
+    uint64_t min_vruntime = 0; ///< The virtual runtime of the last fair process selected
+    std::vector<scheduler::process_control_t*> fair_heap; ///< The fair processes, as a min-heap
+};
 
-    return pid;
-}
+static_assert(scheduler::PRIORITY_LEVELS <= 64, "The ready bitmap is a single word");
 
-scheduler::process_t& new_process(){
-    auto pid = get_free_pid();
+/*!
+ * \brief The scheduling state of a processor.
+ *
+ * A process is only scheduled by the processor it has been assigned to.
+ */
+struct cpu_scheduler_t {
+    volatile scheduler::pid_t current_pid = 0; ///< The process running on the processor
+    scheduler::pid_t idle_pid = 0;             ///< The idle task of the processor
+    volatile bool online = false;              ///< Indicates if the processor is scheduling processes
+    run_queue_t run_queue;                     ///< The processes ready to run on the processor
+    int_spinlock queue_lock;                   ///< The lock protecting the run queue
+};
 
-    auto& process = pcb[pid];
+std::array<cpu_scheduler_t, smp::MAX_CPUS> cpus;
 
-    process.process.system = false;
-    process.process.pid = pid;
-    process.process.ppid = current_pid;
-    process.process.priority = scheduler::DEFAULT_PRIORITY;
-    process.state = scheduler::process_state::NEW;
-    process.process.tty = pcb[current_pid].process.tty;
+int_spinlock pcb_lock; ///< Protect the allocation of PCB slots
 
-    process.process.brk_start = 0;
-    process.process.brk_end = 0;
+timer_wheel timeouts;           ///< The timeouts of the sleeping and blocked processes
+int_spinlock timeouts_lock;     ///< Protect the timeouts
 
-    process.process.wait.pid = pid;
-    process.process.wait.next = nullptr;
+volatile bool started = false;
 
-    // By default, a process is working in root
-    process.working_directory = path("/");
+volatile size_t steals = 0;      ///< The number of processes stolen by idle processors
+volatile size_t migrations = 0;  ///< The number of processes migrated by the balancer
+volatile size_t fpu_reloads = 0; ///< The number of switches that reloaded the FPU control state
+volatile size_t fpu_skips = 0;   ///< The number of switches that kept the FPU control state
+size_t balance_ticks = 0;
 
-    return process.process;
-}
+volatile size_t rr_quantum = 0;
 
-void queue_process(scheduler::pid_t pid){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+size_t gc_pid = 0;
+scheduler::process_control_t* zombies = nullptr; ///< The killed processes not cleaned yet, pushed without lock
+size_t init_pid = 0;
 
-    auto& process = pcb[pid];
+size_t zero_page = 0; ///< The shared page of zeroes, mapped copy-on-write by the reads of the untouched pages
 
-    thor_assert(process.process.priority <= scheduler::MAX_PRIORITY, "Invalid priority");
-    thor_assert(process.process.priority >= scheduler::MIN_PRIORITY, "Invalid priority");
+cpu_scheduler_t& this_cpu(){
+    return cpus[smp::current_cpu()];
+}
 
-    process.state = scheduler::process_state::READY;
+scheduler::pid_t current_pid(){
+    return this_cpu().current_pid;
+}
+
+bool is_idle_task(scheduler::pid_t pid){
+    for(auto& cpu : cpus){
+        if(cpu.online && cpu.idle_pid == pid){
+            return true;
+        }
+    }
 
-    std::lock_guard<int_lock> l(queue_lock);
-    run_queue(process.process.priority).push_back(pid);
+    return false;
 }
 
-void create_idle_task(){
-    auto& idle_process = scheduler::create_kernel_task("idle", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &idle_task);
+/*!
+ * \brief Lock the run queue of the processor of the given process.
+ *
+ * The process may be migrated while waiting for the lock, in which case
+ * the lock of its new processor is taken.
+ */
+cpu_scheduler_t& lock_process_cpu(scheduler::process_control_t& process){
+    while(true){
+        auto& cpu = cpus[process.cpu];
 
-    idle_process.ppid = 0;
-    idle_process.priority = scheduler::MIN_PRIORITY;
+        cpu.queue_lock.lock();
 
-    scheduler::queue_system_process(idle_process.pid);
+        if(&cpu == &cpus[process.cpu]){
+            return cpu;
+        }
 
-    idle_pid = idle_process.pid;
+        cpu.queue_lock.unlock();
+    }
 }
 
-void create_init_tasks(){
-    for(size_t i = 0; i < stdio::terminals_count(); ++i){
-        auto& init_process = scheduler::create_kernel_task("init", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &init_task);
+/*!
+ * \brief Wake up the process after the given number of ticks, unless the
+ * timeout is cancelled before
+ */
+void arm_timeout(scheduler::process_control_t& process, uint64_t ticks){
+    std::lock_guard<int_spinlock> l(timeouts_lock);
 
-        init_process.ppid = 0;
-        init_process.priority = scheduler::MIN_PRIORITY + 1;
+    timeouts.insert(process.timeout, ticks);
+}
 
-        init_process.tty = i;
+void cancel_timeout(scheduler::process_control_t& process){
+    std::lock_guard<int_spinlock> l(timeouts_lock);
 
-        auto pid = init_process.pid;
-        if(i == 0){
-            init_pid = pid;
-        }
+    timeouts.cancel(process.timeout);
+}
 
-        auto tty = "/dev/tty" + std::to_string(i);
+/*!
+ * \brief Mark the process as READY and put it in the run queue of its processor
+ */
+void make_ready(scheduler::process_control_t& process){
+    // A process woken up before its timeout must not be woken up again
+    if(process.timeout.armed){
+        cancel_timeout(process);
+    }
 
-        // Create the 0,1,2 file descriptors
-        pcb[pid].handles.emplace_back(tty);
-        pcb[pid].handles.emplace_back(tty);
-        pcb[pid].handles.emplace_back(tty);
+    auto& cpu = lock_process_cpu(process);
+    auto target = process.cpu;
 
-        scheduler::queue_system_process(pid);
+    process.state = scheduler::process_state::READY;
+    process.wakeup_time = sched_trace::timestamp();
+    cpu.run_queue.enqueue(process);
+
+    cpu.queue_lock.unlock();
 
-        logging::logf(logging::log_level::DEBUG, "scheduler: init_task %u tty:%u fd:%s\n", pid, init_process.tty, tty.c_str());
+    sched_trace::record(sched_trace::event_type::WAKEUP, process.process.pid, current_pid());
+
+    // An idle processor is halted, wake it up
+    if(target != smp::current_cpu() && cpu.online && cpu.current_pid == cpu.idle_pid){
+        apic::send_ipi(smp::apic_id(target), apic::RESCHEDULE_IRQ);
     }
 }
 
-void create_gc_task(){
-    auto& gc_process = scheduler::create_kernel_task("gc", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &gc_task);
-
-    gc_process.ppid = 1;
-    gc_process.priority = scheduler::MIN_PRIORITY + 1;
+/*!
+ * \brief Remove the process from the run queue, if it is queued
+ */
+void make_unready(scheduler::process_control_t& process){
+    auto& cpu = lock_process_cpu(process);
 
-    scheduler::queue_system_process(gc_process.pid);
+    cpu.run_queue.dequeue(process);
 
-    gc_pid = gc_process.pid;
+    cpu.queue_lock.unlock();
 }
 
-void create_post_init_task(){
-    auto& post_init_process = scheduler::create_kernel_task("post_init", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &post_init_task);
+/*!
+ * \brief Change the inherited priority of the process, moving it to its
+ * new level if it is queued
+ * \param raise Only change the boost if it raises the priority of the process
+ * \return true if the boost has been changed, false otherwise
+ */
+bool change_boost(scheduler::process_control_t& process, size_t priority, bool raise){
+    auto& cpu = lock_process_cpu(process);
+    auto target = process.cpu;
 
-    post_init_process.ppid = 1;
-    post_init_process.priority = scheduler::MAX_PRIORITY;
+    auto boost = priority > process.process.priority ? priority : 0;
 
-    scheduler::queue_system_process(post_init_process.pid);
-}
+    if(process.boost == boost || (raise && priority <= effective_priority(process))){
+        cpu.queue_lock.unlock();
+        return false;
+    }
 
-void switch_to_process(size_t pid){
-    if(pcb[current_pid].process.system){
-        verbose_logf(logging::log_level::DEBUG, "scheduler: Switch from %u (s:%u) to %u (rip:%u)\n", current_pid, static_cast<size_t>(pcb[current_pid].state), pid, pcb[current_pid].process.context->rip);
-    } else {
-        verbose_logf(logging::log_level::DEBUG, "scheduler: Switch from %u (s:%u) to %u\n", current_pid, static_cast<size_t>(pcb[current_pid].state), pid);
+    // The level of a queued process depends on its priority
+    bool queued = process.queued;
+
+    if(queued){
+        cpu.run_queue.dequeue(process);
     }
 
-    // This should never be interrupted
-    direct_int_lock l;
+    process.boost = boost;
+
+    if(queued){
+        cpu.run_queue.enqueue(process);
+    }
 
-    auto old_pid = current_pid;
-    current_pid = pid;
+    bool preempt = queued && target != smp::current_cpu() && cpu.online && cpu.run_queue.should_preempt(pcb[cpu.current_pid]);
 
-    auto& process = pcb[pid];
-    process.state = scheduler::process_state::RUNNING;
+    cpu.queue_lock.unlock();
 
-    gdt::tss().rsp0_low = process.process.kernel_rsp & 0xFFFFFFFF;
-    gdt::tss().rsp0_high = process.process.kernel_rsp >> 32;
+    verbose_logf(logging::log_level::DEBUG, "scheduler: Boost process %u to %u\n", process.process.pid, boost);
+
+    // The boosted process may now have to run instead of the current process of its processor
+    if(preempt){
+        apic::send_ipi(smp::apic_id(target), apic::RESCHEDULE_IRQ);
+    }
+
+    return true;
+}
 
-    task_switch(old_pid, current_pid);
+/*!
+ * \brief Returns the number of processes a processor has to run, without its idle task
+ */
+size_t cpu_load(const cpu_scheduler_t& cpu){
+    auto load = cpu.run_queue.size + (cpu.current_pid == cpu.idle_pid ? 0 : 1);
+
+    // The idle task is queued when another process is running
+    return pcb[cpu.idle_pid].queued ? load - 1 : load;
 }
 
-size_t select_next_process(){
-    auto current_priority = pcb[current_pid].process.priority;
+/*!
+ * \brief Returns the online processor with the least processes to run
+ */
+size_t select_cpu(){
+    size_t selected = 0;
+    size_t selected_load = scheduler::MAX_PROCESS;
 
-    std::lock_guard<int_lock> l(queue_lock);
+    for(size_t i = 0; i < cpus.size(); ++i){
+        auto& cpu = cpus[i];
 
-    //1. Run a process of higher priority, if any
-    for(size_t p = scheduler::MAX_PRIORITY; p > current_priority; --p){
-        for(auto pid : run_queue(p)){
-            if(pcb[pid].state == scheduler::process_state::READY || pcb[pid].state == scheduler::process_state::RUNNING){
-                return pid;
+        if(cpu.online){
+            auto load = cpu_load(cpu);
+
+            if(load < selected_load){
+                selected = i;
+                selected_load = load;
             }
         }
     }
 
-    //2. Run the next process of the same priority
+    return selected;
+}
 
-    {
-        auto& current_run_queue = run_queue(current_priority);
+/*!
+ * \brief Indicates if the process can be moved to another processor
+ *
+ * System processes rely on the interrupts of the BSP and are never
+ * migrated. A process whose context is still used by a processor cannot
+ * be migrated either. Cache-hot processes are left where they are.
+ */
+bool can_migrate(const scheduler::process_control_t& process, uint64_t now){
+    return !process.process.system && !process.on_cpu && now - process.last_run >= MIGRATION_COST;
+}
 
-        size_t next_index = 0;
-        for(size_t i = 0; i < current_run_queue.size(); ++i){
-            if(current_run_queue[i] == current_pid){
-                next_index = (i + 1) % current_run_queue.size();
-                break;
-            }
-        }
+/*!
+ * \brief Move one ready process from the source processor to the target processor
+ * \return true if a process has been moved, false otherwise
+ */
+bool migrate_process(size_t source, size_t target){
+    auto& from = cpus[source];
+    auto& to = cpus[target];
 
-        for(size_t i = 0; i < current_run_queue.size(); ++i){
-            auto index = (next_index + i) % current_run_queue.size();
-            auto pid = current_run_queue[index];
+    // Always lock in the same order to avoid dead locks
+    auto& first = source < target ? from : to;
+    auto& second = source < target ? to : from;
 
-            if(pcb[pid].state == scheduler::process_state::READY || pcb[pid].state == scheduler::process_state::RUNNING){
-                return pid;
-            }
-        }
+    std::lock_guard<int_spinlock> l1(first.queue_lock);
+    std::lock_guard<int_spinlock> l2(second.queue_lock);
+
+    auto now = timer::milliseconds();
+
+    auto process = from.run_queue.find([now](const scheduler::process_control_t& p){ return can_migrate(p, now); });
+
+    if(!process){
+        return false;
     }
 
-    thor_assert(current_priority > 0, "The idle task should always be ready");
+    from.run_queue.dequeue(*process);
+    process->cpu = target;
+    to.run_queue.enqueue(*process);
+
+    verbose_logf(logging::log_level::DEBUG, "scheduler: Migrate %u from %u to %u\n", process->process.pid, source, target);
 
-    //3. Run a process of lower priority
+    return true;
+}
 
-    for(size_t p = current_priority - 1; p >= scheduler::MIN_PRIORITY; --p){
-        for(auto pid : run_queue(p)){
-            if(pcb[pid].state == scheduler::process_state::READY || pcb[pid].state == scheduler::process_state::RUNNING){
-                return pid;
+/*!
+ * \brief Returns the online processor with the most processes to run
+ * \param load Will be set to the load of the processor
+ */
+size_t busiest_cpu(size_t& load){
+    size_t selected = 0;
+    load = 0;
+
+    for(size_t i = 0; i < cpus.size(); ++i){
+        if(cpus[i].online){
+            auto cpu_load_i = cpu_load(cpus[i]);
+
+            if(cpu_load_i > load){
+                selected = i;
+                load = cpu_load_i;
             }
         }
     }
 
-    thor_unreachable("No process is READY");
+    return selected;
 }
 
-bool allocate_user_memory(scheduler::process_t& process, size_t address, size_t size, size_t& ref){
-    //1. Calculate some stuff
-    auto first_page = paging::page_align(address);
-    auto left_padding = address - first_page;
+/*!
+ * \brief Steal a ready process for the current processor, about to be idle
+ */
+void steal_process(){
+    auto thief = smp::current_cpu();
 
-    auto bytes = left_padding + size;
-    auto pages = paging::pages(bytes);
+    size_t load;
+    auto victim = busiest_cpu(load);
 
-    //2. Get enough physical memory
-    auto physical_memory = physical_allocator::allocate(pages);
+    // The victim must keep something to run
+    if(victim == thief || load < 2){
+        return;
+    }
 
-    if(!physical_memory){
-        k_print_line("Cannot allocate physical memory, probably out of memory");
-        return false;
+    if(migrate_process(victim, thief)){
+        ++steals;
     }
+}
 
-    //3. Find a start of a page inside the physical memory
+/*!
+ * \brief Periodically move a process from the busiest processor to the
+ * least loaded one
+ */
+void balance_cpus(){
+    size_t busiest_load;
+    auto busiest = busiest_cpu(busiest_load);
 
-    auto aligned_physical_memory = paging::page_aligned(physical_memory) ? physical_memory :
-            (physical_memory / paging::PAGE_SIZE + 1) * paging::PAGE_SIZE;
+    auto idlest = select_cpu();
 
-    logging::logf(logging::log_level::DEBUG, "scheduler: Map(p%u) virtual:%h into phys: %h\n", process.pid, first_page, aligned_physical_memory);
+    if(busiest == idlest || busiest_load < cpu_load(cpus[idlest]) + 2){
+        return;
+    }
 
-    //4. Map physical allocated memory to the necessary virtual memory
-    if(!paging::user_map_pages(process, first_page, aligned_physical_memory, pages)){
-        logging::log(logging::log_level::DEBUG, "Impossible to map in user space\n");
+    if(migrate_process(busiest, idlest)){
+        ++migrations;
 
-        return false;
+        auto& target = cpus[idlest];
+
+        // An idle processor is halted, wake it up
+        if(idlest != smp::current_cpu() && target.current_pid == target.idle_pid){
+            apic::send_ipi(smp::apic_id(idlest), apic::RESCHEDULE_IRQ);
+        }
     }
+}
 
-    ref = physical_memory;
+std::string sysfs_steals(){
+    return std::to_string(steals);
+}
 
-    return true;
+std::string sysfs_migrations(){
+    return std::to_string(migrations);
 }
 
-void clear_physical_memory(size_t memory, size_t pages){
-    physical_pointer phys_ptr(memory, pages);
+std::string sysfs_fpu_reloads(){
+    return std::to_string(fpu_reloads);
+}
 
-    auto it = phys_ptr.as_ptr<uint64_t>();
-    std::fill_n(it, (pages * paging::PAGE_SIZE) / sizeof(uint64_t), 0);
+std::string sysfs_fpu_skips(){
+    return std::to_string(fpu_skips);
 }
 
-bool create_paging(char* buffer, scheduler::process_t& process){
-    //1. Prepare PML4T
+/*!
+ * \brief Switch the FPU control state from the old process to the next one.
+ *
+ * The SSE registers themselves are saved in the interrupt frame of each
+ * process, only the control state is kept in the PCB. Loading MXCSR
+ * is serializing, so it is only done when the two processes differ.
+ */
+void switch_fpu_control(scheduler::process_control_t& old, scheduler::process_control_t& next){
+    old.mxcsr = arch::get_mxcsr();
+    old.fpu_control = arch::get_fpu_control();
+
+    if(old.mxcsr == next.mxcsr && old.fpu_control == next.fpu_control){
+        ++fpu_skips;
+        return;
+    }
 
-    //Get memory for cr3
-    process.physical_cr3 = physical_allocator::allocate(1);
-    process.paging_size = paging::PAGE_SIZE;
+    if(old.mxcsr != next.mxcsr){
+        arch::set_mxcsr(next.mxcsr);
+    }
 
-    logging::logf(logging::log_level::DEBUG, "scheduler: Process %u cr3:%h\n", process.pid, process.physical_cr3);
+    if(old.fpu_control != next.fpu_control){
+        arch::set_fpu_control(next.fpu_control);
+    }
 
-    clear_physical_memory(process.physical_cr3, 1);
+    ++fpu_reloads;
+}
 
-    //Map the kernel pages inside the user memory space
-    paging::map_kernel_inside_user(process);
+/*!
+ * \brief Returns the number of ticks the BSP can be idle without missing
+ * a sleep timeout or a balancing.
+ *
+ * Must be called with interrupts disabled.
+ */
+uint64_t idle_ticks(){
+    uint64_t ticks_per_ms = timer::timer_frequency() / 1000;
+    ticks_per_ms = !ticks_per_ms ? 1 : ticks_per_ms;
 
-    //2. Create all the other necessary structures
+    uint64_t ticks = MAX_TICKLESS * ticks_per_ms;
 
-    //2.1 Allocate user stack
-    allocate_user_memory(process, scheduler::user_stack_start, scheduler::user_stack_size, process.physical_user_stack);
+    if(smp::cpus() > 1){
+        ticks = std::min(ticks, BALANCE_INTERVAL * ticks_per_ms);
+    }
 
-    //2.2 Allocate all user segments
+    // The BSP is the only processor advancing the timeouts
+    ticks = timeouts.next_expiry(ticks);
 
-    auto header = reinterpret_cast<elf::elf_header*>(buffer);
-    auto program_header_table = reinterpret_cast<elf::program_header*>(buffer + header->e_phoff);
+    return ticks;
+}
 
-    for(size_t p = 0; p < header->e_phnum; ++p){
-        auto& p_header = program_header_table[p];
+/*!
+ * \brief Make sure the BSP accounts for a timeout set by another processor
+ */
+void timeout_updated(){
+    auto& bsp = cpus[0];
 
-        if(p_header.p_type == 1){
-            auto first_page = p_header.p_vaddr;
-            auto left_padding = p_header.p_vaddr - first_page;
+    // An idle BSP may have stopped its tick, wake it up to recompute its deadline
+    if(smp::current_cpu() != 0 && bsp.current_pid == bsp.idle_pid){
+        apic::send_ipi(smp::apic_id(0), apic::RESCHEDULE_IRQ);
+    }
+}
 
-            auto bytes = left_padding + p_header.p_memsz;
+void idle_task(){
+    while(true){
+        auto& cpu = this_cpu();
 
-            //Make sure only complete pages are allocated
-            if(bytes % paging::PAGE_SIZE != 0){
-                bytes += paging::PAGE_SIZE - (bytes % paging::PAGE_SIZE);
-            }
+        // The spare time is used to zero free pages, one batch at a time
+        if(!cpu_load(cpu) && physical_allocator::zero_free_pages()){
+            continue;
+        }
 
-            auto pages = bytes / paging::PAGE_SIZE;
+        // Interrupts are enabled again by hlt, a wake up cannot be missed
+        asm volatile("cli");
 
-            scheduler::segment_t segment;
-            segment.size = bytes;
+        if(!cpu_load(cpu)){
+            if(smp::current_cpu() == 0){
+                // The BSP only needs to tick at the next deadline
+                auto ticks = idle_ticks();
 
-            allocate_user_memory(process, first_page, bytes, segment.physical);
+                if(!timer::stop_tick(ticks)){
+                    ticks = 1;
+                }
 
-            process.segments.push_back(segment);
+                qsbr::enter_idle();
 
-            //Copy the code into memory
+                cpuidle::enter((ticks * 1000000) / timer::timer_frequency());
 
-            physical_pointer phys_ptr(segment.physical, pages);
+                qsbr::exit_idle();
 
-            logging::logf(logging::log_level::DEBUG, "scheduler: Copy to physical:%h\n", segment.physical);
+                timer::restart_tick();
+            } else {
+                // Nothing to preempt, the processor is woken up by an IPI
+                apic::stop_timer();
 
-            auto memory_start = phys_ptr.get() + left_padding;
+                qsbr::enter_idle();
 
-            //In the case of the BSS segment, the segment must be
-            //filled with zero
-            if(p_header.p_filesize != p_header.p_memsz){
-                std::copy_n(buffer + p_header.p_offset, p_header.p_filesize, reinterpret_cast<char*>(memory_start));
-                std::fill_n(reinterpret_cast<char*>(memory_start + p_header.p_filesize), p_header.p_memsz - p_header.p_filesize, 0);
-            } else {
-                std::copy_n(buffer + p_header.p_offset, p_header.p_memsz, reinterpret_cast<char*>(memory_start));
+                cpuidle::enter(MAX_TICKLESS * 1000);
+
+                qsbr::exit_idle();
+
+                apic::start_timer(timer::timer_frequency());
+            }
+        } else {
+            asm volatile("sti");
+        }
+
+        //If we go out of 'hlt', there have been an IRQ
+        //There is probably someone ready, let's yield
+        scheduler::yield();
+    }
+}
+
+/*!
+ * \brief The single pages of the cleaned processes, given back to the
+ * physical allocator together
+ */
+struct page_batch {
+    /*!
+     * \brief Add a page, the batch is released once full
+     */
+    void add(size_t page){
+        if(count == pages.size()){
+            flush();
+        }
+
+        pages[count++] = page;
+    }
+
+    /*!
+     * \brief Release the pages of the batch
+     */
+    void flush(){
+        physical_allocator::release_pages(pages.data(), count);
+        count = 0;
+    }
+
+private:
+    std::array<size_t, GC_BATCH> pages; ///< The pages to release
+    size_t count = 0;                   ///< The number of pages in the batch
+};
+
+/*!
+ * \brief Release all the resources of a killed process
+ * \return true if the process was a thread, its owner can now be cleaned
+ */
+bool clean_process(scheduler::process_control_t& process, page_batch& pages){
+    auto& desc = process.process;
+    auto prev_pid = desc.pid;
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Clean process %u\n", prev_pid);
+
+    // 0. Notify parent if still waiting
+    auto ppid = desc.ppid;
+    if(pcb.exists(ppid) && pcb[ppid].state == scheduler::process_state::WAITING){
+        scheduler::unblock_process(ppid);
+    }
+
+    // The asynchronous requests of the process are not collected anymore
+    aio::release(prev_pid);
+
+    // The kernel side of the rings of the process
+    io_ring::release(prev_pid);
+
+    // The shared memory mappings of the process, its pages are released with its segments
+    shm::release(prev_pid);
+
+    // 1. Release physical memory of PML4T (if not system task)
+
+    bool thread = process.owner != prev_pid;
+
+    if(!desc.system && !thread){
+        pages.add(desc.physical_cr3);
+        paging::release_address_space(desc.address_space);
+    }
+
+    // 2. Release physical stacks (if dynamically allocated)
+
+    if(desc.physical_kernel_stack){
+        physical_allocator::free(desc.physical_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE);
+    }
+
+    // The user stack may still be shared with a forked process
+    if(desc.physical_user_stack){
+        physical_allocator::release(desc.physical_user_stack, scheduler::user_stack_size / paging::PAGE_SIZE);
+    }
+
+    // kernel processes can either use dynamic memory or static memory
+
+    if(desc.system){
+        if(reinterpret_cast<size_t>(desc.user_stack) >= paging::virtual_paging_start + (paging::physical_memory_pages * paging::PAGE_SIZE)){
+            delete[] desc.user_stack;
+        }
+
+        if(reinterpret_cast<size_t>(desc.kernel_stack) >= paging::virtual_paging_start + (paging::physical_memory_pages * paging::PAGE_SIZE)){
+            delete[] desc.kernel_stack;
+        }
+    }
+
+    // 3. Release segment's physical memory
+
+    // The tables and most of the pages are single pages, released together
+    for(auto& segment : desc.segments){
+        if(segment.size == paging::PAGE_SIZE){
+            pages.add(segment.physical);
+        } else {
+            physical_allocator::release(segment.physical, segment.size / paging::PAGE_SIZE);
+        }
+    }
+    desc.segments.clear();
+    desc.regions.clear();
+
+    // 4. Release virtual kernel stack
+
+    if(desc.virtual_kernel_stack){
+        // The guard page below the stack is only reserved
+        virtual_allocator::free(desc.virtual_kernel_stack - paging::PAGE_SIZE, scheduler::kernel_stack_size / paging::PAGE_SIZE + 1);
+        paging::unmap_pages(desc.virtual_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE);
+    }
+
+    // 5. Remove process from run queue and from the timeouts
+
+    make_unready(process);
+    cancel_timeout(process);
+
+    // 6. Clean process
+
+    desc.pid = 0;
+    desc.ppid = 0;
+    desc.system = false;
+    desc.physical_cr3 = 0;
+    desc.address_space = 0;
+    desc.tlb_generation = 0;
+    desc.physical_user_stack = 0;
+    desc.physical_kernel_stack = 0;
+    desc.virtual_kernel_stack = 0;
+    desc.paging_size = 0;
+    desc.context = nullptr;
+    desc.brk_start = desc.brk_end = 0;
+
+    delete desc.syscalls;
+    desc.syscalls = nullptr;
+
+    // 7. Clean file handles, the other ends of the pipes are woken up
+
+    for(auto& handle : process.handles){
+        pipe::release(handle.base_path);
+    }
+
+    process.handles.clear();
+
+    for(auto* instance : process.polls){
+        delete instance;
+    }
+
+    process.polls.clear();
+
+    // 8. Release the PCB slot
+    {
+        std::lock_guard<int_spinlock> l(pcb_lock);
+
+        process.state = scheduler::process_state::EMPTY;
+        pcb.release(prev_pid);
+    }
+
+    // The owner may be the last one waiting for its threads
+    if(thread){
+        __atomic_sub_fetch(&pcb[process.owner].threads, 1, __ATOMIC_SEQ_CST);
+        process.owner = prev_pid;
+    }
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Process %u cleaned\n", prev_pid);
+
+    return thread;
+}
+
+page_batch gc_pages; ///< Too large for the stack of the GC thread
+
+void gc_task(){
+    // The killed processes that could not be cleaned yet
+    scheduler::process_control_t* deferred = nullptr;
+
+    bool pending = false;
+
+    while(true){
+        //Wait until there is something to do
+        if(pending || __atomic_load_n(&zombies, __ATOMIC_RELAXED)){
+            scheduler::yield();
+        } else {
+            scheduler::block_process(scheduler::get_pid());
+        }
+
+        pending = false;
+
+        // All the processes killed since the last round, at once
+        auto* process = __atomic_exchange_n(&zombies, nullptr, __ATOMIC_ACQUIRE);
+
+        // The deferred processes are tried again
+        while(deferred){
+            auto* next = deferred->zombie_next;
+            deferred->zombie_next = process;
+            process = deferred;
+            deferred = next;
+        }
+
+        while(process){
+            auto* next = process->zombie_next;
+
+            // A killed process may still be switching out of its processor
+            // and the address space stays until the last thread is cleaned
+            if(process->on_cpu || process->threads){
+                pending = pending || process->on_cpu;
+
+                process->zombie_next = deferred;
+                deferred = process;
+            } else if(clean_process(*process, gc_pages)){
+                pending = true;
+            }
+
+            process = next;
+        }
+
+        gc_pages.flush();
+    }
+}
+
+/*!
+ * \brief An asynchronous initialization task
+ */
+struct init_task_t {
+    const char* name;                                           ///< The name of the task
+    void (*fun)();                                              ///< The function of the task
+    std::array<size_t, scheduler::MAX_INIT_DEPENDENCIES> after; ///< The tasks to wait for
+    size_t dependencies;                                        ///< The number of tasks to wait for
+    semaphore done;                                             ///< Released once the task is finished
+};
+
+std::array<init_task_t, scheduler::MAX_INIT_TASKS> init_tasks;
+size_t queued_init_tasks = 0;
+
+void run_init_task(void* data){
+    auto& task = *reinterpret_cast<init_task_t*>(data);
+
+    // Each finished task is released again for its next dependent
+    for(size_t i = 0; i < task.dependencies; ++i){
+        auto& dependency = init_tasks[task.after[i]].done;
+
+        dependency.lock();
+        dependency.unlock();
+    }
+
+    auto start = boot_trace::now();
+
+    task.fun();
+
+    boot_trace::record(task.name, start, boot_trace::now());
+
+    task.done.unlock();
+
+    scheduler::kill_current_process();
+}
+
+void post_init_task(){
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: post_init_task (pid:%u) starts %u tasks\n", scheduler::get_pid(), queued_init_tasks);
+
+    for(size_t i = 0; i < queued_init_tasks; ++i){
+        auto& task = init_tasks[i];
+
+        auto& process = scheduler::create_kernel_task_args(task.name, new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &run_init_task, &task);
+
+        process.ppid = 1;
+        process.priority = scheduler::MAX_PRIORITY;
+
+        scheduler::queue_system_process(process.pid);
+    }
+
+    scheduler::kill_current_process();
+}
+
+//TODO tsh should be configured somewhere
+void init_task(){
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: init_task started (pid:%d)\n", scheduler::get_pid());
+
+    //The shell is loaded from the root
+    vfs::wait_root();
+
+    logging::logf(logging::log_level::USER, "result|kernel|boot|shell_ms|%u\n", timer::milliseconds());
+
+    // The autorun script runs once, before the first interactive shell
+    auto script = vfs::open(AUTORUN_SCRIPT, 0);
+
+    if(script){
+        vfs::close(*script);
+
+        scheduler::params_type script_params;
+        script_params.emplace_back(AUTORUN_SCRIPT);
+
+        auto pid = scheduler::exec("/bin/tsh", script_params);
+
+        if(pid){
+            scheduler::await_termination(*pid);
+        } else {
+            subsystem_logf(SCHEDULER, DEBUG, "scheduler: failed to run %s: %s\n", AUTORUN_SCRIPT, std::error_message(pid.error()));
+        }
+    }
+
+    scheduler::params_type params;
+
+    while(true){
+        auto pid = scheduler::exec("/bin/tsh", params);
+
+        if(!pid){
+            subsystem_logf(SCHEDULER, DEBUG, "scheduler: failed to run the shell: %s\n", std::error_message(pid.error()));
+            return;
+        }
+
+        scheduler::await_termination(*pid);
+
+        logging::log(logging::log_level::DEBUG, "scheduler: shell exited, run new one\n");
+    }
+}
+
+scheduler::pid_t get_free_pid(){
+    scheduler::pid_t pid;
+
+    if(!pcb.allocate(pid)){
+        logging::logf(logging::log_level::ERROR, "scheduler: Ran out of process\n");
+        k_print_line("Ran out of processes");
+        suspend_kernel();
+    }
+
+    return pid;
+}
+
+/*!
+ * \brief Returns the process owning the address space and the handles of the
+ * current process, the process itself unless it is a thread
+ */
+scheduler::process_control_t& current_owner(){
+    return pcb[pcb[current_pid()].owner];
+}
+
+scheduler::process_t& new_process(){
+    pcb_lock.lock();
+
+    auto pid = get_free_pid();
+
+    auto& process = pcb[pid];
+
+    // The slot is reserved once it is no longer EMPTY
+    process.state = scheduler::process_state::NEW;
+
+    pcb_lock.unlock();
+
+    process.process.system = false;
+    process.process.pid = pid;
+    process.process.ppid = current_pid();
+    process.process.priority = scheduler::DEFAULT_PRIORITY;
+    process.cpu = 0;
+    process.on_cpu = false;
+    process.last_run = 0;
+    process.timeout.id = pid;
+    process.policy = scheduler::sched_policy::ROUND_ROBIN;
+    process.vruntime = 0;
+    process.wakeup_time = 0;
+    process.run_delay.clear();
+    process.usage = {};
+    process.mxcsr = DEFAULT_MXCSR;
+    process.fpu_control = DEFAULT_FPU_CONTROL;
+    process.owner = pid;
+    process.threads = 0;
+    process.fs_base = 0;
+    process.process.tty = pcb[current_pid()].process.tty;
+
+    process.process.mmap_end = scheduler::program_mmap;
+
+    process.process.brk_start = 0;
+    process.process.brk_end = 0;
+    process.process.huge_heap = false;
+    process.process.alloc_profile = 0;
+    process.process.syscalls = nullptr;
+    arena::init(process.process.scratch);
+
+    process.process.wait.pid = pid;
+    process.process.wait.next = nullptr;
+
+    process.boost = 0;
+    process.process.blocked_on = nullptr;
+    process.process.held_mutexes = nullptr;
+
+    // By default, a process is working in root
+    process.working_directory = path("/");
+
+    return process.process;
+}
+
+/*!
+ * \brief Grow the heap of the process by large pages
+ * \return true if the heap grew, false otherwise
+ */
+bool huge_sbrk(scheduler::process_t& process, size_t inc){
+    if(!paging::large_page_aligned(process.brk_end)){
+        return false;
+    }
+
+    auto size = (inc + paging::LARGE_PAGE_SIZE - 1) & ~(paging::LARGE_PAGE_SIZE - 1);
+    auto old_end = process.brk_end;
+
+    subsystem_logf(SCHEDULER, DEBUG, "sbrk: Add %u large pages to process %u heap\n", size / paging::LARGE_PAGE_SIZE, process.pid);
+
+    while(process.brk_end - old_end < size){
+        auto physical = physical_allocator::allocate(paging::LARGE_PAGE_PAGES);
+
+        if(!physical){
+            break;
+        }
+
+        if(!paging::large_page_aligned(physical) || !paging::user_map_large(process, process.brk_end, physical)){
+            physical_allocator::free(physical, paging::LARGE_PAGE_PAGES);
+            break;
+        }
+
+        process.segments.push_back({physical, paging::LARGE_PAGE_SIZE, false});
+
+        process.brk_end += paging::LARGE_PAGE_SIZE;
+    }
+
+    return process.brk_end != old_end;
+}
+
+/*!
+ * \brief Make the demand-zero region of the heap of the process cover
+ * [brk_start, brk_end), the heap pages are mapped on first touch
+ */
+void update_heap_region(scheduler::process_t& process){
+    for(size_t i = 0; i < process.regions.size(); ++i){
+        auto& region = process.regions[i];
+
+        if(region.start == process.brk_start && !region.cached && !region.physical){
+            if(process.brk_end == process.brk_start){
+                process.regions.erase(i);
+            } else {
+                region.end = process.brk_end;
+            }
+
+            return;
+        }
+    }
+
+    if(process.brk_end == process.brk_start){
+        return;
+    }
+
+    scheduler::region_t heap;
+    heap.start = process.brk_start;
+    heap.end = process.brk_end;
+    heap.file_start = heap.start;
+    heap.file_end = heap.start;
+    heap.offset = 0;
+    heap.cached = false;
+    heap.writable = true;
+
+    process.regions.push_back(heap);
+}
+
+void queue_process(scheduler::pid_t pid){
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+
+    auto& process = pcb[pid];
+
+    thor_assert(process.process.priority <= scheduler::MAX_PRIORITY, "Invalid priority");
+    thor_assert(process.process.priority >= scheduler::MIN_PRIORITY, "Invalid priority");
+
+    process.cpu = select_cpu();
+
+    make_ready(process);
+}
+
+void create_idle_task(){
+    auto& idle_process = scheduler::create_kernel_task("idle", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &idle_task);
+
+    idle_process.ppid = 0;
+    idle_process.priority = scheduler::MIN_PRIORITY;
+
+    scheduler::queue_system_process(idle_process.pid);
+
+    cpus[0].idle_pid = idle_process.pid;
+}
+
+void create_init_tasks(){
+    for(size_t i = 0; i < stdio::terminals_count(); ++i){
+        auto& init_process = scheduler::create_kernel_task("init", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &init_task);
+
+        init_process.ppid = 0;
+        init_process.priority = scheduler::MIN_PRIORITY + 1;
+
+        init_process.tty = i;
+
+        auto pid = init_process.pid;
+        if(i == 0){
+            init_pid = pid;
+        }
+
+        auto tty = "/dev/tty" + std::to_string(i);
+
+        // Create the 0,1,2 file descriptors
+        pcb[pid].handles.emplace_back(tty);
+        pcb[pid].handles.emplace_back(tty);
+        pcb[pid].handles.emplace_back(tty);
+
+        scheduler::queue_system_process(pid);
+
+        subsystem_logf(SCHEDULER, DEBUG, "scheduler: init_task %u tty:%u fd:%s\n", pid, init_process.tty, tty.c_str());
+    }
+}
+
+void create_gc_task(){
+    auto& gc_process = scheduler::create_kernel_task("gc", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &gc_task);
+
+    gc_process.ppid = 1;
+    gc_process.priority = scheduler::MIN_PRIORITY + 1;
+
+    scheduler::queue_system_process(gc_process.pid);
+
+    gc_pid = gc_process.pid;
+}
+
+void create_post_init_task(){
+    auto& post_init_process = scheduler::create_kernel_task("post_init", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &post_init_task);
+
+    post_init_process.ppid = 1;
+    post_init_process.priority = scheduler::MAX_PRIORITY;
+
+    scheduler::queue_system_process(post_init_process.pid);
+}
+
+void switch_to_process(size_t pid){
+    if(pcb[current_pid()].process.system){
+        verbose_logf(logging::log_level::DEBUG, "scheduler: Switch from %u (s:%u) to %u (rip:%u)\n", current_pid(), static_cast<size_t>(pcb[current_pid()].state), pid, pcb[current_pid()].process.context->rip);
+    } else {
+        verbose_logf(logging::log_level::DEBUG, "scheduler: Switch from %u (s:%u) to %u\n", current_pid(), static_cast<size_t>(pcb[current_pid()].state), pid);
+    }
+
+    // This should never be interrupted
+    direct_int_lock l;
+
+    auto& cpu = this_cpu();
+
+    auto old_pid = cpu.current_pid;
+    cpu.current_pid = pid;
+
+    pcb[old_pid].last_run = timer::milliseconds();
+
+    // A process switched out while still ready has been preempted
+    if(pcb[old_pid].state == scheduler::process_state::READY){
+        ++pcb[old_pid].usage.involuntary_switches;
+    } else {
+        ++pcb[old_pid].usage.voluntary_switches;
+    }
+
+    auto& process = pcb[pid];
+    process.state = scheduler::process_state::RUNNING;
+    process.on_cpu = true;
+
+    // Measure the time the process waited since it was woken up
+    if(process.wakeup_time){
+        process.run_delay.add(sched_trace::to_us(sched_trace::timestamp() - process.wakeup_time));
+        process.wakeup_time = 0;
+    }
+
+    sched_trace::record(sched_trace::event_type::SWITCH, pid, old_pid);
+
+    qsbr::quiescent();
+
+    gdt::tss().rsp0_low = process.process.kernel_rsp & 0xFFFFFFFF;
+    gdt::tss().rsp0_high = process.process.kernel_rsp >> 32;
+
+    switch_fpu_control(pcb[old_pid], process);
+
+    if(pcb[old_pid].fs_base != process.fs_base){
+        arch::write_msr(MSR_FS_BASE, process.fs_base);
+    }
+
+    task_switch(old_pid, pid);
+}
+
+size_t select_next_process(){
+    auto& cpu = this_cpu();
+    auto& run_queue = cpu.run_queue;
+    auto& current = pcb[cpu.current_pid];
+
+    // If only the idle task is left to run, try to get work from another processor
+    if(smp::cpus() > 1 && !cpu_load(cpu) && (cpu.current_pid == cpu.idle_pid || current.state != scheduler::process_state::READY)){
+        steal_process();
+    }
+
+    std::lock_guard<int_spinlock> l(cpu.queue_lock);
+
+    // A preempted process competes with the queued processes. It may already
+    // be queued if it has been woken up before it had the time to reschedule.
+    if(current.state == scheduler::process_state::READY){
+        run_queue.dequeue(current);
+
+        //1. Keep running if no process should run before
+        if(!run_queue.should_preempt(current)){
+            return cpu.current_pid;
+        }
+
+        //2. Otherwise, go back to the queue (round robin or fair)
+        run_queue.enqueue(current);
+    }
+
+    thor_assert(!run_queue.empty(), "The idle task should always be ready");
+
+    //3. Run the first process of the highest priority
+    return run_queue.pop().process.pid;
+}
+
+bool allocate_user_memory(scheduler::process_t& process, size_t address, size_t size, size_t& ref){
+    //1. Calculate some stuff
+    auto first_page = paging::page_align(address);
+    auto left_padding = address - first_page;
+
+    auto bytes = left_padding + size;
+    auto pages = paging::pages(bytes);
+
+    //2. Get enough zeroed physical memory
+    auto physical_memory = physical_allocator::allocate_zeroed(pages);
+
+    if(!physical_memory){
+        k_print_line("Cannot allocate physical memory, probably out of memory");
+        return false;
+    }
+
+    //3. Find a start of a page inside the physical memory
+
+    auto aligned_physical_memory = paging::page_aligned(physical_memory) ? physical_memory :
+            (physical_memory / paging::PAGE_SIZE + 1) * paging::PAGE_SIZE;
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Map(p%u) virtual:%h into phys: %h\n", process.pid, first_page, aligned_physical_memory);
+
+    //4. Map physical allocated memory to the necessary virtual memory
+    if(!paging::user_map_pages(process, first_page, aligned_physical_memory, pages)){
+        logging::log(logging::log_level::DEBUG, "Impossible to map in user space\n");
+
+        return false;
+    }
+
+    ref = physical_memory;
+
+    return true;
+}
+
+/*!
+ * \brief Allocate and map the kernel stack of the process.
+ *
+ * The virtual page below the stack is reserved but never mapped, an
+ * overflow faults instead of overwriting the memory below.
+ */
+bool allocate_kernel_stack(scheduler::process_t& process){
+    auto pages = scheduler::kernel_stack_size / paging::PAGE_SIZE;
+
+    auto virtual_guard = virtual_allocator::allocate(pages + 1);
+    auto physical_kernel_stack = physical_allocator::allocate_zeroed(pages);
+
+    if(!virtual_guard || !physical_kernel_stack){
+        if(virtual_guard){
+            virtual_allocator::free(virtual_guard, pages + 1);
+        }
+
+        if(physical_kernel_stack){
+            physical_allocator::free(physical_kernel_stack, pages);
+        }
+
+        return false;
+    }
+
+    auto virtual_kernel_stack = virtual_guard + paging::PAGE_SIZE;
+
+    if(!paging::map_pages(virtual_kernel_stack, physical_kernel_stack, pages)){
+        virtual_allocator::free(virtual_guard, pages + 1);
+        physical_allocator::free(physical_kernel_stack, pages);
+        return false;
+    }
+
+    process.physical_kernel_stack = physical_kernel_stack;
+    process.virtual_kernel_stack = virtual_kernel_stack;
+    process.kernel_rsp = virtual_kernel_stack + (scheduler::kernel_stack_size - 8);
+
+    return true;
+}
+
+/*!
+ * \brief Read and validate the ELF header and the program headers of the
+ * executable, the segments are loaded on demand
+ */
+std::expected<void> read_headers(const path& image, elf::elf_header& header, std::vector<elf::program_header>& program_headers){
+    auto result = vfs::direct_read(image, reinterpret_cast<char*>(&header), sizeof(header));
+    if(!result){
+        subsystem_logf(SCHEDULER, DEBUG, "scheduler: direct_read error: %s\n", std::error_message(result.error()));
+
+        return std::make_unexpected<void, size_t>(result.error());
+    }
+
+    if(!*result){
+        logging::log(logging::log_level::DEBUG, "scheduler:exec: Not a file\n");
+
+        return std::make_unexpected<void>(std::ERROR_NOT_EXISTS);
+    }
+
+    if(*result != sizeof(header) || !elf::is_valid(reinterpret_cast<const char*>(&header)) || !header.e_phnum || header.e_phentsize != sizeof(elf::program_header)){
+        logging::log(logging::log_level::DEBUG, "scheduler:exec: Not a valid file\n");
+
+        return std::make_unexpected<void>(std::ERROR_NOT_EXECUTABLE);
+    }
+
+    program_headers.resize(header.e_phnum);
+
+    auto headers_size = header.e_phnum * sizeof(elf::program_header);
+    result = vfs::direct_read(image, reinterpret_cast<char*>(&program_headers[0]), headers_size, header.e_phoff);
+    if(!result || *result != headers_size){
+        logging::log(logging::log_level::DEBUG, "scheduler:exec: Invalid program headers\n");
+
+        return std::make_unexpected<void>(std::ERROR_NOT_EXECUTABLE);
+    }
+
+    return {};
+}
+
+/*!
+ * \brief Register the region of a loadable segment of the executable.
+ *
+ * When the file offset and the virtual address of the segment are
+ * congruent modulo the page size, the pages full of file bytes are mapped
+ * from the page cache, shared by all the processes of the executable. The
+ * read-only pages are mapped directly, the writable ones are copied on
+ * write. The last page of the file bytes and the BSS are loaded in private
+ * pages.
+ */
+bool add_segment(scheduler::process_t& process, const elf::program_header& p_header, const page_cache::source* source){
+    scheduler::region_t region;
+    region.start = paging::page_align(p_header.p_vaddr);
+    region.end = region.start + paging::pages(p_header.p_vaddr + p_header.p_memsz - region.start) * paging::PAGE_SIZE;
+    region.file_start = p_header.p_vaddr;
+    region.file_end = p_header.p_vaddr + p_header.p_filesize;
+    region.offset = p_header.p_offset;
+    region.cached = false;
+    region.writable = true;
+
+    //The segments must not reach the kernel
+    if(region.start < scheduler::program_base){
+        return false;
+    }
+
+    if(source && p_header.p_offset % paging::PAGE_SIZE == p_header.p_vaddr % paging::PAGE_SIZE){
+        auto shared_end = paging::page_align(region.file_end);
+
+        if(shared_end > region.start){
+            scheduler::region_t shared;
+            shared.start = region.start;
+            shared.end = shared_end;
+            shared.file_start = region.start;
+            shared.file_end = shared_end;
+            shared.offset = p_header.p_offset - (p_header.p_vaddr - region.start);
+            shared.cached = true;
+            shared.writable = p_header.p_flags & elf::PF_W;
+            shared.source = *source;
+
+            subsystem_logf(SCHEDULER, DEBUG, "scheduler: Shared region(p%u) virtual:%h size:%u\n", process.pid, shared.start, shared.end - shared.start);
+
+            process.regions.push_back(shared);
+
+            region.start = shared_end;
+        }
+    }
+
+    if(region.start < region.end){
+        subsystem_logf(SCHEDULER, DEBUG, "scheduler: Region(p%u) virtual:%h size:%u\n", process.pid, region.start, region.end - region.start);
+
+        process.regions.push_back(region);
+    }
+
+    return true;
+}
+
+bool create_paging(const std::vector<elf::program_header>& program_headers, scheduler::process_t& process, const page_cache::source* source){
+    //1. Prepare PML4T
+
+    //Get memory for cr3
+    process.physical_cr3 = physical_allocator::allocate_zeroed(1);
+    process.paging_size = paging::PAGE_SIZE;
+    process.address_space = paging::new_address_space();
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Process %u cr3:%h\n", process.pid, process.physical_cr3);
+
+    //Map the kernel pages inside the user memory space
+    paging::map_kernel_inside_user(process);
+
+    //2. Create all the other necessary structures
+
+    //2.1 Allocate user stack
+    if(!allocate_user_memory(process, scheduler::user_stack_start, scheduler::user_stack_size, process.physical_user_stack)){
+        return false;
+    }
+
+    //The stack grows down on demand until its limit, with zeroed pages.
+    //The page below the limit is in no region, an overflow faults
+    scheduler::region_t stack;
+    stack.start = scheduler::user_stack_limit;
+    stack.end = scheduler::user_stack_start;
+    stack.file_start = stack.start;
+    stack.file_end = stack.start;
+    stack.offset = 0;
+    stack.cached = false;
+    stack.writable = true;
+
+    process.regions.push_back(stack);
+
+    //2.2 Register all user segments, they are loaded on first touch
+
+    for(auto& p_header : program_headers){
+        if(p_header.p_type == elf::PT_LOAD && !add_segment(process, p_header, source)){
+            return false;
+        }
+    }
+
+    //2.3 Allocate kernel stack
+    if(!allocate_kernel_stack(process)){
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Returns the first address of the physical block of the process
+ * containing the given physical address, 0 if there is none
+ */
+size_t owner_block(const scheduler::process_t& process, size_t physical){
+    if(physical >= process.physical_user_stack && physical < process.physical_user_stack + scheduler::user_stack_size){
+        return process.physical_user_stack;
+    }
+
+    for(auto& segment : process.segments){
+        if(!segment.table && physical >= segment.physical && physical < segment.physical + segment.size){
+            return segment.physical;
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Give the process its own writable copy of the copy-on-write page
+ * containing the given address
+ * \return true if the page is now writable, false otherwise
+ */
+bool copy_on_write(scheduler::process_t& process, size_t address){
+    bool large;
+    auto entry = paging::user_entry(process, address, large);
+
+    if(!(entry & paging::PRESENT)){
+        return false;
+    }
+
+    //The entry was made writable after it had been cached in the TLB
+    if(entry & paging::WRITE){
+        return true;
+    }
+
+    if(!(entry & paging::COPY_ON_WRITE)){
+        return false;
+    }
+
+    auto size = large ? paging::LARGE_PAGE_SIZE : paging::PAGE_SIZE;
+    auto pages = size / paging::PAGE_SIZE;
+    auto virt = address & ~(size - 1);
+    auto physical = entry & 0x000FFFFFFFFFF000 & ~(size - 1);
+
+    //The first write to the zero page gets a fresh page of zeroes
+    bool zero = physical == zero_page;
+
+    //Once the other owners are gone, the page is written in place
+    auto block = owner_block(process, physical);
+    if(!zero && block && !physical_allocator::shared(block)){
+        return paging::user_remap_writable(process, virt, physical, large);
+    }
+
+    auto copy = zero ? physical_allocator::allocate_zeroed(pages) : physical_allocator::allocate(pages);
+
+    if(!copy){
+        subsystem_logf(SCHEDULER, DEBUG, "scheduler: Cannot copy %h of process %u\n", virt, process.pid);
+        return false;
+    }
+
+    bool copied = zero;
+
+    if(!copied && (!large || paging::large_page_aligned(copy))){
+        physical_pointer source_ptr(physical, pages);
+        physical_pointer copy_ptr(copy, pages);
+
+        if(source_ptr && copy_ptr){
+            std::copy_n(source_ptr.as_ptr<uint64_t>(), size / sizeof(uint64_t), copy_ptr.as_ptr<uint64_t>());
+            copied = true;
+        }
+    }
+
+    if(!copied || !paging::user_remap_writable(process, virt, copy, large)){
+        physical_allocator::free(copy, pages);
+        return false;
+    }
+
+    if(zero){
+        for(size_t i = 0; i < process.segments.size(); ++i){
+            if(process.segments[i].physical == zero_page){
+                process.segments.erase(i);
+                physical_allocator::release(zero_page, 1);
+                break;
+            }
+        }
+    } else if(block == physical){
+        // When the copied page is the whole block, the process does not
+        // own it anymore, its last owner then writes it in place
+        for(size_t i = 0; i < process.segments.size(); ++i){
+            auto& segment = process.segments[i];
+
+            if(!segment.table && segment.physical == physical && segment.size == size){
+                process.segments.erase(i);
+                physical_allocator::release(physical, pages);
+                break;
+            }
+        }
+    }
+
+    process.segments.push_back({copy, size, false});
+
+    return true;
+}
+
+/*!
+ * \brief Load and map the given page of a region of the process
+ * \param write Indicates if the page is loaded for a write
+ * \return true if the page has been mapped, false otherwise
+ */
+bool load_region_page(scheduler::process_t& process, const scheduler::region_t& region, size_t page, bool write){
+    //A page without bytes of the file is read from the zero page until its first write
+    if(!write && zero_page && (page + paging::PAGE_SIZE <= region.file_start || page >= region.file_end)){
+        physical_allocator::share(zero_page);
+
+        auto mapped = region.writable
+            ? paging::user_map_copy_on_write(process, page, zero_page)
+            : paging::user_map(process, page, zero_page, false);
+
+        if(!mapped){
+            physical_allocator::release(zero_page, 1);
+            return false;
+        }
+
+        process.segments.push_back({zero_page, paging::PAGE_SIZE, false});
+
+        return true;
+    }
+
+    //The BSS and the padding stay zero
+    auto physical = physical_allocator::allocate_zeroed(1);
+
+    if(!physical){
+        subsystem_logf(SCHEDULER, DEBUG, "scheduler: Cannot allocate a page for process %u\n", process.pid);
+        return false;
+    }
+
+    {
+        physical_pointer page_ptr(physical, 1);
+
+        if(!page_ptr){
+            physical_allocator::free(physical, 1);
+            return false;
+        }
+
+        auto memory = page_ptr.as_ptr<char>();
+
+        auto first = std::max(page, region.file_start);
+        auto last = std::min(page + paging::PAGE_SIZE, region.file_end);
+
+        if(first < last){
+            //The disk driver needs the interrupts
+            if(!arch::interrupts_enabled()){
+                logging::logf(logging::log_level::ERROR, "scheduler: Cannot load %h of process %u with interrupts disabled\n", page, process.pid);
+
+                physical_allocator::free(physical, 1);
+                return false;
+            }
+
+            auto count = last - first;
+            auto result = vfs::direct_read(process.image, memory + (first - page), count, region.offset + (first - region.file_start));
+
+            if(!result || *result != count){
+                logging::logf(logging::log_level::ERROR, "scheduler: Cannot load %h of process %u from its executable\n", page, process.pid);
+
+                physical_allocator::free(physical, 1);
+                return false;
             }
         }
     }
 
-    //2.3 Allocate kernel stack
-    auto virtual_kernel_stack = virtual_allocator::allocate(scheduler::kernel_stack_size / paging::PAGE_SIZE);
-    auto physical_kernel_stack = physical_allocator::allocate(scheduler::kernel_stack_size / paging::PAGE_SIZE);
+    if(!paging::user_map(process, page, physical)){
+        physical_allocator::free(physical, 1);
+        return false;
+    }
+
+    process.segments.push_back({physical, paging::PAGE_SIZE, false});
+
+    return true;
+}
+
+/*!
+ * \brief Map the following pages of a read-only cached region that are
+ * already in the page cache, they are shared with the other processes
+ * running the same executable and are likely to be used soon
+ */
+void fault_around(scheduler::process_t& process, const scheduler::region_t& region, size_t page){
+    for(size_t i = 1; i <= FAULT_AROUND_PAGES; ++i){
+        auto next = page + i * paging::PAGE_SIZE;
+
+        if(next >= region.end){
+            break;
+        }
 
-    if(!paging::map_pages(virtual_kernel_stack, physical_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE)){
+        bool large;
+        if(paging::user_entry(process, next, large) & paging::PRESENT){
+            continue;
+        }
+
+        auto physical = page_cache::get_cached(region.source, (region.offset + (next - region.start)) / paging::PAGE_SIZE);
+
+        if(!physical){
+            break;
+        }
+
+        if(!paging::user_map(process, next, physical, false)){
+            physical_allocator::release(physical, 1);
+            break;
+        }
+
+        process.segments.push_back({physical, paging::PAGE_SIZE, false});
+    }
+}
+
+/*!
+ * \brief Map the given page of a cached region of the process from the page cache
+ * \return true if the page has been mapped, false otherwise
+ */
+bool load_cached_page(scheduler::process_t& process, const scheduler::region_t& region, size_t page){
+    //The page cache may have to read the file
+    if(!arch::interrupts_enabled()){
+        logging::logf(logging::log_level::ERROR, "scheduler: Cannot map %h of process %u with interrupts disabled\n", page, process.pid);
         return false;
     }
 
-    process.physical_kernel_stack = physical_kernel_stack;
-    process.virtual_kernel_stack = virtual_kernel_stack;
-    process.kernel_rsp = virtual_kernel_stack + (scheduler::user_stack_size - 8);
+    auto physical = page_cache::get(region.source, (region.offset + (page - region.start)) / paging::PAGE_SIZE);
+
+    if(!physical){
+        subsystem_logf(SCHEDULER, DEBUG, "scheduler: Cannot map %h of process %u from the page cache\n", page, process.pid);
+        return false;
+    }
 
-    //3. Clear stacks
-    clear_physical_memory(process.physical_user_stack, scheduler::user_stack_size / paging::PAGE_SIZE);
-    clear_physical_memory(process.physical_kernel_stack, scheduler::kernel_stack_size / paging::PAGE_SIZE);
+    //The cache keeps the page shared, a write copies it
+    auto mapped = region.writable
+        ? paging::user_map_copy_on_write(process, page, physical)
+        : paging::user_map(process, page, physical, false);
+
+    if(!mapped){
+        physical_allocator::release(physical, 1);
+        return false;
+    }
+
+    process.segments.push_back({physical, paging::PAGE_SIZE, false});
+
+    if(!region.writable){
+        fault_around(process, region, page);
+    }
 
     return true;
 }
 
-void init_context(scheduler::process_t& process, const char* buffer, const std::string& file, const std::vector<std::string>& params){
-    auto header = reinterpret_cast<const elf::elf_header*>(buffer);
+/*!
+ * \brief Map the given page of a device region of the process, the page stays
+ * owned by the device
+ * \return true if the page has been mapped, false otherwise
+ */
+bool load_device_page(scheduler::process_t& process, const scheduler::region_t& region, size_t page){
+    auto physical = region.physical + (page - region.start);
+
+    physical_allocator::share(physical);
+
+    if(!paging::user_map(process, page, physical, region.writable)){
+        physical_allocator::release(physical, 1);
+        return false;
+    }
+
+    process.segments.push_back({physical, paging::PAGE_SIZE, false});
+
+    return true;
+}
 
+void init_context(scheduler::process_t& process, const elf::elf_header& header, const std::string& file, const scheduler::params_type& params){
     auto pages = scheduler::user_stack_size / paging::PAGE_SIZE;
 
     physical_pointer phys_ptr(process.physical_user_stack, pages);
@@ -590,177 +1951,582 @@ void init_context(scheduler::process_t& process, const char* buffer, const std::
 
         acc += param.size();
 
-        *(reinterpret_cast<size_t*>(rsp)) = arrays_start - acc;
-        rsp -= sizeof(size_t);
+        *(reinterpret_cast<size_t*>(rsp)) = arrays_start - acc;
+        rsp -= sizeof(size_t);
+
+        ++acc;
+    }
+
+    //Add pointer to the default argument string
+    *(reinterpret_cast<size_t*>(rsp)) = arrays_start - acc - file.size();
+    rsp -= sizeof(size_t);
+
+    //Add the strings of the arguments
+    for(int64_t i = params.size() - 1; i >= 0; --i){
+        auto& param = params[i];
+
+        *(reinterpret_cast<char*>(rsp--)) = '\0';
+        for(int64_t j = param.size() - 1; j >= 0; --j){
+            *(reinterpret_cast<char*>(rsp--)) = param[j];
+        }
+    }
+
+    //Add the the string of the default argument
+    *(reinterpret_cast<char*>(rsp--)) = '\0';
+    for(int64_t i = file.size() - 1; i >= 0; --i){
+        *(reinterpret_cast<char*>(rsp--)) = file[i];
+    }
+
+    //3. Modify the stack to configure the context
+
+    rsp = phys_ptr.get() + scheduler::user_stack_size - sizeof(interrupt::syscall_regs) - 8 - args_size;
+    auto regs = reinterpret_cast<interrupt::syscall_regs*>(rsp);
+
+    regs->rsp = scheduler::user_rsp - sizeof(interrupt::syscall_regs) - args_size; //Not sure about that
+    regs->rbp = 0;
+    regs->rip = header.e_entry;
+    regs->cs = gdt::USER_CODE_SELECTOR + 3;
+    regs->ds = gdt::USER_DATA_SELECTOR + 3;
+    regs->rflags = 0x200;
+
+    regs->rdi = 1 + params.size(); //argc
+    regs->rsi = scheduler::user_rsp - params.size() * sizeof(size_t); //argv
+
+    process.context = reinterpret_cast<interrupt::syscall_regs*>(scheduler::user_rsp - sizeof(interrupt::syscall_regs) - args_size);
+}
+
+} //end of anonymous namespace
+
+//Provided for task_switch.s
+
+extern "C" {
+
+uint64_t get_context_address(size_t pid){
+    return reinterpret_cast<size_t>(&pcb[pid].process.context);
+}
+
+uint64_t get_process_cr3(size_t pid){
+    // The threads share the TLB generation of their owner
+    return paging::switch_cr3(pcb[pcb[pid].owner].process);
+}
+
+void task_switched(size_t pid){
+    pcb[pid].on_cpu = false;
+}
+
+} //end of extern "C"
+
+void scheduler::init(){
+    pcb_lock.set_name("scheduler_pcb");
+    timeouts_lock.set_name("scheduler_timeouts");
+
+    //The zero page is never freed, each mapping takes a reference on it
+    zero_page = physical_allocator::allocate_zeroed(1);
+
+    //Create all the kernel tasks
+    create_idle_task();
+    create_init_tasks();
+    create_gc_task();
+    create_post_init_task();
+
+    procfs::set_pcb(&pcb);
+
+    sysfs::set_dynamic_value(path("/sys"), path("/scheduler/steals"), &sysfs_steals);
+    sysfs::set_dynamic_value(path("/sys"), path("/scheduler/migrations"), &sysfs_migrations);
+    sysfs::set_dynamic_value(path("/sys"), path("/scheduler/fpu_reloads"), &sysfs_fpu_reloads);
+    sysfs::set_dynamic_value(path("/sys"), path("/scheduler/fpu_skips"), &sysfs_fpu_skips);
+
+    subsystem_logf(SCHEDULER, TRACE, "scheduler: initialized (PCB slab:%m pcb_entry:%m process: %m)\n", sizeof(process_control_t) * process_table::slab_size, sizeof(process_control_t), sizeof(process_t));
+}
+
+void scheduler::start(){
+    auto& cpu = cpus[0];
+
+    //Run the init task by default
+    cpu.current_pid = init_pid;
+    make_unready(pcb[init_pid]);
+    pcb[init_pid].state = scheduler::process_state::RUNNING;
+    pcb[init_pid].on_cpu = true;
+
+    cpu.online = true;
+    started = true;
+
+    init_task_switch(init_pid);
+}
+
+void scheduler::init_cpu(size_t cpu){
+    auto& idle_process = scheduler::create_kernel_task("idle", new char[scheduler::user_stack_size], new char[scheduler::kernel_stack_size], &idle_task);
+
+    idle_process.ppid = 0;
+    idle_process.priority = scheduler::MIN_PRIORITY;
+
+    pcb[idle_process.pid].cpu = cpu;
+
+    cpus[cpu].idle_pid = idle_process.pid;
+}
+
+void scheduler::start_cpu(size_t cpu){
+    auto& cpu_scheduler = cpus[cpu];
+
+    // The processor starts with its idle task
+    auto pid = cpu_scheduler.idle_pid;
+
+    cpu_scheduler.current_pid = pid;
+    pcb[pid].state = scheduler::process_state::RUNNING;
+    pcb[pid].on_cpu = true;
+
+    cpu_scheduler.online = true;
+
+    // The BSP timer is used for timekeeping, the local timer only preempts
+    apic::start_timer(timer::timer_frequency());
+
+    init_task_switch(pid);
+}
+
+bool scheduler::is_started(){
+    return started;
+}
+
+std::expected<scheduler::pid_t> scheduler::exec(const std::string& file, const params_type& params, size_t flags, const size_t* handles){
+    logging::log(logging::log_level::TRACE, "scheduler:exec: read headers start\n");
+
+    if(handles){
+        for(size_t i = 0; i < 3; ++i){
+            if(handles[i] && !has_handle(handles[i])){
+                return std::make_unexpected<pid_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+            }
+        }
+    }
+
+    auto image = path(file);
+    if(image.is_relative()){
+        image = current_owner().working_directory / image;
+    }
+
+    // The executables of the page cache can share their pages and their
+    // parsed headers
+    page_cache::source source;
+    bool cacheable = vfs::cache_source(image, source).valid();
+
+    elf::elf_header header;
+    std::vector<elf::program_header> program_headers;
+
+    if(!cacheable || !elf_cache::get(source, header, program_headers)){
+        auto headers = read_headers(image, header, program_headers);
+
+        if(!headers){
+            return std::make_unexpected<pid_t>(headers.error());
+        }
+
+        if(cacheable){
+            elf_cache::put(source, header, program_headers);
+        }
+    }
+
+    logging::log(logging::log_level::TRACE, "scheduler:exec: read headers end\n");
+
+    auto& process = new_process();
+
+    process.name = file;
+    process.image = image;
+
+    if(flags & std::EXEC_FAIR){
+        pcb[process.pid].policy = sched_policy::FAIR;
+    }
+
+    process.huge_heap = flags & std::EXEC_HUGE_HEAP;
+
+    if(!create_paging(program_headers, process, cacheable ? &source : nullptr)){
+        logging::log(logging::log_level::DEBUG, "scheduler:exec: Impossible to create paging\n");
+
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    if(!time_page::map(process)){
+        logging::log(logging::log_level::DEBUG, "scheduler:exec: Impossible to map the time page\n");
+
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    process.brk_start = program_break;
+    process.brk_end = program_break;
+
+    init_context(process, header, file, params);
+
+    pcb[process.pid].working_directory = current_owner().working_directory;
+
+    // Inherit standard file descriptors from the parent, or the given ones
+    for(size_t i = 0; i < 3; ++i){
+        auto fd = handles && handles[i] ? handles[i] : i + 1;
+        auto& handle = current_owner().handles[fd - 1];
+
+        pipe::acquire(handle.base_path);
+        pcb[process.pid].handles.emplace_back(handle);
+    }
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Exec process pid=%u, ppid=%u\n", process.pid, process.ppid);
+
+    queue_process(process.pid);
+
+    return process.pid;
+}
+
+std::expected<scheduler::pid_t> scheduler::fork(const interrupt::syscall_regs& regs){
+    auto& parent_control = current_owner();
+    auto& parent = parent_control.process;
+
+    if(parent.system){
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    auto& process = new_process();
+    auto& control = pcb[process.pid];
+
+    process.name = parent.name;
+    process.image = parent.image;
+    process.regions = parent.regions;
+    process.priority = parent.priority;
+    process.mmap_end = parent.mmap_end;
+    process.brk_start = parent.brk_start;
+    process.brk_end = parent.brk_end;
+    process.huge_heap = parent.huge_heap;
+    process.alloc_profile = parent.alloc_profile;
+
+    control.policy = parent_control.policy;
+    control.mxcsr = arch::get_mxcsr();
+    control.fpu_control = arch::get_fpu_control();
+    control.fs_base = pcb[current_pid()].fs_base;
+
+    //1. Share the address space, the child gets its own paging tables
+
+    process.physical_cr3 = physical_allocator::allocate_zeroed(1);
+    process.paging_size = paging::PAGE_SIZE;
+    process.address_space = paging::new_address_space();
+
+    paging::map_kernel_inside_user(process);
+
+    if(!paging::user_share(parent, process)){
+        logging::log(logging::log_level::DEBUG, "scheduler:fork: Impossible to share the address space\n");
+
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    //2. The physical memory is owned by both processes
+
+    for(auto& segment : parent.segments){
+        if(!segment.table){
+            physical_allocator::share(segment.physical);
+            process.segments.push_back(segment);
+        }
+    }
+
+    physical_allocator::share(parent.physical_user_stack);
+    process.physical_user_stack = parent.physical_user_stack;
+
+    if(!allocate_kernel_stack(process)){
+        logging::log(logging::log_level::DEBUG, "scheduler:fork: Impossible to allocate the kernel stack\n");
+
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    //3. The child returns from the system call with 0
+
+    auto context = reinterpret_cast<interrupt::syscall_regs*>(process.kernel_rsp - sizeof(interrupt::syscall_regs));
+    *context = regs;
+
+    // The entry of the system call pushes rax between the code and
+    // the interrupt frame, the frame is one word after the fields
+    auto frame = reinterpret_cast<const uint64_t*>(&regs.rip) + 1;
+    context->rip = frame[0];
+    context->cs = frame[1];
+    context->rflags = frame[2];
+    context->rsp = frame[3];
+    context->ds = frame[4];
+    context->rax = 0;
+
+    process.context = context;
+
+    //4. Inherit the files of the parent
+
+    control.working_directory = parent_control.working_directory;
+
+    for(auto& handle : parent_control.handles){
+        pipe::acquire(handle.base_path);
+        control.handles.push_back(handle);
+    }
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Fork process pid=%u, ppid=%u\n", process.pid, process.ppid);
+
+    queue_process(process.pid);
+
+    return process.pid;
+}
+
+std::expected<scheduler::pid_t> scheduler::create_thread(size_t entry, size_t stack, size_t data, size_t tls){
+    auto& owner_control = current_owner();
+    auto& owner = owner_control.process;
+
+    if(owner.system){
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    auto& process = new_process();
+    auto& control = pcb[process.pid];
+
+    process.name = owner.name;
+    process.priority = owner.priority;
+
+    control.owner = owner.pid;
+    control.policy = owner_control.policy;
+    control.mxcsr = arch::get_mxcsr();
+    control.fpu_control = arch::get_fpu_control();
+    control.fs_base = tls;
+
+    //1. Share the paging structures, the owner keeps the memory
+
+    process.physical_cr3 = owner.physical_cr3;
+    process.paging_size = 0;
+    process.address_space = owner.address_space;
+    process.physical_user_stack = 0;
+
+    if(!allocate_kernel_stack(process)){
+        logging::log(logging::log_level::DEBUG, "scheduler:create_thread: Impossible to allocate the kernel stack\n");
+
+        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    }
+
+    //2. The thread starts in the entry, as if it was called
+
+    auto context = reinterpret_cast<interrupt::syscall_regs*>(process.kernel_rsp - sizeof(interrupt::syscall_regs));
+    std::fill_n(reinterpret_cast<char*>(context), sizeof(interrupt::syscall_regs), 0);
+
+    context->rip = entry;
+    context->rsp = (stack & ~(STACK_ALIGNMENT - 1)) - 8;
+    context->rbp = 0;
+    context->cs = gdt::USER_CODE_SELECTOR + 3;
+    context->ds = gdt::USER_DATA_SELECTOR + 3;
+    context->rflags = 0x200;
+    context->rdi = data;
+
+    process.context = context;
+
+    control.working_directory = owner_control.working_directory;
+
+    __atomic_add_fetch(&owner_control.threads, 1, __ATOMIC_SEQ_CST);
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Thread pid=%u of process %u\n", process.pid, owner.pid);
+
+    queue_process(process.pid);
+
+    return process.pid;
+}
+
+void scheduler::set_tls(size_t tls){
+    direct_int_lock lock;
 
-        ++acc;
-    }
+    pcb[current_pid()].fs_base = tls;
+    arch::write_msr(MSR_FS_BASE, tls);
+}
 
-    //Add pointer to the default argument string
-    *(reinterpret_cast<size_t*>(rsp)) = arrays_start - acc - file.size();
-    rsp -= sizeof(size_t);
+scheduler::process_t& scheduler::get_owner_process(){
+    return current_owner().process;
+}
 
-    //Add the strings of the arguments
-    for(int64_t i = params.size() - 1; i >= 0; --i){
-        auto& param = params[i];
+void scheduler::sbrk(size_t inc){
+    auto& process = current_owner().process;
 
-        *(reinterpret_cast<char*>(rsp--)) = '\0';
-        for(int64_t j = param.size() - 1; j >= 0; --j){
-            *(reinterpret_cast<char*>(rsp--)) = param[j];
-        }
+    if(process.huge_heap && huge_sbrk(process, inc)){
+        update_heap_region(process);
+        return;
     }
 
-    //Add the the string of the default argument
-    *(reinterpret_cast<char*>(rsp--)) = '\0';
-    for(int64_t i = file.size() - 1; i >= 0; --i){
-        *(reinterpret_cast<char*>(rsp--)) = file[i];
-    }
+    size_t size = (inc + paging::PAGE_SIZE - 1) & ~(paging::PAGE_SIZE - 1);
 
-    //3. Modify the stack to configure the context
+    subsystem_logf(SCHEDULER, DEBUG, "sbrk: Add %u pages to process %u heap\n", size / paging::PAGE_SIZE, process.pid);
 
-    rsp = phys_ptr.get() + scheduler::user_stack_size - sizeof(interrupt::syscall_regs) - 8 - args_size;
-    auto regs = reinterpret_cast<interrupt::syscall_regs*>(rsp);
+    //The pages are only allocated on first write, the reads map the zero page
+    process.brk_end += size;
 
-    regs->rsp = scheduler::user_rsp - sizeof(interrupt::syscall_regs) - args_size; //Not sure about that
-    regs->rbp = 0;
-    regs->rip = header->e_entry;
-    regs->cs = gdt::USER_CODE_SELECTOR + 3;
-    regs->ds = gdt::USER_DATA_SELECTOR + 3;
-    regs->rflags = 0x200;
+    update_heap_region(process);
+}
 
-    regs->rdi = 1 + params.size(); //argc
-    regs->rsi = scheduler::user_rsp - params.size() * sizeof(size_t); //argv
+void scheduler::brk_release(size_t dec){
+    auto& process = current_owner().process;
 
-    process.context = reinterpret_cast<interrupt::syscall_regs*>(scheduler::user_rsp - sizeof(interrupt::syscall_regs) - args_size);
-}
+    auto size = std::min(dec, process.brk_end - process.brk_start) & ~(paging::PAGE_SIZE - 1);
+    auto new_end = process.brk_end - size;
 
-} //end of anonymous namespace
+    // The heap is released one segment at a time, from its end
+    while(process.brk_end > new_end){
+        auto top = process.brk_end - paging::PAGE_SIZE;
 
-//Provided for task_switch.s
+        bool large;
+        auto entry = paging::user_entry(process, top, large);
 
-extern "C" {
+        //The untouched pages are not backed
+        if(!(entry & paging::PRESENT)){
+            process.brk_end = top;
+            continue;
+        }
 
-uint64_t get_context_address(size_t pid){
-    return reinterpret_cast<size_t>(&pcb[pid].process.context);
-}
+        auto physical = entry & 0x000FFFFFFFFFF000;
 
-uint64_t get_process_cr3(size_t pid){
-    return reinterpret_cast<uint64_t>(pcb[pid].process.physical_cr3);
-}
+        if(large){
+            physical = (physical & ~(paging::LARGE_PAGE_SIZE - 1)) + (top & (paging::LARGE_PAGE_SIZE - 1));
+        }
 
-} //end of extern "C"
+        size_t index = 0;
+        for(; index < process.segments.size(); ++index){
+            auto& segment = process.segments[index];
 
-void scheduler::init(){
-    //Create all the kernel tasks
-    create_idle_task();
-    create_init_tasks();
-    create_gc_task();
-    create_post_init_task();
+            if(!segment.table && physical >= segment.physical && physical < segment.physical + segment.size){
+                break;
+            }
+        }
 
-    procfs::set_pcb(pcb.data());
+        if(index == process.segments.size()){
+            break;
+        }
 
-    logging::logf(logging::log_level::TRACE, "scheduler: initialized (PCB size:%m pcb_entry:%m process: %m)\n", sizeof(pcb_t), sizeof(process_control_t), sizeof(process_t));
-}
+        auto segment = process.segments[index];
+        auto start = top - (physical - segment.physical);
+        auto pages = segment.size / paging::PAGE_SIZE;
 
-void scheduler::start(){
-    //Run the init task by default
-    current_pid = init_pid;
-    pcb[current_pid].state = scheduler::process_state::RUNNING;
+        if(start < new_end || !paging::user_unmap_pages(process, start, pages)){
+            break;
+        }
 
-    started = true;
+        subsystem_logf(SCHEDULER, DEBUG, "sbrk: Release %u pages of process %u heap\n", pages, process.pid);
 
-    init_task_switch(current_pid);
-}
+        physical_allocator::release(segment.physical, pages);
+        process.segments.erase(index);
 
-bool scheduler::is_started(){
-    return started;
+        process.brk_end = start;
+    }
+
+    update_heap_region(process);
 }
 
-std::expected<scheduler::pid_t> scheduler::exec(const std::string& file, const std::vector<std::string>& params){
-    logging::log(logging::log_level::TRACE, "scheduler:exec: read_file start\n");
+std::expected<size_t> scheduler::mmap(size_t fd, size_t offset, size_t length, size_t prot){
+    auto& process = current_owner().process;
 
-    std::string content;
-    auto result = vfs::direct_read(path(file), content);
-    if(!result){
-        logging::logf(logging::log_level::DEBUG, "scheduler: direct_read error: %s\n", std::error_message(result.error()));
+    if(process.system){
+        return std::make_unexpected<size_t>(std::ERROR_UNSUPPORTED);
+    }
 
-        return std::make_unexpected<pid_t, size_t>(result.error());
+    if(!paging::page_aligned(offset)){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_OFFSET);
     }
 
-    logging::log(logging::log_level::TRACE, "scheduler:exec: read_file end\n");
+    if(!length || !(prot & std::MMAP_READ)){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
 
-    if(content.empty()){
-        logging::log(logging::log_level::DEBUG, "scheduler:exec: Not a file\n");
+    scheduler::region_t region;
 
-        return std::make_unexpected<pid_t>(std::ERROR_NOT_EXISTS);
-    }
+    size_t physical = 0;
+    size_t size = 0;
 
-    auto buffer = content.c_str();
+    auto result = vfs::cache_source(fd, region.source);
 
-    if(!elf::is_valid(buffer)){
-        logging::log(logging::log_level::DEBUG, "scheduler:exec: Not a valid file\n");
+    if(result){
+        size = region.source.size;
+    } else if(!vfs::device_memory(fd, physical, size)){
+        // The devices can give their own memory instead
+        return std::make_unexpected<size_t>(result.error());
+    }
 
-        return std::make_unexpected<pid_t>(std::ERROR_NOT_EXECUTABLE);
+    if(offset >= size){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_OFFSET);
     }
 
-    auto& process = new_process();
+    length = std::min(length, size - offset);
 
-    process.name = file;
+    region.start = process.mmap_end;
+    region.end = region.start + paging::pages(length) * paging::PAGE_SIZE;
+    region.file_start = region.start;
+    region.file_end = region.start + length;
+    region.offset = offset;
+    region.cached = !physical;
+    region.writable = prot & std::MMAP_WRITE;
+    region.physical = physical ? physical + offset : 0;
 
-    if(!create_paging(buffer, process)){
-        logging::log(logging::log_level::DEBUG, "scheduler:exec: Impossible to create paging\n");
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Map(p%u) %s virtual:%h size:%u\n", process.pid, region.source.fs_path.string().c_str(), region.start, length);
 
-        return std::make_unexpected<pid_t>(std::ERROR_FAILED_EXECUTION);
+    process.regions.push_back(region);
+    process.mmap_end = region.end;
+
+    return region.start;
+}
+
+std::expected<size_t> scheduler::map_shared_pages(const size_t* pages, size_t n){
+    auto& process = current_owner().process;
+
+    if(process.system){
+        return std::make_unexpected<size_t>(std::ERROR_UNSUPPORTED);
     }
 
-    process.brk_start = program_break;
-    process.brk_end = program_break;
+    // The range is reserved even if the mapping fails midway
+    auto start = process.mmap_end;
+    process.mmap_end = start + n * paging::PAGE_SIZE;
 
-    init_context(process, buffer, file, params);
+    for(size_t i = 0; i < n; ++i){
+        physical_allocator::share(pages[i]);
 
-    pcb[process.pid].working_directory = pcb[current_pid].working_directory;
+        if(!paging::user_map(process, start + i * paging::PAGE_SIZE, pages[i], true)){
+            physical_allocator::release(pages[i], 1);
 
-    // Inherit standard file descriptors from the parent
-    pcb[process.pid].handles.emplace_back(pcb[current_pid].handles[0]);
-    pcb[process.pid].handles.emplace_back(pcb[current_pid].handles[1]);
-    pcb[process.pid].handles.emplace_back(pcb[current_pid].handles[2]);
+            // The pages mapped so far stay owned until the process ends
+            return std::make_unexpected<size_t>(std::ERROR_FAILED);
+        }
 
-    logging::logf(logging::log_level::DEBUG, "scheduler: Exec process pid=%u, ppid=%u\n", process.pid, process.ppid);
+        process.segments.push_back({pages[i], paging::PAGE_SIZE, false});
+    }
 
-    queue_process(process.pid);
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Map(p%u) %u shared pages virtual:%h\n", process.pid, n, start);
 
-    return process.pid;
+    return start;
 }
 
-void scheduler::sbrk(size_t inc){
-    auto& process = pcb[current_pid].process;
+std::expected<void> scheduler::unmap_shared_pages(size_t address, size_t n){
+    auto& process = current_owner().process;
 
-    size_t size = (inc + paging::PAGE_SIZE - 1) & ~(paging::PAGE_SIZE - 1);
-    size_t pages = size / paging::PAGE_SIZE;
+    if(process.system || !paging::page_aligned(address)){
+        return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+    }
 
-    logging::logf(logging::log_level::DEBUG, "sbrk: Add %u pages to process %u heap\n", pages, process.pid);
+    for(size_t i = 0; i < n; ++i){
+        auto virt = address + i * paging::PAGE_SIZE;
 
-    //Get some physical memory
-    auto physical = physical_allocator::allocate(pages);
+        bool large;
+        auto entry = paging::user_entry(process, virt, large);
 
-    if(!physical){
-        logging::logf(logging::log_level::DEBUG, "sbrk: Impossible to allocate %u pages for process %u\n", pages, process.pid);
-        return;
-    }
+        if(!(entry & paging::PRESENT) || large){
+            return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+        }
 
-    auto virtual_start = process.brk_end;
+        auto physical = entry & 0x000FFFFFFFFFF000;
 
-    logging::logf(logging::log_level::DEBUG, "sbrk: Map(p%u) virtual:%h into phys: %h\n", process.pid, virtual_start, physical);
+        size_t index = 0;
+        for(; index < process.segments.size(); ++index){
+            auto& segment = process.segments[index];
 
-    //Map the memory inside the process memory space
-    if(!paging::user_map_pages(process, virtual_start, physical, pages)){
-        physical_allocator::free(physical, pages);
-        return;
+            if(!segment.table && segment.physical == physical && segment.size == paging::PAGE_SIZE){
+                break;
+            }
+        }
+
+        if(index == process.segments.size() || !paging::user_unmap_pages(process, virt, 1)){
+            return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+        }
+
+        physical_allocator::release(physical, 1);
+        process.segments.erase(index);
     }
 
-    process.segments.push_back({physical, pages});
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Unmap(p%u) %u shared pages virtual:%h\n", process.pid, n, address);
 
-    process.brk_end += size;
+    return {};
 }
 
 void scheduler::await_termination(pid_t pid){
@@ -768,26 +2534,20 @@ void scheduler::await_termination(pid_t pid){
         {
             direct_int_lock lock;
 
-            bool found = false;
-            for(auto& process : pcb){
-                if(process.process.ppid == current_pid && process.process.pid == pid){
-                    if(process.state == process_state::KILLED || process.state == process_state::EMPTY){
-                        return;
-                    }
-
-                    found = true;
-                    break;
-                }
+            // The process may have already been cleaned, we can simply return
+            if(!pcb.exists(pid) || pcb[pid].process.ppid != current_pid()){
+                return;
             }
 
-            // The process may have already been cleaned, we can simply return
-            if(!found){
+            if(pcb[pid].state == process_state::KILLED){
                 return;
             }
 
-            logging::logf(logging::log_level::DEBUG, "scheduler: Process %u waits for %u\n", current_pid, pid);
+            subsystem_logf(SCHEDULER, DEBUG, "scheduler: Process %u waits for %u\n", current_pid(), pid);
+
+            pcb[current_pid()].state = process_state::WAITING;
 
-            pcb[current_pid].state = process_state::WAITING;
+            sched_trace::record(sched_trace::event_type::BLOCK, current_pid(), 0);
         }
 
         // Reschedule is out of the critical section
@@ -796,20 +2556,36 @@ void scheduler::await_termination(pid_t pid){
 }
 
 void scheduler::kill_current_process(){
-    logging::logf(logging::log_level::DEBUG, "scheduler: Kill %u\n", current_pid);
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Kill %u\n", current_pid());
 
     {
         direct_int_lock lock;
 
         // The process is now considered killed
-        pcb[current_pid].state = scheduler::process_state::KILLED;
+        pcb[current_pid()].state = scheduler::process_state::KILLED;
+        make_unready(pcb[current_pid()]);
+
+        // The resources are released by the GC thread, outside of the exit
+        auto& zombie = pcb[current_pid()];
+        zombie.zombie_next = __atomic_load_n(&zombies, __ATOMIC_RELAXED);
+
+        // On failure, zombie_next is updated with the current head
+        while(!__atomic_compare_exchange_n(&zombies, &zombie.zombie_next, &zombie, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){}
+
+        auto ppid = pcb[current_pid()].process.ppid;
+
+        // The parent is charged with the time of the process and of its own children
+        if(pcb.exists(ppid)){
+            auto& usage = pcb[current_pid()].usage;
+            auto& parent_usage = pcb[ppid].usage;
+
+            parent_usage.children_user_ticks   += usage.user_ticks + usage.children_user_ticks;
+            parent_usage.children_kernel_ticks += usage.kernel_ticks + usage.children_kernel_ticks;
+        }
 
         //Notify parent if waiting
-        auto ppid = pcb[current_pid].process.ppid;
-        for(auto& process : pcb){
-            if(process.process.pid == ppid && process.state == process_state::WAITING){
-                unblock_process(process.process.pid);
-            }
+        if(pcb.exists(ppid) && pcb[ppid].state == process_state::WAITING){
+            unblock_process(ppid);
         }
 
         //The GC thread will clean the resources eventually
@@ -825,25 +2601,59 @@ void scheduler::kill_current_process(){
 }
 
 void scheduler::tick(){
+    tick(1);
+}
+
+void scheduler::tick(uint64_t ticks){
     if(!started){
         return;
     }
 
-    // Update sleep timeouts
-    for(auto& process : pcb){
-        if(process.state == process_state::SLEEPING || process.state == process_state::BLOCKED_TIMEOUT){
-            --process.sleep_timeout;
+    // The tick cannot interrupt a read section, they disable the preemption
+    qsbr::quiescent();
+
+    // Update sleep timeouts, only once for all the processors
+    if(smp::current_cpu() == 0){
+        // Too large for the stack, the BSP is the only user
+        static std::array<pid_t, MAX_PROCESS> expired_pids;
+        size_t expired = 0;
+
+        {
+            std::lock_guard<int_spinlock> l(timeouts_lock);
+
+            // The timers cannot be used once the lock is released
+            for(auto timer = timeouts.advance(ticks); timer; timer = timer->next){
+                expired_pids[expired++] = timer->id;
+            }
+        }
 
-            if(process.sleep_timeout == 0){
+        for(size_t i = 0; i < expired; ++i){
+            auto& process = pcb[expired_pids[i]];
+
+            // The process may have been woken up and put to sleep again
+            if(!process.timeout.armed && (process.state == process_state::SLEEPING || process.state == process_state::BLOCKED_TIMEOUT)){
                 verbose_logf(logging::log_level::TRACE, "scheduler: Process %u finished sleeping, is ready\n", process.process.pid);
-                process.state = process_state::READY;
+                make_ready(process);
             }
         }
+
+        // Periodically balance the processes between the processors
+        balance_ticks += ticks;
+
+        if(smp::cpus() > 1 && balance_ticks >= BALANCE_INTERVAL * (timer::timer_frequency() / 1000)){
+            balance_ticks = 0;
+            balance_cpus();
+        }
     }
 
-    auto& process = pcb[current_pid];
+    auto& process = pcb[current_pid()];
+
+    if(process.policy == sched_policy::FAIR){
+        process.vruntime += ticks * (FAIR_SCALE / fair_weight(process));
+    }
 
-    if(process.rounds == rr_quantum){
+    // The softirqs interrupted by the tick must finish on this processor
+    if(process.rounds >= rr_quantum && !softirq::active()){
         process.rounds = 0;
 
         process.state = process_state::READY;
@@ -851,77 +2661,154 @@ void scheduler::tick(){
         auto pid = select_next_process();
 
         //If it is the same, no need to go to the switching process
-        if(pid == current_pid){
+        if(pid == current_pid()){
             process.state = process_state::RUNNING;
             return;
         }
 
-        verbose_logf(logging::log_level::DEBUG, "scheduler: Preempt %u to %u\n", current_pid, pid);
+        verbose_logf(logging::log_level::DEBUG, "scheduler: Preempt %u to %u\n", current_pid(), pid);
 
         switch_to_process(pid);
     } else {
-        ++process.rounds;
+        process.rounds += ticks;
     }
 
     //At this point we just have to return to the current process
 }
 
+void scheduler::account_tick(bool user){
+    if(!started){
+        return;
+    }
+
+    auto& usage = pcb[current_pid()].usage;
+
+    if(user){
+        ++usage.user_ticks;
+    } else {
+        ++usage.kernel_ticks;
+    }
+}
+
+void scheduler::account_io(size_t read, size_t written){
+    if(!started){
+        return;
+    }
+
+    auto& usage = pcb[current_pid()].usage;
+
+    usage.read_bytes += read;
+    usage.written_bytes += written;
+}
+
+void scheduler::account_socket(size_t received, size_t sent){
+    if(!started){
+        return;
+    }
+
+    auto& usage = pcb[current_pid()].usage;
+
+    usage.received_bytes += received;
+    usage.sent_bytes += sent;
+}
+
 void scheduler::yield(){
     thor_assert(started, "No interest in yielding before start");
 
-    pcb[current_pid].state = process_state::READY;
+    pcb[current_pid()].state = process_state::READY;
 
     auto pid = select_next_process();
 
-    if(pid != current_pid){
-        verbose_logf(logging::log_level::DEBUG, "scheduler: Yields %u to %u\n", current_pid, pid);
+    if(pid != current_pid()){
+        verbose_logf(logging::log_level::DEBUG, "scheduler: Yields %u to %u\n", current_pid(), pid);
         switch_to_process(pid);
     } else {
-        pcb[current_pid].state = process_state::RUNNING;
+        pcb[current_pid()].state = process_state::RUNNING;
     }
 }
 
 void scheduler::reschedule(){
     thor_assert(started, "No interest in rescheduling before start");
 
-    auto& process = pcb[current_pid];
+    auto& process = pcb[current_pid()];
 
     //The process just got blocked or put to sleep, choose another one
     if(process.state != process_state::RUNNING){
         auto index = select_next_process();
 
-        switch_to_process(index);
+        //The process may have been woken up in the meantime
+        if(index == current_pid()){
+            process.state = process_state::RUNNING;
+        } else {
+            switch_to_process(index);
+        }
     }
 
     //At this point we just have to return to the current process
 }
 
+size_t scheduler::process_slots(){
+    return pcb.size();
+}
+
 scheduler::pid_t scheduler::get_pid(){
-    return current_pid;
+    return current_pid();
 }
 
 scheduler::process_t& scheduler::get_process(pid_t pid){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
 
     return pcb[pid].process;
 }
 
 scheduler::process_state scheduler::get_process_state(pid_t pid){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
 
     return pcb[pid].state;
 }
 
+bool scheduler::is_running(pid_t pid){
+    if(!pcb.valid(pid)){
+        return false;
+    }
+
+    return pcb[pid].on_cpu;
+}
+
+size_t scheduler::get_priority(pid_t pid){
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+
+    return effective_priority(pcb[pid]);
+}
+
+bool scheduler::inherit_priority(pid_t pid, size_t priority){
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+    thor_assert(priority <= scheduler::MAX_PRIORITY, "Invalid priority");
+
+    return change_boost(pcb[pid], priority, true);
+}
+
+void scheduler::set_boost(pid_t pid, size_t priority){
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+    thor_assert(priority <= scheduler::MAX_PRIORITY, "Invalid priority");
+
+    change_boost(pcb[pid], priority, false);
+}
+
 void scheduler::block_process_light(pid_t pid){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
 
     verbose_logf(logging::log_level::DEBUG, "scheduler: Block process (light) %u\n", pid);
 
     pcb[pid].state = process_state::BLOCKED;
+
+    make_unready(pcb[pid]);
+
+    sched_trace::record(sched_trace::event_type::BLOCK, pid, 0);
 }
 
 void scheduler::block_process_timeout_light(pid_t pid, size_t ms){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
 
     verbose_logf(logging::log_level::DEBUG, "scheduler: Block process (light) %u with timeout %u\n", pid, ms);
 
@@ -930,122 +2817,172 @@ void scheduler::block_process_timeout_light(pid_t pid, size_t ms){
     sleep_ticks = !sleep_ticks ? 1 : sleep_ticks;
 
     // Put the process to sleep
-    pcb[pid].sleep_timeout = sleep_ticks;
-
     pcb[pid].state = process_state::BLOCKED_TIMEOUT;
+
+    make_unready(pcb[pid]);
+
+    sched_trace::record(sched_trace::event_type::BLOCK, pid, 0);
+
+    // The state must be set before the timeout can expire
+    arm_timeout(pcb[pid], sleep_ticks);
+
+    timeout_updated();
 }
 
 void scheduler::block_process(pid_t pid){
     thor_assert(is_started(), "The scheduler is not started");
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
-    thor_assert(pid != idle_pid, "No reason to block the idle task");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+    thor_assert(!is_idle_task(pid), "No reason to block the idle task");
 
     verbose_logf(logging::log_level::DEBUG, "scheduler: Block process %u\n", pid);
 
     pcb[pid].state = process_state::BLOCKED;
 
+    make_unready(pcb[pid]);
+
+    sched_trace::record(sched_trace::event_type::BLOCK, pid, 0);
+
     reschedule();
 }
 
 void scheduler::unblock_process(pid_t pid){
     verbose_logf(logging::log_level::DEBUG, "scheduler: Unblock process %u (%u)\n", pid, size_t(pcb[pid].state));
 
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
-    thor_assert(pid != idle_pid, "No reason to unblock the idle task");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+    thor_assert(!is_idle_task(pid), "No reason to unblock the idle task");
     thor_assert(is_started(), "The scheduler is not started");
     thor_assert(pcb[pid].state == process_state::BLOCKED || pcb[pid].state == process_state::BLOCKED_TIMEOUT || pcb[pid].state == process_state::WAITING, "Can only unblock BLOCKED/WAITING processes");
 
-    pcb[pid].state = process_state::READY;
+    make_ready(pcb[pid]);
 }
 
 void scheduler::unblock_process_hint(pid_t pid){
     verbose_logf(logging::log_level::DEBUG, "scheduler: Unblock process (hint) %u (%u)\n", pid, size_t(pcb[pid].state));
 
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
-    thor_assert(pid != idle_pid, "No reason to unblock the idle task");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+    thor_assert(!is_idle_task(pid), "No reason to unblock the idle task");
     thor_assert(is_started(), "The scheduler is not started");
 
     auto state = pcb[pid].state;
 
-    if(state != process_state::RUNNING){
-        pcb[pid].state = process_state::READY;
+    // READY processes are already queued and dead processes must not be
+    if(state == process_state::BLOCKED || state == process_state::BLOCKED_TIMEOUT || state == process_state::WAITING || state == process_state::SLEEPING){
+        make_ready(pcb[pid]);
     }
 }
 
 void scheduler::sleep_ms(size_t time){
-    sleep_ms(current_pid, time);
+    sleep_ms(current_pid(), time);
 }
 
 void scheduler::sleep_ms(pid_t pid, size_t time){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
     thor_assert(pcb[pid].state == process_state::RUNNING, "Only RUNNING processes can sleep");
 
     // Compute the amount of ticks to sleep
     auto sleep_ticks = time * (timer::timer_frequency() / 1000);
     sleep_ticks = !sleep_ticks ? 1 : sleep_ticks;
 
-    logging::logf(logging::log_level::DEBUG, "scheduler: Put %u to sleep for %u ticks\n", pid, sleep_ticks);
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Put %u to sleep for %u ticks\n", pid, sleep_ticks);
 
     // Put the process to sleep
-    pcb[pid].sleep_timeout = sleep_ticks;
     pcb[pid].state = process_state::SLEEPING;
 
+    sched_trace::record(sched_trace::event_type::BLOCK, pid, 0);
+
+    // The state must be set before the timeout can expire
+    arm_timeout(pcb[pid], sleep_ticks);
+
+    timeout_updated();
+
     // Run another process
     reschedule();
 }
 
 size_t scheduler::register_new_handle(const path& p){
-    pcb[current_pid].handles.push_back(p);
+    pipe::acquire(p);
+    current_owner().handles.push_back(p);
 
-    return pcb[current_pid].handles.size();
+    return current_owner().handles.size();
 }
 
 void scheduler::release_handle(size_t fd){
-    pcb[current_pid].handles[fd - 1].invalidate();
+    pipe::release(current_owner().handles[fd - 1].base_path);
+    current_owner().handles[fd - 1] = vfs::open_file();
 }
 
 bool scheduler::has_handle(size_t fd){
-    return fd > 0 && fd <= pcb[current_pid].handles.size() && pcb[current_pid].handles[fd - 1].is_valid();
+    return fd > 0 && fd <= current_owner().handles.size() && current_owner().handles[fd - 1].base_path.is_valid();
 }
 
 const path& scheduler::get_handle(size_t fd){
-    return pcb[current_pid].handles[fd - 1];
+    return current_owner().handles[fd - 1].base_path;
+}
+
+vfs::open_file& scheduler::get_open_file(size_t fd){
+    return current_owner().handles[fd - 1];
 }
 
 size_t scheduler::register_new_socket(network::socket_domain domain, network::socket_type type, network::socket_protocol protocol){
-    auto id = pcb[current_pid].sockets.size() + 1;
+    auto id = current_owner().sockets.size() + 1;
 
-    pcb[current_pid].sockets.emplace_back(id, domain, type, protocol, size_t(1), false);
+    current_owner().sockets.emplace_back(id, domain, type, protocol, size_t(1), false);
 
     return id;
 }
 
 void scheduler::release_socket(size_t fd){
-    pcb[current_pid].sockets[fd - 1].invalidate();
+    current_owner().sockets[fd - 1].invalidate();
 }
 
 bool scheduler::has_socket(size_t fd){
-    return fd > 0 && fd - 1 < pcb[current_pid].sockets.size() && pcb[current_pid].sockets[fd - 1].is_valid();
+    return fd > 0 && fd - 1 < current_owner().sockets.size() && current_owner().sockets[fd - 1].is_valid();
 }
 
 network::socket& scheduler::get_socket(size_t fd){
-    return pcb[current_pid].sockets[fd - 1];
+    return current_owner().sockets[fd - 1];
 }
 
 std::deque<network::socket>& scheduler::get_sockets(){
-    return pcb[current_pid].sockets;
+    return current_owner().sockets;
 }
 
 std::deque<network::socket>& scheduler::get_sockets(scheduler::pid_t pid){
     return pcb[pid].sockets;
 }
 
+size_t scheduler::register_new_poll(poll::instance* instance){
+    current_owner().polls.push_back(instance);
+
+    return current_owner().polls.size();
+}
+
+poll::instance& scheduler::get_poll(size_t fd){
+    return *current_owner().polls[fd - 1];
+}
+
+bool scheduler::has_poll(size_t fd){
+    return fd > 0 && fd <= current_owner().polls.size() && current_owner().polls[fd - 1];
+}
+
+poll::instance* scheduler::release_poll(size_t fd){
+    auto* instance = current_owner().polls[fd - 1];
+
+    current_owner().polls[fd - 1] = nullptr;
+
+    return instance;
+}
+
+std::vector<poll::instance*>& scheduler::get_polls(){
+    return current_owner().polls;
+}
+
 const path& scheduler::get_working_directory(){
-    return pcb[current_pid].working_directory;
+    return current_owner().working_directory;
 }
 
 void scheduler::set_working_directory(const path& directory){
-    pcb[current_pid].working_directory = directory;
+    current_owner().working_directory = directory;
 }
 
 scheduler::process_t& scheduler::create_kernel_task(const char* name, char* user_stack, char* kernel_stack, void (*fun)()){
@@ -1054,6 +2991,7 @@ scheduler::process_t& scheduler::create_kernel_task(const char* name, char* user
     process.system = true;
     process.physical_cr3 = paging::get_physical_pml4t();
     process.paging_size = 0;
+    process.address_space = paging::KERNEL_ADDRESS_SPACE;
     process.name = name;
 
     // Directly uses memory of the executable
@@ -1094,20 +3032,54 @@ scheduler::process_t& scheduler::create_kernel_task_args(const char* name, char*
 }
 
 void scheduler::queue_system_process(scheduler::pid_t pid){
-    thor_assert(pid < scheduler::MAX_PROCESS, "pid out of bounds");
+    thor_assert(pcb.valid(pid), "pid out of bounds");
 
     auto& process = pcb[pid];
 
     thor_assert(process.process.priority <= scheduler::MAX_PRIORITY, "Invalid priority");
     thor_assert(process.process.priority >= scheduler::MIN_PRIORITY, "Invalid priority");
 
-    process.state = scheduler::process_state::READY;
+    make_ready(process);
+}
+
+void scheduler::queue_system_process(scheduler::pid_t pid, size_t cpu){
+    thor_assert(pcb.valid(pid), "pid out of bounds");
+    thor_assert(cpu < cpus.size(), "cpu out of bounds");
+
+    pcb[pid].cpu = cpu;
 
-    run_queue(process.process.priority).push_back(pid);
+    queue_system_process(pid);
 }
 
-void scheduler::queue_async_init_task(void (*fun)()){
-    init_tasks.emplace_back(fun);
+void scheduler::queue_async_init_task(const char* name, void (*fun)(), std::initializer_list<const char*> after){
+    thor_assert(queued_init_tasks < MAX_INIT_TASKS, "Too many asynchronous init tasks");
+    thor_assert(after.size() <= MAX_INIT_DEPENDENCIES, "Too many dependencies for an init task");
+
+    auto& task = init_tasks[queued_init_tasks];
+
+    task.name = name;
+    task.fun = fun;
+    task.dependencies = 0;
+    task.done.init(0);
+
+    // The dependencies are queued before, there cannot be any cycle
+    for(auto dependency : after){
+        bool found = false;
+
+        for(size_t i = 0; i < queued_init_tasks; ++i){
+            if(std::string(init_tasks[i].name) == dependency){
+                task.after[task.dependencies++] = i;
+                found = true;
+                break;
+            }
+        }
+
+        if(!found){
+            logging::logf(logging::log_level::ERROR, "scheduler: init task %s depends on unknown task %s\n", name, dependency);
+        }
+    }
+
+    ++queued_init_tasks;
 }
 
 void scheduler::frequency_updated(uint64_t old_frequency, uint64_t new_frequency){
@@ -1118,17 +3090,88 @@ void scheduler::frequency_updated(uint64_t old_frequency, uint64_t new_frequency
 
     double ratio = old_frequency / double(new_frequency);
 
-    for(auto& process : pcb){
-        if(process.state == process_state::SLEEPING){
-            process.sleep_timeout *= ratio;
+    {
+        std::lock_guard<int_spinlock> l(timeouts_lock);
+
+        for(auto& process : pcb){
+            if(process.timeout.armed){
+                timeouts.insert(process.timeout, timeouts.remaining(process.timeout) * ratio);
+            }
+        }
+    }
+
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler:: Frequency updated. New Round Robin quantum: %u\n", rr_quantum);
+}
+
+size_t scheduler::user_physical_address(size_t address){
+    auto& process = current_owner().process;
+
+    if(process.system){
+        return 0;
+    }
+
+    bool large;
+    auto entry = paging::user_entry(process, address, large);
+
+    //The pages of the regions are only mapped on first touch
+    if(!(entry & paging::PRESENT)){
+        if(!scheduler::page_fault(address, paging::WRITE)){
+            return 0;
+        }
+
+        entry = paging::user_entry(process, address, large);
+    }
+
+    if((entry & paging::PRESENT) && !(entry & paging::WRITE)){
+        if(!copy_on_write(process, address)){
+            return 0;
+        }
+
+        entry = paging::user_entry(process, address, large);
+    }
+
+    if(!(entry & paging::PRESENT)){
+        return 0;
+    }
+
+    auto size = large ? paging::LARGE_PAGE_SIZE : paging::PAGE_SIZE;
+
+    return (entry & 0x000FFFFFFFFFF000 & ~(size - 1)) + (address & (size - 1));
+}
+
+bool scheduler::page_fault(size_t address, uint64_t error_code){
+    auto& process = current_owner().process;
+
+    if(process.system){
+        return false;
+    }
+
+    ++pcb[current_pid()].usage.page_faults;
+
+    // The only protection violation resolved is a write to a copy-on-write page
+    if(error_code & paging::PRESENT){
+        return (error_code & paging::WRITE) && copy_on_write(process, address);
+    }
+
+    for(auto& region : process.regions){
+        if(address >= region.start && address < region.end){
+            if(region.cached){
+                return load_cached_page(process, region, paging::page_align(address));
+            }
+
+            if(region.physical){
+                return load_device_page(process, region, paging::page_align(address));
+            }
+
+            return load_region_page(process, region, paging::page_align(address), error_code & paging::WRITE);
         }
     }
 
-    logging::logf(logging::log_level::DEBUG, "scheduler:: Frequency updated. New Round Robin quantum: %u\n", rr_quantum);
+    return false;
 }
 
 void scheduler::fault(){
-    logging::logf(logging::log_level::DEBUG, "scheduler: Fault in %u kill it\n", current_pid);
+    subsystem_logf(SCHEDULER, DEBUG, "scheduler: Fault in %u kill it\n", current_pid());
 
     kill_current_process();
 }
@@ -0,0 +1,241 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <vector.hpp>
+#include <string.hpp>
+#include <lock_guard.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "shm.hpp"
+#include "scheduler.hpp"
+#include "physical_allocator.hpp"
+#include "paging.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+
+namespace {
+
+/*!
+ * \brief A shared memory object
+ */
+struct object_t {
+    std::string name;          ///< The name of the object, empty once removed
+    std::vector<size_t> pages; ///< The physical pages of the object
+    size_t mappings;           ///< The number of processes mapping the object
+};
+
+/*!
+ * \brief The mapping of an object by a process
+ */
+struct mapping_t {
+    scheduler::pid_t pid; ///< The process owning the mapping
+    size_t address;       ///< The virtual address of the mapping
+    object_t* object;     ///< The mapped object
+};
+
+spinlock lock;                   ///< The lock of the objects and the mappings
+std::vector<object_t*> objects;  ///< The named objects
+std::vector<mapping_t> mappings; ///< The mappings of all the processes
+
+bool valid_name(const char* name){
+    auto length = std::str_len(name);
+
+    return length && length <= shm::MAX_NAME;
+}
+
+// Find a named object, with the lock held
+object_t* find_object(const char* name){
+    for(auto* object : objects){
+        if(object->name == name){
+            return object;
+        }
+    }
+
+    return nullptr;
+}
+
+// Release the memory of the object, once neither named nor mapped, with the lock held
+void release_object(object_t* object){
+    if(!object->name.empty() || object->mappings){
+        return;
+    }
+
+    // The pages still mapped in a dead process are freed by its last owner
+    for(auto page : object->pages){
+        physical_allocator::release(page, 1);
+    }
+
+    delete object;
+}
+
+} //End of anonymous namespace
+
+std::expected<void> shm::create(const char* name, size_t size){
+    if(!valid_name(name)){
+        return std::make_unexpected<void>(std::ERROR_INVALID_FILE_PATH);
+    }
+
+    if(!size || size > MAX_SIZE){
+        return std::make_unexpected<void>(std::ERROR_INVALID_COUNT);
+    }
+
+    auto* object = new object_t();
+    object->name = name;
+    object->mappings = 0;
+
+    auto pages = paging::pages(size);
+
+    // The pages are allocated one by one, each of them is released by its last owner
+    for(size_t i = 0; i < pages; ++i){
+        auto physical = physical_allocator::allocate_zeroed(1);
+
+        if(!physical){
+            logging::logf(logging::log_level::ERROR, "shm: Unable to allocate %u pages for %s\n", pages, name);
+
+            for(auto page : object->pages){
+                physical_allocator::free(page, 1);
+            }
+
+            delete object;
+
+            return std::make_unexpected<void>(std::ERROR_FAILED);
+        }
+
+        object->pages.push_back(physical);
+    }
+
+    std::lock_guard<spinlock> l(lock);
+
+    if(find_object(name)){
+        for(auto page : object->pages){
+            physical_allocator::free(page, 1);
+        }
+
+        delete object;
+
+        return std::make_unexpected<void>(std::ERROR_EXISTS);
+    }
+
+    objects.push_back(object);
+
+    logging::logf(logging::log_level::TRACE, "shm: Created %s (%u pages)\n", name, pages);
+
+    return {};
+}
+
+std::expected<size_t> shm::map(const char* name, size_t& size){
+    if(!valid_name(name)){
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_PATH);
+    }
+
+    object_t* object;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        object = find_object(name);
+
+        if(!object){
+            return std::make_unexpected<size_t>(std::ERROR_NOT_EXISTS);
+        }
+
+        // The object cannot go away while it is being mapped
+        ++object->mappings;
+    }
+
+    // Mapping may allocate paging structures, outside of the lock
+    auto address = scheduler::map_shared_pages(&object->pages[0], object->pages.size());
+
+    std::lock_guard<spinlock> l(lock);
+
+    if(!address){
+        --object->mappings;
+        release_object(object);
+
+        return std::make_unexpected<size_t>(address.error());
+    }
+
+    mappings.push_back({scheduler::get_owner_process().pid, *address, object});
+
+    size = object->pages.size() * paging::PAGE_SIZE;
+
+    return *address;
+}
+
+std::expected<void> shm::unmap(size_t address){
+    auto pid = scheduler::get_owner_process().pid;
+
+    object_t* object = nullptr;
+
+    {
+        std::lock_guard<spinlock> l(lock);
+
+        for(size_t i = 0; i < mappings.size(); ++i){
+            if(mappings[i].pid == pid && mappings[i].address == address){
+                object = mappings[i].object;
+                mappings.erase(i);
+                break;
+            }
+        }
+    }
+
+    if(!object){
+        return std::make_unexpected<void>(std::ERROR_INVALID_REQUEST);
+    }
+
+    auto status = scheduler::unmap_shared_pages(address, object->pages.size());
+
+    std::lock_guard<spinlock> l(lock);
+
+    --object->mappings;
+    release_object(object);
+
+    return status;
+}
+
+std::expected<void> shm::remove(const char* name){
+    if(!valid_name(name)){
+        return std::make_unexpected<void>(std::ERROR_INVALID_FILE_PATH);
+    }
+
+    std::lock_guard<spinlock> l(lock);
+
+    for(size_t i = 0; i < objects.size(); ++i){
+        auto* object = objects[i];
+
+        if(object->name == name){
+            objects.erase(i);
+
+            object->name.clear();
+            release_object(object);
+
+            return {};
+        }
+    }
+
+    return std::make_unexpected<void>(std::ERROR_NOT_EXISTS);
+}
+
+void shm::release(scheduler::pid_t pid){
+    std::lock_guard<spinlock> l(lock);
+
+    // The pages themselves are released with the segments of the process
+    for(size_t i = 0; i < mappings.size();){
+        if(mappings[i].pid == pid){
+            auto* object = mappings[i].object;
+
+            mappings.erase(i);
+
+            --object->mappings;
+            release_object(object);
+        } else {
+            ++i;
+        }
+    }
+}
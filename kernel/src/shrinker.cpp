@@ -0,0 +1,255 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <math.hpp>
+
+#include "tlib/errors.hpp"
+
+#include "shrinker.hpp"
+#include "physical_allocator.hpp"
+#include "paging.hpp"
+#include "work_queue.hpp"
+#include "poll.hpp"
+#include "logging.hpp"
+#include "arch.hpp"
+
+#include "fs/devfs.hpp"
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t RECLAIM_BATCH = 64; ///< The number of pages reclaimed beyond the low watermark
+
+/*!
+ * \brief A cache registered to give memory back
+ */
+struct shrinker_t {
+    const char* name;           ///< The name of the cache
+    shrinker::count_fun count;  ///< The estimate of the reclaimable pages
+    shrinker::scan_fun scan;    ///< The reclaim function
+    volatile size_t reclaimed;  ///< The number of pages given back
+};
+
+std::array<shrinker_t, shrinker::MAX_SHRINKERS> shrinkers;
+volatile size_t registered = 0; ///< The number of registered caches
+
+volatile shrinker::pressure current = shrinker::pressure::NONE; ///< The last computed level
+volatile bool started = false;                                  ///< Indicates if the worker can be used
+
+volatile size_t reclaims = 0;  ///< The number of reclaims triggered by the watermark
+volatile size_t reclaimed = 0; ///< The number of pages given back by the reclaims
+
+work_queue::work reclaim_work; ///< The reclaim and the notifications done once the level changed
+
+poll::source source; ///< The readiness of the device, readable under pressure
+
+// The device, its reads return the current level
+struct pressure_driver final : devfs::char_driver {
+    size_t read(void* data, char* buffer, size_t count, size_t& read) override;
+    size_t read(void* data, char* buffer, size_t count, size_t& read, size_t ms) override;
+    size_t write(void* data, const char* buffer, size_t count, size_t& written) override;
+    poll::source* poll_source(void* data) override;
+};
+
+pressure_driver driver;
+
+const char* level_name(shrinker::pressure level){
+    switch(level){
+        case shrinker::pressure::NONE:
+            return "none";
+        case shrinker::pressure::LOW:
+            return "low";
+        case shrinker::pressure::MEDIUM:
+            return "medium";
+        case shrinker::pressure::CRITICAL:
+            return "critical";
+    }
+
+    return "unknown";
+}
+
+size_t total_pages(){
+    return physical_allocator::available() / paging::PAGE_SIZE;
+}
+
+size_t free_pages(){
+    return physical_allocator::free() / paging::PAGE_SIZE;
+}
+
+shrinker::pressure compute_level(){
+    auto total = total_pages();
+    auto free = free_pages();
+
+    if(free < total / 32){
+        return shrinker::pressure::CRITICAL;
+    } else if(free < total / 16){
+        return shrinker::pressure::MEDIUM;
+    } else if(free < total / 8){
+        return shrinker::pressure::LOW;
+    }
+
+    return shrinker::pressure::NONE;
+}
+
+void reclaim(void* /*data*/){
+    source.notify();
+
+    if(current != shrinker::pressure::NONE){
+        auto target = total_pages() / 8;
+        auto free = free_pages();
+
+        if(free < target){
+            ++reclaims;
+            reclaimed += shrinker::shrink(target - free + RECLAIM_BATCH);
+        }
+
+        // The reclaim may have lowered the level
+        shrinker::update();
+    }
+}
+
+size_t pressure_readiness(const void* /*object*/){
+    return current != shrinker::pressure::NONE ? poll::POLL_IN : 0;
+}
+
+size_t pressure_driver::read(void* /*data*/, char* buffer, size_t count, size_t& read){
+    std::string value = level_name(current);
+    value += '\n';
+
+    read = std::min(count, value.size());
+    std::copy_n(value.c_str(), read, buffer);
+
+    return 0;
+}
+
+size_t pressure_driver::read(void* data, char* buffer, size_t count, size_t& read, size_t /*ms*/){
+    return this->read(data, buffer, count, read);
+}
+
+size_t pressure_driver::write(void* /*data*/, const char* /*buffer*/, size_t /*count*/, size_t& /*written*/){
+    return std::ERROR_UNSUPPORTED;
+}
+
+poll::source* pressure_driver::poll_source(void* /*data*/){
+    return &source;
+}
+
+std::string sysfs_level(){
+    return level_name(current);
+}
+
+uint64_t sysfs_reclaims(){
+    return reclaims;
+}
+
+uint64_t sysfs_reclaimed(){
+    return reclaimed;
+}
+
+uint64_t sysfs_reclaimable(void* data){
+    return static_cast<shrinker_t*>(data)->count();
+}
+
+uint64_t sysfs_shrinker_reclaimed(void* data){
+    return static_cast<shrinker_t*>(data)->reclaimed;
+}
+
+} //end of anonymous namespace
+
+void shrinker::init(){
+    reclaim_work.fun = &reclaim;
+    reclaim_work.data = nullptr;
+
+    source.init(pressure_readiness, nullptr);
+
+    devfs::register_device("/dev/", "memory_pressure", devfs::device_type::CHAR_DEVICE, &driver, nullptr);
+
+    sysfs::set_dynamic_value(path("/sys"), path("/memory/pressure/level"), &sysfs_level);
+    sysfs::set_counter_value(path("/sys"), path("/memory/pressure/reclaims"), &sysfs_reclaims);
+    sysfs::set_counter_value(path("/sys"), path("/memory/pressure/reclaimed"), &sysfs_reclaimed);
+
+    started = true;
+}
+
+void shrinker::add(const char* name, count_fun count, scan_fun scan){
+    if(registered == MAX_SHRINKERS){
+        logging::logf(logging::log_level::ERROR, "shrinker: Too many caches, %s is not registered\n", name);
+        return;
+    }
+
+    auto& entry = shrinkers[registered];
+
+    entry.name = name;
+    entry.count = count;
+    entry.scan = scan;
+    entry.reclaimed = 0;
+
+    auto base = path("/memory/shrinkers") / name;
+
+    sysfs::set_counter_value_data(path("/sys"), base / "reclaimable", &sysfs_reclaimable, &entry);
+    sysfs::set_counter_value_data(path("/sys"), base / "reclaimed", &sysfs_shrinker_reclaimed, &entry);
+
+    ++registered;
+}
+
+void shrinker::update(){
+    // With the interrupts disabled, a lock of the scheduler may be held, the
+    // change is seen by a later update
+    if(!started || !arch::interrupts_enabled()){
+        return;
+    }
+
+    auto next = compute_level();
+
+    if(next != current){
+        current = next;
+
+        work_queue::submit(reclaim_work);
+    }
+}
+
+size_t shrinker::shrink(size_t pages){
+    std::array<size_t, MAX_SHRINKERS> counts;
+
+    size_t total = 0;
+
+    for(size_t i = 0; i < registered; ++i){
+        counts[i] = shrinkers[i].count();
+        total += counts[i];
+    }
+
+    if(!total){
+        return 0;
+    }
+
+    size_t given = 0;
+
+    for(size_t i = 0; i < registered; ++i){
+        if(!counts[i]){
+            continue;
+        }
+
+        auto& entry = shrinkers[i];
+
+        // Each cache gives back in proportion of its reclaimable pages
+        auto share = std::min(counts[i], std::ceil_divide(pages * counts[i], total));
+        auto released = entry.scan(share);
+
+        entry.reclaimed += released;
+        given += released;
+    }
+
+    logging::logf(logging::log_level::TRACE, "shrinker: %u pages given back for %u\n", given, pages);
+
+    return given;
+}
+
+shrinker::pressure shrinker::level(){
+    return current;
+}
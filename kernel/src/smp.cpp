@@ -0,0 +1,334 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+#include <string.hpp>
+
+#include "smp.hpp"
+#include "acpica.hpp"
+#include "arch.hpp"
+#include "gdt.hpp"
+#include "interrupts.hpp"
+#include "logging.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+#include "work_queue.hpp"
+#include "softirq.hpp"
+#include "time_page.hpp"
+#include "profile.hpp"
+#include "paging.hpp"
+#include "tlb_shootdown.hpp"
+
+#include "drivers/apic.hpp"
+#include "drivers/ioapic.hpp"
+
+#include "fs/sysfs.hpp"
+
+//Provided by ap_boot.s
+extern "C" {
+extern char ap_trampoline_start[];
+extern char ap_trampoline_end[];
+extern char ap_trampoline_gdtr[];
+extern char ap_trampoline_cr3[];
+extern char ap_trampoline_stack[];
+extern char ap_trampoline_entry[];
+}
+
+namespace {
+
+constexpr const size_t TRAMPOLINE_ADDRESS = 0x80000; ///< Must match ap_boot.s
+constexpr const size_t AP_STACK_SIZE = 4 * 4096;     ///< The stack used until the idle task runs
+constexpr const size_t STARTUP_TIMEOUT = 100;        ///< In milliseconds
+
+std::array<uint32_t, smp::MAX_CPUS> apic_ids;
+std::array<uint8_t, 256> apic_cpus;
+
+size_t cpu_count = 1;
+volatile size_t started_cpus = 1;
+
+static_assert(smp::MAX_CPUS <= 64, "The online processors must fit in the mask");
+
+volatile uint64_t online_cpus = 1; ///< The mask of the processors running the kernel
+volatile size_t max_cpu = 1;       ///< One more than the highest index of the processors running the kernel
+
+// Until the APs are started, every processor is the BSP
+volatile bool apic_lookup = false;
+
+/*!
+ * \brief The state of the processor being started
+ */
+enum ap_state_t : size_t {
+    AP_STARTING,  ///< The startup IPIs are sent
+    AP_BOOTING,   ///< The processor runs ap_main, the BSP waits for it
+    AP_STARTED,   ///< The processor is initialized
+    AP_ABANDONED  ///< The processor did not start in time, it is parked if it starts later
+};
+
+volatile size_t starting_cpu = 0;
+volatile size_t ap_state = AP_STARTING;
+
+void wait_ms(uint64_t ms){
+    auto start = timer::milliseconds();
+    while(timer::milliseconds() < start + ms){
+        arch::pause();
+    }
+}
+
+/*!
+ * \brief Returns the address of a trampoline slot once copied in low memory
+ */
+template<typename T>
+T& trampoline_slot(char* slot){
+    return *reinterpret_cast<T*>(TRAMPOLINE_ADDRESS + (slot - ap_trampoline_start));
+}
+
+bool discover_cpus(){
+    ACPI_TABLE_MADT* madt;
+    auto status = AcpiGetTable(ACPI_SIG_MADT, 0, reinterpret_cast<ACPI_TABLE_HEADER **>(&madt));
+    if (ACPI_FAILURE(status)){
+        logging::logf(logging::log_level::TRACE, "smp: No ACPI MADT table\n");
+        return false;
+    }
+
+    // The current processor is always the first
+    apic_ids[0] = apic::id();
+    apic_cpus[apic_ids[0]] = 0;
+
+    auto start = reinterpret_cast<uintptr_t>(madt) + sizeof(ACPI_TABLE_MADT);
+    auto end = reinterpret_cast<uintptr_t>(madt) + madt->Header.Length;
+
+    while(start < end){
+        auto header = reinterpret_cast<ACPI_SUBTABLE_HEADER*>(start);
+
+        if(!header->Length){
+            break;
+        }
+
+        if(header->Type == ACPI_MADT_TYPE_LOCAL_APIC){
+            auto local_apic = reinterpret_cast<ACPI_MADT_LOCAL_APIC*>(header);
+
+            if((local_apic->LapicFlags & ACPI_MADT_ENABLED) && local_apic->Id != apic_ids[0]){
+                if(cpu_count == smp::MAX_CPUS){
+                    logging::logf(logging::log_level::WARNING, "smp: Too many processors, ignore APIC %u\n", size_t(local_apic->Id));
+                } else {
+                    apic_ids[cpu_count] = local_apic->Id;
+                    apic_cpus[local_apic->Id] = cpu_count;
+                    ++cpu_count;
+                }
+            }
+        }
+
+        start += header->Length;
+    }
+
+    logging::logf(logging::log_level::TRACE, "smp: Found %u processors\n", cpu_count);
+
+    return true;
+}
+
+void ap_main(){
+    // A processor that starts after its timeout must not run, the BSP
+    // has given up on its index
+    if(!__sync_bool_compare_and_swap(&ap_state, AP_STARTING, AP_BOOTING)){
+        while(true){
+            asm volatile("cli; hlt");
+        }
+    }
+
+    auto cpu = starting_cpu;
+
+    arch::enable_sse();
+    arch::enable_write_protect();
+    paging::init_pat();
+    paging::init_global_pages();
+    paging::init_pcid(cpu);
+
+    gdt::init_cpu(cpu);
+    gdt::init_fault_stack(cpu);
+    interrupt::setup_ap_interrupts();
+    apic::init_ap();
+
+    // From now on, the processor receives the TLB shootdowns, the
+    // mappings changed while it was starting are flushed
+    max_cpu = cpu + 1;
+    __atomic_or_fetch(&online_cpus, uint64_t(1) << cpu, __ATOMIC_SEQ_CST);
+    paging::flush_tlb_local();
+
+    __atomic_store_n(&ap_state, AP_STARTED, __ATOMIC_RELEASE);
+
+    scheduler::start_cpu(cpu);
+}
+
+bool start_cpu(size_t cpu){
+    auto id = apic_ids[cpu];
+
+    // Each processor needs a stack to reach the scheduler
+    auto stack = new char[AP_STACK_SIZE];
+
+    trampoline_slot<uint64_t>(ap_trampoline_stack) = reinterpret_cast<uintptr_t>(stack + AP_STACK_SIZE);
+    trampoline_slot<uint64_t>(ap_trampoline_entry) = reinterpret_cast<uintptr_t>(&ap_main);
+
+    scheduler::init_cpu(cpu);
+
+    starting_cpu = cpu;
+    ap_state = AP_STARTING;
+
+    // INIT-SIPI-SIPI sequence
+    apic::send_init(id);
+    wait_ms(10);
+
+    for(size_t i = 0; i < 2 && ap_state == AP_STARTING; ++i){
+        apic::send_startup(id, TRAMPOLINE_ADDRESS >> 12);
+
+        auto start = timer::milliseconds();
+        while(ap_state == AP_STARTING && timer::milliseconds() < start + STARTUP_TIMEOUT){
+            arch::pause();
+        }
+    }
+
+    if(__sync_bool_compare_and_swap(&ap_state, AP_STARTING, AP_ABANDONED)){
+        // The stack cannot be released, the processor may still start
+        logging::logf(logging::log_level::ERROR, "smp: Processor %u (APIC %u) did not start\n", cpu, size_t(id));
+        return false;
+    }
+
+    // The processor is booting, it is not abandoned anymore
+    while(__atomic_load_n(&ap_state, __ATOMIC_ACQUIRE) != AP_STARTED){
+        arch::pause();
+    }
+
+    logging::logf(logging::log_level::TRACE, "smp: Processor %u (APIC %u) started\n", cpu, size_t(id));
+
+    return true;
+}
+
+void timer_handler(interrupt::syscall_regs* regs, void*){
+    apic::timer_interrupt();
+
+    // Keep the time page fresh while the bootstrap processor is idle
+    time_page::update();
+
+    profile::sample(regs);
+    scheduler::account_tick(regs->cs & 0x3);
+
+    scheduler::tick();
+}
+
+void reschedule_handler(interrupt::syscall_regs*, void*){
+    // Nothing to do, the idle task yields when it wakes up
+}
+
+void shootdown_handler(interrupt::syscall_regs*, void*){
+    tlb_shootdown::handle();
+}
+
+std::string sysfs_cpus(){
+    return std::to_string(started_cpus);
+}
+
+} //End of anonymous namespace
+
+void smp::init(){
+    // The processors are enumerated with ACPI, the local APIC timer is
+    // calibrated against the final timer counter
+    scheduler::queue_async_init_task("smp", smp::late_init, {"acpi", "hpet"});
+}
+
+void smp::late_init(){
+    sysfs::set_dynamic_value(path("/sys"), path("/cpus"), &sysfs_cpus);
+
+    // The local APIC gives the id of the bootstrap processor
+    if(!apic::init()){
+        return;
+    }
+
+    bool discovered = discover_cpus();
+
+    // The legacy IRQs can then be routed to any processor
+    ioapic::init();
+
+    if(!discovered || cpu_count == 1){
+        return;
+    }
+
+    if(!interrupt::register_apic_handler(apic::TIMER_IRQ, timer_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "smp: Unable to register the APIC timer handler\n");
+        return;
+    }
+
+    if(!interrupt::register_apic_handler(apic::RESCHEDULE_IRQ, reschedule_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "smp: Unable to register the reschedule handler\n");
+        return;
+    }
+
+    if(!interrupt::register_apic_handler(apic::SHOOTDOWN_IRQ, shootdown_handler, nullptr)){
+        logging::logf(logging::log_level::ERROR, "smp: Unable to register the TLB shootdown handler\n");
+        return;
+    }
+
+    //1. Copy the trampoline in low memory
+
+    std::copy(ap_trampoline_start, ap_trampoline_end, reinterpret_cast<char*>(TRAMPOLINE_ADDRESS));
+
+    //2. Share the GDT and the page tables of the BSP
+
+    uint64_t cr3;
+    asm volatile("mov %0, cr3" : "=r" (cr3));
+
+    asm volatile("sgdt [%0]" : : "r" (&trampoline_slot<char>(ap_trampoline_gdtr)) : "memory");
+    // The processors start with the PCID 0, CR4.PCIDE cannot be set otherwise
+    trampoline_slot<uint64_t>(ap_trampoline_cr3) = cr3 & ~uint64_t(0xFFF);
+
+    //3. Start the processors one by one
+
+    apic_lookup = true;
+
+    for(size_t cpu = 1; cpu < cpu_count; ++cpu){
+        if(!start_cpu(cpu)){
+            // A late processor would read the trampoline slots of the next
+            // one, the remaining processors are not started
+            logging::logf(logging::log_level::ERROR, "smp: Do not start the %u remaining processors\n", cpu_count - cpu - 1);
+            break;
+        }
+
+        ++started_cpus;
+
+        work_queue::init_cpu(cpu);
+        softirq::init_cpu(cpu);
+    }
+
+    logging::logf(logging::log_level::TRACE, "smp: %u processors are running\n", size_t(started_cpus));
+}
+
+size_t smp::cpus(){
+    return started_cpus;
+}
+
+size_t smp::max_cpus(){
+    return max_cpu;
+}
+
+uint64_t smp::online_mask(){
+    return __atomic_load_n(&online_cpus, __ATOMIC_ACQUIRE);
+}
+
+bool smp::online(size_t cpu){
+    return cpu < MAX_CPUS && (online_mask() & (uint64_t(1) << cpu));
+}
+
+size_t smp::current_cpu(){
+    if(!apic_lookup){
+        return 0;
+    }
+
+    return apic_cpus[apic::id()];
+}
+
+uint32_t smp::apic_id(size_t cpu){
+    return apic_ids[cpu];
+}
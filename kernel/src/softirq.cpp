@@ -0,0 +1,237 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <string.hpp>
+#include <lock_guard.hpp>
+
+#include "softirq.hpp"
+#include "scheduler.hpp"
+#include "smp.hpp"
+#include "timer.hpp"
+#include "logging.hpp"
+
+#include "conc/int_spinlock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t max_rounds = 10; ///< The rounds of pending softirqs run after an interrupt
+constexpr const size_t max_ms = 2;      ///< The time the softirqs can run after an interrupt
+
+/*!
+ * \brief A registered bottom half
+ */
+struct handler_t {
+    void (*fun)(void*); ///< The function to execute
+    void* data;         ///< The data given to the function
+};
+
+/*!
+ * \brief The softirqs of a processor
+ */
+struct cpu_t {
+    volatile uint64_t pending = 0;   ///< The raised softirqs, one bit per id
+    volatile bool active = false;    ///< Indicates if softirqs are running on the processor
+    volatile bool deferred = false;  ///< Indicates if the thread runs the softirqs, under load
+    int_spinlock wait_lock;          ///< Protect the wake up of the thread
+    volatile bool waiting = false;   ///< Indicates if the thread waits for softirqs
+    scheduler::pid_t pid = scheduler::INVALID_PID; ///< The softirq thread
+};
+
+std::array<handler_t, softirq::MAX_SOFTIRQS> handlers;
+std::array<cpu_t, smp::MAX_CPUS> cpus;
+
+size_t registered = 0; ///< The number of registered softirqs
+
+volatile size_t executed = 0; ///< The number of softirq handlers executed
+volatile size_t deferred = 0; ///< The number of times the thread took over the softirqs
+
+std::string sysfs_executed(){
+    return std::to_string(executed);
+}
+
+std::string sysfs_deferred(){
+    return std::to_string(deferred);
+}
+
+// Run the given softirqs once, the interrupts are enabled
+void execute(uint64_t pending){
+    while(pending){
+        auto id = __builtin_ctzll(pending);
+        pending &= pending - 1;
+
+        handlers[id].fun(handlers[id].data);
+
+        __atomic_add_fetch(&executed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Give the softirqs to the thread of the processor, with the interrupts disabled
+void defer(cpu_t& cpu){
+    if(cpu.pid == scheduler::INVALID_PID || cpu.deferred){
+        return;
+    }
+
+    cpu.deferred = true;
+    __atomic_add_fetch(&deferred, 1, __ATOMIC_RELAXED);
+
+    // The flag is set before, a thread not seen waiting yet sees it
+    __sync_synchronize();
+
+    if(!cpu.waiting){
+        return;
+    }
+
+    std::lock_guard<int_spinlock> l(cpu.wait_lock);
+
+    if(cpu.waiting){
+        cpu.waiting = false;
+        scheduler::unblock_process_hint(cpu.pid);
+    }
+}
+
+void wait_for_softirqs(cpu_t& cpu){
+    {
+        std::lock_guard<int_spinlock> l(cpu.wait_lock);
+
+        // The interrupts run the softirqs again once the thread sleeps
+        cpu.deferred = false;
+
+        cpu.waiting = true;
+        __sync_synchronize();
+
+        // A softirq may have been raised or deferred before the waiting flag was visible
+        if(cpu.deferred || cpu.pending){
+            cpu.waiting = false;
+            return;
+        }
+
+        scheduler::block_process_light(cpu.pid);
+    }
+
+    scheduler::reschedule();
+
+    cpu.waiting = false;
+}
+
+void softirq_task(void* data){
+    auto& cpu = *static_cast<cpu_t*>(data);
+
+    while(true){
+        if(cpu.pending){
+            // The interrupts do not run the softirqs meanwhile
+            cpu.active = true;
+
+            execute(__atomic_exchange_n(&cpu.pending, 0, __ATOMIC_SEQ_CST));
+
+            cpu.active = false;
+
+            // Leave the processor to the other processes between the rounds
+            scheduler::yield();
+        } else {
+            wait_for_softirqs(cpu);
+        }
+    }
+}
+
+void start_thread(size_t cpu){
+    auto& state = cpus[cpu];
+
+    auto name = "softirq_" + std::to_string(cpu);
+
+    auto* user_stack = new char[scheduler::user_stack_size];
+    auto* kernel_stack = new char[scheduler::kernel_stack_size];
+
+    auto& process = scheduler::create_kernel_task_args(name.c_str(), user_stack, kernel_stack, &softirq_task, &state);
+    process.ppid = 1;
+    process.priority = scheduler::DEFAULT_PRIORITY;
+
+    state.pid = process.pid;
+
+    scheduler::queue_system_process(process.pid, cpu);
+
+    logging::logf(logging::log_level::TRACE, "softirq: thread %u started on processor %u\n", process.pid, cpu);
+}
+
+} //End of anonymous namespace
+
+void softirq::init(){
+    start_thread(0);
+
+    sysfs::set_dynamic_value(path("/sys"), path("/softirq/executed"), &sysfs_executed);
+    sysfs::set_dynamic_value(path("/sys"), path("/softirq/deferred"), &sysfs_deferred);
+}
+
+void softirq::init_cpu(size_t cpu){
+    start_thread(cpu);
+}
+
+bool softirq::register_handler(size_t& id, void (*handler)(void*), void* data){
+    if(registered == MAX_SOFTIRQS){
+        logging::logf(logging::log_level::ERROR, "softirq: No free softirq\n");
+        return false;
+    }
+
+    id = registered++;
+
+    handlers[id].fun = handler;
+    handlers[id].data = data;
+
+    return true;
+}
+
+void softirq::raise(size_t id){
+    auto cpu = smp::current_cpu();
+
+    // Processors without thread are still handled after their interrupts
+    __atomic_or_fetch(&cpus[cpu].pending, 1ULL << id, __ATOMIC_SEQ_CST);
+}
+
+void softirq::run(){
+    auto& cpu = cpus[smp::current_cpu()];
+
+    // A nested interrupt leaves the softirqs to the outer one
+    if(!cpu.pending || cpu.active || cpu.deferred){
+        return;
+    }
+
+    cpu.active = true;
+
+    auto start = timer::milliseconds();
+    size_t rounds = 0;
+
+    asm volatile("sti");
+
+    while(true){
+        execute(__atomic_exchange_n(&cpu.pending, 0, __ATOMIC_SEQ_CST));
+
+        if(!cpu.pending){
+            break;
+        }
+
+        // The softirqs keep being raised, the thread continues with the
+        // other processes
+        if(++rounds == max_rounds || timer::milliseconds() - start >= max_ms){
+            asm volatile("cli");
+
+            cpu.active = false;
+            defer(cpu);
+
+            return;
+        }
+    }
+
+    asm volatile("cli");
+
+    cpu.active = false;
+}
+
+bool softirq::active(){
+    return cpus[smp::current_cpu()].active;
+}
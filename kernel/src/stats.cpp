@@ -0,0 +1,109 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <algorithms.hpp>
+
+#include <tlib/errors.hpp>
+
+#include "stats.hpp"
+#include "physical_allocator.hpp"
+#include "virtual_allocator.hpp"
+#include "kalloc.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+
+#include "conc/int_lock.hpp"
+
+#include "net/network.hpp"
+
+namespace {
+
+void fill_interface(const network::interface_descriptor& interface, stats::interface_stats& s){
+    auto n = std::min(interface.name.size(), stats::STATS_INTERFACE_NAME - 1);
+
+    std::fill_n(s.name, stats::STATS_INTERFACE_NAME, '\0');
+    std::copy_n(interface.name.c_str(), n, s.name);
+
+    s.enabled       = interface.enabled;
+    s.rx_packets    = interface.rx_packets_counter.value();
+    s.rx_bytes      = interface.rx_bytes_counter.value();
+    s.tx_packets    = interface.tx_packets_counter.value();
+    s.tx_bytes      = interface.tx_bytes_counter.value();
+    s.rx_dropped    = interface.rx_dropped_counter;
+    s.tx_dropped    = interface.tx_dropped_counter;
+    s.rx_errors     = interface.rx_errors_counter;
+    s.rx_interrupts = interface.rx_interrupts_counter;
+    s.rx_polls      = interface.rx_polls_counter;
+}
+
+void fill(stats::stats_snapshot& s){
+    // No other work runs on this processor while the counters are read
+    direct_int_lock l;
+
+    s.version   = stats::STATS_SNAPSHOT_VERSION;
+    s.uptime_ms = timer::milliseconds();
+
+    s.physical_available = physical_allocator::available();
+    s.physical_allocated = physical_allocator::allocated();
+    s.physical_free      = s.physical_available - s.physical_allocated;
+
+    s.virtual_available = virtual_allocator::available();
+    s.virtual_allocated = virtual_allocator::allocated();
+    s.virtual_free      = s.virtual_available - s.virtual_allocated;
+
+    s.kalloc_allocated = kalloc::allocated_memory();
+    s.kalloc_used      = kalloc::used_memory();
+    s.kalloc_free      = kalloc::free_memory();
+
+    s.processes = 0;
+    std::fill_n(s.process_states, stats::STATS_PROCESS_STATES, 0);
+
+    for(size_t i = 0; i < scheduler::process_slots(); ++i){
+        auto state = static_cast<size_t>(scheduler::get_process_state(i));
+
+        if(state < stats::STATS_PROCESS_STATES){
+            ++s.process_states[state];
+        }
+
+        if(state != static_cast<size_t>(scheduler::process_state::EMPTY)){
+            ++s.processes;
+        }
+    }
+
+    s.interfaces = std::min(network::number_of_interfaces(), stats::STATS_MAX_INTERFACES);
+
+    for(size_t i = 0; i < s.interfaces; ++i){
+        fill_interface(network::interface(i), s.interface[i]);
+    }
+}
+
+} //end of anonymous namespace
+
+std::expected<size_t> stats::snapshot(char* buffer, size_t size){
+    if(size < 2 * sizeof(uint64_t)){
+        return std::make_unexpected<size_t>(std::ERROR_BUFFER_SMALL);
+    }
+
+    auto n = std::min(size, sizeof(stats_snapshot));
+
+    if(n == sizeof(stats_snapshot)){
+        auto& s = *reinterpret_cast<stats_snapshot*>(buffer);
+
+        fill(s);
+        s.size = n;
+    } else {
+        // An older layout only gets the beginning of the snapshot
+        stats_snapshot s;
+
+        fill(s);
+        s.size = n;
+
+        std::copy_n(reinterpret_cast<const char*>(&s), n, buffer);
+    }
+
+    return std::make_expected<size_t>(n);
+}
@@ -41,9 +41,12 @@ void input_thread(void* data) {
         // Wait for some input
         scheduler::block_process(pid);
 
+        stdio::irq_input input;
+        bool raw = false;
+
         // Handle keyboard input
-        while (!terminal.keyboard_buffer.empty()) {
-            auto key = terminal.keyboard_buffer.pop();
+        while (terminal.keyboard_buffer.pop(input)) {
+            char key = input.value;
 
             if (terminal.canonical) {
                 //Key released
@@ -95,6 +98,7 @@ void input_thread(void* data) {
                                 }
 
                                 terminal.input_queue.notify_one();
+                                terminal.input_source.notify();
                             }
                         }
                     }
@@ -102,30 +106,35 @@ void input_thread(void* data) {
             } else {
                 // The complete processing of the key will be done by the
                 // userspace program
+                // A reader too slow to drain the events loses the new ones
                 auto code = keyboard::raw_key_to_keycode(key);
-                terminal.raw_buffer.push(static_cast<size_t>(code));
-
-                terminal.input_queue.notify_one();
-
-                thor_assert(!terminal.raw_buffer.full(), "raw buffer is full!");
+                if (terminal.raw_buffer.push({input.time, code})) {
+                    raw = true;
+                }
             }
         }
 
         // Handle mouse input
-        while (!terminal.mouse_buffer.empty()) {
-            auto key = terminal.mouse_buffer.pop();
-
+        while (terminal.mouse_buffer.pop(input)) {
             if (!terminal.canonical && terminal.is_mouse()) {
-                terminal.raw_buffer.push(key);
-
-                terminal.input_queue.notify_one();
-
-                thor_assert(!terminal.raw_buffer.full(), "raw buffer is full!");
+                if (terminal.raw_buffer.push({input.time, static_cast<std::keycode>(input.value)})) {
+                    raw = true;
+                }
             }
         }
+
+        // The reader is woken once for the whole burst of events
+        if (raw) {
+            terminal.input_queue.notify_one();
+            terminal.input_source.notify();
+        }
     }
 }
 
+size_t terminal_events(const void* object) {
+    return static_cast<const stdio::virtual_terminal*>(object)->poll_events();
+}
+
 } //end of anonymous namespace
 
 void stdio::init_terminals() {
@@ -136,6 +145,8 @@ void stdio::init_terminals() {
         terminal.active    = false;
         terminal.canonical = true;
         terminal.mouse     = false;
+
+        terminal.input_source.init(&terminal_events, &terminal);
     }
 
     // Initialize the active terminal
@@ -0,0 +1,157 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <algorithms.hpp>
+
+#include "syscall_stats.hpp"
+#include "scheduler.hpp"
+#include "smp.hpp"
+#include "print.hpp"
+#include "logging.hpp"
+
+#include "conc/int_lock.hpp"
+
+#define unlikely(x)  __builtin_expect (!!(x), 0)
+
+namespace {
+
+constexpr const size_t max_codes = 0x1000; ///< The number of system call numbers
+
+/*!
+ * \brief The statistics of the system calls run on a processor
+ */
+struct cpu_stats {
+    std::array<uint64_t, syscall_stats::MAX_SYSCALLS> counts;                                 ///< The calls of each system call
+    std::array<std::array<uint64_t, syscall_stats::BUCKETS>, syscall_stats::MAX_SYSCALLS> latencies; ///< The latency histograms of each system call
+};
+
+std::array<uint8_t, max_codes> slots;                       ///< The slot of each system call, plus one, 0 if none
+std::array<uint16_t, syscall_stats::MAX_SYSCALLS> codes;    ///< The system call of each slot
+size_t registered = 0;                                      ///< The number of used slots
+
+std::array<cpu_stats*, smp::MAX_CPUS> cpus; ///< The statistics of each processor, allocated by its first system call
+
+size_t bucket(uint64_t cycles){
+    // The number of significant bits, the cycles are lower than 2^bits
+    size_t bits = cycles ? 64 - __builtin_clzll(cycles) : 0;
+
+    return std::min(bits, syscall_stats::BUCKETS - 1);
+}
+
+cpu_stats& current_stats(){
+    auto cpu = smp::current_cpu();
+
+    if(unlikely(!cpus[cpu])){
+        direct_int_lock lock;
+
+        if(!cpus[cpu]){
+            cpus[cpu] = new cpu_stats();
+        }
+    }
+
+    return *cpus[cpu];
+}
+
+void format_line(std::string& value, size_t slot, uint64_t count, const uint64_t* latencies){
+    value += sprintf("%h %u", size_t(codes[slot]), count);
+
+    for(size_t b = 0; b < syscall_stats::BUCKETS; ++b){
+        value += ' ';
+        value += std::to_string(latencies[b]);
+    }
+
+    value += '\n';
+}
+
+} //End of anonymous namespace
+
+void syscall_stats::register_syscall(size_t code){
+    if(code >= max_codes || slots[code]){
+        return;
+    }
+
+    if(registered == MAX_SYSCALLS){
+        logging::logf(logging::log_level::ERROR, "syscall_stats: No slot for the system call %h\n", code);
+        return;
+    }
+
+    codes[registered] = code;
+    slots[code] = ++registered;
+}
+
+void syscall_stats::record(size_t code, uint64_t cycles){
+    if(code >= max_codes || !slots[code]){
+        return;
+    }
+
+    auto slot = slots[code] - 1;
+    auto b = bucket(cycles);
+
+    auto& stats = current_stats();
+
+    ++stats.counts[slot];
+    ++stats.latencies[slot][b];
+
+    // Only the process itself updates its statistics
+    auto& process = scheduler::get_process(scheduler::get_pid());
+
+    if(unlikely(!process.syscalls)){
+        process.syscalls = new process_stats();
+    }
+
+    ++process.syscalls->counts[slot];
+    ++process.syscalls->latencies[slot][b];
+}
+
+std::string syscall_stats::format(){
+    std::string value;
+
+    for(size_t slot = 0; slot < registered; ++slot){
+        uint64_t count = 0;
+        std::array<uint64_t, BUCKETS> latencies = {};
+
+        for(auto* stats : cpus){
+            if(!stats){
+                continue;
+            }
+
+            count += stats->counts[slot];
+
+            for(size_t b = 0; b < BUCKETS; ++b){
+                latencies[b] += stats->latencies[slot][b];
+            }
+        }
+
+        if(count){
+            format_line(value, slot, count, latencies.data());
+        }
+    }
+
+    return value;
+}
+
+std::string syscall_stats::format(const process_stats* stats){
+    std::string value;
+
+    if(!stats){
+        return value;
+    }
+
+    for(size_t slot = 0; slot < registered; ++slot){
+        if(!stats->counts[slot]){
+            continue;
+        }
+
+        std::array<uint64_t, BUCKETS> latencies;
+        std::copy(stats->latencies[slot].begin(), stats->latencies[slot].end(), latencies.begin());
+
+        format_line(value, slot, stats->counts[slot], latencies.data());
+    }
+
+    return value;
+}
@@ -49,3 +49,68 @@ syscall_common_handler:
     add rsp, 16
 
     iretq // iret will clean the other automatically pushed stuff
+
+// Entry of the SYSCALL instruction, the return address is in rcx and
+// the flags in r11, so the second parameter is passed in r10.
+// An interrupt frame is built so that the system calls (and the
+// scheduler) can not tell the difference with an int 50
+
+.global _syscall_fast
+_syscall_fast:
+    // Interrupts are masked by FMASK, the user stack cannot be trusted,
+    // switch to the kernel stack of the process (rsp0 of the TSS)
+    swapgs
+    mov gs:[0], rsp
+    mov rsp, gs:[8]
+    mov rsp, [rsp+4]
+
+    push 0x2B               // User SS (USER_DATA_SELECTOR + 3)
+    push qword ptr gs:[0]   // User RSP
+    swapgs
+
+    push r11                // User RFLAGS
+    push 0x33               // User CS (SYSRET_CODE_SELECTOR + 3)
+    push rcx                // User RIP
+
+    // SYSCALL left the selector following the kernel code in SS, it
+    // would be reloaded by the iretq of a nested interrupt
+    push rax
+    xor eax, eax
+    mov ss, eax
+    pop rax
+
+    sti
+
+    push rax
+    push 0
+
+    save_context
+
+    // Move the parameter from r10 to the rcx slot of the context
+    mov [rsp + 256 + 16], r10
+
+    restore_kernel_segments
+
+    mov rdi, rsp
+    call _syscall_handler
+
+    restore_context
+
+    //Was pushed by the entry code
+    add rsp, 16
+
+    cli
+
+    // SYSRET faults in kernel mode on a non-canonical address
+    mov rcx, [rsp]
+    mov r11, rcx
+    shr r11, 47
+    jnz .fast_iret
+
+    mov r11, [rsp+16]
+    mov rsp, [rsp+24]
+
+    sysretq
+
+.fast_iret:
+    iretq
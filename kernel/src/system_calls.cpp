@@ -7,6 +7,8 @@
 
 #include <array.hpp>
 
+#include <tlib/errors.hpp>
+
 #include "system_calls.hpp"
 #include "print.hpp"
 #include "scheduler.hpp"
@@ -20,6 +22,17 @@
 #include "drivers/mouse.hpp"
 #include "vfs/vfs.hpp"
 #include "ioctl.hpp"
+#include "alloc_profile.hpp"
+#include "arena.hpp"
+#include "disks.hpp"
+#include "aio.hpp"
+#include "io_ring.hpp"
+#include "shm.hpp"
+#include "pipe.hpp"
+#include "futex.hpp"
+#include "poll.hpp"
+#include "syscall_stats.hpp"
+#include "stats.hpp"
 #include "net/network.hpp"
 #include "net/alpha.hpp"
 
@@ -68,25 +81,107 @@ void sc_set_mouse(interrupt::syscall_regs* regs){
     tty.set_mouse(regs->rbx);
 }
 
+void sc_read_input_events(interrupt::syscall_regs* regs){
+    auto events = reinterpret_cast<std::input_event*>(regs->rbx);
+    auto max    = regs->rcx;
+
+    auto ttyid = scheduler::get_process(scheduler::get_pid()).tty;
+    auto& tty = stdio::get_terminal(ttyid);
+
+    regs->rax = tty.read_input_events(events, max);
+}
+
+void sc_read_input_events_timeout(interrupt::syscall_regs* regs){
+    auto events = reinterpret_cast<std::input_event*>(regs->rbx);
+    auto max    = regs->rcx;
+    auto ms     = regs->rdx;
+
+    auto ttyid = scheduler::get_process(scheduler::get_pid()).tty;
+    auto& tty = stdio::get_terminal(ttyid);
+
+    regs->rax = tty.read_input_events(events, max, ms);
+}
+
+void sc_get_pid(interrupt::syscall_regs* regs){
+    regs->rax = scheduler::get_pid();
+}
+
 void sc_sleep_ms(interrupt::syscall_regs* regs){
     auto time = regs->rbx;
 
     scheduler::sleep_ms(time);
 }
 
+void sc_yield(interrupt::syscall_regs*){
+    scheduler::yield();
+}
+
 void sc_exec(interrupt::syscall_regs* regs){
     auto file = reinterpret_cast<char*>(regs->rbx);
 
     auto argc = regs->rcx;
     auto argv = reinterpret_cast<const char**>(regs->rdx);
+    auto flags = regs->rsi;
+    auto handles = reinterpret_cast<const size_t*>(regs->rdi);
 
-    std::vector<std::string> params;
+    scheduler::params_type params;
 
     for(size_t i = 0; i < argc; ++i){
         params.emplace_back(argv[i]);
     }
 
-    auto status = scheduler::exec(file, params);
+    auto status = scheduler::exec(file, params, flags, handles);
+    regs->rax = expected_to_i64(status);
+}
+
+void sc_brk_release(interrupt::syscall_regs* regs){
+    scheduler::brk_release(regs->rbx);
+
+    auto& process = scheduler::get_owner_process();
+    regs->rax = process.brk_end;
+}
+
+void sc_alloc_profile(interrupt::syscall_regs* regs){
+    auto address = regs->rbx;
+
+    auto& process = scheduler::get_owner_process();
+
+    // The profile must be in the image of the program, it is read by the kernel
+    if(address >= scheduler::program_base && address + sizeof(tlib::alloc_profile) <= scheduler::program_break){
+        process.alloc_profile = address;
+    }
+}
+
+void sc_futex_wait(interrupt::syscall_regs* regs){
+    auto address = reinterpret_cast<const volatile uint32_t*>(regs->rbx);
+    auto value   = regs->rcx;
+    auto ms      = regs->rdx;
+
+    regs->rax = expected_to_i64(futex::wait(address, value, ms));
+}
+
+void sc_futex_wake(interrupt::syscall_regs* regs){
+    auto address = reinterpret_cast<const volatile uint32_t*>(regs->rbx);
+    auto n       = regs->rcx;
+
+    regs->rax = expected_to_i64(futex::wake(address, n));
+}
+
+void sc_create_thread(interrupt::syscall_regs* regs){
+    auto entry = regs->rbx;
+    auto stack = regs->rcx;
+    auto data  = regs->rdx;
+    auto tls   = regs->rsi;
+
+    regs->rax = expected_to_i64(scheduler::create_thread(entry, stack, data, tls));
+}
+
+void sc_set_tls(interrupt::syscall_regs* regs){
+    scheduler::set_tls(regs->rbx);
+}
+
+void sc_fork(interrupt::syscall_regs* regs){
+    auto status = scheduler::fork(*regs);
     regs->rax = expected_to_i64(status);
 }
 
@@ -97,13 +192,13 @@ void sc_await_termination(interrupt::syscall_regs* regs){
 }
 
 void sc_brk_start(interrupt::syscall_regs* regs){
-    auto& process = scheduler::get_process(scheduler::get_pid());
+    auto& process = scheduler::get_owner_process();
 
     regs->rax = process.brk_start;
 }
 
 void sc_brk_end(interrupt::syscall_regs* regs){
-    auto& process = scheduler::get_process(scheduler::get_pid());
+    auto& process = scheduler::get_owner_process();
 
     regs->rax = process.brk_end;
 }
@@ -111,7 +206,7 @@ void sc_brk_end(interrupt::syscall_regs* regs){
 void sc_sbrk(interrupt::syscall_regs* regs){
     scheduler::sbrk(regs->rbx);
 
-    auto& process = scheduler::get_process(scheduler::get_pid());
+    auto& process = scheduler::get_owner_process();
     regs->rax = process.brk_end;
 }
 
@@ -137,6 +232,8 @@ void sc_clear_screen(interrupt::syscall_regs*){
 }
 
 void sc_reboot(interrupt::syscall_regs*){
+    disks::sync();
+
     if(!acpi::initialized() || !acpi::reboot()){
         logging::logf(logging::log_level::ERROR, "ACPI reset not possible, fallback to 8042 reboot\n");
         asm volatile("mov al, 0x64; or al, 0xFE; out 0x64, al; mov al, 0xFE; out 0x64, al; " : : );
@@ -146,6 +243,8 @@ void sc_reboot(interrupt::syscall_regs*){
 }
 
 void sc_shutdown(interrupt::syscall_regs*){
+    disks::sync();
+
     if(!acpi::initialized()){
         logging::logf(logging::log_level::ERROR, "ACPI not initialized, impossible to shutdown\n");
         return;
@@ -154,6 +253,14 @@ void sc_shutdown(interrupt::syscall_regs*){
     acpi::shutdown();
 }
 
+void sc_stats_snapshot(interrupt::syscall_regs* regs){
+    auto buffer = reinterpret_cast<char*>(regs->rbx);
+    auto size   = regs->rcx;
+
+    auto status = stats::snapshot(buffer, size);
+    regs->rax = expected_to_i64(status);
+}
+
 void sc_open(interrupt::syscall_regs* regs){
     auto file = reinterpret_cast<char*>(regs->rbx);
     auto flags = regs->rcx;
@@ -162,6 +269,12 @@ void sc_open(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(status);
 }
 
+void sc_pipe(interrupt::syscall_regs* regs){
+    auto fds = reinterpret_cast<size_t*>(regs->rbx);
+
+    regs->rax = expected_to_i64(pipe::create(fds[0], fds[1]));
+}
+
 void sc_close(interrupt::syscall_regs* regs){
     auto fd = regs->rbx;
 
@@ -205,6 +318,16 @@ void sc_read_timeout(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(status);
 }
 
+void sc_mmap(interrupt::syscall_regs* regs){
+    auto fd     = regs->rbx;
+    auto offset = regs->rcx;
+    auto length = regs->rdx;
+    auto prot   = regs->rsi;
+
+    auto status = scheduler::mmap(fd, offset, length, prot);
+    regs->rax = expected_to_i64(status);
+}
+
 void sc_write(interrupt::syscall_regs* regs){
     auto fd = regs->rbx;
     auto buffer = reinterpret_cast<char*>(regs->rcx);
@@ -215,6 +338,90 @@ void sc_write(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(status);
 }
 
+void sc_readv(interrupt::syscall_regs* regs){
+    auto fd      = regs->rbx;
+    auto vectors = reinterpret_cast<const vfs::iovec*>(regs->rcx);
+    auto n       = regs->rdx;
+    auto offset  = regs->rsi;
+
+    auto status = vfs::readv(fd, vectors, n, offset);
+    regs->rax = expected_to_i64(status);
+}
+
+void sc_writev(interrupt::syscall_regs* regs){
+    auto fd      = regs->rbx;
+    auto vectors = reinterpret_cast<const vfs::iovec*>(regs->rcx);
+    auto n       = regs->rdx;
+    auto offset  = regs->rsi;
+
+    auto status = vfs::writev(fd, vectors, n, offset);
+    regs->rax = expected_to_i64(status);
+}
+
+void sc_aio_read(interrupt::syscall_regs* regs){
+    auto fd     = regs->rbx;
+    auto buffer = reinterpret_cast<char*>(regs->rcx);
+    auto max    = regs->rdx;
+    auto offset = regs->rsi;
+
+    auto status = aio::read(fd, buffer, max, offset);
+    regs->rax = expected_to_i64(status);
+}
+
+void sc_aio_write(interrupt::syscall_regs* regs){
+    auto fd     = regs->rbx;
+    auto buffer = reinterpret_cast<char*>(regs->rcx);
+    auto max    = regs->rdx;
+    auto offset = regs->rsi;
+
+    auto status = aio::write(fd, buffer, max, offset);
+    regs->rax = expected_to_i64(status);
+}
+
+void sc_aio_wait(interrupt::syscall_regs* regs){
+    auto result = reinterpret_cast<int64_t*>(regs->rbx);
+    auto ms     = regs->rcx;
+
+    auto status = aio::wait(*result, ms);
+    regs->rax = expected_to_i64(status);
+}
+
+void sc_io_ring_setup(interrupt::syscall_regs* regs){
+    regs->rax = expected_to_i64(io_ring::setup());
+}
+
+void sc_io_ring_enter(interrupt::syscall_regs* regs){
+    auto n    = regs->rbx;
+    auto wait = regs->rcx;
+    auto ms   = regs->rdx;
+
+    regs->rax = expected_to_i64(io_ring::enter(n, wait, ms));
+}
+
+void sc_shm_create(interrupt::syscall_regs* regs){
+    auto name = reinterpret_cast<const char*>(regs->rbx);
+    auto size = regs->rcx;
+
+    regs->rax = expected_to_i64(shm::create(name, size));
+}
+
+void sc_shm_map(interrupt::syscall_regs* regs){
+    auto name = reinterpret_cast<const char*>(regs->rbx);
+    auto size = reinterpret_cast<size_t*>(regs->rcx);
+
+    regs->rax = expected_to_i64(shm::map(name, *size));
+}
+
+void sc_shm_unmap(interrupt::syscall_regs* regs){
+    regs->rax = expected_to_i64(shm::unmap(regs->rbx));
+}
+
+void sc_shm_remove(interrupt::syscall_regs* regs){
+    auto name = reinterpret_cast<const char*>(regs->rbx);
+
+    regs->rax = expected_to_i64(shm::remove(name));
+}
+
 void sc_clear(interrupt::syscall_regs* regs){
     auto fd = regs->rbx;
     auto max = regs->rcx;
@@ -232,6 +439,14 @@ void sc_truncate(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(status);
 }
 
+void sc_sync(interrupt::syscall_regs* regs){
+    if(disks::sync()){
+        regs->rax = 0;
+    } else {
+        regs->rax = -std::ERROR_FAILED;
+    }
+}
+
 void sc_entries(interrupt::syscall_regs* regs){
     auto fd = regs->rbx;
     auto buffer = reinterpret_cast<char*>(regs->rcx);
@@ -241,6 +456,15 @@ void sc_entries(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(status);
 }
 
+void sc_entries_stat(interrupt::syscall_regs* regs){
+    auto fd = regs->rbx;
+    auto buffer = reinterpret_cast<char*>(regs->rcx);
+    auto max = regs->rdx;
+
+    auto status = vfs::entries_stat(fd, buffer, max);
+    regs->rax = expected_to_i64(status);
+}
+
 void sc_mounts(interrupt::syscall_regs* regs){
     auto buffer = reinterpret_cast<char*>(regs->rbx);
     auto max = regs->rcx;
@@ -339,6 +563,14 @@ void sc_vesa_redraw(interrupt::syscall_regs* regs){
     vesa::redraw(new_buffer);
 }
 
+void sc_vesa_map(interrupt::syscall_regs* regs){
+    regs->rax = expected_to_i64(vesa::map_buffer());
+}
+
+void sc_vesa_present(interrupt::syscall_regs* regs){
+    regs->rax = expected_to_i64(vesa::present(regs->rbx, regs->rcx, regs->rdx, regs->rsi));
+}
+
 void sc_mouse_x(interrupt::syscall_regs* regs){
     regs->rax = mouse::x();
 }
@@ -393,6 +625,26 @@ void sc_prepare_packet(interrupt::syscall_regs* regs){
     regs->rbx = index;
 }
 
+void sc_prepare_mapped_packet(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto desc = reinterpret_cast<void*>(regs->rcx);
+
+    int64_t fd;
+    size_t index;
+    size_t payload;
+    std::tie(fd, index, payload) = network::prepare_mapped_packet(socket_fd, desc);
+
+    regs->rax = fd;
+    regs->rbx = index;
+    regs->rdx = payload;
+}
+
+void sc_map_packet_buffers(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+
+    regs->rax = expected_to_i64(network::map_packet_buffers(socket_fd));
+}
+
 void sc_finalize_packet(interrupt::syscall_regs* regs){
     auto socket_fd = regs->rbx;
     auto packet_fd = regs->rcx;
@@ -410,6 +662,23 @@ void sc_send(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(network::send(socket_fd, buffer, n, target_buffer));
 }
 
+void sc_sendv(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto vectors   = reinterpret_cast<const vfs::iovec*>(regs->rcx);
+    auto n         = regs->rdx;
+
+    regs->rax = expected_to_i64(network::sendv(socket_fd, vectors, n));
+}
+
+void sc_sendfile(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto file_fd   = regs->rcx;
+    auto offset    = regs->rdx;
+    auto count     = regs->rsi;
+
+    regs->rax = expected_to_i64(network::sendfile(socket_fd, file_fd, offset, count));
+}
+
 void sc_send_to(interrupt::syscall_regs* regs){
     auto socket_fd     = regs->rbx;
     auto buffer        = reinterpret_cast<char*>(regs->rcx);
@@ -456,6 +725,67 @@ void sc_receive_from_timeout(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(network::receive_from(socket_fd, buffer, n, ms, address));
 }
 
+void sc_send_to_batch(interrupt::syscall_regs* regs){
+    auto socket_fd     = regs->rbx;
+    auto messages      = reinterpret_cast<network::message*>(regs->rcx);
+    auto n             = regs->rdx;
+    auto target_buffer = reinterpret_cast<char*>(regs->rsi);
+
+    regs->rax = expected_to_i64(network::send_to_batch(socket_fd, messages, n, target_buffer));
+}
+
+void sc_receive_from_batch(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto messages  = reinterpret_cast<network::message*>(regs->rcx);
+    auto n         = regs->rdx;
+
+    regs->rax = expected_to_i64(network::receive_from_batch(socket_fd, messages, n));
+}
+
+void sc_receive_from_batch_timeout(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto messages  = reinterpret_cast<network::message*>(regs->rcx);
+    auto n         = regs->rdx;
+    auto ms        = regs->rsi;
+
+    regs->rax = expected_to_i64(network::receive_from_batch(socket_fd, messages, n, ms));
+}
+
+void sc_poll_create(interrupt::syscall_regs* regs){
+    regs->rax = expected_to_i64(poll::create());
+}
+
+void sc_poll_close(interrupt::syscall_regs* regs){
+    auto fd = regs->rbx;
+
+    regs->rax = expected_to_i64(poll::close(fd));
+}
+
+void sc_poll_control(interrupt::syscall_regs* regs){
+    auto fd        = regs->rbx;
+    auto operation = static_cast<poll::poll_operation>(regs->rcx);
+    auto event     = reinterpret_cast<const poll::poll_event*>(regs->rdx);
+
+    regs->rax = expected_to_i64(poll::control(fd, operation, event));
+}
+
+void sc_poll_wait(interrupt::syscall_regs* regs){
+    auto fd     = regs->rbx;
+    auto events = reinterpret_cast<poll::poll_event*>(regs->rcx);
+    auto n      = regs->rdx;
+
+    regs->rax = expected_to_i64(poll::wait(fd, events, n));
+}
+
+void sc_poll_wait_timeout(interrupt::syscall_regs* regs){
+    auto fd     = regs->rbx;
+    auto events = reinterpret_cast<poll::poll_event*>(regs->rcx);
+    auto n      = regs->rdx;
+    auto ms     = regs->rsi;
+
+    regs->rax = expected_to_i64(poll::wait(fd, events, n, ms));
+}
+
 void sc_listen(interrupt::syscall_regs* regs){
     auto socket_fd = regs->rbx;
     auto listen = bool(regs->rcx);
@@ -464,6 +794,28 @@ void sc_listen(interrupt::syscall_regs* regs){
     regs->rax = expected_to_i64(status);
 }
 
+void sc_set_non_blocking(interrupt::syscall_regs* regs){
+    auto socket_fd    = regs->rbx;
+    auto non_blocking = bool(regs->rcx);
+
+    regs->rax = expected_to_i64(network::set_non_blocking(socket_fd, non_blocking));
+}
+
+void sc_set_buffer_size(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto buffer    = static_cast<network::socket_buffer>(regs->rcx);
+    auto size      = regs->rdx;
+
+    regs->rax = expected_to_i64(network::set_buffer_size(socket_fd, buffer, size));
+}
+
+void sc_get_buffer_size(interrupt::syscall_regs* regs){
+    auto socket_fd = regs->rbx;
+    auto buffer    = static_cast<network::socket_buffer>(regs->rcx);
+
+    regs->rax = expected_to_i64(network::get_buffer_size(socket_fd, buffer));
+}
+
 void sc_client_bind(interrupt::syscall_regs* regs){
     auto socket_fd = regs->rbx;
     auto server_ip = regs->rcx;
@@ -518,8 +870,9 @@ void sc_server_start(interrupt::syscall_regs* regs) {
     auto socket_fd = regs->rbx;
     auto ip        = regs->rcx;
     auto port      = regs->rdx;
+    auto backlog   = regs->rsi;
 
-    auto status = network::server_start(socket_fd, ip, port);
+    auto status = network::server_start(socket_fd, ip, port, backlog);
     regs->rax   = expected_to_i64(status);
 }
 
@@ -542,6 +895,24 @@ void sc_dns_server(interrupt::syscall_regs* regs){
     regs->rax = network::dns_server().raw_address;
 }
 
+void sc_dns_resolve(interrupt::syscall_regs* regs){
+    auto domain = reinterpret_cast<const char*>(regs->rbx);
+    auto timeout = regs->rcx;
+    auto retries = regs->rdx;
+
+    auto status = network::resolve(domain, timeout, retries);
+
+    if(status){
+        regs->rax = status->raw_address;
+    } else {
+        regs->rax = -status.error();
+    }
+}
+
+void sc_dns_flush(interrupt::syscall_regs* /*regs*/){
+    network::flush_dns_cache();
+}
+
 void sc_disconnect(interrupt::syscall_regs* regs){
     auto socket_fd = regs->rbx;
 
@@ -580,8 +951,16 @@ void sc_kill(interrupt::syscall_regs* /*regs*/){
 void system_call_entry(interrupt::syscall_regs* regs){
     auto code = regs->rax;
 
-    if(likely(system_calls[code])){
+    if(likely(code < system_calls.size() && system_calls[code])){
+        auto start = syscall_stats::cycles();
+
         system_calls[code](regs);
+
+        syscall_stats::record(code, syscall_stats::cycles() - start);
+
+        // The temporaries of the system call are all gone
+        arena::reset();
+
         return;
     }
 
@@ -601,19 +980,31 @@ void install_system_calls(){
     std::fill(system_calls.begin(), system_calls.end(), nullptr);
 
     system_calls[0x2] = sc_log_string;
+    system_calls[0x3] = sc_get_pid;
     system_calls[0x4] = sc_sleep_ms;
     system_calls[0x5] = sc_exec;
     system_calls[0x6] = sc_await_termination;
     system_calls[0x7] = sc_brk_start;
     system_calls[0x8] = sc_brk_end;
     system_calls[0x9] = sc_sbrk;
+    system_calls[0xA] = sc_fork;
+    system_calls[0xB] = sc_brk_release;
+    system_calls[0xC] = sc_alloc_profile;
+    system_calls[0xD] = sc_futex_wait;
+    system_calls[0xE] = sc_futex_wake;
+    system_calls[0xF] = sc_create_thread;
+    system_calls[0x10] = sc_set_tls;
+    system_calls[0x11] = sc_yield;
     system_calls[0x20] = sc_set_canonical;
     system_calls[0x21] = sc_set_mouse;
     system_calls[0x22] = sc_clear_screen;
     system_calls[0x23] = sc_get_columns;
     system_calls[0x24] = sc_get_rows;
+    system_calls[0x25] = sc_read_input_events;
+    system_calls[0x26] = sc_read_input_events_timeout;
     system_calls[0x50] = sc_reboot;
     system_calls[0x51] = sc_shutdown;
+    system_calls[0x52] = sc_stats_snapshot;
     system_calls[0x300] = sc_open;
     system_calls[0x301] = sc_stat;
     system_calls[0x302] = sc_close;
@@ -630,6 +1021,21 @@ void install_system_calls(){
     system_calls[0x313] = sc_clear;
     system_calls[0x314] = sc_mount;
     system_calls[0x315] = sc_read_timeout;
+    system_calls[0x316] = sc_mmap;
+    system_calls[0x317] = sc_sync;
+    system_calls[0x318] = sc_aio_read;
+    system_calls[0x319] = sc_aio_write;
+    system_calls[0x320] = sc_aio_wait;
+    system_calls[0x321] = sc_readv;
+    system_calls[0x322] = sc_writev;
+    system_calls[0x323] = sc_io_ring_setup;
+    system_calls[0x324] = sc_io_ring_enter;
+    system_calls[0x325] = sc_shm_create;
+    system_calls[0x326] = sc_shm_map;
+    system_calls[0x327] = sc_shm_unmap;
+    system_calls[0x328] = sc_shm_remove;
+    system_calls[0x329] = sc_pipe;
+    system_calls[0x330] = sc_entries_stat;
     system_calls[0x400] = sc_datetime;
     system_calls[0x401] = sc_time_seconds;
     system_calls[0x402] = sc_time_milliseconds;
@@ -643,6 +1049,8 @@ void install_system_calls(){
     system_calls[0xC06] = sc_vesa_green_shift;
     system_calls[0xC07] = sc_vesa_blue_shift;
     system_calls[0xC08] = sc_vesa_redraw;
+    system_calls[0xC09] = sc_vesa_map;
+    system_calls[0xC0A] = sc_vesa_present;
     system_calls[0xCA0] = sc_mouse_x;
     system_calls[0xCA1] = sc_mouse_y;
     system_calls[0xA00] = sc_ioctl;
@@ -671,5 +1079,28 @@ void install_system_calls(){
     system_calls[0xB15] = sc_dns_server;
     system_calls[0xB16] = sc_accept;
     system_calls[0xB17] = sc_accept_timeout;
+    system_calls[0xB18] = sc_sendfile;
+    system_calls[0xB19] = sc_sendv;
+    system_calls[0xB1A] = sc_send_to_batch;
+    system_calls[0xB1B] = sc_receive_from_batch;
+    system_calls[0xB1C] = sc_receive_from_batch_timeout;
+    system_calls[0xB1D] = sc_set_non_blocking;
+    system_calls[0xB1E] = sc_dns_resolve;
+    system_calls[0xB1F] = sc_dns_flush;
+    system_calls[0xB20] = sc_set_buffer_size;
+    system_calls[0xB21] = sc_get_buffer_size;
+    system_calls[0xB22] = sc_map_packet_buffers;
+    system_calls[0xB23] = sc_prepare_mapped_packet;
+    system_calls[0xD00] = sc_poll_create;
+    system_calls[0xD01] = sc_poll_close;
+    system_calls[0xD02] = sc_poll_control;
+    system_calls[0xD03] = sc_poll_wait;
+    system_calls[0xD04] = sc_poll_wait_timeout;
     system_calls[0x66] = sc_alpha;
+
+    for(size_t code = 0; code < system_calls.size(); ++code){
+        if(system_calls[code]){
+            syscall_stats::register_syscall(code);
+        }
+    }
 }
@@ -54,8 +54,10 @@ task_switch:
 // Fake error code
     push 0
 
-// Push the current context on the stack
-    save_context
+// Push the current context on the stack. The SSE registers are
+// caller-saved and the ones of the interrupted code are already in
+// the interrupt frame, they do not need to be saved again
+    save_context_light
 
 // Save the new context pointer
     push rdi
@@ -83,7 +85,28 @@ task_switch:
     pop rdi
     mov rsp, [rax]
 
-    restore_context
+// The stack of the previous task is not used anymore
+    call task_switched
+
+// Do not leak the SSE registers of the previous task
+    pxor xmm0, xmm0
+    pxor xmm1, xmm1
+    pxor xmm2, xmm2
+    pxor xmm3, xmm3
+    pxor xmm4, xmm4
+    pxor xmm5, xmm5
+    pxor xmm6, xmm6
+    pxor xmm7, xmm7
+    pxor xmm8, xmm8
+    pxor xmm9, xmm9
+    pxor xmm10, xmm10
+    pxor xmm11, xmm11
+    pxor xmm12, xmm12
+    pxor xmm13, xmm13
+    pxor xmm14, xmm14
+    pxor xmm15, xmm15
+
+    restore_context_light
 
     //Was pushed by the base handler code
     add rsp, 8
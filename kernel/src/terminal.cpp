@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <array.hpp>
+#include <lock_guard.hpp>
 
 #include "drivers/keyboard.hpp"
 
@@ -14,21 +15,29 @@
 #include "assert.hpp"
 #include "logging.hpp"
 #include "scheduler.hpp"
+#include "timer.hpp"
 
 #include "print.hpp"
 
 void stdio::virtual_terminal::print(char key) {
+    std::lock_guard<int_spinlock> l(output_lock);
+
     cons.print(key);
 }
 
+void stdio::virtual_terminal::print(const char* s, size_t n) {
+    std::lock_guard<int_spinlock> l(output_lock);
+
+    cons.print(s, n);
+}
+
 void stdio::virtual_terminal::send_input(char key) {
     if (!input_thread_pid) {
         return;
     }
 
-    // Simply give the input to the input thread
-    keyboard_buffer.push(key);
-    thor_assert(!keyboard_buffer.full(), "keyboard buffer is full!");
+    // Simply give the input to the input thread, a full buffer drops it
+    keyboard_buffer.push({size_t(uint8_t(key)), timer::milliseconds()});
 
     // Need hint here because it is coming from an IRQ
     scheduler::unblock_process_hint(input_thread_pid);
@@ -39,9 +48,8 @@ void stdio::virtual_terminal::send_mouse_input(std::keycode key) {
         return;
     }
 
-    // Simply give the input to the input thread
-    mouse_buffer.push(size_t(key));
-    thor_assert(!mouse_buffer.full(), "mouse buffer is full!");
+    // Simply give the input to the input thread, a full buffer drops it
+    mouse_buffer.push({size_t(key), timer::milliseconds()});
 
     // Need hint here because it is coming from an IRQ
     scheduler::unblock_process_hint(input_thread_pid);
@@ -91,33 +99,67 @@ size_t stdio::virtual_terminal::read_input_can(char* buffer, size_t max, size_t
 }
 
 size_t stdio::virtual_terminal::read_input_raw() {
-    if (raw_buffer.empty()) {
+    std::input_event event;
+
+    read_input_events(&event, 1);
+
+    return static_cast<size_t>(event.code);
+}
+
+size_t stdio::virtual_terminal::read_input_raw(size_t ms) {
+    std::input_event event;
+
+    if (!read_input_events(&event, 1, ms)) {
+        return static_cast<size_t>(std::keycode::TIMEOUT);
+    }
+
+    return static_cast<size_t>(event.code);
+}
+
+size_t stdio::virtual_terminal::read_input_events(std::input_event* events, size_t max) {
+    if (!max) {
+        return 0;
+    }
+
+    while (raw_buffer.empty()) {
         input_queue.wait();
     }
 
-    return raw_buffer.pop();
+    size_t read = 0;
+
+    while (read < max && raw_buffer.pop(events[read])) {
+        ++read;
+    }
+
+    return read;
 }
 
-size_t stdio::virtual_terminal::read_input_raw(size_t ms) {
-    if (raw_buffer.empty()) {
-        if (!ms) {
-            return static_cast<size_t>(std::keycode::TIMEOUT);
-        }
+size_t stdio::virtual_terminal::read_input_events(std::input_event* events, size_t max, size_t ms) {
+    if (!max) {
+        return 0;
+    }
 
-        if (!input_queue.wait_for(ms)) {
-            return static_cast<size_t>(std::keycode::TIMEOUT);
+    if (raw_buffer.empty()) {
+        if (!ms || !input_queue.wait_for(ms)) {
+            return 0;
         }
     }
 
-    thor_assert(!raw_buffer.empty(), "There is a problem with the sleep queue");
+    size_t read = 0;
 
-    return raw_buffer.pop();
+    while (read < max && raw_buffer.pop(events[read])) {
+        ++read;
+    }
+
+    return read;
 }
 
 void stdio::virtual_terminal::set_canonical(bool can) {
     logging::logf(logging::log_level::TRACE, "Switched terminal %u canonical mode from %u to %u\n", id, uint64_t(canonical), uint64_t(can));
 
     canonical = can;
+
+    input_source.notify();
 }
 
 void stdio::virtual_terminal::set_mouse(bool m) {
@@ -141,6 +183,9 @@ void stdio::virtual_terminal::set_active(bool active) {
 
     this->active = active;
 
+    // A write cannot be split between the screen and the saved state
+    std::lock_guard<int_spinlock> l(output_lock);
+
     cons.set_active(active);
 
     if (active) {
@@ -150,6 +195,16 @@ void stdio::virtual_terminal::set_active(bool active) {
     }
 }
 
+size_t stdio::virtual_terminal::poll_events() const {
+    size_t events = poll::POLL_OUT;
+
+    if (canonical ? !canonical_buffer.empty() : !raw_buffer.empty()) {
+        events |= poll::POLL_IN;
+    }
+
+    return events;
+}
+
 stdio::console& stdio::virtual_terminal::get_console() {
     return cons;
 }
@@ -12,7 +12,7 @@
 #include "print.hpp"
 
 void* operator new(uint64_t size){
-    return kalloc::k_malloc(size);
+    return kalloc::k_malloc(size, __builtin_return_address(0));
 }
 
 void operator delete(void* p){
@@ -20,7 +20,7 @@ void operator delete(void* p){
 }
 
 void* operator new[](uint64_t size){
-    return kalloc::k_malloc(size);
+    return kalloc::k_malloc(size, __builtin_return_address(0));
 }
 
 void operator delete[](void* p){
@@ -12,6 +12,7 @@
 #include "conc/mutex.hpp"
 #include "conc/semaphore.hpp"
 #include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
 
 #include "acpica.hpp"
 
@@ -26,6 +27,70 @@
 #include "drivers/pci.hpp"
 #include "logging.hpp"
 
+/*!
+ * \brief A cache of ACPICA objects of the same size.
+ *
+ * The released objects are kept on a free list, linked through their first
+ * word, up to the maximum depth asked by ACPICA.
+ */
+struct thor_acpi_cache {
+    const char* name;   ///< The name of the cache, for the statistics
+    size_t object_size; ///< The size of the objects
+    size_t max_depth;   ///< The maximum number of free objects kept
+    size_t depth;       ///< The current number of free objects
+    void* free_list;    ///< The free objects
+    size_t requests;    ///< The number of acquired objects
+    size_t hits;        ///< The number of objects taken from the free list
+    int_spinlock lock;  ///< Protect the free list
+};
+
+namespace {
+
+constexpr const size_t MAPPINGS = 32; ///< The maximum number of kept mappings
+
+// A mapping of physical memory kept after its unmap, the tables and the
+// register blocks are mapped again and again by ACPICA
+struct mapping {
+    size_t phys;     // The first physical page, 0 if the slot is free
+    size_t virt;     // The first virtual page
+    size_t pages;    // The number of pages
+    size_t users;    // The number of unreleased maps
+    size_t last_use; // The tick of the last map, for the eviction
+};
+
+mapping mappings[MAPPINGS];
+size_t mapping_tick = 0;
+int_spinlock mappings_lock;
+
+// Returns the mapping covering the given physical range, nullptr if none
+mapping* find_mapping(size_t phys, size_t length){
+    for(auto& m : mappings){
+        if(m.phys && phys >= m.phys && phys + length <= m.phys + m.pages * paging::PAGE_SIZE){
+            return &m;
+        }
+    }
+
+    return nullptr;
+}
+
+// Returns the mapping containing the given virtual address, nullptr if none
+mapping* find_virtual(size_t virt){
+    for(auto& m : mappings){
+        if(m.phys && virt >= m.virt && virt < m.virt + m.pages * paging::PAGE_SIZE){
+            return &m;
+        }
+    }
+
+    return nullptr;
+}
+
+void unmap_range(size_t virt, size_t pages){
+    paging::unmap_pages(virt, pages);
+    virtual_allocator::free(virt, pages);
+}
+
+} //end of anonymous namespace
+
 extern "C" {
 
 // Initialization
@@ -94,6 +159,139 @@ void AcpiOsFree(void* p){
     kalloc::k_free(p);
 }
 
+// Object caches
+
+/*!
+ * \brief Create a cache of objects of the same size
+ */
+ACPI_STATUS AcpiOsCreateCache(char* name, UINT16 object_size, UINT16 max_depth, ACPI_CACHE_T** return_cache){
+    if(!name || !return_cache || object_size < 16){
+        return AE_BAD_PARAMETER;
+    }
+
+    auto* cache = new thor_acpi_cache();
+
+    cache->name        = name;
+    cache->object_size = object_size;
+    cache->max_depth   = max_depth;
+    cache->depth       = 0;
+    cache->free_list   = nullptr;
+    cache->requests    = 0;
+    cache->hits        = 0;
+
+    *return_cache = cache;
+
+    return AE_OK;
+}
+
+/*!
+ * \brief Release all the free objects of a cache
+ */
+ACPI_STATUS AcpiOsPurgeCache(ACPI_CACHE_T* cache){
+    if(!cache){
+        return AE_BAD_PARAMETER;
+    }
+
+    void* objects;
+
+    {
+        std::lock_guard<int_spinlock> l(cache->lock);
+
+        objects = cache->free_list;
+
+        cache->free_list = nullptr;
+        cache->depth = 0;
+    }
+
+    while(objects){
+        auto* next = *static_cast<void**>(objects);
+        kalloc::k_free(objects);
+        objects = next;
+    }
+
+    return AE_OK;
+}
+
+/*!
+ * \brief Delete a cache and its free objects
+ */
+ACPI_STATUS AcpiOsDeleteCache(ACPI_CACHE_T* cache){
+    if(!cache){
+        return AE_BAD_PARAMETER;
+    }
+
+    logging::logf(logging::log_level::DEBUG, "acpica: cache %s: %u requests, %u hits\n", cache->name, cache->requests, cache->hits);
+
+    AcpiOsPurgeCache(cache);
+
+    delete cache;
+
+    return AE_OK;
+}
+
+/*!
+ * \brief Returns a zeroed object from a cache
+ */
+void* AcpiOsAcquireObject(ACPI_CACHE_T* cache){
+    if(!cache){
+        return nullptr;
+    }
+
+    void* object = nullptr;
+
+    {
+        std::lock_guard<int_spinlock> l(cache->lock);
+
+        ++cache->requests;
+
+        if(cache->free_list){
+            object = cache->free_list;
+
+            cache->free_list = *static_cast<void**>(object);
+            --cache->depth;
+            ++cache->hits;
+        }
+    }
+
+    if(!object){
+        object = kalloc::k_malloc(cache->object_size);
+
+        if(!object){
+            return nullptr;
+        }
+    }
+
+    std::fill_n(static_cast<char*>(object), cache->object_size, 0);
+
+    return object;
+}
+
+/*!
+ * \brief Give back an object to its cache
+ */
+ACPI_STATUS AcpiOsReleaseObject(ACPI_CACHE_T* cache, void* object){
+    if(!cache || !object){
+        return AE_BAD_PARAMETER;
+    }
+
+    {
+        std::lock_guard<int_spinlock> l(cache->lock);
+
+        if(cache->depth < cache->max_depth){
+            *static_cast<void**>(object) = cache->free_list;
+
+            cache->free_list = object;
+            ++cache->depth;
+
+            return AE_OK;
+        }
+    }
+
+    kalloc::k_free(object);
+
+    return AE_OK;
+}
+
 // terminal
 
 /*!
@@ -233,7 +431,11 @@ ACPI_PHYSICAL_ADDRESS AcpiOsGetRootPointer(){
 // Paging
 
 /*!
- * \brief Map physical memory to a virtual address
+ * \brief Map physical memory to a virtual address.
+ *
+ * The mappings are kept once unmapped, the next maps of the same range
+ * reuse them. The least recently used unused mapping is evicted when all
+ * the slots are taken.
  */
 void* AcpiOsMapMemory(ACPI_PHYSICAL_ADDRESS phys, ACPI_SIZE length){
     auto offset = phys % paging::PAGE_SIZE;
@@ -241,6 +443,19 @@ void* AcpiOsMapMemory(ACPI_PHYSICAL_ADDRESS phys, ACPI_SIZE length){
     auto real_length = offset + length;
     auto pages = paging::pages(real_length);
 
+    auto phys_aligned = phys - offset;
+
+    {
+        std::lock_guard<int_spinlock> l(mappings_lock);
+
+        if(auto* m = find_mapping(phys, length)){
+            ++m->users;
+            m->last_use = ++mapping_tick;
+
+            return reinterpret_cast<void*>(m->virt + (phys - m->phys));
+        }
+    }
+
     auto virt_aligned = virtual_allocator::allocate(pages);
 
     if(!virt_aligned){
@@ -248,13 +463,46 @@ void* AcpiOsMapMemory(ACPI_PHYSICAL_ADDRESS phys, ACPI_SIZE length){
         return nullptr;
     }
 
-    auto phys_aligned = phys - offset;
-
     if(!paging::map_pages(virt_aligned, phys_aligned, pages)){
         logging::logf(logging::log_level::ERROR, "acpica: map memory failed (impossible to map pages\n");
+        virtual_allocator::free(virt_aligned, pages);
         return nullptr;
     }
 
+    mapping evicted{0, 0, 0, 0, 0};
+
+    {
+        std::lock_guard<int_spinlock> l(mappings_lock);
+
+        mapping* slot = nullptr;
+
+        for(auto& m : mappings){
+            if(!m.phys){
+                slot = &m;
+                break;
+            }
+
+            if(!m.users && (!slot || m.last_use < slot->last_use)){
+                slot = &m;
+            }
+        }
+
+        // Without a slot, the mapping is released on unmap
+        if(slot){
+            evicted = *slot;
+
+            slot->phys     = phys_aligned;
+            slot->virt     = virt_aligned;
+            slot->pages    = pages;
+            slot->users    = 1;
+            slot->last_use = ++mapping_tick;
+        }
+    }
+
+    if(evicted.phys){
+        unmap_range(evicted.virt, evicted.pages);
+    }
+
     return reinterpret_cast<void*>(virt_aligned + offset);
 }
 
@@ -264,14 +512,21 @@ void* AcpiOsMapMemory(ACPI_PHYSICAL_ADDRESS phys, ACPI_SIZE length){
 void AcpiOsUnmapMemory(void* virt_raw, ACPI_SIZE length){
     auto virt = reinterpret_cast<size_t>(virt_raw);
 
+    {
+        std::lock_guard<int_spinlock> l(mappings_lock);
+
+        // The kept mappings are only released on eviction
+        if(auto* m = find_virtual(virt)){
+            --m->users;
+            return;
+        }
+    }
+
     auto offset = virt % paging::PAGE_SIZE;
     auto real_length = offset + length;
     auto pages = paging::pages(real_length);
 
-    auto virt_aligned = virt - offset;
-
-    paging::unmap_pages(virt_aligned, pages);
-    virtual_allocator::free(virt_aligned, pages);
+    unmap_range(virt - offset, pages);
 }
 
 // Concurrency
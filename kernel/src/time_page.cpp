@@ -0,0 +1,89 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <tlib/time_page.hpp>
+
+#include "time_page.hpp"
+#include "timer.hpp"
+#include "clocksource.hpp"
+#include "cpu_features.hpp"
+#include "drivers/rtc.hpp"
+#include "paging.hpp"
+#include "physical_allocator.hpp"
+#include "mmap.hpp"
+#include "logging.hpp"
+
+#include "conc/spinlock.hpp"
+
+namespace {
+
+static_assert(tlib::TIME_PAGE_ADDRESS == scheduler::time_page_start, "The time page must be at the same address for programs");
+
+size_t physical_page = 0;
+tlib::time_page* page = nullptr;
+
+spinlock update_lock; ///< Serialize the updates of the processors
+
+} //End of anonymous namespace
+
+void time_page::init(){
+    physical_page = physical_allocator::allocate(1);
+
+    if(!physical_page){
+        logging::logf(logging::log_level::ERROR, "time_page: Unable to allocate the time page\n");
+        return;
+    }
+
+    page = static_cast<tlib::time_page*>(mmap_phys(physical_page, paging::PAGE_SIZE));
+
+    if(!page){
+        logging::logf(logging::log_level::ERROR, "time_page: Unable to map the time page\n");
+        return;
+    }
+
+    page->sequence = 0;
+    page->cpu_features = cpu_features::mask();
+
+    update();
+}
+
+void time_page::update(){
+    // Only called from interrupt handlers, the lock cannot be preempted
+    if(!page || !update_lock.try_lock()){
+        return;
+    }
+
+    // An odd sequence tells the readers that the values are changing
+    ++page->sequence;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    page->milliseconds = timer::milliseconds();
+    page->seconds = timer::seconds();
+    page->counter_frequency = timer::counter_frequency();
+    page->nanoseconds = clocksource::nanoseconds();
+
+    auto tsc = clocksource::conversion();
+
+    page->tsc_base = tsc.base;
+    page->tsc_nanoseconds = tsc.nanoseconds;
+    page->tsc_mult = tsc.mult;
+    page->epoch_offset = rtc::epoch_offset();
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ++page->sequence;
+
+    update_lock.unlock();
+}
+
+bool time_page::map(scheduler::process_t& process){
+    if(!page){
+        return false;
+    }
+
+    // The page is shared, it is not part of the segments of the process
+    return paging::user_map(process, scheduler::time_page_start, physical_page, false);
+}
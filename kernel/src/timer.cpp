@@ -7,6 +7,7 @@
 
 #include "timer.hpp"
 #include "scheduler.hpp"
+#include "time_page.hpp"
 #include "logging.hpp"
 #include "kernel.hpp"   //suspend_boot
 
@@ -25,6 +26,9 @@ uint64_t _timer_frequency = 0;
 uint64_t (*_counter_fun)() = nullptr;
 uint64_t _counter_frequency = 0;
 
+void (*_stop_tick_fun)(uint64_t) = nullptr;
+void (*_restart_tick_fun)() = nullptr;
+
 std::string sysfs_uptime(){
     return std::to_string(timer::seconds());
 }
@@ -57,10 +61,34 @@ void timer::install(){
 }
 
 void timer::tick(){
-    // Simply let the scheduler know about the tick
+    time_page::update();
+
+    // Let the scheduler know about the tick
     scheduler::tick();
 }
 
+void timer::tick(uint64_t ticks){
+    time_page::update();
+
+    scheduler::tick(ticks);
+}
+
+bool timer::stop_tick(uint64_t ticks){
+    if(!_stop_tick_fun){
+        return false;
+    }
+
+    _stop_tick_fun(ticks);
+
+    return true;
+}
+
+void timer::restart_tick(){
+    if(_restart_tick_fun){
+        _restart_tick_fun();
+    }
+}
+
 uint64_t timer::seconds(){
     return counter() / counter_frequency();
 }
@@ -98,3 +126,8 @@ void timer::counter_frequency(uint64_t freq){
 void timer::counter_fun(uint64_t (*fun)()){
     _counter_fun = fun;
 }
+
+void timer::tickless_fun(void (*stop_fun)(uint64_t), void (*restart_fun)()){
+    _stop_tick_fun = stop_fun;
+    _restart_tick_fun = restart_fun;
+}
@@ -7,6 +7,10 @@
 
 #include <types.hpp>
 #include <algorithms.hpp>
+#include <lock_guard.hpp>
+#include <array.hpp>
+
+#include <tlib/pixels.hpp>
 
 #include "vesa.hpp"
 #include "paging.hpp"
@@ -14,6 +18,11 @@
 #include "early_memory.hpp"
 #include "console.hpp"
 #include "kernel.hpp"
+#include "scheduler.hpp"
+#include "work_queue.hpp"
+#include "physical_allocator.hpp"
+
+#include "conc/int_spinlock.hpp"
 
 #include "fs/sysfs.hpp"
 
@@ -26,7 +35,38 @@
 
 namespace {
 
-uint32_t* screen;
+constexpr const size_t FRAME_MS = 16; ///< The delay between two flushes of the damage, about 60 per second
+
+/*!
+ * \brief The damaged pixels of a scanline, empty if begin >= end
+ */
+struct span {
+    uint32_t begin;
+    uint32_t end;
+};
+
+uint32_t* screen; ///< The framebuffer
+uint32_t* shadow; ///< The back buffer, all the drawing is done here
+
+size_t* shadow_pages;     ///< The physical pages of the back buffer
+size_t shadow_page_count; ///< The number of pages of the back buffer
+
+spinlock owner_lock;                             ///< Protect the owner of the back buffer
+scheduler::pid_t owner = scheduler::INVALID_PID; ///< The process the back buffer is mapped in
+
+size_t rows;
+
+int_spinlock damage_lock; ///< Protect the current damage
+span* damage[2];          ///< The damage of each scanline, the current one is written and the other is flushed
+size_t current_damage = 0;
+size_t damage_top;        ///< The first damaged scanline
+size_t damage_bottom;     ///< The scanline after the last damaged one
+
+spinlock flush_lock; ///< Serialize the flushes
+
+void flush_task(void*);
+
+work_queue::work flush_work = {&flush_task, nullptr, nullptr, 0, false};
 
 size_t x_shift;
 size_t y_shift;
@@ -39,6 +79,131 @@ size_t total_size;
 
 #include <tlib/Liberation.inl>
 
+constexpr const size_t GLYPH_COLORS = 4; ///< The number of colors with pre-rendered glyphs
+
+/*!
+ * \brief The glyphs pre-rendered in one color on a black background.
+ *
+ * Each row of a glyph is eight pixels, stored as four pairs.
+ */
+struct glyph_cache {
+    uint32_t color;      ///< The foreground color of the glyphs
+    volatile bool ready; ///< Indicates if the glyphs are rendered
+    uint64_t* rows;      ///< The rows of the 256 glyphs, 16 rows each
+};
+
+std::array<glyph_cache, GLYPH_COLORS> glyph_caches;
+spinlock glyph_lock; ///< Serialize the publication of the caches
+
+uint32_t glyph_pixel(const uint8_t* font_char, size_t i, size_t j, uint32_t color){
+    return font_char[i] & (1 << (8 - j)) ? color : 0;
+}
+
+void render_glyphs(uint64_t* rows, uint32_t color){
+    for(size_t c = 0; c < 256; ++c){
+        auto font_char = &Liberation_VESA_data[c * 16];
+
+        for(size_t i = 0; i < 16; ++i){
+            for(size_t j = 0; j < 8; j += 2){
+                auto low = glyph_pixel(font_char, i, j, color);
+                auto high = glyph_pixel(font_char, i, j + 1, color);
+
+                rows[(c * 16 + i) * 4 + j / 2] = uint64_t(low) | (uint64_t(high) << 32);
+            }
+        }
+    }
+}
+
+// Returns the glyphs of the given color, nullptr if all the caches are used by other colors
+const uint64_t* find_glyphs(uint32_t color){
+    bool free = false;
+
+    for(auto& cache : glyph_caches){
+        if(!__atomic_load_n(&cache.ready, __ATOMIC_ACQUIRE)){
+            free = true;
+        } else if(cache.color == color){
+            return cache.rows;
+        }
+    }
+
+    if(!free){
+        return nullptr;
+    }
+
+    // The glyphs are rendered outside of the lock
+    auto rows = new uint64_t[256 * 16 * 4];
+    render_glyphs(rows, color);
+
+    std::lock_guard<spinlock> l(glyph_lock);
+
+    for(auto& cache : glyph_caches){
+        if(cache.ready){
+            // Another processor rendered the same color
+            if(cache.color == color){
+                delete[] rows;
+                return cache.rows;
+            }
+
+            continue;
+        }
+
+        // The caches are never replaced, a reader may be using them
+        cache.color = color;
+        cache.rows = rows;
+
+        __atomic_store_n(&cache.ready, true, __ATOMIC_RELEASE);
+
+        return rows;
+    }
+
+    delete[] rows;
+
+    return nullptr;
+}
+
+// Must be called with the damage lock
+void damage_row(size_t y, size_t begin, size_t end){
+    auto& row = damage[current_damage][y];
+
+    if(row.begin >= row.end){
+        row.begin = begin;
+        row.end = end;
+    } else {
+        row.begin = std::min(row.begin, uint32_t(begin));
+        row.end = std::max(row.end, uint32_t(end));
+    }
+
+    damage_top = std::min(damage_top, y);
+    damage_bottom = std::max(damage_bottom, y + 1);
+}
+
+// The drawings are coalesced and flushed once per frame
+void schedule_flush(){
+    // Without workers, the damage is flushed right away
+    if(!scheduler::is_started()){
+        vesa::flush();
+        return;
+    }
+
+    work_queue::submit_delayed(flush_work, FRAME_MS);
+}
+
+void damage_rect(size_t x, size_t y, size_t w, size_t h){
+    {
+        std::lock_guard<int_spinlock> l(damage_lock);
+
+        for(size_t i = 0; i < h && y + i < rows; ++i){
+            damage_row(y + i, x, x + w);
+        }
+    }
+
+    schedule_flush();
+}
+
+void flush_task(void*){
+    vesa::flush();
+}
+
 } //end of anonymous namespace
 
 bool vesa::enabled(){
@@ -69,7 +234,13 @@ bool vesa::init(){
         return false;
     }
 
-    if(!paging::map_pages(virt, physical, pages)){
+    // The framebuffer is only written, with full scanlines
+    uint8_t flags = paging::PRESENT | paging::WRITE;
+    if(paging::write_combining()){
+        flags |= paging::WRITE_COMBINING;
+    }
+
+    if(!paging::map_pages(virt, physical, pages, flags)){
         return false;
     }
 
@@ -81,6 +252,40 @@ bool vesa::init(){
     green_shift = block.linear_green_mask_position;
 
     screen = reinterpret_cast<uint32_t*>(virt);
+    rows = block.height;
+
+    // The back buffer is made of physical pages, to be mapped in a graphics process
+    shadow_page_count = paging::pages(total_size);
+    shadow_pages = new size_t[shadow_page_count];
+
+    auto shadow_virt = virtual_allocator::allocate(shadow_page_count);
+
+    if(!shadow_virt){
+        return false;
+    }
+
+    for(size_t i = 0; i < shadow_page_count; ++i){
+        shadow_pages[i] = physical_allocator::allocate(1);
+
+        if(!shadow_pages[i] || !paging::map(shadow_virt + i * paging::PAGE_SIZE, shadow_pages[i])){
+            return false;
+        }
+    }
+
+    // The back buffer starts with the current content of the screen
+    shadow = reinterpret_cast<uint32_t*>(shadow_virt);
+    std::copy_n(reinterpret_cast<const char*>(screen), total_size, reinterpret_cast<char*>(shadow));
+
+    damage[0] = new span[rows];
+    damage[1] = new span[rows];
+
+    for(size_t y = 0; y < rows; ++y){
+        damage[0][y] = {0, 0};
+        damage[1][y] = {0, 0};
+    }
+
+    damage_top = rows;
+    damage_bottom = 0;
 
     sysfs::set_constant_value(path("/sys"), path("/vesa/enabled"), "true");
     sysfs::set_constant_value(path("/sys"), path("/vesa/resolution/width"), std::to_string(block.width));
@@ -131,15 +336,12 @@ uint32_t vesa::make_color(uint8_t r, uint8_t g, uint8_t b){
 void vesa::draw_hline(void* buffer, size_t x, size_t y, size_t w, uint32_t color){
     auto screen = static_cast<uint32_t*>(buffer);
 
-    auto where = x + y * y_shift;
-
-    for(size_t i = 0; i < w; ++i){
-        screen[where + i] = color;
-    }
+    tlib::pixels::fill(screen + x + y * y_shift, w, color);
 }
 
 void vesa::draw_hline(size_t x, size_t y, size_t w, uint32_t color){
-    draw_hline(screen, x, y, w, color);
+    draw_hline(shadow, x, y, w, color);
+    damage_rect(x, y, w, 1);
 }
 
 void vesa::draw_vline(void* buffer, size_t x, size_t y, size_t h, uint32_t color){
@@ -153,7 +355,8 @@ void vesa::draw_vline(void* buffer, size_t x, size_t y, size_t h, uint32_t color
 }
 
 void vesa::draw_vline(size_t x, size_t y, size_t h, uint32_t color){
-    draw_vline(screen, x, y, h, color);
+    draw_vline(shadow, x, y, h, color);
+    damage_rect(x, y, 1, h);
 }
 
 void vesa::draw_char(void* buffer, size_t x, size_t y, char c, uint32_t color){
@@ -161,15 +364,29 @@ void vesa::draw_char(void* buffer, size_t x, size_t y, char c, uint32_t color){
 
     auto where = x + y * y_shift;
 
+    // Each row of a pre-rendered glyph is copied with four stores
+    if(auto glyphs = find_glyphs(color)){
+        auto glyph = glyphs + size_t(c) * 16 * 4;
+
+        for(size_t i = 0; i < 16; ++i){
+            auto destination = reinterpret_cast<uint64_t*>(screen + where);
+
+            destination[0] = glyph[i * 4 + 0];
+            destination[1] = glyph[i * 4 + 1];
+            destination[2] = glyph[i * 4 + 2];
+            destination[3] = glyph[i * 4 + 3];
+
+            where += y_shift;
+        }
+
+        return;
+    }
+
     auto font_char = &Liberation_VESA_data[c * 16];
 
     for(size_t i = 0; i < 16; ++i){
         for(size_t j = 0; j < 8; ++j){
-            if(font_char[i] & (1 << (8 - j))){
-                screen[where+j] = color;
-            } else {
-                screen[where+j] = 0;
-            }
+            screen[where+j] = glyph_pixel(font_char, i, j, color);
         }
 
         where += y_shift;
@@ -177,25 +394,19 @@ void vesa::draw_char(void* buffer, size_t x, size_t y, char c, uint32_t color){
 }
 
 void vesa::draw_char(size_t x, size_t y, char c, uint32_t color){
-    draw_char(screen, x, y, c, color);
+    draw_char(shadow, x, y, c, color);
+    damage_rect(x, y, 8, 16);
 }
 
 void vesa::draw_rect(void* buffer, size_t x, size_t y, size_t w, size_t h, uint32_t color){
     auto screen = static_cast<uint32_t*>(buffer);
 
-    auto where = x + y * y_shift;
-
-    for(size_t j = 0; j < h; ++j){
-        for(size_t i = 0; i < w; ++i){
-            screen[where + i] = color;
-        }
-
-        where += y_shift;
-    }
+    tlib::pixels::fill_rect(screen, y_shift, x, y, w, h, color);
 }
 
 void vesa::draw_rect(size_t x, size_t y, size_t w, size_t h, uint32_t color){
-    draw_rect(screen, x, y, w, h, color);
+    draw_rect(shadow, x, y, w, h, color);
+    damage_rect(x, y, w, h);
 }
 
 void vesa::move_lines_up(void* buffer, size_t y, size_t x, size_t w, size_t lines, size_t n){
@@ -210,7 +421,8 @@ void vesa::move_lines_up(void* buffer, size_t y, size_t x, size_t w, size_t line
 }
 
 void vesa::move_lines_up(size_t y, size_t x, size_t w, size_t lines, size_t n){
-    move_lines_up(screen, y, x, w, lines, n);
+    move_lines_up(shadow, y, x, w, lines, n);
+    damage_rect(x, y - n, w, lines);
 }
 
 void* vesa::create_buffer(){
@@ -218,9 +430,112 @@ void* vesa::create_buffer(){
 }
 
 void vesa::redraw(const char* buffer){
-    std::copy_n(buffer, total_size, reinterpret_cast<char*>(screen));
+    auto source = reinterpret_cast<const uint32_t*>(buffer);
+
+    // Only the pixels that differ from the back buffer are damaged
+    for(size_t y = 0; y < rows; ++y){
+        auto line = y * y_shift;
+
+        size_t begin = 0;
+        while(begin < y_shift && source[line + begin] == shadow[line + begin]){
+            ++begin;
+        }
+
+        if(begin == y_shift){
+            continue;
+        }
+
+        size_t end = y_shift;
+        while(source[line + end - 1] == shadow[line + end - 1]){
+            --end;
+        }
+
+        tlib::pixels::copy(shadow + line + begin, source + line + begin, end - begin);
+
+        std::lock_guard<int_spinlock> l(damage_lock);
+        damage_row(y, begin, end);
+    }
+
+    // A full redraw is already a frame
+    flush();
 }
 
 void vesa::save(char* buffer){
-    std::copy_n(reinterpret_cast<const char*>(screen), total_size, buffer);
+    std::copy_n(reinterpret_cast<const char*>(shadow), total_size, buffer);
+}
+
+void vesa::flush(){
+    if(!shadow){
+        return;
+    }
+
+    std::lock_guard<spinlock> f(flush_lock);
+
+    size_t top;
+    size_t bottom;
+    span* spans;
+
+    {
+        std::lock_guard<int_spinlock> l(damage_lock);
+
+        top = damage_top;
+        bottom = damage_bottom;
+        spans = damage[current_damage];
+
+        // The drawings during the copy go in the other damage
+        current_damage = 1 - current_damage;
+        damage_top = rows;
+        damage_bottom = 0;
+    }
+
+    for(size_t y = top; y < bottom; ++y){
+        auto& row = spans[y];
+
+        if(row.begin < row.end){
+            auto line = y * y_shift;
+            tlib::pixels::copy(screen + line + row.begin, shadow + line + row.begin, row.end - row.begin);
+        }
+
+        row = {0, 0};
+    }
+}
+
+std::expected<size_t> vesa::map_buffer(){
+    auto pid = scheduler::get_owner_process().pid;
+
+    {
+        std::lock_guard<spinlock> l(owner_lock);
+
+        // The buffer of a terminated owner can be taken over
+        if(owner != scheduler::INVALID_PID && owner != pid){
+            auto state = scheduler::get_process_state(owner);
+
+            if(state != scheduler::process_state::EMPTY && state != scheduler::process_state::KILLED){
+                return std::make_unexpected<size_t>(std::ERROR_BUSY);
+            }
+        }
+
+        owner = pid;
+    }
+
+    // Mapping may allocate paging structures, outside of the lock
+    return scheduler::map_shared_pages(shadow_pages, shadow_page_count);
+}
+
+std::expected<void> vesa::present(size_t x, size_t y, size_t w, size_t h){
+    if(scheduler::get_owner_process().pid != owner){
+        return std::make_unexpected<void>(std::ERROR_PERMISSION_DENIED);
+    }
+
+    if(tlib::pixels::clip(x, y, w, h, get_width(), rows)){
+        std::lock_guard<int_spinlock> l(damage_lock);
+
+        for(size_t i = 0; i < h; ++i){
+            damage_row(y + i, x, x + w);
+        }
+    }
+
+    flush();
+
+    return {};
 }
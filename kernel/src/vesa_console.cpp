@@ -5,9 +5,13 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithms.hpp>
+
 #include "vesa_console.hpp"
 #include "vesa.hpp"
 #include "early_memory.hpp"
+#include "scheduler.hpp"
+#include "work_queue.hpp"
 
 namespace {
 
@@ -16,11 +20,98 @@ constexpr const size_t PADDING = 5;
 constexpr const size_t LEFT    = MARGIN + PADDING;
 constexpr const size_t TOP     = 40;
 
+constexpr const size_t FRAME_MS = 16; ///< The delay between two renderings of the console
+
 // Constants extracted from VESA
 size_t _lines;
 size_t _columns;
 uint32_t _color;
-size_t buffer_size;
+
+/*!
+ * \brief The characters of a console, in a ring of lines.
+ *
+ * Scrolling only moves the first line of the ring, the lines are
+ * rendered lazily.
+ */
+struct text_state {
+    size_t first; ///< The index in the ring of the first line of the console
+    char* cells;  ///< The characters of the lines, _columns per line
+};
+
+text_state* screen;     ///< The state of the console on screen, owned by its terminal once saved
+volatile bool* dirty;   ///< Indicates, for each line of the screen, if it must be rendered
+size_t batch_depth = 0; ///< The number of started batches of changes
+
+void render_task(void*);
+
+work_queue::work render_work = {&render_task, nullptr, nullptr, 0, false};
+
+text_state* new_state(){
+    auto state = new text_state;
+
+    state->first = 0;
+    state->cells = new char[_lines * _columns];
+
+    std::fill_n(state->cells, _lines * _columns, ' ');
+
+    return state;
+}
+
+char* line_cells(text_state& state, size_t line){
+    return state.cells + ((state.first + line) % _lines) * _columns;
+}
+
+void scroll_state(text_state& state){
+    // The first line becomes the last one
+    std::fill_n(line_cells(state, 0), _columns, ' ');
+
+    state.first = (state.first + 1) % _lines;
+}
+
+void render(){
+    for(size_t line = 0; line < _lines; ++line){
+        if(!dirty[line]){
+            continue;
+        }
+
+        // Changes during the rendering mark the line again
+        dirty[line] = false;
+
+        auto cells = line_cells(*screen, line);
+
+        for(size_t column = 0; column < _columns; ++column){
+            vesa::draw_char(LEFT + 8 * column, TOP + 16 * line, cells[column], _color);
+        }
+    }
+
+    vesa::flush();
+}
+
+void render_task(void*){
+    render();
+}
+
+// The changes are coalesced and rendered once per frame
+void schedule_render(){
+    // Without workers, the console is rendered right away
+    if(!scheduler::is_started()){
+        render();
+        return;
+    }
+
+    work_queue::submit_delayed(render_work, FRAME_MS);
+}
+
+void damage(size_t first, size_t count){
+    for(size_t line = first; line < first + count; ++line){
+        dirty[line] = true;
+    }
+
+    // The rendering of a batch is scheduled at its end
+    if(!batch_depth){
+        schedule_render();
+    }
+}
 
 } //end of anonymous namespace
 
@@ -31,7 +122,10 @@ void vesa_console::init() {
     _lines   = (block.height - TOP - MARGIN - PADDING) / 16;
     _color   = vesa::make_color(0, 255, 0);
 
-    buffer_size = block.height * block.bytes_per_scan_line;
+    screen = new_state();
+
+    dirty = new bool[_lines];
+    std::fill_n(dirty, _lines, false);
 
     vesa::draw_hline(MARGIN, MARGIN, block.width - 2 * MARGIN, _color);
     vesa::draw_hline(MARGIN, 35, block.width - 2 * MARGIN, _color);
@@ -55,43 +149,71 @@ size_t vesa_console::columns() const {
     return _columns;
 }
 
+void vesa_console::begin_batch() {
+    ++batch_depth;
+}
+
+void vesa_console::end_batch() {
+    if (!--batch_depth) {
+        schedule_render();
+    }
+}
+
+void* vesa_console::create_buffer() {
+    return new_state();
+}
+
 void vesa_console::clear() {
-    vesa::draw_rect(LEFT, TOP, _columns * 8, _lines * 16, vesa::make_color(0, 0, 0));
+    std::fill_n(screen->cells, _lines * _columns, ' ');
+
+    damage(0, _lines);
 }
 
 void vesa_console::clear(void* buffer) {
-    vesa::draw_rect(buffer, LEFT, TOP, _columns * 8, _lines * 16, vesa::make_color(0, 0, 0));
+    auto& state = *static_cast<text_state*>(buffer);
+
+    std::fill_n(state.cells, _lines * _columns, ' ');
 }
 
 void vesa_console::scroll_up() {
-    vesa::move_lines_up(TOP + 16, LEFT, _columns * 8, (_lines - 1) * 16, 16);
-    vesa::draw_rect(LEFT, TOP + (_lines - 1) * 16, _columns * 8, 16, vesa::make_color(0, 0, 0));
+    scroll_state(*screen);
+
+    // All the lines moved on screen
+    damage(0, _lines);
 }
 
 void vesa_console::scroll_up(void* buffer) {
-    vesa::move_lines_up(buffer, TOP + 16, LEFT, _columns * 8, (_lines - 1) * 16, 16);
-    vesa::draw_rect(buffer, LEFT, TOP + (_lines - 1) * 16, _columns * 8, 16, vesa::make_color(0, 0, 0));
+    scroll_state(*static_cast<text_state*>(buffer));
 }
 
 void vesa_console::print_char(size_t line, size_t column, char c) {
-    vesa::draw_char(LEFT + 8 * column, TOP + 16 * line, c, _color);
+    line_cells(*screen, line)[column] = c;
+
+    damage(line, 1);
 }
 
 void vesa_console::print_char(void* buffer, size_t line, size_t column, char c) {
-    vesa::draw_char(buffer, LEFT + 8 * column, TOP + 16 * line, c, _color);
+    line_cells(*static_cast<text_state*>(buffer), line)[column] = c;
 }
 
 void* vesa_console::save(void* buffer) {
-    void* buffer32 = static_cast<uint32_t*>(buffer);
-    if (!buffer32) {
-        buffer32 = new uint32_t[buffer_size];
+    auto state = static_cast<text_state*>(buffer);
+    if (!state) {
+        state = new_state();
     }
 
-    vesa::save(static_cast<char*>(buffer32));
+    // The screen of a restored terminal already is its own state
+    if (state != screen) {
+        state->first = screen->first;
+        std::copy_n(screen->cells, _lines * _columns, state->cells);
+    }
 
-    return buffer32;
+    return state;
 }
 
 void vesa_console::restore(void* buffer) {
-    vesa::redraw(static_cast<char*>(buffer));
+    // The screen now shows the state of the terminal, nothing is copied
+    screen = static_cast<text_state*>(buffer);
+
+    damage(0, _lines);
 }
@@ -0,0 +1,270 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <lock_guard.hpp>
+#include <hash.hpp>
+
+#include "vfs/dentry_cache.hpp"
+
+#include "conc/mutex.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+constexpr const size_t MAX_ENTRIES = 512; ///< The maximum number of cached names
+constexpr const size_t BUCKETS = 128;     ///< The number of buckets of the hash table
+constexpr const size_t NO_ENTRY = MAX_ENTRIES; ///< Marks the end of a chain
+
+/*!
+ * \brief A cached name of a directory
+ */
+struct entry_t {
+    vfs::file_system* fs; ///< The mounted file system
+    size_t parent;        ///< The location of the directory
+    size_t hash;          ///< The hash of the key
+    bool used;            ///< Indicates if the entry is used
+    bool negative;        ///< Indicates that the name does not exist
+    bool referenced;      ///< Indicates if the entry was used since the clock last passed
+    vfs::file file;       ///< The file, only the name is valid for a negative entry
+    size_t next;          ///< The next entry of the bucket or of the free list
+};
+
+std::array<entry_t, MAX_ENTRIES> entries;
+std::array<size_t, BUCKETS> buckets;
+
+size_t free_head = NO_ENTRY; ///< The first free entry
+size_t hand = 0;             ///< The clock hand of the eviction
+size_t cached = 0;           ///< The number of cached names
+size_t generation = 0;       ///< The number of invalidations
+
+mutex lock; ///< Protect the entries, never held during I/O
+
+volatile size_t hits = 0;      ///< The number of names found in the cache
+volatile size_t misses = 0;    ///< The number of names searched in their directory
+volatile size_t evictions = 0; ///< The number of names evicted to make room
+
+std::string sysfs_entries(){
+    return std::to_string(cached);
+}
+
+std::string sysfs_hits(){
+    return std::to_string(hits);
+}
+
+std::string sysfs_misses(){
+    return std::to_string(misses);
+}
+
+std::string sysfs_evictions(){
+    return std::to_string(evictions);
+}
+
+// The hash of the name is the one of the parts of the paths, mixed with the directory
+size_t hash(vfs::file_system* fs, size_t parent, size_t name_hash){
+    auto key = name_hash ^ reinterpret_cast<size_t>(fs) ^ (parent * 0x9E3779B97F4A7C15);
+
+    return key ^ (key >> 29);
+}
+
+/*!
+ * \brief Returns the entry of the given name, NO_ENTRY if it is not cached
+ */
+size_t find(vfs::file_system* fs, size_t parent, const std::string& name, size_t key){
+    auto i = buckets[key % BUCKETS];
+
+    while(i != NO_ENTRY){
+        auto& entry = entries[i];
+
+        if(entry.hash == key && entry.fs == fs && entry.parent == parent && entry.file.file_name == name){
+            return i;
+        }
+
+        i = entry.next;
+    }
+
+    return NO_ENTRY;
+}
+
+/*!
+ * \brief Remove the entry from its bucket and put it back in the free list
+ */
+void remove(size_t index){
+    auto& entry = entries[index];
+    auto* link = &buckets[entry.hash % BUCKETS];
+
+    while(*link != index){
+        link = &entries[*link].next;
+    }
+
+    *link = entry.next;
+
+    entry.used = false;
+    entry.file.file_name.clear();
+    entry.next = free_head;
+    free_head = index;
+
+    --cached;
+}
+
+/*!
+ * \brief Evict an entry not used recently
+ */
+void evict(){
+    // The first pass clears the referenced bits, the second one finds them cleared
+    while(true){
+        auto index = hand;
+        hand = (hand + 1) % MAX_ENTRIES;
+
+        auto& entry = entries[index];
+
+        if(!entry.used){
+            continue;
+        }
+
+        if(entry.referenced){
+            entry.referenced = false;
+            continue;
+        }
+
+        remove(index);
+        ++evictions;
+
+        return;
+    }
+}
+
+void add_entry(vfs::file_system* fs, size_t parent, const vfs::file& file, bool negative, size_t read_generation){
+    std::lock_guard<mutex> l(lock);
+
+    // The directory may have changed during the search
+    if(read_generation != generation){
+        return;
+    }
+
+    auto key = hash(fs, parent, std::hash<std::string>()(file.file_name));
+
+    // Another process may have searched the same name in the meantime
+    if(find(fs, parent, file.file_name, key) != NO_ENTRY){
+        return;
+    }
+
+    if(free_head == NO_ENTRY){
+        evict();
+    }
+
+    auto index = free_head;
+
+    auto& entry = entries[index];
+    free_head = entry.next;
+
+    auto& head = buckets[key % BUCKETS];
+
+    entry.fs = fs;
+    entry.parent = parent;
+    entry.hash = key;
+    entry.used = true;
+    entry.negative = negative;
+    entry.referenced = true;
+    entry.file = file;
+    entry.next = head;
+    head = index;
+
+    ++cached;
+}
+
+} //end of anonymous namespace
+
+void dentry_cache::init(){
+    lock.init();
+    lock.set_name("dentry_cache");
+
+    for(size_t i = 0; i < BUCKETS; ++i){
+        buckets[i] = NO_ENTRY;
+    }
+
+    // The lowest entries are used first
+    for(size_t i = MAX_ENTRIES; i > 0; --i){
+        entries[i - 1].used = false;
+        entries[i - 1].next = free_head;
+        free_head = i - 1;
+    }
+
+    sysfs::set_dynamic_value(path("/sys"), path("/vfs/dentry_cache/entries"), &sysfs_entries);
+    sysfs::set_dynamic_value(path("/sys"), path("/vfs/dentry_cache/hits"), &sysfs_hits);
+    sysfs::set_dynamic_value(path("/sys"), path("/vfs/dentry_cache/misses"), &sysfs_misses);
+    sysfs::set_dynamic_value(path("/sys"), path("/vfs/dentry_cache/evictions"), &sysfs_evictions);
+}
+
+bool dentry_cache::lookup(vfs::file_system* fs, size_t parent, const std::string& name, vfs::file& file, bool& exists, size_t& read_generation){
+    return lookup(fs, parent, name, std::hash<std::string>()(name), file, exists, read_generation);
+}
+
+bool dentry_cache::lookup(vfs::file_system* fs, size_t parent, const std::string& name, size_t name_hash, vfs::file& file, bool& exists, size_t& read_generation){
+    std::lock_guard<mutex> l(lock);
+
+    auto index = find(fs, parent, name, hash(fs, parent, name_hash));
+
+    if(index == NO_ENTRY){
+        read_generation = generation;
+        ++misses;
+
+        return false;
+    }
+
+    auto& entry = entries[index];
+
+    entry.referenced = true;
+
+    exists = !entry.negative;
+
+    if(exists){
+        file = entry.file;
+    }
+
+    ++hits;
+
+    return true;
+}
+
+void dentry_cache::insert(vfs::file_system* fs, size_t parent, const vfs::file& file, size_t read_generation){
+    add_entry(fs, parent, file, false, read_generation);
+}
+
+void dentry_cache::insert_negative(vfs::file_system* fs, size_t parent, const std::string& name, size_t read_generation){
+    vfs::file file;
+    file.file_name = name;
+
+    add_entry(fs, parent, file, true, read_generation);
+}
+
+void dentry_cache::invalidate(vfs::file_system* fs, size_t parent, const std::string& name){
+    std::lock_guard<mutex> l(lock);
+
+    ++generation;
+
+    auto index = find(fs, parent, name, hash(fs, parent, std::hash<std::string>()(name)));
+
+    if(index != NO_ENTRY){
+        remove(index);
+    }
+}
+
+void dentry_cache::invalidate(vfs::file_system* fs, size_t parent){
+    std::lock_guard<mutex> l(lock);
+
+    ++generation;
+
+    for(size_t i = 0; i < MAX_ENTRIES; ++i){
+        auto& entry = entries[i];
+
+        if(entry.used && entry.fs == fs && entry.parent == parent){
+            remove(i);
+        }
+    }
+}
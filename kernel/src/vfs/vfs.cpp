@@ -20,11 +20,20 @@
 #include "fs/sysfs.hpp"
 #include "fs/devfs.hpp"
 #include "fs/procfs.hpp"
+#include "fs/pipefs.hpp"
 
 #include "scheduler.hpp"
+#include "page_cache.hpp"
+#include "elf_cache.hpp"
+#include "poll.hpp"
 #include "console.hpp"
 #include "logging.hpp"
 #include "assert.hpp"
+#include "timer.hpp"
+
+#include "conc/semaphore.hpp"
+#include "conc/mutex.hpp"
+#include "conc/qsbr.hpp"
 
 namespace {
 
@@ -52,6 +61,8 @@ std::string partition_type_to_string(vfs::partition_type type) {
             return "devfs";
         case vfs::partition_type::PROCFS:
             return "procfs";
+        case vfs::partition_type::PIPEFS:
+            return "pipefs";
         case vfs::partition_type::UNKNOWN:
             return "Unknown";
         default:
@@ -59,13 +70,71 @@ std::string partition_type_to_string(vfs::partition_type type) {
     }
 }
 
-std::vector<mounted_fs> mount_point_list;
+/*!
+ * \brief The mounted file systems.
+ *
+ * A table is never modified once published, a mount publishes a copy and
+ * releases the previous table after a grace period of its readers. The
+ * mounted file systems themselves never move nor are released.
+ */
+struct mount_table {
+    std::vector<mounted_fs*> entries; ///< The mounted file systems, in mount order
+};
 
-void mount_root() {
-    //TODO Get information about the root from a configuration file
-    mount(vfs::partition_type::FAT32, "/", "/dev/hda1");
+mount_table initial_table;                      ///< The empty table, before the first mount
+mount_table* mount_point_list = &initial_table; ///< The current table
+mutex mounts_lock;                              ///< Serialize the mounts
+
+/*!
+ * \brief Returns the current table, only valid in a qsbr read section
+ */
+const std::vector<mounted_fs*>& current_mounts() {
+    return __atomic_load_n(&mount_point_list, __ATOMIC_ACQUIRE)->entries;
 }
 
+/*!
+ * \brief Returns a copy of the mounted file systems, for the slow paths
+ * that may sleep
+ */
+std::vector<mounted_fs*> mounted() {
+    std::lock_guard<mutex> l(mounts_lock);
+
+    return mount_point_list->entries;
+}
+
+/*!
+ * \brief Add a file system to the mount table
+ */
+std::expected<mounted_fs*> add_mount(vfs::partition_type type, const path& dev_path, const path& mp_path, vfs::file_system* fs) {
+    std::lock_guard<mutex> l(mounts_lock);
+
+    auto* old_table = mount_point_list;
+
+    for (auto* m : old_table->entries) {
+        if (m->mount_point == mp_path) {
+            return std::make_unexpected<mounted_fs*>(std::ERROR_ALREADY_MOUNTED);
+        }
+    }
+
+    auto* mp = new mounted_fs(type, dev_path, mp_path, fs);
+
+    auto* table = new mount_table(*old_table);
+    table->entries.push_back(mp);
+
+    __atomic_store_n(&mount_point_list, table, __ATOMIC_RELEASE);
+
+    // The lookups in progress may still see the previous table
+    qsbr::synchronize();
+
+    if (old_table != &initial_table) {
+        delete old_table;
+    }
+
+    return mp;
+}
+
+semaphore root_ready; ///< Given back by each process waiting for the root
+
 void mount_sys() {
     mount(vfs::partition_type::SYSFS, "/sys/", "none");
 }
@@ -78,7 +147,18 @@ void mount_proc() {
     mount(vfs::partition_type::PROCFS, "/proc/", "none");
 }
 
+void mount_pipe() {
+    mount(vfs::partition_type::PIPEFS, "/pipe/", "none");
+}
+
+/*!
+ * \brief Returns the absolute path of the given file.
+ *
+ * The path is a temporary of the system call, it must be copied to be kept.
+ */
 path get_path(const char* file_path) {
+    arena::scope scope;
+
     path p(file_path);
 
     if (!p.is_valid()) {
@@ -96,16 +176,21 @@ mounted_fs& get_fs(const path& base_path) {
     size_t best       = 0;
     size_t best_match = 0;
 
+    // The lookups take no lock, only the table can be replaced
+    qsbr_reader reader;
+
+    auto& list = current_mounts();
+
     if (base_path.is_root()) {
-        for (auto& mp : mount_point_list) {
-            if (mp.mount_point.is_root()) {
-                return mp;
+        for (auto* mp : list) {
+            if (mp->mount_point.is_root()) {
+                return *mp;
             }
         }
     }
 
-    for (size_t i = 0; i < mount_point_list.size(); ++i) {
-        auto& mp = mount_point_list[i];
+    for (size_t i = 0; i < list.size(); ++i) {
+        auto& mp = *list[i];
 
         bool match = true;
         for (size_t j = 0; j < mp.mount_point.size() && j < base_path.size(); ++j) {
@@ -121,18 +206,85 @@ mounted_fs& get_fs(const path& base_path) {
         }
     }
 
-    return mount_point_list[best_match];
+    return *list[best_match];
 }
 
+/*!
+ * \brief Returns the path of the file inside its file system.
+ *
+ * The path is a temporary of the system call, it must be copied to be kept.
+ */
 path get_fs_path(const path& base_path, const mounted_fs& fs) {
     thor_assert(base_path.is_absolute(), "Invalid base_path in get_fs_path");
     thor_assert(fs.mount_point.is_absolute(), "Invalid base_path in get_fs_path");
 
+    arena::scope scope;
+
     if (base_path == fs.mount_point) {
         return path("/");
     }
 
-    return path("/") / base_path.sub_path(fs.mount_point.size());
+    return base_path.root_sub_path(fs.mount_point.size());
+}
+
+/*!
+ * \brief Returns the location of the file to invalidate in the page cache
+ * once the file is modified, 0 if there is nothing to invalidate
+ */
+size_t cached_location(const mounted_fs& fs, const path& fs_path) {
+    if (fs.fs_type != vfs::partition_type::FAT32 || (page_cache::empty() && elf_cache::empty())) {
+        return 0;
+    }
+
+    vfs::file f;
+    if (fs.file_system->get_file(fs_path, f)) {
+        return 0;
+    }
+
+    return f.location;
+}
+
+/*!
+ * \brief Drop the cached pages and headers of the modified file
+ */
+void invalidate_pages(const mounted_fs& fs, size_t location) {
+    if (location) {
+        page_cache::invalidate(fs.file_system, location);
+        elf_cache::invalidate(fs.file_system, location);
+    }
+}
+
+/*!
+ * \brief Returns the open file of the given file descriptor, resolved to its
+ * file system on first use
+ */
+vfs::open_file& resolve(vfs::fd_t fd) {
+    auto& file = scheduler::get_open_file(fd);
+
+    if (!file.fs) {
+        auto& fs = get_fs(file.base_path);
+
+        file.fs_path = get_fs_path(file.base_path, fs);
+        file.cached  = fs.fs_type == vfs::partition_type::FAT32;
+        file.fs      = fs.file_system;
+    }
+
+    return file;
+}
+
+/*!
+ * \brief Drop the cached pages and headers of the modified open file
+ */
+void invalidate_pages(const vfs::open_file& file) {
+    if (file.cached && file.location) {
+        if (!page_cache::empty()) {
+            page_cache::invalidate(file.fs, file.location);
+        }
+
+        if (!elf_cache::empty()) {
+            elf_cache::invalidate(file.fs, file.location);
+        }
+    }
 }
 
 vfs::file_system* get_new_fs(vfs::partition_type type, const path& mount_point, const path& device) {
@@ -149,25 +301,95 @@ vfs::file_system* get_new_fs(vfs::partition_type type, const path& mount_point,
         case vfs::partition_type::PROCFS:
             return new procfs::procfs_file_system(mount_point);
 
+        case vfs::partition_type::PIPEFS:
+            return new pipefs::pipefs_file_system(mount_point);
+
         default:
             return nullptr;
     }
 }
 
+/*!
+ * \brief Fill the attributes of the file of the given name
+ */
+void fill_stat(vfs::stat_info& info, const vfs::file& f, std::string_view name) {
+    info.size  = f.size;
+    info.flags = 0;
+
+    if (f.directory) {
+        info.flags |= vfs::STAT_FLAG_DIRECTORY;
+    }
+
+    if (f.system) {
+        info.flags |= vfs::STAT_FLAG_SYSTEM;
+    }
+
+    if (f.hidden) {
+        info.flags |= vfs::STAT_FLAG_HIDDEN;
+    }
+
+    if (f.char_device) {
+        info.flags |= vfs::STAT_FLAG_CHAR_DEVICE;
+    }
+
+    // All files starting with a .dot are hidden by default
+    if (!name.empty() && name[0] == '.') {
+        info.flags |= vfs::STAT_FLAG_HIDDEN;
+    }
+
+    info.created  = f.created;
+    info.modified = f.modified;
+    info.accessed = f.accessed;
+}
+
+/*!
+ * \brief Returns the size of the stat entry of the given name, padded to
+ * keep the next entry aligned
+ */
+size_t stat_entry_size(size_t length) {
+    auto size = __builtin_offsetof(vfs::directory_stat_entry, name) + length + 1;
+    return (size + 7) & ~size_t(7);
+}
+
 } //end of anonymous namespace
 
 void vfs::init() {
-    mount_root();
+    mounts_lock.init();
+
+    root_ready.init(0);
+
     mount_sys();
     mount_dev();
     mount_proc();
+    mount_pipe();
 
     //Finish initilization of the file systems
-    for (auto& mp : mount_point_list) {
-        mp.file_system->init();
+    for (auto* mp : mounted()) {
+        mp->file_system->init();
     }
 }
 
+void vfs::mount_root() {
+    auto start = timer::milliseconds();
+
+    //TODO Get information about the root from a configuration file
+    if (mount(vfs::partition_type::FAT32, "/", "/dev/hda1")) {
+        get_fs(path("/")).file_system->init();
+
+        logging::logf(logging::log_level::DEBUG, "vfs: root mounted in %ums\n", timer::milliseconds() - start);
+    } else {
+        logging::logf(logging::log_level::ERROR, "vfs: failed to mount the root\n");
+    }
+
+    //Even without root, the waiting processes must not be stuck
+    root_ready.unlock();
+}
+
+void vfs::wait_root() {
+    root_ready.lock();
+    root_ready.unlock();
+}
+
 std::expected<void> vfs::mount(partition_type type, fd_t mp_fd, fd_t dev_fd) {
     if (!scheduler::has_handle(mp_fd)) {
         return std::make_unexpected<void>(std::ERROR_INVALID_FILE_DESCRIPTOR);
@@ -180,8 +402,8 @@ std::expected<void> vfs::mount(partition_type type, fd_t mp_fd, fd_t dev_fd) {
     auto& mp_path  = scheduler::get_handle(mp_fd);
     auto& dev_path = scheduler::get_handle(dev_fd);
 
-    for (auto& m : mount_point_list) {
-        if (m.mount_point == mp_path) {
+    for (auto* m : mounted()) {
+        if (m->mount_point == mp_path) {
             return std::make_unexpected<void>(std::ERROR_ALREADY_MOUNTED);
         }
     }
@@ -192,7 +414,13 @@ std::expected<void> vfs::mount(partition_type type, fd_t mp_fd, fd_t dev_fd) {
         return std::make_unexpected<void>(std::ERROR_INVALID_FILE_SYSTEM);
     }
 
-    mount_point_list.emplace_back(type, dev_path, mp_path, fs);
+    auto mp = add_mount(type, dev_path, mp_path, fs);
+
+    if (!mp) {
+        delete fs;
+        return std::make_unexpected<void>(mp.error());
+    }
+
     fs->init();
 
     logging::logf(logging::log_level::TRACE, "vfs: mounted file system %s at %s \n", dev_path.string().c_str(), mp_path.string().c_str());
@@ -210,7 +438,12 @@ std::expected<void> vfs::mount(partition_type type, const char* mount_point, con
         return std::make_unexpected<void>(std::ERROR_INVALID_FILE_SYSTEM);
     }
 
-    mount_point_list.emplace_back(type, dev_path, mp_path, fs);
+    auto mp = add_mount(type, dev_path, mp_path, fs);
+
+    if (!mp) {
+        delete fs;
+        return std::make_unexpected<void>(mp.error());
+    }
 
     return {};
 }
@@ -265,6 +498,8 @@ std::expected<vfs::fd_t> vfs::open(const char* file_path, size_t flags) {
 
 void vfs::close(fd_t fd) {
     if (scheduler::has_handle(fd)) {
+        poll::forget(poll::poll_target::FILE, fd);
+
         scheduler::release_handle(fd);
     }
 }
@@ -282,12 +517,12 @@ std::expected<void> vfs::mkdir(const char* file_path) {
 #ifdef THOR_CONFIG_DEBUG_VFS
     logging::logf(logging::log_level::TRACE, "vfs: mkdir: %s \n", file_path);
 
-    for (auto& p : base_path) {
-        logging::logf(logging::log_level::TRACE, "vfs: mkdir base_path: %s\n", p.c_str());
+    for (auto p : base_path) {
+        logging::logf(logging::log_level::TRACE, "vfs: mkdir base_path: %s\n", std::string(p).c_str());
     }
 
-    for (auto& p : fs_path) {
-        logging::logf(logging::log_level::TRACE, "vfs: mkdir fs_path: %s\n", p.c_str());
+    for (auto p : fs_path) {
+        logging::logf(logging::log_level::TRACE, "vfs: mkdir fs_path: %s\n", std::string(p).c_str());
     }
 #endif
 
@@ -305,7 +540,13 @@ std::expected<void> vfs::rm(const char* file_path) {
     auto& fs     = get_fs(base_path);
     auto fs_path = get_fs_path(base_path, fs);
 
+    // The location of the file may be reused once it is removed
+    auto location = cached_location(fs, fs_path);
+
     auto error = fs.file_system->rm(fs_path);
+
+    invalidate_pages(fs, location);
+
     return std::make_expected_zero(error);
 }
 
@@ -334,29 +575,7 @@ std::expected<void> vfs::stat(fd_t fd, vfs::stat_info& info) {
         return std::make_unexpected<void>(result);
     }
 
-    info.size  = f.size;
-    info.flags = 0;
-
-    if (f.directory) {
-        info.flags |= vfs::STAT_FLAG_DIRECTORY;
-    }
-
-    if (f.system) {
-        info.flags |= vfs::STAT_FLAG_SYSTEM;
-    }
-
-    if (f.hidden) {
-        info.flags |= vfs::STAT_FLAG_HIDDEN;
-    }
-
-    // All files starting with a .dot are hidden by default
-    if (fs_path.base_name()[0] == '.') {
-        info.flags |= vfs::STAT_FLAG_HIDDEN;
-    }
-
-    info.created  = f.created;
-    info.modified = f.modified;
-    info.accessed = f.accessed;
+    fill_stat(info, f, fs_path.base_name());
 
     return {};
 }
@@ -372,15 +591,34 @@ std::expected<size_t> vfs::read(fd_t fd, char* buffer, size_t count, size_t offs
         return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_PATH);
     }
 
-    auto& fs     = get_fs(base_path);
-    auto fs_path = get_fs_path(base_path, fs);
+    auto& file = resolve(fd);
+
+    // The contents of the regular files are served by the page cache
+    if (file.cached) {
+        auto result = file.fs->resolve(file);
+
+        if (result) {
+            return std::make_unexpected<size_t>(result);
+        }
+
+        if (!file.directory) {
+            auto cached = page_cache::read({file.fs, file.fs_path, file.location, file.size}, buffer, count, offset);
+
+            if (cached) {
+                scheduler::account_io(*cached, 0);
+            }
+
+            return cached;
+        }
+    }
 
     size_t read = 0;
-    auto result = fs.file_system->read(fs_path, buffer, count, offset, read);
+    auto result = file.fs->read(file, buffer, count, offset, read);
 
     if (result) {
         return std::make_unexpected<size_t>(result);
     } else {
+        scheduler::account_io(read, 0);
         return read;
     }
 }
@@ -405,6 +643,7 @@ std::expected<size_t> vfs::read(fd_t fd, char* buffer, size_t count, size_t offs
     if (result) {
         return std::make_unexpected<size_t>(result);
     } else {
+        scheduler::account_io(read, 0);
         return read;
     }
 }
@@ -413,6 +652,20 @@ std::expected<size_t> vfs::direct_read(const path& base_path, char* buffer, size
     auto& fs     = get_fs(base_path);
     auto fs_path = get_fs_path(base_path, fs);
 
+    // The contents of the regular files are served by the page cache
+    if (fs.fs_type == vfs::partition_type::FAT32) {
+        vfs::file f;
+        auto result = fs.file_system->get_file(fs_path, f);
+
+        if (result) {
+            return std::make_unexpected<size_t>(result);
+        }
+
+        if (!f.directory) {
+            return page_cache::read({fs.file_system, fs_path, f.location, f.size}, buffer, count, offset);
+        }
+    }
+
     size_t read = 0;
     auto result = fs.file_system->read(fs_path, buffer, count, offset, read);
 
@@ -434,19 +687,80 @@ std::expected<size_t> vfs::write(fd_t fd, const char* buffer, size_t count, size
         return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_PATH);
     }
 
-    auto& fs     = get_fs(base_path);
-    auto fs_path = get_fs_path(base_path, fs);
+    auto& file = resolve(fd);
 
     size_t written = 0;
-    auto result    = fs.file_system->write(fs_path, buffer, count, offset, written);
+    auto result    = file.fs->write(file, buffer, count, offset, written);
+
+    invalidate_pages(file);
 
     if (result) {
         return std::make_unexpected<size_t>(result);
     } else {
+        scheduler::account_io(0, written);
         return written;
     }
 }
 
+std::expected<size_t> vfs::readv(fd_t fd, const iovec* vectors, size_t n, size_t offset) {
+    if (n > MAX_IOVECS) {
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    size_t total = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        auto result = read(fd, vectors[i].base, vectors[i].length, offset + total);
+
+        if (!result) {
+            // The bytes already read are still reported
+            if (total) {
+                break;
+            }
+
+            return result;
+        }
+
+        total += *result;
+
+        // The end of the file has been reached
+        if (*result < vectors[i].length) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+std::expected<size_t> vfs::writev(fd_t fd, const iovec* vectors, size_t n, size_t offset) {
+    if (n > MAX_IOVECS) {
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_COUNT);
+    }
+
+    size_t total = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        auto result = write(fd, vectors[i].base, vectors[i].length, offset + total);
+
+        if (!result) {
+            // The bytes already written are still reported
+            if (total) {
+                break;
+            }
+
+            return result;
+        }
+
+        total += *result;
+
+        if (*result < vectors[i].length) {
+            break;
+        }
+    }
+
+    return total;
+}
+
 std::expected<size_t> vfs::clear(fd_t fd, size_t count, size_t offset) {
     if (!scheduler::has_handle(fd)) {
         return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
@@ -458,11 +772,12 @@ std::expected<size_t> vfs::clear(fd_t fd, size_t count, size_t offset) {
         return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_PATH);
     }
 
-    auto& fs     = get_fs(base_path);
-    auto fs_path = get_fs_path(base_path, fs);
+    auto& file = resolve(fd);
 
     size_t written = 0;
-    auto result    = fs.file_system->clear(fs_path, count, offset, written);
+    auto result    = file.fs->clear(file, count, offset, written);
+
+    invalidate_pages(file);
 
     if (result) {
         return std::make_unexpected<size_t>(result);
@@ -475,9 +790,13 @@ std::expected<size_t> vfs::direct_write(const path& base_path, const char* buffe
     auto& fs     = get_fs(base_path);
     auto fs_path = get_fs_path(base_path, fs);
 
+    auto location = cached_location(fs, fs_path);
+
     size_t written = 0;
     auto result    = fs.file_system->write(fs_path, buffer, count, offset, written);
 
+    invalidate_pages(fs, location);
+
     if (result) {
         return std::make_unexpected<size_t>(result);
     } else {
@@ -499,7 +818,12 @@ std::expected<void> vfs::truncate(fd_t fd, size_t size) {
     auto& fs     = get_fs(base_path);
     auto fs_path = get_fs_path(base_path, fs);
 
+    auto location = cached_location(fs, fs_path);
+
     auto result = fs.file_system->truncate(fs_path, size);
+
+    invalidate_pages(fs, location);
+
     return std::make_expected_zero(result);
 }
 
@@ -533,6 +857,83 @@ std::expected<size_t> vfs::direct_read(const path& base_path, std::string& conte
     }
 }
 
+std::expected<poll::source*> vfs::poll_source(fd_t fd) {
+    if (!scheduler::has_handle(fd)) {
+        return std::make_unexpected<poll::source*>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    auto& file = resolve(fd);
+
+    auto* source = file.fs->poll_source(file.fs_path);
+
+    if (!source) {
+        return std::make_unexpected<poll::source*>(std::ERROR_UNSUPPORTED);
+    }
+
+    return source;
+}
+
+std::expected<void> vfs::device_memory(fd_t fd, size_t& physical, size_t& size) {
+    if (!scheduler::has_handle(fd)) {
+        return std::make_unexpected<void>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    auto& file = resolve(fd);
+
+    auto result = file.fs->memory(file.fs_path, physical, size);
+
+    if (result) {
+        return std::make_unexpected<void>(result);
+    }
+
+    return {};
+}
+
+std::expected<void> vfs::cache_source(fd_t fd, page_cache::source& source) {
+    if (!scheduler::has_handle(fd)) {
+        return std::make_unexpected<void>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    return cache_source(scheduler::get_handle(fd), source);
+}
+
+std::expected<void> vfs::cache_source(const path& base_path, page_cache::source& source) {
+    auto& fs        = get_fs(base_path);
+    auto fs_path    = get_fs_path(base_path, fs);
+
+    if (fs_path.is_root()) {
+        return std::make_unexpected<void>(std::ERROR_DIRECTORY);
+    }
+
+    // The other file systems have no stable location for their files
+    if (fs.fs_type != vfs::partition_type::FAT32) {
+        return std::make_unexpected<void>(std::ERROR_UNSUPPORTED);
+    }
+
+    vfs::file f;
+    auto result = fs.file_system->get_file(fs_path, f);
+
+    if (result) {
+        return std::make_unexpected<void>(result);
+    }
+
+    if (f.directory) {
+        return std::make_unexpected<void>(std::ERROR_DIRECTORY);
+    }
+
+    // An empty file has no cluster yet
+    if (!f.size) {
+        return std::make_unexpected<void>(std::ERROR_INVALID_COUNT);
+    }
+
+    source.fs       = fs.file_system;
+    source.fs_path  = fs_path;
+    source.location = f.location;
+    source.size     = f.size;
+
+    return {};
+}
+
 std::expected<size_t> vfs::entries(fd_t fd, char* buffer, size_t size) {
     if (!scheduler::has_handle(fd)) {
         return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
@@ -584,11 +985,65 @@ std::expected<size_t> vfs::entries(fd_t fd, char* buffer, size_t size) {
     return total_size;
 }
 
+std::expected<size_t> vfs::entries_stat(fd_t fd, char* buffer, size_t size) {
+    if (!scheduler::has_handle(fd)) {
+        return std::make_unexpected<size_t>(std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    auto& base_path = scheduler::get_handle(fd);
+    auto& fs        = get_fs(base_path);
+    auto fs_path    = get_fs_path(base_path, fs);
+
+    // The attributes come from the same directory scan as the names
+    std::vector<vfs::file> files;
+    auto result = fs.file_system->ls(fs_path, files);
+
+    if (result > 0) {
+        return -result;
+    }
+
+    size_t total_size = 0;
+
+    for (auto& f : files) {
+        total_size += stat_entry_size(f.file_name.size());
+    }
+
+    if (size < total_size) {
+        return std::make_unexpected<size_t>(std::ERROR_BUFFER_SMALL);
+    }
+
+    size_t position = 0;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto& file = files[i];
+
+        auto entry = reinterpret_cast<vfs::directory_stat_entry*>(buffer + position);
+
+        entry->length = file.file_name.size();
+        fill_stat(entry->info, file, file.file_name);
+
+        if (i + 1 < files.size()) {
+            entry->offset_next = stat_entry_size(file.file_name.size());
+            position += entry->offset_next;
+        } else {
+            entry->offset_next = 0;
+        }
+
+        char* name_buffer = &(entry->name);
+        std::copy(file.file_name.begin(), file.file_name.end(), name_buffer);
+        name_buffer[file.file_name.size()] = '\0';
+    }
+
+    return total_size;
+}
+
 std::expected<size_t> vfs::mounts(char* buffer, size_t size) {
     size_t total_size = 0;
 
-    for (auto& mp : mount_point_list) {
-        total_size += 4 * sizeof(size_t) + 3 + mp.device.string().size() + mp.mount_point.string().size() + partition_type_to_string(mp.fs_type).size();
+    auto list = mounted();
+
+    for (auto* mp : list) {
+        total_size += 4 * sizeof(size_t) + 3 + mp->device.string().size() + mp->mount_point.string().size() + partition_type_to_string(mp->fs_type).size();
     }
 
     if (size < total_size) {
@@ -597,8 +1052,8 @@ std::expected<size_t> vfs::mounts(char* buffer, size_t size) {
 
     size_t position = 0;
 
-    for (size_t i = 0; i < mount_point_list.size(); ++i) {
-        auto& mp = mount_point_list[i];
+    for (size_t i = 0; i < list.size(); ++i) {
+        auto& mp = *list[i];
 
         auto entry = reinterpret_cast<vfs::mount_point*>(buffer + position);
 
@@ -608,7 +1063,7 @@ std::expected<size_t> vfs::mounts(char* buffer, size_t size) {
         entry->length_dev  = mp.device.string().size();
         entry->length_type = fs_type.size();
 
-        if (i + 1 < mount_point_list.size()) {
+        if (i + 1 < list.size()) {
             entry->offset_next = 4 * sizeof(size_t) + 3 + mp.device.string().size() + mp.mount_point.string().size() + fs_type.size();
             position += entry->offset_next;
         } else {
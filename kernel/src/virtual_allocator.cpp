@@ -6,13 +6,15 @@
 //=======================================================================
 
 #include <array.hpp>
+#include <lock_guard.hpp>
 
 #include "virtual_allocator.hpp"
 #include "paging.hpp"
-#include "buddy_allocator.hpp"
 #include "assert.hpp"
 #include "logging.hpp"
 
+#include "conc/int_spinlock.hpp"
+
 #include "fs/sysfs.hpp"
 
 //For problems during boot
@@ -28,23 +30,314 @@ size_t managed_space;
 
 constexpr const size_t unit = paging::PAGE_SIZE;
 
-size_t allocated_pages = first_virtual_address / paging::PAGE_SIZE;
+constexpr const size_t MAX_EXTENTS = 2048; ///< The maximum number of free extents
+
+size_t allocated_pages = 0;
+
+/*!
+ * \brief A free range of virtual memory.
+ *
+ * Each extent is in two treaps, one ordered by address to coalesce the
+ * neighbours and one ordered by size to find the best fit.
+ */
+struct extent {
+    size_t start;          ///< The first address of the extent
+    size_t pages;          ///< The number of pages of the extent
+    uint32_t priority;     ///< The heap priority, in both treaps
+    extent* address_left;  ///< The extents at lower addresses
+    extent* address_right; ///< The extents at higher addresses
+    extent* size_left;     ///< The smaller extents
+    extent* size_right;    ///< The larger extents
+};
+
+/*!
+ * \brief The order of the extents by address
+ */
+struct by_address {
+    static extent*& left(extent* e){
+        return e->address_left;
+    }
+
+    static extent*& right(extent* e){
+        return e->address_right;
+    }
+
+    static bool less(const extent* lhs, const extent* rhs){
+        return lhs->start < rhs->start;
+    }
+};
+
+/*!
+ * \brief The order of the extents by size, then by address
+ */
+struct by_size {
+    static extent*& left(extent* e){
+        return e->size_left;
+    }
+
+    static extent*& right(extent* e){
+        return e->size_right;
+    }
+
+    static bool less(const extent* lhs, const extent* rhs){
+        return lhs->pages < rhs->pages || (lhs->pages == rhs->pages && lhs->start < rhs->start);
+    }
+};
+
+std::array<extent, MAX_EXTENTS> extents;
+
+extent* free_extents = nullptr; ///< The unused extents, chained by address_left
+extent* address_root = nullptr; ///< The root of the address treap
+extent* size_root = nullptr;    ///< The root of the size treap
+size_t used_extents = 0;        ///< The number of free ranges
+
+uint32_t random_state = 2463534242;
+
+int_spinlock allocator_lock;
+
+uint32_t next_priority(){
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/*!
+ * \brief Split the treap in the extents lower than the key and the others
+ */
+template<typename Order>
+void split(extent* root, const extent* key, extent*& lower, extent*& higher){
+    if(!root){
+        lower = higher = nullptr;
+    } else if(Order::less(root, key)){
+        split<Order>(Order::right(root), key, Order::right(root), higher);
+        lower = root;
+    } else {
+        split<Order>(Order::left(root), key, lower, Order::left(root));
+        higher = root;
+    }
+}
+
+/*!
+ * \brief Merge two treaps, all the extents of lower being lower than the higher ones
+ */
+template<typename Order>
+extent* merge(extent* lower, extent* higher){
+    if(!lower || !higher){
+        return lower ? lower : higher;
+    }
+
+    if(lower->priority > higher->priority){
+        Order::right(lower) = merge<Order>(Order::right(lower), higher);
+        return lower;
+    }
+
+    Order::left(higher) = merge<Order>(lower, Order::left(higher));
+    return higher;
+}
+
+template<typename Order>
+void insert(extent*& root, extent* e){
+    Order::left(e) = nullptr;
+    Order::right(e) = nullptr;
+
+    extent* lower;
+    extent* higher;
+    split<Order>(root, e, lower, higher);
+
+    root = merge<Order>(merge<Order>(lower, e), higher);
+}
+
+template<typename Order>
+extent* erase(extent* root, extent* e){
+    if(root == e){
+        return merge<Order>(Order::left(root), Order::right(root));
+    }
+
+    if(Order::less(e, root)){
+        Order::left(root) = erase<Order>(Order::left(root), e);
+    } else {
+        Order::right(root) = erase<Order>(Order::right(root), e);
+    }
+
+    return root;
+}
+
+extent* new_extent(size_t start, size_t pages){
+    auto e = free_extents;
+
+    if(!e){
+        return nullptr;
+    }
+
+    free_extents = e->address_left;
+
+    e->start = start;
+    e->pages = pages;
+    e->priority = next_priority();
+
+    insert<by_address>(address_root, e);
+    insert<by_size>(size_root, e);
 
-constexpr size_t array_size(int block){
-    return (virtual_allocator::kernel_virtual_size / (block * unit) + 1) / (sizeof(uint64_t) * 8) + 1;
+    ++used_extents;
+
+    return e;
+}
+
+void delete_extent(extent* e){
+    address_root = erase<by_address>(address_root, e);
+    size_root = erase<by_size>(size_root, e);
+
+    e->address_left = free_extents;
+    free_extents = e;
+
+    --used_extents;
 }
 
-std::array<uint64_t, array_size(1)> data_bitmap_1;
-std::array<uint64_t, array_size(2)> data_bitmap_2;
-std::array<uint64_t, array_size(4)> data_bitmap_4;
-std::array<uint64_t, array_size(8)> data_bitmap_8;
-std::array<uint64_t, array_size(16)> data_bitmap_16;
-std::array<uint64_t, array_size(32)> data_bitmap_32;
-std::array<uint64_t, array_size(64)> data_bitmap_64;
-std::array<uint64_t, array_size(128)> data_bitmap_128;
+/*!
+ * \brief Change the range of the extent, without changing its order by address
+ */
+void resize_extent(extent* e, size_t start, size_t pages){
+    size_root = erase<by_size>(size_root, e);
 
-typedef buddy_allocator<8, unit> buddy_type;
-buddy_type allocator;
+    e->start = start;
+    e->pages = pages;
+
+    insert<by_size>(size_root, e);
+}
+
+/*!
+ * \brief Returns the smallest extent of at least the given number of pages
+ */
+extent* best_fit(size_t pages){
+    extent* best = nullptr;
+
+    for(auto e = size_root; e;){
+        if(e->pages >= pages){
+            best = e;
+            e = e->size_left;
+        } else {
+            e = e->size_right;
+        }
+    }
+
+    return best;
+}
+
+/*!
+ * \brief Returns the alignment, in bytes, of a block of the given number of pages.
+ *
+ * The blocks are aligned on their size rounded to a power of two, up to a
+ * large page. The slabs are found by alignment and the large blocks can be
+ * mapped with large pages.
+ */
+size_t alignment(size_t pages){
+    size_t align = 1;
+
+    while(align < pages && align < paging::LARGE_PAGE_PAGES){
+        align *= 2;
+    }
+
+    return align * unit;
+}
+
+/*!
+ * \brief Returns the first aligned address of the extent
+ */
+size_t aligned_start(const extent* e, size_t align){
+    return (e->start + align - 1) & ~(align - 1);
+}
+
+bool fits(const extent* e, size_t pages, size_t align){
+    auto start = aligned_start(e, align);
+    return start + pages * unit <= e->start + e->pages * unit;
+}
+
+/*!
+ * \brief Take the given range out of the extent
+ * \return true if the range has been taken, false otherwise
+ */
+bool carve(extent* e, size_t start, size_t pages){
+    auto end = start + pages * unit;
+    auto e_end = e->start + e->pages * unit;
+
+    if(start == e->start){
+        if(end == e_end){
+            delete_extent(e);
+        } else {
+            resize_extent(e, end, (e_end - end) / unit);
+        }
+
+        return true;
+    }
+
+    if(end != e_end && !new_extent(end, (e_end - end) / unit)){
+        return false;
+    }
+
+    resize_extent(e, e->start, (start - e->start) / unit);
+
+    return true;
+}
+
+size_t allocate_pages(size_t pages){
+    auto align = alignment(pages);
+
+    // The best fit may not be aligned, the smallest extent always large
+    // enough once aligned is used instead
+    auto e = best_fit(pages);
+
+    if(e && !fits(e, pages, align)){
+        e = best_fit(pages + align / unit - 1);
+    }
+
+    if(!e){
+        return 0;
+    }
+
+    auto start = aligned_start(e, align);
+
+    if(!carve(e, start, pages)){
+        return 0;
+    }
+
+    return start;
+}
+
+void free_pages(size_t address, size_t pages){
+    // Find the free neighbours
+    extent* prev = nullptr;
+    extent* next = nullptr;
+
+    for(auto e = address_root; e;){
+        if(e->start < address){
+            prev = e;
+            e = e->address_right;
+        } else {
+            next = e;
+            e = e->address_left;
+        }
+    }
+
+    auto end = address + pages * unit;
+
+    bool merge_prev = prev && prev->start + prev->pages * unit == address;
+    bool merge_next = next && next->start == end;
+
+    if(merge_prev && merge_next){
+        auto total = prev->pages + pages + next->pages;
+
+        delete_extent(next);
+        resize_extent(prev, prev->start, total);
+    } else if(merge_prev){
+        resize_extent(prev, prev->start, prev->pages + pages);
+    } else if(merge_next){
+        // The extent stays between the same neighbours
+        resize_extent(next, address, next->pages + pages);
+    } else if(!new_extent(address, pages)){
+        logging::logf(logging::log_level::ERROR, "valloc: No more extents, %u pages at %h are lost\n", pages, address);
+    }
+}
 
 std::string sysfs_free(){
     return std::to_string(virtual_allocator::free());
@@ -58,46 +351,51 @@ std::string sysfs_allocated(){
     return std::to_string(virtual_allocator::allocated());
 }
 
+std::string sysfs_extents(){
+    return std::to_string(used_extents);
+}
+
 } //end of anonymous namespace
 
 void virtual_allocator::init(){
+    allocator_lock.set_name("virtual_allocator");
+
     // The first addressable virtual address is just after the paging structures
     virtual_start = paging::virtual_paging_start + (paging::physical_memory_pages * paging::PAGE_SIZE);
 
-    // Take the next first aligned 1MiB virtual address
-    first_virtual_address = virtual_start % 0x100000 == 0 ? virtual_start : (virtual_start / 0x100000 + 1) * 0x100000;
+    // Take the next first aligned 2MiB virtual address, so that large blocks can be mapped with large pages
+    first_virtual_address = virtual_start % paging::LARGE_PAGE_SIZE == 0 ? virtual_start : (virtual_start / paging::LARGE_PAGE_SIZE + 1) * paging::LARGE_PAGE_SIZE;
     last_virtual_address = virtual_allocator::kernel_virtual_size;
     managed_space = last_virtual_address - first_virtual_address;
 
-    allocator.set_memory_range(first_virtual_address, last_virtual_address);
+    // The memory below the managed space is used by the kernel
+    allocated_pages = first_virtual_address / unit;
 
-    //Give room to the bitmaps
-    allocator.init<0>(array_size(1), data_bitmap_1.data());
-    allocator.init<1>(array_size(2), data_bitmap_2.data());
-    allocator.init<2>(array_size(4), data_bitmap_4.data());
-    allocator.init<3>(array_size(8), data_bitmap_8.data());
-    allocator.init<4>(array_size(16), data_bitmap_16.data());
-    allocator.init<5>(array_size(32), data_bitmap_32.data());
-    allocator.init<6>(array_size(64), data_bitmap_64.data());
-    allocator.init<7>(array_size(128), data_bitmap_128.data());
+    for(auto& e : extents){
+        e.address_left = free_extents;
+        free_extents = &e;
+    }
 
-    allocator.init();
+    new_extent(first_virtual_address, managed_space / unit);
 }
 
 void virtual_allocator::finalize(){
     sysfs::set_dynamic_value(path("/sys/"), path("/memory/virtual/available"), &sysfs_available);
     sysfs::set_dynamic_value(path("/sys/"), path("/memory/virtual/free"), &sysfs_free);
     sysfs::set_dynamic_value(path("/sys/"), path("/memory/virtual/allocated"), &sysfs_allocated);
+    sysfs::set_dynamic_value(path("/sys/"), path("/memory/virtual/extents"), &sysfs_extents);
 }
 
 size_t virtual_allocator::allocate(size_t pages){
-    thor_assert(pages < free() / paging::PAGE_SIZE, "Not enough virtual memory");
+    std::lock_guard<int_spinlock> l(allocator_lock);
 
-    allocated_pages += buddy_type::level_size(pages);
+    thor_assert(pages < free() / paging::PAGE_SIZE, "Not enough virtual memory");
 
-    auto virt = allocator.allocate(pages);
+    auto virt = allocate_pages(pages);
 
-    if(!virt){
+    if(virt){
+        allocated_pages += pages;
+    } else {
         logging::logf(logging::log_level::ERROR, "valloc: Unable to allocate %u pages\n", size_t(pages));
     }
 
@@ -105,9 +403,11 @@ size_t virtual_allocator::allocate(size_t pages){
 }
 
 void virtual_allocator::free(size_t address, size_t pages){
-    allocated_pages -= buddy_type::level_size(pages);
+    std::lock_guard<int_spinlock> l(allocator_lock);
+
+    allocated_pages -= pages;
 
-    allocator.free(address, pages);
+    free_pages(address, pages);
 }
 
 size_t virtual_allocator::available(){
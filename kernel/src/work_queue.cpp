@@ -0,0 +1,248 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <array.hpp>
+#include <string.hpp>
+#include <lock_guard.hpp>
+
+#include "work_queue.hpp"
+#include "scheduler.hpp"
+#include "smp.hpp"
+#include "timer.hpp"
+#include "logging.hpp"
+
+#include "conc/int_lock.hpp"
+#include "conc/int_spinlock.hpp"
+
+#include "fs/sysfs.hpp"
+
+namespace {
+
+/*!
+ * \brief The queue of the worker of a processor
+ */
+struct queue_t {
+    work_queue::work* volatile head = nullptr;  ///< The submitted works, last first
+    work_queue::work* delayed = nullptr;        ///< The delayed works, not ordered
+    int_spinlock delayed_lock;                  ///< Protect the delayed works
+    int_spinlock wait_lock;                     ///< Protect the wake up of the worker
+    volatile bool waiting = false;              ///< Indicates if the worker is waiting for work
+    scheduler::pid_t pid = scheduler::INVALID_PID; ///< The worker process
+};
+
+std::array<queue_t, smp::MAX_CPUS> queues;
+
+volatile size_t executed = 0; ///< The number of works executed by the workers
+
+std::string sysfs_executed(){
+    return std::to_string(executed);
+}
+
+queue_t& select_queue(size_t cpu){
+    // Processors without worker rely on the bootstrap processor
+    if(cpu >= queues.size() || queues[cpu].pid == scheduler::INVALID_PID){
+        return queues[0];
+    }
+
+    return queues[cpu];
+}
+
+void wake_up(queue_t& queue){
+    // The push is a full barrier, a worker that is not seen waiting
+    // yet will see the work before waiting
+    if(!queue.waiting){
+        return;
+    }
+
+    std::lock_guard<int_spinlock> l(queue.wait_lock);
+
+    if(queue.waiting){
+        queue.waiting = false;
+        scheduler::unblock_process_hint(queue.pid);
+    }
+}
+
+void push(queue_t& queue, work_queue::work& w){
+    work_queue::work* head = queue.head;
+
+    do {
+        w.next = head;
+    } while(!__atomic_compare_exchange_n(&queue.head, &head, &w, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    // The push is ordered before the read of the waiting flag
+    wake_up(queue);
+}
+
+/*!
+ * \brief Submit the expired delayed works
+ * \return The number of milliseconds before the next delayed work, 0 if there is none
+ */
+size_t submit_expired(queue_t& queue){
+    std::lock_guard<int_spinlock> l(queue.delayed_lock);
+
+    auto now = timer::milliseconds();
+    size_t next = 0;
+
+    work_queue::work* prev = nullptr;
+    auto w = queue.delayed;
+
+    while(w){
+        auto following = w->next;
+
+        if(w->expires <= now){
+            if(prev){
+                prev->next = following;
+            } else {
+                queue.delayed = following;
+            }
+
+            push(queue, *w);
+        } else {
+            auto remaining = w->expires - now;
+            next = !next || remaining < next ? remaining : next;
+
+            prev = w;
+        }
+
+        w = following;
+    }
+
+    return next;
+}
+
+void run(work_queue::work* list){
+    // The works are pushed in front, reverse them to run them in order
+    work_queue::work* ordered = nullptr;
+
+    while(list){
+        auto next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    while(ordered){
+        auto& w = *ordered;
+        ordered = w.next;
+
+        // The function is allowed to submit the work again
+        w.pending = false;
+        __sync_synchronize();
+
+        w.fun(w.data);
+
+        ++executed;
+    }
+}
+
+void wait_for_work(queue_t& queue, size_t timeout){
+    {
+        std::lock_guard<int_spinlock> l(queue.wait_lock);
+
+        queue.waiting = true;
+        __sync_synchronize();
+
+        // A work may have been pushed before the waiting flag was visible
+        if(queue.head){
+            queue.waiting = false;
+            return;
+        }
+
+        if(timeout){
+            scheduler::block_process_timeout_light(queue.pid, timeout);
+        } else {
+            scheduler::block_process_light(queue.pid);
+        }
+    }
+
+    scheduler::reschedule();
+
+    queue.waiting = false;
+}
+
+void worker_task(void* data){
+    auto& queue = *static_cast<queue_t*>(data);
+
+    while(true){
+        auto timeout = submit_expired(queue);
+
+        auto list = __atomic_exchange_n(&queue.head, nullptr, __ATOMIC_ACQUIRE);
+
+        if(list){
+            run(list);
+        } else {
+            wait_for_work(queue, timeout);
+        }
+    }
+}
+
+void start_worker(size_t cpu){
+    auto& queue = queues[cpu];
+
+    auto name = "worker_" + std::to_string(cpu);
+
+    auto* user_stack = new char[scheduler::user_stack_size];
+    auto* kernel_stack = new char[scheduler::kernel_stack_size];
+
+    auto& process = scheduler::create_kernel_task_args(name.c_str(), user_stack, kernel_stack, &worker_task, &queue);
+    process.ppid = 1;
+    process.priority = scheduler::DEFAULT_PRIORITY;
+
+    queue.pid = process.pid;
+
+    scheduler::queue_system_process(process.pid, cpu);
+
+    logging::logf(logging::log_level::TRACE, "work_queue: worker %u started on processor %u\n", process.pid, cpu);
+}
+
+} //End of anonymous namespace
+
+void work_queue::init(){
+    start_worker(0);
+
+    sysfs::set_dynamic_value(path("/sys"), path("/work_queue/executed"), &sysfs_executed);
+}
+
+void work_queue::init_cpu(size_t cpu){
+    start_worker(cpu);
+}
+
+bool work_queue::submit(work& w){
+    return submit_on(smp::current_cpu(), w);
+}
+
+bool work_queue::submit_on(size_t cpu, work& w){
+    if(!__sync_bool_compare_and_swap(&w.pending, false, true)){
+        return false;
+    }
+
+    push(select_queue(cpu), w);
+
+    return true;
+}
+
+bool work_queue::submit_delayed(work& w, size_t ms){
+    if(!__sync_bool_compare_and_swap(&w.pending, false, true)){
+        return false;
+    }
+
+    auto& queue = select_queue(smp::current_cpu());
+
+    w.expires = timer::milliseconds() + ms;
+
+    {
+        std::lock_guard<int_spinlock> l(queue.delayed_lock);
+
+        w.next = queue.delayed;
+        queue.delayed = &w;
+    }
+
+    // The worker may have to wait for a shorter time
+    wake_up(queue);
+
+    return true;
+}
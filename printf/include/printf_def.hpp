@@ -16,185 +16,203 @@ inline size_t str_cat(char* destination, const char* source){
     return n;
 }
 
-std::string vsprintf(const std::string& format, va_list va){
-    std::string s(format.size());
+// Appends the formatted characters to a string
+struct printf_string_sink {
+    std::string& s;
 
-    char ch;
-    int fi = 0;
+    void put(char c){
+        s += c;
+    }
 
-    while ((ch = format[fi++])) {
-        if(ch != '%'){
-            s += ch;
-        } else {
-            ch = format[fi++];
+    void write(const char* data, size_t n){
+        s.append(data, n);
+    }
 
-            size_t min_width = 0;
-            while(ch >= '0' && ch <= '9'){
-                min_width = 10 * min_width + (ch - '0');
-                ch = format[fi++];
-            }
+    size_t size() const {
+        return s.size();
+    }
+};
+
+// Writes the formatted characters to a fixed buffer, dropping what does
+// not fit. The size counts the dropped characters too, so that the widths
+// are computed the same way as for a string.
+struct printf_buffer_sink {
+    char* buffer;
+    size_t capacity; // Without the terminating character
+    size_t i;
+
+    void put(char c){
+        if(i < capacity){
+            buffer[i] = c;
+        }
 
-            size_t min_digits = 0;
-            if(ch == '.'){
-                ch = format[fi++];
+        ++i;
+    }
 
-                while(ch >= '0' && ch <= '9'){
-                    min_digits = 10 * min_digits + (ch - '0');
-                    ch = format[fi++];
-                }
-            }
+    void write(const char* data, size_t n){
+        if(i < capacity){
+            std::copy_n(data, std::min(n, capacity - i), buffer + i);
+        }
 
-            auto prev = s.size();
+        i += n;
+    }
 
-            //Signed decimal
-            if(ch == 'd'){
-                int64_t arg = va_arg(va, int64_t);
+    size_t size() const {
+        return i;
+    }
+};
 
-                if(min_digits > 0){
-                    size_t d = std::digits(arg);
-                    if(min_digits > d){
-                        min_digits -= d;
+template<typename Sink>
+void printf_digits(Sink& sink, const char* first, const char* last, size_t min_digits){
+    size_t d = last - first;
 
-                        if(arg < 0){
-                            arg *= -1;
-                            s += '-';
-                        }
+    while(min_digits > d){
+        sink.put('0');
+        --min_digits;
+    }
 
-                        while(min_digits > 0){
-                            s += '0';
-                            --min_digits;
-                        }
-                    }
-                }
+    sink.write(first, d);
+}
 
-                s += std::to_string(arg);
-            }
-            //Unsigned Decimal
-            else if(ch == 'u'){
-                uint64_t arg = va_arg(va, uint64_t);
-
-                if(min_digits > 0){
-                    size_t d = std::digits(arg);
-                    if(min_digits > d){
-                        min_digits -= d;
-                        while(min_digits > 0){
-                            s += '0';
-                            --min_digits;
-                        }
-                    }
-                }
-
-                s += std::to_string(arg);
-            }
-            //Hexadecimal
-            else if(ch == 'h' || ch == 'x' || ch == 'p'){
-                if(ch == 'h' || ch == 'p'){
-                    s += "0x";
-                }
-
-                uint8_t buffer[20];
-
-                uint64_t arg = va_arg(va, uint64_t);
-                size_t i = 0;
-
-                while(arg / 16 != 0){
-                    buffer[i++] = arg % 16;
-                    arg /= 16;
-                }
-
-                buffer[i] = arg;
-
-                if(min_digits > 0 && min_digits > i){
-                    min_digits -= i + 1;
-                    while(min_digits > 0){
-                        arg += '0';
-                        --min_digits;
-                    }
-                }
-
-                while(true){
-                    uint8_t digit = buffer[i];
-
-                    if(digit < 10){
-                        s += static_cast<char>('0' + digit);
-                    } else {
-                        switch(digit){
-                        case 10:
-                            s += 'A';
-                            break;
-                        case 11:
-                            s += 'B';
-                            break;
-                        case 12:
-                            s += 'C';
-                            break;
-                        case 13:
-                            s += 'D';
-                            break;
-                        case 14:
-                            s += 'E';
-                            break;
-                        case 15:
-                            s += 'F';
-                            break;
-                        }
-                    }
-
-                    if(i == 0){
-                        break;
-                    }
-
-                    --i;
-                }
+template<typename Sink>
+void printf_str(Sink& sink, const char* s){
+    sink.write(s, std::str_len(s));
+}
+
+template<typename Sink>
+void printf_format(Sink& sink, const char* format, va_list va){
+    char digits[std::MAX_DECIMAL_DIGITS];
+    char* const digits_end = digits + std::MAX_DECIMAL_DIGITS;
+
+    while(*format) {
+        // Copy the characters up to the next conversion at once
+        auto literal = format;
+        while(*format && *format != '%'){
+            ++format;
+        }
+
+        if(format != literal){
+            sink.write(literal, format - literal);
+        }
+
+        if(!*format){
+            break;
+        }
+
+        char ch = *++format;
+
+        // A conversion truncated by the end of the format prints nothing
+        if(!ch){
+            break;
+        }
+
+        ++format;
+
+        size_t min_width = 0;
+        while(ch >= '0' && ch <= '9'){
+            min_width = 10 * min_width + (ch - '0');
+            ch = *format++;
+        }
+
+        size_t min_digits = 0;
+        if(ch == '.'){
+            ch = *format++;
+
+            while(ch >= '0' && ch <= '9'){
+                min_digits = 10 * min_digits + (ch - '0');
+                ch = *format++;
             }
-            //Memory
-            else if(ch == 'm'){
-                uint64_t memory= va_arg(va, uint64_t);
-
-                if(memory >= 1024 * 1024 * 1024){
-                    s += std::to_string(memory / (1024 * 1024 * 1024));
-                    s += "GiB";
-                } else if(memory >= 1024 * 1024){
-                    s += std::to_string(memory / (1024 * 1024));
-                    s += "MiB";
-                } else if(memory >= 1024){
-                    s += std::to_string(memory / 1024);
-                    s += "KiB";
-                } else {
-                    s += std::to_string(memory);
-                    s += "B";
-                }
+        }
+
+        if(!ch){
+            break;
+        }
+
+        auto prev = sink.size();
+
+        //Signed decimal
+        if(ch == 'd'){
+            int64_t arg = va_arg(va, int64_t);
+
+            if(arg < 0){
+                sink.put('-');
             }
-            // Boolean
-            else if(ch == 'b'){
-                bool value= va_arg(va, int);
-
-                if(value){
-                    s += "true";
-                } else {
-                    s += "false";
-                }
+
+            // The magnitude of the smallest value does not fit in int64_t
+            auto magnitude = arg < 0 ? 0 - static_cast<uint64_t>(arg) : static_cast<uint64_t>(arg);
+
+            printf_digits(sink, std::format_decimal(magnitude, digits_end), digits_end, min_digits);
+        }
+        //Unsigned Decimal
+        else if(ch == 'u'){
+            uint64_t arg = va_arg(va, uint64_t);
+
+            printf_digits(sink, std::format_decimal(arg, digits_end), digits_end, min_digits);
+        }
+        //Hexadecimal
+        else if(ch == 'h' || ch == 'x' || ch == 'p'){
+            if(ch == 'h' || ch == 'p'){
+                sink.write("0x", 2);
             }
-            //String
-            else if(ch == 's'){
-                const char* arg = va_arg(va, const char*);
-                s += arg;
+
+            uint64_t arg = va_arg(va, uint64_t);
+
+            printf_digits(sink, std::format_hex(arg, digits_end), digits_end, min_digits);
+        }
+        //Memory
+        else if(ch == 'm'){
+            uint64_t memory= va_arg(va, uint64_t);
+
+            const char* unit;
+
+            if(memory >= 1024 * 1024 * 1024){
+                memory /= 1024 * 1024 * 1024;
+                unit = "GiB";
+            } else if(memory >= 1024 * 1024){
+                memory /= 1024 * 1024;
+                unit = "MiB";
+            } else if(memory >= 1024){
+                memory /= 1024;
+                unit = "KiB";
+            } else {
+                unit = "B";
             }
 
-            if(min_width > 0){
-                size_t width = s.size() - prev;
+            printf_digits(sink, std::format_decimal(memory, digits_end), digits_end, 0);
+            printf_str(sink, unit);
+        }
+        // Boolean
+        else if(ch == 'b'){
+            bool value= va_arg(va, int);
+
+            if(value){
+                sink.write("true", 4);
+            } else {
+                sink.write("false", 5);
+            }
+        }
+        //String
+        else if(ch == 's'){
+            const char* arg = va_arg(va, const char*);
+            printf_str(sink, arg);
+        }
 
-                if(min_width > width){
-                    min_width -= width;
+        if(min_width > 0){
+            size_t width = sink.size() - prev;
 
-                    while(min_width > 0){
-                        s += ' ';
-                        --min_width;
-                    }
-                }
+            while(min_width > width){
+                sink.put(' ');
+                --min_width;
             }
         }
     }
+}
+
+std::string vsprintf(const std::string& format, va_list va){
+    std::string s(format.size());
+
+    printf_string_sink sink{s};
+    printf_format(sink, format.c_str(), va);
 
     return std::move(s);
 }
@@ -225,199 +243,15 @@ void printf(const std::string& format, ...){
 
 // Raw versions
 
-//TODO Check for n
-void vsprintf_raw(char* out_buffer, size_t /*n*/, const char* format, va_list va){
-    char ch;
-    int fi = 0;
-
-    size_t out_i = 0;
-
-    while ((ch = format[fi++])) {
-        if(ch != '%'){
-            out_buffer[out_i++] = ch;
-        } else {
-            ch = format[fi++];
-
-            size_t min_width = 0;
-            while(ch >= '0' && ch <= '9'){
-                min_width = 10 * min_width + (ch - '0');
-                ch = format[fi++];
-            }
-
-            size_t min_digits = 0;
-            if(ch == '.'){
-                ch = format[fi++];
-
-                while(ch >= '0' && ch <= '9'){
-                    min_digits = 10 * min_digits + (ch - '0');
-                    ch = format[fi++];
-                }
-            }
-
-            auto prev = out_i;
-
-            //Signed decimal
-            if(ch == 'd'){
-                int64_t arg = va_arg(va, int64_t);
-
-                if(min_digits > 0){
-                    size_t d = std::digits(arg);
-                    if(min_digits > d){
-                        min_digits -= d;
-
-                        if(arg < 0){
-                            arg *= -1;
-                            out_buffer[out_i++] = '-';
-                        }
-
-                        while(min_digits > 0){
-                            out_buffer[out_i++] = '0';
-                            --min_digits;
-                        }
-                    }
-                }
-
-                char buffer[32];
-                std::to_raw_string(arg, buffer, 32);
-                out_i += str_cat(out_buffer + out_i, buffer);
-            }
-            //Unsigned Decimal
-            else if(ch == 'u'){
-                uint64_t arg = va_arg(va, uint64_t);
-
-                if(min_digits > 0){
-                    size_t d = std::digits(arg);
-                    if(min_digits > d){
-                        min_digits -= d;
-                        while(min_digits > 0){
-                            out_buffer[out_i++] = '0';
-                            --min_digits;
-                        }
-                    }
-                }
-
-                char buffer[32];
-                std::to_raw_string(arg, buffer, 32);
-                out_i += str_cat(out_buffer + out_i, buffer);
-            }
-            //Hexadecimal
-            else if(ch == 'h' || ch == 'x' || ch == 'p'){
-                if(ch == 'h' || ch == 'p'){
-                    out_buffer[out_i++] = '0';
-                    out_buffer[out_i++] = 'x';
-                }
-
-                uint8_t buffer[20];
-
-                uint64_t arg = va_arg(va, uint64_t);
-                size_t i = 0;
-
-                while(arg / 16 != 0){
-                    buffer[i++] = arg % 16;
-                    arg /= 16;
-                }
-
-                buffer[i] = arg;
-
-                if(min_digits > 0 && min_digits > i){
-                    min_digits -= i + 1;
-                    while(min_digits > 0){
-                        out_buffer[out_i++] = '0';
-                        --min_digits;
-                    }
-                }
-
-                while(true){
-                    uint8_t digit = buffer[i];
-
-                    if(digit < 10){
-                        out_buffer[out_i++] = static_cast<char>('0' + digit);
-                    } else {
-                        switch(digit){
-                        case 10:
-                            out_buffer[out_i++] = 'A';
-                            break;
-                        case 11:
-                            out_buffer[out_i++] = 'B';
-                            break;
-                        case 12:
-                            out_buffer[out_i++] = 'C';
-                            break;
-                        case 13:
-                            out_buffer[out_i++] = 'D';
-                            break;
-                        case 14:
-                            out_buffer[out_i++] = 'E';
-                            break;
-                        case 15:
-                            out_buffer[out_i++] = 'F';
-                            break;
-                        }
-                    }
-
-                    if(i == 0){
-                        break;
-                    }
-
-                    --i;
-                }
-            }
-            //Memory
-            else if(ch == 'm'){
-                uint64_t memory= va_arg(va, uint64_t);
-
-                char buffer[32];
-
-                if(memory >= 1024 * 1024 * 1024){
-                    std::to_raw_string(memory / (1024 * 1024 * 1024), buffer, 32);
-                    out_i += str_cat(out_buffer + out_i, buffer);
-                    out_i += str_cat(out_buffer + out_i, "GiB");
-                } else if(memory >= 1024 * 1024){
-                    std::to_raw_string(memory / (1024 * 1024), buffer, 32);
-                    out_i += str_cat(out_buffer + out_i, buffer);
-                    out_i += str_cat(out_buffer + out_i, "MiB");
-                } else if(memory >= 1024){
-                    std::to_raw_string(memory / 1024, buffer, 32);
-                    out_i += str_cat(out_buffer + out_i, buffer);
-                    out_i += str_cat(out_buffer + out_i, "KiB");
-                } else {
-                    std::to_raw_string(memory, buffer, 32);
-                    out_i += str_cat(out_buffer + out_i, buffer);
-                    out_i += str_cat(out_buffer + out_i, "B");
-                }
-            }
-            // Boolean
-            else if(ch == 'b'){
-                bool value= va_arg(va, int);
-
-                if(value){
-                    out_i += str_cat(out_buffer + out_i, "true");
-                } else {
-                    out_i += str_cat(out_buffer + out_i, "false");
-                }
-            }
-            //String
-            else if(ch == 's'){
-                const char* arg = va_arg(va, const char*);
-                out_i += str_cat(out_buffer + out_i, arg);
-            }
-
-            if(min_width > 0){
-                size_t width = out_i - prev;
-
-                if(min_width > width){
-                    min_width -= width;
-
-                    while(min_width > 0){
-                        out_buffer[out_i++] = ' ';
-                        --min_width;
-                    }
-                }
-            }
-        }
+void vsprintf_raw(char* out_buffer, size_t n, const char* format, va_list va){
+    if(!n){
+        return;
     }
 
-    out_buffer[out_i++] = '\0';
+    printf_buffer_sink sink{out_buffer, n - 1, 0};
+    printf_format(sink, format, va);
+
+    out_buffer[std::min(sink.size(), n - 1)] = '\0';
 }
 
 void sprintf_raw(char* buffer, size_t n, const char* format, ...){
@@ -5,90 +5,471 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <vector.hpp>
+#include <deque.hpp>
+#include <algorithms.hpp>
+
 #include <tlib/print.hpp>
 #include <tlib/system.hpp>
+#include <tlib/checksum.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/file.hpp>
+#include <tlib/malloc.hpp>
 
 constexpr const size_t PAGES = 512;
+constexpr const size_t SYSCALLS = 100;
+constexpr const size_t SORT_VALUES = 100000;
+constexpr const size_t CONTAINER_VALUES = 100000;
+constexpr const size_t SWITCHES = 100;
+constexpr const size_t ALLOCATIONS = 100;
+constexpr const size_t FAULT_PAGES = 64;
+constexpr const size_t PIPE_CHUNK = 4096;
+constexpr const size_t PIPE_BYTES = 256 * 1024;
+
+constexpr const size_t WARMUP = 3;    ///< The number of runs before the measures
+constexpr const size_t SAMPLES = 101; ///< The number of measured runs of the fast benchmarks
+constexpr const size_t SLOW_SAMPLES = 21; ///< The number of measured runs of the slow benchmarks
 
 namespace {
 
-size_t repeat = 1;
+/*!
+ * \brief Run the functor WARMUP times, then measure each of the runs.
+ *
+ * The setup functor prepares the state of each run, outside of the measure.
+ *
+ * \return The sorted durations of the runs, in nanoseconds
+ */
+template<typename S, typename F>
+std::vector<uint64_t> measure(size_t runs, S setup, F functor){
+    std::vector<uint64_t> durations;
+    durations.reserve(runs);
+
+    for(size_t i = 0; i < WARMUP; ++i){
+        setup();
+        functor();
+    }
+
+    for(size_t i = 0; i < runs; ++i){
+        setup();
 
-bool display_result(const char* name, uint64_t duration){
-    if(!duration){
-        repeat *= 2;
-        tlib::printf("%s was too fast (duration=0) increasing repeat to %u\n", name, repeat);
-        return false;
+        auto start = tlib::ns_time();
+        functor();
+        durations.push_back(tlib::ns_time() - start);
     }
 
-    uint64_t throughput = 1000 * ((repeat * PAGES * 4096) / duration);
+    std::sort(durations.begin(), durations.end());
+
+    return std::move(durations);
+}
+
+template<typename F>
+std::vector<uint64_t> measure(size_t runs, F functor){
+    return measure(runs, [](){}, functor);
+}
+
+uint64_t median(const std::vector<uint64_t>& durations){
+    return durations[durations.size() / 2];
+}
+
+uint64_t p99(const std::vector<uint64_t>& durations){
+    return durations[(durations.size() * 99) / 100];
+}
+
+// The durations are for ops operations, the latencies are for one
+void report_latency(const char* name, const std::vector<uint64_t>& durations, size_t ops){
+    tlib::printf("%s: min %uns median %uns p99 %uns\n", name,
+        durations.front() / ops, median(durations) / ops, p99(durations) / ops);
+
+    tlib::log_result("bench", name, "median_ns", median(durations) / ops);
+    tlib::log_result("bench", name, "p99_ns", p99(durations) / ops);
+}
+
+// The durations are for bytes bytes, the bandwidth is the one of the median
+void report_bandwidth(const char* name, const std::vector<uint64_t>& durations, size_t bytes){
+    auto duration = std::max(median(durations), uint64_t(1));
+    uint64_t throughput = (1000000000 * bytes) / duration;
+
+    tlib::printf("%s: min %uus median %uus p99 %uus bandwidth: ", name,
+        durations.front() / 1000, median(durations) / 1000, p99(durations) / 1000);
+
+    tlib::log_result("bench", name, "kib_s", throughput / 1024);
 
     if(throughput > (1024 * 1024)){
-        tlib::printf("%s: %ums bandwith: %uMiB/s\n", name, duration, throughput / (1024 * 1024));
+        tlib::printf("%uMiB/s\n", throughput / (1024 * 1024));
     } else if(throughput > 1024){
-        tlib::printf("%s: %ums bandwith: %uKiB/s\n", name, duration, throughput / 1024);
+        tlib::printf("%uKiB/s\n", throughput / 1024);
     } else {
-        tlib::printf("%s: %ums bandwith: %uB/s\n", name, duration, throughput);
+        tlib::printf("%uB/s\n", throughput);
     }
+}
 
-    return true;
+// The legacy interrupt entry, to compare with the SYSCALL entry of tlib
+size_t int_get_pid(){
+    size_t value;
+    asm volatile("mov rax, 0x3; int 50; mov %[value], rax"
+        : [value] "=m" (value)
+        : //No inputs
+        : "rax");
+    return value;
 }
 
-} // end of anonymous namespace
+// The byte at a time checksum, as a reference
+uint32_t bytes_checksum(const char* values, size_t length){
+    auto raw_values = reinterpret_cast<const uint8_t*>(values);
 
-int main(){
-    char* buffer_one = new char[PAGES * 4096];
-    char* buffer_two = new char[PAGES * 4096];
+    uint32_t sum = 0;
+
+    for(size_t i = 0; i < length; ++i){
+        if(i & 1){
+            sum += static_cast<uint32_t>(raw_values[i]);
+        } else {
+            sum += static_cast<uint32_t>(raw_values[i]) << 8;
+        }
+    }
+
+    return sum;
+}
+
+// Sum the buffer in packets of the given size
+template<typename F>
+void bench_checksum(const char* name, size_t packet, F functor){
+    auto durations = measure(SAMPLES, [&](){
+        for(size_t offset = 0; offset + packet <= PAGES * 4096; offset += packet){
+            functor(offset, packet);
+        }
+    });
+
+    report_bandwidth(name, durations, PAGES * 4096);
+}
 
-    tlib::printf("Start benchmark...\n");
+// Run the functor on the whole buffer
+template<typename F>
+void bench_memory(const char* name, F functor){
+    report_bandwidth(name, measure(SAMPLES, functor), PAGES * 4096);
+}
 
-    uint64_t start = 0, end = 0;
+// Sort copies of the values, the duration is for one sort
+template<typename F>
+void bench_sort(const char* name, const std::vector<uint32_t>& values, F functor){
+    std::vector<uint32_t> copy;
 
-    while(repeat < 100){
-        start = tlib::ms_time();
+    auto durations = measure(SLOW_SAMPLES, [&](){ copy = values; }, [&](){ functor(copy); });
 
-        for(size_t i = 0; i < repeat; ++i){
-            std::copy_n(buffer_two, PAGES * 4096, buffer_one);
+    report_latency(name, durations, 1);
+}
+
+template<typename C>
+void fill_values(C& c){
+    for(size_t i = 0; i < CONTAINER_VALUES; ++i){
+        c.push_back(i);
+    }
+}
+
+// A queue of 64 values, pushed at the back and removed from the front
+template<typename C>
+void queue_values(C& c){
+    for(size_t i = 0; i < CONTAINER_VALUES; ++i){
+        c.push_back(i);
+
+        if(c.size() > 64){
+            c.erase(c.begin());
         }
+    }
+}
 
-        end = tlib::ms_time();
+template<>
+void queue_values(std::deque<size_t>& c){
+    for(size_t i = 0; i < CONTAINER_VALUES; ++i){
+        c.push_back(i);
 
-        if(display_result("copy", end - start)){
-            break;
+        if(c.size() > 64){
+            c.pop_front();
         }
     }
+}
+
+// Run the functor on a new container, the duration is for one run
+template<typename C, typename F>
+void bench_container(const char* name, F functor){
+    C container;
 
-    repeat = 1;
+    auto durations = measure(SLOW_SAMPLES, [&](){ container = C(); }, [&](){ functor(container); });
 
-    while(repeat < 100){
-        start = tlib::ms_time();
+    report_latency(name, durations, 1);
+}
 
-        for(size_t i = 0; i < repeat; ++i){
-            std::fill_n(buffer_two, PAGES * 4096, 'Z');
+template<typename F>
+void bench_syscall(const char* name, F functor){
+    auto durations = measure(SAMPLES, [&](){
+        for(size_t i = 0; i < SYSCALLS; ++i){
+            functor();
         }
+    });
+
+    report_latency(name, durations, SYSCALLS);
+}
+
+// The child yields back to the parent, each yield of the parent is a
+// round trip through the child. Both processes must run on the same core
+// for the yields to switch between them.
+void bench_context_switch(){
+    auto pid = tlib::fork();
 
-        end = tlib::ms_time();
+    if(!pid){
+        tlib::printf("context switch: fork error: %s\n", std::error_message(pid.error()));
+        return;
+    }
 
-        if(display_result("fill", end - start)){
-            break;
+    if(!*pid){
+        // Yield more than the parent, the trailing yields return at once
+        for(size_t i = 0; i < 2 * (WARMUP + SAMPLES) * SWITCHES; ++i){
+            tlib::yield();
         }
+
+        tlib::exit(0);
     }
 
-    repeat = 1;
+    auto durations = measure(SAMPLES, [](){
+        for(size_t i = 0; i < SWITCHES; ++i){
+            tlib::yield();
+        }
+    });
+
+    tlib::await_termination(*pid);
+
+    report_latency("context switch (yield round trip)", durations, SWITCHES);
+}
+
+// The program itself is executed, it exits at once with the --exit argument
+void bench_exec(){
+    std::vector<std::string> params;
+    params.push_back("--exit");
+
+    auto durations = measure(SLOW_SAMPLES, [&](){
+        auto result = tlib::exec_and_wait("/bin/bench", params);
+
+        if(!result){
+            tlib::printf("exec: error: %s\n", std::error_message(result.error()));
+        }
+    });
 
-    while(repeat < 100){
-        start = tlib::ms_time();
+    report_latency("exec + await", durations, 1);
+}
 
-        for(size_t i = 0; i < repeat; ++i){
-            std::fill_n(buffer_two, PAGES * 4096, 0);
+// Grow the heap a page at a time, then give it back in one call
+void bench_sbrk(){
+    auto durations = measure(SAMPLES, [](){
+        for(size_t i = 0; i < ALLOCATIONS; ++i){
+            tlib::sbrk(4096);
         }
 
-        end = tlib::ms_time();
+        tlib::brk_release(ALLOCATIONS * 4096);
+    });
+
+    report_latency("sbrk (4KiB) + brk_release", durations, ALLOCATIONS);
+}
+
+// Allocate ALLOCATIONS blocks of the given size, then free them
+void bench_malloc(const char* name, size_t size){
+    void* pointers[ALLOCATIONS];
 
-        if(display_result("clear", end - start)){
-            break;
+    auto durations = measure(SAMPLES, [&](){
+        for(size_t i = 0; i < ALLOCATIONS; ++i){
+            pointers[i] = tlib::malloc(size);
         }
+
+        for(size_t i = 0; i < ALLOCATIONS; ++i){
+            tlib::free(pointers[i]);
+        }
+    });
+
+    report_latency(name, durations, ALLOCATIONS);
+}
+
+// The heap pages are mapped on their first write, each write of a new page
+// of the heap is a page fault
+void bench_page_fault(){
+    char* pages = nullptr;
+
+    auto durations = measure(SAMPLES, [&](){
+        pages = reinterpret_cast<char*>(tlib::brk_end());
+        tlib::sbrk(FAULT_PAGES * 4096);
+    }, [&](){
+        for(size_t i = 0; i < FAULT_PAGES; ++i){
+            *static_cast<volatile char*>(pages + i * 4096) = 1;
+        }
+
+        tlib::brk_release(FAULT_PAGES * 4096);
+    });
+
+    report_latency("page fault (heap, with release)", durations, FAULT_PAGES);
+}
+
+// The child writes the bytes of all the runs to the pipe, each run reads
+// PIPE_BYTES of them
+void bench_pipe(){
+    size_t read_fd;
+    size_t write_fd;
+
+    auto status = tlib::pipe(read_fd, write_fd);
+
+    if(!status){
+        tlib::printf("pipe: error: %s\n", std::error_message(status.error()));
+        return;
+    }
+
+    auto pid = tlib::fork();
+
+    if(!pid){
+        tlib::printf("pipe: fork error: %s\n", std::error_message(pid.error()));
+        return;
+    }
+
+    char chunk[PIPE_CHUNK];
+    std::fill_n(chunk, PIPE_CHUNK, 'P');
+
+    if(!*pid){
+        tlib::close(read_fd);
+
+        for(size_t i = 0; i < (WARMUP + SLOW_SAMPLES) * (PIPE_BYTES / PIPE_CHUNK); ++i){
+            if(!tlib::write(write_fd, chunk, PIPE_CHUNK)){
+                break;
+            }
+        }
+
+        tlib::close(write_fd);
+        tlib::exit(0);
+    }
+
+    tlib::close(write_fd);
+
+    auto durations = measure(SLOW_SAMPLES, [&](){
+        size_t remaining = PIPE_BYTES;
+
+        while(remaining){
+            auto result = tlib::read(read_fd, chunk, std::min(remaining, PIPE_CHUNK));
+
+            if(!result || !*result){
+                break;
+            }
+
+            remaining -= *result;
+        }
+    });
+
+    tlib::close(read_fd);
+    tlib::await_termination(*pid);
+
+    report_bandwidth("pipe (4KiB writes)", durations, PIPE_BYTES);
+}
+
+// The durations include the wake up latency of the timer
+void bench_sleep(const char* name, size_t ms){
+    auto durations = measure(SLOW_SAMPLES, [ms](){ tlib::sleep_ms(ms); });
+
+    tlib::printf("%s: min %uus median %uus p99 %uus\n", name,
+        durations.front() / 1000, median(durations) / 1000, p99(durations) / 1000);
+
+    tlib::log_result("bench", name, "median_us", median(durations) / 1000);
+    tlib::log_result("bench", name, "p99_us", p99(durations) / 1000);
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]){
+    // Executed by the exec benchmark
+    if(argc > 1 && std::string(argv[1]) == "--exit"){
+        return 0;
+    }
+
+    char* buffer_one = new char[PAGES * 4096];
+    char* buffer_two = new char[PAGES * 4096];
+
+    tlib::printf("Start benchmark (%u warmup runs, %u or %u measured runs)...\n", WARMUP, SAMPLES, SLOW_SAMPLES);
+
+    bench_syscall("null syscall (syscall)", [](){ tlib::get_pid(); });
+    bench_syscall("null syscall (int 50)", [](){ int_get_pid(); });
+
+    bench_context_switch();
+    bench_exec();
+
+    bench_sbrk();
+    bench_malloc("malloc/free (16B)", 16);
+    bench_malloc("malloc/free (256B)", 256);
+    bench_malloc("malloc/free (4KiB)", 4096);
+    bench_malloc("malloc/free (64KiB)", 65536);
+    bench_page_fault();
+
+    bench_pipe();
+
+    bench_sleep("sleep (1ms)", 1);
+    bench_sleep("sleep (10ms)", 10);
+
+    bench_memory("copy", [&](){ std::copy_n(buffer_two, PAGES * 4096, buffer_one); });
+    bench_memory("fill", [&](){ std::fill_n(buffer_two, PAGES * 4096, 'Z'); });
+    bench_memory("clear", [&](){ std::fill_n(buffer_two, PAGES * 4096, 0); });
+    // Each tier of the memory operations, on the whole buffer
+    bench_memory("copy words", [&](){ std::mem::copy_words(buffer_one, buffer_two, PAGES * 4096); });
+    bench_memory("copy sse", [&](){ std::mem::copy_sse(buffer_one, buffer_two, PAGES * 4096); });
+    bench_memory("copy stream", [&](){ std::mem::copy_stream(buffer_one, buffer_two, PAGES * 4096); });
+    bench_memory("fill words", [&](){ std::mem::fill_words(buffer_two, 'Z', PAGES * 4096); });
+    bench_memory("fill sse", [&](){ std::mem::fill_sse(buffer_two, 'Z', PAGES * 4096); });
+    bench_memory("fill stream", [&](){ std::mem::fill_stream(buffer_two, 'Z', PAGES * 4096); });
+
+    if(std::mem::has_erms()){
+        bench_memory("copy rep movsb", [&](){ std::mem::copy_rep(buffer_one, buffer_two, PAGES * 4096); });
+        bench_memory("fill rep stosb", [&](){ std::mem::fill_rep(buffer_two, 'Z', PAGES * 4096); });
+    } else {
+        tlib::printf("rep movsb/stosb: no ERMS\n");
     }
 
+    for(size_t i = 0; i < PAGES * 4096; ++i){
+        buffer_two[i] = i * 7;
+    }
+
+    volatile uint64_t sink = 0;
+
+    bench_checksum("checksum bytes (1500B)", 1500, [&](size_t offset, size_t length){ sink += bytes_checksum(buffer_two + offset, length); });
+    bench_checksum("checksum words (1500B)", 1500, [&](size_t offset, size_t length){ sink += tlib::checksum_partial(buffer_two + offset, length); });
+    bench_checksum("checksum copy (1500B)", 1500, [&](size_t offset, size_t length){ sink += tlib::checksum_copy_partial(buffer_one + offset, buffer_two + offset, length); });
+    bench_checksum("checksum bytes (64KiB)", 65536, [&](size_t offset, size_t length){ sink += bytes_checksum(buffer_two + offset, length); });
+    bench_checksum("checksum words (64KiB)", 65536, [&](size_t offset, size_t length){ sink += tlib::checksum_partial(buffer_two + offset, length); });
+    bench_checksum("checksum copy (64KiB)", 65536, [&](size_t offset, size_t length){ sink += tlib::checksum_copy_partial(buffer_one + offset, buffer_two + offset, length); });
+
+    // The two implementations must agree
+    auto words = tlib::checksum_fold_partial(tlib::checksum_partial(buffer_two, 1501));
+    auto bytes = bytes_checksum(buffer_two, 1501);
+
+    while(bytes >> 16){
+        bytes = (bytes & 0xFFFF) + (bytes >> 16);
+    }
+
+    if(uint16_t((words >> 8) | (words << 8)) != bytes){
+        tlib::printf("checksum mismatch: %h != %h\n", size_t(words), size_t(bytes));
+    }
+
+    std::vector<uint32_t> random_values;
+    std::vector<uint32_t> sorted_values;
+
+    uint32_t seed = 42;
+
+    for(size_t i = 0; i < SORT_VALUES; ++i){
+        seed = seed * 1103515245 + 12345;
+
+        random_values.push_back(seed >> 8);
+        sorted_values.push_back(i);
+    }
+
+    bench_sort("sort (random)", random_values, [](std::vector<uint32_t>& v){ std::sort(v.begin(), v.end()); });
+    bench_sort("sort (sorted)", sorted_values, [](std::vector<uint32_t>& v){ std::sort(v.begin(), v.end()); });
+    bench_sort("stable_sort (random)", random_values, [](std::vector<uint32_t>& v){ std::stable_sort(v.begin(), v.end()); });
+    bench_sort("partial_sort (random, 1%)", random_values, [](std::vector<uint32_t>& v){ std::partial_sort(v.begin(), v.begin() + v.size() / 100, v.end()); });
+    bench_sort("nth_element (random)", random_values, [](std::vector<uint32_t>& v){ std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end()); });
+
+    bench_container<std::vector<size_t>>("vector push_back", &fill_values<std::vector<size_t>>);
+    bench_container<std::deque<size_t>>("deque push_back", &fill_values<std::deque<size_t>>);
+    bench_container<std::vector<size_t>>("vector queue (erase front)", &queue_values<std::vector<size_t>>);
+    bench_container<std::deque<size_t>>("deque queue (pop_front)", &queue_values<std::deque<size_t>>);
+
     return 0;
 }
@@ -9,11 +9,37 @@
 #include <tlib/system.hpp>
 #include <tlib/errors.hpp>
 #include <tlib/print.hpp>
+#include <tlib/stream.hpp>
+
+namespace {
+
+constexpr const size_t copy_size = 4096; ///< The bytes copied from the standard input at once
+
+// The standard input is copied until its end, the end of a pipe
+int copy_input(){
+    char buffer[copy_size];
+
+    while(true){
+        auto read = tlib::read(1, buffer, copy_size);
+
+        if(!read){
+            tlib::printf("cat: error: %s\n", std::error_message(read.error()));
+            return 1;
+        }
+
+        if(!*read){
+            return 0;
+        }
+
+        tlib::out().write(buffer, *read);
+    }
+}
+
+} // end of anonymous namespace
 
 int main(int argc, char* argv[]){
     if(argc == 1){
-        tlib::print_line("Usage: cat file_path");
-        return 1;
+        return copy_input();
     }
 
     auto fd = tlib::open(argv[1]);
@@ -27,22 +53,32 @@ int main(int argc, char* argv[]){
             } else {
                 auto size = info->size;
 
-                auto buffer = new char[size];
+                // The files of the page cache are printed without copy
+                auto mapped = tlib::mmap(*fd, 0, size);
+
+                if(mapped.valid()){
+                    auto content = static_cast<const char*>(*mapped);
+
+                    // A single write, the reader of a pipe is woken up once
+                    tlib::out().write(content, size);
+                    tlib::out().put('\n');
 
-                auto content_result = tlib::read(*fd, buffer, size);
+                    tlib::close(*fd);
 
-                if(content_result.valid()){
-                    if(*content_result != size){
-                        //TODO Read more
-                    } else {
-                        for(size_t i = 0; i < size; ++i){
-                            tlib::print(buffer[i]);
-                        }
+                    return 0;
+                }
+
+                // The other files are streamed, one block at a time
+                tlib::block_view blocks(*fd);
+
+                for(auto block : blocks){
+                    tlib::out().write(block.data, block.size);
+                }
 
-                        tlib::print_line();
-                    }
+                if(blocks.error()){
+                    tlib::printf("cat: error: %s\n", std::error_message(blocks.error()));
                 } else {
-                    tlib::printf("cat: error: %s\n", std::error_message(content_result.error()));
+                    tlib::out().put('\n');
                 }
             }
         } else {
@@ -394,6 +394,19 @@ void get_deterministic_cache_parameters(){
     }
 }
 
+// The features detected by the kernel, usable by the programs
+void get_kernel_features(){
+    tlib::print("Kernel Features:");
+
+    for(size_t i = 0; i < size_t(tlib::cpu_feature::COUNT); ++i){
+        if(tlib::cpu_has(static_cast<tlib::cpu_feature>(i))){
+            tlib::printf(" %s", tlib::cpu_feature_names[i]);
+        }
+    }
+
+    tlib::print("\n");
+}
+
 } //end of anonymous namespace
 
 int main(){
@@ -401,6 +414,7 @@ int main(){
     get_vendor_id();
     get_brand_string();
     get_features();
+    get_kernel_features();
     get_cache_info();
     get_deterministic_cache_parameters();
 
@@ -0,0 +1,94 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string.hpp>
+
+#include <tlib/file.hpp>
+#include <tlib/system.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/print.hpp>
+#include <tlib/stream.hpp>
+
+namespace {
+
+bool contains(const std::string& line, const std::string& pattern){
+    if(pattern.size() > line.size()){
+        return false;
+    }
+
+    for(size_t i = 0; i + pattern.size() <= line.size(); ++i){
+        size_t j = 0;
+
+        while(j < pattern.size() && line[i + j] == pattern[j]){
+            ++j;
+        }
+
+        if(j == pattern.size()){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void match(const std::string& line, const std::string& pattern){
+    if(contains(line, pattern)){
+        tlib::out().write(line);
+        tlib::out().put('\n');
+    }
+}
+
+// Print the matching lines of the input as they arrive, until its end
+int grep(tlib::stream& input, const std::string& pattern){
+    std::string line;
+
+    while(true){
+        auto read = input.read_line(line);
+
+        if(!read){
+            tlib::printf("grep: error: %s\n", std::error_message(read.error()));
+            return 1;
+        }
+
+        if(!*read){
+            return 0;
+        }
+
+        match(line, pattern);
+    }
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]){
+    if(argc != 2 && argc != 3){
+        tlib::print_line("Usage: grep pattern [file_path]");
+        return 1;
+    }
+
+    std::string pattern(argv[1]);
+
+    // Without file, the standard input is filtered, for instance the end of a pipe
+    if(argc == 2){
+        return grep(tlib::in(), pattern);
+    }
+
+    auto fd = tlib::open(argv[2]);
+
+    if(!fd){
+        tlib::printf("grep: error: %s\n", std::error_message(fd.error()));
+        return 1;
+    }
+
+    tlib::stream input(*fd);
+
+    auto status = grep(input, pattern);
+
+    tlib::close(*fd);
+
+    return status;
+}
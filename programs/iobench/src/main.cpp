@@ -0,0 +1,331 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string.hpp>
+#include <random.hpp>
+#include <algorithms.hpp>
+
+#include <tlib/file.hpp>
+#include <tlib/system.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/io.hpp>
+#include <tlib/print.hpp>
+#include <tlib/flags.hpp>
+
+namespace {
+
+constexpr const size_t MAX_SAMPLES = 1024;           ///< The maximum number of operations of a test
+constexpr const size_t OPERATIONS = 256;             ///< The number of operations of the transfer tests
+constexpr const size_t FILES = 128;                  ///< The number of files of the file system tests
+constexpr const size_t RAMDISK_SIZE = 16 * 1024 * 1024; ///< The size of the ramdisk created for the tests
+constexpr const size_t FILE_SIZE = 1024 * 1024;      ///< The size of the file of the file system tests
+constexpr const size_t MAX_BLOCK = 64 * 1024;        ///< The largest block size
+
+constexpr const size_t BLOCK_SIZES[] = {512, 4096, MAX_BLOCK};
+
+uint64_t ticks_per_us = 1;
+
+uint64_t samples[MAX_SAMPLES];
+size_t count = 0;
+uint64_t sampled_bytes = 0;
+
+std::string scope; ///< The device or directory of the current tests, in the logged results
+
+std::default_random_engine engine;
+
+char buffer[MAX_BLOCK];
+
+uint64_t ticks(){
+    uint32_t low;
+    uint32_t high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return (uint64_t(high) << 32) | low;
+}
+
+// The latencies are measured with the TSC, calibrated against the clock of the kernel
+void calibrate(){
+    auto start_ms = tlib::ms_time();
+
+    while(tlib::ms_time() == start_ms){}
+
+    auto start = ticks();
+    start_ms = tlib::ms_time();
+
+    while(tlib::ms_time() - start_ms < 50){}
+
+    ticks_per_us = std::max(uint64_t(1), (ticks() - start) / ((tlib::ms_time() - start_ms) * 1000));
+}
+
+void reset(){
+    count = 0;
+    sampled_bytes = 0;
+}
+
+template<typename F>
+bool sample(size_t bytes, F functor){
+    auto start = ticks();
+    bool ok = functor();
+    auto duration = (ticks() - start) / ticks_per_us;
+
+    if(ok && count < MAX_SAMPLES){
+        samples[count++] = duration;
+        sampled_bytes += bytes;
+    }
+
+    return ok;
+}
+
+// Shell sort of the samples, enough for a few hundred values
+void sort_samples(){
+    for(size_t gap = count / 2; gap > 0; gap /= 2){
+        for(size_t i = gap; i < count; ++i){
+            auto value = samples[i];
+            size_t j = i;
+
+            for(; j >= gap && samples[j - gap] > value; j -= gap){
+                samples[j] = samples[j - gap];
+            }
+
+            samples[j] = value;
+        }
+    }
+}
+
+uint64_t percentile(size_t p){
+    return samples[std::min(count - 1, (count * p) / 100)];
+}
+
+void report(const char* name){
+    if(!count){
+        tlib::printf("%s: failed\n", name);
+        return;
+    }
+
+    uint64_t total = 0;
+    for(size_t i = 0; i < count; ++i){
+        total += samples[i];
+    }
+
+    sort_samples();
+
+    total = std::max(uint64_t(1), total);
+
+    auto iops = (count * 1000000) / total;
+
+    tlib::printf("%s: %u ops %uus iops:%u", name, count, total, iops);
+
+    if(sampled_bytes){
+        tlib::printf(" %uKiB/s", ((sampled_bytes * 1000000) / total) / 1024);
+    }
+
+    tlib::printf(" p50:%uus p90:%uus p99:%uus max:%uus\n", percentile(50), percentile(90), percentile(99), samples[count - 1]);
+
+    // The names are indented under their scope on the terminal
+    std::string key = scope;
+    key += ' ';
+    key += name + 2;
+
+    tlib::log_result("iobench", key.c_str(), "iops", iops);
+    tlib::log_result("iobench", key.c_str(), "p50_us", percentile(50));
+}
+
+size_t random_offset(size_t size, size_t block){
+    return (engine() % (size / block)) * block;
+}
+
+void bench_transfers(const char* name, size_t fd, size_t size, bool write){
+    for(auto block : BLOCK_SIZES){
+        if(size < block * OPERATIONS){
+            continue;
+        }
+
+        tlib::printf("%s, %u bytes blocks\n", name, block);
+
+        scope = name;
+        scope += ' ';
+        scope += std::to_string(block);
+        scope += 'B';
+
+        if(write){
+            reset();
+            for(size_t i = 0; i < OPERATIONS; ++i){
+                sample(block, [&](){ return tlib::write(fd, buffer, block, i * block).valid(); });
+            }
+            report("  sequential write");
+
+            reset();
+            for(size_t i = 0; i < OPERATIONS; ++i){
+                auto offset = random_offset(size, block);
+                sample(block, [&](){ return tlib::write(fd, buffer, block, offset).valid(); });
+            }
+            report("  random write");
+        }
+
+        // The first pass may be served from the device, the second should hit the caches
+        reset();
+        for(size_t i = 0; i < OPERATIONS; ++i){
+            sample(block, [&](){ return tlib::read(fd, buffer, block, i * block).valid(); });
+        }
+        report("  sequential read (first)");
+
+        reset();
+        for(size_t i = 0; i < OPERATIONS; ++i){
+            sample(block, [&](){ return tlib::read(fd, buffer, block, i * block).valid(); });
+        }
+        report("  sequential read (cached)");
+
+        reset();
+        for(size_t i = 0; i < OPERATIONS; ++i){
+            auto offset = random_offset(size, block);
+            sample(block, [&](){ return tlib::read(fd, buffer, block, offset).valid(); });
+        }
+        report("  random read");
+    }
+}
+
+void bench_device(const char* device, bool write){
+    auto fd = tlib::open(device);
+
+    if(!fd){
+        tlib::printf("iobench: open %s error: %s\n", device, std::error_message(fd.error()));
+        return;
+    }
+
+    uint64_t size = 0;
+    auto code = tlib::ioctl(*fd, tlib::ioctl_request::GET_BLK_SIZE, &size);
+
+    if(code){
+        tlib::printf("iobench: ioctl %s error: %s\n", device, std::error_message(-code));
+    } else {
+        bench_transfers(device, *fd, std::min(size, uint64_t(RAMDISK_SIZE)), write);
+    }
+
+    tlib::close(*fd);
+}
+
+std::string file_name(const char* directory, size_t i){
+    std::string name(directory);
+    name += "/file_";
+    name += std::to_string(i);
+    return name;
+}
+
+void bench_files(const char* directory){
+    if(tlib::mkdir(directory)){
+        tlib::printf("iobench: cannot create %s\n", directory);
+        return;
+    }
+
+    tlib::printf("files in %s\n", directory);
+
+    scope = directory;
+
+    reset();
+    for(size_t i = 0; i < FILES; ++i){
+        auto name = file_name(directory, i);
+
+        sample(0, [&](){
+            auto fd = tlib::open(name.c_str(), std::OPEN_CREATE);
+
+            if(fd){
+                tlib::close(*fd);
+            }
+
+            return fd.valid();
+        });
+    }
+    report("  create");
+
+    reset();
+    for(size_t i = 0; i < FILES; ++i){
+        auto name = file_name(directory, engine() % FILES);
+
+        sample(0, [&](){
+            auto fd = tlib::open(name.c_str());
+
+            if(fd){
+                tlib::close(*fd);
+            }
+
+            return fd.valid();
+        });
+    }
+    report("  lookup");
+
+    reset();
+    for(size_t i = 0; i < FILES; ++i){
+        auto name = file_name(directory, FILES + i);
+
+        sample(0, [&](){ return !tlib::open(name.c_str()).valid(); });
+    }
+    report("  lookup (missing)");
+
+    auto file = file_name(directory, 0);
+    auto fd = tlib::open(file.c_str());
+
+    if(fd && tlib::truncate(*fd, FILE_SIZE)){
+        bench_transfers("  file", *fd, FILE_SIZE, true);
+    }
+
+    if(fd){
+        tlib::close(*fd);
+    }
+
+    reset();
+    for(size_t i = 0; i < FILES; ++i){
+        auto name = file_name(directory, i);
+
+        sample(0, [&](){ return tlib::rm(name.c_str()) == 0; });
+    }
+    report("  delete");
+
+    tlib::rm(directory);
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]){
+    if(argc > 1 && std::string(argv[1]) == "-h"){
+        tlib::print_line("Usage: iobench [device...]");
+        tlib::print_line("The devices are only read, the writes go to a new ramdisk");
+        return 0;
+    }
+
+    engine = std::default_random_engine(tlib::ms_time());
+
+    calibrate();
+
+    // A ramdisk of its own can be written without risk
+    uint64_t ramdisk = RAMDISK_SIZE;
+
+    auto dev_fd = tlib::open("/dev");
+
+    if(dev_fd){
+        auto code = tlib::ioctl(*dev_fd, tlib::ioctl_request::CREATE_RAMDISK, &ramdisk);
+
+        if(code){
+            tlib::printf("iobench: cannot create a ramdisk: %s\n", std::error_message(-code));
+        } else {
+            auto device = "/dev/ram" + std::to_string(ramdisk);
+            bench_device(device.c_str(), true);
+        }
+
+        tlib::close(*dev_fd);
+    }
+
+    if(argc > 1){
+        for(int i = 1; i < argc; ++i){
+            bench_device(argv[i], false);
+        }
+    } else {
+        bench_device("/dev/hda", false);
+    }
+
+    bench_files("/iobench");
+
+    return 0;
+}
@@ -5,6 +5,8 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <algorithms.hpp>
+
 #include <tlib/file.hpp>
 #include <tlib/system.hpp>
 #include <tlib/errors.hpp>
@@ -20,6 +22,43 @@ struct config {
     bool hidden = false;
 };
 
+/*!
+ * \brief A file of the listed directory
+ */
+struct file_t {
+    const char* name;   ///< The name, in the entries buffer
+    bool hidden;        ///< Indicates if the file is hidden
+};
+
+// Order the files by name, byte by byte
+bool name_less(const file_t& lhs, const file_t& rhs){
+    auto a = lhs.name;
+    auto b = rhs.name;
+
+    while(*a && *a == *b){
+        ++a;
+        ++b;
+    }
+
+    return *a < *b;
+}
+
+// Read the entries of the directory with their attributes, the buffer
+// grows until all the entries fit
+std::expected<size_t> read_entries(size_t fd, char*& buffer){
+    for(size_t size = BUFFER_SIZE; ; size *= 2){
+        buffer = new char[size];
+
+        auto entries_result = tlib::entries_stat(fd, buffer, size);
+
+        if(entries_result || entries_result.error() != std::ERROR_BUFFER_SMALL){
+            return entries_result;
+        }
+
+        delete[] buffer;
+    }
+}
+
 void ls_files(const config& conf, const char* file_path){
     auto fd = tlib::open(file_path);
 
@@ -30,54 +69,41 @@ void ls_files(const config& conf, const char* file_path){
             if(!(info->flags & tlib::STAT_FLAG_DIRECTORY)){
                 tlib::print_line("ls: error: Is not a directory");
             } else {
-                auto buffer = new char[BUFFER_SIZE];
+                char* buffer = nullptr;
 
-                auto entries_result = tlib::entries(*fd, buffer, BUFFER_SIZE);
+                auto entries_result = read_entries(*fd, buffer);
 
                 if(entries_result.valid()){
                     if(*entries_result){
+                        std::vector<file_t> files;
+
                         size_t position = 0;
 
                         while(true){
-                            auto entry = reinterpret_cast<tlib::directory_entry*>(buffer + position);
+                            auto entry = reinterpret_cast<tlib::directory_stat_entry*>(buffer + position);
 
-                            bool show = true;
-                            if(!conf.hidden){
-                                auto path = std::string(file_path) + "/" + &entry->name;
+                            files.push_back({&entry->name, bool(entry->info.flags & tlib::STAT_FLAG_HIDDEN)});
 
-                                auto file_fd = tlib::open(path.c_str());
-
-                                if(file_fd.valid()){
-                                    auto file_info = tlib::stat(*file_fd);
+                            if(!entry->offset_next){
+                                break;
+                            }
 
-                                    if(file_info.valid()){
-                                        if(file_info->flags & tlib::STAT_FLAG_HIDDEN){
-                                            show = false;
-                                        }
-                                    } else {
-                                        tlib::printf("ls: stat error: %s\n", std::error_message(file_info.error()));
-                                    }
-                                } else {
-                                    tlib::printf("ls: open error: %s\n", std::error_message(file_fd.error()));
-                                }
+                            position += entry->offset_next;
+                        }
 
-                                tlib::close(*file_fd);
-                            }
+                        std::sort(files.begin(), files.end(), name_less);
 
-                            if(show){
-                                if(conf.list){
-                                    tlib::print_line(&entry->name);
-                                } else {
-                                    tlib::print(&entry->name);
-                                    tlib::print(" ");
-                                }
+                        for(auto& file : files){
+                            if(file.hidden && !conf.hidden){
+                                continue;
                             }
 
-                            if(!entry->offset_next){
-                                break;
+                            if(conf.list){
+                                tlib::print_line(file.name);
+                            } else {
+                                tlib::print(file.name);
+                                tlib::print(" ");
                             }
-
-                            position += entry->offset_next;
                         }
 
                         if(!conf.list){
@@ -17,6 +17,7 @@
 #include <tlib/fat32_specs.hpp>
 
 static constexpr const size_t BUFFER_SIZE = 4096;
+static constexpr const size_t FAT_CHUNK_SIZE = 64 * 1024; ///< The part of the FAT written from memory
 
 int main(int argc, char* argv[]){
     if(argc < 3){
@@ -93,14 +94,6 @@ int main(int argc, char* argv[]){
         std::copy_n("FAT32", 5, &fat_bs->file_system_type[0]);
         fat_bs->signature = 0xAA55;
 
-        // Write the FAT BS
-        auto status = tlib::write(*fd, reinterpret_cast<const char*>(fat_bs.get()), sector_size, 0);
-
-        if(!status.valid()){
-            tlib::printf("mkfs: write error: %s\n", std::error_message(status.error()));
-            return 1;
-        }
-
         auto fat_is = std::make_unique<fat32::fat_is_t>();
 
         fat_is->allocated_clusters = 1;
@@ -109,33 +102,54 @@ int main(int argc, char* argv[]){
         fat_is->signature_middle = 0x72724161;
         fat_is->signature_end = 0x000055AA;
 
-        // Write the FAT IS
-        status = tlib::write(*fd, reinterpret_cast<const char*>(fat_is.get()), sector_size, sector_size);
+        // Write the reserved sectors, with the FAT BS and the FAT IS, at once
+
+        auto reserved_bytes = fat_bs->reserved_sectors * sector_size;
+
+        std::unique_heap_array<char> reserved(reserved_bytes);
+        std::fill_n(reserved.get(), reserved_bytes, 0);
+
+        std::copy_n(reinterpret_cast<const char*>(fat_bs.get()), sector_size, reserved.get());
+        std::copy_n(reinterpret_cast<const char*>(fat_is.get()), sector_size, reserved.get() + sector_size);
+
+        auto status = tlib::write(*fd, reserved.get(), reserved_bytes, 0);
 
         if(!status.valid()){
             tlib::printf("mkfs: write error: %s\n", std::error_message(status.error()));
             return 1;
         }
 
-        // Clear the FAT
+        // Write the FAT: the first chunk is built in memory, with the
+        // reserved entries and the end of chain of cluster 2 (root), the
+        // rest of the FAT is cleared at once
 
         auto fat_begin = fat_bs->reserved_sectors;
-        status = tlib::clear(*fd, fat_begin * sector_size, fat_size_sectors * sector_size);
+        auto fat_bytes = fat_size_sectors * sector_size;
+        auto first_bytes = std::min(fat_bytes, FAT_CHUNK_SIZE);
 
-        if(!status.valid()){
-            tlib::printf("mkfs: clear error: %s\n", std::error_message(status.error()));
-            return 1;
-        }
+        std::unique_heap_array<uint32_t> fat_chunk(first_bytes / sizeof(uint32_t));
+        std::fill_n(fat_chunk.get(), fat_chunk.size(), 0);
+
+        fat_chunk[0] = 0x0FFFFFF8;
+        fat_chunk[1] = 0x0FFFFFFF;
+        fat_chunk[2] = 0x0FFFFFF8;
 
-        // Write end of chain for cluster 2 (root)
-        uint32_t end_of_cluster_chain = 0x0FFFFFF8;
-        status = tlib::write(*fd, reinterpret_cast<char*>(&end_of_cluster_chain), 4, fat_begin * sector_size + 2 * 4);
+        status = tlib::write(*fd, reinterpret_cast<const char*>(fat_chunk.get()), first_bytes, fat_begin * sector_size);
 
         if(!status.valid()){
             tlib::printf("mkfs: write error: %s\n", std::error_message(status.error()));
             return 1;
         }
 
+        if(fat_bytes > first_bytes){
+            status = tlib::clear(*fd, fat_bytes - first_bytes, fat_begin * sector_size + first_bytes);
+
+            if(!status.valid()){
+                tlib::printf("mkfs: clear error: %s\n", std::error_message(status.error()));
+                return 1;
+            }
+        }
+
         // Write the root cluster
 
         std::unique_heap_array<fat32::cluster_entry> root_cluster_entries(16 * fat_bs->sectors_per_cluster);
@@ -150,8 +164,11 @@ int main(int argc, char* argv[]){
 
         //Write the directory entries to the disk
         auto root_sector = fat_begin + (fat_bs->number_of_fat * fat_bs->sectors_per_fat_long);
-        if(!tlib::write(*fd, reinterpret_cast<char*>(root_cluster_entries.get()), sector_size * fat_bs->sectors_per_cluster, root_sector * sector_size)){
-            return std::ERROR_FAILED;
+        status = tlib::write(*fd, reinterpret_cast<char*>(root_cluster_entries.get()), sector_size * fat_bs->sectors_per_cluster, root_sector * sector_size);
+
+        if(!status.valid()){
+            tlib::printf("mkfs: write error: %s\n", std::error_message(status.error()));
+            return 1;
         }
 
         return 0;
@@ -0,0 +1,614 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string.hpp>
+#include <algorithms.hpp>
+
+#include <tlib/system.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/print.hpp>
+#include <tlib/net.hpp>
+
+namespace {
+
+constexpr const size_t MAX_SAMPLES = 1024;       ///< The maximum number of measured operations of a test
+constexpr const size_t MAX_BLOCK = 64 * 1024;    ///< The largest block sent at once
+constexpr const size_t timeout_ms = 5000;        ///< The time to wait for the other side
+constexpr const size_t server_timeout_ms = 30000; ///< The time a server waits for a client
+constexpr const size_t report_tries = 5;         ///< The number of times the UDP report is asked for
+
+/*!
+ * \brief The commands sent by the client at the start of a TCP connection
+ */
+enum command : uint64_t {
+    STREAM  = 1, ///< Receive the given number of bytes and acknowledge them
+    REQUEST = 2, ///< Send back each request of the given number of bytes
+    QUIT    = 3  ///< Stop the server
+};
+
+/*!
+ * \brief The header of a TCP connection
+ */
+struct request_header {
+    uint64_t command; ///< The command of the connection
+    uint64_t bytes;   ///< The number of bytes of the stream or of each request
+} __attribute__((packed));
+
+/*!
+ * \brief The types of the UDP messages
+ */
+enum message_type : uint32_t {
+    DATA   = 1, ///< A datagram of the test
+    DONE   = 2, ///< The end of the test, asks for the report
+    REPORT = 3, ///< The number of datagrams received by the server
+    STOP   = 4  ///< Stop the server
+};
+
+/*!
+ * \brief The header of every UDP datagram
+ */
+struct message_header {
+    uint32_t type;     ///< The type of the message
+    uint32_t sequence; ///< The sequence number of the datagram or the number of datagrams received
+} __attribute__((packed));
+
+uint64_t ticks_per_us = 1;
+
+uint64_t samples[MAX_SAMPLES];
+size_t count = 0;
+
+char buffer[MAX_BLOCK];
+
+std::string ip_to_str(tlib::ip::address ip){
+    std::string value;
+    value += std::to_string(ip(0));
+    value += '.';
+    value += std::to_string(ip(1));
+    value += '.';
+    value += std::to_string(ip(2));
+    value += '.';
+    value += std::to_string(ip(3));
+    return value;
+}
+
+uint64_t ticks(){
+    uint32_t low;
+    uint32_t high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return (uint64_t(high) << 32) | low;
+}
+
+// The latencies are measured with the TSC, calibrated against the clock of the kernel
+void calibrate(){
+    auto start_ms = tlib::ms_time();
+
+    while(tlib::ms_time() == start_ms){}
+
+    auto start = ticks();
+    start_ms = tlib::ms_time();
+
+    while(tlib::ms_time() - start_ms < 50){}
+
+    ticks_per_us = std::max(uint64_t(1), (ticks() - start) / ((tlib::ms_time() - start_ms) * 1000));
+}
+
+uint64_t elapsed_us(uint64_t start){
+    return std::max(uint64_t(1), (ticks() - start) / ticks_per_us);
+}
+
+void add_sample(uint64_t us){
+    if(count < MAX_SAMPLES){
+        samples[count++] = us;
+    }
+}
+
+void sort_samples(){
+    std::sort(samples, samples + count);
+}
+
+uint64_t percentile(size_t p){
+    return samples[std::min(count - 1, (count * p) / 100)];
+}
+
+void report_latencies(const char* name){
+    if(!count){
+        tlib::printf("%s: failed\n", name);
+        return;
+    }
+
+    uint64_t total = 0;
+    for(size_t i = 0; i < count; ++i){
+        total += samples[i];
+    }
+
+    sort_samples();
+
+    tlib::printf("%s: %u ops %uus ops/s:%u", name, count, total, (count * 1000000) / std::max(uint64_t(1), total));
+    tlib::printf(" p50:%uus p90:%uus p99:%uus max:%uus\n", percentile(50), percentile(90), percentile(99), samples[count - 1]);
+
+    tlib::log_result("netbench", name, "p50_us", percentile(50));
+    tlib::log_result("netbench", name, "p99_us", percentile(99));
+}
+
+bool socket_error(tlib::socket& sock, const char* operation){
+    if(!sock){
+        tlib::printf("netbench: %s error: %s\n", operation, std::error_message(sock.error()));
+        return true;
+    }
+
+    return false;
+}
+
+// The stream sockets may return fewer bytes than asked for
+bool receive_exact(tlib::socket& sock, char* destination, size_t n){
+    while(n){
+        auto size = sock.receive(destination, n, timeout_ms);
+
+        if(!sock){
+            return false;
+        }
+
+        destination += size;
+        n -= size;
+    }
+
+    return true;
+}
+
+bool send_header(tlib::socket& sock, command c, uint64_t bytes){
+    request_header header;
+    header.command = c;
+    header.bytes   = bytes;
+
+    sock.send(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    return !socket_error(sock, "send");
+}
+
+bool connect(tlib::socket& sock, const tlib::ip::address& server, size_t port){
+    sock.connect(server, port);
+    sock.listen(true);
+
+    return !socket_error(sock, "connect");
+}
+
+// Read a stream of bytes and acknowledge it with its last byte
+void serve_stream(tlib::socket& child, uint64_t bytes){
+    while(bytes){
+        auto size = child.receive(buffer, std::min(bytes, uint64_t(MAX_BLOCK)), timeout_ms);
+
+        if(!child){
+            return;
+        }
+
+        bytes -= size;
+    }
+
+    child.send(buffer, 1);
+}
+
+// Send back the requests until the client disconnects
+void serve_requests(tlib::socket& child, uint64_t bytes){
+    if(!bytes || bytes > MAX_BLOCK){
+        return;
+    }
+
+    while(receive_exact(child, buffer, bytes)){
+        child.send(buffer, bytes);
+
+        if(!child){
+            return;
+        }
+    }
+}
+
+int tcp_server(const tlib::ip::address& local, size_t port){
+    tlib::printf("netbench: TCP server %s:%u\n", ip_to_str(local).c_str(), port);
+
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::STREAM, tlib::socket_protocol::TCP);
+
+    sock.server_start(local, port);
+
+    if(socket_error(sock, "server")){
+        return 1;
+    }
+
+    while(true){
+        auto child = sock.accept(server_timeout_ms);
+
+        if(!sock){
+            if(sock.error() == std::ERROR_SOCKET_TIMEOUT){
+                tlib::print_line("netbench: no client, stop the server");
+                return 0;
+            }
+
+            socket_error(sock, "accept");
+            return 1;
+        }
+
+        child.listen(true);
+
+        request_header header;
+
+        if(!receive_exact(child, reinterpret_cast<char*>(&header), sizeof(header))){
+            // The connections of the setup test are closed right away
+            continue;
+        }
+
+        if(header.command == STREAM){
+            serve_stream(child, header.bytes);
+        } else if(header.command == REQUEST){
+            serve_requests(child, header.bytes);
+        } else if(header.command == QUIT){
+            return 0;
+        }
+    }
+}
+
+int udp_server(const tlib::ip::address& local, size_t port){
+    tlib::printf("netbench: UDP server %s:%u\n", ip_to_str(local).c_str(), port);
+
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::DGRAM, tlib::socket_protocol::UDP);
+
+    sock.server_bind(local, port);
+    sock.listen(true);
+
+    if(socket_error(sock, "bind")){
+        return 1;
+    }
+
+    uint32_t received = 0;
+
+    while(true){
+        tlib::inet_address address;
+
+        auto size = sock.receive_from(buffer, MAX_BLOCK, server_timeout_ms, &address);
+
+        if(!sock){
+            if(sock.error() == std::ERROR_SOCKET_TIMEOUT){
+                tlib::print_line("netbench: no client, stop the server");
+                return 0;
+            }
+
+            socket_error(sock, "receive_from");
+            return 1;
+        }
+
+        if(size < sizeof(message_header)){
+            continue;
+        }
+
+        auto* header = reinterpret_cast<message_header*>(buffer);
+
+        if(header->type == DATA){
+            ++received;
+        } else if(header->type == DONE){
+            message_header report;
+            report.type     = REPORT;
+            report.sequence = received;
+
+            sock.send_to(reinterpret_cast<const char*>(&report), sizeof(report), &address);
+            sock.clear();
+
+            received = 0;
+        } else if(header->type == STOP){
+            return 0;
+        }
+    }
+}
+
+// The time to send the blocks until the server acknowledges the last one
+int tcp_stream(const tlib::ip::address& server, size_t port, size_t blocks, size_t size){
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::STREAM, tlib::socket_protocol::TCP);
+
+    if(!connect(sock, server, port)){
+        return 1;
+    }
+
+    uint64_t bytes = uint64_t(blocks) * size;
+
+    auto start = ticks();
+
+    if(!send_header(sock, STREAM, bytes)){
+        return 1;
+    }
+
+    for(size_t i = 0; i < blocks; ++i){
+        sock.send(buffer, size);
+
+        if(socket_error(sock, "send")){
+            return 1;
+        }
+    }
+
+    if(!receive_exact(sock, buffer, 1)){
+        socket_error(sock, "receive");
+        return 1;
+    }
+
+    auto us = elapsed_us(start);
+
+    tlib::printf("tcp_stream: %u bytes %uus %uKiB/s\n", bytes, us, ((bytes * 1000000) / us) / 1024);
+
+    tlib::log_result("netbench", "tcp_stream", "kib_s", ((bytes * 1000000) / us) / 1024);
+
+    return 0;
+}
+
+// The round trip time of each request of the same connection
+int tcp_rr(const tlib::ip::address& server, size_t port, size_t requests, size_t size){
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::STREAM, tlib::socket_protocol::TCP);
+
+    if(!connect(sock, server, port) || !send_header(sock, REQUEST, size)){
+        return 1;
+    }
+
+    count = 0;
+
+    for(size_t i = 0; i < requests; ++i){
+        auto start = ticks();
+
+        sock.send(buffer, size);
+
+        if(socket_error(sock, "send")){
+            return 1;
+        }
+
+        if(!receive_exact(sock, buffer, size)){
+            socket_error(sock, "receive");
+            return 1;
+        }
+
+        add_sample(elapsed_us(start));
+    }
+
+    report_latencies("tcp_rr");
+
+    return 0;
+}
+
+// The time to establish and close each connection
+int tcp_connect(const tlib::ip::address& server, size_t port, size_t connections){
+    count = 0;
+
+    for(size_t i = 0; i < connections; ++i){
+        auto start = ticks();
+
+        {
+            tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::STREAM, tlib::socket_protocol::TCP);
+
+            if(!connect(sock, server, port)){
+                return 1;
+            }
+
+            sock.listen(false);
+        }
+
+        add_sample(elapsed_us(start));
+    }
+
+    report_latencies("tcp_connect");
+
+    return 0;
+}
+
+int tcp_quit(const tlib::ip::address& server, size_t port){
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::STREAM, tlib::socket_protocol::TCP);
+
+    if(!connect(sock, server, port) || !send_header(sock, QUIT, 0)){
+        return 1;
+    }
+
+    return 0;
+}
+
+// The rate of datagrams sent and the number lost before the server
+int udp_stream(const tlib::ip::address& server, size_t port, size_t datagrams, size_t size){
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::DGRAM, tlib::socket_protocol::UDP);
+
+    sock.client_bind(server, port);
+    sock.listen(true);
+
+    if(socket_error(sock, "bind")){
+        return 1;
+    }
+
+    size = std::max(size, sizeof(message_header));
+
+    auto* header = reinterpret_cast<message_header*>(buffer);
+
+    auto start = ticks();
+
+    for(size_t i = 0; i < datagrams; ++i){
+        header->type     = DATA;
+        header->sequence = i;
+
+        sock.send(buffer, size);
+
+        if(socket_error(sock, "send")){
+            return 1;
+        }
+    }
+
+    auto us = elapsed_us(start);
+
+    // The report is asked for again if the request or the answer is lost
+    for(size_t t = 0; t < report_tries; ++t){
+        message_header done;
+        done.type     = DONE;
+        done.sequence = datagrams;
+
+        sock.send(reinterpret_cast<const char*>(&done), sizeof(done));
+
+        if(socket_error(sock, "send")){
+            return 1;
+        }
+
+        auto received = sock.receive(buffer, MAX_BLOCK, 1000);
+
+        if(!sock){
+            if(sock.error() == std::ERROR_SOCKET_TIMEOUT){
+                sock.clear();
+                continue;
+            }
+
+            socket_error(sock, "receive");
+            return 1;
+        }
+
+        if(received < sizeof(message_header) || header->type != REPORT){
+            continue;
+        }
+
+        auto lost = datagrams - std::min(size_t(header->sequence), datagrams);
+
+        tlib::printf("udp_stream: %u datagrams %uus pps:%u %uKiB/s lost:%u (%u%%)\n",
+            datagrams, us, (datagrams * 1000000) / us, ((uint64_t(datagrams) * size * 1000000) / us) / 1024,
+            lost, (lost * 100) / datagrams);
+
+        tlib::log_result("netbench", "udp_stream", "kib_s", ((uint64_t(datagrams) * size * 1000000) / us) / 1024);
+
+        return 0;
+    }
+
+    tlib::print_line("udp_stream: no report from the server");
+
+    return 1;
+}
+
+int udp_quit(const tlib::ip::address& server, size_t port){
+    tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::DGRAM, tlib::socket_protocol::UDP);
+
+    sock.client_bind(server, port);
+
+    message_header stop;
+    stop.type     = STOP;
+    stop.sequence = 0;
+
+    sock.send(reinterpret_cast<const char*>(&stop), sizeof(stop));
+
+    return socket_error(sock, "send") ? 1 : 0;
+}
+
+bool parse_address(const std::string& value, tlib::ip::address& address){
+    auto ip_parts = std::split(value, '.');
+
+    if(ip_parts.size() != 4){
+        return false;
+    }
+
+    address = tlib::ip::make_address(std::atoui(ip_parts[0]), std::atoui(ip_parts[1]), std::atoui(ip_parts[2]), std::atoui(ip_parts[3]));
+
+    return true;
+}
+
+void usage(){
+    tlib::print_line("usage: netbench -l [-u] local port");
+    tlib::print_line("       netbench [-u] [-L] [-t stream|rr|connect] [-n count] [-s size] server port");
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    bool udp = false;
+    bool server = false;
+    bool loopback = false;
+
+    std::string test;
+    size_t n = 0;
+    size_t size = 0;
+
+    size_t i = 1;
+    for(; i < size_t(argc); ++i){
+        std::string param(argv[i]);
+
+        if(param == "-u"){
+            udp = true;
+        } else if(param == "-l"){
+            server = true;
+        } else if(param == "-L"){
+            loopback = true;
+        } else if(param == "-t" && i + 1 < size_t(argc)){
+            test = argv[++i];
+        } else if(param == "-n" && i + 1 < size_t(argc)){
+            n = std::atoui(argv[++i]);
+        } else if(param == "-s" && i + 1 < size_t(argc)){
+            size = std::atoui(argv[++i]);
+        } else {
+            break;
+        }
+    }
+
+    // The server of the loopback is started by the benchmark itself
+    bool valid_test = test.empty() || (!udp && (test == "stream" || test == "rr" || test == "connect"));
+
+    if(argc - i != (loopback ? 1 : 2) || size > MAX_BLOCK || (server && loopback) || !valid_test){
+        usage();
+        return 1;
+    }
+
+    tlib::ip::address address = tlib::ip::make_address(127, 0, 0, 1);
+
+    if(!loopback && !parse_address(argv[i++], address)){
+        tlib::print_line("netbench: invalid address IP");
+        return 1;
+    }
+
+    auto port = std::atoui(argv[i]);
+
+    if(server){
+        return udp ? udp_server(address, port) : tcp_server(address, port);
+    }
+
+    size_t server_pid = 0;
+
+    if(loopback){
+        auto pid = tlib::fork();
+
+        if(!pid){
+            tlib::printf("netbench: fork error: %s\n", std::error_message(pid.error()));
+            return 1;
+        }
+
+        if(!*pid){
+            tlib::exit(udp ? udp_server(address, port) : tcp_server(address, port));
+        }
+
+        server_pid = *pid;
+
+        // Leave the time to the server to start listening
+        tlib::sleep_ms(100);
+    }
+
+    calibrate();
+
+    int status = 0;
+
+    if(udp){
+        status = udp_stream(address, port, n ? n : 4096, size ? size : 512);
+    } else {
+        if(test.empty() || test == "stream"){
+            status |= tcp_stream(address, port, n ? n : 256, size ? size : MAX_BLOCK);
+        }
+
+        if(test.empty() || test == "rr"){
+            status |= tcp_rr(address, port, n ? n : 256, size ? size : 64);
+        }
+
+        if(test.empty() || test == "connect"){
+            status |= tcp_connect(address, port, n ? n : 64);
+        }
+    }
+
+    if(loopback){
+        status |= udp ? udp_quit(address, port) : tcp_quit(address, port);
+
+        tlib::await_termination(server_pid);
+    }
+
+    return status;
+}
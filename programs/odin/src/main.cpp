@@ -11,6 +11,7 @@
 #include <tlib/graphics.hpp>
 #include <tlib/print.hpp>
 #include <tlib/malloc.hpp>
+#include <tlib/pixels.hpp>
 
 // TODO The order of the windows should be maintained by an
 // intrusive list
@@ -35,14 +36,7 @@ uint32_t make_color(uint8_t r, uint8_t g, uint8_t b) {
 }
 
 void fill_buffer(uint32_t color) {
-    auto where = 0;
-    for (size_t j = 0; j < height; ++j) {
-        for (size_t i = 0; i < width; ++i) {
-            z_buffer[where + i] = color;
-        }
-
-        where += y_shift;
-    }
+    tlib::pixels::fill_rect(z_buffer, y_shift, 0, 0, width, height, color);
 }
 
 void draw_pixel(size_t x, size_t y, uint32_t color) {
@@ -52,10 +46,10 @@ void draw_pixel(size_t x, size_t y, uint32_t color) {
 }
 
 void draw_hline(size_t x, size_t y, size_t w, uint32_t color) {
-    auto where = x + y * y_shift;
+    size_t h = 1;
 
-    for (size_t i = 0; i < w && x + i < width; ++i) {
-        z_buffer[where + i] = color;
+    if (tlib::pixels::clip(x, y, w, h, width, height)) {
+        tlib::pixels::fill(z_buffer + x + y * y_shift, w, color);
     }
 }
 
@@ -69,14 +63,8 @@ void draw_vline(size_t x, size_t y, size_t h, uint32_t color) {
 }
 
 void draw_rect(size_t x, size_t y, size_t w, size_t h, uint32_t color) {
-    auto where = x + y * y_shift;
-
-    for (size_t j = 0; j < h && y + j < height; ++j) {
-        for (size_t i = 0; i < w && x + i < width; ++i) {
-            z_buffer[where + i] = color;
-        }
-
-        where += y_shift;
+    if (tlib::pixels::clip(x, y, w, h, width, height)) {
+        tlib::pixels::fill_rect(z_buffer, y_shift, x, y, w, h, color);
     }
 }
 
@@ -272,9 +260,16 @@ int main(int /*argc*/, char* /*argv*/ []) {
 
     size_t total_size = height * bytes_per_scan_line;
 
-    auto buffer = new char[total_size];
+    // Draw directly in the back buffer of the screen when possible
+    char* buffer = nullptr;
+    auto mapped  = tlib::graphics::map_buffer();
 
-    z_buffer = reinterpret_cast<uint32_t*>(buffer);
+    if (mapped) {
+        z_buffer = *mapped;
+    } else {
+        buffer   = new char[total_size];
+        z_buffer = reinterpret_cast<uint32_t*>(buffer);
+    }
 
     auto background = make_color(128, 128, 128);
 
@@ -282,6 +277,7 @@ int main(int /*argc*/, char* /*argv*/ []) {
     tlib::set_mouse(true);
 
     static constexpr const size_t sleep_timeout = 50;
+    static constexpr const size_t max_events    = 32;
 
     std::default_random_engine eng(tlib::ms_time());
     std::uniform_int_distribution<> width_dist(200, 300);
@@ -304,60 +300,71 @@ int main(int /*argc*/, char* /*argv*/ []) {
 
         paint_cursor();
 
-        tlib::graphics::redraw(buffer);
+        if (mapped) {
+            tlib::graphics::present(0, 0, width, height);
+        } else {
+            tlib::graphics::redraw(buffer);
+        }
+
+        // All the events of a burst (mouse movements...) are read at once
+        std::input_event events[max_events];
 
         auto before = tlib::ms_time();
-        auto code   = tlib::read_input_raw(sleep_timeout);
+        auto n      = tlib::read_input_events(events, max_events, sleep_timeout);
         auto after  = tlib::ms_time();
 
-        if (code != std::keycode::TIMEOUT) {
-            switch (code) {
-                case std::keycode::RELEASED_ENTER: {
-                    size_t width  = width_dist(eng);
-                    size_t height = width_dist(eng);
-                    size_t pos_x  = position_dist(eng);
-                    size_t pos_y  = position_dist(eng);
+        if (n) {
+            for (size_t i = 0; i < n; ++i) {
+                auto code = events[i].code;
 
-                    windows.emplace_back(width, height, pos_x, pos_y);
+                switch (code) {
+                    case std::keycode::RELEASED_ENTER: {
+                        size_t width  = width_dist(eng);
+                        size_t height = width_dist(eng);
+                        size_t pos_x  = position_dist(eng);
+                        size_t pos_y  = position_dist(eng);
 
-                    break;
-                }
+                        windows.emplace_back(width, height, pos_x, pos_y);
 
-                case std::keycode::MOUSE_LEFT_PRESS:
-                    tlib::user_logf("odin: left press");
+                        break;
+                    }
 
-                    raise();
+                    case std::keycode::MOUSE_LEFT_PRESS:
+                        tlib::user_logf("odin: left press");
 
-                    if (windows.front().mouse_in_title()) {
-                        tlib::user_logf("odin: start drag");
-                        windows.front().start_drag();
-                    }
+                        raise();
 
-                    break;
+                        if (windows.front().mouse_in_title()) {
+                            tlib::user_logf("odin: start drag");
+                            windows.front().start_drag();
+                        }
 
-                case std::keycode::MOUSE_LEFT_RELEASE:
-                    tlib::user_logf("odin: left release");
+                        break;
 
-                    raise();
+                    case std::keycode::MOUSE_LEFT_RELEASE:
+                        tlib::user_logf("odin: left release");
 
-                    windows.front().stop_drag();
+                        raise();
 
-                    break;
+                        windows.front().stop_drag();
 
-                case std::keycode::MOUSE_RIGHT_PRESS:
-                    raise();
+                        break;
 
-                    tlib::user_logf("odin: right press");
-                    break;
+                    case std::keycode::MOUSE_RIGHT_PRESS:
+                        raise();
 
-                case std::keycode::MOUSE_RIGHT_RELEASE:
-                    raise();
+                        tlib::user_logf("odin: right press");
+                        break;
 
-                    tlib::user_logf("odin: right release");
-                    break;
+                    case std::keycode::MOUSE_RIGHT_RELEASE:
+                        raise();
 
-                default:
-                    tlib::user_logf("odin: %u ", static_cast<size_t>(code));
+                        tlib::user_logf("odin: right release");
+                        break;
+
+                    default:
+                        tlib::user_logf("odin: %u ", static_cast<size_t>(code));
+                }
             }
 
             auto duration = after - before;
@@ -0,0 +1,361 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <vector.hpp>
+#include <string.hpp>
+
+#include <tlib/file.hpp>
+#include <tlib/io.hpp>
+#include <tlib/poll.hpp>
+#include <tlib/system.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/print.hpp>
+#include <tlib/flags.hpp>
+#include <tlib/dns.hpp>
+#include <tlib/capture_constants.hpp>
+
+namespace {
+
+constexpr const size_t default_count = 100;      ///< The number of frames to capture by default
+constexpr const size_t flush_size    = 64 * 1024; ///< The number of bytes buffered before a write
+
+/*!
+ * \brief The global header of a pcap file
+ */
+struct pcap_header {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} __attribute__((packed));
+
+/*!
+ * \brief The header of a frame in a pcap file
+ */
+struct pcap_record {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} __attribute__((packed));
+
+/*!
+ * \brief Build a filter from the primitives of the command line, they must
+ * all match. Each check rejects the frame when its condition is false.
+ */
+struct filter_builder {
+    std::vector<tlib::capture::filter_instruction> program;
+    std::vector<size_t> rejects; ///< The checks jumping to the rejection
+
+    void add(uint16_t code, uint32_t k){
+        program.push_back({code, 0, 0, k});
+    }
+
+    void check(uint16_t code, uint32_t k, uint8_t jt = 0){
+        rejects.push_back(program.size());
+        program.push_back({code, jt, 0, k});
+    }
+
+    void ip(){
+        add(tlib::capture::LD_H_ABS, 12);
+        check(tlib::capture::JMP_JEQ_K, 0x800);
+    }
+
+    void protocol(uint32_t protocol){
+        ip();
+        add(tlib::capture::LD_B_ABS, 23);
+        check(tlib::capture::JMP_JEQ_K, protocol);
+    }
+
+    void host(uint32_t address){
+        ip();
+        add(tlib::capture::LD_W_ABS, 26);
+        program.push_back({tlib::capture::JMP_JEQ_K, 2, 0, address});
+        add(tlib::capture::LD_W_ABS, 30);
+        check(tlib::capture::JMP_JEQ_K, address);
+    }
+
+    void port(uint32_t port){
+        ip();
+        add(tlib::capture::LD_B_ABS, 23);
+        program.push_back({tlib::capture::JMP_JEQ_K, 1, 0, 6});
+        check(tlib::capture::JMP_JEQ_K, 17);
+        add(tlib::capture::LDX_B_MSH, 14);
+        add(tlib::capture::LD_H_IND, 14);
+        program.push_back({tlib::capture::JMP_JEQ_K, 2, 0, port});
+        add(tlib::capture::LD_H_IND, 16);
+        check(tlib::capture::JMP_JEQ_K, port);
+    }
+
+    bool finish(size_t snap_length){
+        add(tlib::capture::RET_K, snap_length);
+        add(tlib::capture::RET_K, 0);
+
+        if(program.size() > tlib::capture::MAX_FILTER){
+            return false;
+        }
+
+        auto reject = program.size() - 1;
+
+        for(auto i : rejects){
+            program[i].jf = reject - i - 1;
+        }
+
+        return true;
+    }
+};
+
+bool parse_address(const std::string& value, uint32_t& address){
+    if(!tlib::dns::is_ip(value)){
+        return false;
+    }
+
+    auto parts = std::split(value, '.');
+
+    address = (std::atoui(parts[0]) << 24) | (std::atoui(parts[1]) << 16) | (std::atoui(parts[2]) << 8) | std::atoui(parts[3]);
+
+    return true;
+}
+
+void copy_from_ring(const char* frames, uint64_t position, char* destination, size_t n){
+    auto offset = position % tlib::capture::RING_SIZE;
+    auto first = std::min(n, tlib::capture::RING_SIZE - offset);
+
+    std::copy_n(frames + offset, first, destination);
+    std::copy_n(frames, n - first, destination + first);
+}
+
+bool flush(size_t fd, std::vector<char>& buffer, size_t& offset){
+    if(buffer.empty()){
+        return true;
+    }
+
+    auto truncated = tlib::truncate(fd, offset + buffer.size());
+
+    if(!truncated){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(truncated.error()));
+        return false;
+    }
+
+    auto written = tlib::write(fd, buffer.begin(), buffer.size(), offset);
+
+    if(!written){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(written.error()));
+        return false;
+    }
+
+    offset += buffer.size();
+    buffer.clear();
+
+    return true;
+}
+
+template<typename T>
+void append(std::vector<char>& buffer, const T& value){
+    auto* bytes = reinterpret_cast<const char*>(&value);
+
+    for(size_t i = 0; i < sizeof(T); ++i){
+        buffer.push_back(bytes[i]);
+    }
+}
+
+int capture(size_t fd, size_t device, filter_builder& filter, size_t snap_length, size_t count){
+    auto mapped = tlib::mmap(device, 0, tlib::capture::MAP_SIZE, std::MMAP_READ | std::MMAP_WRITE);
+
+    if(!mapped){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(mapped.error()));
+        return 1;
+    }
+
+    auto* header = reinterpret_cast<tlib::capture::ring_header*>(*mapped);
+    auto* frames = reinterpret_cast<const char*>(*mapped) + 4096;
+
+    auto poll_fd = tlib::poll_create();
+
+    if(!poll_fd){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(poll_fd.error()));
+        return 1;
+    }
+
+    auto added = tlib::poll_add(*poll_fd, tlib::poll_target::FILE, device, tlib::POLL_IN);
+
+    if(!added){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(added.error()));
+        return 1;
+    }
+
+    tlib::capture::capture_config config;
+    config.snap_length   = snap_length;
+    config.filter        = filter.rejects.empty() ? nullptr : filter.program.begin();
+    config.filter_length = filter.rejects.empty() ? 0 : filter.program.size();
+
+    auto started = tlib::ioctl(device, tlib::ioctl_request::CAPTURE_START, &config);
+
+    if(started < 0){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(-started));
+        return 1;
+    }
+
+    std::vector<char> buffer;
+    size_t offset = 0;
+
+    pcap_header file_header;
+    file_header.magic         = 0xa1b2c3d4;
+    file_header.version_major = 2;
+    file_header.version_minor = 4;
+    file_header.thiszone      = 0;
+    file_header.sigfigs       = 0;
+    file_header.snaplen       = snap_length;
+    file_header.network       = 1; // Ethernet
+
+    append(buffer, file_header);
+
+    std::vector<char> frame(tlib::capture::MAX_SNAP_LENGTH);
+
+    size_t captured = 0;
+    int status = 0;
+
+    while(captured < count){
+        tlib::poll_event events[1];
+        tlib::poll_wait(*poll_fd, events, 1, 1000);
+
+        while(captured < count && header->tail != header->head){
+            auto tail = header->tail;
+
+            tlib::capture::record_header record;
+            copy_from_ring(frames, tail, reinterpret_cast<char*>(&record), sizeof(record));
+            copy_from_ring(frames, tail + sizeof(record), frame.begin(), record.captured);
+
+            auto size = sizeof(record) + record.captured;
+            header->tail = tail + ((size + tlib::capture::RECORD_ALIGN - 1) / tlib::capture::RECORD_ALIGN) * tlib::capture::RECORD_ALIGN;
+
+            pcap_record file_record;
+            file_record.ts_sec   = record.timestamp / 1000000;
+            file_record.ts_usec  = record.timestamp % 1000000;
+            file_record.incl_len = record.captured;
+            file_record.orig_len = record.length;
+
+            append(buffer, file_record);
+
+            for(size_t i = 0; i < record.captured; ++i){
+                buffer.push_back(frame[i]);
+            }
+
+            ++captured;
+
+            if(buffer.size() >= flush_size && !flush(fd, buffer, offset)){
+                status = 1;
+                break;
+            }
+        }
+
+        if(status){
+            break;
+        }
+    }
+
+    tlib::ioctl(device, tlib::ioctl_request::CAPTURE_STOP, nullptr);
+
+    if(!status && !flush(fd, buffer, offset)){
+        status = 1;
+    }
+
+    tlib::printf("pcapdump: %u frames captured, %u dropped\n", captured, size_t(header->dropped));
+
+    tlib::poll_close(*poll_fd);
+
+    return status;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = default_count;
+    size_t snap_length = tlib::capture::MAX_SNAP_LENGTH;
+
+    size_t i = 1;
+    for(; i + 1 < size_t(argc); ++i){
+        std::string param(argv[i]);
+
+        if(param == "-c"){
+            count = std::atoui(argv[++i]);
+        } else if(param == "-s"){
+            snap_length = std::atoui(argv[++i]);
+        } else {
+            break;
+        }
+    }
+
+    if(i >= size_t(argc) || !count || !snap_length){
+        tlib::print_line("usage: pcapdump [-c count] [-s snap_length] file [arp|ip|icmp|tcp|udp|host address|port number]...");
+        return 1;
+    }
+
+    std::string file(argv[i++]);
+
+    filter_builder filter;
+
+    for(; i < size_t(argc); ++i){
+        std::string primitive(argv[i]);
+
+        if(primitive == "arp"){
+            filter.add(tlib::capture::LD_H_ABS, 12);
+            filter.check(tlib::capture::JMP_JEQ_K, 0x806);
+        } else if(primitive == "ip"){
+            filter.ip();
+        } else if(primitive == "icmp"){
+            filter.protocol(1);
+        } else if(primitive == "tcp"){
+            filter.protocol(6);
+        } else if(primitive == "udp"){
+            filter.protocol(17);
+        } else if(primitive == "host" && i + 1 < size_t(argc)){
+            uint32_t address;
+            if(!parse_address(argv[++i], address)){
+                tlib::printf("pcapdump: invalid address: %s\n", argv[i]);
+                return 1;
+            }
+
+            filter.host(address);
+        } else if(primitive == "port" && i + 1 < size_t(argc)){
+            filter.port(std::atoui(argv[++i]));
+        } else {
+            tlib::printf("pcapdump: invalid filter: %s\n", primitive.c_str());
+            return 1;
+        }
+    }
+
+    if(!filter.finish(snap_length)){
+        tlib::print_line("pcapdump: the filter is too long");
+        return 1;
+    }
+
+    auto device = tlib::open("/dev/capture");
+
+    if(!device){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(device.error()));
+        return 1;
+    }
+
+    auto fd = tlib::open(file.c_str(), std::OPEN_CREATE);
+
+    if(!fd){
+        tlib::printf("pcapdump: error: %s\n", std::error_message(fd.error()));
+        tlib::close(*device);
+        return 1;
+    }
+
+    auto status = capture(*fd, *device, filter, snap_length, count);
+
+    tlib::close(*fd);
+    tlib::close(*device);
+
+    return status;
+}
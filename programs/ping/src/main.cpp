@@ -84,6 +84,9 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // The echo requests are written in place when the buffers can be mapped
+    sock.map_packet_buffers();
+
     tlib::icmp::packet_descriptor desc;
     desc.payload_size = 0;
     desc.target_ip    = tlib::ip::make_address(std::atoui(ip_parts[0]), std::atoui(ip_parts[1]), std::atoui(ip_parts[2]), std::atoui(ip_parts[3]));
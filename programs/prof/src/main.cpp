@@ -0,0 +1,388 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string.hpp>
+#include <vector.hpp>
+#include <algorithms.hpp>
+
+#include <tlib/file.hpp>
+#include <tlib/system.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/print.hpp>
+#include <tlib/elf.hpp>
+
+namespace {
+
+constexpr const size_t read_size = 4096; ///< The bytes read from the profiler at once
+constexpr const size_t drain_ms = 100;   ///< The delay between two reads while profiling
+
+constexpr const size_t max_frames = 9;   ///< The instruction pointer and the maximum of frames of a sample
+
+constexpr const uint32_t SHT_SYMTAB = 2;
+constexpr const uint8_t STT_FUNC = 2;
+
+char read_buffer[read_size];
+
+struct function {
+    uint64_t address;  ///< The first address of the function
+    uint64_t size;     ///< The size of the function, 0 if unknown
+    uint32_t name;     ///< The name of the function in the string table
+    size_t self = 0;   ///< The samples in the function itself
+    size_t total = 0;  ///< The samples with the function in the call chain
+};
+
+struct user_process {
+    size_t pid;     ///< The pid of the process
+    size_t samples; ///< The samples in user mode
+};
+
+std::vector<function> functions;
+std::vector<user_process> user_processes;
+char* string_table = nullptr;
+size_t string_table_size = 0;
+
+size_t kernel_samples = 0;
+size_t unknown_samples = 0;
+size_t lines = 0;
+
+template<typename T, typename Less>
+void sort(std::vector<T>& values, Less less){
+    std::sort(values.begin(), values.end(), less);
+}
+
+bool read_exactly(size_t fd, char* buffer, size_t size, size_t offset){
+    size_t done = 0;
+
+    while(done < size){
+        auto result = tlib::read(fd, buffer + done, size - done, offset + done);
+
+        if(!result || !*result){
+            return false;
+        }
+
+        done += *result;
+    }
+
+    return true;
+}
+
+// Load the functions of the symbol table of the kernel
+bool load_symbols(const char* file){
+    auto fd = tlib::open(file);
+
+    if(!fd){
+        tlib::printf("prof: error: %s: %s\n", file, std::error_message(fd.error()));
+        return false;
+    }
+
+    elf::elf_header header;
+
+    if(!read_exactly(*fd, reinterpret_cast<char*>(&header), sizeof(header), 0) || !elf::is_valid(reinterpret_cast<char*>(&header))){
+        tlib::printf("prof: error: %s is not an ELF64 file\n", file);
+        tlib::close(*fd);
+        return false;
+    }
+
+    auto* sections = new elf::section_header[header.e_shnum];
+
+    if(!read_exactly(*fd, reinterpret_cast<char*>(sections), header.e_shnum * sizeof(elf::section_header), header.e_shoff)){
+        tlib::printf("prof: error: Cannot read the sections of %s\n", file);
+        delete[] sections;
+        tlib::close(*fd);
+        return false;
+    }
+
+    for(size_t s = 0; s < header.e_shnum; ++s){
+        auto& section = sections[s];
+
+        if(section.sh_type != SHT_SYMTAB || section.sh_link >= header.e_shnum){
+            continue;
+        }
+
+        auto& strings = sections[section.sh_link];
+
+        string_table_size = strings.sh_size;
+        string_table = new char[string_table_size + 1];
+        string_table[string_table_size] = '\0';
+
+        auto count = section.sh_size / sizeof(elf::symbol);
+        auto* symbols = new elf::symbol[count];
+
+        if(read_exactly(*fd, string_table, string_table_size, strings.sh_offset)
+                && read_exactly(*fd, reinterpret_cast<char*>(symbols), count * sizeof(elf::symbol), section.sh_offset)){
+            for(size_t i = 0; i < count; ++i){
+                auto& symbol = symbols[i];
+
+                if((symbol.st_info & 0xF) == STT_FUNC && symbol.st_value && symbol.st_name < string_table_size){
+                    function f;
+                    f.address = symbol.st_value;
+                    f.size = symbol.st_size;
+                    f.name = symbol.st_name;
+
+                    functions.push_back(f);
+                }
+            }
+        }
+
+        delete[] symbols;
+
+        break;
+    }
+
+    delete[] sections;
+
+    tlib::close(*fd);
+
+    if(functions.empty()){
+        tlib::printf("prof: error: No function symbols in %s\n", file);
+        return false;
+    }
+
+    sort(functions, [](const function& a, const function& b){ return a.address < b.address; });
+
+    return true;
+}
+
+// Find the function containing the address, -1 if none
+int64_t find_function(uint64_t address){
+    size_t first = 0;
+    size_t last = functions.size();
+
+    // The last function starting at or before the address
+    while(first < last){
+        auto middle = first + (last - first) / 2;
+
+        if(functions[middle].address <= address){
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    if(!first){
+        return -1;
+    }
+
+    auto& f = functions[first - 1];
+
+    if(f.size && address >= f.address + f.size){
+        return -1;
+    }
+
+    return first - 1;
+}
+
+uint64_t parse_hex(const std::string& value){
+    uint64_t result = 0;
+
+    for(char c : value){
+        if(c >= '0' && c <= '9'){
+            result = result * 16 + (c - '0');
+        } else if(c >= 'a' && c <= 'f'){
+            result = result * 16 + (c - 'a' + 10);
+        } else if(c >= 'A' && c <= 'F'){
+            result = result * 16 + (c - 'A' + 10);
+        }
+    }
+
+    return result;
+}
+
+// A sample is "cpu pid k|u rip [frames...]"
+void account(const std::string& line){
+    auto parts = std::split(line);
+
+    if(parts.size() < 4){
+        return;
+    }
+
+    ++lines;
+
+    if(parts[2] == "u"){
+        auto pid = std::atoui(parts[1]);
+
+        for(auto& process : user_processes){
+            if(process.pid == pid){
+                ++process.samples;
+                return;
+            }
+        }
+
+        user_processes.push_back({pid, 1});
+
+        return;
+    }
+
+    ++kernel_samples;
+
+    int64_t chain[max_frames];
+    size_t depth = 0;
+
+    for(size_t i = 3; i < parts.size() && depth < max_frames; ++i){
+        chain[depth++] = find_function(parse_hex(parts[i]));
+    }
+
+    if(chain[0] < 0){
+        ++unknown_samples;
+    } else {
+        ++functions[chain[0]].self;
+    }
+
+    // A recursive function is only counted once per sample
+    for(size_t i = 0; i < depth; ++i){
+        if(chain[i] < 0){
+            continue;
+        }
+
+        bool seen = false;
+
+        for(size_t j = 0; j < i; ++j){
+            seen |= chain[j] == chain[i];
+        }
+
+        if(!seen){
+            ++functions[chain[i]].total;
+        }
+    }
+}
+
+void drain(size_t fd, std::string& partial, bool keep = true){
+    while(true){
+        auto read = tlib::read(fd, read_buffer, read_size);
+
+        if(!read){
+            tlib::printf("prof: error: %s\n", std::error_message(read.error()));
+            return;
+        }
+
+        if(!*read){
+            return;
+        }
+
+        for(size_t i = 0; i < *read; ++i){
+            if(read_buffer[i] == '\n'){
+                if(keep){
+                    account(partial);
+                }
+
+                partial.clear();
+            } else {
+                partial += read_buffer[i];
+            }
+        }
+    }
+}
+
+bool command(size_t fd, const std::string& value){
+    auto result = tlib::write(fd, value.c_str(), value.size());
+
+    if(!result){
+        tlib::printf("prof: error: %s\n", std::error_message(result.error()));
+        return false;
+    }
+
+    return true;
+}
+
+std::string percent(size_t samples){
+    auto permille = (samples * 1000) / lines;
+
+    return std::to_string(permille / 10) + "." + std::to_string(permille % 10);
+}
+
+void report(size_t depth){
+    if(!lines){
+        tlib::print_line("prof: No samples");
+        return;
+    }
+
+    tlib::printf("%u samples (%u kernel, %u user)\n", lines, kernel_samples, lines - kernel_samples);
+
+    std::vector<function> sampled;
+
+    for(auto& f : functions){
+        if(f.self || f.total){
+            sampled.push_back(f);
+        }
+    }
+
+    sort(sampled, [](const function& a, const function& b){ return a.self > b.self || (a.self == b.self && a.total > b.total); });
+
+    if(depth){
+        tlib::print_line("self    %       total   function");
+    } else {
+        tlib::print_line("self    %       function");
+    }
+
+    for(auto& f : sampled){
+        tlib::printf("%8u%8s", f.self, percent(f.self).c_str());
+
+        if(depth){
+            tlib::printf("%8u", f.total);
+        }
+
+        tlib::printf("%s\n", string_table + f.name);
+    }
+
+    if(unknown_samples){
+        tlib::printf("%8u%8s[unknown]\n", unknown_samples, percent(unknown_samples).c_str());
+    }
+
+    for(auto& process : user_processes){
+        tlib::printf("%8u%8s[user pid %u]\n", process.samples, percent(process.samples).c_str(), process.pid);
+    }
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[]){
+    if(argc > 4){
+        tlib::print_line("Usage: prof [seconds] [depth] [kernel_elf]");
+        return 1;
+    }
+
+    size_t seconds = argc > 1 ? std::atoui(argv[1]) : 5;
+    size_t depth = argc > 2 ? std::atoui(argv[2]) : 0;
+    const char* kernel = argc > 3 ? argv[3] : "/kernel.elf";
+
+    if(!load_symbols(kernel)){
+        return 1;
+    }
+
+    auto fd = tlib::open("/proc/profile");
+
+    if(!fd){
+        tlib::printf("prof: error: %s\n", std::error_message(fd.error()));
+        return 1;
+    }
+
+    std::string partial;
+
+    // Discard the samples of a previous run
+    drain(*fd, partial, false);
+
+    if(!command(*fd, "start " + std::to_string(depth))){
+        tlib::close(*fd);
+        return 1;
+    }
+
+    // The rings are drained while profiling, they would overflow otherwise
+    for(size_t elapsed = 0; elapsed < seconds * 1000; elapsed += drain_ms){
+        tlib::sleep_ms(drain_ms);
+        drain(*fd, partial);
+    }
+
+    command(*fd, "stop");
+
+    drain(*fd, partial);
+
+    tlib::close(*fd);
+
+    report(depth);
+
+    return 0;
+}
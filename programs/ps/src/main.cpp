@@ -98,6 +98,16 @@ int main(int /*argc*/, char* /*argv*/[]){
                     std::string base_path = "/proc/";
                     std::string entry_name = &entry->name;
 
+                    // Only the process folders are named after a pid
+                    if(entry_name[0] < '0' || entry_name[0] > '9'){
+                        if(!entry->offset_next){
+                            break;
+                        }
+
+                        position += entry->offset_next;
+                        continue;
+                    }
+
                     auto pid = parse(read_file(base_path + entry_name + "/pid"));
                     auto ppid = parse(read_file(base_path + entry_name + "/ppid"));
                     auto system = read_file(base_path + entry_name + "/system") == "true";
@@ -93,6 +93,17 @@ int main(int argc, char* argv[]){
                 if(size == 0){
                     tlib::print_line("readelf: error: The file is empty");
                 } else {
+                    // The files of the page cache are parsed in place
+                    auto mapped = tlib::mmap(*fd, 0, size);
+
+                    if(mapped.valid()){
+                        readelf(static_cast<char*>(*mapped));
+
+                        tlib::close(*fd);
+
+                        return 0;
+                    }
+
                     auto buffer = new char[size];
 
                     auto content_result = tlib::read(*fd, buffer, size);
@@ -0,0 +1,21 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <tlib/file.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/print.hpp>
+
+int main(){
+    auto result = tlib::sync();
+
+    if(!result){
+        tlib::printf("sync: error: %s\n", std::error_message(result.error()));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,267 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <string.hpp>
+#include <vector.hpp>
+
+#include <tlib/file.hpp>
+#include <tlib/system.hpp>
+#include <tlib/errors.hpp>
+#include <tlib/print.hpp>
+#include <tlib/directory_entry.hpp>
+
+namespace {
+
+static constexpr const size_t BUFFER_SIZE = 4096;
+
+/*!
+ * \brief The counters of /proc/<pid>/stat of a process
+ */
+struct process_stat {
+    size_t pid;
+    std::string name;
+    uint64_t user_ms;
+    uint64_t kernel_ms;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t page_faults;
+    uint64_t resident_pages;
+    uint64_t read_bytes;
+    uint64_t written_bytes;
+    uint64_t received_bytes;
+    uint64_t sent_bytes;
+    uint64_t cpu_ms; ///< The processor time since the previous refresh
+};
+
+std::string read_file(const std::string& path){
+    auto fd = tlib::open(path.c_str());
+
+    if(!fd.valid()){
+        return "";
+    }
+
+    std::string content;
+
+    auto info = tlib::stat(*fd);
+
+    if(info.valid()){
+        auto size = info->size;
+
+        auto buffer = new char[size + 1];
+
+        auto content_result = tlib::read(*fd, buffer, size);
+
+        if(content_result.valid()){
+            buffer[*content_result] = '\0';
+            content = buffer;
+        }
+
+        delete[] buffer;
+    }
+
+    tlib::close(*fd);
+
+    return content;
+}
+
+// Each line of the stat file is a counter and its value
+uint64_t stat_value(const std::string& stat, const char* key){
+    std::string prefix = key;
+    prefix += ' ';
+
+    size_t start = 0;
+
+    while(start < stat.size()){
+        size_t end = start;
+        while(end < stat.size() && stat[end] != '\n'){
+            ++end;
+        }
+
+        size_t i = 0;
+        while(i < prefix.size() && start + i < end && stat[start + i] == prefix[i]){
+            ++i;
+        }
+
+        if(i == prefix.size()){
+            return std::parse(stat.c_str() + start + i, stat.c_str() + end);
+        }
+
+        start = end + 1;
+    }
+
+    return 0;
+}
+
+bool read_stat(const std::string& pid, process_stat& process){
+    auto base_path = "/proc/" + pid;
+
+    auto stat = read_file(base_path + "/stat");
+
+    if(stat.empty()){
+        return false;
+    }
+
+    process.pid = std::parse(pid);
+    process.name = read_file(base_path + "/name");
+    process.user_ms = stat_value(stat, "user_ms");
+    process.kernel_ms = stat_value(stat, "kernel_ms");
+    process.voluntary_switches = stat_value(stat, "voluntary_switches");
+    process.involuntary_switches = stat_value(stat, "involuntary_switches");
+    process.page_faults = stat_value(stat, "page_faults");
+    process.resident_pages = stat_value(stat, "resident_pages");
+    process.read_bytes = stat_value(stat, "read_bytes");
+    process.written_bytes = stat_value(stat, "written_bytes");
+    process.received_bytes = stat_value(stat, "received_bytes");
+    process.sent_bytes = stat_value(stat, "sent_bytes");
+    process.cpu_ms = 0;
+
+    return true;
+}
+
+bool read_processes(std::vector<process_stat>& processes){
+    auto fd = tlib::open("/proc/");
+
+    if(!fd.valid()){
+        tlib::printf("top: error: %s\n", std::error_message(fd.error()));
+        return false;
+    }
+
+    auto entries_buffer = new char[BUFFER_SIZE];
+
+    auto entries_result = tlib::entries(*fd, entries_buffer, BUFFER_SIZE);
+
+    if(entries_result.valid()){
+        size_t position = 0;
+
+        while(true){
+            auto entry = reinterpret_cast<tlib::directory_entry*>(entries_buffer + position);
+
+            std::string entry_name = &entry->name;
+
+            // Only the process folders are named after a pid
+            if(entry_name[0] >= '0' && entry_name[0] <= '9'){
+                process_stat process;
+
+                // The process may have exited since the listing
+                if(read_stat(entry_name, process)){
+                    processes.push_back(process);
+                }
+            }
+
+            if(!entry->offset_next){
+                break;
+            }
+
+            position += entry->offset_next;
+        }
+    } else {
+        tlib::printf("top: error: %s\n", std::error_message(entries_result.error()));
+    }
+
+    delete[] entries_buffer;
+
+    tlib::close(*fd);
+
+    return entries_result.valid();
+}
+
+void compute_cpu(std::vector<process_stat>& processes, const std::vector<process_stat>& previous){
+    for(auto& process : processes){
+        uint64_t before = 0;
+
+        // A pid may be reused, the new process starts from zero
+        for(auto& old : previous){
+            if(old.pid == process.pid && old.user_ms + old.kernel_ms <= process.user_ms + process.kernel_ms){
+                before = old.user_ms + old.kernel_ms;
+                break;
+            }
+        }
+
+        process.cpu_ms = process.user_ms + process.kernel_ms - before;
+    }
+
+    // Insertion sort, the busiest first, the tables are small
+    for(size_t i = 1; i < processes.size(); ++i){
+        auto value = processes[i];
+        size_t j = i;
+
+        for(; j > 0 && processes[j - 1].cpu_ms < value.cpu_ms; --j){
+            processes[j] = processes[j - 1];
+        }
+
+        processes[j] = value;
+    }
+}
+
+void display(const std::vector<process_stat>& processes, uint64_t elapsed){
+    tlib::clear();
+
+    tlib::printf("top - %u processes, refresh every %u ms, q to quit\n\n", processes.size(), elapsed);
+    tlib::print_line("PID CPU%   User   Kernel VCSW   ICSW   Faults Res    Read   Write  Recv   Sent   Name");
+
+    auto rows = tlib::get_rows();
+
+    for(size_t i = 0; i < processes.size() && i + 4 < rows; ++i){
+        auto& process = processes[i];
+
+        tlib::printf("%3u %6u %6u %6u %6u %6u %6u %6m %6m %6m %6m %6m %s\n",
+            process.pid, elapsed ? process.cpu_ms * 100 / elapsed : 0,
+            process.user_ms, process.kernel_ms,
+            process.voluntary_switches, process.involuntary_switches, process.page_faults,
+            process.resident_pages * 4096, process.read_bytes, process.written_bytes,
+            process.received_bytes, process.sent_bytes, process.name.c_str());
+    }
+}
+
+} // end of anonymous space
+
+int main(int argc, char* argv[]){
+    if(argc > 3){
+        tlib::print_line("Usage: top [delay_ms] [iterations]");
+        return 1;
+    }
+
+    size_t delay = argc > 1 ? std::atoui(argv[1]) : 1000;
+    size_t iterations = argc > 2 ? std::atoui(argv[2]) : 0;
+
+    std::vector<process_stat> previous;
+
+    if(!read_processes(previous)){
+        return 1;
+    }
+
+    tlib::set_canonical(false);
+
+    auto last = tlib::ms_time();
+
+    for(size_t i = 0; !iterations || i < iterations; ++i){
+        // A key stops the refresh, the others only refresh early
+        auto code = tlib::read_input_raw(delay);
+
+        if(code == std::keycode::PRESSED_Q){
+            break;
+        }
+
+        std::vector<process_stat> processes;
+
+        if(!read_processes(processes)){
+            break;
+        }
+
+        auto now = tlib::ms_time();
+
+        compute_cpu(processes, previous);
+        display(processes, now - last);
+
+        last = now;
+        previous = processes;
+    }
+
+    tlib::set_canonical(true);
+
+    return 0;
+}
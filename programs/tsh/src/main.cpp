@@ -7,11 +7,13 @@
 
 #include <string.hpp>
 #include <algorithms.hpp>
+#include <unordered_map.hpp>
 
 #include <tlib/print.hpp>
 #include <tlib/file.hpp>
 #include <tlib/system.hpp>
 #include <tlib/errors.hpp>
+#include <tlib/directory_entry.hpp>
 
 namespace {
 
@@ -29,21 +31,56 @@ void sleep_command(const std::vector<std::string>& params);
 void clear_command(const std::vector<std::string>& params);
 void cd_command(const std::vector<std::string>& params);
 void pwd_command(const std::vector<std::string>& params);
+void ls_command(const std::vector<std::string>& params);
+void rehash_command(const std::vector<std::string>& params);
+void time_command(const std::vector<std::string>& params);
+void jobs_command(const std::vector<std::string>& params);
+void wait_command(const std::vector<std::string>& params);
+void source_command(const std::vector<std::string>& params);
+
+void run_command(const std::vector<std::string>& params, const std::string& line);
+void run_script(const std::string& path);
 
 struct command_definition {
     const char* name;
     void (*function)(const std::vector<std::string>&);
 };
 
-command_definition commands[6] = {
+command_definition commands[12] = {
     {"exit", exit_command},
     {"echo", echo_command},
     {"sleep", sleep_command},
     {"clear", clear_command},
     {"cd", cd_command},
     {"pwd", pwd_command},
+    {"ls", ls_command},
+    {"rehash", rehash_command},
+    {"time", time_command},
+    {"jobs", jobs_command},
+    {"wait", wait_command},
+    {"source", source_command},
 };
 
+static constexpr const size_t ENTRIES_BUFFER_SIZE = 4096;
+
+// The directories searched for the commands, in order
+const char* search_path[1] = {"/bin/"};
+
+// The resolved executables of the commands, until the next rehash
+std::unordered_map<std::string, std::string> command_cache;
+
+/*!
+ * \brief A command running in the background
+ */
+struct job {
+    size_t id;                ///< The number of the job, for wait
+    std::vector<size_t> pids; ///< The processes of the job, several for a pipeline
+    std::string line;         ///< The command line of the job
+};
+
+std::vector<job> jobs;
+size_t next_job = 1;
+
 void exit_command(const std::vector<std::string>&){
     tlib::exit(0);
 }
@@ -109,11 +146,483 @@ void pwd_command(const std::vector<std::string>&){
     tlib::print_line(cwd);
 }
 
+// Order the files by name, byte by byte
+bool name_less(const char* a, const char* b){
+    while(*a && *a == *b){
+        ++a;
+        ++b;
+    }
+
+    return *a < *b;
+}
+
+void list_directory(const std::string& directory, bool list, bool hidden){
+    auto fd = tlib::open(directory.c_str());
+
+    if(!fd.valid()){
+        tlib::printf("ls: open error: %s\n", std::error_message(fd.error()));
+        return;
+    }
+
+    auto info = tlib::stat(*fd);
+
+    if(!info.valid()){
+        tlib::printf("ls: stat error: %s\n", std::error_message(info.error()));
+    } else if(!(info->flags & tlib::STAT_FLAG_DIRECTORY)){
+        tlib::print_line("ls: error: Is not a directory");
+    } else {
+        auto buffer = new char[ENTRIES_BUFFER_SIZE];
+
+        auto entries_result = tlib::entries_stat(*fd, buffer, ENTRIES_BUFFER_SIZE);
+
+        if(!entries_result.valid()){
+            tlib::printf("ls: entries error: %s\n", std::error_message(entries_result.error()));
+        } else if(*entries_result){
+            std::vector<const char*> files;
+
+            size_t position = 0;
+
+            while(true){
+                auto entry = reinterpret_cast<tlib::directory_stat_entry*>(buffer + position);
+
+                if(hidden || !(entry->info.flags & tlib::STAT_FLAG_HIDDEN)){
+                    files.push_back(&entry->name);
+                }
+
+                if(!entry->offset_next){
+                    break;
+                }
+
+                position += entry->offset_next;
+            }
+
+            std::sort(files.begin(), files.end(), name_less);
+
+            for(auto file : files){
+                if(list){
+                    tlib::print_line(file);
+                } else {
+                    tlib::print(file);
+                    tlib::print(' ');
+                }
+            }
+
+            if(!list){
+                tlib::print_line();
+            }
+        }
+
+        delete[] buffer;
+    }
+
+    tlib::close(*fd);
+}
+
+// The same options as /bin/ls, without starting a process
+void ls_command(const std::vector<std::string>& params){
+    bool list = false;
+    bool hidden = false;
+
+    size_t i = 1;
+    for(; i < params.size() && params[i][0] == '-'; ++i){
+        for(size_t j = 1; j < params[i].size(); ++j){
+            auto c = params[i][j];
+
+            if(c == 'l'){
+                list = true;
+            } else if(c == 'a'){
+                hidden = true;
+            } else {
+                tlib::print_line("ls: invalid argument");
+                return;
+            }
+        }
+    }
+
+    if(i == params.size()){
+        list_directory(tlib::current_working_directory(), list, hidden);
+    } else {
+        list_directory(params.back(), list, hidden);
+    }
+}
+
+void rehash_command(const std::vector<std::string>&){
+    command_cache.clear();
+}
+
+/*!
+ * \brief The processor times of the shell and of its terminated children
+ */
+struct cpu_times {
+    uint64_t user_ms = 0;
+    uint64_t kernel_ms = 0;
+};
+
+cpu_times read_cpu_times(){
+    cpu_times times;
+
+    tlib::file f("/proc/" + std::to_string(tlib::get_pid()) + "/stat");
+
+    if(!f){
+        return times;
+    }
+
+    auto contents = f.read_file();
+
+    // Each line of the stat file is a counter and its value
+    for(auto line : std::split_view(contents, '\n')){
+        auto space = line.find(' ');
+
+        if(space == std::string_view::npos){
+            continue;
+        }
+
+        auto key   = line.substr(0, space);
+        auto value = std::atoui(line.substr(space + 1));
+
+        if(key == "user_ms" || key == "children_user_ms"){
+            times.user_ms += value;
+        } else if(key == "kernel_ms" || key == "children_kernel_ms"){
+            times.kernel_ms += value;
+        }
+    }
+
+    return times;
+}
+
+void time_command(const std::vector<std::string>& params){
+    if(params.size() == 1){
+        tlib::print_line("Usage: time command");
+        return;
+    }
+
+    std::vector<std::string> command;
+    std::string line;
+
+    for(size_t i = 1; i < params.size(); ++i){
+        command.push_back(params[i]);
+
+        if(i > 1){
+            line += ' ';
+        }
+
+        line += params[i];
+    }
+
+    auto before = read_cpu_times();
+    auto start = tlib::ms_time();
+
+    run_command(command, line);
+
+    auto wall = tlib::ms_time() - start;
+    auto after = read_cpu_times();
+
+    tlib::printf("real %ums user %ums sys %ums\n", wall, after.user_ms - before.user_ms, after.kernel_ms - before.kernel_ms);
+}
+
+// Find the executable of a command in the search path, the result is kept
+// until the next rehash
+std::string executable_path(const std::vector<std::string>& params){
+    auto& executable = params[0];
+
+    if(executable[0] == '/'){
+        return executable;
+    }
+
+    auto it = command_cache.find(executable);
+
+    if(it != command_cache.end()){
+        return it->second;
+    }
+
+    for(auto directory : search_path){
+        std::string candidate = directory + executable;
+
+        auto fd = tlib::open(candidate.c_str());
+
+        if(fd.valid()){
+            tlib::close(*fd);
+
+            command_cache.insert({executable, candidate});
+
+            return candidate;
+        }
+    }
+
+    // The missing commands are not cached, they may be installed later
+    return search_path[0] + executable;
+}
+
+std::vector<std::string> arguments(const std::vector<std::string>& params){
+    std::vector<std::string> args;
+
+    if(params.size() > 1){
+        args.reserve(params.size() - 1);
+        for(size_t i = 1; i < params.size(); ++i){
+            args.push_back(params[i]);
+        }
+    }
+
+    return args;
+}
+
+void exec_error(size_t error, const std::string& command){
+    tlib::print("error: ");
+    tlib::print_line(std::error_message(error));
+    tlib::print("command: \"");
+    tlib::print(command);
+    tlib::print_line("\"");
+}
+
+/*!
+ * \brief Start the stages of a pipeline concurrently, each stage reads the
+ * output of the previous one through a pipe
+ * \return the processes of the started stages
+ */
+std::vector<size_t> start_pipeline(const std::vector<std::string>& stages){
+    std::vector<size_t> pids;
+
+    // The read end of the previous pipe, 0 for the terminal
+    size_t input = 0;
+
+    for(size_t i = 0; i < stages.size(); ++i){
+        auto params = std::split(stages[i]);
+
+        if(params.empty()){
+            tlib::print_line("tsh: empty command in the pipeline");
+            break;
+        }
+
+        size_t read_fd = 0;
+        size_t write_fd = 0;
+
+        if(i + 1 < stages.size()){
+            auto status = tlib::pipe(read_fd, write_fd);
+
+            if(!status){
+                tlib::printf("tsh: pipe error: %s\n", std::error_message(status.error()));
+                break;
+            }
+        }
+
+        const size_t handles[3] = {input, write_fd, 0};
+
+        auto result = tlib::exec(executable_path(params).c_str(), arguments(params), 0, handles);
+
+        // Only the stages keep the ends, the end of file reaches the readers
+        if(input){
+            tlib::close(input);
+        }
+
+        if(write_fd){
+            tlib::close(write_fd);
+        }
+
+        input = read_fd;
+
+        if(!result){
+            exec_error(result.error(), stages[i]);
+            break;
+        }
+
+        pids.push_back(*result);
+    }
+
+    if(input){
+        tlib::close(input);
+    }
+
+    return pids;
+}
+
+/*!
+ * \brief Run a built-in command or start the executable of the command.
+ *
+ * The built-in commands are always run to completion in the shell.
+ *
+ * \return the processes started for the command, none for a built-in
+ */
+std::vector<size_t> start_command(const std::vector<std::string>& params, const std::string& line){
+    std::vector<size_t> pids;
+
+    for(auto& command : commands){
+        if(params[0] == command.name){
+            command.function(params);
+            return pids;
+        }
+    }
+
+    auto result = tlib::exec(executable_path(params).c_str(), arguments(params));
+
+    if(result.valid()){
+        pids.push_back(*result);
+    } else {
+        // The executable may have been removed since it was cached
+        if(result.error() == std::ERROR_NOT_EXISTS){
+            command_cache.erase(params[0]);
+        }
+
+        exec_error(result.error(), line);
+    }
+
+    return pids;
+}
+
+void run_command(const std::vector<std::string>& params, const std::string& line){
+    for(auto pid : start_command(params, line)){
+        tlib::await_termination(pid);
+    }
+}
+
+// Start a command or a pipeline, in the foreground or in the background
+void start_job(const std::string& line, bool background){
+    std::vector<size_t> pids;
+
+    auto stages = std::split(line, '|');
+
+    if(stages.size() > 1){
+        pids = start_pipeline(stages);
+    } else {
+        auto params = std::split(line);
+
+        if(params.empty()){
+            return;
+        }
+
+        pids = start_command(params, line);
+    }
+
+    if(pids.empty()){
+        return;
+    }
+
+    if(background){
+        tlib::printf("[%u] %u\n", next_job, pids.back());
+
+        jobs.push_back({next_job++, std::move(pids), line});
+    } else {
+        for(auto pid : pids){
+            tlib::await_termination(pid);
+        }
+    }
+}
+
+/*!
+ * \brief Execute a command line.
+ *
+ * The commands separated by & run concurrently, the last one runs in the
+ * foreground unless the line ends with &.
+ */
+void execute(const std::string& line){
+    auto parts = std::split(line, '&');
+
+    size_t last = line.size();
+    while(last > 0 && (line[last - 1] == ' ' || line[last - 1] == '\t')){
+        --last;
+    }
+
+    bool background = last > 0 && line[last - 1] == '&';
+
+    for(size_t i = 0; i < parts.size(); ++i){
+        start_job(parts[i], background || i + 1 < parts.size());
+    }
+}
+
+void wait_job(const job& j){
+    for(auto pid : j.pids){
+        tlib::await_termination(pid);
+    }
+
+    tlib::printf("[%u] Done %s\n", j.id, j.line.c_str());
+}
+
+void jobs_command(const std::vector<std::string>&){
+    for(auto& j : jobs){
+        tlib::printf("[%u] %s\n", j.id, j.line.c_str());
+    }
+}
+
+// Wait for all the jobs, or only for the given ones (by number, with or without %)
+void wait_command(const std::vector<std::string>& params){
+    if(params.size() == 1){
+        for(auto& j : jobs){
+            wait_job(j);
+        }
+
+        jobs.clear();
+
+        return;
+    }
+
+    for(size_t i = 1; i < params.size(); ++i){
+        std::string_view id = params[i];
+
+        if(!id.empty() && id[0] == '%'){
+            id.remove_prefix(1);
+        }
+
+        auto number = std::atoui(id);
+
+        auto it = std::find_if(jobs.begin(), jobs.end(), [number](const job& j){ return j.id == number; });
+
+        if(it == jobs.end()){
+            tlib::printf("wait: no such job: %s\n", params[i].c_str());
+            continue;
+        }
+
+        wait_job(*it);
+        jobs.erase(it);
+    }
+}
+
+void source_command(const std::vector<std::string>& params){
+    if(params.size() == 1){
+        tlib::print_line("Usage: source file");
+        return;
+    }
+
+    run_script(params[1]);
+}
+
+// Execute each line of the script, the empty lines and the comments are skipped
+void run_script(const std::string& path){
+    tlib::file f(path);
+
+    if(!f){
+        tlib::printf("tsh: %s: %s\n", path.c_str(), std::error_message(f.error()));
+        return;
+    }
+
+    for(auto& line : f.lines()){
+        size_t first = 0;
+        while(first < line.size() && (line[first] == ' ' || line[first] == '\t')){
+            ++first;
+        }
+
+        if(first == line.size() || line[first] == '#'){
+            continue;
+        }
+
+        execute(line);
+    }
+}
+
 } //end of anonymous namespace
 
-int main(){
+int main(int argc, char* argv[]){
     get_console_information();
 
+    // A script runs to completion, background jobs included
+    if(argc > 1){
+        run_script(argv[1]);
+
+        for(auto& j : jobs){
+            wait_job(j);
+        }
+
+        return 0;
+    }
+
     char input_buffer[256];
     std::string current_input;
 
@@ -130,42 +639,7 @@ int main(){
             }
 
             if(current_input.size() > 0){
-                auto params = std::split(current_input);
-
-                bool found = false;
-                for(auto& command : commands){
-                    if(params[0] == command.name){
-                        command.function(params);
-                        found = true;
-                        break;
-                    }
-                }
-
-                if(!found){
-                    std::vector<std::string> args;
-                    if(params.size() > 1){
-                        args.reserve(params.size() - 1);
-                        for(size_t i = 1; i < params.size(); ++i){
-                            args.push_back(params[i]);
-                        }
-                    }
-
-                    auto executable = params[0];
-
-                    if(executable[0] != '/'){
-                        executable = "/bin/" + executable;
-                    }
-
-                    auto result = tlib::exec_and_wait(executable.c_str(), args);
-
-                    if(!result.valid()){
-                        tlib::print("error: ");
-                        tlib::print_line(std::error_message(result.error()));
-                        tlib::print("command: \"");
-                        tlib::print(current_input);
-                        tlib::print_line("\"");
-                    }
-                }
+                execute(current_input);
             }
 
             current_input.clear();
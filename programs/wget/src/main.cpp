@@ -5,15 +5,361 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <string.hpp>
+#include <algorithms.hpp>
+
 #include <tlib/system.hpp>
 #include <tlib/errors.hpp>
 #include <tlib/print.hpp>
 #include <tlib/net.hpp>
 #include <tlib/dns.hpp>
+#include <tlib/file.hpp>
+#include <tlib/flags.hpp>
 
 namespace {
 
-int wget_http(const std::string& url){
+constexpr const size_t timeout_ms     = 5000;             ///< The time to wait for the server
+constexpr const size_t receive_size   = 16 * 1024;        ///< The bytes read from the socket at once
+constexpr const size_t write_size     = 64 * 1024;        ///< The bytes written to the file at once
+constexpr const size_t receive_buffer = 1024 * 1024;      ///< The receive buffer of the socket, filled while writing
+
+char receive_data[receive_size];
+char write_data[write_size];
+
+/*!
+ * \brief The body is written to the file in large blocks, at offsets
+ * multiple of their size
+ */
+struct file_writer {
+    size_t fd;
+    size_t used   = 0; ///< The bytes waiting in the buffer
+    size_t offset = 0; ///< The bytes already written to the file
+    bool failed   = false;
+
+    explicit file_writer(size_t fd) : fd(fd) {}
+
+    void append(const char* data, size_t n){
+        while(n && !failed){
+            auto copied = std::min(n, write_size - used);
+
+            std::copy_n(data, copied, write_data + used);
+
+            used += copied;
+            data += copied;
+            n -= copied;
+
+            if(used == write_size){
+                flush();
+            }
+        }
+    }
+
+    void flush(){
+        if(failed){
+            return;
+        }
+
+        // The file also shrinks to the body if it existed before
+        auto truncated = tlib::truncate(fd, offset + used);
+
+        if(!truncated){
+            tlib::printf("wget: error: %s\n", std::error_message(truncated.error()));
+            failed = true;
+            return;
+        }
+
+        if(used){
+            auto written = tlib::write(fd, write_data, used, offset);
+
+            if(!written){
+                tlib::printf("wget: error: %s\n", std::error_message(written.error()));
+                failed = true;
+                return;
+            }
+        }
+
+        offset += used;
+        used = 0;
+    }
+
+    size_t size() const {
+        return offset + used;
+    }
+};
+
+/*!
+ * \brief The states of the decoding of the body
+ */
+enum class body_state {
+    DATA,     ///< Bytes of the body, or of the current chunk
+    SIZE,     ///< The line with the size of the next chunk
+    DATA_END, ///< The end of line after the data of a chunk
+    TRAILER,  ///< The header lines after the last chunk
+    DONE      ///< The whole body was received
+};
+
+/*!
+ * \brief An HTTP response parsed as its bytes arrive
+ */
+struct response {
+    bool in_headers  = true; ///< Indicates if the headers are not complete yet
+    bool status_line = true; ///< Indicates if the next line is the status line
+    std::string line;        ///< The current line of the headers or of the chunks
+
+    size_t status       = 0;     ///< The status code of the response
+    bool chunked        = false; ///< Indicates if the body uses the chunked transfer encoding
+    bool has_length     = false; ///< Indicates if the length of the body is known
+    uint64_t length     = 0;     ///< The length of the body given by the server
+
+    body_state state    = body_state::DATA;
+    uint64_t remaining  = 0; ///< The bytes left in the current chunk or in the body
+
+    bool done() const {
+        return state == body_state::DONE;
+    }
+
+    // The body ends with the connection when its length is not known
+    bool ends_with_close() const {
+        return !in_headers && !chunked && !has_length;
+    }
+};
+
+char to_lower(char c){
+    if(c >= 'A' && c <= 'Z'){
+        return c - 'A' + 'a';
+    }
+
+    return c;
+}
+
+// Compare the value with the lower case string, ignoring the case of the value
+bool equals_lower(std::string_view value, std::string_view lower){
+    if(value.size() != lower.size()){
+        return false;
+    }
+
+    for(size_t i = 0; i < value.size(); ++i){
+        if(to_lower(value[i]) != lower[i]){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string_view trim(std::string_view value){
+    size_t first = 0;
+    size_t last = value.size();
+
+    while(first < last && (value[first] == ' ' || value[first] == '\t')){
+        ++first;
+    }
+
+    while(last > first && (value[last - 1] == ' ' || value[last - 1] == '\t' || value[last - 1] == '\r')){
+        --last;
+    }
+
+    return value.substr(first, last - first);
+}
+
+// The size of a chunk, its extensions are ignored
+uint64_t parse_hex(std::string_view value){
+    uint64_t result = 0;
+
+    for(auto c : value){
+        if(c >= '0' && c <= '9'){
+            result = result * 16 + (c - '0');
+        } else if(c >= 'a' && c <= 'f'){
+            result = result * 16 + (c - 'a' + 10);
+        } else if(c >= 'A' && c <= 'F'){
+            result = result * 16 + (c - 'A' + 10);
+        } else {
+            break;
+        }
+    }
+
+    return result;
+}
+
+void header_line(response& r, std::string_view line){
+    if(r.status_line){
+        r.status_line = false;
+
+        auto parts = std::split_view(line, ' ');
+
+        if(parts.size() >= 2){
+            r.status = std::atoui(parts[1]);
+        }
+
+        tlib::printf("wget: %s\n", std::string(line).c_str());
+
+        return;
+    }
+
+    auto colon = line.find(':');
+
+    if(colon == std::string::npos){
+        return;
+    }
+
+    auto name  = trim(line.substr(0, colon));
+    auto value = trim(line.substr(colon + 1));
+
+    if(equals_lower(name, "content-length")){
+        r.has_length = true;
+        r.length = std::atoui(value);
+    } else if(equals_lower(name, "transfer-encoding") && equals_lower(value, "chunked")){
+        r.chunked = true;
+    }
+}
+
+void start_body(response& r){
+    r.in_headers = false;
+
+    if(r.chunked){
+        r.state = body_state::SIZE;
+    } else if(r.has_length){
+        r.remaining = r.length;
+        r.state = r.length ? body_state::DATA : body_state::DONE;
+    } else {
+        r.remaining = uint64_t(-1);
+        r.state = body_state::DATA;
+    }
+}
+
+// Consume the received bytes, the body is given to the writer
+void feed(response& r, file_writer& writer, const char* data, size_t n){
+    size_t i = 0;
+
+    while(i < n && !r.done()){
+        if(r.in_headers){
+            auto c = data[i++];
+
+            if(c != '\n'){
+                r.line += c;
+                continue;
+            }
+
+            // The line is a view of the received characters, cleared once handled
+            auto line = trim(r.line);
+
+            if(line.empty() && !r.status_line){
+                r.line.clear();
+
+                start_body(r);
+
+                // Nothing is written for an error
+                if(r.status < 200 || r.status >= 300){
+                    return;
+                }
+            } else {
+                if(!line.empty()){
+                    header_line(r, line);
+                }
+
+                r.line.clear();
+            }
+
+            continue;
+        }
+
+        if(r.state == body_state::DATA){
+            auto bytes = std::min(r.remaining, uint64_t(n - i));
+
+            writer.append(data + i, bytes);
+
+            i += bytes;
+            r.remaining -= bytes;
+
+            if(!r.remaining){
+                r.state = r.chunked ? body_state::DATA_END : body_state::DONE;
+            }
+
+            continue;
+        }
+
+        auto c = data[i++];
+
+        if(c != '\n'){
+            r.line += c;
+            continue;
+        }
+
+        auto line = trim(r.line);
+
+        if(r.state == body_state::SIZE){
+            r.remaining = parse_hex(line);
+            r.state = r.remaining ? body_state::DATA : body_state::TRAILER;
+        } else if(r.state == body_state::DATA_END){
+            r.state = body_state::SIZE;
+        } else if(r.state == body_state::TRAILER && line.empty()){
+            r.state = body_state::DONE;
+        }
+
+        r.line.clear();
+    }
+}
+
+std::string default_file(const std::vector<std::string>& parts){
+    if(parts.size() >= 3 && !parts.back().empty()){
+        return parts.back();
+    }
+
+    return "index.html";
+}
+
+int download(tlib::socket& sock, size_t fd){
+    response r;
+    file_writer writer(fd);
+
+    auto start = tlib::ms_time();
+
+    while(!r.done()){
+        auto size = sock.receive(receive_data, receive_size, timeout_ms);
+
+        if(!sock){
+            if(sock.error() == std::ERROR_SOCKET_NOT_CONNECTED && r.ends_with_close()){
+                sock.clear();
+                break;
+            }
+
+            if(sock.error() == std::ERROR_SOCKET_TIMEOUT){
+                tlib::print_line("wget: Timeout");
+            } else if(sock.error() == std::ERROR_SOCKET_NOT_CONNECTED){
+                tlib::print_line("wget: Connection closed before the end of the response");
+            } else {
+                tlib::printf("wget: receive error: %s\n", std::error_message(sock.error()));
+            }
+
+            return 1;
+        }
+
+        feed(r, writer, receive_data, size);
+
+        if(writer.failed){
+            return 1;
+        }
+
+        if(!r.in_headers && (r.status < 200 || r.status >= 300)){
+            tlib::printf("wget: The server answered with the status %u\n", r.status);
+            return 1;
+        }
+    }
+
+    writer.flush();
+
+    if(writer.failed){
+        return 1;
+    }
+
+    auto ms = std::max(uint64_t(1), tlib::ms_time() - start);
+
+    tlib::printf("wget: %u bytes in %ums (%uKiB/s)\n", writer.size(), ms, ((writer.size() * 1000) / ms) / 1024);
+
+    return 0;
+}
+
+int wget_http(const std::string& url, std::string file){
     auto parts = std::split(url, '/');
 
     if(parts.size() < 2){
@@ -40,13 +386,21 @@ int wget_http(const std::string& url){
             ip = *ip_result;
         }
 
+        if(file.empty()){
+            file = default_file(parts);
+        }
+
         tlib::socket sock(tlib::socket_domain::AF_INET, tlib::socket_type::STREAM, tlib::socket_protocol::TCP);
 
+        // The stack keeps receiving while the body is written to the disk
+        sock.set_buffer_size(tlib::socket_buffer::RECEIVE, receive_buffer);
+        sock.clear();
+
         sock.connect(ip, 80);
         sock.listen(true);
 
         if (!sock) {
-            tlib::printf("nc: socket error: %s\n", std::error_message(sock.error()));
+            tlib::printf("wget: socket error: %s\n", std::error_message(sock.error()));
             return 1;
         }
 
@@ -67,33 +421,34 @@ int wget_http(const std::string& url){
         message += "Host: ";
         message += domain;
         message += "\r\n";
-        message += "Accept: text/html text/plain\r\n";
+        message += "Accept: */*\r\n";
         message += "User-Agent: wget (Thor OS)\r\n";
+        message += "Connection: close\r\n";
         message += "\r\n";
 
         sock.send(message.c_str(), message.size());
 
-        char message_buffer[2049];
-        auto size = sock.receive(message_buffer, 2048, 2000);
         if (!sock) {
-            if (sock.error() == std::ERROR_SOCKET_TIMEOUT) {
-                tlib::printf("Timeout\n");
-                return 1;
-            }
-
-            tlib::printf("nc: receive error: %s\n", std::error_message(sock.error()));
+            tlib::printf("wget: send error: %s\n", std::error_message(sock.error()));
             return 1;
-        } else {
-            message_buffer[size] = '\0';
-            tlib::print(message_buffer);
         }
 
-        sock.listen(false);
+        auto fd = tlib::open(file.c_str(), std::OPEN_CREATE);
 
-        if (!sock) {
-            tlib::printf("nc: socket error: %s\n", std::error_message(sock.error()));
+        if(!fd){
+            tlib::printf("wget: error: %s\n", std::error_message(fd.error()));
             return 1;
         }
+
+        tlib::printf("wget: Save to %s\n", file.c_str());
+
+        auto status = download(sock, *fd);
+
+        tlib::close(*fd);
+
+        sock.listen(false);
+
+        return status;
     } else {
         tlib::print_line("wget: The given protocol is not support");
         return 1;
@@ -105,11 +460,19 @@ int wget_http(const std::string& url){
 } // end of anonymous namespace
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        tlib::print_line("usage: wget url");
+    std::string file;
+
+    size_t i = 1;
+    if(i + 1 < size_t(argc) && std::string(argv[i]) == "-O"){
+        file = argv[i + 1];
+        i += 2;
+    }
+
+    if (i + 1 != size_t(argc)) {
+        tlib::print_line("usage: wget [-O file] url");
         return 1;
     }
 
-    std::string url(argv[1]);
-    return wget_http(url);
+    std::string url(argv[i]);
+    return wget_http(url, file);
 }
@@ -0,0 +1,42 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_ALLOC_PROFILE_H
+#define TLIB_ALLOC_PROFILE_H
+
+#include <types.hpp>
+
+namespace tlib {
+
+constexpr const size_t ALLOC_PROFILE_PERIOD = 128; ///< One allocation out of this number is sampled
+constexpr const size_t ALLOC_PROFILE_SITES = 64;   ///< The maximum number of call sites of a program
+
+/*!
+ * \brief The sampled allocations of a call site
+ */
+struct alloc_site {
+    uint64_t caller;      ///< The return address of the allocation call
+    uint64_t live_bytes;  ///< The bytes of the sampled blocks not yet freed
+    uint64_t live_blocks; ///< The number of sampled blocks not yet freed
+    uint64_t samples;     ///< The number of sampled allocations
+};
+
+/*!
+ * \brief The allocation profile of a program.
+ *
+ * It is filled by tlib::malloc and read by the kernel for
+ * /proc/<pid>/allocations.
+ */
+struct alloc_profile {
+    uint64_t period;                         ///< One allocation out of period is sampled
+    uint64_t sites;                          ///< The number of used sites
+    alloc_site site[ALLOC_PROFILE_SITES];    ///< The call sites
+};
+
+} // end of namespace tlib
+
+#endif
@@ -0,0 +1,106 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_CAPTURE_CONSTANTS_H
+#define TLIB_CAPTURE_CONSTANTS_H
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+THOR_NAMESPACE(tlib, network) {
+
+namespace capture {
+
+constexpr const size_t RING_PAGES      = 64;                ///< The number of pages holding the frames
+constexpr const size_t RING_SIZE       = RING_PAGES * 4096; ///< The number of bytes holding the frames
+constexpr const size_t MAP_SIZE        = RING_SIZE + 4096;  ///< The size of the device mapping, the header page and the frames
+constexpr const size_t MAX_SNAP_LENGTH = 65535;             ///< The maximum number of bytes captured per frame
+constexpr const size_t MAX_FILTER      = 64;                ///< The maximum number of instructions of a filter
+constexpr const size_t RECORD_ALIGN    = 8;                 ///< The alignment of the records in the ring
+
+/*!
+ * \brief The direction of a captured frame
+ */
+enum class direction : uint32_t {
+    RX, ///< Received by the interface
+    TX  ///< Sent by the interface
+};
+
+/*!
+ * \brief The first page of the capture device.
+ *
+ * The kernel appends records at head, the reader consumes them from tail.
+ * Both are byte counters that only grow, a position in the frames is
+ * counter % RING_SIZE and a record may wrap around the end of the frames.
+ */
+struct ring_header {
+    volatile uint64_t head;     ///< The bytes written by the kernel
+    volatile uint64_t tail;     ///< The bytes consumed by the reader
+    volatile uint64_t captured; ///< The number of captured frames
+    volatile uint64_t dropped;  ///< The number of frames dropped because the ring was full
+};
+
+/*!
+ * \brief The header of a captured frame, followed by its bytes and padded
+ * to RECORD_ALIGN
+ */
+struct record_header {
+    uint64_t timestamp; ///< The time of the capture, in microseconds since boot
+    uint32_t length;    ///< The length of the frame
+    uint32_t captured;  ///< The number of bytes of the frame in the record
+    uint32_t interface; ///< The interface of the frame
+    direction dir;      ///< The direction of the frame
+};
+
+/*!
+ * \brief An instruction of a filter, with the encoding of the classic BPF.
+ *
+ * Only a subset of the instructions is supported: the absolute and
+ * indirect loads, the IP header length load, the AND with a constant, the
+ * conditional jumps with a constant, TAX, TXA and the returns. The
+ * program returns the number of bytes to capture, 0 to ignore the frame.
+ */
+struct filter_instruction {
+    uint16_t code; ///< The operation
+    uint8_t jt;    ///< The forward jump if the condition is true
+    uint8_t jf;    ///< The forward jump if the condition is false
+    uint32_t k;    ///< The constant
+};
+
+constexpr const uint16_t LD_W_ABS   = 0x20; ///< A = frame[k:4]
+constexpr const uint16_t LD_H_ABS   = 0x28; ///< A = frame[k:2]
+constexpr const uint16_t LD_B_ABS   = 0x30; ///< A = frame[k]
+constexpr const uint16_t LD_W_IND   = 0x40; ///< A = frame[X + k:4]
+constexpr const uint16_t LD_H_IND   = 0x48; ///< A = frame[X + k:2]
+constexpr const uint16_t LD_B_IND   = 0x50; ///< A = frame[X + k]
+constexpr const uint16_t LDX_B_MSH  = 0xB1; ///< X = 4 * (frame[k] & 0xF)
+constexpr const uint16_t ALU_AND_K  = 0x54; ///< A &= k
+constexpr const uint16_t JMP_JA     = 0x05; ///< Jump k instructions
+constexpr const uint16_t JMP_JEQ_K  = 0x15; ///< Jump jt if A == k, jf otherwise
+constexpr const uint16_t JMP_JGT_K  = 0x25; ///< Jump jt if A > k, jf otherwise
+constexpr const uint16_t JMP_JGE_K  = 0x35; ///< Jump jt if A >= k, jf otherwise
+constexpr const uint16_t JMP_JSET_K = 0x45; ///< Jump jt if A & k, jf otherwise
+constexpr const uint16_t RET_K      = 0x06; ///< Return k
+constexpr const uint16_t RET_A      = 0x16; ///< Return A
+constexpr const uint16_t MISC_TAX   = 0x07; ///< X = A
+constexpr const uint16_t MISC_TXA   = 0x87; ///< A = X
+
+/*!
+ * \brief The configuration of a capture
+ */
+struct capture_config {
+    size_t snap_length;                ///< The maximum number of bytes captured per frame
+    const filter_instruction* filter;  ///< The filter, nullptr to capture all the frames
+    size_t filter_length;              ///< The number of instructions of the filter
+};
+
+} // end of capture namespace
+
+} // end of network namespace
+
+#endif
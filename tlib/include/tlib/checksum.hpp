@@ -0,0 +1,273 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_CHECKSUM_H
+#define TLIB_CHECKSUM_H
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+/*
+ * The Internet checksum (RFC 1071) is computed in the native byte order of
+ * the machine: the one-complement sum of the little-endian words is the
+ * byte-swapped sum of the big-endian words. The partial sums are kept on
+ * 64 bits with end-around carry and only folded at the end.
+ */
+
+// The vectors are only used when the build enables them, the AVX2
+// registers are not saved by the kernel on a context switch
+#if defined(__AVX2__)
+#define THOR_CHECKSUM_VECTOR
+#elif defined(__SSE2__)
+#define THOR_CHECKSUM_VECTOR
+#endif
+
+THOR_NAMESPACE(tlib, network) {
+
+#ifdef THOR_CHECKSUM_VECTOR
+
+#ifdef __AVX2__
+typedef uint64_t checksum_vector __attribute__((vector_size(32))); ///< The vector summed at once
+#else
+typedef uint64_t checksum_vector __attribute__((vector_size(16))); ///< The vector summed at once
+#endif
+
+constexpr const size_t checksum_vector_threshold = 256; ///< The smallest buffer summed with the vectors
+
+#endif
+
+/*!
+ * \brief Add a value to a partial sum, with end-around carry
+ */
+inline uint64_t checksum_add_carry(uint64_t sum, uint64_t value){
+    sum += value;
+    return sum + (sum < value);
+}
+
+/*!
+ * \brief Add the given number of 32 bytes blocks to a partial sum, with a
+ * chain of add-with-carry.
+ */
+inline uint64_t checksum_add_blocks(uint64_t sum, const char* data, size_t blocks){
+    asm("1:\n\t"
+        "add %[sum], [%[data]]\n\t"
+        "adc %[sum], [%[data] + 8]\n\t"
+        "adc %[sum], [%[data] + 16]\n\t"
+        "adc %[sum], [%[data] + 24]\n\t"
+        "adc %[sum], 0\n\t"
+        "lea %[data], [%[data] + 32]\n\t"
+        "dec %[blocks]\n\t"
+        "jnz 1b\n\t"
+        : [sum] "+r" (sum), [data] "+r" (data), [blocks] "+r" (blocks)
+        : //No inputs
+        : "cc", "memory");
+
+    return sum;
+}
+
+#ifdef THOR_CHECKSUM_VECTOR
+
+/*!
+ * \brief Add the given number of vectors to a partial sum.
+ *
+ * The 32-bit halves of the 64-bit lanes are accumulated separately, the
+ * lanes can not overflow.
+ */
+inline uint64_t checksum_add_vectors(uint64_t sum, const char* data, size_t vectors){
+    checksum_vector low = {};
+    checksum_vector high = {};
+
+    const checksum_vector mask = low + 0xFFFFFFFF;
+
+    for(size_t i = 0; i < vectors; ++i){
+        checksum_vector value;
+        __builtin_memcpy(&value, data + i * sizeof(checksum_vector), sizeof(checksum_vector));
+
+        low += value & mask;
+        high += value >> 32;
+    }
+
+    for(size_t i = 0; i < sizeof(checksum_vector) / sizeof(uint64_t); ++i){
+        sum = checksum_add_carry(sum, low[i]);
+        sum = checksum_add_carry(sum, high[i]);
+    }
+
+    return sum;
+}
+
+#endif
+
+/*!
+ * \brief Add the last bytes of a buffer (less than 8) to a partial sum
+ */
+inline uint64_t checksum_add_tail(uint64_t sum, const char* data, size_t length){
+    uint64_t value = 0;
+
+    if(length & 4){
+        uint32_t word;
+        __builtin_memcpy(&word, data, sizeof(word));
+        value += word;
+        data += 4;
+    }
+
+    if(length & 2){
+        uint16_t word;
+        __builtin_memcpy(&word, data, sizeof(word));
+        value += word;
+        data += 2;
+    }
+
+    if(length & 1){
+        value += static_cast<uint8_t>(*data);
+    }
+
+    return checksum_add_carry(sum, value);
+}
+
+/*!
+ * \brief Add a buffer to a partial sum, in native byte order
+ * \param data The buffer, it does not need to be aligned
+ * \param length The number of bytes of the buffer
+ * \param sum The partial sum to start from
+ * \return The new partial sum
+ */
+inline uint64_t checksum_partial(const void* data, size_t length, uint64_t sum = 0){
+    auto* bytes = static_cast<const char*>(data);
+
+#ifdef THOR_CHECKSUM_VECTOR
+    if(length >= checksum_vector_threshold){
+        auto vectors = length / sizeof(checksum_vector);
+
+        sum = checksum_add_vectors(sum, bytes, vectors);
+
+        bytes += vectors * sizeof(checksum_vector);
+        length -= vectors * sizeof(checksum_vector);
+    }
+#endif
+
+    if(length >= 32){
+        auto blocks = length / 32;
+
+        sum = checksum_add_blocks(sum, bytes, blocks);
+
+        bytes += blocks * 32;
+        length -= blocks * 32;
+    }
+
+    while(length >= 8){
+        uint64_t word;
+        __builtin_memcpy(&word, bytes, sizeof(word));
+        sum = checksum_add_carry(sum, word);
+
+        bytes += 8;
+        length -= 8;
+    }
+
+    return checksum_add_tail(sum, bytes, length);
+}
+
+/*!
+ * \brief Copy a buffer and add it to a partial sum, in native byte order,
+ * in a single pass over the data
+ * \param destination The destination buffer
+ * \param source The source buffer
+ * \param length The number of bytes to copy
+ * \param sum The partial sum to start from
+ * \return The new partial sum
+ */
+inline uint64_t checksum_copy_partial(void* destination, const void* source, size_t length, uint64_t sum = 0){
+    auto* out = static_cast<char*>(destination);
+    auto* in = static_cast<const char*>(source);
+
+    while(length >= 16){
+        uint64_t first;
+        uint64_t second;
+        __builtin_memcpy(&first, in, sizeof(first));
+        __builtin_memcpy(&second, in + 8, sizeof(second));
+        __builtin_memcpy(out, &first, sizeof(first));
+        __builtin_memcpy(out + 8, &second, sizeof(second));
+
+        sum = checksum_add_carry(sum, first);
+        sum = checksum_add_carry(sum, second);
+
+        in += 16;
+        out += 16;
+        length -= 16;
+    }
+
+    if(length >= 8){
+        uint64_t word;
+        __builtin_memcpy(&word, in, sizeof(word));
+        __builtin_memcpy(out, &word, sizeof(word));
+
+        sum = checksum_add_carry(sum, word);
+
+        in += 8;
+        out += 8;
+        length -= 8;
+    }
+
+    for(size_t i = 0; i < length; ++i){
+        out[i] = in[i];
+    }
+
+    return checksum_add_tail(sum, in, length);
+}
+
+/*!
+ * \brief Fold a partial sum into a 16-bit one-complement sum, in native
+ * byte order
+ */
+inline uint16_t checksum_fold_partial(uint64_t sum){
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+
+    while(sum >> 16){
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return sum;
+}
+
+/*!
+ * \brief Update a checksum after a 16-bit field changed, without summing
+ * the data again (RFC 1624, equation 3).
+ *
+ * The checksum and the values must have the same byte order.
+ *
+ * \param checksum The current value of the checksum field
+ * \param old_value The previous value of the field
+ * \param new_value The new value of the field
+ * \return The new value of the checksum field
+ */
+inline uint16_t checksum_update(uint16_t checksum, uint16_t old_value, uint16_t new_value){
+    // HC' = ~(~HC + ~m + m')
+    uint32_t sum = static_cast<uint16_t>(~checksum);
+    sum += static_cast<uint16_t>(~old_value);
+    sum += new_value;
+
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return ~sum;
+}
+
+/*!
+ * \brief Update a checksum after a 32-bit field changed (RFC 1624)
+ * \param checksum The current value of the checksum field
+ * \param old_value The previous value of the field
+ * \param new_value The new value of the field
+ * \return The new value of the checksum field
+ */
+inline uint16_t checksum_update32(uint16_t checksum, uint32_t old_value, uint32_t new_value){
+    checksum = checksum_update(checksum, old_value >> 16, new_value >> 16);
+    return checksum_update(checksum, old_value & 0xFFFF, new_value & 0xFFFF);
+}
+
+} // end of network namespace
+
+#endif
@@ -0,0 +1,189 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_CPU_FEATURES_H
+#define TLIB_CPU_FEATURES_H
+
+#include <types.hpp>
+
+namespace tlib {
+
+/*!
+ * \brief A feature of the processor, the value is its bit in the features
+ * mask. The vector extensions are only reported when the state of their
+ * registers is saved by the system.
+ */
+enum class cpu_feature : uint8_t {
+    SSE3          = 0,  ///< SSE3 instructions
+    SSSE3         = 1,  ///< Supplemental SSE3 instructions
+    SSE4_1        = 2,  ///< SSE4.1 instructions
+    SSE4_2        = 3,  ///< SSE4.2 instructions (crc32)
+    POPCNT        = 4,  ///< popcnt instruction
+    PCLMULQDQ     = 5,  ///< Carry-less multiplication
+    AVX           = 6,  ///< AVX instructions, usable
+    AVX2          = 7,  ///< AVX2 instructions, usable
+    BMI1          = 8,  ///< Bit manipulation instructions
+    BMI2          = 9,  ///< Bit manipulation instructions 2
+    ERMS          = 10, ///< Enhanced rep movsb/stosb
+    FSRM          = 11, ///< Fast short rep movsb
+    XSAVE         = 12, ///< xsave/xrstor instructions
+    XSAVEOPT      = 13, ///< xsaveopt instruction
+    XSAVEC        = 14, ///< xsavec instruction
+    XSAVES        = 15, ///< xsaves/xrstors instructions
+    RDRAND        = 16, ///< rdrand instruction
+    MWAIT         = 17, ///< monitor/mwait instructions
+    PAT           = 18, ///< Page attribute table
+    PCID          = 19, ///< Process context identifiers
+    INVPCID       = 20, ///< invpcid instruction
+    X2APIC        = 21, ///< x2APIC mode of the local APIC
+    TSC_DEADLINE  = 22, ///< TSC deadline mode of the APIC timer
+    INVARIANT_TSC = 23, ///< The TSC runs at a constant rate in all the states
+    RDTSCP        = 24, ///< rdtscp instruction
+    NX            = 25, ///< No-execute pages
+    PAGE_1GB      = 26, ///< 1GiB pages
+    SMEP          = 27, ///< Supervisor mode execution prevention
+    SMAP          = 28, ///< Supervisor mode access prevention
+    COUNT         = 29  ///< The number of features
+};
+
+/*!
+ * \brief The names of the features, in the order of cpu_feature
+ */
+constexpr const char* cpu_feature_names[] = {
+    "sse3", "ssse3", "sse4_1", "sse4_2", "popcnt", "pclmulqdq", "avx", "avx2",
+    "bmi1", "bmi2", "erms", "fsrm", "xsave", "xsaveopt", "xsavec", "xsaves",
+    "rdrand", "mwait", "pat", "pcid", "invpcid", "x2apic", "tsc_deadline",
+    "invariant_tsc", "rdtscp", "nx", "page_1gb", "smep", "smap"
+};
+
+static_assert(sizeof(cpu_feature_names) / sizeof(cpu_feature_names[0]) == size_t(cpu_feature::COUNT), "A feature has no name");
+
+/*!
+ * \brief Returns the bit of the feature in the features mask
+ */
+constexpr uint64_t cpu_feature_bit(cpu_feature feature){
+    return uint64_t(1) << static_cast<uint8_t>(feature);
+}
+
+/*!
+ * \brief Returns the mask of the given feature
+ */
+constexpr uint64_t cpu_feature_mask(cpu_feature feature){
+    return cpu_feature_bit(feature);
+}
+
+/*!
+ * \brief Returns the mask of all the given features
+ */
+template<typename... F>
+constexpr uint64_t cpu_feature_mask(cpu_feature feature, F... rest){
+    return cpu_feature_bit(feature) | cpu_feature_mask(rest...);
+}
+
+/*!
+ * \brief Execute the CPUID instruction for the given leaf and subleaf
+ */
+inline void cpuid(uint32_t key, uint32_t subleaf, uint32_t& eax, uint32_t& ebx, uint32_t& ecx, uint32_t& edx){
+    asm volatile("cpuid"
+        : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+        : "a" (key), "c" (subleaf));
+}
+
+/*!
+ * \brief Detect the features of the current processor.
+ *
+ * The programs should use the mask detected by the kernel, see
+ * tlib::cpu_features().
+ *
+ * \return The mask of the tlib::cpu_feature bits
+ */
+inline uint64_t detect_cpu_features(){
+    uint64_t mask = 0;
+
+    auto set = [&mask](cpu_feature feature, bool present){
+        if(present){
+            mask |= cpu_feature_bit(feature);
+        }
+    };
+
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    auto max_leaf = eax;
+
+    cpuid(1, 0, eax, ebx, ecx, edx);
+
+    set(cpu_feature::SSE3, ecx & (1 << 0));
+    set(cpu_feature::PCLMULQDQ, ecx & (1 << 1));
+    set(cpu_feature::MWAIT, ecx & (1 << 3));
+    set(cpu_feature::SSSE3, ecx & (1 << 9));
+    set(cpu_feature::PCID, ecx & (1 << 17));
+    set(cpu_feature::SSE4_1, ecx & (1 << 19));
+    set(cpu_feature::SSE4_2, ecx & (1 << 20));
+    set(cpu_feature::X2APIC, ecx & (1 << 21));
+    set(cpu_feature::POPCNT, ecx & (1 << 23));
+    set(cpu_feature::TSC_DEADLINE, ecx & (1 << 24));
+    set(cpu_feature::XSAVE, ecx & (1 << 26));
+    set(cpu_feature::RDRAND, ecx & (1 << 30));
+    set(cpu_feature::PAT, edx & (1 << 16));
+
+    // The AVX registers are only usable once enabled in XCR0 by the system
+    bool avx_state = false;
+
+    if((ecx & (1 << 27)) && (ecx & (1 << 28))){
+        uint32_t xcr0_low, xcr0_high;
+        asm volatile("xgetbv" : "=a" (xcr0_low), "=d" (xcr0_high) : "c" (0));
+
+        avx_state = (xcr0_low & 0x6) == 0x6;
+    }
+
+    set(cpu_feature::AVX, avx_state);
+
+    if(max_leaf >= 7){
+        cpuid(7, 0, eax, ebx, ecx, edx);
+
+        set(cpu_feature::BMI1, ebx & (1 << 3));
+        set(cpu_feature::AVX2, avx_state && (ebx & (1 << 5)));
+        set(cpu_feature::SMEP, ebx & (1 << 7));
+        set(cpu_feature::BMI2, ebx & (1 << 8));
+        set(cpu_feature::ERMS, ebx & (1 << 9));
+        set(cpu_feature::INVPCID, ebx & (1 << 10));
+        set(cpu_feature::SMAP, ebx & (1 << 20));
+        set(cpu_feature::FSRM, edx & (1 << 4));
+    }
+
+    if(max_leaf >= 0xD && (mask & cpu_feature_bit(cpu_feature::XSAVE))){
+        cpuid(0xD, 1, eax, ebx, ecx, edx);
+
+        set(cpu_feature::XSAVEOPT, eax & (1 << 0));
+        set(cpu_feature::XSAVEC, eax & (1 << 1));
+        set(cpu_feature::XSAVES, eax & (1 << 3));
+    }
+
+    cpuid(0x80000000, 0, eax, ebx, ecx, edx);
+    auto max_extended = eax;
+
+    if(max_extended >= 0x80000001){
+        cpuid(0x80000001, 0, eax, ebx, ecx, edx);
+
+        set(cpu_feature::NX, edx & (1 << 20));
+        set(cpu_feature::PAGE_1GB, edx & (1 << 26));
+        set(cpu_feature::RDTSCP, edx & (1 << 27));
+    }
+
+    if(max_extended >= 0x80000007){
+        cpuid(0x80000007, 0, eax, ebx, ecx, edx);
+
+        set(cpu_feature::INVARIANT_TSC, edx & (1 << 8));
+    }
+
+    return mask;
+}
+
+} // end of namespace tlib
+
+#endif
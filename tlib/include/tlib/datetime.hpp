@@ -25,6 +25,53 @@ struct datetime {
     uint64_t precise;
 } __attribute__((packed)) ;
 
+/*!
+ * \brief Returns the number of seconds between the Unix epoch and the given date
+ */
+inline uint64_t epoch_seconds(const datetime& date){
+    // Days from the civil date, with the years starting in March
+    int64_t year = int64_t(date.year) - (date.month <= 2 ? 1 : 0);
+    int64_t era = year / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t month = date.month > 2 ? date.month - 3 : date.month + 9;
+    int64_t day_of_year = (153 * month + 2) / 5 + date.day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int64_t days = era * 146097 + day_of_era - 719468;
+
+    return uint64_t(days) * 86400 + date.hour * 3600 + date.minutes * 60 + date.seconds;
+}
+
+/*!
+ * \brief Returns the date of the given number of nanoseconds since the
+ * Unix epoch. The nanoseconds inside the second are kept in precise.
+ */
+inline datetime epoch_date(uint64_t nanoseconds){
+    uint64_t seconds = nanoseconds / 1000000000;
+    uint64_t days = seconds / 86400;
+    uint64_t rest = seconds % 86400;
+
+    // Civil date from the days, with the years starting in March
+    uint64_t shifted = days + 719468;
+    uint64_t era = shifted / 146097;
+    uint64_t day_of_era = shifted - era * 146097;
+    uint64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    uint64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    uint64_t month = (5 * day_of_year + 2) / 153;
+
+    datetime date;
+
+    date.day = day_of_year - (153 * month + 2) / 5 + 1;
+    date.month = month < 10 ? month + 3 : month - 9;
+    date.year = year_of_era + era * 400 + (date.month <= 2 ? 1 : 0);
+    date.hour = rest / 3600;
+    date.minutes = (rest % 3600) / 60;
+    date.seconds = rest % 60;
+    date.unused = 0;
+    date.precise = nanoseconds % 1000000000;
+
+    return date;
+}
+
 } // end of namespace tlib
 
 #endif
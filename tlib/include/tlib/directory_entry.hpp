@@ -10,6 +10,7 @@
 
 #include <types.hpp>
 
+#include "tlib/stat_info.hpp"
 #include "tlib/config.hpp"
 
 THOR_NAMESPACE(tlib, vfs) {
@@ -21,6 +22,19 @@ struct directory_entry {
     char name; //First char
 };
 
+/*!
+ * \brief A directory entry with the attributes of its file, so that a
+ * listing needs no stat per file.
+ *
+ * The entries are aligned on 8 bytes, offset_next accounts for the padding.
+ */
+struct directory_stat_entry {
+    size_t offset_next; ///< The offset of the next entry, 0 for the last one
+    size_t length;      ///< The length of the name
+    stat_info info;     ///< The attributes of the file
+    char name;          ///< The first char of the null-terminated name
+};
+
 } // end of namespace tlib
 
 #endif
@@ -22,9 +22,22 @@ namespace dns {
 std::string decode_domain(char* payload, size_t& offset);
 std::expected<void> send_request(tlib::socket& sock, const std::string& domain, uint16_t rr_type = 0x1, uint16_t rr_class = 0x1);
 
+/*!
+ * \brief Resolve a domain name to an IPv4 address. The lookup goes through
+ * the DNS cache of the kernel.
+ * \param domain The domain name
+ * \param timeout The time to wait for an answer to a query, in milliseconds
+ * \param retries The number of queries to send before giving up
+ */
 std::expected<tlib::ip::address> resolve(const std::string& domain, size_t timeout = 1000, size_t retries = 1);
 std::expected<std::string> resolve_str(const std::string& domain, size_t timeout = 1000, size_t retries = 1);
 
+/*!
+ * \brief Remove the resolved and negative names from the DNS cache of the
+ * kernel
+ */
+void flush_cache();
+
 tlib::ip::address gateway_address();
 
 bool is_ip(const std::string& value);
@@ -13,6 +13,12 @@
 
 namespace elf {
 
+constexpr const uint32_t PT_LOAD = 1; ///< The type of the loadable segments
+
+constexpr const uint32_t PF_X = 1 << 0; ///< The segment is executable
+constexpr const uint32_t PF_W = 1 << 1; ///< The segment is writable
+constexpr const uint32_t PF_R = 1 << 2; ///< The segment is readable
+
 struct elf_header {
     char e_ident[16];
     uint16_t e_type;
@@ -54,6 +60,15 @@ struct section_header {
     uint64_t sh_entsize;
 }__attribute__((packed));
 
+struct symbol {
+    uint32_t st_name;
+    uint8_t st_info;
+    uint8_t st_other;
+    uint16_t st_shndx;
+    uint64_t st_value;
+    uint64_t st_size;
+}__attribute__((packed));
+
 inline bool is_valid(const char* buffer){
     auto header = reinterpret_cast<const elf::elf_header*>(buffer);
 
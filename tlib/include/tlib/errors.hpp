@@ -45,6 +45,11 @@ constexpr const size_t ERROR_SOCKET_INVALID_TYPE_PROTOCOL     = 30;
 constexpr const size_t ERROR_SOCKET_NOT_CONNECTED             = 31;
 constexpr const size_t ERROR_SOCKET_INVALID_CONNECTION        = 32;
 constexpr const size_t ERROR_SOCKET_TCP_ERROR        = 33;
+constexpr const size_t ERROR_TIMEOUT                          = 34;
+constexpr const size_t ERROR_BUSY                             = 35;
+constexpr const size_t ERROR_WOULD_BLOCK                      = 36;
+constexpr const size_t ERROR_SOCKET_BUFFER_FULL               = 37;
+constexpr const size_t ERROR_BROKEN_PIPE                      = 38;
 
 inline const char* error_message(size_t error){
     switch(error){
@@ -114,6 +119,16 @@ inline const char* error_message(size_t error){
             return "Issue with the internal connection";
         case ERROR_SOCKET_TCP_ERROR:
             return "TCP packet was not acknowledged";
+        case ERROR_TIMEOUT:
+            return "Timeout";
+        case ERROR_BUSY:
+            return "Too many pending requests";
+        case ERROR_WOULD_BLOCK:
+            return "The operation would block";
+        case ERROR_SOCKET_BUFFER_FULL:
+            return "The send buffer of the socket is full";
+        case ERROR_BROKEN_PIPE:
+            return "The pipe has no reader anymore";
         default:
             return "Unknonwn error";
     }
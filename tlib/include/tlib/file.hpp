@@ -16,6 +16,8 @@
 #include "tlib/statfs_info.hpp"
 #include "tlib/config.hpp"
 #include "tlib/directory_entry.hpp"
+#include "tlib/flags.hpp"
+#include "tlib/iovec.hpp"
 
 ASSERT_ONLY_THOR_PROGRAM
 
@@ -27,19 +29,80 @@ int64_t rm(const char* file);
 std::expected<size_t> read(size_t fd, char* buffer, size_t max, size_t offset = 0);
 std::expected<size_t> read(size_t fd, char* buffer, size_t max, size_t offset, size_t ms);
 std::expected<size_t> write(size_t fd, const char* buffer, size_t max, size_t offset = 0);
+
+/*!
+ * \brief Read from the file into several buffers, filled in order
+ * \return the number of bytes read
+ */
+std::expected<size_t> readv(size_t fd, const iovec* vectors, size_t n, size_t offset = 0);
+
+/*!
+ * \brief Write several buffers contiguously to the file
+ * \return the number of bytes written
+ */
+std::expected<size_t> writev(size_t fd, const iovec* vectors, size_t n, size_t offset = 0);
 std::expected<size_t> clear(size_t fd, size_t max, size_t offset = 0);
 std::expected<size_t> truncate(size_t fd, size_t size);
 std::expected<size_t> entries(size_t fd, char* buffer, size_t max);
+
+/*!
+ * \brief List the entries of the directory with the attributes of their
+ * files, as directory_stat_entry records
+ * \return the size of the entries
+ */
+std::expected<size_t> entries_stat(size_t fd, char* buffer, size_t max);
 void close(size_t fd);
+
+/*!
+ * \brief Create a pipe, the bytes written to its write end are read from
+ * its read end. The read end reaches the end of file once all the write
+ * ends are closed.
+ * \param read_fd Output reference to the fd of the read end
+ * \param write_fd Output reference to the fd of the write end
+ */
+std::expected<void> pipe(size_t& read_fd, size_t& write_fd);
 std::expected<stat_info> stat(size_t fd);
 std::expected<statfs_info> statfs(const char* file);
 std::expected<size_t> mounts(char* buffer, size_t max);
 std::expected<void> mount(size_t type, size_t dev_fd, size_t mp_fd);
+std::expected<void*> mmap(size_t fd, size_t offset, size_t length, size_t prot = std::MMAP_READ);
+std::expected<void> sync();
+
+/*!
+ * \brief Submit a read of the file, the buffer is filled when the
+ * completion is collected with aio_wait
+ * \return the token of the request
+ */
+std::expected<size_t> aio_read(size_t fd, char* buffer, size_t max, size_t offset = 0);
+
+/*!
+ * \brief Submit a write to the file, the buffer can be reused right away
+ * \return the token of the request
+ */
+std::expected<size_t> aio_write(size_t fd, const char* buffer, size_t max, size_t offset = 0);
+
+/*!
+ * \brief Wait for the completion of any asynchronous request of the process
+ * \param result Output reference to the result of the completed request
+ * \param ms The maximum time to wait, in milliseconds, 0 to wait indefinitely
+ * \return the token of the completed request
+ */
+std::expected<size_t> aio_wait(std::expected<size_t>& result, size_t ms = 0);
 
 std::string current_working_directory();
 void set_current_working_directory(const std::string& directory);
 
 struct directory_view;
+struct block_view;
+struct line_view;
+
+/*!
+ * \brief A file mapped in memory, it stays mapped until the end of the process
+ */
+struct file_mapping {
+    const char* data; ///< The content of the file
+    size_t size;      ///< The size of the file
+};
 
 /*!
  * \brief Represent a file
@@ -88,6 +151,27 @@ struct file {
      */
     std::string read_file();
 
+    /*!
+     * \brief Returns an iterable structure for all blocks of the file, read
+     * one at a time in the same buffer
+     * \param block_size The maximum size of a block
+     */
+    block_view blocks(size_t block_size = 4096);
+
+    /*!
+     * \brief Returns an iterable structure for all lines of the file, read
+     * one at a time
+     */
+    line_view lines();
+
+    /*!
+     * \brief Map the complete file in memory, only possible for the files
+     * of the page cache
+     *
+     * The error code will be set if any error occurs
+     */
+    std::expected<file_mapping> map();
+
     /*!
      * \brief Returns an iterable structure for all files of the directory
      * \return an iterable structure for all files of the directory
@@ -123,6 +207,11 @@ struct directory_iterator {
 
     const char* operator*() const ;
 
+    /*!
+     * \brief Returns the attributes of the current file
+     */
+    const tlib::stat_info& info() const ;
+
     directory_iterator& operator++();
 
     bool operator==(const directory_iterator& rhs) const ;
@@ -131,8 +220,120 @@ struct directory_iterator {
 private:
     const directory_view& view;   ///< The originating view
     size_t position;              ///< The current position
-    tlib::directory_entry* entry; ///< The current entry
-    bool end;                     ///< Indicates the end of the entries
+    tlib::directory_stat_entry* entry; ///< The current entry
+    bool end;                          ///< Indicates the end of the entries
+};
+
+/*!
+ * \brief A block of a file, valid until the next block is read
+ */
+struct file_block {
+    const char* data; ///< The bytes of the block
+    size_t size;      ///< The number of bytes of the block
+};
+
+struct block_iterator;
+
+/*!
+ * \brief A view of the blocks of a file, read one after the other in a
+ * buffer reused for each block
+ */
+struct block_view {
+    block_view(size_t fd, size_t block_size = 4096);
+    block_view(block_view&& rhs);
+
+    block_view(const block_view& rhs) = delete;
+    block_view& operator=(const block_view& rhs) = delete;
+
+    ~block_view();
+
+    block_iterator begin();
+    block_iterator end();
+
+    /*!
+     * \brief Returns the error code of the last read, if any
+     */
+    size_t error() const ;
+
+private:
+    void next();
+
+    size_t fd;         ///< The file descriptor
+    char* buffer;      ///< The buffer of the current block
+    size_t block_size; ///< The maximum size of a block
+    size_t offset;     ///< The offset of the next block
+    size_t size;       ///< The size of the current block
+    size_t error_code; ///< The error code, if any
+    bool started;      ///< Indicates if the first block has been read
+    bool done;         ///< Indicates the end of the blocks
+
+    friend struct block_iterator;
+};
+
+struct block_iterator {
+    block_iterator(block_view& view, bool end);
+
+    file_block operator*() const ;
+
+    block_iterator& operator++();
+
+    bool operator==(const block_iterator& rhs) const ;
+    bool operator!=(const block_iterator& rhs) const ;
+
+private:
+    block_view& view; ///< The originating view
+    bool end;         ///< Indicates the end iterator
+};
+
+struct stream;
+struct line_iterator;
+
+/*!
+ * \brief A view of the lines of a file, without their new line, read one
+ * after the other through a buffered stream
+ */
+struct line_view {
+    line_view(size_t fd);
+    line_view(line_view&& rhs);
+
+    line_view(const line_view& rhs) = delete;
+    line_view& operator=(const line_view& rhs) = delete;
+
+    ~line_view();
+
+    line_iterator begin();
+    line_iterator end();
+
+    /*!
+     * \brief Returns the error code of the last read, if any
+     */
+    size_t error() const ;
+
+private:
+    void next();
+
+    stream* input;     ///< The stream of the file
+    std::string line;  ///< The current line
+    size_t error_code; ///< The error code, if any
+    bool started;      ///< Indicates if the first line has been read
+    bool done;         ///< Indicates the end of the lines
+
+    friend struct line_iterator;
+};
+
+struct line_iterator {
+    line_iterator(line_view& view, bool end);
+
+    const std::string& operator*() const ;
+
+    line_iterator& operator++();
+
+    bool operator==(const line_iterator& rhs) const ;
+    bool operator!=(const line_iterator& rhs) const ;
+
+private:
+    line_view& view; ///< The originating view
+    bool end;        ///< Indicates the end iterator
 };
 
 } // end of namespace tlib
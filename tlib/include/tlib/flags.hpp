@@ -14,6 +14,12 @@ namespace std {
 
 constexpr const size_t OPEN_CREATE = 0x1;
 
+constexpr const size_t EXEC_FAIR = 0x1;      ///< Run the new process in the fair scheduling class
+constexpr const size_t EXEC_HUGE_HEAP = 0x2; ///< Back the heap of the new process with large pages
+
+constexpr const size_t MMAP_READ = 0x1;  ///< The mapped pages can be read
+constexpr const size_t MMAP_WRITE = 0x2; ///< The mapped pages can be written, the writes stay private to the process (shared for a device)
+
 } // end of namespace
 
 #endif
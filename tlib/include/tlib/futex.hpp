@@ -0,0 +1,50 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Blocking on a word in memory
+ */
+
+#ifndef TLIB_FUTEX_H
+#define TLIB_FUTEX_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+/*!
+ * \brief Block while the word at the given address has the given value
+ * \param address The address of the word, aligned on 4 bytes
+ * \param value The expected value of the word
+ * \return nothing once woken up, ERROR_WOULD_BLOCK if the word does not have the value
+ */
+std::expected<void> futex_wait(volatile uint32_t* address, uint32_t value);
+
+/*!
+ * \brief Block while the word at the given address has the given value, at most ms milliseconds
+ * \param address The address of the word, aligned on 4 bytes
+ * \param value The expected value of the word
+ * \param ms The maximum time to wait
+ * \return nothing once woken up, ERROR_WOULD_BLOCK if the word does not have the value, ERROR_TIMEOUT after the time
+ */
+std::expected<void> futex_wait(volatile uint32_t* address, uint32_t value, size_t ms);
+
+/*!
+ * \brief Wake up at most n processes waiting on the word at the given address
+ * \return the number of woken up processes, or an error
+ */
+std::expected<size_t> futex_wake(volatile uint32_t* address, size_t n);
+
+} // end of namespace tlib
+
+#endif
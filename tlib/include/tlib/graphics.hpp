@@ -9,6 +9,7 @@
 #define GRAPHICS_HPP
 
 #include <types.hpp>
+#include <expected.hpp>
 
 #include "tlib/config.hpp"
 
@@ -35,6 +36,19 @@ uint64_t mouse_y();
 
 void redraw(char* buffer);
 
+/*!
+ * \brief Map the back buffer of the screen in the process.
+ *
+ * Only one process can map it at a time. The drawings must be made
+ * visible with present().
+ */
+std::expected<uint32_t*> map_buffer();
+
+/*!
+ * \brief Make a rectangle of the mapped back buffer visible on the screen
+ */
+std::expected<void> present(size_t x, size_t y, size_t w, size_t h);
+
 } // end of namespace graphics
 
 } // end of namespace tlib
@@ -0,0 +1,91 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Batched operations through rings shared with the kernel
+ */
+
+#ifndef TLIB_IO_RING_H
+#define TLIB_IO_RING_H
+
+#include <expected.hpp>
+
+#include "tlib/io_ring_constants.hpp"
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+/*!
+ * \brief Map the rings of the process, the same rings are returned by each call
+ * \return the rings, or an error
+ */
+std::expected<ring_page*> io_ring_setup();
+
+/*!
+ * \brief Let the kernel execute the pending submissions
+ * \param n The maximum number of submissions to execute
+ * \param wait The number of completions to wait for
+ * \param ms The maximum time to wait, in milliseconds, 0 to wait indefinitely
+ * \return the number of executed submissions, or an error
+ */
+std::expected<size_t> io_ring_enter(size_t n, size_t wait = 0, size_t ms = 0);
+
+/*!
+ * \brief The rings of the process.
+ *
+ * The submissions are filled in place, then executed together by a single
+ * submit. Each submission produces one completion with its data.
+ */
+struct io_ring {
+    /*!
+     * \brief Map the rings
+     * \return true if the rings are mapped, false otherwise
+     */
+    bool init();
+
+    /*!
+     * \brief Prepare a submission
+     * \return false if the submission ring is full
+     */
+    bool prepare(ring_operation operation, size_t fd, size_t address, size_t length, size_t offset, size_t data);
+
+    /*!
+     * \brief Execute the queued submissions
+     * \param wait The number of completions to wait for
+     * \param ms The maximum time to wait, 0 to wait indefinitely
+     * \return the number of executed submissions, or an error
+     */
+    std::expected<size_t> submit(size_t wait = 0, size_t ms = 0);
+
+    /*!
+     * \brief Returns the next completion, nullptr if there is none.
+     * The completion stays in the ring until consume() is called.
+     */
+    const ring_completion* completion() const;
+
+    /*!
+     * \brief Release the current completion
+     */
+    void consume();
+
+    /*!
+     * \brief Returns the number of pending completions
+     */
+    size_t completions() const;
+
+private:
+    ring_submission* submission();
+
+    ring_page* page = nullptr; ///< The shared rings
+};
+
+} // end of namespace tlib
+
+#endif
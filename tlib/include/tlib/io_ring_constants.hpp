@@ -0,0 +1,78 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_IO_RING_CONSTANTS_H
+#define TLIB_IO_RING_CONSTANTS_H
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+THOR_NAMESPACE(tlib, io_ring) {
+
+constexpr const size_t RING_SUBMISSIONS = 64;  ///< The number of entries of the submission ring
+constexpr const size_t RING_COMPLETIONS = 128; ///< The number of entries of the completion ring
+constexpr const size_t RING_PAGES = 2;         ///< The number of pages shared with the kernel
+
+/*!
+ * \brief An operation of the submission ring
+ */
+enum class ring_operation : size_t {
+    NOP,     ///< Complete right away, with 0
+    OPEN,    ///< Open the file at address, with the flags in fd
+    CLOSE,   ///< Close the file fd
+    STAT,    ///< Fill the stat_info at address for the file fd
+    READ,    ///< Read length bytes of the file fd at offset into address
+    WRITE,   ///< Write length bytes from address into the file fd at offset
+    ENTRIES, ///< Read the entries of the directory fd into address (length bytes)
+    SEND,    ///< Send length bytes from address on the socket fd
+    RECEIVE, ///< Receive at most length bytes from the socket fd, waiting at most offset ms (0 waits indefinitely)
+    TIMEOUT  ///< Complete with 0 after length milliseconds
+};
+
+/*!
+ * \brief An entry of the submission ring, written by the process
+ */
+struct ring_submission {
+    ring_operation operation; ///< The operation
+    size_t fd;                ///< The descriptor, or the flags of an open
+    size_t address;           ///< The buffer, the path or the information of the operation
+    size_t length;            ///< The length of the buffer, or the time of a timeout
+    size_t offset;            ///< The offset in the file, or the time to wait for a receive
+    size_t data;              ///< The data returned with the completion
+};
+
+/*!
+ * \brief An entry of the completion ring, written by the kernel
+ */
+struct ring_completion {
+    size_t data;    ///< The data of the submission
+    int64_t result; ///< The result of the operation, or the negated error code
+};
+
+/*!
+ * \brief The rings, shared between the process and the kernel.
+ *
+ * The indices only grow, the entry of an index is at index modulo the
+ * size of its ring. The process produces submissions and consumes
+ * completions, the kernel does the opposite.
+ */
+struct ring_page {
+    volatile size_t submission_head; ///< The next submission consumed by the kernel
+    volatile size_t submission_tail; ///< The next submission written by the process
+    volatile size_t completion_head; ///< The next completion consumed by the process
+    volatile size_t completion_tail; ///< The next completion written by the kernel
+
+    ring_submission submissions[RING_SUBMISSIONS]; ///< The submission ring
+    ring_completion completions[RING_COMPLETIONS]; ///< The completion ring
+};
+
+static_assert(sizeof(ring_page) <= RING_PAGES * 4096, "The rings must fit in the shared pages");
+
+} // end of io_ring namespace
+
+#endif
@@ -15,7 +15,10 @@
 THOR_NAMESPACE(tlib, io) {
 
 enum class ioctl_request : size_t {
-    GET_BLK_SIZE = 1
+    GET_BLK_SIZE = 1,
+    CREATE_RAMDISK = 2, ///< On /dev, create a RAM disk of the given size, replaced by its number
+    CAPTURE_START = 3,  ///< On /dev/capture, start capturing the frames with the given capture::capture_config
+    CAPTURE_STOP = 4    ///< On /dev/capture, stop capturing the frames
 };
 
 } // end of namespace
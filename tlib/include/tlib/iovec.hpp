@@ -0,0 +1,29 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef USER_IOVEC_HPP
+#define USER_IOVEC_HPP
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+THOR_NAMESPACE(tlib, vfs) {
+
+constexpr const size_t MAX_IOVECS = 16; ///< The maximum number of buffers of a vectored transfer
+
+/*!
+ * \brief A buffer of a vectored transfer
+ */
+struct iovec {
+    char* base;    ///< The start of the buffer
+    size_t length; ///< The number of bytes of the buffer
+};
+
+} // end of namespace tlib
+
+#endif
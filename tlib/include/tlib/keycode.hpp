@@ -191,6 +191,14 @@ enum class keycode : size_t {
     , MOUSE_RIGHT_RELEASE
 };
 
+/*!
+ * \brief An input event of a terminal in raw mode
+ */
+struct input_event {
+    uint64_t time; ///< The time (in ms since boot) of the input
+    keycode code;  ///< The key code of the input
+};
+
 } // end of workspace std
 
 #endif
@@ -10,6 +10,7 @@
 
 #include "types.hpp"
 #include "tlib/config.hpp"
+#include "tlib/alloc_profile.hpp"
 
 ASSERT_ONLY_THOR_PROGRAM
 
@@ -27,6 +28,12 @@ void free(void* pointer);
 size_t brk_start();
 size_t brk_end();
 size_t sbrk(size_t inc);
+size_t brk_release(size_t dec);
+
+/*!
+ * \brief Let the kernel know of the allocation profile of the program
+ */
+void register_alloc_profile(alloc_profile* profile);
 
 } // end of tlib namespace
 
@@ -22,6 +22,7 @@
 #include <expected.hpp>
 
 #include "tlib/net_constants.hpp"
+#include "tlib/iovec.hpp"
 #include "tlib/config.hpp"
 #include "tlib/malloc.hpp"
 
@@ -38,6 +39,7 @@ struct packet {
     size_t fd;     ///< The packet file descriptor
     char* payload; ///< The payload pointer
     size_t index;  ///< The index at which to read or write
+    bool mapped;   ///< Indicates if the payload is a buffer mapped from the kernel
 
     packet();
 
@@ -73,6 +75,25 @@ void socket_close(size_t socket_fd);
  */
 std::expected<packet> prepare_packet(size_t socket_fd, void* desc);
 
+/*!
+ * \brief Map packet buffers of the socket in the process.
+ *
+ * The packets prepared with prepare_mapped_packet are then written directly
+ * in the buffers of the kernel and sent without any copy.
+ *
+ * \param socket_fd The socket file descriptor
+ * \return nothing, or an error
+ */
+std::expected<void> map_packet_buffers(size_t socket_fd);
+
+/*!
+ * \brief Prepare a packet in a mapped packet buffer of the socket
+ * \param socket_fd The socket file descriptor
+ * \param desc The packet descriptor
+ * \return The prepared packet or an error
+ */
+std::expected<packet> prepare_mapped_packet(size_t socket_fd, void* desc);
+
 /*!
  * \brief Finalize a packet (send it)
  * \param socket_fd The socket file descriptor
@@ -99,6 +120,35 @@ std::expected<void> send(size_t socket_fd, const char* buffer, size_t n);
  */
 std::expected<void> send_to(size_t socket_fd, const char* buffer, size_t n, void* address);
 
+/*!
+ * \brief Send several buffers through a connected TCP socket, as one message
+ * \param socket_fd The socket file descriptor
+ * \param vectors The buffers to send
+ * \param n The number of buffers
+ * \return nothing, or an error
+ */
+std::expected<void> sendv(size_t socket_fd, const iovec* vectors, size_t n);
+
+/*!
+ * \brief Send several datagrams through the socket, in a single system call
+ * \param socket_fd The socket file descriptor
+ * \param messages The messages to send (at most MAX_MESSAGES)
+ * \param n The number of messages
+ * \return the number of messages sent, or an error if none was sent
+ */
+std::expected<size_t> send_to_batch(size_t socket_fd, message* messages, size_t n);
+
+/*!
+ * \brief Send the contents of a file through a connected TCP socket,
+ * without copying it through the process
+ * \param socket_fd The socket file descriptor
+ * \param file_fd The file descriptor of the file
+ * \param offset The offset of the first byte to send
+ * \param count The number of bytes to send
+ * \return the number of bytes sent, or an error
+ */
+std::expected<size_t> sendfile(size_t socket_fd, size_t file_fd, size_t offset, size_t count);
+
 /*!
  * \brief Receive a message from the socket
  * \param socket_fd The socket file descriptor
@@ -131,6 +181,30 @@ std::expected<size_t> receive_from(size_t socket_fd, char* buffer, size_t n, voi
  */
 std::expected<size_t> receive_from(size_t socket_fd, char* buffer, size_t n, size_t ms, void* address);
 
+/*!
+ * \brief Receive several datagrams from the socket, in a single system call.
+ *
+ * Only the first datagram is waited for, the other messages are filled
+ * with the datagrams already received.
+ *
+ * \param socket_fd The socket file descriptor
+ * \param messages The messages to fill (at most MAX_MESSAGES)
+ * \param n The number of messages
+ * \return the number of messages filled, or an error
+ */
+std::expected<size_t> receive_from_batch(size_t socket_fd, message* messages, size_t n);
+
+/*!
+ * \brief Receive several datagrams from the socket, in a single system
+ * call, waiting at most ms milliseconds for the first one
+ * \param socket_fd The socket file descriptor
+ * \param messages The messages to fill (at most MAX_MESSAGES)
+ * \param n The number of messages
+ * \param ms The maximum time to wait
+ * \return the number of messages filled, or an error
+ */
+std::expected<size_t> receive_from_batch(size_t socket_fd, message* messages, size_t n, size_t ms);
+
 /*!
  * \brief Listen for messages on the socket
  * \param socket_fd The socket file descriptor
@@ -139,6 +213,39 @@ std::expected<size_t> receive_from(size_t socket_fd, char* buffer, size_t n, siz
  */
 std::expected<void> listen(size_t socket_fd, bool l);
 
+/*!
+ * \brief Set the socket non-blocking or not. The receive and accept calls
+ * of a non-blocking socket return ERROR_WOULD_BLOCK instead of waiting.
+ * \param socket_fd The socket file descriptor
+ * \param non_blocking Indicates if the socket is non-blocking
+ * \return nothing, or an error
+ */
+std::expected<void> set_non_blocking(size_t socket_fd, bool non_blocking);
+
+/*!
+ * \brief Set the size of a buffer of the socket, clamped between
+ * MIN_SOCKET_BUFFER and MAX_SOCKET_BUFFER.
+ *
+ * A received datagram that does not fit in the receive buffer is dropped
+ * and the prepared packets must fit in the send buffer. The receive buffer
+ * of a TCP socket is its window, it is only applied to the connections
+ * established afterwards.
+ *
+ * \param socket_fd The socket file descriptor
+ * \param buffer The buffer to set
+ * \param size The maximum number of bytes of the buffer
+ * \return nothing, or an error
+ */
+std::expected<void> set_buffer_size(size_t socket_fd, socket_buffer buffer, size_t size);
+
+/*!
+ * \brief Returns the size of a buffer of the socket
+ * \param socket_fd The socket file descriptor
+ * \param buffer The buffer to query
+ * \return the maximum number of bytes of the buffer, or an error
+ */
+std::expected<size_t> get_buffer_size(size_t socket_fd, socket_buffer buffer);
+
 /*!
  * \brief Bind a destination to the datagram socket
  * \param socket_fd The socket file descriptor
@@ -193,9 +300,10 @@ std::expected<size_t> connect(size_t socket_fd, tlib::ip::address server, size_t
  * \param socket_fd The socket file descriptor
  * \param server The server address
  * \param port The server port
+ * \param backlog The maximum number of connections waiting to be accepted
  * \return the local port, or an error
  */
-std::expected<void> server_start(size_t socket_fd, tlib::ip::address server, size_t port);
+std::expected<void> server_start(size_t socket_fd, tlib::ip::address server, size_t port, size_t backlog = DEFAULT_BACKLOG);
 
 /*!
  * \brief Wait for a incoming connection
@@ -331,8 +439,9 @@ struct socket {
      * \brief Start as a server (stream socket)
      * \param server The IP of the server
      * \param port The port of the server
+     * \param backlog The maximum number of connections waiting to be accepted
      */
-    void server_start(tlib::ip::address server, size_t port);
+    void server_start(tlib::ip::address server, size_t port, size_t backlog = DEFAULT_BACKLOG);
 
     /*!
      * \brief Wait for a incoming connection
@@ -358,6 +467,24 @@ struct socket {
      */
     void listen(bool l);
 
+    /*!
+     * \brief Set the socket non-blocking or not
+     */
+    void set_non_blocking(bool non_blocking);
+
+    /*!
+     * \brief Set the size of a buffer of the socket
+     */
+    void set_buffer_size(socket_buffer buffer, size_t size);
+
+    /*!
+     * \brief Map the packet buffers of the socket, the next packets are
+     * prepared in place. The socket keeps copying the packets if the
+     * buffers cannot be mapped.
+     * \return true if the buffers are mapped, false otherwise
+     */
+    bool map_packet_buffers();
+
     /*!
      * \brief Prepare a packet to send
      * \param desc The descriptor of the packet
@@ -436,6 +563,7 @@ private:
     size_t error_code;        ///< The error code
     bool _connected;          ///< Connection flag
     bool _bound;              ///< Bind flag
+    bool _mapped = false;     ///< Indicates if the packet buffers are mapped
 };
 
 /*!
@@ -75,6 +75,26 @@ struct inet_address {
     size_t port;
 };
 
+constexpr const size_t MAX_MESSAGES = 64; ///< The maximum number of messages of a batched transfer
+
+constexpr const size_t DEFAULT_BACKLOG = 16; ///< The default number of connections of a server waiting to be accepted
+constexpr const size_t MAX_BACKLOG     = 128; ///< The maximum number of connections of a server waiting to be accepted
+
+constexpr const size_t DEFAULT_SEND_BUFFER    = 128 * 1024;      ///< The default number of bytes a socket can hold to send
+constexpr const size_t DEFAULT_RECEIVE_BUFFER = 128 * 1024;      ///< The default number of bytes a socket can hold received
+constexpr const size_t MIN_SOCKET_BUFFER      = 4 * 1024;        ///< The smallest send or receive buffer of a socket
+constexpr const size_t MAX_SOCKET_BUFFER      = 4 * 1024 * 1024; ///< The largest send or receive buffer of a socket
+
+/*!
+ * \brief A datagram of a batched transfer
+ */
+struct message {
+    char* buffer;         ///< The payload
+    size_t length;        ///< The size of the payload to send, or the size of the buffer to receive into
+    size_t received;      ///< The size of the received payload
+    inet_address address; ///< The peer address
+};
+
 namespace ethernet {
 
 struct address {
@@ -231,6 +251,14 @@ enum class socket_protocol : size_t {
     UDP
 };
 
+/*!
+ * \brief A byte budget of a socket
+ */
+enum class socket_buffer : size_t {
+    SEND,   ///< The prepared packets and the TCP bytes not acknowledged yet
+    RECEIVE ///< The packets waiting to be read and the TCP receive window
+};
+
 } // end of network namespace
 
 #endif
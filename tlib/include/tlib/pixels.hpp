@@ -0,0 +1,148 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_PIXELS_H
+#define TLIB_PIXELS_H
+
+#include <types.hpp>
+
+// The primitives are shared by the kernel and the programs, they work on
+// 32 bits pixels and are vectorized with SSE2 when it is enabled
+
+namespace tlib {
+
+namespace pixels {
+
+#ifdef __SSE2__
+
+typedef uint32_t vector_t __attribute__((vector_size(16), may_alias));                      ///< Four pixels, aligned
+typedef uint32_t unaligned_vector_t __attribute__((vector_size(16), aligned(4), may_alias)); ///< Four pixels, unaligned
+
+constexpr const size_t VECTOR_PIXELS = 4; ///< The number of pixels of a vector
+
+#endif
+
+/*!
+ * \brief Fill n pixels with the given color
+ */
+inline void fill(uint32_t* destination, size_t n, uint32_t color){
+#ifdef __SSE2__
+    // The head is filled until the destination is aligned
+    while(n && (reinterpret_cast<uintptr_t>(destination) & 15)){
+        *destination++ = color;
+        --n;
+    }
+
+    vector_t value = {color, color, color, color};
+
+    for(; n >= VECTOR_PIXELS; n -= VECTOR_PIXELS, destination += VECTOR_PIXELS){
+        *reinterpret_cast<vector_t*>(destination) = value;
+    }
+#endif
+
+    while(n--){
+        *destination++ = color;
+    }
+}
+
+/*!
+ * \brief Copy n pixels, the ranges must not overlap
+ */
+inline void copy(uint32_t* destination, const uint32_t* source, size_t n){
+#ifdef __SSE2__
+    while(n && (reinterpret_cast<uintptr_t>(destination) & 15)){
+        *destination++ = *source++;
+        --n;
+    }
+
+    for(; n >= VECTOR_PIXELS; n -= VECTOR_PIXELS, destination += VECTOR_PIXELS, source += VECTOR_PIXELS){
+        *reinterpret_cast<vector_t*>(destination) = *reinterpret_cast<const unaligned_vector_t*>(source);
+    }
+#endif
+
+    while(n--){
+        *destination++ = *source++;
+    }
+}
+
+/*!
+ * \brief Fill a rectangle of a buffer of the given stride (in pixels)
+ */
+inline void fill_rect(uint32_t* buffer, size_t stride, size_t x, size_t y, size_t w, size_t h, uint32_t color){
+    auto row = buffer + x + y * stride;
+
+    for(size_t j = 0; j < h; ++j, row += stride){
+        fill(row, w, color);
+    }
+}
+
+/*!
+ * \brief Copy a rectangle of pixels between two buffers of the given strides (in pixels)
+ */
+inline void copy_rect(uint32_t* destination, size_t destination_stride, const uint32_t* source, size_t source_stride, size_t w, size_t h){
+    for(size_t j = 0; j < h; ++j){
+        copy(destination + j * destination_stride, source + j * source_stride, w);
+    }
+}
+
+/*!
+ * \brief Clip a rectangle to a width x height area
+ * \return false if nothing of the rectangle is left
+ */
+inline bool clip(size_t x, size_t y, size_t& w, size_t& h, size_t width, size_t height){
+    if(x >= width || y >= height){
+        return false;
+    }
+
+    if(w > width - x){
+        w = width - x;
+    }
+
+    if(h > height - y){
+        h = height - y;
+    }
+
+    return w && h;
+}
+
+/*!
+ * \brief Copy a rectangle of pixels at (x,y) of a destination of width x height pixels, clipped to it
+ */
+inline void clipped_copy(uint32_t* destination, size_t stride, size_t width, size_t height, size_t x, size_t y, const uint32_t* source, size_t source_stride, size_t w, size_t h){
+    if(clip(x, y, w, h, width, height)){
+        copy_rect(destination + x + y * stride, stride, source, source_stride, w, h);
+    }
+}
+
+/*!
+ * \brief Blend the source pixel over the destination pixel with the given alpha (0-256)
+ *
+ * The channels are blended two at a time.
+ */
+inline uint32_t blend(uint32_t destination, uint32_t source, uint32_t alpha){
+    uint32_t inverse = 256 - alpha;
+
+    auto even = ((source & 0x00FF00FF) * alpha + (destination & 0x00FF00FF) * inverse) >> 8;
+    auto odd  = (((source >> 8) & 0x00FF00FF) * alpha + ((destination >> 8) & 0x00FF00FF) * inverse) >> 8;
+
+    return (even & 0x00FF00FF) | ((odd & 0x00FF00FF) << 8);
+}
+
+/*!
+ * \brief Blend n source pixels over the destination pixels with the given alpha (0-256)
+ */
+inline void blend(uint32_t* destination, const uint32_t* source, size_t n, uint32_t alpha){
+    for(size_t i = 0; i < n; ++i){
+        destination[i] = blend(destination[i], source[i], alpha);
+    }
+}
+
+} // end of namespace pixels
+
+} // end of namespace tlib
+
+#endif
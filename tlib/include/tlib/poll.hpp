@@ -0,0 +1,90 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Readiness multiplexing over several files and sockets
+ */
+
+#ifndef TLIB_POLL_H
+#define TLIB_POLL_H
+
+#include <expected.hpp>
+
+#include "tlib/poll_constants.hpp"
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+/*!
+ * \brief Create a new poll instance
+ * \return the descriptor of the instance, or an error
+ */
+std::expected<size_t> poll_create();
+
+/*!
+ * \brief Destroy a poll instance
+ * \param fd The descriptor of the instance
+ * \return nothing, or an error
+ */
+std::expected<void> poll_close(size_t fd);
+
+/*!
+ * \brief Watch a new descriptor
+ * \param fd The descriptor of the instance
+ * \param target The kind of descriptor (file or socket)
+ * \param target_fd The descriptor to watch
+ * \param events The events to watch, with POLL_EDGE for edge triggering
+ * \param data The data to report with the events
+ * \return nothing, or an error
+ */
+std::expected<void> poll_add(size_t fd, poll_target target, size_t target_fd, size_t events, size_t data = 0);
+
+/*!
+ * \brief Change the watched events of a descriptor
+ * \param fd The descriptor of the instance
+ * \param target The kind of descriptor (file or socket)
+ * \param target_fd The watched descriptor
+ * \param events The events to watch, with POLL_EDGE for edge triggering
+ * \param data The data to report with the events
+ * \return nothing, or an error
+ */
+std::expected<void> poll_modify(size_t fd, poll_target target, size_t target_fd, size_t events, size_t data = 0);
+
+/*!
+ * \brief Stop watching a descriptor
+ * \param fd The descriptor of the instance
+ * \param target The kind of descriptor (file or socket)
+ * \param target_fd The watched descriptor
+ * \return nothing, or an error
+ */
+std::expected<void> poll_remove(size_t fd, poll_target target, size_t target_fd);
+
+/*!
+ * \brief Wait indefinitely for ready descriptors
+ * \param fd The descriptor of the instance
+ * \param events The events to fill
+ * \param n The maximum number of events (at most MAX_POLL_EVENTS)
+ * \return the number of events, or an error
+ */
+std::expected<size_t> poll_wait(size_t fd, poll_event* events, size_t n);
+
+/*!
+ * \brief Wait for ready descriptors at most ms milliseconds
+ * \param fd The descriptor of the instance
+ * \param events The events to fill
+ * \param n The maximum number of events (at most MAX_POLL_EVENTS)
+ * \param ms The maximum time to wait
+ * \return the number of events (0 on timeout), or an error
+ */
+std::expected<size_t> poll_wait(size_t fd, poll_event* events, size_t n, size_t ms);
+
+} // end of namespace tlib
+
+#endif
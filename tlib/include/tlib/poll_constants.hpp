@@ -0,0 +1,53 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_POLL_CONSTANTS_H
+#define TLIB_POLL_CONSTANTS_H
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+THOR_NAMESPACE(tlib, poll) {
+
+constexpr const size_t POLL_IN   = 1 << 0; ///< Data can be read without blocking
+constexpr const size_t POLL_OUT  = 1 << 1; ///< Data can be written without blocking
+constexpr const size_t POLL_HUP  = 1 << 2; ///< The peer is gone, always reported
+constexpr const size_t POLL_EDGE = 1 << 8; ///< Report the events only once per change (edge triggered)
+
+constexpr const size_t MAX_POLL_EVENTS = 64; ///< The maximum number of events returned by one wait
+
+/*!
+ * \brief The kind of descriptor watched by a poll instance
+ */
+enum class poll_target : size_t {
+    FILE,  ///< A file descriptor
+    SOCKET ///< A socket descriptor
+};
+
+/*!
+ * \brief An operation on the interest set of a poll instance
+ */
+enum class poll_operation : size_t {
+    ADD,    ///< Watch a new descriptor
+    MODIFY, ///< Change the events of a watched descriptor
+    REMOVE  ///< Stop watching a descriptor
+};
+
+/*!
+ * \brief A ready descriptor, as returned by a wait
+ */
+struct poll_event {
+    poll_target target; ///< The kind of descriptor
+    size_t fd;          ///< The descriptor
+    size_t events;      ///< The ready events
+    size_t data;        ///< The data given when the descriptor was added
+};
+
+} // end of poll namespace
+
+#endif
@@ -49,6 +49,9 @@ size_t read_input(char* buffer, size_t max, size_t ms);
 std::keycode read_input_raw();
 std::keycode read_input_raw(size_t ms);
 
+size_t read_input_events(std::input_event* events, size_t max);
+size_t read_input_events(std::input_event* events, size_t max, size_t ms);
+
 void clear();
 
 size_t get_columns();
@@ -58,6 +61,12 @@ size_t get_rows();
 
 void user_logf(const char* s, ...);
 
+/*!
+ * \brief Log a benchmark result to the kernel log, in the format read by
+ * the regression harness: result|program|name|metric|value
+ */
+void log_result(const char* program, const char* name, const char* metric, uint64_t value);
+
 } //end of namespace tlib
 
 #endif
@@ -0,0 +1,54 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Named shared memory objects, mapped by several processes
+ */
+
+#ifndef TLIB_SHM_H
+#define TLIB_SHM_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+/*!
+ * \brief Create a named shared memory object, filled with zeroes
+ * \param name The name of the object
+ * \param size The size of the object, rounded up to pages
+ */
+std::expected<void> shm_create(const char* name, size_t size);
+
+/*!
+ * \brief Map a shared memory object into the process
+ * \param name The name of the object
+ * \param size Output reference to the size of the mapping
+ * \return the address of the mapping, or an error
+ */
+std::expected<void*> shm_map(const char* name, size_t& size);
+
+/*!
+ * \brief Unmap a shared memory object from the process
+ * \param address The address returned by shm_map()
+ */
+std::expected<void> shm_unmap(void* address);
+
+/*!
+ * \brief Remove the name of a shared memory object, its memory is freed
+ * once no process maps it anymore
+ */
+std::expected<void> shm_remove(const char* name);
+
+} // end of namespace tlib
+
+#endif
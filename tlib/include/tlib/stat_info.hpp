@@ -20,6 +20,7 @@ using datetime = THOR_NAMESPACE_NAME(tlib, rtc)::datetime;
 constexpr const size_t STAT_FLAG_DIRECTORY = 1 << 0;
 constexpr const size_t STAT_FLAG_HIDDEN = 1 << 1;
 constexpr const size_t STAT_FLAG_SYSTEM = 1 << 2;
+constexpr const size_t STAT_FLAG_CHAR_DEVICE = 1 << 3;
 
 struct stat_info {
     size_t flags;
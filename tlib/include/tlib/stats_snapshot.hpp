@@ -0,0 +1,74 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_STATS_SNAPSHOT_H
+#define TLIB_STATS_SNAPSHOT_H
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+THOR_NAMESPACE(tlib, stats) {
+
+constexpr const uint64_t STATS_SNAPSHOT_VERSION = 1; ///< The version of the layout of the snapshot
+constexpr const size_t STATS_MAX_INTERFACES     = 8; ///< The maximum number of network interfaces in a snapshot
+constexpr const size_t STATS_INTERFACE_NAME     = 16; ///< The size of the name of an interface, null-terminated
+constexpr const size_t STATS_PROCESS_STATES     = 9; ///< The number of process states
+
+/*!
+ * \brief The counters of a network interface
+ */
+struct interface_stats {
+    char name[STATS_INTERFACE_NAME]; ///< The name of the interface
+    uint64_t enabled;                ///< 1 if the interface is enabled, 0 otherwise
+    uint64_t rx_packets;             ///< The received packets
+    uint64_t rx_bytes;               ///< The received bytes
+    uint64_t tx_packets;             ///< The transmitted packets
+    uint64_t tx_bytes;               ///< The transmitted bytes
+    uint64_t rx_dropped;             ///< The received packets dropped on a full queue
+    uint64_t tx_dropped;             ///< The packets to transmit dropped on a full queue
+    uint64_t rx_errors;              ///< The received packets dropped as malformed
+    uint64_t rx_interrupts;          ///< The reception interrupts that scheduled a poll
+    uint64_t rx_polls;               ///< The poll passes
+};
+
+/*!
+ * \brief A snapshot of the core counters of the system, taken at once.
+ *
+ * The layout only grows at the end, the version is incremented each time.
+ * The kernel fills as much of the snapshot as the given size allows and
+ * stores the size it filled, older programs keep working with newer
+ * kernels and the opposite.
+ */
+struct stats_snapshot {
+    uint64_t version; ///< The version of the layout filled by the kernel
+    uint64_t size;    ///< The number of bytes filled by the kernel
+
+    uint64_t uptime_ms; ///< The milliseconds since boot when the snapshot was taken
+
+    uint64_t physical_available; ///< The bytes of physical memory
+    uint64_t physical_allocated; ///< The allocated bytes of physical memory
+    uint64_t physical_free;      ///< The free bytes of physical memory
+
+    uint64_t virtual_available; ///< The bytes of kernel virtual memory
+    uint64_t virtual_allocated; ///< The allocated bytes of kernel virtual memory
+    uint64_t virtual_free;      ///< The free bytes of kernel virtual memory
+
+    uint64_t kalloc_allocated; ///< The bytes obtained by the kernel allocator
+    uint64_t kalloc_used;      ///< The bytes used by the kernel allocations
+    uint64_t kalloc_free;      ///< The bytes available to the kernel allocations
+
+    uint64_t processes;                            ///< The processes, in any state but EMPTY
+    uint64_t process_states[STATS_PROCESS_STATES]; ///< The processes in each state, by value of the state
+
+    uint64_t interfaces;                             ///< The network interfaces in the snapshot
+    interface_stats interface[STATS_MAX_INTERFACES]; ///< The network interfaces
+};
+
+} // end of namespace tlib
+
+#endif
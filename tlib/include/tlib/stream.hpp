@@ -0,0 +1,141 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef USER_STREAM_HPP
+#define USER_STREAM_HPP
+
+#include <types.hpp>
+#include <expected.hpp>
+#include <string.hpp>
+
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+/*!
+ * \brief The buffering of a stream
+ */
+enum class buffering : uint8_t {
+    NONE, ///< Every write goes to the file right away
+    LINE, ///< The buffer is written at each new line
+    FULL, ///< The buffer is written once full
+    AUTO  ///< LINE on a character device (a terminal), FULL otherwise, decided on first use
+};
+
+/*!
+ * \brief A buffered stream on a file descriptor.
+ *
+ * The writes are coalesced in the buffer and the reads are done a buffer
+ * at a time, the accesses larger than the buffer go directly to the file.
+ * A stream is either used for reading or for writing, switching from one
+ * to the other flushes the buffer.
+ *
+ * The stream is not flushed on destruction, the standard streams are
+ * flushed by tlib::exit and before reading the standard input.
+ */
+struct stream {
+    static constexpr const size_t BUFFER_SIZE = 4096; ///< The size of the buffer
+
+    /*!
+     * \brief Create a stream on the given file descriptor
+     * \param fd The file descriptor
+     * \param mode The buffering of the writes
+     */
+    constexpr stream(size_t fd, buffering mode = buffering::AUTO)
+            : fd(fd), mode(mode), reading(false), eof(false), position(0), start(0), end(0), buffer() {
+        //Nothing else to init
+    }
+
+    stream(const stream& rhs) = delete;
+    stream& operator=(const stream& rhs) = delete;
+
+    /*!
+     * \brief Write n bytes to the stream
+     * \return the number of bytes accepted by the stream
+     */
+    std::expected<size_t> write(const char* s, size_t n);
+
+    /*!
+     * \brief Write a null-terminated string to the stream
+     */
+    std::expected<size_t> write(const char* s);
+
+    /*!
+     * \brief Write a string to the stream
+     */
+    std::expected<size_t> write(const std::string& s);
+
+    /*!
+     * \brief Write a single character to the stream
+     */
+    std::expected<size_t> put(char c);
+
+    /*!
+     * \brief Write a formatted string to the stream
+     */
+    void printf(const std::string& format, ...);
+
+    /*!
+     * \brief Write the buffered bytes to the file
+     */
+    std::expected<void> flush();
+
+    /*!
+     * \brief Read at most max bytes from the stream
+     * \return the number of bytes read, 0 at the end of file
+     */
+    std::expected<size_t> read(char* destination, size_t max);
+
+    /*!
+     * \brief Read the next line of the stream, without its new line
+     * \return true if a line was read, false at the end of file
+     */
+    std::expected<bool> read_line(std::string& line);
+
+    /*!
+     * \brief Returns the file descriptor of the stream
+     */
+    size_t descriptor() const {
+        return fd;
+    }
+
+private:
+    std::expected<void> fill();
+    std::expected<size_t> write_direct(const char* s, size_t n);
+    void resolve_mode();
+
+    size_t fd;       ///< The file descriptor
+    buffering mode;  ///< The buffering of the writes
+    bool reading;    ///< Indicates if the buffer holds bytes read from the file
+    bool eof;        ///< Indicates if the end of file has been reached
+    size_t position; ///< The position in the file
+    size_t start;    ///< The first buffered byte not read yet
+    size_t end;      ///< The end of the buffered bytes
+
+    char buffer[BUFFER_SIZE]; ///< The buffered bytes
+};
+
+/*!
+ * \brief Returns the standard input stream
+ */
+stream& in();
+
+/*!
+ * \brief Returns the standard output stream, on which print and printf write
+ */
+stream& out();
+
+/*!
+ * \brief Returns the standard error stream, not buffered
+ */
+stream& err();
+
+} //end of namespace tlib
+
+#endif
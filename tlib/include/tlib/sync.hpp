@@ -0,0 +1,113 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Synchronization primitives for the processes sharing memory.
+ *
+ * The primitives only enter the kernel to block or to wake up a waiting
+ * process, never when there is no contention.
+ */
+
+#ifndef TLIB_SYNC_H
+#define TLIB_SYNC_H
+
+#include <types.hpp>
+
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+/*!
+ * \brief A mutual exclusion lock
+ */
+struct mutex {
+    /*!
+     * \brief Acquire the lock, blocking while it is held
+     */
+    void lock();
+
+    /*!
+     * \brief Try to acquire the lock without blocking
+     * \return true if the lock was acquired, false otherwise
+     */
+    bool try_lock();
+
+    /*!
+     * \brief Release the lock
+     */
+    void unlock();
+
+private:
+    volatile uint32_t state = 0; ///< 0 unlocked, 1 locked, 2 locked with waiters
+
+    friend struct condition_variable;
+};
+
+/*!
+ * \brief A condition variable, used with a mutex
+ */
+struct condition_variable {
+    /*!
+     * \brief Release the mutex and wait for a notification, the mutex is
+     * acquired again before returning. The wake ups can be spurious.
+     */
+    void wait(mutex& m);
+
+    /*!
+     * \brief Wait for a notification at most ms milliseconds
+     * \return false if the time passed, true otherwise
+     */
+    bool wait_for(mutex& m, size_t ms);
+
+    /*!
+     * \brief Wake up one waiting process
+     */
+    void notify_one();
+
+    /*!
+     * \brief Wake up all the waiting processes
+     */
+    void notify_all();
+
+private:
+    volatile uint32_t sequence = 0; ///< Incremented on each notification
+    volatile uint32_t waiters = 0;  ///< The number of waiting processes
+};
+
+/*!
+ * \brief A counting semaphore
+ */
+struct semaphore {
+    explicit semaphore(uint32_t value = 0) : value(value) {}
+
+    /*!
+     * \brief Decrement the semaphore, blocking while it is zero
+     */
+    void acquire();
+
+    /*!
+     * \brief Decrement the semaphore if it is not zero
+     * \return true if the semaphore was decremented, false otherwise
+     */
+    bool try_acquire();
+
+    /*!
+     * \brief Increment the semaphore
+     */
+    void release();
+
+private:
+    volatile uint32_t value;       ///< The value of the semaphore
+    volatile uint32_t waiters = 0; ///< The number of waiting processes
+};
+
+} // end of namespace tlib
+
+#endif
@@ -14,7 +14,9 @@
 #include <string.hpp>
 
 #include "tlib/datetime.hpp"
+#include "tlib/stats_snapshot.hpp"
 #include "tlib/config.hpp"
+#include "tlib/cpu_features.hpp"
 
 ASSERT_ONLY_THOR_PROGRAM
 
@@ -22,21 +24,67 @@ namespace tlib {
 
 void exit(size_t return_code) __attribute__((noreturn));
 
-std::expected<size_t> exec(const char* executable, const std::vector<std::string>& params = {});
-std::expected<size_t> exec_and_wait(const char* executable, const std::vector<std::string>& params = {});
+std::expected<size_t> exec(const char* executable, const std::vector<std::string>& params = {}, size_t flags = 0);
+
+/*!
+ * \brief Execute the given program with other standard fds
+ * \param handles The fds to use as the standard input, output and error
+ * of the new process, 0 to keep the standard one of this process
+ * \return The pid of the new process
+ */
+std::expected<size_t> exec(const char* executable, const std::vector<std::string>& params, size_t flags, const size_t (&handles)[3]);
+
+std::expected<size_t> exec_and_wait(const char* executable, const std::vector<std::string>& params = {}, size_t flags = 0);
+
+/*!
+ * \brief Create a copy of the current process, sharing its memory until
+ * one of them writes to it
+ * \return The pid of the child in the parent, 0 in the child
+ */
+std::expected<size_t> fork();
 
 void await_termination(size_t pid);
 
+size_t get_pid();
+
 void sleep_ms(size_t ms);
 
+/*!
+ * \brief Let another ready process run before this one continues
+ */
+void yield();
+
 datetime local_date();
 
 void reboot();
 void shutdown();
 
+/*!
+ * \brief Take a snapshot of the core counters of the system (memory,
+ * processes and network interfaces) with a single system call
+ */
+std::expected<void> snapshot_stats(stats_snapshot& snapshot);
+
 uint64_t s_time();
 uint64_t ms_time();
 
+/*!
+ * \brief Returns the nanoseconds since boot, with the resolution of the
+ * TSC if the kernel uses it, without a system call
+ */
+uint64_t ns_time();
+
+/*!
+ * \brief Returns the features of the processors detected by the kernel,
+ * the mask of the tlib::cpu_feature bits, without a system call
+ */
+uint64_t cpu_features();
+
+/*!
+ * \brief Indicates if the processors have the given feature
+ */
+bool cpu_has(cpu_feature feature);
+
 void alpha();
 
 } // end of tlib namespace
@@ -0,0 +1,88 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file
+ * \brief Threads sharing the address space of the process
+ */
+
+#ifndef TLIB_THREAD_H
+#define TLIB_THREAD_H
+
+#include <types.hpp>
+#include <expected.hpp>
+
+#include "tlib/config.hpp"
+
+ASSERT_ONLY_THOR_PROGRAM
+
+namespace tlib {
+
+constexpr const size_t THREAD_STACK_SIZE = 64 * 1024; ///< The default size of the stack of a thread
+
+/*!
+ * \brief Create a thread executing the given function. The function must
+ * not return, the thread ends with exit().
+ * \param entry The address of the function
+ * \param stack The top of the stack of the thread
+ * \param data The argument of the function
+ * \param tls The base of the thread-local storage (FS) of the thread
+ * \return the id of the thread, or an error
+ */
+std::expected<size_t> create_thread(size_t entry, size_t stack, size_t data, size_t tls);
+
+/*!
+ * \brief Set the base of the thread-local storage (FS) of the current thread
+ */
+void set_tls(void* base);
+
+/*!
+ * \brief A thread of the process.
+ *
+ * The threads share the memory, the files and the sockets of the process.
+ * They must all be joined before the end of the program. Only the thread
+ * that started a thread can join it.
+ */
+struct thread {
+    thread() = default;
+
+    thread(const thread& rhs) = delete;
+    thread& operator=(const thread& rhs) = delete;
+
+    /*!
+     * \brief Start the thread
+     * \param fun The function executed by the thread
+     * \param data The argument of the function
+     * \param stack_size The size of the stack of the thread
+     * \param tls The base of the thread-local storage of the thread
+     * \return true if the thread was started, false otherwise
+     */
+    bool start(void (*fun)(void*), void* data, size_t stack_size = THREAD_STACK_SIZE, void* tls = nullptr);
+
+    /*!
+     * \brief Wait for the end of the thread
+     */
+    void join();
+
+    /*!
+     * \brief Returns the id of the thread
+     */
+    size_t id() const;
+
+    /*!
+     * \brief Indicates if the thread is started and not joined yet
+     */
+    bool joinable() const;
+
+private:
+    size_t pid = 0;        ///< The id of the thread
+    char* stack = nullptr; ///< The stack of the thread
+};
+
+} // end of namespace tlib
+
+#endif
@@ -0,0 +1,49 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef TLIB_TIME_PAGE_H
+#define TLIB_TIME_PAGE_H
+
+#include <types.hpp>
+
+namespace tlib {
+
+constexpr const size_t TIME_PAGE_ADDRESS = 0x8000300000; ///< The virtual address of the time page in each program
+
+/*!
+ * \brief The time page, shared read-only with all the programs.
+ *
+ * The kernel updates it on each timer tick. The sequence is odd while an
+ * update is in progress, a reader must read it again if it is odd or if
+ * it changed while reading the values.
+ *
+ * When the kernel clock uses the invariant TSC, tsc_mult is not zero and
+ * the current nanoseconds are tsc_nanoseconds + ((rdtsc - tsc_base) *
+ * tsc_mult) >> 32, otherwise nanoseconds has the resolution of the tick.
+ *
+ * The wall-clock time is epoch_offset plus the nanoseconds since boot,
+ * the offset is 0 until the kernel has read the RTC.
+ *
+ * The features of the processors are set once at boot, before the first
+ * program starts, they are not covered by the sequence.
+ */
+struct time_page {
+    volatile uint64_t sequence;          ///< The sequence number of the update
+    volatile uint64_t milliseconds;      ///< The milliseconds since boot
+    volatile uint64_t seconds;           ///< The seconds since boot
+    volatile uint64_t counter_frequency; ///< The frequency of the kernel counter
+    volatile uint64_t nanoseconds;       ///< The nanoseconds since boot
+    volatile uint64_t tsc_base;          ///< The TSC at the calibration of the clock
+    volatile uint64_t tsc_nanoseconds;   ///< The nanoseconds since boot at tsc_base
+    volatile uint64_t tsc_mult;          ///< The nanoseconds per TSC cycle, in 32.32 fixed point, 0 if the TSC is not used
+    volatile uint64_t epoch_offset;      ///< The nanoseconds since the Unix epoch at boot, 0 if unknown
+    volatile uint64_t cpu_features;      ///< The features of the processors, the tlib::cpu_feature bits
+};
+
+} // end of namespace tlib
+
+#endif
@@ -6,13 +6,15 @@
 //=======================================================================
 
 #include "tlib/file.hpp"
+#include "tlib/stream.hpp"
+#include "tlib/errors.hpp"
 
 std::expected<size_t> tlib::open(const char* file, size_t flags){
     int64_t fd;
-    asm volatile("mov rax, 0x300; mov rbx, %[path]; mov rcx, %[flags]; int 50; mov %[fd], rax"
+    asm volatile("mov rax, 0x300; mov rbx, %[path]; mov r10, %[flags]; syscall; mov %[fd], rax"
         : [fd] "=m" (fd)
         : [path] "g" (reinterpret_cast<size_t>(file)), [flags] "g" (flags)
-        : "rax", "rbx", "rcx");
+        : "rax", "rbx", "r10", "rcx", "r11");
 
     if(fd < 0){
         return std::make_expected_from_error<size_t, size_t>(-fd);
@@ -23,37 +25,56 @@ std::expected<size_t> tlib::open(const char* file, size_t flags){
 
 int64_t tlib::mkdir(const char* file){
     int64_t result;
-    asm volatile("mov rax, 0x306; mov rbx, %[path]; int 50; mov %[result], rax"
+    asm volatile("mov rax, 0x306; mov rbx, %[path]; syscall; mov %[result], rax"
         : [result] "=m" (result)
         : [path] "g" (reinterpret_cast<size_t>(file))
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
     return result;
 }
 
 int64_t tlib::rm(const char* file){
     int64_t result;
-    asm volatile("mov rax, 0x307; mov rbx, %[path]; int 50; mov %[result], rax"
+    asm volatile("mov rax, 0x307; mov rbx, %[path]; syscall; mov %[result], rax"
         : [result] "=m" (result)
         : [path] "g" (reinterpret_cast<size_t>(file))
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
     return result;
 }
 
 void tlib::close(size_t fd){
-    asm volatile("mov rax, 0x302; mov rbx, %[fd]; int 50;"
+    asm volatile("mov rax, 0x302; mov rbx, %[fd]; syscall;"
         : /* No outputs */
         : [fd] "g" (fd)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
+}
+
+std::expected<void> tlib::pipe(size_t& read_fd, size_t& write_fd){
+    size_t fds[2];
+
+    int64_t code;
+    asm volatile("mov rax, 0x329; mov rbx, %[fds]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fds] "g" (reinterpret_cast<size_t>(fds))
+        : "rax", "rbx", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_unexpected<void, size_t>(-code);
+    }
+
+    read_fd = fds[0];
+    write_fd = fds[1];
+
+    return {};
 }
 
 std::expected<tlib::stat_info> tlib::stat(size_t fd){
     tlib::stat_info info;
 
     int64_t code;
-    asm volatile("mov rax, 0x301; mov rbx, %[fd]; mov rcx, %[buffer]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x301; mov rbx, %[fd]; mov r10, %[buffer]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(&info))
-        : "rax", "rbx", "rcx");
+        : "rax", "rbx", "r10", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<tlib::stat_info, size_t>(-code);
@@ -66,10 +87,10 @@ std::expected<tlib::statfs_info> tlib::statfs(const char* file){
     tlib::statfs_info info;
 
     int64_t code;
-    asm volatile("mov rax, 0x310; mov rbx, %[path]; mov rcx, %[buffer]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x310; mov rbx, %[path]; mov r10, %[buffer]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [path] "g" (reinterpret_cast<size_t>(file)), [buffer] "g" (reinterpret_cast<size_t>(&info))
-        : "rax", "rbx", "rcx");
+        : "rax", "rbx", "r10", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<tlib::statfs_info, size_t>(-code);
@@ -80,10 +101,10 @@ std::expected<tlib::statfs_info> tlib::statfs(const char* file){
 
 std::expected<size_t> tlib::read(size_t fd, char* buffer, size_t max, size_t offset){
     int64_t code;
-    asm volatile("mov rax, 0x303; mov rbx, %[fd]; mov rcx, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x303; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max), [offset] "g" (offset)
-        : "rax", "rbx", "rcx", "rdx", "rsi");
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -93,10 +114,10 @@ std::expected<size_t> tlib::read(size_t fd, char* buffer, size_t max, size_t off
 }
 std::expected<size_t> tlib::read(size_t fd, char* buffer, size_t max, size_t offset, size_t ms){
     int64_t code;
-    asm volatile("mov rax, 0x315; mov rbx, %[fd]; mov rcx, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; mov rdi, %[ms]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x315; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; mov rdi, %[ms]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max), [offset] "g" (offset), [ms] "g" (ms)
-        : "rax", "rbx", "rcx", "rdx", "rsi", "rdi");
+        : "rax", "rbx", "r10", "rdx", "rsi", "rdi", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -105,12 +126,54 @@ std::expected<size_t> tlib::read(size_t fd, char* buffer, size_t max, size_t off
     }
 }
 
+std::expected<void*> tlib::mmap(size_t fd, size_t offset, size_t length, size_t prot){
+    int64_t code;
+    asm volatile("mov rax, 0x316; mov rbx, %[fd]; mov r10, %[offset]; mov rdx, %[length]; mov rsi, %[prot]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fd] "g" (fd), [offset] "g" (offset), [length] "g" (length), [prot] "g" (prot)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
+
+    if(code < 0){
+        return std::make_expected_from_error<void*, size_t>(-code);
+    } else {
+        return std::make_expected<void*>(reinterpret_cast<void*>(code));
+    }
+}
+
 std::expected<size_t> tlib::write(size_t fd, const char* buffer, size_t max, size_t offset){
     int64_t code;
-    asm volatile("mov rax, 0x311; mov rbx, %[fd]; mov rcx, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x311; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max), [offset] "g" (offset)
-        : "rax", "rbx", "rcx", "rdx", "rsi");
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
+
+    if(code < 0){
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    } else {
+        return std::make_expected<size_t>(code);
+    }
+}
+
+std::expected<size_t> tlib::readv(size_t fd, const iovec* vectors, size_t n, size_t offset){
+    int64_t code;
+    asm volatile("mov rax, 0x321; mov rbx, %[fd]; mov r10, %[vectors]; mov rdx, %[n]; mov rsi, %[offset]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fd] "g" (fd), [vectors] "g" (reinterpret_cast<size_t>(vectors)), [n] "g" (n), [offset] "g" (offset)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    } else {
+        return std::make_expected<size_t>(code);
+    }
+}
+
+std::expected<size_t> tlib::writev(size_t fd, const iovec* vectors, size_t n, size_t offset){
+    int64_t code;
+    asm volatile("mov rax, 0x322; mov rbx, %[fd]; mov r10, %[vectors]; mov rdx, %[n]; mov rsi, %[offset]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fd] "g" (fd), [vectors] "g" (reinterpret_cast<size_t>(vectors)), [n] "g" (n), [offset] "g" (offset)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -121,10 +184,10 @@ std::expected<size_t> tlib::write(size_t fd, const char* buffer, size_t max, siz
 
 std::expected<size_t> tlib::clear(size_t fd, size_t max, size_t offset){
     int64_t code;
-    asm volatile("mov rax, 0x313; mov rbx, %[fd]; mov rcx, %[max]; mov rdx, %[offset]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x313; mov rbx, %[fd]; mov r10, %[max]; mov rdx, %[offset]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [max] "g" (max), [offset] "g" (offset)
-        : "rax", "rbx", "rcx", "rdx");
+        : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -135,10 +198,10 @@ std::expected<size_t> tlib::clear(size_t fd, size_t max, size_t offset){
 
 std::expected<size_t> tlib::truncate(size_t fd, size_t size){
     int64_t code;
-    asm volatile("mov rax, 0x312; mov rbx, %[fd]; mov rcx, %[size]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x312; mov rbx, %[fd]; mov r10, %[size]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [size] "g" (size)
-        : "rax", "rbx", "rcx");
+        : "rax", "rbx", "r10", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -149,10 +212,10 @@ std::expected<size_t> tlib::truncate(size_t fd, size_t size){
 
 std::expected<size_t> tlib::entries(size_t fd, char* buffer, size_t max){
     int64_t code;
-    asm volatile("mov rax, 0x308; mov rbx, %[fd]; mov rcx, %[buffer]; mov rdx, %[max]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x308; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max)
-        : "rax", "rbx", "rcx", "rdx");
+        : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -163,10 +226,10 @@ std::expected<size_t> tlib::entries(size_t fd, char* buffer, size_t max){
 
 std::expected<size_t> tlib::mounts(char* buffer, size_t max){
     int64_t code;
-    asm volatile("mov rax, 0x309; mov rbx, %[buffer]; mov rcx, %[max]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x309; mov rbx, %[buffer]; mov r10, %[max]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max)
-        : "rax", "rbx", "rcx");
+        : "rax", "rbx", "r10", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<size_t, size_t>(-code);
@@ -177,10 +240,10 @@ std::expected<size_t> tlib::mounts(char* buffer, size_t max){
 
 std::expected<void> tlib::mount(size_t type, size_t dev_fd, size_t mp_fd){
     int64_t code;
-    asm volatile("mov rax, 0x314; mov rbx, %[type]; mov rcx, %[mp]; mov rdx, %[dev]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0x314; mov rbx, %[type]; mov r10, %[mp]; mov rdx, %[dev]; syscall; mov %[code], rax"
         : [code] "=m" (code)
         : [type] "g" (type), [dev] "g" (dev_fd), [mp] "g" (mp_fd)
-        : "rax", "rbx", "rcx", "rdx");
+        : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if(code < 0){
         return std::make_expected_from_error<void, size_t>(-code);
@@ -189,23 +252,86 @@ std::expected<void> tlib::mount(size_t type, size_t dev_fd, size_t mp_fd){
     }
 }
 
+std::expected<void> tlib::sync(){
+    int64_t code;
+    asm volatile("mov rax, 0x317; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        :
+        : "rax", "rcx", "r11");
+
+    if(code < 0){
+        return std::make_expected_from_error<void, size_t>(-code);
+    } else {
+        return std::make_expected();
+    }
+}
+
+std::expected<size_t> tlib::aio_read(size_t fd, char* buffer, size_t max, size_t offset){
+    int64_t code;
+    asm volatile("mov rax, 0x318; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max), [offset] "g" (offset)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
+
+    if(code < 0){
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    } else {
+        return std::make_expected<size_t>(code);
+    }
+}
+
+std::expected<size_t> tlib::aio_write(size_t fd, const char* buffer, size_t max, size_t offset){
+    int64_t code;
+    asm volatile("mov rax, 0x319; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; mov rsi, %[offset]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max), [offset] "g" (offset)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
+
+    if(code < 0){
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    } else {
+        return std::make_expected<size_t>(code);
+    }
+}
+
+std::expected<size_t> tlib::aio_wait(std::expected<size_t>& result, size_t ms){
+    int64_t value = 0;
+    int64_t code;
+    asm volatile("mov rax, 0x320; mov rbx, %[value]; mov r10, %[ms]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [value] "g" (reinterpret_cast<size_t>(&value)), [ms] "g" (ms)
+        : "rax", "rbx", "r10", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    }
+
+    if(value < 0){
+        result = std::make_expected_from_error<size_t, size_t>(-value);
+    } else {
+        result = std::make_expected<size_t>(value);
+    }
+
+    return std::make_expected<size_t>(code);
+}
+
 std::string tlib::current_working_directory(){
     char buffer[128];
     buffer[0] = '\0';
 
-    asm volatile("mov rax, 0x304; mov rbx, %[buffer]; int 50;"
+    asm volatile("mov rax, 0x304; mov rbx, %[buffer]; syscall;"
         : /* No outputs */
         : [buffer] "g" (reinterpret_cast<size_t>(buffer))
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 
     return {buffer};
 }
 
 void tlib::set_current_working_directory(const std::string& directory){
-    asm volatile("mov rax, 0x305; mov rbx, %[buffer]; int 50;"
+    asm volatile("mov rax, 0x305; mov rbx, %[buffer]; syscall;"
         : /* No outputs */
         : [buffer] "g" (reinterpret_cast<size_t>(directory.c_str()))
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 }
 
 tlib::file::file(const std::string& path) : path(path), fd(0), error_code(0) {
@@ -276,28 +402,85 @@ std::string tlib::file::read_file(){
     return buffer;
 }
 
+tlib::block_view tlib::file::blocks(size_t block_size){
+    return {fd, block_size};
+}
+
+tlib::line_view tlib::file::lines(){
+    return {fd};
+}
+
+std::expected<tlib::file_mapping> tlib::file::map(){
+    if(!good() || !open()){
+        return std::make_unexpected<file_mapping>(error_code ? error_code : std::ERROR_INVALID_FILE_DESCRIPTOR);
+    }
+
+    auto info = tlib::stat(fd);
+
+    if(!info){
+        error_code = info.error();
+        return std::make_unexpected<file_mapping>(error_code);
+    }
+
+    auto mapped = tlib::mmap(fd, 0, info->size);
+
+    if(!mapped){
+        error_code = mapped.error();
+        return std::make_unexpected<file_mapping>(error_code);
+    }
+
+    return std::make_expected<file_mapping>({static_cast<const char*>(*mapped), info->size});
+}
+
+std::expected<size_t> tlib::entries_stat(size_t fd, char* buffer, size_t max){
+    int64_t code;
+    asm volatile("mov rax, 0x330; mov rbx, %[fd]; mov r10, %[buffer]; mov rdx, %[max]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [fd] "g" (fd), [buffer] "g" (reinterpret_cast<size_t>(buffer)), [max] "g" (max)
+        : "rax", "rbx", "r10", "rdx", "rcx", "r11");
+
+    if(code < 0){
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    } else {
+        return std::make_expected<size_t>(code);
+    }
+}
+
 tlib::directory_view tlib::file::entries(){
     if(!good() || !open()){
         return {nullptr};
     }
 
-    auto entries_buffer = new char[4096];
+    // The buffer grows until the entries of large directories fit
+    for(size_t size = 4096; ; size *= 2){
+        auto entries_buffer = new char[size];
+
+        auto entries_result = tlib::entries_stat(fd, entries_buffer, size);
 
-    auto entries_result = tlib::entries(fd, entries_buffer, 4096);
+        if(entries_result){
+            // An empty directory has no entry to iterate
+            if(!*entries_result){
+                delete[] entries_buffer;
+
+                return {nullptr};
+            }
+
+            return {entries_buffer};
+        }
 
-    if(!entries_result){
         delete[] entries_buffer;
-        error_code = entries_result.error();
 
-        return {nullptr};
-    }
+        if(entries_result.error() != std::ERROR_BUFFER_SMALL){
+            error_code = entries_result.error();
 
-    return {entries_buffer};
+            return {nullptr};
+        }
+    }
 }
 
 tlib::directory_iterator::directory_iterator(const directory_view& view, bool end) : view(view), position(0), end(end) {
     if(!end){
-        entry = reinterpret_cast<tlib::directory_entry*>(view.entries_buffer + position);
+        entry = reinterpret_cast<tlib::directory_stat_entry*>(view.entries_buffer + position);
     }
 }
 
@@ -305,6 +488,10 @@ const char* tlib::directory_iterator::operator*() const {
     return &entry->name;
 }
 
+const tlib::stat_info& tlib::directory_iterator::info() const {
+    return entry->info;
+}
+
 tlib::directory_iterator& tlib::directory_iterator::operator++(){
     if(end){
         return *this;
@@ -317,7 +504,7 @@ tlib::directory_iterator& tlib::directory_iterator::operator++(){
     }
 
     position += entry->offset_next;
-    entry = reinterpret_cast<tlib::directory_entry*>(view.entries_buffer + position);
+    entry = reinterpret_cast<tlib::directory_stat_entry*>(view.entries_buffer + position);
 
     return *this;
 }
@@ -355,3 +542,150 @@ tlib::directory_iterator tlib::directory_view::begin() const {
 tlib::directory_iterator tlib::directory_view::end() const {
     return {*this, true};
 }
+
+tlib::block_view::block_view(size_t fd, size_t block_size) : fd(fd), buffer(nullptr), block_size(block_size), offset(0), size(0), error_code(0), started(false), done(false) {
+    if(fd){
+        buffer = new char[block_size];
+    } else {
+        done = true;
+    }
+}
+
+tlib::block_view::block_view(block_view&& rhs) : fd(rhs.fd), buffer(rhs.buffer), block_size(rhs.block_size), offset(rhs.offset),
+        size(rhs.size), error_code(rhs.error_code), started(rhs.started), done(rhs.done) {
+    rhs.buffer = nullptr;
+    rhs.done = true;
+}
+
+tlib::block_view::~block_view(){
+    if(buffer){
+        delete[] buffer;
+    }
+}
+
+tlib::block_iterator tlib::block_view::begin(){
+    // The first block is only read once iterated
+    if(!started){
+        started = true;
+        next();
+    }
+
+    return {*this, false};
+}
+
+tlib::block_iterator tlib::block_view::end(){
+    return {*this, true};
+}
+
+size_t tlib::block_view::error() const {
+    return error_code;
+}
+
+void tlib::block_view::next(){
+    if(done){
+        return;
+    }
+
+    auto read = tlib::read(fd, buffer, block_size, offset);
+
+    if(!read){
+        error_code = read.error();
+        done = true;
+    } else if(!*read){
+        done = true;
+    } else {
+        size = *read;
+        offset += *read;
+    }
+}
+
+tlib::block_iterator::block_iterator(block_view& view, bool end) : view(view), end(end) {}
+
+tlib::file_block tlib::block_iterator::operator*() const {
+    return {view.buffer, view.size};
+}
+
+tlib::block_iterator& tlib::block_iterator::operator++(){
+    view.next();
+
+    return *this;
+}
+
+bool tlib::block_iterator::operator==(const block_iterator& rhs) const {
+    return (end || view.done) == (rhs.end || rhs.view.done);
+}
+
+bool tlib::block_iterator::operator!=(const block_iterator& rhs) const {
+    return !(*this == rhs);
+}
+
+tlib::line_view::line_view(size_t fd) : input(nullptr), error_code(0), started(false), done(false) {
+    if(fd){
+        input = new stream(fd);
+    } else {
+        done = true;
+    }
+}
+
+tlib::line_view::line_view(line_view&& rhs) : input(rhs.input), line(std::move(rhs.line)), error_code(rhs.error_code), started(rhs.started), done(rhs.done) {
+    rhs.input = nullptr;
+    rhs.done = true;
+}
+
+tlib::line_view::~line_view(){
+    if(input){
+        delete input;
+    }
+}
+
+tlib::line_iterator tlib::line_view::begin(){
+    if(!started){
+        started = true;
+        next();
+    }
+
+    return {*this, false};
+}
+
+tlib::line_iterator tlib::line_view::end(){
+    return {*this, true};
+}
+
+size_t tlib::line_view::error() const {
+    return error_code;
+}
+
+void tlib::line_view::next(){
+    if(done){
+        return;
+    }
+
+    auto read = input->read_line(line);
+
+    if(!read){
+        error_code = read.error();
+        done = true;
+    } else if(!*read){
+        done = true;
+    }
+}
+
+tlib::line_iterator::line_iterator(line_view& view, bool end) : view(view), end(end) {}
+
+const std::string& tlib::line_iterator::operator*() const {
+    return view.line;
+}
+
+tlib::line_iterator& tlib::line_iterator::operator++(){
+    view.next();
+
+    return *this;
+}
+
+bool tlib::line_iterator::operator==(const line_iterator& rhs) const {
+    return (end || view.done) == (rhs.end || rhs.view.done);
+}
+
+bool tlib::line_iterator::operator!=(const line_iterator& rhs) const {
+    return !(*this == rhs);
+}
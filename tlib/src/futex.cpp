@@ -0,0 +1,40 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/futex.hpp"
+
+std::expected<void> tlib::futex_wait(volatile uint32_t* address, uint32_t value) {
+    return futex_wait(address, value, 0);
+}
+
+std::expected<void> tlib::futex_wait(volatile uint32_t* address, uint32_t value, size_t ms) {
+    int64_t code;
+    asm volatile("mov rax, 0xD; mov rbx, %[address]; mov r10, %[value]; mov rdx, %[ms]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [address] "g"(reinterpret_cast<size_t>(address)), [value] "g"(size_t(value)), [ms] "g"(ms)
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
+
+std::expected<size_t> tlib::futex_wake(volatile uint32_t* address, size_t n) {
+    int64_t code;
+    asm volatile("mov rax, 0xE; mov rbx, %[address]; mov r10, %[n]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [address] "g"(reinterpret_cast<size_t>(address)), [n] "g"(n)
+                 : "rax", "rbx", "r10", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
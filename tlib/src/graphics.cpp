@@ -11,10 +11,10 @@ namespace {
 
 uint64_t syscall_get(uint64_t call){
     size_t value;
-    asm volatile("mov rax, %[call]; int 50; mov %[value], rax"
+    asm volatile("mov rax, %[call]; syscall; mov %[value], rax"
         : [value] "=m" (value)
         : [call] "r" (call)
-        : "rax");
+        : "rax", "rcx", "r11");
     return value;
 }
 
@@ -53,10 +53,38 @@ uint64_t tlib::graphics::get_blue_shift(){
 }
 
 void tlib::graphics::redraw(char* buffer){
-    asm volatile("mov rax, 0xC08; mov rbx, %[buffer]; int 50;"
+    asm volatile("mov rax, 0xC08; mov rbx, %[buffer]; syscall;"
         :
         : [buffer] "g" (buffer)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
+}
+
+std::expected<uint32_t*> tlib::graphics::map_buffer(){
+    int64_t code;
+    asm volatile("mov rax, 0xC09; syscall; mov %[code], rax;"
+        : [code] "=m" (code)
+        :
+        : "rax", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_unexpected<uint32_t*, size_t>(-code);
+    } else {
+        return reinterpret_cast<uint32_t*>(code);
+    }
+}
+
+std::expected<void> tlib::graphics::present(size_t x, size_t y, size_t w, size_t h){
+    int64_t code;
+    asm volatile("mov rax, 0xC0A; mov rbx, %[x]; mov r10, %[y]; mov rdx, %[w]; mov rsi, %[h]; syscall; mov %[code], rax;"
+        : [code] "=m" (code)
+        : [x] "g" (x), [y] "g" (y), [w] "g" (w), [h] "g" (h)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
 }
 
 uint64_t tlib::graphics::mouse_x(){
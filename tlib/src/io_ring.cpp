@@ -0,0 +1,101 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/io_ring.hpp"
+
+std::expected<tlib::ring_page*> tlib::io_ring_setup() {
+    int64_t code;
+    asm volatile("mov rax, 0x323; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 :
+                 : "rax", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<ring_page*, size_t>(-code);
+    } else {
+        return reinterpret_cast<ring_page*>(code);
+    }
+}
+
+std::expected<size_t> tlib::io_ring_enter(size_t n, size_t wait, size_t ms) {
+    int64_t code;
+    asm volatile("mov rax, 0x324; mov rbx, %[n]; mov r10, %[wait]; mov rdx, %[ms]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [n] "g"(n), [wait] "g"(wait), [ms] "g"(ms)
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+bool tlib::io_ring::init() {
+    auto rings = io_ring_setup();
+
+    if (!rings) {
+        return false;
+    }
+
+    page = *rings;
+
+    return true;
+}
+
+tlib::ring_submission* tlib::io_ring::submission() {
+    auto tail = page->submission_tail;
+
+    if (tail - __atomic_load_n(&page->submission_head, __ATOMIC_ACQUIRE) == RING_SUBMISSIONS) {
+        return nullptr;
+    }
+
+    return &page->submissions[tail % RING_SUBMISSIONS];
+}
+
+bool tlib::io_ring::prepare(ring_operation operation, size_t fd, size_t address, size_t length, size_t offset, size_t data) {
+    auto* entry = submission();
+
+    if (!entry) {
+        return false;
+    }
+
+    entry->operation = operation;
+    entry->fd        = fd;
+    entry->address   = address;
+    entry->length    = length;
+    entry->offset    = offset;
+    entry->data      = data;
+
+    // The entry is complete before the kernel sees the new tail
+    __atomic_store_n(&page->submission_tail, page->submission_tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+std::expected<size_t> tlib::io_ring::submit(size_t wait, size_t ms) {
+    return io_ring_enter(RING_SUBMISSIONS, wait, ms);
+}
+
+const tlib::ring_completion* tlib::io_ring::completion() const {
+    auto head = page->completion_head;
+
+    if (head == __atomic_load_n(&page->completion_tail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+
+    return &page->completions[head % RING_COMPLETIONS];
+}
+
+void tlib::io_ring::consume() {
+    // The entry is read before the kernel can reuse it
+    __atomic_store_n(&page->completion_head, page->completion_head + 1, __ATOMIC_RELEASE);
+}
+
+size_t tlib::io_ring::completions() const {
+    return __atomic_load_n(&page->completion_tail, __ATOMIC_ACQUIRE) - page->completion_head;
+}
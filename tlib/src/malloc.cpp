@@ -5,82 +5,226 @@
 //  http://www.opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <lock_guard.hpp>
+
 #include "tlib/malloc.hpp"
+#include "tlib/alloc_profile.hpp"
+#include "tlib/sync.hpp"
 
 #define likely(x)    __builtin_expect (!!(x), 1)
 #define unlikely(x)  __builtin_expect (!!(x), 0)
 
+/*
+ * The small blocks are served from size-segregated bins, in constant time.
+ * A bin is refilled by carving a span taken from the central heap and its
+ * blocks are never given back to the central heap.
+ *
+ * The large blocks are served from the central heap, a free list ordered by
+ * address, whose free neighbours are coalesced. A large free chunk at the end
+ * of the heap is given back to the kernel.
+ *
+ * The bins form the cache of the thread. For now, all the threads share the
+ * same cache and a single lock protects the whole allocator, taken without
+ * entering the kernel when there is no contention.
+ *
+ * One allocation out of tlib::ALLOC_PROFILE_PERIOD is sampled in the
+ * allocation profile, read by the kernel. The site of a sampled block is kept
+ * in its header, so that freeing it does not need any lookup.
+ */
+
 namespace {
 
 bool init = false;
 
+tlib::mutex heap_lock; ///< The lock of the allocator, shared by the threads
+
 size_t _used = 0;
 size_t _allocated = 0;
 
-struct malloc_header_chunk {
-    size_t size;
-    malloc_header_chunk* next;
-    malloc_header_chunk* prev;
-    size_t padding;
-};
-
-struct fake_head {
-    uint64_t size;
-    malloc_header_chunk* next;
-    malloc_header_chunk* prev;
-};
-
 constexpr size_t ALIGNMENT = 16;
 
 constexpr bool aligned(size_t value){
     return (value & (ALIGNMENT - 1)) == 0;
 }
 
-constexpr const uint64_t META_SIZE = sizeof(malloc_header_chunk);
-constexpr const uint64_t BLOCK_SIZE = 4096;
-constexpr const uint64_t MIN_BLOCKS = 4;
+constexpr size_t align(size_t value){
+    return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+/*!
+ * \brief The header in front of each block
+ */
+struct block_header {
+    size_t size; ///< The usable size of the block
+    size_t bin;  ///< The bin of a small block, LARGE_BIN for a large block
+};
+
+/*!
+ * \brief A free chunk of the central heap
+ */
+struct free_chunk {
+    size_t size;      ///< The usable size of the chunk
+    size_t bin;       ///< Always LARGE_BIN
+    free_chunk* next; ///< The next free chunk, by address
+    free_chunk* prev; ///< The previous free chunk, by address
+};
 
-constexpr const uint64_t MIN_SPLIT = ALIGNMENT == 8 ? 32 : 2 * ALIGNMENT;
+/*!
+ * \brief A free block of a bin
+ */
+struct free_block {
+    free_block* next; ///< The next free block of the bin
+};
 
-static_assert(aligned(sizeof(malloc_header_chunk)), "The header must be aligned");
-static_assert(aligned(MIN_SPLIT), "The size of minimum split must guarantee alignment");
+constexpr const size_t META_SIZE = sizeof(block_header);
+constexpr const size_t BLOCK_SIZE = 4096;
+constexpr const size_t MIN_BLOCKS = 4;
+
+constexpr const size_t BINS = 14;                   ///< The number of size classes
+constexpr const size_t LARGE_BIN = BINS;            ///< The bin of the large blocks
+constexpr const size_t MAX_SMALL = 2048;            ///< The size of the largest small block
+constexpr const size_t SPAN_SIZE = 16 * 1024;       ///< The size of the spans refilling the bins
+constexpr const size_t MIN_SPLIT = sizeof(free_chunk); ///< The minimum size of a large chunk
+constexpr const size_t TRIM_THRESHOLD = 64 * 1024;  ///< The size of free memory at the end of the heap given back to the kernel
+constexpr const size_t BIN_MASK = 0xFF;             ///< The bits of the bin in the header
+constexpr const size_t SITE_SHIFT = 8;              ///< The position of the site (plus one) of a sampled block in the header
+
+/*!
+ * \brief The sizes of the classes, about 1.5 times larger each time
+ */
+constexpr const size_t bin_sizes[BINS] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+
+static_assert(aligned(sizeof(block_header)), "The header must be aligned");
+static_assert(aligned(sizeof(free_chunk)), "The free chunk must be aligned");
+static_assert(bin_sizes[BINS - 1] == MAX_SMALL, "The last class must hold the largest small block");
+
+/*!
+ * \brief A bin of small blocks of the same size
+ */
+struct bin_t {
+    free_block* head; ///< The first free block
+};
 
-fake_head head;
-malloc_header_chunk* malloc_head = 0;
+/*!
+ * \brief The cache of small blocks of a thread
+ */
+struct thread_cache {
+    bin_t bins[BINS]; ///< The bin of each size class
+};
 
-//Insert new_block after current in the free list and update
-//all the necessary links
-void insert_after(malloc_header_chunk* current, malloc_header_chunk* new_block){
-    //Link the new block to its surroundings
-    new_block->next = current->next;
-    new_block->prev = current;
+thread_cache main_cache;
 
-    //Link surroundings to the new block
-    current->next->prev = new_block;
-    current->next = new_block;
+uint8_t bin_index[MAX_SMALL / ALIGNMENT + 1]; ///< The bin of each number of alignment units
+
+free_chunk central_head; ///< The sentinel of the free list of the central heap
+
+size_t heap_end = 0; ///< The end of the heap, as seen by the allocator
+
+tlib::alloc_profile profile;                          ///< The allocation profile of the program
+size_t countdown = tlib::ALLOC_PROFILE_PERIOD;       ///< The allocations before the next sample
+
+thread_cache& local_cache(){
+    return main_cache;
+}
+
+free_chunk* chunk_of(void* block){
+    return reinterpret_cast<free_chunk*>(reinterpret_cast<uintptr_t>(block) - META_SIZE);
+}
+
+uintptr_t chunk_end(const free_chunk* chunk){
+    return reinterpret_cast<uintptr_t>(chunk) + META_SIZE + chunk->size;
 }
 
-//Remove the given block from the free list
-//The node is directly marked as not free
-void remove(malloc_header_chunk* current){
-    //Unlink the node
+//Insert new_chunk after current in the free list and update
+//all the necessary links
+void insert_after(free_chunk* current, free_chunk* new_chunk){
+    //Link the new chunk to its surroundings
+    new_chunk->next = current->next;
+    new_chunk->prev = current;
+
+    //Link surroundings to the new chunk
+    current->next->prev = new_chunk;
+    current->next = new_chunk;
+}
+
+//Remove the given chunk from the free list
+void remove(free_chunk* current){
     current->prev->next = current->next;
     current->next->prev = current->prev;
 
-    //Make sure the node is clean
     current->prev = nullptr;
     current->next = nullptr;
 }
 
-bool expand_heap(malloc_header_chunk* current, size_t bytes = 0){
+/*!
+ * \brief Give a free chunk back to the central heap, merging it with its
+ * free neighbours
+ * \return The merged free chunk
+ */
+free_chunk* central_insert(free_chunk* chunk){
+    chunk->bin = LARGE_BIN;
+
+    //Find the last free chunk before this one
+    auto prev = &central_head;
+    while(prev->next != &central_head && prev->next < chunk){
+        prev = prev->next;
+    }
+
+    insert_after(prev, chunk);
+
+    //Merge with the following chunk
+    auto next = chunk->next;
+    if(next != &central_head && chunk_end(chunk) == reinterpret_cast<uintptr_t>(next)){
+        chunk->size += META_SIZE + next->size;
+        remove(next);
+    }
+
+    //Merge with the preceding chunk
+    if(prev != &central_head && chunk_end(prev) == reinterpret_cast<uintptr_t>(chunk)){
+        prev->size += META_SIZE + chunk->size;
+        remove(chunk);
+        chunk = prev;
+    }
+
+    return chunk;
+}
+
+/*!
+ * \brief Give the end of the heap back to the kernel if the given free chunk
+ * ends the heap and is large enough
+ */
+void central_trim(free_chunk* chunk){
+    if(chunk_end(chunk) != heap_end || chunk->size < TRIM_THRESHOLD){
+        return;
+    }
+
+    //The heap may have been extended behind the allocator
+    if(tlib::brk_end() != heap_end){
+        return;
+    }
+
+    //Keep the header and a minimal chunk in place
+    auto keep = (reinterpret_cast<uintptr_t>(chunk) + META_SIZE + MIN_SPLIT + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+
+    auto new_end = tlib::brk_release(heap_end - keep);
+
+    if(new_end == heap_end){
+        return;
+    }
+
+    _allocated -= heap_end - new_end;
+    heap_end = new_end;
+
+    chunk->size = new_end - reinterpret_cast<uintptr_t>(chunk) - META_SIZE;
+}
+
+bool expand_heap(size_t bytes){
     auto blocks = MIN_BLOCKS;
 
-    if(unlikely(bytes)){
-        auto necessary_blocks = ((bytes + META_SIZE) / BLOCK_SIZE) + 1;
+    auto necessary_blocks = ((bytes + META_SIZE) / BLOCK_SIZE) + 1;
 
-        if(necessary_blocks > blocks){
-            blocks = necessary_blocks;
-        }
+    if(necessary_blocks > blocks){
+        blocks = necessary_blocks;
     }
 
     //Allocate a new block of memory
@@ -91,146 +235,283 @@ bool expand_heap(malloc_header_chunk* current, size_t bytes = 0){
         return false;
     }
 
-    auto real_blocks = (brk_end - old_end) / BLOCK_SIZE;
+    _allocated += brk_end - old_end;
+    heap_end = brk_end;
 
-    _allocated += real_blocks * BLOCK_SIZE;
+    //Transform it into a free chunk
+    auto chunk = reinterpret_cast<free_chunk*>(old_end);
+    chunk->size = brk_end - old_end - META_SIZE;
 
-    //Transform it into a malloc chunk
-    auto header = reinterpret_cast<malloc_header_chunk*>(old_end);
-
-    //Update the size
-    header->size = real_blocks * BLOCK_SIZE - META_SIZE;
-
-    //Insert the new block into the free list
-    insert_after(current, header);
+    central_insert(chunk);
 
     return true;
 }
 
-void init_head(){
-    head.size = 0;
-    head.next = nullptr;
-    head.prev = nullptr;
+/*!
+ * \brief Allocate a chunk of the given size (aligned) from the central heap
+ * \return The chunk, nullptr if there is no more memory
+ */
+free_chunk* central_allocate(size_t bytes){
+    while(true){
+        for(auto current = central_head.next; current != &central_head; current = current->next){
+            if(current->size < bytes){
+                continue;
+            }
+
+            //Is it worth splitting the chunk ?
+            if(current->size >= bytes + META_SIZE + MIN_SPLIT){
+                auto new_chunk = reinterpret_cast<free_chunk*>(reinterpret_cast<uintptr_t>(current) + META_SIZE + bytes);
 
-    malloc_head = reinterpret_cast<malloc_header_chunk*>(&head);
-    malloc_head->next = malloc_head;
-    malloc_head->prev = malloc_head;
+                new_chunk->size = current->size - bytes - META_SIZE;
+                new_chunk->bin = LARGE_BIN;
 
-    expand_heap(malloc_head);
+                insert_after(current, new_chunk);
 
-    init = true;
+                current->size = bytes;
+            }
+
+            remove(current);
+
+            return current;
+        }
+
+        //There are no chunks big enough to hold this request
+        if(!expand_heap(bytes)){
+            return nullptr;
+        }
+    }
 }
 
-} //end of anonymous namespace
+/*!
+ * \brief Fill the given bin with the blocks of a new span
+ * \return true if the bin has been refilled, false otherwise
+ */
+bool refill(bin_t& bin, size_t index){
+    auto size = bin_sizes[index];
+    auto stride = META_SIZE + size;
+    auto count = SPAN_SIZE / stride;
 
-void* tlib::malloc(size_t bytes){
-    if(unlikely(!init)){
-        init_head();
+    auto span = central_allocate(count * stride - META_SIZE);
+
+    if(!span){
+        return false;
     }
 
-    auto current = malloc_head->next;
+    auto start = reinterpret_cast<uintptr_t>(span);
+
+    //The span may be slightly larger than requested
+    count = (META_SIZE + span->size) / stride;
 
-    //Try not to create too small blocks
-    if(bytes < MIN_SPLIT){
-        bytes = MIN_SPLIT;
+    for(size_t i = count; i > 0; --i){
+        auto header = reinterpret_cast<block_header*>(start + (i - 1) * stride);
+
+        header->size = size;
+        header->bin = index;
+
+        auto block = reinterpret_cast<free_block*>(start + (i - 1) * stride + META_SIZE);
+        block->next = bin.head;
+        bin.head = block;
     }
 
-    //Make sure that blocks will have the correct alignment at the end
-    if(!aligned(bytes)){
-        bytes = ((bytes / ALIGNMENT) + 1) * ALIGNMENT;
+    return true;
+}
+
+/*!
+ * \brief Account the given block in the profile of the caller
+ */
+void sample(void* block, void* caller){
+    auto address = reinterpret_cast<uint64_t>(caller);
+
+    size_t index = 0;
+    while(index < profile.sites && profile.site[index].caller != address){
+        ++index;
     }
 
-    while(true){
-        if(current == malloc_head){
-            //There are no blocks big enough to hold this request
-            //So expand the heap
-            expand_heap(current, bytes);
-        } else if(current->size >= bytes){
-            //This block is big enough
+    if(index == profile.sites){
+        if(index == tlib::ALLOC_PROFILE_SITES){
+            return;
+        }
 
-            //Space necessary to hold a new block inside this one
-            auto necessary_space = bytes + META_SIZE;
+        profile.site[index].caller = address;
+        ++profile.sites;
+    }
 
-            //Is it worth splitting the block ?
-            if(current->size > necessary_space + MIN_SPLIT + META_SIZE){
-                auto new_block_size = current->size - necessary_space;
+    auto chunk = chunk_of(block);
 
-                //Set the new size of the current block
-                current->size = bytes;
+    auto& site = profile.site[index];
+    ++site.samples;
+    ++site.live_blocks;
+    site.live_bytes += chunk->size;
+
+    chunk->bin |= (index + 1) << SITE_SHIFT;
+}
 
-                //Create a new block inside the current one
-                auto new_block = reinterpret_cast<malloc_header_chunk*>(
-                    reinterpret_cast<uintptr_t>(current) + bytes + META_SIZE);
+/*!
+ * \brief Remove the sampled block from the profile
+ */
+void unsample(free_chunk* chunk){
+    auto& site = profile.site[(chunk->bin >> SITE_SHIFT) - 1];
+    --site.live_blocks;
+    site.live_bytes -= chunk->size;
 
-                //Update the size of the new block
-                new_block->size = new_block_size;
+    chunk->bin &= BIN_MASK;
+}
 
-                //Add the new block to the free list
-                insert_after(current, new_block);
+void init_heap(){
+    central_head.size = 0;
+    central_head.bin = LARGE_BIN;
+    central_head.next = &central_head;
+    central_head.prev = &central_head;
 
-                //Remove the current block from the free list
-                remove(current);
+    size_t index = 0;
+    for(size_t units = 0; units <= MAX_SMALL / ALIGNMENT; ++units){
+        while(bin_sizes[index] < units * ALIGNMENT){
+            ++index;
+        }
 
-                break;
-            } else {
-                //Remove this node from the free list
-                remove(current);
+        bin_index[units] = index;
+    }
 
-                break;
-            }
+    heap_end = tlib::brk_end();
+
+    profile.period = tlib::ALLOC_PROFILE_PERIOD;
+    profile.sites = 0;
+    tlib::register_alloc_profile(&profile);
+
+    init = true;
+}
+
+void* allocate(size_t bytes){
+    if(likely(bytes <= MAX_SMALL)){
+        auto index = bin_index[(bytes + ALIGNMENT - 1) / ALIGNMENT];
+        auto& bin = local_cache().bins[index];
+
+        if(unlikely(!bin.head) && !refill(bin, index)){
+            return nullptr;
         }
 
-        current = current->next;
+        auto block = bin.head;
+        bin.head = block->next;
+
+        _used += bin_sizes[index] + META_SIZE;
+
+        return block;
     }
 
-    _used += current->size + META_SIZE;
+    auto chunk = central_allocate(align(bytes));
+
+    if(!chunk){
+        return nullptr;
+    }
+
+    chunk->bin = LARGE_BIN;
+
+    _used += chunk->size + META_SIZE;
 
     //Address of the start of the block
-    auto block_start = reinterpret_cast<uintptr_t>(current) + sizeof(malloc_header_chunk);
+    return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(chunk) + META_SIZE);
+}
+
+void* allocate(size_t bytes, void* caller){
+    std::lock_guard<tlib::mutex> l(heap_lock);
+
+    if(unlikely(!init)){
+        init_heap();
+    }
+
+    auto block = allocate(bytes);
+
+    if(unlikely(!--countdown)){
+        countdown = tlib::ALLOC_PROFILE_PERIOD;
+
+        if(block){
+            sample(block, caller);
+        }
+    }
+
+    return block;
+}
 
-    return reinterpret_cast<void*>(block_start);
+} //end of anonymous namespace
+
+void* tlib::malloc(size_t bytes){
+    return allocate(bytes, __builtin_return_address(0));
 }
 
 void tlib::free(void* block){
-    auto free_header = reinterpret_cast<malloc_header_chunk*>(
-        reinterpret_cast<uintptr_t>(block) - sizeof(malloc_header_chunk));
+    if(unlikely(!block)){
+        return;
+    }
+
+    std::lock_guard<tlib::mutex> l(heap_lock);
+
+    auto chunk = chunk_of(block);
+
+    if(unlikely(chunk->bin > BIN_MASK)){
+        unsample(chunk);
+    }
 
     //Less memory is used
-    _used -= free_header->size + META_SIZE;
+    _used -= chunk->size + META_SIZE;
+
+    if(likely(chunk->bin < BINS)){
+        auto& bin = local_cache().bins[chunk->bin];
+
+        auto node = static_cast<free_block*>(block);
+        node->next = bin.head;
+        bin.head = node;
+
+        return;
+    }
 
-    //Add the freed block in the free list
-    insert_after(malloc_head, free_header);
+    central_trim(central_insert(chunk));
 }
 
 size_t tlib::brk_start(){
     size_t value;
-    asm volatile("mov rax, 7; int 50; mov %[brk_start], rax"
+    asm volatile("mov rax, 7; syscall; mov %[brk_start], rax"
         : [brk_start] "=m" (value)
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
     return value;
 }
 
 size_t tlib::brk_end(){
     size_t value;
-    asm volatile("mov rax, 8; int 50; mov %[brk_end], rax"
+    asm volatile("mov rax, 8; syscall; mov %[brk_end], rax"
         : [brk_end] "=m" (value)
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
     return value;
 }
 
 size_t tlib::sbrk(size_t inc){
     size_t value;
-    asm volatile("mov rax, 9; mov rbx, %[brk_inc]; int 50; mov %[brk_end], rax"
+    asm volatile("mov rax, 9; mov rbx, %[brk_inc]; syscall; mov %[brk_end], rax"
         : [brk_end] "=m" (value)
         : [brk_inc] "g" (inc)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
     return value;
 }
 
+size_t tlib::brk_release(size_t dec){
+    size_t value;
+    asm volatile("mov rax, 0xB; mov rbx, %[brk_dec]; syscall; mov %[brk_end], rax"
+        : [brk_end] "=m" (value)
+        : [brk_dec] "g" (dec)
+        : "rax", "rbx", "rcx", "r11");
+    return value;
+}
+
+void tlib::register_alloc_profile(alloc_profile* profile){
+    asm volatile("mov rax, 0xC; mov rbx, %[profile]; syscall;"
+        : //No outputs
+        : [profile] "g" (reinterpret_cast<size_t>(profile))
+        : "rax", "rbx", "rcx", "r11");
+}
+
 void* operator new(uint64_t size){
-    return tlib::malloc(size);
+    return allocate(size, __builtin_return_address(0));
 }
 
 void operator delete(void* p){
@@ -238,7 +519,7 @@ void operator delete(void* p){
 }
 
 void* operator new[](uint64_t size){
-    return tlib::malloc(size);
+    return allocate(size, __builtin_return_address(0));
 }
 
 void operator delete[](void* p){
@@ -7,13 +7,21 @@
 #include "tlib/net.hpp"
 #include "tlib/malloc.hpp"
 
+#include <algorithms.hpp>
+
+namespace {
+
+constexpr size_t header_room = 128; ///< The room for the headers of the protocols, before the payload
+
+} // end of anonymous namespace
+
 tlib::packet::packet()
-        : fd(0), payload(nullptr), index(0) {
+        : fd(0), payload(nullptr), index(0), mapped(false) {
     //Nothing else to init
 }
 
 tlib::packet::packet(packet&& rhs)
-        : fd(rhs.fd), payload(rhs.payload), index(rhs.index) {
+        : fd(rhs.fd), payload(rhs.payload), index(rhs.index), mapped(rhs.mapped) {
     rhs.payload = nullptr;
 }
 
@@ -22,6 +30,7 @@ tlib::packet& tlib::packet::operator=(packet&& rhs) {
         this->fd      = rhs.fd;
         this->payload = rhs.payload;
         this->index   = rhs.index;
+        this->mapped  = rhs.mapped;
 
         rhs.payload = nullptr;
     }
@@ -30,17 +39,18 @@ tlib::packet& tlib::packet::operator=(packet&& rhs) {
 }
 
 tlib::packet::~packet() {
-    if (payload) {
+    // The mapped buffers belong to the kernel
+    if (payload && !mapped) {
         tlib::free(payload);
     }
 }
 
 std::expected<size_t> tlib::socket_open(socket_domain domain, socket_type type, socket_protocol protocol) {
     int64_t fd;
-    asm volatile("mov rax, 0xB00; mov rbx, %[domain]; mov rcx, %[type]; mov rdx, %[protocol]; int 50; mov %[fd], rax"
+    asm volatile("mov rax, 0xB00; mov rbx, %[domain]; mov r10, %[type]; mov rdx, %[protocol]; syscall; mov %[fd], rax"
                  : [fd] "=m"(fd)
                  : [domain] "g"(static_cast<size_t>(domain)), [type] "g"(static_cast<size_t>(type)), [protocol] "g"(static_cast<size_t>(protocol))
-                 : "rax", "rbx", "rcx", "rdx");
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if (fd < 0) {
         return std::make_expected_from_error<size_t, size_t>(-fd);
@@ -50,10 +60,10 @@ std::expected<size_t> tlib::socket_open(socket_domain domain, socket_type type,
 }
 
 void tlib::socket_close(size_t fd) {
-    asm volatile("mov rax, 0xB01; mov rbx, %[fd]; int 50;"
+    asm volatile("mov rax, 0xB01; mov rbx, %[fd]; syscall;"
                  : /* No outputs */
                  : [fd] "g"(fd)
-                 : "rax", "rbx");
+                 : "rax", "rbx", "rcx", "r11");
 }
 
 std::expected<tlib::packet> tlib::prepare_packet(size_t socket_fd, void* desc) {
@@ -61,10 +71,10 @@ std::expected<tlib::packet> tlib::prepare_packet(size_t socket_fd, void* desc) {
 
     int64_t fd;
     uint64_t index;
-    asm volatile("mov rax, 0xB02; mov rbx, %[socket]; mov rcx, %[desc]; mov rdx, %[buffer]; int 50; mov %[fd], rax; mov %[index], rbx;"
+    asm volatile("mov rax, 0xB02; mov rbx, %[socket]; mov r10, %[desc]; mov rdx, %[buffer]; syscall; mov %[fd], rax; mov %[index], rbx;"
                  : [fd] "=m"(fd), [index] "=m"(index)
                  : [socket] "g"(socket_fd), [desc] "g"(reinterpret_cast<size_t>(desc)), [buffer] "g"(reinterpret_cast<size_t>(buffer))
-                 : "rax", "rbx", "rcx", "rdx");
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if (fd < 0) {
         free(buffer);
@@ -78,14 +88,49 @@ std::expected<tlib::packet> tlib::prepare_packet(size_t socket_fd, void* desc) {
     }
 }
 
+std::expected<void> tlib::map_packet_buffers(size_t socket_fd) {
+    int64_t code;
+    asm volatile("mov rax, 0xB22; mov rbx, %[socket]; syscall; mov %[code], rax"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd)
+                 : "rax", "rbx", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_expected_from_error<void, size_t>(-code);
+    } else {
+        return std::make_expected();
+    }
+}
+
+std::expected<tlib::packet> tlib::prepare_mapped_packet(size_t socket_fd, void* desc) {
+    int64_t fd;
+    uint64_t index;
+    uint64_t payload;
+    asm volatile("mov rax, 0xB23; mov rbx, %[socket]; mov r10, %[desc]; syscall; mov %[fd], rax; mov %[index], rbx; mov %[payload], rdx;"
+                 : [fd] "=m"(fd), [index] "=m"(index), [payload] "=m"(payload)
+                 : [socket] "g"(socket_fd), [desc] "g"(reinterpret_cast<size_t>(desc))
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
+
+    if (fd < 0) {
+        return std::make_expected_from_error<tlib::packet, size_t>(-fd);
+    } else {
+        tlib::packet p;
+        p.fd      = fd;
+        p.index   = index;
+        p.payload = reinterpret_cast<char*>(payload);
+        p.mapped  = true;
+        return std::make_expected<packet>(std::move(p));
+    }
+}
+
 std::expected<void> tlib::finalize_packet(size_t socket_fd, const tlib::packet& p) {
     auto packet_fd = p.fd;
 
     int64_t code;
-    asm volatile("mov rax, 0xB03; mov rbx, %[socket]; mov rcx, %[packet]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB03; mov rbx, %[socket]; mov r10, %[packet]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [packet] "g"(packet_fd)
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_expected_from_error<void, size_t>(-code);
@@ -95,13 +140,13 @@ std::expected<void> tlib::finalize_packet(size_t socket_fd, const tlib::packet&
 }
 
 std::expected<void> tlib::send(size_t socket_fd, const char* buffer, size_t n) {
-    auto* target_buffer = new char[2048];
+    auto* target_buffer = new char[n + header_room];
 
     int64_t code;
-    asm volatile("mov rax, 0xB0B; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[n]; mov rsi, %[target_buffer]; int 50; mov %[code], rax;"
+    asm volatile("mov rax, 0xB0B; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[n]; mov rsi, %[target_buffer]; syscall; mov %[code], rax;"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [n] "g" (n), [target_buffer] "g"(reinterpret_cast<size_t>(target_buffer))
-                 : "rax", "rbx", "rcx", "rdx", "rsi");
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     delete[] target_buffer;
 
@@ -113,13 +158,13 @@ std::expected<void> tlib::send(size_t socket_fd, const char* buffer, size_t n) {
 }
 
 std::expected<void> tlib::send_to(size_t socket_fd, const char* buffer, size_t n, void* address) {
-    auto* target_buffer = new char[2048];
+    auto* target_buffer = new char[n + header_room];
 
     int64_t code;
-    asm volatile("mov rax, 0xB13; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[n]; mov rsi, %[target_buffer]; mov rdi, %[address]; int 50; mov %[code], rax;"
+    asm volatile("mov rax, 0xB13; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[n]; mov rsi, %[target_buffer]; mov rdi, %[address]; syscall; mov %[code], rax;"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [n] "g" (n), [target_buffer] "g"(reinterpret_cast<size_t>(target_buffer)), [address] "g"(reinterpret_cast<size_t>(address))
-                 : "rax", "rbx", "rcx", "rdx", "rsi", "rdi");
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rdi", "rcx", "r11");
 
     delete[] target_buffer;
 
@@ -130,12 +175,64 @@ std::expected<void> tlib::send_to(size_t socket_fd, const char* buffer, size_t n
     }
 }
 
+std::expected<void> tlib::sendv(size_t socket_fd, const iovec* vectors, size_t n) {
+    int64_t code;
+    asm volatile("mov rax, 0xB19; mov rbx, %[socket]; mov r10, %[vectors]; mov rdx, %[n]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [vectors] "g"(reinterpret_cast<size_t>(vectors)), [n] "g"(n)
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
+
+std::expected<size_t> tlib::send_to_batch(size_t socket_fd, message* messages, size_t n) {
+    // The packets are prepared one at a time in the same buffer
+    size_t largest = 0;
+    for (size_t i = 0; i < n && i < MAX_MESSAGES; ++i) {
+        largest = std::max(largest, messages[i].length);
+    }
+
+    auto* target_buffer = new char[largest + header_room];
+
+    int64_t code;
+    asm volatile("mov rax, 0xB1A; mov rbx, %[socket]; mov r10, %[messages]; mov rdx, %[n]; mov rsi, %[target_buffer]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [messages] "g"(reinterpret_cast<size_t>(messages)), [n] "g"(n), [target_buffer] "g"(reinterpret_cast<size_t>(target_buffer))
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
+
+    delete[] target_buffer;
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+std::expected<size_t> tlib::sendfile(size_t socket_fd, size_t file_fd, size_t offset, size_t count) {
+    int64_t code;
+    asm volatile("mov rax, 0xB18; mov rbx, %[socket]; mov r10, %[file]; mov rdx, %[offset]; mov rsi, %[count]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [file] "g"(file_fd), [offset] "g"(offset), [count] "g"(count)
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
 std::expected<size_t> tlib::receive(size_t socket_fd, char* buffer, size_t n) {
     int64_t code;
-    asm volatile("mov rax, 0xB10; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[n]; int 50; mov %[code], rax;"
+    asm volatile("mov rax, 0xB10; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[n]; syscall; mov %[code], rax;"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [n] "g" (n)
-                 : "rax", "rbx", "rcx", "rdx");
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -146,10 +243,10 @@ std::expected<size_t> tlib::receive(size_t socket_fd, char* buffer, size_t n) {
 
 std::expected<size_t> tlib::receive(size_t socket_fd, char* buffer, size_t n, size_t ms) {
     int64_t code;
-    asm volatile("mov rax, 0xB0C; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[n]; mov rsi, %[ms]; int 50; mov %[code], rax;"
+    asm volatile("mov rax, 0xB0C; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[n]; mov rsi, %[ms]; syscall; mov %[code], rax;"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [n] "g" (n), [ms] "g" (ms)
-                 : "rax", "rbx", "rcx", "rdx", "rsi");
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -160,10 +257,10 @@ std::expected<size_t> tlib::receive(size_t socket_fd, char* buffer, size_t n, si
 
 std::expected<size_t> tlib::receive_from(size_t socket_fd, char* buffer, size_t n, void* address) {
     int64_t code;
-    asm volatile("mov rax, 0xB11; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[n]; mov rsi, %[address]; int 50; mov %[code], rax;"
+    asm volatile("mov rax, 0xB11; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[n]; mov rsi, %[address]; syscall; mov %[code], rax;"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [n] "g" (n), [address] "g" (reinterpret_cast<size_t>(address))
-                 : "rax", "rbx", "rcx", "rdx", "rsi");
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -174,10 +271,38 @@ std::expected<size_t> tlib::receive_from(size_t socket_fd, char* buffer, size_t
 
 std::expected<size_t> tlib::receive_from(size_t socket_fd, char* buffer, size_t n, size_t ms, void* address) {
     int64_t code;
-    asm volatile("mov rax, 0xB12; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[n]; mov rsi, %[ms]; mov rdi, %[address]; int 50; mov %[code], rax;"
+    asm volatile("mov rax, 0xB12; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[n]; mov rsi, %[ms]; mov rdi, %[address]; syscall; mov %[code], rax;"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [n] "g" (n), [ms] "g" (ms), [address] "g" (reinterpret_cast<size_t>(address))
-                 : "rax", "rbx", "rcx", "rdx", "rsi", "rdi");
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rdi", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+std::expected<size_t> tlib::receive_from_batch(size_t socket_fd, message* messages, size_t n) {
+    int64_t code;
+    asm volatile("mov rax, 0xB1B; mov rbx, %[socket]; mov r10, %[messages]; mov rdx, %[n]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [messages] "g"(reinterpret_cast<size_t>(messages)), [n] "g"(n)
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+std::expected<size_t> tlib::receive_from_batch(size_t socket_fd, message* messages, size_t n, size_t ms) {
+    int64_t code;
+    asm volatile("mov rax, 0xB1C; mov rbx, %[socket]; mov r10, %[messages]; mov rdx, %[n]; mov rsi, %[ms]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [messages] "g"(reinterpret_cast<size_t>(messages)), [n] "g"(n), [ms] "g"(ms)
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -188,10 +313,24 @@ std::expected<size_t> tlib::receive_from(size_t socket_fd, char* buffer, size_t
 
 std::expected<void> tlib::listen(size_t socket_fd, bool l) {
     int64_t code;
-    asm volatile("mov rax, 0xB04; mov rbx, %[socket]; mov rcx, %[listen]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB04; mov rbx, %[socket]; mov r10, %[listen]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [listen] "g"(size_t(l))
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_expected_from_error<void, size_t>(-code);
+    } else {
+        return std::make_expected();
+    }
+}
+
+std::expected<void> tlib::set_non_blocking(size_t socket_fd, bool non_blocking) {
+    int64_t code;
+    asm volatile("mov rax, 0xB1D; mov rbx, %[socket]; mov r10, %[non_blocking]; syscall; mov %[code], rax"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [non_blocking] "g"(size_t(non_blocking))
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_expected_from_error<void, size_t>(-code);
@@ -200,12 +339,40 @@ std::expected<void> tlib::listen(size_t socket_fd, bool l) {
     }
 }
 
+std::expected<void> tlib::set_buffer_size(size_t socket_fd, socket_buffer buffer, size_t size) {
+    int64_t code;
+    asm volatile("mov rax, 0xB20; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[size]; syscall; mov %[code], rax"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [buffer] "g"(static_cast<size_t>(buffer)), [size] "g"(size)
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_expected_from_error<void, size_t>(-code);
+    } else {
+        return std::make_expected();
+    }
+}
+
+std::expected<size_t> tlib::get_buffer_size(size_t socket_fd, socket_buffer buffer) {
+    int64_t code;
+    asm volatile("mov rax, 0xB21; mov rbx, %[socket]; mov r10, %[buffer]; syscall; mov %[code], rax"
+                 : [code] "=m"(code)
+                 : [socket] "g"(socket_fd), [buffer] "g"(static_cast<size_t>(buffer))
+                 : "rax", "rbx", "r10", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_expected_from_error<size_t, size_t>(-code);
+    } else {
+        return std::make_expected<size_t>(code);
+    }
+}
+
 std::expected<size_t> tlib::client_bind(size_t socket_fd, tlib::ip::address server) {
     int64_t code;
-    asm volatile("mov rax, 0xB07; mov rbx, %[socket]; mov rcx, %[ip]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB07; mov rbx, %[socket]; mov r10, %[ip]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [ip] "g" (size_t(server.raw_address))
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -216,10 +383,10 @@ std::expected<size_t> tlib::client_bind(size_t socket_fd, tlib::ip::address serv
 
 std::expected<size_t> tlib::client_bind(size_t socket_fd, tlib::ip::address server, size_t port) {
     int64_t code;
-    asm volatile("mov rax, 0xB0D; mov rbx, %[socket]; mov rcx, %[ip]; mov rdx, %[port]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB0D; mov rbx, %[socket]; mov r10, %[ip]; mov rdx, %[port]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [ip] "g" (size_t(server.raw_address)), [port] "g" (port)
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -230,10 +397,10 @@ std::expected<size_t> tlib::client_bind(size_t socket_fd, tlib::ip::address serv
 
 std::expected<void> tlib::server_bind(size_t socket_fd, tlib::ip::address server) {
     int64_t code;
-    asm volatile("mov rax, 0xB0E; mov rbx, %[socket]; mov rcx, %[ip]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB0E; mov rbx, %[socket]; mov r10, %[ip]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [ip] "g" (size_t(server.raw_address))
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<void, size_t>(-code);
@@ -244,10 +411,10 @@ std::expected<void> tlib::server_bind(size_t socket_fd, tlib::ip::address server
 
 std::expected<void> tlib::server_bind(size_t socket_fd, tlib::ip::address server, size_t port) {
     int64_t code;
-    asm volatile("mov rax, 0xB0F; mov rbx, %[socket]; mov rcx, %[ip]; mov rdx, %[port]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB0F; mov rbx, %[socket]; mov r10, %[ip]; mov rdx, %[port]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [ip] "g" (size_t(server.raw_address)), [port] "g" (port)
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<void, size_t>(-code);
@@ -258,10 +425,10 @@ std::expected<void> tlib::server_bind(size_t socket_fd, tlib::ip::address server
 
 std::expected<void> tlib::client_unbind(size_t socket_fd) {
     int64_t code;
-    asm volatile("mov rax, 0xB0A; mov rbx, %[socket]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB0A; mov rbx, %[socket]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd)
-                 : "rax", "rbx");
+                 : "rax", "rbx", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<void, size_t>(-code);
@@ -272,10 +439,10 @@ std::expected<void> tlib::client_unbind(size_t socket_fd) {
 
 std::expected<size_t> tlib::connect(size_t socket_fd, tlib::ip::address server, size_t port) {
     int64_t code;
-    asm volatile("mov rax, 0xB08; mov rbx, %[socket]; mov rcx, %[ip]; mov rdx, %[port]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB08; mov rbx, %[socket]; mov r10, %[ip]; mov rdx, %[port]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [ip] "g"(size_t(server.raw_address)), [port] "g"(port)
-                 : "rax", "rbx", "rcx", "rdx");
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -284,12 +451,12 @@ std::expected<size_t> tlib::connect(size_t socket_fd, tlib::ip::address server,
     }
 }
 
-std::expected<void> tlib::server_start(size_t socket_fd, tlib::ip::address server, size_t port) {
+std::expected<void> tlib::server_start(size_t socket_fd, tlib::ip::address server, size_t port, size_t backlog) {
     int64_t code;
-    asm volatile("mov rax, 0xB14; mov rbx, %[socket]; mov rcx, %[ip]; mov rdx, %[port]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB14; mov rbx, %[socket]; mov r10, %[ip]; mov rdx, %[port]; mov rsi, %[backlog]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
-                 : [socket] "g"(socket_fd), [ip] "g"(size_t(server.raw_address)), [port] "g"(port)
-                 : "rax", "rbx", "rcx", "rdx");
+                 : [socket] "g"(socket_fd), [ip] "g"(size_t(server.raw_address)), [port] "g"(port), [backlog] "g"(backlog)
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<void, size_t>(-code);
@@ -300,10 +467,10 @@ std::expected<void> tlib::server_start(size_t socket_fd, tlib::ip::address serve
 
 std::expected<size_t> tlib::accept(size_t socket_fd) {
     int64_t code;
-    asm volatile("mov rax, 0xB16; mov rbx, %[socket]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB16; mov rbx, %[socket]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd)
-                 : "rax", "rbx");
+                 : "rax", "rbx", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -314,10 +481,10 @@ std::expected<size_t> tlib::accept(size_t socket_fd) {
 
 std::expected<size_t> tlib::accept(size_t socket_fd, size_t ms) {
     int64_t code;
-    asm volatile("mov rax, 0xB17; mov rbx, %[socket]; mov rcx, %[ms]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB17; mov rbx, %[socket]; mov r10, %[ms]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd), [ms] "g"(ms)
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<size_t, size_t>(-code);
@@ -328,10 +495,10 @@ std::expected<size_t> tlib::accept(size_t socket_fd, size_t ms) {
 
 std::expected<void> tlib::disconnect(size_t socket_fd) {
     int64_t code;
-    asm volatile("mov rax, 0xB09; mov rbx, %[socket]; int 50; mov %[code], rax"
+    asm volatile("mov rax, 0xB09; mov rbx, %[socket]; syscall; mov %[code], rax"
                  : [code] "=m"(code)
                  : [socket] "g"(socket_fd)
-                 : "rax", "rbx");
+                 : "rax", "rbx", "rcx", "r11");
 
     if (code < 0) {
         return std::make_unexpected<void, size_t>(-code);
@@ -345,10 +512,10 @@ std::expected<tlib::packet> tlib::wait_for_packet(size_t socket_fd) {
 
     int64_t code;
     uint64_t payload;
-    asm volatile("mov rax, 0xB05; mov rbx, %[socket]; mov rcx, %[buffer]; int 50; mov %[code], rax; mov %[payload], rbx;"
+    asm volatile("mov rax, 0xB05; mov rbx, %[socket]; mov r10, %[buffer]; syscall; mov %[code], rax; mov %[payload], rbx;"
                  : [payload] "=m"(payload), [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer))
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         free(buffer);
@@ -366,10 +533,10 @@ std::expected<tlib::packet> tlib::wait_for_packet(size_t socket_fd, size_t ms) {
 
     int64_t code;
     uint64_t payload;
-    asm volatile("mov rax, 0xB06; mov rbx, %[socket]; mov rcx, %[buffer]; mov rdx, %[ms]; int 50; mov %[code], rax; mov %[payload], rbx;"
+    asm volatile("mov rax, 0xB06; mov rbx, %[socket]; mov r10, %[buffer]; mov rdx, %[ms]; syscall; mov %[code], rax; mov %[payload], rbx;"
                  : [payload] "=m"(payload), [code] "=m"(code)
                  : [socket] "g"(socket_fd), [buffer] "g"(reinterpret_cast<size_t>(buffer)), [ms] "g"(ms)
-                 : "rax", "rbx", "rcx");
+                 : "rax", "rbx", "r10", "rcx", "r11");
 
     if (code < 0) {
         free(buffer);
@@ -398,12 +565,13 @@ tlib::socket::socket(socket_domain domain, socket_type type, socket_protocol pro
 }
 
 tlib::socket::socket(tlib::socket&& rhs)
-        : domain(rhs.domain), type(rhs.type), protocol(rhs.protocol), fd(rhs.fd), error_code(rhs.error_code), _connected(rhs._connected), _bound(rhs._bound) {
+        : domain(rhs.domain), type(rhs.type), protocol(rhs.protocol), fd(rhs.fd), error_code(rhs.error_code), _connected(rhs._connected), _bound(rhs._bound), _mapped(rhs._mapped) {
     // This needs to be done so that the rhs will not do anything on
     // destroy
     rhs.fd = 0;
     rhs._connected = false;
     rhs._bound = false;
+    rhs._mapped = false;
 }
 
 tlib::socket& tlib::socket::operator=(tlib::socket&& rhs){
@@ -415,12 +583,14 @@ tlib::socket& tlib::socket::operator=(tlib::socket&& rhs){
         this->error_code = rhs.error_code;
         this->_connected = rhs._connected;
         this->_bound     = rhs._bound;
+        this->_mapped    = rhs._mapped;
 
         // This needs to be done so that the rhs will not do anything on
         // destroy
         rhs.fd = 0;
         rhs._connected = false;
         rhs._bound = false;
+        rhs._mapped = false;
     }
 
     return *this;
@@ -479,6 +649,38 @@ void tlib::socket::listen(bool l) {
     }
 }
 
+void tlib::socket::set_non_blocking(bool non_blocking) {
+    if (!good() || !open()) {
+        return;
+    }
+
+    auto status = tlib::set_non_blocking(fd, non_blocking);
+    if (!status) {
+        error_code = status.error();
+    }
+}
+
+void tlib::socket::set_buffer_size(socket_buffer buffer, size_t size) {
+    if (!good() || !open()) {
+        return;
+    }
+
+    auto status = tlib::set_buffer_size(fd, buffer, size);
+    if (!status) {
+        error_code = status.error();
+    }
+}
+
+bool tlib::socket::map_packet_buffers() {
+    if (!good() || !open()) {
+        return false;
+    }
+
+    _mapped = bool(tlib::map_packet_buffers(fd));
+
+    return _mapped;
+}
+
 void tlib::socket::client_bind(tlib::ip::address server) {
     if (!good() || !open()) {
         return;
@@ -567,12 +769,12 @@ void tlib::socket::connect(tlib::ip::address server, size_t port) {
     }
 }
 
-void tlib::socket::server_start(tlib::ip::address server, size_t port) {
+void tlib::socket::server_start(tlib::ip::address server, size_t port, size_t backlog) {
     if (!good() || !open()) {
         return;
     }
 
-    auto status = tlib::server_start(fd, server, port);
+    auto status = tlib::server_start(fd, server, port, backlog);
     if (status) {
         _connected = true;
     } else {
@@ -615,7 +817,19 @@ tlib::socket tlib::socket::accept(size_t ms) {
 
     auto status = tlib::accept(fd, ms);
     if (status) {
-        //TODO
+        tlib::socket sock;
+
+        sock.fd = *status;
+
+        sock.domain   = domain;
+        sock.type     = type;
+        sock.protocol = protocol;
+
+        sock._connected = true;
+        sock._bound     = false;
+        sock.error_code = 0;
+
+        return std::move(sock);
     } else {
         error_code = status.error();
     }
@@ -646,7 +860,7 @@ tlib::packet tlib::socket::prepare_packet(void* desc) {
         return tlib::packet();
     }
 
-    auto packet = tlib::prepare_packet(fd, desc);
+    auto packet = _mapped ? tlib::prepare_mapped_packet(fd, desc) : tlib::prepare_packet(fd, desc);
 
     if (!packet) {
         error_code = packet.error();
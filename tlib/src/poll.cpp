@@ -0,0 +1,94 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/poll.hpp"
+
+namespace {
+
+std::expected<void> poll_control(size_t fd, tlib::poll_operation operation, const tlib::poll_event& event) {
+    int64_t code;
+    asm volatile("mov rax, 0xD02; mov rbx, %[fd]; mov r10, %[operation]; mov rdx, %[event]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [fd] "g"(fd), [operation] "g"(static_cast<size_t>(operation)), [event] "g"(reinterpret_cast<size_t>(&event))
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
+
+} //end of anonymous namespace
+
+std::expected<size_t> tlib::poll_create() {
+    int64_t code;
+    asm volatile("mov rax, 0xD00; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 :
+                 : "rax", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+std::expected<void> tlib::poll_close(size_t fd) {
+    int64_t code;
+    asm volatile("mov rax, 0xD01; mov rbx, %[fd]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [fd] "g"(fd)
+                 : "rax", "rbx", "rcx", "r11");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
+
+std::expected<void> tlib::poll_add(size_t fd, poll_target target, size_t target_fd, size_t events, size_t data) {
+    return poll_control(fd, poll_operation::ADD, {target, target_fd, events, data});
+}
+
+std::expected<void> tlib::poll_modify(size_t fd, poll_target target, size_t target_fd, size_t events, size_t data) {
+    return poll_control(fd, poll_operation::MODIFY, {target, target_fd, events, data});
+}
+
+std::expected<void> tlib::poll_remove(size_t fd, poll_target target, size_t target_fd) {
+    return poll_control(fd, poll_operation::REMOVE, {target, target_fd, 0, 0});
+}
+
+std::expected<size_t> tlib::poll_wait(size_t fd, poll_event* events, size_t n) {
+    int64_t code;
+    asm volatile("mov rax, 0xD03; mov rbx, %[fd]; mov r10, %[events]; mov rdx, %[n]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [fd] "g"(fd), [events] "g"(reinterpret_cast<size_t>(events)), [n] "g"(n)
+                 : "rax", "rbx", "r10", "rdx", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+std::expected<size_t> tlib::poll_wait(size_t fd, poll_event* events, size_t n, size_t ms) {
+    int64_t code;
+    asm volatile("mov rax, 0xD04; mov rbx, %[fd]; mov r10, %[events]; mov rdx, %[n]; mov rsi, %[ms]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [fd] "g"(fd), [events] "g"(reinterpret_cast<size_t>(events)), [n] "g"(n), [ms] "g"(ms)
+                 : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
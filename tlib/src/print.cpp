@@ -9,38 +9,25 @@
 
 #include "tlib/print.hpp"
 #include "tlib/file.hpp"
-
-namespace {
-
-size_t strlen(const char* c){
-    size_t s = 0;
-
-    while(*c++){
-        ++s;
-    }
-
-    return s;
-}
-
-} //end of anonymous namespace
+#include "tlib/stream.hpp"
 
 void tlib::print(char c){
-    tlib::write(2, &c, 1, 0);
+    out().put(c);
 }
 
 void tlib::print(const char* s){
-    tlib::write(2, s, strlen(s), 0);
+    out().write(s);
 }
 
 void tlib::print(const std::string& s){
-    tlib::write(2, s.c_str(), s.size(), 0);
+    out().write(s);
 }
 
 void log(const char* s){
-    asm volatile("mov rax, 2; mov rbx, %[s]; int 50"
+    asm volatile("mov rax, 2; mov rbx, %[s]; syscall"
         : //No outputs
         : [s] "g" (reinterpret_cast<size_t>(s))
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 }
 
 void tlib::print(uint8_t v){
@@ -77,21 +64,23 @@ void tlib::print(int64_t v){
 
 void tlib::set_canonical(bool can){
     size_t value = can;
-    asm volatile("mov rax, 0x20; mov rbx, %[value]; int 50;"
+    asm volatile("mov rax, 0x20; mov rbx, %[value]; syscall;"
         :
         : [value] "g" (value)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 }
 
 void tlib::set_mouse(bool m){
     size_t value = m;
-    asm volatile("mov rax, 0x21; mov rbx, %[value]; int 50;"
+    asm volatile("mov rax, 0x21; mov rbx, %[value]; syscall;"
         :
         : [value] "g" (value)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 }
 
 size_t tlib::read_input(char* buffer, size_t max){
+    out().flush();
+
     auto c = tlib::read(1, buffer, max, 0);
     if(c){
         return *c;
@@ -101,6 +90,8 @@ size_t tlib::read_input(char* buffer, size_t max){
 }
 
 size_t tlib::read_input(char* buffer, size_t max, size_t ms){
+    out().flush();
+
     auto c = tlib::read(1, buffer, max, 0, ms);
     if(c){
         return *c;
@@ -110,6 +101,8 @@ size_t tlib::read_input(char* buffer, size_t max, size_t ms){
 }
 
 std::keycode tlib::read_input_raw(){
+    out().flush();
+
     char value;
     auto c = tlib::read(1, &value, 1, 0);
     if(c){
@@ -124,6 +117,8 @@ std::keycode tlib::read_input_raw(){
 }
 
 std::keycode tlib::read_input_raw(size_t ms){
+    out().flush();
+
     char value;
     auto c = tlib::read(1, &value, 1, 0, ms);
     if(c){
@@ -137,28 +132,52 @@ std::keycode tlib::read_input_raw(size_t ms){
     }
 }
 
+size_t tlib::read_input_events(std::input_event* events, size_t max){
+    out().flush();
+
+    size_t read;
+    asm volatile("mov rax, 0x25; mov rbx, %[events]; mov r10, %[max]; syscall; mov %[read], rax"
+        : [read] "=m" (read)
+        : [events] "g" (reinterpret_cast<size_t>(events)), [max] "g" (max)
+        : "rax", "rbx", "r10", "rcx", "r11");
+    return read;
+}
+
+size_t tlib::read_input_events(std::input_event* events, size_t max, size_t ms){
+    out().flush();
+
+    size_t read;
+    asm volatile("mov rax, 0x26; mov rbx, %[events]; mov r10, %[max]; mov rdx, %[ms]; syscall; mov %[read], rax"
+        : [read] "=m" (read)
+        : [events] "g" (reinterpret_cast<size_t>(events)), [max] "g" (max), [ms] "g" (ms)
+        : "rax", "rbx", "r10", "rdx", "rcx", "r11");
+    return read;
+}
+
 void  tlib::clear(){
-    asm volatile("mov rax, 0x22; int 50;"
+    out().flush();
+
+    asm volatile("mov rax, 0x22; syscall;"
         : //No outputs
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
 }
 
 size_t tlib::get_columns(){
     size_t value;
-    asm volatile("mov rax, 0x23; int 50; mov %[columns], rax"
+    asm volatile("mov rax, 0x23; syscall; mov %[columns], rax"
         : [columns] "=m" (value)
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
     return value;
 }
 
 size_t tlib::get_rows(){
     size_t value;
-    asm volatile("mov rax, 0x24; int 50; mov %[rows], rax"
+    asm volatile("mov rax, 0x24; syscall; mov %[rows], rax"
         : [rows] "=m" (value)
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
     return value;
 }
 
@@ -192,6 +211,10 @@ void tlib::user_logf(const char* s, ...){
     va_end(va);
 }
 
+void tlib::log_result(const char* program, const char* name, const char* metric, uint64_t value){
+    user_logf("result|%s|%s|%s|%u", program, name, metric, value);
+}
+
 namespace tlib {
 
 #include "printf_def.hpp"
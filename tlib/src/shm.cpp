@@ -0,0 +1,64 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/shm.hpp"
+
+std::expected<void> tlib::shm_create(const char* name, size_t size) {
+    int64_t code;
+    asm volatile("mov rax, 0x325; mov rbx, %[name]; mov r10, %[size]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [name] "g"(reinterpret_cast<size_t>(name)), [size] "g"(size)
+                 : "rax", "rbx", "r10", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
+
+std::expected<void*> tlib::shm_map(const char* name, size_t& size) {
+    int64_t code;
+    asm volatile("mov rax, 0x326; mov rbx, %[name]; mov r10, %[size]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [name] "g"(reinterpret_cast<size_t>(name)), [size] "g"(reinterpret_cast<size_t>(&size))
+                 : "rax", "rbx", "r10", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<void*, size_t>(-code);
+    } else {
+        return reinterpret_cast<void*>(code);
+    }
+}
+
+std::expected<void> tlib::shm_unmap(void* address) {
+    int64_t code;
+    asm volatile("mov rax, 0x327; mov rbx, %[address]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [address] "g"(reinterpret_cast<size_t>(address))
+                 : "rax", "rbx", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
+
+std::expected<void> tlib::shm_remove(const char* name) {
+    int64_t code;
+    asm volatile("mov rax, 0x328; mov rbx, %[name]; syscall; mov %[code], rax;"
+                 : [code] "=m"(code)
+                 : [name] "g"(reinterpret_cast<size_t>(name))
+                 : "rax", "rbx", "rcx", "r11", "memory");
+
+    if (code < 0) {
+        return std::make_unexpected<void, size_t>(-code);
+    } else {
+        return {};
+    }
+}
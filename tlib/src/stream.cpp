@@ -0,0 +1,256 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <stdarg.h>
+
+#include <algorithms.hpp>
+
+#include "tlib/stream.hpp"
+#include "tlib/file.hpp"
+#include "tlib/print.hpp"
+
+namespace {
+
+// The standard streams are constant initialized, they can be used from
+// the global constructors and destructors of the programs
+tlib::stream standard_input(1, tlib::buffering::AUTO);
+tlib::stream standard_output(2, tlib::buffering::AUTO);
+tlib::stream standard_error(3, tlib::buffering::NONE);
+
+bool has_new_line(const char* s, size_t n){
+    for(size_t i = 0; i < n; ++i){
+        if(s[i] == '\n'){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} //end of anonymous namespace
+
+tlib::stream& tlib::in(){
+    return standard_input;
+}
+
+tlib::stream& tlib::out(){
+    return standard_output;
+}
+
+tlib::stream& tlib::err(){
+    return standard_error;
+}
+
+std::expected<size_t> tlib::stream::write(const char* s, size_t n){
+    if(reading){
+        // The bytes read ahead are dropped, the file position goes back to them
+        position -= end - start;
+        start = end = 0;
+        reading = false;
+    }
+
+    if(mode == buffering::AUTO){
+        resolve_mode();
+    }
+
+    // The large writes and the unbuffered streams go directly to the file
+    if(mode == buffering::NONE || n >= BUFFER_SIZE){
+        auto flushed = flush();
+        if(!flushed){
+            return std::make_unexpected<size_t>(flushed.error());
+        }
+
+        return write_direct(s, n);
+    }
+
+    if(end + n > BUFFER_SIZE){
+        auto flushed = flush();
+        if(!flushed){
+            return std::make_unexpected<size_t>(flushed.error());
+        }
+    }
+
+    std::copy_n(s, n, buffer + end);
+    end += n;
+
+    if(mode == buffering::LINE && has_new_line(s, n)){
+        auto flushed = flush();
+        if(!flushed){
+            return std::make_unexpected<size_t>(flushed.error());
+        }
+    }
+
+    return std::make_expected<size_t>(n);
+}
+
+std::expected<size_t> tlib::stream::write(const char* s){
+    return write(s, std::str_len(s));
+}
+
+std::expected<size_t> tlib::stream::write(const std::string& s){
+    return write(s.c_str(), s.size());
+}
+
+std::expected<size_t> tlib::stream::put(char c){
+    return write(&c, 1);
+}
+
+void tlib::stream::printf(const std::string& format, ...){
+    va_list va;
+    va_start(va, format);
+
+    write(tlib::vsprintf(format, va));
+
+    va_end(va);
+}
+
+std::expected<void> tlib::stream::flush(){
+    if(reading || !end){
+        return {};
+    }
+
+    auto written = write_direct(buffer, end);
+
+    end = 0;
+
+    if(!written){
+        return std::make_unexpected<void>(written.error());
+    }
+
+    return {};
+}
+
+std::expected<size_t> tlib::stream::read(char* destination, size_t max){
+    if(!reading){
+        auto flushed = flush();
+        if(!flushed){
+            return std::make_unexpected<size_t>(flushed.error());
+        }
+
+        reading = true;
+        start = end = 0;
+    }
+
+    if(start == end){
+        if(eof){
+            return std::make_expected<size_t>(0);
+        }
+
+        // The large reads go directly to the destination
+        if(max >= BUFFER_SIZE){
+            if(this == &in()){
+                out().flush();
+            }
+
+            auto read = tlib::read(fd, destination, max, position);
+
+            if(read){
+                position += *read;
+                eof = !*read;
+            }
+
+            return read;
+        }
+
+        auto filled = fill();
+        if(!filled){
+            return std::make_unexpected<size_t>(filled.error());
+        }
+    }
+
+    auto n = std::min(max, end - start);
+
+    std::copy_n(buffer + start, n, destination);
+    start += n;
+
+    return std::make_expected<size_t>(n);
+}
+
+std::expected<bool> tlib::stream::read_line(std::string& line){
+    line.clear();
+
+    if(!reading){
+        auto flushed = flush();
+        if(!flushed){
+            return std::make_unexpected<bool>(flushed.error());
+        }
+
+        reading = true;
+        start = end = 0;
+    }
+
+    bool content = false;
+
+    while(true){
+        if(start == end){
+            if(eof){
+                return std::make_expected<bool>(content);
+            }
+
+            auto filled = fill();
+            if(!filled){
+                return std::make_unexpected<bool>(filled.error());
+            }
+
+            continue;
+        }
+
+        content = true;
+
+        while(start < end){
+            auto c = buffer[start++];
+
+            if(c == '\n'){
+                return std::make_expected<bool>(true);
+            }
+
+            line += c;
+        }
+    }
+}
+
+std::expected<void> tlib::stream::fill(){
+    // The prompt is shown before waiting for the input
+    if(this == &in()){
+        out().flush();
+    }
+
+    auto read = tlib::read(fd, buffer, BUFFER_SIZE, position);
+
+    start = end = 0;
+
+    if(!read){
+        return std::make_unexpected<void>(read.error());
+    }
+
+    end = *read;
+    position += *read;
+    eof = !*read;
+
+    return {};
+}
+
+std::expected<size_t> tlib::stream::write_direct(const char* s, size_t n){
+    auto written = tlib::write(fd, s, n, position);
+
+    if(written){
+        position += *written;
+    }
+
+    return written;
+}
+
+void tlib::stream::resolve_mode(){
+    auto info = tlib::stat(fd);
+
+    // A file that cannot be inspected is treated as a terminal
+    if(info && !(info->flags & tlib::STAT_FLAG_CHAR_DEVICE)){
+        mode = buffering::FULL;
+    } else {
+        mode = buffering::LINE;
+    }
+}
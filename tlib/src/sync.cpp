@@ -0,0 +1,129 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/sync.hpp"
+#include "tlib/futex.hpp"
+#include "tlib/errors.hpp"
+
+namespace {
+
+constexpr const uint32_t UNLOCKED  = 0; ///< Nobody holds the mutex
+constexpr const uint32_t LOCKED    = 1; ///< The mutex is held, nobody waits
+constexpr const uint32_t CONTENDED = 2; ///< The mutex is held, processes may wait
+
+uint32_t compare_exchange(volatile uint32_t* address, uint32_t expected, uint32_t desired){
+    __atomic_compare_exchange_n(address, &expected, desired, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    return expected;
+}
+
+} // end of anonymous namespace
+
+void tlib::mutex::lock(){
+    auto c = compare_exchange(&state, UNLOCKED, LOCKED);
+
+    if(c == UNLOCKED){
+        return;
+    }
+
+    // The unlock of the holder must wake up a waiter from now on
+    if(c != CONTENDED){
+        c = __atomic_exchange_n(&state, CONTENDED, __ATOMIC_ACQUIRE);
+    }
+
+    while(c != UNLOCKED){
+        futex_wait(&state, CONTENDED);
+        c = __atomic_exchange_n(&state, CONTENDED, __ATOMIC_ACQUIRE);
+    }
+}
+
+bool tlib::mutex::try_lock(){
+    return compare_exchange(&state, UNLOCKED, LOCKED) == UNLOCKED;
+}
+
+void tlib::mutex::unlock(){
+    if(__atomic_exchange_n(&state, UNLOCKED, __ATOMIC_RELEASE) == CONTENDED){
+        futex_wake(&state, 1);
+    }
+}
+
+void tlib::condition_variable::wait(mutex& m){
+    auto current = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+
+    __atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+
+    m.unlock();
+
+    // A notification after the unlock changed the sequence, the wait returns right away
+    futex_wait(&sequence, current);
+
+    __atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+
+    m.lock();
+}
+
+bool tlib::condition_variable::wait_for(mutex& m, size_t ms){
+    auto current = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+
+    __atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+
+    m.unlock();
+
+    auto status = futex_wait(&sequence, current, ms);
+
+    __atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+
+    m.lock();
+
+    return status || status.error() != std::ERROR_TIMEOUT;
+}
+
+void tlib::condition_variable::notify_one(){
+    __atomic_add_fetch(&sequence, 1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&waiters, __ATOMIC_SEQ_CST)){
+        futex_wake(&sequence, 1);
+    }
+}
+
+void tlib::condition_variable::notify_all(){
+    __atomic_add_fetch(&sequence, 1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&waiters, __ATOMIC_SEQ_CST)){
+        futex_wake(&sequence, size_t(-1));
+    }
+}
+
+void tlib::semaphore::acquire(){
+    while(!try_acquire()){
+        __atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+
+        // Only blocks while the value is still zero
+        futex_wait(&value, 0);
+
+        __atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+bool tlib::semaphore::try_acquire(){
+    auto current = __atomic_load_n(&value, __ATOMIC_RELAXED);
+
+    while(current){
+        if(__atomic_compare_exchange_n(&value, &current, current - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void tlib::semaphore::release(){
+    __atomic_add_fetch(&value, 1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&waiters, __ATOMIC_SEQ_CST)){
+        futex_wake(&value, 1);
+    }
+}
@@ -6,30 +6,51 @@
 //=======================================================================
 
 #include "tlib/system.hpp"
+#include "tlib/time_page.hpp"
+#include "tlib/stream.hpp"
 
 namespace {
 
 uint64_t syscall_get(uint64_t call){
     size_t value;
-    asm volatile("mov rax, %[call]; int 50; mov %[value], rax"
+    asm volatile("mov rax, %[call]; syscall; mov %[value], rax"
         : [value] "=m" (value)
         : [call] "r" (call)
-        : "rax");
+        : "rax", "rcx", "r11");
     return value;
 }
 
-} // end of anonymous namespace
+/*!
+ * \brief Read a value of the time page, consistent with the last update
+ */
+uint64_t time_page_read(volatile uint64_t tlib::time_page::* value){
+    auto& page = *reinterpret_cast<const tlib::time_page*>(tlib::TIME_PAGE_ADDRESS);
 
-void tlib::exit(size_t return_code) {
-    asm volatile("mov rax, 0x666; mov rbx, %[ret]; int 50"
-        : //No outputs
-        : [ret] "g" (return_code)
-        : "rax", "rbx");
+    while(true){
+        auto sequence = page.sequence;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
 
-    __builtin_unreachable();
+        auto result = page.*value;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if(!(sequence & 1) && sequence == page.sequence){
+            return result;
+        }
+    }
 }
 
-std::expected<size_t> tlib::exec(const char* executable, const std::vector<std::string>& params){
+uint64_t rdtsc(){
+    uint32_t low;
+    uint32_t high;
+    asm volatile("rdtsc" : "=a" (low), "=d" (high));
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+std::expected<size_t> exec_handles(const char* executable, const std::vector<std::string>& params, size_t flags, const size_t* handles){
+    // The output of the parent comes before the output of the child
+    tlib::out().flush();
+
     const char** args = nullptr;
     if(!params.empty()){
         args = new const char*[params.size()];
@@ -40,10 +61,10 @@ std::expected<size_t> tlib::exec(const char* executable, const std::vector<std::
     }
 
     int64_t pid;
-    asm volatile("mov rax, 5; mov rbx, %[path]; mov rcx, %[argc]; mov rdx, %[argv]; int 50; mov %[pid], rax"
+    asm volatile("mov rax, 5; mov rbx, %[path]; mov r10, %[argc]; mov rdx, %[argv]; mov rsi, %[flags]; mov rdi, %[handles]; syscall; mov %[pid], rax"
         : [pid] "=m" (pid)
-        : [path] "g" (reinterpret_cast<size_t>(executable)), [argc] "g" (params.size()), [argv] "g" (reinterpret_cast<size_t>(args))
-        : "rax", "rbx", "rcx", "rdx");
+        : [path] "g" (reinterpret_cast<size_t>(executable)), [argc] "g" (params.size()), [argv] "g" (reinterpret_cast<size_t>(args)), [flags] "g" (flags), [handles] "g" (reinterpret_cast<size_t>(handles))
+        : "rax", "rbx", "r10", "rdx", "rsi", "rdi", "rcx", "r11", "memory");
 
     if(args){
         delete[] args;
@@ -56,41 +77,136 @@ std::expected<size_t> tlib::exec(const char* executable, const std::vector<std::
     }
 }
 
+} // end of anonymous namespace
+
+void tlib::exit(size_t return_code) {
+    out().flush();
+
+    asm volatile("mov rax, 0x666; mov rbx, %[ret]; syscall"
+        : //No outputs
+        : [ret] "g" (return_code)
+        : "rax", "rbx", "rcx", "r11");
+
+    __builtin_unreachable();
+}
+
+std::expected<size_t> tlib::exec(const char* executable, const std::vector<std::string>& params, size_t flags){
+    return exec_handles(executable, params, flags, nullptr);
+}
+
+std::expected<size_t> tlib::exec(const char* executable, const std::vector<std::string>& params, size_t flags, const size_t (&handles)[3]){
+    return exec_handles(executable, params, flags, handles);
+}
+
+std::expected<size_t> tlib::fork(){
+    int64_t pid;
+
+    // The buffered output is not duplicated in the child
+    out().flush();
+
+    // The child does not get the SSE registers of its parent
+    asm volatile("mov rax, 0xA; syscall; mov %[pid], rax"
+        : [pid] "=m" (pid)
+        : //No inputs
+        : "rax", "rcx", "r11", "memory",
+          "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+          "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15");
+
+    if(pid < 0){
+        return std::make_expected_from_error<size_t, size_t>(-pid);
+    } else {
+        return std::make_expected<size_t>(pid);
+    }
+}
+
 void tlib::await_termination(size_t pid) {
-    asm volatile("mov rax, 6; mov rbx, %[pid]; int 50;"
+    asm volatile("mov rax, 6; mov rbx, %[pid]; syscall;"
         : //No outputs
         : [pid] "g" (pid)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 }
 
 void tlib::sleep_ms(size_t ms){
-    asm volatile("mov rax, 4; mov rbx, %[ms]; int 50"
+    asm volatile("mov rax, 4; mov rbx, %[ms]; syscall"
         : //No outputs
         : [ms] "g" (ms)
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
+}
+
+void tlib::yield(){
+    syscall_get(0x11);
 }
 
 tlib::datetime tlib::local_date(){
+    // The date is derived from the time page, without system call
+    auto offset = time_page_read(&tlib::time_page::epoch_offset);
+
+    if(offset){
+        return tlib::epoch_date(offset + ns_time());
+    }
+
     tlib::datetime date_s;
 
-    asm volatile("mov rax, 0x400; mov rbx, %[buffer]; int 50; "
+    asm volatile("mov rax, 0x400; mov rbx, %[buffer]; syscall; "
         : /* No outputs */
         : [buffer] "g" (reinterpret_cast<size_t>(&date_s))
-        : "rax", "rbx");
+        : "rax", "rbx", "rcx", "r11");
 
     return date_s;
 }
 
+size_t tlib::get_pid(){
+    return syscall_get(0x3);
+}
+
 uint64_t tlib::s_time(){
-    return syscall_get(0x401);
+    return time_page_read(&tlib::time_page::seconds);
 }
 
 uint64_t tlib::ms_time(){
-    return syscall_get(0x402);
+    return time_page_read(&tlib::time_page::milliseconds);
+}
+
+uint64_t tlib::ns_time(){
+    auto& page = *reinterpret_cast<const tlib::time_page*>(tlib::TIME_PAGE_ADDRESS);
+
+    while(true){
+        auto sequence = page.sequence;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        auto nanoseconds = page.nanoseconds;
+        auto base = page.tsc_base;
+        auto base_nanoseconds = page.tsc_nanoseconds;
+        auto mult = page.tsc_mult;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if((sequence & 1) || sequence != page.sequence){
+            continue;
+        }
+
+        if(!mult){
+            return nanoseconds;
+        }
+
+        auto delta = rdtsc() - base;
+
+        return base_nanoseconds + (delta >> 32) * mult + (((delta & 0xFFFFFFFF) * mult) >> 32);
+    }
 }
 
-std::expected<size_t> tlib::exec_and_wait(const char* executable, const std::vector<std::string>& params){
-    auto result = exec(executable, params);
+uint64_t tlib::cpu_features(){
+    auto& page = *reinterpret_cast<const tlib::time_page*>(tlib::TIME_PAGE_ADDRESS);
+
+    return page.cpu_features;
+}
+
+bool tlib::cpu_has(cpu_feature feature){
+    return cpu_features() & cpu_feature_bit(feature);
+}
+
+std::expected<size_t> tlib::exec_and_wait(const char* executable, const std::vector<std::string>& params, size_t flags){
+    auto result = exec(executable, params, flags);
 
     if(result.valid()){
         await_termination(result.value());
@@ -100,26 +216,40 @@ std::expected<size_t> tlib::exec_and_wait(const char* executable, const std::vec
 }
 
 void tlib::reboot(){
-    asm volatile("mov rax, 0x50; int 50"
+    asm volatile("mov rax, 0x50; syscall"
         : //No outputs
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
 
     __builtin_unreachable();
 }
 
 void tlib::shutdown(){
-    asm volatile("mov rax, 0x51; int 50"
+    asm volatile("mov rax, 0x51; syscall"
         : //No outputs
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
 
     __builtin_unreachable();
 }
 
+std::expected<void> tlib::snapshot_stats(stats_snapshot& snapshot){
+    int64_t code;
+    asm volatile("mov rax, 0x52; mov rbx, %[buffer]; mov r10, %[size]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [buffer] "g" (reinterpret_cast<size_t>(&snapshot)), [size] "g" (sizeof(stats_snapshot))
+        : "rax", "rbx", "r10", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_unexpected<void, size_t>(-code);
+    }
+
+    return {};
+}
+
 void tlib::alpha(){
-    asm volatile("mov rax, 0x66; int 50"
+    asm volatile("mov rax, 0x66; syscall"
         : //No outputs
         : //No inputs
-        : "rax");
+        : "rax", "rcx", "r11");
 }
@@ -0,0 +1,96 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include "tlib/thread.hpp"
+#include "tlib/system.hpp"
+
+namespace {
+
+/*!
+ * \brief The function of a thread, at the top of its stack
+ */
+struct start_block {
+    void (*fun)(void*); ///< The function to execute
+    void* data;         ///< The argument of the function
+};
+
+void thread_entry(start_block* start) __attribute__((noreturn));
+void thread_entry(start_block* start){
+    start->fun(start->data);
+
+    tlib::exit(0);
+}
+
+} // end of anonymous namespace
+
+std::expected<size_t> tlib::create_thread(size_t entry, size_t stack, size_t data, size_t tls){
+    int64_t code;
+    asm volatile("mov rax, 0xF; mov rbx, %[entry]; mov r10, %[stack]; mov rdx, %[data]; mov rsi, %[tls]; syscall; mov %[code], rax"
+        : [code] "=m" (code)
+        : [entry] "g" (entry), [stack] "g" (stack), [data] "g" (data), [tls] "g" (tls)
+        : "rax", "rbx", "r10", "rdx", "rsi", "rcx", "r11", "memory");
+
+    if(code < 0){
+        return std::make_unexpected<size_t, size_t>(-code);
+    } else {
+        return code;
+    }
+}
+
+void tlib::set_tls(void* base){
+    asm volatile("mov rax, 0x10; mov rbx, %[base]; syscall"
+        : //No outputs
+        : [base] "g" (reinterpret_cast<size_t>(base))
+        : "rax", "rbx", "rcx", "r11");
+}
+
+bool tlib::thread::start(void (*fun)(void*), void* data, size_t stack_size, void* tls){
+    if(pid || stack_size < sizeof(start_block) + 16){
+        return false;
+    }
+
+    stack = new char[stack_size];
+
+    // The function is read by the thread from its own stack
+    auto top = (reinterpret_cast<size_t>(stack) + stack_size - sizeof(start_block)) & ~size_t(15);
+    auto* block = reinterpret_cast<start_block*>(top);
+    block->fun = fun;
+    block->data = data;
+
+    auto result = create_thread(reinterpret_cast<size_t>(&thread_entry), top, top, reinterpret_cast<size_t>(tls));
+
+    if(!result){
+        delete[] stack;
+        stack = nullptr;
+        return false;
+    }
+
+    pid = *result;
+
+    return true;
+}
+
+void tlib::thread::join(){
+    if(!pid){
+        return;
+    }
+
+    await_termination(pid);
+
+    delete[] stack;
+
+    stack = nullptr;
+    pid = 0;
+}
+
+size_t tlib::thread::id() const {
+    return pid;
+}
+
+bool tlib::thread::joinable() const {
+    return pid;
+}
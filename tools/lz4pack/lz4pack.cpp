@@ -0,0 +1,162 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+// Host tool compressing the raw kernel into the image unpacked by the init
+// stage: a kernel_image::lz4_header followed by a single LZ4 block
+//
+// Usage: lz4pack <kernel.bin> <kernel.lz4>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "kernel_image.hpp"
+
+namespace {
+
+constexpr const size_t MIN_MATCH = 4;      ///< The shortest match of LZ4
+constexpr const size_t MF_LIMIT = 12;      ///< No match starts in the last bytes
+constexpr const size_t LAST_LITERALS = 5;  ///< The last bytes are always literals
+constexpr const size_t MAX_OFFSET = 65535; ///< The farthest match of LZ4
+constexpr const size_t HASH_BITS = 16;     ///< The size of the match finder table
+
+uint32_t read_32(const uint8_t* p){
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hash(uint32_t sequence){
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+void write_length(std::vector<uint8_t>& out, size_t length){
+    while(length >= 255){
+        out.push_back(255);
+        length -= 255;
+    }
+
+    out.push_back(length);
+}
+
+// Emit the literals since the anchor, followed by a match if length is not 0
+void write_sequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_length, size_t offset, size_t length){
+    auto match_code = length ? length - MIN_MATCH : 0;
+
+    out.push_back(((literal_length < 15 ? literal_length : 15) << 4) | (match_code < 15 ? match_code : 15));
+
+    if(literal_length >= 15){
+        write_length(out, literal_length - 15);
+    }
+
+    out.insert(out.end(), literals, literals + literal_length);
+
+    if(length){
+        out.push_back(offset & 0xFF);
+        out.push_back(offset >> 8);
+
+        if(match_code >= 15){
+            write_length(out, match_code - 15);
+        }
+    }
+}
+
+// Greedy compression with a single candidate per hash
+std::vector<uint8_t> compress(const std::vector<uint8_t>& in){
+    std::vector<uint8_t> out;
+    std::vector<uint32_t> table(1 << HASH_BITS, 0);
+
+    auto data = in.data();
+    auto n = in.size();
+
+    size_t ip = 0;
+    size_t anchor = 0;
+
+    auto match_start_limit = n > MF_LIMIT ? n - MF_LIMIT : 0;
+    auto match_end_limit = n > LAST_LITERALS ? n - LAST_LITERALS : 0;
+
+    while(ip < match_start_limit){
+        auto sequence = read_32(data + ip);
+        auto h = hash(sequence);
+
+        // The positions are stored plus one, zero is an empty slot
+        size_t candidate = table[h];
+        table[h] = ip + 1;
+
+        if(!candidate || ip - (candidate - 1) > MAX_OFFSET || read_32(data + candidate - 1) != sequence){
+            ++ip;
+            continue;
+        }
+
+        auto ref = candidate - 1;
+        auto length = MIN_MATCH;
+
+        while(ip + length < match_end_limit && data[ref + length] == data[ip + length]){
+            ++length;
+        }
+
+        write_sequence(out, data + anchor, ip - anchor, ip - ref, length);
+
+        ip += length;
+        anchor = ip;
+    }
+
+    write_sequence(out, data + anchor, n - anchor, 0, 0);
+
+    return out;
+}
+
+} //end of anonymous namespace
+
+int main(int argc, char** argv){
+    if(argc != 3){
+        fprintf(stderr, "Usage: lz4pack <kernel.bin> <kernel.lz4>\n");
+        return 1;
+    }
+
+    auto input = fopen(argv[1], "rb");
+    if(!input){
+        fprintf(stderr, "lz4pack: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> raw;
+
+    uint8_t buffer[65536];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), input)) > 0){
+        raw.insert(raw.end(), buffer, buffer + read);
+    }
+
+    fclose(input);
+
+    auto block = compress(raw);
+
+    kernel_image::lz4_header header;
+    header.magic = kernel_image::LZ4_MAGIC;
+    header.size = raw.size();
+    header.compressed_size = block.size();
+    header.reserved = 0;
+
+    auto output = fopen(argv[2], "wb");
+    if(!output){
+        fprintf(stderr, "lz4pack: cannot create %s\n", argv[2]);
+        return 1;
+    }
+
+    if(fwrite(&header, sizeof(header), 1, output) != 1 || fwrite(block.data(), 1, block.size(), output) != block.size()){
+        fprintf(stderr, "lz4pack: cannot write %s\n", argv[2]);
+        fclose(output);
+        return 1;
+    }
+
+    fclose(output);
+
+    printf("lz4pack: %zu bytes -> %zu bytes\n", raw.size(), sizeof(header) + block.size());
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#!/bin/sh
+#=======================================================================
+# Copyright Baptiste Wicht 2013-2016.
+# Distributed under the terms of the MIT License.
+# (See accompanying file LICENSE or copy at
+#  http://www.opensource.org/licenses/MIT)
+#=======================================================================
+
+# Compare the benchmark results of a serial log to a baseline
+#
+# Usage: compare.sh <log> <baseline>
+#        compare.sh --record <log> <baseline>
+#
+# The programs log each result as "result|program|name|metric|value".
+# The baseline has one "program|name|metric|value|threshold" line per
+# result, the threshold is the tolerated regression, in percent. The
+# metrics ending in _ns, _us or _ms are durations, the others are rates.
+#
+# --record writes the results of the log as the new baseline, with the
+# threshold given by BENCH_THRESHOLD (10% by default).
+
+record=0
+
+if [ "$1" = "--record" ]; then
+    record=1
+    shift
+fi
+
+if [ $# -ne 2 ]; then
+    echo "Usage: compare.sh [--record] <log> <baseline>"
+    exit 2
+fi
+
+log=$1
+baseline=$2
+
+if [ ! -f "$log" ]; then
+    echo "compare.sh: no log $log"
+    exit 2
+fi
+
+# The results of the log, the last value of a result wins
+results=$(tr -d '\r' < "$log" | sed -n 's/.*result|//p')
+
+if [ -z "$results" ]; then
+    echo "compare.sh: no result in $log"
+    exit 2
+fi
+
+if [ $record -eq 1 ]; then
+    {
+        echo "# program|name|metric|value|threshold (percent)"
+        echo "$results" | awk -F'|' -v threshold="${BENCH_THRESHOLD:-10}" '
+            { key = $1 "|" $2 "|" $3; if(!(key in values)) order[n++] = key; values[key] = $4 }
+            END { for(i = 0; i < n; ++i) print order[i] "|" values[order[i]] "|" threshold }'
+    } > "$baseline"
+
+    echo "compare.sh: recorded $(grep -vc '^#' "$baseline") results in $baseline"
+    exit 0
+fi
+
+if [ ! -f "$baseline" ]; then
+    echo "compare.sh: no baseline $baseline, record one with make bench_baseline"
+    exit 2
+fi
+
+echo "$results" | awk -F'|' '
+    NR == FNR { values[$1 "|" $2 "|" $3] = $4; next }
+
+    /^#/ || NF < 5 { next }
+
+    {
+        key = $1 "|" $2 "|" $3
+        base = $4
+        threshold = $5
+
+        if(!(key in values)){
+            printf "MISSING    %s\n", key
+            failed = 1
+            next
+        }
+
+        value = values[key]
+        duration = ($3 ~ /_(ns|us|ms)$/)
+
+        # The change in percent, positive when it is worse
+        change = base ? ((value - base) * 100) / base : 0
+        if(!duration){
+            change = -change
+        }
+
+        status = change > threshold ? "REGRESSION" : "ok"
+        if(change > threshold){
+            failed = 1
+        }
+
+        printf "%-10s %s: %s -> %s (%+.1f%%, threshold %s%%)\n", status, key, base, value, change, threshold
+    }
+
+    END { exit failed }' - "$baseline"
@@ -0,0 +1,65 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <vector.hpp>
+#include <algorithms.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr const size_t BYTES = 65536;  ///< The size of the buffers of copy_n and fill_n
+constexpr const size_t VALUES = 10000; ///< The number of values sorted
+
+void bench_copy(){
+    std::vector<char> source;
+    std::vector<char> destination;
+
+    source.resize(BYTES);
+    destination.resize(BYTES);
+
+    measure("copy_n (64KiB)", BYTES, [&](){
+        std::copy_n(source.begin(), BYTES, destination.begin());
+        escape(destination);
+    });
+}
+
+void bench_fill(){
+    std::vector<char> destination;
+    destination.resize(BYTES);
+
+    measure("fill_n (64KiB)", BYTES, [&](){
+        std::fill_n(destination.begin(), BYTES, 'Z');
+        escape(destination);
+    });
+}
+
+void bench_sort(const char* name, bool sorted){
+    std::vector<uint32_t> values;
+    values.resize(VALUES);
+
+    measure(name, VALUES, [&](){
+        uint32_t seed = 42;
+
+        for(size_t i = 0; i < VALUES; ++i){
+            seed = seed * 1103515245 + 12345;
+            values[i] = sorted ? i : seed >> 8;
+        }
+    }, [&](){
+        std::sort(values.begin(), values.end());
+        escape(values);
+    });
+}
+
+} //end of anonymous namespace
+
+void algorithm_benchmarks(){
+    bench_copy();
+    bench_fill();
+    bench_sort("sort (random)", false);
+    bench_sort("sort (sorted)", true);
+}
@@ -0,0 +1,62 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <time.h>
+
+#include <algorithms.hpp>
+
+#include "bench.hpp"
+
+void container_benchmarks();
+void string_benchmarks();
+void algorithm_benchmarks();
+
+namespace {
+
+bool csv = false; ///< Indicates if the results are printed as CSV
+
+} //end of anonymous namespace
+
+int main(int argc, char** argv){
+    csv = argc > 1 && !strcmp(argv[1], "--csv");
+
+    if(csv){
+        printf("name,ops,median_ns_op,p99_ns_op\n");
+    } else {
+        printf("%u warmup runs, %u measured runs, the durations are per operation\n", unsigned(WARMUP), unsigned(REPETITIONS));
+    }
+
+    container_benchmarks();
+    string_benchmarks();
+    algorithm_benchmarks();
+
+    return 0;
+}
+
+uint64_t now(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void report(const char* name, size_t ops, uint64_t* durations){
+    std::sort(durations, durations + REPETITIONS);
+
+    auto median = durations[REPETITIONS / 2];
+    auto p99 = durations[(REPETITIONS * 99) / 100];
+
+    // The durations per operation, with two decimals
+    auto median_op = (median * 100) / ops;
+    auto p99_op = (p99 * 100) / ops;
+
+    if(csv){
+        printf("%s,%lu,%lu.%02lu,%lu.%02lu\n", name, ops, median_op / 100, median_op % 100, p99_op / 100, p99_op % 100);
+    } else {
+        printf("%-36s median: %8lu.%02lu ns/op p99: %8lu.%02lu ns/op\n", name, median_op / 100, median_op % 100, p99_op / 100, p99_op % 100);
+    }
+}
@@ -0,0 +1,73 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <cstring>
+
+#include <types.hpp>
+
+constexpr const size_t WARMUP = 5;        ///< The number of runs before the measures
+constexpr const size_t REPETITIONS = 101; ///< The number of measured runs of each benchmark
+
+/*!
+ * \brief Returns the monotonic time, in nanoseconds
+ */
+uint64_t now();
+
+/*!
+ * \brief Report the measured durations of one benchmark
+ * \param name The name of the benchmark, stable across commits
+ * \param ops The number of operations of one run
+ * \param durations The REPETITIONS durations, in nanoseconds, sorted in place
+ */
+void report(const char* name, size_t ops, uint64_t* durations);
+
+/*!
+ * \brief Prevent the compiler from optimizing the value away
+ */
+template<typename T>
+inline void escape(T& value){
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*!
+ * \brief Run the functor WARMUP times, then measure REPETITIONS runs.
+ *
+ * The setup functor prepares the state of each run, outside of the measure.
+ *
+ * \param name The name of the benchmark, stable across commits
+ * \param ops The number of operations done by one run of the functor
+ */
+template<typename S, typename F>
+void measure(const char* name, size_t ops, S setup, F functor){
+    uint64_t durations[REPETITIONS];
+
+    for(size_t i = 0; i < WARMUP; ++i){
+        setup();
+        functor();
+    }
+
+    for(size_t i = 0; i < REPETITIONS; ++i){
+        setup();
+
+        auto start = now();
+        functor();
+        durations[i] = now() - start;
+    }
+
+    report(name, ops, durations);
+}
+
+/*!
+ * \brief Run the functor WARMUP times, then measure REPETITIONS runs
+ * \param name The name of the benchmark, stable across commits
+ * \param ops The number of operations done by one run of the functor
+ */
+template<typename F>
+void measure(const char* name, size_t ops, F functor){
+    measure(name, ops, [](){}, functor);
+}
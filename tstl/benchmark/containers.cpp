@@ -0,0 +1,74 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <vector.hpp>
+#include <deque.hpp>
+#include <list.hpp>
+#include <shared_ptr.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr const size_t VALUES = 10000; ///< The number of values of the containers
+
+template<typename C>
+void bench_push_back(const char* name){
+    C container;
+
+    measure(name, VALUES, [&](){ container.clear(); }, [&](){
+        for(size_t i = 0; i < VALUES; ++i){
+            container.push_back(i);
+        }
+
+        escape(container);
+    });
+}
+
+template<typename C>
+void bench_iteration(const char* name){
+    C container;
+
+    for(size_t i = 0; i < VALUES; ++i){
+        container.push_back(i);
+    }
+
+    measure(name, VALUES, [&](){
+        size_t sum = 0;
+
+        for(auto& value : container){
+            sum += value;
+        }
+
+        escape(sum);
+    });
+}
+
+void bench_shared_ptr(){
+    auto pointer = std::make_shared<size_t>(42);
+
+    measure("shared_ptr copy", VALUES, [&](){
+        for(size_t i = 0; i < VALUES; ++i){
+            auto copy = pointer;
+            escape(copy);
+        }
+    });
+}
+
+} //end of anonymous namespace
+
+void container_benchmarks(){
+    bench_push_back<std::vector<size_t>>("vector push_back");
+    bench_push_back<std::deque<size_t>>("deque push_back");
+    bench_push_back<std::list<size_t>>("list push_back");
+
+    bench_iteration<std::vector<size_t>>("vector iteration");
+    bench_iteration<std::deque<size_t>>("deque iteration");
+    bench_iteration<std::list<size_t>>("list iteration");
+
+    bench_shared_ptr();
+}
@@ -0,0 +1,88 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdarg>
+
+#include <string.hpp>
+
+#include "bench.hpp"
+
+// The formatting of the kernel and of tlib, kept apart from the C library
+namespace formatting {
+
+#include "printf_dec.hpp"
+#include "printf_def.hpp"
+
+void __printf(const std::string& /*formatted*/){
+    //Nothing to print
+}
+
+void __printf_raw(const char* /*formatted*/){
+    //Nothing to print
+}
+
+} //end of namespace formatting
+
+namespace {
+
+constexpr const size_t STRINGS = 10000; ///< The number of operations of the string benchmarks
+
+void bench_append(){
+    std::string value;
+
+    measure("string append", STRINGS, [&](){ value.clear(); }, [&](){
+        for(size_t i = 0; i < STRINGS; ++i){
+            value += 'a';
+        }
+
+        escape(value);
+    });
+}
+
+void bench_small(){
+    measure("string small construction", STRINGS, [&](){
+        for(size_t i = 0; i < STRINGS; ++i){
+            // Short enough for the small string optimization
+            std::string value("0123456789");
+            escape(value);
+        }
+    });
+}
+
+void bench_large(){
+    measure("string large construction", STRINGS, [&](){
+        for(size_t i = 0; i < STRINGS; ++i){
+            std::string value("0123456789012345678901234567890123456789");
+            escape(value);
+        }
+    });
+}
+
+void bench_sprintf(){
+    measure("sprintf integers", STRINGS, [&](){
+        for(size_t i = 0; i < STRINGS; ++i){
+            auto value = formatting::sprintf("%u %d %h", i, -int64_t(i), i);
+            escape(value);
+        }
+    });
+
+    measure("sprintf strings", STRINGS, [&](){
+        for(size_t i = 0; i < STRINGS; ++i){
+            auto value = formatting::sprintf("%s: %10s", "name", "value");
+            escape(value);
+        }
+    });
+}
+
+} //end of anonymous namespace
+
+void string_benchmarks(){
+    bench_append();
+    bench_small();
+    bench_large();
+    bench_sprintf();
+}
@@ -12,6 +12,7 @@
 #include <utility.hpp>
 #include <types.hpp>
 #include <enable_if.hpp>
+#include <memory_ops.hpp>
 
 namespace std {
 
@@ -42,31 +43,7 @@ void copy(InputIterator first, InputIterator last, OutputIterator d_first){
  * \param bytes The number of bytes
  */
 inline void memcpy(char* out, const char* in, size_t bytes){
-    if(!bytes){
-        return;
-    }
-
-    // Copy as much as possible 64 bits at at time
-    if(bytes >= 8){
-        auto* out64 = reinterpret_cast<uint64_t*>(out);
-        auto* in64 = reinterpret_cast<const uint64_t*>(in);
-
-        const size_t l = bytes / 8;
-
-        for(size_t i = 0; i < l; ++i){
-            out64[i] = in64[i];
-        }
-
-        bytes -= l * 8;
-        out += l * 8;
-        in += l * 8;
-    }
-
-    // Finish up byte by byte
-    while(bytes >= 1){
-        *out++ = *in++;
-        --bytes;
-    }
+    mem::copy(out, in, bytes);
 }
 
 /*!
@@ -120,29 +97,7 @@ void move_n(InputIterator in, size_t n, OutputIterator out){
  * \param bytes The number of bytes
  */
 inline void memclr(char* out, size_t bytes){
-    if(!bytes){
-        return;
-    }
-
-    // Copy as much as possible 64 bits at at time
-    if(bytes >= 8){
-        auto* out64 = reinterpret_cast<uint64_t*>(out);
-
-        const size_t l = bytes / 8;
-
-        for(size_t i = 0; i < l; ++i){
-            out64[i] = 0;
-        }
-
-        bytes -= l * 8;
-        out += l * 8;
-    }
-
-    // Finish up byte by byte
-    while(bytes >= 1){
-        *out++ = 0;
-        --bytes;
-    }
+    mem::fill(out, 0, bytes);
 }
 
 /*!
@@ -191,6 +146,8 @@ template<typename ForwardIterator, typename T, std::enable_if_t<std::is_integral
 void fill_n(ForwardIterator first, size_t count, const T& value){
     if(!value){
         memclr(reinterpret_cast<char*>(first), count * sizeof(decltype(*first)));
+    } else if(sizeof(decltype(*first)) == 1){
+        mem::fill(reinterpret_cast<char*>(first), value, count);
     } else {
         if(count > 0){
             *first = value;
@@ -305,6 +262,418 @@ constexpr const T& max(const T& a, const T& b){
     return a >= b ? a : b;
 }
 
+namespace sort_impl {
+
+constexpr const size_t INSERTION_THRESHOLD = 16; ///< The size under which the ranges are insertion sorted
+constexpr const size_t PARTIAL_MOVES       = 8;  ///< The moves allowed to finish a range that looks sorted
+
+/*!
+ * \brief The default ordering of the sort algorithms
+ */
+struct less {
+    template<typename T>
+    bool operator()(const T& a, const T& b) const {
+        return a < b;
+    }
+};
+
+template<typename It, typename Compare>
+void insertion_sort(It first, size_t n, Compare comp){
+    for(size_t i = 1; i < n; ++i){
+        auto value = std::move(*(first + i));
+
+        size_t hole = i;
+
+        while(hole && comp(value, *(first + (hole - 1)))){
+            *(first + hole) = std::move(*(first + (hole - 1)));
+            --hole;
+        }
+
+        *(first + hole) = std::move(value);
+    }
+}
+
+// Insertion sort giving up after a few moves, returns true if the range is sorted
+template<typename It, typename Compare>
+bool partial_insertion_sort(It first, size_t n, Compare comp){
+    size_t moves = 0;
+
+    for(size_t i = 1; i < n; ++i){
+        if(!comp(*(first + i), *(first + (i - 1)))){
+            continue;
+        }
+
+        auto value = std::move(*(first + i));
+
+        size_t hole = i;
+
+        while(hole && comp(value, *(first + (hole - 1)))){
+            *(first + hole) = std::move(*(first + (hole - 1)));
+            --hole;
+        }
+
+        *(first + hole) = std::move(value);
+
+        moves += i - hole;
+
+        if(moves > PARTIAL_MOVES){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename It, typename Compare>
+void sift_down(It first, size_t root, size_t n, Compare comp){
+    while(true){
+        size_t child = 2 * root + 1;
+
+        if(child >= n){
+            return;
+        }
+
+        if(child + 1 < n && comp(*(first + child), *(first + (child + 1)))){
+            ++child;
+        }
+
+        if(!comp(*(first + root), *(first + child))){
+            return;
+        }
+
+        std::swap(*(first + root), *(first + child));
+
+        root = child;
+    }
+}
+
+template<typename It, typename Compare>
+void make_heap(It first, size_t n, Compare comp){
+    for(size_t i = n / 2; i-- > 0;){
+        sift_down(first, i, n, comp);
+    }
+}
+
+template<typename It, typename Compare>
+void sort_heap(It first, size_t n, Compare comp){
+    for(size_t end = n; end > 1; --end){
+        std::swap(*first, *(first + (end - 1)));
+        sift_down(first, 0, end - 1, comp);
+    }
+}
+
+template<typename It, typename Compare>
+void heap_sort(It first, size_t n, Compare comp){
+    make_heap(first, n, comp);
+    sort_heap(first, n, comp);
+}
+
+// Move the median of the first, middle and last elements in first
+template<typename It, typename Compare>
+void median_of_three(It first, size_t n, Compare comp){
+    auto a = first + 1;
+    auto b = first + n / 2;
+    auto c = first + (n - 1);
+
+    if(comp(*b, *a)){
+        std::swap(*a, *b);
+    }
+
+    if(comp(*c, *b)){
+        std::swap(*b, *c);
+
+        if(comp(*b, *a)){
+            std::swap(*a, *b);
+        }
+    }
+
+    std::swap(*first, *b);
+}
+
+// Partition around the pivot in first, returns the final position of the pivot
+template<typename It, typename Compare>
+size_t partition(It first, size_t n, Compare comp, bool& swapped){
+    size_t left  = 1;
+    size_t right = n - 1;
+
+    swapped = false;
+
+    while(true){
+        while(left <= right && comp(*(first + left), *first)){
+            ++left;
+        }
+
+        while(left <= right && comp(*first, *(first + right))){
+            --right;
+        }
+
+        if(left >= right){
+            break;
+        }
+
+        std::swap(*(first + left), *(first + right));
+        swapped = true;
+
+        ++left;
+        --right;
+    }
+
+    std::swap(*first, *(first + right));
+
+    return right;
+}
+
+template<typename It, typename Compare>
+void introsort(It first, size_t n, Compare comp, size_t depth){
+    while(n > INSERTION_THRESHOLD){
+        // Too many levels, the pivots are not good enough
+        if(!depth){
+            heap_sort(first, n, comp);
+            return;
+        }
+
+        --depth;
+
+        median_of_three(first, n, comp);
+
+        bool swapped;
+        auto pivot = partition(first, n, comp, swapped);
+
+        size_t l = pivot;
+        size_t r = n - pivot - 1;
+
+        auto right = first + (pivot + 1);
+
+        if(l < n / 8 || r < n / 8){
+            // Break the patterns making the partitions unbalanced
+            if(l >= INSERTION_THRESHOLD){
+                std::swap(*first, *(first + l / 4));
+                std::swap(*(first + (l - 1)), *(first + (l - l / 4)));
+            }
+
+            if(r >= INSERTION_THRESHOLD){
+                std::swap(*right, *(right + r / 4));
+                std::swap(*(right + (r - 1)), *(right + (r - r / 4)));
+            }
+        } else if(!swapped){
+            // The range was already partitioned, it may already be sorted
+            if(partial_insertion_sort(first, l, comp) && partial_insertion_sort(right, r, comp)){
+                return;
+            }
+        }
+
+        // Recurse into the smaller side only, to bound the stack
+        if(l < r){
+            introsort(first, l, comp, depth);
+
+            first = right;
+            n = r;
+        } else {
+            introsort(right, r, comp, depth);
+
+            n = l;
+        }
+    }
+
+    insertion_sort(first, n, comp);
+}
+
+template<typename It, typename T, typename Compare>
+void merge_sort(It first, size_t n, T* buffer, Compare comp){
+    if(n <= INSERTION_THRESHOLD){
+        insertion_sort(first, n, comp);
+        return;
+    }
+
+    size_t half = n / 2;
+
+    merge_sort(first, half, buffer, comp);
+    merge_sort(first + half, n - half, buffer, comp);
+
+    // The two halves may already be in order
+    if(!comp(*(first + half), *(first + (half - 1)))){
+        return;
+    }
+
+    std::move_n(first, half, buffer);
+
+    // The left values win the ties, to keep the sort stable
+    size_t i = 0;
+    size_t j = half;
+    size_t k = 0;
+
+    while(i < half && j < n){
+        if(comp(*(first + j), buffer[i])){
+            *(first + k++) = std::move(*(first + j++));
+        } else {
+            *(first + k++) = std::move(buffer[i++]);
+        }
+    }
+
+    while(i < half){
+        *(first + k++) = std::move(buffer[i++]);
+    }
+}
+
+inline size_t log2(size_t n){
+    size_t log = 0;
+
+    while(n >>= 1){
+        ++log;
+    }
+
+    return log;
+}
+
+} //end of namespace sort_impl
+
+/*!
+ * \brief Sort the range [first, last) with the given comparator.
+ *
+ * This is an introsort: a quicksort with median of three pivots falling
+ * back to a heap sort when the recursion is too deep, with insertion sort
+ * for the small ranges. Unbalanced partitions are shuffled to break the
+ * patterns, and already partitioned ranges are checked for being sorted.
+ * The iterators must be random access.
+ */
+template<typename Iterator, typename Compare>
+void sort(Iterator first, Iterator last, Compare comp){
+    size_t n = last - first;
+
+    if(n > 1){
+        sort_impl::introsort(first, n, comp, 2 * sort_impl::log2(n));
+    }
+}
+
+/*!
+ * \brief Sort the range [first, last) in ascending order
+ */
+template<typename Iterator>
+void sort(Iterator first, Iterator last){
+    std::sort(first, last, sort_impl::less());
+}
+
+/*!
+ * \brief Sort the range [first, last) with the given comparator, keeping
+ * the order of the equivalent elements.
+ *
+ * This is a merge sort, with a temporary buffer of half the range. The
+ * values must be default constructible.
+ */
+template<typename Iterator, typename Compare>
+void stable_sort(Iterator first, Iterator last, Compare comp){
+    using value_type = typename std::iterator_traits<Iterator>::value_type;
+
+    size_t n = last - first;
+
+    if(n <= sort_impl::INSERTION_THRESHOLD){
+        sort_impl::insertion_sort(first, n, comp);
+        return;
+    }
+
+    auto buffer = new value_type[n / 2];
+
+    sort_impl::merge_sort(first, n, buffer, comp);
+
+    delete[] buffer;
+}
+
+/*!
+ * \brief Sort the range [first, last) in ascending order, keeping the
+ * order of the equivalent elements
+ */
+template<typename Iterator>
+void stable_sort(Iterator first, Iterator last){
+    std::stable_sort(first, last, sort_impl::less());
+}
+
+/*!
+ * \brief Sort the smallest middle - first elements of [first, last) in
+ * [first, middle), the order of the other elements is unspecified
+ */
+template<typename Iterator, typename Compare>
+void partial_sort(Iterator first, Iterator middle, Iterator last, Compare comp){
+    size_t k = middle - first;
+    size_t n = last - first;
+
+    if(!k){
+        return;
+    }
+
+    // Keep the k smallest elements in a max heap
+    sort_impl::make_heap(first, k, comp);
+
+    for(size_t i = k; i < n; ++i){
+        if(comp(*(first + i), *first)){
+            std::swap(*(first + i), *first);
+            sort_impl::sift_down(first, 0, k, comp);
+        }
+    }
+
+    sort_impl::sort_heap(first, k, comp);
+}
+
+/*!
+ * \brief Sort the smallest middle - first elements of [first, last) in
+ * ascending order in [first, middle)
+ */
+template<typename Iterator>
+void partial_sort(Iterator first, Iterator middle, Iterator last){
+    std::partial_sort(first, middle, last, sort_impl::less());
+}
+
+/*!
+ * \brief Put in nth the element that would be there if the range was
+ * sorted, with no greater element before and no smaller element after
+ */
+template<typename Iterator, typename Compare>
+void nth_element(Iterator first, Iterator nth, Iterator last, Compare comp){
+    size_t n      = last - first;
+    size_t target = nth - first;
+
+    if(target >= n){
+        return;
+    }
+
+    size_t depth = 2 * sort_impl::log2(n);
+
+    while(n > sort_impl::INSERTION_THRESHOLD){
+        if(!depth--){
+            sort_impl::heap_sort(first, n, comp);
+            return;
+        }
+
+        sort_impl::median_of_three(first, n, comp);
+
+        bool swapped;
+        auto pivot = sort_impl::partition(first, n, comp, swapped);
+
+        if(pivot == target){
+            return;
+        }
+
+        // Only continue in the side of the nth element
+        if(target < pivot){
+            n = pivot;
+        } else {
+            first = first + (pivot + 1);
+            n -= pivot + 1;
+            target -= pivot + 1;
+        }
+    }
+
+    sort_impl::insertion_sort(first, n, comp);
+}
+
+/*!
+ * \brief Put in nth the element that would be there if the range was
+ * sorted in ascending order
+ */
+template<typename Iterator>
+void nth_element(Iterator first, Iterator nth, Iterator last){
+    std::nth_element(first, nth, last, sort_impl::less());
+}
+
 } //end of namespace std
 
 #endif
@@ -0,0 +1,51 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <types.hpp>
+
+namespace std {
+
+/*!
+ * \brief The default allocator of the containers, using the general heap.
+ *
+ * The allocators are stateless, all their functions are static. The storage
+ * is returned uninitialized and the elements are constructed in place by the
+ * containers.
+ */
+template<typename T>
+struct heap_allocator {
+    using value_type = T; ///< The type of the allocated elements
+
+    /*!
+     * \brief The same allocator for another type of elements
+     */
+    template<typename U>
+    struct rebind {
+        using other = heap_allocator<U>; ///< The rebound allocator
+    };
+
+    /*!
+     * \brief Allocate uninitialized storage for n elements
+     */
+    static T* allocate(size_t n){
+        return reinterpret_cast<T*>(new char[n * sizeof(T)]);
+    }
+
+    /*!
+     * \brief Release the storage of n elements, allocated with allocate(n)
+     */
+    static void deallocate(T* ptr, size_t /*n*/){
+        delete[] reinterpret_cast<char*>(ptr);
+    }
+};
+
+} //end of namespace std
+
+#endif
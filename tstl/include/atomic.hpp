@@ -12,69 +12,195 @@
 
 namespace std {
 
-template<typename T>
-struct atomic;
+constexpr const size_t hardware_destructive_interference_size = 64; ///< The size of a cache line, written by a single processor at a time
+
+/*!
+ * \brief The ordering constraints of an atomic operation
+ */
+enum memory_order : int {
+    memory_order_relaxed = __ATOMIC_RELAXED, ///< No ordering, only the atomicity
+    memory_order_consume = __ATOMIC_CONSUME, ///< The dependent loads are ordered after the load
+    memory_order_acquire = __ATOMIC_ACQUIRE, ///< The accesses are ordered after the load
+    memory_order_release = __ATOMIC_RELEASE, ///< The accesses are ordered before the store
+    memory_order_acq_rel = __ATOMIC_ACQ_REL, ///< Both acquire and release
+    memory_order_seq_cst = __ATOMIC_SEQ_CST  ///< A single total order of all the operations
+};
 
-template<>
-struct atomic<bool> {
-    using value_type = uint64_t;
+/*!
+ * \brief Returns the order usable for the load of a failed compare exchange
+ */
+constexpr memory_order failure_order(memory_order order){
+    return order == memory_order_acq_rel ? memory_order_acquire
+        : order == memory_order_release ? memory_order_relaxed
+        : order;
+}
+
+/*!
+ * \brief An atomic value of an integral, boolean or pointer type T.
+ *
+ * By default, the operations are sequentially consistent, an explicit
+ * order can be given to each of them. The arithmetic operations are only
+ * valid for the integral types.
+ */
+template<typename T>
+struct atomic {
+    using value_type = T; ///< The type of the value
 
     atomic() = default;
 
     atomic(const atomic& rhs) = delete;
     atomic& operator=(const atomic& rhs) = delete;
 
-    explicit atomic(value_type value) : value(value) {}
+    /*!
+     * \brief Construct the atomic with the given value, it is not an atomic operation
+     */
+    constexpr atomic(value_type value) : value(value) {}
 
-    value_type load() const {
-        return __atomic_load_n(&value, __ATOMIC_CONSUME);
+    /*!
+     * \brief Returns the value
+     */
+    value_type load(memory_order order = memory_order_seq_cst) const {
+        return __atomic_load_n(&value, order);
     }
 
-    value_type operator=(bool new_value){
-        __atomic_store_n(&value, new_value, __ATOMIC_RELEASE);
+    /*!
+     * \brief Set the value
+     */
+    void store(value_type new_value, memory_order order = memory_order_seq_cst){
+        __atomic_store_n(&value, new_value, order);
+    }
 
-        return new_value;
+    /*!
+     * \brief Set the value and returns the previous one
+     */
+    value_type exchange(value_type new_value, memory_order order = memory_order_seq_cst){
+        return __atomic_exchange_n(&value, new_value, order);
     }
 
-private:
-    volatile bool value;
-};
+    /*!
+     * \brief Set the value to desired if it is expected, otherwise expected
+     * is set to the current value. It may fail spuriously.
+     * \return true if the value was set
+     */
+    bool compare_exchange_weak(value_type& expected, value_type desired, memory_order success, memory_order failure){
+        return __atomic_compare_exchange_n(&value, &expected, desired, true, success, failure);
+    }
 
-template<>
-struct atomic<uint64_t> {
-    using value_type = uint64_t;
+    /*!
+     * \brief Set the value to desired if it is expected, otherwise expected
+     * is set to the current value. It may fail spuriously.
+     * \return true if the value was set
+     */
+    bool compare_exchange_weak(value_type& expected, value_type desired, memory_order order = memory_order_seq_cst){
+        return compare_exchange_weak(expected, desired, order, failure_order(order));
+    }
 
-    atomic() = default;
+    /*!
+     * \brief Set the value to desired if it is expected, otherwise expected
+     * is set to the current value.
+     * \return true if the value was set
+     */
+    bool compare_exchange_strong(value_type& expected, value_type desired, memory_order success, memory_order failure){
+        return __atomic_compare_exchange_n(&value, &expected, desired, false, success, failure);
+    }
 
-    atomic(const atomic& rhs) = delete;
-    atomic& operator=(const atomic& rhs) = delete;
+    /*!
+     * \brief Set the value to desired if it is expected, otherwise expected
+     * is set to the current value.
+     * \return true if the value was set
+     */
+    bool compare_exchange_strong(value_type& expected, value_type desired, memory_order order = memory_order_seq_cst){
+        return compare_exchange_strong(expected, desired, order, failure_order(order));
+    }
+
+    /*!
+     * \brief Add to the value and returns the previous value
+     */
+    value_type fetch_add(value_type v, memory_order order = memory_order_seq_cst){
+        return __atomic_fetch_add(&value, v, order);
+    }
+
+    /*!
+     * \brief Subtract from the value and returns the previous value
+     */
+    value_type fetch_sub(value_type v, memory_order order = memory_order_seq_cst){
+        return __atomic_fetch_sub(&value, v, order);
+    }
 
-    explicit atomic(value_type value) : value(value) {}
+    /*!
+     * \brief And the value and returns the previous value
+     */
+    value_type fetch_and(value_type v, memory_order order = memory_order_seq_cst){
+        return __atomic_fetch_and(&value, v, order);
+    }
 
-    value_type load() const {
-        return __atomic_load_n(&value, __ATOMIC_CONSUME);
+    /*!
+     * \brief Or the value and returns the previous value
+     */
+    value_type fetch_or(value_type v, memory_order order = memory_order_seq_cst){
+        return __atomic_fetch_or(&value, v, order);
     }
 
-    value_type operator=(uint64_t new_value){
-        __atomic_store_n(&value, new_value, __ATOMIC_RELEASE);
+    /*!
+     * \brief Xor the value and returns the previous value
+     */
+    value_type fetch_xor(value_type v, memory_order order = memory_order_seq_cst){
+        return __atomic_fetch_xor(&value, v, order);
+    }
+
+    operator value_type() const {
+        return load();
+    }
+
+    value_type operator=(value_type new_value){
+        store(new_value);
 
         return new_value;
     }
 
     value_type operator++(){
-        auto new_value = __atomic_add_fetch(&value, 1, __ATOMIC_RELEASE);
-        return new_value;
+        return __atomic_add_fetch(&value, 1, memory_order_seq_cst);
     }
 
     value_type operator++(int){
-        auto new_value = __atomic_fetch_add(&value, 1, __ATOMIC_RELEASE);
-        return new_value;
+        return fetch_add(1);
+    }
+
+    value_type operator--(){
+        return __atomic_sub_fetch(&value, 1, memory_order_seq_cst);
+    }
+
+    value_type operator--(int){
+        return fetch_sub(1);
+    }
+
+    value_type operator+=(value_type v){
+        return __atomic_add_fetch(&value, v, memory_order_seq_cst);
+    }
+
+    value_type operator-=(value_type v){
+        return __atomic_sub_fetch(&value, v, memory_order_seq_cst);
     }
 
 private:
-    volatile uint64_t value;
+    volatile value_type value; ///< The value
 };
 
+/*!
+ * \brief Order the memory accesses around the fence
+ */
+inline void atomic_thread_fence(memory_order order){
+    __atomic_thread_fence(order);
+}
+
+/*!
+ * \brief Order the memory accesses with a signal handler, or an interrupt
+ * handler, running on the same thread
+ */
+inline void atomic_signal_fence(memory_order order){
+    __atomic_signal_fence(order);
+}
+
 } //end of namespace std
 
 #endif
@@ -13,21 +13,22 @@
 #include <algorithms.hpp>
 #include <new.hpp>
 #include <iterator.hpp>
+#include <allocator.hpp>
 
 namespace std {
 
-template <typename T>
+template <typename T, typename Allocator = heap_allocator<T>, size_t B = 16>
 struct deque;
 
-template <typename T>
+template <typename T, typename Container>
 struct deque_iterator {
-    using iterator_type   = deque_iterator<T>; ///< The iterator type
+    using iterator_type   = deque_iterator<T, Container>; ///< The iterator type
     using value_type      = T;                 ///< The value type
     using difference_type = int64_t;           ///< The difference type
     using pointer         = value_type*;       ///< The pointer type
     using reference       = value_type&;       ///< The reference type
 
-    deque_iterator(deque<T>* container, int64_t index)
+    deque_iterator(Container* container, int64_t index)
             : container(container), index(index) {
         // Nothing else to init
     }
@@ -105,10 +106,11 @@ struct deque_iterator {
         return index - rhs.index;
     }
 
-    friend struct deque<T>;
+    template <typename, typename, size_t>
+    friend struct deque;
 
 private:
-    deque<T>* container;
+    Container* container;
     int64_t index;
 };
 
@@ -120,22 +122,31 @@ private:
  *
  * Insertions at the front and at the back are done in O(1) and random access is
  * possible in O(1). Insertions at other positions is done in O(n).
+ *
+ * The elements are stored in blocks of B elements, the map of the blocks is
+ * what grows, the elements are never moved by the insertions and the
+ * removals at the ends and their references stay valid. The blocks emptied
+ * at one end are reused at the other end before the map grows, a deque used
+ * as a queue does not allocate once it reached its largest size.
  */
-template <typename T>
+template <typename T, typename Allocator, size_t B>
 struct deque {
     using value_type           = T;                 ///< The value type contained in the vector
+    using allocator_type       = Allocator;         ///< The allocator, rebound to allocate the blocks
     using pointer_type         = value_type*;       ///< The pointer type contained in the vector
     using size_type            = size_t;            ///< The size type
     using reference_type       = value_type&;       ///< The reference type
     using const_reference_type = const value_type&; ///< The const reference type
 
-    using iterator       = deque_iterator<T>;       ///< The iterator type
-    using const_iterator = deque_iterator<const T>; ///< The const iterator type
+    using iterator       = deque_iterator<T, deque>;             ///< The iterator type
+    using const_iterator = deque_iterator<const T, const deque>; ///< The const iterator type
 
     using reverse_iterator       = std::reverse_iterator<iterator>;       ///< The reverse iterator type
     using const_reverse_iterator = std::reverse_iterator<const_iterator>; ///< The const reverse iterator type
 
-    static constexpr const size_t block_elements = 16;                         ///< Number of entries per block
+    static_assert(B > 0, "The blocks must contain elements");
+
+    static constexpr const size_t block_elements = B;                          ///< Number of entries per block
     static constexpr const size_t block_size     = block_elements * sizeof(T); ///< Size of a block, in bytes
 
     /*!
@@ -198,7 +209,7 @@ struct deque {
         destruct_all();
 
         for(size_t i = 0; i < blocks; ++i){
-            deallocate(data[i]);
+            deallocate_block(data[i]);
         }
 
         delete[] data;
@@ -368,6 +379,8 @@ struct deque {
         }
 
         ++_size;
+
+        return front();
     }
 
     /*!
@@ -392,6 +405,8 @@ struct deque {
         }
 
         ++_size;
+
+        return front();
     }
 
     /*!
@@ -488,6 +503,13 @@ struct deque {
         return _size;
     }
 
+    /*!
+     * \brief Indicates if the deque is empty
+     */
+    bool empty() const {
+        return _size == 0;
+    }
+
     /*!
      * \brief Returns the current maximum size of the deque
      */
@@ -610,95 +632,165 @@ struct deque {
     }
 
 private:
-    static value_type* allocate(size_t n){
-        return reinterpret_cast<value_type*>(new char[n * sizeof(value_type)]);
+    /*!
+     * \brief The storage of a block, allocated as a single element
+     */
+    struct block_storage {
+        alignas(T) char bytes[block_size]; ///< The storage of the elements
+    };
+
+    using block_allocator = typename Allocator::template rebind<block_storage>::other; ///< The allocator of the blocks
+
+    static value_type* allocate_block(){
+        return reinterpret_cast<value_type*>(block_allocator::allocate(1));
     }
 
-    static void deallocate(value_type* ptr){
-        delete[] reinterpret_cast<char*>(ptr);
+    static void deallocate_block(value_type* ptr){
+        block_allocator::deallocate(reinterpret_cast<block_storage*>(ptr), 1);
+    }
+
+    /*!
+     * \brief Move the k first blocks of the map to its end
+     */
+    void rotate_blocks(size_t k){
+        reverse_blocks(0, k);
+        reverse_blocks(k, blocks);
+        reverse_blocks(0, blocks);
+    }
+
+    void reverse_blocks(size_t first, size_t last){
+        while (first + 1 < last) {
+            std::swap(data[first++], data[--last]);
+        }
+    }
+
+    static size_t blocks_for(size_t n){
+        return n % block_elements == 0 ? n / block_elements : (n / block_elements) + 1;
+    }
+
+    void allocate_map(size_t n){
+        blocks = blocks_for(n);
+
+        data = new T*[blocks];
+
+        for (size_t i = 0; i < blocks; ++i) {
+            data[i] = allocate_block();
+        }
     }
 
     void ensure_capacity_front(size_t n) {
-        auto capacity_front = first_element;
+        if (!data) {
+            allocate_map(n);
 
-        if (capacity_front < n) {
-            if (!data) {
-                blocks = n % block_elements == 0 ? n / block_elements : (n / block_elements) + 1;
+            first_element = blocks * block_elements - 1;
+            last_element  = blocks * block_elements - 1;
 
-                data = new T*[blocks];
+            return;
+        }
 
-                for (size_t i = 0; i < blocks; ++i) {
-                    data[i] = allocate(block_elements);
-                }
+        // An empty deque can start anywhere, the front has the most room at the end
+        if (!_size) {
+            first_element = blocks * block_elements - 1;
+            last_element  = blocks * block_elements - 1;
+        }
 
-                first_element = blocks * block_elements - 1;
-                last_element  = blocks * block_elements - 1;
-            } else {
-                auto expand_front = n - capacity_front;
-                auto new_blocks   = expand_front % block_elements == 0 ? expand_front / block_elements : (expand_front / block_elements) + 1;
+        auto capacity_front = first_element;
 
-                auto new_data = new T*[blocks + new_blocks];
+        if (capacity_front >= n) {
+            return;
+        }
 
-                for (size_t i = 0; i < blocks; ++i) {
-                    new_data[i + new_blocks] = data[i];
-                }
+        auto needed = blocks_for(n - capacity_front);
+        auto spare  = blocks - 1 - last_element / block_elements;
 
-                for (size_t i = 0; i < new_blocks; ++i) {
-                    new_data[i] = allocate(block_elements);
-                }
+        // The blocks emptied at the back are moved to the front, as long as
+        // they are at least half of the map, the moves stay amortized O(1)
+        if (spare >= needed && 2 * spare >= blocks) {
+            rotate_blocks(blocks - spare);
 
-                first_element += new_blocks * block_elements;
-                last_element += new_blocks * block_elements;
+            first_element += spare * block_elements;
+            last_element += spare * block_elements;
+        } else {
+            // The map grows geometrically, the insertions stay amortized O(1)
+            auto new_blocks = std::max(needed, blocks);
+
+            auto new_data = new T*[blocks + new_blocks];
+
+            for (size_t i = 0; i < blocks; ++i) {
+                new_data[i + new_blocks] = data[i];
+            }
 
-                delete[] data;
-                data = new_data;
-                blocks += new_blocks;
+            for (size_t i = 0; i < new_blocks; ++i) {
+                new_data[i] = allocate_block();
             }
+
+            first_element += new_blocks * block_elements;
+            last_element += new_blocks * block_elements;
+
+            delete[] data;
+            data = new_data;
+            blocks += new_blocks;
         }
     }
 
     void ensure_capacity_back(size_t n) {
-        auto very_last_element = blocks ? blocks * block_elements - 1 : 0;
-        auto capacity_back     = very_last_element - last_element;
+        if (!data) {
+            allocate_map(n);
+
+            first_element = 0;
+            last_element  = 0;
+
+            return;
+        }
+
+        // An empty deque can start anywhere, the back has the most room at the start
+        if (!_size) {
+            first_element = 0;
+            last_element  = 0;
+        }
 
-        if (capacity_back < n) {
-            if (!data) {
-                blocks = n % block_elements == 0 ? n / block_elements : (n / block_elements) + 1;
+        auto very_last_element = blocks * block_elements - 1;
+        auto capacity_back     = very_last_element - last_element;
 
-                data = new T*[blocks];
+        if (capacity_back >= n) {
+            return;
+        }
 
-                for (size_t i = 0; i < blocks; ++i) {
-                    data[i] = allocate(block_elements);
-                }
+        auto needed = blocks_for(n - capacity_back);
+        auto spare  = _size ? first_element / block_elements : 0;
 
-                first_element = 0;
-                last_element  = 0;
-            } else {
-                auto expand_back = n - capacity_back;
-                auto new_blocks  = expand_back % block_elements == 0 ? expand_back / block_elements : (expand_back / block_elements) + 1;
+        // The blocks emptied at the front are moved to the back, as long as
+        // they are at least half of the map, the moves stay amortized O(1)
+        if (spare >= needed && 2 * spare >= blocks) {
+            rotate_blocks(spare);
 
-                auto new_data = new T*[blocks + new_blocks];
+            first_element -= spare * block_elements;
+            last_element -= spare * block_elements;
+        } else {
+            // The map grows geometrically, the insertions stay amortized O(1)
+            auto new_blocks = std::max(needed, blocks);
 
-                for (size_t i = 0; i < blocks; ++i) {
-                    new_data[i] = data[i];
-                }
+            auto new_data = new T*[blocks + new_blocks];
 
-                for (size_t i = blocks; i < blocks + new_blocks; ++i) {
-                    new_data[i] = allocate(block_elements);
-                }
+            for (size_t i = 0; i < blocks; ++i) {
+                new_data[i] = data[i];
+            }
 
-                delete[] data;
-                data = new_data;
-                blocks += new_blocks;
+            for (size_t i = blocks; i < blocks + new_blocks; ++i) {
+                new_data[i] = allocate_block();
             }
+
+            delete[] data;
+            data = new_data;
+            blocks += new_blocks;
         }
     }
 
-    T** data;
-    size_t first_element;
-    size_t last_element;
-    size_t blocks;
-    size_t _size;
+    T** data;             ///< The map of the blocks, all allocated
+    size_t first_element; ///< The index of the first element, from the first block
+    size_t last_element;  ///< The index of the last element, from the first block
+    size_t blocks;        ///< The number of blocks of the map
+    size_t _size;         ///< The number of elements
 };
 
 } //end of namespace std
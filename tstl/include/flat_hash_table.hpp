@@ -0,0 +1,496 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef FLAT_HASH_TABLE_H
+#define FLAT_HASH_TABLE_H
+
+#include <types.hpp>
+#include <utility.hpp>
+#include <new.hpp>
+#include <pair.hpp>
+#include <allocator.hpp>
+
+namespace std {
+
+namespace hash_impl {
+
+constexpr const size_t GROUP        = 16;   ///< The number of control bytes probed at once
+constexpr const size_t MIN_CAPACITY = 16;   ///< The capacity of the first allocation
+constexpr const uint8_t EMPTY       = 0x80; ///< The control byte of an empty slot
+
+#ifdef __SSE2__
+
+typedef char group_t __attribute__((vector_size(16), aligned(1), may_alias)); ///< 16 control bytes, unaligned
+
+/*!
+ * \brief Returns the bitmask of the control bytes of the group equal to value
+ */
+inline uint32_t match(const uint8_t* ctrl, uint8_t value){
+    auto group = *reinterpret_cast<const group_t*>(ctrl);
+
+    const char v = value;
+    const group_t values = {v, v, v, v, v, v, v, v, v, v, v, v, v, v, v, v};
+
+    return __builtin_ia32_pmovmskb128(group == values);
+}
+
+/*!
+ * \brief Returns the bitmask of the empty slots of the group
+ */
+inline uint32_t match_empty(const uint8_t* ctrl){
+    // Only the empty slots have their high bit set
+    return __builtin_ia32_pmovmskb128(*reinterpret_cast<const group_t*>(ctrl));
+}
+
+#else
+
+inline uint32_t match(const uint8_t* ctrl, uint8_t value){
+    uint32_t mask = 0;
+
+    for(size_t i = 0; i < GROUP; ++i){
+        if(ctrl[i] == value){
+            mask |= 1U << i;
+        }
+    }
+
+    return mask;
+}
+
+inline uint32_t match_empty(const uint8_t* ctrl){
+    return match(ctrl, EMPTY);
+}
+
+#endif
+
+/*!
+ * \brief Iterator over the full slots of a flat_hash_table
+ */
+template<typename V, typename Slot>
+struct flat_iterator {
+    using value_type      = V;         ///< The value type
+    using reference       = V&;        ///< The reference type
+    using pointer         = V*;        ///< The pointer type
+    using difference_type = int64_t;   ///< The difference type
+
+    flat_iterator(Slot* slots, const uint8_t* ctrl, size_t index, size_t capacity) : slots(slots), ctrl(ctrl), index(index), capacity(capacity) {
+        skip();
+    }
+
+    reference operator*() const {
+        return *reinterpret_cast<pointer>(&slots[index]);
+    }
+
+    pointer operator->() const {
+        return reinterpret_cast<pointer>(&slots[index]);
+    }
+
+    flat_iterator& operator++(){
+        ++index;
+        skip();
+        return *this;
+    }
+
+    bool operator==(const flat_iterator& rhs) const {
+        return index == rhs.index;
+    }
+
+    bool operator!=(const flat_iterator& rhs) const {
+        return index != rhs.index;
+    }
+
+    size_t position() const {
+        return index;
+    }
+
+private:
+    void skip(){
+        while(index < capacity && ctrl[index] == EMPTY){
+            ++index;
+        }
+    }
+
+    Slot* slots;
+    const uint8_t* ctrl;
+    size_t index;
+    size_t capacity;
+};
+
+} //end of namespace hash_impl
+
+/*!
+ * \brief An open addressing hash table, storing its values in a flat
+ * array of slots.
+ *
+ * Each slot has a control byte, EMPTY or the 7 high bits of the hash of
+ * its key. The slots are probed linearly, 16 control bytes at a time
+ * (with SSE2 when available), only comparing the keys of the matching
+ * control bytes. The slots are erased by shifting the next values back,
+ * so there are never tombstones. The table grows at 7/8 of its capacity.
+ *
+ * KeyOf extracts the key of a value, Hash hashes a key.
+ */
+template<typename Value, typename Key, typename KeyOf, typename Hash, typename Allocator = heap_allocator<Value>>
+struct flat_hash_table {
+    using value_type     = Value;     ///< The value type
+    using key_type       = Key;       ///< The key type
+    using size_type      = size_t;    ///< The size type
+    using allocator_type = Allocator; ///< The allocator of the slots
+
+private:
+    /*!
+     * \brief The uninitialized storage of a value
+     */
+    struct slot {
+        alignas(Value) char storage[sizeof(Value)];
+    };
+
+    using slot_allocator = typename Allocator::template rebind<slot>::other;
+    using ctrl_allocator = typename Allocator::template rebind<uint8_t>::other;
+
+public:
+    using iterator       = hash_impl::flat_iterator<Value, slot>;             ///< The iterator type
+    using const_iterator = hash_impl::flat_iterator<const Value, const slot>; ///< The const iterator type
+
+    flat_hash_table() : slots(nullptr), ctrl(nullptr), _size(0), _capacity(0) {}
+
+    flat_hash_table(const flat_hash_table& rhs) : flat_hash_table() {
+        reserve(rhs._size);
+
+        for(auto& value : rhs){
+            insert_unique(value);
+        }
+    }
+
+    flat_hash_table& operator=(const flat_hash_table& rhs){
+        if(this != &rhs){
+            clear();
+            reserve(rhs._size);
+
+            for(auto& value : rhs){
+                insert_unique(value);
+            }
+        }
+
+        return *this;
+    }
+
+    flat_hash_table(flat_hash_table&& rhs) : slots(rhs.slots), ctrl(rhs.ctrl), _size(rhs._size), _capacity(rhs._capacity) {
+        rhs.slots     = nullptr;
+        rhs.ctrl      = nullptr;
+        rhs._size     = 0;
+        rhs._capacity = 0;
+    }
+
+    flat_hash_table& operator=(flat_hash_table&& rhs){
+        if(this != &rhs){
+            release();
+
+            slots     = rhs.slots;
+            ctrl      = rhs.ctrl;
+            _size     = rhs._size;
+            _capacity = rhs._capacity;
+
+            rhs.slots     = nullptr;
+            rhs.ctrl      = nullptr;
+            rhs._size     = 0;
+            rhs._capacity = 0;
+        }
+
+        return *this;
+    }
+
+    ~flat_hash_table(){
+        release();
+    }
+
+    /*!
+     * \brief Returns the number of values in the table
+     */
+    size_t size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Indicates if the table is empty
+     */
+    bool empty() const {
+        return !_size;
+    }
+
+    /*!
+     * \brief Returns the number of slots of the table
+     */
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    /*!
+     * \brief Returns the position of the value with the given key, or capacity() if there is none
+     */
+    size_t find_position(const Key& key) const {
+        if(!_size){
+            return _capacity;
+        }
+
+        auto hash  = Hash()(key);
+        auto mask  = _capacity - 1;
+        auto small = h2(hash);
+
+        for(size_t position = hash & mask;; position = (position + hash_impl::GROUP) & mask){
+            for(auto matches = hash_impl::match(ctrl + position, small); matches; matches &= matches - 1){
+                auto index = (position + __builtin_ctz(matches)) & mask;
+
+                if(KeyOf()(value(index)) == key){
+                    return index;
+                }
+            }
+
+            // A key is never stored after an empty slot of its probe sequence
+            if(hash_impl::match_empty(ctrl + position)){
+                return _capacity;
+            }
+        }
+    }
+
+    /*!
+     * \brief Returns an iterator to the value with the given key, or end()
+     */
+    iterator find(const Key& key){
+        return iterator(slots, ctrl, find_position(key), _capacity);
+    }
+
+    /*!
+     * \brief Returns an iterator to the value with the given key, or end()
+     */
+    const_iterator find(const Key& key) const {
+        return const_iterator(slots, ctrl, find_position(key), _capacity);
+    }
+
+    /*!
+     * \brief Insert the value, unless a value with the same key is already present
+     * \return an iterator to the value with the key, and true if the value was inserted
+     */
+    template<typename V>
+    std::pair<iterator, bool> insert(V&& v){
+        auto index = find_position(KeyOf()(v));
+
+        if(index != _capacity){
+            return std::make_pair(iterator(slots, ctrl, index, _capacity), false);
+        }
+
+        return std::make_pair(iterator(slots, ctrl, insert_unique(std::forward<V>(v)), _capacity), true);
+    }
+
+    /*!
+     * \brief Erase the value with the given key
+     * \return the number of erased values
+     */
+    size_t erase(const Key& key){
+        auto index = find_position(key);
+
+        if(index == _capacity){
+            return 0;
+        }
+
+        erase_position(index);
+
+        return 1;
+    }
+
+    /*!
+     * \brief Erase the value at the given position.
+     *
+     * The following values are shifted back, the position may then hold a
+     * value not yet iterated. When the shift wraps around the end of the
+     * table, a value can be visited twice by an iteration.
+     *
+     * \return an iterator to the value now following the erased one
+     */
+    iterator erase(iterator it){
+        auto index = it.position();
+
+        erase_position(index);
+
+        return iterator(slots, ctrl, index, _capacity);
+    }
+
+    /*!
+     * \brief Remove all the values, the storage is kept
+     */
+    void clear(){
+        for(size_t i = 0; i < _capacity; ++i){
+            if(ctrl[i] != hash_impl::EMPTY){
+                value(i).~Value();
+                set_ctrl(i, hash_impl::EMPTY);
+            }
+        }
+
+        _size = 0;
+    }
+
+    /*!
+     * \brief Make room for n values without growing the table
+     */
+    void reserve(size_t n){
+        size_t capacity = hash_impl::MIN_CAPACITY;
+
+        while(n > max_load(capacity)){
+            capacity *= 2;
+        }
+
+        if(capacity > _capacity){
+            rehash(capacity);
+        }
+    }
+
+    iterator begin(){
+        return iterator(slots, ctrl, 0, _capacity);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(slots, ctrl, 0, _capacity);
+    }
+
+    iterator end(){
+        return iterator(slots, ctrl, _capacity, _capacity);
+    }
+
+    const_iterator end() const {
+        return const_iterator(slots, ctrl, _capacity, _capacity);
+    }
+
+private:
+    static uint8_t h2(size_t hash){
+        return hash >> 57;
+    }
+
+    static size_t max_load(size_t capacity){
+        return capacity - capacity / 8;
+    }
+
+    Value& value(size_t index) const {
+        return *reinterpret_cast<Value*>(&slots[index]);
+    }
+
+    // The first control bytes are mirrored after the end, so that a
+    // group can always be loaded at once
+    void set_ctrl(size_t index, uint8_t value){
+        ctrl[index] = value;
+
+        if(index < hash_impl::GROUP - 1){
+            ctrl[_capacity + index] = value;
+        }
+    }
+
+    // Returns the first empty slot of the probe sequence of the hash
+    size_t empty_position(size_t hash) const {
+        auto mask = _capacity - 1;
+
+        for(size_t position = hash & mask;; position = (position + hash_impl::GROUP) & mask){
+            if(auto empty = hash_impl::match_empty(ctrl + position)){
+                return (position + __builtin_ctz(empty)) & mask;
+            }
+        }
+    }
+
+    // Insert a value whose key is known not to be present
+    template<typename V>
+    size_t insert_unique(V&& v){
+        if(_size + 1 > max_load(_capacity)){
+            rehash(_capacity ? 2 * _capacity : hash_impl::MIN_CAPACITY);
+        }
+
+        auto hash  = Hash()(KeyOf()(v));
+        auto index = empty_position(hash);
+
+        new (&slots[index]) Value(std::forward<V>(v));
+        set_ctrl(index, h2(hash));
+
+        ++_size;
+
+        return index;
+    }
+
+    void erase_position(size_t index){
+        auto mask = _capacity - 1;
+
+        value(index).~Value();
+        set_ctrl(index, hash_impl::EMPTY);
+
+        --_size;
+
+        // Shift back the next values that can get closer to their home slot
+        for(size_t next = (index + 1) & mask; ctrl[next] != hash_impl::EMPTY; next = (next + 1) & mask){
+            auto home = Hash()(KeyOf()(value(next))) & mask;
+
+            if(((next - home) & mask) >= ((next - index) & mask)){
+                new (&slots[index]) Value(std::move(value(next)));
+                value(next).~Value();
+
+                set_ctrl(index, ctrl[next]);
+                set_ctrl(next, hash_impl::EMPTY);
+
+                index = next;
+            }
+        }
+    }
+
+    void rehash(size_t capacity){
+        auto old_slots    = slots;
+        auto old_ctrl     = ctrl;
+        auto old_capacity = _capacity;
+
+        slots     = slot_allocator::allocate(capacity);
+        ctrl      = ctrl_allocator::allocate(capacity + hash_impl::GROUP - 1);
+        _capacity = capacity;
+
+        for(size_t i = 0; i < capacity + hash_impl::GROUP - 1; ++i){
+            ctrl[i] = hash_impl::EMPTY;
+        }
+
+        for(size_t i = 0; i < old_capacity; ++i){
+            if(old_ctrl[i] != hash_impl::EMPTY){
+                auto& old = *reinterpret_cast<Value*>(&old_slots[i]);
+
+                auto hash  = Hash()(KeyOf()(old));
+                auto index = empty_position(hash);
+
+                new (&slots[index]) Value(std::move(old));
+                set_ctrl(index, h2(hash));
+
+                old.~Value();
+            }
+        }
+
+        if(old_slots){
+            slot_allocator::deallocate(old_slots, old_capacity);
+            ctrl_allocator::deallocate(old_ctrl, old_capacity + hash_impl::GROUP - 1);
+        }
+    }
+
+    void release(){
+        if(slots){
+            clear();
+
+            slot_allocator::deallocate(slots, _capacity);
+            ctrl_allocator::deallocate(ctrl, _capacity + hash_impl::GROUP - 1);
+
+            slots     = nullptr;
+            ctrl      = nullptr;
+            _capacity = 0;
+        }
+    }
+
+    slot* slots;      ///< The storage of the values
+    uint8_t* ctrl;    ///< The control bytes, followed by a copy of the first ones
+    size_t _size;     ///< The number of values
+    size_t _capacity; ///< The number of slots, a power of two
+};
+
+} //end of namespace std
+
+#endif
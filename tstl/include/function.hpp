@@ -8,59 +8,226 @@
 #ifndef STD_FUNCTION_HPP
 #define STD_FUNCTION_HPP
 
+#include <types.hpp>
 #include <algorithms.hpp>
 #include <type_traits.hpp>
+#include <enable_if.hpp>
+#include <new.hpp>
 
 namespace std {
 
 template<typename>
 struct function;
 
+/*!
+ * \brief A polymorphic owning wrapper of callables.
+ *
+ * The callables of up to three pointers (function pointers, lambdas
+ * capturing a few references...) are stored inline, the larger ones are
+ * allocated on the heap.
+ */
 template<typename R, typename... Args>
 struct function<R(Args...)> {
 public:
-    template<typename T>
+    static constexpr const size_t INLINE_SIZE = 3 * sizeof(void*); ///< The maximum size of the inline callables
+
+    /*!
+     * \brief Construct an empty function
+     */
+    function() : invoker(nullptr), manager(nullptr) {}
+
+    /*!
+     * \brief Construct an empty function
+     */
+    function(decltype(nullptr)) : function() {}
+
+    /*!
+     * \brief Construct a function wrapping the given callable
+     */
+    template<typename T, typename = std::disable_if_t<std::is_same<typename std::decay<T>::type, function>::value>>
     function(T&& t){
         typedef model<typename std::decay<T>::type> impl;
 
-        static_assert(sizeof(impl) <= sizeof(storage), "Limited size in function");
-        static_assert(std::is_trivially_destructible<T>::value, "Limited support of function");
+        impl::create(*this, std::forward<T>(t));
 
-        auto* s = static_cast<void*>(&storage[0]);
-        new (s) impl(std::forward<T>(t));
+        invoker = &impl::invoke;
+        manager = &impl::manage;
     }
 
     function(const function& rhs) = delete;
     function& operator=(const function& rhs) = delete;
 
-    function(function&& rhs) = delete;
-    function& operator=(function&& rhs) = delete;
+    function(function&& rhs) : invoker(nullptr), manager(nullptr) {
+        steal(rhs);
+    }
+
+    function& operator=(function&& rhs){
+        if(this != &rhs){
+            reset();
+            steal(rhs);
+        }
+
+        return *this;
+    }
+
+    ~function(){
+        reset();
+    }
 
+    /*!
+     * \brief Indicates if the function contains a callable
+     */
+    explicit operator bool() const {
+        return invoker;
+    }
+
+    /*!
+     * \brief Call the wrapped callable
+     */
     R operator()(Args... args) const {
-        auto* s = static_cast<const void*>(&storage[0]);
-        auto* c = static_cast<const concept*>(s);
-        return (*c)(std::forward<Args>(args)...);
+        return invoker(*this, std::forward<Args>(args)...);
     }
 
 private:
-    size_t storage[2];
+    enum class operation {
+        MOVE,   ///< Move the callable of src into dst, src is left empty
+        DESTROY ///< Destroy the callable of src
+    };
+
+    template<typename T>
+    struct inline_model {
+        template<typename U>
+        static void create(function& f, U&& u){
+            new (&f.storage[0]) T(std::forward<U>(u));
+        }
 
-    struct concept {
-        virtual R operator()(Args...) const = 0;
+        static T* get(const function& f){
+            return reinterpret_cast<T*>(const_cast<char*>(&f.storage[0]));
+        }
+
+        static void manage(operation op, function& dst, function& src){
+            if(op == operation::MOVE){
+                new (&dst.storage[0]) T(std::move(*get(src)));
+            }
+
+            get(src)->~T();
+        }
+
+        static R invoke(const function& f, Args... args){
+            return (*get(f))(std::forward<Args>(args)...);
+        }
     };
 
     template<typename T>
-    struct model : concept {
+    struct heap_model {
         template<typename U>
-        model(U&& u) : t(std::forward<U>(u)){
-            //Nothing to init
+        static void create(function& f, U&& u){
+            f.heap = new T(std::forward<U>(u));
+        }
+
+        static T* get(const function& f){
+            return static_cast<T*>(f.heap);
         }
 
-        R operator()(Args... args) const override {
-            return t(std::forward<Args>(args)...);
+        static void manage(operation op, function& dst, function& src){
+            if(op == operation::MOVE){
+                dst.heap = src.heap;
+            } else {
+                delete get(src);
+            }
         }
 
-        T t;
+        static R invoke(const function& f, Args... args){
+            return (*get(f))(std::forward<Args>(args)...);
+        }
+    };
+
+    template<typename T>
+    using model = std::conditional_t<sizeof(T) <= INLINE_SIZE && alignof(T) <= alignof(void*), inline_model<T>, heap_model<T>>;
+
+    void reset(){
+        if(manager){
+            manager(operation::DESTROY, *this, *this);
+
+            invoker = nullptr;
+            manager = nullptr;
+        }
+    }
+
+    void steal(function& rhs){
+        if(rhs.manager){
+            rhs.manager(operation::MOVE, *this, rhs);
+
+            invoker = rhs.invoker;
+            manager = rhs.manager;
+
+            rhs.invoker = nullptr;
+            rhs.manager = nullptr;
+        }
+    }
+
+    R (*invoker)(const function&, Args...);               ///< Call the callable
+    void (*manager)(operation, function&, function&);     ///< Move or destroy the callable
+
+    union {
+        void* heap;                                       ///< The callable, when allocated
+        alignas(void*) char storage[INLINE_SIZE];         ///< The callable, when inline
+    };
+};
+
+template<typename>
+struct function_ref;
+
+/*!
+ * \brief A non-owning reference to a callable.
+ *
+ * It is only two pointers and never allocates, but the callable must
+ * outlive it. It is meant for the callbacks used during a call.
+ */
+template<typename R, typename... Args>
+struct function_ref<R(Args...)> {
+public:
+    /*!
+     * \brief Construct a reference to the given callable
+     */
+    template<typename T, typename = std::disable_if_t<
+        std::is_same<typename std::decay<T>::type, function_ref>::value || std::is_function<std::remove_reference_t<T>>::value>>
+    function_ref(T&& t) : invoker(&invoke_object<std::remove_reference_t<T>>) {
+        object = const_cast<void*>(static_cast<const void*>(&t));
+    }
+
+    /*!
+     * \brief Construct a reference to the given function
+     */
+    function_ref(R (*f)(Args...)) : invoker(&invoke_function) {
+        function = f;
+    }
+
+    function_ref(const function_ref& rhs) = default;
+    function_ref& operator=(const function_ref& rhs) = default;
+
+    /*!
+     * \brief Call the referenced callable
+     */
+    R operator()(Args... args) const {
+        return invoker(*this, std::forward<Args>(args)...);
+    }
+
+private:
+    template<typename T>
+    static R invoke_object(const function_ref& f, Args... args){
+        return (*static_cast<T*>(f.object))(std::forward<Args>(args)...);
+    }
+
+    static R invoke_function(const function_ref& f, Args... args){
+        return f.function(std::forward<Args>(args)...);
+    }
+
+    R (*invoker)(const function_ref&, Args...); ///< Call the callable
+
+    union {
+        void* object;          ///< The referenced callable object
+        R (*function)(Args...); ///< The referenced function
     };
 };
 
@@ -0,0 +1,98 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <types.hpp>
+#include <type_traits.hpp>
+#include <enable_if.hpp>
+#include <string.hpp>
+#include <string_view.hpp>
+
+namespace std {
+
+/*!
+ * \brief Mix the bits of the value, every bit of the result depends on
+ * every bit of the value (finalizer of MurmurHash3)
+ */
+inline size_t hash_mix(uint64_t value){
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+/*!
+ * \brief Hash n bytes (FNV-1a, mixed)
+ */
+inline size_t hash_bytes(const char* bytes, size_t n){
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for(size_t i = 0; i < n; ++i){
+        hash ^= static_cast<uint8_t>(bytes[i]);
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash_mix(hash);
+}
+
+/*!
+ * \brief The hash function of the hash containers.
+ *
+ * The hashes are well mixed, the containers use both their low and
+ * their high bits.
+ */
+template<typename T, typename Enable = void>
+struct hash;
+
+/*!
+ * \brief The hash of the integers
+ */
+template<typename T>
+struct hash<T, std::enable_if_t<std::is_integral<T>::value>> {
+    size_t operator()(T value) const {
+        return hash_mix(static_cast<uint64_t>(value));
+    }
+};
+
+/*!
+ * \brief The hash of the pointers, by address
+ */
+template<typename T>
+struct hash<T*> {
+    size_t operator()(T* value) const {
+        return hash_mix(reinterpret_cast<uintptr_t>(value));
+    }
+};
+
+/*!
+ * \brief The hash of the strings, by content
+ */
+template<>
+struct hash<std::string> {
+    size_t operator()(const std::string& value) const {
+        return hash_bytes(value.c_str(), value.size());
+    }
+};
+
+/*!
+ * \brief The hash of the string views, by content, the same as the strings
+ */
+template<>
+struct hash<std::string_view> {
+    size_t operator()(std::string_view value) const {
+        return hash_bytes(value.data(), value.size());
+    }
+};
+
+} //end of namespace std
+
+#endif
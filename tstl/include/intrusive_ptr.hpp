@@ -0,0 +1,200 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef INTRUSIVE_PTR_H
+#define INTRUSIVE_PTR_H
+
+#include <types.hpp>
+#include <algorithms.hpp>
+
+namespace std {
+
+/*!
+ * \brief A reference-counted pointer of type T, the counter being stored in
+ * the object itself.
+ *
+ * The references are taken with intrusive_ptr_add_ref(T*) and dropped with
+ * intrusive_ptr_release(T*), both found by argument dependent lookup. The
+ * release is in charge of destroying the object with the last reference.
+ * Contrary to the shared_ptr, there is no control block, the pointer is
+ * only one pointer large.
+ */
+template <typename T>
+struct intrusive_ptr {
+    using pointer_type   = T*; ///< The pointer type
+    using reference_type = T&; ///< The reference type
+    using element_type   = T;  ///< The element type
+
+    /*!
+     * \brief Construct an empty intrusive_ptr
+     */
+    constexpr intrusive_ptr() : ptr(nullptr) {}
+
+    /*!
+     * \brief Construct an empty intrusive_ptr
+     */
+    constexpr intrusive_ptr(decltype(nullptr)) : ptr(nullptr) {}
+
+    /*!
+     * \brief Construct an intrusive_ptr around the given pointer, taking a
+     * new reference on it
+     */
+    explicit intrusive_ptr(T* ptr) : ptr(ptr) {
+        increment();
+    }
+
+    intrusive_ptr(const intrusive_ptr& rhs) : ptr(rhs.ptr) {
+        increment();
+    }
+
+    intrusive_ptr& operator=(const intrusive_ptr& rhs){
+        if(this != &rhs){
+            // The new reference is taken first, rhs could only live through this
+            auto* old = ptr;
+
+            ptr = rhs.ptr;
+            increment();
+
+            if(old){
+                intrusive_ptr_release(old);
+            }
+        }
+
+        return *this;
+    }
+
+    intrusive_ptr(intrusive_ptr&& rhs) : ptr(rhs.ptr) {
+        rhs.ptr = nullptr;
+    }
+
+    intrusive_ptr& operator=(intrusive_ptr&& rhs){
+        if(this != &rhs){
+            decrement();
+
+            ptr = rhs.ptr;
+            rhs.ptr = nullptr;
+        }
+
+        return *this;
+    }
+
+    /*!
+     * \brief Resets the intrusive_ptr value
+     */
+    intrusive_ptr& operator=(decltype(nullptr)){
+        decrement();
+
+        ptr = nullptr;
+
+        return *this;
+    }
+
+    /*!
+     * \brief Destroy the intrusive_ptr, dropping its reference
+     */
+    ~intrusive_ptr(){
+        decrement();
+    }
+
+    /*!
+     * \brief Returns the managed pointer
+     */
+    pointer_type get() const {
+        return ptr;
+    }
+
+    /*!
+     * \brief Returns the managed pointer
+     */
+    pointer_type operator->() const {
+        return get();
+    }
+
+    /*!
+     * \brief Returns a reference to the managed object
+     */
+    reference_type operator*() const {
+        return *get();
+    }
+
+    /*!
+     * \brief Converts the intrusive ptr to a boolean, indicating if it points to something or not
+     */
+    explicit operator bool() const {
+        return get();
+    }
+
+    bool operator==(const intrusive_ptr& rhs) const {
+        return ptr == rhs.ptr;
+    }
+
+    bool operator!=(const intrusive_ptr& rhs) const {
+        return ptr != rhs.ptr;
+    }
+
+private:
+    void increment(){
+        if(ptr){
+            intrusive_ptr_add_ref(ptr);
+        }
+    }
+
+    void decrement(){
+        if(ptr){
+            intrusive_ptr_release(ptr);
+        }
+    }
+
+    pointer_type ptr; ///< The managed pointer
+};
+
+/*!
+ * \brief A base class embedding the reference counter of an object, the
+ * object is deleted with its last reference.
+ *
+ * T is the class deriving from the counter.
+ */
+template <typename T>
+struct intrusive_ref_counter {
+    intrusive_ref_counter() : references(0) {}
+
+    intrusive_ref_counter(const intrusive_ref_counter& rhs) = delete;
+    intrusive_ref_counter& operator=(const intrusive_ref_counter& rhs) = delete;
+
+    /*!
+     * \brief Take a new reference on the object
+     */
+    friend void intrusive_ptr_add_ref(const T* p){
+        // A new reference is taken from an existing one, no ordering is needed
+        __atomic_fetch_add(&p->references, 1, __ATOMIC_RELAXED);
+    }
+
+    /*!
+     * \brief Drop a reference on the object, deleting it with the last one
+     */
+    friend void intrusive_ptr_release(const T* p){
+        // The accesses of the other owners are done before the deletion
+        if(!__atomic_sub_fetch(&p->references, 1, __ATOMIC_ACQ_REL)){
+            delete p;
+        }
+    }
+
+private:
+    mutable volatile size_t references; ///< The number of references
+};
+
+/*!
+ * \brief Creates a new object managed by an intrusive_ptr
+ */
+template <typename T, typename... Args>
+std::intrusive_ptr<T> make_intrusive(Args&&... args){
+    return std::intrusive_ptr<T>{new T(std::forward<Args>(args)...)};
+}
+
+} //end of namespace std
+
+#endif
@@ -13,13 +13,15 @@
 #include <types.hpp>
 #include <type_traits.hpp>
 #include <iterator.hpp>
+#include <new.hpp>
+#include <allocator.hpp>
 
 namespace std {
 
 template<typename T>
 struct list_node;
 
-template<typename T>
+template<typename T, typename Allocator = heap_allocator<T>>
 struct list;
 
 template <typename T, typename V>
@@ -84,7 +86,7 @@ private:
  * This container should almost never be preferred over vector. The only time when list is better than vector
  * is when the data is very expensive to copy or it is necessary to have stable references.
  */
-template<typename T>
+template<typename T, typename Allocator>
 struct list {
     using value_type             = T;                                                            ///7< The value type of the container
     using pointer_type           = value_type*;                                                  ///< The pointer type of the container
@@ -92,6 +94,7 @@ struct list {
     using const_reference_type   = const value_type&;                                            ///< The pointer type of the container
     using size_type              = size_t;                                                       ///< The size type of the container
     using node_type              = list_node<T>;                                                 ///< The type of nodes
+    using allocator_type         = Allocator;                                                    ///< The allocator, rebound to allocate the nodes
     using iterator               = list_iterator<T, T>;                                          ///< The iterator type
     using const_iterator         = list_iterator<T, std::add_const_t<T>>;                        ///< The const iterator type
     using reverse_iterator       = std::reverse_iterator<list_iterator<T, T>>;                   ///< The reverse iterator type
@@ -172,10 +175,10 @@ struct list {
      */
     void push_front(const value_type& value){
         if(_size == 0){
-            head = new node_type(value, nullptr, nullptr);
+            head = new_node(value, nullptr, nullptr);
             tail = head;
         } else {
-            auto node = new node_type(value, head, nullptr);
+            auto node = new_node(value, head, nullptr);
             head->prev = node;
             head = node;
         }
@@ -188,10 +191,10 @@ struct list {
      */
     void push_back(const value_type& value){
         if(_size == 0){
-            head = new node_type(value, nullptr, nullptr);
+            head = new_node(value, nullptr, nullptr);
             tail = head;
         } else {
-            auto node = new node_type(value, nullptr, tail);
+            auto node = new_node(value, nullptr, tail);
             tail->next = node;
             tail = node;
         }
@@ -202,10 +205,10 @@ struct list {
     template<typename... Args>
     value_type& emplace_front(Args&&... args){
         if(_size == 0){
-            head = new node_type(nullptr, nullptr, std::forward<Args>(args)...);
+            head = new_node(nullptr, nullptr, std::forward<Args>(args)...);
             tail = head;
         } else {
-            auto node = new node_type(head, nullptr, std::forward<Args>(args)...);
+            auto node = new_node(head, nullptr, std::forward<Args>(args)...);
             head->prev = node;
             head = node;
         }
@@ -218,10 +221,10 @@ struct list {
     template<typename... Args>
     value_type& emplace_back(Args&&... args){
         if(_size == 0){
-            head = new node_type(nullptr, nullptr, std::forward<Args>(args)...);
+            head = new_node(nullptr, nullptr, std::forward<Args>(args)...);
             tail = head;
         } else {
-            auto node = new node_type(nullptr, tail, std::forward<Args>(args)...);
+            auto node = new_node(nullptr, tail, std::forward<Args>(args)...);
             tail->next = node;
             tail = node;
         }
@@ -244,7 +247,7 @@ struct list {
             head->prev = nullptr;
         }
 
-        delete old;
+        delete_node(old);
 
         --_size;
     }
@@ -262,12 +265,24 @@ struct list {
             tail->next = nullptr;
         }
 
-        delete old;
+        delete_node(old);
 
         --_size;
     }
 
 private:
+    using node_allocator = typename Allocator::template rebind<node_type>::other; ///< The allocator of the nodes
+
+    template<typename... Args>
+    static node_type* new_node(Args&&... args){
+        return new (node_allocator::allocate(1)) node_type(std::forward<Args>(args)...);
+    }
+
+    static void delete_node(node_type* node){
+        node->~node_type();
+        node_allocator::deallocate(node, 1);
+    }
+
     iterator erase_node(node_type* node){
         if(!node){
             return end();
@@ -291,7 +306,7 @@ private:
 
         auto next = node->next;
 
-        delete node;
+        delete_node(node);
 
         --_size;
 
@@ -416,7 +431,8 @@ struct list_node {
         //Nothing else to init
     }
 
-    friend struct list<T>;
+    template<typename, typename>
+    friend struct list;
     friend struct list_iterator<T, T>;
     friend struct list_iterator<T, std::add_const_t<T>>;
 
@@ -0,0 +1,324 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef MEMORY_OPS_H
+#define MEMORY_OPS_H
+
+#include <types.hpp>
+
+namespace std {
+
+/*!
+ * \brief The implementations of the memory copy and fill, by size tier.
+ *
+ * The small ranges are done 64 bits at a time, the medium ranges with
+ * rep movsb/stosb when the processor has fast strings (ERMS) or with
+ * SSE2 otherwise, and the very large ranges with non-temporal stores
+ * to not flush the caches. The processor features are read with CPUID
+ * on first use.
+ */
+namespace mem {
+
+constexpr const size_t SMALL_BYTES  = 64;          ///< The size under which the ranges are done by words
+constexpr const size_t STREAM_BYTES = 1024 * 1024; ///< The size from which the stores bypass the caches
+
+/*!
+ * \brief The features of the processor, detected on first use
+ */
+template<typename T = void>
+struct features {
+    static volatile uint8_t erms; ///< 0 when not detected yet, 1 without ERMS, 2 with ERMS
+};
+
+template<typename T>
+volatile uint8_t features<T>::erms = 0;
+
+#ifdef __x86_64__
+
+/*!
+ * \brief Indicates if the processor has the Enhanced REP MOVSB/STOSB feature
+ */
+inline bool has_erms(){
+    auto erms = features<>::erms;
+
+    if(!erms){
+        uint32_t eax = 0, ebx, ecx = 0, edx;
+        asm volatile("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+
+        erms = 1;
+
+        if(eax >= 7){
+            eax = 7;
+            ecx = 0;
+            asm volatile("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+
+            if(ebx & (1 << 9)){
+                erms = 2;
+            }
+        }
+
+        // Concurrent detections store the same value
+        features<>::erms = erms;
+    }
+
+    return erms == 2;
+}
+
+#else
+
+inline bool has_erms(){
+    return false;
+}
+
+#endif
+
+/*!
+ * \brief Copy bytes from in to out, 64 bits at a time
+ */
+inline void copy_words(char* out, const char* in, size_t bytes){
+    // Copy as much as possible 64 bits at at time
+    if(bytes >= 8){
+        auto* out64 = reinterpret_cast<uint64_t*>(out);
+        auto* in64 = reinterpret_cast<const uint64_t*>(in);
+
+        const size_t l = bytes / 8;
+
+        for(size_t i = 0; i < l; ++i){
+            out64[i] = in64[i];
+        }
+
+        bytes -= l * 8;
+        out += l * 8;
+        in += l * 8;
+    }
+
+    // Finish up byte by byte
+    while(bytes >= 1){
+        *out++ = *in++;
+        --bytes;
+    }
+}
+
+/*!
+ * \brief Fill bytes of out with value, 64 bits at a time
+ */
+inline void fill_words(char* out, uint8_t value, size_t bytes){
+    if(bytes >= 8){
+        auto* out64 = reinterpret_cast<uint64_t*>(out);
+
+        const uint64_t value64 = value * 0x0101010101010101ULL;
+        const size_t l = bytes / 8;
+
+        for(size_t i = 0; i < l; ++i){
+            out64[i] = value64;
+        }
+
+        bytes -= l * 8;
+        out += l * 8;
+    }
+
+    while(bytes >= 1){
+        *out++ = value;
+        --bytes;
+    }
+}
+
+#ifdef __x86_64__
+
+/*!
+ * \brief Copy bytes from in to out with rep movsb
+ */
+inline void copy_rep(char* out, const char* in, size_t bytes){
+    asm volatile("rep movsb" : "+D" (out), "+S" (in), "+c" (bytes) : : "memory");
+}
+
+/*!
+ * \brief Fill bytes of out with value with rep stosb
+ */
+inline void fill_rep(char* out, uint8_t value, size_t bytes){
+    asm volatile("rep stosb" : "+D" (out), "+c" (bytes) : "a" (value) : "memory");
+}
+
+#endif
+
+#ifdef __SSE2__
+
+typedef long long vector_t __attribute__((vector_size(16), may_alias));                      ///< 16 bytes, aligned
+typedef long long unaligned_vector_t __attribute__((vector_size(16), aligned(1), may_alias)); ///< 16 bytes, unaligned
+
+/*!
+ * \brief Copy bytes until out is aligned on 16 bytes
+ */
+inline void align_copy(char*& out, const char*& in, size_t& bytes){
+    while(bytes && (reinterpret_cast<uintptr_t>(out) & 15)){
+        *out++ = *in++;
+        --bytes;
+    }
+}
+
+/*!
+ * \brief Fill bytes until out is aligned on 16 bytes
+ */
+inline void align_fill(char*& out, uint8_t value, size_t& bytes){
+    while(bytes && (reinterpret_cast<uintptr_t>(out) & 15)){
+        *out++ = value;
+        --bytes;
+    }
+}
+
+/*!
+ * \brief Copy bytes from in to out, 64 bytes at a time with SSE2
+ */
+inline void copy_sse(char* out, const char* in, size_t bytes){
+    align_copy(out, in, bytes);
+
+    for(; bytes >= 64; bytes -= 64, out += 64, in += 64){
+        auto a = reinterpret_cast<const unaligned_vector_t*>(in)[0];
+        auto b = reinterpret_cast<const unaligned_vector_t*>(in)[1];
+        auto c = reinterpret_cast<const unaligned_vector_t*>(in)[2];
+        auto d = reinterpret_cast<const unaligned_vector_t*>(in)[3];
+
+        reinterpret_cast<vector_t*>(out)[0] = a;
+        reinterpret_cast<vector_t*>(out)[1] = b;
+        reinterpret_cast<vector_t*>(out)[2] = c;
+        reinterpret_cast<vector_t*>(out)[3] = d;
+    }
+
+    copy_words(out, in, bytes);
+}
+
+/*!
+ * \brief Fill bytes of out with value, 64 bytes at a time with SSE2
+ */
+inline void fill_sse(char* out, uint8_t value, size_t bytes){
+    align_fill(out, value, bytes);
+
+    const long long value64 = value * 0x0101010101010101ULL;
+    const vector_t v = {value64, value64};
+
+    for(; bytes >= 64; bytes -= 64, out += 64){
+        reinterpret_cast<vector_t*>(out)[0] = v;
+        reinterpret_cast<vector_t*>(out)[1] = v;
+        reinterpret_cast<vector_t*>(out)[2] = v;
+        reinterpret_cast<vector_t*>(out)[3] = v;
+    }
+
+    fill_words(out, value, bytes);
+}
+
+/*!
+ * \brief Copy bytes from in to out with non-temporal stores, bypassing the caches
+ */
+inline void copy_stream(char* out, const char* in, size_t bytes){
+    align_copy(out, in, bytes);
+
+    for(; bytes >= 64; bytes -= 64, out += 64, in += 64){
+        auto a = reinterpret_cast<const unaligned_vector_t*>(in)[0];
+        auto b = reinterpret_cast<const unaligned_vector_t*>(in)[1];
+        auto c = reinterpret_cast<const unaligned_vector_t*>(in)[2];
+        auto d = reinterpret_cast<const unaligned_vector_t*>(in)[3];
+
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 0, a);
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 1, b);
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 2, c);
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 3, d);
+    }
+
+    // The non-temporal stores are weakly ordered
+    __builtin_ia32_sfence();
+
+    copy_words(out, in, bytes);
+}
+
+/*!
+ * \brief Fill bytes of out with value with non-temporal stores, bypassing the caches
+ */
+inline void fill_stream(char* out, uint8_t value, size_t bytes){
+    align_fill(out, value, bytes);
+
+    const long long value64 = value * 0x0101010101010101ULL;
+    const vector_t v = {value64, value64};
+
+    for(; bytes >= 64; bytes -= 64, out += 64){
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 0, v);
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 1, v);
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 2, v);
+        __builtin_ia32_movntdq(reinterpret_cast<vector_t*>(out) + 3, v);
+    }
+
+    __builtin_ia32_sfence();
+
+    fill_words(out, value, bytes);
+}
+
+#endif
+
+/*!
+ * \brief Copy bytes from in to out, with the best implementation for the size
+ */
+inline void copy(char* out, const char* in, size_t bytes){
+    if(bytes < SMALL_BYTES){
+        copy_words(out, in, bytes);
+        return;
+    }
+
+#ifdef __SSE2__
+    if(bytes >= STREAM_BYTES){
+        copy_stream(out, in, bytes);
+        return;
+    }
+#endif
+
+#ifdef __x86_64__
+    if(has_erms()){
+        copy_rep(out, in, bytes);
+        return;
+    }
+#endif
+
+#ifdef __SSE2__
+    copy_sse(out, in, bytes);
+#else
+    copy_words(out, in, bytes);
+#endif
+}
+
+/*!
+ * \brief Fill bytes of out with value, with the best implementation for the size
+ */
+inline void fill(char* out, uint8_t value, size_t bytes){
+    if(bytes < SMALL_BYTES){
+        fill_words(out, value, bytes);
+        return;
+    }
+
+#ifdef __SSE2__
+    if(bytes >= STREAM_BYTES){
+        fill_stream(out, value, bytes);
+        return;
+    }
+#endif
+
+#ifdef __x86_64__
+    if(has_erms()){
+        fill_rep(out, value, bytes);
+        return;
+    }
+#endif
+
+#ifdef __SSE2__
+    fill_sse(out, value, bytes);
+#else
+    fill_words(out, value, bytes);
+#endif
+}
+
+} //end of namespace mem
+
+} //end of namespace std
+
+#endif
@@ -0,0 +1,169 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef MPMC_RING_H
+#define MPMC_RING_H
+
+#include <types.hpp>
+#include <atomic.hpp>
+
+/*!
+ * \brief A lock-free bounded ring of S elements, for any number of producers
+ * and consumers.
+ *
+ * Each slot has a sequence number telling if it can be written or read at a
+ * given index. A producer (or consumer) claims an index with a compare
+ * exchange on the tail (or head), fills (or empties) the slot and then
+ * publishes it by advancing its sequence.
+ */
+template<typename T, size_t S>
+struct mpmc_ring {
+    static_assert(S && !(S & (S - 1)), "The size of the ring must be a power of two");
+
+    /*!
+     * \brief Construct a new empty ring
+     */
+    mpmc_ring() : head(0), tail(0) {
+        for(size_t i = 0; i < S; ++i){
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_ring(const mpmc_ring& rhs) = delete;
+    mpmc_ring& operator=(const mpmc_ring& rhs) = delete;
+
+    /*!
+     * \brief Returns the maximum number of elements of the ring
+     */
+    static constexpr size_t capacity(){
+        return S;
+    }
+
+    /*!
+     * \brief Returns an estimate of the number of elements in the ring
+     */
+    size_t size() const {
+        auto h = head.load(std::memory_order_acquire);
+        auto t = tail.load(std::memory_order_acquire);
+
+        // The head may have been read before pops that passed the read tail
+        return t > h ? t - h : 0;
+    }
+
+    /*!
+     * \brief Returns true if the ring looks empty
+     */
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /*!
+     * \brief Push the given value to the ring
+     * \return true if the value was pushed, false if the ring is full
+     */
+    bool push(const T& value){
+        auto t = tail.load(std::memory_order_relaxed);
+
+        while(true){
+            auto& slot = slots[t & MASK];
+            auto seq = slot.sequence.load(std::memory_order_acquire);
+            auto diff = int64_t(seq - t);
+
+            if(diff == 0){
+                // The slot is free at this index, claim it
+                if(tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)){
+                    slot.value = value;
+                    slot.sequence.store(t + 1, std::memory_order_release);
+
+                    return true;
+                }
+            } else if(diff < 0){
+                // The slot still holds the value of the previous round
+                return false;
+            } else {
+                t = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /*!
+     * \brief Push as many of the n given values as possible, in order
+     * \return The number of values pushed
+     */
+    size_t push(const T* values, size_t n){
+        size_t pushed = 0;
+
+        while(pushed < n && push(values[pushed])){
+            ++pushed;
+        }
+
+        return pushed;
+    }
+
+    /*!
+     * \brief Pop the oldest value of the ring
+     * \return true if a value was popped, false if the ring is empty
+     */
+    bool pop(T& value){
+        auto h = head.load(std::memory_order_relaxed);
+
+        while(true){
+            auto& slot = slots[h & MASK];
+            auto seq = slot.sequence.load(std::memory_order_acquire);
+            auto diff = int64_t(seq - (h + 1));
+
+            if(diff == 0){
+                // The slot is filled at this index, claim it
+                if(head.compare_exchange_weak(h, h + 1, std::memory_order_relaxed)){
+                    value = slot.value;
+
+                    // The slot is free for the next round
+                    slot.sequence.store(h + S, std::memory_order_release);
+
+                    return true;
+                }
+            } else if(diff < 0){
+                // The slot is not filled yet
+                return false;
+            } else {
+                h = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /*!
+     * \brief Pop up to n values from the ring
+     * \return The number of values popped
+     */
+    size_t pop(T* values, size_t n){
+        size_t popped = 0;
+
+        while(popped < n && pop(values[popped])){
+            ++popped;
+        }
+
+        return popped;
+    }
+
+private:
+    static constexpr const size_t MASK = S - 1; ///< The mask of an index into the buffer
+
+    /*!
+     * \brief A slot of the ring
+     */
+    struct slot_t {
+        std::atomic<size_t> sequence; ///< The index at which the slot can be written, or the index plus one at which it can be read
+        T value;                      ///< The element
+    };
+
+    alignas(std::hardware_destructive_interference_size) std::atomic<size_t> head; ///< The index of the next element to pop
+    alignas(std::hardware_destructive_interference_size) std::atomic<size_t> tail; ///< The index of the next element to push
+
+    alignas(std::hardware_destructive_interference_size) slot_t slots[S]; ///< The slots
+};
+
+#endif
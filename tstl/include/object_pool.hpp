@@ -0,0 +1,231 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <types.hpp>
+#include <new.hpp>
+#include <utility.hpp>
+#include <allocator.hpp>
+
+namespace std {
+
+/*!
+ * \brief A pool of objects of the same type.
+ *
+ * The pool grows by chunks of about a page, carved in slots. The released
+ * slots are recycled through a free list, so that allocating and releasing
+ * an object costs a few instructions. The chunks are only given back to the
+ * heap when the pool is destroyed.
+ *
+ * The pool is not synchronized.
+ */
+template<typename T>
+struct object_pool {
+    using value_type = T; ///< The type of the objects
+
+    static constexpr const size_t chunk_size = 4096; ///< The size of the chunks, in bytes
+
+    /*!
+     * \brief Construct an empty pool, without any chunk
+     */
+    constexpr object_pool() : free_slots(nullptr), chunks(nullptr), _allocated(0), _used(0) {
+        //Nothing else to init
+    }
+
+    object_pool(const object_pool& rhs) = delete;
+    object_pool& operator=(const object_pool& rhs) = delete;
+
+    /*!
+     * \brief Destroy the pool and release all its chunks.
+     *
+     * All the objects must have been released before.
+     */
+    ~object_pool(){
+        while(chunks){
+            auto next = chunks->next;
+            delete[] reinterpret_cast<char*>(chunks);
+            chunks = next;
+        }
+    }
+
+    /*!
+     * \brief Returns uninitialized storage for one object
+     * \return The storage, nullptr if the heap is exhausted
+     */
+    T* allocate(){
+        if(!free_slots && !grow()){
+            return nullptr;
+        }
+
+        auto s = free_slots;
+        free_slots = s->next;
+
+        ++_used;
+
+        return reinterpret_cast<T*>(s->storage);
+    }
+
+    /*!
+     * \brief Give back storage returned by allocate()
+     */
+    void deallocate(T* object){
+        auto s = reinterpret_cast<slot*>(object);
+        s->next = free_slots;
+        free_slots = s;
+
+        --_used;
+    }
+
+    /*!
+     * \brief Construct a new object in the pool
+     * \return The object, nullptr if the heap is exhausted
+     */
+    template<typename... Args>
+    T* create(Args&&... args){
+        auto object = allocate();
+
+        if(object){
+            new (object) T(std::forward<Args>(args)...);
+        }
+
+        return object;
+    }
+
+    /*!
+     * \brief Destruct an object of the pool and recycle its slot
+     */
+    void destroy(T* object){
+        object->~T();
+        deallocate(object);
+    }
+
+    /*!
+     * \brief Returns the number of objects currently allocated
+     */
+    size_t used() const {
+        return _used;
+    }
+
+    /*!
+     * \brief Returns the number of slots of the pool
+     */
+    size_t allocated() const {
+        return _allocated;
+    }
+
+private:
+    /*!
+     * \brief A slot, holding an object or the link to the next free slot
+     */
+    union slot {
+        slot* next;                            ///< The next free slot
+        alignas(T) char storage[sizeof(T)];    ///< The storage of the object
+    };
+
+    /*!
+     * \brief The header of a chunk, followed by its slots
+     */
+    struct chunk {
+        chunk* next; ///< The next chunk of the pool
+    };
+
+    static constexpr const size_t slots_offset = (sizeof(chunk) + alignof(slot) - 1) & ~(alignof(slot) - 1);
+    static constexpr const size_t chunk_slots  = slots_offset + sizeof(slot) <= chunk_size ? (chunk_size - slots_offset) / sizeof(slot) : 1;
+
+    /*!
+     * \brief Add a new chunk to the pool and put all its slots in the free list
+     */
+    bool grow(){
+        auto memory = new char[slots_offset + chunk_slots * sizeof(slot)];
+
+        if(!memory){
+            return false;
+        }
+
+        auto c = reinterpret_cast<chunk*>(memory);
+        c->next = chunks;
+        chunks = c;
+
+        auto slots = reinterpret_cast<slot*>(memory + slots_offset);
+
+        for(size_t i = chunk_slots; i > 0; --i){
+            slots[i - 1].next = free_slots;
+            free_slots = &slots[i - 1];
+        }
+
+        _allocated += chunk_slots;
+
+        return true;
+    }
+
+    slot* free_slots; ///< The first free slot
+    chunk* chunks;    ///< The chunks of the pool
+    size_t _allocated; ///< The number of slots
+    size_t _used;      ///< The number of used slots
+};
+
+/*!
+ * \brief An allocator serving single elements from an object pool shared by
+ * all the containers of the same type of elements.
+ *
+ * The allocations of several elements at once, for instance the storage of a
+ * vector, are served by the heap. The pool is not synchronized, the
+ * containers using this allocator must all be protected by the same lock.
+ */
+template<typename T>
+struct pool_allocator {
+    using value_type = T; ///< The type of the allocated elements
+
+    /*!
+     * \brief The same allocator for another type of elements
+     */
+    template<typename U>
+    struct rebind {
+        using other = pool_allocator<U>; ///< The rebound allocator
+    };
+
+    /*!
+     * \brief Allocate uninitialized storage for n elements
+     */
+    static T* allocate(size_t n){
+        if(n == 1){
+            return pool.allocate();
+        }
+
+        return heap_allocator<T>::allocate(n);
+    }
+
+    /*!
+     * \brief Release the storage of n elements, allocated with allocate(n)
+     */
+    static void deallocate(T* ptr, size_t n){
+        if(n == 1){
+            pool.deallocate(ptr);
+        } else {
+            heap_allocator<T>::deallocate(ptr, n);
+        }
+    }
+
+    /*!
+     * \brief Returns the pool shared by the allocators of this type
+     */
+    static const object_pool<T>& get_pool(){
+        return pool;
+    }
+
+private:
+    static object_pool<T> pool; ///< The pool of elements
+};
+
+template<typename T>
+object_pool<T> pool_allocator<T>::pool;
+
+} //end of namespace std
+
+#endif
@@ -130,6 +130,8 @@ struct shared_ptr {
         this->ptr = ptr;
 
         control_block = new control_block_impl<U, default_delete<U>>(ptr);
+
+        return *this;
     }
 
     /*!
@@ -140,6 +142,8 @@ struct shared_ptr {
 
         this->ptr = nullptr;
         this->control_block = nullptr;
+
+        return *this;
     }
 
     /*!
@@ -229,7 +233,7 @@ private:
      */
     void decrement(){
         if(control_block){
-            if(!__sync_sub_and_fetch(&control_block->counter, 1)){
+            if(!__atomic_sub_fetch(&control_block->counter, 1, __ATOMIC_ACQ_REL)){
                 control_block->destroy();
                 delete control_block;
             }
@@ -242,7 +246,7 @@ private:
      */
     void increment(){
         if(control_block){
-            __sync_fetch_and_add(&control_block->counter, 1);
+            __atomic_fetch_add(&control_block->counter, 1, __ATOMIC_RELAXED);
         }
     }
 
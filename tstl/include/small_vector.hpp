@@ -0,0 +1,523 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SMALL_VECTOR_H
+#define SMALL_VECTOR_H
+
+#include <initializer_list.hpp>
+#include <types.hpp>
+#include <algorithms.hpp>
+#include <new.hpp>
+#include <iterator.hpp>
+#include <allocator.hpp>
+
+namespace std {
+
+/*!
+ * \brief A contiguous container of elements, storing up to N elements
+ * inline before spilling to the allocator.
+ *
+ * It has the interface of std::vector. The small containers (paths,
+ * arguments...) are then never allocated.
+ */
+template<typename T, size_t N, typename Allocator = heap_allocator<T>>
+struct small_vector {
+    using value_type           = T;                 ///< The value type contained in the vector
+    using allocator_type       = Allocator;         ///< The allocator of the storage, once spilled
+    using pointer_type         = value_type*;       ///< The pointer type contained in the vector
+    using reference_type       = value_type&;       ///< The pointer type contained in the vector
+    using const_reference_type = const value_type&; ///< The pointer type contained in the vector
+    using size_type            = size_t;            ///< The size type
+    using iterator             = value_type*;       ///< The iterator type
+    using const_iterator       = const value_type*; ///< The const iterator type
+
+    using reverse_iterator       = std::reverse_iterator<iterator>;       ///< The reverse iterator type
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>; ///< The const reverse iterator type
+
+    static_assert(N > 0, "A small_vector must have some inline capacity");
+
+    /*!
+     * \brief Constructs en empty vector, using the inline storage
+     */
+    small_vector() : data(inline_data()), _size(0), _capacity(N) {}
+
+    /*!
+     * \brief Constructs an empty vector with the given capacity
+     */
+    explicit small_vector(size_t c) : small_vector() {
+        reserve(c);
+    }
+
+    /*!
+     * \brief Construct a vector containing the given values
+     */
+    small_vector(initializer_list<T> values) : small_vector() {
+        reserve(values.size());
+
+        for(auto& v : values){
+            new (&data[_size++]) value_type(v);
+        }
+    }
+
+    small_vector(const small_vector& rhs) : small_vector() {
+        reserve(rhs._size);
+
+        for(size_t i = 0; i < rhs._size; ++i){
+            new (&data[i]) value_type(rhs.data[i]);
+        }
+
+        _size = rhs._size;
+    }
+
+    small_vector& operator=(const small_vector& rhs){
+        if (this != &rhs) {
+            clear();
+            reserve(rhs._size);
+
+            for (size_t i = 0; i < rhs._size; ++i) {
+                new (&data[i]) value_type(rhs.data[i]);
+            }
+
+            _size = rhs._size;
+        }
+
+        return *this;
+    }
+
+    //Move constructors
+
+    small_vector(small_vector&& rhs) : small_vector() {
+        steal(rhs);
+    }
+
+    small_vector& operator=(small_vector&& rhs){
+        if (this != &rhs) {
+            release();
+
+            data      = inline_data();
+            _capacity = N;
+
+            steal(rhs);
+        }
+
+        return *this;
+    }
+
+    ~small_vector(){
+        release();
+    }
+
+    //Getters
+
+    /*!
+     * \brief Returns the size of the vector
+     */
+    size_type size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Indicates if the vector is empty
+     */
+    bool empty() const {
+        return _size == 0;
+    }
+
+    /*!
+     * \brief Returns the capacity of the vector
+     */
+    size_type capacity() const {
+        return _capacity;
+    }
+
+    /*!
+     * \brief Indicates if the elements are stored inline
+     */
+    bool is_inline() const {
+        return data == inline_data();
+    }
+
+    /*!
+     * \brief Returns a const reference to the elemenet at the given position
+     */
+    const value_type& operator[](size_type pos) const {
+        return data[pos];
+    }
+
+    /*!
+     * \brief Returns a reference to the elemenet at the given position
+     */
+    value_type& operator[](size_type pos){
+        return data[pos];
+    }
+
+    /*!
+     * \brief Returns a reference to the element at the front of the collection
+     */
+    value_type& front(){
+        return data[0];
+    }
+
+    /*!
+     * \brief Returns a const reference to the element at the front of the collection
+     */
+    const value_type& front() const  {
+        return data[0];
+    }
+
+    /*!
+     * \brief Returns a reference to the element at the back of the collection
+     */
+    value_type& back(){
+        return data[size() - 1];
+    }
+
+    /*!
+     * \brief Returns a const reference to the element at the back of the collection
+     */
+    const value_type& back() const  {
+        return data[size() - 1];
+    }
+
+    //Modifiers
+
+    /*!
+     * \brief Augments the capacity to at least the given capacity
+     */
+    void reserve(size_t new_capacity){
+        if(new_capacity > capacity()){
+            ensure_capacity(new_capacity);
+        }
+    }
+
+    /*!
+     * \brief Resize the vector to the given size
+     */
+    void resize(size_t new_size){
+        if(new_size > size()){
+            ensure_capacity(new_size);
+
+            // Default initialize the new elements
+            for(size_t i = _size; i < new_size; ++i){
+                new (&data[i]) value_type();
+            }
+
+            _size = new_size;
+        } else if(new_size < _size){
+            // Call the necessary destructors
+            for(size_t i = new_size; i < _size; ++i){
+                data[i].~value_type();
+            }
+
+            _size = new_size;
+        }
+    }
+
+    /*!
+     * \brief Add an element at the back of the vector
+     */
+    void push_back(value_type&& element){
+        ensure_capacity(_size + 1);
+
+        new (&data[_size++]) value_type(std::move(element));
+    }
+
+    /*!
+     * \brief Add an element at the back of the vector
+     */
+    void push_back(const value_type& element){
+        ensure_capacity(_size + 1);
+
+        new (&data[_size++]) value_type(element);
+    }
+
+    /*!
+     * \brief Construct a new element inplace
+     */
+    value_type& emplace_back(){
+        ensure_capacity(_size + 1);
+
+        new (&data[_size++]) value_type();
+
+        return back();
+    }
+
+    /*!
+     * \brief Construct a new element inplace
+     */
+    template<typename... Args>
+    value_type& emplace_back(Args... args){
+        ensure_capacity(_size + 1);
+
+        new (&data[_size++]) value_type{std::forward<Args>(args)...};
+
+        return back();
+    }
+
+    /*!
+     * \brief Add an element at the front of the vector
+     */
+    void push_front(value_type&& element){
+        ensure_capacity(_size + 1);
+
+        if(!empty()){
+            new (&data[_size]) value_type(std::move(data[_size - 1]));
+
+            for (size_t i = _size - 1; i > 0; --i) {
+                data[i] = std::move(data[i - 1]);
+            }
+
+            data[0] = std::move(element);
+        } else {
+            new (&data[0]) value_type(std::move(element));
+        }
+
+        ++_size;
+    }
+
+    /*!
+     * \brief Add an element at the front of the vector
+     */
+    void push_front(const value_type& element){
+        ensure_capacity(_size + 1);
+
+        if(!empty()){
+            new (&data[_size]) value_type(std::move(data[_size - 1]));
+
+            for (size_t i = _size - 1; i > 0; --i) {
+                data[i] = std::move(data[i - 1]);
+            }
+
+            data[0] = element;
+        } else {
+            new (&data[0]) value_type(element);
+        }
+
+        ++_size;
+    }
+
+    /*!
+     * \brief Removes the last element of the vector
+     */
+    void pop_back(){
+        --_size;
+
+        // Call the destructor of the erased value
+        data[_size].~value_type();
+    }
+
+    /*!
+     * \brief Removes all the elements of the vector, the storage is kept
+     */
+    void clear(){
+        destruct_all();
+
+        _size = 0;
+    }
+
+    /*!
+     * \brief Erase the element at the given position
+     */
+    void erase(size_t position){
+        for(size_t i = position; i < _size - 1; ++i){
+            data[i] = std::move(data[i+1]);
+        }
+
+        --_size;
+
+        // Call the destructor of the last value
+        data[_size].~value_type();
+    }
+
+    /*!
+     * \brief Erase the element at the given position
+     */
+    void erase(iterator position){
+        erase(size_t(position - begin()));
+    }
+
+    /*!
+     * \brief Erase all the elements of the given range
+     */
+    void erase(iterator first, iterator last){
+        auto n = std::distance(first, last);
+
+        for(size_t i = first - begin(); i < _size - n; ++i){
+            data[i] = std::move(data[i+n]);
+        }
+
+        // Call the destructors on the erase elements
+        for(size_t i = _size - n; i < _size; ++i){
+            data[i].~value_type();
+        }
+
+        _size -= n;
+    }
+
+    //Iterators
+
+    /*!
+     * \brief Return an iterator to point to the first element
+     */
+    iterator begin(){
+        return iterator(&data[0]);
+    }
+
+    /*!
+     * \brief Return an iterator to point to the first element
+     */
+    const_iterator begin() const {
+        return const_iterator(&data[0]);
+    }
+
+    /*!
+     * \brief Return an iterator to point to the past-the-end element
+     */
+    iterator end(){
+        return iterator(&data[_size]);
+    }
+
+    /*!
+     * \brief Return an iterator to point to the past-the-end element
+     */
+    const_iterator end() const {
+        return const_iterator(&data[_size]);
+    }
+
+    /*!
+     * \brief Return a reverse iterator to point to the first element
+     */
+    reverse_iterator rbegin(){
+        return reverse_iterator(&data[_size] - 1);
+    }
+
+    /*!
+     * \brief Return a reverse iterator to point to the first element
+     */
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(&data[_size] - 1);
+    }
+
+    /*!
+     * \brief Return a reverse iterator point to the past-the-end element
+     */
+    reverse_iterator rend(){
+        return reverse_iterator(&data[0] - 1);
+    }
+
+    /*!
+     * \brief Return a reverse iterator point to the past-the-end element
+     */
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(&data[0] - 1);
+    }
+
+    // Relational operators
+
+    bool operator==(const small_vector& rhs) const {
+        if(size() != rhs.size()){
+            return false;
+        }
+
+        for(size_t i = 0; i < size(); ++i){
+            if((*this)[i] != rhs[i]){
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool operator!=(const small_vector& rhs) const {
+        return !(*this == rhs);
+    }
+
+private:
+    T* inline_data(){
+        return reinterpret_cast<T*>(&storage[0]);
+    }
+
+    const T* inline_data() const {
+        return reinterpret_cast<const T*>(&storage[0]);
+    }
+
+    void destruct_all(){
+        // Call the destructors
+        for(size_t i = 0; i< _size; ++i){
+            data[i].~value_type();
+        }
+    }
+
+    void release(){
+        destruct_all();
+
+        if(!is_inline()){
+            allocator_type::deallocate(data, _capacity);
+        }
+
+        _size = 0;
+    }
+
+    // Take the elements of rhs, which is left empty and inline
+    void steal(small_vector& rhs){
+        if(rhs.is_inline()){
+            // The inline elements can only be moved one by one
+            for(size_t i = 0; i < rhs._size; ++i){
+                new (&data[i]) value_type(std::move(rhs.data[i]));
+                rhs.data[i].~value_type();
+            }
+
+            _size = rhs._size;
+        } else {
+            data      = rhs.data;
+            _size     = rhs._size;
+            _capacity = rhs._capacity;
+
+            rhs.data      = rhs.inline_data();
+            rhs._capacity = N;
+        }
+
+        rhs._size = 0;
+    }
+
+    void ensure_capacity(size_t new_capacity){
+        if(_capacity < new_capacity){
+            // Double the current capacity
+            auto next_capacity = _capacity * 2;
+
+            // If not enough, use the given new_capacity
+            if(new_capacity > next_capacity){
+                next_capacity = new_capacity;
+            }
+
+            auto new_data = allocator_type::allocate(next_capacity);
+
+            // Move the old data into the new one
+            for(size_t i = 0; i < _size; ++i){
+                new (&new_data[i]) value_type(std::move(data[i]));
+            }
+
+            auto size = _size;
+
+            release();
+
+            data      = new_data;
+            _size     = size;
+            _capacity = next_capacity;
+        }
+    }
+
+    T* data;            ///< The data storage, inline or allocated
+    uint64_t _size;     ///< The vector size
+    uint64_t _capacity; ///< The data capacity
+
+    alignas(T) char storage[N * sizeof(T)]; ///< The inline storage
+};
+
+} //end of namespace std
+
+#endif
@@ -0,0 +1,157 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <types.hpp>
+#include <atomic.hpp>
+
+/*!
+ * \brief A lock-free bounded ring of S elements, for a single producer and a
+ * single consumer.
+ *
+ * The producer only writes the tail and the consumer only writes the head,
+ * each on its own cache line. Each side keeps a copy of the index of the
+ * other side and only reads it again when the ring looks full or empty.
+ */
+template<typename T, size_t S>
+struct spsc_ring {
+    static_assert(S && !(S & (S - 1)), "The size of the ring must be a power of two");
+
+    /*!
+     * \brief Construct a new empty ring
+     */
+    spsc_ring() : head(0), tail(0), cached_head(0), cached_tail(0) {
+        //Nothing else to init
+    }
+
+    spsc_ring(const spsc_ring& rhs) = delete;
+    spsc_ring& operator=(const spsc_ring& rhs) = delete;
+
+    /*!
+     * \brief Returns the maximum number of elements of the ring
+     */
+    static constexpr size_t capacity(){
+        return S;
+    }
+
+    /*!
+     * \brief Returns the number of elements in the ring, it may be outdated
+     * as soon as it is returned
+     */
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    /*!
+     * \brief Returns true if the ring is empty
+     */
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /*!
+     * \brief Returns true if the ring is full
+     */
+    bool full() const {
+        return size() == S;
+    }
+
+    /*!
+     * \brief Push the given value to the ring, from the producer
+     * \return true if the value was pushed, false if the ring is full
+     */
+    bool push(const T& value){
+        return push(&value, 1) == 1;
+    }
+
+    /*!
+     * \brief Push as many of the n given values as possible, from the producer.
+     *
+     * The values are published at once to the consumer.
+     *
+     * \return The number of values pushed
+     */
+    size_t push(const T* values, size_t n){
+        auto t = tail.load(std::memory_order_relaxed);
+
+        if(S - (t - cached_head) < n){
+            cached_head = head.load(std::memory_order_acquire);
+        }
+
+        auto space = S - (t - cached_head);
+
+        if(n > space){
+            n = space;
+        }
+
+        for(size_t i = 0; i < n; ++i){
+            buffer[(t + i) & MASK] = values[i];
+        }
+
+        if(n){
+            tail.store(t + n, std::memory_order_release);
+        }
+
+        return n;
+    }
+
+    /*!
+     * \brief Pop the oldest value of the ring, from the consumer
+     * \return true if a value was popped, false if the ring is empty
+     */
+    bool pop(T& value){
+        return pop(&value, 1) == 1;
+    }
+
+    /*!
+     * \brief Pop up to n values from the ring, from the consumer.
+     *
+     * The slots are given back at once to the producer.
+     *
+     * \return The number of values popped
+     */
+    size_t pop(T* values, size_t n){
+        auto h = head.load(std::memory_order_relaxed);
+
+        if(cached_tail - h < n){
+            cached_tail = tail.load(std::memory_order_acquire);
+        }
+
+        auto available = cached_tail - h;
+
+        if(n > available){
+            n = available;
+        }
+
+        for(size_t i = 0; i < n; ++i){
+            values[i] = buffer[(h + i) & MASK];
+        }
+
+        if(n){
+            head.store(h + n, std::memory_order_release);
+        }
+
+        return n;
+    }
+
+private:
+    static constexpr const size_t MASK = S - 1; ///< The mask of an index into the buffer
+
+    // The indices are never wrapped, only masked to access the buffer
+
+    alignas(std::hardware_destructive_interference_size) std::atomic<size_t> head; ///< The index of the next element to pop, written by the consumer
+    alignas(std::hardware_destructive_interference_size) std::atomic<size_t> tail; ///< The index of the next element to push, written by the producer
+
+    alignas(std::hardware_destructive_interference_size) size_t cached_head; ///< The head as last seen by the producer
+    alignas(std::hardware_destructive_interference_size) size_t cached_tail; ///< The tail as last seen by the consumer
+
+    alignas(std::hardware_destructive_interference_size) T buffer[S]; ///< The elements
+};
+
+#endif
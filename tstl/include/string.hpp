@@ -13,17 +13,10 @@
 #include <vector.hpp>
 #include <unique_ptr.hpp>
 #include <iterator.hpp>
+#include <string_view.hpp>
 
 namespace std {
 
-inline uint64_t str_len(const char* a){
-    uint64_t length = 0;
-    while(*a++){
-        ++length;
-    }
-    return length;
-}
-
 template<typename CharT>
 struct base_long {
     size_t capacity;
@@ -201,6 +194,13 @@ public:
         (*this)[size()] = '\0';
     }
 
+    /*!
+     * \brief Construct a new string from the characters of the given view
+     */
+    basic_string(std::string_view view) : basic_string(view.begin(), view.end()) {
+        //Nothing else to init
+    }
+
     //Copy
 
     basic_string(const basic_string& rhs) : _size(rhs._size) {
@@ -342,25 +342,26 @@ public:
     }
 
     basic_string& operator+=(const char* rhs){
-        auto len = str_len(rhs);
-
-        ensure_capacity(size() + len + 1);
-
-        std::copy_n(rhs, len, begin() + size());
-
-        set_size(size() + len);
+        return append(rhs, str_len(rhs));
+    }
 
-        (*this)[size()] = '\0';
+    basic_string& operator+=(const basic_string& rhs){
+        return append(rhs.begin(), rhs.size());
+    }
 
-        return *this;
+    basic_string& operator+=(std::string_view rhs){
+        return append(rhs.data(), rhs.size());
     }
 
-    basic_string& operator+=(const basic_string& rhs){
-        ensure_capacity(size() + rhs.size() + 1);
+    /*!
+     * \brief Concatenates the n first characters of s to the current string
+     */
+    basic_string& append(const CharT* s, size_t n){
+        ensure_capacity(size() + n + 1);
 
-        std::copy_n(rhs.begin(), rhs.size(), begin() + size());
+        std::copy_n(s, n, begin() + size());
 
-        set_size(size() + rhs.size());
+        set_size(size() + n);
 
         (*this)[size()] = '\0';
 
@@ -448,6 +449,29 @@ public:
         return npos;
     }
 
+    /*!
+     * \brief Returns the position of the first occurrence of s from pos, npos
+     * if there is none
+     */
+    size_t find(std::string_view s, size_t pos = 0) const {
+        return std::string_view(*this).find(s, pos);
+    }
+
+    /*!
+     * \brief Returns a view of n characters (at most) from the given
+     * position, valid until the string is modified
+     */
+    std::string_view view(size_t pos = 0, size_t n = npos) const {
+        return std::string_view(data_ptr(), size()).substr(pos, n);
+    }
+
+    /*!
+     * \brief Returns a view of the characters, valid until the string is modified
+     */
+    operator std::string_view() const {
+        return {data_ptr(), size()};
+    }
+
     //Operators
 
     /*!
@@ -581,6 +605,24 @@ typedef basic_string<char> string;
 
 static_assert(sizeof(string) == 24, "The size of a string must always be 24 bytes");
 
+// The exact overloads are preferred to the conversions between the strings and the views
+
+inline bool operator==(string_view lhs, const string& rhs){
+    return lhs == string_view(rhs);
+}
+
+inline bool operator==(const string& lhs, string_view rhs){
+    return string_view(lhs) == rhs;
+}
+
+inline bool operator!=(string_view lhs, const string& rhs){
+    return !(lhs == string_view(rhs));
+}
+
+inline bool operator!=(const string& lhs, string_view rhs){
+    return !(string_view(lhs) == rhs);
+}
+
 inline uint64_t parse(const char* it, const char* end){
     int i = end - it - 1;
 
@@ -658,8 +700,31 @@ std::vector<std::basic_string<Char>> split(const std::basic_string<Char>& s, cha
     return std::move(parts);
 }
 
-template<typename Char>
-void split_append(const std::basic_string<Char>& s, std::vector<std::basic_string<Char>>& container, char sep = ' '){
+/*!
+ * \brief Split the given characters on the separator, without copying them.
+ *
+ * The returned views are valid as long as the characters are.
+ */
+inline std::vector<std::string_view> split_view(std::string_view s, char sep = ' '){
+    std::vector<std::string_view> parts;
+
+    size_t start = 0;
+
+    for(size_t i = 0; i <= s.size(); ++i){
+        if(i == s.size() || s[i] == sep){
+            if(i > start){
+                parts.push_back(s.substr(start, i - start));
+            }
+
+            start = i + 1;
+        }
+    }
+
+    return std::move(parts);
+}
+
+template<typename Char, typename Container>
+void split_append(const std::basic_string<Char>& s, Container& container, char sep = ' '){
     std::basic_string<Char> current(s.size());
 
     for(char c : s){
@@ -678,40 +743,90 @@ void split_append(const std::basic_string<Char>& s, std::vector<std::basic_strin
     }
 }
 
-template<typename T>
-std::string to_string(const T& value);
+constexpr const size_t MAX_DECIMAL_DIGITS = 20; ///< The number of decimal digits of the largest uint64_t
+constexpr const size_t MAX_HEX_DIGITS = 16;     ///< The number of hexadecimal digits of the largest uint64_t
 
-template<>
-inline std::string to_string<uint64_t>(const uint64_t& value){
-    if(value == 0){
-        return "0";
+/*!
+ * \brief Write the decimal digits of the value backward, two digits at a time.
+ *
+ * At most MAX_DECIMAL_DIGITS characters are written before end.
+ *
+ * \param value The value to format
+ * \param end The end of the destination
+ * \return A pointer to the first digit
+ */
+inline char* format_decimal(uint64_t value, char* end){
+    static constexpr const char pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    // Each division produces two digits
+    while(value >= 100){
+        auto pair = (value % 100) * 2;
+        value /= 100;
+
+        *--end = pairs[pair + 1];
+        *--end = pairs[pair];
+    }
+
+    if(value >= 10){
+        auto pair = value * 2;
+
+        *--end = pairs[pair + 1];
+        *--end = pairs[pair];
+    } else {
+        *--end = static_cast<char>('0' + value);
     }
 
-    std::string s;
+    return end;
+}
 
-    char buffer[20];
-    int i = 0;
-    auto rem = value;
+/*!
+ * \brief Write the upper case hexadecimal digits of the value backward.
+ *
+ * At most MAX_HEX_DIGITS characters are written before end.
+ *
+ * \param value The value to format
+ * \param end The end of the destination
+ * \return A pointer to the first digit
+ */
+inline char* format_hex(uint64_t value, char* end){
+    static constexpr const char hex_digits[] = "0123456789ABCDEF";
 
-    while(rem != 0){
-        buffer[i++] = '0' + rem  % 10;
-        rem /= 10;
-    }
+    do {
+        *--end = hex_digits[value & 0xF];
+        value >>= 4;
+    } while(value != 0);
 
-    --i;
+    return end;
+}
 
-    for(; i >= 0; --i){
-        s += buffer[i];
-    }
+template<typename T>
+std::string to_string(const T& value);
 
-    return std::move(s);
+template<>
+inline std::string to_string<uint64_t>(const uint64_t& value){
+    char buffer[MAX_DECIMAL_DIGITS];
+    auto end = buffer + MAX_DECIMAL_DIGITS;
+    auto begin = format_decimal(value, end);
+
+    return std::string(begin, end);
 }
 
 template<>
 inline std::string to_string<int64_t>(const int64_t& value){
     if(value < 0){
+        // The magnitude of the smallest value does not fit in int64_t
         std::string s("-");
-        s += to_string(static_cast<uint64_t>(-value));
+        s += to_string(0 - static_cast<uint64_t>(value));
         return std::move(s);
     } else {
         return to_string(static_cast<uint64_t>(value));
@@ -753,41 +868,26 @@ void to_raw_string(const T& value, char* buffer, size_t n);
 
 template<>
 inline void to_raw_string<uint64_t>(const uint64_t& value, char* buffer, size_t n){
-    if(n < 20){
-        //TODO Print an error ?
-        return;
-    }
-
-    if(value == 0){
-        buffer[0] = '0';
-        buffer[1] = '\0';
-        return;
-    }
+    char int_buffer[MAX_DECIMAL_DIGITS];
+    auto end = int_buffer + MAX_DECIMAL_DIGITS;
+    auto begin = format_decimal(value, end);
 
-    char int_buffer[20];
-    int i = 0;
-    auto rem = value;
+    auto length = static_cast<size_t>(end - begin);
 
-    while(rem != 0){
-        int_buffer[i++] = '0' + rem  % 10;
-        rem /= 10;
-    }
-
-    --i;
-
-    size_t j = 0;
-    for(; i >= 0; --i){
-        buffer[j++] = int_buffer[i];
+    if(n < length + 1){
+        //TODO Print an error ?
+        return;
     }
 
-    buffer[j] = '\0';
+    std::copy(begin, end, buffer);
+    buffer[length] = '\0';
 }
 
 template<>
 inline void to_raw_string<int64_t>(const int64_t& value, char* buffer, size_t n){
     if(value < 0){
         *buffer = '-';
-        to_raw_string(static_cast<uint64_t>(-value), buffer + 1, n - 1);
+        to_raw_string(0 - static_cast<uint64_t>(value), buffer + 1, n - 1);
     } else {
         to_raw_string(static_cast<uint64_t>(value), buffer, n);
     }
@@ -823,7 +923,7 @@ inline void to_raw_string<int32_t>(const int32_t& value, char* buffer, size_t n)
     to_raw_string(static_cast<uint64_t>(value), buffer, n);
 }
 
-inline uint64_t atoui(const std::string& s){
+inline uint64_t atoui(std::string_view s){
     uint64_t value = 0;
     uint64_t mul = 1;
 
@@ -0,0 +1,268 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef STRING_VIEW_H
+#define STRING_VIEW_H
+
+#include <types.hpp>
+
+namespace std {
+
+inline uint64_t str_len(const char* a){
+    uint64_t length = 0;
+    while(*a++){
+        ++length;
+    }
+    return length;
+}
+
+/*!
+ * \brief A non-owning view of a sequence of characters.
+ *
+ * The characters are not null-terminated and must outlive the view. The
+ * strings convert to and from views, converting a view to a string copies
+ * its characters.
+ */
+struct string_view {
+    using value_type     = char;        ///< The type of the characters
+    using iterator       = const char*; ///< The iterator type
+    using const_iterator = const char*; ///< The const iterator type
+
+    static constexpr const size_t npos = -1;
+
+    /*!
+     * \brief Construct an empty view
+     */
+    constexpr string_view() : _data(nullptr), _size(0) {}
+
+    /*!
+     * \brief Construct a view of the n first characters of s
+     */
+    constexpr string_view(const char* s, size_t n) : _data(s), _size(n) {}
+
+    /*!
+     * \brief Construct a view of the null-terminated string s
+     */
+    string_view(const char* s) : _data(s), _size(str_len(s)) {}
+
+    /*!
+     * \brief Returns a pointer to the characters, not null-terminated
+     */
+    constexpr const char* data() const {
+        return _data;
+    }
+
+    /*!
+     * \brief Returns the number of characters of the view
+     */
+    constexpr size_t size() const {
+        return _size;
+    }
+
+    /*!
+     * \brief Indicates if the view is empty
+     */
+    constexpr bool empty() const {
+        return _size == 0;
+    }
+
+    /*!
+     * \brief Returns the character at the given position
+     */
+    constexpr char operator[](size_t i) const {
+        return _data[i];
+    }
+
+    /*!
+     * \brief Returns the first character
+     */
+    char front() const {
+        return _data[0];
+    }
+
+    /*!
+     * \brief Returns the last character
+     */
+    char back() const {
+        return _data[_size - 1];
+    }
+
+    /*!
+     * \brief Returns the view of n characters (at most) from the given position
+     */
+    string_view substr(size_t pos, size_t n = npos) const {
+        if(pos > _size){
+            pos = _size;
+        }
+
+        if(n > _size - pos){
+            n = _size - pos;
+        }
+
+        return {_data + pos, n};
+    }
+
+    /*!
+     * \brief Drops the n first characters of the view
+     */
+    void remove_prefix(size_t n){
+        _data += n;
+        _size -= n;
+    }
+
+    /*!
+     * \brief Drops the n last characters of the view
+     */
+    void remove_suffix(size_t n){
+        _size -= n;
+    }
+
+    /*!
+     * \brief Returns the position of the first c from pos, npos if there is none
+     */
+    size_t find(char c, size_t pos = 0) const {
+        for(; pos < _size; ++pos){
+            if(_data[pos] == c){
+                return pos;
+            }
+        }
+
+        return npos;
+    }
+
+    /*!
+     * \brief Returns the position of the first occurrence of the view s from
+     * pos, npos if there is none
+     */
+    size_t find(string_view s, size_t pos = 0) const {
+        if(s._size > _size){
+            return npos;
+        }
+
+        for(; pos + s._size <= _size; ++pos){
+            if(substr(pos, s._size) == s){
+                return pos;
+            }
+        }
+
+        return npos;
+    }
+
+    /*!
+     * \brief Returns the position of the last c before pos (included), npos
+     * if there is none
+     */
+    size_t rfind(char c, size_t pos = npos) const {
+        if(pos >= _size){
+            pos = _size;
+        } else {
+            ++pos;
+        }
+
+        while(pos > 0){
+            if(_data[--pos] == c){
+                return pos;
+            }
+        }
+
+        return npos;
+    }
+
+    /*!
+     * \brief Compares the view with s in lexicographic order
+     * \return a negative value if the view is before s, 0 if they are equal
+     * and a positive value otherwise
+     */
+    int compare(string_view s) const {
+        auto n = _size < s._size ? _size : s._size;
+
+        for(size_t i = 0; i < n; ++i){
+            if(_data[i] != s._data[i]){
+                return static_cast<unsigned char>(_data[i]) < static_cast<unsigned char>(s._data[i]) ? -1 : 1;
+            }
+        }
+
+        if(_size == s._size){
+            return 0;
+        }
+
+        return _size < s._size ? -1 : 1;
+    }
+
+    /*!
+     * \brief Indicates if the view starts with s
+     */
+    bool starts_with(string_view s) const {
+        return _size >= s._size && substr(0, s._size) == s;
+    }
+
+    /*!
+     * \brief Indicates if the view ends with s
+     */
+    bool ends_with(string_view s) const {
+        return _size >= s._size && substr(_size - s._size) == s;
+    }
+
+    /*!
+     * \brief Return an iterator to the first character
+     */
+    const_iterator begin() const {
+        return _data;
+    }
+
+    /*!
+     * \brief Return an iterator past the last character
+     */
+    const_iterator end() const {
+        return _data + _size;
+    }
+
+    /*!
+     * \brief Indicates if the two views have the same characters
+     */
+    friend bool operator==(string_view lhs, string_view rhs){
+        if(lhs._size != rhs._size){
+            return false;
+        }
+
+        for(size_t i = 0; i < lhs._size; ++i){
+            if(lhs._data[i] != rhs._data[i]){
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    friend bool operator!=(string_view lhs, string_view rhs){
+        return !(lhs == rhs);
+    }
+
+    friend bool operator==(string_view lhs, const char* rhs){
+        return lhs == string_view(rhs);
+    }
+
+    friend bool operator==(const char* lhs, string_view rhs){
+        return string_view(lhs) == rhs;
+    }
+
+    friend bool operator!=(string_view lhs, const char* rhs){
+        return !(lhs == string_view(rhs));
+    }
+
+    friend bool operator!=(const char* lhs, string_view rhs){
+        return !(string_view(lhs) == rhs);
+    }
+
+private:
+    const char* _data; ///< The characters
+    size_t _size;      ///< The number of characters
+};
+
+} //end of namespace std
+
+#endif
@@ -0,0 +1,160 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef UNORDERED_MAP_H
+#define UNORDERED_MAP_H
+
+#include <hash.hpp>
+#include <flat_hash_table.hpp>
+
+namespace std {
+
+/*!
+ * \brief An associative container of unique keys, in a flat open
+ * addressing hash table.
+ *
+ * Unlike the standard one, the values move when the table grows or when
+ * a value is erased, the pointers and the iterators to the values are
+ * then invalidated.
+ */
+template<typename K, typename V, typename Hash = std::hash<K>>
+struct unordered_map {
+    using key_type    = K;                     ///< The key type
+    using mapped_type = V;                     ///< The mapped type
+    using value_type  = std::pair<const K, V>; ///< The value type
+    using size_type   = size_t;                ///< The size type
+
+private:
+    struct key_of {
+        const K& operator()(const value_type& value) const {
+            return value.first;
+        }
+    };
+
+    using table_type = flat_hash_table<value_type, K, key_of, Hash>;
+
+public:
+    using iterator       = typename table_type::iterator;       ///< The iterator type
+    using const_iterator = typename table_type::const_iterator; ///< The const iterator type
+
+    /*!
+     * \brief Returns the number of values in the map
+     */
+    size_t size() const {
+        return table.size();
+    }
+
+    /*!
+     * \brief Indicates if the map is empty
+     */
+    bool empty() const {
+        return table.empty();
+    }
+
+    /*!
+     * \brief Returns an iterator to the value of the key, or end()
+     */
+    iterator find(const K& key){
+        return table.find(key);
+    }
+
+    /*!
+     * \brief Returns an iterator to the value of the key, or end()
+     */
+    const_iterator find(const K& key) const {
+        return table.find(key);
+    }
+
+    /*!
+     * \brief Returns the number of values with the given key (0 or 1)
+     */
+    size_t count(const K& key) const {
+        return table.find_position(key) != table.capacity() ? 1 : 0;
+    }
+
+    /*!
+     * \brief Insert the value, unless its key is already present
+     * \return an iterator to the value of the key, and true if the value was inserted
+     */
+    std::pair<iterator, bool> insert(const value_type& value){
+        return table.insert(value);
+    }
+
+    /*!
+     * \brief Insert the value, unless its key is already present
+     * \return an iterator to the value of the key, and true if the value was inserted
+     */
+    std::pair<iterator, bool> insert(value_type&& value){
+        return table.insert(std::move(value));
+    }
+
+    /*!
+     * \brief Returns the value of the key, inserted default constructed if not present
+     */
+    V& operator[](const K& key){
+        auto it = table.find(key);
+
+        if(it == table.end()){
+            it = table.insert(value_type(key, V())).first;
+        }
+
+        return it->second;
+    }
+
+    /*!
+     * \brief Erase the value of the key
+     * \return the number of erased values
+     */
+    size_t erase(const K& key){
+        return table.erase(key);
+    }
+
+    /*!
+     * \brief Erase the value at the iterator, see flat_hash_table::erase
+     * \return an iterator to the value now following the erased one
+     */
+    iterator erase(iterator it){
+        return table.erase(it);
+    }
+
+    /*!
+     * \brief Remove all the values
+     */
+    void clear(){
+        table.clear();
+    }
+
+    /*!
+     * \brief Make room for n values
+     */
+    void reserve(size_t n){
+        table.reserve(n);
+    }
+
+    iterator begin(){
+        return table.begin();
+    }
+
+    const_iterator begin() const {
+        return table.begin();
+    }
+
+    iterator end(){
+        return table.end();
+    }
+
+    const_iterator end() const {
+        return table.end();
+    }
+
+private:
+    table_type table; ///< The hash table
+};
+
+} //end of namespace std
+
+#endif
@@ -0,0 +1,122 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef UNORDERED_SET_H
+#define UNORDERED_SET_H
+
+#include <hash.hpp>
+#include <flat_hash_table.hpp>
+
+namespace std {
+
+/*!
+ * \brief A set of unique values, in a flat open addressing hash table.
+ *
+ * Unlike the standard one, the values move when the table grows or when
+ * a value is erased, the pointers and the iterators to the values are
+ * then invalidated.
+ */
+template<typename T, typename Hash = std::hash<T>>
+struct unordered_set {
+    using key_type   = T;      ///< The key type
+    using value_type = T;      ///< The value type
+    using size_type  = size_t; ///< The size type
+
+private:
+    struct key_of {
+        const T& operator()(const T& value) const {
+            return value;
+        }
+    };
+
+    using table_type = flat_hash_table<T, T, key_of, Hash>;
+
+public:
+    using iterator       = typename table_type::const_iterator; ///< The iterator type, the values cannot be modified
+    using const_iterator = typename table_type::const_iterator; ///< The const iterator type
+
+    /*!
+     * \brief Returns the number of values in the set
+     */
+    size_t size() const {
+        return table.size();
+    }
+
+    /*!
+     * \brief Indicates if the set is empty
+     */
+    bool empty() const {
+        return table.empty();
+    }
+
+    /*!
+     * \brief Returns an iterator to the value, or end()
+     */
+    const_iterator find(const T& value) const {
+        return table.find(value);
+    }
+
+    /*!
+     * \brief Returns the number of times the value is in the set (0 or 1)
+     */
+    size_t count(const T& value) const {
+        return table.find_position(value) != table.capacity() ? 1 : 0;
+    }
+
+    /*!
+     * \brief Insert the value, unless it is already present
+     * \return true if the value was inserted
+     */
+    bool insert(const T& value){
+        return table.insert(value).second;
+    }
+
+    /*!
+     * \brief Insert the value, unless it is already present
+     * \return true if the value was inserted
+     */
+    bool insert(T&& value){
+        return table.insert(std::move(value)).second;
+    }
+
+    /*!
+     * \brief Erase the value
+     * \return the number of erased values
+     */
+    size_t erase(const T& value){
+        return table.erase(value);
+    }
+
+    /*!
+     * \brief Remove all the values
+     */
+    void clear(){
+        table.clear();
+    }
+
+    /*!
+     * \brief Make room for n values
+     */
+    void reserve(size_t n){
+        table.reserve(n);
+    }
+
+    const_iterator begin() const {
+        return table.begin();
+    }
+
+    const_iterator end() const {
+        return table.end();
+    }
+
+private:
+    table_type table; ///< The hash table
+};
+
+} //end of namespace std
+
+#endif
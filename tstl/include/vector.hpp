@@ -13,15 +13,17 @@
 #include <algorithms.hpp>
 #include <new.hpp>
 #include <iterator.hpp>
+#include <allocator.hpp>
 
 namespace std {
 
 /*!
  * \brief A contiguous container of elements, automatically increasing.
  */
-template<typename T>
+template<typename T, typename Allocator = heap_allocator<T>>
 struct vector {
     using value_type           = T;                 ///< The value type contained in the vector
+    using allocator_type       = Allocator;         ///< The allocator of the storage
     using pointer_type         = value_type*;       ///< The pointer type contained in the vector
     using reference_type       = value_type&;       ///< The pointer type contained in the vector
     using const_reference_type = const value_type&; ///< The pointer type contained in the vector
@@ -445,11 +447,11 @@ struct vector {
 
 private:
     static value_type* allocate(size_t n){
-        return reinterpret_cast<value_type*>(new uint8_t[n * sizeof(value_type)]);
+        return allocator_type::allocate(n);
     }
 
-    static void deallocate(value_type* ptr){
-        delete[] reinterpret_cast<uint8_t*>(ptr);
+    static void deallocate(value_type* ptr, size_t n){
+        allocator_type::deallocate(ptr, n);
     }
 
     void destruct_all(){
@@ -463,7 +465,7 @@ private:
         destruct_all();
 
         // Deallocate the memory
-        deallocate(data);
+        deallocate(data, _capacity);
         data = nullptr;
     }
 
@@ -473,14 +475,14 @@ private:
             data = allocate(_capacity);
         } else if(_capacity < new_capacity){
             // Double the current capacity
-            _capacity= _capacity * 2;
+            auto next_capacity = _capacity * 2;
 
             // If not enough, use the given new_capacity
-            if(new_capacity > _capacity){
-                _capacity = new_capacity;
+            if(new_capacity > next_capacity){
+                next_capacity = new_capacity;
             }
 
-            auto new_data = allocate(_capacity);
+            auto new_data = allocate(next_capacity);
 
             // Move the old data into the new one
             for(size_t i = 0; i < _size; ++i){
@@ -490,6 +492,7 @@ private:
             release();
 
             data = new_data;
+            _capacity = next_capacity;
         }
     }
 
@@ -11,6 +11,8 @@
 
 #include <type_traits.hpp>
 #include <string.hpp>
+#include <vector.hpp>
+#include <deque.hpp>
 
 #include "test.hpp"
 
@@ -162,6 +164,191 @@ void test_fill_n_3(){
     check(test[3].a == 99, "Invalid fill_n");
 }
 
+// Each size tier of the memory operations
+void test_memory_tiers(){
+    const size_t sizes[] = {0, 1, 7, 63, 64, 65, 1000, 4096 + 3, std::mem::STREAM_BYTES + 77};
+
+    auto source = new char[std::mem::STREAM_BYTES + 128];
+    auto dest = new char[std::mem::STREAM_BYTES + 128];
+
+    for(size_t i = 0; i < std::mem::STREAM_BYTES + 128; ++i){
+        source[i] = i * 7;
+    }
+
+    for(auto size : sizes){
+        // Misaligned on purpose
+        std::fill_n(dest, std::mem::STREAM_BYTES + 128, 0);
+        std::copy_n(source + 3, size, dest + 1);
+
+        check(dest[0] == 0, "Invalid memcpy");
+        for(size_t i = 0; i < size; ++i){
+            check(dest[i + 1] == source[i + 3], "Invalid memcpy");
+        }
+        check(dest[size + 1] == 0, "Invalid memcpy");
+
+        std::fill_n(dest + 5, size, 'T');
+
+        check(dest[4] == (size >= 4 ? source[6] : 0), "Invalid fill_n");
+        for(size_t i = 0; i < size; ++i){
+            check(dest[i + 5] == 'T', "Invalid fill_n");
+        }
+    }
+
+    delete[] source;
+    delete[] dest;
+}
+
+// The inputs of the sort tests, with the usual patterns
+std::vector<int> sort_input(size_t n, size_t pattern){
+    std::vector<int> values;
+
+    unsigned seed = 42;
+
+    for(size_t i = 0; i < n; ++i){
+        seed = seed * 1103515245 + 12345;
+
+        switch(pattern){
+            case 0: // Random
+                values.push_back((seed >> 8) % 1000);
+                break;
+            case 1: // Sorted
+                values.push_back(i);
+                break;
+            case 2: // Reversed
+                values.push_back(n - i);
+                break;
+            case 3: // Equal
+                values.push_back(7);
+                break;
+            default: // Organ pipe
+                values.push_back(i < n / 2 ? i : n - i);
+                break;
+        }
+    }
+
+    return values;
+}
+
+bool is_sorted(const std::vector<int>& values){
+    for(size_t i = 1; i < values.size(); ++i){
+        if(values[i] < values[i - 1]){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+long sum(const std::vector<int>& values){
+    long total = 0;
+
+    for(auto value : values){
+        total += value;
+    }
+
+    return total;
+}
+
+void test_sort(){
+    const size_t sizes[] = {0, 1, 2, 15, 17, 100, 1000, 10000};
+
+    for(auto n : sizes){
+        for(size_t pattern = 0; pattern < 5; ++pattern){
+            auto values = sort_input(n, pattern);
+            auto total = sum(values);
+
+            std::sort(values.begin(), values.end());
+
+            check(is_sorted(values), "Invalid sort");
+            check(sum(values) == total, "Invalid sort");
+        }
+    }
+
+    auto values = sort_input(1000, 0);
+
+    std::sort(values.begin(), values.end(), [](int a, int b){ return a > b; });
+
+    for(size_t i = 1; i < values.size(); ++i){
+        check(values[i] <= values[i - 1], "Invalid sort");
+    }
+}
+
+void test_sort_deque(){
+    std::deque<int> values;
+
+    for(int i = 0; i < 100; ++i){
+        values.push_back((i * 37) % 100);
+    }
+
+    std::sort(values.begin(), values.end());
+
+    for(int i = 0; i < 100; ++i){
+        check(values[i] == i, "Invalid sort (deque)");
+    }
+}
+
+struct keyed {
+    int key;
+    int index;
+};
+
+void test_stable_sort(){
+    std::vector<keyed> values;
+
+    for(int i = 0; i < 1000; ++i){
+        values.push_back({(i * 7919) % 13, i});
+    }
+
+    std::stable_sort(values.begin(), values.end(), [](const keyed& a, const keyed& b){ return a.key < b.key; });
+
+    for(size_t i = 1; i < values.size(); ++i){
+        check(values[i - 1].key <= values[i].key, "Invalid stable_sort");
+
+        if(values[i - 1].key == values[i].key){
+            check(values[i - 1].index < values[i].index, "Invalid stable_sort (not stable)");
+        }
+    }
+
+    auto small = sort_input(10, 2);
+
+    std::stable_sort(small.begin(), small.end());
+
+    check(is_sorted(small), "Invalid stable_sort");
+}
+
+void test_partial_sort(){
+    auto values = sort_input(1000, 0);
+    auto sorted = values;
+
+    std::sort(sorted.begin(), sorted.end());
+    std::partial_sort(values.begin(), values.begin() + 50, values.end());
+
+    for(size_t i = 0; i < 50; ++i){
+        check(values[i] == sorted[i], "Invalid partial_sort");
+    }
+}
+
+void test_nth_element(){
+    for(size_t pattern = 0; pattern < 5; ++pattern){
+        auto values = sort_input(1000, pattern);
+        auto sorted = values;
+
+        std::sort(sorted.begin(), sorted.end());
+
+        for(size_t nth : {0, 1, 499, 998, 999}){
+            auto copy = values;
+
+            std::nth_element(copy.begin(), copy.begin() + nth, copy.end());
+
+            check(copy[nth] == sorted[nth], "Invalid nth_element");
+
+            for(size_t i = 0; i < copy.size(); ++i){
+                check(i <= nth ? copy[i] <= copy[nth] : copy[i] >= copy[nth], "Invalid nth_element");
+            }
+        }
+    }
+}
+
 } //end of anonymous namespace
 
 void algorithms_tests(){
@@ -173,4 +360,10 @@ void algorithms_tests(){
     test_fill_n_3();
     test_clear();
     test_clear_n();
+    test_memory_tiers();
+    test_sort();
+    test_sort_deque();
+    test_stable_sort();
+    test_partial_sort();
+    test_nth_element();
 }
@@ -10,6 +10,7 @@
 #include <cstdlib>
 
 #include <deque.hpp>
+#include <unique_ptr.hpp>
 
 #include "test.hpp"
 
@@ -31,6 +32,18 @@ void test_base(){
     check(a.back() == 4, "test_base: invalid back()");
 }
 
+void test_empty(){
+    std::deque<int> a;
+
+    check(a.empty(), "test_empty: Invalid deque:empty");
+
+    a.push_back(1);
+    check(!a.empty(), "test_empty: Invalid deque:empty");
+
+    a.pop_front();
+    check(a.empty(), "test_empty: Invalid deque:empty");
+}
+
 void test_erase(){
     std::deque<int> a{1, 0, 0, 2, 3, 4};
 
@@ -254,10 +267,106 @@ void test_lots() {
     check_equals(vec.back(), 10000, "test_lots: invalid back()");
 }
 
+void test_queue_reuse() {
+    std::deque<size_t> queue;
+
+    for(size_t i = 0; i < 100; ++i){
+        queue.push_back(i);
+    }
+
+    auto capacity = queue.max_size();
+
+    // Used as a queue, the emptied blocks are reused at the back
+    for(size_t i = 100; i < 100000; ++i){
+        queue.push_back(i);
+
+        check_equals(queue.front(), i - 100, "queue_reuse: invalid front()");
+
+        queue.pop_front();
+    }
+
+    check_equals(queue.size(), 100, "queue_reuse: invalid size()");
+    check(queue.max_size() <= 4 * capacity, "queue_reuse: the deque should not grow");
+
+    for(size_t i = 0; i < 100; ++i){
+        check_equals(queue[i], 99900 + i, "queue_reuse: invalid []");
+    }
+
+    // The same in the other direction
+    for(size_t i = 0; i < 100000; ++i){
+        queue.push_front(i);
+        queue.pop_back();
+    }
+
+    check_equals(queue.size(), 100, "queue_reuse: invalid size()");
+    check(queue.max_size() <= 4 * capacity, "queue_reuse: the deque should not grow");
+    check_equals(queue.front(), 99999, "queue_reuse: invalid front()");
+    check_equals(queue.back(), 99900, "queue_reuse: invalid back()");
+}
+
+void test_stable_references() {
+    std::deque<size_t> vec;
+
+    vec.push_back(42);
+    vec.push_front(21);
+
+    auto& a = vec.front();
+    auto& b = vec.back();
+
+    for(size_t i = 0; i < 1000; ++i){
+        vec.push_back(i);
+        vec.push_front(i);
+    }
+
+    check(&a == &vec[999 + 1], "stable_references: the front element moved");
+    check(&b == &vec[1000 + 1], "stable_references: the back element moved");
+    check_equals(a, 21, "stable_references: invalid front element");
+    check_equals(b, 42, "stable_references: invalid back element");
+}
+
+void test_move_only() {
+    std::deque<std::unique_ptr<size_t>> vec;
+
+    for(size_t i = 0; i < 100; ++i){
+        vec.push_back(std::make_unique<size_t>(i));
+        vec.emplace_front(new size_t(1000 + i));
+    }
+
+    check_equals(vec.size(), 200, "move_only: invalid size()");
+    check_equals(*vec.front(), 1099, "move_only: invalid front()");
+    check_equals(*vec.back(), 99, "move_only: invalid back()");
+
+    vec.erase(vec.begin());
+
+    check_equals(*vec.front(), 1098, "move_only: invalid erase()");
+
+    vec.pop_back();
+
+    check_equals(*vec.back(), 98, "move_only: invalid pop_back()");
+}
+
+void test_block_size() {
+    std::deque<size_t, std::heap_allocator<size_t>, 4> vec;
+
+    for(size_t i = 0; i < 100; ++i){
+        vec.push_back(i);
+        vec.push_front(i);
+    }
+
+    check_equals(vec.size(), 200, "block_size: invalid size()");
+    check_equals(vec.max_size() % 4, 0, "block_size: invalid blocks");
+
+    for(size_t i = 0; i < 100; ++i){
+        check_equals(vec[i], 99 - i, "block_size: invalid []");
+        check_equals(vec[100 + i], i, "block_size: invalid []");
+    }
+}
+
 } //end of anonymous namespace
 
 void deque_tests(){
     test_base();
+    test_empty();
     test_erase();
     test_erase_range();
     test_erase_remove();
@@ -269,4 +378,8 @@ void deque_tests(){
     test_clear();
     test_pop_back_dst();
     test_lots();
+    test_queue_reuse();
+    test_stable_references();
+    test_move_only();
+    test_block_size();
 }
@@ -7,7 +7,6 @@
 
 #include <cstdio>
 #include <cstring>
-#include <new>
 
 #include <function.hpp>
 
@@ -53,10 +52,82 @@ void test_lambda_state(){
     check(a == 4, "function: lambda error");
 }
 
+void test_heap(){
+    size_t a = 1, b = 2, c = 3, d = 4;
+
+    auto l = [a, b, c, d](){ return a + b + c + d; };
+    std::function<size_t()> f(l);
+
+    check(sizeof(l) > std::function<size_t()>::INLINE_SIZE, "function: heap error");
+    check(f() == 10, "function: heap error");
+}
+
+struct counted {
+    int* count;
+
+    counted(int* count) : count(count) {
+        ++*count;
+    }
+
+    counted(counted&& rhs) : count(rhs.count) {
+        ++*count;
+    }
+
+    ~counted(){
+        --*count;
+    }
+
+    int operator()() const {
+        return *count;
+    }
+};
+
+void test_move(){
+    int count = 0;
+
+    {
+        std::function<int()> f(counted{&count});
+        check(count == 1, "function: destructor error");
+        check(bool(f), "function: bool error");
+
+        std::function<int()> g(std::move(f));
+        check(!f, "function: move error");
+        check(g() == 1, "function: move error");
+
+        std::function<int()> h;
+        check(!h, "function: bool error");
+
+        h = std::move(g);
+        check(!g, "function: move error");
+        check(h() == 1, "function: move error");
+    }
+
+    check(count == 0, "function: destructor error");
+}
+
+int call(std::function_ref<int(int&)> f, int& a){
+    return f(a);
+}
+
+void test_function_ref(){
+    int a = 1;
+
+    check(call(foo, a) == 2, "function_ref: function error");
+
+    int b = 10;
+    auto l = [&b](int& ref){ ref += b; return ref; };
+
+    check(call(l, a) == 12, "function_ref: lambda error");
+    check(call([](int& ref){ return ref * 2; }, a) == 24, "function_ref: lambda error");
+}
+
 } //end of anonymous namespace
 
 void function_tests(){
     test_function_ptr();
     test_lambda();
     test_lambda_state();
+    test_heap();
+    test_move();
+    test_function_ref();
 }
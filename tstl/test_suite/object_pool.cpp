@@ -0,0 +1,186 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <cstring>
+
+#include <object_pool.hpp>
+#include <vector.hpp>
+#include <deque.hpp>
+#include <list.hpp>
+
+#include "test.hpp"
+
+namespace {
+
+struct counted {
+    static int instances;
+
+    size_t a;
+    size_t b;
+
+    counted(size_t a, size_t b) : a(a), b(b) {
+        ++instances;
+    }
+
+    ~counted(){
+        --instances;
+    }
+};
+
+int counted::instances = 0;
+
+void test_base(){
+    std::object_pool<counted> pool;
+
+    check_equals(pool.used(), 0, "test_base: invalid used()");
+    check_equals(pool.allocated(), 0, "test_base: invalid allocated()");
+
+    auto a = pool.create(1, 2);
+    auto b = pool.create(3, 4);
+
+    check(a != b, "test_base: invalid create()");
+    check_equals(a->a, 1, "test_base: invalid create()");
+    check_equals(b->b, 4, "test_base: invalid create()");
+    check_equals(counted::instances, 2, "test_base: invalid create()");
+    check_equals(pool.used(), 2, "test_base: invalid used()");
+    check(pool.allocated() >= 2, "test_base: invalid allocated()");
+
+    pool.destroy(a);
+
+    check_equals(counted::instances, 1, "test_base: invalid destroy()");
+    check_equals(pool.used(), 1, "test_base: invalid used()");
+
+    // The last released slot is recycled first
+    auto c = pool.create(5, 6);
+
+    check(c == a, "test_base: the slot is not recycled");
+
+    pool.destroy(b);
+    pool.destroy(c);
+
+    check_equals(counted::instances, 0, "test_base: invalid destroy()");
+    check_equals(pool.used(), 0, "test_base: invalid used()");
+}
+
+void test_grow(){
+    std::object_pool<counted> pool;
+
+    counted* objects[1000];
+
+    for(size_t i = 0; i < 1000; ++i){
+        objects[i] = pool.create(i, 2 * i);
+    }
+
+    check(pool.allocated() >= 1000, "test_grow: invalid allocated()");
+    check_equals(pool.used(), 1000, "test_grow: invalid used()");
+
+    for(size_t i = 0; i < 1000; ++i){
+        check_equals(objects[i]->a, i, "test_grow: invalid object");
+        check_equals(objects[i]->b, 2 * i, "test_grow: invalid object");
+    }
+
+    auto allocated = pool.allocated();
+
+    for(size_t i = 0; i < 1000; ++i){
+        pool.destroy(objects[i]);
+    }
+
+    for(size_t i = 0; i < 1000; ++i){
+        objects[i] = pool.create(i, i);
+    }
+
+    check_equals(pool.allocated(), allocated, "test_grow: the slots are not recycled");
+
+    for(size_t i = 0; i < 1000; ++i){
+        pool.destroy(objects[i]);
+    }
+}
+
+void test_large(){
+    struct large {
+        char bytes[8000];
+    };
+
+    std::object_pool<large> pool;
+
+    auto a = pool.allocate();
+    auto b = pool.allocate();
+
+    a->bytes[7999] = 1;
+    b->bytes[7999] = 2;
+
+    check(a != b, "test_large: invalid allocate()");
+    check_equals(a->bytes[7999], 1, "test_large: invalid allocate()");
+    check_equals(pool.allocated(), 2, "test_large: invalid allocated()");
+
+    pool.deallocate(a);
+    pool.deallocate(b);
+}
+
+void test_list(){
+    std::list<size_t, std::pool_allocator<size_t>> a;
+
+    for(size_t i = 0; i < 100; ++i){
+        a.push_back(i);
+    }
+
+    check_equals(a.size(), 100, "test_list: invalid size()");
+    check_equals(a.front(), 0, "test_list: invalid front()");
+    check_equals(a.back(), 99, "test_list: invalid back()");
+
+    a.clear();
+
+    for(size_t i = 0; i < 50; ++i){
+        a.push_front(i);
+    }
+
+    check_equals(a.front(), 49, "test_list: invalid front()");
+    check_equals(a.back(), 0, "test_list: invalid back()");
+}
+
+void test_deque(){
+    std::deque<size_t, std::pool_allocator<size_t>> a;
+
+    for(size_t i = 0; i < 100; ++i){
+        a.push_back(i);
+        a.push_front(i);
+    }
+
+    check_equals(a.size(), 200, "test_deque: invalid size()");
+    check_equals(a.front(), 99, "test_deque: invalid front()");
+    check_equals(a.back(), 99, "test_deque: invalid back()");
+    check_equals(a[100], 0, "test_deque: invalid []");
+}
+
+void test_vector(){
+    std::vector<size_t, std::pool_allocator<size_t>> a;
+
+    for(size_t i = 0; i < 100; ++i){
+        a.push_back(i);
+    }
+
+    check_equals(a.size(), 100, "test_vector: invalid size()");
+    check_equals(a[0], 0, "test_vector: invalid []");
+    check_equals(a[99], 99, "test_vector: invalid []");
+
+    std::vector<size_t, std::pool_allocator<size_t>> b(std::move(a));
+
+    check_equals(b.size(), 100, "test_vector: invalid move");
+    check_equals(b[50], 50, "test_vector: invalid move");
+}
+
+} //end of anonymous namespace
+
+void object_pool_tests(){
+    test_base();
+    test_grow();
+    test_large();
+    test_list();
+    test_deque();
+    test_vector();
+}
@@ -0,0 +1,258 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <spsc_ring.hpp>
+#include <mpmc_ring.hpp>
+
+#include "test.hpp"
+
+namespace {
+
+constexpr const size_t ITEMS = 200000; ///< The number of values pushed by each producer of the stress tests
+constexpr const size_t THREADS = 4;    ///< The number of producers and of consumers of the MPMC stress test
+
+void spsc_base_test(){
+    spsc_ring<size_t, 4> ring;
+
+    check(ring.empty());
+    check(!ring.full());
+    check_equals(ring.capacity(), 4, "Invalid capacity");
+
+    check(ring.push(11));
+    check(ring.push(22));
+    check(ring.push(33));
+    check(ring.push(44));
+
+    check(ring.full());
+    check(!ring.push(55), "The ring should be full");
+
+    size_t value = 0;
+
+    check(ring.pop(value));
+    check_equals(value, 11, "Invalid pop");
+
+    check(ring.push(55));
+
+    check(ring.pop(value));
+    check_equals(value, 22, "Invalid pop");
+    check(ring.pop(value));
+    check_equals(value, 33, "Invalid pop");
+    check(ring.pop(value));
+    check_equals(value, 44, "Invalid pop");
+    check(ring.pop(value));
+    check_equals(value, 55, "Invalid pop");
+
+    check(ring.empty());
+    check(!ring.pop(value), "The ring should be empty");
+}
+
+void spsc_batch_test(){
+    spsc_ring<size_t, 8> ring;
+
+    size_t values[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+    check_equals(ring.push(values, 5), 5, "Invalid batch push");
+    check_equals(ring.push(values + 5, 5), 3, "The batch push should be truncated");
+    check(ring.full());
+
+    size_t out[10] = {};
+
+    check_equals(ring.pop(out, 3), 3, "Invalid batch pop");
+    check_equals(out[0], 1, "Invalid batch pop");
+    check_equals(out[2], 3, "Invalid batch pop");
+
+    check_equals(ring.pop(out, 10), 5, "The batch pop should be truncated");
+    check_equals(out[0], 4, "Invalid batch pop");
+    check_equals(out[4], 8, "Invalid batch pop");
+
+    check(ring.empty());
+}
+
+void mpmc_base_test(){
+    mpmc_ring<size_t, 4> ring;
+
+    check(ring.empty());
+
+    check(ring.push(11));
+    check(ring.push(22));
+    check(ring.push(33));
+    check(ring.push(44));
+    check(!ring.push(55), "The ring should be full");
+
+    size_t value = 0;
+
+    check(ring.pop(value));
+    check_equals(value, 11, "Invalid pop");
+
+    check(ring.push(55));
+
+    size_t out[8] = {};
+
+    check_equals(ring.pop(out, 8), 4, "The batch pop should be truncated");
+    check_equals(out[0], 22, "Invalid batch pop");
+    check_equals(out[3], 55, "Invalid batch pop");
+
+    check(ring.empty());
+    check(!ring.pop(value), "The ring should be empty");
+}
+
+// The SPSC stress test
+
+spsc_ring<size_t, 64> spsc;
+
+void* spsc_producer(void*){
+    size_t batch[7];
+
+    for(size_t i = 0; i < ITEMS;){
+        size_t n = 0;
+
+        while(n < 7 && i + n < ITEMS){
+            batch[n] = i + n;
+            ++n;
+        }
+
+        auto pushed = spsc.push(batch, n);
+
+        // Let the consumer run when the ring is full
+        if(!pushed){
+            sched_yield();
+        }
+
+        i += pushed;
+    }
+
+    return nullptr;
+}
+
+void spsc_stress_test(){
+    pthread_t producer;
+    pthread_create(&producer, nullptr, spsc_producer, nullptr);
+
+    size_t expected = 0;
+    bool ordered = true;
+
+    size_t batch[5];
+
+    while(expected < ITEMS){
+        auto n = spsc.pop(batch, 5);
+
+        if(!n){
+            sched_yield();
+        }
+
+        for(size_t i = 0; i < n; ++i){
+            ordered &= batch[i] == expected++;
+        }
+    }
+
+    pthread_join(producer, nullptr);
+
+    check(ordered, "The values must be popped in order");
+    check(spsc.empty());
+}
+
+// The MPMC stress test
+
+mpmc_ring<size_t, 128> mpmc;
+
+std::atomic<size_t> consumed(0); ///< The number of values popped by all the consumers
+
+size_t sums[THREADS];   ///< The sum of the values popped by each consumer
+bool orders[THREADS];   ///< Indicates if each consumer saw the values of each producer in order
+
+void* mpmc_producer(void* data){
+    auto id = reinterpret_cast<size_t>(data);
+
+    for(size_t i = 0; i < ITEMS;){
+        // The producer is in the high bits, the value is in the low bits
+        if(mpmc.push((id << 32) | i)){
+            ++i;
+        } else {
+            sched_yield();
+        }
+    }
+
+    return nullptr;
+}
+
+void* mpmc_consumer(void* data){
+    auto id = reinterpret_cast<size_t>(data);
+
+    size_t last[THREADS];
+
+    for(size_t i = 0; i < THREADS; ++i){
+        last[i] = ~size_t(0);
+    }
+
+    sums[id] = 0;
+    orders[id] = true;
+
+    while(consumed.load(std::memory_order_relaxed) < THREADS * ITEMS){
+        size_t value;
+
+        if(mpmc.pop(value)){
+            auto producer = value >> 32;
+            auto i = value & 0xFFFFFFFF;
+
+            // The values of a producer are popped in order by a consumer
+            orders[id] &= last[producer] == ~size_t(0) || last[producer] < i;
+            last[producer] = i;
+
+            sums[id] += i;
+
+            consumed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            sched_yield();
+        }
+    }
+
+    return nullptr;
+}
+
+void mpmc_stress_test(){
+    pthread_t producers[THREADS];
+    pthread_t consumers[THREADS];
+
+    for(size_t i = 0; i < THREADS; ++i){
+        pthread_create(&consumers[i], nullptr, mpmc_consumer, reinterpret_cast<void*>(i));
+        pthread_create(&producers[i], nullptr, mpmc_producer, reinterpret_cast<void*>(i));
+    }
+
+    for(size_t i = 0; i < THREADS; ++i){
+        pthread_join(producers[i], nullptr);
+        pthread_join(consumers[i], nullptr);
+    }
+
+    size_t sum = 0;
+    bool ordered = true;
+
+    for(size_t i = 0; i < THREADS; ++i){
+        sum += sums[i];
+        ordered &= orders[i];
+    }
+
+    check_equals(consumed.load(), THREADS * ITEMS, "All the values must be popped");
+    check_equals(sum, THREADS * (ITEMS * (ITEMS - 1) / 2), "Each value must be popped exactly once");
+    check(ordered, "The values of a producer must be popped in order");
+    check(mpmc.empty());
+}
+
+} //end of anonymous namespace
+
+void rings_tests(){
+    spsc_base_test();
+    spsc_batch_test();
+    mpmc_base_test();
+    spsc_stress_test();
+    mpmc_stress_test();
+}
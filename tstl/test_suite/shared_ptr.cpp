@@ -9,6 +9,7 @@
 #include <cstring>
 
 #include <shared_ptr.hpp>
+#include <intrusive_ptr.hpp>
 
 #include "test.hpp"
 
@@ -76,6 +77,43 @@ void test_make_shared() {
     check(counter == 1, "make_shared: Invalid destructors");
 }
 
+struct counted_kiss : std::intrusive_ref_counter<counted_kiss> {
+    int* ref;
+    counted_kiss(int* ref) : ref(ref) {}
+    ~counted_kiss(){
+        ++(*ref);
+    }
+};
+
+void test_intrusive() {
+    int counter = 0;
+
+    {
+        auto a = std::make_intrusive<counted_kiss>(&counter);
+        auto b = a;
+
+        std::intrusive_ptr<counted_kiss> c;
+        check(!c, "intrusive: Invalid bool");
+
+        c = a;
+        check(c == a, "intrusive: Invalid copy");
+
+        auto d = std::move(b);
+        check(!b && d == a, "intrusive: Invalid move");
+
+        // A new pointer from the raw pointer shares the same counter
+        std::intrusive_ptr<counted_kiss> e(a.get());
+
+        a = nullptr;
+        c = nullptr;
+
+        check(counter == 0, "intrusive: Invalid destructors");
+        check(e.get()->ref == &counter, "intrusive: Invalid get");
+    }
+
+    check(counter == 1, "intrusive: Invalid destructors");
+}
+
 } //end of anonymous namespace
 
 void shared_ptr_tests(){
@@ -83,4 +121,5 @@ void shared_ptr_tests(){
     test_struct();
     test_destructor();
     test_make_shared();
+    test_intrusive();
 }
@@ -0,0 +1,110 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include <small_vector.hpp>
+#include <string.hpp>
+
+#include "test.hpp"
+
+namespace {
+
+void test_inline(){
+    std::small_vector<size_t, 4> a;
+
+    check(a.empty(), "Invalid small_vector:empty");
+    check(a.is_inline(), "Invalid small_vector:is_inline");
+    check_equals(a.capacity(), 4, "Invalid small_vector:capacity");
+
+    a.push_back(1);
+    a.push_back(2);
+    a.push_back(3);
+    a.push_back(4);
+
+    check(a.is_inline(), "Invalid small_vector:is_inline");
+    check_equals(a.size(), 4, "Invalid small_vector:size");
+    check_equals(a[0], 1, "Invalid small_vector:[]");
+    check_equals(a[3], 4, "Invalid small_vector:[]");
+}
+
+void test_spill(){
+    std::small_vector<size_t, 2> a{1, 2};
+
+    check(a.is_inline(), "Invalid small_vector:is_inline");
+
+    for(size_t i = 3; i <= 100; ++i){
+        a.push_back(i);
+    }
+
+    check(!a.is_inline(), "Invalid small_vector:is_inline");
+    check_equals(a.size(), 100, "Invalid small_vector:size");
+
+    for(size_t i = 0; i < 100; ++i){
+        check_equals(a[i], i + 1, "Invalid small_vector:[]");
+    }
+}
+
+void test_copy_move(){
+    std::small_vector<std::string, 2> a;
+    a.push_back("one");
+    a.push_back("two");
+
+    std::small_vector<std::string, 2> b(a);
+    check(b == a, "Invalid small_vector:copy");
+
+    std::small_vector<std::string, 2> c(std::move(a));
+    check(c == b, "Invalid small_vector:move");
+    check(a.empty() && a.is_inline(), "Invalid small_vector:move");
+
+    b.push_back("three");
+
+    c = std::move(b);
+    check_equals(c.size(), 3, "Invalid small_vector:move");
+    check(!c.is_inline(), "Invalid small_vector:move");
+    check(c[2] == "three", "Invalid small_vector:move");
+    check(b.empty() && b.is_inline(), "Invalid small_vector:move");
+
+    a = c;
+    check(a == c, "Invalid small_vector:copy");
+}
+
+void test_modifiers(){
+    std::small_vector<std::string, 4> a;
+    a.push_back("b");
+    a.push_back("c");
+    a.push_front("a");
+
+    check_equals(a.size(), 3, "Invalid small_vector:push_front");
+    check(a[0] == "a" && a[1] == "b" && a[2] == "c", "Invalid small_vector:push_front");
+
+    a.erase(1);
+    check_equals(a.size(), 2, "Invalid small_vector:erase");
+    check(a[0] == "a" && a[1] == "c", "Invalid small_vector:erase");
+
+    a.pop_back();
+    check_equals(a.size(), 1, "Invalid small_vector:pop_back");
+    check(a.back() == "a", "Invalid small_vector:pop_back");
+
+    a.resize(8);
+    check_equals(a.size(), 8, "Invalid small_vector:resize");
+    check(!a.is_inline(), "Invalid small_vector:resize");
+
+    a.clear();
+    check(a.empty(), "Invalid small_vector:clear");
+}
+
+} //end of anonymous namespace
+
+void small_vector_tests(){
+    test_inline();
+    test_spill();
+    test_copy_move();
+    test_modifiers();
+}
@@ -10,6 +10,7 @@
 #include <cstdlib>
 
 #include <string.hpp>
+#include <string_view.hpp>
 
 #include "test.hpp"
 
@@ -394,6 +395,103 @@ void test_operators_long_to_short(){
     check(strcmp(last.c_str(), "asdf") == 0, "Invalid content");
 }
 
+void test_view(){
+    std::string s("asdf/qwer");
+    std::string_view view(s);
+
+    check_equals(view.size(), 9, "Invalid size");
+    check(view == s, "Invalid content");
+    check(view == "asdf/qwer", "Invalid content");
+
+    auto first = view.substr(0, 4);
+    auto second = view.substr(5);
+
+    check_equals(first.size(), 4, "Invalid size");
+    check_equals(second.size(), 4, "Invalid size");
+    check(first == "asdf", "Invalid content");
+    check(second == "qwer", "Invalid content");
+    check(first != second, "Invalid comparison");
+    check(view.substr(20).empty(), "Substring must be empty");
+
+    std::string copy = second;
+
+    check_equals(copy.size(), 4, "Invalid size");
+    check(strcmp(copy.c_str(), "qwer") == 0, "Invalid content");
+    check(copy == second, "Invalid comparison");
+}
+
+void test_view_find(){
+    std::string_view view("GET /index.html HTTP/1.1");
+
+    check_equals(view.find(' '), 3, "Invalid find");
+    check_equals(view.find(' ', 4), 15, "Invalid find");
+    check_equals(view.rfind(' '), 15, "Invalid rfind");
+    check_equals(view.rfind('G'), 0, "Invalid rfind");
+    check(view.find('#') == std::string_view::npos, "Invalid find");
+    check_equals(view.find("HTTP"), 16, "Invalid find");
+    check(view.find("HTTPS") == std::string_view::npos, "Invalid find");
+
+    check(view.starts_with("GET"), "Invalid starts_with");
+    check(view.ends_with("1.1"), "Invalid ends_with");
+    check(!view.starts_with("POST"), "Invalid starts_with");
+
+    check(std::string_view("abc").compare("abd") < 0, "Invalid compare");
+    check(std::string_view("abd").compare("abc") > 0, "Invalid compare");
+    check(std::string_view("ab").compare("abc") < 0, "Invalid compare");
+    check_equals(std::string_view("abc").compare("abc"), 0, "Invalid compare");
+
+    auto copy = view;
+    copy.remove_prefix(4);
+    copy.remove_suffix(9);
+
+    check(copy == "/index.html", "Invalid remove_prefix/remove_suffix");
+}
+
+void test_view_string(){
+    std::string s("asdf");
+    s += std::string_view("qwerasdfqwer", 4);
+    s.append("zxcvb", 2);
+
+    check_equals(s.size(), 10, "Invalid size");
+    check(strcmp(s.c_str(), "asdfqwerzx") == 0, "Invalid content");
+
+    check_equals(s.find("qwer"), 4, "Invalid find");
+    check(s.view(4, 4) == "qwer", "Invalid view");
+    check(s.view(8) == "zx", "Invalid view");
+
+    auto parts = std::split_view("1.22..333.", '.');
+
+    check_equals(parts.size(), 3, "Invalid size");
+    check(parts[0] == "1", "Invalid part");
+    check(parts[1] == "22", "Invalid part");
+    check(parts[2] == "333", "Invalid part");
+    check_equals(std::atoui(parts[2]), 333, "Invalid atoui");
+}
+
+void test_to_string(){
+    check(std::to_string(uint64_t(0)) == "0", "Invalid conversion");
+    check(std::to_string(uint64_t(7)) == "7", "Invalid conversion");
+    check(std::to_string(uint64_t(42)) == "42", "Invalid conversion");
+    check(std::to_string(uint64_t(100)) == "100", "Invalid conversion");
+    check(std::to_string(uint64_t(1234567)) == "1234567", "Invalid conversion");
+    check(std::to_string(uint64_t(18446744073709551615ULL)) == "18446744073709551615", "Invalid conversion");
+    check(std::to_string(int64_t(-9876)) == "-9876", "Invalid conversion");
+    check(std::to_string(int64_t(-9223372036854775807LL - 1)) == "-9223372036854775808", "Invalid conversion");
+
+    char buffer[24];
+
+    std::to_raw_string(uint64_t(9050), buffer, sizeof(buffer));
+    check(strcmp(buffer, "9050") == 0, "Invalid raw conversion");
+
+    std::to_raw_string(int64_t(-9223372036854775807LL - 1), buffer, sizeof(buffer));
+    check(strcmp(buffer, "-9223372036854775808") == 0, "Invalid raw conversion");
+
+    char hex[std::MAX_HEX_DIGITS];
+    auto end = hex + std::MAX_HEX_DIGITS;
+    auto begin = std::format_hex(0xBEEF0, end);
+    check(std::string(begin, end) == "BEEF0", "Invalid hex conversion");
+}
+
 } //end of anonymous namespace
 
 void string_tests(){
@@ -410,4 +508,8 @@ void string_tests(){
     test_operators_long();
     test_operators_short_to_long();
     test_operators_long_to_short();
+    test_view();
+    test_view_find();
+    test_view_string();
+    test_to_string();
 }
@@ -21,6 +21,10 @@ void traits_tests();
 void algorithms_tests();
 void circular_buffer_tests();
 void shared_ptr_tests();
+void object_pool_tests();
+void unordered_tests();
+void small_vector_tests();
+void rings_tests();
 
 int main(){
     string_tests();
@@ -34,6 +38,10 @@ int main(){
     shared_ptr_tests();
     list_tests();
     function_tests();
+    object_pool_tests();
+    unordered_tests();
+    small_vector_tests();
+    rings_tests();
 
     printf("All tests finished\n");
 
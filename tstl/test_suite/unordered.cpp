@@ -0,0 +1,152 @@
+//=======================================================================
+// Copyright Baptiste Wicht 2013-2016.
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://www.opensource.org/licenses/MIT)
+//=======================================================================
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include <unordered_map.hpp>
+#include <unordered_set.hpp>
+#include <string.hpp>
+
+#include "test.hpp"
+
+namespace {
+
+void test_map_base(){
+    std::unordered_map<size_t, size_t> map;
+
+    check(map.empty(), "Invalid unordered_map:empty");
+    check(map.find(3) == map.end(), "Invalid unordered_map:find");
+
+    check(map.insert({3, 33}).second, "Invalid unordered_map:insert");
+    check(!map.insert({3, 44}).second, "Invalid unordered_map:insert");
+
+    check_equals(map.size(), 1, "Invalid unordered_map:size");
+    check_equals(map.find(3)->second, 33, "Invalid unordered_map:find");
+
+    map[5] = 55;
+    map[5] += 1;
+
+    check_equals(map.size(), 2, "Invalid unordered_map:size");
+    check_equals(map[5], 56, "Invalid unordered_map:[]");
+    check_equals(map.count(5), 1, "Invalid unordered_map:count");
+    check_equals(map.count(6), 0, "Invalid unordered_map:count");
+
+    check_equals(map.erase(3), 1, "Invalid unordered_map:erase");
+    check_equals(map.erase(3), 0, "Invalid unordered_map:erase");
+    check(map.find(3) == map.end(), "Invalid unordered_map:erase");
+    check_equals(map.size(), 1, "Invalid unordered_map:size");
+}
+
+void test_map_grow(){
+    std::unordered_map<size_t, size_t> map;
+
+    for(size_t i = 0; i < 10000; ++i){
+        map[i * 16] = i;
+    }
+
+    check_equals(map.size(), 10000, "Invalid unordered_map:size");
+
+    for(size_t i = 0; i < 10000; ++i){
+        auto it = map.find(i * 16);
+
+        check(it != map.end() && it->second == i, "Invalid unordered_map:find");
+    }
+
+    size_t n = 0;
+    for(auto& value : map){
+        check(value.first == value.second * 16, "Invalid unordered_map:iterator");
+        ++n;
+    }
+
+    check_equals(n, 10000, "Invalid unordered_map:iterator");
+}
+
+void test_map_erase(){
+    std::unordered_map<size_t, size_t> map;
+
+    for(size_t i = 0; i < 1000; ++i){
+        map[i] = i;
+    }
+
+    // Erase one value out of two, the others must still be found after the shifts
+    for(size_t i = 0; i < 1000; i += 2){
+        check_equals(map.erase(i), 1, "Invalid unordered_map:erase");
+    }
+
+    check_equals(map.size(), 500, "Invalid unordered_map:size");
+
+    for(size_t i = 0; i < 1000; ++i){
+        check(map.count(i) == i % 2, "Invalid unordered_map:erase");
+    }
+
+    // Reuse the erased slots
+    for(size_t i = 0; i < 1000; i += 2){
+        map[i] = i;
+    }
+
+    check_equals(map.size(), 1000, "Invalid unordered_map:size");
+
+    for(auto it = map.begin(); it != map.end();){
+        it = map.erase(it);
+    }
+
+    check(map.empty(), "Invalid unordered_map:erase(iterator)");
+}
+
+void test_map_strings(){
+    std::unordered_map<std::string, size_t> map;
+
+    map["thor"] = 1;
+    map["os"] = 2;
+    map[std::string("kernel")] = 3;
+
+    check_equals(map["thor"], 1, "Invalid unordered_map<string>");
+    check_equals(map["os"], 2, "Invalid unordered_map<string>");
+    check_equals(map["kernel"], 3, "Invalid unordered_map<string>");
+    check(map.find("tstl") == map.end(), "Invalid unordered_map<string>");
+
+    auto copy = map;
+
+    map.clear();
+
+    check(map.empty(), "Invalid unordered_map:clear");
+    check_equals(copy.size(), 3, "Invalid unordered_map:copy");
+    check_equals(copy["kernel"], 3, "Invalid unordered_map:copy");
+
+    auto moved = std::move(copy);
+
+    check_equals(moved.size(), 3, "Invalid unordered_map:move");
+    check_equals(moved["os"], 2, "Invalid unordered_map:move");
+}
+
+void test_set(){
+    std::unordered_set<int> set;
+
+    check(set.insert(1), "Invalid unordered_set:insert");
+    check(set.insert(2), "Invalid unordered_set:insert");
+    check(!set.insert(1), "Invalid unordered_set:insert");
+
+    check_equals(set.size(), 2, "Invalid unordered_set:size");
+    check_equals(set.count(1), 1, "Invalid unordered_set:count");
+    check_equals(set.count(3), 0, "Invalid unordered_set:count");
+
+    check_equals(set.erase(1), 1, "Invalid unordered_set:erase");
+    check_equals(set.count(1), 0, "Invalid unordered_set:erase");
+    check(set.find(2) != set.end(), "Invalid unordered_set:find");
+}
+
+} //end of anonymous namespace
+
+void unordered_tests(){
+    test_map_base();
+    test_map_grow();
+    test_map_erase();
+    test_map_strings();
+    test_set();
+}